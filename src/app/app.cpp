@@ -14,6 +14,7 @@
 #include "app/app_mod.h"
 #include "app/check_update.h"
 #include "app/cli/app_options.h"
+#include "app/cli/batch_server.h"
 #include "app/cli/cli_processor.h"
 #include "app/cli/default_cli_delegate.h"
 #include "app/cli/preview_cli_delegate.h"
@@ -41,6 +42,7 @@
 #include "app/send_crash.h"
 #include "app/site.h"
 #include "app/tools/active_tool.h"
+#include "app/tools/pointer_recorder.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/backup_indicator.h"
 #include "app/ui/color_bar.h"
@@ -55,12 +57,14 @@
 #include "app/ui/workspace.h"
 #include "app/ui_context.h"
 #include "app/util/clipboard.h"
+#include "base/chrono.h"
 #include "base/exception.h"
 #include "base/fs.h"
 #include "base/platform.h"
 #include "base/replace_string.h"
 #include "base/split_string.h"
 #include "doc/sprite.h"
+#include "doc/trace.h"
 #include "fmt/format.h"
 #include "os/error.h"
 #include "os/surface.h"
@@ -118,6 +122,37 @@ private:
 
 #endif // ENABLER_SCRIPTING
 
+namespace {
+
+// Prints in stderr the time spent in each phase of App::initialize()
+// when --trace-startup is used.
+class StartupTrace {
+public:
+  StartupTrace(const bool enabled) : m_enabled(enabled) { }
+
+  void phase(const char* name) {
+    if (!m_enabled)
+      return;
+    const double t = m_chrono.elapsed();
+    std::cerr << fmt::format("startup: {:<24} {:8.2f} ms\n",
+                             name, 1000.0 * (t - m_last));
+    m_last = t;
+  }
+
+  void total() {
+    if (m_enabled)
+      std::cerr << fmt::format("startup: {:<24} {:8.2f} ms\n",
+                               "total", 1000.0 * m_chrono.elapsed());
+  }
+
+private:
+  bool m_enabled;
+  base::Chrono m_chrono;
+  double m_last = 0.0;
+};
+
+} // anonymous namespace
+
 class App::CoreModules {
 public:
   ConfigModule m_configModule;
@@ -139,8 +174,10 @@ public:
   Extensions m_extensions;
   // Load main language (after loading the extensions)
   LoadLanguage m_loadLanguage;
-  tools::ToolBox m_toolbox;
-  tools::ActiveToolManager m_activeToolManager;
+  // The tool box (and its gui.xml part) is loaded the first time it's
+  // needed (it's not used to process most CLI options).
+  std::unique_ptr<tools::ToolBox> m_toolbox;
+  std::unique_ptr<tools::ActiveToolManager> m_activeToolManager;
   Commands m_commands;
   RecentFiles m_recent_files;
   InputChain m_inputChain;
@@ -156,7 +193,6 @@ public:
           Preferences& pref)
     : m_loggerModule(createLogInDesktop)
     , m_loadLanguage(pref, m_extensions)
-    , m_activeToolManager(&m_toolbox)
     , m_recent_files(pref.general.recentItems())
 #ifdef ENABLE_DATA_RECOVERY
     , m_recovery(nullptr)
@@ -171,6 +207,19 @@ public:
 #endif
   }
 
+  tools::ToolBox* toolBox() {
+    if (!m_toolbox) {
+      m_toolbox = std::make_unique<tools::ToolBox>();
+      m_activeToolManager = std::make_unique<tools::ActiveToolManager>(m_toolbox.get());
+    }
+    return m_toolbox.get();
+  }
+
+  tools::ActiveToolManager* activeToolManager() {
+    toolBox();
+    return m_activeToolManager.get();
+  }
+
   app::crash::DataRecovery* recovery() {
 #ifdef ENABLE_DATA_RECOVERY
     return m_recovery.get();
@@ -251,8 +300,23 @@ App::App(AppMod* mod)
 
 int App::initialize(const AppOptions& options)
 {
+  StartupTrace trace(options.traceStartup());
   os::System* system = os::instance();
 
+  m_traceFilename = options.traceFilename();
+  if (!m_traceFilename.empty())
+    doc::trace_start();
+
+  const std::string recordStrokesFilename = options.recordStrokesFilename();
+  if (!recordStrokesFilename.empty()) {
+    m_pointerRecorder = std::make_unique<tools::PointerRecorder>(recordStrokesFilename);
+    if (!m_pointerRecorder->isValid()) {
+      LOG(ERROR, "APP: Cannot open file %s to record strokes\n",
+          recordStrokesFilename.c_str());
+      m_pointerRecorder.reset();
+    }
+  }
+
   m_isGui = options.startUI() && !options.previewCLI();
 
   // Notify the scripting engine that we're going to enter to GUI
@@ -265,7 +329,10 @@ int App::initialize(const AppOptions& options)
 #endif
 
   m_isShell = options.startShell();
+  if (options.startServer())
+    m_server = std::make_unique<BatchServer>(options.exeName());
   m_coreModules = std::make_unique<CoreModules>();
+  trace.phase("core modules");
 
   auto& pref = preferences();
 
@@ -320,6 +387,7 @@ int App::initialize(const AppOptions& options)
   }
 
   initialize_color_spaces(pref);
+  trace.phase("system/color spaces");
 
 #ifdef ENABLE_DRM
   LOG("APP: Initializing DRM...\n");
@@ -333,8 +401,9 @@ int App::initialize(const AppOptions& options)
 
   // Load modules
   m_modules = std::make_unique<Modules>(createLogInDesktop, pref);
+  trace.phase("modules/extensions");
   m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
-  m_brushes = std::make_unique<AppBrushes>();
+  trace.phase("legacy modules");
 
   // Data recovery is enabled only in GUI mode
   if (isGui() && pref.general.dataRecovery())
@@ -346,6 +415,7 @@ int App::initialize(const AppOptions& options)
   // Load or create the default palette, or migrate the default
   // palette from an old format palette to the new one, etc.
   load_default_palette();
+  trace.phase("default palette");
 
   // Initialize GUI interface
   if (isGui()) {
@@ -359,6 +429,7 @@ int App::initialize(const AppOptions& options)
     ui::set_use_native_cursors(pref.cursor.useNativeCursor());
     ui::set_mouse_cursor_scale(pref.cursor.cursorScale());
     ui::set_mouse_cursor(kArrowCursor);
+    ui::set_max_paint_rate(pref.experimental.maxPaintRate());
 
     auto manager = ui::Manager::getDefault();
     manager->invalidate();
@@ -398,10 +469,13 @@ int App::initialize(const AppOptions& options)
 #endif
   }
 
+  trace.phase("gui");
+
 #ifdef ENABLE_SCRIPTING
   // Call the init() function from all plugins
   LOG("APP: Initializing scripts...\n");
   extensions().executeInitActions();
+  trace.phase("scripts init");
 #endif
 
   // Process options
@@ -417,6 +491,8 @@ int App::initialize(const AppOptions& options)
     CliProcessor cli(delegate.get(), options);
     code = cli.process(context());
   }
+  trace.phase("cli options");
+  trace.total();
 
   LOG("APP: Finish launching...\n");
   system->finishLaunching();
@@ -574,6 +650,10 @@ void App::run()
   }
 #endif  // ENABLE_SCRIPTING
 
+  // Process batch jobs from the standard input (--server mode).
+  if (m_server)
+    m_server->run(context(), std::cin);
+
   // ----------------------------------------------------------------------
 
 #ifdef ENABLE_SCRIPTING
@@ -605,6 +685,12 @@ App::~App()
     LOG("APP: Exit\n");
     ASSERT(m_instance == this);
 
+    if (!m_traceFilename.empty()) {
+      doc::trace_stop();
+      if (!doc::trace_save_chrome_json(m_traceFilename))
+        LOG(ERROR, "APP: Cannot save trace file %s\n", m_traceFilename.c_str());
+    }
+
 #ifdef ENABLE_SCRIPTING
     // Destroy scripting engine calling a method (instead of using
     // reset()) because we need to keep the "m_engine" pointer valid
@@ -683,17 +769,17 @@ bool App::isPortable()
 tools::ToolBox* App::toolBox() const
 {
   ASSERT(m_modules != NULL);
-  return &m_modules->m_toolbox;
+  return m_modules->toolBox();
 }
 
 tools::Tool* App::activeTool() const
 {
-  return m_modules->m_activeToolManager.activeTool();
+  return m_modules->activeToolManager()->activeTool();
 }
 
 tools::ActiveToolManager* App::activeToolManager() const
 {
-  return &m_modules->m_activeToolManager;
+  return m_modules->activeToolManager();
 }
 
 RecentFiles* App::recentFiles() const
@@ -37,6 +37,7 @@ namespace app {
   class AppMod;
   class AppOptions;
   class BackupIndicator;
+  class BatchServer;
   class Context;
   class ContextBar;
   class Doc;
@@ -57,6 +58,7 @@ namespace app {
 
   namespace tools {
     class ActiveToolManager;
+    class PointerRecorder;
     class Tool;
     class ToolBox;
   }
@@ -89,6 +91,9 @@ namespace app {
     tools::ToolBox* toolBox() const;
     tools::Tool* activeTool() const;
     tools::ActiveToolManager* activeToolManager() const;
+    // Returns the recorder of strokes (--record-strokes option) or
+    // nullptr if the strokes aren't being recorded.
+    tools::PointerRecorder* pointerRecorder() const { return m_pointerRecorder.get(); }
     RecentFiles* recentFiles() const;
     MainWindow* mainWindow() const { return m_mainWindow.get(); }
     Workspace* workspace() const;
@@ -98,8 +103,10 @@ namespace app {
     Extensions& extensions() const;
     crash::DataRecovery* dataRecovery() const;
 
+    // Brushes are loaded the first time they are needed.
     AppBrushes& brushes() {
-      ASSERT(m_brushes.get());
+      if (!m_brushes)
+        m_brushes = std::make_unique<AppBrushes>();
       return *m_brushes;
     }
 
@@ -137,6 +144,10 @@ namespace app {
     std::unique_ptr<LegacyModules> m_legacy;
     bool m_isGui;
     bool m_isShell;
+    std::unique_ptr<BatchServer> m_server;
+    // File where the trace zones are saved at exit (--trace option)
+    std::string m_traceFilename;
+    std::unique_ptr<tools::PointerRecorder> m_pointerRecorder;
 #ifdef ENABLE_STEAM
     bool m_inAppSteam = true;
 #endif
@@ -0,0 +1,89 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/buffered_writer.h"
+
+#include <algorithm>
+#include <limits>
+#include <ostream>
+
+namespace app {
+
+BufferedWriter::BufferedWriter(std::ostream& os,
+                               const std::size_t bufferSize)
+  : m_os(os)
+  , m_buf(std::max<std::size_t>(bufferSize, 64))
+  , m_pos(0)
+{
+}
+
+BufferedWriter::~BufferedWriter()
+{
+  flush();
+}
+
+void BufferedWriter::flush()
+{
+  if (m_pos > 0) {
+    writeToStream(m_buf.data(), m_pos);
+    m_pos = 0;
+  }
+}
+
+void BufferedWriter::writeJsonString(const std::string& str)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  put('"');
+
+  const char* begin = str.c_str();
+  const char* end = begin + str.size();
+  const char* p = begin;
+  for (; p != end; ++p) {
+    const unsigned char chr = *p;
+    if (chr != '\\' && chr != '"' && chr >= 0x20)
+      continue;
+
+    // Write all the previous characters that don't need escaping
+    write(begin, p - begin);
+    begin = p+1;
+
+    switch (chr) {
+      case '\\': write("\\\\", 2); break;
+      case '"':  write("\\\"", 2); break;
+      case '\n': write("\\n", 2); break;
+      case '\r': write("\\r", 2); break;
+      case '\t': write("\\t", 2); break;
+      default: {
+        const char tmp[6] = { '\\', 'u', '0', '0', hex[chr >> 4], hex[chr & 15] };
+        write(tmp, 6);
+        break;
+      }
+    }
+  }
+  write(begin, p - begin);
+
+  put('"');
+}
+
+void BufferedWriter::writeString(const std::string& str)
+{
+  const std::size_t n =
+    std::min<std::size_t>(str.size(), std::numeric_limits<uint16_t>::max());
+  writeUint16(uint16_t(n));
+  write(str.c_str(), n);
+}
+
+void BufferedWriter::writeToStream(const char* data, const std::size_t n)
+{
+  m_os.write(data, std::streamsize(n));
+}
+
+} // namespace app
@@ -0,0 +1,106 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_BUFFERED_WRITER_H_INCLUDED
+#define APP_BUFFERED_WRITER_H_INCLUDED
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace app {
+
+  // Writes text/binary data to a std::ostream through a preallocated
+  // buffer. It's used to generate big data files (e.g. sprite sheet
+  // data files) without the std::ostream formatting overhead for each
+  // number/string.
+  //
+  // Binary values are written in little-endian byte order.
+  class BufferedWriter {
+  public:
+    explicit BufferedWriter(std::ostream& os,
+                            const std::size_t bufferSize = 64*1024);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    // Writes the whole buffer in the output stream.
+    void flush();
+
+    void write(const char* data, const std::size_t n) {
+      if (m_pos + n > m_buf.size()) {
+        flush();
+        if (n > m_buf.size()) {
+          writeToStream(data, n);
+          return;
+        }
+      }
+      std::memcpy(m_buf.data() + m_pos, data, n);
+      m_pos += n;
+    }
+
+    void put(const char chr) {
+      if (m_pos == m_buf.size())
+        flush();
+      m_buf[m_pos++] = chr;
+    }
+
+    // Text output
+    BufferedWriter& operator<<(const char chr) { put(chr); return *this; }
+    BufferedWriter& operator<<(const char* str) { write(str, std::strlen(str)); return *this; }
+    BufferedWriter& operator<<(const std::string& str) { write(str.c_str(), str.size()); return *this; }
+
+    template<typename T>
+    std::enable_if_t<std::is_integral_v<T> &&
+                     !std::is_same_v<T, bool> &&
+                     !std::is_same_v<T, char>, BufferedWriter&>
+    operator<<(const T value) {
+      char tmp[24];
+      auto res = std::to_chars(tmp, tmp+sizeof(tmp), value);
+      write(tmp, res.ptr - tmp);
+      return *this;
+    }
+
+    // Writes the string between quotes escaping backslashes, quotes,
+    // and control characters.
+    void writeJsonString(const std::string& str);
+
+    // Binary output
+    void writeUint8(const uint8_t value) { put(char(value)); }
+    void writeUint16(const uint16_t value) {
+      const char tmp[2] = { char(value & 0xff), char((value >> 8) & 0xff) };
+      write(tmp, 2);
+    }
+    void writeUint32(const uint32_t value) {
+      const char tmp[4] = { char(value & 0xff), char((value >> 8) & 0xff),
+                            char((value >> 16) & 0xff), char((value >> 24) & 0xff) };
+      write(tmp, 4);
+    }
+    void writeInt32(const int32_t value) { writeUint32(uint32_t(value)); }
+
+    // Writes the string length as an uint16 and then the UTF-8
+    // characters (without the null character). Longer strings are
+    // truncated.
+    void writeString(const std::string& str);
+
+  private:
+    void writeToStream(const char* data, const std::size_t n);
+
+    std::ostream& m_os;
+    std::vector<char> m_buf;
+    std::size_t m_pos;
+  };
+
+} // namespace app
+
+#endif
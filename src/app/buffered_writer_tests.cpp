@@ -0,0 +1,65 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/buffered_writer.h"
+
+#include <sstream>
+
+using namespace app;
+
+TEST(BufferedWriter, Text)
+{
+  std::stringstream s;
+  {
+    BufferedWriter w(s);
+    w << "{ \"x\": " << 32 << ", \"y\": " << -8 << ", \"name\": ";
+    w.writeJsonString("a\"b\\c\nd\x01");
+    w << ' ' << '}';
+  }
+  EXPECT_EQ("{ \"x\": 32, \"y\": -8, \"name\": \"a\\\"b\\\\c\\nd\\u0001\" }",
+            s.str());
+}
+
+TEST(BufferedWriter, SmallBuffer)
+{
+  std::stringstream s;
+  std::string expected;
+  {
+    BufferedWriter w(s, 64);
+    for (int i=0; i<100; ++i) {
+      w << i << ",";
+      expected += std::to_string(i) + ",";
+    }
+    const std::string big(200, 'x');
+    w << big;
+    expected += big;
+  }
+  EXPECT_EQ(expected, s.str());
+}
+
+TEST(BufferedWriter, Binary)
+{
+  std::stringstream s;
+  {
+    BufferedWriter w(s);
+    w.writeUint8(1);
+    w.writeUint16(0x0302);
+    w.writeUint32(0x07060504);
+    w.writeInt32(-1);
+    w.writeString("ab");
+  }
+  const std::string res = s.str();
+  ASSERT_EQ(15, res.size());
+  for (int i=0; i<7; ++i)
+    EXPECT_EQ(i+1, res[i]);
+  for (int i=7; i<11; ++i)
+    EXPECT_EQ(char(0xff), res[i]);
+  EXPECT_EQ(2, res[11]);
+  EXPECT_EQ(0, res[12]);
+  EXPECT_EQ("ab", res.substr(13));
+}
@@ -13,6 +13,7 @@
 
 #include "base/fs.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace app {
@@ -21,6 +22,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
   , m_previewCLI(false)
   , m_showHelp(false)
   , m_showVersion(false)
@@ -29,7 +31,9 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_server(m_po.add("server").description("Do not start the UI and process batch jobs\nfrom the standard input (one command line\nper job) in the same process"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
+  , m_jobs(m_po.add("jobs").requiresValue("<n>").description("Number of consecutive files to load at\nthe same time (in parallel)"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previously opened sprites"))
@@ -38,6 +42,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_colorMode(m_po.add("color-mode").requiresValue("<mode>").description("Change color mode of all previously\nopened sprites:\n  rgb\n  grayscale\n  indexed"))
   , m_shrinkTo(m_po.add("shrink-to").requiresValue("width,height").description("Shrink each sprite if it is\nlarger than width or height"))
   , m_data(m_po.add("data").requiresValue("<filename.json>").description("File to store the sprite sheet metadata"))
+  , m_dataBinary(m_po.add("data-binary").requiresValue("<filename.bin>").description("File to store the sprite sheet metadata\nin a compact binary format"))
   , m_format(m_po.add("format").requiresValue("<format>").description("Format to export the data file\n(json-hash, json-array)"))
   , m_sheet(m_po.add("sheet").requiresValue("<filename.png>").description("Image file to save the texture"))
   , m_sheetType(m_po.add("sheet-type").requiresValue("<type>").description("Algorithm to create the sprite sheet:\n  horizontal\n  vertical\n  rows\n  columns\n  packed"))
@@ -81,6 +86,9 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_exportTileset(m_po.add("export-tileset").description("Export only tilesets from visible tilemap layers"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_traceStartup(m_po.add("trace-startup").description("Print the time spent in each\ninitialization phase in stderr"))
+  , m_trace(m_po.add("trace").requiresValue("<filename>").description("Record trace zones (file load/save,\nrender, tools, filters, etc.) and save\nthem in a Chrome trace JSON file at exit"))
+  , m_recordStrokes(m_po.add("record-strokes").requiresValue("<filename>").description("Append the pointer events of each\nstroke done with the drawing tools\nto the given file"))
 #ifdef ENABLE_STEAM
   , m_noInApp(m_po.add("noinapp").description("Disable \"in game\" visibility on Steam\nDoesn't count playtime"))
 #endif
@@ -101,11 +109,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #ifdef ENABLE_SCRIPTING
     m_startShell = m_po.enabled(m_shell);
 #endif
+    m_startServer = m_po.enabled(m_server);
     m_previewCLI = m_po.enabled(m_preview);
     m_showHelp = m_po.enabled(m_help);
     m_showVersion = m_po.enabled(m_version);
 
     if (m_startShell ||
+        m_startServer ||
         m_showHelp ||
         m_showVersion ||
         m_po.enabled(m_batch)) {
@@ -119,13 +129,97 @@ AppOptions::AppOptions(int argc, const char* argv[])
   }
 }
 
+bool AppOptions::traceStartup() const
+{
+  return m_po.enabled(m_traceStartup);
+}
+
+std::string AppOptions::traceFilename() const
+{
+  return m_po.value_of(m_trace);
+}
+
+std::string AppOptions::recordStrokesFilename() const
+{
+  return m_po.value_of(m_recordStrokes);
+}
+
 bool AppOptions::hasExporterParams() const
 {
   return
     m_po.enabled(m_data) ||
+    m_po.enabled(m_dataBinary) ||
     m_po.enabled(m_sheet);
 }
 
+bool AppOptions::listsSpriteInfoOnly() const
+{
+  if (!m_po.enabled(m_batch))
+    return false;
+
+  bool list = false;
+  for (const auto& value : m_po.values()) {
+    const Option* opt = value.option();
+    if (!opt)                   // File name
+      continue;
+
+    if (opt == &m_listLayers ||
+        opt == &m_listLayerHierarchy ||
+        opt == &m_listTags ||
+        opt == &m_listSlices) {
+      list = true;
+    }
+    // Any other option could need the cels of the sprite
+    else if (opt != &m_batch &&
+             opt != &m_verbose &&
+             opt != &m_debug &&
+             opt != &m_traceStartup &&
+             opt != &m_trace &&
+             opt != &m_recordStrokes &&
+             opt != &m_jobs &&
+             opt != &m_allLayers &&
+             opt != &m_oneFrame) {
+      return false;
+    }
+  }
+  return list;
+}
+
+bool AppOptions::exportsSpriteSheetsOnly() const
+{
+  if (!m_po.enabled(m_batch) ||
+      !m_po.enabled(m_sheet))
+    return false;
+
+  // Options that use only the exported frames/layers of each file
+  const Option* exportOptions[] = {
+    &m_batch, &m_verbose, &m_debug, &m_traceStartup, &m_trace, &m_recordStrokes, &m_jobs,
+    &m_data, &m_dataBinary, &m_format, &m_sheet, &m_sheetType, &m_sheetPack,
+    &m_sheetWidth, &m_sheetHeight, &m_sheetColumns, &m_sheetRows,
+    &m_splitLayers, &m_splitTags, &m_splitSlices, &m_splitGrid,
+    &m_layer, &m_allLayers, &m_ignoreLayer, &m_tag, &m_playSubtags,
+    &m_frameRange, &m_ignoreEmpty, &m_mergeDuplicates,
+    &m_borderPadding, &m_shapePadding, &m_innerPadding,
+    &m_trim, &m_trimByGrid, &m_extrude, &m_slice,
+    &m_filenameFormat, &m_tagnameFormat,
+    &m_listLayers, &m_listLayerHierarchy, &m_listTags, &m_listSlices,
+    &m_oneFrame, &m_exportTileset
+  };
+
+  for (const auto& value : m_po.values()) {
+    const Option* opt = value.option();
+    if (!opt)                   // File name
+      continue;
+
+    // Any other option (e.g. --save-as, --script, --scale, etc.)
+    // could need all cels of the sprite
+    if (std::find(std::begin(exportOptions),
+                  std::end(exportOptions), opt) == std::end(exportOptions))
+      return false;
+  }
+  return true;
+}
+
 #ifdef ENABLE_STEAM
 bool AppOptions::noInApp() const
 {
@@ -36,6 +36,10 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
+  bool traceStartup() const;
+  std::string traceFilename() const;
+  std::string recordStrokesFilename() const;
   bool previewCLI() const { return m_previewCLI; }
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
@@ -45,6 +49,8 @@ public:
     return m_po.values();
   }
 
+  const Option& jobs() const { return m_jobs; }
+
   // Export options
   const Option& saveAs() const { return m_saveAs; }
   const Option& palette() const { return m_palette; }
@@ -54,6 +60,7 @@ public:
   const Option& colorMode() const { return m_colorMode; }
   const Option& shrinkTo() const { return m_shrinkTo; }
   const Option& data() const { return m_data; }
+  const Option& dataBinary() const { return m_dataBinary; }
   const Option& format() const { return m_format; }
   const Option& sheet() const { return m_sheet; }
   const Option& sheetType() const { return m_sheetType; }
@@ -97,6 +104,15 @@ public:
   const Option& exportTileset() const { return m_exportTileset; }
 
   bool hasExporterParams() const;
+
+  // Returns true if the options just list the layers/tags/slices of
+  // the given files in batch mode (so the cels are not needed).
+  bool listsSpriteInfoOnly() const;
+
+  // Returns true if the options just export sprite sheets in batch
+  // mode (so only the exported frames/layers of each file are
+  // needed).
+  bool exportsSpriteSheetsOnly() const;
 #ifdef ENABLE_STEAM
   bool noInApp() const;
 #endif
@@ -111,6 +127,7 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
   bool m_previewCLI;
   bool m_showHelp;
   bool m_showVersion;
@@ -120,7 +137,9 @@ private:
   Option& m_shell;
 #endif
   Option& m_batch;
+  Option& m_server;
   Option& m_preview;
+  Option& m_jobs;
   Option& m_saveAs;
   Option& m_palette;
   Option& m_scale;
@@ -129,6 +148,7 @@ private:
   Option& m_colorMode;
   Option& m_shrinkTo;
   Option& m_data;
+  Option& m_dataBinary;
   Option& m_format;
   Option& m_sheet;
   Option& m_sheetType;
@@ -173,6 +193,9 @@ private:
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_traceStartup;
+  Option& m_trace;
+  Option& m_recordStrokes;
 #ifdef ENABLE_STEAM
   Option& m_noInApp;
 #endif
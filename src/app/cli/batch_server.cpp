@@ -0,0 +1,139 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/batch_server.h"
+
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+#include "app/cli/preview_cli_delegate.h"
+#include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/ui_context.h"
+
+#include <iostream>
+#include <memory>
+
+namespace app {
+
+BatchServer::BatchServer(const std::string& exeName)
+  : m_exeName(exeName)
+{
+}
+
+void BatchServer::run(Context* ctx, std::istream& input)
+{
+  std::string line;
+  while (std::getline(input, line)) {
+    // Remove the CR character of Windows new lines
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+
+    if (line == "exit")
+      break;
+
+    const std::vector<std::string> args = SplitArgs(line);
+    if (args.empty() || args[0][0] == '#')
+      continue;
+
+    const int code = processJob(ctx, args);
+    closeAllDocs(ctx);
+
+    std::cout << "#END " << code << std::endl;
+  }
+}
+
+int BatchServer::processJob(Context* ctx, const std::vector<std::string>& args)
+{
+  std::vector<const char*> argv;
+  argv.reserve(args.size()+2);
+  argv.push_back(m_exeName.c_str());
+  argv.push_back("--batch");
+  for (const auto& arg : args)
+    argv.push_back(arg.c_str());
+
+  AppOptions options(int(argv.size()), argv.data());
+
+  std::unique_ptr<CliDelegate> delegate;
+  if (options.previewCLI())
+    delegate.reset(new PreviewCliDelegate);
+  else
+    delegate.reset(new DefaultCliDelegate);
+
+  try {
+    CliProcessor cli(delegate.get(), options);
+    return cli.process(ctx);
+  }
+  catch (const std::exception& ex) {
+    Console::showException(ex);
+    return -1;
+  }
+}
+
+void BatchServer::closeAllDocs(Context* ctx)
+{
+  std::vector<Doc*> docs;
+  if (auto* uiCtx = dynamic_cast<UIContext*>(ctx)) {
+    for (Doc* doc : uiCtx->getAndRemoveAllClosedDocs())
+      docs.push_back(doc);
+  }
+  for (Doc* doc : ctx->documents())
+    docs.push_back(doc);
+
+  for (Doc* doc : docs) {
+    doc->close();
+    delete doc;
+  }
+}
+
+// static
+std::vector<std::string> BatchServer::SplitArgs(const std::string& line)
+{
+  std::vector<std::string> args;
+  std::string arg;
+  bool inArg = false;
+  char quote = 0;
+
+  for (std::size_t i=0; i<line.size(); ++i) {
+    const char chr = line[i];
+
+    if (quote) {
+      if (chr == quote)
+        quote = 0;
+      else if (chr == '\\' && quote == '"' && i+1 < line.size() &&
+               (line[i+1] == '"' || line[i+1] == '\\'))
+        arg.push_back(line[++i]);
+      else
+        arg.push_back(chr);
+    }
+    else if (chr == '"' || chr == '\'') {
+      quote = chr;
+      inArg = true;
+    }
+    else if (chr == ' ' || chr == '\t') {
+      if (inArg) {
+        args.push_back(arg);
+        arg.clear();
+        inArg = false;
+      }
+    }
+    else {
+      arg.push_back(chr);
+      inArg = true;
+    }
+  }
+  if (inArg)
+    args.push_back(arg);
+
+  return args;
+}
+
+} // namespace app
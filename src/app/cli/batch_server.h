@@ -0,0 +1,51 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_BATCH_SERVER_H_INCLUDED
+#define APP_CLI_BATCH_SERVER_H_INCLUDED
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+
+  // Processes batch jobs from an input stream (--server mode) with
+  // the same initialized App (so the startup cost is paid only once).
+  //
+  // Each line of the input is one job: the same arguments that could
+  // be given to "aseprite -b" (batch mode is implied). The output of
+  // the job is printed in std::cout and finishes with a line
+  // "#END <code>" (where <code> is 0 if the job finished successfully).
+  // All documents opened by a job are closed when the job ends.
+  //
+  // Empty lines and lines starting with "#" are ignored, and the
+  // "exit" line (or the end of the input) finishes the server.
+  class BatchServer {
+  public:
+    BatchServer(const std::string& exeName);
+
+    void run(Context* ctx, std::istream& input);
+
+    // Splits the given command line in arguments (handling single and
+    // double quotes, and \" or \\ inside double quotes). Backslashes
+    // outside quotes are kept (e.g. for Windows paths). Public so it
+    // can be tested.
+    static std::vector<std::string> SplitArgs(const std::string& line);
+
+  private:
+    int processJob(Context* ctx, const std::vector<std::string>& args);
+    void closeAllDocs(Context* ctx);
+
+    std::string m_exeName;
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,27 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/cli/batch_server.h"
+
+using namespace app;
+
+using Args = std::vector<std::string>;
+
+TEST(BatchServer, SplitArgs)
+{
+  EXPECT_EQ(Args(), BatchServer::SplitArgs(""));
+  EXPECT_EQ(Args(), BatchServer::SplitArgs("  \t "));
+  EXPECT_EQ(Args({ "a.png", "--save-as", "b.png" }),
+            BatchServer::SplitArgs("a.png  --save-as\tb.png "));
+  EXPECT_EQ(Args({ "--script-param", "name=a b", "c d.ase", "" }),
+            BatchServer::SplitArgs("--script-param name=\"a b\" 'c d.ase' \"\""));
+  EXPECT_EQ(Args({ "say \"hi\"", "back\\slash" }),
+            BatchServer::SplitArgs("\"say \\\"hi\\\"\" \"back\\\\slash\""));
+  EXPECT_EQ(Args({ "C:\\dir\\file.ase", "C:\\dir\\out.png" }),
+            BatchServer::SplitArgs("C:\\dir\\file.ase \"C:\\dir\\out.png\""));
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -35,4 +35,27 @@ FileOpROI CliOpenFile::roi() const
                    true);
 }
 
+FileOpLoadROI CliOpenFile::loadROI() const
+{
+  FileOpLoadROI roi;
+  roi.tagName = tag;
+  if (hasFrameRange()) {
+    roi.fromFrame = fromFrame;
+    roi.toFrame = toFrame;
+  }
+
+  // Filters with wildcards are resolved with all the layers of the
+  // loaded sprite (see CliProcessor::FilterLayers()), so in that
+  // case we load all layers. Excluded layers are loaded too (they
+  // can only hide included layers).
+  roi.layers = includeLayers;
+  for (const auto& filter : includeLayers) {
+    if (filter.find('*') != std::string::npos) {
+      roi.layers.clear();
+      break;
+    }
+  }
+  return roi;
+}
+
 } // namespace app
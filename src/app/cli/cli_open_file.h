@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_CLI_CLI_OPEN_FILE_H_INCLUDED
 #pragma once
 
+#include "app/file/file_op_load_roi.h"
 #include "doc/frame.h"
 #include "gfx/rect.h"
 
@@ -44,6 +45,8 @@ namespace app {
     bool trim = false;
     bool trimByGrid = false;
     bool oneFrame = false;
+    bool metadataOnly = false;
+    bool loadSubset = false;
     bool exportTileset = false;
     bool playSubtags = false;
     gfx::Rect crop;
@@ -66,6 +69,10 @@ namespace app {
     }
 
     FileOpROI roi() const;
+
+    // Frames/layers of the file that are needed to export it (used
+    // when "loadSubset" is true).
+    FileOpLoadROI loadROI() const;
   };
 
 } // namespace app
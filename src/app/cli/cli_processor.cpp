@@ -37,6 +37,7 @@
 #include "render/dithering_algorithm.h"
 
 #include <algorithm>
+#include <iterator>
 #include <queue>
 #include <vector>
 
@@ -192,16 +193,38 @@ int CliProcessor::process(Context* ctx)
     render::DitheringAlgorithm ditheringAlgorithm = render::DitheringAlgorithm::None;
     std::string ditheringMatrix;
 
-    for (const auto& value : m_options.values()) {
+    // If we are only listing layers/tags/slices, we don't need to
+    // decompress the cels of the files
+    cof.metadataOnly = m_options.listsSpriteInfoOnly();
+
+    // If we are only exporting sprite sheets, we can load just the
+    // exported frames/layers of each file
+    cof.loadSubset = m_options.exportsSpriteSheetsOnly();
+
+    // Number of consecutive files to load at the same time
+    int jobs = 1;
+
+    const auto& values = m_options.values();
+    for (auto it=values.begin(), end=values.end(); it!=end; ++it) {
+      const auto& value = *it;
       const AppOptions::Option* opt = value.option();
 
       // Special options/commands
       if (opt) {
+        // --jobs <n>
+        if (opt == &m_options.jobs()) {
+          jobs = std::max(1, int(strtol(value.value().c_str(), nullptr, 0)));
+        }
         // --data <file.json>
-        if (opt == &m_options.data()) {
+        else if (opt == &m_options.data()) {
           if (m_exporter)
             m_exporter->setDataFilename(value.value());
         }
+        // --data-binary <file.bin>
+        else if (opt == &m_options.dataBinary()) {
+          if (m_exporter)
+            m_exporter->setBinaryDataFilename(value.value());
+        }
         // --format <format>
         else if (opt == &m_options.format()) {
           if (m_exporter) {
@@ -608,6 +631,24 @@ int CliProcessor::process(Context* ctx)
         }
       }
       // File names aren't associated to any option
+      else if (jobs > 1) {
+        // Load all the consecutive file names at the same time (the
+        // same options are used for all of them)
+        base::paths filenames;
+        auto next = it;
+        for (; next != end && !next->option(); ++next) {
+          auto fn = base::normalize_path(next->value());
+          if (m_usedFiles.find(fn) == m_usedFiles.end() &&
+              std::find(filenames.begin(), filenames.end(), fn) == filenames.end())
+            filenames.push_back(fn);
+        }
+        it = std::prev(next);
+
+        if (!filenames.empty() &&
+            openFiles(ctx, cof, filenames, jobs)) {
+          lastDoc = cof.document;
+        }
+      }
       else {
         cof.document = nullptr;
         cof.filename = base::normalize_path(value.value());
@@ -654,16 +695,10 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   m_batch.open(ctx,
                cof.filename,
-               cof.oneFrame);
-
-  // Mark used file names as "already processed" so we don't try to
-  // open then again
-  for (const auto& usedFn : m_batch.usedFiles()) {
-    auto fn = base::normalize_path(usedFn);
-    m_usedFiles.insert(fn);
-
-    os::instance()->markCliFileAsProcessed(fn);
-  }
+               cof.oneFrame,
+               cof.metadataOnly,
+               (cof.loadSubset ? cof.loadROI(): FileOpLoadROI()));
+  markUsedFiles();
 
   Doc* doc = ctx->activeDocument();
   // If the active document is equal to the previous one, it
@@ -673,58 +708,113 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 
   cof.document = doc;
 
-  if (doc) {
-    // Show all layers
-    if (cof.allLayers) {
-      for (doc::Layer* layer : doc->sprite()->allLayers())
-        layer->setVisible(true);
+  if (doc)
+    addOpenedDoc(cof);
+
+  m_delegate->afterOpenFile(cof);
+
+  return (doc ? true: false);
+}
+
+bool CliProcessor::openFiles(Context* ctx,
+                             CliOpenFile& cof,
+                             const base::paths& filenames,
+                             const int jobs)
+{
+  m_batch.open(ctx,
+               filenames,
+               jobs,
+               cof.oneFrame,
+               cof.metadataOnly,
+               (cof.loadSubset ? cof.loadROI(): FileOpLoadROI()));
+  markUsedFiles();
+
+  // Process the loaded files in the given order (so the output is the
+  // same as loading the files one by one)
+  Doc* lastDoc = nullptr;
+  for (const auto& openedFile : m_batch.openedFiles()) {
+    CliOpenFile fileCof = cof;
+    fileCof.filename = base::normalize_path(openedFile.filename);
+    fileCof.document = openedFile.document;
+
+    m_delegate->beforeOpenFile(fileCof);
+    if (fileCof.document) {
+      addOpenedDoc(fileCof);
+      lastDoc = fileCof.document;
+      cof.filename = fileCof.filename;
     }
+    m_delegate->afterOpenFile(fileCof);
+  }
 
-    // Add document to exporter
-    if (m_exporter) {
-      Tag* tag = nullptr;
-      SelectedFrames selFrames;
+  if (lastDoc)
+    ctx->setActiveDocument(lastDoc);
 
-      if (cof.hasTag()) {
-        tag = doc->sprite()->tags().getByName(cof.tag);
-      }
-      if (cof.hasFrameRange()) {
-        // --frame-range with --frame-tag
-        if (tag) {
-          selFrames.insert(
-            tag->fromFrame()+std::clamp(cof.fromFrame, 0, tag->frames()-1),
-            tag->fromFrame()+std::clamp(cof.toFrame, 0, tag->frames()-1));
-        }
-        // --frame-range without --frame-tag
-        else {
-          selFrames.insert(cof.fromFrame, cof.toFrame);
-        }
-      }
+  cof.document = lastDoc;
+  return (lastDoc ? true: false);
+}
 
-      SelectedLayers filteredLayers;
-      if (cof.hasLayersFilter())
-        filterLayers(doc->sprite(), cof, filteredLayers);
+void CliProcessor::markUsedFiles()
+{
+  // Mark used file names as "already processed" so we don't try to
+  // open then again
+  for (const auto& usedFn : m_batch.usedFiles()) {
+    auto fn = base::normalize_path(usedFn);
+    m_usedFiles.insert(fn);
+
+    os::instance()->markCliFileAsProcessed(fn);
+  }
+}
 
-      if (cof.exportTileset) {
-        m_exporter->addTilesetsSamples(
-          doc,
-          (cof.hasLayersFilter() ? &filteredLayers: nullptr));
+void CliProcessor::addOpenedDoc(const CliOpenFile& cof)
+{
+  Doc* doc = cof.document;
+  ASSERT(doc);
+  // Show all layers
+  if (cof.allLayers) {
+    for (doc::Layer* layer : doc->sprite()->allLayers())
+      layer->setVisible(true);
+  }
+
+  // Add document to exporter
+  if (m_exporter) {
+    Tag* tag = nullptr;
+    SelectedFrames selFrames;
+
+    if (cof.hasTag()) {
+      tag = doc->sprite()->tags().getByName(cof.tag);
+    }
+    if (cof.hasFrameRange()) {
+      // --frame-range with --frame-tag
+      if (tag) {
+        selFrames.insert(
+          tag->fromFrame()+std::clamp(cof.fromFrame, 0, tag->frames()-1),
+          tag->fromFrame()+std::clamp(cof.toFrame, 0, tag->frames()-1));
       }
+      // --frame-range without --frame-tag
       else {
-        m_exporter->addDocumentSamples(
-          doc, tag,
-          cof.splitLayers,
-          cof.splitTags,
-          cof.splitGrid,
-          (cof.hasLayersFilter() ? &filteredLayers: nullptr),
-          (!selFrames.empty() ? &selFrames: nullptr));
+        selFrames.insert(cof.fromFrame, cof.toFrame);
       }
     }
-  }
 
-  m_delegate->afterOpenFile(cof);
+    SelectedLayers filteredLayers;
+    if (cof.hasLayersFilter())
+      filterLayers(doc->sprite(), cof, filteredLayers);
 
-  return (doc ? true: false);
+    if (cof.exportTileset) {
+      m_exporter->addTilesetsSamples(
+        doc,
+        (cof.hasLayersFilter() ? &filteredLayers: nullptr));
+    }
+    else {
+      m_exporter->addDocumentSamples(
+        doc, tag,
+        cof.splitLayers,
+        cof.splitTags,
+        cof.splitGrid,
+        (cof.hasLayersFilter() ? &filteredLayers: nullptr),
+        (!selFrames.empty() ? &selFrames: nullptr));
+    }
+  }
 }
 
 void CliProcessor::saveFile(Context* ctx, const CliOpenFile& cof)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "app/cli/cli_open_file.h"
 #include "app/doc_exporter.h"
 #include "app/util/open_batch.h"
+#include "base/paths.h"
 #include "doc/selected_layers.h"
 
 #include <memory>
@@ -45,6 +46,12 @@ namespace app {
 
   private:
     bool openFile(Context* ctx, CliOpenFile& cof);
+    bool openFiles(Context* ctx,
+                   CliOpenFile& cof,
+                   const base::paths& filenames,
+                   const int jobs);
+    void markUsedFiles();
+    void addOpenedDoc(const CliOpenFile& cof);
     void saveFile(Context* ctx, const CliOpenFile& cof);
 
     void filterLayers(const doc::Sprite* sprite,
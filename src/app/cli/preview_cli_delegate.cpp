@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -215,6 +215,11 @@ void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
                 << exporter.filenameFormat() << "'\n";
     }
   }
+
+  if (!exporter.binaryDataFilename().empty()) {
+    std::cout << "  - Save binary data file: '"
+              << exporter.binaryDataFilename() << "'\n";
+  }
 }
 
 #ifdef ENABLE_SCRIPTING
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,9 +9,18 @@
 #endif
 
 #include "app/closed_docs.h"
+#include "app/crash/read_document.h"
+#include "app/crash/write_document.h"
 #include "app/doc.h"
 #include "app/pref/preferences.h"
+#include "base/convert_to.h"
+#include "base/fs.h"
+#include "base/log.h"
+#include "base/process.h"
 #include "base/thread.h"
+#include "doc/cancel_io.h"
+#include "doc/image_buffer_pool.h"
+#include "ver/info.h"
 
 #include <algorithm>
 #include <limits>
@@ -20,8 +29,24 @@
 
 namespace app {
 
+namespace {
+
+class CancelSaving : public doc::CancelIO {
+public:
+  CancelSaving(const std::atomic<bool>& done,
+               const std::atomic<bool>& cancel)
+    : m_done(done), m_cancel(cancel) { }
+  bool isCanceled() override { return m_done || m_cancel; }
+private:
+  const std::atomic<bool>& m_done;
+  const std::atomic<bool>& m_cancel;
+};
+
+}
+
 ClosedDocs::ClosedDocs(const Preferences& pref)
   : m_done(false)
+  , m_cancelSaving(false)
 {
   if (pref.general.dataRecovery())
     m_dataRecoveryPeriodMSecs = int(1000.0*60.0*pref.general.dataRecoveryPeriod());
@@ -87,15 +112,21 @@ void ClosedDocs::addClosedDoc(Doc* doc)
 
 Doc* ClosedDocs::reopenLastClosedDoc()
 {
-  Doc* doc = nullptr;
+  ClosedDoc closedDoc = { nullptr, 0 };
   {
     std::unique_lock<std::mutex> lock(m_mutex);
+    waitSavingDoc(lock);
     if (!m_docs.empty()) {
-      doc = m_docs.front().doc;
+      closedDoc = m_docs.front();
       m_docs.erase(m_docs.begin());
     }
-    CLOSEDOC_TRACE(" -> ", doc);
+    CLOSEDOC_TRACE(" -> ", closedDoc.doc, closedDoc.dir);
   }
+
+  Doc* doc = closedDoc.doc;
+  if (!doc && !closedDoc.dir.empty())
+    doc = readClosedDoc(closedDoc);
+
   CLOSEDOC_TRACE("CLOSEDOC: Reopen last closed doc", doc);
   return doc;
 }
@@ -106,10 +137,15 @@ std::vector<Doc*> ClosedDocs::getAndRemoveAllClosedDocs()
   {
     std::unique_lock<std::mutex> lock(m_mutex);
     CLOSEDOC_TRACE("CLOSEDOC: Get and remove all closed", m_docs.size(), "docs");
-    for (const ClosedDoc& closedDoc : m_docs)
-      docs.push_back(closedDoc.doc);
-    m_docs.clear();
     m_done = true;
+    waitSavingDoc(lock);
+    for (const ClosedDoc& closedDoc : m_docs) {
+      if (closedDoc.doc)
+        docs.push_back(closedDoc.doc);
+      else
+        deleteClosedDocDir(closedDoc.dir);
+    }
+    m_docs.clear();
     m_cv.notify_one();
   }
   return docs;
@@ -125,23 +161,36 @@ void ClosedDocs::backgroundThread()
   while (!m_done) {
     base::tick_t now = base::current_tick();
     base::tick_t waitForMSecs = std::numeric_limits<base::tick_t>::max();
+    Doc* docToSave = nullptr;
 
     for (auto it=m_docs.begin(); it != m_docs.end(); ) {
       const ClosedDoc& closedDoc = *it;
       auto doc = closedDoc.doc;
 
+      // The document cannot be deleted from memory until the
+      // BackupObserver doesn't need it anymore.
+      const bool canDelete =
+        (// If the document is not in memory
+         !doc ||
+         // If we backup process is disabled
+         m_dataRecoveryPeriodMSecs == 0 ||
+         // Or this document doesn't need a backup (e.g. an unmodified document)
+         !doc->needsBackup() ||
+         // Or the document already has the backup done
+         doc->isFullyBackedUp());
+
       base::tick_t diff = now - closedDoc.timestamp;
       if (diff >= m_keepClosedDocAliveForMSecs) {
-        if (// If we backup process is disabled
-            m_dataRecoveryPeriodMSecs == 0 ||
-            // Or this document doesn't need a backup (e.g. an unmodified document)
-            !doc->needsBackup() ||
-            // Or the document already has the backup done
-            doc->isFullyBackedUp()) {
+        if (canDelete) {
           // Finally delete the document (this is the place where we
           // delete all documents created/loaded by the user)
-          CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete doc", doc);
-          delete doc;
+          CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete doc", doc, closedDoc.dir);
+          if (doc) {
+            delete doc;
+            doc::image_buffer_pool_trim();
+          }
+          else
+            deleteClosedDocDir(closedDoc.dir);
           it = m_docs.erase(it);
         }
         else {
@@ -150,11 +199,27 @@ void ClosedDocs::backgroundThread()
         }
       }
       else {
+        // Save the document in a directory to free its memory
+        if (doc && closedDoc.canBeSaved) {
+          if (canDelete) {
+            if (!docToSave)
+              docToSave = doc;
+          }
+          else
+            waitForMSecs = std::min(waitForMSecs, m_dataRecoveryPeriodMSecs);
+        }
         waitForMSecs = std::min(waitForMSecs, m_keepClosedDocAliveForMSecs-diff);
         ++it;
       }
     }
 
+    if (docToSave) {
+      saveClosedDoc(docToSave, lock);
+      // Check the list of docs again (it could be modified while the
+      // doc was being saved)
+      continue;
+    }
+
     if (waitForMSecs < std::numeric_limits<base::tick_t>::max()) {
       CLOSEDOC_TRACE("CLOSEDOC: [BG] Wait for", waitForMSecs, "milliseconds");
 
@@ -172,4 +237,108 @@ void ClosedDocs::backgroundThread()
   CLOSEDOC_TRACE("CLOSEDOC: [BG] Background thread end");
 }
 
+// Executed from the backgroundThread() with the mutex locked
+void ClosedDocs::saveClosedDoc(Doc* doc, std::unique_lock<std::mutex>& lock)
+{
+  static int counter = 0;
+
+  const std::string dir = base::join_path(
+    base::join_path(base::get_temp_path(), get_app_name()),
+    "closed-" + base::convert_to<std::string>(int(base::get_current_process_id())) +
+    "-" + base::convert_to<std::string>(++counter));
+  const bool modified = doc->isModified();
+  const bool associatedToFile = doc->isAssociatedToFile();
+
+  CLOSEDOC_TRACE("CLOSEDOC: [BG] Save doc", doc, dir);
+
+  m_savingDoc = doc;
+  lock.unlock();
+
+  bool saved = false;
+  try {
+    base::make_all_directories(dir);
+
+    CancelSaving cancel(m_done, m_cancelSaving);
+    saved = crash::DocSnapshot::saveFullDocument(dir, doc, &cancel);
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLOSEDOC: Error saving closed document: %s\n", ex.what());
+  }
+  if (!saved)
+    deleteClosedDocDir(dir);
+
+  lock.lock();
+  m_savingDoc = nullptr;
+
+  auto it = std::find_if(m_docs.begin(), m_docs.end(),
+                         [doc](const ClosedDoc& closedDoc){
+                           return closedDoc.doc == doc;
+                         });
+  ASSERT(it != m_docs.end());
+  if (it != m_docs.end()) {
+    if (saved) {
+      CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete saved doc", doc);
+      it->doc = nullptr;
+      it->dir = dir;
+      it->modified = modified;
+      it->associatedToFile = associatedToFile;
+      delete doc;
+
+      // Release the memory of the saved doc images
+      doc::image_buffer_pool_trim();
+    }
+    // If it wasn't canceled, we cannot save this doc
+    else if (!m_cancelSaving && !m_done) {
+      it->canBeSaved = false;
+    }
+  }
+  m_savingCv.notify_all();
+}
+
+void ClosedDocs::waitSavingDoc(std::unique_lock<std::mutex>& lock)
+{
+  if (!m_savingDoc)
+    return;
+
+  m_cancelSaving = true;
+  m_savingCv.wait(lock, [this]{ return m_savingDoc == nullptr; });
+  m_cancelSaving = false;
+}
+
+// static
+Doc* ClosedDocs::readClosedDoc(const ClosedDoc& closedDoc)
+{
+  Doc* doc = nullptr;
+  try {
+    doc = crash::read_document(closedDoc.dir, nullptr);
+    if (doc && !closedDoc.modified && closedDoc.associatedToFile)
+      doc->markAsSaved();
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLOSEDOC: Error reading closed document: %s\n", ex.what());
+  }
+  deleteClosedDocDir(closedDoc.dir);
+  return doc;
+}
+
+// static
+void ClosedDocs::deleteClosedDocDir(const std::string& dir)
+{
+  try {
+    if (!base::is_directory(dir))
+      return;
+
+    for (const auto& item : base::list_files(dir)) {
+      const std::string fn = base::join_path(dir, item);
+      if (base::is_file(fn))
+        base::delete_file(fn);
+    }
+    base::remove_directory(dir);
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLOSEDOC: Error deleting directory %s: %s\n",
+        dir.c_str(), ex.what());
+  }
+}
+
 } // namespace app
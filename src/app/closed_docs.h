@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,6 +13,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -29,6 +30,10 @@ namespace app {
   //   garbage collector).
   // * If the document was not restore, we delete it from memory, if
   //   the document was restore, we remove it from the m_docs.
+  // * In the meantime, the background thread saves each closed doc in
+  //   a temporary directory (using the compressed format of the data
+  //   recovery backups) and deletes it from memory. Reopening the doc
+  //   reads it from that directory (without the undo history).
   class ClosedDocs {
   public:
     ClosedDocs(const Preferences& pref);
@@ -43,13 +48,24 @@ namespace app {
     std::vector<Doc*> getAndRemoveAllClosedDocs();
 
   private:
-    void backgroundThread();
-
     struct ClosedDoc {
+      // The document in memory, or nullptr if it was saved in "dir"
       Doc* doc;
       base::tick_t timestamp;
+      std::string dir;
+      // State of the document when it was saved in "dir"
+      bool modified = false;
+      bool associatedToFile = false;
+      // False if the document couldn't be saved in a directory
+      bool canBeSaved = true;
     };
 
+    void backgroundThread();
+    void saveClosedDoc(Doc* doc, std::unique_lock<std::mutex>& lock);
+    void waitSavingDoc(std::unique_lock<std::mutex>& lock);
+    static Doc* readClosedDoc(const ClosedDoc& closedDoc);
+    static void deleteClosedDocDir(const std::string& dir);
+
     std::atomic<bool> m_done;
     base::tick_t m_dataRecoveryPeriodMSecs;
     base::tick_t m_keepClosedDocAliveForMSecs;
@@ -57,6 +73,13 @@ namespace app {
     std::mutex m_mutex;
     std::condition_variable m_cv;
     std::thread m_thread;
+
+    // Document being saved by saveClosedDoc() (the mutex is unlocked
+    // while the document is saved, so other threads must wait until
+    // it's done or canceled to access it, see waitSavingDoc())
+    Doc* m_savingDoc = nullptr;
+    std::atomic<bool> m_cancelSaving;
+    std::condition_variable m_savingCv;
   };
 
 } // namespace app
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -51,6 +52,8 @@ void Cmd::undo()
 
   onUndo();
   onFireNotifications();
+  m_compressed = false;
+  m_spilled = false;
 
 #if _DEBUG
   m_state = State::Undone;
@@ -64,6 +67,8 @@ void Cmd::redo()
 
   onRedo();
   onFireNotifications();
+  m_compressed = false;
+  m_spilled = false;
 
 #if _DEBUG
   m_state = State::Redone;
@@ -89,6 +94,30 @@ size_t Cmd::memSize() const
   return onMemSize();
 }
 
+void Cmd::compress()
+{
+  if (m_compressed)
+    return;
+
+  CMD_TRACE("CMD: Compressing '%s'\n", typeid(*this).name());
+
+  onCompress();
+  m_compressed = true;
+}
+
+void Cmd::spill(UndoSpillFile* file)
+{
+  if (m_spilled)
+    return;
+
+  compress();
+
+  CMD_TRACE("CMD: Spilling '%s'\n", typeid(*this).name());
+
+  onSpill(file);
+  m_spilled = true;
+}
+
 void Cmd::onExecute()
 {
   // Do nothing
@@ -119,4 +148,14 @@ size_t Cmd::onMemSize() const {
   return sizeof(*this);
 }
 
+void Cmd::onCompress()
+{
+  // Do nothing
+}
+
+void Cmd::onSpill(UndoSpillFile* file)
+{
+  // Do nothing
+}
+
 } // namespace app
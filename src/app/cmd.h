@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +17,7 @@
 namespace app {
 
   class Context;
+  class UndoSpillFile;
 
   class Cmd : public undo::UndoCommand {
   public:
@@ -32,6 +34,18 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Compresses the undo information of this command to save memory
+    // (used for old undo states). The information is uncompressed
+    // automatically when it's needed again in undo()/redo().
+    void compress();
+    bool isCompressed() const { return m_compressed; }
+
+    // Compresses and moves the undo information to the given file
+    // (used when the undo history is too big). It's read back from
+    // the file automatically in undo()/redo().
+    void spill(UndoSpillFile* file);
+    bool isSpilled() const { return m_spilled; }
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,9 +55,13 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onCompress();
+    virtual void onSpill(UndoSpillFile* file);
 
   private:
     Context* m_ctx;
+    bool m_compressed = false;
+    bool m_spilled = false;
 #if _DEBUG
     enum class State { NotExecuted, Executed, Undone, Redone };
     State m_state;
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,11 +24,13 @@ namespace cmd {
 
 using namespace doc;
 
-AddFrame::AddFrame(Sprite* sprite, frame_t newFrame)
+AddFrame::AddFrame(Sprite* sprite, frame_t newFrame, frame_t count)
   : WithSprite(sprite)
   , m_newFrame(newFrame)
-  , m_addCel(nullptr)
+  , m_count(count)
+  , m_firstTime(true)
 {
+  ASSERT(count > 0);
 }
 
 void AddFrame::onExecute()
@@ -35,28 +38,34 @@ void AddFrame::onExecute()
   Sprite* sprite = this->sprite();
   auto doc = static_cast<Doc*>(sprite->document());
 
-  sprite->addFrame(m_newFrame);
+  sprite->addFrames(m_newFrame, m_count);
   sprite->incrementVersion();
 
-  if (m_addCel) {
-    m_addCel->redo();
+  if (!m_firstTime) {
+    m_addCels.redo();
   }
   else {
+    m_firstTime = false;
+
     LayerImage* bglayer = sprite->backgroundLayer();
     if (bglayer) {
-      ImageRef bgimage(Image::create(sprite->pixelFormat(), sprite->width(), sprite->height()));
-      clear_image(bgimage.get(), doc->bgColor(bglayer));
-      Cel* cel = new Cel(m_newFrame, bgimage);
-      m_addCel.reset(new cmd::AddCel(bglayer, cel));
-      m_addCel->execute(context());
+      const color_t bgColor = doc->bgColor(bglayer);
+      for (frame_t i=0; i<m_count; ++i) {
+        ImageRef bgimage(Image::create(sprite->pixelFormat(), sprite->width(), sprite->height()));
+        clear_image(bgimage.get(), bgColor);
+        Cel* cel = new Cel(m_newFrame+i, bgimage);
+        m_addCels.addAndExecute(context(), new cmd::AddCel(bglayer, cel));
+      }
     }
   }
 
-  // Notify observers about the new frame.
+  // Notify observers about the new frames.
   DocEvent ev(doc);
   ev.sprite(sprite);
-  ev.frame(m_newFrame);
-  doc->notify_observers<DocEvent&>(&DocObserver::onAddFrame, ev);
+  for (frame_t i=0; i<m_count; ++i) {
+    ev.frame(m_newFrame+i);
+    doc->notify_observers<DocEvent&>(&DocObserver::onAddFrame, ev);
+  }
 }
 
 void AddFrame::onUndo()
@@ -64,17 +73,17 @@ void AddFrame::onUndo()
   Sprite* sprite = this->sprite();
   auto doc = static_cast<Doc*>(sprite->document());
 
-  if (m_addCel)
-    m_addCel->undo();
+  m_addCels.undo();
 
-  sprite->removeFrame(m_newFrame);
+  sprite->removeFrames(m_newFrame, m_count);
   sprite->incrementVersion();
 
-  // Notify observers about the new frame.
+  // Notify observers about the removed frames.
   DocEvent ev(doc);
   ev.sprite(sprite);
   ev.frame(m_newFrame);
-  doc->notify_observers<DocEvent&>(&DocObserver::onRemoveFrame, ev);
+  for (frame_t i=0; i<m_count; ++i)
+    doc->notify_observers<DocEvent&>(&DocObserver::onRemoveFrame, ev);
 }
 
 } // namespace cmd
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -40,11 +41,25 @@ void ClearImage::onUndo()
 {
   Image* image = this->image();
 
+  if (!m_copy)
+    m_copy = m_compressedCopy.uncompress();
+
   copy_image(image, m_copy.get());
   m_copy.reset();
 
   image->incrementVersion();
 }
 
+void ClearImage::onCompress()
+{
+  if (m_copy)
+    m_compressedCopy.compress(m_copy);
+}
+
+void ClearImage::onSpill(UndoSpillFile* file)
+{
+  m_compressedCopy.spill(file);
+}
+
 } // namespace cmd
 } // namespace app
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/util/undo_compression.h"
 #include "doc/color.h"
 #include "doc/image_ref.h"
 
@@ -26,11 +28,15 @@ namespace cmd {
     void onExecute() override;
     void onUndo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) + (m_copy ? m_copy->getMemSize(): 0) +
+        m_compressedCopy.memSize();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     ImageRef m_copy;
+    CompressedUndoImage m_compressedCopy;
     color_t m_color;
   };
 
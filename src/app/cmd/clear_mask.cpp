@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -90,9 +90,22 @@ void ClearMask::onRedo()
   clear();
 }
 
+void ClearMask::onCompress()
+{
+  m_seq.compress();
+  if (m_copy)
+    m_compressedCopy.compress(m_copy);
+}
+
+void ClearMask::onSpill(UndoSpillFile* file)
+{
+  m_seq.spill(file);
+  m_compressedCopy.spill(file);
+}
+
 void ClearMask::clear()
 {
-  if (!m_copy)
+  if (!m_copy && m_compressedCopy.empty())
     return;
 
   Cel* cel = this->cel();
@@ -110,6 +123,8 @@ void ClearMask::clear()
 
 void ClearMask::restore()
 {
+  if (!m_copy)
+    m_copy = m_compressedCopy.uncompress();
   if (!m_copy)
     return;
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "app/cmd/with_cel.h"
 #include "app/cmd/with_image.h"
 #include "app/cmd_sequence.h"
+#include "app/util/undo_compression.h"
 #include "doc/image_ref.h"
 #include "gfx/rect.h"
 
@@ -33,8 +34,11 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) + m_seq.memSize() +
-        (m_copy ? m_copy->getMemSize(): 0);
+        (m_copy ? m_copy->getMemSize(): 0) +
+        m_compressedCopy.memSize();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void clear();
@@ -42,6 +46,7 @@ namespace cmd {
 
     CmdSequence m_seq;
     ImageRef m_copy;
+    CompressedUndoImage m_compressedCopy;
     gfx::Point m_cropPos;
     color_t m_bgcolor;
   };
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -70,8 +71,22 @@ void ClearRect::onRedo()
     clear();
 }
 
+void ClearRect::onCompress()
+{
+  m_seq.compress();
+  if (m_copy)
+    m_compressedCopy.compress(m_copy);
+}
+
+void ClearRect::onSpill(UndoSpillFile* file)
+{
+  m_seq.spill(file);
+  m_compressedCopy.spill(file);
+}
+
 void ClearRect::clear()
 {
+  uncompressCopy();
   fill_rect(m_dstImage->image(),
             m_offsetX, m_offsetY,
             m_offsetX + m_copy->width() - 1,
@@ -81,8 +96,15 @@ void ClearRect::clear()
 
 void ClearRect::restore()
 {
+  uncompressCopy();
   copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
 }
 
+void ClearRect::uncompressCopy()
+{
+  if (!m_copy)
+    m_copy = m_compressedCopy.uncompress();
+}
+
 } // namespace cmd
 } // namespace app
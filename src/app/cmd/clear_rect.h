@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +12,7 @@
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
 #include "app/cmd_sequence.h"
+#include "app/util/undo_compression.h"
 #include "doc/image_ref.h"
 #include "gfx/fwd.h"
 
@@ -34,16 +36,21 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) + m_seq.memSize() +
-        (m_copy ? m_copy->getMemSize(): 0);
+        (m_copy ? m_copy->getMemSize(): 0) +
+        m_compressedCopy.memSize();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void clear();
     void restore();
+    void uncompressCopy();
 
     CmdSequence m_seq;
     std::unique_ptr<WithImage> m_dstImage;
     ImageRef m_copy;
+    CompressedUndoImage m_compressedCopy;
     int m_offsetX, m_offsetY;
     color_t m_bgcolor;
   };
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,13 +13,17 @@
 #include "app/cmd/assign_color_profile.h"
 #include "app/cmd/replace_image.h"
 #include "app/cmd/set_palette.h"
+#include "app/color_spaces.h"
 #include "app/doc.h"
 #include "doc/cels_range.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
 #include "os/color_space.h"
 #include "os/system.h"
 
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -70,6 +74,33 @@ static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
   return dstImage;
 }
 
+// Returns the images of the unique cels of the sprite converted to
+// the new color space. Images are converted in parallel using the
+// shared pool of worker threads (each image is converted by one
+// thread only). Tilemaps are skipped (they are not included in the
+// result).
+static void convert_cel_images_color_space(
+  const doc::Sprite* sprite,
+  const gfx::ColorSpaceRef& newCS,
+  os::ColorSpaceConversion* conversion,
+  std::vector<std::pair<ImageRef, ImageRef>>& result)
+{
+  for (Cel* cel : sprite->uniqueCels()) {
+    ImageRef oldImage = cel->imageRef();
+    if (oldImage->pixelFormat() != IMAGE_TILEMAP)
+      result.emplace_back(oldImage, nullptr);
+  }
+
+  doc::parallel_for(
+    0, int(result.size()), 1,
+    [&result, &newCS, conversion](const int begin, const int end){
+      for (int i=begin; i<end; ++i) {
+        result[i].second = convert_image_color_space(
+          result[i].first.get(), newCS, conversion);
+      }
+    });
+}
+
 void convert_color_profile(doc::Sprite* sprite,
                            const gfx::ColorSpaceRef& newCS)
 {
@@ -82,19 +113,14 @@ void convert_color_profile(doc::Sprite* sprite,
   ASSERT(srcOCS);
   ASSERT(dstOCS);
 
-  auto conversion = system->convertBetweenColorSpace(srcOCS, dstOCS);
+  auto conversion = get_color_space_conversion(srcOCS, dstOCS);
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        sprite->replaceImage(old_image->id(), new_image);
-      }
-    }
+    std::vector<std::pair<ImageRef, ImageRef>> images;
+    convert_cel_images_color_space(sprite, newCS, conversion.get(), images);
+    for (const auto& pair : images)
+      sprite->replaceImage(pair.first->id(), pair.second);
   }
 
   if (conversion) {
@@ -137,7 +163,7 @@ void convert_color_profile(doc::Image* image,
   ASSERT(srcOCS);
   ASSERT(dstOCS);
 
-  auto conversion = system->convertBetweenColorSpace(srcOCS, dstOCS);
+  auto conversion = get_color_space_conversion(srcOCS, dstOCS);
   if (conversion) {
     switch (image->pixelFormat()) {
       case doc::IMAGE_RGB:
@@ -177,19 +203,14 @@ ConvertColorProfile::ConvertColorProfile(doc::Sprite* sprite, const gfx::ColorSp
   ASSERT(srcOCS);
   ASSERT(dstOCS);
 
-  auto conversion = system->convertBetweenColorSpace(srcOCS, dstOCS);
+  auto conversion = get_color_space_conversion(srcOCS, dstOCS);
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        m_seq.add(new cmd::ReplaceImage(sprite, old_image, new_image));
-      }
-    }
+    std::vector<std::pair<ImageRef, ImageRef>> images;
+    convert_cel_images_color_space(sprite, newCS, conversion.get(), images);
+    for (const auto& pair : images)
+      m_seq.add(new cmd::ReplaceImage(sprite, pair.first, pair.second));
   }
 
   if (conversion) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -57,14 +57,28 @@ void CopyRect::onRedo()
   swap();
 }
 
+void CopyRect::onCompress()
+{
+  compress_undo_buffer(m_data, m_uncompressedSize);
+}
+
+void CopyRect::onSpill(UndoSpillFile* file)
+{
+  m_spilled.spill(file, m_data);
+}
+
 void CopyRect::swap()
 {
   if (m_clip.size.w < 1 || m_clip.size.h < 1)
     return;
 
+  m_spilled.restore(m_data);
+  uncompress_undo_buffer(m_data, m_uncompressedSize);
+
   Image* image = this->image();
   int lineSize = this->lineSize();
   std::vector<uint8_t> tmp(lineSize);
+  image->unshareTiles(m_clip.dstBounds());
 
   auto it = m_data.begin();
   for (int v=0; v<m_clip.size.h; ++v) {
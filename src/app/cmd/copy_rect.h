@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/util/undo_compression.h"
 #include "gfx/clip.h"
 
 #include <vector>
@@ -34,6 +36,8 @@ namespace cmd {
     size_t onMemSize() const override {
       return sizeof(*this) + m_data.size();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void swap();
@@ -41,6 +45,8 @@ namespace cmd {
 
     gfx::Clip m_clip;
     std::vector<uint8_t> m_data;
+    size_t m_uncompressedSize = 0;
+    SpilledUndoBuffer m_spilled;
   };
 
 } // namespace cmd
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -73,11 +73,24 @@ void CopyRegion::onRedo()
   swap();
 }
 
+void CopyRegion::onCompress()
+{
+  compress_undo_buffer(m_buffer, m_uncompressedSize);
+}
+
+void CopyRegion::onSpill(UndoSpillFile* file)
+{
+  m_spilled.spill(file, m_buffer);
+}
+
 void CopyRegion::swap()
 {
   Image* image = this->image();
   ASSERT(image);
 
+  m_spilled.restore(m_buffer);
+  uncompress_undo_buffer(m_buffer, m_uncompressedSize);
+
   swap_image_region_with_buffer(m_region, image, m_buffer);
   image->incrementVersion();
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/util/undo_compression.h"
 #include "base/buffer.h"
 #include "doc/tile.h"
 #include "gfx/point.h"
@@ -43,6 +44,8 @@ namespace cmd {
     size_t onMemSize() const override {
       return sizeof(*this) + m_buffer.size();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void swap();
@@ -51,6 +54,8 @@ namespace cmd {
     bool m_alreadyCopied;
     gfx::Region m_region;
     base::buffer m_buffer;
+    size_t m_uncompressedSize = 0;
+    SpilledUndoBuffer m_spilled;
   };
 
   class CopyTileRegion : public CopyRegion {
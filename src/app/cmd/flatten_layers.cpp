@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,7 @@
 #include "app/doc.h"
 #include "app/i18n/strings.h"
 #include "app/restore_visible_layers.h"
+#include "app/util/parallel_process.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
@@ -29,6 +30,9 @@
 #include "doc/sprite.h"
 #include "render/render.h"
 
+#include <numeric>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -66,9 +70,6 @@ void FlattenLayers::onExecute()
   if (list.empty())
     return;                     // Do nothing
 
-  // Create a temporary image.
-  ImageRef image(Image::create(sprite->spec()));
-
   LayerImage* flatLayer;  // The layer onto which everything will be flattened.
   color_t bgcolor;        // The background color to use for flatLayer.
   bool newFlatLayer = false;
@@ -87,49 +88,60 @@ void FlattenLayers::onExecute()
     bgcolor = sprite->transparentColor();
   }
 
-  render::Render render;
-  render.setNewBlend(m_newBlendMethod);
-  render.setBgOptions(render::BgOptions::MakeNone());
-
   {
     // Show only the layers to be flattened so other layers are hidden
     // temporarily.
     RestoreVisibleLayers restore;
     restore.showSelectedLayers(sprite, layers);
 
-    // Copy all frames to the background.
-    for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-      // Clear the image and render this frame.
-      clear_image(image.get(), bgcolor);
-      render.renderSprite(image.get(), sprite, frame);
-
-      // TODO Keep cel links when possible
-
-      ImageRef cel_image;
-      Cel* cel = flatLayer->cel(frame);
-      if (cel) {
-        if (cel->links())
-          executeAndAdd(new cmd::UnlinkCel(cel));
-
-        cel_image = cel->imageRef();
-        ASSERT(cel_image);
-
-        executeAndAdd(
-          new cmd::CopyRect(cel_image.get(), image.get(),
-                            gfx::Clip(0, 0, image->bounds())));
-      }
-      else {
-        gfx::Rect bounds(image->bounds());
-        if (doc::algorithm::shrink_bounds(
-              image.get(), image->maskColor(), nullptr, bounds)) {
-          cel_image.reset(
-            doc::crop_image(image.get(), bounds, image->maskColor()));
-          cel = new Cel(frame, cel_image);
-          cel->setPosition(bounds.origin());
-          flatLayer->addCel(cel);
+    std::vector<frame_t> frames(sprite->totalFrames());
+    std::iota(frames.begin(), frames.end(), frame_t(0));
+
+    // Copy all frames to the background. Frames are rendered in
+    // parallel (in batches to limit the memory used by the rendered
+    // images), and then the commands are executed in frame order.
+    parallel_process(
+      frames,
+      [this, sprite, bgcolor](const frame_t frame){
+        // Clear the image and render this frame.
+        ImageRef image(Image::create(sprite->spec()));
+        clear_image(image.get(), bgcolor);
+
+        render::Render render;
+        render.setNewBlend(m_newBlendMethod);
+        render.setBgOptions(render::BgOptions::MakeNone());
+        render.renderSprite(image.get(), sprite, frame);
+        return image;
+      },
+      [this, flatLayer](const frame_t frame, ImageRef&& image){
+        // TODO Keep cel links when possible
+
+        ImageRef cel_image;
+        Cel* cel = flatLayer->cel(frame);
+        if (cel) {
+          if (cel->links())
+            executeAndAdd(new cmd::UnlinkCel(cel));
+
+          cel_image = cel->imageRef();
+          ASSERT(cel_image);
+
+          executeAndAdd(
+            new cmd::CopyRect(cel_image.get(), image.get(),
+                              gfx::Clip(0, 0, image->bounds())));
         }
-      }
-    }
+        else {
+          gfx::Rect bounds(image->bounds());
+          if (doc::algorithm::shrink_bounds(
+                image.get(), image->maskColor(), nullptr, bounds)) {
+            cel_image.reset(
+              doc::crop_image(image.get(), bounds, image->maskColor()));
+            cel = new Cel(frame, cel_image);
+            cel->setPosition(bounds.origin());
+            flatLayer->addCel(cel);
+          }
+        }
+      },
+      2*doc::parallel_concurrency());
   }
 
   // Add new flatten layer
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -72,8 +72,9 @@ void MoveCel::onExecute()
   }
 
   // Add empty frames until newFrame
-  while (dstSprite->totalFrames() <= m_dstFrame)
-    executeAndAdd(new cmd::AddFrame(dstSprite, dstSprite->totalFrames()));
+  if (dstSprite->totalFrames() <= m_dstFrame)
+    executeAndAdd(new cmd::AddFrame(dstSprite, dstSprite->totalFrames(),
+                                    m_dstFrame - dstSprite->totalFrames() + 1));
 
   Image* srcImage = (srcCel ? srcCel->image(): NULL);
   ImageRef dstImage;
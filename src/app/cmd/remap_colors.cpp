@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,17 +11,23 @@
 
 #include "app/cmd/remap_colors.h"
 
-#include "doc/cel.h"
-#include "doc/cels_range.h"
 #include "doc/image.h"
+#include "doc/parallel.h"
+#include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
 using namespace doc;
 
+// Number of images remapped by each task of the thread pool
+static constexpr int kImagesPerTask = 4;
+
 RemapColors::RemapColors(Sprite* sprite, const Remap& remap)
   : WithSprite(sprite)
   , m_remap(remap)
@@ -30,25 +37,40 @@ RemapColors::RemapColors(Sprite* sprite, const Remap& remap)
 void RemapColors::onExecute()
 {
   Sprite* spr = sprite();
-  if (spr->pixelFormat() == IMAGE_INDEXED) {
-    spr->remapImages(m_remap);
-    incrementVersions(spr);
-  }
+  if (spr->pixelFormat() == IMAGE_INDEXED)
+    remapImages(spr, m_remap);
 }
 
 void RemapColors::onUndo()
 {
   Sprite* spr = this->sprite();
-  if (spr->pixelFormat() == IMAGE_INDEXED) {
-    spr->remapImages(m_remap.invert());
-    incrementVersions(spr);
-  }
+  if (spr->pixelFormat() == IMAGE_INDEXED)
+    remapImages(spr, m_remap.invert());
 }
 
-void RemapColors::incrementVersions(Sprite* spr)
+void RemapColors::remapImages(Sprite* spr, const Remap& remap)
 {
-  for (const Cel* cel : spr->uniqueCels())
-    cel->image()->incrementVersion();
+  // Images of unique cels (linked cels share the same image) and
+  // tiles of the tilesets
+  std::vector<ImageRef> images;
+  spr->getImages(images);
+  std::sort(images.begin(), images.end());
+  images.erase(std::unique(images.begin(), images.end()), images.end());
+
+  // Each image is remapped by just one thread
+  std::vector<char> modified(images.size(), 0);
+  doc::parallel_for(
+    0, int(images.size()), kImagesPerTask,
+    [&images, &modified, &remap](const int begin, const int end){
+      for (int i=begin; i<end; ++i)
+        modified[i] = remap_image(images[i].get(), remap);
+    });
+
+  // Only images with remapped pixels must be re-rendered
+  for (int i=0; i<int(images.size()); ++i) {
+    if (modified[i])
+      images[i]->incrementVersion();
+  }
 }
 
 } // namespace cmd
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -29,7 +30,7 @@ namespace cmd {
     }
 
   private:
-    void incrementVersions(Sprite* spr);
+    void remapImages(Sprite* spr, const Remap& remap);
 
     Remap m_remap;
   };
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,10 +12,6 @@
 
 #include "app/doc.h"
 #include "app/doc_event.h"
-#include "doc/cel.h"
-#include "doc/cels_range.h"
-#include "doc/layer.h"
-#include "doc/layer_tilemap.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
@@ -36,14 +32,12 @@ void RemapTilemaps::onExecute()
 {
   Tileset* tileset = this->tileset();
   remapTileset(tileset, m_remap);
-  incrementVersions(tileset);
 }
 
 void RemapTilemaps::onUndo()
 {
   Tileset* tileset = this->tileset();
   remapTileset(tileset, m_remap.invert());
-  incrementVersions(tileset);
 }
 
 void RemapTilemaps::remapTileset(Tileset* tileset, const Remap& remap)
@@ -58,16 +52,5 @@ void RemapTilemaps::remapTileset(Tileset* tileset, const Remap& remap)
   doc->notify_observers<DocEvent&, const Remap&>(&DocObserver::onRemapTileset, ev, remap);
 }
 
-void RemapTilemaps::incrementVersions(Tileset* tileset)
-{
-  Sprite* spr = tileset->sprite();
-  for (const Cel* cel : spr->uniqueCels()) {
-    if (cel->layer()->isTilemap() &&
-        static_cast<LayerTilemap*>(cel->layer())->tileset() == tileset) {
-      cel->image()->incrementVersion();
-    }
-  }
-}
-
 } // namespace cmd
 } // namespace app
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,15 +22,26 @@ namespace cmd {
 
 using namespace doc;
 
-RemoveFrame::RemoveFrame(Sprite* sprite, frame_t frame)
+RemoveFrame::RemoveFrame(Sprite* sprite, frame_t frame, frame_t count)
   : WithSprite(sprite)
   , m_frame(frame)
+  , m_count(count)
+  , m_framesRemoved(0)
   , m_firstTime(true)
-  , m_frameRemoved(false)
 {
-  m_frameDuration = sprite->frameDuration(frame);
-  for (Cel* cel : sprite->cels(m_frame))
-    m_seq.add(new cmd::RemoveCel(cel));
+  ASSERT(count > 0);
+  ASSERT(frame+count <= sprite->totalFrames());
+
+  m_frameDurations.resize(m_count);
+  for (frame_t i=0; i<m_count; ++i)
+    m_frameDurations[i] = sprite->frameDuration(m_frame+i);
+
+  // Cels are removed from the last frame, so each removed cel is
+  // near the end of the list of cels of its layer.
+  for (frame_t fr=m_frame+m_count-1; fr>=m_frame; --fr) {
+    for (Cel* cel : sprite->cels(fr))
+      m_seq.add(new cmd::RemoveCel(cel));
+  }
 }
 
 void RemoveFrame::onExecute()
@@ -46,19 +58,20 @@ void RemoveFrame::onExecute()
 
   int oldTotalFrames = sprite->totalFrames();
 
-  sprite->removeFrame(m_frame);
+  sprite->removeFrames(m_frame, m_count);
   sprite->incrementVersion();
 
-  // True when the number of total frames changed (e.g. this can be
-  // false only then we try to delete the last frame and only frame in
-  // the sprite).
-  m_frameRemoved = (oldTotalFrames != sprite->totalFrames());
+  // Number of frames that were really removed (e.g. this can be less
+  // than m_count only when we try to delete all the frames of the
+  // sprite, as the sprite keeps at least one frame).
+  m_framesRemoved = oldTotalFrames - sprite->totalFrames();
 
-  // Notify observers.
+  // Notify observers (one event for each removed frame).
   DocEvent ev(doc);
   ev.sprite(sprite);
   ev.frame(m_frame);
-  doc->notify_observers<DocEvent&>(&DocObserver::onRemoveFrame, ev);
+  for (frame_t i=0; i<m_count; ++i)
+    doc->notify_observers<DocEvent&>(&DocObserver::onRemoveFrame, ev);
 }
 
 void RemoveFrame::onUndo()
@@ -66,17 +79,20 @@ void RemoveFrame::onUndo()
   Sprite* sprite = this->sprite();
   Doc* doc = static_cast<Doc*>(sprite->document());
 
-  if (m_frameRemoved)
-    sprite->addFrame(m_frame);
-  sprite->setFrameDuration(m_frame, m_frameDuration);
+  if (m_framesRemoved > 0)
+    sprite->addFrames(m_frame, m_framesRemoved);
+  for (frame_t i=0; i<m_count; ++i)
+    sprite->setFrameDuration(m_frame+i, m_frameDurations[i]);
   sprite->incrementVersion();
   m_seq.undo();
 
-  // Notify observers about the new frame.
+  // Notify observers about the new frames.
   DocEvent ev(doc);
   ev.sprite(sprite);
-  ev.frame(m_frame);
-  doc->notify_observers<DocEvent&>(&DocObserver::onAddFrame, ev);
+  for (frame_t i=0; i<m_count; ++i) {
+    ev.frame(m_frame+i);
+    doc->notify_observers<DocEvent&>(&DocObserver::onAddFrame, ev);
+  }
 }
 
 } // namespace cmd
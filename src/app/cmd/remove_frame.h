@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,28 +14,35 @@
 #include "app/cmd_sequence.h"
 #include "doc/frame.h"
 
+#include <vector>
+
 namespace app {
 namespace cmd {
   using namespace doc;
 
+  // Removes "count" consecutive frames from the given frame (all
+  // cels in those frames are removed and the next cels are displaced
+  // only once).
   class RemoveFrame : public Cmd
                     , public WithSprite {
   public:
-    RemoveFrame(Sprite* sprite, frame_t frame);
+    RemoveFrame(Sprite* sprite, frame_t frame, frame_t count = 1);
 
   protected:
     void onExecute() override;
     void onUndo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_seq.memSize();
+      return sizeof(*this) + m_seq.memSize() +
+        m_frameDurations.size()*sizeof(int);
     }
 
   private:
     frame_t m_frame;
-    int m_frameDuration;
+    frame_t m_count;
+    frame_t m_framesRemoved;
+    std::vector<int> m_frameDurations;
     CmdSequence m_seq;
     bool m_firstTime;
-    bool m_frameRemoved;
   };
 
 } // namespace cmd
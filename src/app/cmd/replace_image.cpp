@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -51,6 +51,7 @@ void ReplaceImage::onUndo()
   ImageRef newImage = sprite()->getImageRef(m_newImageId);
   ASSERT(newImage);
   ASSERT(!sprite()->getImageRef(m_oldImageId));
+  uncompressCopy();
   m_copy->setId(m_oldImageId);
 
   replaceImage(m_newImageId, m_copy);
@@ -62,12 +63,30 @@ void ReplaceImage::onRedo()
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
   ASSERT(!sprite()->getImageRef(m_newImageId));
+  uncompressCopy();
   m_copy->setId(m_newImageId);
 
   replaceImage(m_oldImageId, m_copy);
   m_copy.reset(Image::createCopy(oldImage.get()));
 }
 
+void ReplaceImage::onCompress()
+{
+  if (m_copy)
+    m_compressedCopy.compress(m_copy);
+}
+
+void ReplaceImage::onSpill(UndoSpillFile* file)
+{
+  m_compressedCopy.spill(file);
+}
+
+void ReplaceImage::uncompressCopy()
+{
+  if (!m_copy)
+    m_copy = m_compressedCopy.uncompress();
+}
+
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
 {
   Sprite* spr = sprite();
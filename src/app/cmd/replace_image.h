@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_sprite.h"
+#include "app/util/undo_compression.h"
 #include "doc/image_ref.h"
 
 #include <sstream>
@@ -29,11 +31,15 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) +
-        (m_copy ? m_copy->getMemSize(): 0);
+        (m_copy ? m_copy->getMemSize(): 0) +
+        m_compressedCopy.memSize();
     }
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     void replaceImage(ObjectId oldId, const ImageRef& newImage);
+    void uncompressCopy();
 
     ObjectId m_oldImageId;
     ObjectId m_newImageId;
@@ -43,6 +49,7 @@ namespace cmd {
     // Then the reference is not used anymore.
     ImageRef m_newImage;
     ImageRef m_copy;
+    CompressedUndoImage m_compressedCopy;
   };
 
 } // namespace cmd
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +33,7 @@ void SetCelFrame::onExecute()
 {
   Cel* cel = this->cel();
   cel->layer()->moveCel(cel, m_newFrame);
+  cel->layer()->incrementVersion();
   cel->incrementVersion();
 }
 
@@ -39,6 +41,7 @@ void SetCelFrame::onUndo()
 {
   Cel* cel = this->cel();
   cel->layer()->moveCel(cel, m_oldFrame);
+  cel->layer()->incrementVersion();
   cel->incrementVersion();
 }
 
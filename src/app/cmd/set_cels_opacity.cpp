@@ -0,0 +1,70 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/set_cels_opacity.h"
+
+#include "app/doc.h"
+#include "app/doc_event.h"
+#include "doc/cel.h"
+
+namespace app {
+namespace cmd {
+
+using namespace doc;
+
+SetCelsOpacity::SetCelsOpacity(int opacity)
+  : m_newOpacity(opacity)
+{
+}
+
+void SetCelsOpacity::addCel(Cel* cel)
+{
+  m_celIds.push_back(cel->id());
+  m_oldOpacities.push_back(cel->opacity());
+}
+
+void SetCelsOpacity::onExecute()
+{
+  for (const ObjectId celId : m_celIds) {
+    Cel* cel = get<Cel>(celId);
+    ASSERT(cel);
+    cel->setOpacity(m_newOpacity);
+    cel->data()->incrementVersion();
+  }
+}
+
+void SetCelsOpacity::onUndo()
+{
+  for (size_t i=0; i<m_celIds.size(); ++i) {
+    Cel* cel = get<Cel>(m_celIds[i]);
+    ASSERT(cel);
+    cel->setOpacity(m_oldOpacities[i]);
+    cel->data()->incrementVersion();
+  }
+}
+
+void SetCelsOpacity::onFireNotifications()
+{
+  if (m_celIds.empty())
+    return;
+
+  Cel* cel = get<Cel>(m_celIds.front());
+  Doc* doc = static_cast<Doc*>(cel->document());
+  DocEvent ev(doc);
+  ev.sprite(cel->sprite());
+
+  for (const ObjectId celId : m_celIds) {
+    ev.cel(get<Cel>(celId));
+    doc->notify_observers<DocEvent&>(&DocObserver::onCelOpacityChange, ev);
+  }
+}
+
+} // namespace cmd
+} // namespace app
@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CMD_SET_CELS_OPACITY_H_INCLUDED
+#define APP_CMD_SET_CELS_OPACITY_H_INCLUDED
+#pragma once
+
+#include "app/cmd.h"
+#include "doc/object_id.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+  class Cel;
+}
+
+namespace app {
+namespace cmd {
+  using namespace doc;
+
+  // Changes the opacity of several cels with one command (instead of
+  // one SetCelOpacity for each cel), useful to change the opacity of
+  // a big range of cels.
+  class SetCelsOpacity : public Cmd {
+  public:
+    SetCelsOpacity(int opacity);
+
+    // Adds a cel to be modified (must be called before executing
+    // the command).
+    void addCel(Cel* cel);
+    bool empty() const { return m_celIds.empty(); }
+
+  protected:
+    void onExecute() override;
+    void onUndo() override;
+    void onFireNotifications() override;
+    size_t onMemSize() const override {
+      return sizeof(*this) +
+        m_celIds.capacity() * sizeof(ObjectId) +
+        m_oldOpacities.capacity();
+    }
+
+  private:
+    std::vector<ObjectId> m_celIds;
+    std::vector<uint8_t> m_oldOpacities;
+    int m_newOpacity;
+  };
+
+} // namespace cmd
+} // namespace app
+
+#endif
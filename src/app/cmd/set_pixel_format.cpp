@@ -23,12 +23,16 @@
 #include "doc/document.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "doc/tilesets.h"
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <mutex>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -45,12 +49,14 @@ public:
   }
 
   void notifyTaskProgress(double progress) override {
+    const std::lock_guard lock(m_mutex);
     if (m_delegate)
       m_delegate->notifyTaskProgress(
         (progress + m_curImage) / m_nimages);
   }
 
   bool continueTask() override {
+    const std::lock_guard lock(m_mutex);
     if (m_delegate)
       return m_delegate->continueTask();
     else
@@ -58,15 +64,39 @@ public:
   }
 
   void nextImage() {
+    const std::lock_guard lock(m_mutex);
     ++m_curImage;
   }
 
 private:
+  // Images can be converted from several threads at the same time
+  std::mutex m_mutex;
   int m_nimages;
   int m_curImage;
   TaskDelegate* m_delegate;
 };
 
+// Delegate used to convert several images at the same time. The
+// progress of each image is ignored (SuperDelegate::nextImage() is
+// called when each image is finished).
+class ParallelImageDelegate : public render::TaskDelegate {
+public:
+  ParallelImageDelegate(SuperDelegate* superDel)
+    : m_superDel(superDel) {
+  }
+
+  void notifyTaskProgress(double progress) override {
+    // Do nothing
+  }
+
+  bool continueTask() override {
+    return m_superDel->continueTask();
+  }
+
+private:
+  SuperDelegate* m_superDel;
+};
+
 } // anonymous namespace
 
 SetPixelFormat::SetPixelFormat(Sprite* sprite,
@@ -83,62 +113,31 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // Collect the cel and tileset images to convert (the number of
+  // images is used to show a proper progress bar too).
+  std::vector<ImageToConvert> images;
   for (Cel* cel : sprite->uniqueCels()) {
-    if (cel->layer()->isTilemap())
-      continue;
-
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel,
-                 fitCriteria);
-
-    superDel.nextImage();
+    if (!cel->layer()->isTilemap())
+      images.push_back({ cel->imageRef(),
+                         cel->frame(),
+                         cel->layer()->isBackground() });
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
         continue;
 
       for (tile_index i=0; i<tileset->size(); ++i) {
-        ImageRef oldImage = tileset->get(i);
-        if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel,
-                       fitCriteria);
-        }
-        superDel.nextImage();
+        // TODO select a frame or generate other tilesets?
+        // TODO is background? it depends of the layer where this tileset is used
+        images.push_back({ tileset->get(i), 0, false });
       }
     }
   }
 
+  convertImages(sprite, dithering, images,
+                mapAlgorithm, toGray, delegate, fitCriteria);
+
   // By default, when converting to RGB or grayscale, the mask color
   // is always 0.
   int newMaskIndex = 0;
@@ -226,48 +225,92 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate,
-                                  const doc::FitCriteria fitCriteria)
+void SetPixelFormat::convertImages(doc::Sprite* sprite,
+                                   const render::Dithering& dithering,
+                                   const std::vector<ImageToConvert>& images,
+                                   const doc::RgbMapAlgorithm mapAlgorithm,
+                                   doc::rgba_to_graya_func toGray,
+                                   render::TaskDelegate* delegate,
+                                   const doc::FitCriteria fitCriteria)
 {
-  ASSERT(oldImage);
-  ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
-
-  // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
-  int newMaskIndex = (isBackground ? -1 : 0);
-  if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame,
-                            sprite->rgbMapForSprite(),
-                            mapAlgorithm,
-                            fitCriteria);
-    if (m_oldFormat == IMAGE_INDEXED)
-      newMaskIndex = sprite->transparentColor();
-    else
-      newMaskIndex = rgbmap->maskIndex();
+  SuperDelegate superDel(int(images.size()), delegate);
+  ParallelImageDelegate parallelDel(&superDel);
+  std::vector<ImageRef> newImages(images.size());
+
+  // Images are converted in runs of consecutive images that use the
+  // same palette (so they use the same rgbmap).
+  for (int i=0; i<int(images.size()); ) {
+    const Palette* palette = sprite->palette(images[i].frame);
+    int j = i+1;
+    while (j < int(images.size()) &&
+           sprite->palette(images[j].frame) == palette)
+      ++j;
+
+    // Making the RGBMap for Image->INDEXDED conversion.
+    RgbMap* rgbmap;
+    if (m_newFormat == IMAGE_INDEXED) {
+      rgbmap = sprite->rgbMap(images[i].frame,
+                              sprite->rgbMapForSprite(),
+                              mapAlgorithm,
+                              fitCriteria);
+    }
+    else {
+      rgbmap = nullptr;
+    }
+
+    auto convertImage = [&](const int k, render::TaskDelegate* del) {
+      const ImageToConvert& image = images[k];
+      if (!image.oldImage)
+        return;
+
+      ASSERT(image.oldImage->pixelFormat() != IMAGE_TILEMAP);
+
+      int newMaskIndex = (image.isBackground ? -1 : 0);
+      if (m_newFormat == IMAGE_INDEXED) {
+        if (m_oldFormat == IMAGE_INDEXED)
+          newMaskIndex = sprite->transparentColor();
+        else
+          newMaskIndex = rgbmap->maskIndex();
+      }
+
+      newImages[k].reset(
+        render::convert_pixel_format
+        (image.oldImage.get(), nullptr, m_newFormat,
+         dithering,
+         rgbmap,
+         palette,
+         image.isBackground,
+         newMaskIndex,
+         toGray,
+         del));
+    };
+
+    // Each image is converted independently (even with error
+    // diffusion, which must be serial inside each image), so
+    // several images can be converted at the same time if the
+    // rgbmap can be used from several threads.
+    if (j-i > 1 && (!rgbmap || rgbmap->isThreadSafe())) {
+      parallel_for(i, j, 1, [&](const int begin, const int end){
+        for (int k=begin; k<end; ++k) {
+          convertImage(k, &parallelDel);
+          superDel.nextImage();
+          superDel.notifyTaskProgress(0.0);
+        }
+      });
+    }
+    else {
+      for (int k=i; k<j; ++k) {
+        convertImage(k, &superDel);
+        superDel.nextImage();
+      }
+    }
+    i = j;
   }
-  else {
-    rgbmap = nullptr;
+
+  for (int k=0; k<int(images.size()); ++k) {
+    if (newImages[k])
+      m_pre.add(new cmd::ReplaceImage(sprite, images[k].oldImage, newImages[k]));
   }
-  ImageRef newImage(
-    render::convert_pixel_format
-    (oldImage.get(), nullptr, m_newFormat,
-     dithering,
-     rgbmap,
-     sprite->palette(frame),
-     isBackground,
-     newMaskIndex,
-     toGray,
-     delegate));
-
-  m_pre.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
 }
 
 } // namespace cmd
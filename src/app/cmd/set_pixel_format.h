@@ -18,6 +18,8 @@
 #include "doc/pixel_format.h"
 #include "doc/rgbmap_algorithm.h"
 
+#include <vector>
+
 namespace doc {
   class Sprite;
 }
@@ -51,15 +53,20 @@ namespace cmd {
 
   private:
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate,
-                      const doc::FitCriteria fitCriteria = doc::FitCriteria::DEFAULT);
+    // An image to convert and the info needed to convert it
+    struct ImageToConvert {
+      doc::ImageRef oldImage;
+      doc::frame_t frame;
+      bool isBackground;
+    };
+
+    void convertImages(doc::Sprite* sprite,
+                       const render::Dithering& dithering,
+                       const std::vector<ImageToConvert>& images,
+                       const doc::RgbMapAlgorithm mapAlgorithm,
+                       doc::rgba_to_graya_func toGray,
+                       render::TaskDelegate* delegate,
+                       const doc::FitCriteria fitCriteria);
 
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
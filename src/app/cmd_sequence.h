@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -27,11 +27,15 @@ namespace app {
     // function.
     void executeAndAdd(Cmd* cmd);
 
+    const std::vector<Cmd*>& cmds() const { return m_cmds; }
+
   protected:
     void onExecute() override;
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override;
+    void onCompress() override;
+    void onSpill(UndoSpillFile* file) override;
 
   private:
     std::vector<Cmd*> m_cmds;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -107,11 +107,11 @@ void ColorPicker::pickColor(const Site& site,
 
     // Pick from the composed image
     case FromComposition: {
-      doc::RenderPlan plan;
-      plan.addLayer(sprite->root(), site.frame());
+      const doc::RenderPlanPtr plan =
+        sprite->renderPlan(sprite->root(), site.frame());
 
       doc::CelList cels;
-      sprite->pickCels(pos, kOpacityThreshold, plan, cels);
+      sprite->pickCels(pos, kOpacityThreshold, *plan, cels);
       if (!cels.empty())
         m_layer = cels.front()->layer();
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -16,6 +16,10 @@
 #include "os/system.h"
 #include "os/window.h"
 
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
 namespace app {
 
 // We use this variable to avoid accessing Preferences::instance()
@@ -65,21 +69,75 @@ gfx::ColorSpaceRef get_working_rgb_space_from_preferences()
 //////////////////////////////////////////////////////////////////////
 // Color conversion
 
+namespace {
+
+// Conversions between color spaces are cached because a ConvertCS is
+// created to paint several widgets (each time they are painted), and
+// creating a conversion is more expensive than converting a couple
+// of colors.
+struct CachedConversion {
+  os::ColorSpaceRef srcCS;
+  os::ColorSpaceRef dstCS;
+  os::Ref<os::ColorSpaceConversion> conversion;
+};
+
+constexpr int kMaxCachedConversions = 8;
+
+// The most recently used conversion is at the end
+std::vector<CachedConversion> g_conversions;
+std::mutex g_conversionsMutex;
+
+// Color spaces are compared by pointer (or both are sRGB, as we
+// create new sRGB instances in several places)
+bool same_color_space(const os::ColorSpaceRef& a,
+                      const os::ColorSpaceRef& b)
+{
+  return (a.get() == b.get() || (a->isSRGB() && b->isSRGB()));
+}
+
+} // anonymous namespace
+
+os::Ref<os::ColorSpaceConversion> get_color_space_conversion(
+  const os::ColorSpaceRef& srcCS,
+  const os::ColorSpaceRef& dstCS)
+{
+  // Identity conversion (e.g. sRGB to sRGB)
+  if (same_color_space(srcCS, dstCS))
+    return os::Ref<os::ColorSpaceConversion>();
+
+  const std::lock_guard lock(g_conversionsMutex);
+  auto it = std::find_if(g_conversions.begin(), g_conversions.end(),
+                         [&srcCS, &dstCS](const CachedConversion& c){
+                           return (same_color_space(c.srcCS, srcCS) &&
+                                   same_color_space(c.dstCS, dstCS));
+                         });
+  if (it != g_conversions.end()) {
+    std::rotate(it, it+1, g_conversions.end());
+    return g_conversions.back().conversion;
+  }
+
+  auto conversion = os::instance()->convertBetweenColorSpace(srcCS, dstCS);
+  if (int(g_conversions.size()) >= kMaxCachedConversions)
+    g_conversions.erase(g_conversions.begin());
+  g_conversions.push_back(CachedConversion{ srcCS, dstCS, conversion });
+  return conversion;
+}
+
 ConvertCS::ConvertCS()
 {
   if (g_manage) {
     auto srcCS = get_current_color_space();
     auto dstCS = get_screen_color_space();
     if (srcCS && dstCS)
-      m_conversion = os::instance()->convertBetweenColorSpace(srcCS, dstCS);
+      m_conversion = get_color_space_conversion(srcCS, dstCS);
   }
 }
 
 ConvertCS::ConvertCS(const os::ColorSpaceRef& srcCS,
                      const os::ColorSpaceRef& dstCS)
 {
-  if (g_manage) {
-    m_conversion = os::instance()->convertBetweenColorSpace(srcCS, dstCS);
+  if (g_manage && srcCS && dstCS) {
+    m_conversion = get_color_space_conversion(srcCS, dstCS);
   }
 }
 
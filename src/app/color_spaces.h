@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2020  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -28,6 +28,14 @@ namespace app {
 
   gfx::ColorSpaceRef get_working_rgb_space_from_preferences();
 
+  // Returns a conversion between the given color spaces (or nullptr
+  // if both are the same color space). Conversions are cached, so it
+  // can be called to paint each widget. It can be called from
+  // background threads.
+  os::Ref<os::ColorSpaceConversion> get_color_space_conversion(
+    const os::ColorSpaceRef& srcCS,
+    const os::ColorSpaceRef& dstCS);
+
   class ConvertCS {
   public:
     ConvertCS();
@@ -10,7 +10,7 @@
 #endif
 
 #include "app/app.h"
-#include "app/cmd/set_cel_opacity.h"
+#include "app/cmd/set_cels_opacity.h"
 #include "app/commands/command.h"
 #include "app/commands/params.h"
 #include "app/context.h"
@@ -23,6 +23,7 @@
 #include "doc/cels_range.h"
 #include "doc/sprite.h"
 
+#include <memory>
 #include <string>
 
 namespace app {
@@ -85,15 +86,18 @@ void CelOpacityCommand::onExecute(Context* context)
       range.endRange(layer, cel->frame());
     }
 
+    auto cmd = std::make_unique<cmd::SetCelsOpacity>(m_opacity);
     for (Cel* c : cel->sprite()->uniqueCels(range.selectedFrames())) {
       if (range.contains(c->layer())) {
         if (!c->layer()->isBackground() &&
             c->layer()->isEditable() &&
             m_opacity != c->opacity()) {
-          tx(new cmd::SetCelOpacity(c, m_opacity));
+          cmd->addCel(c);
         }
       }
     }
+    if (!cmd->empty())
+      tx(cmd.release());
 
     tx.commit();
   }
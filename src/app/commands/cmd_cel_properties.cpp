@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,7 +10,7 @@
 #endif
 
 #include "app/app.h"
-#include "app/cmd/set_cel_opacity.h"
+#include "app/cmd/set_cels_opacity.h"
 #include "app/cmd/set_cel_zindex.h"
 #include "app/cmd/set_user_data.h"
 #include "app/commands/command.h"
@@ -36,6 +36,7 @@
 
 #include <algorithm>
 #include <limits>
+#include <memory>
 
 namespace app {
 
@@ -233,13 +234,16 @@ private:
         Sprite* sprite = m_document->sprite();
         bool redrawTimeline = false;
 
+        // The opacity of all cels is changed with just one command
+        auto opacityCmd = std::make_unique<cmd::SetCelsOpacity>(newOpacity);
+
         // For each unique cel (don't repeat on links)
         for (Cel* cel : sprite->uniqueCels(range.selectedFrames())) {
           if (range.contains(cel->layer())) {
             if (opacityChanged &&
                 !cel->layer()->isBackground() &&
                 newOpacity != cel->opacity()) {
-              tx(new cmd::SetCelOpacity(cel, newOpacity));
+              opacityCmd->addCel(cel);
             }
 
             if (newUserData != cel->data()->userData()) {
@@ -258,6 +262,9 @@ private:
           }
         }
 
+        if (!opacityCmd->empty())
+          tx(opacityCmd.release());
+
         // For all cels (repeat links)
         if (newZIndex != m_lastValues.zIndex) {
           for (Cel* cel : sprite->cels(range.selectedFrames())) {
@@ -578,6 +578,8 @@ void ChangePixelFormatCommand::onLoadParams(const Params& params)
     m_rgbmap = doc::RgbMapAlgorithm::OCTREE;
   else if (rgbmap == "rgb5a3")
     m_rgbmap = doc::RgbMapAlgorithm::RGB5A3;
+  else if (rgbmap == "kdtree")
+    m_rgbmap = doc::RgbMapAlgorithm::KDTREE;
   else if (rgbmap == "default")
     m_rgbmap = doc::RgbMapAlgorithm::DEFAULT;
   else {
@@ -39,6 +39,7 @@ struct ColorQuantizationParams : public NewParams {
   Param<int> maxColors { this, 256, "maxColors" };
   Param<bool> useRange { this, false, "useRange" };
   Param<RgbMapAlgorithm> algorithm { this, RgbMapAlgorithm::DEFAULT, "algorithm" };
+  Param<bool> refinePalette { this, false, "refinePalette" };
 };
 
 class PaletteFromSpriteWindow : public app::gen::PaletteFromSprite {
@@ -94,6 +95,7 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
   bool withAlpha = params().withAlpha();
   int maxColors = params().maxColors();
   RgbMapAlgorithm algorithm = params().algorithm();
+  bool refinePalette = params().refinePalette();
   bool createPal;
 
   Site site = ctx->activeSite();
@@ -109,12 +111,15 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
         algorithm = pref.quantization.rgbmapAlgorithm();
       if (!params().withAlpha.isSet())
         withAlpha = pref.quantization.withAlpha();
+      if (!params().refinePalette.isSet())
+        refinePalette = pref.quantization.refinePalette();
 
       const bool advanced = pref.quantization.advanced();
       window.advancedCheck()->setSelected(advanced);
       window.advanced()->setVisible(advanced);
 
       window.algorithm(algorithm);
+      window.refinePalette()->setSelected(refinePalette);
       window.newPalette()->setSelected(true);
       window.ncolors()->setTextf("%d", maxColors);
 
@@ -140,8 +145,10 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
     maxColors = window.ncolors()->textInt();
     withAlpha = window.alphaChannel()->isSelected();
     algorithm = window.algorithm();
+    refinePalette = window.refinePalette()->isSelected();
 
     pref.quantization.withAlpha(withAlpha);
+    pref.quantization.refinePalette(refinePalette);
     pref.quantization.advanced(window.advancedCheck()->isSelected());
 
     if (window.newPalette()->isSelected()) {
@@ -177,13 +184,15 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
     const bool newBlend = pref.experimental.newBlend();
     job.startJobWithCallback(
       [sprite, withAlpha, curPalette, &tmpPalette, &job, &entries,
-       newBlend, algorithm, createPal, site, frame](Tx& tx) {
+       newBlend, algorithm, refinePalette, createPal, site, frame](Tx& tx) {
         render::create_palette_from_sprite(
           sprite, 0, sprite->lastFrame(),
           withAlpha, &tmpPalette,
           &job,                 // SpriteJob is a render::TaskDelegate
           newBlend,
-          algorithm);
+          algorithm,
+          true,                 // Calculate with transparent
+          refinePalette);
 
         std::unique_ptr<Palette> newPalette(
           new Palette(createPal ? tmpPalette:
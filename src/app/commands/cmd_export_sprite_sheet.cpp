@@ -1257,6 +1257,10 @@ void ExportSpriteSheetCommand::onExecute(Context* context)
   auto& params = this->params();
   DocExporter exporter;
 
+  if (!m_renderCache)
+    m_renderCache = std::make_shared<SampleRenderCache>();
+  exporter.setSampleRenderCache(m_renderCache);
+
   Doc* document = site.document();
   DocumentPreferences& docPref(Preferences::instance().document(document));
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "app/commands/new_params.h"
+#include "app/sample_render_cache.h"
 #include "app/sprite_sheet_data_format.h"
 #include "app/sprite_sheet_type.h"
 
@@ -64,6 +65,12 @@ public:
 protected:
   bool onEnabled(Context* context) override;
   void onExecute(Context* context) override;
+
+private:
+  // Renders of the last exported sprite sheets, so exporting the
+  // same sprite again (e.g. with "Repeat Last Export") renders again
+  // the modified frames only.
+  SampleRenderCachePtr m_renderCache;
 };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +14,7 @@
 #include "app/cmd/trim_cel.h"
 #include "app/color_utils.h"
 #include "app/commands/command.h"
+#include "app/commands/params.h"
 #include "app/context_access.h"
 #include "app/pref/preferences.h"
 #include "app/tx.h"
@@ -23,6 +24,8 @@
 #include "doc/algorithm/stroke_selection.h"
 #include "doc/mask.h"
 
+#include <algorithm>
+
 namespace app {
 
 class FillCommand : public Command {
@@ -30,19 +33,29 @@ public:
   enum Type { Fill, Stroke };
   FillCommand(Type type);
 protected:
+  void onLoadParams(const Params& params) override;
   bool onEnabled(Context* ctx) override;
   void onExecute(Context* ctx) override;
 private:
   Type m_type;
+  int m_width;                  // Width of the stroke in pixels
 };
 
 FillCommand::FillCommand(Type type)
   : Command(type == Stroke ? CommandId::Stroke():
                              CommandId::Fill(), CmdUIOnlyFlag)
   , m_type(type)
+  , m_width(1)
 {
 }
 
+void FillCommand::onLoadParams(const Params& params)
+{
+  m_width = 1;
+  if (params.has_param("width"))
+    m_width = std::max(1, params.get_as<int>("width"));
+}
+
 bool FillCommand::onEnabled(Context* ctx)
 {
   if (ctx->checkFlags(ContextFlags::ActiveDocumentIsWritable |
@@ -103,7 +116,8 @@ void FillCommand::onExecute(Context* ctx)
           imageBounds,
           mask,
           color,
-          (site.tilemapMode() == TilemapMode::Tiles ? &grid: nullptr));
+          (site.tilemapMode() == TilemapMode::Tiles ? &grid: nullptr),
+          m_width);
       }
       else {
         doc::algorithm::fill_selection(
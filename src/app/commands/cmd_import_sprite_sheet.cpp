@@ -33,6 +33,7 @@
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "render/render.h"
@@ -495,18 +496,29 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
         break;
     }
 
-    // As first step, we cut each tile and add them into "animation" list.
-    for (const auto& tileRect : tileRects) {
-      ImageRef resultImage(
-        Image::create(
-          sprite->pixelFormat(), tileRect.w, tileRect.h));
-
-      // Render the portion of sheet.
-      render.renderSprite(
-        resultImage.get(), sprite, currentFrame,
-        gfx::Clip(0, 0, tileRect));
-
-      animation.push_back(resultImage);
+    // As first step, we render the whole sheet once, and then we cut
+    // each tile (in parallel, all tiles are read from the same sheet
+    // image) and add them into "animation" list. Empty tiles are
+    // kept as nullptr so their frames don't get a cel.
+    if (!tileRects.empty()) {
+      ImageRef sheetImage(
+        Image::create(sprite->pixelFormat(),
+                      sprite->width(), sprite->height()));
+      sheetImage->setMaskColor(sprite->transparentColor());
+      render.renderSprite(sheetImage.get(), sprite, currentFrame);
+
+      animation.resize(tileRects.size());
+      doc::parallel_for(
+        0, int(tileRects.size()), 16,
+        [&tileRects, &animation, &sheetImage](const int begin, const int end){
+          for (int i=begin; i<end; ++i) {
+            ImageRef resultImage(
+              crop_image(sheetImage.get(), tileRects[i],
+                         sheetImage->maskColor()));
+            if (!is_empty_image(resultImage.get()))
+              animation[i] = resultImage;
+          }
+        });
     }
 
     if (animation.size() == 0) {
@@ -528,6 +540,9 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
 
     // Add all frames+cels to the new layer
     for (size_t i=0; i<animation.size(); ++i) {
+      if (!animation[i])
+        continue;
+
       // Create the cel.
       std::unique_ptr<Cel> resultCel(new Cel(frame_t(i), animation[i]));
 
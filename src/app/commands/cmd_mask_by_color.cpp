@@ -28,6 +28,7 @@
 #include "base/chrono.h"
 #include "base/convert_to.h"
 #include "base/scoped_value.h"
+#include "doc/color_distance_map.h"
 #include "doc/image.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
@@ -79,6 +80,11 @@ private:
   Slider* m_sliderTolerance = nullptr;
   SelModeField* m_selMode = nullptr;
   bool m_isOrigMaskVisible;
+
+  // Distances of the image pixels to the selected color, so we can
+  // re-generate the mask for a new tolerance/selection mode without
+  // comparing the image pixels again.
+  doc::ColorDistanceMap m_distances;
 };
 
 MaskByColorCommand::MaskByColorCommand()
@@ -207,6 +213,8 @@ void MaskByColorCommand::onExecute(Context* context)
 
   // Save window configuration.
   save_window_pos(m_window, ConfigSection);
+
+  m_distances.clear();
 }
 
 Mask* MaskByColorCommand::generateMask(const Mask& origMask,
@@ -219,8 +227,11 @@ Mask* MaskByColorCommand::generateMask(const Mask& origMask,
                                            sprite->pixelFormat());
   int tolerance = m_sliderTolerance->getValue();
 
+  if (!m_distances.isFor(image, color))
+    m_distances.build(image, color);
+
   std::unique_ptr<Mask> mask(new Mask());
-  mask->byColor(image, color, tolerance);
+  mask->byColor(m_distances, tolerance);
   mask->offsetOrigin(xpos, ypos);
 
   if (!origMask.isEmpty() && m_isOrigMaskVisible) {
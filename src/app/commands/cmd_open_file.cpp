@@ -27,13 +27,32 @@
 #include "app/ui_context.h"
 #include "base/fs.h"
 #include "base/thread.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <vector>
 
 namespace app {
 
+// Loads the file from the disk (it's called from a background thread).
+static void load_file(FileOp* fop, IFileOpProgress* progress)
+{
+  try {
+    fop->operate(progress);
+  }
+  catch (const std::exception& e) {
+    fop->setError("Error loading file:\n%s", e.what());
+  }
+
+  if (fop->isStop() && fop->document())
+    delete fop->releaseDocument();
+
+  fop->done();
+}
+
 class OpenFileJob : public Job, public IFileOpProgress {
 public:
   OpenFileJob(FileOp* fop, const bool showProgress)
@@ -54,17 +73,7 @@ public:
 private:
   // Thread to do the hard work: load the file from the disk.
   virtual void onJob() override {
-    try {
-      m_fop->operate(this);
-    }
-    catch (const std::exception& e) {
-      m_fop->setError("Error loading file:\n%s", e.what());
-    }
-
-    if (m_fop->isStop() && m_fop->document())
-      delete m_fop->releaseDocument();
-
-    m_fop->done();
+    load_file(m_fop, this);
   }
 
   virtual void ackFileOpProgress(double progress) override {
@@ -79,6 +88,8 @@ OpenFileCommand::OpenFileCommand()
   , m_ui(true)
   , m_repeatCheckbox(false)
   , m_oneFrame(false)
+  , m_metadataOnly(false)
+  , m_jobs(1)
   , m_seqDecision(gen::SequenceDecision::ASK)
 {
 }
@@ -95,6 +106,7 @@ void OpenFileCommand::onLoadParams(const Params& params)
 
   m_repeatCheckbox = params.get_as<bool>("repeat_checkbox");
   m_oneFrame = params.get_as<bool>("oneframe");
+  m_metadataOnly = params.get_as<bool>("metadataonly");
 
   std::string sequence = params.get("sequence");
   if (m_oneFrame ||
@@ -116,11 +128,17 @@ void OpenFileCommand::onExecute(Context* context)
   Console console;
 
   m_usedFiles.clear();
+  m_openedFiles.clear();
 
   base::paths filenames;
 
+  // Files specified with setFilenames()
+  if (!m_filenames.empty()) {
+    filenames = std::move(m_filenames);
+    m_filenames.clear();
+  }
   // interactive
-  if (context->isUIAvailable() && m_filename.empty()) {
+  else if (context->isUIAvailable() && m_filename.empty()) {
     base::paths exts = get_readable_extensions();
 
     // Add backslash as show_file_selector() expected a filename as
@@ -179,25 +197,43 @@ void OpenFileCommand::onExecute(Context* context)
   if (m_oneFrame)
     flags |= FILE_LOAD_ONE_FRAME;
 
-  std::string filename;
-  while (!filenames.empty()) {
-    filename = filenames[0];
-    filenames.erase(filenames.begin());
+  if (m_metadataOnly)
+    flags |= FILE_LOAD_METADATA_ONLY;
+
+  const int jobs = std::max(1, m_jobs);
+  bool stop = false;
+  while (!filenames.empty() && !stop) {
+    // Create the next "jobs" file operations to load them at the
+    // same time
+    std::vector<std::unique_ptr<FileOp>> fops;
+    std::vector<std::size_t> fopOpenedFiles; // Index in m_openedFiles of each fop
+    while (!filenames.empty() && int(fops.size()) < jobs) {
+      const std::string filename = filenames[0];
+      filenames.erase(filenames.begin());
+
+      std::unique_ptr<FileOp> fop(
+        FileOp::createLoadDocumentOperation(
+          context, filename, flags));
+
+      // Do nothing (the user cancelled or something like that)
+      if (!fop) {
+        stop = true;
+        break;
+      }
 
-    std::unique_ptr<FileOp> fop(
-      FileOp::createLoadDocumentOperation(
-        context, filename, flags));
-    bool unrecent = false;
+      fop->setLoadROI(m_loadROI);
 
-    // Do nothing (the user cancelled or something like that)
-    if (!fop)
-      return;
+      if (fop->hasError()) {
+        console.printf(fop->error().c_str());
+        m_openedFiles.push_back({ filename, nullptr });
+
+        // The file was not found so we can remove it from the
+        // recent-file list
+        if (context->isUIAvailable())
+          App::instance()->recentFiles()->removeRecentFile(m_filename);
+        continue;
+      }
 
-    if (fop->hasError()) {
-      console.printf(fop->error().c_str());
-      unrecent = true;
-    }
-    else {
       if (fop->isSequence()) {
         if (fop->sequenceFlags() & FILE_LOAD_SEQUENCE_YES) {
           m_seqDecision = gen::SequenceDecision::YES;
@@ -224,8 +260,31 @@ void OpenFileCommand::onExecute(Context* context)
         m_usedFiles.push_back(fn);
       }
 
-      OpenFileJob task(fop.get(), m_ui);
+      fopOpenedFiles.push_back(m_openedFiles.size());
+      m_openedFiles.push_back({ filename, nullptr });
+      fops.push_back(std::move(fop));
+    }
+
+    if (fops.size() == 1) {
+      OpenFileJob task(fops[0].get(), m_ui);
       task.showProgressWindow();
+    }
+    else if (fops.size() > 1) {
+      // Decode all files in parallel (without progress window)
+      doc::TaskGroup tasks;
+      for (auto& fop : fops) {
+        FileOp* fopPtr = fop.get();
+        tasks.run([fopPtr](base::task_token&){
+          load_file(fopPtr, nullptr);
+        });
+      }
+      tasks.wait();
+    }
+
+    // Post-load processing (in the same order of the given files)
+    for (std::size_t i=0; i<fops.size(); ++i) {
+      FileOp* fop = fops[i].get();
+      bool unrecent = false;
 
       // Post-load processing, it is called from the GUI because may require user intervention.
       fop->postLoad();
@@ -255,16 +314,17 @@ void OpenFileCommand::onExecute(Context* context)
         }
 
         doc->setContext(context);
+        m_openedFiles[fopOpenedFiles[i]].document = doc;
       }
       else if (!fop->isStop())
         unrecent = true;
-    }
 
-    // The file was not found or was loaded loaded with errors,
-    // so we can remove it from the recent-file list
-    if (unrecent) {
-      if (context->isUIAvailable())
-        App::instance()->recentFiles()->removeRecentFile(m_filename);
+      // The file was loaded with errors, so we can remove it from
+      // the recent-file list
+      if (unrecent) {
+        if (context->isUIAvailable())
+          App::instance()->recentFiles()->removeRecentFile(m_filename);
+      }
     }
   }
 }
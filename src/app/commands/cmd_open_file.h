@@ -11,25 +11,59 @@
 
 #include "app/commands/command.h"
 #include "app/commands/params.h"
+#include "app/file/file_op_load_roi.h"
 #include "app/pref/preferences.h"
 #include "base/paths.h"
 
 #include <string>
+#include <vector>
 
 namespace app {
 
+  class Doc;
+
   class OpenFileCommand : public Command {
   public:
     OpenFileCommand();
 
+    // A file given to the command and the document loaded from it.
+    struct OpenedFile {
+      std::string filename;
+      Doc* document;            // nullptr if the file couldn't be loaded
+    };
+
     const base::paths& usedFiles() const {
       return m_usedFiles;
     }
 
+    // Files given to the last execution of the command (without the
+    // files used as part of a sequence of images) in the same order.
+    const std::vector<OpenedFile>& openedFiles() const {
+      return m_openedFiles;
+    }
+
     gen::SequenceDecision seqDecision() const {
       return m_seqDecision;
     }
 
+    // Subset of the files to be loaded by the next execution of the
+    // command (it cannot be specified with params).
+    void setLoadROI(const FileOpLoadROI& roi) {
+      m_loadROI = roi;
+    }
+
+    // Files to be loaded by the next execution of the command
+    // (replaces the "filename" param).
+    void setFilenames(const base::paths& filenames) {
+      m_filenames = filenames;
+    }
+
+    // Number of files that can be loaded at the same time (in
+    // parallel) by the next executions of the command.
+    void setJobs(const int jobs) {
+      m_jobs = jobs;
+    }
+
   protected:
     void onLoadParams(const Params& params) override;
     void onExecute(Context* context) override;
@@ -41,7 +75,12 @@ namespace app {
     bool m_ui;
     bool m_repeatCheckbox;
     bool m_oneFrame;
+    bool m_metadataOnly;
+    FileOpLoadROI m_loadROI;
+    base::paths m_filenames;
+    int m_jobs;
     base::paths m_usedFiles;
+    std::vector<OpenedFile> m_openedFiles;
     gen::SequenceDecision m_seqDecision;
   };
 
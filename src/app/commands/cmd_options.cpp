@@ -376,6 +376,9 @@ public:
     if (m_pref.general.showFullPath())
       showFullPath()->setSelected(true);
 
+    asepriteCompression()->setSelectedItemIndex(
+      static_cast<int>(m_pref.saveFile.asepriteCompression()));
+
     dataRecoveryPeriod()->setSelectedItemIndex(
       dataRecoveryPeriod()->findItemIndexByValue(
         base::convert_to<std::string>(m_pref.general.dataRecoveryPeriod())));
@@ -671,6 +674,8 @@ public:
 
     m_globPref.timeline.firstFrame(firstFrame()->textInt());
     m_pref.general.showFullPath(showFullPath()->isSelected());
+    m_pref.saveFile.asepriteCompression(
+      static_cast<app::gen::AsepriteCompression>(asepriteCompression()->getSelectedItemIndex()));
     m_pref.saveFile.defaultExtension(getExtension(defaultExtension()));
     m_pref.exportFile.imageDefaultExtension(getExtension(exportImageDefaultExtension()));
     m_pref.exportFile.animationDefaultExtension(getExtension(exportAnimationDefaultExtension()));
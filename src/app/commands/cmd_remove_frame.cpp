@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -58,9 +58,20 @@ void RemoveFrameCommand::onExecute(Context* context)
     const Site* site = writer.site();
     if (site->inTimeline() &&
         !site->selectedFrames().empty()) {
+      // Remove each range of consecutive selected frames at once
+      // (from the last one, so the previous frames are not displaced)
+      frame_t first = -1, last = -1;
       for (frame_t frame : site->selectedFrames().reversed()) {
-        api.removeFrame(sprite, frame);
+        if (frame == first-1) {
+          first = frame;
+          continue;
+        }
+        if (first >= 0)
+          api.removeFrames(sprite, first, last-first+1);
+        first = last = frame;
       }
+      if (first >= 0)
+        api.removeFrames(sprite, first, last-first+1);
     }
     else {
       api.removeFrame(sprite, writer.frame());
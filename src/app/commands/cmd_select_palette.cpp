@@ -142,13 +142,14 @@ void SelectPaletteColorsCommand::onExecute(Context* context)
           octreemap.feedWithImage(image, true, image->maskColor(), 8);
           break;
 
-        case IMAGE_INDEXED:
-          doc::for_each_pixel<IndexedTraits>(
-            image,
-            [&usedEntries](const color_t p) {
-              usedEntries[p] = true;
-            });
+        case IMAGE_INDEXED: {
+          const Image::IndexHistogram& histogram = image->indexHistogram();
+          for (int i=0; i<int(histogram.size()); ++i) {
+            if (histogram[i] > 0 && i < usedEntries.size())
+              usedEntries[i] = true;
+          }
           break;
+        }
       }
     };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -34,6 +34,8 @@
 
 #include "outline.xml.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace app::skin;
@@ -45,6 +47,7 @@ struct OutlineParams : public NewParams {
   Param<filters::Target> channels { this, 0, "channels" };
   Param<filters::OutlineFilter::Place> place { this, OutlineFilter::Place::Outside, "place" };
   Param<filters::OutlineFilter::Matrix> matrix { this, OutlineFilter::Matrix::Circle, "matrix" };
+  Param<int> thickness { this, 1, "thickness" };
   Param<app::Color> color { this, app::Color(), "color" };
   Param<app::Color> bgColor { this, app::Color(), "bgColor" };
   Param<filters::TiledMode> tiledMode { this, filters::TiledMode::NONE, "tiledMode" };
@@ -77,6 +80,7 @@ private:
 };
 
 static const char* ConfigSection = "Outline";
+static const int kMaxThickness = 100;
 
 class OutlineWindow : public FilterWindow {
 public:
@@ -92,6 +96,7 @@ public:
     m_panel.color()->setColor(m_filter.color());
     m_panel.bgColor()->setColor(m_filter.bgColor());
     m_panel.place()->setSelectedItem((int)m_filter.place());
+    m_panel.thickness()->setTextf("%d", m_filter.thickness());
     updateButtonsFromMatrix();
 
     m_panel.color()->Change.connect(&OutlineWindow::onColorChange, this);
@@ -108,6 +113,10 @@ public:
       [this](ButtonSet::Item*){
         onPlaceChange((OutlineFilter::Place)m_panel.place()->selectedItem());
       });
+    m_panel.thickness()->Change.connect(
+      [this]{
+        onThicknessChange(m_panel.thickness()->textInt());
+      });
   }
 
 private:
@@ -152,6 +161,12 @@ private:
     restartPreview();
   }
 
+  void onThicknessChange(const int thickness) {
+    stopPreview();
+    m_filter.thickness(std::clamp(thickness, 1, kMaxThickness));
+    restartPreview();
+  }
+
   void onMatrixTypeChange() {
     stopPreview();
 
@@ -224,6 +239,7 @@ void OutlineCommand::onExecute(Context* context)
   if (ui) {
     filter.place((OutlineFilter::Place)get_config_int(ConfigSection, "Place", int(OutlineFilter::Place::Outside)));
     filter.matrix((OutlineFilter::Matrix)get_config_int(ConfigSection, "Matrix", int(OutlineFilter::Matrix::Circle)));
+    filter.thickness(std::clamp(get_config_int(ConfigSection, "Thickness", 1), 1, kMaxThickness));
     filter.color(ColorBar::instance()->getFgColor());
 
     DocumentPreferences& docPref = Preferences::instance()
@@ -233,6 +249,7 @@ void OutlineCommand::onExecute(Context* context)
 
   if (params().place.isSet()) filter.place(params().place());
   if (params().matrix.isSet()) filter.matrix(params().matrix());
+  if (params().thickness.isSet()) filter.thickness(std::clamp(params().thickness(), 1, kMaxThickness));
   if (params().color.isSet()) filter.color(params().color());
   if (params().bgColor.isSet()) filter.bgColor(params().bgColor());
   if (params().tiledMode.isSet()) filter.tiledMode(params().tiledMode());
@@ -254,6 +271,7 @@ void OutlineCommand::onExecute(Context* context)
     if (window.doModal()) {
       set_config_int(ConfigSection, "Place", int(filter.place()));
       set_config_int(ConfigSection, "Matrix", int(filter.matrix()));
+      set_config_int(ConfigSection, "Thickness", filter.thickness());
     }
   }
   else {
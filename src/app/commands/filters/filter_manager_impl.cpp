@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -35,14 +35,19 @@
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
+#include "doc/trace.h"
 #include "filters/filter.h"
 #include "ui/manager.h"
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <set>
 
 namespace app {
@@ -50,6 +55,83 @@ namespace app {
 using namespace std;
 using namespace ui;
 
+class FilterManagerImpl::RowManager : public FilterManager {
+public:
+  RowManager(FilterManagerImpl* parent,
+             const doc::Image* src,
+             doc::Image* dst,
+             const Target target,
+             const int row)
+    : m_parent(parent)
+    , m_src(src)
+    , m_dst(dst)
+    , m_target(target)
+    , m_row(row)
+    , m_bounds(parent->m_bounds)
+    , m_mask(parent->m_mask && parent->m_mask->bitmap() ?
+             parent->m_mask: nullptr) {
+  }
+
+  // Locks the mask bits of this row (the same area that applyStep()
+  // locks). Returns false if the row is outside the mask.
+  bool lockMask() {
+    if (!m_mask)
+      return true;
+
+    int x = m_bounds.x - m_mask->bounds().x;
+    int y = m_bounds.y - m_mask->bounds().y + m_row;
+    if ((x >= m_bounds.w) ||
+        (y >= m_bounds.h))
+      return false;
+
+    m_maskBits = m_mask->bitmap()
+      ->lockBits<BitmapTraits>(Image::ReadLock,
+        gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
+
+    m_maskIterator = m_maskBits.begin();
+    return true;
+  }
+
+  doc::PixelFormat pixelFormat() const override {
+    return m_parent->pixelFormat();
+  }
+  const void* getSourceAddress() override {
+    return m_src->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
+  }
+  void* getDestinationAddress() override {
+    return m_dst->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
+  }
+  int getWidth() override { return m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return m_parent; }
+  bool skipPixel() override {
+    bool skip = false;
+    if (m_mask) {
+      if (!*m_maskIterator)
+        skip = true;
+      ++m_maskIterator;
+    }
+    return skip;
+  }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return m_bounds.x; }
+  int y() const override { return m_bounds.y+m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_parent->isMaskActive(); }
+  base::task_token& taskToken() const override { return m_parent->taskToken(); }
+
+private:
+  FilterManagerImpl* m_parent;
+  const doc::Image* m_src;
+  doc::Image* m_dst;
+  Target m_target;
+  int m_row;
+  gfx::Rect m_bounds;
+  doc::Mask* m_mask;
+  doc::ImageBits<doc::BitmapTraits> m_maskBits;
+  doc::ImageBits<doc::BitmapTraits>::iterator m_maskIterator;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_reader(context)
   , m_site(*const_cast<Site*>(m_reader.site()))
@@ -202,61 +284,64 @@ bool FilterManagerImpl::applyStep()
   return true;
 }
 
+bool FilterManagerImpl::applyPreviewStep()
+{
+  // The first row is applied with applyStep() to apply the filter to
+  // the palette.
+  if (m_row <= 0)
+    return applyStep();
+
+  if (m_row >= m_bounds.h)
+    return false;
+
+  // The pixels will not change, we can skip the rest of rows
+  // directly (flush() will redraw the whole area with the new
+  // palette).
+  if (modifiesOnlyPalette()) {
+    m_row = m_bounds.h;
+    return true;
+  }
+
+  if (!canApplyRowsInParallel())
+    return applyStep();
+
+  const int grain = rowsGrain();
+  const int end = std::min(m_bounds.h,
+                           m_row + grain * doc::parallel_concurrency());
+
+  doc::parallel_for(
+    m_row, end, grain,
+    [this](const int begin, const int end) {
+      applyRows(m_src.get(), m_dst.get(), m_target, begin, end);
+    });
+
+  m_row = end;
+  return true;
+}
+
 void FilterManagerImpl::apply()
 {
   CommandResult result;
   bool cancelled = false;
 
   begin();
-  while (!cancelled && applyStep()) {
-    if (m_progressDelegate) {
-      // Report progress.
-      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_bounds.h);
-
-      // Does the user cancelled the whole process?
-      cancelled = m_progressDelegate->isCancelled();
-    }
+  if (canApplyRowsInParallel()) {
+    cancelled = !applyRowsInParallel();
   }
+  else {
+    while (!cancelled && applyStep()) {
+      if (m_progressDelegate) {
+        // Report progress.
+        m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_bounds.h);
 
-  if (!cancelled) {
-    gfx::Rect output;
-    if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
-                                  m_bounds, output)) {
-      if (m_cel->layer()->isTilemap()) {
-        modify_tilemap_cel_region(
-          *m_tx,
-          m_cel, nullptr,
-          gfx::Region(output),
-          m_site.tilesetMode(),
-          [this](const doc::ImageRef& origTile,
-                 const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
-            return ImageRef(
-              crop_image(m_dst.get(),
-                         tileBoundsInCanvas.x,
-                         tileBoundsInCanvas.y,
-                         tileBoundsInCanvas.w,
-                         tileBoundsInCanvas.h,
-                         m_dst->maskColor()));
-          });
-      }
-      else if (m_cel->layer()->isBackground()) {
-        (*m_tx)(
-          new cmd::CopyRegion(
-            m_cel->image(),
-            m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-      else {
-        // Patch "m_cel"
-        (*m_tx)(
-          new cmd::PatchCel(
-            m_cel, m_dst.get(),
-            gfx::Region(output),
-            position()));
+        // Does the user cancelled the whole process?
+        cancelled = m_progressDelegate->isCancelled();
       }
     }
+  }
 
+  if (!cancelled) {
+    addCelChangesToTransaction();
     result = CommandResult(CommandResult::kOk);
   }
   else {
@@ -267,8 +352,52 @@ void FilterManagerImpl::apply()
   m_reader.context()->setCommandResult(result);
 }
 
+// Adds the commands to patch m_cel with the modified pixels of m_dst.
+void FilterManagerImpl::addCelChangesToTransaction()
+{
+  gfx::Rect output;
+  if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
+                                m_bounds, output)) {
+    if (m_cel->layer()->isTilemap()) {
+      modify_tilemap_cel_region(
+        *m_tx,
+        m_cel, nullptr,
+        gfx::Region(output),
+        m_site.tilesetMode(),
+        [this](const doc::ImageRef& origTile,
+               const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
+          return ImageRef(
+            crop_image(m_dst.get(),
+                       tileBoundsInCanvas.x,
+                       tileBoundsInCanvas.y,
+                       tileBoundsInCanvas.w,
+                       tileBoundsInCanvas.h,
+                       m_dst->maskColor()));
+        });
+    }
+    else if (m_cel->layer()->isBackground()) {
+      (*m_tx)(
+        new cmd::CopyRegion(
+          m_cel->image(),
+          m_dst.get(),
+          gfx::Region(output),
+          position()));
+    }
+    else {
+      // Patch "m_cel"
+      (*m_tx)(
+        new cmd::PatchCel(
+          m_cel, m_dst.get(),
+          gfx::Region(output),
+          position()));
+    }
+  }
+}
+
 void FilterManagerImpl::applyToTarget()
 {
+  DOC_TRACE_ZONE("filter apply");
+
   applyToPaletteIfNeeded();
 
   const bool paletteChange = paletteHasChanged();
@@ -301,6 +430,11 @@ void FilterManagerImpl::applyToTarget()
     }
   }
 
+  // Indexed images without selection are filtered just changing the
+  // palette, so there is no need to process each cel.
+  if (modifiesOnlyPalette())
+    cels.clear();
+
   if (cels.empty() && !paletteChange) {
     // We don't have images/palette changes to do (there will not be a
     // transaction).
@@ -321,9 +455,14 @@ void FilterManagerImpl::applyToTarget()
                           m_site.frame(), &newPalette));
   }
 
+  // Apply the filter to several cels at the same time
+  const bool parallel = canApplyCelsInParallel(cels);
+  if (parallel)
+    cancelled = !applyToCelsInParallel(cels, visited);
+
   // For each target image
   for (auto it = cels.begin();
-       it != cels.end() && !cancelled;
+       it != cels.end() && !cancelled && !parallel;
        ++it) {
     Image* image = (*it)->image();
 
@@ -418,6 +557,206 @@ void FilterManagerImpl::disablePreview()
   }
 }
 
+bool FilterManagerImpl::modifiesOnlyPalette() const
+{
+  return m_filter->modifiesOnlyPalette(this);
+}
+
+bool FilterManagerImpl::canApplyRowsInParallel() const
+{
+  // Indexed images are filtered serially because the RgbMap used to
+  // find the nearest palette entries isn't thread-safe.
+  return (m_filter->isThreadSafe() &&
+          m_site.sprite()->pixelFormat() != IMAGE_INDEXED &&
+          m_bounds.h > 1 &&
+          doc::parallel_concurrency() > 1);
+}
+
+// Applies the filter to the whole m_bounds distributing bands of rows
+// in several threads. Returns false if the process was cancelled.
+bool FilterManagerImpl::applyRowsInParallel()
+{
+  // The first row is applied in this thread to apply the filter to
+  // the palette (if needed) before the rest of rows.
+  if (!applyStep())
+    return true;
+
+  const int h = m_bounds.h;
+  std::atomic<int> rowsDone(1);
+  std::atomic<bool> cancelled(false);
+  std::mutex progressMutex;
+
+  doc::parallel_for(
+    1, h, rowsGrain(),
+    [this, h, &rowsDone, &cancelled, &progressMutex](const int begin, const int end) {
+      if (cancelled)
+        return;
+
+      applyRows(m_src.get(), m_dst.get(), m_target, begin, end);
+
+      const int done = (rowsDone += end - begin);
+      if (m_progressDelegate) {
+        const std::lock_guard lock(progressMutex);
+        m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * done / h);
+        if (m_progressDelegate->isCancelled())
+          cancelled = true;
+      }
+    });
+
+  m_row = h;
+  return !cancelled;
+}
+
+// Number of rows processed by each parallel task (around 64K pixels).
+int FilterManagerImpl::rowsGrain() const
+{
+  return std::max(1, 65536 / std::max(1, m_bounds.w));
+}
+
+// Applies the filter to the [begin, end) rows of m_bounds from "src"
+// to "dst". It can be called from any thread.
+void FilterManagerImpl::applyRows(const Image* src, Image* dst,
+                                  const Target target,
+                                  const int begin, const int end)
+{
+  const PixelFormat pixelFormat = m_site.sprite()->pixelFormat();
+  for (int row=begin; row<end; ++row) {
+    RowManager rowMgr(this, src, dst, target, row);
+    if (!rowMgr.lockMask())
+      break;
+
+    switch (pixelFormat) {
+      case IMAGE_RGB:       m_filter->applyToRgba(&rowMgr); break;
+      case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(&rowMgr); break;
+      case IMAGE_INDEXED:   m_filter->applyToIndexed(&rowMgr); break;
+    }
+  }
+}
+
+bool FilterManagerImpl::canApplyCelsInParallel(const CelList& cels) const
+{
+  return (cels.size() > 1 &&
+          m_filter->isThreadSafe() &&
+          m_site.sprite()->pixelFormat() != IMAGE_INDEXED &&
+          doc::parallel_concurrency() > 1);
+}
+
+// Applies the filter to several cels at the same time. The cels are
+// processed in batches (limited by kMaxBatchBytes of source+destination
+// pixels) and the undo commands for each batch are added to the
+// transaction in the same order as the cels in the list. Returns false
+// if the process was cancelled.
+bool FilterManagerImpl::applyToCelsInParallel(const CelList& cels,
+                                              std::set<ObjectId>& visited)
+{
+  const size_t kMaxBatchBytes = 128*1024*1024;
+
+  struct CelJob {
+    Cel* cel;
+    ImageRef src;
+    ImageRef dst;
+    Target target;
+  };
+
+  Doc* doc = m_site.document();
+  m_mask = (doc->isMaskVisible() ? doc->mask(): nullptr);
+  m_taskToken = &m_noToken;
+  if (!updateBounds(m_mask))
+    throw InvalidAreaException();
+
+  // Apply the filter to the palette (this is done in the first row
+  // when cels are processed one by one).
+  applyToPaletteIfNeeded();
+
+  const int h = m_bounds.h;
+  const int ncels = int(cels.size());
+  std::vector<CelJob> jobs;
+  std::atomic<bool> cancelled(false);
+  std::mutex progressMutex;
+  int celsDone = 0;
+
+  for (auto it = cels.begin(); it != cels.end() && !cancelled; ) {
+    // Create the source and destination images of the next batch of
+    // cels in this thread (crop_cel_image() can render tilemaps).
+    jobs.clear();
+    size_t batchBytes = 0;
+    for (; it != cels.end() &&
+           (jobs.empty() || batchBytes < kMaxBatchBytes); ++it) {
+      Cel* cel = *it;
+      Image* image = cel->image();
+
+      // Avoid applying the filter two times to the same image
+      if (visited.find(image->id()) != visited.end()) {
+        ++celsDone;
+        continue;
+      }
+      visited.insert(image->id());
+
+      CelJob job;
+      job.cel = cel;
+      job.src = crop_cel_image(cel, 0);
+      job.dst.reset(Image::createCopy(job.src.get()));
+      job.target = m_targetOrig;
+      // The alpha channel of the background layer can't be modified
+      if (cel->layer()->isBackground())
+        job.target &= ~TARGET_ALPHA_CHANNEL;
+
+      batchBytes += 2 * job.src->getMemSize();
+      jobs.push_back(std::move(job));
+    }
+
+    // Each task applies a band of rows of one cel of the batch
+    const int rowsPerTask = rowsGrain();
+    const int tasksPerCel = (h + rowsPerTask - 1) / rowsPerTask;
+    std::vector<std::atomic<int>> rowsLeft(jobs.size());
+    for (auto& rows : rowsLeft)
+      rows = h;
+
+    doc::parallel_for(
+      0, int(jobs.size()) * tasksPerCel, 1,
+      [&](const int begin, const int end) {
+        for (int i=begin; i<end && !cancelled; ++i) {
+          const int j = i / tasksPerCel;
+          const int row = (i % tasksPerCel) * rowsPerTask;
+          const int rowEnd = std::min(row + rowsPerTask, h);
+          CelJob& job = jobs[j];
+
+          applyRows(job.src.get(), job.dst.get(), job.target, row, rowEnd);
+
+          if ((rowsLeft[j] -= rowEnd - row) == 0 && m_progressDelegate) {
+            const std::lock_guard lock(progressMutex);
+            ++celsDone;
+            m_progressDelegate->reportProgress(float(celsDone) / ncels);
+            if (m_progressDelegate->isCancelled())
+              cancelled = true;
+          }
+        }
+      });
+
+    if (cancelled)
+      break;
+
+    // Add the undo commands in the original order of cels
+    for (CelJob& job : jobs) {
+      m_cel = job.cel;
+      m_src = job.src;
+      m_dst = job.dst;
+      m_target = job.target;
+      addCelChangesToTransaction();
+    }
+  }
+
+  m_cel = nullptr;
+  m_src.reset();
+  m_dst.reset();
+  m_row = -1;
+  m_target = m_targetOrig;
+  m_reader.context()->setCommandResult(
+    CommandResult(cancelled ? CommandResult::kCanceled:
+                              CommandResult::kOk));
+  return !cancelled;
+}
+
 const void* FilterManagerImpl::getSourceAddress()
 {
   return m_src->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
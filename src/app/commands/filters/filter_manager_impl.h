@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,8 +15,10 @@
 #include "app/tx.h"
 #include "base/exception.h"
 #include "base/task.h"
+#include "doc/cel_list.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
+#include "doc/object_id.h"
 #include "doc/pixel_format.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
@@ -24,6 +26,7 @@
 
 #include <cstring>
 #include <memory>
+#include <set>
 #include <vector>
 
 namespace doc {
@@ -88,6 +91,17 @@ namespace app {
     bool applyStep();
     void applyToTarget();
 
+    // Applies the next band of rows of the preview, in several
+    // threads if the filter is thread-safe (or just one row with
+    // applyStep() in other case). Returns false when there are no
+    // more rows.
+    bool applyPreviewStep();
+
+    // Returns true if the filter will only modify the palette of the
+    // sprite (e.g. color adjustments of indexed images without
+    // selection), so the cels are not processed.
+    bool modifiesOnlyPalette() const;
+
     void initTransaction();
     bool isTransaction() const;
     void commitTransaction();
@@ -126,8 +140,22 @@ namespace app {
     doc::PalettePicks getPalettePicks() override;
 
   private:
+    // FilterManager used to apply the filter to one specific row from
+    // a worker thread (see applyRowsInParallel()).
+    class RowManager;
+
     void init(doc::Cel* cel);
     void apply();
+    bool canApplyRowsInParallel() const;
+    bool applyRowsInParallel();
+    int rowsGrain() const;
+    void applyRows(const doc::Image* src, doc::Image* dst,
+                   const Target target,
+                   const int begin, const int end);
+    bool canApplyCelsInParallel(const doc::CelList& cels) const;
+    bool applyToCelsInParallel(const doc::CelList& cels,
+                               std::set<doc::ObjectId>& visited);
+    void addCelChangesToTransaction();
     void applyToCel(doc::Cel* cel);
     bool updateBounds(doc::Mask* mask);
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -156,7 +156,7 @@ void FilterPreview::onFilterTask(base::task_token& token)
   while (!token.canceled()) {
     {
       std::scoped_lock lock(m_filterMgrMutex);
-      if (!m_filterMgr->applyStep())
+      if (!m_filterMgr->applyPreviewStep())
         token.cancel();
     }
     base::this_thread::yield();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -46,6 +46,7 @@ FilterWindow::FilterWindow(const char* title, const char* cfgSection,
   , m_tiledCheck(withTiled == WithTiledCheckBox ?
                    new CheckBox(Strings::filters_tiled()) :
                    nullptr)
+  , m_paletteOnlyLabel(nullptr)
   , m_editor(nullptr)
   , m_oldTool(nullptr)
 {
@@ -85,6 +86,13 @@ FilterWindow::FilterWindow(const char* title, const char* cfgSection,
     m_vbox.addChild(m_tiledCheck);
   }
 
+  // Tell the user that the pixels will not be modified (just the
+  // palette colors).
+  if (filterMgr->modifiesOnlyPalette()) {
+    m_paletteOnlyLabel = new Label(Strings::filters_palette_only());
+    m_vbox.addChild(m_paletteOnlyLabel);
+  }
+
   // Load "Preview" check status.
   m_showPreview.setSelected(get_config_bool(m_cfgSection, "Preview", true));
 
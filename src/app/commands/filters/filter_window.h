@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "filters/tiled_mode.h"
 #include "ui/box.h"
 #include "ui/button.h"
+#include "ui/label.h"
 #include "ui/window.h"
 
 namespace app {
@@ -87,6 +88,7 @@ namespace app {
     FilterTargetButtons m_targetButton;
     ui::CheckBox m_showPreview;
     ui::CheckBox* m_tiledCheck;
+    ui::Label* m_paletteOnlyLabel;
     Editor* m_editor;
     tools::Tool* m_oldTool;
   };
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,7 +17,7 @@
 #include "app/modules/gui.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/status_bar.h"
-#include "base/thread.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
@@ -25,7 +25,6 @@
 #include <cstring>
 #include <functional>
 #include <mutex>
-#include <thread>
 
 namespace app {
 
@@ -123,11 +122,11 @@ void FilterWorker::run()
   // Initialize writting transaction
   m_filterMgr->initTransaction();
 
-  std::thread thread;
+  doc::TaskGroup tasks;
   // Open the alert window in foreground (this is modal, locks the main thread)
   if (m_alert) {
-    // Launch the thread to apply the effect in background
-    thread = std::thread([this]{ applyFilterInBackground(); });
+    // Launch a task to apply the effect in background
+    tasks.run([this](base::task_token&){ applyFilterInBackground(); });
     m_alert->openAndWait();
   }
   else {
@@ -137,15 +136,18 @@ void FilterWorker::run()
 
   {
     const std::lock_guard lock(m_mutex);
-    if (m_done && m_filterMgr->isTransaction())
+    if (m_done && m_filterMgr->isTransaction()) {
       m_filterMgr->commitTransaction();
-    else
+    }
+    else {
       m_cancelled = true;
+      // Don't start the background task if it's still queued
+      tasks.cancel();
+    }
   }
 
-  // Wait the `effect_bg' thread
-  if (thread.joinable())
-    thread.join();
+  // Wait the background task
+  tasks.wait();
 
   if (!m_error.empty()) {
     Console console;
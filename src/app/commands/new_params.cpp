@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -237,6 +237,8 @@ void Param<doc::RgbMapAlgorithm>::fromString(const std::string& value)
     setValue(doc::RgbMapAlgorithm::OCTREE);
   else if (base::utf8_icmp(value, "rgb5a3") == 0)
     setValue(doc::RgbMapAlgorithm::RGB5A3);
+  else if (base::utf8_icmp(value, "kdtree") == 0)
+    setValue(doc::RgbMapAlgorithm::KDTREE);
   else
     setValue(doc::RgbMapAlgorithm::DEFAULT);
 }
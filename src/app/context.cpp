@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "app/site.h"
 #include "app/util/clipboard.h"
 #include "base/scoped_value.h"
+#include "doc/image_buffer_pool.h"
 #include "doc/layer.h"
 #include "ui/system.h"
 
@@ -329,6 +330,9 @@ void Context::onCloseDocument(Doc* doc)
   ASSERT(doc != nullptr);
   ASSERT(doc->context() == nullptr);
   delete doc;
+
+  // Release the memory of the destroyed images
+  doc::image_buffer_pool_trim();
 }
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -30,6 +30,7 @@
 #include "base/chrono.h"
 #include "base/remove_from_container.h"
 #include "base/thread.h"
+#include "doc/trace.h"
 #include "ui/app_state.h"
 #include "ui/system.h"
 
@@ -185,6 +186,8 @@ void BackupObserver::backgroundThread()
 // Executed from the backgroundThread() (non-UI thread)
 bool BackupObserver::saveDocData(Doc* doc)
 {
+  DOC_TRACE_ZONE("backup document");
+
   try {
     if (!doc->needsBackup())
       return true;
@@ -0,0 +1,204 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/crash/image_delta.h"
+
+#include "app/crash/internals.h"
+#include "base/convert_to.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/serialization.h"
+#include "doc/cancel_io.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace app {
+namespace crash {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+using namespace doc;
+
+namespace {
+
+int tiles_per_row(const Image* image)
+{
+  return (image->width() + kImageDeltaTileSize - 1) / kImageDeltaTileSize;
+}
+
+gfx::Rect tile_bounds(const Image* image, const int tile)
+{
+  const int cols = tiles_per_row(image);
+  return gfx::Rect((tile % cols) * kImageDeltaTileSize,
+                   (tile / cols) * kImageDeltaTileSize,
+                   kImageDeltaTileSize,
+                   kImageDeltaTileSize).createIntersection(image->bounds());
+}
+
+// FNV-1a hash processing 8 bytes at a time
+uint64_t hash_bytes(uint64_t hash, const uint8_t* p, int n)
+{
+  const uint64_t kPrime = 0x100000001b3ull;
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    hash = (hash ^ v) * kPrime;
+  }
+  for (; n > 0; ++p, --n)
+    hash = (hash ^ *p) * kPrime;
+  return hash;
+}
+
+} // anonymous namespace
+
+int image_delta_tiles_count(const Image* image)
+{
+  const int rows = (image->height() + kImageDeltaTileSize - 1) / kImageDeltaTileSize;
+  return tiles_per_row(image) * rows;
+}
+
+void calculate_image_tile_hashes(const Image* image,
+                                 std::vector<uint64_t>& hashes)
+{
+  const int n = image_delta_tiles_count(image);
+  hashes.resize(n);
+  for (int i=0; i<n; ++i) {
+    const gfx::Rect rc = tile_bounds(image, i);
+    const int rowBytes = image->bytesPerPixel() * rc.w;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int y=rc.y; y<rc.y2(); ++y)
+      hash = hash_bytes(hash, image->getPixelAddress(rc.x, y), rowBytes);
+    hashes[i] = hash;
+  }
+}
+
+bool write_image_delta(std::ostream& os,
+                       const ObjectId id,
+                       const Image* image,
+                       const ObjectVersion baseVersion,
+                       const std::vector<int>& tiles,
+                       CancelIO* cancel)
+{
+  write32(os, id);
+  write32(os, baseVersion);
+  write8(os, image->pixelFormat());
+  write16(os, image->width());
+  write16(os, image->height());
+  write32(os, image->maskColor());
+  write16(os, kImageDeltaTileSize);
+  write32(os, tiles.size());
+
+  std::vector<uint8_t> pixels;
+  std::vector<uint8_t> compressed;
+
+  for (const int tile : tiles) {
+    if (cancel && cancel->isCanceled())
+      return false;
+
+    // Copy the tile pixels in a continuous buffer to compress them
+    const gfx::Rect rc = tile_bounds(image, tile);
+    const int rowBytes = image->bytesPerPixel() * rc.w;
+    pixels.resize(rowBytes * rc.h);
+    for (int y=0; y<rc.h; ++y)
+      std::copy_n(image->getPixelAddress(rc.x, rc.y+y), rowBytes,
+                  &pixels[y * rowBytes]);
+
+    uLongf compressedSize = compressBound(pixels.size());
+    compressed.resize(compressedSize);
+    int err = compress(&compressed[0], &compressedSize,
+                       &pixels[0], pixels.size());
+    if (err != Z_OK)
+      throw base::Exception("ZLib error %d in compress().", err);
+
+    write32(os, tile);
+    write32(os, compressedSize);
+    if (os.write((char*)&compressed[0], compressedSize).fail())
+      throw base::Exception("Error writing compressed image tile.\n");
+  }
+  return true;
+}
+
+Image* read_image_delta(std::istream& is,
+                        const std::string& dir)
+{
+  const ObjectId id = read32(is);
+  const ObjectVersion baseVersion = read32(is);
+  const int pixelFormat = read8(is);
+  const int width = read16(is);
+  const int height = read16(is);
+  const uint32_t maskColor = read32(is);
+  const int tileSize = read16(is);
+  const int ntiles = read32(is);
+
+  if (tileSize != kImageDeltaTileSize)
+    return nullptr;
+
+  std::string fn = base::join_path(
+    dir,
+    "img-" + base::convert_to<std::string>(id) +
+    "." + base::convert_to<std::string>(baseVersion));
+
+  std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+  if (read32(s) != MAGIC_NUMBER)
+    return nullptr;
+
+  std::unique_ptr<Image> image(read_image(s, false));
+  if (!image ||
+      image->pixelFormat() != pixelFormat ||
+      image->width() != width ||
+      image->height() != height)
+    return nullptr;
+
+  image->setMaskColor(maskColor);
+
+  const int total = image_delta_tiles_count(image.get());
+  std::vector<uint8_t> pixels;
+  std::vector<uint8_t> compressed;
+
+  for (int i=0; i<ntiles; ++i) {
+    const int tile = read32(is);
+    const uLong compressedSize = read32(is);
+    if (tile < 0 || tile >= total || is.fail())
+      return nullptr;
+
+    compressed.resize(compressedSize);
+    if (compressedSize > 0 &&
+        is.read((char*)&compressed[0], compressedSize).fail())
+      return nullptr;
+
+    const gfx::Rect rc = tile_bounds(image.get(), tile);
+    const int rowBytes = image->bytesPerPixel() * rc.w;
+    pixels.resize(rowBytes * rc.h);
+
+    uLongf pixelsSize = pixels.size();
+    int err = uncompress(&pixels[0], &pixelsSize,
+                         compressed.data(), compressedSize);
+    if (err != Z_OK || pixelsSize != pixels.size())
+      return nullptr;
+
+    for (int y=0; y<rc.h; ++y)
+      std::copy_n(&pixels[y * rowBytes], rowBytes,
+                  image->getPixelAddress(rc.x, rc.y+y));
+  }
+
+  // The pixels were modified directly
+  image->invalidateContentHash();
+  return image.release();
+}
+
+} // namespace crash
+} // namespace app
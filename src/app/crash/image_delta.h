@@ -0,0 +1,59 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CRASH_IMAGE_DELTA_H_INCLUDED
+#define APP_CRASH_IMAGE_DELTA_H_INCLUDED
+#pragma once
+
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace doc {
+  class CancelIO;
+  class Image;
+}
+
+namespace app {
+namespace crash {
+
+  // Size (in pixels) of the tiles used to detect which parts of an
+  // image were modified between two backups.
+  const int kImageDeltaTileSize = 128;
+
+  // Returns the number of tiles needed to cover the given image.
+  int image_delta_tiles_count(const doc::Image* image);
+
+  // Calculates a hash for each tile of the image (in row-major
+  // order), so we can compare them with the hashes of the base
+  // version of the image.
+  void calculate_image_tile_hashes(const doc::Image* image,
+                                   std::vector<uint64_t>& hashes);
+
+  // Writes a delta of the image: only the given tiles are written,
+  // the rest of the pixels are taken from the full "img-<id>.<base>"
+  // file when the image is restored. The "id" is the ID of the
+  // original image (the given image can be a copy of it).
+  bool write_image_delta(std::ostream& os,
+                         const doc::ObjectId id,
+                         const doc::Image* image,
+                         const doc::ObjectVersion baseVersion,
+                         const std::vector<int>& tiles,
+                         doc::CancelIO* cancel);
+
+  // Reads an image delta, the base image is loaded from the given
+  // directory. Returns nullptr if the base image cannot be loaded.
+  doc::Image* read_image_delta(std::istream& is,
+                               const std::string& dir);
+
+} // namespace crash
+} // namespace app
+
+#endif
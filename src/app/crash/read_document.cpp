@@ -12,6 +12,7 @@
 #include "app/crash/read_document.h"
 
 #include "app/console.h"
+#include "app/crash/image_delta.h"
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
 #include "app/doc.h"
@@ -31,6 +32,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/parallel.h"
 #include "doc/serial_format.h"
 #include "doc/slice.h"
 #include "doc/slice_io.h"
@@ -46,8 +48,11 @@
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
 
+#include <atomic>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -58,6 +63,10 @@ using namespace doc;
 
 namespace {
 
+// Part of the progress used to restore the document structure (the
+// rest is for the pixels of images)
+const float kCelsProgress = 0.25f;
+
 // Returns true if the file was saved correctly (has the "FINE" magic
 // number), so we can ignore broken versions of objects directly.
 bool check_magic_number(const std::string& fn)
@@ -145,10 +154,104 @@ private:
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
 
-    ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage));
+    // Here we read only the header of the image to create it, its
+    // pixels are loaded later (in parallel with other images) from
+    // loadAllImagesPixels().
+    Image* img = nullptr;
+    const ObjVersions& versions = m_objVersions[imageId];
+    for (size_t i=0; i<versions.size() && !img; ++i) {
+      ObjectVersion ver = versions[i];
+      if (!ver)
+        continue;
+
+      img = loadObjectVersion<Image*>("img", imageId, ver, &Reader::readImageHeader);
+      if (!img)
+        img = loadObjectVersion<Image*>("imgd", imageId, ver, &Reader::readImageDeltaHeader);
+    }
+    if (!img && !m_loadInfo)
+      Console().printf("Error loading object img #%d\n", imageId);
+
+    ImageRef image(img);
+    if (image)
+      m_imagesToLoad.push_back(std::make_pair(image, imageId));
     return m_images[imageId] = image;
   }
 
+  // Loads the pixels of all images created in getImageRef(). Each
+  // version of an image can be a full image ("img" file) or a delta
+  // over a full image ("imgd" file).
+  bool loadAllImagesPixels() {
+    const int n = int(m_imagesToLoad.size());
+    std::vector<char> failed(n, 0);
+    std::atomic<int> loaded(0);
+
+    doc::TaskGroup tasks;
+    for (int i=0; i<n; ++i) {
+      tasks.run(
+        [this, i, n, &failed, &loaded](base::task_token&){
+          if (canceled())
+            return;
+
+          const auto& pair = m_imagesToLoad[i];
+          if (!loadImagePixels(pair.second, pair.first.get()))
+            failed[i] = 1;
+
+          if (m_taskToken)
+            m_taskToken->set_progress(kCelsProgress +
+                                      (1.0f - kCelsProgress) * float(++loaded) / float(n));
+        });
+    }
+    tasks.wait();
+
+    if (canceled())
+      return false;
+
+    for (int i=0; i<n; ++i) {
+      if (failed[i]) {
+        Image* image = m_imagesToLoad[i].first.get();
+        image->clear(image->maskColor());
+        Console().printf("Error loading object img #%d\n", m_imagesToLoad[i].second);
+      }
+    }
+    m_imagesToLoad.clear();
+    return true;
+  }
+
+  // Executed from a worker thread, so we don't modify any member of
+  // the Reader here.
+  bool loadImagePixels(ObjectId imageId, Image* dst) {
+    auto it = m_objVersions.find(imageId);
+    if (it == m_objVersions.end())
+      return false;
+
+    const ObjVersions& versions = it->second;
+    for (size_t i=0; i<versions.size(); ++i) {
+      ObjectVersion ver = versions[i];
+      if (!ver)
+        continue;
+
+      std::unique_ptr<Image> src;
+      try {
+        src.reset(loadObjectVersion<Image*>("img", imageId, ver, &Reader::readImage));
+        if (!src)
+          src.reset(loadObjectVersion<Image*>("imgd", imageId, ver, &Reader::readImageDelta));
+      }
+      catch (const std::exception& ex) {
+        (void)ex;
+        RECO_TRACE("RECO: img #%d v%d cannot be read: %s\n", imageId, ver, ex.what());
+      }
+
+      if (src &&
+          src->pixelFormat() == dst->pixelFormat() &&
+          src->size() == dst->size()) {
+        dst->copy(src.get(), gfx::Clip(src->bounds()));
+        dst->setMaskColor(src->maskColor());
+        return true;
+      }
+    }
+    return false;
+  }
+
   CelDataRef getCelDataRef(ObjectId celdataId) {
     if (m_celdatas.find(celdataId) != m_celdatas.end())
       return m_celdatas[celdataId];
@@ -166,26 +269,8 @@ private:
       if (!ver)
         continue;
 
-      RECO_TRACE("RECO: Restoring %s #%d v%d\n", prefix, id, ver);
-
-      std::string fn = prefix;
-      fn.push_back('-');
-      fn += base::convert_to<std::string>(id);
-      fn.push_back('.');
-      fn += base::convert_to<std::string>(ver);
-
-      std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, fn)), std::ifstream::binary);
-      T obj = nullptr;
-      if (read32(s) == MAGIC_NUMBER)
-        obj = (this->*readMember)(s);
-
-      if (obj) {
-        RECO_TRACE("RECO: %s #%d v%d restored successfully\n", prefix, id, ver);
+      if (T obj = loadObjectVersion<T>(prefix, id, ver, readMember))
         return obj;
-      }
-      else {
-        RECO_TRACE("RECO: %s #%d v%d was not restored\n", prefix, id, ver);
-      }
     }
 
     // Show error only if we've failed to load all versions
@@ -195,6 +280,35 @@ private:
     return nullptr;
   }
 
+  template<typename T>
+  T loadObjectVersion(const char* prefix, ObjectId id, ObjectVersion ver,
+                      T (Reader::*readMember)(std::ifstream&)) {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+
+    fn = base::join_path(m_dir, fn);
+    if (!base::is_file(fn))
+      return nullptr;
+
+    RECO_TRACE("RECO: Restoring %s #%d v%d\n", prefix, id, ver);
+
+    std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+    T obj = nullptr;
+    if (read32(s) == MAGIC_NUMBER)
+      obj = (this->*readMember)(s);
+
+    if (obj) {
+      RECO_TRACE("RECO: %s #%d v%d restored successfully\n", prefix, id, ver);
+    }
+    else {
+      RECO_TRACE("RECO: %s #%d v%d was not restored\n", prefix, id, ver);
+    }
+    return obj;
+  }
+
   Doc* readDocument(std::ifstream& s) {
     ObjectId sprId = read32(s);
     std::string filename = read_string(s);
@@ -337,10 +451,14 @@ private:
       }
 
       if (m_taskToken) {
-        m_taskToken->set_progress(float(i) / float(m_celsToLoad.size()));
+        m_taskToken->set_progress(kCelsProgress * float(i) / float(m_celsToLoad.size()));
       }
     }
 
+    // Load the pixels of all images used by cels
+    if (!loadAllImagesPixels())
+      return nullptr;
+
     // Read palettes
     int npalettes = read32(s);
     if (npalettes >= 1 && npalettes < 0xfffff) {
@@ -518,6 +636,44 @@ private:
     return read_image(s, false);
   }
 
+  // Reads the header of doc::write_image() to create an image
+  // without pixels (they are loaded from loadAllImagesPixels()).
+  Image* readImageHeader(std::ifstream& s) {
+    read32(s);                  // ID
+    return createImageFromHeader(s);
+  }
+
+  // Same for the header of write_image_delta()
+  Image* readImageDeltaHeader(std::ifstream& s) {
+    read32(s);                  // ID
+    read32(s);                  // Base version
+    return createImageFromHeader(s);
+  }
+
+  Image* createImageFromHeader(std::ifstream& s) {
+    const int pixelFormat = read8(s);
+    const int width = read16(s);
+    const int height = read16(s);
+    const color_t maskColor = read32(s);
+
+    if ((pixelFormat != IMAGE_RGB &&
+         pixelFormat != IMAGE_GRAYSCALE &&
+         pixelFormat != IMAGE_INDEXED &&
+         pixelFormat != IMAGE_BITMAP &&
+         pixelFormat != IMAGE_TILEMAP) ||
+        (width < 1 || height < 1) ||
+        s.fail())
+      return nullptr;
+
+    Image* image = Image::create((PixelFormat)pixelFormat, width, height);
+    image->setMaskColor(maskColor);
+    return image;
+  }
+
+  Image* readImageDelta(std::ifstream& s) {
+    return read_image_delta(s, m_dir);
+  }
+
   Palette* readPalette(std::ifstream& s) {
     return read_palette(s);
   }
@@ -596,6 +752,8 @@ private:
   DocumentInfo* m_loadInfo;
   std::vector<std::pair<ObjectId, ObjectId> > m_celsToLoad;
   std::map<ObjectId, ImageRef> m_images;
+  // Images created from their headers, with pixels to be loaded
+  std::vector<std::pair<ImageRef, ObjectId> > m_imagesToLoad;
   std::map<ObjectId, CelDataRef> m_celdatas;
   // Each ObjectId is a tileset ID that didn't contain the empty tile
   // as the first tile (this was an old format used in internal betas)
@@ -655,8 +813,12 @@ Doc* read_document_with_raw_images(const std::string& dir,
       continue;
 
     ImageRef img;
-    if (read32(s) == MAGIC_NUMBER)
-      img.reset(read_image(s, false));
+    if (read32(s) == MAGIC_NUMBER) {
+      if (fn.compare(0, 5, "imgd-") == 0)
+        img.reset(read_image_delta(s, dir));
+      else
+        img.reset(read_image(s, false));
+    }
 
     if (img) {
       lay->addCel(new Cel(frame, img));
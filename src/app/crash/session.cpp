@@ -228,13 +228,22 @@ public:
 
 bool Session::saveDocumentChanges(Doc* doc)
 {
-  CustomWeakDocReader reader(doc);
-  if (!reader.isLocked())
-    return false;
-
-  app::Context ctx;
   std::string dir = base::join_path(m_path,
     base::convert_to<std::string>(doc->id()));
+  DocSnapshot snapshot(dir, doc);
+
+  // Copy the modified objects while the document is locked, then we
+  // can write them without blocking the user.
+  {
+    CustomWeakDocReader reader(doc);
+    if (!reader.isLocked())
+      return false;
+
+    app::Context ctx;
+    if (!snapshot.take(&reader))
+      return false;
+  }
+
   RECO_TRACE("RECO: Saving document '%s'...\n", dir.c_str());
 
   // Create directory for document
@@ -252,7 +261,7 @@ bool Session::saveDocumentChanges(Doc* doc)
   }
 
   // Save document information
-  return write_document(dir, doc, &reader);
+  return snapshot.save();
 }
 
 void Session::removeDocument(Doc* doc)
@@ -11,6 +11,7 @@
 
 #include "app/crash/write_document.h"
 
+#include "app/crash/image_delta.h"
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
 #include "app/doc.h"
@@ -25,6 +26,7 @@
 #include "doc/cel_io.h"
 #include "doc/cels_range.h"
 #include "doc/frame.h"
+#include "doc/image.h"
 #include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
@@ -43,8 +45,12 @@
 #include "doc/user_data_io.h"
 #include "fixmath/fixmath.h"
 
+#include <algorithm>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -58,24 +64,94 @@ namespace {
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
 static std::map<ObjectId, base::paths> g_deleteFiles;
 
-class Writer {
+// Information to save only the modified tiles of each image (deltas)
+// in the following backups.
+struct ImageBackup {
+  // Version of the last full "img" file of this image
+  ObjectVersion base = 0;
+  PixelFormat pixelFormat = IMAGE_RGB;
+  gfx::Size size;
+  // Hashes of the tiles of the base version
+  std::vector<uint64_t> hashes;
+  // Base version used by each saved version (the same version for
+  // full images)
+  std::map<ObjectVersion, ObjectVersion> bases;
+
+  bool isBaseUsed(const ObjectVersion ver) const {
+    return (ver == base ||
+            std::any_of(bases.begin(), bases.end(),
+                        [ver](const auto& it){ return it.second == ver; }));
+  }
+};
+
+typedef std::map<ObjectId, ImageBackup> ImageBackupsMap;
+
+static std::map<ObjectId, ImageBackupsMap> g_docImages;
+
+} // anonymous namespace
+
+class DocSnapshot::Writer {
 public:
-  Writer(const std::string& dir, Doc* doc, doc::CancelIO* cancel)
+  Writer(const std::string& dir, Doc* doc)
+    : Writer(dir, doc,
+             g_docVersions[doc->id()],
+             g_deleteFiles[doc->id()],
+             g_docImages[doc->id()]) {
+  }
+
+  Writer(const std::string& dir, Doc* doc,
+         ObjVersionsMap& objVersions,
+         base::paths& deleteFiles,
+         ImageBackupsMap& images)
     : m_dir(dir)
     , m_doc(doc)
-    , m_objVersions(g_docVersions[doc->id()])
-    , m_deleteFiles(g_deleteFiles[doc->id()])
-    , m_cancel(cancel) {
+    , m_objVersions(objVersions)
+    , m_deleteFiles(deleteFiles)
+    , m_images(images)
+    , m_cancel(nullptr) {
   }
 
-  bool saveDocument() {
+  bool takeSnapshot(doc::CancelIO* cancel) {
+    m_cancel = cancel;
+    m_objects.clear();
+    const bool result = snapshotDocument();
+    m_cancel = nullptr;
+    return result;
+  }
+
+  bool saveSnapshot(doc::CancelIO* cancel = nullptr) {
+    for (ObjectSnapshot& obj : m_objects) {
+      if (cancel && cancel->isCanceled())
+        return false;
+      if (!(obj.image ? saveImage(obj): saveObject(obj)))
+        return false;
+    }
+    m_objects.clear();
+
+    // Delete old files after all files are correctly saved.
+    deleteOldVersions();
+    return true;
+  }
+
+private:
+  // A modified object serialized in memory, or a copy of the image
+  // for "img" objects (which are compressed when they are saved).
+  struct ObjectSnapshot {
+    const char* prefix;
+    ObjectId id;
+    ObjectVersion version;
+    std::string data;
+    std::unique_ptr<Image> image;
+  };
+
+  bool snapshotDocument() {
     Sprite* spr = m_doc->sprite();
 
     // Save from objects without children (e.g. images), to aggregated
     // objects (e.g. cels, layers, etc.)
 
     for (Palette* pal : spr->getPalettes())
-      if (!saveObject("pal", pal, &Writer::writePalette))
+      if (!snapshotObject("pal", pal, &Writer::writePalette))
         return false;
 
     if (spr->hasTilesets()) {
@@ -83,18 +159,18 @@ public:
         // The tileset can be nullptr if it was erased (as we keep
         // empty spaces in the Tilesets array)
         if (tset) {
-          if (!saveObject("tset", tset, &Writer::writeTileset))
+          if (!snapshotObject("tset", tset, &Writer::writeTileset))
             return false;
         }
       }
     }
 
     for (Tag* frtag : spr->tags())
-      if (!saveObject("frtag", frtag, &Writer::writeFrameTag))
+      if (!snapshotObject("frtag", frtag, &Writer::writeFrameTag))
         return false;
 
     for (Slice* slice : spr->slices())
-      if (!saveObject("slice", slice, &Writer::writeSlice))
+      if (!snapshotObject("slice", slice, &Writer::writeSlice))
         return false;
 
     // Get all layers (visible, hidden, subchildren, etc.)
@@ -109,10 +185,10 @@ public:
         if (cel->link())        // Skip link
           continue;
 
-        if (!saveObject("img", cel->image(), &Writer::writeImage))
+        if (!snapshotImage(cel->image()))
           return false;
 
-        if (!saveObject("celdata", cel->data(), &Writer::writeCelData))
+        if (!snapshotObject("celdata", cel->data(), &Writer::writeCelData))
           return false;
       }
     }
@@ -123,23 +199,21 @@ public:
       lay->getCels(cels);
 
       for (Cel* cel : cels)
-        if (!saveObject("cel", cel, &Writer::writeCel))
+        if (!snapshotObject("cel", cel, &Writer::writeCel))
           return false;
     }
 
     // Save all layers (top level, groups, children, etc.)
     for (Layer* lay : layers)
-      if (!saveObject("lay", lay, &Writer::writeLayerStructure))
+      if (!snapshotObject("lay", lay, &Writer::writeLayerStructure))
         return false;
 
-    if (!saveObject("spr", spr, &Writer::writeSprite))
+    if (!snapshotObject("spr", spr, &Writer::writeSprite))
       return false;
 
-    if (!saveObject("doc", m_doc, &Writer::writeDocumentFile))
+    if (!snapshotObject("doc", m_doc, &Writer::writeDocumentFile))
       return false;
 
-    // Delete old files after all files are correctly saved.
-    deleteOldVersions();
     return true;
   }
 
@@ -149,14 +223,14 @@ private:
     return (m_cancel && m_cancel->isCanceled());
   }
 
-  bool writeDocumentFile(std::ofstream& s, Doc* doc) {
+  bool writeDocumentFile(std::ostream& s, Doc* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
     write16(s, uint16_t(doc::SerialFormat::LastVer));
     return true;
   }
 
-  bool writeSprite(std::ofstream& s, Sprite* spr) {
+  bool writeSprite(std::ostream& s, Sprite* spr) {
     // Header
     write8(s, int(spr->colorMode()));
     write16(s, spr->width());
@@ -210,7 +284,7 @@ private:
     return true;
   }
 
-  bool writeGridBounds(std::ofstream& s, const gfx::Rect& grid) {
+  bool writeGridBounds(std::ostream& s, const gfx::Rect& grid) {
     write16(s, (int16_t)grid.x);
     write16(s, (int16_t)grid.y);
     write16(s, grid.w);
@@ -218,7 +292,7 @@ private:
     return true;
   }
 
-  bool writeColorSpace(std::ofstream& s, const gfx::ColorSpaceRef& colorSpace) {
+  bool writeColorSpace(std::ostream& s, const gfx::ColorSpaceRef& colorSpace) {
     write16(s, colorSpace->type());
     write16(s, colorSpace->flags());
     write32(s, fixmath::ftofix(colorSpace->gamma()));
@@ -232,7 +306,7 @@ private:
     return true;
   }
 
-  void writeAllLayersID(std::ofstream& s, ObjectId parentId, const LayerGroup* group) {
+  void writeAllLayersID(std::ostream& s, ObjectId parentId, const LayerGroup* group) {
     for (const Layer* lay : group->layers()) {
       write32(s, lay->id());
       write32(s, parentId);
@@ -242,7 +316,7 @@ private:
     }
   }
 
-  bool writeLayerStructure(std::ofstream& s, Layer* lay) {
+  bool writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -282,63 +356,198 @@ private:
     return true;
   }
 
-  bool writeCel(std::ofstream& s, Cel* cel) {
+  bool writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
     return true;
   }
 
-  bool writeCelData(std::ofstream& s, CelData* celdata) {
+  bool writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
     return true;
   }
 
-  bool writeImage(std::ofstream& s, Image* img) {
-    return write_image(s, img, m_cancel);
-  }
-
-  bool writePalette(std::ofstream& s, Palette* pal) {
+  bool writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, pal);
     return true;
   }
 
-  bool writeTileset(std::ofstream& s, Tileset* tileset) {
+  bool writeTileset(std::ostream& s, Tileset* tileset) {
     write_tileset(s, tileset);
     return true;
   }
 
-  bool writeFrameTag(std::ofstream& s, Tag* frameTag) {
+  bool writeFrameTag(std::ostream& s, Tag* frameTag) {
     write_tag(s, frameTag);
     return true;
   }
 
-  bool writeSlice(std::ofstream& s, Slice* slice) {
+  bool writeSlice(std::ostream& s, Slice* slice) {
     write_slice(s, slice);
     return true;
   }
 
   template<typename T>
-  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+  bool snapshotObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ostream&, T*)) {
     if (isCanceled())
       return false;
 
     if (!obj->version())
       obj->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+    if (m_objVersions[obj->id()].newer() == obj->version())
+      return true;
+
+    std::ostringstream s;
+    if (!(this->*writeMember)(s, obj)) // Write the object
+      return false;
+
+    m_objects.push_back(
+      ObjectSnapshot{ prefix, obj->id(), obj->version(), s.str(), nullptr });
+    return true;
+  }
+
+  bool snapshotImage(Image* img) {
+    if (isCanceled())
+      return false;
+
+    if (!img->version())
+      img->incrementVersion();
+
+    if (m_objVersions[img->id()].newer() == img->version())
+      return true;
+
+    // Copying the image is cheap compared with compressing it (and
+    // for tiled images the copy shares all tiles with the original
+    // one until they are modified).
+    m_objects.push_back(
+      ObjectSnapshot{ "img", img->id(), img->version(), std::string(),
+                      std::unique_ptr<Image>(Image::createCopy(img)) });
+    return true;
+  }
+
+  bool saveObject(const ObjectSnapshot& obj) {
+    ObjVersions& versions = m_objVersions[obj.id];
+    if (versions.newer() == obj.version)
+      return true;
+
+    if (!writeFile(objectFilename(obj.prefix, obj.id, obj.version),
+                   [&obj](std::ofstream& s){
+                     return !s.write(obj.data.c_str(), obj.data.size()).fail();
+                   }))
+      return false;
+
+    // Remove the older version
+    if (versions.older())
+      deleteFile(objectFilename(obj.prefix, obj.id, versions.older()));
+
+    // Rotate versions and add the latest one
+    versions.rotateRevisions(obj.version);
+
+    RECO_TRACE(" - Saved %s #%d v%d\n", obj.prefix, obj.id, obj.version);
+    return true;
+  }
+
+  // Saves the image as a full "img" file, or as an "imgd" file
+  // (delta) with only the tiles that are different from the last
+  // full version of the image.
+  bool saveImage(const ObjectSnapshot& obj) {
+    const ObjectId id = obj.id;
+    const ObjectVersion ver = obj.version;
+    const Image* img = obj.image.get();
+    ObjVersions& versions = m_objVersions[id];
+    if (versions.newer() == ver)
       return true;
+    ImageBackup& backup = m_images[id];
+    std::vector<uint64_t> hashes;
+    calculate_image_tile_hashes(img, hashes);
+
+    std::vector<int> tiles;
+    bool full = (!backup.base ||
+                 backup.pixelFormat != img->pixelFormat() ||
+                 backup.size != img->size() ||
+                 backup.hashes.size() != hashes.size());
+    if (!full) {
+      for (int i=0; i<int(hashes.size()); ++i)
+        if (hashes[i] != backup.hashes[i])
+          tiles.push_back(i);
+
+      // Compaction: when more than half of the image was modified
+      // since the base version, we save the full image again (which
+      // will be the new base for following deltas).
+      full = (tiles.size()*2 > hashes.size());
+    }
+
+    if (full) {
+      if (!writeFile(objectFilename("img", id, ver),
+                     [id, img](std::ofstream& s){
+                       if (!write_image(s, img))
+                         return false;
+
+                       // The copy of the image has its own ID, so we
+                       // replace it with the ID of the original image
+                       // (the first field after the magic number).
+                       s.seekp(4);
+                       write32(s, id);
+                       s.seekp(0, std::ios::end);
+                       return true;
+                     }))
+        return false;
 
+      backup.base = ver;
+      backup.pixelFormat = img->pixelFormat();
+      backup.size = img->size();
+      backup.hashes = std::move(hashes);
+    }
+    else {
+      if (!writeFile(objectFilename("imgd", id, ver),
+                     [id, img, &backup, &tiles](std::ofstream& s){
+                       return write_image_delta(s, id, img, backup.base,
+                                                tiles, nullptr);
+                     }))
+        return false;
+    }
+    backup.bases[ver] = backup.base;
+
+    // Remove the older version, and its base image if it's not used
+    // by other versions.
+    const ObjectVersion older = versions.older();
+    if (older) {
+      ObjectVersion olderBase = older;
+      auto it = backup.bases.find(older);
+      if (it != backup.bases.end()) {
+        olderBase = it->second;
+        backup.bases.erase(it);
+      }
+      if (olderBase != older)
+        deleteFile(objectFilename("imgd", id, older));
+      if (!backup.isBaseUsed(olderBase))
+        deleteFile(objectFilename("img", id, olderBase));
+    }
+
+    versions.rotateRevisions(ver);
+
+    RECO_TRACE(" - Saved %s #%d v%d (%d tiles)\n",
+               (full ? "img": "imgd"), id, ver,
+               (full ? int(backup.hashes.size()): int(tiles.size())));
+    return true;
+  }
+
+  std::string objectFilename(const char* prefix,
+                             const ObjectId id,
+                             const ObjectVersion ver) const {
     std::string fn = prefix;
     fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
-
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return base::join_path(m_dir, fn);
+  }
 
-    std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
+  template<typename WriteFunc>
+  bool writeFile(const std::string& fn, WriteFunc writeFunc) {
+    std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
-    if (!(this->*writeMember)(s, obj)) // Write the object
+    if (!writeFunc(s))            // Write the object
       return false;
 
     // Flush all data. In this way we ensure that the magic number is
@@ -348,18 +557,16 @@ private:
     // Write the magic number
     s.seekp(0);
     write32(s, MAGIC_NUMBER);
-
-    // Remove the older version
-    if (versions.older() && base::is_file(oldfn))
-      m_deleteFiles.push_back(oldfn);
-
-    // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
-
-    RECO_TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
     return true;
   }
 
+  // Adds the file to the list of files to be deleted after the whole
+  // document is saved.
+  void deleteFile(const std::string& fn) {
+    if (base::is_file(fn))
+      m_deleteFiles.push_back(fn);
+  }
+
   void deleteOldVersions() {
     while (!m_deleteFiles.empty() && !isCanceled()) {
       std::string file = m_deleteFiles.back();
@@ -379,20 +586,44 @@ private:
   Doc* m_doc;
   ObjVersionsMap& m_objVersions;
   base::paths& m_deleteFiles;
+  ImageBackupsMap& m_images;
   doc::CancelIO* m_cancel;
+  std::vector<ObjectSnapshot> m_objects;
 };
 
-} // anonymous namespace
-
 //////////////////////////////////////////////////////////////////////
 // Public API
 
-bool write_document(const std::string& dir,
-                    Doc* doc,
-                    doc::CancelIO* cancel)
+DocSnapshot::DocSnapshot(const std::string& dir, Doc* doc)
+  : m_writer(std::make_unique<Writer>(dir, doc))
+{
+}
+
+DocSnapshot::~DocSnapshot()
 {
-  Writer writer(dir, doc, cancel);
-  return writer.saveDocument();
+}
+
+bool DocSnapshot::take(doc::CancelIO* cancel)
+{
+  return m_writer->takeSnapshot(cancel);
+}
+
+bool DocSnapshot::save()
+{
+  return m_writer->saveSnapshot();
+}
+
+// static
+bool DocSnapshot::saveFullDocument(const std::string& dir, Doc* doc,
+                                   doc::CancelIO* cancel)
+{
+  // Empty information of previous backups, so all objects are saved
+  ObjVersionsMap objVersions;
+  base::paths deleteFiles;
+  ImageBackupsMap images;
+  Writer writer(dir, doc, objVersions, deleteFiles, images);
+  return (writer.takeSnapshot(cancel) &&
+          writer.saveSnapshot(cancel));
 }
 
 void delete_document_internals(Doc* doc)
@@ -411,6 +642,11 @@ void delete_document_internals(Doc* doc)
     if (it != g_deleteFiles.end())
       g_deleteFiles.erase(it);
   }
+  {
+    auto it = g_docImages.find(doc->id());
+    if (it != g_docImages.end())
+      g_docImages.erase(it);
+  }
 }
 
 } // namespace crash
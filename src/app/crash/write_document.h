@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -8,6 +9,7 @@
 #define APP_CRASH_WRITE_DOCUMENT_H_INCLUDED
 #pragma once
 
+#include <memory>
 #include <string>
 
 namespace doc {
@@ -19,7 +21,31 @@ namespace app {
 
   namespace crash {
 
-    bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
+    // Backup of the modified objects of a document in two steps:
+    // take() copies the modified objects in memory (the document
+    // must be locked for reading), and save() writes them in the
+    // backup directory (without locking the document, so the user
+    // can modify the document in the meantime).
+    class DocSnapshot {
+    public:
+      DocSnapshot(const std::string& dir, Doc* doc);
+      ~DocSnapshot();
+
+      bool take(doc::CancelIO* cancel);
+      bool save();
+
+      // Writes all objects of the document in the given directory
+      // (ignoring what was saved in previous backups), so it can be
+      // read again with read_document() (e.g. used by ClosedDocs to
+      // free the memory of closed documents).
+      static bool saveFullDocument(const std::string& dir, Doc* doc,
+                                   doc::CancelIO* cancel);
+
+    private:
+      class Writer;
+      std::unique_ptr<Writer> m_writer;
+    };
+
     void delete_document_internals(Doc* doc);
 
   } // namespace crash
@@ -25,6 +25,7 @@
 #include "app/pref/preferences.h"
 #include "app/util/cel_ops.h"
 #include "base/memory.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
@@ -36,6 +37,7 @@
 #include "doc/tag.h"
 #include "os/system.h"
 #include "os/window.h"
+#include "render/composite_cache.h"
 #include "ui/system.h"
 
 #include <limits>
@@ -149,6 +151,18 @@ void Doc::weakUnlock()
   m_rwLock.weakUnlock();
 }
 
+render::CompositeCache* Doc::compositeCache()
+{
+  if (!m_compositeCache)
+    m_compositeCache = std::make_unique<render::CompositeCache>();
+  return m_compositeCache.get();
+}
+
+std::size_t Doc::compositeCacheBytes() const
+{
+  return (m_compositeCache ? m_compositeCache->bytes(): 0);
+}
+
 void Doc::setTransaction(Transaction* transaction)
 {
   if (transaction) {
@@ -206,6 +220,18 @@ void Doc::setLayerVisibilityWithNotifications(Layer* layer, const bool visible)
 //////////////////////////////////////////////////////////////////////
 // Notifications
 
+void Doc::beginBatchUpdate()
+{
+  ++m_batchUpdates;
+}
+
+void Doc::endBatchUpdate()
+{
+  ASSERT(m_batchUpdates > 0);
+  if (--m_batchUpdates == 0)
+    notifyGeneralUpdate();
+}
+
 void Doc::notifyGeneralUpdate()
 {
   DocEvent ev(this);
@@ -413,27 +439,57 @@ void Doc::setFormatOptions(const FormatOptionsPtr& format_options)
 void Doc::destroyMaskBoundaries()
 {
   m_maskBoundaries.reset();
+  m_maskBoundariesBitmap.reset();
   notifySelectionBoundariesChanged();
 }
 
 void Doc::generateMaskBoundaries(const Mask* mask)
 {
-  m_maskBoundaries.reset();
-
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
-      return;                   // Done, without boundaries
+    if (!isMaskVisible()) {     // The mask is hidden
+      m_maskBoundaries.reset(); // Done, without boundaries
+      m_maskBoundariesBitmap.reset();
+      return;
+    }
     else
       mask = this->mask();      // Use the document mask
   }
 
   ASSERT(mask);
 
-  if (!mask->isEmpty()) {
-    m_maskBoundaries.regen(mask->bitmap());
-    m_maskBoundaries.offset(mask->bounds().x,
-                            mask->bounds().y);
+  if (mask->isEmpty()) {
+    m_maskBoundaries.reset();
+    m_maskBoundariesBitmap.reset();
+  }
+  else {
+    const Image* bitmap = mask->bitmap();
+    const gfx::Point origin = mask->bounds().origin();
+
+    // If the previous boundaries were generated from a bitmap of the
+    // same size (e.g. the selection was moved, or modified in a
+    // small area) we regenerate only the area with differences.
+    if (!m_maskBoundaries.isEmpty() &&
+        m_maskBoundariesBitmap &&
+        m_maskBoundariesBitmap->size() == bitmap->size()) {
+      gfx::Rect dirtyBounds;
+      if (doc::algorithm::shrink_bounds2(m_maskBoundariesBitmap.get(),
+                                         bitmap,
+                                         bitmap->bounds(),
+                                         dirtyBounds)) {
+        m_maskBoundaries.regen(bitmap, dirtyBounds);
+        m_maskBoundariesBitmap->copy(bitmap, gfx::Clip(dirtyBounds));
+      }
+
+      const gfx::Point delta = origin - m_maskBoundaries.origin();
+      if (delta != gfx::Point(0, 0))
+        m_maskBoundaries.offset(delta.x, delta.y);
+    }
+    else {
+      m_maskBoundaries.regen(bitmap);
+      m_maskBoundaries.offset(origin.x, origin.y);
+      m_maskBoundariesBitmap.reset(Image::createCopy(bitmap));
+    }
   }
 
   notifySelectionBoundariesChanged();
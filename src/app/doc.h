@@ -19,6 +19,7 @@
 #include "doc/color.h"
 #include "doc/document.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/mask_boundaries.h"
 #include "doc/pixel_format.h"
 #include "gfx/rect.h"
@@ -42,6 +43,10 @@ namespace gfx {
   class Region;
 }
 
+namespace render {
+  class CompositeCache;
+}
+
 namespace app {
 
   class Context;
@@ -87,6 +92,15 @@ namespace app {
     bool weakLock(std::atomic<base::RWLock::WeakLock>* weak_lock_flag);
     void weakUnlock();
 
+    // Composited tiles of the rendered frames shared by all editors
+    // that show this document (e.g. views created with "Duplicate
+    // View" or the preview window), so two views showing the same
+    // frame with the same zoom level render it just once. Must be
+    // used from the UI thread only.
+    render::CompositeCache* compositeCache();
+    // Bytes used by the composite cache (0 if it wasn't created yet)
+    std::size_t compositeCacheBytes() const;
+
     // Sets active/running transaction.
     void setTransaction(Transaction* transaction);
     Transaction* transaction() { return m_transaction; }
@@ -118,6 +132,15 @@ namespace app {
     //////////////////////////////////////////////////////////////////////
     // Notifications
 
+    // A batch update groups the UI refresh of several modifications
+    // (e.g. all the changes of a script transaction). Observers can
+    // check inBatchUpdate() to defer expensive updates (like
+    // relayouts) because they will receive one onGeneralUpdate()
+    // notification when the last batch update ends.
+    void beginBatchUpdate();
+    void endBatchUpdate();
+    bool inBatchUpdate() const { return m_batchUpdates > 0; }
+
     void notifyGeneralUpdate();
     void notifyColorSpaceChanged();
     void notifyPaletteChanged();
@@ -264,6 +287,9 @@ namespace app {
     // Read-Write locks.
     base::RWLock m_rwLock;
 
+    // Created the first time the document is rendered in an editor.
+    std::unique_ptr<render::CompositeCache> m_compositeCache;
+
     // Undo and redo information about the document.
     std::unique_ptr<DocUndo> m_undo;
 
@@ -274,6 +300,10 @@ namespace app {
     // Selected mask region boundaries
     doc::MaskBoundaries m_maskBoundaries;
 
+    // Copy of the mask bitmap used to generate m_maskBoundaries, to
+    // regenerate only the modified area the next time.
+    doc::ImageRef m_maskBoundariesBitmap;
+
     // Data to save the file in the same format that it was loaded
     FormatOptionsPtr m_format_options;
 
@@ -291,6 +321,9 @@ namespace app {
     // Last used color space to render a sprite.
     os::ColorSpaceRef m_osColorSpace;
 
+    // Number of nested beginBatchUpdate() calls.
+    int m_batchUpdates = 0;
+
     DISABLE_COPYING(Doc);
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/context.h"
 #include "app/doc.h"
 #include "base/exception.h"
+#include "doc/image_buffer_pool.h"
 
 #include <atomic>
 #include <exception>
@@ -208,6 +209,9 @@ namespace app {
 
       delete doc;
       m_doc = nullptr;
+
+      // Release the memory of the destroyed images
+      doc::image_buffer_pool_trim();
     }
 
     void closeDocument() {
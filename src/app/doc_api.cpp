@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -48,6 +48,7 @@
 #include "app/snap_to_grid.h"
 #include "app/transaction.h"
 #include "app/util/autocrop.h"
+#include "app/util/parallel_process.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
@@ -181,70 +182,59 @@ void DocApi::cropSprite(Sprite* sprite,
   }
 }
 
-void DocApi::cropImageLayer(LayerImage* layer,
-                            const gfx::Rect& bounds,
-                            const bool trimOutside)
-{
-  std::set<ObjectId> visited;
-  CelList cels, clearCels;
-  layer->getCels(cels);
-  for (Cel* cel : cels) {
-    if (visited.find(cel->data()->id()) != visited.end())
-      continue;
-    visited.insert(cel->data()->id());
+namespace {
 
-    if (!cropCel(layer, cel, bounds, trimOutside)) {
-      // Delete this cel and its links
-      clearCels.push_back(cel);
-    }
-  }
+// Result of cropping one cel (calculated in a worker thread by
+// crop_cel(), and then applied to the sprite by
+// DocApi::cropImageLayer() in the main thread).
+struct CroppedCel {
+  // True if the cel (and its links) must be deleted
+  bool clear = false;
+  // New image for the cel (or nullptr to keep the current one)
+  ImageRef newImage;
+  // New cel position (for non-background and non-reference layers)
+  gfx::Point newPosition;
+};
 
-  for (Cel* cel : clearCels)
-    clearCelAndAllLinks(cel);
-}
-
-// Returns false if the cel (and its links) must be deleted after this
-bool DocApi::cropCel(LayerImage* layer,
-                     Cel* cel,
-                     const gfx::Rect& bounds,
-                     const bool trimOutside)
+// Calculates the new image/position of the given cel to crop the
+// sprite to the given bounds. It doesn't modify the sprite so it can
+// be executed in parallel for several cels.
+CroppedCel crop_cel(const LayerImage* layer,
+                    const Cel* cel,
+                    const gfx::Rect& bounds,
+                    const bool trimOutside,
+                    const color_t bgColor)
 {
+  CroppedCel result;
+
   if (layer->isBackground()) {
     Image* image = cel->image();
     if (image && !cel->link()) {
       ASSERT(cel->x() == 0);
       ASSERT(cel->y() == 0);
 
-      ImageRef newImage(
+      result.newImage.reset(
         crop_image(image,
                    bounds.x, bounds.y,
                    bounds.w, bounds.h,
-                   m_document->bgColor(layer)));
-
-      replaceImage(cel->sprite(),
-                   cel->imageRef(),
-                   newImage);
+                   bgColor));
     }
-    return true;
+    return result;
   }
 
-  if (layer->isReference()) {
-    // Update the ref cel's bounds
-    gfx::RectF newBounds = cel->boundsF();
-    newBounds.x -= bounds.x;
-    newBounds.y -= bounds.y;
-    m_transaction.execute(new cmd::SetCelBoundsF(cel, newBounds));
-    return true;
-  }
+  // Reference layers only need to update the cel bounds
+  if (layer->isReference())
+    return result;
 
   gfx::Point newCelPos(cel->position() - bounds.origin());
+  result.newPosition = newCelPos;
 
   // This is the complex case: we want to crop a transparent cel and
   // remove the content that is outside the sprite canvas. This might
   // generate one or two of the following Cmd:
-  // 1. Clear the cel ("return false" will generate a "cmd::ClearCel"
-  //    then) if the cel bounds will be totally outside in the new
-  //    canvas size
+  // 1. Clear the cel ("result.clear = true" will generate a
+  //    "cmd::ClearCel" then) if the cel bounds will be totally
+  //    outside in the new canvas size
   // 2. Replace the cel image if the cel must be cut in
   //    some edge because it's not totally contained
   // 3. Just set the cel position (the most common case)
@@ -255,8 +245,10 @@ bool DocApi::cropCel(LayerImage* layer,
     if (image && !cel->link()) {
       gfx::Rect newCelBounds = (bounds & cel->bounds());
 
-      if (newCelBounds.isEmpty())
-        return false;
+      if (newCelBounds.isEmpty()) {
+        result.clear = true;
+        return result;
+      }
 
       newCelBounds.offset(-bounds.origin());
 
@@ -265,12 +257,12 @@ bool DocApi::cropCel(LayerImage* layer,
 
       const color_t bg = image->pixelFormat() == IMAGE_TILEMAP ?
                            notile :
-                           m_document->bgColor(layer);
+                           bgColor;
       newCelPos = newCelBounds.origin();
 
       doc::Grid grid;
       if (layer->isTilemap()) {
-        const Tileset* tileset = static_cast<LayerTilemap*>(layer)->tileset();
+        const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset();
         grid = tileset->grid();
         grid.origin(cel->position());
 
@@ -307,25 +299,84 @@ bool DocApi::cropCel(LayerImage* layer,
       }
       else {
         // Delete this cel and its links
-        return false;
+        result.clear = true;
+        return result;
       }
 
       // If it's the same image, we can re-use the cel image and just
       // move the cel position.
-      if (!is_same_image(cel->image(), newImage.get())) {
+      if (!is_same_image(cel->image(), newImage.get()))
+        result.newImage = newImage;
+    }
+  }
+
+  result.newPosition = newCelPos;
+  return result;
+}
+
+} // anonymous namespace
+
+void DocApi::cropImageLayer(LayerImage* layer,
+                            const gfx::Rect& bounds,
+                            const bool trimOutside)
+{
+  std::set<ObjectId> visited;
+  CelList cels, clearCels;
+  layer->getCels(cels);
+
+  std::vector<Cel*> uniqueCels;
+  uniqueCels.reserve(cels.size());
+  for (Cel* cel : cels) {
+    if (visited.find(cel->data()->id()) != visited.end())
+      continue;
+    visited.insert(cel->data()->id());
+    uniqueCels.push_back(cel);
+  }
+
+  // The background color depends on the preferences, so we get it
+  // here (from the main thread) for all cels.
+  const color_t bgColor = m_document->bgColor(layer);
+
+  // Crop the images of all cels in parallel, and then execute the
+  // commands in the same order of the cels.
+  parallel_process(
+    uniqueCels,
+    [layer, &bounds, trimOutside, bgColor](const Cel* cel){
+      return crop_cel(layer, cel, bounds, trimOutside, bgColor);
+    },
+    [this, layer, &bounds, &clearCels](Cel* cel, CroppedCel&& result){
+      if (layer->isReference()) {
+        // Update the ref cel's bounds
+        gfx::RectF newBounds = cel->boundsF();
+        newBounds.x -= bounds.x;
+        newBounds.y -= bounds.y;
+        m_transaction.execute(new cmd::SetCelBoundsF(cel, newBounds));
+        return;
+      }
+
+      if (result.clear) {
+        // Delete this cel and its links
+        clearCels.push_back(cel);
+        return;
+      }
+
+      if (result.newImage) {
         replaceImage(cel->sprite(),
                      cel->imageRef(),
-                     newImage);
+                     result.newImage);
       }
-    }
-  }
 
-  // Update the cel's position
-  setCelPosition(
-    cel->sprite(), cel,
-    newCelPos.x,
-    newCelPos.y);
-  return true;
+      // Update the cel's position
+      if (!layer->isBackground()) {
+        setCelPosition(
+          cel->sprite(), cel,
+          result.newPosition.x,
+          result.newPosition.y);
+      }
+    });
+
+  for (Cel* cel : clearCels)
+    clearCelAndAllLinks(cel);
 }
 
 void DocApi::trimSprite(Sprite* sprite, const bool byGrid)
@@ -344,16 +395,23 @@ void DocApi::addFrame(Sprite* sprite, frame_t newFrame)
 
 void DocApi::addEmptyFrame(Sprite* sprite, frame_t newFrame)
 {
-  m_transaction.execute(new cmd::AddFrame(sprite, newFrame));
-  adjustTags(sprite, newFrame, +1,
+  addEmptyFrames(sprite, newFrame, 1);
+}
+
+void DocApi::addEmptyFrames(Sprite* sprite, frame_t newFrame, frame_t count)
+{
+  ASSERT(count > 0);
+  m_transaction.execute(new cmd::AddFrame(sprite, newFrame, count));
+  adjustTags(sprite, newFrame, +count,
              kDropBeforeFrame,
              kDefaultTagsAdjustment);
 }
 
 void DocApi::addEmptyFramesTo(Sprite* sprite, frame_t newFrame)
 {
-  while (sprite->totalFrames() <= newFrame)
-    addEmptyFrame(sprite, sprite->totalFrames());
+  if (sprite->totalFrames() <= newFrame)
+    addEmptyFrames(sprite, sprite->totalFrames(),
+                   newFrame - sprite->totalFrames() + 1);
 }
 
 void DocApi::copyFrame(Sprite* sprite,
@@ -389,10 +447,19 @@ void DocApi::copyFrame(Sprite* sprite,
 }
 
 void DocApi::removeFrame(Sprite* sprite, frame_t frame)
+{
+  removeFrames(sprite, frame, 1);
+}
+
+// Removes the [frame, frame+count) range with one cmd::RemoveFrame,
+// so the cels of the next frames are displaced only once (instead of
+// once per removed frame).
+void DocApi::removeFrames(Sprite* sprite, frame_t frame, frame_t count)
 {
   ASSERT(frame >= 0);
-  m_transaction.execute(new cmd::RemoveFrame(sprite, frame));
-  adjustTags(sprite, frame, -1,
+  ASSERT(count > 0);
+  m_transaction.execute(new cmd::RemoveFrame(sprite, frame, count));
+  adjustTags(sprite, frame, -count,
              kDropBeforeFrame,
              kDefaultTagsAdjustment);
 }
@@ -811,34 +878,37 @@ void DocApi::adjustTags(Sprite* sprite,
 
     TRACE_DOCAPI(" - [from to]=[%d %d] ->", from, to);
 
-    // When delta = +1, frame = beforeFrame
-    if (delta == +1) {
+    // When delta > 0, frame = beforeFrame (the result is the same
+    // as inserting one frame "delta" times)
+    if (delta > 0) {
       switch (tagsHandling) {
         case kDefaultTagsAdjustment:
-          if (frame <= from) { ++from; }
-          if (frame <= to+1) { ++to; }
+          if (frame <= from) { from += delta; }
+          if (frame <= to+1) { to += delta; }
           break;
         case kFitInsideTags:
-          if (frame < from) { ++from; }
-          if (frame <= to) { ++to; }
+          if (frame < from) { from += delta; }
+          if (frame <= to) { to += delta; }
           break;
         case kFitOutsideTags:
           if ((frame < from) ||
               (frame == from &&
                dropFramePlace == kDropBeforeFrame)) {
-            ++from;
+            from += delta;
           }
           if ((frame < to) ||
               (frame == to &&
                dropFramePlace == kDropBeforeFrame)) {
-            ++to;
+            to += delta;
           }
           break;
       }
     }
-    else if (delta == -1) {
-      if (frame < from) { --from; }
-      if (frame <= to) { --to; }
+    // When delta < 0, the [frame, frame-delta) range was removed
+    else if (delta < 0) {
+      const frame_t count = -delta;
+      from -= std::clamp(from - frame, 0, count);
+      to -= std::clamp(to - frame + 1, 0, count);
     }
 
     TRACE_DOCAPI(" [%d %d]\n", from, to);
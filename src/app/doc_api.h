@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -56,6 +56,7 @@ namespace app {
     // Frames API
     void addFrame(Sprite* sprite, frame_t newFrame);
     void addEmptyFrame(Sprite* sprite, frame_t newFrame);
+    void addEmptyFrames(Sprite* sprite, frame_t newFrame, frame_t count);
     void addEmptyFramesTo(Sprite* sprite, frame_t newFrame);
     void copyFrame(Sprite* sprite,
                    frame_t fromFrame,
@@ -63,6 +64,7 @@ namespace app {
                    const DropFramePlace dropFramePlace,
                    const TagsHandling tagsHandling);
     void removeFrame(Sprite* sprite, frame_t frame);
+    void removeFrames(Sprite* sprite, frame_t frame, frame_t count);
     void setTotalFrames(Sprite* sprite, frame_t frames);
     void setFrameDuration(Sprite* sprite, frame_t frame, int msecs);
     void setFrameRangeDuration(Sprite* sprite, frame_t from, frame_t to, int msecs);
@@ -118,10 +120,6 @@ namespace app {
     void cropImageLayer(LayerImage* layer,
                         const gfx::Rect& bounds,
                         const bool trimOutside);
-    bool cropCel(LayerImage* layer,
-                 Cel* cel,
-                 const gfx::Rect& bounds,
-                 const bool trimOutside);
     void setCelFramePosition(Cel* cel, frame_t frame);
     void moveFrameLayer(Layer* layer, frame_t frame, frame_t beforeFrame);
     void adjustTags(Sprite* sprite,
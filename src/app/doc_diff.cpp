@@ -24,6 +24,12 @@
 #include "doc/tilesets.h"
 #include "doc/user_data.h"
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+
 #ifdef _DEBUG
 namespace doc {
 
@@ -249,4 +255,273 @@ DocDiff compare_docs(const Doc* a,
   return diff;
 }
 
+namespace {
+
+// FNV-1a hash to combine the properties of each object
+class Hasher {
+public:
+  template<typename T>
+  Hasher& add(const T value) {
+    static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+    return addBytes(&value, sizeof(value));
+  }
+
+  Hasher& add(const std::string& value) {
+    add(value.size());
+    return addBytes(value.data(), value.size());
+  }
+
+  Hasher& add(const gfx::Rect& rc) {
+    return add(rc.x).add(rc.y).add(rc.w).add(rc.h);
+  }
+
+  Hasher& add(const UserData& userData) {
+    // TODO add user data properties
+    return add(userData.text()).add(userData.color());
+  }
+
+  Hasher& addImage(const Image* image) {
+    if (!image)
+      return add(0);
+    return add(int(image->pixelFormat()))
+      .add(image->width())
+      .add(image->height())
+      .add(image->contentHash());
+  }
+
+  uint64_t hash() const { return m_hash; }
+
+private:
+  Hasher& addBytes(const void* data, size_t size) {
+    auto p = (const uint8_t*)data;
+    for (size_t i=0; i<size; ++i)
+      m_hash = (m_hash ^ p[i]) * 0x100000001b3ull;
+    return *this;
+  }
+
+  uint64_t m_hash = 0xcbf29ce484222325ull;
+};
+
+DocHashNode make_node(const ObjectType type,
+                       const ObjectId id,
+                       const uint64_t propsHash)
+{
+  DocHashNode node;
+  node.type = type;
+  node.id = id;
+  node.propsHash = propsHash;
+  return node;
+}
+
+// Calculates node.hash from the propsHash and the children hashes
+void finish_node(DocHashNode& node)
+{
+  Hasher h;
+  h.add(node.propsHash);
+  for (const DocHashNode& child : node.children)
+    h.add(child.hash);
+  node.hash = h.hash();
+}
+
+DocHashNode create_layer_hash_node(const Layer* layer)
+{
+  Hasher h;
+  h.add(int(layer->type()))
+    .add(layer->name())
+    .add(layer->userData())
+    .add(int(layer->flags()) & int(LayerFlags::StructuralFlagsMask));
+
+  if (layer->isImage()) {
+    auto layerImage = static_cast<const LayerImage*>(layer);
+    h.add(layerImage->opacity())
+      .add(int(layerImage->blendMode()));
+  }
+  if (layer->isTilemap())
+    h.add(static_cast<const LayerTilemap*>(layer)->tilesetIndex());
+
+  DocHashNode node = make_node(layer->type(), layer->id(), h.hash());
+
+  if (layer->isGroup()) {
+    for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers())
+      node.children.push_back(create_layer_hash_node(child));
+  }
+  else if (layer->isImage()) {
+    auto layerImage = static_cast<const LayerImage*>(layer);
+    for (auto it = layerImage->getCelBegin(),
+           end = layerImage->getCelEnd(); it != end; ++it) {
+      const Cel* cel = *it;
+      Hasher ch;
+      ch.add(cel->frame())
+        .add(cel->bounds())
+        .add(cel->opacity())
+        .add(cel->zIndex())
+        .add(cel->data()->userData())
+        .addImage(cel->image());
+
+      DocHashNode celNode = make_node(ObjectType::Cel, cel->id(), ch.hash());
+      finish_node(celNode);
+      node.children.push_back(std::move(celNode));
+    }
+  }
+
+  finish_node(node);
+  return node;
+}
+
+void add_diff(std::vector<DocObjectDiff>& output,
+              const DocObjectDiff::Kind kind,
+              const DocHashNode* a,
+              const DocHashNode* b)
+{
+  DocObjectDiff diff;
+  diff.kind = kind;
+  diff.type = (a ? a->type: b->type);
+  diff.a = (a ? a->id: NullId);
+  diff.b = (b ? b->id: NullId);
+  output.push_back(diff);
+}
+
+void diff_nodes(const DocHashNode& a,
+                const DocHashNode& b,
+                const bool sameDoc,
+                std::vector<DocObjectDiff>& output)
+{
+  if (a.hash == b.hash)
+    return;
+
+  if (a.propsHash != b.propsHash)
+    add_diff(output, DocObjectDiff::Modified, &a, &b);
+
+  // Match children of "a" with children of "b"
+  std::vector<int> matchB(b.children.size(), -1);
+  std::vector<int> matchA(a.children.size(), -1);
+
+  if (sameDoc) {
+    std::map<ObjectId, int> bById;
+    for (int i=0; i<int(b.children.size()); ++i)
+      bById[b.children[i].id] = i;
+
+    for (int i=0; i<int(a.children.size()); ++i) {
+      auto it = bById.find(a.children[i].id);
+      if (it != bById.end()) {
+        matchA[i] = it->second;
+        matchB[it->second] = i;
+      }
+    }
+  }
+  else {
+    // Match by position (for each type of child)
+    std::map<ObjectType, std::vector<int>> bByType;
+    for (int i=0; i<int(b.children.size()); ++i)
+      bByType[b.children[i].type].push_back(i);
+
+    std::map<ObjectType, size_t> nextOfType;
+    for (int i=0; i<int(a.children.size()); ++i) {
+      const ObjectType type = a.children[i].type;
+      const auto& bs = bByType[type];
+      size_t& next = nextOfType[type];
+      if (next < bs.size()) {
+        matchA[i] = bs[next];
+        matchB[bs[next]] = i;
+        ++next;
+      }
+    }
+  }
+
+  for (int i=0; i<int(a.children.size()); ++i) {
+    if (matchA[i] >= 0)
+      diff_nodes(a.children[i], b.children[matchA[i]], sameDoc, output);
+    else
+      add_diff(output, DocObjectDiff::Removed, &a.children[i], nullptr);
+  }
+  for (int i=0; i<int(b.children.size()); ++i) {
+    if (matchB[i] < 0)
+      add_diff(output, DocObjectDiff::Added, nullptr, &b.children[i]);
+  }
+}
+
+} // anonymous namespace
+
+DocHashNode create_doc_hash_tree(const Doc* document)
+{
+  const Sprite* sprite = document->sprite();
+
+  Hasher h;
+  h.add(sprite->width())
+    .add(sprite->height())
+    .add(int(sprite->pixelFormat()))
+    .add(sprite->transparentColor())
+    .add(sprite->userData())
+    .add(sprite->gridBounds())
+    .add(int(sprite->colorSpace()->type()))
+    .add(sprite->colorSpace()->gamma())
+    .add(sprite->colorSpace()->name())
+    .add(sprite->totalFrames());
+  for (frame_t f=0; f<sprite->totalFrames(); ++f)
+    h.add(sprite->frameDuration(f));
+
+  DocHashNode root = make_node(ObjectType::Sprite, sprite->id(), h.hash());
+
+  for (const Tag* tag : sprite->tags()) {
+    Hasher th;
+    th.add(tag->fromFrame())
+      .add(tag->toFrame())
+      .add(tag->name())
+      .add(int(tag->aniDir()))
+      .add(tag->repeat())
+      .add(tag->userData());
+
+    DocHashNode node = make_node(ObjectType::Tag, tag->id(), th.hash());
+    finish_node(node);
+    root.children.push_back(std::move(node));
+  }
+
+  for (const Palette* pal : sprite->getPalettes()) {
+    Hasher ph;
+    ph.add(pal->frame())
+      .add(pal->size());
+    for (int i=0; i<pal->size(); ++i)
+      ph.add(pal->getEntry(i));
+
+    DocHashNode node = make_node(ObjectType::Palette, pal->id(), ph.hash());
+    finish_node(node);
+    root.children.push_back(std::move(node));
+  }
+
+  if (sprite->hasTilesets()) {
+    for (const Tileset* tileset : *sprite->tilesets()) {
+      if (!tileset)
+        continue;
+
+      Hasher tsh;
+      tsh.add(tileset->name())
+        .add(tileset->baseIndex())
+        .add(tileset->grid().tileSize().w)
+        .add(tileset->grid().tileSize().h)
+        .add(tileset->userData())
+        .add(tileset->size());
+      for (tile_index ti=0; ti<tileset->size(); ++ti)
+        tsh.addImage(tileset->get(ti).get());
+
+      DocHashNode node = make_node(ObjectType::Tileset, tileset->id(), tsh.hash());
+      finish_node(node);
+      root.children.push_back(std::move(node));
+    }
+  }
+
+  for (const Layer* layer : sprite->root()->layers())
+    root.children.push_back(create_layer_hash_node(layer));
+
+  finish_node(root);
+  return root;
+}
+
+std::vector<DocObjectDiff> diff_doc_hash_trees(const DocHashNode& a,
+                                               const DocHashNode& b)
+{
+  std::vector<DocObjectDiff> output;
+  diff_nodes(a, b, (a.id == b.id), output);
+  return output;
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,12 @@
 #define APP_DOC_DIFF_H_INCLUDED
 #pragma once
 
+#include "doc/object_id.h"
+#include "doc/object_type.h"
+
+#include <cstdint>
+#include <vector>
+
 namespace app {
   class Doc;
 
@@ -47,6 +53,40 @@ namespace app {
   DocDiff compare_docs(const Doc* a,
                        const Doc* b);
 
+  // Hash tree of a document: each node is an object of the sprite
+  // (the sprite itself, tags, palettes, tilesets, layers and cels)
+  // with a hash of its properties, and a hash that includes the
+  // hashes of its children. Pixels are hashed with
+  // Image::contentHash(), which is cached for each image version, so
+  // creating the tree again after some changes only hashes the
+  // modified images.
+  struct DocHashNode {
+    doc::ObjectType type = doc::ObjectType::Unknown;
+    doc::ObjectId id = doc::NullId;
+    uint64_t propsHash = 0;     // Hash of the object properties
+    uint64_t hash = 0;          // propsHash + hashes of children
+    std::vector<DocHashNode> children;
+  };
+
+  DocHashNode create_doc_hash_tree(const Doc* doc);
+
+  struct DocObjectDiff {
+    enum Kind { Added, Removed, Modified };
+    Kind kind;
+    doc::ObjectType type;
+    doc::ObjectId a;            // NullId if the object was added
+    doc::ObjectId b;            // NullId if the object was removed
+  };
+
+  // Returns the objects that are different between the two trees,
+  // skipping subtrees with the same hash (so the time is
+  // proportional to the number of changes). Children are matched by
+  // ID if both trees are from the same sprite (e.g. before and after
+  // an operation), or by position if they are from different
+  // documents.
+  std::vector<DocObjectDiff> diff_doc_hash_trees(const DocHashNode& a,
+                                                 const DocHashNode& b);
+
 } // namespace app
 
 #endif
@@ -0,0 +1,93 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_diff.h"
+#include "app/test_context.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+using namespace app;
+using namespace doc;
+
+typedef std::unique_ptr<Doc> DocPtr;
+
+TEST(DocDiff, HashTreeOfSameDoc)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(32, 16));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer1 = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  Cel* cel = layer1->cel(0);
+  ASSERT_TRUE(cel != nullptr);
+
+  const DocHashNode tree0 = create_doc_hash_tree(doc.get());
+  EXPECT_EQ(tree0.hash, create_doc_hash_tree(doc.get()).hash);
+  EXPECT_TRUE(diff_doc_hash_trees(tree0, tree0).empty());
+
+  // Modify one pixel of the cel
+  put_pixel(cel->image(), 1, 1, rgba(255, 0, 0, 255));
+  const DocHashNode tree1 = create_doc_hash_tree(doc.get());
+  auto diff = diff_doc_hash_trees(tree0, tree1);
+  ASSERT_EQ(1, diff.size());
+  EXPECT_EQ(DocObjectDiff::Modified, diff[0].kind);
+  EXPECT_EQ(ObjectType::Cel, diff[0].type);
+  EXPECT_EQ(cel->id(), diff[0].a);
+  EXPECT_EQ(cel->id(), diff[0].b);
+
+  // Rename a layer and add a new one
+  LayerImage* layer2 = new LayerImage(sprite);
+  sprite->root()->addLayer(layer2);
+  layer1->setName("Renamed");
+  const DocHashNode tree2 = create_doc_hash_tree(doc.get());
+  diff = diff_doc_hash_trees(tree1, tree2);
+  ASSERT_EQ(2, diff.size());
+  EXPECT_EQ(DocObjectDiff::Modified, diff[0].kind);
+  EXPECT_EQ(layer1->id(), diff[0].a);
+  EXPECT_EQ(DocObjectDiff::Added, diff[1].kind);
+  EXPECT_EQ(layer2->id(), diff[1].b);
+
+  // Remove the new layer
+  sprite->root()->removeLayer(layer2);
+  diff = diff_doc_hash_trees(tree2, create_doc_hash_tree(doc.get()));
+  ASSERT_EQ(1, diff.size());
+  EXPECT_EQ(DocObjectDiff::Removed, diff[0].kind);
+  EXPECT_EQ(layer2->id(), diff[0].a);
+  delete layer2;
+
+  doc->close();
+}
+
+TEST(DocDiff, HashTreeOfDifferentDocs)
+{
+  TestContextT<Context> ctx;
+  DocPtr a(ctx.documents().add(32, 16));
+  DocPtr b(ctx.documents().add(32, 16));
+
+  // Equal documents have the same hash (object IDs are not hashed)
+  EXPECT_EQ(create_doc_hash_tree(a.get()).hash,
+            create_doc_hash_tree(b.get()).hash);
+
+  Cel* cel = b->sprite()->root()->firstLayer()->cel(0);
+  put_pixel(cel->image(), 0, 0, rgba(0, 0, 255, 255));
+
+  auto diff = diff_doc_hash_trees(create_doc_hash_tree(a.get()),
+                                  create_doc_hash_tree(b.get()));
+  ASSERT_EQ(1, diff.size());
+  EXPECT_EQ(DocObjectDiff::Modified, diff[0].kind);
+  EXPECT_EQ(ObjectType::Cel, diff[0].type);
+  EXPECT_EQ(a->sprite()->root()->firstLayer()->cel(0)->id(), diff[0].a);
+  EXPECT_EQ(cel->id(), diff[0].b);
+
+  a->close();
+  b->close();
+}
@@ -12,19 +12,20 @@
 #include "app/doc_exporter.h"
 
 #include "app/app.h"
+#include "app/buffered_writer.h"
 #include "app/cmd/set_pixel_format.h"
 #include "app/console.h"
 #include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/filename_formatter.h"
+#include "app/max_rects_packer.h"
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
-#include "base/replace_string.h"
 #include "base/string.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
@@ -33,13 +34,13 @@
 #include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/selected_frames.h"
 #include "doc/selected_layers.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
-#include "gfx/packing_rects.h"
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 #include "render/dithering.h"
@@ -48,12 +49,14 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <set>
+#include <tuple>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -62,32 +65,55 @@ using namespace doc;
 
 namespace {
 
-std::string escape_for_json(const std::string& path)
+// Used to write a string between quotes (escaping characters) in a
+// JSON file.
+struct json_string {
+  const std::string& str;
+};
+
+app::BufferedWriter& operator<<(app::BufferedWriter& os, const json_string& s)
 {
-  std::string res = path;
-  base::replace_string(res, "\\", "\\\\");
-  base::replace_string(res, "\"", "\\\"");
-  return res;
+  os.writeJsonString(s.str);
+  return os;
 }
 
-std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
+app::BufferedWriter& operator<<(app::BufferedWriter& os, const doc::UserData& data)
 {
+  static const char hex[] = "0123456789abcdef";
   doc::color_t color = data.color();
   if (doc::rgba_geta(color)) {
-    os << ", \"color\": \"#"
-       << std::hex << std::setfill('0')
-       << std::setw(2) << (int)doc::rgba_getr(color)
-       << std::setw(2) << (int)doc::rgba_getg(color)
-       << std::setw(2) << (int)doc::rgba_getb(color)
-       << std::setw(2) << (int)doc::rgba_geta(color)
-       << std::dec
-       << "\"";
+    const int c[4] = { doc::rgba_getr(color),
+                       doc::rgba_getg(color),
+                       doc::rgba_getb(color),
+                       doc::rgba_geta(color) };
+    os << ", \"color\": \"#";
+    for (int v : c)
+      os << hex[(v >> 4) & 15] << hex[v & 15];
+    os << "\"";
   }
   if (!data.text().empty())
-    os << ", \"data\": \"" << escape_for_json(data.text()) << "\"";
+    os << ", \"data\": " << json_string{ data.text() };
   return os;
 }
 
+void write_binary_user_data(app::BufferedWriter& os, const doc::UserData& data)
+{
+  doc::color_t color = data.color();
+  os.writeUint8(doc::rgba_getr(color));
+  os.writeUint8(doc::rgba_getg(color));
+  os.writeUint8(doc::rgba_getb(color));
+  os.writeUint8(doc::rgba_geta(color));
+  os.writeString(data.text());
+}
+
+void write_binary_rect(app::BufferedWriter& os, const gfx::Rect& rc)
+{
+  os.writeInt32(rc.x);
+  os.writeInt32(rc.y);
+  os.writeInt32(rc.w);
+  os.writeInt32(rc.h);
+}
+
 } // anonymous namespace
 
 namespace app {
@@ -170,6 +196,7 @@ public:
     m_extrude(extrude),
     m_isLinked(false),
     m_isDuplicated(false),
+    m_renderCache(nullptr),
     m_originalSize(size),
     m_trimmedBounds(size),
     m_inTextureBounds(std::make_shared<gfx::Rect>(size)) {
@@ -234,6 +261,7 @@ public:
 
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
+  void setRenderCache(SampleRenderCache* cache) { m_renderCache = cache; }
 
   ImageRef createRender(ImageBufferPtr& imageBuf) {
     ASSERT(m_sprite);
@@ -260,7 +288,14 @@ public:
       layersVisibility.showSelectedLayers(m_sprite,
                                           *m_selLayers);
 
+    // Render of the whole canvas from the cache (or from previous
+    // exports), so we have to copy pixels only.
+    ImageRef canvas = m_image;
+    if (!canvas && m_renderCache)
+      canvas = m_renderCache->render(m_sprite, m_frame);
+
     render::Render render;
+    render.setParallel(true);
 
     // 1) We cannot use the Preferences because this is called from a non-UI thread
     // 2) We should use the new blend mode always when we're saving files
@@ -288,8 +323,8 @@ public:
       for (int j=0; j<3; ++j) {
         for (int i=0; i<3; ++i) {
           gfx::Clip clip(x+dx[i], y+dy[j], gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j]));
-          if (m_image) {
-            dst->copy(m_image.get(), clip);
+          if (canvas) {
+            dst->copy(canvas.get(), clip);
           }
           else {
             render.renderSprite(dst, m_sprite, m_frame, clip);
@@ -299,8 +334,8 @@ public:
     }
     else {
       gfx::Clip clip(x, y, m_trimmedBounds);
-      if (m_image) {
-        dst->copy(m_image.get(), clip);
+      if (canvas) {
+        dst->copy(canvas.get(), clip);
       }
       else {
         render.renderSprite(dst, m_sprite, m_frame, clip);
@@ -322,6 +357,7 @@ private:
   bool m_extrude;
   bool m_isLinked;
   bool m_isDuplicated;
+  SampleRenderCache* m_renderCache;
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   SharedRectPtr m_inTextureBounds;
@@ -533,7 +569,7 @@ public:
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
+    MaxRectsPacker pr(borderPadding, shapePadding);
     doc::ImagesMap duplicates;
 
     uint32_t i = 0;
@@ -593,6 +629,7 @@ public:
 DocExporter::DocExporter()
   : m_docBuf(std::make_shared<doc::ImageBuffer>())
   , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
+  , m_renderCache(std::make_shared<SampleRenderCache>())
 {
   m_cache.spriteId = doc::NullId;
   reset();
@@ -603,6 +640,7 @@ void DocExporter::reset()
   m_sheetType = SpriteSheetType::None;
   m_dataFormat = SpriteSheetDataFormat::Default;
   m_dataFilename.clear();
+  m_binaryDataFilename.clear();
   m_textureFilename.clear();
   m_filenameFormat.clear();
   m_tagnameFormat.clear();
@@ -633,6 +671,20 @@ void DocExporter::setDocImageBuffer(const doc::ImageBufferPtr& docBuf)
   m_docBuf = docBuf;
 }
 
+static void make_missing_dirs_for_file(const std::string& filename)
+{
+  std::string dir = base::get_file_path(filename);
+  try {
+    if (!base::is_directory(dir))
+      base::make_all_directories(dir);
+  }
+  catch (const std::exception& ex) {
+    Console console;
+    console.printf("Error creating directory \"%s\"\n%s",
+                   dir.c_str(), ex.what());
+  }
+}
+
 Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
 {
   // We output the metadata to std::cout if the user didn't specify a file.
@@ -645,18 +697,7 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   }
   else {
     // Make missing directories for the json file
-    {
-      std::string dir = base::get_file_path(m_dataFilename);
-      try {
-        if (!base::is_directory(dir))
-          base::make_all_directories(dir);
-      }
-      catch (const std::exception& ex) {
-        Console console;
-        console.printf("Error creating directory \"%s\"\n%s",
-                       dir.c_str(), ex.what());
-      }
-    }
+    make_missing_dirs_for_file(m_dataFilename);
 
     fos.open(FSTREAM_PATH(m_dataFilename), std::ios::out);
     osbuf = fos.rdbuf();
@@ -708,6 +749,13 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   // Save the metadata.
   if (osbuf)
     createDataFile(samples, os, texture);
+  if (!m_binaryDataFilename.empty()) {
+    make_missing_dirs_for_file(m_binaryDataFilename);
+
+    std::ofstream bos(FSTREAM_PATH(m_binaryDataFilename),
+                      std::ios::out | std::ios::binary);
+    createBinaryDataFile(samples, bos, texture);
+  }
   token.set_progress(0.95f);
 
   // Save the image files.
@@ -885,6 +933,24 @@ void DocExporter::captureSamples(Samples& samples,
 {
   DX_TRACE("DX: Capture samples");
 
+  // Index of the first sample of each sprite/layer/frame, used to
+  // find the sample of the original cel of linked cels without
+  // iterating all the samples (which was too slow for big sprite
+  // sheets).
+  using SampleKey = std::tuple<const Sprite*, const Layer*, frame_t>;
+  std::map<SampleKey, int> firstSamples;
+  auto addSample = [&samples, &firstSamples](const Sample& sample) {
+    firstSamples.insert(
+      std::make_pair(SampleKey(sample.sprite(), sample.layer(), sample.frame()),
+                     samples.size()));
+    samples.addSample(sample);
+  };
+  for (int i=0; i<samples.size(); ++i) {
+    const Sample& sample = samples[i];
+    firstSamples.insert(
+      std::make_pair(SampleKey(sample.sprite(), sample.layer(), sample.frame()), i));
+  }
+
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -970,6 +1036,7 @@ void DocExporter::captureSamples(Samples& samples,
         doc, sprite, item.image, item.selLayers.get(),
         frame, innerTag, filename,
         m_innerPadding, m_extrude);
+      sample.setRenderCache(m_renderCache.get());
       Cel* cel = nullptr;
       Cel* link = nullptr;
       bool done = false;
@@ -984,22 +1051,16 @@ void DocExporter::captureSamples(Samples& samples,
       bool alreadyTrimmed = false;
       if (link && m_mergeDuplicates &&
           !item.isOneImageOnly()) {
-        for (const Sample& other : samples) {
-          if (token.canceled())
-            return;
-
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isLinked());
-
-            sample.setLinked();
-            sample.setTrimmedBounds(other.trimmedBounds());
-            sample.setSharedBounds(other.sharedBounds());
-            alreadyTrimmed = true;
-            done = true;
-            break;
-          }
+        auto it = firstSamples.find(SampleKey(sprite, layer, link->frame()));
+        if (it != firstSamples.end()) {
+          const Sample& other = samples[it->second];
+          ASSERT(!other.isLinked());
+
+          sample.setLinked();
+          sample.setTrimmedBounds(other.trimmedBounds());
+          sample.setSharedBounds(other.sharedBounds());
+          alreadyTrimmed = true;
+          done = true;
         }
         // "done" variable can be false here, e.g. when we export a
         // frame tag and the first linked cel is outside the tag range.
@@ -1012,34 +1073,45 @@ void DocExporter::captureSamples(Samples& samples,
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
-
         gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
+        bool emptyRender;
+
+        // A cel with a transparent image (known from the cached
+        // Image::isPlain() value) gives a transparent render, so we
+        // don't need to render it.
+        if (cel && !layer->isBackground() &&
+            is_empty_image(cel->image())) {
+          emptyRender = true;
+        }
+        else {
+          ImageRef sampleRender(sample.createRender(m_sampleBuf));
+          doc::color_t refColor = 0;
+
+          if (m_trimCels) {
+            if ((layer &&
+                 layer->isBackground()) ||
+                (!layer &&
+                 sprite->backgroundLayer() &&
+                 sprite->backgroundLayer()->isVisible())) {
+              refColor = get_pixel(sampleRender.get(), 0, 0);
+            }
+            else {
+              refColor = sprite->transparentColor();
+            }
           }
-          else {
+          else if (m_ignoreEmptyCels)
             refColor = sprite->transparentColor();
-          }
-        }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
-
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
+
           // If shrink_bounds() returns false, it's because the whole
           // image is transparent (equal to the mask color).
+          emptyRender = !algorithm::shrink_bounds(sampleRender.get(),
+                                                  refColor,
+                                                  nullptr,        // layer
+                                                  spriteBounds,   // startBounds
+                                                  frameBounds);   // output bounds
+        }
 
+        if (emptyRender) {
           // Should we ignore this empty frame? (i.e. don't include
           // the frame in the sprite sheet)
           if (m_ignoreEmptyCels)
@@ -1090,12 +1162,12 @@ void DocExporter::captureSamples(Samples& samples,
             const gfx::Rect cellBounds(pos, gridBounds.size());
             sample.setTrimmedBounds(cellBounds);
             sample.setSharedBounds(std::make_shared<gfx::Rect>(sample.inTextureBounds()));
-            samples.addSample(sample);
+            addSample(sample);
           }
         }
       }
       else {
-        samples.addSample(sample);
+        addSample(sample);
       }
 
       DX_TRACE("DX:   - Sample:",
@@ -1273,21 +1345,21 @@ void DocExporter::renderTexture(Context* ctx,
 {
   textureImage->clear(textureImage->maskColor());
 
-  int i = 0;
+  std::vector<const Sample*> samplesToRender;
+  std::set<const Sprite*> spritesWithSelLayers;
   for (const auto& sample : samples) {
     if (token.canceled())
       return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
 
     if (sample.isLinked() ||
         sample.isDuplicated() ||
         sample.isEmpty()) {
-      ++i;
       continue;
     }
 
     // Make the sprite compatible with the texture so the render()
-    // works correctly.
+    // works correctly. This is done here (before rendering samples in
+    // parallel) because it modifies the sprite.
     if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
       RgbMapAlgorithm rgbmapAlgo =
         Preferences::instance().quantization.rgbmapAlgorithm();
@@ -1304,13 +1376,51 @@ void DocExporter::renderTexture(Context* ctx,
         .execute(ctx);
     }
 
-    sample.renderSample(
+    samplesToRender.push_back(&sample);
+    if (sample.selectedLayers())
+      spritesWithSelLayers.insert(sample.sprite());
+  }
+
+  // Each sample is rendered in its own area of the texture, so
+  // samples can be rendered at the same time. The only exception are
+  // samples with selected layers, which change the visibility of the
+  // sprite layers while they are rendered (RestoreVisibleLayers), so
+  // all the samples of those sprites are rendered sequentially in
+  // the same task.
+  const int n = int(samplesToRender.size());
+  std::atomic<int> rendered(0);
+  auto renderSample = [this, textureImage, &token, &rendered, n](const Sample* sample) {
+    sample->renderSample(
       textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
+      sample->inTextureBounds().x+m_innerPadding,
+      sample->inTextureBounds().y+m_innerPadding,
       m_extrude);
-    ++i;
+    token.set_progress(0.6f + 0.2f * (++rendered) / n);
+  };
+
+  std::map<const Sprite*, std::vector<const Sample*>> serialSamples;
+  doc::TaskGroup tasks;
+  for (const Sample* sample : samplesToRender) {
+    if (spritesWithSelLayers.find(sample->sprite()) != spritesWithSelLayers.end()) {
+      serialSamples[sample->sprite()].push_back(sample);
+      continue;
+    }
+    tasks.run([&renderSample, &token, sample](base::task_token&){
+      if (!token.canceled())
+        renderSample(sample);
+    });
+  }
+  for (const auto& it : serialSamples) {
+    const std::vector<const Sample*>* spriteSamples = &it.second;
+    tasks.run([&renderSample, &token, spriteSamples](base::task_token&){
+      for (const Sample* sample : *spriteSamples) {
+        if (token.canceled())
+          return;
+        renderSample(sample);
+      }
+    });
   }
+  tasks.wait();
 }
 
 void DocExporter::trimTexture(const Samples& samples,
@@ -1348,10 +1458,95 @@ void DocExporter::trimTexture(const Samples& samples,
                    m_textureHeight > 0 ? m_textureHeight: size.h);
 }
 
+std::vector<Doc*> DocExporter::metaDocuments() const
+{
+  std::vector<Doc*> docs;
+  std::set<doc::ObjectId> includedSprites;
+
+  for (auto& item : m_documents) {
+    if (item.isOneImageOnly())
+      continue;
+
+    // Avoid including tags/slices two or more times in the list
+    // (e.g. when -split-layers is specified, several calls of
+    // addDocument() are used for each layer, so we have to avoid
+    // iterating the same sprite several times)
+    Sprite* sprite = item.doc->sprite();
+    if (includedSprites.find(sprite->id()) != includedSprites.end())
+      continue;
+    includedSprites.insert(sprite->id());
+
+    docs.push_back(item.doc);
+  }
+  return docs;
+}
+
+LayerList DocExporter::metaLayers() const
+{
+  LayerList metaLayers;
+  for (auto& item : m_documents) {
+    if (item.isOneImageOnly())
+      continue;
+
+    Doc* doc = item.doc;
+    Sprite* sprite = doc->sprite();
+    Layer* root = sprite->root();
+
+    LayerList layers;
+    if (item.selLayers) {
+      // Select all layers (not only browseable ones)
+      layers = item.selLayers->toAllLayersList();
+    }
+    else {
+      // Select all visible layers by default
+      layers = sprite->allVisibleLayers();
+    }
+
+    for (Layer* layer : layers) {
+      // If this layer is inside a group, check that the group will
+      // be included in the meta data too.
+      Layer* group = layer->parent();
+      int pos = int(metaLayers.size());
+      while (group && group != root) {
+        if (std::find(metaLayers.begin(), metaLayers.end(), group) == metaLayers.end()) {
+          metaLayers.insert(metaLayers.begin()+pos, group);
+        }
+        group = group->parent();
+      }
+      // Insert the layer
+      if (std::find(metaLayers.begin(), metaLayers.end(), layer) == metaLayers.end()) {
+        metaLayers.push_back(layer);
+      }
+    }
+  }
+  return metaLayers;
+}
+
+std::string DocExporter::tagName(const Doc* doc, const Tag* tag) const
+{
+  std::string format = m_tagnameFormat;
+  if (format.empty()) {
+    format = "{tag}";
+  }
+
+  FilenameInfo fnInfo;
+  fnInfo
+    .filename(doc->filename())
+    .innerTagName(tag->name());
+  return filename_formatter(format, fnInfo);
+}
+
+static bool cel_has_meta_data(const Cel* cel)
+{
+  return (cel->zIndex() != 0 ||
+          !cel->data()->userData().isEmpty());
+}
+
 void DocExporter::createDataFile(const Samples& samples,
-                                 std::ostream& os,
+                                 std::ostream& stream,
                                  doc::Sprite* texture)
 {
+  BufferedWriter os(stream);
   std::string frames_begin;
   std::string frames_end;
   bool filename_as_key = false;
@@ -1393,10 +1588,10 @@ void DocExporter::createDataFile(const Samples& samples,
     gfx::Rect frameBounds = sample.inTextureBounds();
 
     if (filename_as_key)
-      os << "   \"" << escape_for_json(sample.filename()) << "\": {\n";
+      os << "   " << json_string{ sample.filename() } << ": {\n";
     else if (filename_as_attr)
       os << "   {\n"
-         << "    \"filename\": \"" << escape_for_json(sample.filename()) << "\",\n";
+         << "    \"filename\": " << json_string{ sample.filename() } << ",\n";
 
     os << "    \"frame\": { "
        << "\"x\": " << frameBounds.x + nonExtrudedPosition << ", "
@@ -1430,9 +1625,9 @@ void DocExporter::createDataFile(const Samples& samples,
      << "  \"version\": \"" << get_app_version() << "\",\n";
 
   if (!m_textureFilename.empty())
-    os << "  \"image\": \""
-       << escape_for_json(base::get_file_name(m_textureFilename)).c_str()
-       << "\",\n";
+    os << "  \"image\": "
+       << json_string{ base::get_file_name(m_textureFilename) }
+       << ",\n";
 
   os << "  \"format\": \"" << (texture->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
      << "  \"size\": { "
@@ -1445,44 +1640,18 @@ void DocExporter::createDataFile(const Samples& samples,
     os << ",\n"
        << "  \"frameTags\": ["; // TODO rename this someday in the future
 
-    std::set<doc::ObjectId> includedSprites;
-
     bool firstTag = true;
-    for (auto& item : m_documents) {
-      if (item.isOneImageOnly())
-        continue;
-
-      Doc* doc = item.doc;
-      Sprite* sprite = doc->sprite();
-
-      // Avoid including tags two or more times in the list (e.g. when
-      // -split-layers is specified, several calls of addDocument()
-      // are used for each layer, so we have to avoid iterating the
-      // same sprite several times)
-      if (includedSprites.find(sprite->id()) != includedSprites.end())
-        continue;
-      includedSprites.insert(sprite->id());
-
-      for (Tag* tag : sprite->tags()) {
+    for (Doc* doc : metaDocuments()) {
+      for (Tag* tag : doc->sprite()->tags()) {
         if (firstTag)
           firstTag = false;
         else
           os << ",";
 
-        std::string format = m_tagnameFormat;
-        if (format.empty()) {
-          format = "{tag}";
-        }
-
-        FilenameInfo fnInfo;
-        fnInfo
-          .filename(doc->filename())
-          .innerTagName(tag->name());
-        std::string tagname = filename_formatter(format, fnInfo);
-        os << "\n   { \"name\": \"" << escape_for_json(tagname) << "\","
+        os << "\n   { \"name\": " << json_string{ tagName(doc, tag) } << ","
            << " \"from\": " << (tag->fromFrame()) << ","
            << " \"to\": " << (tag->toFrame()) << ","
-           " \"direction\": \"" << escape_for_json(convert_anidir_to_string(tag->aniDir())) << "\"";
+           " \"direction\": " << json_string{ convert_anidir_to_string(tag->aniDir()) };
         if (tag->repeat() > 0) {
           os << ", \"repeat\": \"" << tag->repeat() << "\"";
         }
@@ -1494,55 +1663,18 @@ void DocExporter::createDataFile(const Samples& samples,
 
   // meta.layers
   if (m_listLayers || m_listLayerHierarchy) {
-    LayerList metaLayers;
-    for (auto& item : m_documents) {
-      if (item.isOneImageOnly())
-        continue;
-
-      Doc* doc = item.doc;
-      Sprite* sprite = doc->sprite();
-      Layer* root = sprite->root();
-
-      LayerList layers;
-      if (item.selLayers) {
-        // Select all layers (not only browseable ones)
-        layers = item.selLayers->toAllLayersList();
-      }
-      else {
-        // Select all visible layers by default
-        layers = sprite->allVisibleLayers();
-      }
-
-      for (Layer* layer : layers) {
-        // If this layer is inside a group, check that the group will
-        // be included in the meta data too.
-        Layer* group = layer->parent();
-        int pos = int(metaLayers.size());
-        while (group && group != root) {
-          if (std::find(metaLayers.begin(), metaLayers.end(), group) == metaLayers.end()) {
-            metaLayers.insert(metaLayers.begin()+pos, group);
-          }
-          group = group->parent();
-        }
-        // Insert the layer
-        if (std::find(metaLayers.begin(), metaLayers.end(), layer) == metaLayers.end()) {
-          metaLayers.push_back(layer);
-        }
-      }
-    }
-
     bool firstLayer = true;
     os << ",\n"
        << "  \"layers\": [";
-    for (Layer* layer : metaLayers) {
+    for (Layer* layer : metaLayers()) {
       if (firstLayer)
         firstLayer = false;
       else
         os << ",";
-      os << "\n   { \"name\": \"" << escape_for_json(layer->name()) << "\"";
+      os << "\n   { \"name\": " << json_string{ layer->name() };
 
       if (layer->parent() != layer->sprite()->root())
-        os << ", \"group\": \"" << escape_for_json(layer->parent()->name()) << "\"";
+        os << ", \"group\": " << json_string{ layer->parent()->name() };
 
       if (LayerImage* layerImg = dynamic_cast<LayerImage*>(layer)) {
         os << ", \"opacity\": " << layerImg->opacity()
@@ -1553,22 +1685,15 @@ void DocExporter::createDataFile(const Samples& samples,
       // Cels
       CelList cels;
       layer->getCels(cels);
-      bool someCelWithData = false;
-      for (const Cel* cel : cels) {
-        if (cel->zIndex() != 0 ||
-            !cel->data()->userData().isEmpty()) {
-          someCelWithData = true;
-          break;
-        }
-      }
+      const bool someCelWithData =
+        std::any_of(cels.begin(), cels.end(), cel_has_meta_data);
 
       if (someCelWithData) {
         bool firstCel = true;
 
         os << ", \"cels\": [";
         for (const Cel* cel : cels) {
-          if (cel->zIndex() != 0 ||
-              !cel->data()->userData().isEmpty()) {
+          if (cel_has_meta_data(cel)) {
             if (firstCel)
               firstCel = false;
             else
@@ -1600,32 +1725,16 @@ void DocExporter::createDataFile(const Samples& samples,
     os << ",\n"
        << "  \"slices\": [";
 
-    std::set<doc::ObjectId> includedSprites;
-
     bool firstSlice = true;
-    for (auto& item : m_documents) {
-      if (item.isOneImageOnly())
-        continue;
-
-      Doc* doc = item.doc;
-      Sprite* sprite = doc->sprite();
-
-      // Avoid including slices two or more times in the list
-      // (e.g. when -split-layers is specified, several calls of
-      // addDocument() are used for each layer, so we have to avoid
-      // iterating the same sprite several times)
-      if (includedSprites.find(sprite->id()) != includedSprites.end())
-        continue;
-      includedSprites.insert(sprite->id());
-
+    for (Doc* doc : metaDocuments()) {
       // TODO add possibility to export some slices
 
-      for (Slice* slice : sprite->slices()) {
+      for (Slice* slice : doc->sprite()->slices()) {
         if (firstSlice)
           firstSlice = false;
         else
           os << ",";
-        os << "\n   { \"name\": \"" << escape_for_json(slice->name()) << "\""
+        os << "\n   { \"name\": " << json_string{ slice->name() }
            << slice->userData();
 
         // Keys
@@ -1676,4 +1785,141 @@ void DocExporter::createDataFile(const Samples& samples,
      << "}\n";
 }
 
+// The format of this file is documented in
+// docs/sprite-sheet-binary-data.md
+void DocExporter::createBinaryDataFile(const Samples& samples,
+                                       std::ostream& stream,
+                                       doc::Sprite* texture)
+{
+  BufferedWriter os(stream);
+  int nonExtrudedPosition = 0;
+  int nonExtrudedSize = 0;
+  if (m_extrude) {
+    nonExtrudedPosition += 1;
+    nonExtrudedSize -= 2;
+  }
+
+  enum {
+    kHasTags   = 1,
+    kHasLayers = 2,
+    kHasSlices = 4,
+  };
+  uint16_t flags = 0;
+  if (m_listTags) flags |= kHasTags;
+  if (m_listLayers || m_listLayerHierarchy) flags |= kHasLayers;
+  if (m_listSlices) flags |= kHasSlices;
+
+  // Header
+  os.write("ASSD", 4);
+  os.writeUint16(1);            // Version
+  os.writeUint16(flags);
+  os.writeString(get_app_url());
+  os.writeString(get_app_version());
+  os.writeString(m_textureFilename.empty() ? std::string():
+                                             base::get_file_name(m_textureFilename));
+  os.writeUint8(texture->pixelFormat() == IMAGE_RGB ? 0: 1);
+  os.writeInt32(texture->width());
+  os.writeInt32(texture->height());
+
+  // Frames
+  os.writeUint32(samples.size());
+  for (const Sample& sample : samples) {
+    gfx::Rect frameBounds = sample.inTextureBounds();
+    frameBounds.x += nonExtrudedPosition;
+    frameBounds.y += nonExtrudedPosition;
+    frameBounds.w += nonExtrudedSize;
+    frameBounds.h += nonExtrudedSize;
+
+    os.writeString(sample.filename());
+    write_binary_rect(os, frameBounds);
+    os.writeUint8(sample.trimmed() ? 1: 0);
+    write_binary_rect(os, sample.trimmedBounds());
+    os.writeInt32(sample.originalSize().w);
+    os.writeInt32(sample.originalSize().h);
+    os.writeUint32(sample.sprite()->frameDuration(sample.frame()));
+  }
+
+  // Tags
+  if (flags & kHasTags) {
+    std::vector<std::pair<Doc*, Tag*>> tags;
+    for (Doc* doc : metaDocuments())
+      for (Tag* tag : doc->sprite()->tags())
+        tags.push_back(std::make_pair(doc, tag));
+
+    os.writeUint32(tags.size());
+    for (const auto& pair : tags) {
+      const Tag* tag = pair.second;
+      os.writeString(tagName(pair.first, tag));
+      os.writeInt32(tag->fromFrame());
+      os.writeInt32(tag->toFrame());
+      os.writeUint8(int(tag->aniDir()));
+      os.writeUint16(std::max(0, tag->repeat()));
+      write_binary_user_data(os, tag->userData());
+    }
+  }
+
+  // Layers
+  if (flags & kHasLayers) {
+    const LayerList layers = metaLayers();
+    os.writeUint32(layers.size());
+    for (const Layer* layer : layers) {
+      os.writeString(layer->name());
+      os.writeString(layer->parent() != layer->sprite()->root() ?
+                     layer->parent()->name(): std::string());
+
+      if (const auto* layerImg = dynamic_cast<const LayerImage*>(layer)) {
+        os.writeUint8(1);
+        os.writeUint8(layerImg->opacity());
+        os.writeUint16(uint16_t(layerImg->blendMode()));
+      }
+      else
+        os.writeUint8(0);
+      write_binary_user_data(os, layer->userData());
+
+      CelList cels;
+      layer->getCels(cels);
+      os.writeUint32(std::count_if(cels.begin(), cels.end(), cel_has_meta_data));
+      for (const Cel* cel : cels) {
+        if (!cel_has_meta_data(cel))
+          continue;
+        os.writeInt32(cel->frame());
+        os.writeUint8(cel->opacity());
+        os.writeInt32(cel->zIndex());
+        write_binary_user_data(os, cel->data()->userData());
+      }
+    }
+  }
+
+  // Slices
+  if (flags & kHasSlices) {
+    std::vector<const Slice*> slices;
+    for (Doc* doc : metaDocuments())
+      for (const Slice* slice : doc->sprite()->slices())
+        slices.push_back(slice);
+
+    os.writeUint32(slices.size());
+    for (const Slice* slice : slices) {
+      os.writeString(slice->name());
+      write_binary_user_data(os, slice->userData());
+
+      os.writeUint32(slice->size());
+      for (const auto& key : *slice) {
+        const SliceKey* sliceKey = key.value();
+        const bool hasCenter = !sliceKey->center().isEmpty();
+        const bool hasPivot = sliceKey->hasPivot();
+
+        os.writeInt32(key.frame());
+        write_binary_rect(os, sliceKey->bounds());
+        os.writeUint8((hasCenter ? 1: 0) | (hasPivot ? 2: 0));
+        if (hasCenter)
+          write_binary_rect(os, sliceKey->center());
+        if (hasPivot) {
+          os.writeInt32(sliceKey->pivot().x);
+          os.writeInt32(sliceKey->pivot().y);
+        }
+      }
+    }
+  }
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_DOC_EXPORTER_H_INCLUDED
 #pragma once
 
+#include "app/sample_render_cache.h"
 #include "app/sprite_sheet_data_format.h"
 #include "app/sprite_sheet_type.h"
 #include "base/disable_copying.h"
@@ -16,6 +17,7 @@
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "doc/image_buffer.h"
+#include "doc/layer_list.h"
 #include "doc/object_id.h"
 #include "doc/object_version.h"
 #include "gfx/fwd.h"
@@ -47,8 +49,13 @@ namespace app {
     void reset();
     void setDocImageBuffer(const doc::ImageBufferPtr& docBuf);
 
+    // Uses the given cache of sample renders (e.g. to keep the
+    // renders of the last export between different exporters).
+    void setSampleRenderCache(const SampleRenderCachePtr& cache) { m_renderCache = cache; }
+
     SpriteSheetDataFormat dataFormat() const { return m_dataFormat; }
     const std::string& dataFilename() { return m_dataFilename; }
+    const std::string& binaryDataFilename() { return m_binaryDataFilename; }
     const std::string& textureFilename() { return m_textureFilename; }
     SpriteSheetType spriteSheetType() { return m_sheetType; }
     const std::string& filenameFormat() const { return m_filenameFormat; }
@@ -56,6 +63,7 @@ namespace app {
 
     void setDataFormat(SpriteSheetDataFormat format) { m_dataFormat = format; }
     void setDataFilename(const std::string& filename) { m_dataFilename = filename; }
+    void setBinaryDataFilename(const std::string& filename) { m_binaryDataFilename = filename; }
     void setTextureFilename(const std::string& filename) { m_textureFilename = filename; }
     void setTextureWidth(int width) { m_textureWidth = width; }
     void setTextureHeight(int height) { m_textureHeight = height; }
@@ -127,6 +135,10 @@ namespace app {
                        base::task_token& token) const;
     void trimTexture(const Samples& samples, doc::Sprite* texture) const;
     void createDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
+    void createBinaryDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
+    std::vector<Doc*> metaDocuments() const;
+    doc::LayerList metaLayers() const;
+    std::string tagName(const Doc* doc, const doc::Tag* tag) const;
 
     class Item {
     public:
@@ -161,6 +173,7 @@ namespace app {
     SpriteSheetType m_sheetType;
     SpriteSheetDataFormat m_dataFormat;
     std::string m_dataFilename;
+    std::string m_binaryDataFilename;
     std::string m_textureFilename;
     std::string m_filenameFormat;
     std::string m_tagnameFormat;
@@ -188,6 +201,7 @@ namespace app {
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
     doc::ImageBufferPtr m_sampleBuf;
+    SampleRenderCachePtr m_renderCache;
 
     // Trimmed bounds of a specific sprite (to avoid recalculating
     // this)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,11 +18,14 @@
 #include "app/context.h"
 #include "app/doc_undo_observer.h"
 #include "app/pref/preferences.h"
+#include "app/util/undo_compression.h"
+#include "base/log.h"
 #include "base/mem_utils.h"
 #include "base/scoped_value.h"
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -31,11 +34,19 @@
 
 namespace app {
 
+// Number of recent undo states that are kept uncompressed (so
+// undoing the last actions doesn't need to uncompress anything).
+static constexpr int kUncompressedUndoStates = 8;
+
 DocUndo::DocUndo()
   : m_undoHistory(this)
 {
 }
 
+DocUndo::~DocUndo()
+{
+}
+
 void DocUndo::setContext(Context* ctx)
 {
   m_ctx = ctx;
@@ -64,6 +75,19 @@ void DocUndo::add(CmdTransaction* cmd)
   m_undoHistory.add(cmd);
   m_totalUndoSize += cmd->memSize();
 
+  if (App::instance()) {
+    auto& undoPref = App::instance()->preferences().undo;
+    if (undoPref.compressOldStates())
+      compressOldStates();
+
+    // If the spill size is 0, old undo states are always kept in
+    // memory.
+    const size_t spillSize =
+      size_t(std::max(0, undoPref.spillToDiskSize())) * 1024 * 1024;
+    if (spillSize > 0 && m_totalUndoSize > spillSize)
+      spillOldStates(spillSize);
+  }
+
   notify_observers(&DocUndoObserver::onAddUndoState, this);
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 
@@ -300,6 +324,71 @@ void DocUndo::moveToState(const undo::UndoState* state)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 }
 
+void DocUndo::compressOldStates()
+{
+  const undo::UndoState* state = m_undoHistory.lastState();
+  for (int i=0; state && i<kUncompressedUndoStates; ++i)
+    state = state->prev();
+
+  // Compress old states until we find one that is already compressed
+  // (states are uncompressed again when they are undone/redone).
+  for (; state; state = state->prev()) {
+    Cmd* cmd = STATE_CMD(state);
+    if (cmd->isCompressed())
+      break;
+
+    const size_t oldSize = cmd->memSize();
+    cmd->compress();
+    m_totalUndoSize -= oldSize;
+    m_totalUndoSize += cmd->memSize();
+
+    UNDO_TRACE("UNDO: Compressed state <%s> from %s to %s\n",
+               cmd->label().c_str(),
+               base::get_pretty_memory_size(oldSize).c_str(),
+               base::get_pretty_memory_size(cmd->memSize()).c_str());
+  }
+}
+
+void DocUndo::spillOldStates(const size_t spillSize)
+{
+  if (!m_spillFile)
+    m_spillFile = std::make_unique<UndoSpillFile>();
+
+  // The most recent states are never spilled
+  const undo::UndoState* recent = m_undoHistory.lastState();
+  for (int i=0; recent && i<kUncompressedUndoStates; ++i)
+    recent = recent->prev();
+  if (!recent)
+    return;
+
+  for (const undo::UndoState* state = m_undoHistory.firstState();
+       state && m_totalUndoSize > spillSize;
+       state = state->next()) {
+    Cmd* cmd = STATE_CMD(state);
+    if (!cmd->isSpilled()) {
+      const size_t oldSize = cmd->memSize();
+      bool ok = true;
+      try {
+        cmd->spill(m_spillFile.get());
+      }
+      catch (const std::exception& ex) {
+        LOG(ERROR, "UNDO: Cannot spill undo state to disk: %s\n", ex.what());
+        ok = false;
+      }
+      m_totalUndoSize -= oldSize;
+      m_totalUndoSize += cmd->memSize();
+      if (!ok)
+        break;
+
+      UNDO_TRACE("UNDO: Spilled state <%s> of %s to disk\n",
+                 cmd->label().c_str(),
+                 base::get_pretty_memory_size(oldSize).c_str());
+    }
+    if (state == recent)
+      break;
+  }
+}
+
 const undo::UndoState* DocUndo::nextUndo() const
 {
   return m_undoHistory.currentState();
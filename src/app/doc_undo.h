@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "undo/undo_history.h"
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 namespace app {
@@ -26,6 +27,7 @@ namespace app {
   class CmdTransaction;
   class Context;
   class DocUndoObserver;
+  class UndoSpillFile;
 
   // Exception thrown when we want to modify the sprite (add new
   // app::Cmd objects) when we are undoing/redoing/moving throw the
@@ -40,6 +42,7 @@ namespace app {
                   public undo::UndoHistoryDelegate {
   public:
     DocUndo();
+    ~DocUndo();
 
     size_t totalUndoSize() const { return m_totalUndoSize; }
 
@@ -101,12 +104,24 @@ namespace app {
     void moveToState(const undo::UndoState* state);
 
   private:
+    // Compresses the undo information of old undo states (all
+    // except the last kUncompressedUndoStates ones).
+    void compressOldStates();
+
+    // Moves the undo information of the oldest states to a temporary
+    // file until the total undo size is smaller than spillSize.
+    void spillOldStates(const size_t spillSize);
+
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
 
     // undo::UndoHistoryDelegate impl
     void onDeleteUndoState(undo::UndoState* state) override;
 
+    // File used to spill old undo states (it's declared before
+    // m_undoHistory because spilled commands release their space
+    // from this file when they are deleted).
+    std::unique_ptr<UndoSpillFile> m_spillFile;
     undo::UndoHistory m_undoHistory;
     const undo::UndoState* m_savedState = nullptr;
     Context* m_ctx = nullptr;
@@ -0,0 +1,346 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/copy_region.h"
+#include "app/cmd/patch_cel.h"
+#include "app/cmd/remap_colors.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_api.h"
+#include "app/doc_range.h"
+#include "app/doc_range_ops.h"
+#include "app/doc_undo.h"
+#include "app/test_context.h"
+#include "app/tx.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/remap.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_us(const Clock::time_point& t0,
+                  const Clock::time_point& t1)
+{
+  return std::chrono::duration<double, std::micro>(t1 - t0).count();
+}
+
+// Runs the same transaction in each iteration measuring the time to
+// execute/undo/redo it, and the undo memory used by the
+// transaction. Each iteration starts from the same state (the
+// transaction is undone again and the redo history cleared, without
+// timing).
+void run_transaction(benchmark::State& state,
+                     Doc* doc,
+                     const std::function<void()>& execute)
+{
+  DocUndo* undo = doc->undoHistory();
+  double executeTime = 0.0;
+  double undoTime = 0.0;
+  double redoTime = 0.0;
+  double memSize = 0.0;
+
+  for (auto _ : state) {
+    const size_t oldSize = undo->totalUndoSize();
+    const auto t0 = Clock::now();
+    execute();
+    const auto t1 = Clock::now();
+    undo->undo();
+    const auto t2 = Clock::now();
+    undo->redo();
+    const auto t3 = Clock::now();
+
+    executeTime += elapsed_us(t0, t1);
+    undoTime += elapsed_us(t1, t2);
+    redoTime += elapsed_us(t2, t3);
+    memSize += double(undo->totalUndoSize() - oldSize);
+
+    state.PauseTiming();
+    undo->undo();
+    undo->clearRedo();
+    state.ResumeTiming();
+  }
+
+  const double n = double(state.iterations());
+  state.counters["execute_us"] = executeTime / n;
+  state.counters["undo_us"] = undoTime / n;
+  state.counters["redo_us"] = redoTime / n;
+  state.counters["mem_bytes"] = memSize / n;
+}
+
+void fill_random(Image* image, const int seed)
+{
+  std::srand(seed);
+  doc::algorithm::random_image(image);
+}
+
+} // anonymous namespace
+
+// Commit of a stroke in a cel (like a ToolLoop), args: sprite size,
+// patch size
+void BM_PatchCel(benchmark::State& state) {
+  const int size = state.range(0);
+  const int patchSize = state.range(1);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(size, size));
+  Cel* cel = doc->sprite()->firstLayer()->cel(0);
+  fill_random(cel->image(), 1);
+
+  ImageRef patch(Image::create(IMAGE_RGB, patchSize, patchSize));
+  fill_random(patch.get(), 2);
+  const gfx::Region region(patch->bounds());
+  const gfx::Point pos((size - patchSize) / 2,
+                       (size - patchSize) / 2);
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "Stroke");
+    tx(new cmd::PatchCel(cel, patch.get(), region, pos));
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+// Moves a range of cels to the next frames, args: number of cels
+void BM_MoveCelRange(benchmark::State& state) {
+  const int ncels = state.range(0);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(256, 256));
+  Sprite* sprite = doc->sprite();
+  auto layer = static_cast<LayerImage*>(sprite->firstLayer());
+  sprite->setTotalFrames(2*ncels);
+  for (frame_t frame=1; frame<ncels; ++frame) {
+    ImageRef image(Image::create(sprite->spec()));
+    fill_random(image.get(), frame);
+    layer->addCel(new Cel(frame, image));
+  }
+
+  DocRange from, to;
+  from.startRange(layer, 0, DocRange::kCels);
+  from.endRange(layer, ncels-1);
+  to.startRange(layer, ncels, DocRange::kCels);
+  to.endRange(layer, 2*ncels-1);
+
+  run_transaction(state, doc.get(), [&]{
+    move_range(doc.get(), from, to, kDocRangeAfter);
+  });
+
+  doc->close();
+}
+
+// Adds a frame copying the cels of the previous frame, args: number
+// of layers
+void BM_AddFrame(benchmark::State& state) {
+  const int nlayers = state.range(0);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(256, 256));
+  Sprite* sprite = doc->sprite();
+  for (int i=1; i<nlayers; ++i) {
+    auto layer = new LayerImage(sprite);
+    ImageRef image(Image::create(sprite->spec()));
+    fill_random(image.get(), i);
+    layer->addCel(new Cel(0, image));
+    sprite->root()->addLayer(layer);
+  }
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "New Frame");
+    doc->getApi(tx).addFrame(sprite, 1);
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+// Removes the first frame of a sprite, args: number of layers
+void BM_RemoveFrame(benchmark::State& state) {
+  const int nlayers = state.range(0);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(256, 256));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(2);
+  for (int i=1; i<nlayers; ++i)
+    sprite->root()->addLayer(new LayerImage(sprite));
+  int seed = 0;
+  for (Layer* layer : sprite->root()->layers()) {
+    for (frame_t frame=0; frame<2; ++frame) {
+      if (!layer->cel(frame)) {
+        ImageRef image(Image::create(sprite->spec()));
+        fill_random(image.get(), ++seed);
+        static_cast<LayerImage*>(layer)->addCel(new Cel(frame, image));
+      }
+    }
+  }
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "Remove Frame");
+    doc->getApi(tx).removeFrame(sprite, 0);
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+// Removes a range of frames, args: number of layers, number of
+// removed frames (of a sprite with twice that number of frames)
+void BM_RemoveFrameRange(benchmark::State& state) {
+  const int nlayers = state.range(0);
+  const int nframes = state.range(1);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(32, 32));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(2*nframes);
+  for (int i=1; i<nlayers; ++i)
+    sprite->root()->addLayer(new LayerImage(sprite));
+  // Linked cels to avoid using too much memory
+  for (Layer* layer : sprite->root()->layers()) {
+    auto imgLayer = static_cast<LayerImage*>(layer);
+    Cel* firstCel = imgLayer->cel(0);
+    if (!firstCel) {
+      firstCel = new Cel(0, ImageRef(Image::create(sprite->spec())));
+      imgLayer->addCel(firstCel);
+    }
+    for (frame_t frame=1; frame<2*nframes; ++frame)
+      imgLayer->addCel(Cel::MakeLink(frame, firstCel));
+  }
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "Remove Frames");
+    doc->getApi(tx).removeFrames(sprite, 0, nframes);
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+// Remaps the colors of all cels of an indexed sprite (e.g. sorting
+// the palette), args: sprite size, number of frames
+void BM_RemapColors(benchmark::State& state) {
+  const int size = state.range(0);
+  const int nframes = state.range(1);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(size, size, ColorMode::INDEXED));
+  Sprite* sprite = doc->sprite();
+  auto layer = static_cast<LayerImage*>(sprite->firstLayer());
+  sprite->setTotalFrames(nframes);
+  fill_random(layer->cel(0)->image(), 0);
+  for (frame_t frame=1; frame<nframes; ++frame) {
+    ImageRef image(Image::create(sprite->spec()));
+    fill_random(image.get(), frame);
+    layer->addCel(new Cel(frame, image));
+  }
+
+  Remap remap(256);
+  for (int i=0; i<256; ++i)
+    remap.map(i, 255-i);
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "Remap Colors");
+    tx(new cmd::RemapColors(sprite, remap));
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+// Modifies several tiles of a tileset in one transaction, args:
+// number of modified tiles, tile size
+void BM_TileEdits(benchmark::State& state) {
+  const int ntiles = state.range(0);
+  const int tileSize = state.range(1);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(256, 256));
+  Sprite* sprite = doc->sprite();
+  auto tileset = new Tileset(sprite, Grid(gfx::Size(tileSize, tileSize)), ntiles+1);
+  sprite->tilesets()->add(tileset);
+
+  std::vector<ImageRef> newTiles(ntiles);
+  for (int i=0; i<ntiles; ++i) {
+    newTiles[i].reset(Image::create(IMAGE_RGB, tileSize, tileSize));
+    fill_random(newTiles[i].get(), i);
+  }
+  const gfx::Region region(gfx::Rect(0, 0, tileSize, tileSize));
+
+  run_transaction(state, doc.get(), [&]{
+    Tx tx(doc.get(), "Tile Edits");
+    for (int i=0; i<ntiles; ++i) {
+      const tile_index ti = tile_index(i+1);
+      tx(new cmd::CopyTileRegion(tileset->get(ti).get(),
+                                 newTiles[i].get(),
+                                 region, gfx::Point(0, 0),
+                                 false, ti, tileset));
+    }
+    tx.commit();
+  });
+
+  doc->close();
+}
+
+BENCHMARK(BM_PatchCel)
+  ->ArgsProduct({ { 256, 1024, 4096 }, { 16, 128 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_MoveCelRange)
+  ->Arg(1)->Arg(16)->Arg(128)
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_AddFrame)
+  ->Arg(1)->Arg(16)->Arg(128)
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_RemoveFrame)
+  ->Arg(1)->Arg(16)->Arg(128)
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_RemoveFrameRange)
+  ->ArgsProduct({ { 1, 200 }, { 10, 1000 } })
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RemapColors)
+  ->ArgsProduct({ { 256, 1024 }, { 1, 16 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TileEdits)
+  ->ArgsProduct({ { 1, 64, 1024 }, { 8, 32 } })
+  ->Unit(benchmark::kMicrosecond);
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -25,6 +25,7 @@
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "doc/parallel.h"
 #include "render/dithering_matrix.h"
 #include "ui/widget.h"
 
@@ -42,7 +43,9 @@
 #include "archive_entry.h"
 #include "json11.hpp"
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <queue>
 #include <sstream>
 #include <string>
@@ -181,12 +184,9 @@ private:
 
 void read_json_file(const std::string& path, json11::Json& json)
 {
-  std::string jsonText, line;
   std::ifstream in(FSTREAM_PATH(path), std::ifstream::binary);
-  while (std::getline(in, line)) {
-    jsonText += line;
-    jsonText.push_back('\n');
-  }
+  std::string jsonText((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
   std::string err;
   json = json11::Json::parse(jsonText, err);
   if (!err.empty())
@@ -808,8 +808,17 @@ Extensions::Extensions()
   rf.includeUserDir("extensions");
   rf.includeDataDir("extensions");
 
-  // Load extensions from data/ directory on all possible locations
-  // (installed folder and user folder)
+  struct Package {
+    std::string dir;
+    std::string fullFn;
+    bool isBuiltinExtension;
+    json11::Json json;
+    std::string error;
+  };
+  std::vector<Package> packages;
+
+  // Look for extensions from data/ directory on all possible
+  // locations (installed folder and user folder)
   while (rf.next()) {
     const auto& extensionsDir = rf.filename();
 
@@ -827,20 +836,46 @@ Extensions::Extensions()
       auto fullFn = base::join_path(dir, kPackageJson);
       fullFn = base::normalize_path(fullFn);
 
-      LOG("EXT: Loading extension '%s'...\n", fullFn.c_str());
       if (!base::is_file(fullFn)) {
         LOG("EXT: File '%s' not found\n", fullFn.c_str());
         continue;
       }
 
+      packages.push_back(Package{ dir, fullFn, isBuiltinExtension });
+    }
+  }
+
+  // Read and parse all package.json files in parallel (this is the
+  // slow part when there are lots of extensions). Contributed
+  // resources are just registered by path and loaded on demand.
+  doc::parallel_for(0, int(packages.size()), 1, [&packages](int begin, int end){
+    for (int i=begin; i<end; ++i) {
+      Package& pkg = packages[i];
       try {
-        loadExtension(dir, fullFn, isBuiltinExtension);
+        read_json_file(pkg.fullFn, pkg.json);
       }
       catch (const std::exception& ex) {
-        LOG("EXT: Error loading JSON file: %s\n",
-            ex.what());
+        pkg.error = ex.what();
       }
     }
+  });
+
+  // Register extensions in the same order they were found
+  for (const Package& pkg : packages) {
+    LOG("EXT: Loading extension '%s'...\n", pkg.fullFn.c_str());
+    if (!pkg.error.empty()) {
+      LOG("EXT: Error loading JSON file: %s\n",
+          pkg.error.c_str());
+      continue;
+    }
+
+    try {
+      loadExtension(pkg.dir, pkg.json, pkg.isBuiltinExtension);
+    }
+    catch (const std::exception& ex) {
+      LOG("EXT: Error loading extension: %s\n",
+          ex.what());
+    }
   }
 }
 
@@ -1113,6 +1148,13 @@ Extension* Extensions::loadExtension(const std::string& path,
 {
   json11::Json json;
   read_json_file(fullPackageFilename, json);
+  return loadExtension(path, json, isBuiltinExtension);
+}
+
+Extension* Extensions::loadExtension(const std::string& path,
+                                     const json11::Json& json,
+                                     const bool isBuiltinExtension)
+{
   auto name = json["name"].string_value();
   auto version = json["version"].string_value();
   auto displayName = json["displayName"].string_value();
@@ -23,15 +23,21 @@
 #include "dio/aseprite_decoder.h"
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
+#include "dio/mapped_file.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "ui/alert.h"
 #include "ver/info.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <deque>
+#include <map>
+#include <memory>
+#include <tuple>
 #include <variant>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
@@ -70,6 +76,16 @@ public:
     return m_fop->isOneFrame();
   }
 
+  bool decodeMetadataOnly() override {
+    return m_fop->isMetadataOnly();
+  }
+
+  bool decodeCel(const doc::Layer* layer,
+                 const doc::frame_t frame,
+                 const gfx::Rect& celBounds) override {
+    return m_fop->loadROI().containsCel(layer, frame, celBounds);
+  }
+
   doc::color_t defaultSliceColor() override {
     auto color = m_fop->config().defaultSliceColor;
     return doc::rgba(color.getRed(),
@@ -88,6 +104,10 @@ public:
     return m_fop->config().cacheCompressedTilesets;
   }
 
+  std::size_t parallelDecodingMemoryLimit() const override {
+    return 64*1024*1024;
+  }
+
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
@@ -117,31 +137,6 @@ public:
   }
 };
 
-class TilesetScanlines : public ScanlinesGen {
-  const Tileset* m_tileset;
-public:
-  TilesetScanlines(const Tileset* tileset) : m_tileset(tileset) { }
-  gfx::Size getImageSize() const override {
-    return gfx::Size(m_tileset->grid().tileSize().w,
-                     m_tileset->grid().tileSize().h * m_tileset->size());
-  }
-  int getScanlineSize() const override {
-    return bytes_per_pixel_for_colormode(m_tileset->sprite()->colorMode())
-      * m_tileset->grid().tileSize().w;
-  }
-  const uint8_t* getScanlineAddress(int y) const override {
-    const int h = m_tileset->grid().tileSize().h;
-    const tile_index ti = (y / h);
-    ASSERT(ti >= 0 && ti < m_tileset->size());
-    ImageRef image = m_tileset->get(ti);
-    ASSERT(image);
-    if (image)
-      return image->getPixelAddress(0, y % h);
-    else
-      return nullptr;
-  }
-};
-
 } // anonymous namespace
 
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
@@ -152,6 +147,14 @@ static void ase_file_write_header_filesize(FILE* f, dio::AsepriteHeader* header)
 static void ase_file_prepare_frame_header(FILE* f, dio::AsepriteFrameHeader* frame_header);
 static void ase_file_write_frame_header(FILE* f, dio::AsepriteFrameHeader* frame_header);
 
+// Compressed data of the plain cel images (e.g. empty or filled
+// with one color) already written in the file, by pixel format,
+// width, height, and color. The same plain cels are usually repeated
+// in all frames, so we compress them just once.
+using PlainImagesCache = std::map<std::tuple<int, int, int, color_t>, base::buffer>;
+
+class CelsCompressor;
+
 static void ase_file_write_layers(FILE* f, FileOp* fop,
                                   dio::AsepriteFrameHeader* frame_header,
                                   const dio::AsepriteExternalFiles& ext_files,
@@ -161,7 +164,8 @@ static layer_t ase_file_write_cels(FILE* f,  FileOp* fop,
                                    const dio::AsepriteExternalFiles& ext_files,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
-                                   const frame_t frame);
+                                   const frame_t frame,
+                                   CelsCompressor& compressor);
 
 static void ase_file_write_padding(FILE* f, int bytes);
 static void ase_file_write_string(FILE* f, const std::string& string);
@@ -177,7 +181,8 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
-                                     const frame_t firstFrame);
+                                     const frame_t firstFrame,
+                                     CelsCompressor& compressor);
 static void ase_file_write_cel_extra_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
                                            const Cel* cel);
 static void ase_file_write_color_profile(FILE* f,
@@ -206,12 +211,14 @@ static void ase_file_write_external_files_chunk(FILE* f, FileOp* fop,
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
-                                          const Tilesets* tilesets);
+                                          const Tilesets* tilesets,
+                                          CelsCompressor& compressor);
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
                                          const Tileset* tileset,
-                                         const tileset_index si);
+                                         const tileset_index si,
+                                         CelsCompressor& compressor);
 static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
                                            const dio::AsepriteExternalFiles& ext_files,
                                             size_t nmaps,
@@ -219,6 +226,186 @@ static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
 static bool ase_has_groups(LayerGroup* group);
 static void ase_ungroup_all(LayerGroup* group);
 
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame);
+static int ase_file_compression_level(const FileOpConfig& config);
+static void compress_image(const ScanlinesGen* gen,
+                           PixelFormat pixelFormat,
+                           const int level,
+                           base::buffer& output);
+static void compress_tileset(const Tileset* tileset,
+                             const int level,
+                             const bool useCache,
+                             base::buffer& output);
+static bool tileset_has_cached_compressed_data(const Tileset* tileset);
+
+// Compresses the cel images and tilesets of the following frames
+// with worker threads while the frames are written in order in the
+// file. The zlib compression is the slowest part of saving a big
+// sprite, so this way the file can be written while the next cels
+// are being compressed.
+class CelsCompressor {
+public:
+  // Maximum size of the uncompressed images queued to be compressed
+  // (to avoid keeping the compressed data of the whole sprite in
+  // memory).
+  static constexpr std::size_t kMaxQueuedBytes = 256*1024*1024;
+
+  CelsCompressor(const Sprite* sprite, const FileOp* fop)
+    : m_sprite(sprite)
+    , m_firstFrame(fop->roi().fromFrame())
+    , m_level(ase_file_compression_level(fop->config()))
+    , m_cacheTilesets(fop->config().cacheCompressedTilesets)
+    , m_layers(sprite->allLayers())
+    , m_nextFrame(0)
+    , m_queuedBytes(0) {
+    for (frame_t frame : fop->roi().framesSequence())
+      m_frames.push_back(frame);
+  }
+
+  ~CelsCompressor() {
+    for (auto& batch : m_batches)
+      batch->tasks.cancel();
+  }
+
+  // Queues the compression of the following frames (at least
+  // "outputFrame") and waits the compressed data of "outputFrame".
+  void startFrame(const int outputFrame) {
+    while (m_nextFrame < int(m_frames.size()) &&
+           (m_nextFrame <= outputFrame ||
+            m_queuedBytes < kMaxQueuedBytes)) {
+      queueFrame(m_nextFrame++);
+    }
+
+    ASSERT(!m_batches.empty());
+    ASSERT(m_batches.front()->outputFrame == outputFrame);
+    m_batches.front()->tasks.wait();
+  }
+
+  // Releases the compressed data of the written frame.
+  void endFrame() {
+    ASSERT(!m_batches.empty());
+    m_queuedBytes -= m_batches.front()->bytes;
+    m_batches.pop_front();
+  }
+
+  // Returns the compressed data of the given image or tileset of
+  // the current frame, or nullptr if it must be compressed now.
+  const base::buffer* compressedData(const ObjectId id) const {
+    if (m_batches.empty())
+      return nullptr;
+    const auto& data = m_batches.front()->data;
+    auto it = data.find(id);
+    if (it != data.end())
+      return &it->second;
+    return nullptr;
+  }
+
+  PlainImagesCache& plainImages() { return m_plainImages; }
+  int level() const { return m_level; }
+
+private:
+  struct Batch {
+    int outputFrame;
+    // Compressed data by image/tileset ID. All entries are created
+    // before starting the tasks, so each task modifies its own
+    // buffer only.
+    std::map<ObjectId, base::buffer> data;
+    std::size_t bytes = 0;
+    doc::TaskGroup tasks;
+  };
+
+  void queueFrame(const int outputFrame) {
+    auto batch = std::make_unique<Batch>();
+    batch->outputFrame = outputFrame;
+
+    struct Job {
+      std::unique_ptr<ScanlinesGen> gen;
+      PixelFormat pixelFormat;
+      base::buffer* output;
+    };
+    std::vector<Job> jobs;
+    std::vector<std::pair<const Tileset*, base::buffer*>> tilesetJobs;
+
+    // Tilesets are written in the first frame
+    if (outputFrame == 0) {
+      for (const Tileset* tileset : *m_sprite->tilesets()) {
+        if (!tileset ||
+            !tileset->externalFilename().empty() ||
+            tileset_has_cached_compressed_data(tileset))
+          continue;
+
+        const gfx::Size tileSize = tileset->grid().tileSize();
+        batch->bytes += std::size_t(bytes_per_pixel_for_colormode(m_sprite->colorMode()))
+          * tileSize.w * tileSize.h * tileset->size();
+        tilesetJobs.push_back(std::make_pair(tileset,
+                                             &batch->data[tileset->id()]));
+      }
+    }
+
+    const frame_t frame = m_frames[outputFrame];
+    for (const Layer* layer : m_layers) {
+      if (!layer->isImage())
+        continue;
+
+      const Cel* cel = layer->cel(frame);
+      if (!cel ||
+          ase_file_get_cel_link(cel, static_cast<const LayerImage*>(layer),
+                                m_firstFrame))
+        continue;
+
+      // Plain images are compressed once in the main thread (see
+      // write_compressed_cel_image())
+      const Image* image = cel->image();
+      color_t color;
+      bool exact;
+      if (!image || (image->isPlain(&color, &exact) && exact))
+        continue;
+
+      batch->bytes += std::size_t(image->rowBytes()) * image->height();
+      jobs.push_back(Job{ std::make_unique<ImageScanlines>(image),
+                          image->pixelFormat(),
+                          &batch->data[image->id()] });
+    }
+
+    for (auto& job : jobs) {
+      batch->tasks.run(
+        [gen = std::shared_ptr<ScanlinesGen>(std::move(job.gen)),
+         pixelFormat = job.pixelFormat,
+         level = m_level,
+         output = job.output](base::task_token& token){
+          if (!token.canceled())
+            compress_image(gen.get(), pixelFormat, level, *output);
+        });
+    }
+    for (const auto& [tileset, output] : tilesetJobs) {
+      batch->tasks.run(
+        [tileset = tileset,
+         level = m_level,
+         useCache = m_cacheTilesets,
+         output = output](base::task_token& token){
+          if (!token.canceled())
+            compress_tileset(tileset, level, useCache, *output);
+        });
+    }
+
+    m_queuedBytes += batch->bytes;
+    m_batches.push_back(std::move(batch));
+  }
+
+  const Sprite* m_sprite;
+  frame_t m_firstFrame;
+  int m_level;
+  bool m_cacheTilesets;
+  LayerList m_layers;
+  std::vector<frame_t> m_frames;
+  int m_nextFrame;
+  std::size_t m_queuedBytes;
+  std::deque<std::unique_ptr<Batch>> m_batches;
+  PlainImagesCache m_plainImages;
+};
+
 class ChunkWriter {
 public:
   ChunkWriter(FILE* f, dio::AsepriteFrameHeader* frame_header, int type) : m_file(f) {
@@ -280,12 +467,24 @@ FileFormat* CreateAseFormat()
 
 bool AseFormat::onLoad(FileOp* fop)
 {
-  FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+  // Map the file in memory so the decoder can read the compressed
+  // cels without copying them, or read it with stdio if that's not
+  // possible.
+  dio::MappedFile mappedFile(fop->filename());
+  FileHandle handle;
+  std::unique_ptr<dio::FileInterface> fileInterface;
+  if (mappedFile.data()) {
+    fileInterface = std::make_unique<dio::MemoryFileInterface>(
+      mappedFile.data(), mappedFile.size());
+  }
+  else {
+    handle = open_file_with_exception(fop->filename(), "rb");
+    fileInterface = std::make_unique<dio::StdioFileInterface>(handle.get());
+  }
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
-  decoder.initialize(&delegate, &fileInterface);
+  decoder.initialize(&delegate, fileInterface.get());
   if (!decoder.decode())
     return false;
 
@@ -371,7 +570,12 @@ bool AseFormat::onSave(FileOp* fop)
   // Write frames
   int outputFrame = 0;
   dio::AsepriteExternalFiles ext_files;
+  CelsCompressor compressor(sprite, fop);
   for (frame_t frame : fop->roi().framesSequence()) {
+    // Wait the compressed cels of this frame (and start compressing
+    // the next ones)
+    compressor.startFrame(outputFrame);
+
     // Prepare the frame header
     dio::AsepriteFrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -416,7 +620,7 @@ bool AseFormat::onSave(FileOp* fop)
 
       // Write tilesets
       ase_file_write_tileset_chunks(f, fop, &frame_header, ext_files,
-                                    sprite->tilesets());
+                                    sprite->tilesets(), compressor);
 
       // Writer frame tags
       if (sprite->tags().size() > 0) {
@@ -447,10 +651,11 @@ bool AseFormat::onSave(FileOp* fop)
     // Write cel chunks
     ase_file_write_cels(f, fop, &frame_header, ext_files,
                         sprite, sprite->root(),
-                        0, frame);
+                        0, frame, compressor);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
+    compressor.endFrame();
 
     // Progress
     if (fop->roi().frames() > 1)
@@ -595,14 +800,16 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
                                    const dio::AsepriteExternalFiles& ext_files,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
-                                   const frame_t frame)
+                                   const frame_t frame,
+                                   CelsCompressor& compressor)
 {
   if (layer->isImage()) {
     const Cel* cel = layer->cel(frame);
     if (cel) {
       ase_file_write_cel_chunk(f, frame_header, cel,
                                static_cast<const LayerImage*>(layer),
-                               layer_index, sprite, fop->roi().fromFrame());
+                               layer_index, sprite, fop->roi().fromFrame(),
+                               compressor);
 
       if (layer->isReference())
         ase_file_write_cel_extra_chunk(f, frame_header, cel);
@@ -622,7 +829,7 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
     for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
       layer_index =
         ase_file_write_cels(f, fop, frame_header, ext_files, sprite, child,
-                            layer_index, frame);
+                            layer_index, frame, compressor);
     }
   }
 
@@ -874,9 +1081,9 @@ static void write_raw_image(FILE* f, ScanlinesGen* gen, PixelFormat pixelFormat)
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void write_compressed_image_templ(FILE* f,
-                                         ScanlinesGen* gen,
-                                         base::buffer* compressedOutput)
+static void compress_image_templ(const ScanlinesGen* gen,
+                                 const int level,
+                                 base::buffer& output)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -885,14 +1092,19 @@ static void write_compressed_image_templ(FILE* f,
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, level);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
   std::vector<uint8_t> scanline(gen->getScanlineSize());
-  std::vector<uint8_t> compressed(4096);
-
   const gfx::Size imgSize = gen->getImageSize();
+
+  // Compress directly in the output buffer (with enough space for
+  // the worst case)
+  output.resize(deflateBound(&zstream, uLong(scanline.size()) * imgSize.h));
+  zstream.next_out = (Bytef*)output.data();
+  zstream.avail_out = output.size();
+
   for (y=0; y<imgSize.h; ++y) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)gen->getScanlineAddress(y);
@@ -903,64 +1115,318 @@ static void write_compressed_image_templ(FILE* f,
     zstream.avail_in = scanline.size();
     int flush = (y == imgSize.h-1 ? Z_FINISH: Z_NO_FLUSH);
 
-    do {
-      zstream.next_out = (Bytef*)&compressed[0];
-      zstream.avail_out = compressed.size();
-
-      // Compress
-      err = deflate(&zstream, flush);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in deflate().", err);
-
-      int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-
-        // Save the whole compressed buffer to re-use in following
-        // save options (so we don't have to re-compress the whole
-        // tileset)
-        if (compressedOutput) {
-          std::size_t n = compressedOutput->size();
-          compressedOutput->resize(n + output_bytes);
-          std::copy(compressed.begin(),
-                    compressed.begin() + output_bytes,
-                    compressedOutput->begin() + n);
-        }
-      }
-    } while (zstream.avail_out == 0);
+    // Compress
+    err = deflate(&zstream, flush);
+    if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      throw base::Exception("ZLib error %d in deflate().", err);
+    ASSERT(zstream.avail_in == 0);
   }
 
+  output.resize(zstream.total_out);
+
   err = deflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
-static void write_compressed_image(FILE* f,
-                                   ScanlinesGen* gen,
-                                   PixelFormat pixelFormat,
-                                   base::buffer* compressedOutput = nullptr)
+static int ase_file_compression_level(const FileOpConfig& config)
+{
+  switch (config.asepriteCompression) {
+    case gen::AsepriteCompression::FAST: return Z_BEST_SPEED;
+    case gen::AsepriteCompression::BEST: return Z_BEST_COMPRESSION;
+    // Uncompressed zlib blocks
+    case gen::AsepriteCompression::NONE: return Z_NO_COMPRESSION;
+    default: return Z_DEFAULT_COMPRESSION;
+  }
+}
+
+static void compress_image(const ScanlinesGen* gen,
+                           PixelFormat pixelFormat,
+                           const int level,
+                           base::buffer& output)
 {
   switch (pixelFormat) {
     case IMAGE_RGB:
-      write_compressed_image_templ<RgbTraits>(f, gen, compressedOutput);
+      compress_image_templ<RgbTraits>(gen, level, output);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      compress_image_templ<GrayscaleTraits>(gen, level, output);
+      break;
+
+    case IMAGE_INDEXED:
+      compress_image_templ<IndexedTraits>(gen, level, output);
+      break;
+
+    case IMAGE_TILEMAP:
+      compress_image_templ<TilemapTraits>(gen, level, output);
+      break;
+  }
+}
+
+// Number of consecutive tiles compressed in each segment of a
+// tileset (about 64KB of pixels, so the compression ratio is similar
+// to compressing the whole tileset in one segment).
+static int tileset_tiles_per_segment(const Tileset* tileset)
+{
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const int tileBytes =
+    bytes_per_pixel_for_colormode(tileset->sprite()->colorMode())
+    * tileSize.w * tileSize.h;
+  return std::max(1, 64*1024 / std::max(1, tileBytes));
+}
+
+// Returns the key of the cached compressed segment of the tiles
+// [begin, end). It changes when a tile is modified (the content hash
+// is included in case that a tile is modified without incrementing
+// its version).
+static uint64_t tileset_segment_key(const Tileset* tileset,
+                                    const tile_index begin,
+                                    const tile_index end,
+                                    const int level)
+{
+  // FNV-1a of each value
+  uint64_t key = 14695981039346656037ull;
+  auto mix = [&key](const uint64_t value) {
+    key ^= value;
+    key *= 1099511628211ull;
+  };
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  mix(uint32_t(level));
+  mix(int(tileset->sprite()->pixelFormat()));
+  mix(tileSize.w);
+  mix(tileSize.h);
+  mix(end - begin);
+  for (tile_index ti=begin; ti<end; ++ti) {
+    const ImageRef image = tileset->get(ti);
+    if (image) {
+      mix(image->id());
+      mix(image->version());
+      mix(image->contentHash());
+    }
+    else
+      mix(0);
+  }
+  return key;
+}
+
+// Compresses the pixels of the tiles [begin, end) in a raw deflate
+// segment that doesn't reference previous data and ends in a byte
+// boundary (Z_FULL_FLUSH), so segments can be concatenated in one
+// zlib stream (see compress_tileset()). The first 4 bytes of the
+// output contain the Adler-32 checksum of the uncompressed pixels.
+template<typename ImageTraits>
+static void compress_tileset_segment_templ(const Tileset* tileset,
+                                           const tile_index begin,
+                                           const tile_index end,
+                                           const int level,
+                                           base::buffer& output)
+{
+  PixelIO<ImageTraits> pixel_io;
+  z_stream zstream;
+  int err;
+
+  zstream.zalloc = (alloc_func)0;
+  zstream.zfree  = (free_func)0;
+  zstream.opaque = (voidpf)0;
+  err = deflateInit2(&zstream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in deflateInit2().", err);
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  std::vector<uint8_t> scanline(ImageTraits::bytes_per_pixel * tileSize.w);
+  const int rows = tileSize.h * (end - begin);
+
+  // Space for the worst case + the checksum + the empty stored block
+  // added by the full flush
+  output.resize(4 + deflateBound(&zstream, uLong(scanline.size()) * rows) + 16);
+  zstream.next_out = (Bytef*)output.data() + 4;
+  zstream.avail_out = output.size() - 4;
+
+  uLong adler = adler32(0, nullptr, 0);
+  for (tile_index ti=begin; ti<end; ++ti) {
+    const ImageRef image = tileset->get(ti);
+    ASSERT(image);
+    ASSERT(image->size() == tileSize);
+
+    for (int y=0; y<tileSize.h; ++y) {
+      if (image)
+        pixel_io.write_scanline(
+          (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+          tileSize.w, &scanline[0]);
+      adler = adler32(adler, &scanline[0], uInt(scanline.size()));
+
+      zstream.next_in = (Bytef*)&scanline[0];
+      zstream.avail_in = scanline.size();
+      const int flush = (ti == end-1 && y == tileSize.h-1 ? Z_FULL_FLUSH: Z_NO_FLUSH);
+
+      err = deflate(&zstream, flush);
+      if (err != Z_OK && err != Z_BUF_ERROR)
+        throw base::Exception("ZLib error %d in deflate().", err);
+      ASSERT(zstream.avail_in == 0);
+    }
+  }
+
+  output.resize(4 + zstream.total_out);
+  output[0] = (adler >> 24) & 0xff;
+  output[1] = (adler >> 16) & 0xff;
+  output[2] = (adler >> 8) & 0xff;
+  output[3] = adler & 0xff;
+
+  // deflateEnd() returns Z_DATA_ERROR because the stream wasn't
+  // finished (the final block is added by compress_tileset()).
+  deflateEnd(&zstream);
+}
+
+static void compress_tileset_segment(const Tileset* tileset,
+                                     const tile_index begin,
+                                     const tile_index end,
+                                     const int level,
+                                     base::buffer& output)
+{
+  switch (tileset->sprite()->pixelFormat()) {
+    case IMAGE_RGB:
+      compress_tileset_segment_templ<RgbTraits>(tileset, begin, end, level, output);
       break;
 
     case IMAGE_GRAYSCALE:
-      write_compressed_image_templ<GrayscaleTraits>(f, gen, compressedOutput);
+      compress_tileset_segment_templ<GrayscaleTraits>(tileset, begin, end, level, output);
       break;
 
     case IMAGE_INDEXED:
-      write_compressed_image_templ<IndexedTraits>(f, gen, compressedOutput);
+      compress_tileset_segment_templ<IndexedTraits>(tileset, begin, end, level, output);
       break;
 
     case IMAGE_TILEMAP:
-      write_compressed_image_templ<TilemapTraits>(f, gen, compressedOutput);
+      compress_tileset_segment_templ<TilemapTraits>(tileset, begin, end, level, output);
       break;
   }
 }
 
+// Compresses all tiles of the tileset (one below the other) in one
+// zlib stream. Groups of tiles are compressed in independent
+// segments in parallel, and if "useCache" is true, the segments are
+// cached in the tileset (Tileset::compressedTilesCache()), so saving
+// the tileset again only re-compresses the segments with modified
+// tiles.
+static void compress_tileset(const Tileset* tileset,
+                             const int level,
+                             const bool useCache,
+                             base::buffer& output)
+{
+  const tile_index ntiles = tileset->size();
+  const int tilesPerSegment = tileset_tiles_per_segment(tileset);
+  const int nsegments = (ntiles + tilesPerSegment - 1) / tilesPerSegment;
+
+  std::vector<Tileset::CompressedTiles>& cache = tileset->compressedTilesCache();
+  std::vector<Tileset::CompressedTiles> noCache;
+  if (!useCache)
+    cache.clear();
+  std::vector<Tileset::CompressedTiles>& segments = (useCache ? cache: noCache);
+  segments.resize(nsegments);
+
+  doc::parallel_for(
+    0, nsegments, 1,
+    [&](const int begin, const int end){
+      for (int i=begin; i<end; ++i) {
+        const tile_index ti = i * tilesPerSegment;
+        const tile_index tj = std::min<tile_index>(ti + tilesPerSegment, ntiles);
+        const uint64_t key = tileset_segment_key(tileset, ti, tj, level);
+        if (segments[i].data.empty() || segments[i].key != key) {
+          compress_tileset_segment(tileset, ti, tj, level, segments[i].data);
+          segments[i].key = key;
+        }
+      }
+    });
+
+  std::size_t size = 2 + 2 + 4;
+  for (const auto& segment : segments)
+    size += segment.data.size() - 4;
+  output.clear();
+  output.reserve(size);
+
+  // zlib header (deflate with a 32K window and the same compression
+  // level flags used by deflate())
+  const int levelFlags = (level == Z_DEFAULT_COMPRESSION || level == 6 ? 2:
+                          level < 2 ? 0:
+                          level < 6 ? 1: 3);
+  int header = ((Z_DEFLATED + ((MAX_WBITS-8) << 4)) << 8) | (levelFlags << 6);
+  header += 31 - (header % 31);
+  output.push_back((header >> 8) & 0xff);
+  output.push_back(header & 0xff);
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const z_off_t tileBytes =
+    z_off_t(bytes_per_pixel_for_colormode(tileset->sprite()->colorMode()))
+    * tileSize.w * tileSize.h;
+
+  uLong adler = adler32(0, nullptr, 0);
+  for (int i=0; i<nsegments; ++i) {
+    const base::buffer& data = segments[i].data;
+    const uLong segmentAdler = ((uLong(data[0]) << 24) |
+                                (uLong(data[1]) << 16) |
+                                (uLong(data[2]) << 8) |
+                                uLong(data[3]));
+    const int n = std::min<int>(tilesPerSegment, ntiles - i*tilesPerSegment);
+    adler = adler32_combine(adler, segmentAdler, tileBytes * n);
+    output.insert(output.end(), data.begin()+4, data.end());
+  }
+
+  // Final empty block (fixed Huffman codes with just the end-of-block
+  // code) and the Adler-32 checksum of the whole stream
+  output.push_back(0x03);
+  output.push_back(0x00);
+  output.push_back((adler >> 24) & 0xff);
+  output.push_back((adler >> 16) & 0xff);
+  output.push_back((adler >> 8) & 0xff);
+  output.push_back(adler & 0xff);
+}
+
+static void write_compressed_data(FILE* f, const base::buffer& data)
+{
+  if ((fwrite(data.data(), 1, data.size(), f) != data.size())
+      || ferror(f))
+    throw base::Exception("Error writing compressed image pixels.\n");
+}
+
+// Writes the compressed pixels of a cel image, re-using the
+// compressed data of a previous equal plain image if possible, or
+// the data already compressed by the CelsCompressor.
+static void write_compressed_cel_image(FILE* f,
+                                       const Image* image,
+                                       CelsCompressor& compressor)
+{
+  if (const base::buffer* data = compressor.compressedData(image->id())) {
+    write_compressed_data(f, *data);
+    return;
+  }
+
+  ImageScanlines scan(image);
+  color_t color;
+  bool exact;
+  if (image->isPlain(&color, &exact) && exact) {
+    const auto key = std::make_tuple(int(image->pixelFormat()),
+                                     image->width(),
+                                     image->height(),
+                                     color);
+    PlainImagesCache& plainImages = compressor.plainImages();
+    auto it = plainImages.find(key);
+    if (it == plainImages.end()) {
+      it = plainImages.insert({ key, base::buffer() }).first;
+      compress_image(&scan, image->pixelFormat(), compressor.level(),
+                     it->second);
+    }
+    write_compressed_data(f, it->second);
+    return;
+  }
+
+  base::buffer data;
+  compress_image(&scan, image->pixelFormat(), compressor.level(), data);
+  write_compressed_data(f, data);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
@@ -970,24 +1436,12 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
-                                     const frame_t firstFrame)
+                                     const frame_t firstFrame,
+                                     CelsCompressor& compressor)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
-  const Cel* link = cel->link();
-
-  // In case the original link is outside the ROI, we've to find the
-  // first linked cel that is inside the ROI.
-  if (link && link->frame() < firstFrame) {
-    link = nullptr;
-    for (frame_t i=firstFrame; i<=cel->frame(); ++i) {
-      link = layer->cel(i);
-      if (link && link->image()->id() == cel->image()->id())
-        break;
-    }
-    if (link == cel)
-      link = nullptr;
-  }
+  const Cel* link = ase_file_get_cel_link(cel, layer, firstFrame);
 
   int cel_type = (link ? ASE_FILE_LINK_CEL:
                   cel->layer()->isTilemap() ? ASE_FILE_COMPRESSED_TILEMAP:
@@ -1036,8 +1490,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        ImageScanlines scan(image);
-        write_compressed_image(f, &scan, image->pixelFormat());
+        write_compressed_cel_image(f, image, compressor);
       }
       else {
         // Width and height
@@ -1061,10 +1514,32 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       fputl(tile_f_dflip, f);
       ase_file_write_padding(f, 10);
 
-      ImageScanlines scan(image);
-      write_compressed_image(f, &scan, IMAGE_TILEMAP);
+      write_compressed_cel_image(f, image, compressor);
+    }
+  }
+}
+
+// Returns the cel that is saved as the link of the given cel, or
+// nullptr if the cel image must be saved.
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame)
+{
+  const Cel* link = cel->link();
+
+  // In case the original link is outside the ROI, we've to find the
+  // first linked cel that is inside the ROI.
+  if (link && link->frame() < firstFrame) {
+    link = nullptr;
+    for (frame_t i=firstFrame; i<=cel->frame(); ++i) {
+      link = layer->cel(i);
+      if (link && link->image()->id() == cel->image()->id())
+        break;
     }
+    if (link == cel)
+      link = nullptr;
   }
+  return link;
 }
 
 static void ase_file_write_cel_extra_chunk(FILE* f,
@@ -1413,13 +1888,14 @@ static void ase_file_write_external_files_chunk(
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
-                                          const Tilesets* tilesets)
+                                          const Tilesets* tilesets,
+                                          CelsCompressor& compressor)
 {
   tileset_index si = 0;
   for (const Tileset* tileset : *tilesets) {
     if (tileset) {
       ase_file_write_tileset_chunk(f, fop, frame_header, ext_files,
-                                   tileset, si);
+                                   tileset, si, compressor);
 
       ase_file_write_user_data_chunk(f, fop, frame_header, ext_files, &tileset->userData());
 
@@ -1437,7 +1913,8 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
                                          const Tileset* tileset,
-                                         const tileset_index si)
+                                         const tileset_index si,
+                                         CelsCompressor& compressor)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_TILESET);
 
@@ -1483,43 +1960,37 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
 
   // Flag 2 = tileset
   if (flags & ASE_TILESET_FLAG_EMBEDDED) {
-    size_t beg = ftell(f);
-
     // Save the cached tileset compressed data
-    if (!tileset->compressedData().empty() &&
-        tileset->compressedDataVersion() == tileset->version()) {
+    if (tileset_has_cached_compressed_data(tileset)) {
       const base::buffer& data = tileset->compressedData();
 
       ASEFILE_TRACE("[%d] saving compressed tileset (%s)\n",
                     tileset->id(), base::get_pretty_memory_size(data.size()).c_str());
 
       fputl(data.size(), f); // Compressed data length
-      fwrite(&data[0], 1, data.size(), f);
+      write_compressed_data(f, data);
     }
-    // Compress and save the tileset now
+    // Save the tileset compressed by the CelsCompressor (or compress
+    // it now)
     else {
-      fputl(0, f);                  // Field for compressed data length (completed later)
-      TilesetScanlines gen(tileset);
-
       ASEFILE_TRACE("[%d] recompressing tileset\n", tileset->id());
 
       base::buffer compressedData;
-      base::buffer* compressedDataPtr = nullptr;
-      if (fop->config().cacheCompressedTilesets)
-        compressedDataPtr = &compressedData;
+      const base::buffer* data = compressor.compressedData(tileset->id());
+      if (!data) {
+        compress_tileset(tileset, compressor.level(),
+                         fop->config().cacheCompressedTilesets,
+                         compressedData);
+        data = &compressedData;
+      }
 
-      write_compressed_image(f, &gen, tileset->sprite()->pixelFormat(),
-                             compressedDataPtr);
+      fputl(data->size(), f); // Compressed data length
+      write_compressed_data(f, *data);
 
       // As we've just compressed the tileset, we can cache this same
       // data (so saving the file again will not need recompressing).
-      if (compressedDataPtr)
-        tileset->setCompressedData(compressedData);
-
-      size_t end = ftell(f);
-      fseek(f, beg, SEEK_SET);
-      fputl(end-beg-4, f);          // Save the compressed data length
-      fseek(f, end, SEEK_SET);
+      if (fop->config().cacheCompressedTilesets)
+        tileset->setCompressedData(*data);
     }
   }
 }
@@ -1590,20 +2061,29 @@ static void ase_file_write_property_value(FILE* f,
       fputw(type, f);
 
       for (const auto& elem : vector) {
-        UserData::Variant v = elem;
+        // Only integers are copied to be reduced, other elements
+        // (strings, vectors, properties, etc.) are written directly.
+        if (!is_reducible_int(elem)) {
+          if (type == 0)
+            fputw(elem.type(), f);
+          ase_file_write_property_value(f, elem);
+          continue;
+        }
+
+        UserData::Variant v;
 
         // Reduce each element if possible, because each element has
         // its own type.
         if (type == 0) {
-          if (is_reducible_int(v)) {
-            v = reduce_int_type_size(v);
-          }
+          v = reduce_int_type_size(elem);
           fputw(v.type(), f);
         }
         // Reduce to the smaller/common int type.
-        else if (is_reducible_int(v) && type < v.type()) {
-          v = cast_to_smaller_int_type(v, type);
+        else if (type < elem.type()) {
+          v = cast_to_smaller_int_type(elem, type);
         }
+        else
+          v = elem;
 
         ase_file_write_property_value(f, v);
       }
@@ -1618,13 +2098,16 @@ static void ase_file_write_property_value(FILE* f,
         const std::string& name = property.first;
         ase_file_write_string(f, name);
 
-        UserData::Variant v = property.second;
-        if (is_reducible_int(v)) {
-          v = reduce_int_type_size(v);
+        const UserData::Variant& value = property.second;
+        if (is_reducible_int(value)) {
+          UserData::Variant v = reduce_int_type_size(value);
+          fputw(v.type(), f);
+          ase_file_write_property_value(f, v);
+        }
+        else {
+          fputw(value.type(), f);
+          ase_file_write_property_value(f, value);
         }
-        fputw(v.type(), f);
-
-        ase_file_write_property_value(f, v);
       }
       break;
     }
@@ -1638,6 +2121,12 @@ static void ase_file_write_property_value(FILE* f,
   }
 }
 
+static bool tileset_has_cached_compressed_data(const Tileset* tileset)
+{
+  return (!tileset->compressedData().empty() &&
+          tileset->compressedDataVersion() == tileset->version());
+}
+
 static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
                                            const dio::AsepriteExternalFiles& ext_files,
                                            size_t nmaps,
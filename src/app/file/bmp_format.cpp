@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,9 @@
 #include "doc/doc.h"
 #include "fmt/format.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 // Max supported .bmp size (to filter out invalid image sizes)
@@ -511,172 +514,82 @@ static void read_bmicolors(FileOp* fop, int bytes, FILE *f, bool win_flag)
 /* read_1bit_line:
  *  Support function for reading the 1 bit bitmap file format.
  */
-static void read_1bit_line(int length, FILE *f, Image *image, int line)
+static void read_1bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[32];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 32;
-    if (j == 0) {
-      n = fgetl(f);
-      n =
-        ((n&0x000000ff)<<24) |
-        ((n&0x0000ff00)<< 8) |
-        ((n&0x00ff0000)>> 8) |
-        ((n&0xff000000)>>24);
-      for (k=0; k<32; k++) {
-        b[31-k] = (char)(n & 1);
-        n = n >> 1;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/8] >> (7 - (i & 7))) & 1;
 }
 
 /* read_2bit_line (not standard):
  *  Support function for reading the 2 bit bitmap file format.
  */
-static void read_2bit_line(int length, FILE *f, Image *image, int line)
+static void read_2bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[16];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 16;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*4+3] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+2] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+1] = temp & 3;
-        temp = temp >> 2;
-        b[k*4] = temp & 3;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/4] >> (2*(3 - (i & 3)))) & 3;
 }
 
 /* read_4bit_line:
  *  Support function for reading the 4 bit bitmap file format.
  */
-static void read_4bit_line(int length, FILE *f, Image *image, int line)
+static void read_4bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[8];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 8;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*2+1] = temp & 15;
-        temp = temp >> 4;
-        b[k*2] = temp & 15;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/2] >> (4*(1 - (i & 1)))) & 15;
 }
 
 /* read_8bit_line:
  *  Support function for reading the 8 bit bitmap file format.
  */
-static void read_8bit_line(int length, FILE *f, Image *image, int line)
+static void read_8bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[4];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 4;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        b[k] = (char)(n & 255);
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  std::copy(src, src+length, (IndexedTraits::address_t)image->getPixelAddress(0, line));
 }
 
-static void read_16bit_line(int length, FILE *f, Image *image, int line, bool& withAlpha)
+static void read_16bit_line(int length, const uint8_t* src, Image *image, int line, bool& withAlpha)
 {
-  int i, r, g, b, a, word;
-
-  for (i=0; i<length; i++) {
-    word = fgetw(f);
-
-    r = (word >> 10) & 0x1f;
-    g = (word >> 5) & 0x1f;
-    b = (word) & 0x1f;
-    a = (word & 0x8000 ? 255 : 0);
-    if (a)
-      withAlpha = true;
-    put_pixel(image, i, line,
-              rgba(scale_5bits_to_8bits(r),
-                   scale_5bits_to_8bits(g),
-                   scale_5bits_to_8bits(b), a));
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  int alpha = 0;
+
+  for (int i=0; i<length; i++, src+=2) {
+    const int word = src[0] | (src[1] << 8);
+    const int r = (word >> 10) & 0x1f;
+    const int g = (word >> 5) & 0x1f;
+    const int b = (word) & 0x1f;
+    const int a = (word & 0x8000 ? 255 : 0);
+    alpha |= a;
+    dst[i] = rgba(scale_5bits_to_8bits(r),
+                  scale_5bits_to_8bits(g),
+                  scale_5bits_to_8bits(b), a);
   }
 
-  i = (2*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  if (alpha)
+    withAlpha = true;
 }
 
-static void read_24bit_line(int length, FILE *f, Image *image, int line)
+static void read_24bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b;
-
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    put_pixel(image, i, line, rgba(r, g, b, 255));
-  }
-
-  i = (3*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; i++, src+=3)
+    dst[i] = rgba(src[2], src[1], src[0], 255);
 }
 
-static void read_32bit_line(int length, FILE *f, Image *image, int line,
+static void read_32bit_line(int length, const uint8_t* src, Image *image, int line,
                             bool& withAlpha)
 {
-  int i, r, g, b, a;
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  int alpha = 0;
 
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    a = fgetc(f);
-    if (a)
-      withAlpha = true;
-    put_pixel(image, i, line, rgba(r, g, b, a));
+  for (int i=0; i<length; i++, src+=4) {
+    alpha |= src[3];
+    dst[i] = rgba(src[2], src[1], src[0], src[3]);
   }
+
+  if (alpha)
+    withAlpha = true;
 }
 
 /* read_image:
@@ -691,15 +604,24 @@ static void read_image(FILE *f, Image *image, const BITMAPINFOHEADER *infoheader
   dir    = height < 0 ? 1: -1;
   height = ABS(height);
 
+  // Each row is aligned to 4 bytes, we read the whole row at once
+  const int width = infoheader->biWidth;
+  const int rowBytes = int((uint64_t(width)*infoheader->biBitCount + 31) / 32 * 4);
+  std::vector<uint8_t> row(rowBytes);
+
   for (i=0; i<height; i++, line+=dir) {
+    const size_t n = fread(row.data(), 1, rowBytes, f);
+    if (n < size_t(rowBytes))
+      std::fill(row.begin()+n, row.end(), 0);
+
     switch (infoheader->biBitCount) {
-      case 1: read_1bit_line(infoheader->biWidth, f, image, line); break;
-      case 2: read_2bit_line(infoheader->biWidth, f, image, line); break;
-      case 4: read_4bit_line(infoheader->biWidth, f, image, line); break;
-      case 8: read_8bit_line(infoheader->biWidth, f, image, line); break;
-      case 16: read_16bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
-      case 24: read_24bit_line(infoheader->biWidth, f, image, line); break;
-      case 32: read_32bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
+      case 1: read_1bit_line(width, row.data(), image, line); break;
+      case 2: read_2bit_line(width, row.data(), image, line); break;
+      case 4: read_4bit_line(width, row.data(), image, line); break;
+      case 8: read_8bit_line(width, row.data(), image, line); break;
+      case 16: read_16bit_line(width, row.data(), image, line, withAlpha); break;
+      case 24: read_24bit_line(width, row.data(), image, line); break;
+      case 32: read_32bit_line(width, row.data(), image, line, withAlpha); break;
     }
 
     fop->setProgress((float)(i+1) / (float)(height));
@@ -1295,27 +1217,38 @@ bool BmpFormat::onSave(FileOp *fop)
     default: colorMask = 0; break;
   }
 
-  // Save image pixels (from bottom to top)
+  // Save image pixels (from bottom to top), each row (including the
+  // filler bytes to align it to 4 bytes) is written at once
+  std::vector<uint8_t> row((w*bpp+7)/8 + filler, 0);
+
   for (i=h-1; i>=0; i--) {
+    uint8_t* dst = row.data();
     switch (spec.colorMode()) {
       case ColorMode::RGB: {
         auto scanline = (const uint32_t*)img->getScanline(i);
-        for (j=0; j<w; ++j) {
-          c = scanline[j];
-          fputc(rgba_getb(c), f);
-          fputc(rgba_getg(c), f);
-          fputc(rgba_getr(c), f);
-          if (withAlpha)
-            fputc(rgba_geta(c), f);
+        if (withAlpha) {
+          for (j=0; j<w; ++j, dst+=4) {
+            c = scanline[j];
+            dst[0] = rgba_getb(c);
+            dst[1] = rgba_getg(c);
+            dst[2] = rgba_getr(c);
+            dst[3] = rgba_geta(c);
+          }
+        }
+        else {
+          for (j=0; j<w; ++j, dst+=3) {
+            c = scanline[j];
+            dst[0] = rgba_getb(c);
+            dst[1] = rgba_getg(c);
+            dst[2] = rgba_getr(c);
+          }
         }
         break;
       }
       case ColorMode::GRAYSCALE: {
         auto scanline = (const uint16_t*)img->getScanline(i);
-        for (j=0; j<w; ++j) {
-          c = scanline[j];
-          fputc(graya_getv(c), f);
-        }
+        for (j=0; j<w; ++j)
+          dst[j] = graya_getv(scanline[j]);
         break;
       }
       case ColorMode::INDEXED: {
@@ -1326,14 +1259,13 @@ bool BmpFormat::onSave(FileOp *fop)
             c = scanline[j];
             value |= (c & colorMask) << (bpp*k);
           }
-          fputc(value, f);
+          *(dst++) = value;
         }
         break;
       }
     }
 
-    for (j=0; j<filler; j++)
-      fputc(0, f);
+    fwrite(row.data(), 1, row.size(), f);
 
     fop->setProgress((float)(h-i) / (float)h);
   }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2023  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -25,6 +25,8 @@
 
 #include "css_options.xml.h"
 
+#include <vector>
+
 
 namespace app {
 
@@ -42,6 +44,8 @@ class CssFormat : public FileFormat {
     bool withVars;
   };
 
+  static constexpr std::size_t kOutputBufferSize = 1024*1024;
+
   const char* onGetName() const override {
     return "css";
   }
@@ -91,8 +95,12 @@ bool CssFormat::onSave(FileOp* fop)
   const ImageRef image = fop->sequenceImageToSave();
   int x, y, c, r, g, b, a, alpha;
   const auto css_options = std::static_pointer_cast<CssOptions>(fop->formatOptions());
+  // Buffer for the box-shadow of each pixel (it must outlive the
+  // file handle).
+  std::vector<char> buffer(kOutputBufferSize);
   FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
   FILE* f = handle.get();
+  setvbuf(f, buffer.data(), _IOFBF, buffer.size());
   auto print_color = [f](int r, int g, int b, int a) {
     if (a == 255) {
       fprintf(f, "#%02X%02X%02X", r, g, b);
@@ -36,6 +36,8 @@
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
+#include "doc/trace.h"
 #include "fmt/format.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -50,6 +52,7 @@
 #include <algorithm>
 #include <cstring>
 #include <cstdarg>
+#include <deque>
 
 namespace app {
 
@@ -95,12 +98,14 @@ public:
         m_tmpScaledImage.reset(doc::Image::create(m_spec));
       }
 
+      // The nearest neighbor method doesn't need the sprite RgbMap
+      // (frames of a sequence can be saved from several threads)
       doc::algorithm::resize_image(
         image.get(),
         m_tmpScaledImage.get(),
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         palette(frame),
-        m_sprite->rgbMap(frame),
+        nullptr,
         image->maskColor());
     }
   }
@@ -153,34 +158,39 @@ public:
                    doc::Image* dst) const override {
     const bool needResize = this->needResize();
 
-    if (needResize &&
-        (!m_tmpUnscaledRender ||
-         m_tmpUnscaledRender->size() != frameBounds.size())) {
+    // The temporary image is local because this function can be
+    // called from several threads at the same time.
+    doc::ImageRef tmpUnscaledRender;
+    if (needResize) {
       auto spec = m_sprite->spec();
       spec.setSize(frameBounds.size());
       spec.setColorMode(dst->colorMode());
-      m_tmpUnscaledRender.reset(doc::Image::create(spec));
+      tmpUnscaledRender.reset(doc::Image::create(spec));
     }
 
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
+    render.setParallel(true);
     render.renderSprite(
-      (needResize ? m_tmpUnscaledRender.get(): dst),
+      (needResize ? tmpUnscaledRender.get(): dst),
       m_sprite, frame,
       gfx::Clip(gfx::Point(0, 0), frameBounds));
 
+    // The nearest neighbor method doesn't need the sprite RgbMap
+    // (which would be regenerated for this frame palette)
     if (needResize) {
       doc::algorithm::resize_image(
-        m_tmpUnscaledRender.get(),
+        tmpUnscaledRender.get(),
         dst,
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         palette(frame),
-        m_sprite->rgbMap(frame),
-        m_tmpUnscaledRender->maskColor());
+        nullptr,
+        tmpUnscaledRender->maskColor());
     }
   }
 
+  const gfx::PointF& scale() const { return m_scale; }
   void setScale(const gfx::PointF& scale) {
     m_scale = scale;
     m_spec.setWidth(m_spec.width() * m_scale.x);
@@ -198,7 +208,6 @@ private:
   const bool m_supportAnimation;
   const bool m_newBlend;
   doc::ImageRef m_tmpScaledImage = nullptr;
-  mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
 };
 
@@ -523,6 +532,10 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context,
   if (flags & FILE_LOAD_ONE_FRAME)
     fop->m_oneframe = true;
 
+  // Load just layers, tags, slices, etc. (without cels)
+  if (flags & FILE_LOAD_METADATA_ONLY)
+    fop->m_metadataOnly = true;
+
   if (flags & FILE_LOAD_CREATE_PALETTE)
     fop->m_createPaletteFromRgba = true;
 
@@ -831,6 +844,7 @@ bool FileOp::checkIfFormatSupportResizeOnTheFly(const std::string& filename)
 void FileOp::operate(IFileOpProgress* progress)
 {
   ASSERT(!isDone());
+  DOC_TRACE_ZONE(m_type == FileOpLoad ? "file load": "file save");
 
   m_progressInterface = progress;
 
@@ -872,13 +886,107 @@ void FileOp::operate(IFileOpProgress* progress)
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)frames;
 
+      // Frames that are being decoded in worker threads (only if the
+      // format supports FILE_DECODE_SEQUENCE_IN_PARALLEL). The first
+      // frame is loaded in this thread (it creates the document), the
+      // rest of frames are loaded with their own FileOp (each one
+      // with its own temporary document and palette) and then added
+      // to the document in order.
+      struct FrameLoad {
+        std::unique_ptr<FileOp> fop;
+        bool result = false;
+        doc::TaskGroup tasks;
+
+        ~FrameLoad() {
+          tasks.cancel();
+          try {
+            tasks.wait();
+          }
+          catch (...) {
+            // Ignore errors of frames that weren't used
+          }
+          if (fop) {
+            delete fop->m_seq.last_cel;
+            delete fop->releaseDocument();
+          }
+        }
+      };
+      std::deque<std::unique_ptr<FrameLoad>> frameLoads;
+      const bool parallel =
+        (m_format->support(FILE_DECODE_SEQUENCE_IN_PARALLEL) && frames > 1);
+      const int maxFrameLoads = 2*doc::parallel_concurrency();
+      frame_t nextFrameLoad = 1;
+
+      auto queueFrameLoads = [&]() {
+        while (nextFrameLoad < frames &&
+               int(frameLoads.size()) < maxFrameLoads) {
+          auto frameLoad = std::make_unique<FrameLoad>();
+          frameLoad->fop.reset(
+            createSequenceFrameLoadOperation(
+              m_seq.filename_list[nextFrameLoad], nextFrameLoad));
+          frameLoad->tasks.run(
+            [format = m_format,
+             frameLoad = frameLoad.get()](base::task_token& token){
+              if (!token.canceled())
+                frameLoad->result = format->load(frameLoad->fop.get());
+            });
+          frameLoads.push_back(std::move(frameLoad));
+          ++nextFrameLoad;
+        }
+      };
+
+      // Moves the image/cel/palette of the oldest frame that is being
+      // loaded to m_seq as if it were loaded with this FileOp.
+      auto takeFrameLoad = [this, &frameLoads]() -> bool {
+        std::unique_ptr<FrameLoad> frameLoad = std::move(frameLoads.front());
+        frameLoads.pop_front();
+        frameLoad->tasks.wait();
+
+        FileOp* frameFop = frameLoad->fop.get();
+        if (frameFop->hasError())
+          setError("%s", frameFop->error().c_str());
+        if (!frameLoad->result ||
+            !frameFop->m_document ||
+            !frameFop->m_seq.last_cel)
+          return false;
+
+        const Sprite* frameSprite = frameFop->m_document->sprite();
+        if (frameSprite->pixelFormat() != m_document->sprite()->pixelFormat()) {
+          setError("Error: image does not match color mode\n");
+          return false;
+        }
+
+        m_seq.image = frameFop->m_seq.image;
+        m_seq.last_cel = frameFop->m_seq.last_cel;
+        frameFop->m_seq.last_cel = nullptr;
+        frameFop->m_seq.palette->copyColorsTo(m_seq.palette);
+        if (frameFop->m_seq.has_alpha)
+          m_seq.has_alpha = true;
+        if (frameSprite->transparentColor() != 0)
+          m_document->sprite()->setTransparentColor(frameSprite->transparentColor());
+        if (frameFop->m_embeddedColorProfile)
+          m_embeddedColorProfile = true;
+        if (frameFop->m_formatOptions)
+          m_formatOptions = frameFop->m_formatOptions;
+        return true;
+      };
+
+      if (parallel)
+        queueFrameLoads();
+
       auto it = m_seq.filename_list.begin(),
            end = m_seq.filename_list.end();
       for (; it != end; ++it) {
         m_filename = it->c_str();
 
         // Call the "load" procedure to read the first bitmap.
-        bool loadres = m_format->load(this);
+        bool loadres;
+        if (parallel && frame > 0) {
+          queueFrameLoads();
+          loadres = takeFrameLoad();
+        }
+        else
+          loadres = m_format->load(this);
         if (!loadres) {
           setError("Error loading frame %d from file \"%s\"\n",
                    frame+1, m_filename.c_str());
@@ -934,7 +1042,12 @@ void FileOp::operate(IFileOpProgress* progress)
 
         ++frame;
         m_seq.progress_offset += m_seq.progress_fraction;
+        // Frames loaded in worker threads don't report their progress
+        if (parallel)
+          setProgress(0.0);
       }
+      // Cancel the frames that weren't used (if there was an error)
+      frameLoads.clear();
       m_filename = *m_seq.filename_list.begin();
 
       // Final setup
@@ -1005,17 +1118,61 @@ void FileOp::operate(IFileOpProgress* progress)
       Sprite* sprite = m_document->sprite();
 
       // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      m_roi.fileCanvasSize().w,
-                                      m_roi.fileCanvasSize().h));
+      auto createSeqImage = [this, sprite]{
+        m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                        m_roi.fileCanvasSize().w,
+                                        m_roi.fileCanvasSize().h));
+      };
+      createSeqImage();
 
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
 
+      // Frames that are being saved in worker threads (only if the
+      // format supports FILE_ENCODE_SEQUENCE_IN_PARALLEL). Each frame
+      // is saved with its own FileOp (with its own image, palette,
+      // and filename).
+      struct FrameSave {
+        std::unique_ptr<FileOp> fop;
+        frame_t outputFrame;
+        std::size_t bytes;
+        bool result = false;
+        doc::TaskGroup tasks;
+      };
+      std::deque<std::unique_ptr<FrameSave>> frameSaves;
+      std::size_t frameSavesBytes = 0;
+      const bool parallel = m_format->support(FILE_ENCODE_SEQUENCE_IN_PARALLEL);
+      const int maxFrameSaves = std::max(2, doc::parallel_concurrency());
+
+      // Waits the oldest frame that is being saved, returns false if
+      // it couldn't be saved.
+      auto waitFrameSave = [this, &frameSaves, &frameSavesBytes]() -> bool {
+        FrameSave& frameSave = *frameSaves.front();
+        frameSave.tasks.wait();
+
+        FileOp* frameFop = frameSave.fop.get();
+        if (frameFop->hasError())
+          setError("%s", frameFop->error().c_str());
+        if (frameFop->hasIncompatibilityError())
+          setIncompatibilityError(frameFop->m_incompatibilityError);
+
+        const bool result = frameSave.result;
+        if (!result) {
+          setError("Error saving frame %d in the file \"%s\"\n",
+                   frameSave.outputFrame+1, frameFop->filename().c_str());
+        }
+
+        frameSavesBytes -= frameSave.bytes;
+        frameSaves.pop_front();
+        return result;
+      };
+
       // For each frame in the sprite.
       render::Render render;
       render.setNewBlend(m_config.newBlend);
+      render.setParallel(true);
 
+      bool failed = false;
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.framesSequence()) {
         gfx::Rect bounds = m_roi.frameBounds(frame);
@@ -1051,18 +1208,61 @@ void FileOp::operate(IFileOpProgress* progress)
           // Make directories
           makeDirectories();
 
+          if (parallel) {
+            auto frameSave = std::make_unique<FrameSave>();
+            frameSave->fop.reset(createSequenceFrameOperation(bounds));
+            frameSave->outputFrame = outputFrame;
+            frameSave->bytes = std::size_t(m_seq.image->rowBytes()) * m_seq.image->height();
+
+            frameSave->tasks.run(
+              [format = m_format,
+               frameSave = frameSave.get()](base::task_token& token){
+                if (!token.canceled())
+                  frameSave->result = format->save(frameSave->fop.get());
+              });
+            frameSavesBytes += frameSave->bytes;
+            frameSaves.push_back(std::move(frameSave));
+
+            // The image is owned by the frame FileOp now
+            createSeqImage();
+
+            // Limit the memory used by the frames that are being saved
+            while (!frameSaves.empty() &&
+                   (int(frameSaves.size()) >= maxFrameSaves ||
+                    frameSavesBytes >= kMaxSequenceFramesBytes)) {
+              if (!waitFrameSave())
+                failed = true;
+            }
+          }
           // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
+          else if (!m_format->save(this)) {
             setError("Error saving frame %d in the file \"%s\"\n",
                      outputFrame+1, m_filename.c_str());
-            break;
+            failed = true;
           }
+
+          if (failed)
+            break;
         }
 
         m_seq.progress_offset += m_seq.progress_fraction;
         ++outputFrame;
       }
 
+      // Wait the rest of frames (or cancel them if a frame failed)
+      for (auto& frameSave : frameSaves) {
+        if (failed)
+          frameSave->tasks.cancel();
+      }
+      while (!frameSaves.empty()) {
+        if (failed) {
+          frameSaves.front()->tasks.wait();
+          frameSaves.pop_front();
+        }
+        else if (!waitFrameSave())
+          failed = true;
+      }
+
       m_filename = *m_seq.filename_list.begin();
 
       // Destroy the image
@@ -1398,6 +1598,56 @@ void FileOp::makeAbstractImage()
     m_abstractImage = std::make_unique<FileAbstractImageImpl>(this);
 }
 
+FileOp* FileOp::createSequenceFrameLoadOperation(const std::string& filename,
+                                                const frame_t frame)
+{
+  ASSERT(m_type == FileOpLoad);
+  ASSERT(isSequence());
+
+  std::unique_ptr<FileOp> fop(new FileOp(FileOpLoad, m_context, &m_config));
+  fop->m_format = m_format;
+  fop->m_filename = filename;
+  fop->m_loadROI = m_loadROI;
+  fop->m_createPaletteFromRgba = m_createPaletteFromRgba;
+  fop->prepareForSequence();
+  fop->m_seq.palette->makeBlack();
+  // Frame of the cel created by sequenceImageToLoad()
+  fop->m_seq.frame = frame;
+
+  return fop.release();
+}
+
+FileOp* FileOp::createSequenceFrameOperation(const gfx::Rect& frameBounds)
+{
+  ASSERT(m_type == FileOpSave);
+  ASSERT(isSequence());
+
+  std::unique_ptr<FileOp> fop(new FileOp(FileOpSave, m_context, &m_config));
+  fop->m_format = m_format;
+  fop->m_document = m_document;
+  fop->m_filename = m_filename;
+  fop->m_roi = m_roi;
+  fop->m_ignoreEmpty = m_ignoreEmpty;
+  fop->prepareForSequence();
+  fop->m_formatOptions = m_formatOptions;
+  m_seq.palette->copyColorsTo(fop->m_seq.palette);
+  fop->m_seq.image = m_seq.image;
+  // Frame number used by abstractImageToSave() to get the palette
+  fop->m_seq.frame = m_seq.frame++;
+  fop->m_seq.has_alpha = m_seq.has_alpha;
+  fop->m_seq.flags = m_seq.flags;
+
+  if (m_format->support(FILE_ENCODE_ABSTRACT_IMAGE)) {
+    fop->makeAbstractImage();
+    if (m_abstractImage)
+      fop->m_abstractImage->setScale(m_abstractImage->scale());
+    fop->m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
+                                      frameBounds.size());
+  }
+
+  return fop.release();
+}
+
 FileAbstractImage* FileOp::abstractImageToSave()
 {
   ASSERT(m_format->support(FILE_ENCODE_ABSTRACT_IMAGE));
@@ -1520,6 +1770,7 @@ FileOp::FileOp(FileOpType type,
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_metadataOnly(false)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
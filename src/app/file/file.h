@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/color.h"
 #include "app/doc.h"
 #include "app/file/file_op_config.h"
+#include "app/file/file_op_load_roi.h"
 #include "app/file/format_options.h"
 #include "app/pref/preferences.h"
 #include "base/paths.h"
@@ -19,8 +20,10 @@
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "doc/frames_sequence.h"
+#include "gfx/size.h"
 #include "os/color_space.h"
 
+#include <cstddef>
 #include <cstdio>
 #include <memory>
 #include <mutex>
@@ -34,6 +37,7 @@
 #define FILE_LOAD_ONE_FRAME             0x00000010
 #define FILE_LOAD_DATA_FILE             0x00000020
 #define FILE_LOAD_CREATE_PALETTE        0x00000040
+#define FILE_LOAD_METADATA_ONLY         0x00000080
 
 namespace doc {
   class Tag;
@@ -138,7 +142,8 @@ namespace app {
     virtual const uint8_t* getScanline(int y) const = 0;
 
     // In case that the encoder supports animation and needs to render
-    // a full frame renders.
+    // a full frame renders. It can be called from several threads at
+    // the same time to render different frames.
     virtual void renderFrame(const doc::frame_t frame,
                              const gfx::Rect& frameBounds,
                              doc::Image* dst) const = 0;
@@ -169,6 +174,7 @@ namespace app {
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+    bool isMetadataOnly() const { return m_metadataOnly; }
     bool preserveColorProfile() const { return m_config.preserveColorProfile; }
     const FileFormat* fileFormat() const { return m_format; }
 
@@ -184,6 +190,18 @@ namespace app {
 
     const FileOpROI& roi() const { return m_roi; }
 
+    // Subset of the file to be loaded.
+    const FileOpLoadROI& loadROI() const { return m_loadROI; }
+    void setLoadROI(const FileOpLoadROI& roi) { m_loadROI = roi; }
+
+    // Size needed by the caller (e.g. to generate a thumbnail), empty
+    // to load the file in its original size. Formats that can decode
+    // a smaller version of the image faster (e.g. JPEG) can create a
+    // smaller sprite, which will be at least as big as the image
+    // fitted (keeping the aspect ratio) in this size.
+    const gfx::Size& loadSizeHint() const { return m_loadSizeHint; }
+    void setLoadSizeHint(const gfx::Size& size) { m_loadSizeHint = size; }
+
     // Creates a new document with the given sprite.
     void createDocument(Sprite* spr);
     void operate(IFileOpProgress* progress = nullptr);
@@ -286,6 +304,10 @@ namespace app {
     const FileOpConfig& config() const { return m_config; }
 
   private:
+    // Maximum number of bytes of the rendered frames of a sequence
+    // that can be waiting to be saved in worker threads.
+    static constexpr std::size_t kMaxSequenceFramesBytes = 256*1024*1024;
+
     FileOp();                   // Undefined
     FileOp(FileOpType type,
            Context* context,
@@ -300,6 +322,8 @@ namespace app {
     std::string m_filename;     // File-name to load/save.
     std::string m_dataFilename; // File-name for a special XML .aseprite-data where extra sprite data can be stored
     FileOpROI m_roi;
+    FileOpLoadROI m_loadROI;
+    gfx::Size m_loadSizeHint;
 
     // Shared fields between threads.
     mutable std::mutex m_mutex; // Mutex to access to the next two fields.
@@ -312,6 +336,8 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_metadataOnly;        // Load just the sprite structure
+                                // without cels (only in ASE).
     bool m_createPaletteFromRgba;
     bool m_ignoreEmpty;
 
@@ -349,6 +375,13 @@ namespace app {
 
     void prepareForSequence();
     void makeAbstractImage();
+    // Creates a FileOp to save the current m_filename/m_seq.image of
+    // the sequence as a single file from other thread.
+    FileOp* createSequenceFrameOperation(const gfx::Rect& frameBounds);
+    // Creates a FileOp to load the given file of the sequence (as the
+    // given frame) in other thread.
+    FileOp* createSequenceFrameLoadOperation(const std::string& filename,
+                                             const frame_t frame);
     void makeDirectories();
   };
 
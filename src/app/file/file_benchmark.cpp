@@ -0,0 +1,349 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/fs.h"
+#include "dio/detect_format.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+// All the files are saved in this directory (removed after each
+// benchmark).
+const char* kDir = "_file_benchmark";
+
+const char* kExtensions[] = {
+  "ase", "png", "gif",
+#ifdef ENABLE_WEBP
+  "webp",
+#endif
+  "qoi", "bmp", "jpg"
+};
+const int kNumExtensions = int(sizeof(kExtensions) / sizeof(kExtensions[0]));
+
+const ColorMode kColorModes[] = {
+  ColorMode::RGB, ColorMode::GRAYSCALE, ColorMode::INDEXED
+};
+
+const char* color_mode_name(const ColorMode colorMode)
+{
+  switch (colorMode) {
+    case ColorMode::RGB:       return "rgb";
+    case ColorMode::GRAYSCALE: return "gray";
+    case ColorMode::INDEXED:   return "indexed";
+    default:                   return "";
+  }
+}
+
+void remove_bench_files()
+{
+  if (!base::is_directory(kDir))
+    return;
+  for (const auto& item : base::list_files(kDir))
+    base::delete_file(base::join_path(kDir, item));
+  base::remove_directory(kDir);
+}
+
+// Returns the first file that was saved in kDir (the first file of
+// the sequence when the format doesn't support frames).
+std::string first_bench_file()
+{
+  auto files = base::list_files(kDir);
+  if (files.empty())
+    return std::string();
+  std::sort(files.begin(), files.end());
+  return base::join_path(kDir, files.front());
+}
+
+void fill_image(Image* image, const int seed)
+{
+  std::srand(seed);
+  doc::algorithm::random_image(image);
+  if (image->pixelFormat() == IMAGE_INDEXED) {
+    // Use only opaque colors of the default palette
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image, x, y, 1 + get_pixel(image, x, y) % 255);
+  }
+}
+
+// Creates a document with random images in each cel (or with a
+// tilemap layer with random tiles if "tilemap" is true).
+std::unique_ptr<Doc> make_doc(Context* ctx,
+                              const ColorMode colorMode,
+                              const int size,
+                              const int nlayers,
+                              const int nframes,
+                              const bool tilemap = false)
+{
+  std::unique_ptr<Doc> doc(
+    ctx->documents().add(size, size, colorMode, 256));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(nframes);
+
+  for (int i=1; i<nlayers; ++i) {
+    auto layer = new LayerImage(sprite);
+    sprite->root()->addLayer(layer);
+  }
+
+  int seed = 0;
+  for (Layer* layer : sprite->root()->layers()) {
+    auto imgLayer = static_cast<LayerImage*>(layer);
+    for (frame_t frame=0; frame<nframes; ++frame) {
+      if (Cel* cel = imgLayer->cel(frame))
+        fill_image(cel->image(), ++seed);
+      else {
+        ImageRef image(Image::create(sprite->spec()));
+        fill_image(image.get(), ++seed);
+        imgLayer->addCel(new Cel(frame, image));
+      }
+    }
+  }
+
+  if (tilemap) {
+    const int tileSize = 16;
+    const int ntiles = 64;
+    auto tileset = new Tileset(sprite, Grid(gfx::Size(tileSize, tileSize)), ntiles);
+    for (tile_index ti=1; ti<ntiles; ++ti)
+      fill_image(tileset->get(ti).get(), ++seed);
+    const tileset_index tsi = sprite->tilesets()->add(tileset);
+
+    auto layer = new LayerTilemap(sprite, tsi);
+    sprite->root()->addLayer(layer);
+    for (frame_t frame=0; frame<nframes; ++frame) {
+      ImageRef image(Image::create(IMAGE_TILEMAP,
+                                   size / tileSize, size / tileSize));
+      std::srand(++seed);
+      for (int y=0; y<image->height(); ++y)
+        for (int x=0; x<image->width(); ++x)
+          put_pixel(image.get(), x, y, tile(std::rand() % ntiles, 0));
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
+  return doc;
+}
+
+bool save_bench_doc(Context* ctx, Doc* doc, const std::string& ext)
+{
+  doc->setFilename(base::join_path(kDir, "bench." + ext));
+  return (save_document(ctx, doc) == 0);
+}
+
+// Loads the saved file (all the frames of the sequence if it's
+// needed).
+std::unique_ptr<Doc> load_bench_doc(Context* ctx, const std::string& fn)
+{
+  std::unique_ptr<FileOp> fop(
+    FileOp::createLoadDocumentOperation(
+      ctx, fn,
+      FILE_LOAD_CREATE_PALETTE |
+      FILE_LOAD_SEQUENCE_YES));
+  if (!fop)
+    return nullptr;
+
+  fop->operate();
+  fop->done();
+  fop->postLoad();
+  if (fop->hasError())
+    return nullptr;
+
+  return std::unique_ptr<Doc>(fop->releaseDocument());
+}
+
+// Returns false if the benchmark must be skipped because the format
+// cannot save the color mode.
+bool check_format_support(benchmark::State& state,
+                          const std::string& ext,
+                          const ColorMode colorMode)
+{
+  FileFormat* format =
+    FileFormatsManager::instance()->getFileFormat(
+      dio::detect_format_by_file_extension("bench." + ext));
+  if (!format) {
+    state.SkipWithError("Format not available");
+    return false;
+  }
+
+  int flag = 0;
+  switch (colorMode) {
+    case ColorMode::RGB:       flag = FILE_SUPPORT_RGB; break;
+    case ColorMode::GRAYSCALE: flag = FILE_SUPPORT_GRAY; break;
+    case ColorMode::INDEXED:   flag = FILE_SUPPORT_INDEXED; break;
+    default: break;
+  }
+  if (!format->support(flag)) {
+    state.SkipWithError("Color mode not supported by the format");
+    return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+// Args: extension index, color mode index, sprite size, number of
+// layers, number of frames
+void BM_SaveFile(benchmark::State& state) {
+  const std::string ext = kExtensions[state.range(0)];
+  const ColorMode colorMode = kColorModes[state.range(1)];
+  const int size = state.range(2);
+  const int nlayers = state.range(3);
+  const int nframes = state.range(4);
+  state.SetLabel(ext + " " + color_mode_name(colorMode));
+
+  if (!check_format_support(state, ext, colorMode))
+    return;
+
+  Context ctx;
+  std::unique_ptr<Doc> doc = make_doc(&ctx, colorMode, size, nlayers, nframes);
+  base::make_all_directories(kDir);
+
+  for (auto _ : state) {
+    if (!save_bench_doc(&ctx, doc.get(), ext)) {
+      state.SkipWithError("Error saving the file");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * nframes * size * size);
+
+  doc->close();
+  remove_bench_files();
+}
+
+void BM_LoadFile(benchmark::State& state) {
+  const std::string ext = kExtensions[state.range(0)];
+  const ColorMode colorMode = kColorModes[state.range(1)];
+  const int size = state.range(2);
+  const int nlayers = state.range(3);
+  const int nframes = state.range(4);
+  state.SetLabel(ext + " " + color_mode_name(colorMode));
+
+  if (!check_format_support(state, ext, colorMode))
+    return;
+
+  Context ctx;
+  {
+    std::unique_ptr<Doc> doc = make_doc(&ctx, colorMode, size, nlayers, nframes);
+    base::make_all_directories(kDir);
+    const bool saved = save_bench_doc(&ctx, doc.get(), ext);
+    doc->close();
+    if (!saved) {
+      state.SkipWithError("Error saving the file");
+      remove_bench_files();
+      return;
+    }
+  }
+
+  const std::string fn = first_bench_file();
+  for (auto _ : state) {
+    std::unique_ptr<Doc> doc = load_bench_doc(&ctx, fn);
+    if (!doc) {
+      state.SkipWithError("Error loading the file");
+      break;
+    }
+    doc->close();
+  }
+  state.SetItemsProcessed(state.iterations() * nframes * size * size);
+
+  remove_bench_files();
+}
+
+// Args: sprite size, number of frames
+void BM_SaveTilemap(benchmark::State& state) {
+  const int size = state.range(0);
+  const int nframes = state.range(1);
+
+  Context ctx;
+  std::unique_ptr<Doc> doc = make_doc(&ctx, ColorMode::RGB, size, 1, nframes, true);
+  base::make_all_directories(kDir);
+
+  for (auto _ : state) {
+    if (!save_bench_doc(&ctx, doc.get(), "ase")) {
+      state.SkipWithError("Error saving the file");
+      break;
+    }
+  }
+
+  doc->close();
+  remove_bench_files();
+}
+
+void BM_LoadTilemap(benchmark::State& state) {
+  const int size = state.range(0);
+  const int nframes = state.range(1);
+
+  Context ctx;
+  {
+    std::unique_ptr<Doc> doc = make_doc(&ctx, ColorMode::RGB, size, 1, nframes, true);
+    base::make_all_directories(kDir);
+    save_bench_doc(&ctx, doc.get(), "ase");
+    doc->close();
+  }
+
+  const std::string fn = first_bench_file();
+  for (auto _ : state) {
+    std::unique_ptr<Doc> doc = load_bench_doc(&ctx, fn);
+    if (!doc) {
+      state.SkipWithError("Error loading the file");
+      break;
+    }
+    doc->close();
+  }
+
+  remove_bench_files();
+}
+
+static void FileArguments(benchmark::internal::Benchmark* b) {
+  for (int ext=0; ext<kNumExtensions; ++ext)
+    b->ArgsProduct({ { ext }, { 0, 1, 2 }, { 256, 1024 }, { 1, 4 }, { 1, 8 } });
+  b->Unit(benchmark::kMillisecond);
+}
+
+static void TilemapArguments(benchmark::internal::Benchmark* b) {
+  b->ArgsProduct({ { 256, 1024 }, { 1, 8 } })
+    ->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_SaveFile)->Apply(FileArguments);
+BENCHMARK(BM_LoadFile)->Apply(FileArguments);
+BENCHMARK(BM_SaveTilemap)->Apply(TilemapArguments);
+BENCHMARK(BM_LoadTilemap)->Apply(TilemapArguments);
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +32,8 @@
 #define FILE_SUPPORT_PALETTE_WITH_ALPHA 0x00004000
 #define FILE_ENCODE_ABSTRACT_IMAGE      0x00008000 // Use the new FileAbstractImage
 #define FILE_GIF_ANI_LIMITATIONS        0x00010000
+#define FILE_ENCODE_SEQUENCE_IN_PARALLEL 0x00020000 // Frames of a sequence can be saved from several threads
+#define FILE_DECODE_SEQUENCE_IN_PARALLEL 0x00040000 // Files of a sequence can be loaded from several threads
 
 namespace app {
 
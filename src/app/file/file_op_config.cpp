@@ -27,6 +27,9 @@ void FileOpConfig::fillFromPreferences()
   rgbMapAlgorithm = pref.quantization.rgbmapAlgorithm();
   fitCriteria = pref.quantization.fitCriteria();
   cacheCompressedTilesets = pref.tileset.cacheCompressedTilesets();
+  asepriteCompression = pref.saveFile.asepriteCompression();
+  pngCompression = pref.saveFile.pngCompression();
+  pngFilter = pref.saveFile.pngFilter();
 }
 
 } // namespace app
@@ -47,6 +47,15 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // Compression level used to save .aseprite files (all levels
+    // are saved as zlib streams, so any version can read them).
+    app::gen::AsepriteCompression asepriteCompression = app::gen::AsepriteCompression::DEFAULT;
+
+    // zlib compression level and row filter used to save .png files
+    // (DEFAULT uses the libpng defaults).
+    app::gen::PngCompression pngCompression = app::gen::PngCompression::DEFAULT;
+    app::gen::PngFilter pngFilter = app::gen::PngFilter::DEFAULT;
+
     void fillFromPreferences();
   };
 
@@ -0,0 +1,83 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/file_op_load_roi.h"
+
+#include "app/util/layer_utils.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+
+#include <algorithm>
+
+namespace app {
+
+doc::frame_t FileOpLoadROI::lastFrame(const doc::Sprite* sprite) const
+{
+  const doc::Tag* tag = (!tagName.empty() ? sprite->tags().getByName(tagName): nullptr);
+  if (tag) {
+    if (fromFrame >= 0 && toFrame >= 0)
+      return tag->fromFrame()+std::clamp(toFrame, 0, tag->frames()-1);
+    else
+      return tag->toFrame();
+  }
+  else if (fromFrame >= 0 && toFrame >= 0)
+    return toFrame;
+  else
+    return -1;
+}
+
+bool FileOpLoadROI::containsFrame(const doc::Sprite* sprite,
+                                  const doc::frame_t frame) const
+{
+  // Same frames that the CLI exports with --frame-tag/--frame-range
+  const doc::Tag* tag = (!tagName.empty() ? sprite->tags().getByName(tagName): nullptr);
+  if (tag) {
+    if (fromFrame >= 0 && toFrame >= 0)
+      return (frame >= tag->fromFrame()+std::clamp(fromFrame, 0, tag->frames()-1) &&
+              frame <= tag->fromFrame()+std::clamp(toFrame, 0, tag->frames()-1));
+    else
+      return tag->contains(frame);
+  }
+  else if (fromFrame >= 0 && toFrame >= 0)
+    return (frame >= fromFrame && frame <= toFrame);
+  else
+    return true;
+}
+
+bool FileOpLoadROI::containsLayer(const doc::Layer* layer) const
+{
+  if (layers.empty())
+    return true;
+
+  // The layer is loaded if it or one of its parent groups match one
+  // of the names/paths
+  for (; layer && layer->parent(); layer = layer->parent()) {
+    const std::string path = get_layer_path(layer);
+    for (const std::string& name : layers) {
+      if (name == layer->name() || name == path)
+        return true;
+    }
+  }
+  return false;
+}
+
+bool FileOpLoadROI::containsCel(const doc::Layer* layer,
+                                const doc::frame_t frame,
+                                const gfx::Rect& celBounds) const
+{
+  // Empty "celBounds" means that the bounds are unknown
+  return (containsFrame(layer->sprite(), frame) &&
+          containsLayer(layer) &&
+          (bounds.isEmpty() || celBounds.isEmpty() ||
+           bounds.intersects(celBounds)));
+}
+
+} // namespace app
@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_FILE_OP_LOAD_ROI_H_INCLUDED
+#define APP_FILE_FILE_OP_LOAD_ROI_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "gfx/rect.h"
+
+#include <string>
+#include <vector>
+
+namespace doc {
+  class Layer;
+  class Sprite;
+}
+
+namespace app {
+
+  // Region of interest to load a subset of a file (e.g. to export
+  // some frames/layers from the CLI). File formats can skip the cels
+  // (or pixels) outside this region, but the sprite structure
+  // (frames, layers, tags, etc.) is loaded completely. The default
+  // region includes the whole file.
+  struct FileOpLoadROI {
+    // Range of frames to load (relative to the given tag in case that
+    // the tag exists, like --frame-tag/--frame-range in the CLI)
+    std::string tagName;
+    doc::frame_t fromFrame = -1;
+    doc::frame_t toFrame = -1;
+
+    // Names or paths ("Group/Layer") of the layers (or groups) to
+    // load, empty to load all layers
+    std::vector<std::string> layers;
+
+    // Area of the canvas to load, empty to load the whole canvas
+    gfx::Rect bounds;
+
+    bool isEmpty() const {
+      return (tagName.empty() &&
+              (fromFrame < 0 || toFrame < 0) &&
+              layers.empty() &&
+              bounds.isEmpty());
+    }
+
+    // Returns the last frame of the sprite that must be loaded (or -1
+    // if all frames must be loaded).
+    doc::frame_t lastFrame(const doc::Sprite* sprite) const;
+
+    bool containsFrame(const doc::Sprite* sprite,
+                       const doc::frame_t frame) const;
+    bool containsLayer(const doc::Layer* layer) const;
+    bool containsCel(const doc::Layer* layer,
+                     const doc::frame_t frame,
+                     const gfx::Rect& celBounds) const;
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -341,3 +341,79 @@ TEST(File, CustomProperties)
     }
   }
 }
+
+TEST(File, LoadROI)
+{
+  app::Context ctx;
+  const std::string fn = "test_roi.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(16, 16, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+
+    Sprite* sprite = doc->sprite();
+    sprite->setTotalFrames(3);
+
+    LayerImage* a = static_cast<LayerImage*>(sprite->root()->firstLayer());
+    a->setName("A");
+    auto b = new LayerImage(sprite);
+    b->setName("B");
+    sprite->root()->addLayer(b);
+
+    for (frame_t frame=0; frame<3; ++frame) {
+      if (frame > 0)
+        a->addCel(new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 16, 16))));
+      clear_image(a->cel(frame)->image(), rgba(255, 0, 0, 255));
+    }
+    b->addCel(new Cel(0, ImageRef(Image::create(IMAGE_RGB, 16, 16))));
+    clear_image(b->cel(0)->image(), rgba(0, 0, 255, 255));
+    // Link in the last frame to the cel of the first frame
+    b->addCel(Cel::MakeLink(2, b->cel(0)));
+
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+  {
+    std::unique_ptr<FileOp> fop(
+      FileOp::createLoadDocumentOperation(
+        &ctx, fn, FILE_LOAD_SEQUENCE_NONE));
+    ASSERT_TRUE(fop != nullptr);
+
+    FileOpLoadROI roi;
+    roi.fromFrame = 2;
+    roi.toFrame = 2;
+    roi.layers.push_back("B");
+    fop->setLoadROI(roi);
+
+    fop->operate();
+    fop->done();
+    fop->postLoad();
+    ASSERT_FALSE(fop->hasError());
+
+    std::unique_ptr<Doc> doc(fop->releaseDocument());
+    ASSERT_TRUE(doc != nullptr);
+
+    // The structure of the sprite is complete
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(3, sprite->totalFrames());
+    ASSERT_EQ(2, sprite->allLayersCount());
+
+    Layer* a = sprite->root()->firstLayer();
+    Layer* b = a->getNext();
+    EXPECT_EQ("A", a->name());
+    EXPECT_EQ("B", b->name());
+    for (frame_t frame=0; frame<3; ++frame)
+      EXPECT_EQ(nullptr, a->cel(frame));
+
+    // The original cel of the linked cel is loaded even when it's in
+    // a frame outside the region
+    EXPECT_EQ(nullptr, b->cel(1));
+    ASSERT_TRUE(b->cel(0) != nullptr);
+    Cel* cel = b->cel(2);
+    ASSERT_TRUE(cel != nullptr);
+    EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(cel->image(), 8, 8));
+
+    doc->close();
+  }
+}
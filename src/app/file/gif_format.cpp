@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,7 +24,9 @@
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "doc/doc.h"
+#include "doc/duplicated_images.h"
 #include "doc/octree_map.h"
+#include "doc/parallel.h"
 #include "gfx/clip.h"
 #include "render/dithering.h"
 #include "render/ordered_dither.h"
@@ -35,6 +37,11 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include <gif_lib.h>
 
@@ -251,6 +258,14 @@ public:
       if (m_fop->isOneFrame() && m_frameNum > 0)
         break;
 
+      // Frames must be composited one over the other, so we can skip
+      // only the frames after the last one that is needed
+      if (m_sprite && !m_fop->loadROI().isEmpty()) {
+        const frame_t lastFrame = m_fop->loadROI().lastFrame(m_sprite.get());
+        if (lastFrame >= 0 && m_frameNum > lastFrame)
+          break;
+      }
+
       if (m_fop->isStop())
         break;
 
@@ -288,6 +303,11 @@ public:
           break;
       }
 
+      // Link the cels of repeated frames to release the memory of
+      // their duplicated images
+      if (m_layer)
+        link_duplicated_cels(m_layer);
+
       if (m_layer && m_opaque)
         m_layer->configureAsBackground();
 
@@ -519,10 +539,17 @@ private:
       // Mark all entries as used if the colormap is global.
       usedEntries.all();
     else {
-      for (const auto& i : LockImageBits<IndexedTraits>(frameImage)) {
-        if (i >= 0 && i < ncolors) {
+      // Mark the used indexes in a table first (indexes >= ncolors
+      // are ignored)
+      std::array<bool, 256> used = { };
+      for (int y=0; y<frameImage->height(); ++y) {
+        auto addr = (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
+        for (int x=0; x<frameImage->width(); ++x, ++addr)
+          used[*addr] = true;
+      }
+      for (int i=0; i<ncolors; ++i) {
+        if (used[i])
           usedEntries[i] = true;
-        }
       }
       // GIF Case: unnamed.gif. If a pixel is equal to
       // m_localtransparentindex in a frame > 0 in a sprite
@@ -608,11 +635,21 @@ private:
     // Frames > 0, find new colors on the palette and remap or
     // add new used color and remap.
     else {
+      std::array<int, 256>& cachedRemap = colormapRemap(colormap);
+
       for (int i=0; i<ncolors; ++i) {
 
         if (!usedEntries[i])
           continue;
 
+        // This entry was already remapped in a previous frame
+        // with the same colormap
+        int j = cachedRemap[i];
+        if (j >= 0) {
+          m_remap.map(i, j);
+          continue;
+        }
+
         // If by chance, the actual used entry 'i'
         // matches with the palette entry 'i', it isn't
         // need to find a match or add a new color to the palette.
@@ -624,14 +661,15 @@ private:
                  colormap->Colors[i].Green,
                  colormap->Colors[i].Blue,
                  255) == palette->getEntry(i)) {
+          cachedRemap[i] = i;
           continue;
         }
 
-        int j = palette->findExactMatch(
-                  colormap->Colors[i].Red,
-                  colormap->Colors[i].Green,
-                  colormap->Colors[i].Blue, 255,
-                  m_opaque ? -1: m_bgIndex);
+        j = palette->findExactMatch(
+              colormap->Colors[i].Red,
+              colormap->Colors[i].Green,
+              colormap->Colors[i].Blue, 255,
+              m_opaque ? -1: m_bgIndex);
         if (j < 0) {
           palette->resize(palette->size() + 1);
           j = palette->size() - 1;
@@ -644,11 +682,43 @@ private:
         if (j >= 256)
           break;
         m_remap.map(i, j);
+        cachedRemap[i] = j;
       }
     }
     m_sprite->setPalette(palette.get(), false);
   }
 
+  // Returns the cached remap (from colormap indexes to the sprite
+  // palette) of the given colormap for frames > 0. As colors are
+  // only appended to the palette after the first frame, the remapped
+  // entries are still valid for following frames using the same
+  // colormap (the global one or an equal local colormap), so we
+  // don't have to search them in the palette again.
+  std::array<int, 256>& colormapRemap(const ColorMapObject* colormap) {
+    const int ncolors = std::min(colormap->ColorCount, 256);
+    auto it = std::find_if(
+      m_colormapRemaps.begin(), m_colormapRemaps.end(),
+      [colormap, ncolors](const ColormapRemap& cached){
+        return (int(cached.colors.size()) == ncolors &&
+                std::memcmp(cached.colors.data(), colormap->Colors,
+                            sizeof(GifColorType)*ncolors) == 0);
+      });
+    if (it != m_colormapRemaps.end()) {
+      // Keep the most recently used at the end
+      std::rotate(it, it+1, m_colormapRemaps.end());
+      return m_colormapRemaps.back().remap;
+    }
+
+    if (m_colormapRemaps.size() >= kMaxCachedColormapRemaps)
+      m_colormapRemaps.erase(m_colormapRemaps.begin());
+
+    ColormapRemap cached;
+    cached.colors.assign(colormap->Colors, colormap->Colors+ncolors);
+    cached.remap.fill(-1);
+    m_colormapRemaps.push_back(std::move(cached));
+    return m_colormapRemaps.back().remap;
+  }
+
   void compositeIndexedImageToIndexed(const gfx::Rect& frameBounds,
                                       const Image* frameImage) {
     gfx::Clip clip(frameBounds.x, frameBounds.y, 0, 0,
@@ -659,24 +729,27 @@ private:
                    frameImage->height()))
       return;
 
-    const LockImageBits<IndexedTraits> srcBits(frameImage, clip.srcBounds());
-    LockImageBits<IndexedTraits> dstBits(m_currentImage.get(), clip.dstBounds());
-
-    auto srcIt = srcBits.begin(), srcEnd = srcBits.end();
-    auto dstIt = dstBits.begin(), dstEnd = dstBits.end();
+    // Table to convert the frame indexes to the palette indexes
+    // (-1 for the transparent index which keeps the previous pixel)
+    std::array<int, 256> table;
+    for (int i=0; i<256; ++i)
+      table[i] = (i == m_localTransparentIndex ? -1: m_remap[i]);
 
     // Compose the frame image with the previous frame
-    for (; srcIt != srcEnd && dstIt != dstEnd; ++srcIt, ++dstIt) {
-      color_t i = *srcIt;
-      if (int(i) == m_localTransparentIndex)
-        continue;
-
-      i = m_remap[i];
-      *dstIt = i;
+    const gfx::Rect srcBounds = clip.srcBounds();
+    const gfx::Rect dstBounds = clip.dstBounds();
+    for (int y=0; y<srcBounds.h; ++y) {
+      auto src = (IndexedTraits::const_address_t)
+        frameImage->getPixelAddress(srcBounds.x, srcBounds.y+y);
+      auto dst = (IndexedTraits::address_t)
+        m_currentImage->getPixelAddress(dstBounds.x, dstBounds.y+y);
+
+      for (int x=0; x<srcBounds.w; ++x, ++src, ++dst) {
+        const int i = table[*src];
+        if (i >= 0)
+          *dst = i;
+      }
     }
-
-    ASSERT(srcIt == srcEnd);
-    ASSERT(dstIt == dstEnd);
   }
 
   void compositeIndexedImageToRgb(const gfx::Rect& frameBounds,
@@ -689,30 +762,30 @@ private:
                    frameImage->height()))
       return;
 
-    const LockImageBits<IndexedTraits> srcBits(frameImage, clip.srcBounds());
-    LockImageBits<RgbTraits> dstBits(m_currentImage.get(), clip.dstBounds());
-
-    auto srcIt = srcBits.begin(), srcEnd = srcBits.end();
-    auto dstIt = dstBits.begin(), dstEnd = dstBits.end();
-
     ColorMapObject* colormap = getFrameColormap();
 
-    // Compose the frame image with the previous frame
-    for (; srcIt != srcEnd && dstIt != dstEnd; ++srcIt, ++dstIt) {
-      color_t i = *srcIt;
-      if (int(i) == m_localTransparentIndex)
-        continue;
-
-      i = rgba(
-        colormap->Colors[i].Red,
-        colormap->Colors[i].Green,
-        colormap->Colors[i].Blue, 255);
+    // Convert the colormap to RGBA colors once (indexes outside the
+    // colormap are black)
+    std::array<color_t, 256> colors;
+    colors.fill(rgba(0, 0, 0, 255));
+    for (int i=0; i<std::min(colormap->ColorCount, 256); ++i)
+      colors[i] = colormap2rgba(colormap, i);
 
-      *dstIt = i;
+    // Compose the frame image with the previous frame
+    const gfx::Rect srcBounds = clip.srcBounds();
+    const gfx::Rect dstBounds = clip.dstBounds();
+    for (int y=0; y<srcBounds.h; ++y) {
+      auto src = (IndexedTraits::const_address_t)
+        frameImage->getPixelAddress(srcBounds.x, srcBounds.y+y);
+      auto dst = (RgbTraits::address_t)
+        m_currentImage->getPixelAddress(dstBounds.x, dstBounds.y+y);
+
+      for (int x=0; x<srcBounds.w; ++x, ++src, ++dst) {
+        const int i = *src;
+        if (i != m_localTransparentIndex)
+          *dst = colors[i];
+      }
     }
-
-    ASSERT(srcIt == srcEnd);
-    ASSERT(dstIt == dstEnd);
   }
 
   void createCel() {
@@ -880,6 +953,14 @@ private:
   Remap m_remap;
   bool m_hasLocalColormaps;     // Indicates that this fila contains local colormaps
 
+  // Cache of remaps for each colormap (see colormapRemap())
+  static constexpr std::size_t kMaxCachedColormapRemaps = 16;
+  struct ColormapRemap {
+    std::vector<GifColorType> colors;
+    std::array<int, 256> remap;
+  };
+  std::vector<ColormapRemap> m_colormapRemaps; // The most recently used at the end
+
   // This is a copy of the first local color map. It's used to see if
   // all local colormaps are the same, so we can use it as a global
   // colormap.
@@ -1071,7 +1152,8 @@ public:
           nullptr,
           m_fop->newBlend(),
           RgbMapAlgorithm::OCTREE, // TODO configurable?
-          false); // Do not add the transparent color yet
+          false, // Do not add the transparent color yet
+          gifOptions->refinePalette());
 
         m_transparentIndex = 0;
         m_globalColormapPalette = newPalette;
@@ -1081,13 +1163,27 @@ public:
 
     // Create the 3 temporary images (previous/current/next) to
     // compare pixels between them.
-    for (int i=0; i<3; ++i)
-      m_images[i].reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
-                                      m_spriteBounds.w,
-                                      m_spriteBounds.h));
+    m_previousImage.reset(createFrameImage());
+    m_currentImage.reset(createFrameImage());
+    m_nextImage.reset(createFrameImage());
+
+    // Number of frames that can be rendered/quantized in advance
+    const std::size_t frameBytes =
+      std::size_t(m_previousImage->rowBytes()) * m_spriteBounds.h;
+    m_maxFramesAhead =
+      int(std::clamp<std::size_t>(kMaxQueuedBytes / std::max<std::size_t>(1, frameBytes),
+                                  1, std::max(2, doc::parallel_concurrency())));
   }
 
   ~GifEncoder() {
+    // Wait the running tasks (they use the encoder data)
+    for (auto& encoded : m_encodedFrames)
+      encoded->tasks.cancel();
+    for (auto& rendered : m_renderedFrames)
+      rendered->tasks.cancel();
+    m_encodedFrames.clear();
+    m_renderedFrames.clear();
+
     if (m_globalColormap)
       GifFreeMapObject(m_globalColormap);
   }
@@ -1097,36 +1193,42 @@ public:
     if (m_loop >= 0)
       writeLoopExtension();
 
+    for (frame_t frame : m_fop->roi().framesSequence())
+      m_frames.push_back(frame);
+
+    // Calculate the plain info of all images in this thread, as
+    // frames are rendered at the same time in worker threads and
+    // they can share images (linked cels).
+    std::vector<ImageRef> images;
+    m_sprite->getImages(images);
+    for (const ImageRef& image : images)
+      image->isPlain();
+
     // Previous and next images are used to decide the best disposal
     // method (e.g. if it's more convenient to restore the background
     // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    auto frame_beg = m_fop->roi().framesSequence().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().framesSequence().end();
-#endif
-    auto frame_it = frame_beg;
+    //
+    // The frames are rendered in advance by worker threads, and
+    // quantized by worker threads too, so here we just calculate the
+    // delta image of each frame (which depends on the previous
+    // frames) and write the quantized frames in order.
 
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
     gifframe_t nframes = totalFrames();
+    ASSERT(nframes == int(m_frames.size()));
     for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
+      frame_t frame = m_frames[gifFrame];
 
       if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
+        takeRenderedFrame(gifFrame, m_nextImage);
       else
         std::swap(m_previousImage, m_currentImage);
 
       // Render next frame
       std::swap(m_currentImage, m_nextImage);
       if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+        takeRenderedFrame(gifFrame+1, m_nextImage);
 
       gfx::Rect frameBounds = m_spriteBounds;
       DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
@@ -1140,22 +1242,115 @@ public:
 
       calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
-
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      auto encoded = std::make_unique<EncodedFrame>();
+      encoded->gifFrame = gifFrame;
+      encoded->frame = frame;
+      encoded->frameBounds = frameBounds;
+      encoded->disposal = disposal;
+      // Only the last frame in the animation needs the fix
+      encoded->fixDuration = (fix_last_frame_duration && gifFrame == nframes-1);
+      encoded->deltaImage = std::move(m_deltaImage);
+      encoded->tasks.run(
+        [this, encoded = encoded.get()](base::task_token& token){
+          if (!token.canceled())
+            quantizeFrame(*encoded);
+        });
+      m_encodedFrames.push_back(std::move(encoded));
+
+      while (int(m_encodedFrames.size()) > m_maxFramesAhead)
+        writeNextFrame();
     }
+
+    while (!m_encodedFrames.empty())
+      writeNextFrame();
     return true;
   }
 
 private:
+  // Maximum size of the frames that are rendered/quantized in
+  // advance.
+  static constexpr std::size_t kMaxQueuedBytes = 256*1024*1024;
+
+  // A frame rendered in a worker thread.
+  struct RenderedFrame {
+    ImageRef image;
+    doc::TaskGroup tasks;
+  };
+
+  // A frame to be quantized in a worker thread and written in the
+  // file in the main thread.
+  struct EncodedFrame {
+    gifframe_t gifFrame;
+    frame_t frame;
+    gfx::Rect frameBounds;
+    DisposalMethod disposal;
+    bool fixDuration;
+    std::unique_ptr<Image> deltaImage;
+
+    // Output of quantizeFrame()
+    ImageRef frameImage;
+    bool hasLocalColormap = false;
+    Palette localColormapPalette;
+    int localTransparent = -1;
+    Remap remap = Remap(256);
+
+    doc::TaskGroup tasks;
+  };
+
+  Image* createFrameImage() const {
+    return Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                         m_spriteBounds.w,
+                         m_spriteBounds.h);
+  }
+
+  // Queues the rendering of the following frames (at least up to
+  // "gifFrame"), waits the given "gifFrame" and moves its image to
+  // "dst" (the old "dst" image is reused to render other frame).
+  void takeRenderedFrame(const gifframe_t gifFrame, ImageRef& dst) {
+    while (m_nextRenderedFrame < int(m_frames.size()) &&
+           (m_nextRenderedFrame <= gifFrame ||
+            int(m_renderedFrames.size()) < m_maxFramesAhead)) {
+      auto rendered = std::make_unique<RenderedFrame>();
+      if (!m_freeImages.empty()) {
+        rendered->image = m_freeImages.back();
+        m_freeImages.pop_back();
+      }
+      else
+        rendered->image.reset(createFrameImage());
+
+      rendered->tasks.run(
+        [this, frame = m_frames[m_nextRenderedFrame],
+         image = rendered->image.get()](base::task_token& token){
+          if (!token.canceled())
+            renderFrame(frame, image);
+        });
+      m_renderedFrames.push_back(std::move(rendered));
+      ++m_nextRenderedFrame;
+    }
+
+    ASSERT(!m_renderedFrames.empty());
+    ASSERT(m_nextRenderedFrame - int(m_renderedFrames.size()) == gifFrame);
+    m_renderedFrames.front()->tasks.wait();
+
+    m_freeImages.push_back(dst);
+    dst = m_renderedFrames.front()->image;
+    m_renderedFrames.pop_front();
+  }
+
+  void writeNextFrame() {
+    ASSERT(!m_encodedFrames.empty());
+    EncodedFrame& encoded = *m_encodedFrames.front();
+    encoded.tasks.wait();
+    writeImage(encoded);
+    m_fop->setProgress(double(encoded.gifFrame+1) / double(totalFrames()));
+    m_encodedFrames.pop_front();
+  }
 
   void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
                                               gfx::Rect& frameBounds,
                                               DisposalMethod& disposal) {
     if (gifFrame == 0) {
-      m_deltaImage.reset(Image::createCopy(m_currentImage));
+      m_deltaImage.reset(Image::createCopy(m_currentImage.get()));
       frameBounds = m_spriteBounds;
 
       // The first frame (frame 0) is good to force to disposal = DO_NOT_DISPOSE,
@@ -1164,8 +1359,8 @@ private:
 
       // "Pixel clearing" detection:
       if (!m_hasBackground && !m_preservePaletteOrder) {
-        const LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
+        const LockImageBits<RgbTraits> bits2(m_currentImage.get());
+        const LockImageBits<RgbTraits> bits3(m_nextImage.get());
         typename LockImageBits<RgbTraits>::const_iterator it2, it3, end2, end3;
         for (it2 = bits2.begin(), end2 = bits2.end(),
              it3 = bits3.begin(), end3 = bits3.end();
@@ -1205,9 +1400,9 @@ private:
 
         int i = 0;
         int x, y;
-        const LockImageBits<RgbTraits> bits1(m_previousImage);
-        LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
+        const LockImageBits<RgbTraits> bits1(m_previousImage.get());
+        LockImageBits<RgbTraits> bits2(m_currentImage.get());
+        const LockImageBits<RgbTraits> bits3(m_nextImage.get());
         m_deltaImage.reset(Image::create(PixelFormat::IMAGE_RGB, m_spriteBounds.w, m_spriteBounds.h));
         clear_image(m_deltaImage.get(), 0);
         LockImageBits<RgbTraits> deltaBits(m_deltaImage.get());
@@ -1257,7 +1452,7 @@ private:
       // In the other hand, if disposal is still DO_NOT_DISPOSAL, delta image will be a cropped image
       // from itself in frameBounds.
       if (disposal == DisposalMethod::RESTORE_BGCOLOR || m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-        m_deltaImage.reset(crop_image(m_currentImage, frameBounds, 0));
+        m_deltaImage.reset(crop_image(m_currentImage.get(), frameBounds, 0));
       }
       else {
         m_deltaImage.reset(crop_image(m_deltaImage.get(), frameBounds, 0));
@@ -1366,35 +1561,34 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Creates the indexed image (and the local colormap) of the given
+  // frame from its delta image. It's called from a worker thread.
+  void quantizeFrame(EncodedFrame& encoded) {
+    const gfx::Rect& frameBounds = encoded.frameBounds;
+    int transparentIndex = m_transparentIndex;
+
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(encoded.deltaImage.get(), transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
+    octree.regenerateMap(&framePalette, transparentIndex);
     ImageRef frameImage(Image::create(IMAGE_INDEXED,
                                       frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+                                      frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = encoded.remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
+      const LockImageBits<RgbTraits> srcBits(encoded.deltaImage.get());
       LockImageBits<IndexedTraits> dstBits(frameImage.get());
 
       auto srcIt = srcBits.begin();
@@ -1414,13 +1608,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1443,7 +1637,7 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
+      if (!m_globalColormap) {
         Palette reducedPalette(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
@@ -1454,23 +1648,39 @@ private:
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
+        encoded.hasLocalColormap = true;
+        encoded.localColormapPalette = reducedPalette;
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      frameImage.reset(Image::createCopy(encoded.deltaImage.get()));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    encoded.frameImage = frameImage;
+    encoded.localTransparent = localTransparent;
+    encoded.deltaImage.reset();
+  }
+
+  void writeImage(const EncodedFrame& encoded) {
+    const gifframe_t gifFrame = encoded.gifFrame;
+    const gfx::Rect& frameBounds = encoded.frameBounds;
+    const Image* frameImage = encoded.frameImage.get();
+    const Remap& remap = encoded.remap;
+
+    ColorMapObject* colormap = m_globalColormap;
+    if (encoded.hasLocalColormap)
+      colormap = createColorMap(&encoded.localColormapPalette);
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, encoded.frame, encoded.localTransparent,
+                   encoded.disposal, encoded.fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1488,8 +1698,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1501,8 +1711,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1516,9 +1726,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1745,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,7 +1755,7 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
@@ -1602,12 +1813,18 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
-  Image* m_previousImage;
-  Image* m_currentImage;
-  Image* m_nextImage;
+  ImageRef m_previousImage;
+  ImageRef m_currentImage;
+  ImageRef m_nextImage;
   std::unique_ptr<Image> m_deltaImage;
+
+  // Frames to encode (doc::Sprite frames for each GIF frame)
+  std::vector<frame_t> m_frames;
+  int m_maxFramesAhead;
+  gifframe_t m_nextRenderedFrame = 0;
+  std::vector<ImageRef> m_freeImages;
+  std::deque<std::unique_ptr<RenderedFrame>> m_renderedFrames;
+  std::deque<std::unique_ptr<EncodedFrame>> m_encodedFrames;
 };
 
 bool GifFormat::onSave(FileOp* fop)
@@ -1647,12 +1864,15 @@ FormatOptionsPtr GifFormat::onAskUserForFormatOptions(FileOp* fop)
         opts->setLoop(pref.gif.loop());
       if (pref.isSet(pref.gif.preservePaletteOrder))
         opts->setPreservePaletteOrder(pref.gif.preservePaletteOrder());
+      if (pref.isSet(pref.gif.refinePalette))
+        opts->setRefinePalette(pref.gif.refinePalette());
 
       if (pref.gif.showAlert()) {
         app::gen::GifOptions win;
         win.interlaced()->setSelected(opts->interlaced());
         win.loop()->setSelected(opts->loop());
         win.preservePaletteOrder()->setSelected(opts->preservePaletteOrder());
+        win.refinePalette()->setSelected(opts->refinePalette());
 
         if (fop->document()->sprite()->pixelFormat() == PixelFormat::IMAGE_INDEXED &&
             !fop->document()->sprite()->isOpaque())
@@ -1671,11 +1891,13 @@ FormatOptionsPtr GifFormat::onAskUserForFormatOptions(FileOp* fop)
           pref.gif.interlaced(win.interlaced()->isSelected());
           pref.gif.loop(win.loop()->isSelected());
           pref.gif.preservePaletteOrder(win.preservePaletteOrder()->isSelected());
+          pref.gif.refinePalette(win.refinePalette()->isSelected());
           pref.gif.showAlert(!win.dontShow()->isSelected());
 
           opts->setInterlaced(pref.gif.interlaced());
           opts->setLoop(pref.gif.loop());
           opts->setPreservePaletteOrder(pref.gif.preservePaletteOrder());
+          opts->setRefinePalette(pref.gif.refinePalette());
         }
         else {
           opts.reset();
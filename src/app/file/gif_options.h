@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C)      2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -20,24 +20,29 @@ namespace app {
     GifOptions(
       bool interlaced = false,
       bool loop = true,
-      bool preservePaletteOrder = true)
+      bool preservePaletteOrder = true,
+      bool refinePalette = false)
       : m_interlaced(interlaced)
       , m_loop(loop)
-      , m_preservePaletteOrder(preservePaletteOrder) {
+      , m_preservePaletteOrder(preservePaletteOrder)
+      , m_refinePalette(refinePalette) {
     }
 
     bool interlaced() const { return m_interlaced; }
     bool loop() const { return m_loop; }
     bool preservePaletteOrder() const { return m_preservePaletteOrder; }
+    bool refinePalette() const { return m_refinePalette; }
 
     void setInterlaced(bool interlaced) { m_interlaced = interlaced; }
     void setLoop(bool loop) { m_loop = loop; }
     void setPreservePaletteOrder(bool preservePaletteOrder) {m_preservePaletteOrder = preservePaletteOrder; }
+    void setRefinePalette(bool refinePalette) { m_refinePalette = refinePalette; }
 
   private:
     bool m_interlaced;
     bool m_loop;
     bool m_preservePaletteOrder;
+    bool m_refinePalette;
   };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -174,9 +174,34 @@ bool JpegFormat::onLoad(FileOp* fop)
   else
     dinfo.out_color_space = JCS_RGB;
 
+  // If a smaller image is enough (e.g. for thumbnails), we can
+  // decode the image directly at 1/2, 1/4, or 1/8 scale, which is
+  // much faster (the scaling is done in the DCT domain).
+  const gfx::Size sizeHint = fop->loadSizeHint();
+  if (sizeHint.w > 0 && sizeHint.h > 0) {
+    for (int denom=8; denom>1; denom/=2) {
+      if (int(dinfo.image_width) >= sizeHint.w*denom ||
+          int(dinfo.image_height) >= sizeHint.h*denom) {
+        dinfo.scale_num = 1;
+        dinfo.scale_denom = denom;
+        break;
+      }
+    }
+  }
+
   // Start decompressor.
   jpeg_start_decompress(&dinfo);
 
+  // Rows below the region of interest are not needed (only when the
+  // image is decoded in its original size, as the ROI is specified
+  // in sprite coordinates)
+  JDIMENSION rowsToRead = dinfo.output_height;
+  const gfx::Rect& roiBounds = fop->loadROI().bounds;
+  if (!roiBounds.isEmpty() &&
+      dinfo.output_height == dinfo.image_height) {
+    rowsToRead = JDIMENSION(std::clamp(roiBounds.y2(), 0, int(dinfo.output_height)));
+  }
+
   // Create the image.
   ImageRef image = fop->sequenceImageToLoad(
     (dinfo.out_color_space == JCS_RGB ? IMAGE_RGB:
@@ -213,8 +238,12 @@ bool JpegFormat::onLoad(FileOp* fop)
     for (c=0; c<256; c++)
       fop->sequenceSetColor(c, c, c, c);
 
+  // Rows that will not be read are cleared
+  for (int y=int(rowsToRead); y<image->height(); ++y)
+    std::fill_n(image->getPixelAddress(0, y), image->rowBytes(), 0);
+
   // Read each scan line.
-  while (dinfo.output_scanline < dinfo.output_height) {
+  while (dinfo.output_scanline < rowsToRead) {
     num_scanlines = jpeg_read_scanlines(&dinfo, buffer, buffer_height);
 
     // RGB
@@ -272,7 +301,11 @@ bool JpegFormat::onLoad(FileOp* fop)
     base_free(buffer[c]);
   base_free(buffer);
 
-  jpeg_finish_decompress(&dinfo);
+  // jpeg_finish_decompress() needs all scanlines to be read
+  if (dinfo.output_scanline < dinfo.output_height)
+    jpeg_abort_decompress(&dinfo);
+  else
+    jpeg_finish_decompress(&dinfo);
   jpeg_destroy_decompress(&dinfo);
 
   return true;
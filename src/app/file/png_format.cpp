@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,10 +20,12 @@
 #include "doc/doc.h"
 #include "gfx/color_space.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -55,7 +57,9 @@ class PngFormat : public FileFormat {
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA |
-      FILE_ENCODE_ABSTRACT_IMAGE;
+      FILE_ENCODE_ABSTRACT_IMAGE |
+      FILE_ENCODE_SEQUENCE_IN_PARALLEL |
+      FILE_DECODE_SEQUENCE_IN_PARALLEL;
   }
 
   bool onLoad(FileOp* fop) override;
@@ -329,8 +333,18 @@ bool PngFormat::onLoad(FileOp* fop)
   for (y = 0; y < height; y++)
     rows_pointer[y] = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
 
+  // Rows below the region of interest are not needed (we can stop
+  // reading rows only if the image is not interlaced)
+  png_uint_32 rowsToRead = height;
+  const gfx::Rect& roiBounds = fop->loadROI().bounds;
+  if (number_passes == 1 && !roiBounds.isEmpty()) {
+    rowsToRead = png_uint_32(std::clamp(roiBounds.y2(), 0, int(height)));
+    for (y = rowsToRead; y < height; y++)
+      std::fill_n(rows_pointer[y], png_get_rowbytes(png, info), 0);
+  }
+
   for (int pass=0; pass<number_passes; ++pass) {
-    for (y = 0; y < height; y++) {
+    for (y = 0; y < rowsToRead; y++) {
       png_read_rows(png, rows_pointer+y, nullptr, 1);
 
       fop->setProgress(
@@ -523,6 +537,25 @@ gfx::ColorSpaceRef PngFormat::loadColorSpace(png_structp png_ptr, png_infop info
 
 #ifdef ENABLE_SAVE
 
+static void set_png_compression(png_structp png, const FileOpConfig& config)
+{
+  switch (config.pngCompression) {
+    case gen::PngCompression::FAST: png_set_compression_level(png, Z_BEST_SPEED); break;
+    case gen::PngCompression::BEST: png_set_compression_level(png, Z_BEST_COMPRESSION); break;
+    case gen::PngCompression::NONE: png_set_compression_level(png, Z_NO_COMPRESSION); break;
+    default: break;
+  }
+
+  switch (config.pngFilter) {
+    case gen::PngFilter::NONE: png_set_filter(png, 0, PNG_FILTER_NONE); break;
+    case gen::PngFilter::SUB: png_set_filter(png, 0, PNG_FILTER_SUB); break;
+    case gen::PngFilter::UP: png_set_filter(png, 0, PNG_FILTER_UP); break;
+    case gen::PngFilter::AVG: png_set_filter(png, 0, PNG_FILTER_AVG); break;
+    case gen::PngFilter::PAETH: png_set_filter(png, 0, PNG_FILTER_PAETH); break;
+    default: break;
+  }
+}
+
 bool PngFormat::onSave(FileOp* fop)
 {
   png_infop info;
@@ -551,6 +584,7 @@ bool PngFormat::onSave(FileOp* fop)
     return false;
 
   png_init_io(png, fp);
+  set_png_compression(png, fop->config());
 
   const FileAbstractImage* img = fop->abstractImageToSave();
   const ImageSpec spec = img->spec();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,10 +11,14 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "psd/psd.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 doc::PixelFormat psd_cmode_to_ase_format(const psd::ColorMode mode)
@@ -109,7 +113,11 @@ public:
     , m_layerHasTransparentChannel(false)
   { }
 
-  Sprite* getSprite() { return assembleDocument(); }
+  Sprite* getSprite()
+  {
+    decodePendingChannels();
+    return assembleDocument();
+  }
 
   void onFileHeader(const psd::FileHeader& header) override
   {
@@ -208,6 +216,10 @@ public:
     if (!m_framesInfo.empty() &&
         (layerRecord.inFrames.size() == m_framesInfo.size()) &&
         m_currentImage) {
+      // The image of this layer is copied to each frame, so its
+      // pixels must be decoded right now
+      decodePendingChannels();
+
       std::unique_ptr<Cel> layerCel(m_currentLayer->cel(frame_t(0)));
       LayerImage* imageLayer = static_cast<LayerImage*>(m_currentLayer);
       imageLayer->removeCel(layerCel.get());
@@ -266,6 +278,8 @@ public:
   // Emitted when all layers and their masks have been processed
   void onLayersAndMask(const psd::LayersInformation& layersInfo) override
   {
+    decodePendingChannels();
+
     if (layersInfo.layers.size() == m_layers.size()) {
       for (int i = 0; i < m_layers.size(); ++i) {
         const psd::LayerRecord& layerRecord = layersInfo.layers[i];
@@ -284,6 +298,9 @@ public:
     }
   }
 
+  // The channel data of each scanline is just copied here, the
+  // pixels are decoded later in parallel (one task per image) by
+  // decodePendingChannels().
   void onImageScanline(const psd::ImageData& img,
                        const int y,
                        const psd::ChannelID chanID,
@@ -293,26 +310,108 @@ public:
     if (!m_currentImage || y >= m_currentImage->height())
       return;
 
-    const int dataCount = bytes / (img.depth >= 8 ? (img.depth / 8) : 1);
-    uint8_t* dstGenericAddress = m_currentImage->getPixelAddress(0, y);
+    if (img.depth != 1 && img.depth != 8 &&
+        img.depth != 16 && img.depth != 32)
+      throw std::runtime_error("invalid image depth");
+
+    // Scanlines of the same image must be decoded in order (as each
+    // channel modifies the pixels of the previous ones)
+    if (m_pendingChannels.empty() ||
+        m_pendingChannels.back().image != m_currentImage) {
+      auto it = std::find_if(
+        m_pendingChannels.begin(), m_pendingChannels.end(),
+        [this](const PendingChannels& pending) {
+          return pending.image == m_currentImage;
+        });
+      if (it != m_pendingChannels.end()) {
+        // Move it to the end so the next scanline finds it faster
+        PendingChannels pending = std::move(*it);
+        m_pendingChannels.erase(it);
+        m_pendingChannels.push_back(std::move(pending));
+      }
+      else {
+        m_pendingChannels.push_back(PendingChannels());
+        m_pendingChannels.back().image = m_currentImage;
+      }
+    }
+
+    PendingChannels& pending = m_pendingChannels.back();
+    ChannelScanline scanline;
+    scanline.y = y;
+    scanline.chanID = chanID;
+    scanline.depth = img.depth;
+    scanline.hasTransparentChannel = m_layerHasTransparentChannel;
+    scanline.offset = pending.data.size();
+    scanline.bytes = bytes;
+    pending.scanlines.push_back(scanline);
+    pending.data.insert(pending.data.end(), data, data + bytes);
+  }
+
+private:
+  struct ChannelScanline {
+    int y;
+    psd::ChannelID chanID;
+    int depth;
+    bool hasTransparentChannel;
+    size_t offset;
+    int bytes;
+  };
+
+  // Channel data of one image that wasn't decoded yet
+  struct PendingChannels {
+    doc::ImageRef image;
+    std::vector<ChannelScanline> scanlines;
+    std::vector<uint8_t> data;
+  };
+
+  // Decodes the channel data of all pending images, each image in
+  // its own task.
+  void decodePendingChannels()
+  {
+    if (m_pendingChannels.empty())
+      return;
+
+    doc::parallel_for(
+      0, int(m_pendingChannels.size()), 1,
+      [this](const int i1, const int i2) {
+        for (int i = i1; i < i2; ++i) {
+          const PendingChannels& pending = m_pendingChannels[i];
+          for (const ChannelScanline& scanline : pending.scanlines) {
+            decodeScanline(pending.image.get(), scanline,
+                           pending.data.data() + scanline.offset);
+          }
+        }
+      });
+
+    m_pendingChannels.clear();
+  }
+
+  void decodeScanline(doc::Image* image,
+                      const ChannelScanline& scanline,
+                      const uint8_t* data) const
+  {
+    const int depth = scanline.depth;
+    const psd::ChannelID chanID = scanline.chanID;
+    const int dataCount = scanline.bytes / (depth >= 8 ? (depth / 8) : 1);
+    uint8_t* dstGenericAddress = image->getPixelAddress(0, scanline.y);
 
     if (m_pixelFormat == doc::PixelFormat::IMAGE_INDEXED) {
       IndexedTraits::address_t dstAddress =
         (IndexedTraits::address_t)dstGenericAddress;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        *(dstAddress)++ = getNormalizedPixelValue(data, img.depth);
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
+        *(dstAddress)++ = getNormalizedPixelValue(data, depth);
       }
     }
     else if (m_pixelFormat == doc::PixelFormat::IMAGE_GRAYSCALE) {
       GrayscaleTraits::address_t dstAddress =
         (GrayscaleTraits::address_t)dstGenericAddress;
       uint8_t v = 0, a = 0;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
         const GrayscaleTraits::pixel_t pixel = *dstAddress;
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
+        const uint8_t newPixelValue = getNormalizedPixelValue(data, depth);
         if (chanID == psd::ChannelID::Red) {
           v = newPixelValue;
-          a = m_layerHasTransparentChannel ? graya_geta(pixel) : 255;
+          a = scanline.hasTransparentChannel ? graya_geta(pixel) : 255;
         }
         else if (chanID == psd::ChannelID::Alpha ||
                  chanID == psd::ChannelID::TransparencyMask) {
@@ -325,13 +424,13 @@ public:
     else if (m_pixelFormat == doc::PixelFormat::IMAGE_RGB) {
       RgbTraits::address_t dstAddress = (RgbTraits::address_t)dstGenericAddress;
       uint8_t r, g, b, a;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
+      for (int x = 0; x < dataCount && x < image->width(); ++x) {
+        const uint8_t newPixelValue = getNormalizedPixelValue(data, depth);
         const color_t c = *(dstAddress);
         r = rgba_getr(c);
         g = rgba_getg(c);
         b = rgba_getb(c);
-        a = m_layerHasTransparentChannel ? rgba_geta(c) : 255;
+        a = scanline.hasTransparentChannel ? rgba_geta(c) : 255;
         if (chanID == psd::ChannelID::Red) {
           r = newPixelValue;
         }
@@ -350,7 +449,6 @@ public:
     }
   }
 
-private:
   inline bool hasTransparency(const size_t nchannels)
   {
     // RGBA or grayscale image with alpha channel
@@ -388,8 +486,8 @@ private:
     return m_sprite;
   }
 
-  std::uint8_t getNormalizedPixelValue(const std::uint8_t*& data,
-                                       const int depth)
+  static std::uint8_t getNormalizedPixelValue(const std::uint8_t*& data,
+                                              const int depth)
   {
     if (depth == 1 || depth == 8) {
       return *(data++);
@@ -429,6 +527,7 @@ private:
   std::vector<psd::FrameInformation> m_framesInfo;
   Palette m_palette;
   bool m_layerHasTransparentChannel;
+  std::vector<PendingChannels> m_pendingChannels;
 };
 
 bool PsdFormat::onLoad(FileOp* fop)
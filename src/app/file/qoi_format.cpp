@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,15 +11,93 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "base/file_handle.h"
+#include "dio/mapped_file.h"
 
+#include <cstring>
+#include <vector>
+
+// We use only the qoi_desc type and colorspace constants, pixels are
+// decoded/encoded directly from/to the doc::Image rows (without the
+// intermediate RGBA buffers of qoi_decode()/qoi_encode()).
 #define QOI_NO_STDIO
-#define QOI_IMPLEMENTATION
 #include "qoi.h"
 
 namespace app {
 
 using namespace base;
 
+namespace {
+
+// Chunks of the QOI specification (https://qoiformat.org/)
+constexpr uint8_t kOpIndex = 0x00; // 00xxxxxx
+constexpr uint8_t kOpDiff  = 0x40; // 01xxxxxx
+constexpr uint8_t kOpLuma  = 0x80; // 10xxxxxx
+constexpr uint8_t kOpRun   = 0xc0; // 11xxxxxx
+constexpr uint8_t kOpRgb   = 0xfe; // 11111110
+constexpr uint8_t kOpRgba  = 0xff; // 11111111
+constexpr uint8_t kMask2   = 0xc0; // 11000000
+
+constexpr int kHeaderSize = 14;
+constexpr uint8_t kPadding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+constexpr uint32_t kMaxPixels = 400000000;
+
+inline int qoi_hash(const doc::color_t c)
+{
+  return (doc::rgba_getr(c)*3 +
+          doc::rgba_getg(c)*5 +
+          doc::rgba_getb(c)*7 +
+          doc::rgba_geta(c)*11) % 64;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+  return ((uint32_t(p[0]) << 24) |
+          (uint32_t(p[1]) << 16) |
+          (uint32_t(p[2]) << 8) |
+          uint32_t(p[3]));
+}
+
+// Buffered output of the encoded chunks.
+class QoiWriter {
+public:
+  static constexpr std::size_t kBufferSize = 64*1024;
+
+  QoiWriter(FILE* f) : m_f(f), m_buf(kBufferSize), m_pos(0) { }
+
+  // Reserves space for "n" bytes (n <= 8)
+  uint8_t* next(const std::size_t n) {
+    if (m_pos+n > m_buf.size())
+      flush();
+    uint8_t* p = m_buf.data()+m_pos;
+    m_pos += n;
+    return p;
+  }
+
+  void write8(const uint8_t v) { *next(1) = v; }
+
+  void write32(const uint32_t v) {
+    uint8_t* p = next(4);
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+  }
+
+  void flush() {
+    if (m_pos > 0) {
+      fwrite(m_buf.data(), 1, m_pos, m_f);
+      m_pos = 0;
+    }
+  }
+
+private:
+  FILE* m_f;
+  std::vector<uint8_t> m_buf;
+  std::size_t m_pos;
+};
+
+} // anonymous namespace
+
 class QoiFormat : public FileFormat {
   const char* onGetName() const override {
     return "qoi";
@@ -56,24 +134,44 @@ FileFormat* CreateQoiFormat()
 
 bool QoiFormat::onLoad(FileOp* fop)
 {
-  FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  FILE* f = handle.get();
-
-  fseek(f, 0, SEEK_END);
-  auto size = ftell(f);
-  if (size <= 0)
-    return false;
-  fseek(f, 0, SEEK_SET);
+  // Map the file in memory to decode it without copying its bytes
+  // (or read the whole file if it cannot be mapped).
+  dio::MappedFile mappedFile(fop->filename());
+  std::vector<uint8_t> fileData;
+  const uint8_t* data = mappedFile.data();
+  std::size_t size = mappedFile.size();
+  if (!data) {
+    FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
+    FILE* f = handle.get();
+
+    fseek(f, 0, SEEK_END);
+    auto fileSize = ftell(f);
+    if (fileSize <= 0)
+      return false;
+    fseek(f, 0, SEEK_SET);
+
+    fileData.resize(fileSize);
+    size = fread(fileData.data(), 1, fileSize, f);
+    if (ferror(f)) {
+      fop->setError("Error reading file.\n");
+      return false;
+    }
+    data = fileData.data();
+  }
 
-  auto data = QOI_MALLOC(size);
-  if (!data)
+  if (size < kHeaderSize + sizeof(kPadding) ||
+      std::memcmp(data, "qoif", 4) != 0)
     return false;
 
   qoi_desc desc;
-  auto bytes_read = fread(data, 1, size, f);
-  auto pixels = qoi_decode(data, bytes_read, &desc, 0);
-  QOI_FREE(data);
-  if (!pixels)
+  desc.width = read32(data+4);
+  desc.height = read32(data+8);
+  desc.channels = data[12];
+  desc.colorspace = data[13];
+  if (desc.width == 0 || desc.height == 0 ||
+      desc.channels < 3 || desc.channels > 4 ||
+      desc.colorspace > 1 ||
+      desc.height >= kMaxPixels / desc.width)
     return false;
 
   ImageRef image = fop->sequenceImageToLoad(
@@ -83,26 +181,72 @@ bool QoiFormat::onLoad(FileOp* fop)
   if (!image)
     return false;
 
-  auto src = (const uint8_t*)pixels;
-  for (int y=0; y<desc.height; ++y) {
+  // Decode the chunks directly in the image rows
+  const uint8_t* p = data + kHeaderSize;
+  const uint8_t* chunksEnd = data + size - sizeof(kPadding);
+  doc::color_t index[64] = { 0 };
+  doc::color_t px = doc::rgba(0, 0, 0, 255);
+  int run = 0;
+  const doc::color_t alphaMask = (desc.channels == 4 ? 0: doc::rgba_a_mask);
+
+  for (int y=0; y<int(desc.height); ++y) {
     auto dst = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], src[3]);
-          src += 4;
+    for (int x=0; x<int(desc.width); ++x, ++dst) {
+      if (run > 0) {
+        --run;
+      }
+      else if (p < chunksEnd) {
+        // There are 8 bytes of padding after the chunks, so we can
+        // read the bytes of the last chunk without checking the end.
+        const int b1 = *(p++);
+
+        if ((b1 & kMask2) == kOpIndex) {
+          px = index[b1];
+        }
+        else if ((b1 & kMask2) == kOpRun && b1 < kOpRgb) {
+          run = (b1 & 0x3f);
         }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++dst) {
-          *dst = doc::rgba(src[0], src[1], src[2], 255);
-          src += 3;
+        else {
+          int r = doc::rgba_getr(px);
+          int g = doc::rgba_getg(px);
+          int b = doc::rgba_getb(px);
+          int a = doc::rgba_geta(px);
+
+          if (b1 == kOpRgb) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            p += 3;
+          }
+          else if (b1 == kOpRgba) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            a = p[3];
+            p += 4;
+          }
+          else if ((b1 & kMask2) == kOpDiff) {
+            r += ((b1 >> 4) & 0x03) - 2;
+            g += ((b1 >> 2) & 0x03) - 2;
+            b += ( b1       & 0x03) - 2;
+          }
+          else if ((b1 & kMask2) == kOpLuma) {
+            const int b2 = *(p++);
+            const int vg = (b1 & 0x3f) - 32;
+            r += vg - 8 + ((b2 >> 4) & 0x0f);
+            g += vg;
+            b += vg - 8 +  (b2       & 0x0f);
+          }
+          px = doc::rgba(r & 0xff, g & 0xff, b & 0xff, a & 0xff);
         }
-        break;
+        index[qoi_hash(px)] = px;
+      }
+      *dst = (px | alphaMask);
     }
-  }
 
-  QOI_FREE(pixels);
+    if ((y & 15) == 0)
+      fop->setProgress((float)y / (float)desc.height);
+  }
 
   if (desc.channels == 4)
     fop->sequenceSetHasAlpha(true);
@@ -124,13 +268,7 @@ bool QoiFormat::onLoad(FileOp* fop)
     fop->document()->notifyColorSpaceChanged();
   }
 
-  if (ferror(handle.get())) {
-    fop->setError("Error reading file.\n");
-    return false;
-  }
-  else {
-    return true;
-  }
+  return true;
 }
 
 #ifdef ENABLE_SAVE
@@ -156,44 +294,104 @@ bool QoiFormat::onSave(FileOp* fop)
     desc.colorspace = QOI_LINEAR;
   }
 
-  auto pixels = (uint8_t*)QOI_MALLOC(desc.width * desc.height * desc.channels);
-  if (!pixels)
+  if (desc.width == 0 || desc.height == 0 ||
+      desc.height >= kMaxPixels / desc.width)
     return false;
 
-  auto dst = pixels;
-  for (int y=0; y<desc.height; ++y) {
-    auto src = (uint32_t*)image->getPixelAddress(0, y);
-    switch (desc.channels) {
-      case 4:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst[3] = doc::rgba_geta(c);
-          dst += 4;
+  QoiWriter w(f);
+  w.write8('q');
+  w.write8('o');
+  w.write8('i');
+  w.write8('f');
+  w.write32(desc.width);
+  w.write32(desc.height);
+  w.write8(desc.channels);
+  w.write8(desc.colorspace);
+
+  // Encode the chunks directly from the image rows
+  doc::color_t index[64] = { 0 };
+  doc::color_t pxPrev = doc::rgba(0, 0, 0, 255);
+  int run = 0;
+  const doc::color_t alphaMask = (desc.channels == 4 ? 0: doc::rgba_a_mask);
+
+  for (int y=0; y<int(desc.height); ++y) {
+    auto src = (const uint32_t*)image->getPixelAddress(0, y);
+    for (int x=0; x<int(desc.width); ++x, ++src) {
+      const doc::color_t px = (*src | alphaMask);
+
+      if (px == pxPrev) {
+        ++run;
+        if (run == 62 ||
+            (y == int(desc.height)-1 && x == int(desc.width)-1)) {
+          w.write8(kOpRun | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+
+      if (run > 0) {
+        w.write8(kOpRun | (run - 1));
+        run = 0;
+      }
+
+      const int i = qoi_hash(px);
+      if (index[i] == px) {
+        w.write8(kOpIndex | i);
+      }
+      else {
+        index[i] = px;
+
+        const int r = doc::rgba_getr(px);
+        const int g = doc::rgba_getg(px);
+        const int b = doc::rgba_getb(px);
+        const int a = doc::rgba_geta(px);
+
+        if (a == int(doc::rgba_geta(pxPrev))) {
+          const int vr = int8_t(r - doc::rgba_getr(pxPrev));
+          const int vg = int8_t(g - doc::rgba_getg(pxPrev));
+          const int vb = int8_t(b - doc::rgba_getb(pxPrev));
+          const int vg_r = vr - vg;
+          const int vg_b = vb - vg;
+
+          if (vr > -3 && vr < 2 &&
+              vg > -3 && vg < 2 &&
+              vb > -3 && vb < 2) {
+            w.write8(kOpDiff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+          }
+          else if (vg_r >  -9 && vg_r <  8 &&
+                   vg   > -33 && vg   < 32 &&
+                   vg_b >  -9 && vg_b <  8) {
+            uint8_t* p = w.next(2);
+            p[0] = kOpLuma | (vg + 32);
+            p[1] = (vg_r + 8) << 4 | (vg_b + 8);
+          }
+          else {
+            uint8_t* p = w.next(4);
+            p[0] = kOpRgb;
+            p[1] = r;
+            p[2] = g;
+            p[3] = b;
+          }
         }
-        break;
-      case 3:
-        for (int x=0; x<desc.width; ++x, ++src) {
-          uint32_t c = *src;
-          dst[0] = doc::rgba_getr(c);
-          dst[1] = doc::rgba_getg(c);
-          dst[2] = doc::rgba_getb(c);
-          dst += 3;
+        else {
+          uint8_t* p = w.next(5);
+          p[0] = kOpRgba;
+          p[1] = r;
+          p[2] = g;
+          p[3] = b;
+          p[4] = a;
         }
-        break;
+      }
+      pxPrev = px;
     }
-  }
 
-  int size = 0;
-  auto encoded = qoi_encode(pixels, &desc, &size);
-  QOI_FREE(pixels);
-  if (!encoded)
-    return false;
+    if ((y & 15) == 0)
+      fop->setProgress((float)y / (float)desc.height);
+  }
 
-  fwrite(encoded, 1, size, f);
-  QOI_FREE(encoded);
+  for (uint8_t v : kPadding)
+    w.write8(v);
+  w.flush();
 
   if (ferror(handle.get())) {
     fop->setError("Error writing file.\n");
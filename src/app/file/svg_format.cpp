@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2023  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -23,6 +23,9 @@
 
 #include "svg_options.xml.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -31,10 +34,14 @@ class SvgFormat : public FileFormat {
   // Data for SVG files
   class SvgOptions : public FormatOptions {
   public:
-    SvgOptions() : pixelScale(1) { }
+    SvgOptions() : pixelScale(1), mergeRects(false) { }
     int pixelScale;
+    // Save rectangles of pixels with the same color as one <rect>
+    bool mergeRects;
   };
 
+  static constexpr std::size_t kOutputBufferSize = 1024*1024;
+
   const char* onGetName() const override {
     return "svg";
   }
@@ -82,79 +89,121 @@ bool SvgFormat::onLoad(FileOp* fop)
 bool SvgFormat::onSave(FileOp* fop)
 {
   const ImageRef image = fop->sequenceImageToSave();
+  const int w = image->width();
+  const int h = image->height();
   int x, y, c, r, g, b, a, alpha;
   const auto svg_options = std::static_pointer_cast<SvgOptions>(fop->formatOptions());
   const int pixelScaleValue = std::clamp(svg_options->pixelScale, 0, 10000);
+  // Buffer for the thousands of small <rect> elements (it must
+  // outlive the file handle).
+  std::vector<char> buffer(kOutputBufferSize);
   FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
   FILE* f = handle.get();
-  auto printcol = [f](int x, int y,int r, int g, int b, int a, int pxScale) {
+  setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+  auto printcol = [f](int x, int y, int w, int h, int r, int g, int b, int a, int pxScale) {
     fprintf(f, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02X%02X%02X\" ",
-            x*pxScale, y*pxScale, pxScale, pxScale, r, g, b);
+            x*pxScale, y*pxScale, w*pxScale, h*pxScale, r, g, b);
     if (a != 255)
       fprintf(f, "opacity=\"%f\" ", (float)a / 255.0);
     fprintf(f, "/>\n");
   };
   fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
   fprintf(f, "<svg version=\"1.1\" width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n",
-          image->width()*pixelScaleValue, image->height()*pixelScaleValue);
+          w*pixelScaleValue, h*pixelScaleValue);
+
+  // RGBA color of each pixel, and if the pixel must be saved
+  std::vector<color_t> colors(w*h, 0);
+  std::vector<uint8_t> pending(w*h, 0);
 
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
+      for (y=0; y<h; y++) {
+        for (x=0; x<w; x++) {
           c = get_pixel_fast<RgbTraits>(image.get(), x, y);
           alpha = rgba_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, rgba_getr(c), rgba_getg(c), rgba_getb(c), alpha, pixelScaleValue);
+          if (alpha != 0x00) {
+            colors[y*w+x] = c;
+            pending[y*w+x] = 1;
+          }
         }
-        fop->setProgress((float)y / (float)(image->height()));
       }
       break;
     }
     case IMAGE_GRAYSCALE: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
+      for (y=0; y<h; y++) {
+        for (x=0; x<w; x++) {
           c = get_pixel_fast<GrayscaleTraits>(image.get(), x, y);
           auto v = graya_getv(c);
           alpha = graya_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, v, v, v, alpha, pixelScaleValue);
+          if (alpha != 0x00) {
+            colors[y*w+x] = rgba(v, v, v, alpha);
+            pending[y*w+x] = 1;
+          }
         }
-        fop->setProgress((float)y / (float)(image->height()));
       }
       break;
     }
     case IMAGE_INDEXED: {
-      unsigned char image_palette[256][4];
+      color_t image_palette[256];
       for (y=0; y<256; y++) {
         fop->sequenceGetColor(y, &r, &g, &b);
-        image_palette[y][0] = r;
-        image_palette[y][1] = g;
-        image_palette[y][2] = b;
         fop->sequenceGetAlpha(y, &a);
-        image_palette[y][3] = a;
+        image_palette[y] = rgba(r & 0xff, g & 0xff, b & 0xff, a & 0xff);
       }
       color_t mask_color = -1;
       if (fop->document()->sprite()->backgroundLayer() == NULL ||
           !fop->document()->sprite()->backgroundLayer()->isVisible()) {
         mask_color = fop->document()->sprite()->transparentColor();
       }
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
+      for (y=0; y<h; y++) {
+        for (x=0; x<w; x++) {
           c = get_pixel_fast<IndexedTraits>(image.get(), x, y);
-          if (c != mask_color)
-            printcol(x, y, image_palette[c][0] & 0xff,
-                     image_palette[c][1] & 0xff,
-                     image_palette[c][2] & 0xff,
-                     image_palette[c][3] & 0xff,
-                     pixelScaleValue);
+          if (c != mask_color) {
+            colors[y*w+x] = image_palette[c];
+            pending[y*w+x] = 1;
+          }
         }
-        fop->setProgress((float)y / (float)(image->height()));
       }
       break;
     }
   }
+
+  for (y=0; y<h; y++) {
+    for (x=0; x<w; x++) {
+      if (!pending[y*w+x])
+        continue;
+
+      const color_t color = colors[y*w+x];
+      int rw = 1, rh = 1;
+
+      if (svg_options->mergeRects) {
+        // Greedy rectangle cover: extend the run of pixels with the
+        // same color to the right, and then add the rows below while
+        // they have the same run of pixels.
+        auto sameColor = [&](int u, int v) {
+          return (pending[v*w+u] && colors[v*w+u] == color);
+        };
+        while (x+rw < w && sameColor(x+rw, y))
+          ++rw;
+        for (; y+rh < h; ++rh) {
+          int u = x;
+          while (u < x+rw && sameColor(u, y+rh))
+            ++u;
+          if (u < x+rw)
+            break;
+        }
+        for (int v=y; v<y+rh; ++v)
+          std::fill_n(&pending[v*w+x], rw, 0);
+      }
+
+      printcol(x, y, rw, rh,
+               rgba_getr(color), rgba_getg(color), rgba_getb(color), rgba_geta(color),
+               pixelScaleValue);
+    }
+    fop->setProgress((float)y / (float)(h));
+  }
   fprintf(f, "</svg>");
   if (ferror(f)) {
     fop->setError("Error writing file.\n");
@@ -176,17 +225,22 @@ FormatOptionsPtr SvgFormat::onAskUserForFormatOptions(FileOp* fop)
 
       if (pref.isSet(pref.svg.pixelScale))
         opts->pixelScale = pref.svg.pixelScale();
+      if (pref.isSet(pref.svg.mergeRects))
+        opts->mergeRects = pref.svg.mergeRects();
 
      if (pref.svg.showAlert()) {
         app::gen::SvgOptions win;
         win.pxsc()->setTextf("%d", opts->pixelScale);
+        win.mergeRects()->setSelected(opts->mergeRects);
         win.openWindowInForeground();
 
         if (win.closer() == win.ok()) {
           pref.svg.pixelScale((int)win.pxsc()->textInt());
+          pref.svg.mergeRects(win.mergeRects()->isSelected());
           pref.svg.showAlert(!win.dontShow()->isSelected());
 
           opts->pixelScale = pref.svg.pixelScale();
+          opts->mergeRects = pref.svg.mergeRects();
         }
         else {
           opts.reset();
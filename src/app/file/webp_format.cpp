@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -23,6 +23,7 @@
 #include "base/convert_to.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "ui/manager.h"
 
 #include "webp_options.xml.h"
@@ -30,7 +31,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <algorithm>
+#include <deque>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <webp/demux.h>
 #include <webp/mux.h>
@@ -239,6 +243,9 @@ struct WriterData {
     : fp(fp), fop(fop), n(n) { }
 };
 
+// Maximum number of bytes of frames rendered in advance
+static constexpr std::size_t kMaxQueuedBytes = 256*1024*1024;
+
 static int progress_report(int percent, const WebPPicture* pic)
 {
   auto wd = (WriterData*)pic->user_data;
@@ -294,17 +301,19 @@ bool WebPFormat::onSave(FileOp* fop)
         fop->setError("Error in WebP configuration preset\n");
         return false;
       }
+      config.method = std::clamp(opts->method(), 0, 6);
       break;
   }
 
+  // Use multiple threads to encode each frame (when possible)
+  config.thread_level = 1;
+
   WebPAnimEncoderOptions enc_options;
   WebPAnimEncoderOptionsInit(&enc_options);
   enc_options.anim_params.loop_count =
     (opts->loop() ? 0:  // 0 = infinite
                     1); // 1 = loop once
 
-  ImageRef image(Image::create(IMAGE_RGB, w, h));
-
   const doc::frame_t totalFrames = fop->roi().frames();
   WriterData wd(fp, fop, totalFrames);
   WebPPicture pic;
@@ -312,31 +321,78 @@ bool WebPFormat::onSave(FileOp* fop)
   pic.width = w;
   pic.height = h;
   pic.use_argb = true;
-  pic.argb = (uint32_t*)image->getPixelAddress(0, 0);
-  pic.argb_stride = image->rowPixels(); // Stride in pixels (not bytes)
   pic.user_data = &wd;
   pic.progress_hook = progress_report;
 
-  WebPAnimEncoder* enc = WebPAnimEncoderNew(w, h, &enc_options);
-  int timestamp_ms = 0;
-  for (frame_t frame : fop->roi().framesSequence()) {
-    // Render the frame in the bitmap
-    clear_image(image.get(), image->maskColor());
-    sprite->renderFrame(frame, fop->roi().frameBounds(frame), image.get());
-
-    // Switch R <-> B channels because WebPAnimEncoderAssemble()
-    // expects MODE_BGRA pictures.
-    {
-      LockImageBits<RgbTraits> bits(image.get(), Image::ReadWriteLock);
-      auto it = bits.begin(), end = bits.end();
-      for (; it != end; ++it) {
-        auto c = *it;
-        *it = rgba(rgba_getb(c), // Use blue in red channel
-                   rgba_getg(c),
-                   rgba_getr(c), // Use red in blue channel
-                   rgba_geta(c));
+  // Frames are rendered in worker threads while the encoder
+  // compresses the previous ones.
+  struct RenderedFrame {
+    ImageRef image;
+    doc::TaskGroup tasks;
+  };
+  std::vector<frame_t> frames;
+  for (frame_t frame : fop->roi().framesSequence())
+    frames.push_back(frame);
+
+  const std::size_t frameBytes = std::size_t(w) * h * sizeof(uint32_t);
+  const int maxFramesAhead =
+    int(std::clamp<std::size_t>(kMaxQueuedBytes / std::max<std::size_t>(1, frameBytes),
+                                1, std::max(2, doc::parallel_concurrency())));
+  std::vector<ImageRef> freeImages;
+  std::deque<std::unique_ptr<RenderedFrame>> renderedFrames;
+  int nextRenderedFrame = 0;
+
+  auto renderFramesAhead = [&]{
+    while (nextRenderedFrame < int(frames.size()) &&
+           int(renderedFrames.size()) < maxFramesAhead) {
+      auto rendered = std::make_unique<RenderedFrame>();
+      if (!freeImages.empty()) {
+        rendered->image = freeImages.back();
+        freeImages.pop_back();
       }
+      else
+        rendered->image.reset(Image::create(IMAGE_RGB, w, h));
+
+      rendered->tasks.run(
+        [fop, sprite, frame = frames[nextRenderedFrame],
+         image = rendered->image.get()](base::task_token& token){
+          if (token.canceled())
+            return;
+
+          // Render the frame in the bitmap
+          clear_image(image, image->maskColor());
+          sprite->renderFrame(frame, fop->roi().frameBounds(frame), image);
+
+          // Switch R <-> B channels because WebPAnimEncoderAssemble()
+          // expects MODE_BGRA pictures.
+          LockImageBits<RgbTraits> bits(image, Image::ReadWriteLock);
+          auto it = bits.begin(), end = bits.end();
+          for (; it != end; ++it) {
+            auto c = *it;
+            *it = rgba(rgba_getb(c), // Use blue in red channel
+                       rgba_getg(c),
+                       rgba_getr(c), // Use red in blue channel
+                       rgba_geta(c));
+          }
+        });
+      renderedFrames.push_back(std::move(rendered));
+      ++nextRenderedFrame;
     }
+  };
+
+  WebPAnimEncoder* enc = WebPAnimEncoderNew(w, h, &enc_options);
+  int timestamp_ms = 0;
+  for (frame_t frame : frames) {
+    renderFramesAhead();
+
+    ASSERT(!renderedFrames.empty());
+    RenderedFrame& rendered = *renderedFrames.front();
+    rendered.tasks.wait();
+
+    // The encoder copies the pixels, so the image can be reused to
+    // render other frame.
+    pic.argb = (uint32_t*)rendered.image->getPixelAddress(0, 0);
+    pic.argb_stride = rendered.image->rowPixels(); // Stride in pixels (not bytes)
 
     if (!WebPAnimEncoderAdd(enc, &pic, timestamp_ms, &config)) {
       if (!fop->isStop()) {
@@ -348,6 +404,9 @@ bool WebPFormat::onSave(FileOp* fop)
     }
     timestamp_ms += sprite->frameDuration(frame);
 
+    freeImages.push_back(rendered.image);
+    renderedFrames.pop_front();
+
     wd.f++;
   }
   WebPAnimEncoderAdd(enc, nullptr, timestamp_ms, nullptr);
@@ -390,6 +449,7 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
         case WebPOptions::Lossy:
           if (pref.isSet(pref.webp.quality))     opts->setQuality(pref.webp.quality());
           if (pref.isSet(pref.webp.imagePreset)) opts->setImagePreset(WebPPreset(pref.webp.imagePreset()));
+          if (pref.isSet(pref.webp.method))      opts->setMethod(pref.webp.method());
           break;
       }
 
@@ -419,6 +479,7 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
         win.imageHint()->setSelectedItemIndex(opts->imageHint());
         win.quality()->setValue(static_cast<int>(opts->quality()));
         win.imagePreset()->setSelectedItemIndex(opts->imagePreset());
+        win.method()->setValue(opts->method());
 
         updatePanels();
         win.type()->Change.connect(updatePanels);
@@ -432,6 +493,7 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
           pref.webp.imageHint(base::convert_to<int>(win.imageHint()->getValue()));
           pref.webp.quality(win.quality()->getValue());
           pref.webp.imagePreset(base::convert_to<int>(win.imagePreset()->getValue()));
+          pref.webp.method(win.method()->getValue());
 
           opts->setLoop(pref.webp.loop());
           opts->setType(WebPOptions::Type(pref.webp.type()));
@@ -443,6 +505,7 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
             case WebPOptions::Lossy:
               opts->setQuality(pref.webp.quality());
               opts->setImagePreset(WebPPreset(pref.webp.imagePreset()));
+              opts->setMethod(pref.webp.method());
               break;
           }
         }
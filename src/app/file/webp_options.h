@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -24,12 +25,16 @@ namespace app {
     // By default we use 6, because 9 is too slow
     const int kDefaultCompression = 6;
 
+    // Same default method used by the libwebp lossy presets
+    const int kDefaultMethod = 4;
+
     WebPOptions() : m_loop(true),
                     m_type(Type::Simple),
                     m_compression(kDefaultCompression),
                     m_imageHint(WEBP_HINT_DEFAULT),
                     m_quality(100),
-                    m_imagePreset(WEBP_PRESET_DEFAULT) { }
+                    m_imagePreset(WEBP_PRESET_DEFAULT),
+                    m_method(kDefaultMethod) { }
 
     bool loop() const { return m_loop; }
     Type type() const { return m_type; }
@@ -37,6 +42,7 @@ namespace app {
     WebPImageHint imageHint() const { return m_imageHint; }
     int quality() const { return m_quality; }
     WebPPreset imagePreset() const { return m_imagePreset; }
+    int method() const { return m_method; }
 
     void setLoop(const bool loop) {
       m_loop = loop;
@@ -71,6 +77,11 @@ namespace app {
       m_imagePreset = imagePreset;
     }
 
+    void setMethod(const int method) {
+      ASSERT(m_type == Type::Lossy);
+      m_method = method;
+    }
+
   private:
     bool m_loop;
     Type m_type;
@@ -80,6 +91,7 @@ namespace app {
     // Lossy options
     int m_quality;      // Between 0 (smallest file) and 100 (biggest)
     WebPPreset m_imagePreset;  // Image Preset for lossy webp.
+    int m_method;       // Quality/speed trade-off (0=fast, 6=slower-better)
   };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -94,7 +94,8 @@ public:
   FileItem(FileItem* parent);
   ~FileItem();
 
-  void insertChildSorted(FileItem* child);
+  void addChild(FileItem* child);
+  void sortChildren();
   int compare(const FileItem& that) const;
 
   bool operator<(const FileItem& that) const { return compare(that) < 0; }
@@ -178,6 +179,7 @@ public:
   static void put_fileitem(FileItem* fileitem);
 #else
   static FileItem* get_fileitem_by_path(const std::string& path, bool create_if_not);
+  static bool is_dirent_folder(const dirent* entry, const std::string& fullfn);
   static std::string remove_backslash_if_needed(const std::string& filename);
   static std::string get_key_for_filename(const std::string& filename);
   static void put_fileitem(FileItem* fileitem);
@@ -477,7 +479,7 @@ const FileItemList& FileItem::children()
             // item is file or a folder
             for (c=0; c<fetched; ++c) {
               attribs[c] = SFGAO_FOLDER;
-              pFolder->GetAttributesOf(1, (LPCITEMIDLIST*)itempidl, attribs+c);
+              pFolder->GetAttributesOf(1, (LPCITEMIDLIST*)(itempidl+c), attribs+c);
             }
 
             // Generate the FileItems
@@ -501,7 +503,7 @@ const FileItemList& FileItem::children()
                 free_pidl(itempidl[c]);
               }
 
-              insertChildSorted(child);
+              addChild(child);
             }
           }
         }
@@ -515,27 +517,18 @@ const FileItemList& FileItem::children()
         while ((entry = readdir(dir)) != NULL) {
           FileItem* child;
           std::string fn = entry->d_name;
-          std::string fullfn = base::join_path(m_filename, fn);
 
           if (fn == "." || fn == "..")
             continue;
 
-          child = get_fileitem_by_path(fullfn, false);
-          if (!child) {
-            child = new FileItem(this);
-
-            bool is_folder;
-            struct stat fileStat;
-
-            stat(fullfn.c_str(), &fileStat);
-
-            if ((fileStat.st_mode & S_IFMT) == S_IFLNK) {
-              is_folder = base::is_directory(fullfn);
-            }
-            else {
-              is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
-            }
+          std::string fullfn = base::join_path(m_filename, fn);
+          bool is_folder = is_dirent_folder(entry, fullfn);
 
+          // We don't use get_fileitem_by_path() because it checks if
+          // the file exists (and we already know that it exists).
+          auto it2 = fileitems_map->find(get_key_for_filename(fullfn));
+          if (it2 == fileitems_map->end()) {
+            child = new FileItem(this);
             child->m_filename = fullfn;
             child->m_displayname = fn;
             child->m_is_folder = is_folder;
@@ -543,10 +536,12 @@ const FileItemList& FileItem::children()
             put_fileitem(child);
           }
           else {
+            child = it2->second;
             ASSERT(child->m_parent == this);
+            child->m_is_folder = is_folder;
           }
 
-          insertChildSorted(child);
+          addChild(child);
         }
         closedir(dir);
       }
@@ -568,6 +563,8 @@ const FileItemList& FileItem::children()
         ++it;
     }
 
+    sortChildren();
+
     // now this file-item is updated
     m_version = current_file_system_version;
   }
@@ -647,23 +644,27 @@ FileItem::~FileItem()
 #endif
 }
 
-void FileItem::insertChildSorted(FileItem* child)
+void FileItem::addChild(FileItem* child)
 {
-  // this file-item wasn't removed from the last lookup
-  child->m_removed = false;
-
-  // if the fileitem is already in the list we can go back
-  if (std::find(m_children.begin(), m_children.end(), child) != m_children.end())
-    return;
-
-  for (auto it=m_children.begin(), end=m_children.end(); it!=end; ++it) {
-    if (*child < *static_cast<FileItem*>(*it)) {
-      m_children.insert(it, child);
-      return;
-    }
-  }
+  // Children with m_removed=true are the ones that are already in
+  // the m_children list (see FileItem::children()), so we just mark
+  // them as not removed again.
+  if (child->m_removed)
+    child->m_removed = false;
+  else
+    m_children.push_back(child);
+}
 
-  m_children.push_back(child);
+void FileItem::sortChildren()
+{
+  // We sort all the children at once (instead of inserting each one
+  // in its position) because folders with thousands of files were
+  // too slow to load.
+  std::sort(m_children.begin(), m_children.end(),
+            [](const IFileItem* a, const IFileItem* b) {
+              return (*static_cast<const FileItem*>(a) <
+                      *static_cast<const FileItem*>(b));
+            });
 }
 
 int FileItem::compare(const FileItem& that) const
@@ -1067,6 +1068,21 @@ static FileItem* get_fileitem_by_path(const std::string& path, bool create_if_no
   return fileitem;
 }
 
+// Returns true if the directory entry is a folder, avoiding a stat()
+// call when the file system already gives us the type of the entry
+// (stat() is quite slow on network drives).
+static bool is_dirent_folder(const dirent* entry, const std::string& fullfn)
+{
+#ifdef DT_DIR
+  if (entry->d_type == DT_DIR)
+    return true;
+  if (entry->d_type == DT_REG)
+    return false;
+#endif
+  // Unknown type or a symbolic link (is_directory() follows links)
+  return base::is_directory(fullfn);
+}
+
 static std::string remove_backslash_if_needed(const std::string& filename)
 {
   if (!filename.empty() && base::is_path_separator(*(filename.end()-1))) {
@@ -0,0 +1,207 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/font_index.h"
+
+#include "app/resource_finder.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/string.h"
+#include "base/task.h"
+#include "base/time.h"
+#include "fmt/format.h"
+
+#include <fstream>
+#include <memory>
+#include <queue>
+
+namespace app {
+
+// The index file is a text file with one line per directory ("D
+// <time> <path>") followed by its subdirectories ("S <path>") and
+// font files ("F <path>").
+static const char* kIndexHeader = "aseprite-font-index 1";
+
+static std::string time_to_string(const base::Time& t)
+{
+  return fmt::format("{:04}{:02}{:02}{:02}{:02}{:02}",
+                     t.year, t.month, t.day,
+                     t.hour, t.minute, t.second);
+}
+
+FontIndex::FontIndex(const std::string& indexFilename)
+  : m_filename(indexFilename)
+{
+}
+
+void FontIndex::load()
+{
+  if (m_filename.empty() || !base::is_file(m_filename))
+    return;
+
+  std::ifstream f(FSTREAM_PATH(m_filename));
+  std::string line;
+  if (!std::getline(f, line) || line != kIndexHeader)
+    return;
+
+  std::map<std::string, Dir> dirs;
+  Dir* dir = nullptr;
+  while (std::getline(f, line)) {
+    if (line.size() < 3 || line[1] != ' ')
+      continue;
+
+    switch (line[0]) {
+      case 'D': {
+        const std::size_t i = line.find(' ', 2);
+        if (i == std::string::npos)
+          break;
+        dir = &dirs[line.substr(i+1)];
+        dir->time = line.substr(2, i-2);
+        break;
+      }
+      case 'S':
+        if (dir)
+          dir->subdirs.push_back(line.substr(2));
+        break;
+      case 'F':
+        if (dir)
+          dir->files.push_back(line.substr(2));
+        break;
+    }
+  }
+
+  const std::lock_guard lock(m_mutex);
+  m_dirs = std::move(dirs);
+}
+
+void FontIndex::save() const
+{
+  if (m_filename.empty())
+    return;
+
+  std::ofstream f(FSTREAM_PATH(m_filename));
+  if (!f)
+    return;
+
+  const std::lock_guard lock(m_mutex);
+  f << kIndexHeader << "\n";
+  for (const auto& it : m_dirs) {
+    const Dir& dir = it.second;
+    f << "D " << (dir.time.empty() ? "0": dir.time) << " " << it.first << "\n";
+    for (const auto& subdir : dir.subdirs)
+      f << "S " << subdir << "\n";
+    for (const auto& file : dir.files)
+      f << "F " << file << "\n";
+  }
+}
+
+bool FontIndex::update(const base::paths& fontDirs,
+                       base::task_token* token)
+{
+  std::map<std::string, Dir> oldDirs;
+  {
+    const std::lock_guard lock(m_mutex);
+    oldDirs = m_dirs;
+  }
+
+  // Directories modified in the last seconds are listed again in the
+  // next update (as the modification time has a resolution of
+  // seconds, a new file could be added in the same second).
+  const std::string recentTime =
+    time_to_string(base::current_time().addSeconds(-2));
+
+  std::map<std::string, Dir> dirs;
+  std::queue<std::string> q;
+  for (const auto& fontDir : fontDirs)
+    q.push(base::fix_path_separators(fontDir));
+
+  while (!q.empty()) {
+    if (token && token->canceled())
+      return false;
+
+    const std::string path = q.front();
+    q.pop();
+
+    if (dirs.find(path) != dirs.end() ||
+        !base::is_directory(path))
+      continue;
+
+    const std::string time =
+      time_to_string(base::get_modification_time(path));
+
+    Dir& dir = dirs[path];
+    auto it = oldDirs.find(path);
+    if (it != oldDirs.end() &&
+        !it->second.time.empty() &&
+        it->second.time == time) {
+      dir = std::move(it->second);
+    }
+    else {
+      dir.time = (time < recentTime ? time: std::string());
+      for (const auto& file : base::list_files(path)) {
+        const std::string fullpath = base::join_path(path, file);
+        if (isFontFile(fullpath)) {
+          if (base::is_file(fullpath))
+            dir.files.push_back(fullpath);
+        }
+        else if (base::is_directory(fullpath))
+          dir.subdirs.push_back(fullpath);
+      }
+    }
+
+    for (const auto& subdir : dir.subdirs)
+      q.push(subdir);
+  }
+
+  const std::lock_guard lock(m_mutex);
+  const bool changed = (allFiles(m_dirs) != allFiles(dirs));
+  m_dirs = std::move(dirs);
+  return changed;
+}
+
+base::paths FontIndex::files() const
+{
+  const std::lock_guard lock(m_mutex);
+  return allFiles(m_dirs);
+}
+
+// static
+base::paths FontIndex::allFiles(const std::map<std::string, Dir>& dirs)
+{
+  base::paths files;
+  for (const auto& it : dirs)
+    files.insert(files.end(), it.second.files.begin(), it.second.files.end());
+  return files;
+}
+
+// static
+bool FontIndex::isFontFile(const std::string& filename)
+{
+  const std::string ext =
+    base::string_to_lower(base::get_file_extension(filename));
+  return (ext == "ttf" || ext == "ttc" ||
+          ext == "otf" || ext == "dfont");
+}
+
+FontIndex* get_system_font_index()
+{
+  static std::unique_ptr<FontIndex> index;
+  static std::once_flag flag;
+  std::call_once(
+    flag, []{
+      ResourceFinder rf;
+      rf.includeUserDir("fonts.index");
+      index = std::make_unique<FontIndex>(rf.getFirstOrCreateDefault());
+      index->load();
+    });
+  return index.get();
+}
+
+} // namespace app
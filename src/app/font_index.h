@@ -0,0 +1,74 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FONT_INDEX_H_INCLUDED
+#define APP_FONT_INDEX_H_INCLUDED
+#pragma once
+
+#include "base/paths.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace base {
+  class task_token;
+}
+
+namespace app {
+
+  // Index of the font files (.ttf, .ttc, .otf, .dfont) found in the
+  // font directories (and their subdirectories). The index is saved
+  // in a file, so in the next session we can show the list of fonts
+  // without listing all directories again, and update() lists only
+  // the directories that were modified since the last update (using
+  // their modification time).
+  //
+  // It can be used from several threads (e.g. updated from a
+  // background thread while the UI thread reads the files).
+  class FontIndex {
+  public:
+    // The index is loaded from and saved to the given file (it
+    // can be empty to use an index in memory only).
+    explicit FontIndex(const std::string& indexFilename = std::string());
+
+    void load();
+    void save() const;
+
+    // Updates the index with the current content of the given font
+    // directories. Returns true if the list of font files has
+    // changed. It can be canceled through the given token.
+    bool update(const base::paths& fontDirs,
+                base::task_token* token = nullptr);
+
+    // Returns the full path of all font files in the index.
+    base::paths files() const;
+
+    static bool isFontFile(const std::string& filename);
+
+  private:
+    struct Dir {
+      // Modification time of the directory when it was listed (it's
+      // empty if the directory must be listed again)
+      std::string time;
+      base::paths subdirs;
+      base::paths files;
+    };
+
+    static base::paths allFiles(const std::map<std::string, Dir>& dirs);
+
+    std::string m_filename;
+    std::map<std::string, Dir> m_dirs;
+    mutable std::mutex m_mutex;
+  };
+
+  // Returns the index of the system font directories (saved in the
+  // user configuration folder).
+  FontIndex* get_system_font_index();
+
+} // namespace app
+
+#endif
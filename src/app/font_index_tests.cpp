@@ -0,0 +1,76 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/font_index.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+
+#include <algorithm>
+
+using namespace app;
+
+static void write_file(const std::string& fn)
+{
+  base::FileHandle handle(base::open_file(fn, "wb"));
+  fputs("font", handle.get());
+}
+
+static bool contains(const base::paths& files, const std::string& fn)
+{
+  return (std::find(files.begin(), files.end(), fn) != files.end());
+}
+
+TEST(FontIndex, UpdateSaveLoad)
+{
+  const std::string dir = "_test_fonts";
+  const std::string subdir = base::join_path(dir, "sub");
+  const std::string indexFn = "_test_fonts.index";
+  base::make_all_directories(subdir);
+  write_file(base::join_path(dir, "a.ttf"));
+  write_file(base::join_path(dir, "b.txt"));
+  write_file(base::join_path(subdir, "c.OTF"));
+
+  {
+    FontIndex index(indexFn);
+    EXPECT_TRUE(index.files().empty());
+    EXPECT_TRUE(index.update({ dir }));
+
+    const base::paths files = index.files();
+    EXPECT_EQ(2, int(files.size()));
+    EXPECT_TRUE(contains(files, base::join_path(dir, "a.ttf")));
+    EXPECT_TRUE(contains(files, base::join_path(subdir, "c.OTF")));
+
+    // Nothing changed
+    EXPECT_FALSE(index.update({ dir }));
+    index.save();
+  }
+
+  {
+    FontIndex index(indexFn);
+    index.load();
+    EXPECT_EQ(2, int(index.files().size()));
+
+    // Recently modified directories are listed again
+    write_file(base::join_path(subdir, "d.ttc"));
+    EXPECT_TRUE(index.update({ dir }));
+    EXPECT_EQ(3, int(index.files().size()));
+    EXPECT_TRUE(contains(index.files(), base::join_path(subdir, "d.ttc")));
+
+    // Removed directories are removed from the index
+    for (const auto& item : base::list_files(subdir))
+      base::delete_file(base::join_path(subdir, item));
+    base::remove_directory(subdir);
+    EXPECT_TRUE(index.update({ dir }));
+    EXPECT_EQ(1, int(index.files().size()));
+  }
+
+  for (const auto& item : base::list_files(dir))
+    base::delete_file(base::join_path(dir, item));
+  base::remove_directory(dir);
+  base::delete_file(indexFn);
+}
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,14 +13,19 @@
 
 #include "base/fs.h"
 
+#include <mutex>
 #include <queue>
 
 namespace app {
 
 base::paths g_cache;
+std::mutex g_cacheMutex;
 
+// It can be called from a background thread (e.g. to update the
+// FontIndex)
 void get_font_dirs(base::paths& fontDirs)
 {
+  const std::lock_guard lock(g_cacheMutex);
   if (!g_cache.empty()) {
     fontDirs = g_cache;
     return;
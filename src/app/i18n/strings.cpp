@@ -156,6 +156,7 @@ std::string Strings::VFormat(const char* id, const fmt::format_args& vargs)
 
 void Strings::loadLanguage(const std::string& langId)
 {
+  m_cache.assign(kStringsCount, nullptr);
   m_strings.clear();
   loadStringsFromDataDir(kDefLanguage);
   m_default = m_strings;
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/i18n/lang_info.h"
+#include "base/debug.h"
 #include "fmt/core.h"
 #include "obs/signal.h"
 #include "strings.ini.h"
@@ -17,6 +18,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace app {
 
@@ -46,6 +48,17 @@ namespace app {
       return s->translate(id);
     }
 
+    // Used by the generated functions (e.g. Strings::general_ok()),
+    // "index" is the position of the string "id" in en.ini.
+    static const std::string& Translate(const int index, const char* id) {
+      Strings* s = Strings::instance();
+      ASSERT(index >= 0 && index < int(s->m_cache.size()));
+      const std::string*& str = s->m_cache[index];
+      if (!str)
+        str = &s->translate(id);
+      return *str;
+    }
+
     // Formats a string with the given arguments, if it fails
     // (e.g. because the translation contains an invalid formatted
     // string) it tries to return the original string from the default
@@ -72,6 +85,8 @@ namespace app {
     Extensions& m_exts;
     mutable std::unordered_map<std::string, std::string> m_default; // Default strings from en.ini
     mutable std::unordered_map<std::string, std::string> m_strings; // Strings from current language
+    // Pointers to values of m_strings by string index
+    std::vector<const std::string*> m_cache;
   };
 
 } // namespace app
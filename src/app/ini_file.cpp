@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -28,6 +28,8 @@
 #endif
 
 #include <cstdlib>
+#include <cstring>
+#include <set>
 #include <vector>
 
 namespace app {
@@ -37,6 +39,23 @@ using namespace gfx;
 static std::string g_configFilename;
 static std::vector<cfg::CfgFile*> g_configs;
 
+// Config files with changes that weren't saved yet, so
+// flush_config_file() doesn't rewrite files that weren't modified
+// (e.g. when the preferences are saved and nothing was changed).
+static std::set<const cfg::CfgFile*> g_modifiedConfigs;
+
+static cfg::CfgFile* modified_config()
+{
+  cfg::CfgFile* cfg = g_configs.back();
+  g_modifiedConfigs.insert(cfg);
+  return cfg;
+}
+
+static bool has_config_value(const char* section, const char* name)
+{
+  return (g_configs.back()->getValue(section, name, nullptr) != nullptr);
+}
+
 ConfigModule::ConfigModule()
 {
   ResourceFinder rf;
@@ -104,6 +123,7 @@ ConfigModule::~ConfigModule()
   for (auto cfg : g_configs)
     delete cfg;
   g_configs.clear();
+  g_modifiedConfigs.clear();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -118,6 +138,7 @@ void pop_config_state()
 {
   ASSERT(!g_configs.empty());
 
+  g_modifiedConfigs.erase(g_configs.back());
   delete g_configs.back();
   g_configs.erase(--g_configs.end());
 }
@@ -126,7 +147,13 @@ void flush_config_file()
 {
   ASSERT(!g_configs.empty());
 
-  g_configs.back()->save();
+  cfg::CfgFile* cfg = g_configs.back();
+  auto it = g_modifiedConfigs.find(cfg);
+  if (it == g_modifiedConfigs.end())
+    return;
+
+  cfg->save();
+  g_modifiedConfigs.erase(it);
 }
 
 void set_config_file(const char* filename)
@@ -135,6 +162,7 @@ void set_config_file(const char* filename)
     g_configs.push_back(new cfg::CfgFile());
 
   g_configs.back()->load(filename);
+  g_modifiedConfigs.erase(g_configs.back());
 }
 
 std::string main_config_filename()
@@ -149,7 +177,11 @@ const char* get_config_string(const char* section, const char* name, const char*
 
 void set_config_string(const char* section, const char* name, const char* value)
 {
-  g_configs.back()->setValue(section, name, value);
+  const char* old = g_configs.back()->getValue(section, name, nullptr);
+  if (old && value && std::strcmp(old, value) == 0)
+    return;
+
+  modified_config()->setValue(section, name, value);
 }
 
 int get_config_int(const char* section, const char* name, int value)
@@ -159,7 +191,11 @@ int get_config_int(const char* section, const char* name, int value)
 
 void set_config_int(const char* section, const char* name, int value)
 {
-  g_configs.back()->setIntValue(section, name, value);
+  if (has_config_value(section, name) &&
+      g_configs.back()->getIntValue(section, name, 0) == value)
+    return;
+
+  modified_config()->setIntValue(section, name, value);
 }
 
 float get_config_float(const char* section, const char* name, float value)
@@ -169,7 +205,7 @@ float get_config_float(const char* section, const char* name, float value)
 
 void set_config_float(const char* section, const char* name, float value)
 {
-  g_configs.back()->setDoubleValue(section, name, (float)value);
+  set_config_double(section, name, (float)value);
 }
 
 double get_config_double(const char* section, const char* name, double value)
@@ -179,7 +215,11 @@ double get_config_double(const char* section, const char* name, double value)
 
 void set_config_double(const char* section, const char* name, double value)
 {
-  g_configs.back()->setDoubleValue(section, name, value);
+  if (has_config_value(section, name) &&
+      g_configs.back()->getDoubleValue(section, name, 0.0) == value)
+    return;
+
+  modified_config()->setDoubleValue(section, name, value);
 }
 
 bool get_config_bool(const char* section, const char* name, bool value)
@@ -189,7 +229,11 @@ bool get_config_bool(const char* section, const char* name, bool value)
 
 void set_config_bool(const char* section, const char* name, bool value)
 {
-  g_configs.back()->setBoolValue(section, name, value);
+  if (has_config_value(section, name) &&
+      g_configs.back()->getBoolValue(section, name, false) == value)
+    return;
+
+  modified_config()->setBoolValue(section, name, value);
 }
 
 Point get_config_point(const char* section, const char* name, const Point& point)
@@ -269,12 +313,12 @@ void set_config_color(const char* section, const char* name, const app::Color& v
 
 void del_config_value(const char* section, const char* name)
 {
-  g_configs.back()->deleteValue(section, name);
+  modified_config()->deleteValue(section, name);
 }
 
 void del_config_section(const char* section)
 {
-  g_configs.back()->deleteSection(section);
+  modified_config()->deleteSection(section);
 }
 
 base::paths enum_config_keys(const char* section)
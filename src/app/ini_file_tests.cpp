@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -55,3 +55,29 @@ TEST(IniFile, PushPop)
 
   EXPECT_EQ(32, get_config_int("A", "a", 0));
 }
+
+TEST(IniFile, FlushOnlyModified)
+{
+  ConfigModule cm;
+
+  if (base::is_file("_c.ini")) base::delete_file("_c.ini");
+
+  set_config_file("_c.ini");
+  set_config_int("A", "a", 2);
+  set_config_bool("A", "b", true);
+  set_config_string("A", "c", "text");
+  flush_config_file();
+  EXPECT_TRUE(base::is_file("_c.ini"));
+
+  // Setting the same values doesn't rewrite the file
+  base::delete_file("_c.ini");
+  set_config_int("A", "a", 2);
+  set_config_bool("A", "b", true);
+  set_config_string("A", "c", "text");
+  flush_config_file();
+  EXPECT_FALSE(base::is_file("_c.ini"));
+
+  set_config_int("A", "a", 3);
+  flush_config_file();
+  EXPECT_TRUE(base::is_file("_c.ini"));
+}
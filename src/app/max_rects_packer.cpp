@@ -0,0 +1,381 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/max_rects_packer.h"
+
+#include "base/task.h"
+#include "doc/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+namespace app {
+
+using Heuristic = MaxRectsPacker::Heuristic;
+
+namespace {
+
+// Maximal free rectangles of the texture. Each free rectangle is as
+// big as possible (so free rectangles can overlap), and no free
+// rectangle is contained in other one.
+class FreeRects {
+public:
+  explicit FreeRects(const gfx::Rect& bounds) {
+    m_rects.push_back(bounds);
+  }
+
+  // Finds the best position for a rectangle of the given size.
+  bool findPosition(const gfx::Size& size,
+                    const Heuristic heuristic,
+                    gfx::Point& pos) const {
+    bool found = false;
+    int64_t bestScore1 = 0;
+    int64_t bestScore2 = 0;
+
+    for (const gfx::Rect& rc : m_rects) {
+      if (size.w > rc.w || size.h > rc.h)
+        continue;
+
+      const int64_t leftoverW = rc.w - size.w;
+      const int64_t leftoverH = rc.h - size.h;
+      int64_t score1, score2;
+      switch (heuristic) {
+        case Heuristic::BestLongSideFit:
+          score1 = std::max(leftoverW, leftoverH);
+          score2 = std::min(leftoverW, leftoverH);
+          break;
+        case Heuristic::BestAreaFit:
+          score1 = int64_t(rc.w)*rc.h - int64_t(size.w)*size.h;
+          score2 = std::min(leftoverW, leftoverH);
+          break;
+        case Heuristic::BottomLeft:
+          score1 = int64_t(rc.y) + size.h;
+          score2 = rc.x;
+          break;
+        case Heuristic::BestShortSideFit:
+        default:
+          score1 = std::min(leftoverW, leftoverH);
+          score2 = std::max(leftoverW, leftoverH);
+          break;
+      }
+
+      if (!found ||
+          score1 < bestScore1 ||
+          (score1 == bestScore1 && score2 < bestScore2)) {
+        found = true;
+        bestScore1 = score1;
+        bestScore2 = score2;
+        pos = rc.origin();
+      }
+    }
+    return found;
+  }
+
+  // Removes the given area from the free rectangles.
+  void place(const gfx::Rect& placed) {
+    std::vector<gfx::Rect> newRects;
+
+    // Split the free rectangles that intersect the placed one in
+    // (up to) four new maximal rectangles.
+    for (std::size_t i=0; i<m_rects.size(); ) {
+      const gfx::Rect rc = m_rects[i];
+      if (!rc.intersects(placed)) {
+        ++i;
+        continue;
+      }
+
+      m_rects[i] = m_rects.back();
+      m_rects.pop_back();
+
+      if (placed.x > rc.x)
+        newRects.push_back(gfx::Rect(rc.x, rc.y, placed.x - rc.x, rc.h));
+      if (placed.x2() < rc.x2())
+        newRects.push_back(gfx::Rect(placed.x2(), rc.y, rc.x2() - placed.x2(), rc.h));
+      if (placed.y > rc.y)
+        newRects.push_back(gfx::Rect(rc.x, rc.y, rc.w, placed.y - rc.y));
+      if (placed.y2() < rc.y2())
+        newRects.push_back(gfx::Rect(rc.x, placed.y2(), rc.w, rc.y2() - placed.y2()));
+    }
+
+    // Discard new rectangles contained in other ones. Old rectangles
+    // cannot be contained in the new ones (new rectangles are inside
+    // the removed ones, and old rectangles were maximal).
+    const std::size_t oldCount = m_rects.size();
+    for (std::size_t i=0; i<newRects.size(); ++i) {
+      const gfx::Rect& rc = newRects[i];
+      bool redundant = false;
+
+      for (std::size_t j=0; j<newRects.size() && !redundant; ++j) {
+        if (j != i &&
+            newRects[j].contains(rc) &&
+            (newRects[j] != rc || j < i)) // Keep one of equal rectangles
+          redundant = true;
+      }
+      for (std::size_t j=0; j<oldCount && !redundant; ++j) {
+        if (m_rects[j].contains(rc))
+          redundant = true;
+      }
+
+      if (!redundant)
+        m_rects.push_back(rc);
+    }
+  }
+
+private:
+  std::vector<gfx::Rect> m_rects;
+};
+
+} // anonymous namespace
+
+struct MaxRectsPacker::Result {
+  Rects rects;
+  int placed = 0;
+  gfx::Size textureSize;        // Available texture size
+  gfx::Size size;               // Used area of the texture
+
+  bool isBetterThan(const Result& other) const {
+    if (placed != other.placed)
+      return (placed > other.placed);
+
+    const int64_t area = int64_t(size.w) * size.h;
+    const int64_t otherArea = int64_t(other.size.w) * other.size.h;
+    if (area != otherArea)
+      return (area < otherArea);
+
+    // Prefer square textures
+    return (std::max(size.w, size.h) < std::max(other.size.w, other.size.h));
+  }
+};
+
+MaxRectsPacker::MaxRectsPacker(const int borderPadding,
+                               const int shapePadding)
+  : m_borderPadding(borderPadding)
+  , m_shapePadding(shapePadding)
+  , m_heuristic(Heuristic::Auto)
+{
+}
+
+void MaxRectsPacker::add(const gfx::Size& size)
+{
+  m_sizes.push_back(size);
+  m_rects.push_back(gfx::Rect(size));
+}
+
+gfx::Size MaxRectsPacker::bestFit(base::task_token& token,
+                                  const int fixedWidth,
+                                  const int fixedHeight)
+{
+  if (m_sizes.empty())
+    return gfx::Size(fixedWidth, fixedHeight);
+
+  // Total area and limits of the rectangles (including the shape
+  // padding of each one)
+  int64_t area = 0;
+  int maxW = 0;
+  int64_t sumW = 0, sumH = 0;
+  for (const gfx::Size& size : m_sizes) {
+    const int w = size.w + m_shapePadding;
+    const int h = size.h + m_shapePadding;
+    area += int64_t(w) * h;
+    maxW = std::max(maxW, w);
+    sumW += w;
+    sumH += h;
+  }
+
+  // Size of the texture borders (the shape padding of the last
+  // rectangle of each row/column is not needed)
+  const int borders = 2*m_borderPadding - m_shapePadding;
+
+  // Instead of trying to pack the rectangles in bigger textures
+  // each time until they fit, we pack them in textures with
+  // different widths and an unlimited height, and then we use the
+  // smallest used area.
+  std::vector<gfx::Size> textureSizes;
+  if (fixedWidth > 0 && fixedHeight > 0) {
+    textureSizes.push_back(gfx::Size(fixedWidth, fixedHeight));
+  }
+  else if (fixedWidth > 0) {
+    textureSizes.push_back(gfx::Size(fixedWidth, int(sumH) + borders));
+  }
+  else if (fixedHeight > 0) {
+    textureSizes.push_back(gfx::Size(int(sumW) + borders, fixedHeight));
+  }
+  else {
+    const double side = std::sqrt(double(area));
+    for (const double k : { 0.8, 0.9, 1.0, 1.1, 1.25, 1.5, 1.75, 2.0 }) {
+      const int w = std::max(maxW, int(std::ceil(side * k)));
+      textureSizes.push_back(gfx::Size(w + borders, int(sumH) + borders));
+    }
+  }
+
+  Result best;
+  if (m_heuristic == Heuristic::Auto && textureSizes.size() > 1) {
+    // First we find the best width using one heuristic, and then we
+    // try the other heuristics with that width only (trying all
+    // combinations was too slow for thousands of rectangles).
+    const std::vector<Heuristic> others = { Heuristic::BestLongSideFit,
+                                            Heuristic::BestAreaFit,
+                                            Heuristic::BottomLeft };
+    const int total = int(textureSizes.size() + others.size());
+
+    best = packBest(textureSizes, { Heuristic::BestShortSideFit },
+                    0, total, token);
+    Result other = packBest({ best.textureSize }, others,
+                            int(textureSizes.size()), total, token);
+    if (other.isBetterThan(best))
+      best = std::move(other);
+  }
+  else {
+    const std::vector<Heuristic> heuristics = this->heuristics();
+    best = packBest(textureSizes, heuristics,
+                    0, int(textureSizes.size() * heuristics.size()), token);
+  }
+  m_rects = std::move(best.rects);
+
+  gfx::Size size = best.size;
+  if (fixedWidth > 0)
+    size.w = fixedWidth;
+  if (fixedHeight > 0)
+    size.h = fixedHeight;
+  return size;
+}
+
+bool MaxRectsPacker::pack(const gfx::Size& size,
+                          base::task_token& token)
+{
+  const std::vector<Heuristic> heuristics = this->heuristics();
+  Result best = packBest({ size }, heuristics,
+                         0, int(heuristics.size()), token);
+  m_rects = std::move(best.rects);
+  return (best.placed == int(m_sizes.size()));
+}
+
+std::vector<MaxRectsPacker::Heuristic> MaxRectsPacker::heuristics() const
+{
+  if (m_heuristic == Heuristic::Auto) {
+    return { Heuristic::BestShortSideFit,
+             Heuristic::BestLongSideFit,
+             Heuristic::BestAreaFit,
+             Heuristic::BottomLeft };
+  }
+  else
+    return { m_heuristic };
+}
+
+MaxRectsPacker::Result MaxRectsPacker::packBest(
+  const std::vector<gfx::Size>& textureSizes,
+  const std::vector<Heuristic>& heuristics,
+  const int progressBase,
+  const int progressTotal,
+  base::task_token& token) const
+{
+  // Big rectangles first
+  std::vector<int> order(m_sizes.size());
+  for (int i=0; i<int(order.size()); ++i)
+    order[i] = i;
+  std::stable_sort(
+    order.begin(), order.end(),
+    [this](const int a, const int b) {
+      const gfx::Size& sa = m_sizes[a];
+      const gfx::Size& sb = m_sizes[b];
+      const int maxA = std::max(sa.w, sa.h);
+      const int maxB = std::max(sb.w, sb.h);
+      if (maxA != maxB)
+        return (maxA > maxB);
+      return (std::min(sa.w, sa.h) > std::min(sb.w, sb.h));
+    });
+
+  const int nheuristics = int(heuristics.size());
+  const int n = int(textureSizes.size()) * nheuristics;
+  std::vector<Result> results(n);
+  std::atomic<int> done(progressBase);
+  {
+    doc::TaskGroup tasks;
+    for (int i=0; i<n; ++i) {
+      tasks.run(
+        [this, i, nheuristics, progressTotal,
+         &textureSizes, &heuristics, &order, &results, &done, &token]
+        (base::task_token&){
+          packRects(textureSizes[i / nheuristics],
+                    heuristics[i % nheuristics],
+                    order, token, results[i]);
+          token.set_progress(float(++done) / progressTotal);
+        });
+    }
+    tasks.wait();
+  }
+
+  int best = 0;
+  for (int i=1; i<n; ++i) {
+    if (results[i].isBetterThan(results[best]))
+      best = i;
+  }
+  return std::move(results[best]);
+}
+
+void MaxRectsPacker::packRects(const gfx::Size& textureSize,
+                               const Heuristic heuristic,
+                               const std::vector<int>& order,
+                               base::task_token& token,
+                               Result& result) const
+{
+  // Rectangles that don't fit stay at the texture origin
+  result.rects.clear();
+  result.rects.reserve(m_sizes.size());
+  for (const gfx::Size& size : m_sizes)
+    result.rects.push_back(gfx::Rect(gfx::Point(m_borderPadding, m_borderPadding), size));
+  result.placed = 0;
+  result.textureSize = textureSize;
+  result.size = gfx::Size(0, 0);
+
+  // Each rectangle is packed with its shape padding at the
+  // right/bottom sides, so the available area includes the padding
+  // of the last row/column.
+  const gfx::Rect bounds(0, 0,
+                         textureSize.w - 2*m_borderPadding + m_shapePadding,
+                         textureSize.h - 2*m_borderPadding + m_shapePadding);
+  if (bounds.isEmpty())
+    return;
+
+  FreeRects freeRects(bounds);
+  gfx::Point usedPoint2(0, 0);
+
+  for (const int i : order) {
+    if (token.canceled())
+      return;
+
+    const gfx::Size size(m_sizes[i].w + m_shapePadding,
+                         m_sizes[i].h + m_shapePadding);
+    if (size.w <= 0 || size.h <= 0) {
+      ++result.placed;
+      continue;
+    }
+
+    gfx::Point pos;
+    if (!freeRects.findPosition(size, heuristic, pos))
+      continue;
+
+    freeRects.place(gfx::Rect(pos, size));
+
+    gfx::Rect& rc = result.rects[i];
+    rc.x = m_borderPadding + pos.x;
+    rc.y = m_borderPadding + pos.y;
+    usedPoint2.x = std::max(usedPoint2.x, rc.x2());
+    usedPoint2.y = std::max(usedPoint2.y, rc.y2());
+    ++result.placed;
+  }
+
+  result.size = gfx::Size(usedPoint2.x + m_borderPadding,
+                          usedPoint2.y + m_borderPadding);
+}
+
+} // namespace app
@@ -0,0 +1,95 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_MAX_RECTS_PACKER_H_INCLUDED
+#define APP_MAX_RECTS_PACKER_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace base {
+  class task_token;
+}
+
+namespace app {
+
+  // Packs rectangles in a texture using the MaxRects algorithm: a
+  // list of the maximal free rectangles of the texture is kept, and
+  // each rectangle is placed in the free rectangle chosen by the
+  // heuristic. It has the same interface as gfx::PackingRects.
+  class MaxRectsPacker {
+  public:
+    enum class Heuristic {
+      Auto,             // Try all the heuristics and use the best result
+      BestShortSideFit, // Minimize the shortest leftover side
+      BestLongSideFit,  // Minimize the longest leftover side
+      BestAreaFit,      // Minimize the leftover area
+      BottomLeft,       // Place each rectangle as top/left as possible
+    };
+
+    using Rects = std::vector<gfx::Rect>;
+    using const_iterator = Rects::const_iterator;
+
+    MaxRectsPacker(const int borderPadding = 0,
+                   const int shapePadding = 0);
+
+    Heuristic heuristic() const { return m_heuristic; }
+    void setHeuristic(const Heuristic heuristic) { m_heuristic = heuristic; }
+
+    std::size_t size() const { return m_rects.size(); }
+    bool empty() const { return m_rects.empty(); }
+    const_iterator begin() const { return m_rects.begin(); }
+    const_iterator end() const { return m_rects.end(); }
+    const gfx::Rect& operator[](const int i) const { return m_rects[i]; }
+
+    // Adds a new rectangle to be packed. Positions of the packed
+    // rectangles are in the same order they were added.
+    void add(const gfx::Size& size);
+
+    // Finds the smallest texture (in area) where all rectangles can
+    // be packed and returns its size. If fixedWidth or fixedHeight
+    // are specified, the texture will have that width or height.
+    gfx::Size bestFit(base::task_token& token,
+                      const int fixedWidth = 0,
+                      const int fixedHeight = 0);
+
+    // Packs the rectangles in a texture of the given size. Returns
+    // false if there is not enough space for all rectangles (the
+    // ones that don't fit are placed at the texture origin).
+    bool pack(const gfx::Size& size,
+              base::task_token& token);
+
+  private:
+    struct Result;
+
+    // Packs the rectangles in each of the given texture sizes with
+    // each heuristic (in parallel), and returns the best result.
+    Result packBest(const std::vector<gfx::Size>& textureSizes,
+                    const std::vector<Heuristic>& heuristics,
+                    const int progressBase,
+                    const int progressTotal,
+                    base::task_token& token) const;
+    void packRects(const gfx::Size& textureSize,
+                   const Heuristic heuristic,
+                   const std::vector<int>& order,
+                   base::task_token& token,
+                   Result& result) const;
+    std::vector<Heuristic> heuristics() const;
+
+    int m_borderPadding;
+    int m_shapePadding;
+    Heuristic m_heuristic;
+    std::vector<gfx::Size> m_sizes;
+    Rects m_rects;
+  };
+
+} // namespace app
+
+#endif
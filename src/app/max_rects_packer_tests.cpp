@@ -0,0 +1,116 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/max_rects_packer.h"
+#include "base/task.h"
+
+#include <cstdlib>
+
+using namespace app;
+
+namespace {
+
+using Heuristic = MaxRectsPacker::Heuristic;
+
+void expect_packed(const MaxRectsPacker& pr,
+                   const gfx::Size& textureSize,
+                   const int borderPadding,
+                   const int shapePadding)
+{
+  const gfx::Rect bounds =
+    gfx::Rect(textureSize).shrink(borderPadding);
+
+  for (int i=0; i<int(pr.size()); ++i) {
+    EXPECT_TRUE(bounds.contains(pr[i])) << "i=" << i;
+
+    const gfx::Rect a(pr[i].x, pr[i].y,
+                      pr[i].w+shapePadding, pr[i].h+shapePadding);
+    for (int j=i+1; j<int(pr.size()); ++j) {
+      const gfx::Rect b(pr[j].x, pr[j].y,
+                        pr[j].w+shapePadding, pr[j].h+shapePadding);
+      EXPECT_FALSE(a.intersects(b)) << "i=" << i << " j=" << j;
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(MaxRectsPacker, Simple)
+{
+  base::task_token token;
+  MaxRectsPacker pr;
+  pr.add(gfx::Size(256, 128));
+  pr.add(gfx::Size(128, 128));
+  pr.add(gfx::Size(128, 128));
+
+  EXPECT_TRUE(pr.pack(gfx::Size(256, 256), token));
+  expect_packed(pr, gfx::Size(256, 256), 0, 0);
+
+  EXPECT_FALSE(pr.pack(gfx::Size(256, 200), token));
+}
+
+TEST(MaxRectsPacker, BestFit)
+{
+  base::task_token token;
+  MaxRectsPacker pr;
+  for (int i=0; i<4; ++i)
+    pr.add(gfx::Size(32, 32));
+
+  EXPECT_EQ(gfx::Size(64, 64), pr.bestFit(token));
+  expect_packed(pr, gfx::Size(64, 64), 0, 0);
+}
+
+TEST(MaxRectsPacker, Padding)
+{
+  base::task_token token;
+  MaxRectsPacker pr(2, 1);
+  for (int i=0; i<4; ++i)
+    pr.add(gfx::Size(32, 32));
+
+  // 2 + 32 + 1 + 32 + 2
+  EXPECT_EQ(gfx::Size(69, 69), pr.bestFit(token));
+  expect_packed(pr, gfx::Size(69, 69), 2, 1);
+}
+
+TEST(MaxRectsPacker, FixedWidth)
+{
+  base::task_token token;
+  MaxRectsPacker pr;
+  for (int i=0; i<10; ++i)
+    pr.add(gfx::Size(10, 20));
+
+  const gfx::Size size = pr.bestFit(token, 50, 0);
+  EXPECT_EQ(gfx::Size(50, 40), size);
+  expect_packed(pr, size, 0, 0);
+}
+
+TEST(MaxRectsPacker, RandomSizes)
+{
+  std::srand(1);
+  for (const Heuristic heuristic : { Heuristic::Auto,
+                                     Heuristic::BestShortSideFit,
+                                     Heuristic::BestLongSideFit,
+                                     Heuristic::BestAreaFit,
+                                     Heuristic::BottomLeft }) {
+    base::task_token token;
+    MaxRectsPacker pr(1, 2);
+    pr.setHeuristic(heuristic);
+
+    int area = 0;
+    for (int i=0; i<200; ++i) {
+      const gfx::Size size(1 + std::rand() % 40,
+                           1 + std::rand() % 40);
+      pr.add(size);
+      area += size.w * size.h;
+    }
+
+    const gfx::Size size = pr.bestFit(token);
+    EXPECT_GE(size.w * size.h, area);
+    expect_packed(pr, size, 1, 2);
+  }
+}
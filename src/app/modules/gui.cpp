@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -723,8 +723,9 @@ bool CustomizedGuiManager::processKey(Message* msg)
     KeyContext::Normal
   };
   int n = (contexts[0] != contexts[1] ? 2: 1);
+  const Keys candidates = keys->keysFromKeyMessage(msg);
   for (int i = 0; i < n; ++i) {
-    for (const KeyPtr& key : *keys) {
+    for (const KeyPtr& key : candidates) {
       if (key->isPressed(msg, *keys, contexts[i])) {
         // Cancel menu-bar loops (to close any popup menu)
         app->mainWindow()->getMenuBar()->cancelMenuLoop();
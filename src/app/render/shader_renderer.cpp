@@ -15,11 +15,16 @@
 #include "app/color_utils.h"
 #include "app/util/shader_helpers.h"
 #include "doc/render_plan.h"
+#include "doc/tileset.h"
 #include "os/skia/skia_surface.h"
 
 #include "include/core/SkCanvas.h"
 #include "include/effects/SkRuntimeEffect.h"
 
+#include <algorithm>
+#include <cmath>
+#include <string>
+
 namespace app {
 
 using namespace doc;
@@ -55,6 +60,80 @@ half4 main(vec2 fragcoord) {
 }
 )";
 
+// Functions to sample a tile from the tileset atlas (iAtlas) for
+// each color mode, used by kTilemapShaderCode.
+const char* kTilemapRgbSampler = R"(
+uniform shader iAtlas;
+
+half4 sampleTile(float2 p) {
+ return iAtlas.eval(p);
+}
+)";
+
+const char* kTilemapGrayscaleSampler = R"(
+uniform shader iAtlas;
+
+half4 sampleTile(float2 p) {
+ half4 c = iAtlas.eval(p);
+ return half4(c.rrr * c.g, c.g);
+}
+)";
+
+const char* kTilemapIndexedSampler = R"(
+uniform shader iAtlas;
+uniform shader iPal;
+
+half4 sampleTile(float2 p) {
+ int index = int(255.0 * iAtlas.eval(p).a);
+ return iPal.eval(half2(index, 0));
+}
+)";
+
+// Draws a tilemap where each pixel of iMap is a doc::tile_t (its four
+// RGBA bytes) and the tiles are located in a tileset atlas of
+// iAtlasCols columns. Flip flags are applied in the same order as
+// in render::composite_image_general_with_tile_flags().
+const char* kTilemapShaderCode = R"(
+uniform shader iMap;
+uniform float2 iTileSize;
+uniform float iAtlasCols;
+uniform float iTilesetSize;
+
+half4 main(float2 fragcoord) {
+ float2 tilePos = floor(fragcoord / iTileSize);
+ half4 t = iMap.eval(tilePos + 0.5);
+ float r = floor(255.0 * t.r + 0.5);
+ float g = floor(255.0 * t.g + 0.5);
+ float b = floor(255.0 * t.b + 0.5);
+ float a = floor(255.0 * t.a + 0.5);
+ float index = r + 256.0*g + 65536.0*b + 16777216.0*mod(a, 32.0);
+
+ // doc::notile or a tile outside the tileset
+ if (r+g+b+a == 0.0 || index >= iTilesetSize)
+  return half4(0);
+
+ float2 p = floor(fragcoord - tilePos*iTileSize);
+ if (a >= 128.0)                // tile_f_xflip
+  p.x = iTileSize.x - 1.0 - p.x;
+ if (mod(a, 128.0) >= 64.0)     // tile_f_yflip
+  p.y = iTileSize.y - 1.0 - p.y;
+ if (mod(a, 64.0) >= 32.0) {    // tile_f_dflip
+  p = p.yx;
+  float m = min(iTileSize.x, iTileSize.y);
+  if (p.x >= m || p.y >= m)
+   return half4(0);
+ }
+
+ float row = floor((index + 0.5) / iAtlasCols);
+ float col = index - row*iAtlasCols;
+ return sampleTile(float2(col, row)*iTileSize + p + 0.5);
+}
+)";
+
+// Maximum width/height of a tileset atlas texture (bigger
+// tilesets are rendered tile by tile)
+const int kMaxAtlasSize = 8192;
+
 inline SkBlendMode to_skia(const doc::BlendMode bm) {
   switch (bm) {
     case doc::BlendMode::NORMAL: return SkBlendMode::kSrcOver;
@@ -90,6 +169,12 @@ ShaderRenderer::ShaderRenderer()
   m_bgEffect = make_shader(kBgShaderCode);
   m_indexedEffect = make_shader(kIndexedShaderCode);
   m_grayscaleEffect = make_shader(kGrayscaleShaderCode);
+  m_tilemapEffects[int(ColorMode::RGB)] =
+    make_shader((std::string(kTilemapRgbSampler) + kTilemapShaderCode).c_str());
+  m_tilemapEffects[int(ColorMode::GRAYSCALE)] =
+    make_shader((std::string(kTilemapGrayscaleSampler) + kTilemapShaderCode).c_str());
+  m_tilemapEffects[int(ColorMode::INDEXED)] =
+    make_shader((std::string(kTilemapIndexedSampler) + kTilemapShaderCode).c_str());
 }
 
 ShaderRenderer::~ShaderRenderer() = default;
@@ -197,20 +282,24 @@ void ShaderRenderer::renderSprite(os::Surface* dstSurface,
   SkCanvas* canvas = &static_cast<os::SkiaSurface*>(dstSurface)->canvas();
   canvas->save();
   {
+    // Only the given area is rendered (e.g. parts of the preview
+    // image outside this area might not be uploaded to its texture)
+    const SkRect dstRect = SkRect::MakeXYWH(area.dst.x, area.dst.y, area.size.w, area.size.h);
+    canvas->clipRect(dstRect);
+
     SkPaint p;
     p.setStyle(SkPaint::kFill_Style);
     p.setColor(SK_ColorTRANSPARENT);
     p.setBlendMode(SkBlendMode::kSrc);
-    canvas->drawRect(SkRect::MakeXYWH(area.dst.x, area.dst.y, area.size.w, area.size.h), p);
+    canvas->drawRect(dstRect, p);
 
     // Draw cels
     canvas->translate(area.dst.x - area.src.x,
                       area.dst.y - area.src.y);
     canvas->scale(m_proj.scaleX(), m_proj.scaleY());
 
-    RenderPlan plan;
-    plan.addLayer(sprite->root(), frame);
-    renderPlan(canvas, sprite, plan, frame, area);
+    const RenderPlanPtr plan = sprite->renderPlan(sprite->root(), frame);
+    renderPlan(canvas, sprite, *plan, frame, area);
   }
   canvas->restore();
 }
@@ -233,6 +322,9 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
         if (cel) {
           const doc::Image* celImage = nullptr;
           gfx::RectF celBounds;
+          // Pixels of the preview image that might be modified
+          gfx::Rect previewDirtyBounds;
+          const gfx::Rect* dirtyBounds = nullptr;
 
           // Is the 'm_previewImage' set to be used with this layer?
           if (m_previewImage &&
@@ -242,6 +334,15 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
                                    m_previewPos.y,
                                    m_previewImage->width(),
                                    m_previewImage->height());
+
+            // The preview image is modified directly (without
+            // changing its version) by the tool loop, so we upload
+            // the pixels of the rendered area each time.
+            const gfx::Clip iarea(area);
+            previewDirtyBounds = m_proj.remove(gfx::Rect(iarea.src, iarea.size));
+            previewDirtyBounds.enlarge(1);
+            previewDirtyBounds.offset(-m_previewPos);
+            dirtyBounds = &previewDirtyBounds;
           }
           // If not, we use the original cel-image from the images' stock
           else {
@@ -261,7 +362,8 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
                     celBounds.x,
                     celBounds.y,
                     opacity,
-                    imgLayer->blendMode());
+                    imgLayer->blendMode(),
+                    dirtyBounds);
         }
         break;
       }
@@ -281,8 +383,10 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
 
         // Is the 'm_previewTileset' set to be used with this layer?
         const Tileset* tileset;
-        if (m_previewTileset && cel &&
-            checkIfWeShouldUsePreview(cel)) {
+        const bool isPreviewTileset =
+          (m_previewTileset && cel &&
+           checkIfWeShouldUsePreview(cel));
+        if (isPreviewTileset) {
           tileset = m_previewTileset;
         }
         else {
@@ -292,6 +396,20 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
             return;
         }
 
+        int t;
+        int opacity = cel->opacity();
+        opacity = MUL_UN8(opacity, tilemapLayer->opacity(), t);
+
+        // Draw the whole tilemap with one shader using a tileset
+        // atlas. The tiles of the preview tileset are modified
+        // directly, so they are drawn tile by tile (uploading them
+        // each time).
+        if (!isPreviewTileset &&
+            drawTilemap(canvas, celImage, tileset, grid,
+                        opacity, tilemapLayer->blendMode())) {
+          break;
+        }
+
         const gfx::Clip iarea(area);
         gfx::Rect tilesToDraw = grid.canvasToTile(
           m_proj.remove(gfx::Rect(iarea.src, iarea.size)));
@@ -324,16 +442,14 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
               if (!tileImage)
                 continue;
 
-              int t;
-              int opacity = cel->opacity();
-              opacity = MUL_UN8(opacity, tilemapLayer->opacity(), t);
-
+              const gfx::Rect tileDirtyBounds = tileImage->bounds();
               drawImage(canvas,
                         tileImage.get(),
                         tileBoundsOnCanvas.x,
                         tileBoundsOnCanvas.y,
                         opacity,
-                        tilemapLayer->blendMode());
+                        tilemapLayer->blendMode(),
+                        isPreviewTileset ? &tileDirtyBounds: nullptr);
             }
           }
         }
@@ -404,9 +520,12 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
                                const int x,
                                const int y,
                                const int opacity,
-                               const doc::BlendMode blendMode)
+                               const doc::BlendMode blendMode,
+                               const gfx::Rect* dirtyBounds)
 {
-  auto skImg = make_skimage_for_docimage(srcImage);
+  auto skImg = m_textures.image(canvas, srcImage, dirtyBounds);
+  if (!skImg)
+    return;
 
   switch (srcImage->colorMode()) {
 
@@ -444,16 +563,7 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
     case doc::ColorMode::INDEXED: {
       // Use the palette data as an "width x height" image where
       // width=number of palette colors, and height=1
-      const size_t palSize = sizeof(color_t) * m_palette.size();
-      auto skPalData = SkData::MakeWithoutCopy(
-        (const void*)m_palette.rawColorsData(),
-        palSize);
-      auto skPal = SkImage::MakeRasterData(
-        SkImageInfo::Make(m_palette.size(), 1,
-                          kRGBA_8888_SkColorType,
-                          kUnpremul_SkAlphaType),
-        skPalData,
-        palSize);
+      auto skPal = m_textures.palette(canvas, &m_palette);
 
       SkRuntimeShaderBuilder builder(m_indexedEffect);
       builder.child("iImg") = skImg->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
@@ -477,6 +587,140 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
   }
 }
 
+bool ShaderRenderer::drawTilemap(SkCanvas* canvas,
+                                 const doc::Image* tilemapImage,
+                                 const doc::Tileset* tileset,
+                                 const doc::Grid& grid,
+                                 const int opacity,
+                                 const doc::BlendMode blendMode)
+{
+  // Only orthogonal grids are supported by the shader
+  const gfx::Size tileSize = grid.tileSize();
+  if (tileSize.w < 1 || tileSize.h < 1 ||
+      grid.tileOffset() != gfx::Point(tileSize.w, tileSize.h) ||
+      grid.oddRowOffset() != gfx::Point(0, 0) ||
+      grid.oddColOffset() != gfx::Point(0, 0))
+    return false;
+
+  const ColorMode colorMode = m_sprite->colorMode();
+  if (colorMode != ColorMode::RGB &&
+      colorMode != ColorMode::GRAYSCALE &&
+      colorMode != ColorMode::INDEXED)
+    return false;
+
+  gfx::Rect dirtyBounds;
+  const TilesetAtlas* atlas = updateTilesetAtlas(tileset, dirtyBounds);
+  if (!atlas)
+    return false;
+
+  auto skMap = m_textures.image(canvas, tilemapImage);
+  auto skAtlas = m_textures.image(canvas, atlas->image.get(),
+                                  dirtyBounds.isEmpty() ? nullptr: &dirtyBounds);
+  if (!skMap || !skAtlas)
+    return false;
+
+  SkRuntimeShaderBuilder builder(m_tilemapEffects[int(colorMode)]);
+  builder.child("iMap") = skMap->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
+  if (colorMode == ColorMode::RGB)
+    builder.child("iAtlas") = skAtlas->makeShader(SkSamplingOptions(SkFilterMode::kNearest));
+  else
+    builder.child("iAtlas") = skAtlas->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
+  if (colorMode == ColorMode::INDEXED) {
+    auto skPal = m_textures.palette(canvas, &m_palette);
+    builder.child("iPal") = skPal->makeShader(SkSamplingOptions(SkFilterMode::kNearest));
+  }
+  builder.uniform("iTileSize") = SkV2{ float(tileSize.w), float(tileSize.h) };
+  builder.uniform("iAtlasCols") = float(atlas->cols);
+  builder.uniform("iTilesetSize") = float(atlas->tiles.size());
+
+  SkPaint p;
+  p.setAlpha(opacity);
+  p.setBlendMode(to_skia(blendMode));
+  p.setStyle(SkPaint::kFill_Style);
+  p.setShader(builder.makeShader());
+
+  canvas->save();
+  canvas->translate(
+    SkIntToScalar(grid.origin().x),
+    SkIntToScalar(grid.origin().y));
+  canvas->drawRect(
+    SkRect::MakeWH(tilemapImage->width() * tileSize.w,
+                   tilemapImage->height() * tileSize.h), p);
+  canvas->restore();
+  return true;
+}
+
+const ShaderRenderer::TilesetAtlas*
+ShaderRenderer::updateTilesetAtlas(const doc::Tileset* tileset,
+                                   gfx::Rect& dirtyBounds)
+{
+  const int ntiles = int(tileset->size());
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const PixelFormat pixelFormat = m_sprite->pixelFormat();
+  const int cols = std::max(1, int(std::ceil(std::sqrt(double(ntiles)))));
+  const int rows = std::max(1, (ntiles + cols - 1) / cols);
+
+  if (ntiles < 1 ||
+      cols * tileSize.w > kMaxAtlasSize ||
+      rows * tileSize.h > kMaxAtlasSize)
+    return nullptr;
+
+  auto it = std::find_if(m_atlases.begin(), m_atlases.end(),
+                         [tileset](const TilesetAtlas& atlas){
+                           return (atlas.tilesetId == tileset->id());
+                         });
+  if (it == m_atlases.end()) {
+    // Keep only the most recently created atlases
+    if (m_atlases.size() >= kMaxAtlases)
+      m_atlases.pop_back();
+    m_atlases.insert(m_atlases.begin(), TilesetAtlas());
+    it = m_atlases.begin();
+    it->tilesetId = tileset->id();
+  }
+  TilesetAtlas& atlas = *it;
+
+  // Create a new atlas image if the tileset size changed
+  if (!atlas.image ||
+      atlas.image->pixelFormat() != pixelFormat ||
+      atlas.tileSize != tileSize ||
+      int(atlas.tiles.size()) != ntiles) {
+    atlas.image.reset(Image::create(pixelFormat,
+                                    cols * tileSize.w,
+                                    rows * tileSize.h));
+    atlas.image->clear(0);
+    atlas.tileSize = tileSize;
+    atlas.cols = cols;
+    atlas.tiles.assign(ntiles, TilesetAtlas::Tile());
+    dirtyBounds = atlas.image->bounds();
+  }
+
+  // Copy the modified tiles to the atlas
+  for (int i=0; i<ntiles; ++i) {
+    const ImageRef tileImage = tileset->get(i);
+    TilesetAtlas::Tile tile;
+    if (tileImage) {
+      tile.id = tileImage->id();
+      tile.version = tileImage->version();
+    }
+    if (tile.id == atlas.tiles[i].id &&
+        tile.version == atlas.tiles[i].version)
+      continue;
+
+    const gfx::Rect bounds((i % cols) * tileSize.w,
+                           (i / cols) * tileSize.h,
+                           tileSize.w, tileSize.h);
+    atlas.image->fillRect(bounds.x, bounds.y,
+                          bounds.x2()-1, bounds.y2()-1, 0);
+    if (tileImage)
+      atlas.image->copy(tileImage.get(),
+                        gfx::Clip(bounds.origin(), tileImage->bounds()));
+
+    atlas.tiles[i] = tile;
+    dirtyBounds |= bounds;
+  }
+  return &atlas;
+}
+
 // TODO this is equal to Render::checkIfWeShouldUsePreview(const Cel*),
 //      we might think in a way to merge both functions
 bool ShaderRenderer::checkIfWeShouldUsePreview(const doc::Cel* cel) const
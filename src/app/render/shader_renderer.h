@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,14 +11,23 @@
 #if SK_ENABLE_SKSL
 
 #include "app/render/renderer.h"
+#include "app/render/texture_cache.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "doc/palette.h"
+#include "gfx/size.h"
 
 #include "include/core/SkRefCnt.h"
 
+#include <cstddef>
+#include <vector>
+
 class SkCanvas;
 class SkRuntimeEffect;
 
 namespace doc {
+  class Grid;
   class RenderPlan;
 }
 
@@ -86,7 +95,35 @@ namespace app {
                    const int x,
                    const int y,
                    const int opacity,
-                   const doc::BlendMode blendMode);
+                   const doc::BlendMode blendMode,
+                   const gfx::Rect* dirtyBounds = nullptr);
+
+    bool drawTilemap(SkCanvas* canvas,
+                     const doc::Image* tilemapImage,
+                     const doc::Tileset* tileset,
+                     const doc::Grid& grid,
+                     const int opacity,
+                     const doc::BlendMode blendMode);
+
+    // All the tiles of a tileset in one image to draw tilemaps with
+    // one shader.
+    struct TilesetAtlas {
+      struct Tile {
+        doc::ObjectId id = 0;
+        doc::ObjectVersion version = 0;
+      };
+      doc::ObjectId tilesetId = 0;
+      doc::ImageRef image;
+      gfx::Size tileSize;
+      int cols = 0;
+      std::vector<Tile> tiles; // Copied tiles (to know which ones were modified)
+    };
+
+    // Returns the atlas of the given tileset (or nullptr if it's too
+    // big) copying the modified tiles to it, "dirtyBounds" is the
+    // modified area of the atlas image.
+    const TilesetAtlas* updateTilesetAtlas(const doc::Tileset* tileset,
+                                           gfx::Rect& dirtyBounds);
 
     bool checkIfWeShouldUsePreview(const doc::Cel* cel) const;
     void afterBackgroundLayerIsPainted();
@@ -97,6 +134,8 @@ namespace app {
     sk_sp<SkRuntimeEffect> m_bgEffect;
     sk_sp<SkRuntimeEffect> m_indexedEffect;
     sk_sp<SkRuntimeEffect> m_grayscaleEffect;
+    // Tilemap effects for each color mode (RGB, GRAYSCALE, INDEXED)
+    sk_sp<SkRuntimeEffect> m_tilemapEffects[3];
     const doc::Sprite* m_sprite = nullptr;
     const doc::LayerImage* m_bgLayer = nullptr;
     // TODO these members are the same as in render::Render, we should
@@ -111,6 +150,14 @@ namespace app {
     // Palette of 256 colors (useful for the indexed shader to set all
     // colors outside the valid range as transparent RGBA=0 values)
     doc::Palette m_palette;
+
+    // Cel/tile images and palette kept in GPU textures
+    TextureCache m_textures;
+
+    // Atlases of the recently rendered tilesets (the most recently
+    // used first)
+    static constexpr std::size_t kMaxAtlases = 8;
+    std::vector<TilesetAtlas> m_atlases;
   };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,6 +10,7 @@
 
 #include "app/render/simple_renderer.h"
 
+#include "app/doc.h"
 #include "app/ui/editor/editor_render.h"
 #include "app/util/conversion_to_surface.h"
 
@@ -20,6 +21,8 @@ using namespace doc;
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
+  m_render.setParallel(true);
+  m_render.setMipmapCache(EditorRender::getMipmapCache());
 }
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
@@ -102,6 +105,11 @@ void SimpleRenderer::renderSprite(os::Surface* dstSurface,
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
+
+  // Use the cache of the document, so all editors showing the same
+  // document share the composited tiles.
+  auto doc = static_cast<Doc*>(sprite->document());
+  m_render.setCompositeCache(doc ? doc->compositeCache(): nullptr);
   m_render.renderSprite(dstImage.get(), sprite, frame, area);
 
   convert_image_to_surface(dstImage.get(), sprite->palette(frame),
@@ -0,0 +1,248 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/render/texture_cache.h"
+
+#if SK_ENABLE_SKSL
+
+#include "app/util/shader_helpers.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+
+#include "include/core/SkBitmap.h"
+#include "include/core/SkCanvas.h"
+#include "include/core/SkData.h"
+#include "include/core/SkPixmap.h"
+
+#if SK_SUPPORT_GPU
+  #include "include/gpu/GrDirectContext.h"
+  #include "include/gpu/GrRecordingContext.h"
+#endif
+
+#include <algorithm>
+
+namespace app {
+
+using namespace doc;
+
+TextureCache::TextureCache(const std::size_t maxBytes)
+  : m_context(nullptr)
+  , m_bytes(0)
+  , m_maxBytes(maxBytes)
+  , m_paletteSize(0)
+{
+}
+
+TextureCache::~TextureCache() = default;
+
+sk_sp<SkImage> TextureCache::image(SkCanvas* canvas,
+                                   const doc::Image* image,
+                                   const gfx::Rect* dirtyBounds)
+{
+  if (!setContext(canvas))
+    return make_skimage_for_docimage(image);
+
+#if SK_SUPPORT_GPU
+  const ObjectId id = image->id();
+  const ObjectVersion version = image->version();
+  const ImageSpec spec = image->spec();
+
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    if (it->id != id)
+      continue;
+
+    if (it->version == version && it->spec == spec) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      if (dirtyBounds) {
+        const gfx::Rect bounds = (*dirtyBounds & image->bounds());
+        if (!bounds.isEmpty()) {
+          if (it->surface)
+            upload(it->surface.get(), image, bounds);
+          else if (auto texture = makeTexture(image))
+            it->texture = texture;
+        }
+      }
+      if (it->surface)
+        return it->surface->makeImageSnapshot();
+      else
+        return it->texture;
+    }
+
+    // The image was modified, we'll create a new texture
+    m_bytes -= it->bytes;
+    m_entries.erase(it);
+    break;
+  }
+
+  SkImageInfo info = get_skimageinfo_for_docimage(image);
+  const std::size_t bytes = info.computeMinByteSize();
+  sk_sp<SkSurface> surface;
+  sk_sp<SkImage> texture;
+
+  if (image->pixelFormat() == IMAGE_TILEMAP) {
+    texture = makeTexture(image);
+  }
+  else {
+    // Render targets cannot be unpremultiplied, RGBA pixels are
+    // premultiplied by writePixels()
+    if (info.alphaType() == kUnpremul_SkAlphaType &&
+        info.colorType() == kRGBA_8888_SkColorType)
+      info = info.makeAlphaType(kPremul_SkAlphaType);
+
+    surface = SkSurface::MakeRenderTarget(m_context, SkBudgeted::kYes, info);
+    if (surface)
+      upload(surface.get(), image, image->bounds());
+    // The GPU doesn't support this color type as render target
+    else
+      texture = makeTexture(image);
+  }
+
+  if (!surface && !texture)
+    return make_skimage_for_docimage(image);
+
+  m_entries.push_front(Entry{ id, version, spec, surface, texture, bytes });
+  m_bytes += bytes;
+  shrink();
+
+  if (surface)
+    return surface->makeImageSnapshot();
+  else
+    return texture;
+#else
+  return make_skimage_for_docimage(image);
+#endif
+}
+
+sk_sp<SkImage> TextureCache::palette(SkCanvas* canvas,
+                                     const doc::Palette* palette)
+{
+  const bool gpu = setContext(canvas);
+  const int size = std::min(palette->size(), int(m_paletteColors.size()));
+
+  if (m_paletteImage &&
+      m_paletteSize == size &&
+      std::equal(m_paletteColors.begin(),
+                 m_paletteColors.begin()+size,
+                 palette->rawColorsData())) {
+    return m_paletteImage;
+  }
+
+  std::copy(palette->rawColorsData(),
+            palette->rawColorsData()+size,
+            m_paletteColors.begin());
+  m_paletteSize = size;
+
+  // Use the palette data as an "width x height" image where
+  // width=number of palette colors, and height=1
+  const size_t palSize = sizeof(color_t) * size;
+  m_paletteImage = SkImage::MakeRasterData(
+    SkImageInfo::Make(size, 1,
+                      kRGBA_8888_SkColorType,
+                      kUnpremul_SkAlphaType),
+    SkData::MakeWithCopy(m_paletteColors.data(), palSize),
+    palSize);
+
+#if SK_SUPPORT_GPU
+  if (gpu && m_paletteImage) {
+    if (GrDirectContext* direct = m_context->asDirectContext()) {
+      if (auto texture = m_paletteImage->makeTextureImage(direct))
+        m_paletteImage = texture;
+    }
+  }
+#endif
+
+  return m_paletteImage;
+}
+
+void TextureCache::clear()
+{
+  m_entries.clear();
+  m_bytes = 0;
+  m_paletteImage.reset();
+  m_paletteSize = 0;
+}
+
+bool TextureCache::setContext(SkCanvas* canvas)
+{
+#if SK_SUPPORT_GPU
+  GrRecordingContext* context = canvas->recordingContext();
+#else
+  GrRecordingContext* context = nullptr;
+#endif
+
+  // Textures cannot be used with other GPU contexts
+  if (m_context != context) {
+    clear();
+    m_context = context;
+  }
+  return (m_context != nullptr);
+}
+
+sk_sp<SkImage> TextureCache::makeTexture(const doc::Image* image)
+{
+#if SK_SUPPORT_GPU
+  GrDirectContext* direct = m_context->asDirectContext();
+  if (!direct)
+    return nullptr;
+
+  // Copy the pixels (the raster image cannot reference them
+  // directly if the image is tiled)
+  const SkImageInfo info = get_skimageinfo_for_docimage(image);
+  SkBitmap bitmap;
+  if (!bitmap.tryAllocPixels(info))
+    return nullptr;
+  for (int y=0; y<image->height(); ++y) {
+    std::copy_n(image->getPixelAddress(0, y),
+                info.minRowBytes(),
+                (uint8_t*)bitmap.getAddr(0, y));
+  }
+  bitmap.setImmutable();
+
+  return bitmap.asImage()->makeTextureImage(direct);
+#else
+  return nullptr;
+#endif
+}
+
+void TextureCache::upload(SkSurface* surface,
+                          const doc::Image* image,
+                          const gfx::Rect& bounds)
+{
+  const SkImageInfo info = get_skimageinfo_for_docimage(image);
+  const int rowBytes = image->rowBytes();
+
+  // Rows of tiled images aren't contiguous, so we upload runs of
+  // consecutive rows.
+  for (int y=bounds.y; y<bounds.y2(); ) {
+    const uint8_t* addr = image->getPixelAddress(bounds.x, y);
+    int h = 1;
+    while (y+h < bounds.y2() &&
+           image->getPixelAddress(bounds.x, y+h) == addr + h*rowBytes)
+      ++h;
+
+    surface->writePixels(
+      SkPixmap(info.makeWH(bounds.w, h), addr, rowBytes),
+      bounds.x, y);
+    y += h;
+  }
+}
+
+void TextureCache::shrink()
+{
+  // Remove the least recently used textures (but not the new one)
+  while (m_bytes > m_maxBytes && m_entries.size() > 1) {
+    m_bytes -= m_entries.back().bytes;
+    m_entries.pop_back();
+  }
+}
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
@@ -0,0 +1,111 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_RENDER_TEXTURE_CACHE_H_INCLUDED
+#define APP_RENDER_TEXTURE_CACHE_H_INCLUDED
+#pragma once
+
+#if SK_ENABLE_SKSL
+
+#include "doc/color.h"
+#include "doc/image_spec.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "gfx/rect.h"
+
+#include "include/core/SkImage.h"
+#include "include/core/SkRefCnt.h"
+#include "include/core/SkSurface.h"
+
+#include <array>
+#include <cstddef>
+#include <list>
+
+class GrRecordingContext;
+class SkCanvas;
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace app {
+
+  // Keeps the pixels of doc::Image objects in GPU textures so the
+  // ShaderRenderer doesn't need to upload all cel images each time
+  // the sprite is rendered. Textures are identified by the image ID
+  // and version, so an image modified through doc::Image functions
+  // (or a doc::cmd) is uploaded again completely.
+  //
+  // Images that are modified directly without changing their version
+  // (e.g. the preview image of the tool loop while the user is
+  // painting) can be used as "volatile" images: the given dirty
+  // bounds of the texture are uploaded each time the image is used.
+  //
+  // When the canvas isn't GPU-backed the images are wrapped as raster
+  // images (without copying their pixels) and nothing is cached.
+  class TextureCache {
+  public:
+    explicit TextureCache(const std::size_t maxBytes = 256*1024*1024);
+    ~TextureCache();
+
+    // Returns a Skia image with the pixels of the given image to be
+    // drawn in the given canvas. If "dirtyBounds" are specified (in
+    // image coordinates) the image is a volatile image and only
+    // those pixels are uploaded to the existent texture.
+    //
+    // RGB images are returned premultiplied when they are
+    // GPU-backed, other images must be sampled with raw shaders.
+    sk_sp<SkImage> image(SkCanvas* canvas,
+                         const doc::Image* image,
+                         const gfx::Rect* dirtyBounds = nullptr);
+
+    // Returns a "N x 1" image with the palette colors. The texture is
+    // uploaded again only if the colors are different.
+    sk_sp<SkImage> palette(SkCanvas* canvas,
+                           const doc::Palette* palette);
+
+    void clear();
+
+    std::size_t bytes() const { return m_bytes; }
+
+  private:
+    struct Entry {
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      doc::ImageSpec spec;
+      // Render target where the pixels are uploaded, or an immutable
+      // texture for images with raw data (tilemaps) that cannot be
+      // premultiplied to be stored in a render target.
+      sk_sp<SkSurface> surface;
+      sk_sp<SkImage> texture;
+      std::size_t bytes;
+    };
+
+    bool setContext(SkCanvas* canvas);
+    sk_sp<SkImage> makeTexture(const doc::Image* image);
+    void upload(SkSurface* surface,
+                const doc::Image* image,
+                const gfx::Rect& bounds);
+    void shrink();
+
+    // GPU context of the cached textures
+    GrRecordingContext* m_context;
+    std::list<Entry> m_entries; // The most recently used first
+    std::size_t m_bytes;
+    std::size_t m_maxBytes;
+
+    // Last uploaded palette
+    std::array<doc::color_t, 256> m_paletteColors;
+    int m_paletteSize;
+    sk_sp<SkImage> m_paletteImage;
+  };
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
+
+#endif
@@ -0,0 +1,96 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/render/shader_renderer.h"
+#include "app/render/simple_renderer.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+#include "os/surface.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+// Args: sprite size, number of layers, zoom
+template<typename RendererT>
+void BM_Renderer(benchmark::State& state) {
+  const int size = state.range(0);
+  const int nlayers = state.range(1);
+  const int zoom = state.range(2);
+
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, size, size)));
+  for (int i=0; i<nlayers; ++i) {
+    LayerImage* layer;
+    if (i == 0) {
+      layer = static_cast<LayerImage*>(spr->root()->firstLayer());
+    }
+    else {
+      layer = new LayerImage(spr.get());
+      spr->root()->addLayer(layer);
+      layer->addCel(new Cel(0, ImageRef(Image::create(IMAGE_RGB, size, size))));
+    }
+    doc::algorithm::random_image(layer->cel(0)->image());
+  }
+
+  render::BgOptions bg;
+  bg.type = render::BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+
+  RendererT renderer;
+  renderer.setBgOptions(bg);
+  renderer.setProjection(render::Projection(render::PixelRatio(1, 1),
+                                            render::Zoom(zoom, 1)));
+
+  const int w = size*zoom;
+  const gfx::Clip area(0, 0, 0, 0, w, w);
+  os::SurfaceRef surface = os::instance()->makeSurface(w, w);
+
+  auto renderSprite = [&]{
+    if (renderer.properties().renderBgOnScreen)
+      renderer.renderCheckeredBackground(surface.get(), spr.get(), area);
+    renderer.renderSprite(surface.get(), spr.get(), 0, gfx::ClipF(area));
+  };
+
+  // First render to calculate cached info (e.g. content hashes)
+  renderSprite();
+
+  while (state.KeepRunning())
+    renderSprite();
+
+  state.SetItemsProcessed(state.iterations() * w * w);
+}
+
+static void RendererArguments(benchmark::internal::Benchmark* b) {
+  b->ArgsProduct({ { 256, 1024 }, { 1, 10 }, { 1, 4 } })
+    ->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK_TEMPLATE(BM_Renderer, SimpleRenderer)->Apply(RendererArguments);
+#if SK_ENABLE_SKSL
+BENCHMARK_TEMPLATE(BM_Renderer, ShaderRenderer)->Apply(RendererArguments);
+#endif
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,8 @@
 #include "base/replace_string.h"
 #include "base/scoped_value.h"
 #include "base/string.h"
+#include "base/trim_string.h"
+#include "net/http_headers.h"
 #include "net/http_request.h"
 #include "net/http_response.h"
 #include "ver/info.h"
@@ -24,6 +26,61 @@
 
 namespace app {
 
+namespace {
+
+// Validators of a cached response saved in a "<filename>.cache" file
+// next to the downloaded file, so the next request can be a
+// conditional request (and the server can respond with a "304 Not
+// Modified" without a body).
+struct CacheValidators {
+  std::string etag;
+  std::string lastModified;
+
+  bool empty() const { return etag.empty() && lastModified.empty(); }
+};
+
+const char* kETag = "ETag";
+const char* kLastModified = "Last-Modified";
+
+CacheValidators load_cache_validators(const std::string& fn)
+{
+  CacheValidators validators;
+  std::ifstream input(FSTREAM_PATH(fn));
+  std::string line;
+  while (std::getline(input, line)) {
+    std::string::size_type i = line.find(':');
+    if (i == std::string::npos)
+      continue;
+
+    std::string name = line.substr(0, i);
+    std::string value;
+    base::trim_string(line.substr(i+1), value);
+    if (name == kETag)
+      validators.etag = value;
+    else if (name == kLastModified)
+      validators.lastModified = value;
+  }
+  return validators;
+}
+
+void save_cache_validators(const std::string& fn,
+                           const CacheValidators& validators)
+{
+  if (validators.empty()) {
+    if (base::is_file(fn))
+      base::delete_file(fn);
+    return;
+  }
+
+  std::ofstream output(FSTREAM_PATH(fn));
+  if (!validators.etag.empty())
+    output << kETag << ": " << validators.etag << "\n";
+  if (!validators.lastModified.empty())
+    output << kLastModified << ": " << validators.lastModified << "\n";
+}
+
+} // anonymous namespace
+
 HttpLoader::HttpLoader(const std::string& url)
   : m_url(url)
   , m_done(false)
@@ -60,15 +117,56 @@ void HttpLoader::threadHttpRequest()
     base::replace_string(fn, "&", "-");
     fn = base::join_path(dir, fn);
 
-    std::ofstream output(FSTREAM_PATH(fn), std::ofstream::binary);
+    const std::string cacheFn = fn + ".cache";
+    const std::string tmpFn = fn + ".tmp";
+
     m_request = new net::HttpRequest(m_url);
-    net::HttpResponse response(&output);
-    if (m_request->send(response) &&
-        response.status() == 200) {
+
+    // Send a conditional request if we've a previous response
+    if (base::is_file(fn) && base::is_file(cacheFn)) {
+      CacheValidators validators = load_cache_validators(cacheFn);
+      net::HttpHeaders headers;
+      if (!validators.etag.empty())
+        headers.setHeader("If-None-Match", validators.etag);
+      if (!validators.lastModified.empty())
+        headers.setHeader("If-Modified-Since", validators.lastModified);
+      m_request->setHeaders(headers);
+    }
+
+    // Download the body in a temporary file, so the cached file is
+    // kept intact if the server responds with 304 or an error.
+    int status = 0;
+    {
+      std::ofstream output(FSTREAM_PATH(tmpFn), std::ofstream::binary);
+      net::HttpResponse response(&output);
+      if (m_request->send(response)) {
+        status = response.status();
+        if (status == 200) {
+          CacheValidators validators;
+          validators.etag = response.headers().getHeader(kETag);
+          validators.lastModified = response.headers().getHeader(kLastModified);
+          save_cache_validators(cacheFn, validators);
+        }
+      }
+    }
+
+    if (status == 200) {
+      if (base::is_file(fn))
+        base::delete_file(fn);
+      base::move_file(tmpFn, fn);
       m_filename = fn;
     }
+    else {
+      if (base::is_file(tmpFn))
+        base::delete_file(tmpFn);
+
+      if (status == 304) {
+        LOG("HTTP: Using cached file %s\n", fn.c_str());
+        m_filename = fn;
+      }
+    }
 
-    LOG("HTTP: Response: %d\n", response.status());
+    LOG("HTTP: Response: %d\n", status);
   }
   catch (const std::exception& e) {
     LOG(ERROR, "HTTP: Unexpected exception sending http request: %s\n", e.what());
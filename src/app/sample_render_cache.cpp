@@ -0,0 +1,208 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/sample_render_cache.h"
+
+#include "doc/blend_internals.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/image_spec.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/render_plan.h"
+#include "doc/sprite.h"
+#include "gfx/clip.h"
+#include "render/composite_cache.h"
+#include "render/render.h"
+
+#include <functional>
+#include <iterator>
+#include <vector>
+
+namespace app {
+
+using namespace doc;
+
+struct SampleRenderCache::Key {
+  ObjectId spriteId;
+  frame_t frame;
+  ImageSpec spec;
+  const Palette* palette;
+  int paletteModifications;
+  // State of the rendered cels (in rendering order)
+  std::vector<render::CompositeCache::ItemState> items;
+
+  std::size_t hash;
+
+  Key(const Sprite* sprite, const frame_t frame)
+    : spriteId(sprite->id())
+    , frame(frame)
+    , spec(sprite->spec())
+    , palette(sprite->palette(frame))
+    , paletteModifications(palette->getModifications())
+    , hash(std::hash<ObjectId>()(spriteId) ^ frame) {
+  }
+
+  // Returns false if the render of the frame cannot be cached.
+  bool addItems(const Sprite* sprite) {
+    const RenderPlanPtr plan = sprite->renderPlan(sprite->root(), frame);
+    for (const auto& item : plan->items()) {
+      const Layer* layer = item.layer;
+      render::CompositeCache::ItemState state;
+      state.layer = layer;
+
+      // Reference layers aren't rendered in sprite sheets
+      if (layer->isReference()) {
+        items.push_back(state);
+        continue;
+      }
+
+      // Tiles can be modified without modifying the tilemap image,
+      // so we don't cache frames with tilemaps.
+      if (layer->type() != ObjectType::LayerImage)
+        return false;
+
+      const Cel* cel = (item.cel ? item.cel: layer->cel(frame));
+      state.cel = cel;
+      if (cel && cel->image()) {
+        const Image* image = cel->image();
+        const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+        int t;
+        state.image = image;
+        state.imageId = image->id();
+        state.imageVersion = image->version();
+        state.imageHash = image->contentHash();
+        state.celBounds = cel->bounds();
+        state.opacity = MUL_UN8(cel->opacity(), imgLayer->opacity(), t);
+        state.blendMode = imgLayer->blendMode();
+        state.palette = palette;
+        state.paletteModifications = paletteModifications;
+        hash = hash*31 + state.imageHash;
+      }
+      items.push_back(state);
+    }
+    return true;
+  }
+
+  bool operator==(const Key& o) const {
+    return (hash == o.hash &&
+            spriteId == o.spriteId &&
+            frame == o.frame &&
+            spec == o.spec &&
+            palette == o.palette &&
+            paletteModifications == o.paletteModifications &&
+            items == o.items);
+  }
+};
+
+struct SampleRenderCache::Entry {
+  Key key;
+  ImageRef image;
+  std::size_t bytes;
+};
+
+SampleRenderCache::SampleRenderCache(const std::size_t maxBytes)
+  : m_bytes(0)
+  , m_maxBytes(maxBytes)
+{
+}
+
+SampleRenderCache::~SampleRenderCache() = default;
+
+ImageRef SampleRenderCache::render(const Sprite* sprite,
+                                   const frame_t frame)
+{
+  Key key(sprite, frame);
+  if (!key.addItems(sprite))
+    return nullptr;
+
+  {
+    const std::lock_guard lock(m_mutex);
+    auto it = findEntry(key);
+    if (it != m_entries.end()) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->image;
+    }
+  }
+
+  // Render the frame without locking the cache (other threads can
+  // use the cache in the meantime).
+  ImageRef image(Image::create(sprite->spec()));
+  clear_image(image.get(), sprite->transparentColor());
+
+  render::Render render;
+  render.setParallel(true);
+  render.renderSprite(image.get(), sprite, frame,
+                      gfx::Clip(0, 0, image->bounds()));
+
+  const std::size_t bytes = std::size_t(image->rowBytes()) * image->height();
+  if (bytes > m_maxBytes)
+    return image;
+
+  const std::lock_guard lock(m_mutex);
+
+  // Other thread could have rendered the same frame
+  auto it = findEntry(key);
+  if (it != m_entries.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, it);
+    return it->image;
+  }
+
+  const std::size_t hash = key.hash;
+  m_entries.push_front(Entry{ std::move(key), image, bytes });
+  m_index.insert(std::make_pair(hash, m_entries.begin()));
+  m_bytes += bytes;
+  shrink();
+  return image;
+}
+
+void SampleRenderCache::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_index.clear();
+  m_bytes = 0;
+}
+
+std::size_t SampleRenderCache::bytes() const
+{
+  const std::lock_guard lock(m_mutex);
+  return m_bytes;
+}
+
+SampleRenderCache::Entries::iterator SampleRenderCache::findEntry(const Key& key)
+{
+  auto range = m_index.equal_range(key.hash);
+  for (auto it=range.first; it!=range.second; ++it) {
+    if (it->second->key == key)
+      return it->second;
+  }
+  return m_entries.end();
+}
+
+void SampleRenderCache::shrink()
+{
+  // Remove the least recently used renders (but not the new one)
+  while (m_bytes > m_maxBytes && m_entries.size() > 1) {
+    auto last = std::prev(m_entries.end());
+    auto range = m_index.equal_range(last->key.hash);
+    for (auto it=range.first; it!=range.second; ++it) {
+      if (it->second == last) {
+        m_index.erase(it);
+        break;
+      }
+    }
+    m_bytes -= last->bytes;
+    m_entries.erase(last);
+  }
+}
+
+} // namespace app
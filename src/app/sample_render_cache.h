@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SAMPLE_RENDER_CACHE_H_INCLUDED
+#define APP_SAMPLE_RENDER_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace doc {
+  class Sprite;
+}
+
+namespace app {
+
+  // Keeps the renders of the whole canvas of sprite frames used as
+  // samples by the DocExporter. Renders are identified by the state
+  // of each rendered cel (image ID, version, and content hash, cel
+  // bounds, opacity, etc.), so when a sprite sheet is exported again
+  // only the frames that were modified are rendered again.
+  //
+  // It can be used from several threads at the same time.
+  class SampleRenderCache {
+  public:
+    explicit SampleRenderCache(const std::size_t maxBytes = 128*1024*1024);
+    ~SampleRenderCache();
+
+    // Returns the render of the given frame with the current visible
+    // layers of the sprite, or nullptr if the frame cannot be cached
+    // (e.g. frames with tilemaps). The returned image must not be
+    // modified.
+    doc::ImageRef render(const doc::Sprite* sprite,
+                         const doc::frame_t frame);
+
+    void clear();
+
+    std::size_t bytes() const;
+
+  private:
+    struct Key;
+    struct Entry;
+    using Entries = std::list<Entry>;
+
+    Entries::iterator findEntry(const Key& key);
+    void shrink();
+
+    mutable std::mutex m_mutex;
+    Entries m_entries;          // The most recently used first
+    std::unordered_multimap<std::size_t, Entries::iterator> m_index;
+    std::size_t m_bytes;
+    std::size_t m_maxBytes;
+  };
+
+  using SampleRenderCachePtr = std::shared_ptr<SampleRenderCache>;
+
+} // namespace app
+
+#endif
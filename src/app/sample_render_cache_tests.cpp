@@ -0,0 +1,62 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/sample_render_cache.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+TEST(SampleRenderCache, RenderAgainModifiedFrames)
+{
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4)));
+  LayerImage* layer = static_cast<LayerImage*>(spr->root()->firstLayer());
+  Image* image = layer->cel(0)->image();
+  put_pixel(image, 1, 2, rgba(255, 0, 0, 255));
+
+  SampleRenderCache cache;
+  ImageRef a = cache.render(spr.get(), 0);
+  ASSERT_TRUE(a != nullptr);
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(a.get(), 1, 2));
+  EXPECT_EQ(a.get(), cache.render(spr.get(), 0).get());
+
+  put_pixel(image, 1, 2, rgba(0, 0, 255, 255));
+  image->incrementVersion();
+  ImageRef b = cache.render(spr.get(), 0);
+  EXPECT_NE(a.get(), b.get());
+  EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(b.get(), 1, 2));
+
+  layer->setVisible(false);
+  ImageRef c = cache.render(spr.get(), 0);
+  EXPECT_NE(b.get(), c.get());
+  EXPECT_EQ(0, rgba_geta(get_pixel(c.get(), 1, 2)));
+
+  layer->setVisible(true);
+  EXPECT_EQ(b.get(), cache.render(spr.get(), 0).get());
+}
+
+TEST(SampleRenderCache, MaxBytes)
+{
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4)));
+  spr->setTotalFrames(2);
+
+  SampleRenderCache cache(4*4*4);
+  cache.render(spr.get(), 0);
+  EXPECT_EQ(4*4*4, cache.bytes());
+  cache.render(spr.get(), 1);
+  EXPECT_EQ(4*4*4, cache.bytes());
+
+  cache.clear();
+  EXPECT_EQ(0, cache.bytes());
+}
@@ -10,6 +10,7 @@
 #endif
 
 #include "app/app.h"
+#include "app/commands/cmd_open_file.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
 #include "app/context.h"
@@ -46,19 +47,23 @@
 #include "doc/layer.h"
 #include "doc/primitives.h"
 #include "doc/tag.h"
+#include "doc/trace.h"
 #include "render/render.h"
 #include "ui/alert.h"
 #include "ui/scale.h"
 #include "ver/info.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <limits>
 
 namespace app {
 namespace script {
 
 int load_sprite_from_file(lua_State* L, const char* filename,
-                          const LoadSpriteFromFileParam param)
+                          const LoadSpriteFromFileParam param,
+                          const FileOpLoadROI* loadROI)
 {
   std::string absFn = base::get_absolute_path(filename);
   if (!ask_access(L, absFn.c_str(), FileAccessMode::Read, ResourceType::File))
@@ -68,14 +73,24 @@ int load_sprite_from_file(lua_State* L, const char* filename,
   app::Context* ctx = App::instance()->context();
   Doc* oldDoc = ctx->activeDocument();
 
-  Command* openCommand =
-    Commands::instance()->byId(CommandId::OpenFile());
   Params params;
   params.set("filename", absFn.c_str());
   if (param == LoadSpriteFromFileParam::OneFrameAsSprite ||
       param == LoadSpriteFromFileParam::OneFrameAsImage)
     params.set("oneframe", "true");
-  ctx->executeCommand(openCommand, params);
+
+  // The region of interest cannot be specified with params, so we
+  // use our own instance of the command
+  if (loadROI && !loadROI->isEmpty()) {
+    OpenFileCommand openCommand;
+    openCommand.setLoadROI(*loadROI);
+    ctx->executeCommand(&openCommand, params);
+  }
+  else {
+    Command* openCommand =
+      Commands::instance()->byId(CommandId::OpenFile());
+    ctx->executeCommand(openCommand, params);
+  }
 
   Doc* newDoc = ctx->activeDocument();
   if (newDoc != oldDoc) {
@@ -117,8 +132,54 @@ namespace {
 
 int App_open(lua_State* L)
 {
+  const char* filename = luaL_checkstring(L, 1);
+
+  // app.open(filename, { tag=string, fromFrame=int, toFrame=int,
+  //                      layers={ string, ... }, bounds=Rectangle })
+  // loads just the cels in the given frames/layers/area
+  FileOpLoadROI roi;
+  if (lua_istable(L, 2)) {
+    int type = lua_getfield(L, 2, "tag");
+    if (type == LUA_TSTRING)
+      roi.tagName = lua_tostring(L, -1);
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 2, "fromFrame");
+    if (type != LUA_TNIL)
+      roi.fromFrame = get_frame_number_from_arg(L, -1);
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 2, "toFrame");
+    if (type != LUA_TNIL)
+      roi.toFrame = get_frame_number_from_arg(L, -1);
+    lua_pop(L, 1);
+
+    // Just one end of the frame range
+    if (roi.fromFrame >= 0 || roi.toFrame >= 0) {
+      roi.fromFrame = std::max(roi.fromFrame, 0);
+      if (roi.toFrame < 0)
+        roi.toFrame = std::numeric_limits<doc::frame_t>::max();
+    }
+
+    type = lua_getfield(L, 2, "layers");
+    if (type == LUA_TTABLE) {
+      lua_pushnil(L);
+      while (lua_next(L, -2) != 0) {
+        if (const char* v = lua_tostring(L, -1))
+          roi.layers.push_back(v);
+        lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 2, "bounds");
+    if (type != LUA_TNIL)
+      roi.bounds = convert_args_into_rect(L, -1);
+    lua_pop(L, 1);
+  }
+
   return load_sprite_from_file(
-    L, luaL_checkstring(L, 1), LoadSpriteFromFileParam::FullAniAsSprite);
+    L, filename, LoadSpriteFromFileParam::FullAniAsSprite, &roi);
 }
 
 int App_exit(lua_State* L)
@@ -132,6 +193,24 @@ int App_exit(lua_State* L)
   return 0;
 }
 
+// Groups the UI updates of all the changes in a transaction (the
+// observers receive one onGeneralUpdate() notification at the end).
+class ScopedBatchUpdate {
+public:
+  ScopedBatchUpdate(Doc* doc)
+    : m_docId(doc ? doc->id(): doc::NullId) {
+    if (doc)
+      doc->beginBatchUpdate();
+  }
+  ~ScopedBatchUpdate() {
+    // The document could be closed in the transaction
+    if (Doc* doc = doc::get<Doc>(m_docId))
+      doc->endBatchUpdate();
+  }
+private:
+  doc::ObjectId m_docId;
+};
+
 int App_transaction(lua_State* L)
 {
   int top = lua_gettop(L);
@@ -162,6 +241,7 @@ int App_transaction(lua_State* L)
       // RWLock now is re-entrant and we are able to call commands
       // inside the app.transaction() (creating inner ContextWriters).
       ContextWriter writer(ctx);
+      ScopedBatchUpdate batchUpdate(writer.document());
       Tx tx(writer, label);
 
       lua_pushvalue(L, -1);
@@ -271,6 +351,29 @@ int App_refresh(lua_State* L)
   return 0;
 }
 
+// app.startTrace([eventsPerThread]) starts recording the trace
+// zones (e.g. from the developer console)
+int App_startTrace(lua_State* L)
+{
+  const lua_Integer n = luaL_optinteger(L, 1, lua_Integer(doc::kTraceEventsPerThread));
+  if (n < 1)
+    return luaL_error(L, "the number of events per thread must be greater than 0");
+  doc::trace_start(std::size_t(n));
+  return 0;
+}
+
+// app.stopTrace([filename]) stops recording and saves the zones as a
+// Chrome trace JSON file, returns false if the file cannot be saved
+int App_stopTrace(lua_State* L)
+{
+  doc::trace_stop();
+  if (const char* filename = lua_tostring(L, 1)) {
+    lua_pushboolean(L, doc::trace_save_chrome_json(filename));
+    return 1;
+  }
+  return 0;
+}
+
 int App_useTool(lua_State* L)
 {
   // First argument must be a table
@@ -825,6 +928,8 @@ const luaL_Reg App_methods[] = {
   { "alert",       App_alert },
   { "refresh",     App_refresh },
   { "useTool",     App_useTool },
+  { "startTrace",  App_startTrace },
+  { "stopTrace",   App_stopTrace },
   { nullptr,       nullptr }
 };
 
@@ -0,0 +1,111 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "app/script/profiler.h"
+#include "app/script/security.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+struct AppProfiler { };
+
+Profiler* get_profiler(lua_State* L)
+{
+  Engine* engine = App::instance()->scriptEngine();
+  if (!engine)
+    luaL_error(L, "the profiler is not available");
+  return engine->profiler();
+}
+
+int AppProfiler_start(lua_State* L)
+{
+  if (!get_profiler(L)->start())
+    return luaL_error(L, "the profiler cannot be started while the debugger is running");
+  return 0;
+}
+
+int AppProfiler_stop(lua_State* L)
+{
+  get_profiler(L)->stop();
+  return 0;
+}
+
+int AppProfiler_report(lua_State* L)
+{
+  const int maxFunctions = luaL_optinteger(L, 1, 50);
+  std::ostringstream os;
+  get_profiler(L)->writeReport(os, maxFunctions);
+  lua_pushstring(L, os.str().c_str());
+  return 1;
+}
+
+int AppProfiler_save(lua_State* L)
+{
+  const char* fn = luaL_checkstring(L, 1);
+  const std::string absFn = base::get_absolute_path(fn);
+  if (!ask_access(L, absFn.c_str(), FileAccessMode::Write, ResourceType::File))
+    return luaL_error(L, "script doesn't have access to write file %s",
+                      absFn.c_str());
+
+  std::ofstream f(FSTREAM_PATH(absFn), std::ios::binary);
+  if (!f)
+    return luaL_error(L, "cannot create file %s", absFn.c_str());
+
+  get_profiler(L)->writeFoldedStacks(f);
+  return 0;
+}
+
+int AppProfiler_get_isRunning(lua_State* L)
+{
+  lua_pushboolean(L, get_profiler(L)->isRunning());
+  return 1;
+}
+
+const Property AppProfiler_properties[] = {
+  { "isRunning", AppProfiler_get_isRunning, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+const luaL_Reg AppProfiler_methods[] = {
+  { "start", AppProfiler_start },
+  { "stop", AppProfiler_stop },
+  { "report", AppProfiler_report },
+  { "save", AppProfiler_save },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(AppProfiler);
+
+void register_app_profiler_object(lua_State* L)
+{
+  REG_CLASS(L, AppProfiler);
+  REG_CLASS_PROPERTIES(L, AppProfiler);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "profiler");
+  push_new<AppProfiler>(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
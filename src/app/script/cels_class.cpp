@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,6 +29,7 @@ namespace {
 
 struct CelsObj {
   ObjectIds cels;
+  ObjectVersion version = 0;  // Version of the layer (when cached)
   CelsObj(CelsRange& range) {
     for (const Cel* cel : range)
       cels.push_back(cel->id());
@@ -93,10 +94,32 @@ void push_cels(lua_State* L, Sprite* sprite)
 
 void push_cels(lua_State* L, Layer* layer)
 {
+  if (!layer->isImage()) {
+    push_new<CelsObj>(L, ObjectIds());
+    return;
+  }
+
+  // Reuse the previous list of cels if the layer wasn't modified
+  auto imgLayer = static_cast<LayerImage*>(layer);
+  push_docobj_cache(L, get_mtname<CelsObj>());
+  if (lua_rawgeti(L, -1, layer->id()) == LUA_TUSERDATA) {
+    auto obj = get_obj<CelsObj>(L, -1);
+    if (obj->version == layer->version() &&
+        int(obj->cels.size()) == imgLayer->getCelsCount()) {
+      lua_remove(L, -2);
+      return;
+    }
+  }
+  lua_pop(L, 1);
+
   CelList cels;
-  if (layer->isImage())
-    static_cast<LayerImage*>(layer)->getCels(cels);
-  push_new<CelsObj>(L, cels);
+  imgLayer->getCels(cels);
+  auto obj = push_new<CelsObj>(L, cels);
+  obj->version = layer->version();
+
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, -3, layer->id());
+  lua_remove(L, -2);
 }
 
 void push_cels(lua_State* L, const ObjectIds& cels)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -18,10 +18,39 @@ namespace script {
 // Functions to push/get doc:: objects from Lua stack with doc::ObjectId.
 // This can be used to avoid crashes accesing raw pointers.
 
+// Pushes a table with weak values stored in the registry with the
+// given key, used to cache userdata by object ID. The userdata is
+// reused while it's referenced from Lua (so traversing the same
+// objects several times doesn't allocate new userdata), and is
+// collected as usual when it's not referenced anymore.
+inline void push_docobj_cache(lua_State* L, const void* key) {
+  if (lua_rawgetp(L, LUA_REGISTRYINDEX, key) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+  }
+}
+
 template <typename T> void push_docobj(lua_State* L, doc::ObjectId id) {
+  push_docobj_cache(L, get_mtname<T>());
+  if (lua_rawgeti(L, -1, id) == LUA_TUSERDATA) {
+    lua_remove(L, -2);
+    return;
+  }
+  lua_pop(L, 1);
+
   new (lua_newuserdata(L, sizeof(doc::ObjectId))) doc::ObjectId(id);
   luaL_getmetatable(L, get_mtname<T>());
   lua_setmetatable(L, -2);
+
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, -3, id);
+  lua_remove(L, -2);
 }
 
 template <typename T> void push_docobj(lua_State* L, const T* obj) {
@@ -18,6 +18,7 @@
 #include "app/pref/preferences.h"
 #include "app/script/blend_mode.h"
 #include "app/script/luacpp.h"
+#include "app/script/profiler.h"
 #include "app/script/require.h"
 #include "app/script/security.h"
 #include "app/sprite_sheet_type.h"
@@ -31,13 +32,17 @@
 #include "doc/algorithm/flip_type.h"
 #include "doc/anidir.h"
 #include "doc/color_mode.h"
+#include "doc/trace.h"
 #include "filters/target.h"
 #include "fmt/format.h"
 #include "ui/base.h"
 #include "ui/cursor_type.h"
 #include "ui/mouse_button.h"
+#include "ui/system.h"
 
+#include <chrono>
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -161,6 +166,63 @@ int loadfile(lua_State *L)
   return orig_loadfile(L);
 }
 
+// Event handlers that were already reported as slow (to avoid
+// filling the console with the same warning)
+std::set<std::string> g_slowHandlers;
+
+void resume_event_handler(lua_State* L, lua_State* co, int coRef,
+                          int nargs, const std::string& handlerName,
+                          const std::function<void()>& onDone)
+{
+  Engine* engine = App::instance()->scriptEngine();
+  const int budget = Preferences::instance().scripts.handlerTimeBudget();
+  int status;
+
+  while (true) {
+    const auto t0 = std::chrono::steady_clock::now();
+    int nresults = 0;
+    status = lua_resume(co, L, nargs, &nresults);
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - t0).count();
+
+    if (budget > 0 && ms > budget &&
+        g_slowHandlers.insert(handlerName).second) {
+      engine->consolePrint(
+        fmt::format("Warning: {} took {} ms (budget: {} ms), "
+                    "use coroutine.yield() to split long tasks",
+                    handlerName, ms, budget).c_str());
+    }
+
+    if (status != LUA_YIELD)
+      break;
+
+    lua_pop(co, nresults);
+    nargs = 0;
+
+    // Continue the handler in the next iteration of the UI loop
+    if (App::instance()->isGui()) {
+      ui::execute_from_ui_thread(
+        [L, co, coRef, handlerName, onDone]{
+          // The engine could be destroyed (e.g. on exit)
+          App* app = App::instance();
+          if (app && app->scriptEngine() &&
+              app->scriptEngine()->luaState() == L) {
+            resume_event_handler(L, co, coRef, 0, handlerName, onDone);
+          }
+        });
+      return;
+    }
+  }
+
+  if (status != LUA_OK) {
+    if (const char* s = lua_tostring(co, -1))
+      engine->consolePrint(s);
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, coRef);
+  if (onDone)
+    onDone();
+}
+
 int os_clock(lua_State* L)
 {
   lua_pushnumber(L, luaClock.elapsed());
@@ -172,6 +234,7 @@ int os_clock(lua_State* L)
 void register_app_object(lua_State* L);
 void register_app_pixel_color_object(lua_State* L);
 void register_app_fs_object(lua_State* L);
+void register_app_profiler_object(lua_State* L);
 void register_app_os_object(lua_State* L);
 void register_app_command_object(lua_State* L);
 void register_app_preferences_object(lua_State* L);
@@ -193,6 +256,7 @@ void register_grid_class(lua_State* L);
 void register_image_class(lua_State* L);
 void register_image_iterator_class(lua_State* L);
 void register_image_spec_class(lua_State* L);
+void register_image_view_class(lua_State* L);
 void register_images_class(lua_State* L);
 void register_layer_class(lua_State* L);
 void register_layers_class(lua_State* L);
@@ -221,9 +285,32 @@ void register_tool_class(lua_State* L);
 void register_uuid_class(lua_State* L);
 void register_version_class(lua_State* L);
 void register_websocket_class(lua_State* L);
+void register_worker_class(lua_State* L);
 
 void set_app_params(lua_State* L, const Params& params);
 
+void call_event_handler(lua_State* L, int nargs,
+                        const char* handlerName,
+                        std::function<void()> onDone)
+{
+  // Identify the handler by its location in the warnings
+  lua_Debug ar;
+  lua_pushvalue(L, -nargs-1);
+  lua_getinfo(L, ">S", &ar);
+  const std::string name =
+    fmt::format("'{}' handler ({}:{})",
+                handlerName, ar.short_src, ar.linedefined);
+
+  // Move the function and its arguments to a new coroutine, which is
+  // kept in the registry until it finishes
+  lua_State* co = lua_newthread(L);
+  lua_insert(L, -nargs-2);
+  lua_xmove(L, co, nargs+1);
+  const int coRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  resume_event_handler(L, co, coRef, nargs, name, onDone);
+}
+
 Engine::Engine()
   : L(luaL_newstate())
   , m_delegate(nullptr)
@@ -265,6 +352,7 @@ Engine::Engine()
   register_app_object(L);
   register_app_pixel_color_object(L);
   register_app_fs_object(L);
+  register_app_profiler_object(L);
   register_app_os_object(L);
   register_app_command_object(L);
   register_app_preferences_object(L);
@@ -493,6 +581,7 @@ Engine::Engine()
   register_image_class(L);
   register_image_iterator_class(L);
   register_image_spec_class(L);
+  register_image_view_class(L);
   register_images_class(L);
   register_layer_class(L);
   register_layers_class(L);
@@ -520,6 +609,7 @@ Engine::Engine()
   register_tool_class(L);
   register_uuid_class(L);
   register_version_class(L);
+  register_worker_class(L);
 #if ENABLE_WEBSOCKET
   register_websocket_class(L);
 #endif
@@ -536,6 +626,7 @@ Engine::~Engine()
 void Engine::destroy()
 {
   close_all_dialogs();
+  m_profiler.reset();
   lua_close(L);
   L = nullptr;
 }
@@ -566,6 +657,8 @@ void Engine::printLastResult()
 bool Engine::evalCode(const std::string& code,
                       const std::string& filename)
 {
+  DOC_TRACE_ZONE("script eval");
+
   bool ok = true;
   try {
     if (luaL_loadbuffer(L, code.c_str(), code.size(), filename.c_str()) ||
@@ -658,6 +751,10 @@ bool Engine::evalUserFile(const std::string& filename,
 
 void Engine::startDebugger(DebuggerDelegate* debuggerDelegate)
 {
+  // The debugger replaces the hook of the profiler
+  if (m_profiler)
+    m_profiler->stop();
+
   g_debuggerDelegate = debuggerDelegate;
 
   lua_Hook hook = [](lua_State* L, lua_Debug* ar) {
@@ -676,6 +773,13 @@ void Engine::stopDebugger()
   lua_sethook(L, nullptr, 0, 0);
 }
 
+Profiler* Engine::profiler()
+{
+  if (!m_profiler)
+    m_profiler = std::make_unique<Profiler>(L);
+  return m_profiler.get();
+}
+
 void Engine::onConsoleError(const char* text)
 {
   if (text && m_delegate)
@@ -27,6 +27,7 @@
 #include <cstdio>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 
 struct lua_State;
@@ -62,6 +63,7 @@ namespace app {
 
   class Editor;
   class Site;
+  struct FileOpLoadROI;
 
   namespace tools {
     class Tool;
@@ -76,6 +78,8 @@ namespace app {
     virtual void onConsolePrint(const char* text) = 0;
   };
 
+  class Profiler;
+
   class DebuggerDelegate {
   public:
     virtual ~DebuggerDelegate() { }
@@ -123,6 +127,10 @@ namespace app {
     void startDebugger(DebuggerDelegate* debuggerDelegate);
     void stopDebugger();
 
+    // Returns the profiler of script functions (it's created the
+    // first time it's needed).
+    Profiler* profiler();
+
   private:
     void onConsoleError(const char* text);
     void onConsolePrint(const char* text);
@@ -131,6 +139,7 @@ namespace app {
     EngineDelegate* m_delegate;
     bool m_printLastResult;
     int m_returnCode;
+    std::unique_ptr<Profiler> m_profiler;
   };
 
   class ScopedEngineDelegate {
@@ -148,6 +157,16 @@ namespace app {
     EngineDelegate* m_oldDelegate;
   };
 
+  // Calls the function on the stack (below its "nargs" arguments) as
+  // an event handler. The function runs in a coroutine, so it can
+  // call coroutine.yield() to continue its work in the next iteration
+  // of the UI loop (onDone is called when the handler finishes). A
+  // warning is printed in the console when one step of the handler
+  // takes longer than the "scripts.handler_time_budget" milliseconds.
+  void call_event_handler(lua_State* L, int nargs,
+                          const char* handlerName,
+                          std::function<void()> onDone = nullptr);
+
   void push_app_events(lua_State* L);
   void push_app_theme(lua_State* L, int uiscale = 1);
   int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex);
@@ -162,6 +181,10 @@ namespace app {
   void push_editor(lua_State* L, Editor* editor);
   void push_group_layers(lua_State* L, doc::LayerGroup* group);
   void push_image(lua_State* L, doc::Image* image);
+  void push_image_view(lua_State* L, int imageIndex,
+                       doc::Image* image, doc::Cel* cel,
+                       doc::Tileset* tileset, doc::tile_index ti,
+                       const gfx::Rect& bounds);
   void push_layers(lua_State* L, const doc::ObjectIds& layers);
   void push_palette(lua_State* L, doc::Palette* palette);
   void push_plugin(lua_State* L, Extension* ext);
@@ -204,13 +227,15 @@ namespace app {
   app::tools::Tool* get_tool_from_arg(lua_State* L, int index);
   doc::BrushRef get_brush_from_arg(lua_State* L, int index);
   doc::Tileset* get_tile_index_from_arg(lua_State* L, int index, doc::tile_index& ts);
+  doc::Image* may_get_image_view_from_arg(lua_State* L, int index, gfx::Rect& bounds);
 
   // Used by App.open(), Sprite{ fromFile }, and Image{ fromFile }
   enum class LoadSpriteFromFileParam { FullAniAsSprite,
                                        OneFrameAsSprite,
                                        OneFrameAsImage };
   int load_sprite_from_file(lua_State* L, const char* filename,
-                            const LoadSpriteFromFileParam param);
+                            const LoadSpriteFromFileParam param,
+                            const FileOpLoadROI* loadROI = nullptr);
 
   // close all opened Dialogs before closing the UI
   void close_all_dialogs();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021-2023  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -33,6 +33,7 @@
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <string>
 
 // This event was disabled because it can be triggered in a background thread
 // when any effect (e.g. like Replace Color or Convolution Matrix) is running.
@@ -76,9 +77,13 @@ public:
     return false;
   }
 
-  void add(EventType eventType, EventListener callbackRef) {
-    if (eventType >= m_listeners.size())
+  void add(EventType eventType, const char* eventName,
+           EventListener callbackRef) {
+    if (eventType >= m_listeners.size()) {
       m_listeners.resize(eventType+1);
+      m_eventNames.resize(eventType+1);
+    }
+    m_eventNames[eventType] = eventName;
 
     auto& listeners = m_listeners[eventType];
     listeners.push_back(callbackRef);
@@ -130,10 +135,8 @@ protected:
           }
         }
 
-        if (lua_pcall(L, callbackArgs, 0, 0)) {
-          if (const char* s = lua_tostring(L, -1))
-            engine->consolePrint(s);
-        }
+        call_event_handler(L, callbackArgs,
+                           m_eventNames[eventType].c_str());
       }
     }
     catch (const std::exception& ex) {
@@ -147,6 +150,7 @@ private:
 
   using EventListeners = std::vector<EventListener>;
   std::vector<EventListeners> m_listeners;
+  std::vector<std::string> m_eventNames;
 };
 
 // Used in BeforeCommand
@@ -465,7 +469,7 @@ int Events_on(lua_State* L)
   // Copy the callback function to add it to the global registry
   lua_pushvalue(L, 3);
   int callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  evs->add(type, callbackRef);
+  evs->add(type, eventName, callbackRef);
 
   // Return the callback ref (this is an EventListener easier to use
   // in Events_off())
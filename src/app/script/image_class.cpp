@@ -23,6 +23,7 @@
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
 #include "app/site.h"
+#include "app/transaction.h"
 #include "app/tx.h"
 #include "app/util/autocrop.h"
 #include "app/util/resize_image.h"
@@ -40,15 +41,16 @@
 
 #include <algorithm>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace app {
 namespace script {
 
 namespace {
 
-static ImageBufferPtr buf; // TODO non-thread safe
-
 struct ImageObj {
   doc::ObjectId imageId = 0;
   doc::ObjectId celId = 0;
@@ -115,6 +117,164 @@ void render_sprite(Image* dst,
               sprite->height()));
 }
 
+// Original pixels of a cel image modified by script functions inside
+// a transaction (e.g. app.transaction()). All the changes are added
+// to the transaction as just one cmd::CopyRegion (instead of one Cmd
+// for each function call).
+struct PendingImage {
+  doc::ObjectId imageId = 0;
+  doc::ImageRef original;       // Original pixels of originalBounds
+  gfx::Rect originalBounds;
+  gfx::Region region;           // Modified region of the image
+
+  // Saves the original pixels of the given area (must be called
+  // before modifying it).
+  void saveOriginal(const Image* image, const gfx::Rect& bounds) {
+    if (originalBounds.contains(bounds))
+      return;
+
+    // The pixels outside "originalBounds" weren't modified yet
+    const gfx::Rect newBounds = originalBounds.createUnion(bounds);
+    ImageRef newOriginal(doc::crop_image(image, newBounds, image->maskColor()));
+    if (original) {
+      doc::copy_image(newOriginal.get(), original.get(),
+                      originalBounds.x - newBounds.x,
+                      originalBounds.y - newBounds.y);
+    }
+    original = newOriginal;
+    originalBounds = newBounds;
+  }
+};
+
+using PendingImages = std::vector<PendingImage>;
+static std::map<Transaction*, PendingImages> g_pendingImages;
+
+// Called by the transaction before executing a new Cmd (or before
+// the commit/rollback).
+void add_pending_images(Transaction* transaction)
+{
+  auto it = g_pendingImages.find(transaction);
+  if (it == g_pendingImages.end())
+    return;
+
+  PendingImages images = std::move(it->second);
+  g_pendingImages.erase(it);
+
+  for (PendingImage& pending : images) {
+    Image* image = doc::get<Image>(pending.imageId);
+    if (!image || pending.region.isEmpty())
+      continue;
+
+    // The pixels are already modified in the image
+    gfx::Region region = pending.region;
+    region.offset(-pending.originalBounds.origin());
+    transaction->execute(
+      new cmd::CopyRegion(image, pending.original.get(), region,
+                          pending.originalBounds.origin(), true));
+  }
+}
+
+// Modifies the "bounds" area of the "cel" image with the given
+// function, adding the undo information to the document. Inside a
+// transaction, the modified areas of the image are accumulated to add
+// only one Cmd at the end.
+template<typename Func>
+void modify_cel_image(Cel* cel, Image* image, gfx::Rect bounds, Func&& func)
+{
+  bounds &= image->bounds();
+  if (bounds.isEmpty())
+    return;
+
+  Doc* doc = static_cast<Doc*>(cel->sprite()->document());
+  if (doc->isReadOnly())
+    throw CannotModifyWhenReadOnlyException();
+
+  if (Transaction* transaction = doc->transaction()) {
+    auto it = g_pendingImages.find(transaction);
+    if (it == g_pendingImages.end()) {
+      it = g_pendingImages.insert(std::make_pair(transaction, PendingImages())).first;
+      transaction->setPendingChanges(
+        [transaction]{ add_pending_images(transaction); });
+    }
+
+    PendingImages& images = it->second;
+    auto jt = std::find_if(images.begin(), images.end(),
+                           [image](const PendingImage& pending){
+                             return pending.imageId == image->id();
+                           });
+    if (jt == images.end()) {
+      images.push_back(PendingImage());
+      jt = images.end()-1;
+      jt->imageId = image->id();
+    }
+
+    jt->saveOriginal(image, bounds);
+    func(image);
+    jt->region.createUnion(jt->region, gfx::Region(bounds));
+    image->incrementVersion();
+  }
+  else {
+    Tx tx(cel->sprite());
+    ImageRef original(doc::crop_image(image, bounds, image->maskColor()));
+    func(image);
+    image->incrementVersion();
+    tx(new cmd::CopyRegion(
+         image, original.get(),
+         gfx::Region(original->bounds()),
+         bounds.origin(), true));
+    tx.commit();
+  }
+}
+
+struct DrawImageArgs {
+  const Image* image = nullptr;
+  gfx::Point pos;
+  int opacity = 255;
+  doc::BlendMode blendMode = doc::BlendMode::NORMAL;
+};
+
+// Draws all the given images in the "obj" image (using just one
+// undoable Cmd if it's a cel image).
+void draw_images(lua_State* L, ImageObj* obj,
+                 const std::vector<DrawImageArgs>& images)
+{
+  Image* dst = obj->image(L);
+
+  // If we are drawing the same image, we use a copy
+  ImageRef dstCopy;
+  auto blendImages = [dst, &dstCopy, &images](Image* image,
+                                             const Palette* pal) {
+    for (const DrawImageArgs& args : images) {
+      const Image* src = args.image;
+      if (src == dst) {
+        if (!dstCopy)
+          dstCopy.reset(Image::createCopy(dst));
+        src = dstCopy.get();
+      }
+      doc::blend_image(image, src,
+                       gfx::Clip(args.pos, src->bounds()),
+                       pal, args.opacity, args.blendMode);
+    }
+  };
+
+  if (auto cel = obj->cel(L)) {
+    gfx::Rect bounds;
+    for (const DrawImageArgs& args : images)
+      bounds |= gfx::Rect(args.pos, args.image->size());
+
+    modify_cel_image(
+      cel, dst, bounds,
+      [cel, &blendImages](Image* image){
+        blendImages(image, cel->sprite()->palette(0));
+      });
+  }
+  // If the destination image is not related to a sprite, we just draw
+  // the source image without undo information.
+  else {
+    blendImages(dst, get_current_palette());
+  }
+}
+
 int Image_clone(lua_State* L);
 
 int Image_new(lua_State* L)
@@ -310,39 +470,179 @@ int Image_drawImage(lua_State* L)
                   app::script::BlendMode(lua_tointeger(L, 5 + argsFix)));
   }
 
-  Image* dst = obj->image(L);
-  const Image* src = sprite->image(L);
+  DrawImageArgs args;
+  args.image = sprite->image(L);
+  args.pos = pos;
+  args.opacity = opacity;
+  args.blendMode = blendMode;
+  draw_images(L, obj, { args });
+  return 0;
+}
 
-  if (auto cel = obj->cel(L)) {
-    gfx::Rect bounds(src->size());
-
-    // Create the ImageBuffer only when it doesn't exist so we can
-    // cache the allocated buffer.
-    if (!buf)
-      buf = std::make_shared<doc::ImageBuffer>();
-
-    ImageRef tmp_src(doc::crop_image(dst, gfx::Rect(pos, src->size()), 0, buf));
-    doc::blend_image(tmp_src.get(), src,
-                     gfx::Clip(src->size()),
-                     cel->sprite()->palette(0),
-                     opacity, blendMode);
-    // TODO Use something similar to doc::algorithm::shrink_bounds2()
-    //      but we need something that does the render and compares
-    //      the minimal modified area.
-    Tx tx(cel->sprite());
-    tx(new cmd::CopyRegion(
-         dst, tmp_src.get(), gfx::Region(bounds),
-         gfx::Point(pos.x + bounds.x, pos.y + bounds.y)));
-    tx.commit();
+// Image:drawImages{ { image=image, position=point, opacity=int, blendMode=int }, ... }
+int Image_drawImages(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  if (!lua_istable(L, 2))
+    return luaL_error(L, "a table of images to draw is expected");
+
+  std::vector<DrawImageArgs> images;
+  const int n = luaL_len(L, 2);
+  images.reserve(n);
+  for (int i=1; i<=n; ++i) {
+    lua_geti(L, 2, i);
+    if (!lua_istable(L, -1))
+      return luaL_error(L, "item %d must be a table with an image", i);
+
+    DrawImageArgs args;
+    lua_getfield(L, -1, "image");
+    args.image = get_image_from_arg(L, -1);
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, -1, "position") != LUA_TNIL)
+      args.pos = convert_args_into_point(L, lua_absindex(L, -1));
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, -1, "opacity") != LUA_TNIL)
+      args.opacity = std::clamp(int(lua_tointeger(L, -1)), 0, 255);
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, -1, "blendMode") != LUA_TNIL) {
+      args.blendMode = base::convert_to<doc::BlendMode>(
+                         app::script::BlendMode(lua_tointeger(L, -1)));
+    }
+    lua_pop(L, 1);
+
+    lua_pop(L, 1);              // Pop item
+    images.push_back(args);
   }
-  // If the destination image is not related to a sprite, we just draw
-  // the source image without undo information.
-  else {
-    doc::blend_image(dst, src,
-                     gfx::Clip(pos, src->bounds()),
-                     get_current_palette(),
-                     opacity, blendMode);
+
+  if (!images.empty())
+    draw_images(L, obj, images);
+  return 0;
+}
+
+// Image:blendRect(rectangle, color [, opacity, blendMode])
+int Image_blendRect(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  const gfx::Rect rc = (convert_args_into_rect(L, 2) & img->bounds());
+
+  doc::color_t color;
+  if (lua_isinteger(L, 3))
+    color = lua_tointeger(L, 3);
+  else
+    color = convert_args_into_pixel_color(L, 3, img->pixelFormat());
+
+  DrawImageArgs args;
+  if (lua_isinteger(L, 4))
+    args.opacity = std::clamp(int(lua_tointeger(L, 4)), 0, 255);
+  if (lua_isinteger(L, 5)) {
+    args.blendMode = base::convert_to<doc::BlendMode>(
+                       app::script::BlendMode(lua_tointeger(L, 5)));
+  }
+
+  if (rc.isEmpty())
+    return 0;
+
+  ImageRef tmp(Image::create(img->pixelFormat(), rc.w, rc.h));
+  doc::clear_image(tmp.get(), color);
+  args.image = tmp.get();
+  args.pos = rc.origin();
+  draw_images(L, obj, { args });
+  return 0;
+}
+
+template<typename ImageTraits, typename Map>
+void map_image_colors(Image* image, const gfx::Rect& bounds, Map&& map)
+{
+  using address_t = typename ImageTraits::address_t;
+  image->unshareTiles(bounds);
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto p = (address_t)image->getPixelAddress(bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++p)
+      *p = map(*p);
+  }
+}
+
+// Image:mapColors(lut [, rectangle]) where lut is a table
+// { [oldColor]=newColor, ... }, pixels with other colors are not
+// modified.
+int Image_mapColors(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  Image* img = obj->image(L);
+  if (!lua_istable(L, 2))
+    return luaL_error(L, "a table to map colors is expected");
+
+  std::unordered_map<doc::color_t, doc::color_t> lut;
+  lua_pushnil(L);
+  while (lua_next(L, 2) != 0) {
+    // Key at -2 and value at -1
+    if (lua_isinteger(L, -2)) {
+      doc::color_t to;
+      if (lua_isinteger(L, -1))
+        to = lua_tointeger(L, -1);
+      else
+        to = convert_args_into_pixel_color(L, lua_absindex(L, -1), img->pixelFormat());
+      lut[doc::color_t(lua_tointeger(L, -2))] = to;
+    }
+    lua_pop(L, 1);
   }
+
+  gfx::Rect bounds = img->bounds();
+  if (!lua_isnone(L, 3))
+    bounds &= convert_args_into_rect(L, 3);
+  if (lut.empty() || bounds.isEmpty())
+    return 0;
+
+  auto mapColors = [&lut, &bounds](Image* image) {
+    switch (image->pixelFormat()) {
+      case IMAGE_INDEXED: {
+        // Use a table for all the possible indexes
+        uint8_t table[256];
+        for (int i=0; i<256; ++i) {
+          auto it = lut.find(i);
+          table[i] = (it != lut.end() ? it->second: i);
+        }
+        map_image_colors<IndexedTraits>(
+          image, bounds,
+          [&table](const uint8_t c) -> uint8_t { return table[c]; });
+        break;
+      }
+      case IMAGE_RGB:
+      case IMAGE_GRAYSCALE:
+      case IMAGE_TILEMAP: {
+        // Cache the last color because there are usually runs of
+        // pixels with the same color
+        auto doMap = [&lut, from=doc::color_t(0), to=doc::color_t(0), first=true]
+          (const doc::color_t c) mutable -> doc::color_t {
+            if (first || c != from) {
+              auto it = lut.find(c);
+              from = c;
+              to = (it != lut.end() ? it->second: c);
+              first = false;
+            }
+            return to;
+          };
+        switch (image->pixelFormat()) {
+          case IMAGE_RGB:       map_image_colors<RgbTraits>(image, bounds, doMap); break;
+          case IMAGE_GRAYSCALE: map_image_colors<GrayscaleTraits>(image, bounds, doMap); break;
+          case IMAGE_TILEMAP:   map_image_colors<TilemapTraits>(image, bounds, doMap); break;
+          default: break;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  };
+
+  if (auto cel = obj->cel(L))
+    modify_cel_image(cel, img, bounds, mapColors);
+  else
+    mapColors(img);
   return 0;
 }
 
@@ -387,6 +687,18 @@ int Image_pixels(lua_State* L)
   return 1;
 }
 
+int Image_view(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  gfx::Rect bounds = img->bounds();
+  if (!lua_isnone(L, 2))
+    bounds &= convert_args_into_rect(L, 2);
+
+  push_image_view(L, 1, img, obj->cel(L), obj->tileset(L), obj->ti, bounds);
+  return 1;
+}
+
 int Image_getPixel(lua_State* L)
 {
   const auto obj = get_obj<ImageObj>(L, 1);
@@ -397,6 +709,134 @@ int Image_getPixel(lua_State* L)
   return 1;
 }
 
+// Returns the pixels of the given area in an array (row by row)
+template<typename ImageTraits>
+void push_image_pixels(lua_State* L, const Image* image, const gfx::Rect& bounds)
+{
+  using const_address_t = typename ImageTraits::const_address_t;
+  lua_createtable(L, bounds.w*bounds.h, 0);
+  lua_Integer i = 1;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto p = (const_address_t)image->getPixelAddress(bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++p, ++i) {
+      lua_pushinteger(L, *p);
+      lua_rawseti(L, -2, i);
+    }
+  }
+}
+
+template<typename ImageTraits>
+void put_image_pixels(Image* image, const gfx::Rect& bounds,
+                      const std::vector<doc::color_t>& pixels)
+{
+  using address_t = typename ImageTraits::address_t;
+  using pixel_t = typename ImageTraits::pixel_t;
+  auto it = pixels.begin();
+  image->unshareTiles(bounds);
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto p = (address_t)image->getPixelAddress(bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++p, ++it)
+      *p = pixel_t(*it);
+  }
+}
+
+gfx::Rect get_pixels_bounds_from_arg(lua_State* L, int index, const Image* image)
+{
+  if (lua_isnone(L, index))
+    return image->bounds();
+
+  const gfx::Rect bounds = convert_args_into_rect(L, index);
+  if (!image->bounds().contains(bounds))
+    luaL_error(L, "the rectangle is outside the image bounds");
+  return bounds;
+}
+
+// Image:getPixels([rectangle]) returns an array with the pixels (or
+// tiles in tilemaps, with their flags) of the given area, row by row
+int Image_getPixels(lua_State* L)
+{
+  const auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  const gfx::Rect bounds = get_pixels_bounds_from_arg(L, 2, img);
+
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB:       push_image_pixels<RgbTraits>(L, img, bounds); break;
+    case IMAGE_GRAYSCALE: push_image_pixels<GrayscaleTraits>(L, img, bounds); break;
+    case IMAGE_INDEXED:   push_image_pixels<IndexedTraits>(L, img, bounds); break;
+    case IMAGE_TILEMAP:   push_image_pixels<TilemapTraits>(L, img, bounds); break;
+    default: {
+      lua_createtable(L, bounds.w*bounds.h, 0);
+      lua_Integer i = 1;
+      for (int y=bounds.y; y<bounds.y2(); ++y)
+        for (int x=bounds.x; x<bounds.x2(); ++x, ++i) {
+          lua_pushinteger(L, img->getPixel(x, y));
+          lua_rawseti(L, -2, i);
+        }
+      break;
+    }
+  }
+  return 1;
+}
+
+// Image:setPixels(array [, rectangle]) is the inverse of
+// Image:getPixels(), the changes in a cel image are added as just
+// one undoable action.
+int Image_setPixels(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  Image* img = obj->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  const gfx::Rect bounds = get_pixels_bounds_from_arg(L, 3, img);
+
+  const lua_Integer n = lua_Integer(bounds.w)*bounds.h;
+  if (lua_Integer(lua_rawlen(L, 2)) < n)
+    return luaL_error(L, "the array must contain %d pixels", int(n));
+
+  // Read all pixels before modifying the image (in case of errors)
+  std::vector<doc::color_t> pixels(n);
+  for (lua_Integer i=0; i<n; ++i) {
+    lua_rawgeti(L, 2, i+1);
+    int isnum = 0;
+    pixels[i] = lua_tointegerx(L, -1, &isnum);
+    if (!isnum)
+      return luaL_error(L, "pixel %d is not an integer", int(i+1));
+    lua_pop(L, 1);
+  }
+
+  auto setPixels = [&bounds, &pixels](Image* image) {
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:       put_image_pixels<RgbTraits>(image, bounds, pixels); break;
+      case IMAGE_GRAYSCALE: put_image_pixels<GrayscaleTraits>(image, bounds, pixels); break;
+      case IMAGE_INDEXED:   put_image_pixels<IndexedTraits>(image, bounds, pixels); break;
+      case IMAGE_TILEMAP:   put_image_pixels<TilemapTraits>(image, bounds, pixels); break;
+      default: {
+        auto it = pixels.begin();
+        for (int y=bounds.y; y<bounds.y2(); ++y)
+          for (int x=bounds.x; x<bounds.x2(); ++x, ++it)
+            image->putPixel(x, y, *it);
+        break;
+      }
+    }
+  };
+
+  if (auto cel = obj->cel(L)) {
+    modify_cel_image(cel, img, bounds, setPixels);
+  }
+  else {
+    setPixels(img);
+    img->incrementVersion();
+
+    // Rehash tileset
+    if (obj->tilesetId) {
+      if (doc::Tileset* ts = obj->tileset(L)) {
+        ts->incrementVersion();
+        ts->notifyTileContentChange(obj->ti);
+      }
+    }
+  }
+  return 0;
+}
+
 int Image_isEqual(lua_State* L)
 {
   auto objA = get_obj<ImageObj>(L, 1);
@@ -433,6 +873,24 @@ int Image_isPlain(lua_State* L)
   return 1;
 }
 
+// Returns a table with the number of pixels that use each index
+// (from 0 to 255) of an indexed image.
+int Image_histogram(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  auto img = obj->image(L);
+  if (img->pixelFormat() != IMAGE_INDEXED)
+    return luaL_error(L, "histogram() is only available for indexed images");
+
+  const doc::Image::IndexHistogram& histogram = img->indexHistogram();
+  lua_createtable(L, int(histogram.size())-1, 1);
+  for (int i=0; i<int(histogram.size()); ++i) {
+    lua_pushinteger(L, histogram[i]);
+    lua_rawseti(L, -2, i);
+  }
+  return 1;
+}
+
 int Image_saveAs(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
@@ -677,8 +1135,19 @@ int Image_get_bytesPerPixel(lua_State* L)
 int Image_get_bytes(lua_State* L)
 {
   const auto img = get_obj<ImageObj>(L, 1)->image(L);
-  lua_pushlstring(L, (const char*)img->getPixelAddress(0, 0),
-                  img->rowBytes() * img->height());
+  if (!img->isTiled()) {
+    lua_pushlstring(L, (const char*)img->getPixelAddress(0, 0),
+                    img->rowBytes() * img->height());
+  }
+  // Rows of a tiled image aren't contiguous
+  else {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    for (int y=0; y<img->height(); ++y)
+      luaL_addlstring(&b, (const char*)img->getPixelAddress(0, y),
+                      img->rowBytes());
+    luaL_pushresult(&b);
+  }
   return 1;
 }
 
@@ -689,7 +1158,14 @@ int Image_set_bytes(lua_State* L)
   const char* bytes = lua_tolstring(L, 2, &bytes_size);
 
   if (bytes_size == bytes_needed) {
-    std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    img->unshareTiles(img->bounds());
+    if (!img->isTiled()) {
+      std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    }
+    else {
+      for (int y=0; y<img->height(); ++y, bytes+=img->rowBytes())
+        std::memcpy(img->getPixelAddress(0, y), bytes, img->rowBytes());
+    }
   }
   else {
     lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
@@ -745,13 +1221,20 @@ const luaL_Reg Image_methods[] = {
   { "clone", Image_clone },
   { "clear", Image_clear },
   { "getPixel", Image_getPixel },
+  { "getPixels", Image_getPixels },
+  { "setPixels", Image_setPixels },
   { "drawPixel", Image_drawPixel }, { "putPixel", Image_drawPixel },
   { "drawImage", Image_drawImage }, { "putImage", Image_drawImage }, // TODO putImage is deprecated
+  { "drawImages", Image_drawImages },
+  { "blendRect", Image_blendRect },
+  { "mapColors", Image_mapColors },
   { "drawSprite", Image_drawSprite }, { "putSprite", Image_drawSprite }, // TODO putSprite is deprecated
   { "pixels", Image_pixels },
+  { "view", Image_view },
   { "isEqual", Image_isEqual },
   { "isEmpty", Image_isEmpty },
   { "isPlain", Image_isPlain },
+  { "histogram", Image_histogram },
   { "saveAs", Image_saveAs },
   { "resize", Image_resize },
   { "shrinkBounds", Image_shrinkBounds },
@@ -0,0 +1,361 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/copy_region.h"
+#include "app/script/docobj.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "app/tx.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+namespace app {
+namespace script {
+
+namespace {
+
+// A view of a rectangular area of an image to access its pixels
+// directly (without creating intermediate strings or iterators).
+//
+// Images from cels and tilesets are not modified until the changes
+// are committed: the first write copies the "bounds" area into a
+// buffer, and commit() copies the modified area of the buffer into
+// the image (with just one undoable cmd::CopyRegion if the image is
+// from a cel). If the view is garbage collected without committing
+// the changes, the buffer is just dropped. Other images (without
+// undo information) are modified in-place.
+struct ImageViewObj {
+  doc::ObjectId imageId;
+  doc::ObjectId celId;
+  doc::ObjectId tilesetId;
+  doc::tile_index ti;
+  gfx::Rect bounds;        // Area of the view in image coordinates
+  gfx::Rect modified;      // Modified area in image coordinates
+  doc::ImageRef buffer;    // Modified pixels of "bounds" (not yet committed)
+
+  ImageViewObj(doc::Image* image,
+               doc::Cel* cel,
+               doc::Tileset* tileset,
+               doc::tile_index ti,
+               const gfx::Rect& bounds)
+    : imageId(image->id())
+    , celId(cel ? cel->id(): doc::NullId)
+    , tilesetId(tileset ? tileset->id(): doc::NullId)
+    , ti(ti)
+    , bounds(bounds) {
+  }
+  ImageViewObj(const ImageViewObj&) = delete;
+  ImageViewObj& operator=(const ImageViewObj&) = delete;
+
+  doc::Image* image(lua_State* L) {
+    doc::Image* image = check_docobj(L, doc::get<doc::Image>(imageId));
+    // The image could be resized after the view was created
+    if (!bounds.isEmpty() && !image->bounds().contains(bounds))
+      luaL_error(L, "the image was resized, the view is not valid anymore");
+    return image;
+  }
+
+  // Returns the image where the pixels of the view must be read (the
+  // buffer if there are uncommitted changes) and the position of the
+  // view in that image.
+  doc::Image* pixels(lua_State* L, gfx::Point& origin) {
+    doc::Image* img = image(L);
+    if (buffer) {
+      origin = gfx::Point(0, 0);
+      return buffer.get();
+    }
+    origin = bounds.origin();
+    return img;
+  }
+
+  // Must be called before modifying the "rc" area (in image
+  // coordinates) of the view, returns the image where the pixels must
+  // be written.
+  doc::Image* beginWrite(lua_State* L, const gfx::Rect& rc, gfx::Point& origin) {
+    doc::Image* img = image(L);
+    if ((celId || tilesetId) && !buffer)
+      buffer.reset(doc::crop_image(img, bounds, img->maskColor()));
+    modified |= rc;
+    return pixels(L, origin);
+  }
+
+  void commit(lua_State* L) {
+    if (modified.isEmpty())
+      return;
+
+    doc::Image* image = this->image(L);
+    const gfx::Rect rc = modified;
+    const doc::ImageRef buf = buffer;
+    modified = gfx::Rect();
+    buffer.reset();
+
+    if (buf) {
+      const gfx::Rect bufRc = gfx::Rect(rc).offset(-bounds.origin());
+      doc::Cel* cel = doc::get<doc::Cel>(celId);
+      if (cel) {
+        Tx tx(cel->sprite());
+        tx(new cmd::CopyRegion(image, buf.get(), gfx::Region(bufRc),
+                               bounds.origin()));
+        tx.commit();
+      }
+      else {
+        image->copy(buf.get(), gfx::Clip(rc.origin(), bufRc.origin(), rc.size()));
+      }
+    }
+
+    image->incrementVersion();
+
+    // Rehash tileset
+    if (tilesetId) {
+      if (doc::Tileset* ts = doc::get<doc::Tileset>(tilesetId)) {
+        ts->incrementVersion();
+        ts->notifyTileContentChange(ti);
+      }
+    }
+  }
+};
+
+// Gets the pixel coordinates (in view coordinates) from the
+// arguments (index) or (x, y) and returns the index of the next
+// argument.
+int get_pixel_pos_from_args(lua_State* L, ImageViewObj* obj,
+                            const int index, const bool hasValue,
+                            int& x, int& y)
+{
+  const int w = obj->bounds.w;
+  const int h = obj->bounds.h;
+
+  // view:get(index) / view:set(index, color)
+  if (lua_gettop(L) == index + (hasValue ? 1: 0)) {
+    const lua_Integer i = luaL_checkinteger(L, index);
+    if (i < 0 || i >= lua_Integer(w) * h)
+      return luaL_error(L, "index %d out of bounds (%d pixels)", int(i), w*h);
+    x = int(i % w);
+    y = int(i / w);
+    return index+1;
+  }
+  // view:get(x, y) / view:set(x, y, color)
+  else {
+    x = luaL_checkinteger(L, index);
+    y = luaL_checkinteger(L, index+1);
+    if (x < 0 || y < 0 || x >= w || y >= h)
+      return luaL_error(L, "pixel (%d, %d) out of bounds (%dx%d)", x, y, w, h);
+    return index+2;
+  }
+}
+
+doc::color_t get_color_from_arg(lua_State* L, int index,
+                                const doc::Image* image)
+{
+  if (lua_isinteger(L, index))
+    return lua_tointeger(L, index);
+  else
+    return convert_args_into_pixel_color(L, index, image->pixelFormat());
+}
+
+int ImageView_gc(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  // Uncommitted changes are dropped with the buffer (we cannot add
+  // undoable cmds from __gc, it can be called in the middle of a
+  // transaction or after the document was closed)
+  obj->~ImageViewObj();
+  return 0;
+}
+
+int ImageView_get(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  gfx::Point origin;
+  const doc::Image* image = obj->pixels(L, origin);
+  int x, y;
+  get_pixel_pos_from_args(L, obj, 2, false, x, y);
+  lua_pushinteger(L, image->getPixel(origin.x+x, origin.y+y));
+  return 1;
+}
+
+int ImageView_set(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  int x, y;
+  const int i = get_pixel_pos_from_args(L, obj, 2, true, x, y);
+  const doc::color_t color = get_color_from_arg(L, i, obj->image(L));
+
+  gfx::Point origin;
+  doc::Image* image = obj->beginWrite(
+    L, gfx::Rect(obj->bounds.x+x, obj->bounds.y+y, 1, 1), origin);
+  image->putPixel(origin.x+x, origin.y+y, color);
+  return 0;
+}
+
+int ImageView_fill(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  const doc::color_t color = get_color_from_arg(L, 2, obj->image(L));
+
+  gfx::Rect rc;
+  if (lua_isnone(L, 3))
+    rc = obj->bounds;
+  else {
+    rc = convert_args_into_rect(L, 3);
+    rc.offset(obj->bounds.origin());
+    rc &= obj->bounds;
+  }
+  if (rc.isEmpty())
+    return 0;
+
+  gfx::Point origin;
+  doc::Image* image = obj->beginWrite(L, rc, origin);
+  doc::fill_rect(image, rc.offset(origin - obj->bounds.origin()), color);
+  return 0;
+}
+
+int ImageView_copyFrom(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  auto srcObj = get_obj<ImageViewObj>(L, 2);
+  const gfx::Point pos = convert_args_into_point(L, 3);
+
+  if (obj->image(L)->pixelFormat() != srcObj->image(L)->pixelFormat())
+    return luaL_error(L, "the views must have the same color mode");
+
+  // Destination area in image coordinates
+  gfx::Rect rc(obj->bounds.origin() + pos, srcObj->bounds.size());
+  rc &= obj->bounds;
+  if (rc.isEmpty())
+    return 0;
+
+  // Source position in view coordinates
+  const gfx::Point srcPos = rc.origin() - obj->bounds.origin() - pos;
+
+  gfx::Point origin, srcOrigin;
+  doc::Image* image = obj->beginWrite(L, rc, origin);
+  const doc::Image* srcImage = srcObj->pixels(L, srcOrigin);
+  const gfx::Point dstPt = rc.origin() - obj->bounds.origin() + origin;
+  const gfx::Point srcPt = srcPos + srcOrigin;
+
+  // Copy the source area first if we are reading/writing the same
+  // image (the areas could overlap)
+  if (image == srcImage) {
+    doc::ImageRef tmp(doc::crop_image(srcImage, gfx::Rect(srcPt, rc.size()),
+                                      srcImage->maskColor()));
+    image->copy(tmp.get(), gfx::Clip(dstPt, tmp->bounds()));
+  }
+  else {
+    image->copy(srcImage, gfx::Clip(dstPt, srcPt, rc.size()));
+  }
+  return 0;
+}
+
+int ImageView_commit(lua_State* L)
+{
+  auto obj = get_obj<ImageViewObj>(L, 1);
+  obj->commit(L);
+  return 0;
+}
+
+int ImageView_get_width(lua_State* L)
+{
+  const auto obj = get_obj<ImageViewObj>(L, 1);
+  lua_pushinteger(L, obj->bounds.w);
+  return 1;
+}
+
+int ImageView_get_height(lua_State* L)
+{
+  const auto obj = get_obj<ImageViewObj>(L, 1);
+  lua_pushinteger(L, obj->bounds.h);
+  return 1;
+}
+
+int ImageView_get_bounds(lua_State* L)
+{
+  const auto obj = get_obj<ImageViewObj>(L, 1);
+  push_obj(L, obj->bounds);
+  return 1;
+}
+
+int ImageView_get_modified(lua_State* L)
+{
+  const auto obj = get_obj<ImageViewObj>(L, 1);
+  push_obj(L, obj->modified);
+  return 1;
+}
+
+int ImageView_get_colorMode(lua_State* L)
+{
+  const auto obj = get_obj<ImageViewObj>(L, 1);
+  lua_pushinteger(L, obj->image(L)->pixelFormat());
+  return 1;
+}
+
+const luaL_Reg ImageView_methods[] = {
+  { "get", ImageView_get },
+  { "set", ImageView_set },
+  { "fill", ImageView_fill },
+  { "copyFrom", ImageView_copyFrom },
+  { "commit", ImageView_commit },
+  { "__close", ImageView_commit },
+  { "__gc", ImageView_gc },
+  { nullptr, nullptr }
+};
+
+const Property ImageView_properties[] = {
+  { "width", ImageView_get_width, nullptr },
+  { "height", ImageView_get_height, nullptr },
+  { "bounds", ImageView_get_bounds, nullptr },
+  { "modified", ImageView_get_modified, nullptr },
+  { "colorMode", ImageView_get_colorMode, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(ImageViewObj);
+
+void register_image_view_class(lua_State* L)
+{
+  using ImageView = ImageViewObj;
+  REG_CLASS(L, ImageView);
+  REG_CLASS_PROPERTIES(L, ImageView);
+}
+
+void push_image_view(lua_State* L, int imageIndex,
+                     doc::Image* image, doc::Cel* cel,
+                     doc::Tileset* tileset, doc::tile_index ti,
+                     const gfx::Rect& bounds)
+{
+  imageIndex = lua_absindex(L, imageIndex);
+  push_new<ImageViewObj>(L, image, cel, tileset, ti, bounds);
+
+  // Keep a reference to the Image userdata so the image is not
+  // deleted while the view is alive
+  lua_pushvalue(L, imageIndex);
+  lua_setuservalue(L, -2);
+}
+
+doc::Image* may_get_image_view_from_arg(lua_State* L, int index,
+                                        gfx::Rect& bounds)
+{
+  auto obj = may_get_obj<ImageViewObj>(L, index);
+  if (!obj)
+    return nullptr;
+  gfx::Point origin;
+  doc::Image* image = obj->pixels(L, origin);
+  bounds = gfx::Rect(origin, obj->bounds.size());
+  return image;
+}
+
+} // namespace script
+} // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,9 +9,21 @@
 #endif
 
 #include "app/script/luacpp.h"
+#include "app/script/security.h"
 #include "app/script/values.h"
-
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "json11.hpp"
 
@@ -99,6 +111,488 @@ JsonObj get_json_value(lua_State* L, int index)
   return JsonObj();
 }
 
+// Maximum depth of nested arrays/objects (same limit as json11)
+constexpr int kMaxJsonDepth = 200;
+
+// Parses JSON text directly into Lua values (tables, strings,
+// numbers, and booleans) without creating an intermediate DOM. The
+// text can be in memory or read from a file in chunks. JSON nulls are
+// converted to nil (so they are not present in the Lua tables).
+class JsonParser {
+public:
+  JsonParser(lua_State* L, const char* data, size_t size)
+    : L(L)
+    , m_begin(data)
+    , m_pos(data)
+    , m_end(data + size)
+    , m_file(nullptr) {
+  }
+
+  JsonParser(lua_State* L, FILE* file)
+    : L(L)
+    , m_file(file)
+    , m_buffer(kBufferSize) {
+    m_begin = m_pos = m_end = m_buffer.data();
+  }
+
+  // Pushes the parsed value in the Lua stack
+  void parse() {
+    // Skip UTF-8 BOM
+    if (peek() == 0xef) {
+      get();
+      if (get() != 0xbb || get() != 0xbf)
+        error("invalid UTF-8 BOM");
+    }
+
+    parseValue(0);
+    skipSpaces();
+    if (peek() >= 0)
+      error("unexpected trailing characters");
+  }
+
+private:
+  static constexpr size_t kBufferSize = 64*1024;
+
+  void error(const char* msg) {
+    const size_t offset = m_consumed + (m_pos - m_begin);
+    luaL_error(L, "%s", fmt::format("JSON parse error: {} at byte {}",
+                                    msg, offset).c_str());
+  }
+
+  // Reads the next chunk of the file, returns false if there is no
+  // more data
+  bool fill() {
+    if (!m_file)
+      return false;
+    m_consumed += (m_end - m_begin);
+    const size_t n = std::fread(m_buffer.data(), 1, m_buffer.size(), m_file);
+    m_pos = m_buffer.data();
+    m_end = m_pos + n;
+    return (n > 0);
+  }
+
+  int peek() {
+    if (m_pos == m_end && !fill())
+      return -1;
+    return (unsigned char)*m_pos;
+  }
+
+  int get() {
+    if (m_pos == m_end && !fill())
+      return -1;
+    return (unsigned char)*(m_pos++);
+  }
+
+  void expect(int chr, const char* msg) {
+    if (get() != chr)
+      error(msg);
+  }
+
+  void skipSpaces() {
+    for (int chr=peek(); chr == ' ' || chr == '\t' || chr == '\n' || chr == '\r';
+         chr=peek()) {
+      ++m_pos;
+    }
+  }
+
+  void expectLiteral(const char* rest) {
+    for (; *rest; ++rest)
+      expect(*rest, "invalid literal");
+  }
+
+  void parseValue(int depth) {
+    if (depth > kMaxJsonDepth)
+      error("too deep nesting");
+    if (!lua_checkstack(L, 3))
+      error("not enough memory");
+
+    skipSpaces();
+    const int chr = get();
+    switch (chr) {
+      case '{': parseObject(depth); break;
+      case '[': parseArray(depth); break;
+      case '"':
+        parseString();
+        lua_pushlstring(L, m_str.c_str(), m_str.size());
+        break;
+      case 't': expectLiteral("rue"); lua_pushboolean(L, true); break;
+      case 'f': expectLiteral("alse"); lua_pushboolean(L, false); break;
+      case 'n': expectLiteral("ull"); lua_pushnil(L); break;
+      case -1: error("unexpected end of input"); break;
+      default:
+        if (chr == '-' || (chr >= '0' && chr <= '9'))
+          parseNumber(chr);
+        else
+          error("unexpected character");
+        break;
+    }
+  }
+
+  void parseObject(int depth) {
+    lua_newtable(L);
+    skipSpaces();
+    if (peek() == '}') {
+      ++m_pos;
+      return;
+    }
+    while (true) {
+      skipSpaces();
+      expect('"', "expected a string as key");
+      parseString();
+      lua_pushlstring(L, m_str.c_str(), m_str.size());
+      skipSpaces();
+      expect(':', "expected ':'");
+      parseValue(depth+1);
+      lua_rawset(L, -3);
+
+      skipSpaces();
+      const int chr = get();
+      if (chr == '}')
+        break;
+      if (chr != ',')
+        error("expected ',' or '}'");
+    }
+  }
+
+  void parseArray(int depth) {
+    lua_newtable(L);
+    skipSpaces();
+    if (peek() == ']') {
+      ++m_pos;
+      return;
+    }
+    for (lua_Integer i=1; ; ++i) {
+      parseValue(depth+1);
+      lua_rawseti(L, -2, i);
+
+      skipSpaces();
+      const int chr = get();
+      if (chr == ']')
+        break;
+      if (chr != ',')
+        error("expected ',' or ']'");
+    }
+  }
+
+  int parseHex4() {
+    int value = 0;
+    for (int i=0; i<4; ++i) {
+      const int chr = get();
+      value <<= 4;
+      if (chr >= '0' && chr <= '9') value |= chr - '0';
+      else if (chr >= 'a' && chr <= 'f') value |= chr - 'a' + 10;
+      else if (chr >= 'A' && chr <= 'F') value |= chr - 'A' + 10;
+      else error("invalid \\u escape sequence");
+    }
+    return value;
+  }
+
+  void appendUtf8(int cp) {
+    if (cp < 0x80) {
+      m_str.push_back(char(cp));
+    }
+    else if (cp < 0x800) {
+      m_str.push_back(char(0xc0 | (cp >> 6)));
+      m_str.push_back(char(0x80 | (cp & 0x3f)));
+    }
+    else if (cp < 0x10000) {
+      m_str.push_back(char(0xe0 | (cp >> 12)));
+      m_str.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+      m_str.push_back(char(0x80 | (cp & 0x3f)));
+    }
+    else {
+      m_str.push_back(char(0xf0 | (cp >> 18)));
+      m_str.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+      m_str.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+      m_str.push_back(char(0x80 | (cp & 0x3f)));
+    }
+  }
+
+  // Parses a string (the first '"' was already read) in m_str
+  void parseString() {
+    m_str.clear();
+    while (true) {
+      if (m_pos == m_end && !fill())
+        error("unexpected end of input in string");
+
+      // Copy all regular characters at once
+      const char* p = m_pos;
+      while (p < m_end && *p != '"' && *p != '\\' &&
+             (unsigned char)*p >= 0x20) {
+        ++p;
+      }
+      m_str.append(m_pos, p);
+      m_pos = p;
+      if (m_pos == m_end)
+        continue;
+
+      const int chr = get();
+      if (chr == '"')
+        return;
+      if (chr != '\\')
+        error("unescaped control character in string");
+
+      switch (get()) {
+        case '"': m_str.push_back('"'); break;
+        case '\\': m_str.push_back('\\'); break;
+        case '/': m_str.push_back('/'); break;
+        case 'b': m_str.push_back('\b'); break;
+        case 'f': m_str.push_back('\f'); break;
+        case 'n': m_str.push_back('\n'); break;
+        case 'r': m_str.push_back('\r'); break;
+        case 't': m_str.push_back('\t'); break;
+        case 'u': {
+          int cp = parseHex4();
+          // Surrogate pair
+          if (cp >= 0xd800 && cp <= 0xdbff && peek() == '\\') {
+            ++m_pos;
+            expect('u', "expected a low surrogate");
+            const int low = parseHex4();
+            if (low >= 0xdc00 && low <= 0xdfff) {
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            }
+            else {
+              appendUtf8(cp);
+              cp = low;
+            }
+          }
+          appendUtf8(cp);
+          break;
+        }
+        default:
+          error("invalid escape sequence");
+      }
+    }
+  }
+
+  void parseNumber(int chr) {
+    m_str.clear();
+    m_str.push_back(char(chr));
+
+    bool integer = true;
+    for (chr=peek(); ; chr=peek()) {
+      if (chr >= '0' && chr <= '9') { }
+      else if (chr == '.' || chr == 'e' || chr == 'E' ||
+               chr == '+' || chr == '-') {
+        integer = false;
+      }
+      else
+        break;
+      m_str.push_back(char(chr));
+      ++m_pos;
+    }
+
+    if (!isValidNumber())
+      error("invalid number");
+
+    const char* s = m_str.c_str();
+    if (integer) {
+      errno = 0;
+      const long long value = std::strtoll(s, nullptr, 10);
+      if (errno != ERANGE) {
+        lua_pushinteger(L, lua_Integer(value));
+        return;
+      }
+    }
+    lua_pushnumber(L, std::strtod(s, nullptr));
+  }
+
+  // Checks the JSON number grammar:
+  // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  bool isValidNumber() const {
+    const char* p = m_str.c_str();
+    auto digits = [&p]{
+      const char* start = p;
+      while (*p >= '0' && *p <= '9')
+        ++p;
+      return (p > start);
+    };
+    if (*p == '-')
+      ++p;
+    if (*p == '0')
+      ++p;
+    else if (!digits())
+      return false;
+    if (*p == '.') {
+      ++p;
+      if (!digits())
+        return false;
+    }
+    if (*p == 'e' || *p == 'E') {
+      ++p;
+      if (*p == '+' || *p == '-')
+        ++p;
+      if (!digits())
+        return false;
+    }
+    return (*p == 0);
+  }
+
+  lua_State* L;
+  const char* m_begin;          // Beginning of the data/buffer
+  const char* m_pos;
+  const char* m_end;
+  FILE* m_file;
+  std::vector<char> m_buffer;
+  size_t m_consumed = 0;        // Bytes of the file before m_buffer
+  std::string m_str;            // Last parsed string/number
+};
+
+// Encodes Lua values directly to JSON text (with the same format
+// used by json11).
+class JsonEncoder {
+public:
+  JsonEncoder(lua_State* L) : L(L) { }
+
+  const std::string& output() const { return m_out; }
+
+  void encodeValue(int index, int depth) {
+    index = lua_absindex(L, index);
+    switch (lua_type(L, index)) {
+      case LUA_TBOOLEAN:
+        m_out += (lua_toboolean(L, index) ? "true": "false");
+        break;
+      case LUA_TNUMBER:
+        if (lua_isinteger(L, index)) {
+          m_out += fmt::format("{}", lua_tointeger(L, index));
+        }
+        else {
+          const double value = lua_tonumber(L, index);
+          if (std::isfinite(value)) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.17g", value);
+            m_out += buf;
+          }
+          else
+            m_out += "null";
+        }
+        break;
+      case LUA_TSTRING: {
+        size_t len;
+        const char* str = lua_tolstring(L, index, &len);
+        encodeString(str, len);
+        break;
+      }
+      case LUA_TTABLE:
+        if (depth > kMaxJsonDepth)
+          luaL_error(L, "the table is too deep to be encoded as JSON (or it has cycles)");
+        luaL_checkstack(L, 4, nullptr);
+        if (is_array_table(L, index))
+          encodeArray(index, depth);
+        else
+          encodeObject(index, depth);
+        break;
+      case LUA_TUSERDATA:
+        if (auto obj = may_get_obj<JsonObj>(L, index)) {
+          m_out += obj->dump();
+          break;
+        }
+        [[fallthrough]];
+      default:
+        m_out += "null";
+        break;
+    }
+  }
+
+private:
+  void encodeArray(int index, int depth) {
+    m_out.push_back('[');
+    const lua_Integer n = lua_rawlen(L, index);
+    for (lua_Integer i=1; i<=n; ++i) {
+      if (i > 1)
+        m_out += ", ";
+      lua_rawgeti(L, index, i);
+      encodeValue(-1, depth+1);
+      lua_pop(L, 1);
+    }
+    m_out.push_back(']');
+  }
+
+  // Keys are sorted as in json11::Json::object (a std::map)
+  void encodeObject(int index, int depth) {
+    // Values are stored temporarily in an array to get them in the
+    // order of their sorted keys
+    lua_newtable(L);
+    const int valuesIndex = lua_gettop(L);
+    std::vector<std::pair<std::string, int>> keys;
+
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+      const int keyType = lua_type(L, -2);
+      if (keyType == LUA_TSTRING || keyType == LUA_TNUMBER) {
+        // Convert a copy of the key, lua_tolstring() would modify
+        // numeric keys and break lua_next()
+        lua_pushvalue(L, -2);
+        size_t len;
+        const char* key = lua_tolstring(L, -1, &len);
+        keys.emplace_back(std::string(key, len), int(keys.size()+1));
+        lua_pop(L, 1);
+        lua_rawseti(L, valuesIndex, keys.size());
+      }
+      else {
+        lua_pop(L, 1);
+      }
+    }
+
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.first < b.first;
+                     });
+
+    m_out.push_back('{');
+    for (size_t i=0; i<keys.size(); ++i) {
+      // Skip repeated keys (e.g. 1 and "1")
+      if (i > 0 && keys[i].first == keys[i-1].first)
+        continue;
+      if (i > 0)
+        m_out += ", ";
+      encodeString(keys[i].first.c_str(), keys[i].first.size());
+      m_out += ": ";
+      lua_rawgeti(L, valuesIndex, keys[i].second);
+      encodeValue(-1, depth+1);
+      lua_pop(L, 1);
+    }
+    m_out.push_back('}');
+    lua_pop(L, 1);              // Pop the values table
+  }
+
+  void encodeString(const char* str, size_t len) {
+    m_out.push_back('"');
+    for (size_t i=0; i<len; ++i) {
+      const unsigned char chr = str[i];
+      switch (chr) {
+        case '\\': m_out += "\\\\"; break;
+        case '"': m_out += "\\\""; break;
+        case '\b': m_out += "\\b"; break;
+        case '\f': m_out += "\\f"; break;
+        case '\n': m_out += "\\n"; break;
+        case '\r': m_out += "\\r"; break;
+        case '\t': m_out += "\\t"; break;
+        default:
+          if (chr < 0x20) {
+            m_out += fmt::format("\\u{:04x}", int(chr));
+          }
+          // U+2028 and U+2029 are escaped as in json11
+          else if (chr == 0xe2 && i+2 < len &&
+                   (unsigned char)str[i+1] == 0x80 &&
+                   ((unsigned char)str[i+2] == 0xa8 ||
+                    (unsigned char)str[i+2] == 0xa9)) {
+            m_out += ((unsigned char)str[i+2] == 0xa8 ? "\\u2028": "\\u2029");
+            i += 2;
+          }
+          else {
+            m_out.push_back(char(chr));
+          }
+          break;
+      }
+    }
+    m_out.push_back('"');
+  }
+
+  lua_State* L;
+  std::string m_out;
+};
+
 int JsonObj_gc(lua_State* L)
 {
   get_obj<JsonObj>(L, 1)->~JsonObj();
@@ -254,12 +748,40 @@ int Json_encode(lua_State* L)
   }
   // Encode a Lua table
   else if (lua_istable(L, 1)) {
-    lua_pushstring(L, get_json_value(L, 1).dump().c_str());
+    JsonEncoder encoder(L);
+    encoder.encodeValue(1, 0);
+    lua_pushlstring(L, encoder.output().c_str(), encoder.output().size());
     return 1;
   }
   return 0;
 }
 
+// Parses a JSON string directly into Lua tables/values
+int Json_parse(lua_State* L)
+{
+  size_t len;
+  const char* s = luaL_checklstring(L, 1, &len);
+  JsonParser(L, s, len).parse();
+  return 1;
+}
+
+// Parses a JSON file directly into Lua tables/values
+int Json_parseFile(lua_State* L)
+{
+  const char* fn = luaL_checkstring(L, 1);
+  const std::string absFn = base::get_absolute_path(fn);
+  if (!ask_access(L, absFn.c_str(), FileAccessMode::Read, ResourceType::File))
+    return luaL_error(L, "script doesn't have access to open file %s",
+                      absFn.c_str());
+
+  base::FileHandle f(base::open_file(absFn, "rb"));
+  if (!f)
+    return luaL_error(L, "cannot open file %s", absFn.c_str());
+
+  JsonParser(L, f.get()).parse();
+  return 1;
+}
+
 const luaL_Reg JsonObj_methods[] = {
   { "__gc",       JsonObj_gc },
   { "__eq",       JsonObj_eq },
@@ -284,6 +806,8 @@ const luaL_Reg JsonArrayIterator_methods[] = {
 const luaL_Reg Json_methods[] = {
   { "decode",     Json_decode },
   { "encode",     Json_encode },
+  { "parse",      Json_parse },
+  { "parseFile",  Json_parseFile },
   { nullptr,      nullptr }
 };
 
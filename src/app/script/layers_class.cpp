@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -26,12 +26,10 @@ namespace {
 
 struct LayersObj {
   ObjectIds layers;
+  ObjectVersion version = 0;  // Version of the group (when cached)
 
-  LayersObj(Sprite* sprite) {
-    for (const Layer* layer : sprite->root()->layers())
-      layers.push_back(layer->id());
-  }
-  LayersObj(LayerGroup* group) {
+  LayersObj(LayerGroup* group)
+    : version(group->version()) {
     for (const Layer* layer : group->layers())
       layers.push_back(layer->id());
   }
@@ -101,12 +99,27 @@ void register_layers_class(lua_State* L)
 
 void push_sprite_layers(lua_State* L, Sprite* sprite)
 {
-  push_new<LayersObj>(L, sprite);
+  push_group_layers(L, sprite->root());
 }
 
 void push_group_layers(lua_State* L, LayerGroup* group)
 {
+  // Reuse the previous list of layers if the group wasn't modified
+  push_docobj_cache(L, get_mtname<LayersObj>());
+  if (lua_rawgeti(L, -1, group->id()) == LUA_TUSERDATA) {
+    auto obj = get_obj<LayersObj>(L, -1);
+    if (obj->version == group->version() &&
+        int(obj->layers.size()) == group->layersCount()) {
+      lua_remove(L, -2);
+      return;
+    }
+  }
+  lua_pop(L, 1);
+
   push_new<LayersObj>(L, group);
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, -3, group->id());
+  lua_remove(L, -2);
 }
 
 void push_layers(lua_State* L, const ObjectIds& layers)
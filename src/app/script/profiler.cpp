@@ -0,0 +1,351 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/profiler.h"
+
+#include "app/script/luacpp.h"
+#include "base/debug.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+Profiler* g_profiler = nullptr;
+
+// Converts a metatable name like "ImageObj" or "gfx::ColorSpace" to
+// the name used in scripts ("Image", "ColorSpace").
+std::string class_name_from_mtname(std::string name)
+{
+  const auto pos = name.rfind("::");
+  if (pos != std::string::npos)
+    name.erase(0, pos+2);
+  if (name.size() > 3 && name.compare(name.size()-3, 3, "Obj") == 0)
+    name.erase(name.size()-3);
+  return name;
+}
+
+} // anonymous namespace
+
+Profiler::Profiler(lua_State* L)
+  : L(L)
+{
+}
+
+Profiler::~Profiler()
+{
+  stop();
+}
+
+bool Profiler::start()
+{
+  if (m_running)
+    return true;
+
+  // Other hook (e.g. the debugger) is already installed
+  if (lua_gethook(L))
+    return false;
+
+  m_functions.clear();
+  m_index.clear();
+  m_stack.clear();
+  m_nodes.clear();
+  m_nodes.emplace_back(-1, -1);   // Root node
+  collectNativeNames();
+
+  g_profiler = this;
+  m_running = true;
+  lua_sethook(L, &Profiler::hook, LUA_MASKCALL | LUA_MASKRET, 0);
+  return true;
+}
+
+void Profiler::stop()
+{
+  if (!m_running)
+    return;
+
+  lua_sethook(L, nullptr, 0, 0);
+  m_running = false;
+  g_profiler = nullptr;
+
+  // Functions that are still running are accounted until now
+  const auto now = Clock::now();
+  while (!m_stack.empty())
+    onReturn(now);
+}
+
+std::vector<Profiler::FunctionStats> Profiler::functions() const
+{
+  std::vector<FunctionStats> result = m_functions;
+  std::sort(result.begin(), result.end(),
+            [](const FunctionStats& a, const FunctionStats& b) {
+              return a.selfTime > b.selfTime;
+            });
+  return result;
+}
+
+void Profiler::writeReport(std::ostream& os, int maxFunctions) const
+{
+  const auto funcs = functions();
+  int64_t total = 0;
+  for (const auto& f : funcs)
+    total += f.selfTime;
+
+  os << fmt::format("{:>10} {:>7} {:>10} {:>10}  {}\n",
+                    "Calls", "Self%", "Self(ms)", "Total(ms)", "Function");
+  for (const auto& f : funcs) {
+    if (maxFunctions-- == 0)
+      break;
+    os << fmt::format("{:>10} {:>6.2f}% {:>10.3f} {:>10.3f}  {}{}\n",
+                      f.calls,
+                      total > 0 ? 100.0 * f.selfTime / total: 0.0,
+                      f.selfTime / 1000000.0,
+                      f.totalTime / 1000000.0,
+                      f.name,
+                      f.native ? " [C]": "");
+  }
+}
+
+void Profiler::writeFoldedStacks(std::ostream& os) const
+{
+  std::vector<int> path;
+  for (int i=1; i<int(m_nodes.size()); ++i) {
+    const int64_t us = m_nodes[i].selfTime / 1000;
+    if (us <= 0)
+      continue;
+
+    path.clear();
+    for (int j=i; j > 0; j=m_nodes[j].parent)
+      path.push_back(m_nodes[j].function);
+
+    for (auto it=path.rbegin(); it!=path.rend(); ++it) {
+      if (it != path.rbegin())
+        os << ';';
+      // Semicolons separate the frames of the stack
+      std::string name = m_functions[*it].name;
+      std::replace(name.begin(), name.end(), ';', ',');
+      os << name;
+    }
+    os << ' ' << us << '\n';
+  }
+}
+
+// static
+void Profiler::hook(lua_State* L, lua_Debug* ar)
+{
+  // Take the time as soon as possible to discard the time spent in
+  // the hook itself
+  const auto now = Clock::now();
+  Profiler* self = g_profiler;
+  if (!self)
+    return;
+
+  switch (ar->event) {
+    case LUA_HOOKCALL:
+      self->onCall(L, ar, false);
+      break;
+    case LUA_HOOKTAILCALL:
+      self->onCall(L, ar, true);
+      break;
+    case LUA_HOOKRET: {
+      // Errors unwind the stack without return events, so we look
+      // for the frame of the function that is returning.
+      const int function = self->getFunction(L, ar);
+      auto& stack = self->m_stack;
+      auto it = std::find_if(stack.rbegin(), stack.rend(),
+                             [function](const Frame& frame) {
+                               return frame.function == function;
+                             });
+      // A function called before the profiler was started
+      if (it == stack.rend())
+        break;
+
+      const int n = int(it - stack.rbegin());
+      for (int i=0; i<n; ++i)
+        self->onReturn(now);
+
+      // Pop the frame of the returning function and the frames that
+      // were replaced by tail calls
+      bool tailCall;
+      do {
+        tailCall = self->m_stack.back().tailCall;
+        self->onReturn(now);
+      } while (tailCall && !self->m_stack.empty());
+      break;
+    }
+  }
+}
+
+void Profiler::onCall(lua_State* L, lua_Debug* ar, bool tailCall)
+{
+  const int function = getFunction(L, ar);
+  const int parentNode = (m_stack.empty() ? 0: m_stack.back().node);
+
+  FunctionStats& stats = m_functions[function];
+  ++stats.calls;
+  ++stats.active;
+
+  m_stack.push_back(Frame{ function,
+                           getChildNode(parentNode, function),
+                           tailCall,
+                           Clock::now(),
+                           0 });
+}
+
+void Profiler::onReturn(Clock::time_point now)
+{
+  ASSERT(!m_stack.empty());
+  const Frame frame = m_stack.back();
+  m_stack.pop_back();
+
+  const int64_t elapsed =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now - frame.start).count();
+  const int64_t self = std::max<int64_t>(0, elapsed - frame.childrenTime);
+
+  FunctionStats& stats = m_functions[frame.function];
+  stats.selfTime += self;
+  // Count the inclusive time of recursive functions just once
+  if (--stats.active == 0)
+    stats.totalTime += elapsed;
+  m_nodes[frame.node].selfTime += self;
+
+  if (!m_stack.empty())
+    m_stack.back().childrenTime += elapsed;
+}
+
+int Profiler::getFunction(lua_State* L, lua_Debug* ar)
+{
+  lua_getinfo(L, "Sf", ar);
+  const lua_CFunction cfunc = lua_tocfunction(L, -1);
+  lua_pop(L, 1);
+
+  // Lua functions are identified by their source/line (so different
+  // closures of the same function are counted together)
+  const Key key = (cfunc ? Key((const void*)cfunc, -1):
+                           Key((const void*)ar->source, ar->linedefined));
+  auto it = m_index.find(key);
+  if (it != m_index.end())
+    return it->second;
+
+  FunctionStats stats;
+  if (cfunc) {
+    stats.native = true;
+    auto nameIt = m_nativeNames.find((const void*)cfunc);
+    if (nameIt != m_nativeNames.end())
+      stats.name = nameIt->second;
+    else {
+      lua_getinfo(L, "n", ar);
+      stats.name = (ar->name ? ar->name: "?");
+    }
+  }
+  else if (std::strcmp(ar->what, "main") == 0) {
+    stats.name = fmt::format("main chunk ({})", ar->short_src);
+  }
+  else {
+    lua_getinfo(L, "n", ar);
+    stats.name = fmt::format("{} ({}:{})",
+                             ar->name ? ar->name: "?",
+                             ar->short_src, ar->linedefined);
+  }
+
+  const int function = int(m_functions.size());
+  m_functions.push_back(std::move(stats));
+  m_index[key] = function;
+  return function;
+}
+
+int Profiler::getChildNode(int parent, int function)
+{
+  auto it = m_nodes[parent].children.find(function);
+  if (it != m_nodes[parent].children.end())
+    return it->second;
+
+  const int node = int(m_nodes.size());
+  m_nodes.emplace_back(function, parent);
+  m_nodes[parent].children[function] = node;
+  return node;
+}
+
+// Gets the names of native functions from the metatables of the
+// registered classes (methods and __getters/__setters of properties)
+// and the tables in the global namespace.
+void Profiler::collectNativeNames()
+{
+  m_nativeNames.clear();
+
+  lua_pushvalue(L, LUA_REGISTRYINDEX);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING &&
+        lua_istable(L, -1)) {
+      const char* mtname = lua_tostring(L, -2);
+      if (mtname[0] != '_')
+        collectNativeNamesFromTable(class_name_from_mtname(mtname), ":");
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  lua_pushglobaltable(L);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      const char* name = lua_tostring(L, -2);
+      if (lua_iscfunction(L, -1))
+        m_nativeNames.emplace((const void*)lua_tocfunction(L, -1), name);
+      else if (lua_istable(L, -1) && std::strcmp(name, "_G") != 0)
+        collectNativeNamesFromTable(name, ".");
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+// Collects the names of the C functions of the table on the top of
+// the stack.
+void Profiler::collectNativeNamesFromTable(const std::string& prefix,
+                                           const char* sep)
+{
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      const char* name = lua_tostring(L, -2);
+      if (lua_iscfunction(L, -1)) {
+        m_nativeNames.emplace((const void*)lua_tocfunction(L, -1),
+                              prefix + sep + name);
+      }
+      else if (lua_istable(L, -1) &&
+               (std::strcmp(name, "__getters") == 0 ||
+                std::strcmp(name, "__setters") == 0)) {
+        const bool setters = (name[2] == 's');
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+          if (lua_type(L, -2) == LUA_TSTRING && lua_iscfunction(L, -1)) {
+            std::string prop = prefix + "." + lua_tostring(L, -2);
+            if (setters)
+              prop.push_back('=');
+            m_nativeNames.emplace((const void*)lua_tocfunction(L, -1),
+                                  std::move(prop));
+          }
+          lua_pop(L, 1);
+        }
+      }
+    }
+    lua_pop(L, 1);
+  }
+}
+
+} // namespace script
+} // namespace app
@@ -0,0 +1,109 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_PROFILER_H_INCLUDED
+#define APP_SCRIPT_PROFILER_H_INCLUDED
+#pragma once
+
+#ifndef ENABLE_SCRIPTING
+  #error ENABLE_SCRIPTING must be defined
+#endif
+
+#include "app/script/engine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace app {
+namespace script {
+
+  // Collects the time spent in each Lua function and each native API
+  // function (e.g. Image:drawPixel) using the Lua call/return hooks.
+  // The results can be reported as a table of functions sorted by
+  // self time, or as folded stacks ("a;b;c <microseconds>" lines)
+  // which can be loaded in flamegraph.pl or speedscope.
+  class Profiler {
+  public:
+    struct FunctionStats {
+      std::string name;
+      bool native = false;
+      int64_t calls = 0;
+      int64_t totalTime = 0;    // Inclusive time (nanoseconds)
+      int64_t selfTime = 0;     // Exclusive time (nanoseconds)
+      int active = 0;           // Active calls (for recursive functions)
+    };
+
+    Profiler(lua_State* L);
+    ~Profiler();
+
+    bool isRunning() const { return m_running; }
+
+    // Returns false if the profiler cannot be started because other
+    // hook is already installed (e.g. the debugger is running).
+    bool start();
+    void stop();
+
+    // Statistics of each function sorted by self time.
+    std::vector<FunctionStats> functions() const;
+
+    // Writes a table with the "maxFunctions" functions with longer
+    // self time.
+    void writeReport(std::ostream& os, int maxFunctions) const;
+
+    // Writes the folded stacks with the self time (in microseconds)
+    // of each stack.
+    void writeFoldedStacks(std::ostream& os) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    using Key = std::pair<const void*, int>;
+
+    struct Frame {
+      int function;
+      int node;
+      bool tailCall;
+      Clock::time_point start;
+      int64_t childrenTime;
+    };
+
+    // Node of the tree of call stacks
+    struct StackNode {
+      int function;
+      int parent;
+      int64_t selfTime = 0;
+      std::map<int, int> children;
+      StackNode(int function, int parent)
+        : function(function), parent(parent) { }
+    };
+
+    static void hook(lua_State* L, lua_Debug* ar);
+    void onCall(lua_State* L, lua_Debug* ar, bool tailCall);
+    void onReturn(Clock::time_point now);
+    int getFunction(lua_State* L, lua_Debug* ar);
+    int getChildNode(int parent, int function);
+    void collectNativeNames();
+    void collectNativeNamesFromTable(const std::string& prefix,
+                                     const char* sep);
+
+    lua_State* L;
+    bool m_running = false;
+    std::vector<FunctionStats> m_functions;
+    std::map<Key, int> m_index;
+    std::unordered_map<const void*, std::string> m_nativeNames;
+    std::vector<Frame> m_stack;
+    std::vector<StackNode> m_nodes;
+  };
+
+} // namespace script
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -48,16 +48,20 @@
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
 #include "app/script/userdata.h"
+#include "app/util/doc_mem_stats.h"
+#include "app/util/undo_mem_stats.h"
 #include "app/site.h"
 #include "app/transaction.h"
 #include "app/tx.h"
 #include "app/ui/doc_view.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
+#include "doc/duplicated_images.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 #include "doc/palette.h"
+#include "doc/primitives.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
@@ -732,6 +736,58 @@ int Sprite_newTile(lua_State* L)
   return 1;
 }
 
+// Sprite:newTiles(tileset, images [, unique]) adds all the images as
+// new tiles in just one undoable action. If "unique" is true (the
+// default), images that are already in the tileset (or repeated in
+// the array) are not added again. Returns an array with the tile
+// value (index and flags) of each image.
+int Sprite_newTiles(lua_State* L)
+{
+  auto sprite = get_docobj<Sprite>(L, 1);
+  auto ts = get_docobj<Tileset>(L, 2);
+  if (ts->sprite() != sprite)
+    return luaL_error(L, "the tileset belongs to another sprite");
+  luaL_checktype(L, 3, LUA_TTABLE);
+  const bool unique = (lua_isnone(L, 4) ? true: lua_toboolean(L, 4));
+
+  // Copy and validate all images before modifying the tileset
+  const int n = int(lua_rawlen(L, 3));
+  std::vector<ImageRef> tiles;
+  tiles.reserve(n);
+  for (int i=1; i<=n; ++i) {
+    lua_rawgeti(L, 3, i);
+    const Image* img = may_get_image_from_arg(L, -1);
+    if (!img)
+      return luaL_error(L, "item %d is not an image", i);
+    if (img->size() != ts->grid().tileSize() ||
+        img->pixelFormat() != sprite->pixelFormat())
+      return luaL_error(L, "image %d doesn't match the tileset size/color mode", i);
+    lua_pop(L, 1);
+
+    ImageRef tile(Image::createCopy(img));
+    preprocess_transparent_pixels(tile.get());
+    tiles.push_back(tile);
+  }
+
+  lua_createtable(L, n, 0);
+  Tx tx(sprite);
+  for (int i=0; i<n; ++i) {
+    tile_index ti;
+    tile_flags flags = 0;
+    if (!unique ||
+        !ts->findTileIndex(tiles[i], ts->matchFlags(), ti, flags)) {
+      auto addTile = new cmd::AddTile(ts, tiles[i]);
+      tx(addTile);
+      ti = addTile->tileIndex();
+      flags = 0;
+    }
+    lua_pushinteger(L, doc::tile(ti, flags));
+    lua_rawseti(L, -2, i+1);
+  }
+  tx.commit();
+  return 1;
+}
+
 int Sprite_deleteTile(lua_State* L)
 {
   auto sprite = get_docobj<Sprite>(L, 1);
@@ -998,6 +1054,109 @@ int Sprite_get_tileManagementPlugin(lua_State* L)
   return 1;
 }
 
+// Returns a table with the memory used by the undo history, e.g.
+// to inspect it from the developer console:
+//   print(json.encode(app.sprite.undoMemoryStats))
+int Sprite_get_undoMemoryStats(lua_State* L)
+{
+  const auto sprite = get_docobj<Sprite>(L, 1);
+  const Doc* doc = static_cast<Doc*>(sprite->document());
+  const UndoMemStats stats = calculate_undo_mem_stats(doc->undoHistory());
+
+  auto pushGroups = [L](const std::vector<UndoMemStats::Group>& groups,
+                        const char* field) {
+    lua_newtable(L);
+    int i = 0;
+    for (const auto& group : groups) {
+      lua_newtable(L);
+      lua_pushstring(L, group.name.c_str());
+      lua_setfield(L, -2, "name");
+      setfield_uinteger(L, "size", group.size);
+      setfield_integer(L, "count", group.count);
+      lua_rawseti(L, -2, ++i);
+    }
+    lua_setfield(L, -2, field);
+  };
+
+  lua_newtable(L);
+  setfield_uinteger(L, "totalSize", stats.totalSize);
+  pushGroups(stats.byType, "byType");
+  pushGroups(stats.byLayer, "byLayer");
+
+  lua_newtable(L);
+  int i = 0;
+  for (const auto& state : stats.states) {
+    lua_newtable(L);
+    lua_pushstring(L, state.label.c_str());
+    lua_setfield(L, -2, "label");
+    setfield_uinteger(L, "size", state.size);
+    setfield_integer(L, "age", state.age);
+    lua_pushboolean(L, state.compressed);
+    lua_setfield(L, -2, "compressed");
+    lua_pushboolean(L, state.spilled);
+    lua_setfield(L, -2, "spilled");
+    lua_rawseti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "states");
+
+  lua_newtable(L);
+  i = 0;
+  for (const auto& cmd : stats.largeCmds) {
+    lua_newtable(L);
+    lua_pushstring(L, cmd.type.c_str());
+    lua_setfield(L, -2, "type");
+    lua_pushstring(L, cmd.label.c_str());
+    lua_setfield(L, -2, "label");
+    lua_pushstring(L, cmd.layer.c_str());
+    lua_setfield(L, -2, "layer");
+    setfield_uinteger(L, "size", cmd.size);
+    setfield_integer(L, "age", cmd.age);
+    lua_rawseti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "largeCommands");
+  return 1;
+}
+
+// Returns a table with the memory used by cel images that are equal
+// to other images of the sprite (memory that could be saved linking
+// their cels), e.g.:
+//   print(json.encode(app.sprite.duplicatedImagesStats))
+int Sprite_get_duplicatedImagesStats(lua_State* L)
+{
+  const auto sprite = get_docobj<Sprite>(L, 1);
+  const doc::DuplicatedImagesStats stats =
+    doc::calculate_duplicated_images_stats(sprite);
+
+  lua_newtable(L);
+  setfield_integer(L, "images", stats.images);
+  setfield_integer(L, "duplicatedImages", stats.duplicatedImages);
+  setfield_uinteger(L, "size", stats.bytes);
+  setfield_uinteger(L, "duplicatedSize", stats.duplicatedBytes);
+  return 1;
+}
+
+// Memory used by the sprite, e.g. to know which sprite or undo
+// history is using more memory:
+//
+//   for _,s in ipairs(app.sprites) do
+//     print(s.filename, json.encode(s.memoryUsage))
+//   end
+int Sprite_get_memoryUsage(lua_State* L)
+{
+  const auto sprite = get_docobj<Sprite>(L, 1);
+  const Doc* doc = static_cast<Doc*>(sprite->document());
+  const DocMemStats stats = calculate_doc_mem_stats(doc);
+
+  lua_newtable(L);
+  setfield_uinteger(L, "images", stats.images);
+  setfield_uinteger(L, "tilesets", stats.tilesets);
+  setfield_uinteger(L, "undoHistory", stats.undoHistory);
+  setfield_uinteger(L, "renderCache", stats.renderCache);
+  setfield_uinteger(L, "thumbnails", stats.thumbnails);
+  setfield_uinteger(L, "total", stats.total());
+  return 1;
+}
+
 int Sprite_set_tileManagementPlugin(lua_State* L)
 {
   auto sprite = get_docobj<Sprite>(L, 1);
@@ -1046,6 +1205,7 @@ const luaL_Reg Sprite_methods[] = {
   { "newTileset", Sprite_newTileset },
   { "deleteTileset", Sprite_deleteTileset },
   { "newTile", Sprite_newTile },
+  { "newTiles", Sprite_newTiles },
   { "deleteTile", Sprite_deleteTile },
   { nullptr, nullptr }
 };
@@ -1077,6 +1237,9 @@ const Property Sprite_properties[] = {
   { "pixelRatio", Sprite_get_pixelRatio, Sprite_set_pixelRatio },
   { "events", Sprite_get_events, nullptr },
   { "tileManagementPlugin", Sprite_get_tileManagementPlugin, Sprite_set_tileManagementPlugin },
+  { "undoMemoryStats", Sprite_get_undoMemoryStats, nullptr },
+  { "duplicatedImagesStats", Sprite_get_duplicatedImagesStats, nullptr },
+  { "memoryUsage", Sprite_get_memoryUsage, nullptr },
   { nullptr, nullptr, nullptr }
 };
 
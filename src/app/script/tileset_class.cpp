@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -14,6 +14,8 @@
 #include "app/script/engine.h"
 #include "app/script/luacpp.h"
 #include "app/script/userdata.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
 #include "doc/tileset.h"
 
 namespace app {
@@ -57,6 +59,29 @@ int Tileset_tile(lua_State* L)
   return 1;
 }
 
+// Tileset:findTile(image) returns the tile value (index and flags)
+// of the tile that matches the given image (using the tileset hash
+// table), or nil if the image is not in the tileset.
+int Tileset_findTile(lua_State* L)
+{
+  auto tileset = get_docobj<Tileset>(L, 1);
+  const Image* img = get_image_from_arg(L, 2);
+  if (img->size() != tileset->grid().tileSize() ||
+      img->pixelFormat() != tileset->sprite()->pixelFormat())
+    return 0;
+
+  ImageRef tileImage(Image::createCopy(img));
+  preprocess_transparent_pixels(tileImage.get());
+
+  tile_index ti;
+  tile_flags flags;
+  if (tileset->findTileIndex(tileImage, tileset->matchFlags(), ti, flags)) {
+    lua_pushinteger(L, doc::tile(ti, flags));
+    return 1;
+  }
+  return 0;
+}
+
 int Tileset_get_name(lua_State* L)
 {
   auto tileset = get_docobj<Tileset>(L, 1);
@@ -104,6 +129,7 @@ const luaL_Reg Tileset_methods[] = {
   { "__len", Tileset_len },
   { "getTile", Tileset_getTile },
   { "tile", Tileset_tile },
+  { "findTile", Tileset_findTile },
   { nullptr, nullptr }
 };
 
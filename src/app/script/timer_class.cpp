@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -14,6 +14,7 @@
 #include "ui/timer.h"
 
 #include <algorithm>
+#include <memory>
 
 namespace app {
 namespace script {
@@ -42,7 +43,14 @@ public:
     }
   }
 
+  // True while the "ontick" handler is running (it can yield and
+  // continue in the next iteration of the UI loop). Shared with the
+  // handler because the timer could be collected before it finishes.
+  const std::shared_ptr<bool>& busy() const { return m_busy; }
+
 private:
+  std::shared_ptr<bool> m_busy = std::make_shared<bool>(false);
+
   // Reference used to keep the timer alive (so it's not garbage
   // collected) when it's running.
   int m_runningRef = LUA_REFNIL;
@@ -65,7 +73,8 @@ int Timer_new(lua_State* L)
 
       timer->Tick.connect(
         [timer, L]() {
-          if (timer->runningRef() == LUA_REFNIL)
+          // Skip ticks while the previous one is still running
+          if (timer->runningRef() == LUA_REFNIL || *timer->busy())
             return;
 
           try {
@@ -74,12 +83,10 @@ int Timer_new(lua_State* L)
             lua_rawgeti(L, LUA_REGISTRYINDEX, timer->runningRef());
             lua_getuservalue(L, -1);
             if (lua_isfunction(L, -1)) {
-              if (lua_pcall(L, 0, 0, 0)) {
-                if (const char* s = lua_tostring(L, -1))
-                  App::instance()
-                    ->scriptEngine()
-                    ->consolePrint(s);
-              }
+              auto busy = timer->busy();
+              *busy = true;
+              call_event_handler(L, 0, "ontick",
+                                 [busy]{ *busy = false; });
             }
             else {
               lua_pop(L, 1); // Pop the value which should have been a function
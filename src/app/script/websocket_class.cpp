@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,14 +13,19 @@
 #include "app/script/engine.h"
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
+#include "doc/image.h"
 #include "ui/timer.h"
 #include "ui/manager.h"
 #include "ui/system.h"
 
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXWebSocket.h>
-#include <sstream>
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <set>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace script {
@@ -33,6 +38,18 @@ namespace {
 static std::unique_ptr<ui::Timer> g_timer;
 static std::set<ix::WebSocket*> g_connections;
 
+// "ondrain" callback, called when the amount of data waiting to be
+// sent goes below the "drainthreshold" (so a script sending a lot of
+// data can wait before sending more data).
+struct DrainHandler {
+  lua_State* L;
+  int ref;
+  size_t threshold;
+  bool waiting = false;
+};
+
+static std::map<ix::WebSocket*, DrainHandler> g_drainHandlers;
+
 static void close_ws(ix::WebSocket* ws)
 {
   ws->stop();
@@ -42,6 +59,86 @@ static void close_ws(ix::WebSocket* ws)
     g_timer.reset();
 }
 
+static void check_drain_handlers()
+{
+  std::vector<ix::WebSocket*> drained;
+  for (auto& it : g_drainHandlers) {
+    DrainHandler& handler = it.second;
+    if (handler.waiting &&
+        it.first->bufferedAmount() <= handler.threshold) {
+      handler.waiting = false;
+      drained.push_back(it.first);
+    }
+  }
+
+  for (ix::WebSocket* ws : drained) {
+    // The WebSocket could be closed/deleted from other callback
+    auto it = g_drainHandlers.find(ws);
+    if (it == g_drainHandlers.end())
+      continue;
+
+    lua_State* L = it->second.L;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.ref);
+    lua_pushinteger(L, ws->bufferedAmount());
+    if (lua_pcall(L, 1, 0, 0)) {
+      if (const char* s = lua_tostring(L, -1)) {
+        App::instance()->scriptEngine()->consolePrint(s);
+        ws->stop();
+      }
+      lua_pop(L, 1);
+    }
+  }
+}
+
+// Called after sending data to start waiting the "ondrain" event if
+// the data couldn't be sent immediately.
+static void wait_drain(ix::WebSocket* ws)
+{
+  auto it = g_drainHandlers.find(ws);
+  if (it != g_drainHandlers.end() &&
+      ws->bufferedAmount() > it->second.threshold) {
+    it->second.waiting = true;
+  }
+}
+
+// Appends the bytes of the argument at the given index to "data". The
+// argument can be a string, an Image (all its pixels), or an
+// ImageView (the pixels inside the view bounds). Returns the number
+// of bytes of the argument (when "data" is nullptr just the size is
+// calculated).
+static size_t append_binary_arg(lua_State* L, int index, std::string* data)
+{
+  gfx::Rect bounds;
+  const doc::Image* image = may_get_image_view_from_arg(L, index, bounds);
+  if (!image) {
+    image = may_get_image_from_arg(L, index);
+    if (image)
+      bounds = image->bounds();
+  }
+
+  if (image) {
+    const size_t rowBytes = image->bytesPerPixel() * bounds.w;
+    const size_t size = rowBytes * bounds.h;
+    if (data) {
+      // Full rows are contiguous in memory
+      if (bounds.x == 0 && bounds.w == image->width()) {
+        data->append((const char*)image->getPixelAddress(0, bounds.y), size);
+      }
+      else {
+        for (int y=bounds.y; y<bounds.y2(); ++y)
+          data->append((const char*)image->getPixelAddress(bounds.x, y), rowBytes);
+      }
+    }
+    return size;
+  }
+
+  size_t bufLen = 0;
+  const char* buf = lua_tolstring(L, index, &bufLen);
+  if (data && buf)
+    data->append(buf, bufLen);
+  return bufLen;
+}
+
 int WebSocket_new(lua_State* L)
 {
   static std::once_flag f;
@@ -90,12 +187,14 @@ int WebSocket_new(lua_State* L)
         [L, ws, onreceiveRef](const ix::WebSocketMessagePtr& msg) {
           int msgType =
             (msg->binary ? MESSAGE_TYPE_BINARY : static_cast<int>(msg->type));
-          std::string msgData = msg->str;
+          // Shared to avoid copying big messages each time the
+          // function is copied
+          auto msgData = std::make_shared<std::string>(msg->str);
 
           ui::execute_from_ui_thread([=]() {
             lua_rawgeti(L, LUA_REGISTRYINDEX, onreceiveRef);
             lua_pushinteger(L, msgType);
-            lua_pushlstring(L, msgData.c_str(), msgData.length());
+            lua_pushlstring(L, msgData->c_str(), msgData->length());
 
             if (lua_pcall(L, 2, 0, 0)) {
               if (const char* s = lua_tostring(L, -1)) {
@@ -111,6 +210,22 @@ int WebSocket_new(lua_State* L)
       ws->setOnMessageCallback([](const ix::WebSocketMessagePtr& msg) { });
       lua_pop(L, 1);
     }
+
+    type = lua_getfield(L, 1, "ondrain");
+    if (type == LUA_TFUNCTION) {
+      lua_getfield(L, 1, "drainthreshold");
+      const size_t threshold = std::max<lua_Integer>(0, lua_tointeger(L, -1));
+      lua_pop(L, 1);
+
+      DrainHandler handler;
+      handler.L = L;
+      handler.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      handler.threshold = threshold;
+      g_drainHandlers[ws] = handler;
+    }
+    else {
+      lua_pop(L, 1);
+    }
   }
 
   return 1;
@@ -120,6 +235,13 @@ int WebSocket_gc(lua_State* L)
 {
   auto ws = get_ptr<ix::WebSocket>(L, 1);
   close_ws(ws);
+
+  auto it = g_drainHandlers.find(ws);
+  if (it != g_drainHandlers.end()) {
+    luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+    g_drainHandlers.erase(it);
+  }
+
   delete ws;
   return 0;
 }
@@ -144,6 +266,7 @@ int WebSocket_sendText(lua_State* L)
   if (!ws->sendText(data.str()).success) {
     return luaL_error(L, "WebSocket failed to send text");
   }
+  wait_drain(ws);
   return 0;
 }
 
@@ -155,18 +278,21 @@ int WebSocket_sendBinary(lua_State* L)
     return luaL_error(L, "WebSocket is not connected, can't send data");
   }
 
-  std::stringstream data;
-  int argc = lua_gettop(L);
+  // Calculate the final size first to allocate the message just once
+  const int argc = lua_gettop(L);
+  size_t size = 0;
+  for (int i = 2; i <= argc; i++)
+    size += append_binary_arg(L, i, nullptr);
 
-  for (int i = 2; i <= argc; i++) {
-    size_t bufLen;
-    const char* buf = lua_tolstring(L, i, &bufLen);
-    data.write(buf, bufLen);
-  }
+  std::string data;
+  data.reserve(size);
+  for (int i = 2; i <= argc; i++)
+    append_binary_arg(L, i, &data);
 
-  if (!ws->sendBinary(data.str()).success) {
+  if (!ws->sendBinary(data).success) {
     return luaL_error(L, "WebSocket failed to send data");
   }
+  wait_drain(ws);
   return 0;
 }
 
@@ -196,6 +322,7 @@ int WebSocket_connect(lua_State* L)
   if (g_connections.empty()) {
     if (App::instance()->isGui()) {
       g_timer = std::make_unique<ui::Timer>(33, ui::Manager::getDefault());
+      g_timer->Tick.connect(&check_drain_handlers);
       g_timer->start();
     }
   }
@@ -218,6 +345,13 @@ int WebSocket_get_url(lua_State* L)
   return 1;
 }
 
+int WebSocket_get_bufferedAmount(lua_State* L)
+{
+  auto ws = get_ptr<ix::WebSocket>(L, 1);
+  lua_pushinteger(L, ws->bufferedAmount());
+  return 1;
+}
+
 const luaL_Reg WebSocket_methods[] = {
   { "__gc", WebSocket_gc },
   { "close", WebSocket_close },
@@ -230,6 +364,7 @@ const luaL_Reg WebSocket_methods[] = {
 
 const Property WebSocket_properties[] = {
   { "url", WebSocket_get_url, nullptr },
+  { "bufferedAmount", WebSocket_get_bufferedAmount, nullptr },
   { nullptr, nullptr, nullptr }
 };
 
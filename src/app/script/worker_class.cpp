@@ -0,0 +1,746 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/color_mode.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "ui/system.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Max nesting level of tables sent to/from workers (to avoid
+// infinite loops with cyclic tables)
+const int kMaxTableDepth = 64;
+
+// Number of instructions between checks of the canceled flag
+const int kCancelCheckCount = 1000;
+
+// A Lua value that can be sent between the main Lua state and a
+// worker state (Lua values cannot be shared between states). Images
+// are copied so the main thread and the worker never share pixels.
+struct WorkerValue {
+  int type = LUA_TNIL;
+  bool boolean = false;
+  bool isInteger = false;
+  lua_Integer integer = 0;
+  lua_Number number = 0.0;
+  std::string string;
+  std::unique_ptr<doc::Image> image;
+  std::vector<WorkerValue> table;  // Pairs of keys/values
+};
+
+// Image in a worker state (the doc::Image is not shared with the
+// main thread, so it can be modified without locks).
+struct WorkerImage {
+  doc::ImageRef image;
+  WorkerImage(doc::Image* image) : image(image) { }
+};
+
+struct WorkerMessage {
+  enum Type { Message, Done, Error };
+  Type type = Message;
+  WorkerValue value;
+  std::string error;
+};
+
+class Worker;
+
+// Data shared between the Worker object (main thread) and the worker
+// thread.
+class WorkerData : public std::enable_shared_from_this<WorkerData> {
+public:
+  WorkerData(lua_State* L)
+    : L(L)
+    , gui(App::instance() && App::instance()->isGui()) {
+  }
+
+  // Called from the worker thread to send a message to the main
+  // thread.
+  void post(WorkerMessage&& msg) {
+    {
+      const std::lock_guard lock(m_mutex);
+      m_messages.push_back(std::move(msg));
+    }
+
+    // Wake up the main thread (without GUI the messages are
+    // dispatched from Worker:wait())
+    if (gui && !m_dispatchQueued.exchange(true)) {
+      ui::execute_from_ui_thread(
+        [self = shared_from_this()]{
+          self->m_dispatchQueued = false;
+          self->dispatchFromUIThread();
+        });
+    }
+  }
+
+  bool popMessage(WorkerMessage& msg) {
+    const std::lock_guard lock(m_mutex);
+    if (m_messages.empty())
+      return false;
+    msg = std::move(m_messages.front());
+    m_messages.pop_front();
+    return true;
+  }
+
+  void dispatchFromUIThread();
+
+  lua_State* const L;           // Main Lua state
+  const bool gui;
+  Worker* owner = nullptr;      // Accessed only from the main thread
+  std::atomic<bool> running { true };
+  std::atomic<bool> canceled { false };
+
+private:
+  std::mutex m_mutex;
+  std::deque<WorkerMessage> m_messages;
+  std::atomic<bool> m_dispatchQueued { false };
+};
+
+// Code and arguments to run in the worker state.
+struct WorkerJob {
+  std::string code;
+  bool binary = false;
+  WorkerValue input;
+  WorkerValue result;
+};
+
+WorkerData* get_worker_data(lua_State* W)
+{
+  return *(WorkerData**)lua_getextraspace(W);
+}
+
+WorkerValue get_worker_value(lua_State* L, int index,
+                             const bool fromWorker, const int depth = 0)
+{
+  index = lua_absindex(L, index);
+
+  WorkerValue v;
+  v.type = lua_type(L, index);
+  switch (v.type) {
+
+    case LUA_TNIL:
+      break;
+
+    case LUA_TBOOLEAN:
+      v.boolean = lua_toboolean(L, index);
+      break;
+
+    case LUA_TNUMBER:
+      v.isInteger = lua_isinteger(L, index);
+      if (v.isInteger)
+        v.integer = lua_tointeger(L, index);
+      else
+        v.number = lua_tonumber(L, index);
+      break;
+
+    case LUA_TSTRING: {
+      size_t len = 0;
+      const char* s = lua_tolstring(L, index, &len);
+      v.string.assign(s, len);
+      break;
+    }
+
+    case LUA_TTABLE:
+      if (depth >= kMaxTableDepth)
+        luaL_error(L, "tables are nested too deeply to be sent to/from a worker");
+
+      luaL_checkstack(L, 2, nullptr);
+      lua_pushnil(L);
+      while (lua_next(L, index) != 0) {
+        v.table.push_back(get_worker_value(L, -2, fromWorker, depth+1));
+        v.table.push_back(get_worker_value(L, -1, fromWorker, depth+1));
+        lua_pop(L, 1);
+      }
+      break;
+
+    case LUA_TUSERDATA: {
+      const doc::Image* image = nullptr;
+      if (fromWorker) {
+        if (auto obj = may_get_obj<WorkerImage>(L, index))
+          image = obj->image.get();
+      }
+      else
+        image = may_get_image_from_arg(L, index);
+
+      if (image) {
+        v.image.reset(doc::Image::createCopy(image));
+        break;
+      }
+      [[fallthrough]];
+    }
+
+    default:
+      luaL_error(L, "a %s value cannot be sent to/from a worker",
+                 luaL_typename(L, index));
+      break;
+  }
+  return v;
+}
+
+void push_worker_value(lua_State* L, WorkerValue&& v, const bool toWorker)
+{
+  luaL_checkstack(L, 3, nullptr);
+
+  switch (v.type) {
+
+    case LUA_TBOOLEAN:
+      lua_pushboolean(L, v.boolean);
+      break;
+
+    case LUA_TNUMBER:
+      if (v.isInteger)
+        lua_pushinteger(L, v.integer);
+      else
+        lua_pushnumber(L, v.number);
+      break;
+
+    case LUA_TSTRING:
+      lua_pushlstring(L, v.string.c_str(), v.string.size());
+      break;
+
+    case LUA_TTABLE:
+      lua_createtable(L, 0, int(v.table.size()/2));
+      for (size_t i=0; i+1<v.table.size(); i+=2) {
+        push_worker_value(L, std::move(v.table[i]), toWorker);
+        push_worker_value(L, std::move(v.table[i+1]), toWorker);
+        lua_rawset(L, -3);
+      }
+      break;
+
+    case LUA_TUSERDATA:
+      if (toWorker)
+        push_new<WorkerImage>(L, v.image.release());
+      else
+        push_image(L, v.image.release());
+      break;
+
+    default:
+      lua_pushnil(L);
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Functions available in the worker state
+
+int WorkerImage_new(lua_State* W)
+{
+  const int w = luaL_checkinteger(W, 1);
+  const int h = luaL_checkinteger(W, 2);
+  const auto colorMode = (doc::ColorMode)luaL_optinteger(W, 3, int(doc::ColorMode::RGB));
+  if (w < 1 || h < 1)
+    return luaL_error(W, "invalid image size %dx%d", w, h);
+
+  doc::Image* image = doc::Image::create((doc::PixelFormat)colorMode, w, h);
+  doc::clear_image(image, 0);
+  push_new<WorkerImage>(W, image);
+  return 1;
+}
+
+int WorkerImage_gc(lua_State* W)
+{
+  auto obj = get_obj<WorkerImage>(W, 1);
+  obj->~WorkerImage();
+  return 0;
+}
+
+int WorkerImage_getPixel(lua_State* W)
+{
+  const auto obj = get_obj<WorkerImage>(W, 1);
+  const int x = lua_tointeger(W, 2);
+  const int y = lua_tointeger(W, 3);
+  lua_pushinteger(W, doc::get_pixel(obj->image.get(), x, y));
+  return 1;
+}
+
+int WorkerImage_drawPixel(lua_State* W)
+{
+  auto obj = get_obj<WorkerImage>(W, 1);
+  const int x = lua_tointeger(W, 2);
+  const int y = lua_tointeger(W, 3);
+  const doc::color_t color = luaL_checkinteger(W, 4);
+  doc::put_pixel(obj->image.get(), x, y, color);
+  return 0;
+}
+
+int WorkerImage_clear(lua_State* W)
+{
+  auto obj = get_obj<WorkerImage>(W, 1);
+  const doc::color_t color = luaL_optinteger(W, 2, obj->image->maskColor());
+  doc::clear_image(obj->image.get(), color);
+  return 0;
+}
+
+int WorkerImage_get_width(lua_State* W)
+{
+  const auto obj = get_obj<WorkerImage>(W, 1);
+  lua_pushinteger(W, obj->image->width());
+  return 1;
+}
+
+int WorkerImage_get_height(lua_State* W)
+{
+  const auto obj = get_obj<WorkerImage>(W, 1);
+  lua_pushinteger(W, obj->image->height());
+  return 1;
+}
+
+int WorkerImage_get_colorMode(lua_State* W)
+{
+  const auto obj = get_obj<WorkerImage>(W, 1);
+  lua_pushinteger(W, obj->image->pixelFormat());
+  return 1;
+}
+
+const luaL_Reg WorkerImage_methods[] = {
+  { "__gc", WorkerImage_gc },
+  { "getPixel", WorkerImage_getPixel },
+  { "drawPixel", WorkerImage_drawPixel },
+  { "clear", WorkerImage_clear },
+  { nullptr, nullptr }
+};
+
+const Property WorkerImage_properties[] = {
+  { "width", WorkerImage_get_width, nullptr },
+  { "height", WorkerImage_get_height, nullptr },
+  { "colorMode", WorkerImage_get_colorMode, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+int worker_postMessage(lua_State* W)
+{
+  WorkerMessage msg;
+  msg.type = WorkerMessage::Message;
+  msg.value = get_worker_value(W, 1, true);
+  get_worker_data(W)->post(std::move(msg));
+  return 0;
+}
+
+int worker_isCanceled(lua_State* W)
+{
+  lua_pushboolean(W, get_worker_data(W)->canceled);
+  return 1;
+}
+
+void worker_hook(lua_State* W, lua_Debug* ar)
+{
+  if (get_worker_data(W)->canceled)
+    luaL_error(W, "the worker was canceled");
+}
+
+// load() for workers, it accepts text chunks only (binary chunks
+// are not verified and can crash the interpreter). The original
+// load() function is the upvalue.
+int worker_load(lua_State* W)
+{
+  // load(chunk [, chunkname [, mode [, env]]])
+  if (lua_gettop(W) >= 3) {
+    lua_pushliteral(W, "t");
+    lua_replace(W, 3);
+  }
+  else {
+    lua_settop(W, 2);
+    lua_pushliteral(W, "t");
+  }
+  const int nargs = lua_gettop(W);
+  lua_pushvalue(W, lua_upvalueindex(1));
+  lua_insert(W, 1);
+  lua_call(W, nargs, LUA_MULTRET);
+  return lua_gettop(W);
+}
+
+// Creates a Lua state for a worker with the safe parts of the
+// standard library (there is no access to files, the OS, or the
+// document/app API, which is not thread-safe).
+void open_worker_libs(lua_State* W)
+{
+  const luaL_Reg libs[] = {
+    { LUA_GNAME, luaopen_base },
+    { LUA_COLIBNAME, luaopen_coroutine },
+    { LUA_TABLIBNAME, luaopen_table },
+    { LUA_STRLIBNAME, luaopen_string },
+    { LUA_MATHLIBNAME, luaopen_math },
+    { LUA_UTF8LIBNAME, luaopen_utf8 },
+    { nullptr, nullptr }
+  };
+  for (auto lib=libs; lib->name; ++lib) {
+    luaL_requiref(W, lib->name, lib->func, 1);
+    lua_pop(W, 1);
+  }
+
+  // Remove functions to load files
+  lua_pushnil(W);
+  lua_setglobal(W, "dofile");
+  lua_pushnil(W);
+  lua_setglobal(W, "loadfile");
+
+  lua_getglobal(W, "load");
+  lua_pushcclosure(W, worker_load, 1);
+  lua_setglobal(W, "load");
+
+  // Only debug.traceback() is available (used by the errors of
+  // __generic_mt_index), other debug functions can break the sandbox
+  // or remove the hook used to cancel the worker (debug.sethook).
+  luaL_requiref(W, LUA_DBLIBNAME, luaopen_debug, 0);
+  lua_newtable(W);
+  lua_getfield(W, -2, "traceback");
+  lua_setfield(W, -2, "traceback");
+  lua_setglobal(W, LUA_DBLIBNAME);
+  lua_pop(W, 1);
+
+  run_mt_index_code(W);
+
+  REG_CLASS(W, WorkerImage);
+  REG_CLASS_PROPERTIES(W, WorkerImage);
+  lua_pushcfunction(W, WorkerImage_new);
+  lua_setglobal(W, "Image");
+
+  lua_newtable(W);
+  setfield_integer(W, "RGB", doc::ColorMode::RGB);
+  setfield_integer(W, "GRAYSCALE", doc::ColorMode::GRAYSCALE);
+  setfield_integer(W, "INDEXED", doc::ColorMode::INDEXED);
+  lua_setglobal(W, "ColorMode");
+
+  lua_pushcfunction(W, worker_postMessage);
+  lua_setglobal(W, "postMessage");
+  lua_pushcfunction(W, worker_isCanceled);
+  lua_setglobal(W, "isCanceled");
+}
+
+// Runs the job in protected mode (called with lua_pcall)
+int worker_main(lua_State* W)
+{
+  auto job = (WorkerJob*)lua_touserdata(W, 1);
+
+  open_worker_libs(W);
+  lua_sethook(W, worker_hook, LUA_MASKCOUNT, kCancelCheckCount);
+
+  if (luaL_loadbufferx(W, job->code.c_str(), job->code.size(), "=worker",
+                       job->binary ? "b": "t") != LUA_OK)
+    return lua_error(W);
+
+  push_worker_value(W, std::move(job->input), true);
+  lua_call(W, 1, 1);
+  job->result = get_worker_value(W, -1, true);
+  return 0;
+}
+
+void run_worker(std::shared_ptr<WorkerData> data,
+                std::unique_ptr<WorkerJob> job)
+{
+  WorkerMessage msg;
+  msg.type = WorkerMessage::Error;
+
+  if (lua_State* W = luaL_newstate()) {
+    *(WorkerData**)lua_getextraspace(W) = data.get();
+    try {
+      lua_pushcfunction(W, worker_main);
+      lua_pushlightuserdata(W, job.get());
+      if (lua_pcall(W, 1, 0, 0) == LUA_OK) {
+        msg.type = WorkerMessage::Done;
+        msg.value = std::move(job->result);
+      }
+      else if (const char* s = lua_tostring(W, -1))
+        msg.error = s;
+      else
+        msg.error = "unknown error in worker";
+    }
+    catch (const std::exception& ex) {
+      msg.error = ex.what();
+    }
+    job.reset();
+    lua_close(W);
+  }
+  else {
+    msg.error = "cannot create the Lua state for the worker";
+  }
+
+  data->running = false;
+  data->post(std::move(msg));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Worker object in the main state
+
+class Worker {
+public:
+  Worker(lua_State* L)
+    : m_data(std::make_shared<WorkerData>(L)) {
+    m_data->owner = this;
+  }
+
+  ~Worker() {
+    m_data->owner = nullptr;
+    m_data->canceled = true;
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void start(std::unique_ptr<WorkerJob>&& job) {
+    m_thread = std::thread(run_worker, m_data, std::move(job));
+  }
+
+  void wait() {
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void cancel() {
+    m_data->canceled = true;
+  }
+
+  bool isRunning() const {
+    return m_data->running;
+  }
+
+  int runningRef() const {
+    return m_runningRef;
+  }
+
+  void refWorker(lua_State* L, int index) {
+    if (m_runningRef == LUA_REFNIL) {
+      lua_pushvalue(L, index);
+      m_runningRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+  }
+
+  void unrefWorker(lua_State* L) {
+    if (m_runningRef != LUA_REFNIL) {
+      luaL_unref(L, LUA_REGISTRYINDEX, m_runningRef);
+      m_runningRef = LUA_REFNIL;
+    }
+  }
+
+  // Calls the onmessage/ondone/onerror callbacks for the received
+  // messages. "index" is the Worker object in the stack.
+  void dispatch(lua_State* L, int index);
+
+private:
+  std::shared_ptr<WorkerData> m_data;
+  std::thread m_thread;
+  // Reference used to keep the worker alive (so it's not garbage
+  // collected) when it's running.
+  int m_runningRef = LUA_REFNIL;
+};
+
+void call_worker_callback(lua_State* L, int nargs)
+{
+  if (lua_pcall(L, nargs, 0, 0)) {
+    if (const char* s = lua_tostring(L, -1))
+      App::instance()->scriptEngine()->consolePrint(s);
+    lua_pop(L, 1);
+  }
+}
+
+void Worker::dispatch(lua_State* L, int index)
+{
+  index = lua_absindex(L, index);
+
+  WorkerMessage msg;
+  while (m_data->popMessage(msg)) {
+    // Table with callbacks and results
+    lua_getuservalue(L, index);
+    const int t = lua_gettop(L);
+
+    switch (msg.type) {
+
+      case WorkerMessage::Message:
+        if (lua_getfield(L, t, "onmessage") == LUA_TFUNCTION) {
+          push_worker_value(L, std::move(msg.value), false);
+          call_worker_callback(L, 1);
+        }
+        else
+          lua_pop(L, 1);
+        break;
+
+      case WorkerMessage::Done:
+        push_worker_value(L, std::move(msg.value), false);
+        lua_setfield(L, t, "result");
+        if (lua_getfield(L, t, "ondone") == LUA_TFUNCTION) {
+          lua_getfield(L, t, "result");
+          call_worker_callback(L, 1);
+        }
+        else
+          lua_pop(L, 1);
+        unrefWorker(L);
+        break;
+
+      case WorkerMessage::Error:
+        lua_pushstring(L, msg.error.c_str());
+        lua_setfield(L, t, "error");
+        if (lua_getfield(L, t, "onerror") == LUA_TFUNCTION) {
+          lua_pushstring(L, msg.error.c_str());
+          call_worker_callback(L, 1);
+        }
+        else {
+          lua_pop(L, 1);
+          // Print the error if nobody is waiting for the result
+          if (m_thread.joinable())
+            App::instance()->scriptEngine()->consolePrint(msg.error.c_str());
+        }
+        unrefWorker(L);
+        break;
+    }
+    lua_pop(L, 1);  // Pop the uservalue
+  }
+}
+
+void WorkerData::dispatchFromUIThread()
+{
+  if (!owner || owner->runningRef() == LUA_REFNIL)
+    return;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, owner->runningRef());
+  owner->dispatch(L, -1);
+  lua_pop(L, 1);
+}
+
+int Worker_new(lua_State* L)
+{
+  if (!lua_istable(L, 1))
+    return luaL_error(L, "Worker{ run=function(input) ... end } expected");
+
+  auto job = std::make_unique<WorkerJob>();
+
+  // The function is copied as bytecode to the worker state, so it
+  // cannot use local variables (upvalues) of the main state
+  const int type = lua_getfield(L, 1, "run");
+  if (type == LUA_TSTRING) {
+    job->code = lua_tostring(L, -1);
+  }
+  else if (type == LUA_TFUNCTION && !lua_iscfunction(L, -1)) {
+    for (int i=1; const char* name = lua_getupvalue(L, -1, i); ++i) {
+      lua_pop(L, 1);
+      if (std::string(name) != "_ENV")
+        return luaL_error(L, "the worker function cannot use the local variable '%s', "
+                          "use the 'input' field to send values", name);
+    }
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    lua_dump(L,
+             [](lua_State* L, const void* p, size_t sz, void* ud) -> int {
+               luaL_addlstring((luaL_Buffer*)ud, (const char*)p, sz);
+               return 0;
+             }, &b, 0);
+    luaL_pushresult(&b);
+    size_t len = 0;
+    const char* s = lua_tolstring(L, -1, &len);
+    job->code.assign(s, len);
+    job->binary = true;
+    lua_pop(L, 1);
+  }
+  else
+    return luaL_error(L, "the 'run' field must be a Lua function or a string with code");
+  lua_pop(L, 1);
+
+  lua_getfield(L, 1, "input");
+  job->input = get_worker_value(L, -1, false);
+  lua_pop(L, 1);
+
+  // Use the main thread to call the callbacks (the Worker could be
+  // created from a coroutine)
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  lua_State* mainL = lua_tothread(L, -1);
+  lua_pop(L, 1);
+
+  auto worker = push_new<Worker>(L, mainL);
+
+  // Callbacks are stored in the uservalue of the worker
+  lua_newtable(L);
+  for (const char* cb : { "onmessage", "ondone", "onerror" }) {
+    if (lua_getfield(L, 1, cb) == LUA_TFUNCTION)
+      lua_setfield(L, -2, cb);
+    else
+      lua_pop(L, 1);
+  }
+  lua_setuservalue(L, -2);
+
+  worker->refWorker(L, -1);
+  worker->start(std::move(job));
+  return 1;
+}
+
+int Worker_gc(lua_State* L)
+{
+  auto obj = get_obj<Worker>(L, 1);
+  obj->~Worker();
+  return 0;
+}
+
+int Worker_wait(lua_State* L)
+{
+  auto obj = get_obj<Worker>(L, 1);
+  obj->wait();
+  obj->dispatch(L, 1);
+
+  lua_getuservalue(L, 1);
+  if (lua_getfield(L, -1, "error") == LUA_TSTRING)
+    return lua_error(L);
+  lua_pop(L, 1);
+  lua_getfield(L, -1, "result");
+  return 1;
+}
+
+int Worker_cancel(lua_State* L)
+{
+  auto obj = get_obj<Worker>(L, 1);
+  obj->cancel();
+  return 0;
+}
+
+int Worker_get_isRunning(lua_State* L)
+{
+  const auto obj = get_obj<Worker>(L, 1);
+  lua_pushboolean(L, obj->isRunning());
+  return 1;
+}
+
+const luaL_Reg Worker_methods[] = {
+  { "__gc", Worker_gc },
+  { "wait", Worker_wait },
+  { "cancel", Worker_cancel },
+  { nullptr, nullptr }
+};
+
+const Property Worker_properties[] = {
+  { "isRunning", Worker_get_isRunning, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(Worker);
+DEF_MTNAME(WorkerImage);
+
+void register_worker_class(lua_State* L)
+{
+  REG_CLASS(L, Worker);
+  REG_CLASS_NEW(L, Worker);
+  REG_CLASS_PROPERTIES(L, Worker);
+}
+
+} // namespace script
+} // namespace app
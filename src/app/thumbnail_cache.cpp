@@ -0,0 +1,173 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/time.h"
+#include "doc/image.h"
+#include "fmt/format.h"
+
+#include "zlib.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace app {
+
+// Cache files contain: magic number, version, the key of the original
+// file (to detect hash collisions), thumbnail size, and the
+// zlib-compressed RGBA pixels.
+static constexpr uint32_t kMagicNumber = 0x48545341; // "ASTH"
+static constexpr uint32_t kVersion = 1;
+static constexpr int kMaxThumbnailSize = 1024;
+
+static void write32(std::vector<uint8_t>& buf, const uint32_t v)
+{
+  buf.push_back(v & 0xff);
+  buf.push_back((v >> 8) & 0xff);
+  buf.push_back((v >> 16) & 0xff);
+  buf.push_back((v >> 24) & 0xff);
+}
+
+static bool read32(const std::vector<uint8_t>& buf, std::size_t& pos, uint32_t& v)
+{
+  if (pos+4 > buf.size())
+    return false;
+  v = (uint32_t(buf[pos]) |
+       (uint32_t(buf[pos+1]) << 8) |
+       (uint32_t(buf[pos+2]) << 16) |
+       (uint32_t(buf[pos+3]) << 24));
+  pos += 4;
+  return true;
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& dir)
+  : m_dir(dir)
+{
+}
+
+doc::ImageRef ThumbnailCache::load(const std::string& filename) const
+{
+  const std::string key = fileKey(filename);
+  if (key.empty())
+    return nullptr;
+
+  base::FileHandle handle(base::open_file(cacheFilename(key), "rb"));
+  FILE* f = handle.get();
+  if (!f)
+    return nullptr;
+
+  std::vector<uint8_t> buf;
+  uint8_t chunk[4096];
+  std::size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    buf.insert(buf.end(), chunk, chunk+n);
+
+  std::size_t pos = 0;
+  uint32_t magic, version, keyLength, w, h;
+  if (!read32(buf, pos, magic) || magic != kMagicNumber ||
+      !read32(buf, pos, version) || version != kVersion ||
+      !read32(buf, pos, keyLength) || pos+keyLength > buf.size() ||
+      key.compare(0, std::string::npos,
+                  (const char*)&buf[pos], keyLength) != 0)
+    return nullptr;
+  pos += keyLength;
+
+  if (!read32(buf, pos, w) || !read32(buf, pos, h) ||
+      w < 1 || w > kMaxThumbnailSize ||
+      h < 1 || h > kMaxThumbnailSize)
+    return nullptr;
+
+  doc::ImageRef image(doc::Image::create(doc::IMAGE_RGB, w, h));
+  std::vector<uint8_t> pixels(std::size_t(w) * h * 4);
+  uLongf pixelsSize = pixels.size();
+  if (uncompress(pixels.data(), &pixelsSize,
+                 buf.data()+pos, buf.size()-pos) != Z_OK ||
+      pixelsSize != pixels.size())
+    return nullptr;
+
+  for (int y=0; y<int(h); ++y)
+    std::memcpy(image->getPixelAddress(0, y), &pixels[y*w*4], w*4);
+
+  return image;
+}
+
+void ThumbnailCache::save(const std::string& filename, const doc::Image* image) const
+{
+  ASSERT(image->pixelFormat() == doc::IMAGE_RGB);
+
+  const std::string key = fileKey(filename);
+  if (key.empty() ||
+      image->width() > kMaxThumbnailSize ||
+      image->height() > kMaxThumbnailSize)
+    return;
+
+  const int w = image->width();
+  const int h = image->height();
+  std::vector<uint8_t> pixels(std::size_t(w) * h * 4);
+  for (int y=0; y<h; ++y)
+    std::memcpy(&pixels[y*w*4], image->getPixelAddress(0, y), w*4);
+
+  std::vector<uint8_t> buf;
+  write32(buf, kMagicNumber);
+  write32(buf, kVersion);
+  write32(buf, key.size());
+  buf.insert(buf.end(), key.begin(), key.end());
+  write32(buf, w);
+  write32(buf, h);
+
+  const std::size_t pos = buf.size();
+  uLongf compressedSize = compressBound(pixels.size());
+  buf.resize(pos + compressedSize);
+  if (compress(buf.data()+pos, &compressedSize,
+               pixels.data(), pixels.size()) != Z_OK)
+    return;
+  buf.resize(pos + compressedSize);
+
+  try {
+    if (!base::is_directory(m_dir))
+      base::make_all_directories(m_dir);
+  }
+  catch (const std::exception&) {
+    return;
+  }
+
+  // An incomplete file (e.g. if two threads write the same thumbnail)
+  // is discarded by load() because it cannot be uncompressed.
+  base::FileHandle handle(base::open_file(cacheFilename(key), "wb"));
+  if (FILE* f = handle.get())
+    fwrite(buf.data(), 1, buf.size(), f);
+}
+
+std::string ThumbnailCache::fileKey(const std::string& filename) const
+{
+  const std::string fn = base::get_absolute_path(filename);
+  if (!base::is_file(fn))
+    return std::string();
+
+  const base::Time t = base::get_modification_time(fn);
+  return fmt::format("{}\n{}\n{:04}{:02}{:02}{:02}{:02}{:02}",
+                     fn, base::file_size(fn),
+                     t.year, t.month, t.day,
+                     t.hour, t.minute, t.second);
+}
+
+std::string ThumbnailCache::cacheFilename(const std::string& key) const
+{
+  return base::join_path(
+    m_dir, fmt::format("{:016x}.thumb",
+                       uint64_t(std::hash<std::string>()(key))));
+}
+
+} // namespace app
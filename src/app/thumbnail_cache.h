@@ -0,0 +1,50 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <string>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Keeps the thumbnails generated for the file selector in a
+  // directory so we don't need to load the files again in the next
+  // session. Each thumbnail is identified by the full path of the
+  // original file, its size, and its modification time, so a
+  // thumbnail is generated again if the file is modified.
+  //
+  // It can be used from several threads at the same time (each
+  // thumbnail is stored in its own file).
+  class ThumbnailCache {
+  public:
+    explicit ThumbnailCache(const std::string& dir);
+
+    // Returns the cached RGB thumbnail of the given file, or nullptr
+    // if there is no valid thumbnail for the current version of the
+    // file.
+    doc::ImageRef load(const std::string& filename) const;
+
+    // Saves the RGB thumbnail for the given file.
+    void save(const std::string& filename, const doc::Image* image) const;
+
+  private:
+    std::string fileKey(const std::string& filename) const;
+    std::string cacheFilename(const std::string& key) const;
+
+    std::string m_dir;
+  };
+
+} // namespace app
+
+#endif
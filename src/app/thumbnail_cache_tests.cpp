@@ -0,0 +1,58 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+using namespace app;
+using namespace doc;
+
+static void write_file(const std::string& fn, const char* content)
+{
+  base::FileHandle handle(base::open_file(fn, "wb"));
+  fputs(content, handle.get());
+}
+
+TEST(ThumbnailCache, SaveLoad)
+{
+  const std::string dir = "_test_thumbnails";
+  const std::string fn = "_test_thumbnail_file.txt";
+  write_file(fn, "abc");
+
+  ThumbnailCache cache(dir);
+  EXPECT_EQ(nullptr, cache.load(fn).get());
+
+  ImageRef image(Image::create(IMAGE_RGB, 3, 2));
+  for (int y=0; y<2; ++y)
+    for (int x=0; x<3; ++x)
+      put_pixel(image.get(), x, y, rgba(x*10, y*20, 30, 255-x));
+  cache.save(fn, image.get());
+
+  ImageRef loaded = cache.load(fn);
+  ASSERT_NE(nullptr, loaded.get());
+  ASSERT_EQ(3, loaded->width());
+  ASSERT_EQ(2, loaded->height());
+  for (int y=0; y<2; ++y)
+    for (int x=0; x<3; ++x)
+      EXPECT_EQ(get_pixel(image.get(), x, y), get_pixel(loaded.get(), x, y));
+
+  // The thumbnail is discarded if the file is modified
+  write_file(fn, "abcd");
+  EXPECT_EQ(nullptr, cache.load(fn).get());
+
+  // Files that don't exist don't have thumbnails
+  base::delete_file(fn);
+  EXPECT_EQ(nullptr, cache.load(fn).get());
+
+  for (const auto& item : base::list_files(dir))
+    base::delete_file(base::join_path(dir, item));
+  base::remove_directory(dir);
+}
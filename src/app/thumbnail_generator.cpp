@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,11 +16,16 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/pref/preferences.h"
+#include "app/resource_finder.h"
+#include "app/thumbnail_cache.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/fs.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "os/system.h"
@@ -31,7 +36,6 @@
 #include <algorithm>
 #include <atomic>
 #include <memory>
-#include <thread>
 
 #define MAX_THUMBNAIL_SIZE   128
 #define THUMB_TRACE(...)
@@ -40,11 +44,13 @@ namespace app {
 
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
+  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue,
+         const ThumbnailCache* cache)
     : m_queue(queue)
+    , m_cache(cache)
     , m_fop(nullptr)
-    , m_isDone(false)
-    , m_thread([this]{ loadBgThread(); }) {
+    , m_isDone(false) {
+    m_task.run([this](base::task_token& token){ loadBgTask(token); });
   }
 
   ~Worker() {
@@ -53,7 +59,9 @@ public:
       if (m_fop)
         m_fop->stop();
     }
-    m_thread.join();
+    // Don't start the task if it's still queued
+    m_task.cancel();
+    m_task.wait();
   }
 
   void stop() const {
@@ -62,6 +70,12 @@ public:
       m_fop->stop();
   }
 
+  void stopIfNotNeeded(const std::function<bool(IFileItem*)>& isNeeded) const {
+    const std::lock_guard lock(m_mutex);
+    if (m_fop && m_item.fileitem && !isNeeded(m_item.fileitem))
+      m_fop->stop();
+  }
+
   bool isDone() const {
     return m_isDone;
   }
@@ -78,6 +92,7 @@ public:
 private:
   void loadItem() {
     ASSERT(!m_fop);
+    bool thumbnailGenerated = false;
     try {
       {
         const std::lock_guard lock(m_mutex);
@@ -85,76 +100,75 @@ private:
         ASSERT(m_fop);
       }
 
-      THUMB_TRACE("FOP loading thumbnail: %s\n",
-                  m_item.fileitem->fileName().c_str());
-
-      // Load the file
-      m_fop->operate(nullptr);
-
-      // Don't call post-load because postLoad() needs user interaction.
-      //m_fop->postLoad();
-
-      // Convert the loaded document into the os::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
-      std::unique_ptr<Image> thumbnailImage;
-      std::unique_ptr<Palette> palette;
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Special case for indexed images:
-        // If the sprite is transparent -> set the transparent color index alpha = 0
-        if (sprite->colorMode() == ColorMode::INDEXED &&
-            !sprite->backgroundLayer()) {
-          int i = sprite->transparentColor();
-          if (i >= 0 && i < int(palette->size()))
-            palette->setEntry(i, doc::rgba(0, 0, 0, 0));
+      // Try to use the thumbnail generated in a previous session
+      ImageRef thumbnailImage;
+      if (m_cache)
+        thumbnailImage = m_cache->load(m_fop->filename());
+
+      if (!thumbnailImage) {
+        THUMB_TRACE("FOP loading thumbnail: %s\n",
+                    m_item.fileitem->fileName().c_str());
+
+        // Load the file
+        m_fop->operate(nullptr);
+
+        // Don't call post-load because postLoad() needs user interaction.
+        //m_fop->postLoad();
+
+        // Convert the loaded document into the os::Surface.
+        const Sprite* sprite =
+          (m_fop->document() &&
+           m_fop->document()->sprite() ?
+           m_fop->document()->sprite(): nullptr);
+
+        if (!m_fop->isStop() && sprite) {
+          // The palette to convert the Image
+          Palette palette(*sprite->palette(frame_t(0)));
+
+          const int w = sprite->width()*sprite->pixelRatio().w;
+          const int h = sprite->height()*sprite->pixelRatio().h;
+
+          // Calculate the thumbnail size
+          int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
+          int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
+          if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
+            thumb_w = w;
+            thumb_h = h;
+          }
+          thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
+          thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
+
+          // Stretch the 'image' (always in RGB, so the thumbnail can
+          // be cached without its palette)
+          thumbnailImage.reset(
+            Image::create(IMAGE_RGB, thumb_w, thumb_h));
+
+          render::Projection proj(sprite->pixelRatio(),
+                                  render::Zoom(thumb_w, w));
+          render::Render render;
+          render.setBgOptions(render::BgOptions::MakeTransparent());
+          render.setProjection(proj);
+          render.renderSprite(
+            thumbnailImage.get(), sprite, frame_t(0),
+            gfx::Clip(0, 0, 0, 0, w, h));
+
+          // Convert the image to sRGB color space
+          auto cs = sprite->colorSpace();
+          if (m_fop->preserveColorProfile() &&
+              cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
+            app::cmd::convert_color_profile(
+              thumbnailImage.get(), &palette,
+              cs, gfx::ColorSpace::MakeSRGB());
+          }
+
+          if (m_cache && !m_fop->isStop())
+            m_cache->save(m_fop->filename(), thumbnailImage.get());
         }
 
-        const int w = sprite->width()*sprite->pixelRatio().w;
-        const int h = sprite->height()*sprite->pixelRatio().h;
-
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
-        int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
-        if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
-          thumb_w = w;
-          thumb_h = h;
-        }
-        thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
-        thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        thumbnailImage.reset(
-          Image::create(
-            sprite->pixelFormat(), thumb_w, thumb_h));
-
-        render::Projection proj(sprite->pixelRatio(),
-                                render::Zoom(thumb_w, w));
-        render::Render render;
-        render.setBgOptions(render::BgOptions::MakeTransparent());
-        render.setProjection(proj);
-        render.renderSprite(
-          thumbnailImage.get(), sprite, frame_t(0),
-          gfx::Clip(0, 0, 0, 0, w, h));
-
-        // Convert the image to sRGB color space
-        auto cs = sprite->colorSpace();
-        if (m_fop->preserveColorProfile() &&
-            cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
-          app::cmd::convert_color_profile(
-            thumbnailImage.get(), palette.get(),
-            cs, gfx::ColorSpace::MakeSRGB());
-        }
+        // Close file
+        delete m_fop->releaseDocument();
       }
 
-      // Close file
-      delete m_fop->releaseDocument();
-
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
         os::SurfaceRef thumbnail =
@@ -163,13 +177,14 @@ private:
             thumbnailImage->height());
 
         convert_image_to_surface(
-          thumbnailImage.get(), palette.get(), thumbnail.get(),
+          thumbnailImage.get(), nullptr, thumbnail.get(),
           0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
 
         {
           const std::lock_guard lock(m_mutex);
           m_item.fileitem->setThumbnail(thumbnail);
         }
+        thumbnailGenerated = true;
       }
 
       THUMB_TRACE("FOP done with thumbnail: %s %s\n",
@@ -187,6 +202,11 @@ private:
       if (m_item.fileitem->needThumbnail())
         m_item.fileitem->setThumbnail(nullptr);
     }
+    // Reset the progress of a canceled thumbnail so it can be
+    // generated again if it's needed in the future.
+    else if (!thumbnailGenerated) {
+      m_item.fileitem->setThumbnailProgress(0.0);
+    }
 
     // Reset the m_item (first the fileitem so this worker is not
     // associated to this fileitem anymore, and then the FileOp).
@@ -205,12 +225,10 @@ private:
     ASSERT(!m_fop);
   }
 
-  void loadBgThread() {
-    base::this_thread::set_name("thumbnails");
-
-    while (!m_queue.empty()) {
+  void loadBgTask(base::task_token& token) {
+    while (!m_queue.empty() && !token.canceled()) {
       bool success = true;
-      while (success) {
+      while (success && !token.canceled()) {
         {
           const std::lock_guard lock(m_mutex); // To access m_item
           success = m_queue.try_pop(m_item);
@@ -224,11 +242,12 @@ private:
   }
 
   base::concurrent_queue<Item>& m_queue;
+  const ThumbnailCache* m_cache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
   std::atomic<bool> m_isDone;
-  std::thread m_thread;
+  doc::TaskGroup m_task;
 };
 
 ThumbnailGenerator* ThumbnailGenerator::instance()
@@ -246,9 +265,17 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
 
 ThumbnailGenerator::ThumbnailGenerator()
 {
-  int n = std::thread::hardware_concurrency()-1;
+  // Don't use all the worker threads of the shared pool, some of them
+  // will be needed to render the UI (e.g. parallel_for() calls).
+  int n = doc::parallel_concurrency()/2;
   if (n < 1) n = 1;
   m_maxWorkers = n;
+
+  if (Preferences::instance().fileSelector.cacheThumbnails()) {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+    m_cache = std::make_unique<ThumbnailCache>(rf.getFirstOrCreateDefault());
+  }
 }
 
 bool ThumbnailGenerator::checkWorkers()
@@ -286,12 +313,12 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
       // one to process the m_remainingItems queue. How is it possible
       // that a IFileItem has a thumbnail progress == 0.00001 but
       // there is no workers?  This is an edge case where:
-      // 1. The Worker::loadBgThread() asks for the queue of remaining items
-      //    and it's empty, so the thread is going to be closed
+      // 1. The Worker::loadBgTask() asks for the queue of remaining items
+      //    and it's empty, so the task is going to finish
       // 2. We've just created a FOP for this IFileItem and ask for
       //    available workers and we've already launch the max quantity
       //    of possible workers (m_maxWorkers)
-      // 3. All worker threads are just closed so there is no more
+      // 3. All worker tasks are just finished so there is no more
       //    worker for the remaining item in the queue.
       if (m_workers.empty())
         startWorker();
@@ -318,6 +345,10 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
     return;
   }
 
+  // We don't need the image in its original size (e.g. JPEG files are
+  // decoded directly to a smaller scale)
+  fop->setLoadSizeHint(gfx::Size(MAX_THUMBNAIL_SIZE, MAX_THUMBNAIL_SIZE));
+
   m_remainingItems.push(Item(fileitem, fop.get()));
   fop.release();
 
@@ -344,11 +375,36 @@ void ThumbnailGenerator::stopAllWorkers()
     worker->stop();
 }
 
+void ThumbnailGenerator::cancelThumbnails(const std::function<bool(IFileItem*)>& isNeeded)
+{
+  // Remove the items that aren't needed from the queue (keeping the
+  // order of the other ones)
+  std::vector<Item> neededItems;
+  Item item;
+  while (m_remainingItems.try_pop(item)) {
+    if (isNeeded(item.fileitem)) {
+      neededItems.push_back(item);
+    }
+    else {
+      if (!item.fileitem->getThumbnail())
+        item.fileitem->setThumbnailProgress(0.0);
+      delete item.fop;
+    }
+  }
+  for (const Item& neededItem : neededItems)
+    m_remainingItems.push(neededItem);
+
+  const std::lock_guard lock(m_workersAccess);
+  for (const auto& worker : m_workers)
+    worker->stopIfNotNeeded(isNeeded);
+}
+
 void ThumbnailGenerator::startWorker()
 {
   const std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(m_remainingItems,
+                                                 m_cache.get()));
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "base/concurrent_queue.h"
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -22,10 +23,12 @@ namespace base {
 namespace app {
   class FileOp;
   class IFileItem;
+  class ThumbnailCache;
 
   class ThumbnailGenerator {
     ThumbnailGenerator();
   public:
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
@@ -34,7 +37,7 @@ namespace app {
 
     // Checks the status of workers. If there are workers that already
     // done its job, we've to destroy them. This function must be called
-    // from the GUI thread (because a thread is joint to it).
+    // from the GUI thread (because the worker task is waited there).
     // Returns true if there are workers generating thumbnails.
     bool checkWorkers();
 
@@ -43,6 +46,12 @@ namespace app {
     // thread.
     void stopAllWorkers();
 
+    // Cancels the generation of thumbnails of file-items that aren't
+    // needed anymore (e.g. because they aren't visible after
+    // scrolling the list). The "isNeeded" predicate is called from
+    // the GUI thread for each queued or in-progress file-item.
+    void cancelThumbnails(const std::function<bool(IFileItem*)>& isNeeded);
+
   private:
     void startWorker();
 
@@ -61,6 +70,9 @@ namespace app {
     };
 
     int m_maxWorkers;
+    // Thumbnails on disk (nullptr if it's disabled), it's destroyed
+    // after the workers that use it.
+    std::unique_ptr<ThumbnailCache> m_cache;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2016  Carlo Caputo
 //
@@ -10,10 +10,13 @@
 #include "config.h"
 #endif
 
+#include "app/thumbnails.h"
+
 #include "app/util/conversion_to_surface.h"
 #include "doc/blend_mode.h"
 #include "doc/cel.h"
 #include "doc/layer.h"
+#include "doc/palette.h"
 #include "doc/sprite.h"
 #include "os/surface.h"
 #include "os/system.h"
@@ -70,5 +73,52 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
     return nullptr;
 }
 
+os::SurfaceRef CelThumbnailCache::getCelThumbnail(const doc::Cel* cel,
+                                                 const gfx::Size& fitInSize)
+{
+  // Tilemaps depend on the tileset too, we don't cache them
+  if (cel->layer()->isTilemap())
+    return get_cel_thumbnail(cel, fitInSize);
+
+  const doc::Image* image = cel->image();
+  const doc::Palette* palette = cel->sprite()->palette(cel->frame());
+  const doc::PixelRatio& pixelRatio = cel->sprite()->pixelRatio();
+  const Key key(image->id(), image->version(),
+                palette->id(), palette->getModifications(),
+                cel->bounds().w, cel->bounds().h,
+                fitInSize.w, fitInSize.h,
+                pixelRatio.w, pixelRatio.h);
+
+  auto it = m_items.find(key);
+  if (it != m_items.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+    return it->second.surface;
+  }
+
+  os::SurfaceRef surface = get_cel_thumbnail(cel, fitInSize);
+  if (!surface)
+    return nullptr;
+
+  m_lru.push_front(key);
+  m_items[key] = Item{ surface, m_lru.begin() };
+  m_bytes += 4 * surface->width() * surface->height();
+
+  // Remove the least recently used thumbnails
+  while (m_bytes > kMaxBytes && m_lru.size() > 1) {
+    auto it2 = m_items.find(m_lru.back());
+    m_bytes -= 4 * it2->second.surface->width() * it2->second.surface->height();
+    m_items.erase(it2);
+    m_lru.pop_back();
+  }
+  return surface;
+}
+
+void CelThumbnailCache::clear()
+{
+  m_items.clear();
+  m_lru.clear();
+  m_bytes = 0;
+}
+
 } // thumb
 } // app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016  Carlo Caputo
 //
 // This program is distributed under the terms of
@@ -9,9 +9,15 @@
 #define APP_THUMBNAILS_H_INCLUDED
 #pragma once
 
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "gfx/size.h"
 #include "os/surface.h"
 
+#include <list>
+#include <map>
+#include <tuple>
+
 namespace doc {
   class Cel;
 }
@@ -26,6 +32,41 @@ namespace thumb {
   os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
                                    const gfx::Size& fitInSize);
 
+  // Keeps the last generated cel thumbnails so we don't need to
+  // render them again each time the timeline is painted (e.g. when
+  // it's scrolled). Thumbnails are identified by the cel image
+  // id/version (and the palette), so modified cels are rendered
+  // again automatically.
+  class CelThumbnailCache {
+  public:
+    // Maximum number of bytes used by the cached surfaces
+    static constexpr size_t kMaxBytes = 32*1024*1024;
+
+    os::SurfaceRef getCelThumbnail(const doc::Cel* cel,
+                                   const gfx::Size& fitInSize);
+    void clear();
+
+    size_t bytes() const { return m_bytes; }
+
+  private:
+    using Key = std::tuple<doc::ObjectId,      // Image ID
+                           doc::ObjectVersion, // Image version
+                           doc::ObjectId,      // Palette ID
+                           int,                // Palette modifications
+                           int, int,           // Cel size
+                           int, int,           // Fit in size
+                           int, int>;          // Pixel ratio
+
+    struct Item {
+      os::SurfaceRef surface;
+      std::list<Key>::iterator lruIt;
+    };
+
+    std::map<Key, Item> m_items;
+    std::list<Key> m_lru;      // Most recently used keys first
+    size_t m_bytes = 0;
+  };
+
 } // thumb
 } // app
 
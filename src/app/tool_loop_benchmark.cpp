@@ -0,0 +1,237 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Replays recorded strokes (from a file generated with the
+// --record-strokes <filename> option, or synthetic strokes by
+// default) through the ToolLoopManager to measure the latency of
+// each pointer event and the time to commit each stroke:
+//
+//   aseprite-benchmark_tool_loop [--strokes=<filename>] [benchmark options]
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/inline_command_execution.h"
+#include "app/site.h"
+#include "app/tools/active_tool.h"
+#include "app/tools/pointer_recorder.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_box.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/ui/editor/tool_loop_impl.h"
+#include "doc/brush.h"
+#include "doc/sprite.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+tools::RecordedStrokes g_strokes;
+
+// Creates strokes similar to the pen input of a tablet (~240 events
+// per second) with waves in a 1024x1024 canvas.
+tools::RecordedStrokes make_synthetic_strokes()
+{
+  const int nstrokes = 8;
+  const int nevents = 240;
+  tools::RecordedStrokes strokes(nstrokes);
+
+  for (int i=0; i<nstrokes; ++i) {
+    for (int j=0; j<nevents; ++j) {
+      const double t = double(j) / (nevents-1);
+      tools::RecordedPointer rec;
+      rec.event = (j == 0 ? tools::RecordedPointer::Press:
+                   j == nevents-1 ? tools::RecordedPointer::Release:
+                                    tools::RecordedPointer::Movement);
+      rec.time = j / 240.0;
+      rec.pointer = tools::Pointer(
+        gfx::Point(64 + int(896 * t),
+                   128 + i*96 + int(48 * std::sin(t * 12.0))),
+        tools::Vec2(0.0f, 0.0f),
+        tools::Pointer::Left,
+        tools::Pointer::Type::Pen,
+        float(std::sin(t * 3.14159)));
+      strokes[i].push_back(rec);
+    }
+  }
+  return strokes;
+}
+
+double percentile(std::vector<double>& values, const double p)
+{
+  if (values.empty())
+    return 0.0;
+  const std::size_t i = std::min(values.size()-1,
+                                 std::size_t(p * values.size()));
+  std::nth_element(values.begin(), values.begin()+i, values.end());
+  return values[i];
+}
+
+const char* kToolIds[] = { "pencil", "spray", "line" };
+const tools::InkType kInkTypes[] = {
+  tools::InkType::SIMPLE,
+  tools::InkType::ALPHA_COMPOSITING,
+  tools::InkType::LOCK_ALPHA
+};
+
+} // anonymous namespace
+
+#ifdef ENABLE_SCRIPTING
+
+// Args: tool index, ink index, brush size, pressure dynamics (0/1)
+void BM_ReplayStrokes(benchmark::State& state) {
+  const char* toolId = kToolIds[state.range(0)];
+  const tools::InkType inkType = kInkTypes[state.range(1)];
+  const int brushSize = state.range(2);
+  const bool pressure = (state.range(3) != 0);
+  state.SetLabel(std::string(toolId) + " " +
+                 tools::ink_type_to_string_id(inkType));
+
+  auto app = App::instance();
+  Context* ctx = app->context();
+  tools::ToolBox* toolbox = app->toolBox();
+
+  ToolLoopParams params;
+  params.tool = toolbox->getToolById(toolId);
+  params.ink = params.tool->getInk(0);
+  params.controller = params.tool->getController(0);
+  params.inkType = inkType;
+  params.fg = app::Color::fromRgb(0, 0, 0, 128);
+  params.bg = app::Color::fromRgb(255, 255, 255);
+  params.ink = app->activeToolManager()->adjustToolInkDependingOnSelectedInkType(
+    params.ink, params.inkType, params.fg);
+  params.brush.reset(new Brush(BrushType::kCircleBrushType, brushSize, 0));
+  if (pressure) {
+    tools::DynamicsOptions dynamics;
+    dynamics.size = tools::DynamicSensor::Pressure;
+    dynamics.minSize = 1;
+    params.dynamics = dynamics;
+  }
+
+  std::vector<double> latencies; // In microseconds
+  double commitTime = 0.0;       // In milliseconds
+  int commits = 0;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<Doc> doc(ctx->documents().add(1024, 1024));
+    Site site;
+    site.document(doc.get());
+    site.sprite(doc->sprite());
+    site.layer(doc->sprite()->root()->firstLayer());
+    site.frame(0);
+    state.ResumeTiming();
+
+    for (const tools::RecordedStroke& stroke : g_strokes) {
+      InlineCommandExecution inlineCmd(ctx);
+      std::unique_ptr<tools::ToolLoop> loop(
+        create_tool_loop_for_script(ctx, site, params));
+      if (!loop) {
+        state.SkipWithError("Cannot create the tool loop");
+        break;
+      }
+
+      tools::ToolLoopManager manager(loop.get());
+      bool pressed = false;
+      for (const tools::RecordedPointer& rec : stroke) {
+        const auto t0 = Clock::now();
+        switch (rec.event) {
+          case tools::RecordedPointer::Press:
+            if (!pressed) {
+              manager.prepareLoop(rec.pointer);
+              pressed = true;
+            }
+            manager.pressButton(rec.pointer);
+            break;
+          case tools::RecordedPointer::Movement:
+            if (pressed)
+              manager.movement(rec.pointer);
+            break;
+          case tools::RecordedPointer::Release:
+            if (pressed)
+              manager.releaseButton(rec.pointer);
+            break;
+        }
+        latencies.push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+      }
+
+      const auto t0 = Clock::now();
+      manager.end();
+      commitTime +=
+        std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+      ++commits;
+    }
+
+    state.PauseTiming();
+    doc->close();
+    doc.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["events"] = double(latencies.size());
+  state.counters["p50_us"] = percentile(latencies, 0.50);
+  state.counters["p90_us"] = percentile(latencies, 0.90);
+  state.counters["p99_us"] = percentile(latencies, 0.99);
+  state.counters["max_us"] = percentile(latencies, 1.0);
+  state.counters["commit_ms"] = (commits > 0 ? commitTime / commits: 0.0);
+}
+
+BENCHMARK(BM_ReplayStrokes)
+  ->ArgsProduct({ { 0, 1, 2 }, { 0, 1, 2 }, { 1, 16, 64 }, { 0, 1 } })
+  ->Unit(benchmark::kMillisecond);
+
+#endif // ENABLE_SCRIPTING
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+  App app;
+  const char* argv2[] = { argv[0], "--batch" };
+  app.initialize(AppOptions(2, { argv2 }));
+
+  ::benchmark::Initialize(&argc, argv);
+
+  // Our own --strokes=<filename> option
+  const char* kStrokesOption = "--strokes=";
+  const std::size_t kStrokesOptionLen = std::strlen(kStrokesOption);
+  for (int i=1; i<argc; ++i) {
+    if (std::strncmp(argv[i], kStrokesOption, kStrokesOptionLen) == 0) {
+      const std::string fn = argv[i] + kStrokesOptionLen;
+      if (!tools::load_recorded_strokes(fn, g_strokes)) {
+        std::printf("Cannot load strokes from %s\n", fn.c_str());
+        return 1;
+      }
+    }
+  }
+  if (g_strokes.empty())
+    g_strokes = make_synthetic_strokes();
+
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  app.close();
+  return status;
+}
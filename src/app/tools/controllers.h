@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -62,6 +62,7 @@ public:
 
   void pressButton(ToolLoop* loop, Stroke& stroke, const Stroke::Pt& pt) override {
     m_last = pt;
+    m_newPoints = 0;
     stroke.addPoint(pt);
   }
 
@@ -71,6 +72,7 @@ public:
 
   void movement(ToolLoop* loop, Stroke& stroke, const Stroke::Pt& pt) override {
     m_last = pt;
+    ++m_newPoints;
     stroke.addPoint(pt);
   }
 
@@ -79,13 +81,18 @@ public:
       output.addPoint(input[0]);
     }
     else if (input.size() >= 2) {
-      // The freehand controller returns only the last two points to
-      // interwine because we accumulate (TracePolicy::Accumulate) the
-      // previously painted points (i.e. don't want to redraw all the
-      // stroke from the very beginning)
-      output.addPoint(input[input.size()-2]);
-      output.addPoint(input[input.size()-1]);
+      // The freehand controller returns only the new points (and the
+      // previous one to join them) to interwine because we accumulate
+      // (TracePolicy::Accumulate) the previously painted points
+      // (i.e. don't want to redraw all the stroke from the very
+      // beginning). Usually it's just the last two points, but
+      // there can be more if several movements were joined in one
+      // step (see ToolLoopManager::movement()).
+      const int n = std::clamp(m_newPoints, 1, input.size()-1);
+      for (int i=input.size()-n-1; i<input.size(); ++i)
+        output.addPoint(input[i]);
     }
+    m_newPoints = 0;
   }
 
   void getStatusBarText(ToolLoop* loop, const Stroke& stroke, std::string& text) override {
@@ -104,6 +111,8 @@ public:
 
 private:
   Stroke::Pt m_last;
+  // Points added with movement() since the last getStrokeToInterwine()
+  int m_newPoints = 0;
 };
 
 // Controls clicks for tools like line
@@ -12,6 +12,7 @@
 #include "doc/blend_internals.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
+#include "doc/mask.h"
 #include "doc/palette.h"
 #include "doc/remap.h"
 #include "doc/rgbmap.h"
@@ -22,6 +23,10 @@
 #include "render/dithering.h"
 #include "render/gradient.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace app {
 namespace tools {
 
@@ -56,8 +61,6 @@ template<typename Derived>
 class InkProcessing : public BaseInkProcessing {
 public:
   void processScanline(int x1, int y, int x2, ToolLoop* loop) override {
-    int x;
-
     // Use mask
     if (loop->useMask()) {
       Point maskOrigin(loop->getMaskOrigin());
@@ -72,27 +75,66 @@ public:
       if (x2 > maskOrigin.x+maskBounds.w-1)
         x2 = maskOrigin.x+maskBounds.w-1;
 
-      if (Image* bitmap = loop->getMask()->bitmap()) {
-        static_cast<Derived*>(this)->initIterators(loop, x1, y);
-
-        for (x=x1; x<=x2; ++x) {
-          if (bitmap->getPixel(x-maskOrigin.x, y-maskOrigin.y))
-            static_cast<Derived*>(this)->processPixel(x, y);
-
-          static_cast<Derived*>(this)->moveIterators();
+      const Mask* mask = loop->getMask();
+      if (mask->bitmap()) {
+        // Process only the runs of selected pixels in this row
+        for (const MaskSpan& span : mask->spans().row(y-maskOrigin.y)) {
+          const int u1 = std::max(x1, maskOrigin.x+span.x);
+          const int u2 = std::min(x2, maskOrigin.x+span.x2()-1);
+          if (u1 > u2)
+            continue;
+
+          static_cast<Derived*>(this)->initIterators(loop, u1, y);
+          static_cast<Derived*>(this)->processSpan(u1, u2, y);
         }
         return;
       }
     }
 
     static_cast<Derived*>(this)->initIterators(loop, x1, y);
-    for (x=x1; x<=x2; ++x) {
+    static_cast<Derived*>(this)->processSpan(x1, x2, y);
+  }
+
+  // Processes the contiguous pixels [x1, x2] of the row "y" (the
+  // iterators are already initialized in x1). Inks can replace this
+  // function with a tighter loop (e.g. when the result doesn't depend
+  // on the pixel position).
+  void processSpan(int x1, int x2, int y) {
+    processPixels(x1, x2, y);
+  }
+
+protected:
+  // Default per-pixel implementation of processSpan()
+  void processPixels(int x1, int x2, int y) {
+    for (int x=x1; x<=x2; ++x) {
       static_cast<Derived*>(this)->processPixel(x, y);
       static_cast<Derived*>(this)->moveIterators();
     }
   }
 };
 
+// Processes "n" pixels where each destination pixel depends only on
+// its source pixel (e.g. blending with a constant color), "func" is
+// called only when the source color changes (common in big brushes
+// over flat areas). Both iterators are moved to the end of the span.
+template<typename ImageTraits, typename Func>
+inline void process_span_by_src_color(typename ImageTraits::address_t& src,
+                                      typename ImageTraits::address_t& dst,
+                                      const int n,
+                                      Func func)
+{
+  const auto srcEnd = src + n;
+  typename ImageTraits::pixel_t lastSrc = *src;
+  typename ImageTraits::pixel_t lastDst = func(lastSrc);
+  for (; src != srcEnd; ++src, ++dst) {
+    if (*src != lastSrc) {
+      lastSrc = *src;
+      lastDst = func(lastSrc);
+    }
+    *dst = lastDst;
+  }
+}
+
 template<typename Derived, typename ImageTraits>
 class SimpleInkProcessing : public InkProcessing<Derived> {
 public:
@@ -151,6 +193,12 @@ public:
     *this->m_dstAddress = m_color;
   }
 
+  void processSpan(int x1, int x2, int y) {
+    const int n = x2-x1+1;
+    std::fill_n(this->m_dstAddress, n, m_color);
+    this->m_dstAddress += n;
+  }
+
 private:
   color_t m_color;
 };
@@ -174,6 +222,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int x2, int y) {
+    this->processPixels(x1, x2, y);
+  }
+
 private:
   color_t m_color;
   const int m_opacity;
@@ -197,6 +249,30 @@ void LockAlphaInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
     graya_geta(*m_srcAddress));
 }
 
+template<>
+void LockAlphaInkProcessing<RgbTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<RgbTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      const color_t result = rgba_blender_normal(src, m_color, m_opacity);
+      return doc::rgba(rgba_getr(result),
+                       rgba_getg(result),
+                       rgba_getb(result),
+                       rgba_geta(src));
+    });
+}
+
+template<>
+void LockAlphaInkProcessing<GrayscaleTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<GrayscaleTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      const color_t result = graya_blender_normal(src, m_color, m_opacity);
+      return graya(graya_getv(result),
+                   graya_geta(src));
+    });
+}
+
 template<>
 class LockAlphaInkProcessing<IndexedTraits> : public DoubleInkProcessing<LockAlphaInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -254,6 +330,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int x2, int y) {
+    this->processPixels(x1, x2, y);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -269,6 +349,24 @@ void TransparentInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void TransparentInkProcessing<RgbTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<RgbTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      return rgba_blender_normal(src, m_color, m_opacity);
+    });
+}
+
+template<>
+void TransparentInkProcessing<GrayscaleTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<GrayscaleTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      return graya_blender_normal(src, m_color, m_opacity);
+    });
+}
+
 template<>
 class TransparentInkProcessing<IndexedTraits> : public DoubleInkProcessing<TransparentInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -326,6 +424,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int x2, int y) {
+    this->processPixels(x1, x2, y);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -341,6 +443,24 @@ void MergeInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_merge(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void MergeInkProcessing<RgbTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<RgbTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      return rgba_blender_merge(src, m_color, m_opacity);
+    });
+}
+
+template<>
+void MergeInkProcessing<GrayscaleTraits>::processSpan(int x1, int x2, int y) {
+  process_span_by_src_color<GrayscaleTraits>(
+    m_srcAddress, m_dstAddress, x2-x1+1,
+    [this](const color_t src) -> color_t {
+      return graya_blender_merge(src, m_color, m_opacity);
+    });
+}
+
 template<>
 class MergeInkProcessing<IndexedTraits> : public DoubleInkProcessing<MergeInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
@@ -747,50 +867,73 @@ public:
   }
 };
 
+// Table from each color of the shade to the color that replaces it
+// (the previous or the next color of the shade), created when the
+// stroke starts so we don't have to search the shade for each pixel.
+class ShadeColorsTable {
+public:
+  ShadeColorsTable(const Palette& shade, const bool left) {
+    for (int i=0; i<shade.size(); ++i) {
+      const int j = (left ? std::max(i-1, 0):
+                            std::min(i+1, shade.size()-1));
+      // emplace() doesn't replace existent entries, so a repeated
+      // color uses its first position in the shade (as
+      // Palette::findExactMatch() does)
+      m_table.emplace(shade.getEntry(i), shade.getEntry(j));
+    }
+  }
+
+  bool contains(const color_t color) const {
+    return (m_table.find(color) != m_table.end());
+  }
+
+  // Returns false if the color isn't in the shade.
+  bool shade(const color_t color, color_t& result) const {
+    auto it = m_table.find(color);
+    if (it == m_table.end())
+      return false;
+    result = it->second;
+    return true;
+  }
+
+private:
+  std::unordered_map<color_t, color_t> m_table;
+};
+
 template<>
 class PixelShadingInkHelper<RgbTraits> {
 public:
   using pixel_t = RgbTraits::pixel_t;
 
   PixelShadingInkHelper(ToolLoop* loop)
-    : m_shadePalette(0, 1)
-    , m_left(loop->getMouseButton() == ToolLoop::Left)
-  {
-    const Shade shade = loop->getShade();
-    m_shadePalette.resize(shade.size());
-    int i = 0;
-    for (app::Color color : shade) {
-      m_shadePalette.setEntry(
-        i++, color_utils::color_for_layer(color, loop->getLayer()));
-    }
+    : m_table(createShadePalette(loop),
+              loop->getMouseButton() == ToolLoop::Left) {
   }
 
-  int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_shadePalette.findExactMatch(r, g, b, a, -1);
+  bool contains(const color_t color) const {
+    return m_table.contains(color);
   }
 
   pixel_t operator()(const pixel_t src) const {
-    int i = findIndex(rgba_getr(src),
-                      rgba_getg(src),
-                      rgba_getb(src),
-                      rgba_geta(src));
-    if (i < 0)
-      return src;
+    color_t result;
+    if (m_table.shade(src, result))
+      return result;
+    return src;
+  }
 
-    if (m_left) {
-      if (i > 0)
-        --i;
-    }
-    else {
-      if (i < m_shadePalette.size()-1)
-        ++i;
+private:
+  static Palette createShadePalette(ToolLoop* loop) {
+    const Shade shade = loop->getShade();
+    Palette shadePalette(0, shade.size());
+    int i = 0;
+    for (app::Color color : shade) {
+      shadePalette.setEntry(
+        i++, color_utils::color_for_layer(color, loop->getLayer()));
     }
-    return m_shadePalette.getEntry(i);
+    return shadePalette;
   }
 
-private:
-  Palette m_shadePalette;
-  bool m_left;
+  ShadeColorsTable m_table;
 };
 
 template<>
@@ -799,11 +942,26 @@ public:
   using pixel_t = GrayscaleTraits::pixel_t;
 
   PixelShadingInkHelper(ToolLoop* loop)
-    : m_shadePalette(0, 1)
-    , m_left(loop->getMouseButton() == ToolLoop::Left)
-  {
-    Shade shade = loop->getShade();
-    m_shadePalette.resize(shade.size());
+    : m_table(createShadePalette(loop),
+              loop->getMouseButton() == ToolLoop::Left) {
+  }
+
+  bool contains(const color_t color) const {
+    return m_table.contains(color);
+  }
+
+  pixel_t operator()(const pixel_t src) const {
+    const int v = graya_getv(src);
+    color_t result;
+    if (m_table.shade(rgba(v, v, v, graya_geta(src)), result))
+      return graya(rgba_getr(result), rgba_geta(result));
+    return src;
+  }
+
+private:
+  static Palette createShadePalette(ToolLoop* loop) {
+    const Shade shade = loop->getShade();
+    Palette shadePalette(0, shade.size());
 
     // As the colors are going to a palette, we need RGB colors
     // (instead of Grayscale)
@@ -814,39 +972,13 @@ public:
 
     int i = 0;
     for (app::Color color : shade) {
-      m_shadePalette.setEntry(
+      shadePalette.setEntry(
         i++, color_utils::color_for_target(color, target));
     }
+    return shadePalette;
   }
 
-  int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_shadePalette.findExactMatch(r, g, b, a, -1);
-  }
-
-  pixel_t operator()(const pixel_t src) const {
-    int i = findIndex(graya_getv(src),
-                      graya_getv(src),
-                      graya_getv(src),
-                      graya_geta(src));
-    if (i < 0)
-      return src;
-
-    if (m_left) {
-      if (i > 0)
-        --i;
-    }
-    else {
-      if (i < m_shadePalette.size()-1)
-        ++i;
-    }
-
-    color_t rgba = m_shadePalette.getEntry(i);
-    return graya(rgba_getr(rgba), rgba_geta(rgba));
-  }
-
-private:
-  Palette m_shadePalette;
-  bool m_left;
+  ShadeColorsTable m_table;
 };
 
 template<>
@@ -858,10 +990,12 @@ public:
     m_palette(loop->getPalette()),
     m_remap(loop->getShadingRemap()),
     m_left(loop->getMouseButton() == ToolLoop::Left) {
+    for (int i=0; i<m_palette->size(); ++i)
+      m_paletteColors.insert(m_palette->getEntry(i));
   }
 
-  int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
-    return m_palette->findExactMatch(r, g, b, a, -1);
+  bool contains(const color_t color) const {
+    return (m_paletteColors.find(color) != m_paletteColors.end());
   }
 
   pixel_t operator()(pixel_t i) const {
@@ -885,6 +1019,7 @@ private:
   const Palette* m_palette;
   const Remap* m_remap;
   bool m_left;
+  std::unordered_set<color_t> m_paletteColors;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -978,9 +1113,11 @@ public:
   {
   }
 
-  void processScanline(int x1, int y, int x2, ToolLoop* loop) override {
+  // The temporary image iterator is moved on each processed pixel,
+  // so we have to re-position it on each run of the scanline.
+  void initIterators(ToolLoop* loop, int x1, int y) {
+    base::initIterators(loop, x1, y);
     m_tmpAddress = (RgbTraits::address_t)m_tmpImage->getPixelAddress(x1, y);
-    base::processScanline(x1, y, x2, loop);
   }
 
   void prepareForStrokes(ToolLoop* loop, Strokes& strokes) override {
@@ -1673,11 +1810,7 @@ void BrushShadingInkProcessing<RgbTraits>::processPixel(int x, int y) {
   switch (m_brushImage->pixelFormat()) {
     case IMAGE_RGB: {
       auto c = get_pixel_fast<RgbTraits>(m_brushImage, x, y);
-      int iBrush = m_shading.findIndex(rgba_getr(c),
-                                       rgba_getg(c),
-                                       rgba_getb(c),
-                                       rgba_geta(c));
-      if (rgba_geta(c) != 0 && iBrush >= 0)
+      if (rgba_geta(c) != 0 && m_shading.contains(c))
         *m_dstAddress = m_shading(*m_srcAddress);
       break;
     }
@@ -1707,11 +1840,7 @@ void BrushShadingInkProcessing<IndexedTraits>::processPixel(int x, int y) {
   switch (m_brushImage->pixelFormat()) {
     case IMAGE_RGB: {
       auto c = get_pixel_fast<RgbTraits>(m_brushImage, x, y);
-      int iBrush = m_shading.findIndex(rgba_getr(c),
-                                       rgba_getg(c),
-                                       rgba_getb(c),
-                                       rgba_geta(c));
-      if (rgba_geta(c) != 0 && iBrush >= 0)
+      if (rgba_geta(c) != 0 && m_shading.contains(c))
         *m_dstAddress = m_shading(*m_srcAddress);
       break;
     }
@@ -1741,11 +1870,7 @@ void BrushShadingInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   switch (m_brushImage->pixelFormat()) {
     case IMAGE_RGB: {
       auto c = get_pixel_fast<RgbTraits>(m_brushImage, x, y);
-      int iBrush = m_shading.findIndex(rgba_getr(c),
-                                       rgba_getg(c),
-                                       rgba_getb(c),
-                                       rgba_geta(c));
-      if (rgba_geta(c) != 0 && iBrush >= 0)
+      if (rgba_geta(c) != 0 && m_shading.contains(c))
         *m_dstAddress = m_shading(*m_srcAddress);
       break;
     }
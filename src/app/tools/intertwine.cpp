@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2020  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -70,15 +70,12 @@ void Intertwine::doPointshapeStrokePt(const Stroke::Pt& pt, ToolLoop* loop)
   if (symmetry) {
     // Convert the point to the sprite position so we can apply the
     // symmetry transformation.
-    Stroke main_stroke;
-    main_stroke.addPoint(pt);
-
-    Strokes strokes;
-    symmetry->generateStrokes(main_stroke, strokes, loop);
-    for (const auto& stroke : strokes) {
+    std::array<Stroke::Pt, 4> pts;
+    const int n = symmetry->generatePoints(pt, pts, loop);
+    for (int i=0; i<n; ++i) {
       // We call transformPoint() moving back each point to the cel
       // origin.
-      doTransformPoint(stroke[0], loop);
+      doTransformPoint(pts[i], loop);
     }
   }
   else {
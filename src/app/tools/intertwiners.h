@@ -510,7 +510,8 @@ public:
       return;
     }
     else {
-      if (stroke.firstPoint() == stroke.lastPoint())
+      if (stroke.size() == 2 &&
+          stroke.firstPoint() == stroke.lastPoint())
         return;
 
       nextPt = m_pts.size();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -12,7 +12,9 @@
 #include "render/gradient.h"
 
 #include <array>
+#include <map>
 #include <memory>
+#include <tuple>
 
 namespace app {
 namespace tools {
@@ -62,10 +64,32 @@ public:
 };
 
 class BrushPointShape : public PointShape {
+  // Max number of brushes generated by dynamics that are kept in the
+  // cache between strokes.
+  static constexpr int kMaxCachedStamps = 64;
+
+  struct Stamp {
+    BrushRef brush;
+    // Scanlines of the brush for each symmetry mode
+    std::array<CompressedImage, 4> compressedImages;
+    std::array<bool, 4> validCompressedImages;
+    int lastUse = 0;
+    Stamp() { validCompressedImages.fill(false); }
+  };
+  using StampKey = std::tuple<BrushType, int, int>; // type, size, angle
+
   bool m_firstPoint;
   Brush* m_lastBrush;
+  Stamp* m_lastStamp;
   BrushType m_origBrushType;
-  std::array<std::shared_ptr<CompressedImage>, 4> m_compressedImages;
+  // Stamp used for brushes that are not in the cache (the scanlines
+  // are re-generated reusing the memory when the brush changes)
+  Stamp m_stamp;
+  // Brushes (and their scanlines) generated for pressure/angle
+  // dynamics, shared between all strokes so we don't have to
+  // re-generate them for each point
+  std::map<StampKey, std::unique_ptr<Stamp>> m_cachedStamps;
+  int m_stampUses = 0;
   // For dynamics
   DynamicsOptions m_dynamics;
   bool m_useDynamics;
@@ -79,6 +103,7 @@ public:
   void preparePointShape(ToolLoop* loop) override {
     m_firstPoint = true;
     m_lastBrush = nullptr;
+    m_lastStamp = nullptr;
     m_origBrushType = loop->getBrush()->type();
 
     m_dynamics = loop->getDynamics();
@@ -177,15 +202,16 @@ public:
       if ((brush->size() != size) ||
           (brush->angle() != angle && m_origBrushType != kCircleBrushType) ||
           (m_hasDynamicGradient && pt.gradient != m_lastGradientValue)) {
-        // TODO cache brushes
-        BrushRef newBrush = std::make_shared<Brush>(
-          m_origBrushType, size, angle);
+        BrushRef newBrush;
 
         // Dynamic gradient with dithering
         bool prepareInk = false;
         if (m_hasDynamicGradient && !ink->isEraser() &&
             (m_dynamics.ditheringMatrix.rows() > 1 ||
              m_dynamics.ditheringMatrix.cols() > 1)) {
+          // We cannot use a cached brush here because its image is
+          // modified with the gradient/dithering colors.
+          newBrush = std::make_shared<Brush>(m_origBrushType, size, angle);
           convert_bitmap_brush_to_dithering_brush(
             newBrush.get(),
             loop->sprite()->pixelFormat(),
@@ -195,6 +221,9 @@ public:
             m_primaryColor);
           prepareInk = true;
         }
+        else {
+          newBrush = getCachedStamp(m_origBrushType, size, angle)->brush;
+        }
         m_lastGradientValue = pt.gradient;
 
         loop->setBrush(newBrush);
@@ -207,10 +236,13 @@ public:
       }
     }
 
-    // TODO cache compressed images (or remove them completelly)
     if (m_lastBrush != brush) {
       m_lastBrush = brush;
-      m_compressedImages.fill(nullptr);
+      m_lastStamp = findCachedStamp(brush);
+      if (!m_lastStamp) {
+        m_lastStamp = &m_stamp;
+        m_stamp.validCompressedImages.fill(false);
+      }
     }
 
     x += brush->bounds().x;
@@ -258,14 +290,53 @@ public:
   }
 
 private:
+  // Returns the cached stamp for the given brush parameters, creating
+  // it (and discarding the least recently used one) if needed.
+  Stamp* getCachedStamp(const BrushType type, const int size, const int angle) {
+    const StampKey key(type, size, angle);
+    auto it = m_cachedStamps.find(key);
+    if (it == m_cachedStamps.end()) {
+      if (m_cachedStamps.size() >= kMaxCachedStamps) {
+        auto lru = std::min_element(
+          m_cachedStamps.begin(), m_cachedStamps.end(),
+          [](const auto& a, const auto& b){
+            return a.second->lastUse < b.second->lastUse;
+          });
+        // The current stamp is the most recently used one, so it's
+        // never discarded.
+        ASSERT(lru->second.get() != m_lastStamp);
+        m_cachedStamps.erase(lru);
+      }
+
+      auto stamp = std::make_unique<Stamp>();
+      stamp->brush = std::make_shared<Brush>(type, size, angle);
+      it = m_cachedStamps.emplace(key, std::move(stamp)).first;
+    }
+    it->second->lastUse = ++m_stampUses;
+    return it->second.get();
+  }
+
+  // Returns the stamp of the given brush if it was created by
+  // getCachedStamp(), or nullptr if it's other brush (e.g. the
+  // original brush of the tool loop).
+  Stamp* findCachedStamp(const Brush* brush) {
+    auto it = m_cachedStamps.find(
+      StampKey(brush->type(), brush->size(), brush->angle()));
+    if (it != m_cachedStamps.end() && it->second->brush.get() == brush)
+      return it->second.get();
+    return nullptr;
+  }
+
   CompressedImage& getCompressedImage(gen::SymmetryMode symmetryMode) {
-    auto& compressPtr = m_compressedImages[int(symmetryMode)];
-    if (!compressPtr) {
+    CompressedImage& compressed = m_lastStamp->compressedImages[int(symmetryMode)];
+    bool& valid = m_lastStamp->validCompressedImages[int(symmetryMode)];
+    if (!valid) {
+      valid = true;
       switch (symmetryMode) {
         case gen::SymmetryMode::NONE: {
-          compressPtr.reset(new CompressedImage(m_lastBrush->image(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
+          compressed.compress(m_lastBrush->image(),
+                              m_lastBrush->maskBitmap(),
+                              false);
           break;
         }
         case gen::SymmetryMode::HORIZONTAL:
@@ -276,9 +347,9 @@ private:
               doc::algorithm::FlipType::FlipHorizontal:
               doc::algorithm::FlipType::FlipVertical;
           doc::algorithm::flip_image(tempImage.get(), tempImage->bounds(), flip);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
+          compressed.compress(tempImage.get(),
+                              m_lastBrush->maskBitmap(),
+                              false);
           break;
         }
         case gen::SymmetryMode::BOTH: {
@@ -289,14 +360,14 @@ private:
           doc::algorithm::flip_image(tempImage.get(),
                                      tempImage->bounds(),
                                      doc::algorithm::FlipType::FlipHorizontal);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
+          compressed.compress(tempImage.get(),
+                              m_lastBrush->maskBitmap(),
+                              false);
           break;
         }
       }
     }
-    return *compressPtr;
+    return compressed;
   }
 };
 
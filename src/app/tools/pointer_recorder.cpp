@@ -0,0 +1,148 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/pointer_recorder.h"
+
+#include "base/fstream_path.h"
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+
+namespace app {
+namespace tools {
+
+// Text format of the recorded strokes file:
+//
+//   stroke
+//   <event> <time> <x> <y> <pressure> <velocity-x> <velocity-y> <button> <type>
+//   ...
+//   end
+//
+// Where <event> is "press", "move", or "release".
+
+static const char* kEventNames[] = { "press", "move", "release" };
+
+PointerRecorder::PointerRecorder(const std::string& filename)
+  : m_file(FSTREAM_PATH(filename), std::ios::out | std::ios::app)
+{
+}
+
+void PointerRecorder::record(const RecordedPointer::Event event,
+                             const Pointer& pointer)
+{
+  const std::lock_guard lock(m_mutex);
+  const auto now = std::chrono::steady_clock::now();
+  if (event == RecordedPointer::Press && m_stroke.empty())
+    m_startTime = now;
+  // Ignore movements before the stroke starts
+  else if (m_stroke.empty())
+    return;
+
+  RecordedPointer rec;
+  rec.event = event;
+  rec.time = std::chrono::duration<double>(now - m_startTime).count();
+  rec.pointer = pointer;
+  m_stroke.push_back(rec);
+}
+
+void PointerRecorder::endStroke(const bool save)
+{
+  const std::lock_guard lock(m_mutex);
+  if (save && !m_stroke.empty() && m_file) {
+    write_recorded_stroke(m_file, m_stroke);
+    m_file.flush();
+  }
+  m_stroke.clear();
+}
+
+void write_recorded_stroke(std::ostream& os, const RecordedStroke& stroke)
+{
+  os << "stroke\n";
+  for (const RecordedPointer& rec : stroke) {
+    const Pointer& pointer = rec.pointer;
+    os << kEventNames[rec.event] << ' '
+       << rec.time << ' '
+       << pointer.point().x << ' '
+       << pointer.point().y << ' '
+       << pointer.pressure() << ' '
+       << pointer.velocity().x << ' '
+       << pointer.velocity().y << ' '
+       << int(pointer.button()) << ' '
+       << int(pointer.type()) << '\n';
+  }
+  os << "end\n";
+}
+
+RecordedStrokes read_recorded_strokes(std::istream& is)
+{
+  RecordedStrokes strokes;
+  RecordedStroke stroke;
+  bool inStroke = false;
+  std::string line;
+
+  while (std::getline(is, line)) {
+    std::istringstream ls(line);
+    std::string word;
+    if (!(ls >> word))
+      continue;
+
+    if (word == "stroke") {
+      stroke.clear();
+      inStroke = true;
+      continue;
+    }
+    else if (word == "end") {
+      if (inStroke && !stroke.empty())
+        strokes.push_back(std::move(stroke));
+      stroke.clear();
+      inStroke = false;
+      continue;
+    }
+    else if (!inStroke)
+      continue;
+
+    RecordedPointer rec;
+    if (word == kEventNames[RecordedPointer::Press])
+      rec.event = RecordedPointer::Press;
+    else if (word == kEventNames[RecordedPointer::Release])
+      rec.event = RecordedPointer::Release;
+    else if (word == kEventNames[RecordedPointer::Movement])
+      rec.event = RecordedPointer::Movement;
+    else
+      continue;
+
+    gfx::Point pt;
+    float pressure, vx, vy;
+    int button, type;
+    if (!(ls >> rec.time >> pt.x >> pt.y >> pressure >> vx >> vy >> button >> type))
+      continue;
+
+    rec.pointer = Pointer(pt, Vec2(vx, vy),
+                          Pointer::Button(button),
+                          Pointer::Type(type),
+                          pressure);
+    stroke.push_back(rec);
+  }
+  return strokes;
+}
+
+bool load_recorded_strokes(const std::string& filename,
+                           RecordedStrokes& strokes)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  if (!f)
+    return false;
+  strokes = read_recorded_strokes(f);
+  return true;
+}
+
+} // namespace tools
+} // namespace app
@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TOOLS_POINTER_RECORDER_H_INCLUDED
+#define APP_TOOLS_POINTER_RECORDER_H_INCLUDED
+#pragma once
+
+#include "app/tools/pointer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+namespace tools {
+
+// One pointer event received by the ToolLoopManager.
+struct RecordedPointer {
+  enum Event { Press, Movement, Release };
+
+  Event event = Movement;
+  double time = 0.0;            // Seconds since the stroke started
+  Pointer pointer;
+};
+
+using RecordedStroke = std::vector<RecordedPointer>;
+using RecordedStrokes = std::vector<RecordedStroke>;
+
+// Records the pointer events (positions, pressure, velocity, and
+// timestamps) of each stroke done with the ToolLoopManager and
+// appends the finished strokes to a text file, so they can be
+// replayed later (e.g. to benchmark the drawing tools with real
+// input).
+class PointerRecorder {
+public:
+  explicit PointerRecorder(const std::string& filename);
+
+  bool isValid() const { return bool(m_file); }
+
+  void record(const RecordedPointer::Event event,
+              const Pointer& pointer);
+
+  // Writes the current stroke in the file (or discards it if
+  // "save" is false, e.g. when the stroke was canceled).
+  void endStroke(const bool save);
+
+private:
+  std::mutex m_mutex;
+  std::ofstream m_file;
+  RecordedStroke m_stroke;
+  std::chrono::steady_clock::time_point m_startTime;
+};
+
+void write_recorded_stroke(std::ostream& os, const RecordedStroke& stroke);
+RecordedStrokes read_recorded_strokes(std::istream& is);
+bool load_recorded_strokes(const std::string& filename,
+                           RecordedStrokes& strokes);
+
+} // namespace tools
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -49,11 +49,58 @@ void Symmetry::generateStrokes(const Stroke& stroke, Strokes& strokes,
   }
 }
 
+int Symmetry::generatePoints(const Stroke::Pt& pt,
+                             std::array<Stroke::Pt, 4>& pts,
+                             ToolLoop* loop)
+{
+  pts[0] = pt;
+  gen::SymmetryMode symmetryMode = loop->getSymmetry()->mode();
+  switch (symmetryMode) {
+    case gen::SymmetryMode::NONE:
+      ASSERT(false);
+      return 1;
+
+    case gen::SymmetryMode::HORIZONTAL:
+    case gen::SymmetryMode::VERTICAL: {
+      int brushSize, brushCenter;
+      getBrushSizeAndCenter(loop, symmetryMode, brushSize, brushCenter);
+      pts[1] = mirrorPoint(pt, symmetryMode, brushSize, brushCenter);
+      return 2;
+    }
+
+    case gen::SymmetryMode::BOTH: {
+      int hSize, hCenter, vSize, vCenter;
+      getBrushSizeAndCenter(loop, gen::SymmetryMode::HORIZONTAL, hSize, hCenter);
+      getBrushSizeAndCenter(loop, gen::SymmetryMode::VERTICAL, vSize, vCenter);
+      pts[1] = mirrorPoint(pt, gen::SymmetryMode::HORIZONTAL, hSize, hCenter);
+      pts[2] = mirrorPoint(pt, gen::SymmetryMode::VERTICAL, vSize, vCenter);
+      // The BOTH mirror is the horizontal mirror of the vertical one
+      pts[3] = mirrorPoint(pts[2], gen::SymmetryMode::BOTH, hSize, hCenter);
+      return 4;
+    }
+  }
+  return 1;
+}
+
 void Symmetry::calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                           ToolLoop* loop, gen::SymmetryMode symmetryMode)
 {
   int brushSize, brushCenter;
-  if (loop->getPointShape()->isFloodFill()) {
+  getBrushSizeAndCenter(loop, symmetryMode, brushSize, brushCenter);
+
+  for (const auto& pt : refStroke)
+    stroke.addPoint(mirrorPoint(pt, symmetryMode, brushSize, brushCenter));
+}
+
+void Symmetry::getBrushSizeAndCenter(ToolLoop* loop,
+                                     gen::SymmetryMode symmetryMode,
+                                     int& brushSize, int& brushCenter) const
+{
+  if (loop->getDynamics().isDynamic()) {
+    // The size/center is calculated for each point in mirrorPoint()
+    brushSize = brushCenter = -1;
+  }
+  else if (loop->getPointShape()->isFloodFill()) {
     brushSize = 1;
     brushCenter = 0;
   }
@@ -70,21 +117,23 @@ void Symmetry::calculateSymmetricalStroke(const Stroke& refStroke, Stroke& strok
       brushCenter = brush->center().y;
     }
   }
+}
 
-  const bool isDynamic = loop->getDynamics().isDynamic();
-  for (const auto& pt : refStroke) {
-    if (isDynamic) {
-      brushSize = pt.size;
-      brushCenter = (brushSize - brushSize % 2) / 2;
-    }
-    Stroke::Pt pt2 = pt;
-    pt2.symmetry = symmetryMode;
-    if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
-      pt2.x = 2 * (m_x + brushCenter) - pt2.x - brushSize;
-    else
-      pt2.y = 2 * (m_y + brushCenter) - pt2.y - brushSize;
-    stroke.addPoint(pt2);
+Stroke::Pt Symmetry::mirrorPoint(const Stroke::Pt& pt,
+                                 gen::SymmetryMode symmetryMode,
+                                 int brushSize, int brushCenter) const
+{
+  if (brushSize < 0) {
+    brushSize = pt.size;
+    brushCenter = (brushSize - brushSize % 2) / 2;
   }
+  Stroke::Pt pt2 = pt;
+  pt2.symmetry = symmetryMode;
+  if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
+    pt2.x = 2 * (m_x + brushCenter) - pt2.x - brushSize;
+  else
+    pt2.y = 2 * (m_y + brushCenter) - pt2.y - brushSize;
+  return pt2;
 }
 
 } // namespace tools
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2015  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,8 @@
 #include "app/tools/stroke.h"
 #include "app/pref/preferences.h"
 
+#include <array>
+
 namespace app {
 namespace tools {
 
@@ -27,11 +29,23 @@ public:
 
   void generateStrokes(const Stroke& stroke, Strokes& strokes, ToolLoop* loop);
 
+  // Generates the given point and its symmetrical points in "pts"
+  // without creating temporary strokes (used to draw each point of
+  // a freehand stroke). Returns the number of generated points.
+  int generatePoints(const Stroke::Pt& pt, std::array<Stroke::Pt, 4>& pts,
+                     ToolLoop* loop);
+
   gen::SymmetryMode mode() const { return m_symmetryMode; }
 
 private:
   void calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                   ToolLoop* loop, gen::SymmetryMode symmetryMode);
+  void getBrushSizeAndCenter(ToolLoop* loop,
+                             gen::SymmetryMode symmetryMode,
+                             int& brushSize, int& brushCenter) const;
+  Stroke::Pt mirrorPoint(const Stroke::Pt& pt,
+                         gen::SymmetryMode symmetryMode,
+                         int brushSize, int brushCenter) const;
 
   gen::SymmetryMode m_symmetryMode;
   double m_x, m_y;
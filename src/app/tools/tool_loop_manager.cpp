@@ -17,6 +17,7 @@
 #include "app/tools/ink.h"
 #include "app/tools/intertwine.h"
 #include "app/tools/point_shape.h"
+#include "app/tools/pointer_recorder.h"
 #include "app/tools/symmetry.h"
 #include "app/tools/tool_loop.h"
 #include "app/tools/velocity.h"
@@ -24,6 +25,7 @@
 #include "doc/image.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/trace.h"
 #include "gfx/point_io.h"
 #include "gfx/rect_io.h"
 #include "gfx/region.h"
@@ -66,6 +68,9 @@ void ToolLoopManager::cancel()
 
 void ToolLoopManager::end()
 {
+  if (m_recorder)
+    m_recorder->endStroke(!m_canceled);
+
   if (m_canceled)
     m_toolLoop->rollback();
   else
@@ -97,6 +102,9 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::pressButton", pointer.point());
 
+  if (m_recorder)
+    m_recorder->record(RecordedPointer::Press, pointer);
+
   // A little patch to memorize initial Trace Policy in the
   // current function execution.
   // When the initial trace policy is "Last" and then
@@ -125,9 +133,7 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
   Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
   m_toolLoop->getController()->pressButton(m_toolLoop, m_stroke, spritePoint);
 
-  std::string statusText;
-  m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
-  m_toolLoop->updateStatusBar(statusText.c_str());
+  updateStatusBar();
 
   // We evaluate if the trace policy has changed compared with
   // the initial trace policy.
@@ -147,6 +153,9 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::releaseButton", pointer.point());
 
+  if (m_recorder)
+    m_recorder->record(RecordedPointer::Release, pointer);
+
   m_lastPointer = pointer;
 
   if (isCanceled())
@@ -175,6 +184,40 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 
 void ToolLoopManager::movement(Pointer pointer)
 {
+  if (!addMovement(pointer))
+    return;
+
+  updateStatusBar();
+  doLoopStep(false);
+}
+
+void ToolLoopManager::movement(const std::vector<Pointer>& pointers)
+{
+  if (pointers.empty())
+    return;
+
+  if (!canJoinMovements()) {
+    for (const Pointer& pointer : pointers)
+      movement(pointer);
+    return;
+  }
+
+  for (const Pointer& pointer : pointers) {
+    if (!addMovement(pointer))
+      return;
+  }
+
+  updateStatusBar();
+  doLoopStep(false);
+}
+
+// Adds the pointer position to the stroke (through the controller),
+// returns false if the loop was canceled.
+bool ToolLoopManager::addMovement(Pointer pointer)
+{
+  if (m_recorder)
+    m_recorder->record(RecordedPointer::Movement, pointer);
+
   // Filter points with the stabilizer
   if (m_dynamics.stabilizer && m_dynamics.stabilizerFactor > 0) {
     const double f = m_dynamics.stabilizerFactor;
@@ -197,16 +240,45 @@ void ToolLoopManager::movement(Pointer pointer)
   m_lastPointer = pointer;
 
   if (isCanceled())
-    return;
+    return false;
 
   Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
   m_toolLoop->getController()->movement(m_toolLoop, m_stroke, spritePoint);
+  return true;
+}
 
+// Only freehand tools that accumulate the painted points can join
+// several movements in one step. Other tools use only the last
+// position (TracePolicy::Last) or need the result of each step in the
+// source image (TracePolicy::Overlap).
+bool ToolLoopManager::canJoinMovements() const
+{
+  Controller* controller = m_toolLoop->getController();
+  return (controller->isFreehand() &&
+          !controller->handleTracePolicy() &&
+          m_toolLoop->getTracePolicy() == TracePolicy::Accumulate);
+}
+
+void ToolLoopManager::flushDeferredUpdates()
+{
+  if (m_deferredStatusText) {
+    m_toolLoop->updateStatusBar(m_deferredStatusText->c_str());
+    m_deferredStatusText.reset();
+  }
+  if (!m_deferredDirtyArea.isEmpty()) {
+    m_toolLoop->updateDirtyArea(m_deferredDirtyArea);
+    m_deferredDirtyArea.clear();
+  }
+}
+
+void ToolLoopManager::updateStatusBar()
+{
   std::string statusText;
   m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
-  m_toolLoop->updateStatusBar(statusText.c_str());
-
-  doLoopStep(false);
+  if (m_deferUpdates)
+    m_deferredStatusText = std::move(statusText);
+  else
+    m_toolLoop->updateStatusBar(statusText.c_str());
 }
 
 void ToolLoopManager::disableMouseStabilizer() 
@@ -217,6 +289,8 @@ void ToolLoopManager::disableMouseStabilizer()
 
 void ToolLoopManager::doLoopStep(bool lastStep)
 {
+  DOC_TRACE_ZONE("tool loop step");
+
   // Original set of points to interwine (original user stroke,
   // relative to sprite origin).
   Stroke main_stroke;
@@ -295,7 +369,10 @@ void ToolLoopManager::doLoopStep(bool lastStep)
 
   if (!m_dirtyArea.isEmpty()) {
     m_toolLoop->validateDstTileset(m_dirtyArea);
-    m_toolLoop->updateDirtyArea(m_dirtyArea);
+    if (m_deferUpdates)
+      m_deferredDirtyArea |= m_dirtyArea;
+    else
+      m_toolLoop->updateDirtyArea(m_dirtyArea);
   }
 
   TOOL_TRACE("ToolLoopManager::doLoopStep dirtyArea", m_dirtyArea.bounds());
@@ -16,6 +16,8 @@
 #include "gfx/point.h"
 #include "gfx/region.h"
 
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace gfx { class Region; }
@@ -23,6 +25,7 @@ namespace gfx { class Region; }
 namespace app {
 namespace tools {
 
+class PointerRecorder;
 class ToolLoop;
 
 // Class to manage the drawing tool (editor <-> tool interface).
@@ -78,13 +81,36 @@ public:
   // Should be called each time the user moves the mouse inside the editor.
   void movement(Pointer pointer);
 
+  // Processes several mouse movements received since the last
+  // movement() (e.g. high-rate samples from a tablet). Freehand
+  // tools join all the points in just one step (and update the dirty
+  // area just one time), other tools process them one by one.
+  void movement(const std::vector<Pointer>& pointers);
+
   // Should be called when Shift+brush tool is used to disable stabilizer
   // on the line preview
   void disableMouseStabilizer();
 
   const Pointer& lastPointer() const { return m_lastPointer; }
 
+  // Returns true if movement() joins several points in one step.
+  bool canJoinMovements() const;
+
+  // Delays the ToolLoop::updateDirtyArea() and updateStatusBar()
+  // calls until flushDeferredUpdates() is called. Useful to call
+  // movement() from a background thread (the UI must be updated from
+  // the main thread).
+  void setDeferUpdates(bool state) { m_deferUpdates = state; }
+  const gfx::Region& deferredDirtyArea() const { return m_deferredDirtyArea; }
+  void flushDeferredUpdates();
+
+  // Records all the pointer events of this tool loop (the stroke is
+  // saved/discarded when end() is called).
+  void setRecorder(PointerRecorder* recorder) { m_recorder = recorder; }
+
 private:
+  bool addMovement(Pointer pointer);
+  void updateStatusBar();
   void doLoopStep(bool lastStep);
   void snapToGrid(Stroke::Pt& pt);
   Stroke::Pt getSpriteStrokePt(const Pointer& pointer);
@@ -103,6 +129,10 @@ private:
   const int m_brushAngle0;
   DynamicsOptions m_dynamics;
   gfx::PointF m_stabilizerCenter;
+  bool m_deferUpdates = false;
+  gfx::Region m_deferredDirtyArea;
+  std::optional<std::string> m_deferredStatusText;
+  PointerRecorder* m_recorder = nullptr;
 };
 
 } // namespace tools
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -94,6 +94,8 @@ void Transaction::commit()
   ASSERT(m_cmds);
   TX_TRACE("TX: Commit <%s>\n", m_cmds->label().c_str());
 
+  addPendingChanges();
+
   m_cmds->updateSpritePositionAfter();
   const SpritePosition sprPos = m_cmds->spritePositionAfterExecute();
 
@@ -134,6 +136,9 @@ void Transaction::rollback(CmdTransaction* newCmds)
   ASSERT(m_cmds);
   TX_TRACE("TX: Rollback <%s>\n", m_cmds->label().c_str());
 
+  // Add the pending changes so they are undone too
+  addPendingChanges();
+
   m_cmds->undo();
 
   delete m_cmds;
@@ -158,6 +163,8 @@ void Transaction::execute(Cmd* cmd)
   }
 
   try {
+    addPendingChanges();
+
     // We have to add the "cmd" to the sequence (CmdTransaction) and
     // then execute it. This is because the execution can generate
     // some signals that could add/execute new actions to the undo
@@ -170,6 +177,23 @@ void Transaction::execute(Cmd* cmd)
   }
 }
 
+void Transaction::setPendingChanges(std::function<void()>&& addPendingChanges)
+{
+  ASSERT(!m_addPendingChanges);
+  m_addPendingChanges = std::move(addPendingChanges);
+}
+
+void Transaction::addPendingChanges()
+{
+  if (m_addPendingChanges) {
+    // Move the function to a local variable because it will call
+    // execute() again
+    auto func = std::move(m_addPendingChanges);
+    m_addPendingChanges = nullptr;
+    func();
+  }
+}
+
 void Transaction::onSelectionChanged(DocEvent& ev)
 {
   m_changes = Changes(int(m_changes) | int(Changes::kSelection));
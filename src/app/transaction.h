@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "app/doc_observer.h"
 #include "base/exception.h"
 
+#include <functional>
 #include <string>
 
 namespace app {
@@ -100,6 +101,13 @@ namespace app {
 
     CmdTransaction* cmds() { return m_cmds; }
 
+    // Sets a function to add pending changes to the transaction
+    // (e.g. pixels modified directly by scripts that are added as
+    // just one Cmd). The function is called (only once) before
+    // executing the next Cmd and before committing/rolling back the
+    // transaction, so the changes are undone in the correct order.
+    void setPendingChanges(std::function<void()>&& addPendingChanges);
+
   private:
     // List of changes during the execution of this transaction
     enum class Changes {
@@ -112,6 +120,7 @@ namespace app {
     };
 
     void rollback(CmdTransaction* newCmds);
+    void addPendingChanges();
 
     // DocObserver impl
     void onSelectionChanged(DocEvent& ev) override;
@@ -123,6 +132,7 @@ namespace app {
     DocUndo* m_undo;
     CmdTransaction* m_cmds;
     Changes m_changes;
+    std::function<void()> m_addPendingChanges;
   };
 
 } // namespace app
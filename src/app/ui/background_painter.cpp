@@ -0,0 +1,175 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/background_painter.h"
+
+#include "app/color_spaces.h"
+#include "base/debug.h"
+#include "base/thread.h"
+#include "os/system.h"
+#include "ui/system.h"
+
+#include <algorithm>
+
+namespace app {
+
+using namespace ui;
+
+// static
+BackgroundPainter* BackgroundPainter::instance()
+{
+  static BackgroundPainter painter;
+  return &painter;
+}
+
+BackgroundPainter::~BackgroundPainter()
+{
+  ASSERT(m_canvases.empty());
+  ASSERT(!m_paintingThread.joinable());
+}
+
+void BackgroundPainter::addClient(Client* client)
+{
+  assert_ui_thread();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_canvases.empty()) {
+    m_killing = false;
+    m_paintingThread = std::thread([this]{ paintingProc(); });
+  }
+  m_canvases[client] = nullptr;
+}
+
+void BackgroundPainter::removeClient(Client* client)
+{
+  assert_ui_thread();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  stopPainting(lock, client);
+  m_canvases.erase(client);
+
+  if (m_canvases.empty()) {
+    m_killing = true;
+    m_paintingCV.notify_one();
+    lock.unlock();
+
+    m_paintingThread.join();
+  }
+}
+
+os::Surface* BackgroundPainter::getCanvas(Client* client,
+                                          int w, int h,
+                                          gfx::Color bgColor)
+{
+  assert_ui_thread();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_canvases.find(client);
+  ASSERT(it != m_canvases.end());
+  if (it == m_canvases.end())
+    return nullptr;
+
+  os::SurfaceRef& canvas = it->second;
+  auto activeCS = get_current_color_space();
+
+  if (!canvas ||
+      canvas->width() != w ||
+      canvas->height() != h ||
+      canvas->colorSpace() != activeCS) {
+    stopPainting(lock, client);
+
+    os::SurfaceRef oldCanvas = canvas;
+    canvas = os::instance()->makeSurface(w, h, activeCS);
+    os::Paint paint;
+    paint.color(bgColor);
+    paint.style(os::Paint::Fill);
+    canvas->drawRect(gfx::Rect(0, 0, w, h), paint);
+    if (oldCanvas) {
+      canvas->drawSurface(
+        oldCanvas.get(),
+        gfx::Rect(0, 0, oldCanvas->width(), oldCanvas->height()),
+        gfx::Rect(0, 0, w, h),
+        os::Sampling(),
+        nullptr);
+    }
+  }
+  return canvas.get();
+}
+
+void BackgroundPainter::startPainting(Client* client)
+{
+  assert_ui_thread();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  stopPainting(lock, client);
+
+  m_queue.push_back(client);
+  m_paintingCV.notify_one();
+}
+
+void BackgroundPainter::stopPainting(Client* client)
+{
+  assert_ui_thread();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  stopPainting(lock, client);
+}
+
+void BackgroundPainter::stopPainting(std::unique_lock<std::mutex>& lock,
+                                     Client* client)
+{
+  // Discard queued paintings of this client
+  m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), client),
+                m_queue.end());
+
+  // Stop the current painting
+  if (m_current == client) {
+    m_stop = true;
+    m_doneCV.wait(lock, [this, client]{ return m_current != client; });
+  }
+}
+
+void BackgroundPainter::paintingProc()
+{
+  base::this_thread::set_name("bg-painter");
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_paintingCV.wait(lock, [this]{ return m_killing || !m_queue.empty(); });
+    if (m_killing)
+      break;
+
+    Client* client = m_queue.front();
+    m_queue.pop_front();
+
+    auto it = m_canvases.find(client);
+    if (it == m_canvases.end() || !it->second)
+      continue;
+
+    // Keep a reference to the surface, it cannot be re-created while
+    // we are painting it anyway (getCanvas() stops the painting
+    // first).
+    os::SurfaceRef canvas = it->second;
+    m_current = client;
+    m_stop = false;
+
+    // Do the intensive painting without locking the UI thread
+    lock.unlock();
+    client->onPaintInBgThread(canvas.get(), m_stop);
+    lock.lock();
+
+    m_current = nullptr;
+    if (!m_stop)
+      client->onBgPaintingDone();
+    m_doneCV.notify_all();
+  }
+}
+
+} // namespace app
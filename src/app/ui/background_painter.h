@@ -0,0 +1,100 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_BACKGROUND_PAINTER_H_INCLUDED
+#define APP_UI_BACKGROUND_PAINTER_H_INCLUDED
+#pragma once
+
+#include "gfx/color.h"
+#include "os/surface.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace app {
+
+  // Paints the expensive parts of widgets in a background thread.
+  //
+  // Each client has its own offscreen surface:
+  // 1. The widget queues a painting of its surface with
+  //    startPainting() and keeps drawing the last content of the
+  //    surface in its onPaint()
+  // 2. The surface is painted in the background thread
+  //    (Client::onPaintInBgThread())
+  // 3. When the painting is done the client is notified
+  //    (Client::onBgPaintingDone()) so the widget can be invalidated
+  //    to flip the new content onto the screen
+  // 4. If the widget needs a new painting before the previous one is
+  //    done, the old one is stopped (it would render an outdated
+  //    state of the widget)
+  //
+  // TODO An alternative ui::Graphics implementation could generate a
+  //      list of commands for this thread, so widgets could use the
+  //      same onPaint() code, but we would need to invalidate the
+  //      commands that render outdated regions.
+  class BackgroundPainter {
+  public:
+    class Client {
+    public:
+      virtual ~Client() { }
+
+      // Called from the background thread to paint the surface. The
+      // "stop" flag is set to true when the painting is outdated, so
+      // the client must check it frequently and return as soon as
+      // possible.
+      virtual void onPaintInBgThread(os::Surface* s, bool& stop) = 0;
+
+      // Called from the background thread when the painting is done
+      // (and it wasn't stopped).
+      virtual void onBgPaintingDone() = 0;
+    };
+
+    static BackgroundPainter* instance();
+
+    ~BackgroundPainter();
+
+    // Clients must be added/removed from the UI thread. The
+    // background thread runs while there is at least one client.
+    void addClient(Client* client);
+    void removeClient(Client* client);
+
+    // Returns the offscreen surface of the given client with the
+    // given size in the current color space. If the surface must be
+    // re-created, the painting of the client is stopped and the old
+    // content is scaled to the new surface (to display something
+    // until the new painting is done).
+    os::Surface* getCanvas(Client* client, int w, int h, gfx::Color bgColor);
+
+    // Queues a new painting of the client surface, stopping the
+    // current one (if any).
+    void startPainting(Client* client);
+
+    // Stops the painting of the client and waits until the
+    // background thread doesn't use its surface anymore.
+    void stopPainting(Client* client);
+
+  private:
+    BackgroundPainter() { }
+    void stopPainting(std::unique_lock<std::mutex>& lock, Client* client);
+    void paintingProc();
+
+    bool m_killing = false;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_paintingCV;
+    std::condition_variable m_doneCV;
+    std::map<Client*, os::SurfaceRef> m_canvases;
+    std::deque<Client*> m_queue;
+    Client* m_current = nullptr;
+    std::thread m_paintingThread;
+  };
+
+} // namespace app
+
+#endif
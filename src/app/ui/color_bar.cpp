@@ -901,10 +901,10 @@ void ColorBar::onRemapPalButtonClick()
       if (remap.isFor8bit()) {
         PalettePicks usedEntries(256);
 
-        for (ImageRef& image : images) {
-          for (const auto& i : LockImageBits<IndexedTraits>(image.get()))
-            usedEntries[i] = true;
-        }
+        Image::IndexHistogram histogram;
+        sprite->getIndexHistogram(histogram);
+        for (int i=0; i<int(histogram.size()); ++i)
+          usedEntries[i] = (histogram[i] > 0);
 
         if (remap.isInvertible(usedEntries)) {
           for (int i=0; i<remap.size(); ++i) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,14 +18,12 @@
 #include "app/color_utils.h"
 #include "app/modules/gfx.h"
 #include "app/pref/preferences.h"
+#include "app/ui/background_painter.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/util/shader_helpers.h"
-#include "base/concurrent_queue.h"
 #include "base/scoped_value.h"
-#include "base/thread.h"
 #include "os/surface.h"
-#include "os/system.h"
 #include "ui/manager.h"
 #include "ui/message.h"
 #include "ui/paint_event.h"
@@ -36,9 +34,7 @@
 
 #include <algorithm>
 #include <cmath>
-#include <condition_variable>
 #include <cstdio>
-#include <thread>
 
 #if SK_ENABLE_SKSL
   #include "os/skia/skia_surface.h"
@@ -52,189 +48,6 @@ namespace app {
 using namespace app::skin;
 using namespace ui;
 
-// TODO This logic could be used to redraw any widget:
-// 1. We send a onPaintSurfaceInBgThread() to paint the widget on a
-//    offscreen buffer
-// 2. When the painting is done, we flip the buffer onto the screen
-// 3. If we receive another onPaint() we can cancel the background
-//    painting and start another onPaintSurfaceInBgThread()
-//
-// An alternative (better) way:
-// 1. Create an alternative ui::Graphics implementation that generates
-//    a list commands for the render thread
-// 2. Widgets can still use the same onPaint()
-// 3. The background threads consume the list of commands and render
-//    the screen.
-//
-// The bad side is that is harder to invalidate the commands that will
-// render an old state of the widget. So the render thread should
-// start caring about invalidating old commands (outdated regions) or
-// cleaning the queue if it gets too big.
-//
-class ColorSelector::Painter {
-public:
-  Painter() : m_canvas(nullptr) {
-  }
-
-  ~Painter() {
-    ASSERT(!m_canvas);
-  }
-
-  void addRef() {
-    assert_ui_thread();
-
-    if (m_ref == 0)
-      m_paintingThread = std::thread([this]{ paintingProc(); });
-
-    ++m_ref;
-  }
-
-  void releaseRef() {
-    assert_ui_thread();
-
-    --m_ref;
-    if (m_ref == 0) {
-      {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        stopCurrentPainting(lock);
-
-        m_killing = true;
-        m_paintingCV.notify_one();
-      }
-
-      m_paintingThread.join();
-      if (m_canvas)
-        m_canvas.reset();
-    }
-  }
-
-  os::Surface* getCanvas(int w, int h, gfx::Color bgColor) {
-    assert_ui_thread();
-
-    auto activeCS = get_current_color_space();
-
-    if (!m_canvas ||
-        m_canvas->width() != w ||
-        m_canvas->height() != h ||
-        m_canvas->colorSpace() != activeCS) {
-      std::unique_lock<std::mutex> lock(m_mutex);
-      stopCurrentPainting(lock);
-
-      os::SurfaceRef oldCanvas = m_canvas;
-      m_canvas = os::instance()->makeSurface(w, h, activeCS);
-      os::Paint paint;
-      paint.color(bgColor);
-      paint.style(os::Paint::Fill);
-      m_canvas->drawRect(gfx::Rect(0, 0, w, h), paint);
-      if (oldCanvas) {
-        m_canvas->drawSurface(
-          oldCanvas.get(),
-          gfx::Rect(0, 0, oldCanvas->width(), oldCanvas->height()),
-          gfx::Rect(0, 0, w, h),
-          os::Sampling(),
-          nullptr);
-      }
-    }
-    return m_canvas.get();
-  }
-
-  void startBgPainting(ColorSelector* colorSelector,
-                       const gfx::Rect& mainBounds,
-                       const gfx::Rect& bottomBarBounds,
-                       const gfx::Rect& alphaBarBounds) {
-    assert_ui_thread();
-    COLSEL_TRACE("COLSEL: startBgPainting for %p\n", colorSelector);
-
-    std::unique_lock<std::mutex> lock(m_mutex);
-    stopCurrentPainting(lock);
-
-    m_colorSelector = colorSelector;
-    m_manager = colorSelector->manager();
-    m_mainBounds = mainBounds;
-    m_bottomBarBounds = bottomBarBounds;
-    m_alphaBarBounds = alphaBarBounds;
-
-    m_stopPainting = false;
-    m_paintingCV.notify_one();
-  }
-
-private:
-
-  void stopCurrentPainting(std::unique_lock<std::mutex>& lock) {
-    // Stop current
-    if (m_colorSelector) {
-      COLSEL_TRACE("COLSEL: stoppping painting of %p\n", m_colorSelector);
-
-      // TODO use another condition variable here
-      m_stopPainting = true;
-      m_waitStopCV.wait(lock);
-    }
-
-    ASSERT(m_colorSelector == nullptr);
-  }
-
-  void paintingProc() {
-    COLSEL_TRACE("COLSEL: paintingProc starts\n");
-
-    base::this_thread::set_name("colsel-painter");
-
-    std::unique_lock<std::mutex> lock(m_mutex);
-    while (true) {
-      m_paintingCV.wait(lock);
-
-      if (m_killing)
-        break;
-
-      auto colorSel = m_colorSelector;
-      if (!colorSel)
-        break;
-
-      COLSEL_TRACE("COLSEL: starting painting in bg for %p\n", colorSel);
-
-      // Do the intesive painting in the background thread
-      {
-        lock.unlock();
-        colorSel->onPaintSurfaceInBgThread(
-          m_canvas.get(),
-          m_mainBounds,
-          m_bottomBarBounds,
-          m_alphaBarBounds,
-          m_stopPainting);
-        lock.lock();
-      }
-
-      m_colorSelector = nullptr;
-
-      if (m_stopPainting) {
-        COLSEL_TRACE("COLSEL: painting for %p stopped\n");
-        m_waitStopCV.notify_one();
-      }
-      else {
-        COLSEL_TRACE("COLSEL: painting for %p done and sending message\n");
-        colorSel->m_paintFlags |= DoneFlag;
-      }
-    }
-
-    COLSEL_TRACE("COLSEL: paintingProc ends\n");
-  }
-
-  int m_ref = 0;
-  bool m_killing = false;
-  bool m_stopPainting = false;
-  std::mutex m_mutex;
-  std::condition_variable m_paintingCV;
-  std::condition_variable m_waitStopCV;
-  os::SurfaceRef m_canvas;
-  ColorSelector* m_colorSelector;
-  ui::Manager* m_manager;
-  gfx::Rect m_mainBounds;
-  gfx::Rect m_bottomBarBounds;
-  gfx::Rect m_alphaBarBounds;
-  std::thread m_paintingThread;
-};
-
-static ColorSelector::Painter painter;
-
 #if SK_ENABLE_SKSL
 // static
 sk_sp<SkRuntimeEffect> ColorSelector::m_alphaEffect;
@@ -247,7 +60,7 @@ ColorSelector::ColorSelector()
   , m_timer(100, this)
 {
   initTheme();
-  painter.addRef();
+  BackgroundPainter::instance()->addClient(this);
 
   m_appConn = App::instance()
     ->ColorSpaceChange.connect(
@@ -256,7 +69,7 @@ ColorSelector::ColorSelector()
 
 ColorSelector::~ColorSelector()
 {
-  painter.releaseRef();
+  BackgroundPainter::instance()->removeClient(this);
 }
 
 void ColorSelector::selectColor(const app::Color& color)
@@ -455,9 +268,10 @@ void ColorSelector::onPaint(ui::PaintEvent& ev)
       isSRGB = true;
     }
     else {
-      // We'll paint in the ColorSelector::Painter canvas, and so we
+      // We'll paint in the BackgroundPainter canvas, and so we
       // can convert color spaces.
-      painterSurface = painter.getCanvas(rc.w, rc.h, theme->colors.workspace());
+      painterSurface = BackgroundPainter::instance()->getCanvas(
+        this, rc.w, rc.h, theme->colors.workspace());
       canvas = &static_cast<os::SkiaSurface*>(painterSurface)->canvas();
       isSRGB = false;
     }
@@ -513,7 +327,8 @@ void ColorSelector::onPaint(ui::PaintEvent& ev)
   else
 #endif // SK_ENABLE_SKSL
   {
-    painterSurface = painter.getCanvas(rc.w, rc.h, theme->colors.workspace());
+    painterSurface = BackgroundPainter::instance()->getCanvas(
+      this, rc.w, rc.h, theme->colors.workspace());
   }
 
   if (painterSurface)
@@ -536,11 +351,18 @@ void ColorSelector::onPaint(ui::PaintEvent& ev)
     m_paintFlags &= ~DoneFlag;
     m_timer.start();
 
+    // Stop the current painting before changing the areas to paint
+    auto painter = BackgroundPainter::instance();
+    painter->stopPainting(this);
+
     gfx::Point d = -rc.origin();
-    rc.offset(d);
-    if (!bottomBarBounds.isEmpty()) bottomBarBounds.offset(d);
-    if (!alphaBarBounds.isEmpty()) alphaBarBounds.offset(d);
-    painter.startBgPainting(this, rc, bottomBarBounds, alphaBarBounds);
+    m_bgMainBounds = rc;
+    m_bgMainBounds.offset(d);
+    m_bgBottomBarBounds = bottomBarBounds;
+    if (!m_bgBottomBarBounds.isEmpty()) m_bgBottomBarBounds.offset(d);
+    m_bgAlphaBarBounds = alphaBarBounds;
+    if (!m_bgAlphaBarBounds.isEmpty()) m_bgAlphaBarBounds.offset(d);
+    painter->startPainting(this);
   }
 }
 
@@ -568,6 +390,20 @@ void ColorSelector::onPaintSurfaceInBgThread(
   }
 }
 
+void ColorSelector::onPaintInBgThread(os::Surface* s, bool& stop)
+{
+  onPaintSurfaceInBgThread(s,
+                           m_bgMainBounds,
+                           m_bgBottomBarBounds,
+                           m_bgAlphaBarBounds,
+                           stop);
+}
+
+void ColorSelector::onBgPaintingDone()
+{
+  m_paintFlags |= DoneFlag;
+}
+
 int ColorSelector::onNeedsSurfaceRepaint(const app::Color& newColor)
 {
   return (m_color.getRed()   != newColor.getRed()   ||
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/color.h"
+#include "app/ui/background_painter.h"
 #include "app/ui/color_source.h"
 #include "obs/connection.h"
 #include "obs/signal.h"
@@ -36,10 +37,9 @@ inline bool cs_double_diff(double a, double b) {
 namespace app {
 
   class ColorSelector : public ui::Widget
-                      , public IColorSource {
+                      , public IColorSource
+                      , public BackgroundPainter::Client {
   public:
-    class Painter;
-
     ColorSelector();
     ~ColorSelector();
 
@@ -110,6 +110,10 @@ namespace app {
 #endif
 
   private:
+    // BackgroundPainter::Client impl
+    void onPaintInBgThread(os::Surface* s, bool& stop) override;
+    void onBgPaintingDone() override;
+
     app::Color getAlphaBarColor(const int u, const int umax);
     void onPaintAlphaBar(ui::Graphics* g, const gfx::Rect& rc);
 
@@ -138,6 +142,12 @@ namespace app {
 
     ui::Timer m_timer;
 
+    // Areas to paint in the background thread (relative to the
+    // BackgroundPainter surface).
+    gfx::Rect m_bgMainBounds;
+    gfx::Rect m_bgBottomBarBounds;
+    gfx::Rect m_bgAlphaBarBounds;
+
     obs::scoped_connection m_appConn;
 
 #if SK_ENABLE_SKSL
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,12 +13,14 @@
 #include "app/color_spaces.h"
 #include "app/color_utils.h"
 #include "app/modules/gfx.h"
+#include "app/pref/preferences.h"
 #include "app/ui/alpha_entry.h"
 #include "app/ui/alpha_slider.h"
 #include "app/ui/color_sliders.h"
 #include "app/ui/expr_entry.h"
 #include "app/ui/skin/skin_slider_property.h"
 #include "app/ui/skin/skin_theme.h"
+#include "app/util/shader_helpers.h"
 #include "base/scoped_value.h"
 #include "gfx/hsl.h"
 #include "gfx/rgb.h"
@@ -33,6 +35,14 @@
 
 #include <algorithm>
 #include <limits>
+#include <string>
+
+#if SK_ENABLE_SKSL
+  #include "os/skia/skia_surface.h"
+
+  #include "include/core/SkCanvas.h"
+  #include "include/effects/SkRuntimeEffect.h"
+#endif
 
 namespace app {
 
@@ -42,6 +52,73 @@ using namespace ui;
 
 namespace {
 
+#if SK_ENABLE_SKSL
+
+  // Shaders to paint the background of each channel slider (created
+  // on demand).
+  sk_sp<SkRuntimeEffect> g_sliderEffects[ColorSliders::Channels];
+
+  // Returns the SkSL code to paint the background of the given
+  // channel slider, or an empty string for the alpha channel (which
+  // is painted with draw_alpha_slider()). "d" is the value of the
+  // channel in [0, 1] for each pixel, and "iColor" is the current
+  // color in the RGB/HSV/HSL space of the channel.
+  std::string get_slider_shader(const ColorSliders::Channel channel)
+  {
+    std::string code = "uniform half3 iRes;"
+                       "uniform half4 iColor;";
+    const char* color = nullptr;
+    switch (channel) {
+      case ColorSliders::Channel::Red:
+        color = "half4(d, iColor.g, iColor.b, 1.0)";
+        break;
+      case ColorSliders::Channel::Green:
+        color = "half4(iColor.r, d, iColor.b, 1.0)";
+        break;
+      case ColorSliders::Channel::Blue:
+        color = "half4(iColor.r, iColor.g, d, 1.0)";
+        break;
+      case ColorSliders::Channel::HsvHue:
+        code += kHSV_to_RGB_sksl;
+        color = "hsv_to_rgb(half3(d, iColor.y, iColor.z)).rgb1";
+        break;
+      case ColorSliders::Channel::HsvSaturation:
+        code += kHSV_to_RGB_sksl;
+        color = "hsv_to_rgb(half3(iColor.x, d, iColor.z)).rgb1";
+        break;
+      case ColorSliders::Channel::HsvValue:
+        code += kHSV_to_RGB_sksl;
+        color = "hsv_to_rgb(half3(iColor.x, iColor.y, d)).rgb1";
+        break;
+      case ColorSliders::Channel::HslHue:
+        code += kHSL_to_RGB_sksl;
+        color = "hsl_to_rgb(half3(d, iColor.y, iColor.z)).rgb1";
+        break;
+      case ColorSliders::Channel::HslSaturation:
+        code += kHSL_to_RGB_sksl;
+        color = "hsl_to_rgb(half3(iColor.x, d, iColor.z)).rgb1";
+        break;
+      case ColorSliders::Channel::HslLightness:
+        code += kHSL_to_RGB_sksl;
+        color = "hsl_to_rgb(half3(iColor.x, iColor.y, d)).rgb1";
+        break;
+      case ColorSliders::Channel::Gray:
+        color = "half4(d, d, d, 1.0)";
+        break;
+      default:
+        return std::string();
+    }
+    code += R"(
+half4 main(vec2 fragcoord) {
+ half d = clamp((fragcoord.x-0.5) / max(iRes.x-1.0, 1.0), 0.0, 1.0);
+ return )";
+    code += color;
+    code += ";\n}\n";
+    return code;
+  }
+
+#endif // SK_ENABLE_SKSL
+
   // This class is used as SkinSliderProperty for RGB/HSV sliders to
   // draw the background of them.
   class ColorSliderBgPainter : public ISliderBgPainter {
@@ -61,6 +138,11 @@ namespace {
         return;
       }
 
+#if SK_ENABLE_SKSL
+      if (paintWithShader(g, rc))
+        return;
+#endif
+
       // Color space conversion
       auto convertColor = convert_from_current_to_screen_color_space();
 
@@ -127,6 +209,63 @@ namespace {
     }
 
   private:
+#if SK_ENABLE_SKSL
+    bool paintWithShader(Graphics* g, const gfx::Rect& rc) {
+      if (!Preferences::instance().experimental.useShadersForColorSelectors())
+        return false;
+
+      // We paint directly in the ui::Graphics surface, so we cannot
+      // convert color spaces.
+      // TODO compare both color spaces
+      auto surface = g->getInternalSurface();
+      if ((get_current_color_space() &&
+           !get_current_color_space()->isSRGB()) ||
+          (surface->colorSpace() &&
+           !surface->colorSpace()->isSRGB()))
+        return false;
+
+      sk_sp<SkRuntimeEffect>& effect = g_sliderEffects[m_channel];
+      if (!effect) {
+        const std::string code = get_slider_shader(m_channel);
+        if (code.empty())
+          return false;
+        effect = make_shader(code.c_str());
+        if (!effect)
+          return false;
+      }
+
+      SkRuntimeShaderBuilder builder(effect);
+      builder.uniform("iRes") = SkV3{float(rc.w), float(rc.h), 0.0f};
+      switch (m_channel) {
+        case ColorSliders::Channel::HsvHue:
+        case ColorSliders::Channel::HsvSaturation:
+        case ColorSliders::Channel::HsvValue:
+          builder.uniform("iColor") = appColorHsv_to_SkV4(m_color);
+          break;
+        case ColorSliders::Channel::HslHue:
+        case ColorSliders::Channel::HslSaturation:
+        case ColorSliders::Channel::HslLightness:
+          builder.uniform("iColor") = appColorHsl_to_SkV4(m_color);
+          break;
+        default:
+          builder.uniform("iColor") = appColor_to_SkV4(m_color);
+          break;
+      }
+
+      SkPaint p;
+      p.setStyle(SkPaint::kFill_Style);
+      p.setShader(builder.makeShader());
+
+      SkCanvas* canvas = &static_cast<os::SkiaSurface*>(surface)->canvas();
+      canvas->save();
+      canvas->translate(rc.x+g->getInternalDeltaX(),
+                        rc.y+g->getInternalDeltaY());
+      canvas->drawRect(SkRect::MakeXYWH(0, 0, rc.w, rc.h), p);
+      canvas->restore();
+      return true;
+    }
+#endif // SK_ENABLE_SKSL
+
     ColorSliders::Channel m_channel;
     app::Color m_color;
   };
@@ -45,6 +45,7 @@
 #include "ui/manager.h"
 #include "ui/system.h"
 
+#include <algorithm>
 #include <array>
 
 namespace app {
@@ -422,8 +423,10 @@ void BrushPreview::show(const gfx::Point& screenPos)
       createCrosshairCursor(&g, uiCursorColor);
     }
 
-    forEachBrushPixel(&g, spritePos, uiCursorColor, &BrushPreview::savePixelDelegate);
-    forEachBrushPixel(&g, spritePos, uiCursorColor, &BrushPreview::drawPixelDelegate);
+    m_outlinePoints.clear();
+    forEachBrushPixel(&g, spritePos, uiCursorColor, &BrushPreview::addPointDelegate);
+    saveOutlineArea(&g);
+    drawOutline(&g, uiCursorColor);
     m_withModifiedPixels = true;
   }
 
@@ -468,8 +471,7 @@ void BrushPreview::hide()
     // Restore pixels
     ui::ScreenGraphics g(m_editor->display());
     ui::SetClip clip(&g);
-    forEachBrushPixel(&g, m_editorPosition, gfx::ColorNone,
-                      &BrushPreview::clearPixelDelegate);
+    restoreOutlineArea(&g);
   }
 
   // Clean pixel/brush preview
@@ -766,15 +768,108 @@ void BrushPreview::forEachBrushPixel(
   gfx::Color color,
   PixelDelegate pixelDelegate)
 {
-  m_savedPixelsIterator = 0;
-
   if (m_type & SELECTION_CROSSHAIR)
     traceSelectionCrossPixels(g, spritePos, color, 1, pixelDelegate);
 
   if (m_type & BRUSH_BOUNDARIES)
     traceBrushBoundaries(g, spritePos, color, pixelDelegate);
+}
+
+// Saves the screen area behind all the m_outlinePoints with just one
+// blit, so we don't need to read each pixel from the screen.
+void BrushPreview::saveOutlineArea(ui::Graphics* g)
+{
+  m_savedBounds.setEmpty();
+  if (m_outlinePoints.empty())
+    return;
 
-  m_savedPixelsLimit = m_savedPixelsIterator;
+  gfx::Point min = m_outlinePoints.front();
+  gfx::Point max = min;
+  for (const gfx::Point& pt : m_outlinePoints) {
+    min.x = std::min(min.x, pt.x);
+    min.y = std::min(min.y, pt.y);
+    max.x = std::max(max.x, pt.x);
+    max.y = std::max(max.y, pt.y);
+  }
+
+  os::Surface* screen = g->getInternalSurface();
+  m_savedBounds = gfx::Rect(min, max + gfx::Point(1, 1));
+  m_savedBounds.offset(g->getInternalDeltaX(), g->getInternalDeltaY());
+  m_savedBounds &= gfx::Rect(0, 0, screen->width(), screen->height());
+  if (m_savedBounds.isEmpty())
+    return;
+
+  // Re-use the same surface while it's big enough
+  if (!m_savedSurface ||
+      m_savedSurface->width() < m_savedBounds.w ||
+      m_savedSurface->height() < m_savedBounds.h) {
+    m_savedSurface = os::instance()->makeSurface(
+      std::max(m_savedBounds.w, m_savedSurface ? m_savedSurface->width(): 0),
+      std::max(m_savedBounds.h, m_savedSurface ? m_savedSurface->height(): 0),
+      screen->colorSpace());
+  }
+
+  os::SurfaceLock lockScreen(screen);
+  os::SurfaceLock lock(m_savedSurface.get());
+  screen->blitTo(m_savedSurface.get(),
+                 m_savedBounds.x, m_savedBounds.y, 0, 0,
+                 m_savedBounds.w, m_savedBounds.h);
+}
+
+void BrushPreview::drawOutline(ui::Graphics* g, gfx::Color color)
+{
+  if (!m_blackAndWhiteNegative) {
+    for (const gfx::Point& pt : m_outlinePoints)
+      g->putPixel(color, pt.x, pt.y);
+    return;
+  }
+
+  if (m_savedBounds.isEmpty())
+    return;
+
+  // Use the negative of the saved pixels
+  const gfx::Point delta(g->getInternalDeltaX(),
+                         g->getInternalDeltaY());
+  os::SurfaceLock lock(m_savedSurface.get());
+  for (const gfx::Point& pt : m_outlinePoints) {
+    if (!m_savedBounds.contains(pt + delta))
+      continue;
+
+    const gfx::Color c =
+      m_savedSurface->getPixel(pt.x + delta.x - m_savedBounds.x,
+                               pt.y + delta.y - m_savedBounds.y);
+    g->putPixel(color_utils::blackandwhite_neg(
+                  gfx::rgba(gfx::getr(c), gfx::getg(c), gfx::getb(c))),
+                pt.x, pt.y);
+  }
+}
+
+// Restores the area saved in saveOutlineArea() that is still visible
+// and wasn't modified/invalidated since then.
+void BrushPreview::restoreOutlineArea(ui::Graphics* g)
+{
+  if (m_savedBounds.isEmpty() || !m_savedSurface)
+    return;
+
+  const gfx::Point delta(g->getInternalDeltaX(),
+                         g->getInternalDeltaY());
+  gfx::Region rgn(m_savedBounds);
+  rgn.offset(-delta);
+  rgn &= m_clippingRegion;
+  rgn &= m_oldClippingRegion;
+
+  os::Surface* screen = g->getInternalSurface();
+  os::SurfaceLock lockScreen(screen);
+  os::SurfaceLock lock(m_savedSurface.get());
+  for (const gfx::Rect& rc : rgn) {
+    m_savedSurface->blitTo(screen,
+                           rc.x+delta.x-m_savedBounds.x,
+                           rc.y+delta.y-m_savedBounds.y,
+                           rc.x+delta.x, rc.y+delta.y,
+                           rc.w, rc.h);
+    g->invalidate(rc);
+  }
+  m_savedBounds.setEmpty();
 }
 
 // Old thick cross (used for selection tools)
@@ -845,55 +940,10 @@ void BrushPreview::traceBrushBoundaries(ui::Graphics* g,
 //////////////////////////////////////////////////////////////////////
 // Pixel delegates
 
-void BrushPreview::savePixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color)
-{
-  if (m_clippingRegion.contains(pt)) {
-    color_t c = g->getPixel(pt.x, pt.y);
-
-    if (m_savedPixelsIterator < (int)m_savedPixels.size())
-      m_savedPixels[m_savedPixelsIterator] = c;
-    else
-      m_savedPixels.push_back(c);
-
-    ++m_savedPixelsIterator;
-  }
-}
-
-void BrushPreview::drawPixelDelegate(ui::Graphics* gfx, const gfx::Point& pt, gfx::Color color)
-{
-  if (m_savedPixelsIterator < (int)m_savedPixels.size() &&
-      m_clippingRegion.contains(pt)) {
-    if (m_blackAndWhiteNegative) {
-      int c = m_savedPixels[m_savedPixelsIterator];
-      int r = gfx::getr(c);
-      int g = gfx::getg(c);
-      int b = gfx::getb(c);
-
-      gfx->putPixel(color_utils::blackandwhite_neg(gfx::rgba(r, g, b)), pt.x, pt.y);
-    }
-    else {
-      gfx->putPixel(color, pt.x, pt.y);
-    }
-    ++m_savedPixelsIterator;
-  }
-}
-
-void BrushPreview::clearPixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color)
+void BrushPreview::addPointDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color)
 {
-  if (m_savedPixelsIterator < (int)m_savedPixels.size()) {
-    if (m_oldClippingRegion.contains(pt)) {
-      if (m_clippingRegion.contains(pt))
-        g->putPixel(m_savedPixels[m_savedPixelsIterator], pt.x, pt.y);
-      ++m_savedPixelsIterator;
-    }
-  }
-
-#if _DEBUG
-  if (!(m_savedPixelsIterator <= m_savedPixelsLimit)) {
-    TRACE("m_savedPixelsIterator <= m_savedPixelsLimit: %d <= %d failed\n",
-          m_savedPixelsIterator, m_savedPixelsLimit);
-  }
-#endif
+  if (m_clippingRegion.contains(pt))
+    m_outlinePoints.push_back(pt);
 }
 
 } // namespace app
@@ -111,9 +111,11 @@ namespace app {
     void traceSelectionCrossPixels(ui::Graphics* g, const gfx::Point& pt, gfx::Color color, int thickness, PixelDelegate pixel);
     void traceBrushBoundaries(ui::Graphics* g, gfx::Point pos, gfx::Color color, PixelDelegate pixel);
 
-    void savePixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color);
-    void drawPixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color);
-    void clearPixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color);
+    void saveOutlineArea(ui::Graphics* g);
+    void drawOutline(ui::Graphics* g, gfx::Color color);
+    void restoreOutlineArea(ui::Graphics* g);
+
+    void addPointDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color);
 
     Editor* m_editor;
     int m_type = CROSSHAIR;
@@ -136,9 +138,15 @@ namespace app {
     // True if we've modified pixels in the display surface
     // (e.g. drawing the selection crosshair or the brush edges).
     bool m_withModifiedPixels = false;
-    std::vector<gfx::Color> m_savedPixels;
-    int m_savedPixelsIterator;
-    int m_savedPixelsLimit;
+
+    // Screen pixels of the crosshair/brush edges (inside the
+    // clipping region) drawn in the last show().
+    std::vector<gfx::Point> m_outlinePoints;
+
+    // Copy of the screen area behind the m_outlinePoints (in
+    // display surface coordinates) to restore it in hide().
+    os::SurfaceRef m_savedSurface;
+    gfx::Rect m_savedBounds;
 
     gfx::Region m_clippingRegion;
     gfx::Region m_oldClippingRegion;
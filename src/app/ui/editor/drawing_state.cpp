@@ -14,6 +14,7 @@
 #include "app/commands/command.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
+#include "app/pref/preferences.h"
 #include "app/tools/controller.h"
 #include "app/tools/ink.h"
 #include "app/tools/tool.h"
@@ -27,7 +28,10 @@
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui_context.h"
 #include "base/scoped_value.h"
+#include "base/thread.h"
+#include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/primitives.h"
 #include "ui/message.h"
 #include "ui/system.h"
 
@@ -54,11 +58,24 @@ static int get_delay_interval_for_tool_loop(tools::ToolLoop* toolLoop)
     return 5;
   }
   else {
-    // Without delay for freehand-like tools
-    return 0;
+    // Minimum delay for freehand-like tools, just to join all the
+    // mouse movements that are already queued (e.g. from high-rate
+    // tablets) in one step (see DrawingState::m_pendingPointers).
+    return 1;
   }
 }
 
+// Returns true if the ink of the given tool loop can be processed in
+// a background thread (only inks that modify the pixels of the
+// destination image, tiles are modified in the main thread).
+static bool can_draw_in_background(tools::ToolLoop* toolLoop)
+{
+  const tools::Ink* ink = toolLoop->getInk();
+  return (Preferences::instance().experimental.drawInBackground() &&
+          !toolLoop->getDstTileset() &&
+          (ink->isPaint() || ink->isEffect() || ink->isEraser()));
+}
+
 DrawingState::DrawingState(Editor* editor,
                            tools::ToolLoop* toolLoop,
                            const DrawingType type)
@@ -71,7 +88,12 @@ DrawingState::DrawingState(Editor* editor,
   , m_mouseMoveReceived(false)
   , m_mousePressedReceived(false)
   , m_processScrollChange(true)
+  , m_drawInBackground(can_draw_in_background(toolLoop))
+  , m_drawTaskTimer(1)
 {
+  m_drawTaskTimer.Tick.connect([this]{ onDrawTaskTick(); });
+  m_toolLoopManager->setRecorder(App::instance()->pointerRecorder());
+
   m_beforeCmdConn =
     UIContext::instance()->BeforeCommandExecution.connect(
       &DrawingState::onBeforeCommandExecution, this);
@@ -100,12 +122,21 @@ void DrawingState::initToolLoop(Editor* editor,
                          m_toolLoop->getInk()->isSlice() ?
                            nullptr : m_toolLoop->getLayer());
 
+  doc::Image* previewImage = (tileset ? nullptr: m_toolLoop->getDstImage());
+  if (m_drawInBackground) {
+    // The editor shows a copy of the destination image that is
+    // updated only when a step is completed.
+    m_previewImage.reset(doc::Image::createCopy(previewImage));
+    previewImage = m_previewImage.get();
+    m_toolLoopManager->setDeferUpdates(true);
+  }
+
   // Prepare preview image (the destination image will be our preview
   // in the tool-loop time, so we can see what we are drawing)
   editor->renderEngine().setPreviewImage(
     previewLayer,
     m_toolLoop->getFrame(),
-    tileset ? nullptr: m_toolLoop->getDstImage(),
+    previewImage,
     tileset,
     m_toolLoop->getCelOrigin(),
     (previewLayer &&
@@ -123,6 +154,7 @@ void DrawingState::initToolLoop(Editor* editor,
 
   m_toolLoopManager->prepareLoop(pointer);
   m_toolLoopManager->pressButton(pointer);
+  publishDrawing();
 
   ASSERT(!m_toolLoopManager->isCanceled());
 
@@ -138,14 +170,19 @@ void DrawingState::disableMouseStabilizer()
 void DrawingState::sendMovementToToolLoop(const tools::Pointer& pointer)
 {
   ASSERT(m_toolLoopManager);
+  flushPendingMovements();
   m_lastPointer = pointer;
   m_toolLoopManager->movement(pointer);
+  publishDrawing();
 }
 
 void DrawingState::notifyToolLoopModifiersChange(Editor* editor)
 {
-  if (!m_toolLoopManager->isCanceled())
+  waitDrawTask();
+  if (!m_toolLoopManager->isCanceled()) {
     m_toolLoopManager->notifyToolLoopModifiersChange();
+    publishDrawing();
+  }
 }
 
 void DrawingState::onBeforePopState(Editor* editor)
@@ -162,6 +199,8 @@ bool DrawingState::onMouseDown(Editor* editor, MouseMessage* msg)
   if (!editor->hasCapture())
     editor->captureMouse();
 
+  flushPendingMovements();
+
   tools::Pointer pointer = pointer_from_msg(editor, msg,
                                             m_velocity.velocity());
   m_lastPointer = pointer;
@@ -181,6 +220,7 @@ bool DrawingState::onMouseDown(Editor* editor, MouseMessage* msg)
 
   // Notify the mouse button down to the tool loop manager.
   m_toolLoopManager->pressButton(pointer);
+  publishDrawing();
 
   // Store the isCanceled flag, because destroyLoopIfCanceled might
   // destroy the tool loop manager.
@@ -207,6 +247,8 @@ bool DrawingState::onMouseUp(Editor* editor, MouseMessage* msg)
 {
   ASSERT(m_toolLoopManager != NULL);
 
+  flushPendingMovements();
+
   m_lastPointer = pointer_from_msg(editor, msg, m_velocity.velocity());
   m_delayedMouseMove.onMouseUp(msg);
 
@@ -226,7 +268,9 @@ bool DrawingState::onMouseUp(Editor* editor, MouseMessage* msg)
     // Notify the release of the mouse button to the tool loop
     // manager. This is the correct way to say "the user finishes the
     // drawing trace correctly".
-    if (m_toolLoopManager->releaseButton(m_lastPointer))
+    const bool res = m_toolLoopManager->releaseButton(m_lastPointer);
+    publishDrawing();
+    if (res)
       return true;
   }
 
@@ -281,8 +325,10 @@ bool DrawingState::onMouseMove(Editor* editor, MouseMessage* msg)
 
   // Use DelayedMouseMove for tools like line, rectangle, etc. (that
   // use the only the last mouse position) to filter out rapid mouse
-  // movement.
-  m_delayedMouseMove.onMouseMove(msg);
+  // movement. For freehand tools we keep all the positions to join
+  // them in onCommitMouseMove().
+  if (m_delayedMouseMove.onMouseMove(msg))
+    m_pendingPointers.push_back(m_lastPointer);
   return true;
 }
 
@@ -332,6 +378,8 @@ bool DrawingState::onKeyDown(Editor* editor, KeyMessage* msg)
 
 bool DrawingState::onKeyUp(Editor* editor, KeyMessage* msg)
 {
+  waitDrawTask();
+
   // Cancel loop pressing Esc key...
   if (msg->scancode() == ui::kKeyEsc ||
       // Cancel "Shift on freehand" line preview when the Shift key is
@@ -360,6 +408,8 @@ bool DrawingState::onScrollChange(Editor* editor)
                                    m_lastPointer.button(),
                                    m_lastPointer.type(),
                                    m_lastPointer.pressure());
+    m_delayedMouseMove.stopTimer();
+    m_pendingPointers.push_back(m_lastPointer);
     handleMouseMovement();
   }
   return true;
@@ -374,8 +424,21 @@ bool DrawingState::onUpdateStatusBar(Editor* editor)
 
 void DrawingState::onExposeSpritePixels(const gfx::Region& rgn)
 {
-  if (m_toolLoop)
+  if (m_toolLoop) {
+    // We cannot touch the destination image while it's being
+    // modified in the background (the result of the task is
+    // published later in onDrawTaskTick() as we are painting now).
+    if (m_drawTaskPending)
+      waitDrawTaskCompletion();
+
     m_toolLoop->validateDstImage(rgn);
+
+    if (m_previewImage) {
+      gfx::Region imageRgn(rgn);
+      imageRgn.offset(-m_toolLoop->getCelOrigin());
+      doc::copy_image(m_previewImage.get(), m_toolLoop->getDstImage(), imageRgn);
+    }
+  }
 }
 
 bool DrawingState::getGridBounds(Editor* editor, gfx::Rect& gridBounds)
@@ -390,9 +453,139 @@ bool DrawingState::getGridBounds(Editor* editor, gfx::Rect& gridBounds)
 
 void DrawingState::handleMouseMovement()
 {
-  // Notify mouse movement to the tool
   ASSERT(m_toolLoopManager);
-  m_toolLoopManager->movement(m_lastPointer);
+
+  if (m_drawInBackground) {
+    // The new points will be drawn when the current step is
+    // completed (in onDrawTaskTick()).
+    if (m_drawTaskPending) {
+      if (m_pendingPointers.empty())
+        m_pendingPointers.push_back(m_lastPointer);
+      return;
+    }
+
+    if (!m_pendingPointers.empty() &&
+        m_toolLoopManager->canJoinMovements()) {
+      startDrawTask();
+      return;
+    }
+  }
+
+  processPendingMovements();
+}
+
+// Notifies the mouse movements to the tool in the main thread.
+void DrawingState::processPendingMovements()
+{
+  if (m_pendingPointers.empty() ||
+      m_toolLoop->getTracePolicy() == tools::TracePolicy::Last) {
+    m_toolLoopManager->movement(m_lastPointer);
+  }
+  else {
+    m_toolLoopManager->movement(m_pendingPointers);
+  }
+  m_pendingPointers.clear();
+  publishDrawing();
+}
+
+// Processes the mouse movements that are waiting for the
+// DelayedMouseMove timer or the background task (e.g. before
+// releasing the mouse button).
+void DrawingState::flushPendingMovements()
+{
+  waitDrawTask();
+
+  if (m_pendingPointers.empty())
+    return;
+
+  m_delayedMouseMove.stopTimer();
+  if (!m_toolLoopManager->isCanceled())
+    processPendingMovements();
+  m_pendingPointers.clear();
+}
+
+void DrawingState::startDrawTask()
+{
+  ASSERT(!m_drawTaskPending);
+  m_drawTaskPending = true;
+  m_drawTask.run(
+    [this, pointers = std::move(m_pendingPointers)](base::task_token&){
+      try {
+        m_toolLoopManager->movement(pointers);
+      }
+      catch (...) {
+        m_drawTaskError = std::current_exception();
+      }
+    });
+  m_pendingPointers.clear();
+  m_drawTaskTimer.start();
+}
+
+void DrawingState::waitDrawTaskCompletion()
+{
+  ASSERT(m_drawTaskPending);
+  // Task::wait() is too slow for this case (steps take a few
+  // milliseconds)
+  while (!m_drawTask.completed())
+    base::this_thread::sleep_for(0.001);
+}
+
+// Waits the background task and publishes its result.
+void DrawingState::waitDrawTask()
+{
+  if (m_drawTaskPending) {
+    waitDrawTaskCompletion();
+    finishDrawTask();
+  }
+}
+
+void DrawingState::finishDrawTask()
+{
+  m_drawTaskPending = false;
+  m_drawTaskTimer.stop();
+
+  if (m_drawTaskError) {
+    std::exception_ptr error = m_drawTaskError;
+    m_drawTaskError = nullptr;
+    std::rethrow_exception(error);
+  }
+
+  publishDrawing();
+}
+
+void DrawingState::onDrawTaskTick()
+{
+  if (!m_drawTaskPending || !m_drawTask.completed())
+    return;
+
+  try {
+    finishDrawTask();
+
+    // Draw the points received while the task was running
+    if (!m_pendingPointers.empty() &&
+        m_toolLoopManager &&
+        !m_toolLoopManager->isCanceled()) {
+      handleMouseMovement();
+    }
+  }
+  catch (const std::exception& ex) {
+    m_editor->showUnhandledException(ex, nullptr);
+  }
+}
+
+// Copies the modified area of the destination image to the preview
+// image and updates the UI (only when we draw in background).
+void DrawingState::publishDrawing()
+{
+  if (!m_drawInBackground || !m_toolLoopManager)
+    return;
+
+  gfx::Region rgn = m_toolLoopManager->deferredDirtyArea();
+  if (!rgn.isEmpty()) {
+    rgn.offset(-m_toolLoop->getCelOrigin());
+    doc::copy_image(m_previewImage.get(), m_toolLoop->getDstImage(), rgn);
+  }
+  m_toolLoopManager->flushDeferredUpdates();
 }
 
 bool DrawingState::canInterpretMouseMovementAsJustOneClick()
@@ -423,6 +616,8 @@ void DrawingState::onBeforeCommandExecution(CommandExecutionEvent& ev)
   if (!m_toolLoop)
     return;
 
+  waitDrawTask();
+
   if (canExecuteCommands() ||
       // Undo/Redo/Cancel will cancel the ToolLoop
       ev.command()->id() == CommandId::Undo() ||
@@ -453,6 +648,15 @@ void DrawingState::destroyLoopIfCanceled(Editor* editor)
 
 void DrawingState::destroyLoop(Editor* editor)
 {
+  // Wait the background task without publishing its result (the
+  // preview image is removed anyway)
+  if (m_drawTaskPending) {
+    waitDrawTaskCompletion();
+    m_drawTaskPending = false;
+    m_drawTaskTimer.stop();
+    m_drawTaskError = nullptr;
+  }
+
   if (editor)
     editor->renderEngine().removePreviewImage();
 
@@ -461,6 +665,8 @@ void DrawingState::destroyLoop(Editor* editor)
 
   m_toolLoopManager.reset(nullptr);
   m_toolLoop.reset(nullptr);
+  m_pendingPointers.clear();
+  m_previewImage.reset();
 
   app_rebuild_documents_tabs();
 }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -9,13 +9,19 @@
 #define APP_UI_EDITOR_DRAWING_STATE_H_INCLUDED
 #pragma once
 
+#include "app/task.h"
 #include "app/tools/pointer.h"
 #include "app/tools/velocity.h"
 #include "app/ui/editor/delayed_mouse_move.h"
 #include "app/ui/editor/standby_state.h"
 #include "base/time.h"
+#include "doc/image_ref.h"
 #include "obs/connection.h"
+#include "ui/timer.h"
+
+#include <exception>
 #include <memory>
+#include <vector>
 
 namespace app {
   namespace tools {
@@ -72,6 +78,14 @@ namespace app {
 
   private:
     void handleMouseMovement();
+    void processPendingMovements();
+    void flushPendingMovements();
+    void startDrawTask();
+    void waitDrawTaskCompletion();
+    void waitDrawTask();
+    void finishDrawTask();
+    void onDrawTaskTick();
+    void publishDrawing();
     bool canInterpretMouseMovementAsJustOneClick();
     bool canExecuteCommands();
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
@@ -104,6 +118,10 @@ namespace app {
     // button when onScrollChange() event is received.
     tools::Pointer m_lastPointer;
 
+    // Mouse movements received since the last onCommitMouseMove(),
+    // freehand tools process all of them in just one step.
+    std::vector<tools::Pointer> m_pendingPointers;
+
     // Used to calculate the velocity of the mouse (whch is a sensor
     // to generate dynamic parameters).
     tools::VelocitySensor m_velocity;
@@ -117,6 +135,19 @@ namespace app {
     // Locks the scroll
     bool m_processScrollChange;
 
+    // To draw in a background thread (experimental.draw_in_background
+    // option) the editor shows m_previewImage (a copy of the tool loop
+    // destination image with the last published step) while
+    // m_drawTask draws the next points in the destination image.
+    const bool m_drawInBackground;
+    doc::ImageRef m_previewImage;
+    app::Task m_drawTask;
+    // True if m_drawTask was started and its result wasn't published
+    bool m_drawTaskPending = false;
+    std::exception_ptr m_drawTaskError;
+    // Checks when m_drawTask is completed to publish its result
+    ui::Timer m_drawTaskTimer;
+
     obs::scoped_connection m_beforeCmdConn;
   };
 
@@ -57,9 +57,11 @@
 #include "app/util/tile_flags_utils.h"
 #include "base/chrono.h"
 #include "base/convert_to.h"
+#include "base/fstream_path.h"
 #include "doc/doc.h"
 #include "doc/mask_boundaries.h"
 #include "doc/slice.h"
+#include "doc/slices_index.h"
 #include "fmt/format.h"
 #include "os/color_space.h"
 #include "os/sampling.h"
@@ -71,8 +73,11 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <fstream>
 #include <limits>
+#include <map>
 #include <memory>
+#include <vector>
 
 namespace app {
 
@@ -85,6 +90,19 @@ using namespace render;
 static base::Chrono renderChrono;
 static double renderElapsed = 0.0;
 
+// Break down of the time spent in the last Editor::onPaint() (shown
+// with the "perf.show_render_time" option)
+static struct {
+  double background;      // drawBackground()
+  double render;          // Render engine (composition + conversion to surface)
+  double blit;            // Rendered surfaces drawn in the screen
+  int renders;            // Number of renderSprite() calls
+  int64_t pixels;         // Number of rendered pixels
+} perfCounters;
+
+// Minimum size (in screen pixels) of a grid cell to draw the grid
+static const double kMinGridCellSize = 3.0;
+
 class EditorPostRenderImpl : public EditorPostRender {
 public:
   EditorPostRenderImpl(Editor* editor, Graphics* g)
@@ -582,17 +600,21 @@ void Editor::updateEditor(const bool restoreScrollPos)
   View::getView(this)->updateView(restoreScrollPos);
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+bool Editor::calcOneSpriteUnclippedRect(const gfx::Rect& clip,
+                                        const gfx::Rect& spriteRectToDraw,
+                                        const int dx, const int dy,
+                                        gfx::Rect& rc,
+                                        gfx::Rect& dest,
+                                        gfx::Rect& expose) const
 {
   // Clip from sprite and apply zoom
-  gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
+  rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
   rc = m_proj.apply(rc);
 
-  gfx::Rect dest(dx + m_padding.x + rc.x,
-                 dy + m_padding.y + rc.y, 0, 0);
+  dest = gfx::Rect(dx + m_padding.x + rc.x,
+                   dy + m_padding.y + rc.y, 0, 0);
 
   // Clip from graphics/screen
-  const gfx::Rect& clip = g->getClipBounds();
   if (dest.x < clip.x) {
     rc.x += clip.x - dest.x;
     rc.w -= clip.x - dest.x;
@@ -611,11 +633,11 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   }
 
   if (rc.isEmpty())
-    return;
+    return false;
 
   // Bounds of pixels from the sprite canvas that will be exposed in
   // this render cycle.
-  gfx::Rect expose = m_proj.remove(rc);
+  expose = m_proj.remove(rc);
 
   // If the zoom level is less than 100%, we add extra pixels to
   // the exposed area. Those pixels could be shown in the
@@ -641,7 +663,14 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   const int maxh = std::max(0, m_sprite->height()-expose.y);
   expose.w = std::clamp(expose.w, 0, maxw);
   expose.h = std::clamp(expose.h, 0, maxh);
-  if (expose.isEmpty())
+  return !expose.isEmpty();
+}
+
+void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+{
+  gfx::Rect rc, dest, expose;
+  if (!calcOneSpriteUnclippedRect(g->getClipBounds(), spriteRectToDraw,
+                                  dx, dy, rc, dest, expose))
     return;
 
   // rc2 is the rectangle used to create a temporal rendered image of the sprite
@@ -664,55 +693,45 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   // Convert the render to a os::Surface
   static os::SurfaceRef rendered = nullptr; // TODO move this to other centralized place
   const auto& renderProperties = m_renderEngine->properties();
+
+  // In tiled mode the same sprite area can be drawn several times in
+  // the same drawSpriteUnclippedRect() call, so we can re-use the
+  // pixels that were already rendered for other tile.
+  const bool reuseRendered = (rendered &&
+                              !m_renderedArea.isEmpty() &&
+                              m_renderedArea.contains(rc2));
+  gfx::Point renderedPos(0, 0);
+
+  // In tiled mode we render the sprite area needed by all tiles at
+  // once (m_tiledRenderArea), so the other tiles can re-use it.
+  gfx::Rect renderArea = rc2;
+  if (!reuseRendered && !m_tiledRenderArea.isEmpty()) {
+    renderArea |= (newEngine ? m_tiledRenderArea:
+                               m_proj.apply(m_tiledRenderArea));
+    expose |= m_tiledRenderArea;
+  }
+
   try {
-    // Generate a "expose sprite pixels" notification. This is used by
-    // tool managers that need to validate this region (copy pixels from
-    // the original cel) before it can be used by the RenderEngine.
-    m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
-
-    m_renderEngine->setNewBlendMethod(pref.experimental.newBlend());
-    m_renderEngine->setRefLayersVisiblity(true);
-    m_renderEngine->setSelectedLayer(m_layer);
-    m_renderEngine->setNonactiveLayersOpacity(otherLayersOpacity());
-    m_renderEngine->setupBackground(m_document, IMAGE_RGB);
-    m_renderEngine->disableOnionskin();
-
-    if ((m_flags & kShowOnionskin) == kShowOnionskin) {
-      if (m_docPref.onionskin.active()) {
-        OnionskinOptions opts(
-          (m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
-           render::OnionskinType::MERGE:
-           (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
-            render::OnionskinType::RED_BLUE_TINT:
-            render::OnionskinType::NONE)));
-
-        opts.position(m_docPref.onionskin.position());
-        opts.prevFrames(m_docPref.onionskin.prevFrames());
-        opts.nextFrames(m_docPref.onionskin.nextFrames());
-        opts.opacityBase(m_docPref.onionskin.opacityBase());
-        opts.opacityStep(m_docPref.onionskin.opacityStep());
-        opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
-
-        Tag* tag = nullptr;
-        if (m_docPref.onionskin.loopTag())
-          tag = m_sprite->tags().innerTag(m_frame);
-        opts.loopTag(tag);
-
-        m_renderEngine->setOnionskin(opts);
+    if (!reuseRendered) {
+      // Generate a "expose sprite pixels" notification. This is used by
+      // tool managers that need to validate this region (copy pixels from
+      // the original cel) before it can be used by the RenderEngine.
+      m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
+
+      setupRenderEngine(m_frame);
+
+      ExtraCelRef extraCel = m_document->extraCel();
+      if (extraCel &&
+          extraCel->type() != render::ExtraType::NONE) {
+        m_renderEngine->setExtraImage(
+          extraCel->type(),
+          extraCel->cel(),
+          extraCel->image(),
+          extraCel->blendMode(),
+          m_layer, m_frame);
       }
     }
 
-    ExtraCelRef extraCel = m_document->extraCel();
-    if (extraCel &&
-        extraCel->type() != render::ExtraType::NONE) {
-      m_renderEngine->setExtraImage(
-        extraCel->type(),
-        extraCel->cel(),
-        extraCel->image(),
-        extraCel->blendMode(),
-        m_layer, m_frame);
-    }
-
     // Render background first (e.g. new ShaderRenderer will paint the
     // background on the screen first and then composite the rendered
     // sprite on it.)
@@ -726,23 +745,35 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
                   m_proj.apply(rc2)));
     }
 
-    // Create a temporary surface to draw the sprite on it
-    if (!rendered ||
-        rendered->width() < rc2.w ||
-        rendered->height() < rc2.h ||
-        rendered->colorSpace() != m_document->osColorSpace()) {
-      const int maxw = std::max(rc2.w, rendered ? rendered->width(): 0);
-      const int maxh = std::max(rc2.h, rendered ? rendered->height(): 0);
-      rendered = os::instance()->makeRgbaSurface(
-        maxw, maxh, m_document->osColorSpace());
-    }
+    if (!reuseRendered) {
+      m_renderedArea = gfx::Rect();
+
+      // Create a temporary surface to draw the sprite on it
+      if (!rendered ||
+          rendered->width() < renderArea.w ||
+          rendered->height() < renderArea.h ||
+          rendered->colorSpace() != m_document->osColorSpace()) {
+        const int maxw = std::max(renderArea.w, rendered ? rendered->width(): 0);
+        const int maxh = std::max(renderArea.h, rendered ? rendered->height(): 0);
+        rendered = os::instance()->makeRgbaSurface(
+          maxw, maxh, m_document->osColorSpace());
+      }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+      m_renderEngine->setProjection(
+        newEngine ? render::Projection(): m_proj);
+
+      base::Chrono chrono;
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, renderArea));
+      perfCounters.render += chrono.elapsed();
+      perfCounters.pixels += int64_t(renderArea.w) * renderArea.h;
+      ++perfCounters.renders;
 
-    m_renderEngine->removeExtraImage();
+      m_renderEngine->removeExtraImage();
+
+      m_renderedArea = renderArea;
+    }
+    renderedPos = rc2.origin() - m_renderedArea.origin();
 
     // If the checkered background is visible in this sprite, we save
     // all settings of the background for this document.
@@ -754,6 +785,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   }
 
   if (rendered && rendered->nativeHandle()) {
+    base::Chrono chrono;
     os::Paint p;
     if (newEngine) {
       os::Sampling sampling;
@@ -784,18 +816,19 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         p.blendMode(os::BlendMode::Src);
 
       g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, rc2.w, rc2.h),
+                     gfx::Rect(renderedPos, rc2.size()),
                      dest,
                      sampling,
                      &p);
     }
     else {
       g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, dest.w, dest.h),
+                     gfx::Rect(renderedPos, dest.size()),
                      gfx::Rect(dest.x, dest.y, dest.w, dest.h),
                      os::Sampling(os::Sampling::Filter::Nearest),
                      &p);
     }
+    perfCounters.blit += chrono.elapsed();
   }
 
   // Draw grids
@@ -880,6 +913,80 @@ void Editor::drawBackground(ui::Graphics* g)
   g->drawHLine(theme->colors.editorSpriteBottomBorder(), rc.x, rc.y2(), rc.w);
 }
 
+void Editor::setupRenderEngine(const doc::frame_t frame)
+{
+  m_renderEngine->setNewBlendMethod(Preferences::instance().experimental.newBlend());
+  m_renderEngine->setRefLayersVisiblity(true);
+  m_renderEngine->setSelectedLayer(m_layer);
+  m_renderEngine->setNonactiveLayersOpacity(otherLayersOpacity());
+  m_renderEngine->setupBackground(m_document, IMAGE_RGB);
+  m_renderEngine->disableOnionskin();
+
+  if ((m_flags & kShowOnionskin) == kShowOnionskin) {
+    if (m_docPref.onionskin.active()) {
+      OnionskinOptions opts(
+        (m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
+         render::OnionskinType::MERGE:
+         (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
+          render::OnionskinType::RED_BLUE_TINT:
+          render::OnionskinType::NONE)));
+
+      opts.position(m_docPref.onionskin.position());
+      opts.prevFrames(m_docPref.onionskin.prevFrames());
+      opts.nextFrames(m_docPref.onionskin.nextFrames());
+      opts.opacityBase(m_docPref.onionskin.opacityBase());
+      opts.opacityStep(m_docPref.onionskin.opacityStep());
+      opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
+
+      Tag* tag = nullptr;
+      if (m_docPref.onionskin.loopTag())
+        tag = m_sprite->tags().innerTag(frame);
+      opts.loopTag(tag);
+
+      m_renderEngine->setOnionskin(opts);
+    }
+  }
+}
+
+// Renders the visible area of the given frame without showing it, so
+// the composite cache of the renderer contains the frame when it's
+// displayed (e.g. the next frame of the animation playback).
+void Editor::prerenderFrame(const doc::frame_t frame)
+{
+  if (!m_sprite ||
+      !isVisible() ||
+      frame < 0 || frame > m_sprite->lastFrame() ||
+      m_renderEngine->type() != EditorRender::kSimpleRenderer)
+    return;
+
+  gfx::Rect rc = getVisibleSpriteBounds();
+  if (rc.isEmpty())
+    return;
+
+  const bool newEngine = isUsingNewRenderEngine();
+  if (!newEngine)
+    rc = m_proj.apply(rc);
+
+  try {
+    if (!m_prerenderSurface ||
+        m_prerenderSurface->width() < rc.w ||
+        m_prerenderSurface->height() < rc.h ||
+        m_prerenderSurface->colorSpace() != m_document->osColorSpace()) {
+      m_prerenderSurface = os::instance()->makeRgbaSurface(
+        rc.w, rc.h, m_document->osColorSpace());
+    }
+
+    setupRenderEngine(frame);
+    m_renderEngine->setProjection(
+      newEngine ? render::Projection(): m_proj);
+    m_renderEngine->renderSprite(
+      m_prerenderSurface.get(), m_sprite, frame, gfx::Clip(0, 0, rc));
+  }
+  catch (const std::exception& e) {
+    Console::showException(e);
+  }
+}
+
 void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
 {
   gfx::Rect rc = _rc;
@@ -896,35 +1003,57 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_proj.applyY(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
+  // Position of each copy of the sprite (the main sprite at the
+  // center and the tiles of the tiled mode)
+  std::vector<gfx::Point> tiles;
+  tiles.push_back(gfx::Point(0, 0));
 
   // Document preferences
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, 0);
+    tiles.push_back(gfx::Point(spriteRect.w, 0));
+    tiles.push_back(gfx::Point(spriteRect.w*2, 0));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w*3, spriteRect.h);
   }
 
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h*2);
+    tiles.push_back(gfx::Point(0, spriteRect.h));
+    tiles.push_back(gfx::Point(0, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w, spriteRect.h*3);
   }
 
   if (m_docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h*2);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h*2);
+    tiles.push_back(gfx::Point(spriteRect.w,   spriteRect.h));
+    tiles.push_back(gfx::Point(spriteRect.w*2, spriteRect.h));
+    tiles.push_back(gfx::Point(spriteRect.w,   spriteRect.h*2));
+    tiles.push_back(gfx::Point(spriteRect.w*2, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(
       spriteRect.x, spriteRect.y,
       spriteRect.w*3, spriteRect.h*3);
   }
 
+  // Calculate the sprite area that is visible in all tiles, so it's
+  // rendered only once and then it's blitted for each tile.
+  m_renderedArea = gfx::Rect();
+  m_tiledRenderArea = gfx::Rect();
+  if (tiles.size() > 1) {
+    const gfx::Rect clip = g->getClipBounds();
+    for (const gfx::Point& tile : tiles) {
+      gfx::Rect tileRc, tileDest, tileExpose;
+      if (calcOneSpriteUnclippedRect(clip, rc, tile.x, tile.y,
+                                     tileRc, tileDest, tileExpose))
+        m_tiledRenderArea |= tileExpose;
+    }
+  }
+
+  for (const gfx::Point& tile : tiles)
+    drawOneSpriteUnclippedRect(g, rc, tile.x, tile.y);
+
+  m_tiledRenderArea = gfx::Rect();
+  m_renderedArea = gfx::Rect();
+
   // Draw slices
   if (m_docPref.show.slices())
     drawSlices(g);
@@ -1027,9 +1156,7 @@ void Editor::drawMask(Graphics* g)
   pt.x = m_padding.x + m_proj.applyX(pt.x);
   pt.y = m_padding.y + m_proj.applyY(pt.y);
 
-  // Create the mask boundaries path
   auto& segs = m_document->maskBoundaries();
-  segs.createPathIfNeeeded();
 
   ui::Paint paint;
   paint.style(ui::Paint::Stroke);
@@ -1038,13 +1165,82 @@ void Editor::drawMask(Graphics* g)
                            gfx::rgba(255, 255, 255, 255));
 
   // We translate the path instead of applying a matrix to the
-  // ui::Graphics so the "checkered" pattern is not scaled too.
-  gfx::Path path;
-  segs.path().transform(m_proj.scaleMatrix(), &path);
-  path.offset(pt.x, pt.y);
+  // ui::Graphics so the "checkered" pattern is not scaled too. The
+  // transformed path is cached in the boundaries, so the marching
+  // ants animation doesn't transform the path each time.
+  gfx::Path& path =
+    segs.transformedPath(m_proj.scaleX(), m_proj.scaleY(),
+                         gfx::PointF(pt));
   g->drawPath(path, paint);
 }
 
+#if ENABLE_DEVMODE
+void Editor::drawPerfInfo(ui::Graphics* g,
+                          const render::CompositeCache::Stats& cacheStats)
+{
+  auto& pref = Preferences::instance();
+  const double other = renderElapsed
+    - perfCounters.background - perfCounters.render - perfCounters.blit;
+  const std::size_t tiles = cacheStats.hits + cacheStats.misses;
+
+  const std::string lines[] = {
+    fmt::format("{:c} {:.4g}s",
+                pref.experimental.newRenderEngine() ? 'N': 'O',
+                renderElapsed),
+    fmt::format("bg {:.4g}s render {:.4g}s ({} calls, {} px)",
+                perfCounters.background,
+                perfCounters.render,
+                perfCounters.renders,
+                perfCounters.pixels),
+    fmt::format("blit {:.4g}s decorators/other {:.4g}s",
+                perfCounters.blit, other),
+    fmt::format("cache {}/{} tiles ({:.0f}%)",
+                cacheStats.hits, tiles,
+                tiles ? 100.0 * cacheStats.hits / tiles: 0.0),
+  };
+
+  View* view = View::getView(this);
+  gfx::Point pt = view->viewportBounds().origin();
+  m_perfInfoBounds = gfx::Rect(pt, gfx::Size(0, 0));
+  for (const std::string& line : lines) {
+    const gfx::Size size = g->measureUIText(line);
+    g->drawText(
+      line,
+      gfx::rgba(255, 255, 255, 255),
+      gfx::rgba(0, 0, 0, 255),
+      pt - bounds().origin());
+
+    m_perfInfoBounds |= gfx::Rect(pt, size);
+    pt.y += size.h;
+  }
+
+  // Append the same information to a CSV file to compare several
+  // paints (e.g. while drawing/scrolling)
+  static std::ofstream trace;
+  static std::string traceFilename;
+  const std::string& filename = pref.perf.renderTimeTrace();
+  if (traceFilename != filename) {
+    trace.close();
+    traceFilename = filename;
+    if (!filename.empty()) {
+      trace.open(FSTREAM_PATH(filename), std::ofstream::app);
+      trace << "total,background,render,blit,other,renders,pixels,cache_hits,cache_misses\n";
+    }
+  }
+  if (trace.is_open()) {
+    trace << renderElapsed << ','
+          << perfCounters.background << ','
+          << perfCounters.render << ','
+          << perfCounters.blit << ','
+          << other << ','
+          << perfCounters.renders << ','
+          << perfCounters.pixels << ','
+          << cacheStats.hits << ','
+          << cacheStats.misses << '\n';
+  }
+}
+#endif // ENABLE_DEVMODE
+
 void Editor::drawMaskSafe()
 {
   if ((m_flags & kShowMask) == 0)
@@ -1053,9 +1249,22 @@ void Editor::drawMaskSafe()
   if (isVisible() &&
       m_document &&
       m_document->hasMaskBoundaries()) {
+    // Area (in client coordinates) where drawMask() draws the
+    // boundaries, so we only redraw the marching ants in the visible
+    // parts of the selection
+    gfx::Point pt = mainTilePosition();
+    pt.x = m_padding.x + m_proj.applyX(pt.x);
+    pt.y = m_padding.y + m_proj.applyY(pt.y);
+    gfx::Rect antsBounds = m_proj.apply(m_document->maskBoundaries().bounds());
+    antsBounds.offset(pt);
+    antsBounds.enlarge(1);
+
     Region region;
     getDrawableRegion(region, kCutTopWindows);
     region.offset(-bounds().origin());
+    region &= Region(antsBounds);
+    if (region.isEmpty())
+      return;
 
     HideBrushPreview hide(m_brushPreview);
     GraphicsPtr g = getGraphics(clientBounds());
@@ -1091,7 +1300,10 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
   // Convert the "grid" rectangle to screen coordinates
   RectF gridF(grid);
   gridF = editorToScreenF(gridF);
-  if (gridF.w < 1. || gridF.h < 1.)
+
+  // When the cells are just a few screen pixels the grid lines would
+  // cover the whole sprite, so we don't draw them at all.
+  if (gridF.w < kMinGridCellSize || gridF.h < kMinGridCellSize)
     return;
 
   // Adjust for client area
@@ -1108,21 +1320,41 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
     gfx::getg(grid_color),
     gfx::getb(grid_color), alpha);
 
-  // Draw horizontal lines
-  int x1 = spriteBounds.x;
-  int y1 = gridF.y;
-  int x2 = spriteBounds.x + spriteBounds.w;
-  int y2 = spriteBounds.y + spriteBounds.h;
+  // Only the lines inside the clipping region are added to the path
+  // (the last line in each direction is just outside the sprite)
+  const gfx::Rect visible =
+    (gfx::Rect(spriteBounds.x, spriteBounds.y,
+               spriteBounds.w+1, spriteBounds.h+1) & g->getClipBounds());
+  if (visible.isEmpty())
+    return;
+
+  const int w = std::min(visible.x2(), spriteBounds.x2()) - visible.x;
+  const int h = std::min(visible.y2(), spriteBounds.y2()) - visible.y;
 
-  for (double c=y1; c<=y2; c+=gridF.h)
-    g->drawHLine(grid_color, x1, c, spriteBounds.w);
+  // All the lines are added to one path (as 1 pixel rectangles) so
+  // the whole grid is drawn with just one call.
+  gfx::Path path;
+
+  // Horizontal lines (each position is calculated from the first
+  // line, so the lines are in the same place whatever the clipping
+  // region is)
+  int i = std::max(0, int(std::floor((visible.y - gridF.y) / gridF.h)));
+  for (double c=gridF.y+i*gridF.h; c<visible.y2(); c=gridF.y+(++i)*gridF.h) {
+    if (int(c) >= visible.y)
+      path.rect(gfx::RectF(visible.x, int(c), w, 1));
+  }
 
-  // Draw vertical lines
-  x1 = gridF.x;
-  y1 = spriteBounds.y;
+  // Vertical lines
+  i = std::max(0, int(std::floor((visible.x - gridF.x) / gridF.w)));
+  for (double c=gridF.x+i*gridF.w; c<visible.x2(); c=gridF.x+(++i)*gridF.w) {
+    if (int(c) >= visible.x)
+      path.rect(gfx::RectF(int(c), visible.y, 1, h));
+  }
 
-  for (double c=x1; c<=x2; c+=gridF.w)
-    g->drawVLine(grid_color, c, y1, spriteBounds.h);
+  ui::Paint paint;
+  paint.style(ui::Paint::Fill);
+  paint.color(grid_color);
+  g->drawPath(path, paint);
 }
 
 void Editor::drawSlices(ui::Graphics* g)
@@ -1136,7 +1368,17 @@ void Editor::drawSlices(ui::Graphics* g)
   auto theme = SkinTheme::get(this);
   gfx::Point mainOffset(mainTilePosition());
 
-  for (auto slice : m_sprite->slices()) {
+  // Draw only the slices in the clipping area (sprites can have
+  // thousands of slices)
+  gfx::Rect visibleBounds =
+    screenToEditor(g->getClipBounds().offset(bounds().origin()));
+  visibleBounds.offset(-mainOffset);
+  visibleBounds.enlarge(1);
+
+  std::vector<doc::Slice*> slices;
+  m_sprite->slices().index(m_frame)->slices(visibleBounds, slices);
+
+  for (auto slice : slices) {
     auto key = slice->getByFrame(m_frame);
     if (!key)
       continue;
@@ -1213,23 +1455,40 @@ void Editor::drawTileNumbers(ui::Graphics* g, const Cel* cel)
     int ti_offset =
       static_cast<LayerTilemap*>(cel->layer())->tileset()->baseIndex() - 1;
 
+    // Tiles outside this rectangle (in client coordinates) are not
+    // visible, so we can skip them
+    const gfx::Rect clip = g->getClipBounds();
+
+    // Widths of the tile numbers texts so we measure each text just
+    // once for the whole tilemap
+    std::map<doc::tile_index, int> textWidths;
+
     const doc::Image* image = cel->image();
     std::string text;
     for (int y=0; y<image->height(); ++y) {
       for (int x=0; x<image->width(); ++x) {
         doc::tile_t t = image->getPixel(x, y);
         if (t != doc::notile) {
-          const doc::tile_index ti = doc::tile_geti(t);
-          const doc::tile_index tf = doc::tile_getf(t);
-
           gfx::Point pt = editorToScreen(grid.tileToCanvas(gfx::Point(x, y)));
           pt -= bounds().origin();
+          // The text can be wider than the tile
+          if (!clip.intersects(gfx::Rect(pt + mainTilePosition(), tileSize)
+                               .inflate(2*th, 0)))
+            continue;
+
           pt += offset;
 
+          const doc::tile_index ti = doc::tile_geti(t);
+          const doc::tile_index tf = doc::tile_getf(t);
+
           text = fmt::format("{}", ti + ti_offset);
 
+          auto it = textWidths.find(ti);
+          if (it == textWidths.end())
+            it = textWidths.insert(std::make_pair(ti, g->measureUIText(text).w)).first;
+
           gfx::Point pt2(pt);
-          pt2.x -= g->measureUIText(text).w/2;
+          pt2.x -= it->second/2;
           g->drawText(text, fgColor, color, pt2);
 
           if (tf && tileSize.h > 2*th) {
@@ -1875,11 +2134,11 @@ void Editor::selectSlice(const doc::Slice* slice)
 bool Editor::selectSliceBox(const gfx::Rect& box)
 {
   m_selectedSlices.clear();
-  for (auto slice : m_sprite->slices()) {
-    auto key = slice->getByFrame(m_frame);
-    if (key && key->bounds().intersects(box))
-      m_selectedSlices.insert(slice->id());
-  }
+
+  std::vector<doc::Slice*> slices;
+  m_sprite->slices().index(m_frame)->slices(box, slices);
+  for (auto slice : slices)
+    m_selectedSlices.insert(slice->id());
   invalidate();
 
   if (isActive())
@@ -2271,29 +2530,20 @@ void Editor::onPaint(ui::PaintEvent& ev)
       DocReader documentReader(m_document, 0);
 
       // Draw the sprite in the editor
+      perfCounters = {};
+      render::CompositeCache* composites = m_document->compositeCache();
+      composites->resetStats();
+
       renderChrono.reset();
       drawBackground(g);
+      perfCounters.background = renderChrono.elapsed();
       drawSpriteUnclippedRect(g, gfx::Rect(0, 0, m_sprite->width(), m_sprite->height()));
       renderElapsed = renderChrono.elapsed();
 
 #if ENABLE_DEVMODE
       // Show performance stats (TODO show performance stats in other widget)
-      if (Preferences::instance().perf.showRenderTime()) {
-        View* view = View::getView(this);
-        gfx::Rect vp = view->viewportBounds();
-        std::string buf =
-          fmt::format("{:c} {:.4g}s",
-                      Preferences::instance().experimental.newRenderEngine() ? 'N': 'O',
-                      renderElapsed);
-        g->drawText(
-          buf,
-          gfx::rgba(255, 255, 255, 255),
-          gfx::rgba(0, 0, 0, 255),
-          vp.origin() - bounds().origin());
-
-        m_perfInfoBounds.setOrigin(vp.origin());
-        m_perfInfoBounds.setSize(g->measureUIText(buf));
-      }
+      if (Preferences::instance().perf.showRenderTime())
+        drawPerfInfo(g, composites->stats());
 #endif // ENABLE_DEVMODE
 
       // Draw the mask boundaries
@@ -2522,7 +2772,16 @@ EditorHit Editor::calcHit(const gfx::Point& mouseScreenPos)
       if (m_docPref.show.slices()) {
         gfx::Point mainOffset(mainTilePosition());
 
-        for (auto slice : m_sprite->slices()) {
+        // Test only the slices below the mouse
+        gfx::Rect spriteBounds =
+          screenToEditor(gfx::Rect(mouseScreenPos, gfx::Size(1, 1)));
+        spriteBounds.offset(-mainOffset);
+        spriteBounds.enlarge(1);
+
+        std::vector<doc::Slice*> slices;
+        m_sprite->slices().index(m_frame)->slices(spriteBounds, slices);
+
+        for (auto slice : slices) {
           auto key = slice->getByFrame(m_frame);
           if (key) {
             gfx::Rect bounds = key->bounds();
@@ -31,6 +31,8 @@
 #include "gfx/fwd.h"
 #include "obs/connection.h"
 #include "os/color_space.h"
+#include "os/surface.h"
+#include "render/composite_cache.h"
 #include "render/projection.h"
 #include "render/zoom.h"
 #include "ui/base.h"
@@ -280,6 +282,7 @@ namespace app {
               const bool playSubtags);
     void stop();
     bool isPlaying() const;
+    void prerenderFrame(const doc::frame_t frame);
 
     // Shows a popup menu to change the editor animation speed.
     void showAnimationSpeedMultiplierPopup();
@@ -373,6 +376,10 @@ namespace app {
     void drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc);
     void drawMaskSafe();
     void drawMask(ui::Graphics* g);
+#if ENABLE_DEVMODE
+    void drawPerfInfo(ui::Graphics* g,
+                      const render::CompositeCache::Stats& cacheStats);
+#endif
     void drawGrid(ui::Graphics* g, const gfx::Rect& spriteBounds, const gfx::Rect& gridBounds,
                   const app::Color& color, int alpha);
     void drawSlices(ui::Graphics* g);
@@ -398,6 +405,18 @@ namespace app {
     // routine.
     void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
 
+    // Calculates the screen rectangle (rc/dest) and the sprite area
+    // (expose) to draw the "spriteRectToDraw" area of the sprite
+    // copy at the (dx, dy) offset. Returns false if nothing is
+    // visible.
+    bool calcOneSpriteUnclippedRect(const gfx::Rect& clip,
+                                    const gfx::Rect& spriteRectToDraw,
+                                    const int dx, const int dy,
+                                    gfx::Rect& rc,
+                                    gfx::Rect& dest,
+                                    gfx::Rect& expose) const;
+    void setupRenderEngine(const doc::frame_t frame);
+
     gfx::Point calcExtraPadding(const render::Projection& proj);
 
     void invalidateCanvas();
@@ -434,6 +453,21 @@ namespace app {
     // Extra space around the sprite.
     gfx::Point m_padding;
 
+    // Area of the sprite rendered in the temporary surface by the
+    // last drawOneSpriteUnclippedRect() call. It's valid only inside
+    // drawSpriteUnclippedRect() (to render each area once in tiled
+    // mode).
+    gfx::Rect m_renderedArea;
+
+    // Union of the sprite areas visible in all copies of the sprite
+    // in tiled mode (it's rendered once by the first
+    // drawOneSpriteUnclippedRect() call).
+    gfx::Rect m_tiledRenderArea;
+
+    // Surface used to render frames that are not displayed yet (see
+    // prerenderFrame()).
+    os::SurfaceRef m_prerenderSurface;
+
     // Marching ants stuff
     ui::Timer m_antsTimer;
     int m_antsOffset;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,10 +15,14 @@
 #include "app/pref/preferences.h"
 #include "app/render/shader_renderer.h"
 #include "app/render/simple_renderer.h"
+#include "render/mipmap_cache.h"
+
+#include <memory>
 
 namespace app {
 
 static doc::ImageBufferPtr g_renderBuffer;
+static std::unique_ptr<render::MipmapCache> g_mipmaps;
 
 EditorRender::EditorRender()
   // TODO create a switch in the preferences
@@ -213,4 +217,12 @@ doc::ImageBufferPtr EditorRender::getRenderImageBuffer()
   return g_renderBuffer;
 }
 
+// static
+render::MipmapCache* EditorRender::getMipmapCache()
+{
+  if (!g_mipmaps)
+    g_mipmaps = std::make_unique<render::MipmapCache>();
+  return g_mipmaps.get();
+}
+
 } // namespace app
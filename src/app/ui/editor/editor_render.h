@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -34,6 +34,10 @@ namespace os {
   class Surface;
 }
 
+namespace render {
+  class MipmapCache;
+}
+
 namespace app {
   class Doc;
 
@@ -105,6 +109,10 @@ namespace app {
 
     static doc::ImageBufferPtr getRenderImageBuffer();
 
+    // Reduced versions of big cels shared by all editors to render
+    // them zoomed out.
+    static render::MipmapCache* getMipmapCache();
+
   private:
     std::unique_ptr<Renderer> m_renderer;
   };
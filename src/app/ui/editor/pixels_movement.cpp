@@ -40,6 +40,7 @@
 #include "doc/blend_internals.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
@@ -815,6 +816,7 @@ void PixelsMovement::alignMasksAndTransformData(
   const gfx::Size& deltaA,
   const gfx::Size& deltaB)
 {
+  invalidateTransformCache();
   m_initialMask0->replace(make_aligned_mask(&grid, initialMask0));
   m_initialMask->replace(make_aligned_mask(&grid, initialMask));
   m_currentMask->replace(make_aligned_mask(&grid, currentMask));
@@ -957,6 +959,7 @@ void PixelsMovement::stampImage(bool finalStamp)
   m_initialData.bounds(initialData.bounds());
   m_currentData.bounds(currentData.bounds());
   m_site.tilesetMode(originalSiteTilesetMode);
+  invalidateTransformCache();
   currentCel = m_site.cel();
   if (currentCel &&
       (m_site.layer() != currentCel->layer() ||
@@ -1238,10 +1241,24 @@ void PixelsMovement::drawImage(
     }
     m_originalImage->setMaskColor(maskColor);
 
-    drawParallelogram(
-      transformation,
-      dst, m_originalImage.get(),
-      m_initialMask.get(), corners, pt);
+    // For previews (where the original layer is rendered below the
+    // pixels) we can re-use the previous transformed image when the
+    // selection is just translated. In indexed mode with the Opaque
+    // option we cannot do this as all colors are copied and we
+    // cannot distinguish the transparent pixels in the cached image.
+    if (renderOriginalLayer &&
+        maskColor != color_t(-1)) {
+      drawTransformCache(
+        transformation,
+        dst, m_originalImage.get(),
+        m_initialMask.get(), corners, pt);
+    }
+    else {
+      drawParallelogram(
+        transformation,
+        dst, m_originalImage.get(),
+        m_initialMask.get(), corners, pt);
+    }
   }
 }
 
@@ -1275,24 +1292,7 @@ void PixelsMovement::drawParallelogram(
   const Transformation::Corners& corners,
   const gfx::PointF& leftTop)
 {
-  tools::RotationAlgorithm rotAlgo = Preferences::instance().selection.rotationAlgorithm();
-
-  // When the scale isn't modified and we have no rotation or a
-  // right/straight-angle, we should use the fast rotation algorithm,
-  // as it's pixel-perfect match with the original selection when just
-  // a translation is applied.
-  double angle = 180.0*transformation.angle()/PI;
-  if (!Preferences::instance().selection.forceRotsprite() &&
-      (std::fabs(std::fmod(std::fabs(angle), 90.0)) < 0.01 ||
-       std::fabs(std::fmod(std::fabs(angle), 90.0)-90.0) < 0.01)) {
-    rotAlgo = tools::RotationAlgorithm::FAST;
-  }
-
-  // Don't use RotSprite if we are in "fast mode"
-  if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE && m_fastMode) {
-    m_needsRotSpriteRedraw = true;
-    rotAlgo = tools::RotationAlgorithm::FAST;
-  }
+  tools::RotationAlgorithm rotAlgo = rotationAlgorithm(transformation);
 
 retry:;      // In case that we don't have enough memory for RotSprite
              // we can try with the fast algorithm anyway.
@@ -1338,6 +1338,124 @@ retry:;      // In case that we don't have enough memory for RotSprite
   }
 }
 
+tools::RotationAlgorithm PixelsMovement::rotationAlgorithm(
+  const Transformation& transformation)
+{
+  tools::RotationAlgorithm rotAlgo = Preferences::instance().selection.rotationAlgorithm();
+
+  // When the scale isn't modified and we have no rotation or a
+  // right/straight-angle, we should use the fast rotation algorithm,
+  // as it's pixel-perfect match with the original selection when just
+  // a translation is applied.
+  double angle = 180.0*transformation.angle()/PI;
+  if (!Preferences::instance().selection.forceRotsprite() &&
+      (std::fabs(std::fmod(std::fabs(angle), 90.0)) < 0.01 ||
+       std::fabs(std::fmod(std::fabs(angle), 90.0)-90.0) < 0.01)) {
+    rotAlgo = tools::RotationAlgorithm::FAST;
+  }
+
+  // Don't use RotSprite if we are in "fast mode"
+  if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE && m_fastMode) {
+    m_needsRotSpriteRedraw = true;
+    rotAlgo = tools::RotationAlgorithm::FAST;
+  }
+
+  return rotAlgo;
+}
+
+template<typename ImageTraits, typename Blender>
+static void blend_transform_cache(Image* dst, const Image* src, Blender blender)
+{
+  ASSERT(dst->bounds() == src->bounds());
+  const LockImageBits<ImageTraits> srcBits(src);
+  LockImageBits<ImageTraits> dstBits(dst);
+  auto srcIt = srcBits.begin();
+  auto dstIt = dstBits.begin(), dstEnd = dstBits.end();
+  for (; dstIt != dstEnd; ++dstIt, ++srcIt)
+    *dstIt = blender(*dstIt, *srcIt);
+}
+
+// Same as drawParallelogram() but the transformed image is kept in
+// m_transformCache. If the given corners are just a translation of
+// the cached ones (and the dst image has the same size), there is no
+// need to transform the image again.
+void PixelsMovement::drawTransformCache(
+  const Transformation& transformation,
+  doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
+  const Transformation::Corners& corners,
+  const gfx::PointF& leftTop)
+{
+  const std::array<int, 8> coords = {
+    int(corners.leftTop().x-leftTop.x),
+    int(corners.leftTop().y-leftTop.y),
+    int(corners.rightTop().x-leftTop.x),
+    int(corners.rightTop().y-leftTop.y),
+    int(corners.rightBottom().x-leftTop.x),
+    int(corners.rightBottom().y-leftTop.y),
+    int(corners.leftBottom().x-leftTop.x),
+    int(corners.leftBottom().y-leftTop.y) };
+  const tools::RotationAlgorithm rotAlgo = rotationAlgorithm(transformation);
+  const color_t maskColor = src->maskColor();
+
+  TransformCache& cache = m_transformCache;
+  if (!cache.image ||
+      cache.image->pixelFormat() != dst->pixelFormat() ||
+      cache.image->bounds() != dst->bounds() ||
+      cache.corners != coords ||
+      cache.rotAlgo != rotAlgo ||
+      cache.maskColor != maskColor) {
+    // The parallelogram()/rotsprite_image() functions only modify
+    // the non-masked pixels, so we draw them in a transparent image
+    // to blend it later in the given "dst" image with the same
+    // blender used by those functions.
+    const color_t bgColor = (dst->pixelFormat() == IMAGE_INDEXED ? maskColor: 0);
+    if (!cache.image ||
+        cache.image->pixelFormat() != dst->pixelFormat() ||
+        cache.image->bounds() != dst->bounds()) {
+      cache.image.reset(Image::create(dst->pixelFormat(),
+                                      dst->width(), dst->height()));
+    }
+    cache.image->setMaskColor(bgColor);
+    clear_image(cache.image.get(), bgColor);
+
+    drawParallelogram(transformation, cache.image.get(),
+                      src, mask, corners, leftTop);
+
+    cache.corners = coords;
+    cache.rotAlgo = rotAlgo;
+    cache.maskColor = maskColor;
+  }
+
+  switch (dst->pixelFormat()) {
+    case IMAGE_RGB:
+      blend_transform_cache<RgbTraits>(
+        dst, cache.image.get(),
+        [](color_t back, color_t front) {
+          return rgba_blender_normal(back, front);
+        });
+      break;
+    case IMAGE_GRAYSCALE:
+      blend_transform_cache<GrayscaleTraits>(
+        dst, cache.image.get(),
+        [](color_t back, color_t front) {
+          return graya_blender_normal(back, front);
+        });
+      break;
+    case IMAGE_INDEXED:
+      blend_transform_cache<IndexedTraits>(
+        dst, cache.image.get(),
+        [maskColor](color_t back, color_t front) {
+          return (front != maskColor ? front: back);
+        });
+      break;
+  }
+}
+
+void PixelsMovement::invalidateTransformCache()
+{
+  m_transformCache.image.reset();
+}
+
 static void merge_tilemaps(Image* dst, const Image* src, gfx::Clip area)
 {
   if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
@@ -1424,6 +1542,8 @@ void PixelsMovement::hideDocumentMask()
 
 void PixelsMovement::flipOriginalImage(const doc::algorithm::FlipType flipType)
 {
+  invalidateTransformCache();
+
   // Flip the image.
   doc::algorithm::flip_image(
     m_originalImage.get(),
@@ -1442,6 +1562,7 @@ void PixelsMovement::flipOriginalImage(const doc::algorithm::FlipType flipType)
 void PixelsMovement::shiftOriginalImage(const int dx, const int dy,
                                         const double angle)
 {
+  invalidateTransformCache();
   doc::algorithm::shift_image(
     m_originalImage.get(), dx, dy, angle);
 }
@@ -1556,6 +1677,7 @@ void PixelsMovement::reproduceAllTransformationsWithInnerCmds()
             "frame", m_site.frame());
   DUMP_INNER_CMDS();
 
+  invalidateTransformCache();
   m_document->setMask(m_initialMask0.get());
   m_initialMask->copyFrom(m_initialMask0.get());
   if (m_site.layer()->isTilemap() && m_site.tilemapMode() == TilemapMode::Tiles) {
@@ -11,6 +11,7 @@
 
 #include "app/context_access.h"
 #include "app/extra_cel.h"
+#include "app/tools/rotation_algorithm.h"
 #include "app/site.h"
 #include "app/transformation.h"
 #include "app/tx.h"
@@ -21,6 +22,7 @@
 #include "gfx/size.h"
 #include "obs/connection.h"
 
+#include <array>
 #include <memory>
 
 namespace doc {
@@ -151,6 +153,14 @@ namespace app {
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
       const Transformation::Corners& corners,
       const gfx::PointF& leftTop);
+    tools::RotationAlgorithm rotationAlgorithm(
+      const Transformation& transformation);
+    void drawTransformCache(
+      const Transformation& transformation,
+      doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
+      const Transformation::Corners& corners,
+      const gfx::PointF& leftTop);
+    void invalidateTransformCache();
     void drawTransformedTilemap(
       const Transformation& transformation,
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask);
@@ -203,6 +213,17 @@ namespace app {
     bool m_fastMode;
     bool m_needsRotSpriteRedraw;
 
+    // The original image transformed with the last transformation
+    // (drawn on a transparent image) so we can re-use it when the
+    // selection is just translated (e.g. dragging a rotated/scaled
+    // selection doesn't have to run RotSprite again).
+    struct TransformCache {
+      doc::ImageRef image;
+      std::array<int, 8> corners;
+      tools::RotationAlgorithm rotAlgo;
+      color_t maskColor;
+    } m_transformCache;
+
     // Commands used in the interaction with the transformed pixels.
     // This is used to re-create the whole interaction on each
     // modified cel when we are modifying multiples cels at the same
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -39,11 +39,13 @@ PlayState::PlayState(const bool playOnce,
   , m_playSubtags(playSubtags)
   , m_toScroll(false)
   , m_playTimer(10)
+  , m_prerenderTimer(1)
   , m_nextFrameTime(-1)
   , m_refFrame(0)
   , m_tag(nullptr)
 {
   m_playTimer.Tick.connect(&PlayState::onPlaybackTick, this);
+  m_prerenderTimer.Tick.connect(&PlayState::onPrerenderTick, this);
 
   // Hook BeforeCommandExecution signal so we know if the user wants
   // to execute other command, so we can stop the animation.
@@ -117,6 +119,7 @@ void PlayState::onEnterState(Editor* editor)
     m_nextFrameTime = getNextFrameTime();
     m_curFrameTick = base::current_tick();
     m_playTimer.start();
+    m_prerenderTimer.start();
   }
 }
 
@@ -126,6 +129,7 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
   // (we keep playing the animation).
   if (!m_toScroll) {
     m_playTimer.stop();
+    m_prerenderTimer.stop();
 
     if (m_playOnce || Preferences::instance().general.rewindOnStop())
       m_editor->setFrame(m_refFrame);
@@ -221,6 +225,8 @@ void PlayState::onPlaybackTick()
 
   m_nextFrameTime -= (base::current_tick() - m_curFrameTick);
 
+  const frame_t oldFrame = m_editor->frame();
+
   while (m_nextFrameTime <= 0) {
     doc::frame_t frame = m_playback.nextFrame();
     if (m_playback.isStopped() ||
@@ -235,9 +241,28 @@ void PlayState::onPlaybackTick()
     m_nextFrameTime += getNextFrameTime();
   }
 
+  if (m_playTimer.isRunning() &&
+      m_editor->frame() != oldFrame)
+    m_prerenderTimer.start();
+
   m_curFrameTick = base::current_tick();
 }
 
+void PlayState::onPrerenderTick()
+{
+  m_prerenderTimer.stop();
+  if (!m_playTimer.isRunning())
+    return;
+
+  // Use a copy of the playback to know the next frame (honoring the
+  // tags direction) without modifying the current playback
+  doc::Playback playback(m_playback);
+  const frame_t frame = playback.nextFrame();
+  if (!playback.isStopped() &&
+      frame != m_editor->frame())
+    m_editor->prerenderFrame(frame);
+}
+
 // Before executing any command, we stop the animation
 void PlayState::onBeforeCommandExecution(CommandExecutionEvent& ev)
 {
@@ -45,6 +45,7 @@ namespace app {
 
   private:
     void onPlaybackTick();
+    void onPrerenderTick();
 
     // ContextObserver
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
@@ -59,6 +60,11 @@ namespace app {
     bool m_toScroll;
     ui::Timer m_playTimer;
 
+    // Timer to render the next frame of the playback (without
+    // showing it) after the current frame is displayed, so the next
+    // frame is in the render cache when it's time to show it.
+    ui::Timer m_prerenderTimer;
+
     // Number of milliseconds to go to the next frame if m_playTimer
     // is activated.
     double m_nextFrameTime;
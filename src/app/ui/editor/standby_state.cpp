@@ -61,6 +61,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 #include "doc/slice.h"
+#include "doc/slices_index.h"
 #include "doc/sprite.h"
 #include "fmt/format.h"
 #include "gfx/rect.h"
@@ -73,6 +74,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <vector>
 
 namespace app {
 
@@ -619,19 +621,18 @@ bool StandbyState::onUpdateStatusBar(Editor* editor)
 
     if (editor->docPref().show.slices()) {
       int count = 0;
-      for (auto slice : editor->document()->sprite()->slices()) {
-        auto key = slice->getByFrame(editor->frame());
-        if (key &&
-            key->bounds().contains(
-              int(std::floor(spritePos.x)),
-              int(std::floor(spritePos.y)))) {
-          if (++count == 3) {
-            buf += fmt::format(" :slice: ...");
-            break;
-          }
-
-          buf += fmt::format(" :slice: {}", slice->name());
+      std::vector<doc::Slice*> slices;
+      editor->document()->sprite()->slices().index(editor->frame())->slices(
+        gfx::Rect(int(std::floor(spritePos.x)),
+                  int(std::floor(spritePos.y)), 1, 1),
+        slices);
+      for (auto slice : slices) {
+        if (++count == 3) {
+          buf += fmt::format(" :slice: ...");
+          break;
         }
+
+        buf += fmt::format(" :slice: {}", slice->name());
       }
     }
 
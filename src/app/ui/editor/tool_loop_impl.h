@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/color.h"
+#include "app/tools/dynamics.h"
 #include "app/tools/freehand_algorithm.h"
 #include "app/tools/ink_type.h"
 #include "app/tools/pointer.h"
@@ -18,6 +19,8 @@
 #include "doc/image_ref.h"
 #include "gfx/fwd.h"
 
+#include <optional>
+
 namespace doc {
   class Image;
 }
@@ -49,6 +52,10 @@ namespace app {
 
     // For selection tools executed from scripts
     tools::ToolLoopModifiers modifiers = tools::ToolLoopModifiers::kNone;
+
+    // Dynamics for freehand tools when there is no context bar (by
+    // default the context bar dynamics are used)
+    std::optional<tools::DynamicsOptions> dynamics;
   };
 
   //////////////////////////////////////////////////////////////////////
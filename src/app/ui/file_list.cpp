@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <set>
 
 #define ISEARCH_KEYPRESS_INTERVAL_MSECS 500
 
@@ -190,16 +191,31 @@ bool FileList::onProcessMessage(Message* msg)
         gfx::Point mousePos = mouseMsg->position() - bounds().origin();
 
         // rows
-        int i = 0;
-        for (auto begin=m_list.begin(), end=m_list.end(), it=begin;
-             it!=end; ++it, ++i) {
-          IFileItem* fi = *it;
-          ItemInfo info = getFileItemInfo(i);
-
-          if ((info.bounds.contains(mousePos)) ||
-              (isListView() &&
-               ((it == begin && mousePos.y < info.bounds.y) ||
-                (it == end-1 && mousePos.y >= info.bounds.y2())))) {
+        const int n = int(std::min(m_list.size(), m_info.size()));
+        int first, last;
+        itemsRange(mousePos.y, mousePos.y+1, first, last);
+
+        // In the list view, the mouse above/below all items selects
+        // the first/last item
+        bool outside = false;
+        if (n > 0 && isListView()) {
+          if (mousePos.y < m_info[0].bounds.y) {
+            first = 0;
+            last = 1;
+            outside = true;
+          }
+          else if (mousePos.y >= m_info[n-1].bounds.y2()) {
+            first = n-1;
+            last = n;
+            outside = true;
+          }
+        }
+
+        for (int i=first; i<last; ++i) {
+          IFileItem* fi = m_list[i];
+          const ItemInfo& info = m_info[i];
+
+          if (outside || info.bounds.contains(mousePos)) {
             m_selected = fi;
 
             if (m_multiselect &&
@@ -429,20 +445,21 @@ void FileList::onPaint(ui::PaintEvent& ev)
   g->fillRect(theme->colors.background(), bounds);
   // g->fillRect(bgcolor, gfx::Rect(bounds.x, y, bounds.w, itemSize.h));
 
-  int i = 0, selectedIndex = -1;
-  for (IFileItem* fi : m_list) {
-    if (m_selected != fi) {
-      paintItem(g, fi, i);
-    }
-    else {
-      selectedIndex = i;
-    }
-    ++i;
+  // Paint only the items in the clipping region (folders can contain
+  // thousands of items)
+  const gfx::Rect clip = g->getClipBounds();
+  int first, last;
+  itemsRange(clip.y, clip.y2(), first, last);
+
+  for (int i=first; i<last; ++i) {
+    if (m_selected != m_list[i])
+      paintItem(g, m_list[i], i);
   }
 
   // Paint main selected index (so if the filename label is bigger it
   // will appear over other items).
   if (m_selected) {
+    const int selectedIndex = this->selectedIndex();
     ASSERT(selectedIndex >= 0);
     if (selectedIndex >= 0)
       paintItem(g, m_selected, selectedIndex);
@@ -661,6 +678,16 @@ void FileList::onCurrentFolderChanged()
 
 void FileList::onMonitoringTick()
 {
+  // If the user scrolled the list, we don't need the thumbnails of
+  // the items that aren't visible anymore.
+  if (isIconView()) {
+    const gfx::Rect vb = visibleBounds();
+    if (m_thumbnailsVisibleBounds != vb) {
+      m_thumbnailsVisibleBounds = vb;
+      cancelThumbnailsOfHiddenItems();
+    }
+  }
+
   auto start = base::current_tick();
   while (!m_generateThumbnailsForTheseItems.empty() &&
          // No more than 200ms launching thumbnail generators
@@ -812,6 +839,22 @@ FileList::ItemInfo FileList::calcFileItemInfo(int i) const
   return info;
 }
 
+// Items are sorted by their Y position, so we can look for the range
+// [first, last) of items that intersect the [y, y2) interval in
+// O(log n).
+void FileList::itemsRange(const int y, const int y2,
+                          int& first, int& last) const
+{
+  const auto begin = m_info.begin();
+  const auto end = begin + std::min(m_list.size(), m_info.size());
+  auto firstIt = std::partition_point(
+    begin, end, [y](const ItemInfo& info){ return info.bounds.y2() <= y; });
+  auto lastIt = std::partition_point(
+    firstIt, end, [y2](const ItemInfo& info){ return info.bounds.y < y2; });
+  first = int(firstIt - begin);
+  last = int(lastIt - begin);
+}
+
 FileList::ItemInfo FileList::getFileItemInfo(int i) const
 {
   ASSERT(i >= 0 && i < int(m_info.size()));
@@ -919,6 +962,44 @@ void FileList::generateThumbnailForFileItem(IFileItem* fi)
   }
 }
 
+gfx::Rect FileList::visibleBounds()
+{
+  View* view = View::getView(this);
+  if (!view)
+    return clientBounds();
+
+  gfx::Rect vp = view->viewportBounds();
+  vp.offset(-bounds().x, -bounds().y);
+  return vp;
+}
+
+void FileList::cancelThumbnailsOfHiddenItems()
+{
+  const gfx::Rect vb = visibleBounds();
+  std::set<IFileItem*> visibleItems;
+  int first, last;
+  itemsRange(vb.y, vb.y2(), first, last);
+  for (int i=first; i<last; ++i) {
+    if (vb.intersects(m_info[i].bounds))
+      visibleItems.insert(m_list[i]);
+  }
+  // The thumbnail of the selected item is always needed
+  if (m_selected)
+    visibleItems.insert(m_selected);
+
+  auto isNeeded = [&visibleItems](IFileItem* fi) {
+    return (visibleItems.find(fi) != visibleItems.end());
+  };
+
+  m_generateThumbnailsForTheseItems.erase(
+    std::remove_if(m_generateThumbnailsForTheseItems.begin(),
+                   m_generateThumbnailsForTheseItems.end(),
+                   [&isNeeded](IFileItem* fi) { return !isNeeded(fi); }),
+    m_generateThumbnailsForTheseItems.end());
+
+  ThumbnailGenerator::instance()->cancelThumbnails(isNeeded);
+}
+
 void FileList::delayThumbnailGenerationForSelectedItem()
 {
   if (m_selected &&
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -85,12 +85,15 @@ namespace app {
     void recalcAllFileItemInfo();
     ItemInfo calcFileItemInfo(int i) const;
     ItemInfo getFileItemInfo(int i) const;
+    void itemsRange(const int y, const int y2, int& first, int& last) const;
     void makeSelectedFileitemVisible();
     void regenerateList();
     int selectedIndex() const;
     void selectIndex(int index);
     void generateThumbnailForFileItem(IFileItem* fi);
     void delayThumbnailGenerationForSelectedItem();
+    gfx::Rect visibleBounds();
+    void cancelThumbnailsOfHiddenItems();
     bool hasThumbnailsPerItem() const { return m_zoom > 1.0; }
     bool isListView() const { return !hasThumbnailsPerItem(); }
     bool isIconView() const { return hasThumbnailsPerItem(); }
@@ -128,6 +131,10 @@ namespace app {
     // a isIconView()
     std::deque<IFileItem*> m_generateThumbnailsForTheseItems;
 
+    // Visible area of the list (in client coordinates) when we
+    // canceled the thumbnails of the hidden items for the last time.
+    gfx::Rect m_thumbnailsVisibleBounds;
+
     // True if this listbox accepts selecting multiple items at the
     // same time.
     bool m_multiselect;
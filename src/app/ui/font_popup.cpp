@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,9 +14,11 @@
 #include "app/commands/cmd_set_palette.h"
 #include "app/commands/commands.h"
 #include "app/console.h"
+#include "app/font_index.h"
 #include "app/font_path.h"
 #include "app/i18n/strings.h"
 #include "app/match_words.h"
+#include "app/task.h"
 #include "app/ui/search_entry.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui_context.h"
@@ -138,6 +140,7 @@ FontPopup::FontPopup()
                 ClickBehavior::CloseOnClickInOtherWindow,
                 EnterBehavior::DoNothingOnEnter)
   , m_popup(new gen::FontPopup())
+  , m_updateTimer(100, this)
 {
   setAutoRemap(false);
   setBorder(gfx::Border(4*guiscale()));
@@ -152,19 +155,41 @@ FontPopup::FontPopup()
 
   m_popup->view()->attachToView(&m_listBox);
 
-  base::paths fontDirs;
-  get_font_dirs(fontDirs);
-
-  // Create a list of fullpaths to every font found in all font
-  // directories (fontDirs)
-  base::paths files;
-  for (const auto& fontDir : fontDirs) {
-    for (const auto& file : base::list_files(fontDir)) {
-      std::string fullpath = base::join_path(fontDir, file);
-      if (base::is_file(fullpath))
-        files.push_back(fullpath);
-    }
+  m_updateTimer.Tick.connect([this]{ onUpdateTimerTick(); });
+
+  // Show the fonts of the index saved in the previous session, and
+  // update the index in the background (only modified font
+  // directories are listed again).
+  FontIndex* index = get_system_font_index();
+  fillFontsList(index->files());
+
+  m_updateTask = std::make_unique<Task>();
+  m_updateTask->run(
+    [this, index](base::task_token& token){
+      base::paths fontDirs;
+      get_font_dirs(fontDirs);
+      if (index->update(fontDirs, &token)) {
+        index->save();
+        m_fontsChanged = true;
+      }
+    });
+  m_updateTimer.start();
+}
+
+FontPopup::~FontPopup()
+{
+  if (m_updateTask) {
+    m_updateTask->cancel();
+    m_updateTask->wait();
   }
+}
+
+void FontPopup::fillFontsList(base::paths files)
+{
+  // Delete the previous items
+  auto children = m_listBox.children();
+  for (auto child : children)
+    delete child;
 
   // Sort all files by "file title"
   std::sort(
@@ -174,17 +199,34 @@ FontPopup::FontPopup()
     });
 
   // Create one FontItem for each font
-  for (auto& file : files) {
-    std::string ext = base::string_to_lower(base::get_file_extension(file));
-    if (ext == "ttf" || ext == "ttc" ||
-        ext == "otf" || ext == "dfont")
-      m_listBox.addChild(new FontItem(file));
-  }
+  for (auto& file : files)
+    m_listBox.addChild(new FontItem(file));
 
   if (m_listBox.children().empty())
     m_listBox.addChild(new ListItem(Strings::font_popup_empty_fonts()));
 }
 
+void FontPopup::onUpdateTimerTick()
+{
+  if (!m_updateTask || !m_updateTask->completed())
+    return;
+
+  m_updateTimer.stop();
+  m_updateTask.reset();
+
+  if (m_fontsChanged) {
+    m_fontsChanged = false;
+    fillFontsList(get_system_font_index()->files());
+
+    if (isVisible()) {
+      if (!m_popup->search()->text().empty())
+        onSearchChange();
+      else
+        layout();
+    }
+  }
+}
+
 void FontPopup::showPopup(Display* display,
                           const gfx::Rect& buttonBounds)
 {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -9,8 +9,13 @@
 #define APP_UI_FONT_POPUP_H_INCLUDED
 #pragma once
 
+#include "base/paths.h"
 #include "ui/listbox.h"
 #include "ui/popup_window.h"
+#include "ui/timer.h"
+
+#include <atomic>
+#include <memory>
 
 namespace ui {
   class Button;
@@ -18,6 +23,7 @@ namespace ui {
 }
 
 namespace app {
+  class Task;
 
   namespace gen {
     class FontPopup;
@@ -26,6 +32,7 @@ namespace app {
   class FontPopup : public ui::PopupWindow {
   public:
     FontPopup();
+    ~FontPopup();
 
     void showPopup(ui::Display* display,
                    const gfx::Rect& buttonBounds);
@@ -36,10 +43,16 @@ namespace app {
     void onSearchChange();
     void onChangeFont();
     void onLoadFont();
+    void onUpdateTimerTick();
 
   private:
+    void fillFontsList(base::paths files);
+
     gen::FontPopup* m_popup;
     ui::ListBox m_listBox;
+    std::unique_ptr<Task> m_updateTask;
+    ui::Timer m_updateTimer;
+    std::atomic<bool> m_fontsChanged { false };
   };
 
 } // namespace app
@@ -204,6 +204,11 @@ namespace {
     }
   }
 
+  // Incremented each time the accelerators of a Key or the list of
+  // keys change, so KeyboardShortcuts can rebuild its index of keys
+  // by accelerator.
+  static int g_accelsVersion = 0;
+
 } // anonymous namespace
 
 namespace base {
@@ -428,6 +433,7 @@ void Key::add(const ui::Accelerator& accel,
 {
   m_adds.emplace_back(source, accel);
   m_accels.reset();
+  ++g_accelsVersion;
 
   // Remove the accelerator from other commands
   if (source == KeySource::ExtensionDefined ||
@@ -525,6 +531,7 @@ void Key::disableAccel(const ui::Accelerator& accel,
 
   m_dels.emplace_back(source, accel);
   m_accels.reset();
+  ++g_accelsVersion;
 }
 
 void Key::reset()
@@ -532,6 +539,7 @@ void Key::reset()
   erase_accels(m_adds, KeySource::UserDefined);
   erase_accels(m_dels, KeySource::UserDefined);
   m_accels.reset();
+  ++g_accelsVersion;
 }
 
 void Key::copyOriginalToUser()
@@ -545,6 +553,7 @@ void Key::copyOriginalToUser()
   for (const auto& kv : copy)
     m_adds.emplace_back(KeySource::UserDefined, kv.second);
   m_accels.reset();
+  ++g_accelsVersion;
 }
 
 std::string Key::triggerString() const
@@ -614,12 +623,15 @@ void KeyboardShortcuts::setKeys(const KeyboardShortcuts& keys,
   else {
     m_keys = keys.m_keys;
   }
+  ++g_accelsVersion;
   UserChange();
 }
 
 void KeyboardShortcuts::clear()
 {
   m_keys.clear();
+  m_accelsIndex.clear();
+  ++g_accelsVersion;
 }
 
 void KeyboardShortcuts::importFile(XMLElement* rootElement, KeySource source)
@@ -1113,8 +1125,9 @@ bool KeyboardShortcuts::getCommandFromKeyMessage(const Message* msg, Command** c
     KeyContext::Normal
   };
   int n = (contexts[0] != contexts[1] ? 2: 1);
+  const Keys keys = keysFromKeyMessage(msg);
   for (int i = 0; i < n; ++i) {
-    for (KeyPtr& key : m_keys) {
+    for (const KeyPtr& key : keys) {
       if (key->type() == KeyType::Command &&
           key->isPressed(msg, *this, contexts[i])) {
         if (command) *command = key->command();
@@ -1126,6 +1139,52 @@ bool KeyboardShortcuts::getCommandFromKeyMessage(const Message* msg, Command** c
   return false;
 }
 
+Keys KeyboardShortcuts::keysFromKeyMessage(const Message* msg) const
+{
+  auto keyMsg = dynamic_cast<const KeyMessage*>(msg);
+  if (!keyMsg)
+    return m_keys;
+
+  if (m_accelsIndexVersion != g_accelsVersion)
+    updateAccelsIndex();
+
+  // Same accelerators that Accelerator::isPressed() compares
+  std::vector<int> indexes;
+  auto addIndexes = [this, &indexes](const Accelerator& accel) {
+    auto it = m_accelsIndex.find(accel.toString());
+    if (it != m_accelsIndex.end())
+      indexes.insert(indexes.end(), it->second.begin(), it->second.end());
+  };
+  if (keyMsg->scancode())
+    addIndexes(Accelerator(keyMsg->modifiers(), keyMsg->scancode(), 0));
+  if (keyMsg->unicodeChar())
+    addIndexes(Accelerator(keyMsg->modifiers(), kKeyNil, keyMsg->unicodeChar()));
+
+  // Keep the order of m_keys (the first pressed key has priority)
+  std::sort(indexes.begin(), indexes.end());
+  indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+  Keys keys;
+  keys.reserve(indexes.size());
+  for (int i : indexes)
+    keys.push_back(m_keys[i]);
+  return keys;
+}
+
+void KeyboardShortcuts::updateAccelsIndex() const
+{
+  m_accelsIndex.clear();
+  for (int i=0; i<int(m_keys.size()); ++i) {
+    for (const Accelerator& accel : m_keys[i]->accels()) {
+      auto& indexes = m_accelsIndex[accel.toString()];
+      // A key could contain the same accelerator twice
+      if (indexes.empty() || indexes.back() != i)
+        indexes.push_back(i);
+    }
+  }
+  m_accelsIndexVersion = g_accelsVersion;
+}
+
 tools::Tool* KeyboardShortcuts::getCurrentQuicktool(tools::Tool* currentTool)
 {
   if (currentTool && currentTool->getInk(0)->isSelection()) {
@@ -1217,6 +1276,7 @@ void KeyboardShortcuts::clearMouseWheelKeys()
     else
       ++it;
   }
+  ++g_accelsVersion;
 }
 
 void KeyboardShortcuts::addMissingMouseWheelKeys()
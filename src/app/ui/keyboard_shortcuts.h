@@ -12,6 +12,10 @@
 #include "app/ui/key.h"
 #include "obs/signal.h"
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace tinyxml2 {
   class XMLElement;
 }
@@ -62,6 +66,12 @@ namespace app {
 
     KeyContext getCurrentKeyContext() const;
     bool getCommandFromKeyMessage(const ui::Message* msg, Command** command, Params* params);
+
+    // Returns the keys that could be pressed with the given key
+    // message (in the same order of the list of keys), so the caller
+    // doesn't have to check all keys with Key::isPressed(). For other
+    // kind of messages it returns all keys.
+    Keys keysFromKeyMessage(const ui::Message* msg) const;
     tools::Tool* getCurrentQuicktool(tools::Tool* currentTool);
     KeyAction getCurrentActionModifiers(KeyContext context);
     WheelAction getWheelActionFromMouseMessage(const KeyContext context,
@@ -82,8 +92,14 @@ namespace app {
   private:
     void exportKeys(tinyxml2::XMLElement* parent, KeyType type);
     void exportAccel(tinyxml2::XMLElement* parent, const Key* key, const ui::Accelerator& accel, bool removed);
+    void updateAccelsIndex() const;
 
     mutable Keys m_keys;
+
+    // Indexes in m_keys of the keys that use each accelerator (the
+    // key of the map is Accelerator::toString()).
+    mutable std::unordered_map<std::string, std::vector<int>> m_accelsIndex;
+    mutable int m_accelsIndexVersion = -1;
   };
 
   std::string key_tooltip(const char* str, const Key* key);
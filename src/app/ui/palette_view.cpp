@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -833,6 +833,10 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
 
   g->fillRect(theme->colors.editorFace(), bounds);
 
+  // Only entries inside the clip bounds are painted (e.g. big
+  // palettes inside a view, or invalidated regions of a few entries)
+  const gfx::Rect clipBounds = g->getClipBounds();
+
   // Draw palette/tileset entries
   int picksCount = m_selectedEntries.picks();
   int idxOffset = 0;
@@ -841,7 +845,10 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
   if (dragging && !m_copy) palSize -= picksCount;
   if (resizing) palSize = m_hot.color;
 
-  for (int i=0; i<palSize; ++i) {
+  // When we are dragging entries the index of each box depends on the
+  // previous ones, so we iterate all the entries.
+  const int firstEntry = (dragging ? 0: firstVisibleEntry(clipBounds));
+  for (int i=firstEntry; i<palSize; ++i) {
     if (dragging) {
       if (!m_copy) {
         while (i+idxOffset < m_selectedEntries.size() &&
@@ -854,6 +861,11 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
     }
 
     gfx::Rect box = getPaletteEntryBounds(i + boxOffset);
+    if (box.y > clipBounds.y2())
+      break;
+    if (!box.intersects(clipBounds))
+      continue;
+
     gfx::Color negColor;
     m_adapter->drawEntry(g, theme, i + idxOffset, i + boxOffset,
                          childSpacing(), box, negColor);
@@ -927,9 +939,12 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
     }
 
     const int k = (dragging ? m_hot.color+j: i);
+    ++j;
 
     gfx::Rect box, clipR;
     getEntryBoundsAndClip(k, picks, outlineWidth, box, clipR);
+    if (!clipR.intersects(clipBounds))
+      continue;
 
     IntersectClip clip(g, clipR);
     if (clip) {
@@ -952,8 +967,6 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
       theme->paintWidgetPart(
         g, theme->styles.colorbarSelection(), box, info);
     }
-
-    ++j;
   }
 
   // Draw marching ants
@@ -1026,7 +1039,31 @@ void PaletteView::onSizeHint(ui::SizeHintEvent& ev)
 
 void PaletteView::onDrawMarchingAnts()
 {
-  invalidate();
+  // Redraw only the area of the entries in the clipboard
+  auto clipboard = Clipboard::instance();
+  if (clipboard->format() != ClipboardFormat::PaletteEntries) {
+    invalidate();
+    return;
+  }
+
+  const PalettePicks& clipboardPicks = clipboard->getPalettePicks();
+  const int first = clipboardPicks.firstPick();
+  const int last = clipboardPicks.lastPick();
+  if (first < 0) {
+    invalidate();
+    return;
+  }
+
+  gfx::Rect rc = getPaletteEntryBounds(first);
+  rc |= getPaletteEntryBounds(last);
+  if (last / m_columns != first / m_columns) {
+    // Full rows
+    rc.x = getPaletteEntryBounds(0).x;
+    rc |= getPaletteEntryBounds(m_columns-1);
+  }
+  rc.enlarge(1*guiscale());
+  rc.offset(bounds().origin());
+  invalidateRect(rc);
 }
 
 void PaletteView::update_scroll(int color)
@@ -1122,18 +1159,24 @@ PaletteView::Hit PaletteView::hitTest(const gfx::Point& pos)
   View* view = View::getView(this);
   ASSERT(view);
   gfx::Rect vp = view->viewportBounds();
-  for (int i=0; ; ++i) {
-    gfx::Rect box = getPaletteEntryBounds(i);
-    if (i >= size && box.y2() > vp.h)
-      break;
-
-    box.w += childSpacing();
-    box.h += childSpacing();
-    if (box.contains(pos))
-      return Hit(Hit::COLOR, i);
-  }
-
   gfx::Rect box = getPaletteEntryBounds(0);
+  {
+    // Calculate the entry directly from the position (instead of
+    // iterating all entries, there can be thousands of them)
+    const int cell = boxSizePx() + childSpacing();
+    const int dx = pos.x - box.x;
+    const int dy = pos.y - box.y;
+    if (dx >= 0 && dy >= 0 && dx / cell < m_columns) {
+      const int i = (dy / cell) * m_columns + (dx / cell);
+      gfx::Rect box2 = getPaletteEntryBounds(i);
+      if (i < size || box2.y2() <= vp.h) {
+        box2.w += childSpacing();
+        box2.h += childSpacing();
+        if (box2.contains(pos))
+          return Hit(Hit::COLOR, i);
+      }
+    }
+  }
 
   int colsLimit = m_columns;
   if (m_state == State::DRAGGING_OUTLINE)
@@ -1143,6 +1186,15 @@ PaletteView::Hit PaletteView::hitTest(const gfx::Point& pos)
   return Hit(Hit::POSSIBLE_COLOR, i);
 }
 
+int PaletteView::firstVisibleEntry(const gfx::Rect& clipBounds) const
+{
+  const int cell = boxSizePx() + childSpacing();
+  const int dy = clipBounds.y - getPaletteEntryBounds(0).y;
+  if (cell <= 0 || dy <= 0)
+    return 0;
+  return (dy / cell) * m_columns;
+}
+
 void PaletteView::dropColors(int beforeIndex)
 {
   m_adapter->dropColors(this,
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -169,6 +169,7 @@ namespace app {
     void update_scroll(int color);
     void onAppPaletteChange();
     gfx::Rect getPaletteEntryBounds(int index) const;
+    int firstVisibleEntry(const gfx::Rect& clipBounds) const;
     Hit hitTest(const gfx::Point& pos);
     void dropColors(int beforeIndex);
     void getEntryBoundsAndClip(int i,
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -184,6 +184,7 @@ PreviewEditorWindow::PreviewEditorWindow()
   , m_aniSpeed(1.0)
   , m_relatedEditor(nullptr)
   , m_opening(false)
+  , m_centered(false)
 {
   setAutoRemap(false);
   setWantFocus(false);
@@ -280,6 +281,7 @@ void PreviewEditorWindow::onClose(ui::CloseEvent& ev)
 void PreviewEditorWindow::onWindowResize()
 {
   Window::onWindowResize();
+  m_centered = false;
 
   DocView* view = UIContext::instance()->activeView();
   if (view)
@@ -393,9 +395,13 @@ void PreviewEditorWindow::updateUsingEditor(Editor* editor)
   m_centerButton->setSelected(autoScroll);
   if (autoScroll) {
     gfx::Point centerPoint = editor->getVisibleSpriteBounds().center();
-    miniEditor->centerInSpritePoint(centerPoint);
+    if (!m_centered || m_centerPoint != centerPoint) {
+      miniEditor->centerInSpritePoint(centerPoint);
+      m_centerPoint = centerPoint;
+      m_centered = true;
 
-    saveScrollPref();
+      saveScrollPref();
+    }
   }
 
   if (!m_playButton->isPlaying()) {
@@ -425,6 +431,9 @@ void PreviewEditorWindow::onStateChanged(Editor* editor)
 
 void PreviewEditorWindow::onScrollChanged(Editor* miniEditor)
 {
+  // The preview editor must be centered again
+  m_centered = false;
+
   if (miniEditor->hasCapture()) {
     saveScrollPref();
     uncheckCenterButton();
@@ -433,6 +442,7 @@ void PreviewEditorWindow::onScrollChanged(Editor* miniEditor)
 
 void PreviewEditorWindow::onZoomChanged(Editor* miniEditor)
 {
+  m_centered = false;
   saveScrollPref();
 }
 
@@ -486,6 +496,7 @@ void PreviewEditorWindow::destroyDocView()
     delete m_docView;
     m_docView = nullptr;
   }
+  m_centered = false;
 }
 
 void PreviewEditorWindow::adjustPlayingTag()
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "app/ui/editor/editor_observer.h"
 #include "doc/frame.h"
 #include "app/pref/preferences.h"
+#include "gfx/point.h"
 #include "ui/window.h"
 
 namespace app {
@@ -74,6 +75,12 @@ namespace app {
     // an infinite recursive loop when PreviewEditorWindow::updateUsingEditor calls the
     // openWindow() method.
     bool m_opening;
+    // Last sprite point centered in the preview editor (when
+    // m_centered is true), used to avoid scrolling/repainting the
+    // preview editor when the main editor changes but the center is
+    // the same.
+    gfx::Point m_centerPoint;
+    bool m_centered;
   };
 
 } // namespace app
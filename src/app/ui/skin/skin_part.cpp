@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -11,7 +11,9 @@
 
 #include "app/ui/skin/skin_part.h"
 
+#include "base/debug.h"
 #include "os/surface.h"
+#include "os/system.h"
 
 namespace app {
 namespace skin {
@@ -28,14 +30,39 @@ SkinPart::~SkinPart()
 void SkinPart::clear()
 {
   m_bitmaps.clear();
+  m_sheetBounds.clear();
+  m_sheet.reset();
 }
 
 void SkinPart::setBitmap(std::size_t index, const os::SurfaceRef& bitmap)
 {
-  if (index >= m_bitmaps.size())
+  if (index >= m_bitmaps.size()) {
     m_bitmaps.resize(index+1, nullptr);
+    m_sheetBounds.resize(index+1);
+  }
 
   m_bitmaps[index] = bitmap;
+  m_sheetBounds[index] = gfx::Rect();
+}
+
+void SkinPart::setSheetBitmap(std::size_t index,
+                              const os::SurfaceRef& sheet,
+                              const gfx::Rect& bounds)
+{
+  if (index >= m_bitmaps.size()) {
+    m_bitmaps.resize(index+1, nullptr);
+    m_sheetBounds.resize(index+1);
+  }
+
+  m_sheet = sheet;
+  m_sheetBounds[index] = bounds;
+
+  if (m_bitmaps[index]) {
+    if (bounds.isEmpty())
+      m_bitmaps[index] = nullptr;
+    else
+      sliceBitmap(index);
+  }
 }
 
 void SkinPart::setSpriteBounds(const gfx::Rect& bounds)
@@ -50,11 +77,50 @@ void SkinPart::setSlicesBounds(const gfx::Rect& bounds)
 
 gfx::Size SkinPart::size() const
 {
-  if (!m_bitmaps.empty())
+  if (m_bitmaps.empty())
+    return gfx::Size(0, 0);
+  else if (!m_sheetBounds[0].isEmpty())
+    return m_sheetBounds[0].size();
+  else
     return gfx::Size(m_bitmaps[0]->width(),
                      m_bitmaps[0]->height());
-  else
-    return gfx::Size(0, 0);
+}
+
+void SkinPart::sliceBitmap(std::size_t index)
+{
+  ASSERT(m_sheet);
+  m_bitmaps[index] = slice_sheet(m_sheet, m_bitmaps[index],
+                                 m_sheetBounds[index]);
+}
+
+os::SurfaceRef slice_sheet(const os::SurfaceRef& sheet,
+                           os::SurfaceRef sur,
+                           const gfx::Rect& bounds)
+{
+  if (sur && (sur->width() != bounds.w ||
+              sur->height() != bounds.h)) {
+    sur = nullptr;
+  }
+
+  if (!bounds.isEmpty()) {
+    if (!sur)
+      sur = os::instance()->makeRgbaSurface(bounds.w, bounds.h);
+
+    os::SurfaceLock lockSrc(sheet.get());
+    os::SurfaceLock lockDst(sur.get());
+    sheet->blitTo(sur.get(), bounds.x, bounds.y, 0, 0, bounds.w, bounds.h);
+
+    // The new surface is immutable because we're going to re-use the
+    // surface if we reload the theme.
+    //
+    // TODO Add sub-surfaces (SkBitmap::extractSubset())
+    //sur->setImmutable();
+  }
+  else {
+    ASSERT(!sur);
+  }
+
+  return sur;
 }
 
 } // namespace skin
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -37,17 +37,29 @@ namespace app {
 
       // It doesn't destroy the previous bitmap in the given "index".
       void setBitmap(std::size_t index, const os::SurfaceRef& bitmap);
+
+      // Sets the "bounds" of the given bitmap "index" inside the theme
+      // sheet. The bitmap is sliced from the sheet the first time it's
+      // used (most parts are drawn directly from the sheet with
+      // spriteBounds()/slicesBounds()). Bitmaps that were already
+      // sliced are updated in place, because widgets can keep
+      // pointers to them when the theme is reloaded.
+      void setSheetBitmap(std::size_t index,
+                          const os::SurfaceRef& sheet,
+                          const gfx::Rect& bounds);
       void setSpriteBounds(const gfx::Rect& bounds);
       void setSlicesBounds(const gfx::Rect& bounds);
 
       os::Surface* bitmap(std::size_t index) const {
-        return (index < m_bitmaps.size() ? const_cast<SkinPart*>(this)->m_bitmaps[index].get(): nullptr);
+        return const_cast<SkinPart*>(this)->bitmapRef(index).get();
       }
 
       os::SurfaceRef bitmapRef(std::size_t index) {
-        return (index < m_bitmaps.size() ?
-          const_cast<SkinPart*>(this)->m_bitmaps[index]:
-          nullptr);
+        if (index >= m_bitmaps.size())
+          return nullptr;
+        if (!m_bitmaps[index] && !m_sheetBounds[index].isEmpty())
+          sliceBitmap(index);
+        return m_bitmaps[index];
       }
 
       os::Surface* bitmapNW() const { return bitmap(0); }
@@ -62,13 +74,23 @@ namespace app {
       gfx::Size size() const;
 
     private:
+      void sliceBitmap(std::size_t index);
+
       Bitmaps m_bitmaps;
+      os::SurfaceRef m_sheet;
+      std::vector<gfx::Rect> m_sheetBounds;
       gfx::Rect m_spriteBounds;
       gfx::Rect m_slicesBounds;
     };
 
     typedef std::shared_ptr<SkinPart> SkinPartPtr;
 
+    // Copies the given "bounds" of the "sheet" to "sur" (or to a new
+    // surface if "sur" is nullptr or it has a different size).
+    os::SurfaceRef slice_sheet(const os::SurfaceRef& sheet,
+                               os::SurfaceRef sur,
+                               const gfx::Rect& bounds);
+
   } // namespace skin
 } // namespace app
 
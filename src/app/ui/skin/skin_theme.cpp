@@ -553,9 +553,9 @@ void SkinTheme::loadXml(BackwardCompatibility* backward)
 
       if (w > 0 && h > 0) {
         part->setSpriteBounds(gfx::Rect(x, y, w, h));
-        part->setBitmap(0, sliceSheet(part->bitmapRef(0), gfx::Rect(x, y, w, h)));
+        part->setSheetBitmap(0, m_sheet, gfx::Rect(x, y, w, h));
         unscaledPart->setSpriteBounds(part->spriteBounds()/scale);
-        unscaledPart->setBitmap(0, sliceUnscaledSheet(unscaledPart->bitmapRef(0), unscaledPart->spriteBounds()));
+        unscaledPart->setSheetBitmap(0, m_unscaledSheet, unscaledPart->spriteBounds());
       }
       else if (xmlPart->Attribute("w1")) { // 3x3-1 part (NW, N, NE, E, SE, S, SW, W)
         int w1 = scale*strtol(xmlPart->Attribute("w1"), nullptr, 10);
@@ -568,26 +568,26 @@ void SkinTheme::loadXml(BackwardCompatibility* backward)
         part->setSpriteBounds(gfx::Rect(x, y, w1+w2+w3, h1+h2+h3));
         part->setSlicesBounds(gfx::Rect(w1, h1, w2, h2));
 
-        part->setBitmap(0, sliceSheet(part->bitmapRef(0), gfx::Rect(x, y, w1, h1))); // NW
-        part->setBitmap(1, sliceSheet(part->bitmapRef(1), gfx::Rect(x+w1, y, w2, h1))); // N
-        part->setBitmap(2, sliceSheet(part->bitmapRef(2), gfx::Rect(x+w1+w2, y, w3, h1))); // NE
-        part->setBitmap(3, sliceSheet(part->bitmapRef(3), gfx::Rect(x+w1+w2, y+h1, w3, h2))); // E
-        part->setBitmap(4, sliceSheet(part->bitmapRef(4), gfx::Rect(x+w1+w2, y+h1+h2, w3, h3))); // SE
-        part->setBitmap(5, sliceSheet(part->bitmapRef(5), gfx::Rect(x+w1, y+h1+h2, w2, h3))); // S
-        part->setBitmap(6, sliceSheet(part->bitmapRef(6), gfx::Rect(x, y+h1+h2, w1, h3))); // SW
-        part->setBitmap(7, sliceSheet(part->bitmapRef(7), gfx::Rect(x, y+h1, w1, h2))); // W
+        part->setSheetBitmap(0, m_sheet, gfx::Rect(x, y, w1, h1)); // NW
+        part->setSheetBitmap(1, m_sheet, gfx::Rect(x+w1, y, w2, h1)); // N
+        part->setSheetBitmap(2, m_sheet, gfx::Rect(x+w1+w2, y, w3, h1)); // NE
+        part->setSheetBitmap(3, m_sheet, gfx::Rect(x+w1+w2, y+h1, w3, h2)); // E
+        part->setSheetBitmap(4, m_sheet, gfx::Rect(x+w1+w2, y+h1+h2, w3, h3)); // SE
+        part->setSheetBitmap(5, m_sheet, gfx::Rect(x+w1, y+h1+h2, w2, h3)); // S
+        part->setSheetBitmap(6, m_sheet, gfx::Rect(x, y+h1+h2, w1, h3)); // SW
+        part->setSheetBitmap(7, m_sheet, gfx::Rect(x, y+h1, w1, h2)); // W
 
         unscaledPart->setSpriteBounds(part->spriteBounds()/scale);
         unscaledPart->setSlicesBounds(part->slicesBounds()/scale);
 
-        unscaledPart->setBitmap(0, sliceUnscaledSheet(unscaledPart->bitmapRef(0), gfx::Rect(x, y, w1, h1)/scale));
-        unscaledPart->setBitmap(1, sliceUnscaledSheet(unscaledPart->bitmapRef(1), gfx::Rect(x+w1, y, w2, h1)/scale));
-        unscaledPart->setBitmap(2, sliceUnscaledSheet(unscaledPart->bitmapRef(2), gfx::Rect(x+w1+w2, y, w3, h1)/scale));
-        unscaledPart->setBitmap(3, sliceUnscaledSheet(unscaledPart->bitmapRef(3), gfx::Rect(x+w1+w2, y+h1, w3, h2)/scale));
-        unscaledPart->setBitmap(4, sliceUnscaledSheet(unscaledPart->bitmapRef(4), gfx::Rect(x+w1+w2, y+h1+h2, w3, h3)/scale));
-        unscaledPart->setBitmap(5, sliceUnscaledSheet(unscaledPart->bitmapRef(5), gfx::Rect(x+w1, y+h1+h2, w2, h3)/scale));
-        unscaledPart->setBitmap(6, sliceUnscaledSheet(unscaledPart->bitmapRef(6), gfx::Rect(x, y+h1+h2, w1, h3)/scale));
-        unscaledPart->setBitmap(7, sliceUnscaledSheet(unscaledPart->bitmapRef(7), gfx::Rect(x, y+h1, w1, h2)/scale));
+        unscaledPart->setSheetBitmap(0, m_unscaledSheet, gfx::Rect(x, y, w1, h1)/scale);
+        unscaledPart->setSheetBitmap(1, m_unscaledSheet, gfx::Rect(x+w1, y, w2, h1)/scale);
+        unscaledPart->setSheetBitmap(2, m_unscaledSheet, gfx::Rect(x+w1+w2, y, w3, h1)/scale);
+        unscaledPart->setSheetBitmap(3, m_unscaledSheet, gfx::Rect(x+w1+w2, y+h1, w3, h2)/scale);
+        unscaledPart->setSheetBitmap(4, m_unscaledSheet, gfx::Rect(x+w1+w2, y+h1+h2, w3, h3)/scale);
+        unscaledPart->setSheetBitmap(5, m_unscaledSheet, gfx::Rect(x+w1, y+h1+h2, w2, h3)/scale);
+        unscaledPart->setSheetBitmap(6, m_unscaledSheet, gfx::Rect(x, y+h1+h2, w1, h3)/scale);
+        unscaledPart->setSheetBitmap(7, m_unscaledSheet, gfx::Rect(x, y+h1, w1, h2)/scale);
       }
 
       // Is it a mouse cursor?
@@ -882,42 +882,9 @@ void SkinTheme::loadXml(BackwardCompatibility* backward)
   ThemeFile<SkinTheme>::updateInternals();
 }
 
-static os::SurfaceRef sliceSheet(os::SurfaceRef sheet, os::SurfaceRef sur, const gfx::Rect& bounds)
-{
-  if (sur && (sur->width() != bounds.w ||
-              sur->height() != bounds.h)) {
-    sur = nullptr;
-  }
-
-  if (!bounds.isEmpty()) {
-    if (!sur)
-      sur = os::instance()->makeRgbaSurface(bounds.w, bounds.h);
-
-    os::SurfaceLock lockSrc(sheet.get());
-    os::SurfaceLock lockDst(sur.get());
-    sheet->blitTo(sur.get(), bounds.x, bounds.y, 0, 0, bounds.w, bounds.h);
-
-    // The new surface is immutable because we're going to re-use the
-    // surface if we reload the theme.
-    //
-    // TODO Add sub-surfaces (SkBitmap::extractSubset())
-    //sur->setImmutable();
-  }
-  else {
-    ASSERT(!sur);
-  }
-
-  return sur;
-}
-
 os::SurfaceRef SkinTheme::sliceSheet(os::SurfaceRef sur, const gfx::Rect& bounds)
 {
-  return app::skin::sliceSheet(m_sheet, sur, bounds);
-}
-
-os::SurfaceRef SkinTheme::sliceUnscaledSheet(os::SurfaceRef sur, const gfx::Rect& bounds)
-{
-  return app::skin::sliceSheet(m_unscaledSheet, sur, bounds);
+  return slice_sheet(m_sheet, sur, bounds);
 }
 
 os::Font* SkinTheme::getWidgetFont(const Widget* widget) const
@@ -166,7 +166,6 @@ namespace app {
       void loadXml(BackwardCompatibility* backward);
 
       os::SurfaceRef sliceSheet(os::SurfaceRef sur, const gfx::Rect& bounds);
-      os::SurfaceRef sliceUnscaledSheet(os::SurfaceRef sur, const gfx::Rect& bounds);
       gfx::Color getWidgetBgColor(ui::Widget* widget);
       void drawText(ui::Graphics* g,
                     const char* t,
@@ -411,6 +411,7 @@ void Timeline::detachDocument()
     m_document->remove_observer(this);
     m_document = nullptr;
   }
+  m_thumbnailsCache.clear();
 
   // Reset all pointers to this document, even DocRanges, we don't
   // want to store a pointer to a layer of a document that we are not
@@ -620,6 +621,8 @@ Tag* Timeline::getTagByFrame(const frame_t frame,
 
 bool Timeline::onProcessMessage(Message* msg)
 {
+  regenerateRowsIfDirty();
+
   switch (msg->type()) {
 
     case kFocusEnterMessage:
@@ -1714,6 +1717,8 @@ void Timeline::onPaint(ui::PaintEvent& ev)
   if (noDoc)
     goto paintNoDoc;
 
+  regenerateRowsIfDirty();
+
   try {
     // Lock the sprite to read/render it. Here we don't wait if the
     // document is locked (e.g. a filter is being applied to the
@@ -1729,8 +1734,11 @@ void Timeline::onPaint(ui::PaintEvent& ev)
     layer_t layer, firstLayer, lastLayer;
     frame_t frame, firstFrame, lastFrame;
 
-    getDrawableLayers(&firstLayer, &lastLayer);
-    getDrawableFrames(&firstFrame, &lastFrame);
+    // Only the layers/frames inside the clipping region are drawn
+    // (e.g. when just one cel is invalidated)
+    const gfx::Rect clipBounds = g->getClipBounds();
+    getDrawableLayers(clipBounds, &firstLayer, &lastLayer);
+    getDrawableFrames(clipBounds, &firstFrame, &lastFrame);
 
     drawTop(g);
 
@@ -1905,6 +1913,12 @@ void Timeline::onRemoveDocument(Doc* document)
 
 void Timeline::onGeneralUpdate(DocEvent& ev)
 {
+  // Rows that weren't regenerated in a batch update
+  if (m_rowsDirty) {
+    regenerateRowsIfDirty();
+    showCurrentCel();
+    clearClipboardRange();
+  }
   invalidate();
 }
 
@@ -2141,6 +2155,41 @@ void Timeline::getDrawableFrames(frame_t* firstFrame, frame_t* lastFrame)
       + getCelsBounds().w) / frameBoxWidth());
 }
 
+void Timeline::getDrawableLayers(const gfx::Rect& clipBounds,
+                                 layer_t* firstDrawableLayer,
+                                 layer_t* lastDrawableLayer)
+{
+  getDrawableLayers(firstDrawableLayer, lastDrawableLayer);
+
+  // Rows from the top of the layers area (the first row is the last
+  // layer)
+  const int y = clientBounds().y + topHeight() + headerBoxHeight() - viewScroll().y;
+  const int topRow = (clipBounds.y - y) / layerBoxHeight();
+  const int bottomRow = (clipBounds.y2() - 1 - y) / layerBoxHeight();
+
+  if (clipBounds.y2() <= y)
+    *lastDrawableLayer = *firstDrawableLayer - 1;
+  else {
+    *firstDrawableLayer = std::max(*firstDrawableLayer, lastLayer() - bottomRow);
+    *lastDrawableLayer = std::min(*lastDrawableLayer, lastLayer() - std::max(0, topRow));
+  }
+}
+
+void Timeline::getDrawableFrames(const gfx::Rect& clipBounds,
+                                 frame_t* firstFrame,
+                                 frame_t* lastFrame)
+{
+  getDrawableFrames(firstFrame, lastFrame);
+
+  const int x = clientBounds().x + separatorX() + m_separator_w - 1 - viewScroll().x;
+  if (clipBounds.x2() <= x)
+    *lastFrame = *firstFrame - 1;
+  else {
+    *firstFrame = std::max(*firstFrame, frame_t(std::max(0, clipBounds.x - x) / frameBoxWidth()));
+    *lastFrame = std::min(*lastFrame, frame_t((clipBounds.x2() - 1 - x) / frameBoxWidth()));
+  }
+}
+
 void Timeline::drawPart(ui::Graphics* g, const gfx::Rect& bounds,
                         const std::string* text, ui::Style* style,
                         const bool is_active,
@@ -2485,7 +2534,7 @@ void Timeline::drawCel(ui::Graphics* g,
         skinTheme()->calcBorder(this, style));
 
     if (!thumb_bounds.isEmpty()) {
-      if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, thumb_bounds.size())) {
+      if (os::SurfaceRef surface = m_thumbnailsCache.getCelThumbnail(cel, thumb_bounds.size())) {
         const int t = std::clamp(thumb_bounds.w/8, 4, 16);
         draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
 
@@ -2579,7 +2628,7 @@ void Timeline::drawCelOverlay(ui::Graphics* g)
 
   gfx::Rect rc = m_sprite->bounds().fitIn(
     gfx::Rect(m_thumbnailsOverlayBounds).shrink(1));
-  if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, rc.size())) {
+  if (os::SurfaceRef surface = m_thumbnailsCache.getCelThumbnail(cel, rc.size())) {
     draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
 
     g->drawRgbaSurface(surface.get(),
@@ -3238,6 +3287,28 @@ void Timeline::regenerateRows()
   ASSERT(m_document);
   ASSERT(m_sprite);
 
+  // Regenerating the rows for each change of a batch update is too
+  // slow (e.g. a script creating 1000 layers in a transaction), so we
+  // regenerate them when the batch ends (or when they're needed).
+  if (m_document->inBatchUpdate()) {
+    m_rowsDirty = true;
+    return;
+  }
+  updateRows();
+}
+
+void Timeline::regenerateRowsIfDirty()
+{
+  // Here the rows are regenerated even in a batch update because we
+  // need them (e.g. to paint the timeline)
+  if (m_rowsDirty && m_document)
+    updateRows();
+}
+
+void Timeline::updateRows()
+{
+  m_rowsDirty = false;
+
   size_t nlayers = 0;
   for_each_expanded_layer(
     m_sprite->root(),
@@ -14,6 +14,7 @@
 #include "app/docs_observer.h"
 #include "app/loop_tag.h"
 #include "app/pref/preferences.h"
+#include "app/thumbnails.h"
 #include "app/ui/editor/editor_observer.h"
 #include "app/ui/input_chain_element.h"
 #include "app/ui/timeline/ani_controls.h"
@@ -107,6 +108,12 @@ namespace app {
 
     Sprite* sprite() { return m_sprite; }
 
+    // Bytes used by the cached cel thumbnails of the given document
+    // (the cache contains thumbnails of the current document only).
+    size_t thumbnailsCacheBytes(const Doc* doc) const {
+      return (doc == m_document ? m_thumbnailsCache.bytes(): 0);
+    }
+
     bool isMovingCel() const;
 
     Range range() const { return m_range; }
@@ -281,6 +288,11 @@ namespace app {
     void setCursor(ui::Message* msg, const Hit& hit);
     void getDrawableLayers(layer_t* firstLayer, layer_t* lastLayer);
     void getDrawableFrames(frame_t* firstFrame, frame_t* lastFrame);
+    // Same as above but limited to the given clipping bounds.
+    void getDrawableLayers(const gfx::Rect& clipBounds,
+                           layer_t* firstLayer, layer_t* lastLayer);
+    void getDrawableFrames(const gfx::Rect& clipBounds,
+                           frame_t* firstFrame, frame_t* lastFrame);
     void drawPart(ui::Graphics* g, const gfx::Rect& bounds,
                   const std::string* text,
                   ui::Style* style,
@@ -320,6 +332,8 @@ namespace app {
     void invalidateFrame(const frame_t frame);
     void invalidateRange();
     void regenerateRows();
+    void regenerateRowsIfDirty();
+    void updateRows();
     void regenerateTagBands();
     int visibleTagBands() const;
     void updateScrollBars();
@@ -418,6 +432,10 @@ namespace app {
     // Data used to display each row in the timeline
     std::vector<Row> m_rows;
 
+    // True if m_rows must be regenerated (because it was deferred in
+    // a batch update of the document).
+    bool m_rowsDirty = false;
+
     // Data used to display frame tags
     int m_tagBands;
     int m_tagFocusBand;
@@ -455,6 +473,7 @@ namespace app {
     Hit m_thumbnailsOverlayHit;
     gfx::Point m_thumbnailsOverlayDirection;
     obs::connection m_thumbnailsPrefConn;
+    thumb::CelThumbnailCache m_thumbnailsCache;
 
     // Temporal data used to move the range.
     struct MoveRange {
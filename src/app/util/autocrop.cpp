@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -15,11 +15,13 @@
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/image.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/sprite.h"
 #include "render/render.h"
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace app {
 
@@ -263,22 +265,37 @@ gfx::Rect get_trimmed_bounds(
   const doc::Sprite* sprite,
   const bool byGrid)
 {
-  gfx::Rect bounds;
-
-  std::unique_ptr<Image> image_wrap(Image::create(sprite->spec()));
-  Image* image = image_wrap.get();
-
-  render::Render render;
-
-  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-    render.renderSprite(image, sprite, frame);
+  // Calculate the trimmed bounds of each frame in parallel (each
+  // chunk of frames uses its own render and image)
+  const int nframes = sprite->totalFrames();
+  std::vector<gfx::Rect> framesBounds(nframes);
+  const int grain =
+    std::max(1, nframes / (4*doc::parallel_concurrency()));
+
+  doc::parallel_for(
+    0, nframes, grain,
+    [sprite, &framesBounds](const int begin, const int end){
+      std::unique_ptr<Image> image_wrap(Image::create(sprite->spec()));
+      Image* image = image_wrap.get();
+
+      render::Render render;
+
+      for (frame_t frame=begin; frame<end; ++frame) {
+        render.renderSprite(image, sprite, frame);
+
+        gfx::Rect frameBounds;
+        doc::color_t refColor;
+        if (get_best_refcolor_for_trimming(image, refColor) &&
+            doc::algorithm::shrink_bounds(image, refColor, nullptr, frameBounds)) {
+          framesBounds[frame] = frameBounds;
+        }
+      }
+    });
 
-    gfx::Rect frameBounds;
-    doc::color_t refColor;
-    if (get_best_refcolor_for_trimming(image, refColor) &&
-        doc::algorithm::shrink_bounds(image, refColor, nullptr, frameBounds)) {
+  gfx::Rect bounds;
+  for (const gfx::Rect& frameBounds : framesBounds) {
+    if (!frameBounds.isEmpty())
       bounds = bounds.createUnion(frameBounds);
-    }
 
     // TODO merge this code with the code in DocExporter::captureSamples()
     if (byGrid) {
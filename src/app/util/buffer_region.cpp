@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -51,6 +51,7 @@ void swap_image_region_with_buffer(
   const size_t bytesPerPixel = image->bytesPerPixel();
   auto it = buffer.begin();
   for (const auto& rc : region) {
+    image->unshareTiles(rc);
     for (int y=0; y<rc.h; ++y) {
       auto p = (uint8_t*)image->getPixelAddress(rc.x, rc.y+y);
       const size_t rowBytes = bytesPerPixel*rc.w;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,10 +29,13 @@
 #include "doc/cel.h"
 #include "doc/grid.h"
 #include "doc/image.h"
+#include "doc/image_rows.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/mask.h"
+#include "doc/mask_spans.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
@@ -45,6 +48,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -54,32 +58,38 @@ namespace app {
 
 using namespace doc;
 
-namespace {
+// Cel images with at least this number of bytes are shared
+// copy-on-write when the cel is duplicated.
+static constexpr std::size_t kMinBytesToShareImage = 64*1024;
 
-template<typename ImageTraits>
-void mask_image_templ(Image* image, const Image* bitmap)
-{
-  LockImageBits<ImageTraits> bits1(image);
-  const LockImageBits<BitmapTraits> bits2(bitmap);
-  typename LockImageBits<ImageTraits>::iterator it1, end1;
-  LockImageBits<BitmapTraits>::const_iterator it2, end2;
-  for (it1 = bits1.begin(), end1 = bits1.end(),
-       it2 = bits2.begin(), end2 = bits2.end();
-       it1 != end1 && it2 != end2; ++it1, ++it2) {
-    if (!*it2)
-      *it1 = image->maskColor();
-  }
-  ASSERT(it1 == end1);
-  ASSERT(it2 == end2);
-}
+namespace {
 
 void mask_image(Image* image, Image* bitmap)
 {
   ASSERT(image->bounds() == bitmap->bounds());
   switch (image->pixelFormat()) {
-    case IMAGE_RGB:       return mask_image_templ<RgbTraits>(image, bitmap);
-    case IMAGE_GRAYSCALE: return mask_image_templ<GrayscaleTraits>(image, bitmap);
-    case IMAGE_INDEXED:   return mask_image_templ<IndexedTraits>(image, bitmap);
+    case IMAGE_RGB:
+    case IMAGE_GRAYSCALE:
+    case IMAGE_INDEXED:
+      break;
+    default:
+      return;
+  }
+
+  const color_t maskColor = image->maskColor();
+  const MaskSpans spans(bitmap);
+  const int w = image->width();
+
+  // Clear the gaps between the runs of selected pixels
+  for (int y=0; y<image->height(); ++y) {
+    int x = 0;
+    for (const MaskSpan& span : spans.row(y)) {
+      if (x < span.x)
+        image->drawHLine(x, y, span.x-1, maskColor);
+      x = span.x2();
+    }
+    if (x < w)
+      image->drawHLine(x, y, w-1, maskColor);
   }
 }
 
@@ -89,30 +99,104 @@ void create_region_with_differences_templ(const Image* a,
                                           const gfx::Rect& bounds,
                                           gfx::Region& output)
 {
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    for (int x=bounds.x; x<bounds.x2(); ++x) {
-      if (get_pixel_fast<ImageTraits>(a, x, y) !=
-          get_pixel_fast<ImageTraits>(b, x, y)) {
-        output.createUnion(output, gfx::Region(gfx::Rect(x, y, 1, 1)));
+  ASSERT(a->bounds().contains(bounds));
+  ASSERT(b->bounds().contains(bounds));
+
+  // Runs of different pixels of the previous rows, they are extended
+  // vertically while the next rows have exactly the same runs.
+  std::vector<gfx::Rect> prevRuns, runs;
+  auto flush = [&output](const std::vector<gfx::Rect>& rcs){
+    for (const gfx::Rect& rc : rcs)
+      output.createUnion(output, gfx::Region(rc));
+  };
+
+  for_each_row<ImageTraits>(
+    a, bounds,
+    [&](const ConstRowView<ImageTraits>& rowA){
+      const auto rowB = get_row_view<ImageTraits>(b, rowA.x(), rowA.y(), rowA.size());
+      const int w = rowA.size();
+
+      runs.clear();
+      for (int x=0; x<w; ) {
+        if (rowA[x] == rowB[x]) {
+          ++x;
+          continue;
+        }
+        const int x1 = x;
+        for (++x; x<w && rowA[x] != rowB[x]; ++x)
+          ;
+        runs.push_back(gfx::Rect(rowA.x()+x1, rowA.y(), x-x1, 1));
       }
-    }
-  }
+
+      const bool sameRuns =
+        (runs.size() == prevRuns.size() &&
+         std::equal(runs.begin(), runs.end(), prevRuns.begin(),
+                    [](const gfx::Rect& rc, const gfx::Rect& prev){
+                      return (rc.x == prev.x && rc.w == prev.w);
+                    }));
+      if (sameRuns) {
+        for (gfx::Rect& prev : prevRuns)
+          ++prev.h;
+      }
+      else {
+        flush(prevRuns);
+        std::swap(prevRuns, runs);
+      }
+    });
+
+  flush(prevRuns);
 }
 
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
-void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
+void for_each_tilemap_using_tileset(Tileset* tileset, UnaryFunction f)
 {
   for (Cel* cel : tileset->sprite()->uniqueCels()) {
     if (!cel->layer()->isTilemap() ||
         static_cast<LayerTilemap*>(cel->layer())->tileset() != tileset)
       continue;
 
-    Image* tilemapImage = cel->image();
-    for_each_pixel<TilemapTraits>(tilemapImage, f);
+    f(cel->image());
   }
 }
 
+#ifdef _DEBUG
+template<typename UnaryFunction>
+void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
+{
+  for_each_tilemap_using_tileset(
+    tileset, [&f](Image* tilemapImage){
+      for_each_pixel<TilemapTraits>(tilemapImage, f);
+    });
+}
+#endif
+
+// Counts the uses of each tile of the tileset in all tilemaps
+// ("tilesHistogram" can be nullptr). It uses the cached histogram of
+// each tilemap image (Image::tileHistogram()), so only tilemaps
+// modified since the last call are scanned again. Returns the number
+// of tiles referenced by the tilemaps (or the tileset size if it's
+// greater).
+int calc_tiles_histogram(Tileset* tileset,
+                         std::vector<size_t>* tilesHistogram)
+{
+  int n = tileset->size();
+  if (tilesHistogram)
+    tilesHistogram->assign(tileset->size(), 0);
+
+  for_each_tilemap_using_tileset(
+    tileset, [&n, tilesHistogram](const Image* tilemapImage){
+      for (const auto& [ti, count] : tilemapImage->tileHistogram()) {
+        n = std::max<int>(n, ti+1);
+        // Ignore references to tiles outside the valid range (e.g.
+        // when we resize the tileset deleting tiles)
+        if (tilesHistogram && ti < tilesHistogram->size())
+          (*tilesHistogram)[ti] += count;
+      }
+    });
+  return n;
+}
+
 struct Mod {
   tile_index tileIndex;
   ImageRef tileDstImage;
@@ -120,134 +204,31 @@ struct Mod {
   gfx::Region tileRgn;
 };
 
-class DoFlip {
-public:
-  DoFlip(const doc::ImageRef& image,
-         const doc::algorithm::FlipType flipType)
-    : m_image(image.get())
-    , m_flipType(flipType) {
-  }
-  ~DoFlip() {
-    reset();
-  }
-  void flip() {
-    m_flipped = !m_flipped;
-    doc::algorithm::flip_image(m_image,
-                               m_image->bounds(),
-                               m_flipType);
-  }
-  void reset() {
-    if (m_flipped)
-      flip();
-  }
-  bool operator!() const {
-    return !m_flipped;
-  }
-private:
-  doc::Image* m_image;
-  bool m_flipped = false;
-  doc::algorithm::FlipType m_flipType;
+// Tiles cropped from the source image in each batch of
+// draw_image_into_new_tilemap_cel() (limits the memory used by the
+// tile images), and tiles processed by each parallel_for() chunk.
+const int kTilesPerBatch = 4096;
+const int kTilesPerTask = 64;
+
+struct NewTile {
+  ImageRef tileImage;
+  // Result of the search of the tile in the tileset before adding
+  // the tiles of the batch
+  bool found = false;
+  tile_index tileIndex = notile;
+  tile_flags tileFlags = 0;
 };
 
-// This is a terrible way to find tiles, i.e. flipping several times
-// the image, instead of searching for flipped hashes. In the future
-// we could try to improve it.
 bool find_tile(doc::Tileset* tileset,
-               doc::ImageRef& tileImage,
+               const doc::ImageRef& tileImage,
                doc::tile_index& tileIndex,
                doc::tile_flags& tileFlags)
 {
-  // Find without flags
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = 0;
-    return true;
-  }
-
-  if (tileset->matchFlags() == 0) // In case we don't allow flipped tiles
-    return false;
-
-  DoFlip x(tileImage, doc::algorithm::FlipHorizontal);
-
-  // Find with X flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    x.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip;
-      return true;
-    }
-    x.reset();
-  }
-
-  // Find with Y flip
-  DoFlip y(tileImage, doc::algorithm::FlipVertical);
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    y.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_yflip;
-      return true;
-    }
-
-    if (tileset->matchFlags() & doc::tile_f_xflip) {
-      // Find with X+Y flip
-      x.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip;
-        return true;
-      }
-      x.reset();
-    }
-    y.reset();
-  }
-
-  // Check if we can match diagonal flips
-  if ((tileset->matchFlags() & doc::tile_f_dflip) == 0)
-    return false;
-
-  // Find with D flip
-  DoFlip d(tileImage, doc::algorithm::FlipDiagonal);
-  d.flip();
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = doc::tile_f_dflip;
-    return true;
-  }
-
-  // Find with X+D flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    d.reset();
-    x.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip | doc::tile_f_dflip;
-      return true;
-    }
-
-    // Find with X+Y+D flip
-    if (tileset->matchFlags() & doc::tile_f_yflip) {
-      d.reset();
-      y.flip();
-      d.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip | doc::tile_f_dflip;
-        return true;
-      }
-    }
-  }
-
-  // Find with Y+D flip only
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    d.reset();
-    x.reset();
-    if (!y)
-      y.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags =  doc::tile_f_yflip | doc::tile_f_dflip;
-      return true;
-    }
-  }
-
-  // DoFlip destructors will reset the image.
-  return false;
+  // The tileset hash table contains the hashes of the flipped
+  // versions of each tile, so we can match a flipped tile without
+  // flipping the image.
+  return tileset->findTileIndex(tileImage, tileset->matchFlags(),
+                                tileIndex, tileFlags);
 }
 
 } // anonymous namespace
@@ -265,6 +246,73 @@ void create_region_with_differences(const Image* a,
   }
 }
 
+void create_tiled_region_with_differences(const Image* a,
+                                          const Image* b,
+                                          const gfx::Rect& bounds,
+                                          gfx::Region& output,
+                                          const int tileSize)
+{
+  ASSERT(a->pixelFormat() == b->pixelFormat());
+  ASSERT(a->pixelFormat() != IMAGE_BITMAP);
+  ASSERT(a->bounds().contains(bounds));
+  ASSERT(b->bounds().contains(bounds));
+  ASSERT(tileSize > 0);
+
+  const int bpp = a->bytesPerPixel();
+
+  // Runs of dirty tiles of the previous row of tiles, they are
+  // extended vertically while the next rows have the same runs.
+  std::vector<gfx::Rect> prevRuns, runs;
+  auto flush = [&output](const std::vector<gfx::Rect>& rcs){
+    for (const gfx::Rect& rc : rcs)
+      output.createUnion(output, gfx::Region(rc));
+  };
+
+  for (int ty=bounds.y - (bounds.y % tileSize); ty<bounds.y2(); ty+=tileSize) {
+    const int y1 = std::max(ty, bounds.y);
+    const int y2 = std::min(ty+tileSize, bounds.y2());
+
+    runs.clear();
+    for (int tx=bounds.x - (bounds.x % tileSize); tx<bounds.x2(); tx+=tileSize) {
+      const int x1 = std::max(tx, bounds.x);
+      const int x2 = std::min(tx+tileSize, bounds.x2());
+      const size_t rowBytes = size_t(x2-x1) * bpp;
+
+      // Compare whole rows of the tile with memcmp() (which is
+      // vectorized) instead of comparing pixel by pixel.
+      bool dirty = false;
+      for (int y=y1; y<y2 && !dirty; ++y) {
+        dirty = (std::memcmp(a->getPixelAddress(x1, y),
+                             b->getPixelAddress(x1, y), rowBytes) != 0);
+      }
+      if (!dirty)
+        continue;
+
+      if (!runs.empty() && runs.back().x2() == x1)
+        runs.back().w += x2-x1;
+      else
+        runs.push_back(gfx::Rect(x1, y1, x2-x1, y2-y1));
+    }
+
+    const bool sameRuns =
+      (runs.size() == prevRuns.size() &&
+       std::equal(runs.begin(), runs.end(), prevRuns.begin(),
+                  [](const gfx::Rect& rc, const gfx::Rect& prev){
+                    return (rc.x == prev.x && rc.w == prev.w);
+                  }));
+    if (sameRuns) {
+      for (gfx::Rect& prev : prevRuns)
+        prev.h += y2-y1;
+    }
+    else {
+      flush(prevRuns);
+      std::swap(prevRuns, runs);
+    }
+  }
+
+  flush(prevRuns);
+}
+
 static void remove_unused_tiles_from_tileset(
   CmdSequence* cmds,
   doc::Tileset* tileset,
@@ -334,9 +382,41 @@ Cel* create_cel_copy(CmdSequence* cmds,
     dstSize = tilemapBounds.size();
   }
 
+  const bool samePixelFormat =
+    (dstSprite->pixelFormat() == srcImage->pixelFormat() &&
+     // If both images are indexed but with different palette, we can
+     // convert the source cel to RGB first.
+     (dstSprite->pixelFormat() != IMAGE_INDEXED ||
+      !srcCel->sprite()->palette(srcCel->frame())->countDiff(
+        dstSprite->palette(dstFrame), nullptr, nullptr)));
+
+  // Big images are shared copy-on-write (the tiles of pixels are
+  // copied only when one of the cels is modified), so duplicating a
+  // range of big cels doesn't copy all their pixels.
+  const bool shareImage =
+    (samePixelFormat &&
+     !srcCel->layer()->isTilemap() &&
+     !dstLayer->isTilemap() &&
+     (!srcCel->layer()->isReference() || dstLayer->isReference()) &&
+     std::size_t(srcImage->rowBytes()) * srcImage->height() >= kMinBytesToShareImage);
+
   // New cel
-  auto dstCel = std::make_unique<Cel>(
-    dstFrame, ImageRef(Image::create(dstPixelFormat, dstSize.w, dstSize.h)));
+  ImageRef dstImage;
+  if (shareImage) {
+    // The storage of the source image is never changed (other
+    // threads can be reading its rows), so a regular image is copied
+    // once to a new tiled image, and the next copies of that cel
+    // will share its tiles.
+    if (srcImage->isTiled())
+      dstImage.reset(Image::createCopy(srcImage));
+    else {
+      dstImage.reset(Image::createTiled(srcImage->spec()));
+      dstImage->copy(srcImage, gfx::Clip(0, 0, srcImage->bounds()));
+    }
+  }
+  else
+    dstImage.reset(Image::create(dstPixelFormat, dstSize.w, dstSize.h));
+  auto dstCel = std::make_unique<Cel>(dstFrame, dstImage);
 
   dstCel->setOpacity(srcCel->opacity());
   dstCel->setZIndex(srcCel->zIndex());
@@ -417,13 +497,7 @@ Cel* create_cel_copy(CmdSequence* cmds,
       srcCel->bounds(),
       tilemap);
   }
-  else if ((dstSprite->pixelFormat() != srcImage->pixelFormat()) ||
-           // If both images are indexed but with different palette, we can
-           // convert the source cel to RGB first.
-           (dstSprite->pixelFormat() == IMAGE_INDEXED &&
-            srcImage->pixelFormat() == IMAGE_INDEXED &&
-            srcCel->sprite()->palette(srcCel->frame())->countDiff(
-              dstSprite->palette(dstFrame), nullptr, nullptr))) {
+  else if (!samePixelFormat) {
     ImageRef tmpImage(Image::create(IMAGE_RGB, srcImage->width(), srcImage->height()));
     tmpImage->clear(0);
 
@@ -447,8 +521,8 @@ Cel* create_cel_copy(CmdSequence* cmds,
       srcCel->layer()->isBackground(),
       dstSprite->transparentColor());
   }
-  // Simple case, where we copy both images
-  else {
+  // Simple case, where we copy both images (if they aren't shared)
+  else if (!shareImage) {
     render::composite_image(
       dstCel->image(),
       srcImage,
@@ -519,49 +593,93 @@ void draw_image_into_new_tilemap_cel(
     ASSERT(tilemapBounds.h == newTilemap->height());
   }
 
-  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds))) {
-    const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePt);
-    doc::ImageRef tileImage(
-      doc::crop_image(srcImage,
-                      tilePtInCanvas.x-srcImagePos.x,
-                      tilePtInCanvas.y-srcImagePos.y,
-                      tileSize.w, tileSize.h,
-                      srcImage->maskColor()));
-    if (grid.hasMask())
-      mask_image(tileImage.get(), grid.mask().get());
-
-    preprocess_transparent_pixels(tileImage.get());
+  const std::vector<gfx::Point> tilePts =
+    grid.tilesInCanvasRegion(gfx::Region(canvasBounds));
+  const doc::tile_flags matchFlags = tileset->matchFlags();
+  std::vector<NewTile> newTiles;
+
+  for (int i=0; i<int(tilePts.size()); i+=kTilesPerBatch) {
+    const int m = std::min<int>(kTilesPerBatch, int(tilePts.size())-i);
+
+    // Get the hash table from this thread (it can be re-generated),
+    // so the worker threads can search tiles without modifying the
+    // tileset.
+    const doc::TilesetHashTable& hashTable = tileset->hashTable();
+    const doc::tile_index oldTilesetSize = tileset->size();
+
+    // Crop, hash, and search the tiles of this batch in parallel
+    newTiles.clear();
+    newTiles.resize(m);
+    doc::parallel_for(
+      0, m, kTilesPerTask,
+      [&](const int begin, const int end){
+        for (int j=begin; j<end; ++j) {
+          const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePts[i+j]);
+          NewTile& newTile = newTiles[j];
+          newTile.tileImage.reset(
+            doc::crop_image(srcImage,
+                            tilePtInCanvas.x-srcImagePos.x,
+                            tilePtInCanvas.y-srcImagePos.y,
+                            tileSize.w, tileSize.h,
+                            srcImage->maskColor()));
+          if (grid.hasMask())
+            mask_image(newTile.tileImage.get(), grid.mask().get());
+
+          preprocess_transparent_pixels(newTile.tileImage.get());
+
+          // The hash of the tile image is calculated (and cached) here
+          newTile.found = hashTable.find(newTile.tileImage.get(),
+                                         matchFlags,
+                                         newTile.tileIndex,
+                                         newTile.tileFlags);
+        }
+      });
 
-    doc::tile_index tileIndex;
-    doc::tile_flags tileFlag = 0;
+    // Add the new tiles in order
+    for (int j=0; j<m; ++j) {
+      const gfx::Point& tilePt = tilePts[i+j];
+      NewTile& newTile = newTiles[j];
+      doc::tile_index tileIndex = newTile.tileIndex;
+      doc::tile_flags tileFlag = newTile.tileFlags;
+      bool found = newTile.found;
+
+      // A match without flips is the first possible match (added
+      // tiles have greater indexes), in other case the tile can be
+      // equal to a tile added previously in this same batch.
+      if ((!found || tileFlag != 0) &&
+          tileset->size() != oldTilesetSize) {
+        found = find_tile(tileset, newTile.tileImage, tileIndex, tileFlag);
+      }
 
-    if (!find_tile(tileset, tileImage, tileIndex, tileFlag)) {
-      auto addTile = new cmd::AddTile(tileset, tileImage);
+      if (!found) {
+        auto addTile = new cmd::AddTile(tileset, newTile.tileImage);
 
-      if (cmds)
-        cmds->executeAndAdd(addTile);
-      else {
-        // TODO a little hacky
-        addTile->execute(doc->context());
-      }
+        if (cmds)
+          cmds->executeAndAdd(addTile);
+        else {
+          // TODO a little hacky
+          addTile->execute(doc->context());
+        }
 
-      tileIndex = addTile->tileIndex();
+        tileIndex = addTile->tileIndex();
+        tileFlag = 0;
 
-      if (!cmds)
-        delete addTile;
+        if (!cmds)
+          delete addTile;
 
-      doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tileIndex);
-    }
+        doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tileIndex);
+      }
 
-    // We were using newTilemap->putPixel() directly but received a
-    // crash report about an "access violation". So now we've added
-    // some checks to the operation.
-    {
-      const int u = tilePt.x-tilemapBounds.x;
-      const int v = tilePt.y-tilemapBounds.y;
-      ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
-      doc::put_pixel(newTilemap.get(), u, v,
-                     doc::tile(tileIndex, tileFlag));
+      // We were using newTilemap->putPixel() directly but received a
+      // crash report about an "access violation". So now we've added
+      // some checks to the operation.
+      {
+        const int u = tilePt.x-tilemapBounds.x;
+        const int v = tilePt.y-tilemapBounds.y;
+        ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
+        doc::put_pixel(newTilemap.get(), u, v,
+                       doc::tile(tileIndex, tileFlag));
+      }
     }
   }
 
@@ -648,16 +766,8 @@ void modify_tilemap_cel_region(
 
     std::vector<bool> modifiedTileIndexes(tileset->size(), false);
     std::vector<size_t> tilesHistogram(tileset->size(), 0);
-    if (tilesetMode == TilesetMode::Auto) {
-      for_each_tile_using_tileset(
-        tileset, [tileset, &tilesHistogram](const doc::tile_t t){
-                   if (t != doc::notile) {
-                     doc::tile_index ti = doc::tile_geti(t);
-                     if (ti >= 0 && ti < tileset->size())
-                       ++tilesHistogram[ti];
-                   }
-                 });
-    }
+    if (tilesetMode == TilesetMode::Auto)
+      calc_tiles_histogram(tileset, &tilesHistogram);
 
     for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(regionToPatch)) {
       const int u = tilePt.x-newTilemapBounds.x;
@@ -956,33 +1066,27 @@ static void remove_unused_tiles_from_tileset(
 {
   OPS_TRACE("remove_unused_tiles_from_tileset\n");
 
-  int n = tileset->size();
+  // Only the tilemaps modified by the commands executed in "cmds"
+  // must be scanned again to calculate their histogram.
+  const int n = calc_tiles_histogram(tileset, nullptr);
+
 #ifdef _DEBUG
   // Histogram just to check that we've a correct tilesHistogram
-  std::vector<size_t> tilesHistogram2(n, 0);
-#endif
-
+  // (scanning all tilemaps instead of using the cached histograms)
+  std::vector<size_t> tilesHistogram2(tileset->size(), 0);
   for_each_tile_using_tileset(
     tileset,
-    [&n
-#ifdef _DEBUG
-     , &tilesHistogram2
-#endif
-     ](const doc::tile_t t){
+    [&tilesHistogram2](const doc::tile_t t){
       if (t != doc::notile) {
         const doc::tile_index ti = doc::tile_geti(t);
-        n = std::max<int>(n, ti+1);
-#ifdef _DEBUG
         // This check is necessary in case the tilemap has a reference
         // to a tile outside the valid range (e.g. when we resize the
         // tileset deleting tiles that will not be present anymore)
         if (ti >= 0 && ti < tilesHistogram2.size())
           ++tilesHistogram2[ti];
-#endif
       }
     });
 
-#ifdef _DEBUG
   for (int k=0; k<tilesHistogram.size(); ++k) {
     OPS_TRACE("comparing [%d] -> %d vs %d\n", k, tilesHistogram[k], tilesHistogram2[k]);
     ASSERT(tilesHistogram[k] == tilesHistogram2[k]);
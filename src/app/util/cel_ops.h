@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -40,6 +40,19 @@ namespace app {
                                       const gfx::Rect& bounds,
                                       gfx::Region& output);
 
+  // Adds to the output region the tiles (of a fixed grid aligned to
+  // the image origin) inside the given bounds that contain at least
+  // one different pixel between "a" and "b". Compared to
+  // create_region_with_differences() this creates a region with a
+  // few big rectangles (adjacent dirty tiles are merged), which is
+  // faster to create and to copy for scattered changes (e.g. a
+  // dithering brush stroke).
+  void create_tiled_region_with_differences(const doc::Image* a,
+                                            const doc::Image* b,
+                                            const gfx::Rect& bounds,
+                                            gfx::Region& output,
+                                            const int tileSize = 32);
+
   // Creates a new image of the given cel
   doc::ImageRef crop_cel_image(
     const doc::Cel* cel,
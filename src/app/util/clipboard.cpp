@@ -37,6 +37,7 @@
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/blend_image.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "render/dithering.h"
 #include "render/ordered_dither.h"
 #include "render/quantization.h"
@@ -173,6 +174,9 @@ Clipboard* Clipboard::instance()
 
 Clipboard::Clipboard()
   : m_data(new Data)
+  , m_nativeBitmapId(0)
+  , m_nativeBitmapPending(false)
+  , m_nativeTasks(new doc::TaskGroup)
 {
   ASSERT(!g_instance);
   g_instance = this;
@@ -189,6 +193,7 @@ Clipboard::~Clipboard()
 void Clipboard::setClipboardText(const std::string& text)
 {
   if (use_native_clipboard()) {
+    discardNativeBitmap();
     clip::set_text(text);
   }
   else {
@@ -216,6 +221,10 @@ void Clipboard::setData(Image* image,
 {
   const bool isTilemap = (image && image->isTilemap());
 
+  // Don't set the image that we were encoding for the native
+  // clipboard (it's not the last copied data anymore)
+  discardNativeBitmap();
+
   m_data->clear();
   m_data->palette.reset(palette);
   m_data->tileset.reset(tileset);
@@ -230,12 +239,13 @@ void Clipboard::setData(Image* image,
     // Copy tilemap to the native clipboard
     if (isTilemap) {
       ASSERT(tileset);
-      setNativeBitmap(image, mask, palette, tileset, -1);
+      setNativeBitmap(m_data->tilemap, m_data->mask,
+                      m_data->palette, m_data->tileset, -1);
     }
     // Copy non-tilemap images to the native clipboard
     else {
       setNativeBitmap(
-        image, mask, palette, nullptr,
+        m_data->image, m_data->mask, m_data->palette, nullptr,
         image_source_is_transparent ? image->maskColor(): -1);
     }
   }
@@ -288,8 +298,11 @@ bool Clipboard::copyFromDocument(const Site& site, bool merged)
 
 ClipboardFormat Clipboard::format() const
 {
-  // Check if the native clipboard has an image
-  if (use_native_clipboard() && hasNativeBitmap()) {
+  // Check if the native clipboard has an image (that wasn't copied
+  // by us, in that case we've the same data in m_data)
+  if (use_native_clipboard() &&
+      !isNativeBitmapOwner() &&
+      hasNativeBitmap()) {
     return ClipboardFormat::Image;
   }
   else {
@@ -725,8 +738,12 @@ void Clipboard::paste(Context* ctx,
           auto srcLayers = srcSpr->allBrowsableLayers();
           auto dstLayers = dstSpr->allBrowsableLayers();
 
+          // Insert all the new frames at once
+          if (!srcRange.selectedFrames().empty())
+            api.addEmptyFrames(dstSpr, dstFrame,
+                               frame_t(srcRange.selectedFrames().size()));
+
           for (frame_t srcFrame : srcRange.selectedFrames()) {
-            api.addEmptyFrame(dstSpr, dstFrame);
             api.setFrameDuration(dstSpr, dstFrame, srcSpr->frameDuration(srcFrame));
 
             auto srcIt = srcLayers.begin();
@@ -782,8 +799,7 @@ void Clipboard::paste(Context* ctx,
             if (lastCel && maxFrame < lastCel->frame())
               maxFrame = lastCel->frame();
           }
-          while (dstSpr->totalFrames() < maxFrame+1)
-            api.addEmptyFrame(dstSpr, dstSpr->totalFrames());
+          api.addEmptyFramesTo(dstSpr, maxFrame);
 
           for (Layer* srcLayer : srcLayers) {
             Layer* afterThis;
@@ -822,8 +838,10 @@ void Clipboard::paste(Context* ctx,
 
 ImageRef Clipboard::getImage(Palette* palette)
 {
-  // Get the image from the native clipboard.
-  if (use_native_clipboard()) {
+  // Get the image from the native clipboard (if it wasn't copied by
+  // us, in that case we can use m_data directly without decoding the
+  // native data).
+  if (use_native_clipboard() && !isNativeBitmapOwner()) {
     Image* native_image = nullptr;
     Mask* native_mask = nullptr;
     Palette* native_palette = nullptr;
@@ -847,7 +865,9 @@ ImageRef Clipboard::getImage(Palette* palette)
 
 bool Clipboard::getImageSize(gfx::Size& size)
 {
-  if (use_native_clipboard() && getNativeBitmapSize(&size))
+  if (use_native_clipboard() &&
+      !isNativeBitmapOwner() &&
+      getNativeBitmapSize(&size))
     return true;
 
   if (m_data->image) {
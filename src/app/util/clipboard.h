@@ -16,6 +16,7 @@
 #include "ui/base.h"
 #include "ui/clipboard_delegate.h"
 
+#include <atomic>
 #include <memory>
 
 namespace doc {
@@ -23,6 +24,7 @@ namespace doc {
   class Mask;
   class Palette;
   class PalettePicks;
+  class TaskGroup;
   class Tileset;
 }
 
@@ -105,11 +107,13 @@ namespace app {
     void clearNativeContent();
     void registerNativeFormats();
     bool hasNativeBitmap() const;
-    bool setNativeBitmap(const doc::Image* image,
-                         const doc::Mask* mask,
-                         const doc::Palette* palette,
-                         const doc::Tileset* tileset,
+    bool isNativeBitmapOwner() const;
+    void setNativeBitmap(const doc::ImageRef& image,
+                         const std::shared_ptr<doc::Mask>& mask,
+                         const std::shared_ptr<doc::Palette>& palette,
+                         const std::shared_ptr<doc::Tileset>& tileset,
                          const doc::color_t indexMaskColor);
+    void discardNativeBitmap();
     bool getNativeBitmap(doc::Image** image,
                          doc::Mask** mask,
                          doc::Palette** palette,
@@ -121,6 +125,14 @@ namespace app {
 
     struct Data;
     std::unique_ptr<Data> m_data;
+
+    // Number of the last image copied to the native clipboard (it's
+    // incremented each time the native clipboard content changes).
+    std::atomic<int> m_nativeBitmapId;
+    // True if the last image is still being encoded in a background
+    // task to set it in the native clipboard.
+    bool m_nativeBitmapPending;
+    std::unique_ptr<doc::TaskGroup> m_nativeTasks;
   };
 
 } // namespace app
@@ -21,12 +21,18 @@
 #include "doc/image_io.h"
 #include "doc/mask_io.h"
 #include "doc/palette_io.h"
+#include "doc/parallel.h"
 #include "doc/tileset_io.h"
 #include "gfx/size.h"
 #include "os/system.h"
 #include "os/window.h"
 #include "ui/alert.h"
+#include "ui/system.h"
 
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -40,6 +46,24 @@ namespace {
   clip::format custom_image_format = 0;
   bool show_clip_errors = true;
 
+  // Format used to know if the native clipboard still contains the
+  // last image that we've copied: it contains the session ID of this
+  // process and the ID of the copied image (see native_bitmap_token()).
+  clip::format custom_token_format = 0;
+  uint32_t session_id = 0;
+
+  // Native clipboard data of an image, encoded in a background task.
+  struct NativeBitmap {
+    std::vector<char> customData;
+    clip::image image;
+    // Source image (RGB images are referenced directly by "image")
+    doc::ImageRef source;
+  };
+
+  uint64_t native_bitmap_token(const int id) {
+    return ((uint64_t(session_id) << 32) | uint32_t(id));
+  }
+
   class InhibitClipErrors {
     bool m_saved;
   public:
@@ -72,10 +96,123 @@ namespace {
     }
   }
 
+  void encode_native_bitmap(const doc::ImageRef& image,
+                            const doc::Mask* mask,
+                            const doc::Palette* palette,
+                            const doc::Tileset* tileset,
+                            const doc::color_t indexMaskColor,
+                            NativeBitmap& output)
+  {
+    output.source = image;
+
+    // Custom clipboard format
+    if (custom_image_format) {
+      std::stringstream os;
+      write32(os,
+              (image   ? 1: 0) |
+              (mask    ? 2: 0) |
+              (palette ? 4: 0) |
+              (tileset ? 8: 0));
+      if (image) doc::write_image(os, image.get());
+      if (mask) doc::write_mask(os, mask);
+      if (palette) doc::write_palette(os, palette);
+      if (tileset) doc::write_tileset(os, tileset);
+
+      if (os.good()) {
+        size_t size = (size_t)os.tellp();
+        if (size > 0) {
+          output.customData.resize(size);
+          os.seekp(0);
+          os.read(&output.customData[0], size);
+        }
+      }
+    }
+
+    clip::image_spec spec;
+    spec.width = image->width();
+    spec.height = image->height();
+    spec.bits_per_pixel = 32;
+    spec.bytes_per_row = (image->pixelFormat() == doc::IMAGE_RGB ?
+                          image->rowBytes(): 4*spec.width);
+    spec.red_mask    = doc::rgba_r_mask;
+    spec.green_mask  = doc::rgba_g_mask;
+    spec.blue_mask   = doc::rgba_b_mask;
+    spec.alpha_mask  = doc::rgba_a_mask;
+    spec.red_shift   = doc::rgba_r_shift;
+    spec.green_shift = doc::rgba_g_shift;
+    spec.blue_shift  = doc::rgba_b_shift;
+    spec.alpha_shift = doc::rgba_a_shift;
+
+    const int w = image->width();
+    const int grain = std::max(1, 64*1024 / std::max(1, w));
+
+    switch (image->pixelFormat()) {
+      case doc::IMAGE_RGB: {
+        // We use the RGB image data directly (the image is kept alive
+        // in output.source)
+        if (!image->isTiled()) {
+          output.image = clip::image(image->getPixelAddress(0, 0), spec);
+        }
+        // Rows of a tiled image aren't contiguous, so we copy them
+        else {
+          output.image = clip::image(spec);
+          char* dst = output.image.data();
+          for (int y=0; y<image->height(); ++y, dst+=spec.bytes_per_row)
+            std::memcpy(dst, image->getPixelAddress(0, y), image->rowBytes());
+        }
+        break;
+      }
+      case doc::IMAGE_GRAYSCALE: {
+        output.image = clip::image(spec);
+        uint32_t* dst = (uint32_t*)output.image.data();
+        doc::parallel_for(
+          0, image->height(), grain,
+          [&image, dst, w](const int y1, const int y2){
+            for (int y=y1; y<y2; ++y) {
+              auto src = (const uint16_t*)image->getPixelAddress(0, y);
+              uint32_t* dstRow = dst + std::size_t(y)*w;
+              for (int x=0; x<w; ++x) {
+                const doc::color_t c = src[x];
+                dstRow[x] = doc::rgba(doc::graya_getv(c),
+                                      doc::graya_getv(c),
+                                      doc::graya_getv(c),
+                                      doc::graya_geta(c));
+              }
+            }
+          });
+        break;
+      }
+      case doc::IMAGE_INDEXED: {
+        output.image = clip::image(spec);
+        uint32_t* dst = (uint32_t*)output.image.data();
+        doc::parallel_for(
+          0, image->height(), grain,
+          [&image, palette, indexMaskColor, dst, w](const int y1, const int y2){
+            for (int y=y1; y<y2; ++y) {
+              const uint8_t* src = image->getPixelAddress(0, y);
+              uint32_t* dstRow = dst + std::size_t(y)*w;
+              for (int x=0; x<w; ++x) {
+                doc::color_t c = palette->getEntry(src[x]);
+
+                // Use alpha=0 for mask color
+                if (src[x] == indexMaskColor)
+                  c &= doc::rgba_rgb_mask;
+
+                dstRow[x] = c;
+              }
+            }
+          });
+        break;
+      }
+    }
+  }
+
 }
 
 void Clipboard::clearNativeContent()
 {
+  discardNativeBitmap();
+
   clip::lock l(native_window_handle());
   l.clear();
 }
@@ -84,6 +221,8 @@ void Clipboard::registerNativeFormats()
 {
   clip::set_error_handler(custom_error_handler);
   custom_image_format = clip::register_format("org.aseprite.Image");
+  custom_token_format = clip::register_format("org.aseprite.ImageToken");
+  session_id = std::random_device()();
 }
 
 bool Clipboard::hasNativeBitmap() const
@@ -92,107 +231,95 @@ bool Clipboard::hasNativeBitmap() const
   return clip::has(clip::image_format());
 }
 
-bool Clipboard::setNativeBitmap(const doc::Image* image,
-                                const doc::Mask* mask,
-                                const doc::Palette* palette,
-                                const doc::Tileset* tileset,
-                                const doc::color_t indexMaskColor)
+bool Clipboard::isNativeBitmapOwner() const
 {
-  clip::lock l(native_window_handle());
-  if (!l.locked())
+  if (m_nativeBitmapPending)
+    return true;
+  if (!custom_token_format || m_nativeBitmapId == 0)
     return false;
 
-  l.clear();
+  InhibitClipErrors ice;
+  clip::lock l(native_window_handle());
+  if (!l.locked() ||
+      !l.is_convertible(custom_token_format))
+    return false;
 
-  if (!image)
+  uint64_t token = 0;
+  if (l.get_data_length(custom_token_format) != sizeof(token) ||
+      !l.get_data(custom_token_format, (char*)&token, sizeof(token)))
     return false;
 
-  // Set custom clipboard formats
-  if (custom_image_format) {
-    std::stringstream os;
-    write32(os,
-            (image   ? 1: 0) |
-            (mask    ? 2: 0) |
-            (palette ? 4: 0) |
-            (tileset ? 8: 0));
-    if (image) doc::write_image(os, image);
-    if (mask) doc::write_mask(os, mask);
-    if (palette) doc::write_palette(os, palette);
-    if (tileset) doc::write_tileset(os, tileset);
-
-    if (os.good()) {
-      size_t size = (size_t)os.tellp();
-      if (size > 0) {
-        std::vector<char> data(size);
-        os.seekp(0);
-        os.read(&data[0], size);
-
-        l.set_data(custom_image_format, &data[0], size);
-      }
-    }
-  }
+  return (token == native_bitmap_token(m_nativeBitmapId));
+}
 
-  clip::image_spec spec;
-  spec.width = image->width();
-  spec.height = image->height();
-  spec.bits_per_pixel = 32;
-  spec.bytes_per_row = (image->pixelFormat() == doc::IMAGE_RGB ?
-                        image->rowBytes(): 4*spec.width);
-  spec.red_mask    = doc::rgba_r_mask;
-  spec.green_mask  = doc::rgba_g_mask;
-  spec.blue_mask   = doc::rgba_b_mask;
-  spec.alpha_mask  = doc::rgba_a_mask;
-  spec.red_shift   = doc::rgba_r_shift;
-  spec.green_shift = doc::rgba_g_shift;
-  spec.blue_shift  = doc::rgba_b_shift;
-  spec.alpha_shift = doc::rgba_a_shift;
-
-  switch (image->pixelFormat()) {
-    case doc::IMAGE_RGB: {
-      // We use the RGB image data directly
-      clip::image img(image->getPixelAddress(0, 0), spec);
-      l.set_image(img);
-      break;
-    }
-    case doc::IMAGE_GRAYSCALE: {
-      clip::image img(spec);
-      const doc::LockImageBits<doc::GrayscaleTraits> bits(image);
-      auto it = bits.begin();
-      uint32_t* dst = (uint32_t*)img.data();
-      for (int y=0; y<image->height(); ++y) {
-        for (int x=0; x<image->width(); ++x, ++it) {
-          doc::color_t c = *it;
-          *(dst++) = doc::rgba(doc::graya_getv(c),
-                               doc::graya_getv(c),
-                               doc::graya_getv(c),
-                               doc::graya_geta(c));
-        }
-      }
-      l.set_image(img);
-      break;
-    }
-    case doc::IMAGE_INDEXED: {
-      clip::image img(spec);
-      const doc::LockImageBits<doc::IndexedTraits> bits(image);
-      auto it = bits.begin();
-      uint32_t* dst = (uint32_t*)img.data();
-      for (int y=0; y<image->height(); ++y) {
-        for (int x=0; x<image->width(); ++x, ++it) {
-          doc::color_t c = palette->getEntry(*it);
+// The image is encoded for the native clipboard in a background task
+// (copying a big image doesn't freeze the UI), and meanwhile m_data
+// is used for pastes inside the program (isNativeBitmapOwner()
+// returns true). The native clipboard is set from the UI thread when
+// the encoded data is ready, only if the image is still the last
+// copied data.
+void Clipboard::setNativeBitmap(const doc::ImageRef& image,
+                                const std::shared_ptr<doc::Mask>& mask,
+                                const std::shared_ptr<doc::Palette>& palette,
+                                const std::shared_ptr<doc::Tileset>& tileset,
+                                const doc::color_t indexMaskColor)
+{
+  if (!image) {
+    clearNativeContent();
+    return;
+  }
 
-          // Use alpha=0 for mask color
-          if (*it == indexMaskColor)
-            c &= doc::rgba_rgb_mask;
+  const int id = ++m_nativeBitmapId;
+  m_nativeBitmapPending = true;
+
+  m_nativeTasks->run(
+    [this, id, image, mask, palette, tileset,
+     indexMaskColor](base::task_token& token){
+      if (token.canceled() || m_nativeBitmapId != id)
+        return;
+
+      auto bitmap = std::make_shared<NativeBitmap>();
+      encode_native_bitmap(image, mask.get(), palette.get(), tileset.get(),
+                           indexMaskColor, *bitmap);
+
+      if (token.canceled() || m_nativeBitmapId != id)
+        return;
+
+      ui::execute_from_ui_thread(
+        [id, bitmap]{
+          Clipboard* clipboard = Clipboard::instance();
+          if (!clipboard ||
+              clipboard->m_nativeBitmapId != id)
+            return;
+
+          clipboard->m_nativeBitmapPending = false;
+
+          clip::lock l(native_window_handle());
+          if (!l.locked())
+            return;
+
+          l.clear();
+          if (!bitmap->customData.empty())
+            l.set_data(custom_image_format,
+                       &bitmap->customData[0],
+                       bitmap->customData.size());
+          if (custom_token_format) {
+            const uint64_t value = native_bitmap_token(id);
+            l.set_data(custom_token_format, (const char*)&value, sizeof(value));
+          }
+          l.set_image(bitmap->image);
+        });
+    });
+}
 
-          *(dst++) = c;
-        }
-      }
-      l.set_image(img);
-      break;
-    }
+void Clipboard::discardNativeBitmap()
+{
+  // Increment the ID so the pending image is not set in the native
+  // clipboard and isNativeBitmapOwner() returns false.
+  if (m_nativeBitmapPending || m_nativeBitmapId != 0) {
+    ++m_nativeBitmapId;
+    m_nativeBitmapPending = false;
   }
-
-  return true;
 }
 
 bool Clipboard::getNativeBitmap(doc::Image** image,
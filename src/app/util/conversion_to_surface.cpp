@@ -25,6 +25,7 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 
 namespace app {
@@ -77,9 +78,9 @@ uint32_t convert_color_to_surface<BitmapTraits, os::kRgbaSurfaceFormat>(color_t
     ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
 }
 
-template<typename ImageTraits, typename AddressType>
+template<typename ImageTraits, typename AddressType, typename Converter>
 void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
-  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, Converter convert)
 {
   const LockImageBits<ImageTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
   typename LockImageBits<ImageTraits>::const_iterator src_it = bits.begin();
@@ -92,7 +93,7 @@ void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
     for (int u=0; u<w; ++u) {
       ASSERT(src_it != src_end);
 
-      *dst_address = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(*src_it, palette, image->spec(), fd);
+      *dst_address = convert(*src_it);
       ++dst_address;
       ++src_it;
     }
@@ -111,31 +112,43 @@ struct Address24bpp
   }
 };
 
-template<typename ImageTraits>
+template<typename ImageTraits, typename Converter>
 void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
-  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const os::SurfaceFormatData* fd, Converter convert)
 {
   switch (fd->bitsPerPixel) {
 
     case 8:
-      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 15:
     case 16:
-      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 24:
-      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 32:
-      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
   }
 }
 
+// Table with the surface color of each possible index (or gray
+// value), so we don't have to convert the same colors for each pixel.
+using SurfaceColorTable = std::array<uint32_t, 256>;
+
+template<typename ImageTraits>
+void make_surface_color_table(SurfaceColorTable& table, const Palette* palette,
+                              const ImageSpec& spec, const os::SurfaceFormatData* fd)
+{
+  for (int i=0; i<int(table.size()); ++i)
+    table[i] = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(i, palette, spec, fd);
+}
+
 } // anonymous namespace
 
 
@@ -190,20 +203,63 @@ void convert_image_to_surface(
         }
         return;
       }
-      convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+      // Fast path for surfaces with the red/blue channels swapped
+      // (BGRA), with constant shifts the row loop can be vectorized.
+      if (fd.bitsPerPixel == 32 &&
+          fd.redShift == rgba_b_shift &&
+          fd.greenShift == rgba_g_shift &&
+          fd.blueShift == rgba_r_shift &&
+          fd.alphaShift == rgba_a_shift) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(src_x, src_y);
+          uint32_t* dst_address = (uint32_t*)surface->getData(dst_x, dst_y);
+          for (int u=0; u<w; ++u) {
+            const uint32_t c = src_address[u];
+            dst_address[u] = ((c & (rgba_g_mask | rgba_a_mask)) |
+                              (((c & rgba_r_mask) >> rgba_r_shift) << rgba_b_shift) |
+                              (((c & rgba_b_mask) >> rgba_b_shift) << rgba_r_shift));
+          }
+        }
+        break;
+      }
+      convert_image_to_surface_selector<RgbTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        [image, &fd](color_t c) {
+          return convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(c, nullptr, image->spec(), &fd);
+        });
       break;
 
-    case IMAGE_GRAYSCALE:
-      convert_image_to_surface_selector<GrayscaleTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+    case IMAGE_GRAYSCALE: {
+      // Table for the gray values (each index is a gray value with
+      // alpha=0), the alpha is added to each pixel
+      SurfaceColorTable table;
+      make_surface_color_table<GrayscaleTraits>(table, palette, image->spec(), &fd);
+      convert_image_to_surface_selector<GrayscaleTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        [&table, &fd](color_t c) {
+          return (table[graya_getv(c)] |
+                  ((graya_geta(c) << fd.alphaShift) & fd.alphaMask));
+        });
       break;
+    }
 
-    case IMAGE_INDEXED:
-      convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+    case IMAGE_INDEXED: {
+      SurfaceColorTable table;
+      make_surface_color_table<IndexedTraits>(table, palette, image->spec(), &fd);
+      convert_image_to_surface_selector<IndexedTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        [&table](color_t c) { return table[c & 0xff]; });
       break;
+    }
 
-    case IMAGE_BITMAP:
-      convert_image_to_surface_selector<BitmapTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+    case IMAGE_BITMAP: {
+      SurfaceColorTable table;
+      make_surface_color_table<BitmapTraits>(table, palette, image->spec(), &fd);
+      convert_image_to_surface_selector<BitmapTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        [&table](color_t c) { return table[c & 0xff]; });
       break;
+    }
 
     default:
       ASSERT(false);
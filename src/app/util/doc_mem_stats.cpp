@@ -0,0 +1,53 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/doc_mem_stats.h"
+
+#include "app/app.h"
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/ui/timeline/timeline.h"
+#include "doc/cel.h"
+#include "doc/cels_range.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "doc/tilesets.h"
+
+#include <set>
+
+namespace app {
+
+DocMemStats calculate_doc_mem_stats(const Doc* doc)
+{
+  DocMemStats stats;
+  const doc::Sprite* sprite = doc->sprite();
+
+  // The same image can be used by several cels
+  std::set<doc::ObjectId> images;
+  for (const doc::Cel* cel : sprite->uniqueCels()) {
+    const doc::Image* image = cel->image();
+    if (image && images.insert(image->id()).second)
+      stats.images += image->getMemSize();
+  }
+
+  if (sprite->hasTilesets())
+    stats.tilesets = sprite->tilesets()->getMemSize();
+
+  stats.undoHistory = doc->undoHistory()->totalUndoSize();
+  stats.renderCache = doc->compositeCacheBytes();
+
+  if (auto app = App::instance()) {
+    if (Timeline* timeline = app->timeline())
+      stats.thumbnails = timeline->thumbnailsCacheBytes(doc);
+  }
+  return stats;
+}
+
+} // namespace app
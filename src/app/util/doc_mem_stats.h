@@ -0,0 +1,33 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_DOC_MEM_STATS_H_INCLUDED
+#define APP_UTIL_DOC_MEM_STATS_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+
+namespace app {
+  class Doc;
+
+  // Memory used by a document, grouped by the kind of data.
+  struct DocMemStats {
+    size_t images = 0;          // Cel images (linked cels counted once)
+    size_t tilesets = 0;
+    size_t undoHistory = 0;
+    size_t renderCache = 0;     // Composite cache used to render the editor
+    size_t thumbnails = 0;      // Cached cel thumbnails of the timeline
+
+    size_t total() const {
+      return images + tilesets + undoHistory + renderCache + thumbnails;
+    }
+  };
+
+  DocMemStats calculate_doc_mem_stats(const Doc* doc);
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -301,11 +301,12 @@ void ExpandCelCanvas::commit()
     if (m_canCompareSrcVsDst) {
       ASSERT(gfx::Region().createSubtraction(m_validDstRegion, m_validSrcRegion).isEmpty());
 
-      for (gfx::Rect rc : m_validDstRegion) {
-        if (algorithm::shrink_bounds2(getSourceCanvas(),
-                                      getDestCanvas(), rc, rc)) {
-          reduced |= gfx::Region(rc);
-        }
+      // Only the tiles with modified pixels are patched (and saved
+      // in the undo history).
+      for (const gfx::Rect& rc : m_validDstRegion) {
+        create_tiled_region_with_differences(getSourceCanvas(),
+                                             getDestCanvas(),
+                                             rc, reduced);
       }
 
       regionToPatch = &reduced;
@@ -471,7 +472,11 @@ Image* ExpandCelCanvas::getSourceCanvas()
                                      m_bounds.w, m_bounds.h, src_buffer));
       m_srcImage->setMaskColor(m_sprite->transparentColor());
     }
-    m_srcImage->clear(m_srcImage->maskColor());
+
+    // We don't clear the whole canvas (which is slow for big
+    // sprites), pixels are read from m_srcImage only in the
+    // m_validSrcRegion, and validateSourceCanvas() fills each
+    // region that is validated.
   }
   return m_srcImage.get();
 }
@@ -489,7 +494,16 @@ Image* ExpandCelCanvas::getDestCanvas()
                                      m_bounds.w, m_bounds.h, dst_buffer));
       m_dstImage->setMaskColor(m_sprite->transparentColor());
     }
-    m_dstImage->clear(m_dstImage->maskColor());
+
+    // If the m_dstImage is used as the image of a (new or tilemap)
+    // cel, other parts of the UI (e.g. timeline thumbnails) can
+    // render the whole image, so we have to clear it. In other case
+    // the m_dstImage is used as a preview image in the editor, which
+    // validates the exposed areas before rendering them (see
+    // DrawingState::onExposeSpritePixels()), so only the validated
+    // regions are read.
+    if (m_celCreated || (m_layer && m_layer->isTilemap()))
+      m_dstImage->clear(m_dstImage->maskColor());
   }
   return m_dstImage.get();
 }
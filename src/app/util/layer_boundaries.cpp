@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,13 +21,82 @@
 #include "doc/document.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 
 using namespace doc;
 
 namespace app {
 
+namespace {
+
+// Number of rows processed by each parallel task
+const int kRowsPerTask = 64;
+
+// Sets the pixels of the "maskBitmap" (with the same size of
+// "image") where the image pixel is opaque.
+template<typename ImageTraits, typename IsOpaque>
+void mask_opaque_pixels(Image* maskBitmap, const Image* image,
+                        IsOpaque&& isOpaque)
+{
+  ASSERT(maskBitmap->size() == image->size());
+
+  const int w = image->width();
+  maskBitmap->invalidateContentHash();
+  parallel_for(
+    0, image->height(), kRowsPerTask,
+    [maskBitmap, image, w, &isOpaque](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const auto srcRow = get_row_view<ImageTraits>(image, 0, y, w);
+        const RowView<BitmapTraits> maskRow(
+          (BitmapTraits::address_t)maskBitmap->getPixelAddress(0, y), 0, y, w);
+        for (int x=0; x<w; ++x)
+          maskRow.put(x, isOpaque(srcRow[x]));
+      }
+    });
+}
+
+void mask_opaque_pixels(Image* maskBitmap, const Image* image)
+{
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      mask_opaque_pixels<RgbTraits>(
+        maskBitmap, image,
+        [](const color_t c){ return (rgba_geta(c) >= 128); }); // TODO configurable threshold
+      break;
+
+    case IMAGE_GRAYSCALE:
+      mask_opaque_pixels<GrayscaleTraits>(
+        maskBitmap, image,
+        [](const color_t c){ return (graya_geta(c) >= 128); }); // TODO configurable threshold
+      break;
+
+    case IMAGE_INDEXED: {
+      const color_t maskColor = image->maskColor();
+      mask_opaque_pixels<IndexedTraits>(
+        maskBitmap, image,
+        [maskColor](const color_t c){ return (c != maskColor); });
+      break;
+    }
+
+  }
+}
+
+bool is_opaque_color(const Image* image, const color_t c)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return (rgba_geta(c) >= 128);
+    case IMAGE_GRAYSCALE: return (graya_geta(c) >= 128);
+    case IMAGE_INDEXED:   return (c != image->maskColor());
+  }
+  return false;
+}
+
+} // anonymous namespace
+
 void select_layer_boundaries(Layer* layer,
                              const frame_t frame,
                              const SelectLayerBoundariesOp op)
@@ -40,58 +109,15 @@ void select_layer_boundaries(Layer* layer,
     if (image) {
       newMask.replace(cel->bounds());
       newMask.freeze();
-      {
-        LockImageBits<BitmapTraits> maskBits(newMask.bitmap());
-        auto maskIt = maskBits.begin();
-        auto maskEnd = maskBits.end();
-
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB: {
-            LockImageBits<RgbTraits> rgbBits(image);
-            auto rgbIt = rgbBits.begin();
-#if _DEBUG
-            auto rgbEnd = rgbBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++rgbIt) {
-              ASSERT(rgbIt != rgbEnd);
-              color_t c = *rgbIt;
-              *maskIt = (rgba_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_GRAYSCALE: {
-            LockImageBits<GrayscaleTraits> grayBits(image);
-            auto grayIt = grayBits.begin();
-#if _DEBUG
-            auto grayEnd = grayBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++grayIt) {
-              ASSERT(grayIt != grayEnd);
-              color_t c = *grayIt;
-              *maskIt = (graya_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_INDEXED: {
-            const doc::color_t maskColor = image->maskColor();
-            LockImageBits<IndexedTraits> idxBits(image);
-            auto idxIt = idxBits.begin();
-#if _DEBUG
-            auto idxEnd = idxBits.end();
-#endif
-            for (; maskIt != maskEnd; ++maskIt, ++idxIt) {
-              ASSERT(idxIt != idxEnd);
-              color_t c = *idxIt;
-              *maskIt = (c != maskColor);
-            }
-            break;
-          }
 
-        }
-      }
+      // If we already know that the image is plain (e.g. an empty
+      // cel) we don't need to check each pixel.
+      color_t plainColor;
+      if (image->hasPlainInfo() && image->isPlain(&plainColor))
+        newMask.bitmap()->clear(is_opaque_color(image, plainColor) ? 1: 0);
+      else
+        mask_opaque_pixels(newMask.bitmap(), image);
+
       newMask.unfreeze();
     }
   }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021 Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,15 +14,77 @@
 #include "app/doc.h"
 #include "app/site.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "render/render.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace doc;
 
+namespace {
+
+// Number of rows processed by each parallel task
+const int kRowsPerTask = 64;
+
+// Copies the pixels of "src" selected in the "maskBitmap" (with the
+// same size of "dst") into "dst". The pixel (u, v) of "dst" is the
+// pixel (u, v)+offset of "src". If "src" is "dst" the pixels that
+// are not selected are cleared.
+template<typename ImageTraits>
+void copy_masked_pixels(Image* dst,
+                        const Image* src,
+                        const Image* maskBitmap,
+                        const gfx::Point& offset)
+{
+  using address_t = typename ImageTraits::address_t;
+
+  ASSERT(dst->size() == maskBitmap->size());
+
+  const int w = dst->width();
+  const int srcW = src->width();
+  const int srcH = src->height();
+  const color_t maskColor = dst->maskColor();
+  const bool sameImage = (src == dst);
+
+  dst->invalidateContentHash();
+  parallel_for(
+    0, dst->height(), kRowsPerTask,
+    [=](const int v1, const int v2){
+      for (int v=v1; v<v2; ++v) {
+        const auto maskRow = get_row_view<BitmapTraits>(maskBitmap, 0, v, w);
+        auto dstPtr = (address_t)dst->getPixelAddress(0, v);
+
+        if (sameImage) {
+          for (int u=0; u<w; ++u) {
+            if (!maskRow[u])
+              dstPtr[u] = maskColor;
+          }
+          continue;
+        }
+
+        const int gety = v + offset.y;
+        const int u1 = std::max(0, -offset.x);
+        const int u2 = std::min(w, srcW - offset.x);
+        if (gety < 0 || gety >= srcH || u1 >= u2)
+          continue;
+
+        const auto srcRow = get_row_view<ImageTraits>(src, u1+offset.x, gety, u2-u1);
+        for (int u=u1; u<u2; ++u) {
+          if (maskRow[u])
+            dstPtr[u] = srcRow[u-u1];
+        }
+      }
+    });
+}
+
+} // anonymous namespace
+
 Image* new_image_from_mask(const Site& site, const bool newBlend)
 {
   const Mask* srcMask = site.document()->mask();
@@ -81,35 +143,26 @@ doc::Image* new_image_from_mask(const Site& site,
 
   // Copy the masked zones
   if (src) {
+    // If the whole mask bounds are selected (e.g. a rectangular
+    // selection) we don't need to check each pixel of the mask.
+    color_t plainMask;
+    if (srcMaskBitmap->hasPlainInfo() &&
+        srcMaskBitmap->isPlain(&plainMask) &&
+        plainMask != 0) {
+      srcMaskBitmap = nullptr;
+    }
+
     if (srcMaskBitmap) {
       // Copy active layer with mask
-      const LockImageBits<BitmapTraits> maskBits(srcMaskBitmap, gfx::Rect(0, 0, srcBounds.w, srcBounds.h));
-      LockImageBits<BitmapTraits>::const_iterator mask_it = maskBits.begin();
-
-      for (int v=0; v<srcBounds.h; ++v) {
-        for (int u=0; u<srcBounds.w; ++u, ++mask_it) {
-          ASSERT(mask_it != maskBits.end());
-
-          if (src != dst.get()) {
-            if (*mask_it) {
-              int getx = u+srcBounds.x-x;
-              int gety = v+srcBounds.y-y;
-
-              if ((getx >= 0) && (getx < src->width()) &&
-                  (gety >= 0) && (gety < src->height()))
-                dst->putPixel(u, v, src->getPixel(getx, gety));
-            }
-          }
-          else {
-            if (!*mask_it) {
-              dst->putPixel(u, v, dst->maskColor());
-            }
-          }
-        }
+      const gfx::Point offset(srcBounds.x-x, srcBounds.y-y);
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:       copy_masked_pixels<RgbTraits>(dst.get(), src, srcMaskBitmap, offset); break;
+        case IMAGE_GRAYSCALE: copy_masked_pixels<GrayscaleTraits>(dst.get(), src, srcMaskBitmap, offset); break;
+        case IMAGE_INDEXED:   copy_masked_pixels<IndexedTraits>(dst.get(), src, srcMaskBitmap, offset); break;
       }
     }
     else if (src != dst.get()) {
-      copy_image(dst.get(), src, -srcBounds.x, -srcBounds.y);
+      copy_image(dst.get(), src, -srcBounds.x+x, -srcBounds.y+y);
     }
   }
 
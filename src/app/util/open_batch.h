@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -21,9 +21,48 @@ namespace app {
   public:
     void open(Context* ctx,
               const std::string& fn,
-              const bool oneFrame) {
+              const bool oneFrame,
+              const bool metadataOnly = false,
+              const FileOpLoadROI& loadROI = FileOpLoadROI()) {
       Params params;
       params.set("filename", fn.c_str());
+      execute(ctx, params, oneFrame, metadataOnly, loadROI);
+    }
+
+    // Opens several files loading up to "jobs" files at the same
+    // time.
+    void open(Context* ctx,
+              const base::paths& fns,
+              const int jobs,
+              const bool oneFrame,
+              const bool metadataOnly = false,
+              const FileOpLoadROI& loadROI = FileOpLoadROI()) {
+      ASSERT(!fns.empty());
+      Params params;
+      params.set("filename", fns.front().c_str());
+
+      m_cmd.setFilenames(fns);
+      m_cmd.setJobs(jobs);
+      execute(ctx, params, oneFrame, metadataOnly, loadROI);
+      m_cmd.setJobs(1);
+    }
+
+    const base::paths& usedFiles() const {
+      return m_cmd.usedFiles();
+    }
+
+    const std::vector<OpenFileCommand::OpenedFile>& openedFiles() const {
+      return m_cmd.openedFiles();
+    }
+
+  private:
+    void execute(Context* ctx,
+                 Params& params,
+                 const bool oneFrame,
+                 const bool metadataOnly,
+                 const FileOpLoadROI& loadROI) {
+      if (metadataOnly)
+        params.set("metadataonly", "true");
 
       if (oneFrame)
         params.set("oneframe", "true");
@@ -42,6 +81,8 @@ namespace app {
         }
       }
 
+      m_cmd.setLoadROI(loadROI);
+
       if (ctx->isUIAvailable())
         ctx->executeCommandFromMenuOrShortcut(&m_cmd, params);
       else
@@ -53,11 +94,6 @@ namespace app {
         m_lastDecision = d;
     }
 
-    const base::paths& usedFiles() const {
-      return m_cmd.usedFiles();
-    }
-
-  private:
     OpenFileCommand m_cmd;
     gen::SequenceDecision m_lastDecision = gen::SequenceDecision::ASK;
   };
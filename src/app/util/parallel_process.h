@@ -0,0 +1,65 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_PARALLEL_PROCESS_H_INCLUDED
+#define APP_UTIL_PARALLEL_PROCESS_H_INCLUDED
+#pragma once
+
+#include "doc/parallel.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+  // Calls process(item) for each item using the shared pool of
+  // worker threads (doc::parallel_for()), and then calls
+  // commit(item, result) for each item in the same order of the
+  // "items" vector from the calling thread.
+  //
+  // It's used to calculate the new images of each cel/frame of a
+  // sprite in parallel, and then add the undoable commands to the
+  // transaction (which must be done from one thread and in a
+  // deterministic order). "process" must not modify the sprite.
+  //
+  // If batchSize > 0, items are processed in batches of that size
+  // (the results of each batch are committed before processing the
+  // next one) to limit the memory used by the results (e.g. an
+  // image for each frame of a long animation).
+  template<typename Item, typename Process, typename Commit>
+  void parallel_process(const std::vector<Item>& items,
+                        Process&& process,
+                        Commit&& commit,
+                        const int batchSize = 0)
+  {
+    using Result = std::decay_t<std::invoke_result_t<Process&, const Item&>>;
+
+    const int n = int(items.size());
+    const int batch = (batchSize > 0 ? batchSize: std::max(1, n));
+    std::vector<Result> results;
+
+    for (int i=0; i<n; i+=batch) {
+      const int m = std::min(batch, n-i);
+      results.clear();
+      results.resize(m);
+
+      doc::parallel_for(
+        0, m, 1,
+        [&items, &results, &process, i](const int begin, const int end){
+          for (int j=begin; j<end; ++j)
+            results[j] = process(items[i+j]);
+        });
+
+      for (int j=0; j<m; ++j)
+        commit(items[i+j], std::move(results[j]));
+    }
+  }
+
+} // namespace app
+
+#endif
@@ -18,6 +18,8 @@
 
 #include "include/effects/SkRuntimeEffect.h"
 
+#include <cstring>
+
 namespace app {
 
 sk_sp<SkRuntimeEffect> make_shader(const char* code)
@@ -58,6 +60,14 @@ SkImageInfo get_skimageinfo_for_docimage(const doc::Image* img)
                                kUnpremul_SkAlphaType);
 
     }
+
+    case doc::ColorMode::TILEMAP:
+      // Each doc::tile_t is accessed through the four RGBA bytes
+      // (it must be sampled with a raw shader)
+      return SkImageInfo::Make(img->width(),
+                               img->height(),
+                               kRGBA_8888_SkColorType,
+                               kUnpremul_SkAlphaType);
   }
   return SkImageInfo();
 }
@@ -67,10 +77,21 @@ sk_sp<SkImage> make_skimage_for_docimage(const doc::Image* img)
   switch (img->colorMode()) {
     case doc::ColorMode::RGB:
     case doc::ColorMode::GRAYSCALE:
-    case doc::ColorMode::INDEXED: {
-      auto skData = SkData::MakeWithoutCopy(
-        (const void*)img->getPixelAddress(0, 0),
-        img->rowBytes() * img->height());
+    case doc::ColorMode::INDEXED:
+    case doc::ColorMode::TILEMAP: {
+      sk_sp<SkData> skData;
+      if (!img->isTiled()) {
+        skData = SkData::MakeWithoutCopy(
+          (const void*)img->getPixelAddress(0, 0),
+          img->rowBytes() * img->height());
+      }
+      // Rows of a tiled image aren't contiguous, so we copy them
+      else {
+        skData = SkData::MakeUninitialized(img->rowBytes() * img->height());
+        auto dst = (uint8_t*)skData->writable_data();
+        for (int y=0; y<img->height(); ++y, dst+=img->rowBytes())
+          std::memcpy(dst, img->getPixelAddress(0, y), img->rowBytes());
+      }
 
       return SkImage::MakeRasterData(
         get_skimageinfo_for_docimage(img),
@@ -81,14 +102,6 @@ sk_sp<SkImage> make_skimage_for_docimage(const doc::Image* img)
   return nullptr;
 }
 
-std::unique_ptr<SkCanvas> make_skcanvas_for_docimage(const doc::Image* img)
-{
-  return SkCanvas::MakeRasterDirect(
-    get_skimageinfo_for_docimage(img),
-    (void*)img->getPixelAddress(0, 0),
-    img->rowBytes());
-}
-
 } // namespace app
 
 #endif // SK_ENABLE_SKSL
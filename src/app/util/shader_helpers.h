@@ -94,7 +94,6 @@ sk_sp<SkRuntimeEffect> make_shader(const char* code);
 
 SkImageInfo get_skimageinfo_for_docimage(const doc::Image* img);
 sk_sp<SkImage> make_skimage_for_docimage(const doc::Image* img);
-std::unique_ptr<SkCanvas> make_skcanvas_for_docimage(const doc::Image* img);
 
 } // namespace app
 
@@ -0,0 +1,253 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/undo_compression.h"
+
+#include "base/convert_to.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/process.h"
+#include "doc/image.h"
+#include "ver/info.h"
+#include "zlib.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace app {
+
+// Buffers smaller than this are not worth compressing
+static constexpr size_t kMinCompressSize = 1024;
+
+void compress_undo_buffer(base::buffer& buffer,
+                          size_t& uncompressedSize)
+{
+  uncompressedSize = 0;
+  if (buffer.size() < kMinCompressSize)
+    return;
+
+  uLongf compressedSize = compressBound(buffer.size());
+  base::buffer compressed(compressedSize);
+  int err = compress2(&compressed[0], &compressedSize,
+                      &buffer[0], buffer.size(), Z_BEST_SPEED);
+  if (err != Z_OK || compressedSize >= buffer.size())
+    return;
+
+  compressed.resize(compressedSize);
+  compressed.shrink_to_fit();
+
+  uncompressedSize = buffer.size();
+  buffer = std::move(compressed);
+}
+
+void uncompress_undo_buffer(base::buffer& buffer,
+                            size_t& uncompressedSize)
+{
+  if (!uncompressedSize)
+    return;
+
+  base::buffer uncompressed(uncompressedSize);
+  uLongf size = uncompressedSize;
+  int err = uncompress(&uncompressed[0], &size,
+                       &buffer[0], buffer.size());
+  if (err != Z_OK || size != uncompressedSize)
+    throw base::Exception("ZLib error %d uncompressing undo data.", err);
+
+  buffer = std::move(uncompressed);
+  uncompressedSize = 0;
+}
+
+UndoSpillFile::UndoSpillFile()
+{
+}
+
+UndoSpillFile::~UndoSpillFile()
+{
+  if (m_file.is_open()) {
+    m_file.close();
+    try {
+      base::delete_file(m_filename);
+    }
+    catch (...) {
+      // Ignore errors deleting the temporary file
+    }
+  }
+}
+
+uint64_t UndoSpillFile::write(const base::buffer& buffer)
+{
+  if (!m_file.is_open())
+    open();
+
+  // Reuse the first free range where the buffer fits
+  uint64_t offset = m_end;
+  auto it = std::find_if(m_free.begin(), m_free.end(),
+                         [&buffer](const auto& range){
+                           return range.second >= buffer.size();
+                         });
+  if (it != m_free.end()) {
+    offset = it->first;
+    const size_t rest = it->second - buffer.size();
+    m_free.erase(it);
+    if (rest > 0)
+      m_free[offset + buffer.size()] = rest;
+  }
+
+  m_file.seekp(offset);
+  if (m_file.write((const char*)buffer.data(), buffer.size()).fail()) {
+    m_file.clear();
+    if (offset != m_end)
+      release(offset, buffer.size());
+    throw base::Exception("Error writing undo data in %s", m_filename.c_str());
+  }
+  m_end = std::max<uint64_t>(m_end, offset + buffer.size());
+  return offset;
+}
+
+void UndoSpillFile::read(const uint64_t offset, base::buffer& buffer)
+{
+  m_file.seekg(offset);
+  if (m_file.read((char*)buffer.data(), buffer.size()).fail()) {
+    m_file.clear();
+    throw base::Exception("Error reading undo data from %s", m_filename.c_str());
+  }
+}
+
+void UndoSpillFile::release(const uint64_t offset, const size_t size)
+{
+  if (size == 0)
+    return;
+
+  uint64_t start = offset;
+  size_t length = size;
+
+  // Merge with the adjacent free ranges
+  auto next = m_free.find(start + length);
+  if (next != m_free.end()) {
+    length += next->second;
+    m_free.erase(next);
+  }
+  auto prev = m_free.lower_bound(start);
+  if (prev != m_free.begin()) {
+    --prev;
+    if (prev->first + prev->second == start) {
+      start = prev->first;
+      length += prev->second;
+      m_free.erase(prev);
+    }
+  }
+
+  // The end of the file is free (we don't truncate the file, but the
+  // space will be reused from the beginning of the free range)
+  if (start + length == m_end)
+    m_end = start;
+  else
+    m_free[start] = length;
+}
+
+void UndoSpillFile::open()
+{
+  static std::atomic<int> counter(0);
+
+  const std::string dir = base::join_path(base::get_temp_path(), get_app_name());
+  base::make_all_directories(dir);
+
+  m_filename = base::join_path(
+    dir,
+    "undo-" + base::convert_to<std::string>(int(base::get_current_process_id())) +
+    "-" + base::convert_to<std::string>(++counter) + ".tmp");
+
+  m_file.open(FSTREAM_PATH(m_filename),
+              std::fstream::in | std::fstream::out |
+              std::fstream::trunc | std::fstream::binary);
+  if (!m_file.is_open())
+    throw base::Exception("Cannot create the undo file %s", m_filename.c_str());
+}
+
+SpilledUndoBuffer::~SpilledUndoBuffer()
+{
+  if (m_file)
+    m_file->release(m_offset, m_size);
+}
+
+void SpilledUndoBuffer::spill(UndoSpillFile* file, base::buffer& buffer)
+{
+  ASSERT(file);
+  if (m_file || buffer.empty())
+    return;
+
+  m_offset = file->write(buffer);
+  m_size = buffer.size();
+  m_file = file;
+
+  buffer.clear();
+  buffer.shrink_to_fit();
+}
+
+void SpilledUndoBuffer::restore(base::buffer& buffer)
+{
+  if (!m_file)
+    return;
+
+  buffer.resize(m_size);
+  m_file->read(m_offset, buffer);
+  m_file->release(m_offset, m_size);
+  m_file = nullptr;
+}
+
+void CompressedUndoImage::compress(doc::ImageRef& image)
+{
+  ASSERT(image);
+
+  m_pixelFormat = image->pixelFormat();
+  m_width = image->width();
+  m_height = image->height();
+  m_maskColor = image->maskColor();
+
+  const int widthBytes = image->widthBytes();
+  m_buffer.resize(size_t(widthBytes) * m_height);
+  for (int y=0; y<m_height; ++y) {
+    auto p = (const uint8_t*)image->getPixelAddress(0, y);
+    std::copy(p, p+widthBytes, m_buffer.begin() + size_t(y) * widthBytes);
+  }
+
+  compress_undo_buffer(m_buffer, m_size);
+  image.reset();
+}
+
+void CompressedUndoImage::spill(UndoSpillFile* file)
+{
+  m_spilled.spill(file, m_buffer);
+}
+
+doc::ImageRef CompressedUndoImage::uncompress()
+{
+  m_spilled.restore(m_buffer);
+  if (m_buffer.empty())
+    return nullptr;
+
+  uncompress_undo_buffer(m_buffer, m_size);
+
+  doc::ImageRef image(doc::Image::create(m_pixelFormat, m_width, m_height));
+  image->setMaskColor(m_maskColor);
+
+  const int widthBytes = image->widthBytes();
+  for (int y=0; y<m_height; ++y) {
+    auto it = m_buffer.begin() + size_t(y) * widthBytes;
+    std::copy(it, it+widthBytes, (uint8_t*)image->getPixelAddress(0, y));
+  }
+
+  m_buffer.clear();
+  m_buffer.shrink_to_fit();
+  return image;
+}
+
+} // namespace app
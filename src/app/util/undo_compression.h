@@ -0,0 +1,122 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_UNDO_COMPRESSION_H_INCLUDED
+#define APP_UTIL_UNDO_COMPRESSION_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+#include "doc/color.h"
+#include "doc/image_ref.h"
+#include "doc/pixel_format.h"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+
+namespace app {
+
+  // Compresses the buffer in-place (with a fast zlib level) to
+  // reduce the memory used by old undo states. "uncompressedSize" is
+  // set to the original size of the buffer, or to 0 if the buffer
+  // was kept uncompressed (because it's too small or the compressed
+  // version is not smaller).
+  void compress_undo_buffer(base::buffer& buffer,
+                            size_t& uncompressedSize);
+
+  // Restores a buffer compressed with compress_undo_buffer(), it
+  // does nothing if uncompressedSize is 0 (and it's set to 0 after
+  // decompressing the buffer).
+  void uncompress_undo_buffer(base::buffer& buffer,
+                              size_t& uncompressedSize);
+
+  // Temporary file where the undo information of old undo states is
+  // moved when the undo history uses too much memory. The file is
+  // created when the first buffer is written and deleted in the
+  // destructor. The space of released buffers is reused.
+  class UndoSpillFile {
+  public:
+    UndoSpillFile();
+    ~UndoSpillFile();
+
+    // Returns the offset where the buffer was written (throws an
+    // exception if it cannot be written).
+    uint64_t write(const base::buffer& buffer);
+
+    // Reads buffer.size() bytes from the given offset.
+    void read(const uint64_t offset, base::buffer& buffer);
+
+    // Marks the given range as free to be reused by other buffers.
+    void release(const uint64_t offset, const size_t size);
+
+  private:
+    void open();
+
+    std::string m_filename;
+    std::fstream m_file;
+    // Free ranges of the file (offset -> size)
+    std::map<uint64_t, size_t> m_free;
+    uint64_t m_end = 0;
+
+    DISABLE_COPYING(UndoSpillFile);
+  };
+
+  // A buffer moved to an UndoSpillFile. The UndoSpillFile must
+  // outlive this object.
+  class SpilledUndoBuffer {
+  public:
+    SpilledUndoBuffer() { }
+    ~SpilledUndoBuffer();
+
+    bool isSpilled() const { return m_file != nullptr; }
+
+    // Writes the buffer in the file and releases its memory.
+    void spill(UndoSpillFile* file, base::buffer& buffer);
+
+    // Reads the buffer back from the file (does nothing if the
+    // buffer wasn't spilled).
+    void restore(base::buffer& buffer);
+
+  private:
+    UndoSpillFile* m_file = nullptr;
+    uint64_t m_offset = 0;
+    size_t m_size = 0;
+
+    DISABLE_COPYING(SpilledUndoBuffer);
+  };
+
+  // Copy of an image used by undo commands, stored as a compressed
+  // buffer (in memory or in an UndoSpillFile) while it's not needed.
+  class CompressedUndoImage {
+  public:
+    bool empty() const { return m_buffer.empty() && !m_spilled.isSpilled(); }
+    size_t memSize() const { return m_buffer.size(); }
+
+    // Compresses the pixels of the image and releases the reference.
+    void compress(doc::ImageRef& image);
+
+    // Moves the compressed pixels to the given file.
+    void spill(UndoSpillFile* file);
+
+    // Creates the image again from the compressed pixels (and
+    // releases the buffer). Returns nullptr if the buffer is empty.
+    doc::ImageRef uncompress();
+
+  private:
+    doc::PixelFormat m_pixelFormat = doc::IMAGE_RGB;
+    int m_width = 0;
+    int m_height = 0;
+    doc::color_t m_maskColor = 0;
+    size_t m_size = 0;
+    base::buffer m_buffer;
+    SpilledUndoBuffer m_spilled;
+  };
+
+} // namespace app
+
+#endif
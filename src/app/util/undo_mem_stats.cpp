@@ -0,0 +1,170 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/undo_mem_stats.h"
+
+#include "app/cmd.h"
+#include "app/cmd/with_cel.h"
+#include "app/cmd/with_layer.h"
+#include "app/cmd_sequence.h"
+#include "app/cmd_transaction.h"
+#include "app/doc_undo.h"
+#include "doc/cel.h"
+#include "doc/layer.h"
+#include "undo/undo_state.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <typeinfo>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #include <cxxabi.h>
+#endif
+
+namespace app {
+
+namespace {
+
+const char* kNoLayer = "(no layer)";
+
+doc::Layer* get_cmd_layer(Cmd* cmd)
+{
+  if (auto withLayer = dynamic_cast<cmd::WithLayer*>(cmd))
+    return withLayer->layer();
+  if (auto withCel = dynamic_cast<cmd::WithCel*>(cmd)) {
+    if (doc::Cel* cel = withCel->cel())
+      return cel->layer();
+  }
+  return nullptr;
+}
+
+// Returns true if the cmd is only a container of other cmds (i.e. we
+// should inspect its children to know where the memory is used).
+bool is_plain_sequence(const Cmd* cmd)
+{
+  return (typeid(*cmd) == typeid(CmdSequence) ||
+          typeid(*cmd) == typeid(CmdTransaction));
+}
+
+void add_to_group(std::map<std::string, UndoMemStats::Group>& groups,
+                  const std::string& name,
+                  const size_t size)
+{
+  auto& group = groups[name];
+  group.name = name;
+  group.size += size;
+  ++group.count;
+}
+
+std::vector<UndoMemStats::Group> sort_groups(
+  const std::map<std::string, UndoMemStats::Group>& groups)
+{
+  std::vector<UndoMemStats::Group> result;
+  result.reserve(groups.size());
+  for (const auto& kv : groups)
+    result.push_back(kv.second);
+  std::stable_sort(result.begin(), result.end(),
+                   [](const UndoMemStats::Group& a,
+                      const UndoMemStats::Group& b){
+                     return a.size > b.size;
+                   });
+  return result;
+}
+
+} // anonymous namespace
+
+std::string get_cmd_type_name(const Cmd* cmd)
+{
+  std::string name = typeid(*cmd).name();
+
+#if defined(__GNUC__) || defined(__clang__)
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+  if (demangled) {
+    if (status == 0)
+      name = demangled;
+    std::free(demangled);
+  }
+#endif
+
+  // Remove the "class " prefix (MSVC) and the app namespaces
+  for (const char* prefix : { "class ", "struct ", "app::cmd::", "app::" }) {
+    const std::string p(prefix);
+    if (name.compare(0, p.size(), p) == 0)
+      name.erase(0, p.size());
+  }
+  return name;
+}
+
+UndoMemStats calculate_undo_mem_stats(const DocUndo* undo,
+                                      const size_t largeCmdSize)
+{
+  UndoMemStats stats;
+  stats.totalSize = undo->totalUndoSize();
+
+  std::map<std::string, UndoMemStats::Group> byType;
+  std::map<std::string, UndoMemStats::Group> byLayer;
+
+  int age = 0;
+  for (const undo::UndoState* state = undo->lastState();
+       state; state = state->prev(), ++age) {
+    auto transaction = static_cast<CmdTransaction*>(state->cmd());
+
+    UndoMemStats::State s;
+    s.label = transaction->label();
+    s.size = transaction->memSize();
+    s.age = age;
+    s.compressed = transaction->isCompressed();
+    s.spilled = transaction->isSpilled();
+    stats.states.push_back(s);
+
+    // Add the memory of each leaf cmd (the memory used by the
+    // sequences themselves is added to their own type)
+    std::vector<Cmd*> cmds = { transaction };
+    while (!cmds.empty()) {
+      Cmd* cmd = cmds.back();
+      cmds.pop_back();
+
+      size_t size = cmd->memSize();
+      if (is_plain_sequence(cmd)) {
+        for (Cmd* child : static_cast<CmdSequence*>(cmd)->cmds()) {
+          size -= std::min(size, child->memSize());
+          cmds.push_back(child);
+        }
+        add_to_group(byType, get_cmd_type_name(cmd), size);
+        continue;
+      }
+
+      const std::string type = get_cmd_type_name(cmd);
+      const doc::Layer* layer = get_cmd_layer(cmd);
+      const std::string layerName = (layer ? layer->name(): kNoLayer);
+
+      add_to_group(byType, type, size);
+      add_to_group(byLayer, layerName, size);
+
+      if (size >= largeCmdSize) {
+        UndoMemStats::LargeCmd large;
+        large.type = type;
+        large.label = s.label;
+        large.layer = layerName;
+        large.size = size;
+        large.age = age;
+        stats.largeCmds.push_back(large);
+      }
+    }
+  }
+
+  stats.byType = sort_groups(byType);
+  stats.byLayer = sort_groups(byLayer);
+  return stats;
+}
+
+} // namespace app
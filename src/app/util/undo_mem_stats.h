@@ -0,0 +1,63 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_UNDO_MEM_STATS_H_INCLUDED
+#define APP_UTIL_UNDO_MEM_STATS_H_INCLUDED
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace app {
+  class Cmd;
+  class DocUndo;
+
+  // Commands using this amount of memory (or more) are reported in
+  // UndoMemStats::largeCmds.
+  const size_t kLargeUndoCmdSize = 8*1024*1024;
+
+  // Memory used by the undo history of a document, grouped by type
+  // of command, by layer, and by undo state.
+  struct UndoMemStats {
+    struct Group {
+      std::string name;
+      size_t size = 0;
+      int count = 0;
+    };
+
+    struct State {
+      std::string label;
+      size_t size = 0;
+      int age = 0;              // 0 is the most recent undo state
+      bool compressed = false;
+      bool spilled = false;
+    };
+
+    struct LargeCmd {
+      std::string type;
+      std::string label;        // Label of the undo state
+      std::string layer;
+      size_t size = 0;
+      int age = 0;
+    };
+
+    size_t totalSize = 0;
+    std::vector<Group> byType;  // Sorted by size (bigger first)
+    std::vector<Group> byLayer; // Sorted by size (bigger first)
+    std::vector<State> states;  // From the most recent to the oldest one
+    std::vector<LargeCmd> largeCmds;
+  };
+
+  // Returns the class name of the command without namespaces
+  // (e.g. "CopyRegion").
+  std::string get_cmd_type_name(const Cmd* cmd);
+
+  UndoMemStats calculate_undo_mem_stats(const DocUndo* undo,
+                                        const size_t largeCmdSize = kLargeUndoCmdSize);
+
+} // namespace app
+
+#endif
@@ -32,6 +32,7 @@
 #include "base/exception.h"
 #include "base/fs.h"
 #include "base/memory.h"
+#include "base/time.h"
 #include "os/system.h"
 #include "ui/ui.h"
 
@@ -41,7 +42,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 
 namespace app {
 
@@ -52,6 +55,53 @@ using namespace ui;
 static int convert_align_value_to_flags(const char *value);
 static int int_attr(const XMLElement* elem, const char* attribute_name, int default_value);
 
+namespace {
+
+// Parsed .xml files, so dialogs that are opened several times (or
+// several widgets from the same file) don't parse the file each
+// time. The cache is invalidated if the file is modified.
+struct CachedXml {
+  base::Time time;
+  std::size_t size = 0;
+  std::shared_ptr<XMLDocument> doc;
+};
+
+std::mutex g_xmlCacheMutex;
+std::map<std::string, CachedXml> g_xmlCache;
+
+bool same_time(const base::Time& a, const base::Time& b)
+{
+  return (a.year == b.year && a.month == b.month && a.day == b.day &&
+          a.hour == b.hour && a.minute == b.minute && a.second == b.second);
+}
+
+std::shared_ptr<XMLDocument> open_cached_xml(const std::string& filename)
+{
+  const base::Time time = base::get_modification_time(filename);
+  const std::size_t size = base::file_size(filename);
+
+  {
+    const std::lock_guard lock(g_xmlCacheMutex);
+    auto it = g_xmlCache.find(filename);
+    if (it != g_xmlCache.end() &&
+        it->second.size == size &&
+        same_time(it->second.time, time)) {
+      return it->second.doc;
+    }
+  }
+
+  std::shared_ptr<XMLDocument> doc = open_xml(filename);
+
+  const std::lock_guard lock(g_xmlCacheMutex);
+  CachedXml& cached = g_xmlCache[filename];
+  cached.time = time;
+  cached.size = size;
+  cached.doc = doc;
+  return doc;
+}
+
+} // anonymous namespace
+
 WidgetLoader::WidgetLoader()
   : m_tooltipManager(NULL)
 {
@@ -98,7 +148,7 @@ Widget* WidgetLoader::loadWidgetFromXmlFile(
   m_tooltipManager = NULL;
   m_xmlTranslator.setStringIdPrefix(widgetId.c_str());
 
-  XMLDocumentRef doc = open_xml(xmlFilename);
+  std::shared_ptr<XMLDocument> doc = open_cached_xml(xmlFilename);
   XMLHandle handle(doc.get());
 
   // Search the requested widget.
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,12 +21,14 @@
 #include "dio/file_interface.h"
 #include "dio/pixel_io.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "gfx/color_space.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <vector>
 
@@ -98,6 +100,15 @@ bool AsepriteDecoder::decode()
   if (nframes > 1 && delegate()->decodeOneFrame())
     nframes = 1;
 
+  // Skip cel chunks?
+  const bool metadataOnly = delegate()->decodeMetadataOnly();
+
+  // Decompress cels in parallel?
+  m_queuedImages.clear();
+  m_queuedBytes = 0;
+  m_maxQueuedBytes = delegate()->parallelDecodingMemoryLimit();
+  m_skippedCels.clear();
+
   // Read frame by frame to end-of-file
   for (doc::frame_t frame=0; frame<nframes; ++frame) {
     // Start frame position
@@ -170,6 +181,13 @@ bool AsepriteDecoder::decode()
           }
 
           case ASE_FILE_CHUNK_CEL: {
+            // The cel (and its extra/user data chunks) is skipped
+            if (metadataOnly) {
+              last_cel = nullptr;
+              last_object_with_user_data = nullptr;
+              break;
+            }
+
             doc::Cel* cel =
               readCelChunk(sprite.get(), frame,
                            sprite->pixelFormat(), &header,
@@ -179,6 +197,9 @@ bool AsepriteDecoder::decode()
               last_object_with_user_data = cel->data();
             }
             else {
+              // Don't assign the extra/user data of a skipped cel to
+              // the previous cel
+              last_cel = nullptr;
               last_object_with_user_data = nullptr;
             }
             break;
@@ -310,6 +331,9 @@ bool AsepriteDecoder::decode()
       break;
   }
 
+  // Decompress the last read cels
+  decompressQueuedImages();
+
   delegate()->onSprite(sprite.release());
   return true;
 }
@@ -398,11 +422,9 @@ std::string AsepriteDecoder::readString()
   if (length == EOF)
     return "";
 
-  std::string string;
-  string.reserve(length+1);
-
-  for (int c=0; c<length; c++)
-    string.push_back(read8());
+  std::string string(length, 0);
+  if (length > 0)
+    readBytes((uint8_t*)&string[0], length);
 
   return string;
 }
@@ -700,12 +722,12 @@ void read_raw_image(FileInterface* f,
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// Decompresses the zlib "data" in the given image. If the data is
+// incomplete only the first image rows are filled.
 template<typename ImageTraits>
-void read_compressed_image_templ(FileInterface* f,
-                                 DecodeDelegate* delegate,
-                                 doc::Image* image,
-                                 const AsepriteHeader* header,
-                                 const size_t chunk_end)
+void inflate_image_templ(const uint8_t* data,
+                         const size_t size,
+                         doc::Image* image)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -720,80 +742,28 @@ void read_compressed_image_templ(FileInterface* f,
   const int width = image->width();
   const int widthBytes = image->widthBytes();
   std::vector<uint8_t> scanline(widthBytes);
-  std::vector<uint8_t> compressed(4096);
-  std::vector<uint8_t> uncompressed(4096);
-  int scanline_offset = 0;
-  int y = 0;
 
-  while (true) {
-    size_t input_bytes;
+  zstream.next_in = (Bytef*)data;
+  zstream.avail_in = size;
 
-    if (f->tell()+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - f->tell(); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
+  for (int y=0; y<image->height(); ++y) {
+    // Decompress a whole scanline
+    zstream.next_out = (Bytef*)&scanline[0];
+    zstream.avail_out = widthBytes;
 
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else {
-      input_bytes = compressed.size();
+    err = inflate(&zstream, Z_NO_FLUSH);
+    if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+      inflateEnd(&zstream);
+      throw base::Exception("ZLib error %d in inflate().", err);
     }
 
-    size_t bytes_read = f->readBytes(&compressed[0], input_bytes);
-
-    // Error reading "input_bytes" bytes, broken file? chunk without
-    // enough compressed data?
-    if (bytes_read == 0) {
-      delegate->error(
-        fmt::format("Error reading {} bytes of compressed data",
-                    input_bytes));
+    // Not enough compressed data
+    if (zstream.avail_out != 0)
       break;
-    }
 
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
-
-    do {
-      zstream.next_out = (Bytef*)&uncompressed[0];
-      zstream.avail_out = uncompressed.size();
-
-      err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in inflate().", err);
-
-      size_t uncompressed_bytes = uncompressed.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        int i = 0;
-        while (y < image->height()) {
-          int n = std::min(uncompressed_bytes, scanline.size() - scanline_offset);
-          if (n > 0) {
-            // Fill the scanline buffer until it's completed
-            std::copy(uncompressed.begin()+i,
-                      uncompressed.begin()+i+n,
-                      scanline.begin()+scanline_offset);
-            uncompressed_bytes -= n;
-            scanline_offset += n;
-            i += n;
-          }
-          else if (scanline_offset < widthBytes) {
-            // The scanline is not filled yet.
-            break;
-          }
-          else {
-            // Copy the whole scanline to the image
-            pixel_io.read_scanline(
-              (typename ImageTraits::address_t)image->getPixelAddress(0, y),
-              width, &scanline[0]);
-            ++y;
-            scanline_offset = 0;
-            if (uncompressed_bytes == 0)
-              break;
-          }
-        }
-      }
-    } while (zstream.avail_in != 0 && zstream.avail_out == 0);
-
-    delegate->progress((float)f->tell() / (float)header->size);
+    pixel_io.read_scanline(
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+      width, &scanline[0]);
   }
 
   err = inflateEnd(&zstream);
@@ -801,42 +771,85 @@ void read_compressed_image_templ(FileInterface* f,
     throw base::Exception("ZLib error %d in inflateEnd().", err);
 }
 
+void inflate_image(const uint8_t* data,
+                   const size_t size,
+                   doc::Image* image)
+{
+  switch (image->pixelFormat()) {
+
+    case doc::IMAGE_RGB:
+      inflate_image_templ<doc::RgbTraits>(data, size, image);
+      break;
+
+    case doc::IMAGE_GRAYSCALE:
+      inflate_image_templ<doc::GrayscaleTraits>(data, size, image);
+      break;
+
+    case doc::IMAGE_INDEXED:
+      inflate_image_templ<doc::IndexedTraits>(data, size, image);
+      break;
+
+    case doc::IMAGE_TILEMAP:
+      inflate_image_templ<doc::TilemapTraits>(data, size, image);
+      break;
+  }
+}
+
+// Returns the compressed data from the current position to the
+// "chunk_end". If the file is in memory the returned pointer
+// references the file data directly, in other case the data is read
+// in the given "buffer".
+const uint8_t* read_compressed_data(FileInterface* f,
+                                    DecodeDelegate* delegate,
+                                    const size_t chunk_end,
+                                    base::buffer& buffer,
+                                    size_t& size)
+{
+  const size_t pos = f->tell();
+  const size_t input_bytes = (chunk_end > pos ? chunk_end - pos: 0);
+  size = input_bytes;
+  if (input_bytes == 0)
+    return nullptr;
+
+  if (const uint8_t* span = f->readSpan(input_bytes))
+    return span;
+
+  buffer.resize(input_bytes);
+  const size_t bytes_read = f->readBytes(&buffer[0], input_bytes);
+
+  // Error reading "input_bytes" bytes, broken file? chunk without
+  // enough compressed data?
+  if (bytes_read < input_bytes) {
+    delegate->error(
+      fmt::format("Error reading {} bytes of compressed data",
+                  input_bytes));
+    buffer.resize(bytes_read);
+    size = bytes_read;
+  }
+  return buffer.data();
+}
+
 void read_compressed_image(FileInterface* f,
                            DecodeDelegate* delegate,
                            doc::Image* image,
                            const AsepriteHeader* header,
                            const size_t chunk_end)
 {
+  base::buffer buffer;
+  size_t size;
+  const uint8_t* data = read_compressed_data(f, delegate, chunk_end, buffer, size);
+
   // Try to read pixel data
   try {
-    switch (image->pixelFormat()) {
-
-      case doc::IMAGE_RGB:
-        read_compressed_image_templ<doc::RgbTraits>(
-          f, delegate, image, header, chunk_end);
-        break;
-
-      case doc::IMAGE_GRAYSCALE:
-        read_compressed_image_templ<doc::GrayscaleTraits>(
-          f, delegate, image, header, chunk_end);
-        break;
-
-      case doc::IMAGE_INDEXED:
-        read_compressed_image_templ<doc::IndexedTraits>(
-          f, delegate, image, header, chunk_end);
-        break;
-
-      case doc::IMAGE_TILEMAP:
-        read_compressed_image_templ<doc::TilemapTraits>(
-          f, delegate, image, header, chunk_end);
-        break;
-    }
+    inflate_image(data, size, image);
   }
   // OK, in case of error we can show the problem, but continue
   // loading more cels.
   catch (const std::exception& e) {
     delegate->error(e.what());
   }
+
+  delegate->progress((float)f->tell() / (float)header->size);
 }
 
 } // anonymous namespace
@@ -849,8 +862,11 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
                                         doc::frame_t frame,
                                         doc::PixelFormat pixelFormat,
                                         const AsepriteHeader* header,
-                                        const size_t chunk_end)
+                                        const size_t chunk_end,
+                                        const bool skippable)
 {
+  const size_t cel_pos = f()->tell();
+
   // Read chunk data
   doc::layer_t layer_index = read16();
   int x = ((int16_t)read16());
@@ -877,6 +893,17 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
     return nullptr;
   }
 
+  // Returns true if the delegate doesn't want this cel (we remember
+  // its position in case that it's needed by a linked cel)
+  auto skipCel = [&](const gfx::Rect& celBounds) -> bool {
+    if (!skippable || delegate()->decodeCel(layer, frame, celBounds))
+      return false;
+
+    m_skippedCels[std::make_pair(layer_index, frame)] =
+      std::make_pair(cel_pos, chunk_end);
+    return true;
+  };
+
   // Create the new frame.
   std::unique_ptr<doc::Cel> cel;
 
@@ -887,6 +914,9 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int w = read16();
       int h = read16();
 
+      if (skipCel(gfx::Rect(x, y, w, h)))
+        return nullptr;
+
       if (w > 0 && h > 0) {
         // Read pixel data
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
@@ -905,6 +935,29 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       doc::frame_t link_frame = doc::frame_t(read16());
       doc::Cel* link = layer->cel(link_frame);
 
+      gfx::Rect linkBounds;
+      if (link) {
+        linkBounds = link->bounds();
+        linkBounds.setOrigin(gfx::Point(x, y));
+      }
+      if (skipCel(linkBounds))
+        return nullptr;
+
+      // The linked cel was skipped, so we have to read it now
+      if (!link) {
+        auto it = m_skippedCels.find(std::make_pair(layer_index, link_frame));
+        if (it != m_skippedCels.end()) {
+          const size_t pos = f()->tell();
+          const auto [linkPos, linkEnd] = it->second;
+          m_skippedCels.erase(it);
+
+          f()->seek(linkPos);
+          link = readCelChunk(sprite, link_frame, pixelFormat, header,
+                              linkEnd, false);
+          f()->seek(pos);
+        }
+      }
+
       if (link) {
         // There were a beta version that allow to the user specify
         // different X, Y, or opacity per link, in that case we must
@@ -913,6 +966,9 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
           cel.reset(doc::Cel::MakeLink(frame, link));
         }
         else {
+          // The pixels of the linked cel are needed to copy them
+          decompressQueuedImages();
+
           cel.reset(doc::Cel::MakeCopy(frame, link));
           cel->setPosition(x, y);
           cel->setOpacity(opacity);
@@ -931,9 +987,12 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int w = read16();
       int h = read16();
 
+      if (skipCel(gfx::Rect(x, y, w, h)))
+        return nullptr;
+
       if (w > 0 && h > 0) {
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        readCompressedCelImage(image, header, chunk_end);
 
         cel = std::make_unique<doc::Cel>(frame, image);
         cel->setPosition(x, y);
@@ -964,11 +1023,16 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
         break;
       }
 
+      const doc::Tileset* tileset = static_cast<doc::LayerTilemap*>(layer)->tileset();
+      if (skipCel(tileset ? gfx::Rect(gfx::Point(x, y),
+                                      tileset->grid().tileSize() * gfx::Size(w, h)):
+                            gfx::Rect()))
+        return nullptr;
+
       if (w > 0 && h > 0) {
         doc::ImageRef image(doc::Image::create(doc::IMAGE_TILEMAP, w, h));
         image->setMaskColor(doc::notile);
         image->clear(doc::notile);
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
 
         // Check if the tileset of this tilemap has the
         // "ASE_TILESET_FLAG_ZERO_IS_NOTILE" we have to adjust all
@@ -977,42 +1041,50 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
         doc::Tileset* ts = static_cast<doc::LayerTilemap*>(layer)->tileset();
         doc::tileset_index tsi = static_cast<doc::LayerTilemap*>(layer)->tilesetIndex();
         ASSERT(tsi >= 0 && tsi < m_tilesetFlags.size());
-        if (tsi >= 0 && tsi < m_tilesetFlags.size() &&
-            (m_tilesetFlags[tsi] & ASE_TILESET_FLAG_ZERO_IS_NOTILE) == 0) {
-          doc::fix_old_tilemap(image.get(), ts, tileIDMask, flagsMask);
-        }
-
-        // Convert the tile index and masks to a proper in-memory
-        // representation for the doc-lib.
-        doc::transform_image<doc::TilemapTraits>(
-          image.get(),
-          [ts, tileIDMask, tileIDShift,
-           xflipMask, yflipMask, dflipMask]
-          (doc::tile_t tile) {
-            // Get the tile index.
-            doc::tile_index ti = ((tile & tileIDMask) >> tileIDShift);
-
-            // If the index is out of bounds from the tileset, we
-            // allow to keep some small values in-memory, but if the
-            // index is too big, we consider it as a broken file and
-            // remove the tile (as an huge index bring some lag
-            // problems in the remove_unused_tiles_from_tileset()
-            // creating a big Remap structure).
-            //
-            // Related to https://github.com/aseprite/aseprite/issues/2877
-            if (ti > ts->size() &&
-                ti > 0xffffff) {
-              return doc::notile;
-            }
-
-            // Convert read index to doc::tile_i_mask, and flags to doc::tile_f_mask
-            tile = doc::tile(
-              ti,
-              ((tile & xflipMask) == xflipMask ? doc::tile_f_xflip: 0) |
-              ((tile & yflipMask) == yflipMask ? doc::tile_f_yflip: 0) |
-              ((tile & dflipMask) == dflipMask ? doc::tile_f_dflip: 0));
-
-            return tile;
+        const bool fixOldTilemap =
+          (tsi >= 0 && tsi < m_tilesetFlags.size() &&
+           (m_tilesetFlags[tsi] & ASE_TILESET_FLAG_ZERO_IS_NOTILE) == 0);
+
+        // The tileset is not modified after this point, so the
+        // decompressed tilemap can be converted from other thread.
+        readCompressedCelImage(
+          image, header, chunk_end,
+          [=](doc::Image* tilemap) {
+            if (fixOldTilemap)
+              doc::fix_old_tilemap(tilemap, ts, tileIDMask, flagsMask);
+
+            // Convert the tile index and masks to a proper in-memory
+            // representation for the doc-lib.
+            doc::transform_image<doc::TilemapTraits>(
+              tilemap,
+              [ts, tileIDMask, tileIDShift,
+               xflipMask, yflipMask, dflipMask]
+              (doc::tile_t tile) {
+                // Get the tile index.
+                doc::tile_index ti = ((tile & tileIDMask) >> tileIDShift);
+
+                // If the index is out of bounds from the tileset, we
+                // allow to keep some small values in-memory, but if the
+                // index is too big, we consider it as a broken file and
+                // remove the tile (as an huge index bring some lag
+                // problems in the remove_unused_tiles_from_tileset()
+                // creating a big Remap structure).
+                //
+                // Related to https://github.com/aseprite/aseprite/issues/2877
+                if (ti > ts->size() &&
+                    ti > 0xffffff) {
+                  return doc::notile;
+                }
+
+                // Convert read index to doc::tile_i_mask, and flags to doc::tile_f_mask
+                tile = doc::tile(
+                  ti,
+                  ((tile & xflipMask) == xflipMask ? doc::tile_f_xflip: 0) |
+                  ((tile & yflipMask) == yflipMask ? doc::tile_f_yflip: 0) |
+                  ((tile & dflipMask) == dflipMask ? doc::tile_f_dflip: 0));
+
+                return tile;
+              });
           });
 
         cel = std::make_unique<doc::Cel>(frame, image);
@@ -1037,6 +1109,69 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
   return cel.release();
 }
 
+void AsepriteDecoder::readCompressedCelImage(const doc::ImageRef& image,
+                                             const AsepriteHeader* header,
+                                             const size_t chunk_end,
+                                             std::function<void(doc::Image*)>&& postProcess)
+{
+  // Decompress the image now
+  if (m_maxQueuedBytes == 0) {
+    read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+    if (postProcess)
+      postProcess(image.get());
+    return;
+  }
+
+  // Read the compressed data to decompress it later with other cels
+  auto item = std::make_unique<QueuedImage>();
+  item->image = image;
+  item->postProcess = std::move(postProcess);
+  item->data = read_compressed_data(f(), delegate(), chunk_end,
+                                    item->buffer, item->size);
+
+  m_queuedBytes += item->size;
+  m_queuedImages.push_back(std::move(item));
+
+  if (m_queuedBytes >= m_maxQueuedBytes)
+    decompressQueuedImages();
+
+  delegate()->progress((float)f()->tell() / (float)header->size);
+}
+
+void AsepriteDecoder::decompressQueuedImages()
+{
+  if (m_queuedImages.empty())
+    return;
+
+  doc::parallel_for(
+    0, int(m_queuedImages.size()), 1,
+    [this](const int begin, const int end) {
+      for (int i=begin; i<end; ++i) {
+        QueuedImage* item = m_queuedImages[i].get();
+        try {
+          inflate_image(item->data, item->size, item->image.get());
+        }
+        catch (const std::exception& e) {
+          item->error = e.what();
+        }
+        if (item->postProcess)
+          item->postProcess(item->image.get());
+
+        // Release the compressed data as soon as possible
+        base::buffer().swap(item->buffer);
+      }
+    });
+
+  // Report errors from this thread (in the same order of the cels)
+  for (const auto& item : m_queuedImages) {
+    if (!item->error.empty())
+      delegate()->error(item->error);
+  }
+
+  m_queuedImages.clear();
+  m_queuedBytes = 0;
+}
+
 void AsepriteDecoder::readCelExtraChunk(doc::Cel* cel)
 {
   // Read chunk data
@@ -1370,8 +1505,7 @@ void AsepriteDecoder::readPropertiesMaps(doc::UserData::PropertiesMaps& properti
         delegate()->error(
           fmt::format("Error: Invalid extension ID (id={0} not found)", id));
       }
-      auto properties = readPropertyValue(USER_DATA_PROPERTY_TYPE_PROPERTIES);
-      propertiesMaps[extensionId] = doc::get_value<doc::UserData::Properties>(properties);
+      readProperties(propertiesMaps[extensionId]);
     }
   }
   catch (const base::Exception& e) {
@@ -1382,113 +1516,119 @@ void AsepriteDecoder::readPropertiesMaps(doc::UserData::PropertiesMaps& properti
   f()->seek(startPos+size);
 }
 
-const doc::UserData::Variant AsepriteDecoder::readPropertyValue(uint16_t type)
+// Reads each property value in-place in its final map entry (without
+// temporary copies of the values), as tilesets can contain thousands
+// of tiles with their own properties.
+void AsepriteDecoder::readProperties(doc::UserData::Properties& properties)
+{
+  auto numProps = read32();
+  for (int j=0; j<numProps; ++j) {
+    auto name = readString();
+    auto type = read16();
+    readPropertyValue(type, properties[name]);
+  }
+}
+
+void AsepriteDecoder::readPropertyValue(uint16_t type,
+                                        doc::UserData::Variant& value)
 {
   switch (type) {
     case USER_DATA_PROPERTY_TYPE_NULLPTR: {
       // This shouldn't exist in a .aseprite file
       ASSERT(false);
-      return nullptr;
-    }
-    case USER_DATA_PROPERTY_TYPE_BOOL: {
-      bool value = read8();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT8: {
-      int8_t value = read8();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT8: {
-      uint8_t value = read8();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT16: {
-      int16_t value = read16();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT16: {
-      uint16_t value = read16();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT32: {
-      int32_t value = read32();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT32: {
-      uint32_t value = read32();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT64: {
-      int64_t value = read64();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT64: {
-      uint64_t value = read64();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_FIXED: {
-      int32_t value = read32();
-      return doc::UserData::Fixed{value};
-    }
-    case USER_DATA_PROPERTY_TYPE_FLOAT: {
-      float value = readFloat();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_DOUBLE: {
-      double value = readDouble();
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_STRING: {
-      std::string value = readString();
-      return value;
+      value = nullptr;
+      break;
     }
+    case USER_DATA_PROPERTY_TYPE_BOOL:
+      value = bool(read8());
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT8:
+      value = int8_t(read8());
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT8:
+      value = uint8_t(read8());
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT16:
+      value = int16_t(read16());
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT16:
+      value = uint16_t(read16());
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT32:
+      value = int32_t(read32());
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT32:
+      value = uint32_t(read32());
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT64:
+      value = int64_t(read64());
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT64:
+      value = uint64_t(read64());
+      break;
+    case USER_DATA_PROPERTY_TYPE_FIXED:
+      value = doc::UserData::Fixed{ int32_t(read32()) };
+      break;
+    case USER_DATA_PROPERTY_TYPE_FLOAT:
+      value = readFloat();
+      break;
+    case USER_DATA_PROPERTY_TYPE_DOUBLE:
+      value = readDouble();
+      break;
+    case USER_DATA_PROPERTY_TYPE_STRING:
+      value = readString();
+      break;
     case USER_DATA_PROPERTY_TYPE_POINT: {
       int32_t x = read32();
       int32_t y = read32();
-      return gfx::Point(x, y);
+      value = gfx::Point(x, y);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_SIZE: {
       int32_t w = read32();
       int32_t h = read32();
-      return gfx::Size(w, h);
+      value = gfx::Size(w, h);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_RECT: {
       int32_t x = read32();
       int32_t y = read32();
       int32_t w = read32();
       int32_t h = read32();
-      return gfx::Rect(x, y, w, h);
+      value = gfx::Rect(x, y, w, h);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_VECTOR: {
       auto numElems = read32();
       auto elemsType = read16();
       auto elemType = elemsType;
-      std::vector<doc::UserData::Variant> value;
+
+      value = doc::UserData::Vector();
+      auto& vector = doc::get_value<doc::UserData::Vector>(value);
+      // Limit the pre-allocated elements in case that the file is
+      // corrupted
+      vector.reserve(std::min<uint32_t>(numElems, 0x10000));
+
       for (int k=0; k<numElems;++k) {
         if (elemsType == 0) {
           elemType = read16();
         }
-        value.push_back(readPropertyValue(elemType));
+        readPropertyValue(elemType, vector.emplace_back());
       }
-      return value;
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_PROPERTIES: {
-      auto numProps = read32();
-      doc::UserData::Properties value;
-      for (int j=0; j<numProps;++j) {
-        auto name = readString();
-        auto type = read16();
-        value[name] = readPropertyValue(type);
-      }
-      return value;
+      value = doc::UserData::Properties();
+      readProperties(doc::get_value<doc::UserData::Properties>(value));
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_UUID: {
-      base::Uuid value;
-      uint8_t* bytes = value.bytes();
+      value = base::Uuid();
+      uint8_t* bytes = doc::get_value<base::Uuid>(value).bytes();
       for (int i=0; i<16; ++i) {
         bytes[i] = read8();
       }
-      return value;
+      break;
     }
     default: {
       throw base::Exception(
@@ -1496,8 +1636,6 @@ const doc::UserData::Variant AsepriteDecoder::readPropertyValue(uint16_t type)
                     type, f()->tell()));
     }
   }
-
-  return doc::UserData::Variant{};
 }
 
 void AsepriteDecoder::readTilesData(doc::Tileset* tileset, const AsepriteExternalFiles& extFiles)
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,8 +9,10 @@
 #define DIO_ASEPRITE_DECODER_H_INCLUDED
 #pragma once
 
+#include "base/buffer.h"
 #include "dio/decoder.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/layer_list.h"
 #include "doc/pixel_format.h"
 #include "doc/slices.h"
@@ -18,6 +20,10 @@
 #include "doc/tileset.h"
 #include "doc/user_data.h"
 
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -56,7 +62,13 @@ private:
                          doc::frame_t frame,
                          doc::PixelFormat pixelFormat,
                          const AsepriteHeader* header,
-                         const size_t chunk_end);
+                         const size_t chunk_end,
+                         const bool skippable = true);
+  void readCompressedCelImage(const doc::ImageRef& image,
+                              const AsepriteHeader* header,
+                              const size_t chunk_end,
+                              std::function<void(doc::Image*)>&& postProcess = nullptr);
+  void decompressQueuedImages();
   void readCelExtraChunk(doc::Cel* cel);
   void readColorProfile(doc::Sprite* sprite);
   void readExternalFiles(AsepriteExternalFiles& extFiles);
@@ -71,11 +83,36 @@ private:
                                  const AsepriteExternalFiles& extFiles);
   void readPropertiesMaps(doc::UserData::PropertiesMaps& propertiesMaps,
                           const AsepriteExternalFiles& extFiles);
-  const doc::UserData::Variant readPropertyValue(uint16_t type);
+  void readProperties(doc::UserData::Properties& properties);
+  void readPropertyValue(uint16_t type, doc::UserData::Variant& value);
   void readTilesData(doc::Tileset* tileset, const AsepriteExternalFiles& extFiles);
 
+  // Compressed cel image read in memory to be decompressed with
+  // other cels in worker threads.
+  struct QueuedImage {
+    doc::ImageRef image;
+    // Compressed data (it points to "buffer" or to the file data if
+    // the file is in memory)
+    const uint8_t* data = nullptr;
+    std::size_t size = 0;
+    base::buffer buffer;
+    // Function called after decompressing the image (from a worker
+    // thread)
+    std::function<void(doc::Image*)> postProcess;
+    std::string error;
+  };
+
   doc::LayerList m_allLayers;
   std::vector<uint32_t> m_tilesetFlags;
+  // Position and end of the cel chunks that were skipped by the
+  // delegate for each layer index/frame
+  std::map<std::pair<doc::layer_t, doc::frame_t>,
+           std::pair<std::size_t, std::size_t>> m_skippedCels;
+  std::vector<std::unique_ptr<QueuedImage>> m_queuedImages;
+  std::size_t m_queuedBytes = 0;
+  // Maximum size of the compressed data in "m_queuedImages" (0 to
+  // decompress each cel when it's read)
+  std::size_t m_maxQueuedBytes = 0;
 };
 
 } // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,7 +12,9 @@
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/sprite.h"
+#include "gfx/rect.h"
 
+#include <cstddef>
 #include <string>
 
 namespace dio {
@@ -38,6 +40,19 @@ public:
   // to generate a thumbnail)
   virtual bool decodeOneFrame() { return false; }
 
+  // Return true if you want to read just the sprite structure
+  // (layers, tags, slices, palettes, etc.) without decompressing the
+  // cels pixels (e.g. useful to list the tags of a file)
+  virtual bool decodeMetadataOnly() { return false; }
+
+  // Return false to skip the cel of the given layer/frame (e.g. to
+  // load just the frames/layers/area of interest). It's called after
+  // all layers were read, "celBounds" are in canvas coordinates (or
+  // empty if they are unknown, e.g. for a linked cel).
+  virtual bool decodeCel(const doc::Layer* layer,
+                         const doc::frame_t frame,
+                         const gfx::Rect& celBounds) { return true; }
+
   // Default color for slices without user data
   virtual doc::color_t defaultSliceColor() {
     return doc::rgba(0, 0, 255, 255);
@@ -56,6 +71,14 @@ public:
   virtual bool cacheCompressedTilesets() const {
     return false;
   }
+
+  // Returns the maximum size of compressed cel data that can be read
+  // in memory to be decompressed in parallel with worker threads (or
+  // 0 to decompress each cel when it's read). Functions of this
+  // delegate are called from the decoding thread only.
+  virtual std::size_t parallelDecodingMemoryLimit() const {
+    return 0;
+  }
 };
 
 } // namespace dio
@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -31,6 +32,12 @@ public:
   virtual uint8_t read8() = 0;
   virtual size_t readBytes(uint8_t* buf, size_t n) = 0;
 
+  // Returns a pointer to the next "n" bytes of the file and skips
+  // them (like readBytes() but without copying them), or nullptr if
+  // the file isn't in memory or there are less than "n" bytes. The
+  // returned bytes are valid while this FileInterface exists.
+  virtual const uint8_t* readSpan(size_t n) { return nullptr; }
+
   // Writes one byte in the file (or do nothing if ok() = false)
   virtual void write8(uint8_t value) = 0;
 
@@ -50,6 +57,24 @@ private:
   bool m_ok;
 };
 
+// Reads a file that is already in memory (e.g. a MappedFile).
+class MemoryFileInterface : public FileInterface {
+public:
+  MemoryFileInterface(const uint8_t* data, size_t size);
+  bool ok() const override;
+  size_t tell() override;
+  void seek(size_t absPos) override;
+  uint8_t read8() override;
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  const uint8_t* readSpan(size_t n) override;
+  void write8(uint8_t value) override;
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+};
+
 } // namespace dio
 
 #endif
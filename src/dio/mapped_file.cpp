@@ -0,0 +1,102 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "dio/mapped_file.h"
+
+#ifdef _WIN32
+  #include "base/string.h"
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace dio {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+{
+  HANDLE file = CreateFileW(base::from_utf8(filename).c_str(),
+                            GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) ||
+      size.QuadPart <= 0 ||
+      uint64_t(size.QuadPart) > SIZE_MAX) {
+    CloseHandle(file);
+    return;
+  }
+
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return;
+  }
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return;
+  }
+
+  m_file = file;
+  m_mapping = mapping;
+  m_data = (const uint8_t*)data;
+  m_size = size_t(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  if (m_file)
+    CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+{
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode) &&
+      st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // The file is read sequentially
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+      m_data = (const uint8_t*)data;
+      m_size = size_t(st.st_size);
+    }
+  }
+
+  // The mapping is still valid after closing the file descriptor
+  close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_data)
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+#endif
+
+} // namespace dio
@@ -0,0 +1,43 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DIO_MAPPED_FILE_H_INCLUDED
+#define DIO_MAPPED_FILE_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dio {
+
+// Maps a whole file in memory (read-only) so it can be decoded with
+// a MemoryFileInterface without copying its bytes. data() is nullptr
+// if the file cannot be mapped (e.g. it's empty or it's not a
+// regular file), in that case the file should be read with stdio.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void* m_file = nullptr;
+  void* m_mapping = nullptr;
+#endif
+};
+
+} // namespace dio
+
+#endif
@@ -0,0 +1,75 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "dio/file_interface.h"
+
+#include <algorithm>
+
+namespace dio {
+
+MemoryFileInterface::MemoryFileInterface(const uint8_t* data, size_t size)
+  : m_data(data)
+  , m_size(size)
+  , m_pos(0)
+  , m_ok(true)
+{
+}
+
+bool MemoryFileInterface::ok() const
+{
+  return m_ok;
+}
+
+size_t MemoryFileInterface::tell()
+{
+  return m_pos;
+}
+
+void MemoryFileInterface::seek(size_t absPos)
+{
+  // Like fseek(), we can go beyond the end of the file (the next
+  // read will fail)
+  m_pos = absPos;
+}
+
+uint8_t MemoryFileInterface::read8()
+{
+  if (m_pos < m_size)
+    return m_data[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
+size_t MemoryFileInterface::readBytes(uint8_t* buf, size_t n)
+{
+  const size_t n2 = (m_pos < m_size ? std::min(n, m_size - m_pos): 0);
+  if (n2 > 0) {
+    std::copy(m_data + m_pos, m_data + m_pos + n2, buf);
+    m_pos += n2;
+  }
+  if (n2 != n)
+    m_ok = false;
+  return n2;
+}
+
+const uint8_t* MemoryFileInterface::readSpan(size_t n)
+{
+  if (m_pos > m_size || n > m_size - m_pos)
+    return nullptr;
+
+  const uint8_t* span = m_data + m_pos;
+  m_pos += n;
+  return span;
+}
+
+void MemoryFileInterface::write8(uint8_t value)
+{
+  // Read-only file
+  m_ok = false;
+}
+
+} // namespace dio
@@ -0,0 +1,187 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/distance_transform.h"
+
+#include "base/debug.h"
+#include "doc/parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+namespace doc {
+namespace algorithm {
+
+namespace {
+
+// Number of columns/rows processed by each parallel task
+const int kColumnsPerTask = 256;
+const int kRowsPerTask = 16;
+
+// Divides rounding to negative infinity
+int64_t floor_div(const int64_t a, const int64_t b)
+{
+  ASSERT(b > 0);
+  return (a >= 0 ? a / b: -((-a + b - 1) / b));
+}
+
+// The "f" and "sep" functions described in:
+//
+//   "A general algorithm for computing distance transforms in linear
+//   time", A. Meijster, J.B.T.M. Roerdink, W.H. Hesselink, 2000.
+//
+// f(x, i) is the distance from the row pixel "x" to the nearest
+// feature of column "i" (at vertical distance g(i)), and sep(i, u) is
+// the first pixel of the row which is nearer to column "u" than to
+// column "i" (where i < u).
+struct EuclideanMetric {
+  static int64_t f(const int64_t x, const int64_t i, const int64_t gi) {
+    return (x-i)*(x-i) + gi*gi;
+  }
+  static int64_t sep(const int64_t i, const int64_t u,
+                     const int64_t gi, const int64_t gu) {
+    return floor_div(u*u - i*i + gu*gu - gi*gi, 2*(u-i));
+  }
+};
+
+struct ChebyshevMetric {
+  static int64_t f(const int64_t x, const int64_t i, const int64_t gi) {
+    return std::max(std::abs(x-i), gi);
+  }
+  static int64_t sep(const int64_t i, const int64_t u,
+                     const int64_t gi, const int64_t gu) {
+    if (gi <= gu)
+      return std::max(i+gu, (i+u)/2);
+    else
+      return std::min(u-gi, (i+u)/2);
+  }
+};
+
+// Second pass: calculates the distances of a row from the
+// vertical distances "g" (a copy of the first pass results for this
+// row).
+template<typename Metric>
+void transform_row(const int w,
+                   const int infinite,
+                   const int* g,
+                   int* s,
+                   int* t,
+                   int* dist)
+{
+  int q = 0;
+  s[0] = 0;
+  t[0] = 0;
+  for (int u=1; u<w; ++u) {
+    while (q >= 0 &&
+           Metric::f(t[q], s[q], g[s[q]]) > Metric::f(t[q], u, g[u])) {
+      --q;
+    }
+    if (q < 0) {
+      q = 0;
+      s[0] = u;
+    }
+    else {
+      const int64_t x = 1 + Metric::sep(s[q], u, g[s[q]], g[u]);
+      if (x < w) {
+        ++q;
+        s[q] = u;
+        t[q] = int(x);
+      }
+    }
+  }
+
+  for (int u=w-1; u>=0; --u) {
+    const int i = s[q];
+    if (g[i] >= infinite)
+      dist[u] = kInfiniteDistance;
+    else
+      dist[u] = int(std::min<int64_t>(Metric::f(u, i, g[i]),
+                                      kInfiniteDistance));
+    if (u == t[q])
+      --q;
+  }
+}
+
+template<typename Metric>
+void distance_transform_templ(const int w,
+                              const int h,
+                              const uint8_t* features,
+                              int* dist)
+{
+  // Bigger than any distance in the grid (and small enough to
+  // calculate f() with int64_t)
+  const int infinite = w+h;
+
+  // First pass: vertical distance to the nearest feature of the same
+  // column (in "dist")
+  parallel_for(
+    0, w, kColumnsPerTask,
+    [w, h, infinite, features, dist](const int x1, const int x2){
+      for (int x=x1; x<x2; ++x)
+        dist[x] = (features[x] ? 0: infinite);
+
+      for (int y=1; y<h; ++y) {
+        const uint8_t* f = features + std::size_t(y)*w;
+        const int* prev = dist + std::size_t(y-1)*w;
+        int* g = dist + std::size_t(y)*w;
+        for (int x=x1; x<x2; ++x)
+          g[x] = (f[x] ? 0: std::min(prev[x]+1, infinite));
+      }
+
+      for (int y=h-2; y>=0; --y) {
+        const int* next = dist + std::size_t(y+1)*w;
+        int* g = dist + std::size_t(y)*w;
+        for (int x=x1; x<x2; ++x) {
+          if (next[x] < g[x])
+            g[x] = next[x]+1;
+        }
+      }
+    });
+
+  // Second pass: distance to the nearest feature in all columns
+  parallel_for(
+    0, h, kRowsPerTask,
+    [w, infinite, dist](const int y1, const int y2){
+      std::vector<int> g(w), s(w), t(w);
+      for (int y=y1; y<y2; ++y) {
+        int* row = dist + std::size_t(y)*w;
+        std::copy(row, row+w, g.begin());
+        transform_row<Metric>(w, infinite, g.data(), s.data(), t.data(), row);
+      }
+    });
+}
+
+} // anonymous namespace
+
+void distance_transform(const int w,
+                        const int h,
+                        const uint8_t* features,
+                        const DistanceMetric metric,
+                        int* dist)
+{
+  ASSERT(features);
+  ASSERT(dist);
+  if (w <= 0 || h <= 0)
+    return;
+
+  switch (metric) {
+    case DistanceMetric::Euclidean:
+      distance_transform_templ<EuclideanMetric>(w, h, features, dist);
+      break;
+    case DistanceMetric::Chebyshev:
+      distance_transform_templ<ChebyshevMetric>(w, h, features, dist);
+      break;
+  }
+}
+
+} // namespace algorithm
+} // namespace doc
@@ -0,0 +1,39 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ALGORITHM_DISTANCE_TRANSFORM_H_INCLUDED
+#define DOC_ALGORITHM_DISTANCE_TRANSFORM_H_INCLUDED
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace doc {
+  namespace algorithm {
+
+    enum class DistanceMetric {
+      Euclidean,                // Squared Euclidean distance (dx²+dy²)
+      Chebyshev,                // max(|dx|, |dy|)
+    };
+
+    // Distance for all pixels when there is no feature pixel
+    constexpr int kInfiniteDistance = std::numeric_limits<int>::max();
+
+    // Calculates the exact distance from each pixel of a w*h grid to
+    // the nearest feature pixel (features[y*w+x] != 0), storing it
+    // in dist[y*w+x]. It uses the two-pass algorithm of Meijster et
+    // al. (a pass by columns and other by rows, each one in parallel)
+    // so it's linear in the number of pixels.
+    void distance_transform(const int w,
+                            const int h,
+                            const uint8_t* features,
+                            const DistanceMetric metric,
+                            int* dist);
+
+  } // namespace algorithm
+} // namespace doc
+
+#endif
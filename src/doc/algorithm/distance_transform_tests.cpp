@@ -0,0 +1,91 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/distance_transform.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+static int brute_force(const int w, const int h,
+                       const std::vector<uint8_t>& features,
+                       const DistanceMetric metric,
+                       const int x, const int y)
+{
+  int best = kInfiniteDistance;
+  for (int v=0; v<h; ++v)
+    for (int u=0; u<w; ++u) {
+      if (!features[v*w+u])
+        continue;
+      const int dx = std::abs(u-x);
+      const int dy = std::abs(v-y);
+      best = std::min(best,
+                      metric == DistanceMetric::Euclidean ? dx*dx + dy*dy:
+                                                            std::max(dx, dy));
+    }
+  return best;
+}
+
+static void test_features(const int w, const int h,
+                          const std::vector<uint8_t>& features)
+{
+  for (auto metric : { DistanceMetric::Euclidean,
+                       DistanceMetric::Chebyshev }) {
+    std::vector<int> dist(w*h);
+    distance_transform(w, h, features.data(), metric, dist.data());
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        ASSERT_EQ(brute_force(w, h, features, metric, x, y), dist[y*w+x])
+          << "metric=" << int(metric) << " x=" << x << " y=" << y
+          << " w=" << w << " h=" << h;
+  }
+}
+
+TEST(DistanceTransform, MatchBruteForce)
+{
+  std::srand(1);
+  for (int w : { 1, 2, 7, 33, 300 }) {
+    for (int h : { 1, 3, 40 }) {
+      for (int density : { 2, 20, 500 }) {
+        std::vector<uint8_t> features(w*h);
+        for (auto& f : features)
+          f = (std::rand() % density == 0);
+        test_features(w, h, features);
+      }
+    }
+  }
+}
+
+TEST(DistanceTransform, NoFeatures)
+{
+  std::vector<uint8_t> features(5*4, 0);
+  std::vector<int> dist(5*4, 0);
+  distance_transform(5, 4, features.data(), DistanceMetric::Euclidean, dist.data());
+  for (int d : dist)
+    EXPECT_EQ(kInfiniteDistance, d);
+}
+
+TEST(DistanceTransform, OneFeature)
+{
+  std::vector<uint8_t> features(64*64, 0);
+  features[10*64+50] = 1;
+  test_features(64, 64, features);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,6 +16,8 @@
 #include "doc/mask.h"
 #include "doc/primitives.h"
 
+#include <algorithm>
+
 namespace doc {
 namespace algorithm {
 
@@ -34,31 +36,31 @@ void fill_selection(Image* image,
   if (rc.isEmpty())
     return; // <- There is no intersection between image bounds and mask bounds
 
-  const LockImageBits<BitmapTraits> maskBits(mask->bitmap(),
-                                             gfx::Rect(rc).offset(-mask->origin()));
-  auto it = maskBits.begin();
+  const MaskSpans& spans = mask->spans();
+  const gfx::Point maskOrigin = mask->origin();
 
-  for (int v=0; v<rc.h; ++v) {
-    for (int u=0; u<rc.w; ++u, ++it) {
-      ASSERT(it != maskBits.end());
-      if (*it) {
-        gfx::Point pt(u + rc.x,
-                      v + rc.y);
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    for (const MaskSpan& span : spans.row(y - maskOrigin.y)) {
+      const int x1 = std::max(rc.x, maskOrigin.x + span.x);
+      const int x2 = std::min(rc.x2(), maskOrigin.x + span.x2());
+      if (x1 >= x2)
+        continue;
 
-        if (grid) {
-          pt = grid->canvasToTile(pt);
-        }
-        else {
-          pt -= imageBounds.origin();
+      if (grid) {
+        for (int x=x1; x<x2; ++x) {
+          const gfx::Point pt = grid->canvasToTile(gfx::Point(x, y));
+          put_pixel(image, pt.x, pt.y, color);
         }
-
-        // TODO use iterator
-        put_pixel(image, pt.x, pt.y, color);
+      }
+      else {
+        draw_hline(image,
+                   x1 - imageBounds.x,
+                   y - imageBounds.y,
+                   x2 - 1 - imageBounds.x,
+                   color);
       }
     }
   }
-
-  ASSERT(it == maskBits.end());
 }
 
 } // namespace algorithm
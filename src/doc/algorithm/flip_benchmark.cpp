@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/algorithm/flip_image.h"
 
 #include "doc/image.h"
+#include "doc/primitives.h"
 
 #include <benchmark/benchmark.h>
 
@@ -38,25 +39,54 @@ void BM_FlipRawPtr(benchmark::State& state) {
   }
 }
 
-#define DEFARGS()                                                       \
-  ->Args({ IMAGE_RGB, 8192, 8192, doc::algorithm::FlipHorizontal })     \
-  ->Args({ IMAGE_RGB, 8192, 8192, doc::algorithm::FlipVertical })       \
-  ->Args({ IMAGE_GRAYSCALE, 8192, 8192, doc::algorithm::FlipHorizontal }) \
-  ->Args({ IMAGE_GRAYSCALE, 8192, 8192, doc::algorithm::FlipVertical }) \
-  ->Args({ IMAGE_INDEXED, 8192, 8192, doc::algorithm::FlipHorizontal }) \
-  ->Args({ IMAGE_INDEXED, 8192, 8192, doc::algorithm::FlipVertical })   \
-  ->Args({ IMAGE_BITMAP, 8192, 8192, doc::algorithm::FlipHorizontal })  \
-  ->Args({ IMAGE_BITMAP, 8192, 8192, doc::algorithm::FlipVertical })    \
-  ->Args({ IMAGE_TILEMAP, 8192, 8192, doc::algorithm::FlipHorizontal }) \
-  ->Args({ IMAGE_TILEMAP, 8192, 8192, doc::algorithm::FlipVertical })
+void BM_Rotate(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const int angle = state.range(3);
+  std::unique_ptr<Image> src(Image::create(pf, w, h));
+  std::unique_ptr<Image> dst(angle == 180 ? Image::create(pf, w, h):
+                                            Image::create(pf, h, w));
+  while (state.KeepRunning()) {
+    rotate_image(src.get(), dst.get(), angle);
+  }
+}
+
+// Size classes: brush/tile, regular sprite, big canvas
+static const int kSizes[][2] = { { 64, 64 }, { 1024, 1024 }, { 8192, 8192 }, { 8192, 64 } };
+
+static const PixelFormat kFormats[] = {
+  IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP, IMAGE_TILEMAP
+};
+
+static void FlipArgs(benchmark::internal::Benchmark* b) {
+  for (auto pf : kFormats)
+    for (auto& size : kSizes)
+      for (auto ft : { doc::algorithm::FlipHorizontal,
+                       doc::algorithm::FlipVertical,
+                       doc::algorithm::FlipDiagonal })
+        b->Args({ pf, size[0], size[1], ft });
+}
+
+static void RotateArgs(benchmark::internal::Benchmark* b) {
+  for (auto pf : kFormats)
+    for (auto& size : kSizes)
+      for (int angle : { 90, 180, -90 })
+        b->Args({ pf, size[0], size[1], angle });
+}
 
 BENCHMARK(BM_FlipSlow)
-  DEFARGS()
+  ->Apply(FlipArgs)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
 BENCHMARK(BM_FlipRawPtr)
-  DEFARGS()
+  ->Apply(FlipArgs)
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_Rotate)
+  ->Apply(RotateArgs)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
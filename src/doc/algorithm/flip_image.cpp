@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -20,16 +20,127 @@
 #include "gfx/rect.h"
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <vector>
 
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+  #define DOC_FLIP_SSE2 1
+#endif
+
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Size of the square blocks to transpose images (FlipDiagonal)
+const int kTransposeBlockSize = 16;
+
+// Returns the value to store in a flipped image for the given
+// pixel/tile. Only tiles need to be changed (to mirror their
+// content).
+template<typename ImageTraits>
+inline color_t flipped_pixel(const color_t c, const FlipType flipType)
+{
+  if constexpr (ImageTraits::color_mode == ColorMode::TILEMAP)
+    return flip_tile(c, flipType);
+  else
+    return c;
+}
+
+#if DOC_FLIP_SSE2
+
+// Reverses the order of elements of a 128-bit register.
+template<typename T>
+inline __m128i reverse_m128(__m128i v);
+
+template<>
+inline __m128i reverse_m128<uint32_t>(__m128i v)
+{
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+template<>
+inline __m128i reverse_m128<uint16_t>(__m128i v)
+{
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+template<>
+inline __m128i reverse_m128<uint8_t>(__m128i v)
+{
+  // Swap bytes of each 16-bit element and then reverse the 16-bit
+  // elements
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  return reverse_m128<uint16_t>(v);
+}
+
+#endif
+
+// Reverses the [l, r] range of pixels (both inclusive).
+template<typename T>
+void reverse_pixels(T* l, T* r)
+{
+#if DOC_FLIP_SSE2
+  const int k = 16 / sizeof(T); // Pixels per register
+  while (r - l + 1 >= 2*k) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)l);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(r-k+1));
+    _mm_storeu_si128((__m128i*)l, reverse_m128<T>(b));
+    _mm_storeu_si128((__m128i*)(r-k+1), reverse_m128<T>(a));
+    l += k;
+    r -= k;
+  }
+#endif
+  for (; l<r; ++l, --r)
+    std::swap(*l, *r);
+}
+
+// Swaps the content of two non-overlapped memory areas.
+void swap_bytes(uint8_t* a, uint8_t* b, int n)
+{
+#if DOC_FLIP_SSE2
+  for (; n >= 16; n-=16, a+=16, b+=16) {
+    const __m128i u = _mm_loadu_si128((const __m128i*)a);
+    const __m128i v = _mm_loadu_si128((const __m128i*)b);
+    _mm_storeu_si128((__m128i*)a, v);
+    _mm_storeu_si128((__m128i*)b, u);
+  }
+#endif
+  for (; n > 0; --n, ++a, ++b)
+    std::swap(*a, *b);
+}
+
+// Toggles the given flags of all non-empty tiles.
+void toggle_tile_flags(tile_t* p, int n, const tile_flags flags)
+{
+#if DOC_FLIP_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i f = _mm_set1_epi32(flags);
+  for (; n >= 4; n-=4, p+=4) {
+    const __m128i t = _mm_loadu_si128((const __m128i*)p);
+    const __m128i empty = _mm_cmpeq_epi32(t, zero);
+    _mm_storeu_si128((__m128i*)p,
+                     _mm_xor_si128(t, _mm_andnot_si128(empty, f)));
+  }
+#endif
+  for (; n > 0; --n, ++p) {
+    if (*p != notile)
+      *p ^= flags;
+  }
+}
+
+} // anonymous namespace
+
 template<typename ImageTraits>
 void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
+  constexpr bool isTilemap = (ImageTraits::color_mode == ColorMode::TILEMAP);
+
   switch (flipType) {
 
     case FlipHorizontal:
@@ -38,8 +149,15 @@ void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds,
         for (int x=bounds.x; x<bounds.x+bounds.w/2; ++x, --u) {
           uint32_t c1 = get_pixel_fast<ImageTraits>(image, x, y);
           uint32_t c2 = get_pixel_fast<ImageTraits>(image, u, y);
-          put_pixel_fast<ImageTraits>(image, x, y, c2);
-          put_pixel_fast<ImageTraits>(image, u, y, c1);
+          put_pixel_fast<ImageTraits>(image, x, y, flipped_pixel<ImageTraits>(c2, flipType));
+          put_pixel_fast<ImageTraits>(image, u, y, flipped_pixel<ImageTraits>(c1, flipType));
+        }
+        // The tile in the middle isn't moved but it's flipped too
+        if (isTilemap && (bounds.w & 1)) {
+          const int x = bounds.x+bounds.w/2;
+          put_pixel_fast<ImageTraits>(
+            image, x, y,
+            flipped_pixel<ImageTraits>(get_pixel_fast<ImageTraits>(image, x, y), flipType));
         }
       }
       break;
@@ -50,8 +168,17 @@ void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds,
         for (int x=bounds.x; x<bounds.x2(); ++x) {
           uint32_t c1 = get_pixel_fast<ImageTraits>(image, x, y);
           uint32_t c2 = get_pixel_fast<ImageTraits>(image, x, v);
-          put_pixel_fast<ImageTraits>(image, x, y, c2);
-          put_pixel_fast<ImageTraits>(image, x, v, c1);
+          put_pixel_fast<ImageTraits>(image, x, y, flipped_pixel<ImageTraits>(c2, flipType));
+          put_pixel_fast<ImageTraits>(image, x, v, flipped_pixel<ImageTraits>(c1, flipType));
+        }
+      }
+      // The row in the middle isn't moved but its tiles are flipped too
+      if (isTilemap && (bounds.h & 1)) {
+        const int y = bounds.y+bounds.h/2;
+        for (int x=bounds.x; x<bounds.x2(); ++x) {
+          put_pixel_fast<ImageTraits>(
+            image, x, y,
+            flipped_pixel<ImageTraits>(get_pixel_fast<ImageTraits>(image, x, y), flipType));
         }
       }
       break;
@@ -63,8 +190,8 @@ void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds,
         for (int x=bounds.x+y; x<bounds.x+d; ++x) {
           uint32_t c1 = get_pixel_fast<ImageTraits>(image, x, y);
           uint32_t c2 = get_pixel_fast<ImageTraits>(image, y, x);
-          put_pixel_fast<ImageTraits>(image, x, y, c2);
-          put_pixel_fast<ImageTraits>(image, y, x, c1);
+          put_pixel_fast<ImageTraits>(image, x, y, flipped_pixel<ImageTraits>(c2, flipType));
+          put_pixel_fast<ImageTraits>(image, y, x, flipped_pixel<ImageTraits>(c1, flipType));
         }
       }
       break;
@@ -75,19 +202,20 @@ void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds,
 template<typename ImageTraits>
 void flip_image_with_rawptr_templ(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
+  using pixel_t = typename ImageTraits::pixel_t;
   using address_t = typename ImageTraits::address_t;
+  constexpr bool isTilemap = (ImageTraits::color_mode == ColorMode::TILEMAP);
 
   switch (flipType) {
 
     case FlipHorizontal:
       for (int y=bounds.y; y<bounds.y2(); ++y) {
-        const int n = bounds.w/2;
         auto l = (address_t)image->getPixelAddress(bounds.x, y);
         auto r = (address_t)image->getPixelAddress(bounds.x2()-1, y);
+        reverse_pixels<pixel_t>(l, r);
 
-        for (int x=0; x<n; ++x, ++l, --r) {
-          std::swap(*l, *r);
-        }
+        if constexpr (isTilemap)
+          toggle_tile_flags(l, bounds.w, tile_f_xflip);
       }
       break;
 
@@ -97,22 +225,122 @@ void flip_image_with_rawptr_templ(Image* image, const gfx::Rect& bounds, FlipTyp
       for (int y=bounds.y; y<bounds.y+bounds.h/2; ++y, --v) {
         auto t = (address_t)image->getPixelAddress(bounds.x, y);
         auto b = (address_t)image->getPixelAddress(bounds.x, v);
+        swap_bytes((uint8_t*)t, (uint8_t*)b, n*sizeof(pixel_t));
 
-        for (int x=0; x<n; ++x, ++t, ++b) {
-          std::swap(*t, *b);
+        if constexpr (isTilemap) {
+          toggle_tile_flags(t, n, tile_f_yflip);
+          toggle_tile_flags(b, n, tile_f_yflip);
+        }
+      }
+      if constexpr (isTilemap) {
+        if (bounds.h & 1) {
+          auto m = (address_t)image->getPixelAddress(bounds.x, bounds.y+bounds.h/2);
+          toggle_tile_flags(m, n, tile_f_yflip);
+        }
+      }
+      break;
+    }
+
+    case FlipDiagonal: {
+      if (bounds.x != 0 || bounds.y != 0) {
+        flip_image_with_put_pixel_fast_templ<ImageTraits>(image, bounds, flipType);
+        break;
+      }
+
+      // Transpose the square region by blocks so the rows of both
+      // sides of the diagonal stay in the cache.
+      const int d = std::min(bounds.w, bounds.h);
+      for (int by=0; by<d; by+=kTransposeBlockSize) {
+        const int by2 = std::min(by+kTransposeBlockSize, d);
+        for (int bx=by; bx<d; bx+=kTransposeBlockSize) {
+          const int bx2 = std::min(bx+kTransposeBlockSize, d);
+          address_t rows[kTransposeBlockSize];
+          for (int x=bx; x<bx2; ++x)
+            rows[x-bx] = (address_t)image->getPixelAddress(0, x);
+
+          for (int y=by; y<by2; ++y) {
+            const int x1 = std::max(bx, y);
+            auto p = (address_t)image->getPixelAddress(x1, y);
+            for (int x=x1; x<bx2; ++x, ++p) {
+              auto q = rows[x-bx] + y;
+              const pixel_t c = *p;
+              *p = flipped_pixel<ImageTraits>(*q, flipType);
+              if (p != q)
+                *q = flipped_pixel<ImageTraits>(c, flipType);
+            }
+          }
+        }
+      }
+      break;
+    }
+  }
+}
+
+// IMAGE_BITMAP rows are packed (8 pixels per byte, LSB first), so we
+// cannot use the same raw pointer approach than other formats.
+void flip_bitmap(Image* image, const gfx::Rect& bounds, FlipType flipType)
+{
+  switch (flipType) {
+
+    case FlipHorizontal: {
+      // Each row is unpacked in this buffer (one byte per pixel)
+      std::vector<uint8_t> row(bounds.w);
+      for (int y=bounds.y; y<bounds.y2(); ++y) {
+        uint8_t* p = image->getPixelAddress(0, y);
+        for (int i=0, x=bounds.x; i<bounds.w; ++i, ++x)
+          row[i] = ((p[x >> 3] >> (x & 7)) & 1);
+
+        for (int i=bounds.w-1, x=bounds.x; i>=0; --i, ++x) {
+          if (row[i])
+            p[x >> 3] |= (1 << (x & 7));
+          else
+            p[x >> 3] &= ~(1 << (x & 7));
+        }
+      }
+      break;
+    }
+
+    case FlipVertical: {
+      const int x1 = bounds.x;
+      const int x2 = bounds.x2()-1;
+      const int b1 = x1 >> 3;
+      const int b2 = x2 >> 3;
+      // Bits to swap in the first and last bytes
+      uint8_t m1 = uint8_t(0xff << (x1 & 7));
+      uint8_t m2 = uint8_t(0xff >> (7 - (x2 & 7)));
+      if (b1 == b2)
+        m1 = m2 = (m1 & m2);
+
+      auto swap_masked = [](uint8_t& a, uint8_t& b, const uint8_t m) {
+        const uint8_t d = ((a ^ b) & m);
+        a ^= d;
+        b ^= d;
+      };
+
+      int v = bounds.y2()-1;
+      for (int y=bounds.y; y<bounds.y+bounds.h/2; ++y, --v) {
+        uint8_t* t = image->getPixelAddress(0, y);
+        uint8_t* b = image->getPixelAddress(0, v);
+        swap_masked(t[b1], b[b1], m1);
+        if (b2 > b1) {
+          swap_bytes(t+b1+1, b+b1+1, b2-b1-1);
+          swap_masked(t[b2], b[b2], m2);
         }
       }
       break;
     }
 
     case FlipDiagonal:
-      flip_image_with_put_pixel_fast_templ<ImageTraits>(image, bounds, flipType);
+      flip_image_with_put_pixel_fast_templ<BitmapTraits>(image, bounds, flipType);
       break;
   }
 }
 
 void flip_image_slow(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
+  image->unshareTiles(bounds);
+  image->invalidateContentHash();
+
   DOC_DISPATCH_BY_COLOR_MODE(
     image->colorMode(),
     flip_image_with_put_pixel_fast_templ,
@@ -121,10 +349,18 @@ void flip_image_slow(Image* image, const gfx::Rect& bounds, FlipType flipType)
 
 void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
-  // Use get/put_pixel_fast for IMAGE_BITMAP as we cannot use the
+  if (bounds.isEmpty())
+    return;
+
+  // We modify pixels directly through getPixelAddress()
+  image->unshareTiles(bounds);
+  image->invalidateContentHash();
+
+  // IMAGE_BITMAP needs a special implementation as we cannot use the
   // rawptr to iterate through bits.
   if (image->colorMode() == ColorMode::BITMAP) {
-    return flip_image_with_put_pixel_fast_templ<BitmapTraits>(image, bounds, flipType);
+    flip_bitmap(image, bounds, flipType);
+    return;
   }
 
   DOC_DISPATCH_BY_COLOR_MODE_EXCLUDE_BITMAP(
@@ -136,7 +372,11 @@ void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
 template<typename ImageTraits>
 void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
-  gfx::Rect bounds = mask->bounds();
+  const gfx::Rect bounds = mask->bounds();
+  const MaskSpans& spans = mask->spans();
+
+  // Pixels of the current row that receive a mirrored pixel
+  std::vector<uint8_t> covered(bounds.w);
 
   switch (flipType) {
 
@@ -144,18 +384,32 @@ void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipTyp
       std::unique_ptr<Image> originalRow(Image::create(image->pixelFormat(), bounds.w, 1));
 
       for (int y=bounds.y; y<bounds.y2(); ++y) {
+        const auto row = spans.row(y-bounds.y);
+        if (row.empty())
+          continue;
+
         // Copy the current row.
         originalRow->copy(image, gfx::Clip(0, 0, bounds.x, y, bounds.w, 1));
+        std::fill(covered.begin(), covered.end(), 0);
 
-        int u = bounds.x2()-1;
-        for (int x=bounds.x; x<bounds.x2(); ++x, --u) {
-          if (mask->containsPoint(x, y)) {
+        for (const MaskSpan& span : row) {
+          int u = bounds.w-span.x-1;
+          for (int i=span.x; i<span.x2(); ++i, --u) {
             put_pixel_fast<ImageTraits>(
-              image, u, y,
-              get_pixel_fast<ImageTraits>(originalRow.get(), x-bounds.x, 0));
+              image, bounds.x+u, y,
+              flipped_pixel<ImageTraits>(
+                get_pixel_fast<ImageTraits>(originalRow.get(), i, 0),
+                flipType));
+            covered[u] = 1;
+          }
+        }
 
-            if (!mask->containsPoint(u, y))
-              put_pixel_fast<ImageTraits>(image, x, y, bgcolor);
+        // Clear selected pixels that didn't receive a mirrored pixel
+        // (their mirrored position is not selected).
+        for (const MaskSpan& span : row) {
+          for (int i=span.x; i<span.x2(); ++i) {
+            if (!covered[i])
+              put_pixel_fast<ImageTraits>(image, bounds.x+i, y, bgcolor);
           }
         }
       }
@@ -163,21 +417,33 @@ void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipTyp
     }
 
     case FlipVertical: {
-      std::unique_ptr<Image> originalCol(Image::create(image->pixelFormat(), 1, bounds.h));
+      std::unique_ptr<Image> original(Image::create(image->pixelFormat(), bounds.w, bounds.h));
+      original->copy(image, gfx::Clip(0, 0, bounds.x, bounds.y, bounds.w, bounds.h));
 
-      for (int x=bounds.x; x<bounds.x2(); ++x) {
-        // Copy the current column.
-        originalCol->copy(image, gfx::Clip(0, 0, x, bounds.y, 1, bounds.h));
-
-        int v = bounds.y2()-1;
-        for (int y=bounds.y; y<bounds.y2(); ++y, --v) {
-          if (mask->containsPoint(x, y)) {
+      for (int y=bounds.y; y<bounds.y2(); ++y) {
+        const int v = bounds.y2()-1-(y-bounds.y);
+        const auto row = spans.row(y-bounds.y);
+        const auto mirrorRow = spans.row(v-bounds.y);
+        if (row.empty() && mirrorRow.empty())
+          continue;
+
+        // Pixels of this row that come from the mirrored row
+        std::fill(covered.begin(), covered.end(), 0);
+        for (const MaskSpan& span : mirrorRow) {
+          for (int i=span.x; i<span.x2(); ++i) {
             put_pixel_fast<ImageTraits>(
-              image, x, v,
-              get_pixel_fast<ImageTraits>(originalCol.get(), 0, y-bounds.y));
+              image, bounds.x+i, y,
+              flipped_pixel<ImageTraits>(
+                get_pixel_fast<ImageTraits>(original.get(), i, v-bounds.y),
+                flipType));
+            covered[i] = 1;
+          }
+        }
 
-            if (!mask->containsPoint(x, v))
-              put_pixel_fast<ImageTraits>(image, x, y, bgcolor);
+        for (const MaskSpan& span : row) {
+          for (int i=span.x; i<span.x2(); ++i) {
+            if (!covered[i])
+              put_pixel_fast<ImageTraits>(image, bounds.x+i, y, bgcolor);
           }
         }
       }
@@ -193,6 +459,9 @@ void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipTyp
 
 void flip_image_with_mask(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
+  image->unshareTiles(mask->bounds());
+  image->invalidateContentHash();
+
   DOC_DISPATCH_BY_COLOR_MODE(
     image->colorMode(),
     flip_image_with_mask_templ,
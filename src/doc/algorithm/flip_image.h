@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "gfx/fwd.h"
 #include "doc/algorithm/flip_type.h"
+#include "doc/tile.h"
 
 namespace doc {
   class Image;
@@ -18,9 +19,34 @@ namespace doc {
 
   namespace algorithm {
 
+    // Returns the given tile with its flags changed so it's displayed
+    // mirrored with the given flip type. Empty tiles are kept as they
+    // are.
+    inline tile_t flip_tile(const tile_t t, const FlipType flipType) {
+      if (t == notile)
+        return t;
+      switch (flipType) {
+        case FlipHorizontal:
+          return t ^ tile_f_xflip;
+        case FlipVertical:
+          return t ^ tile_f_yflip;
+        case FlipDiagonal: {
+          // Tile flags are applied in x, y, d order, so transposing
+          // the tile swaps the x/y flips and toggles the d flip.
+          const tile_flags tf = tile_getf(t);
+          return tile(tile_geti(t),
+                      (tf & tile_f_xflip ? tile_f_yflip: 0) |
+                      (tf & tile_f_yflip ? tile_f_xflip: 0) |
+                      (tf & tile_f_dflip ? 0: tile_f_dflip));
+        }
+      }
+      return t;
+    }
+
     // Different implementation to flip a rectangular region specified
-    // in the "bounds" parameter.
-    // flip_image: uses raw pointers
+    // in the "bounds" parameter. Tiles of tilemap images are mirrored
+    // too (changing their flip flags with flip_tile()).
+    // flip_image: uses raw pointers (and SIMD when it's possible)
     // flip_image_slow: uses get/put_pixel_fast
     void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType);
     void flip_image_slow(Image* image, const gfx::Rect& bounds, FlipType flipType);
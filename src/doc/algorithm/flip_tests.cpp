@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/algorithm/random_image.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
+#include "doc/mask.h"
 #include "doc/primitives.h"
 
 using namespace doc;
@@ -51,6 +52,114 @@ TEST(Flip, Image)
   }
 }
 
+TEST(Flip, SubBounds)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP, IMAGE_TILEMAP }) {
+    ImageRef a(Image::create(pf, 83, 41));
+    doc::algorithm::random_image(a.get());
+
+    for (const Rect& bounds : { Rect(1, 2, 37, 30),
+                                Rect(3, 0, 5, 41),
+                                Rect(9, 7, 64, 1),
+                                Rect(0, 5, 83, 33) }) {
+      for (auto ft : { doc::algorithm::FlipHorizontal,
+                       doc::algorithm::FlipVertical }) {
+        ImageRef b(Image::createCopy(a.get()));
+        ImageRef c(Image::createCopy(a.get()));
+        doc::algorithm::flip_image(b.get(), bounds, ft);
+        doc::algorithm::flip_image_slow(c.get(), bounds, ft);
+
+        ASSERT_TRUE(is_same_image(b.get(), c.get()))
+          << "Pixel format=" << pf
+          << " Bounds=" << bounds.x << "," << bounds.y << " " << bounds.w << "x" << bounds.h
+          << "\nFlip type=" << ft;
+      }
+    }
+  }
+}
+
+TEST(Flip, Diagonal)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP, IMAGE_TILEMAP }) {
+    for (const Size& size : { Size(1, 1), Size(40, 40), Size(37, 19), Size(5, 70) }) {
+      ImageRef a(Image::create(pf, size.w, size.h));
+      doc::algorithm::random_image(a.get());
+
+      ImageRef b(Image::createCopy(a.get()));
+      ImageRef c(Image::createCopy(a.get()));
+      doc::algorithm::flip_image(b.get(), b->bounds(), doc::algorithm::FlipDiagonal);
+      doc::algorithm::flip_image_slow(c.get(), c->bounds(), doc::algorithm::FlipDiagonal);
+
+      ASSERT_TRUE(is_same_image(b.get(), c.get()))
+        << "Pixel format=" << pf << " Size=" << size.w << "x" << size.h;
+    }
+  }
+}
+
+TEST(Flip, Mask)
+{
+  Mask mask;
+  mask.add(Rect(3, 2, 20, 10));
+  mask.subtract(Rect(5, 4, 4, 3));
+  mask.add(Rect(21, 11, 6, 5));
+
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    ImageRef a(Image::create(pf, 40, 30));
+    doc::algorithm::random_image(a.get());
+
+    for (auto ft : { doc::algorithm::FlipHorizontal,
+                     doc::algorithm::FlipVertical }) {
+      ImageRef b(Image::createCopy(a.get()));
+      doc::algorithm::flip_image_with_mask(b.get(), &mask, ft, 0);
+
+      // Expected result: each selected pixel is moved to its mirrored
+      // position, and selected pixels that don't receive a pixel are
+      // cleared.
+      const Rect bounds = mask.bounds();
+      for (int y=0; y<a->height(); ++y) {
+        for (int x=0; x<a->width(); ++x) {
+          const int u = (ft == doc::algorithm::FlipHorizontal ? bounds.x2()-1-(x-bounds.x): x);
+          const int v = (ft == doc::algorithm::FlipVertical ? bounds.y2()-1-(y-bounds.y): y);
+          color_t expected = get_pixel(a.get(), x, y);
+          if (mask.containsPoint(u, v))
+            expected = get_pixel(a.get(), u, v);
+          else if (mask.containsPoint(x, y))
+            expected = 0;
+          ASSERT_EQ(expected, get_pixel(b.get(), x, y))
+            << "Pixel format=" << pf << " Flip type=" << ft
+            << " x=" << x << " y=" << y;
+        }
+      }
+    }
+  }
+}
+
+TEST(Flip, TileFlags)
+{
+  ImageRef a(Image::create(IMAGE_TILEMAP, 3, 1));
+  put_pixel(a.get(), 0, 0, tile(1, 0));
+  put_pixel(a.get(), 1, 0, tile(2, tile_f_yflip));
+  put_pixel(a.get(), 2, 0, notile);
+
+  doc::algorithm::flip_image(a.get(), a->bounds(), doc::algorithm::FlipHorizontal);
+  EXPECT_EQ(notile, get_pixel(a.get(), 0, 0));
+  EXPECT_EQ(tile(2, tile_f_xflip | tile_f_yflip), get_pixel(a.get(), 1, 0));
+  EXPECT_EQ(tile(1, tile_f_xflip), get_pixel(a.get(), 2, 0));
+
+  doc::algorithm::flip_image(a.get(), a->bounds(), doc::algorithm::FlipVertical);
+  EXPECT_EQ(notile, get_pixel(a.get(), 0, 0));
+  EXPECT_EQ(tile(2, tile_f_xflip), get_pixel(a.get(), 1, 0));
+  EXPECT_EQ(tile(1, tile_f_xflip | tile_f_yflip), get_pixel(a.get(), 2, 0));
+
+  // Transposing a tile swaps its x/y flips
+  EXPECT_EQ(tile(2, tile_f_yflip | tile_f_dflip),
+            doc::algorithm::flip_tile(tile(2, tile_f_xflip),
+                                      doc::algorithm::FlipDiagonal));
+  EXPECT_EQ(tile(2, tile_f_xflip | tile_f_yflip),
+            doc::algorithm::flip_tile(tile(2, tile_f_xflip | tile_f_yflip | tile_f_dflip),
+                                      doc::algorithm::FlipDiagonal));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -6,6 +6,10 @@
 // - Added non-contiguous mode
 // - Added mask parameter
 //
+// Changes by Igara Studio:
+// - Pixels are compared a whole row at a time (with SSE2 when it's
+//   available) and large areas are classified in parallel
+//
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
 //
@@ -17,19 +21,30 @@
 
 #include "base/base.h"
 #include "doc/algo.h"
+#include "doc/algorithm/floodfill.h"
 #include "doc/image.h"
+#include "doc/image_impl.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
-#include "doc/primitives_fast.h"
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <vector>
 
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+  #define DOC_FLOODFILL_SSE2 1
+#endif
+
 namespace doc {
 namespace algorithm {
 
+namespace {
+
 struct FLOODED_LINE {   // store segments which have been flooded
   char flags;           // status of the segment
   int lpos, rpos;       // left and right ends of segment
@@ -37,15 +52,10 @@ struct FLOODED_LINE {   // store segments which have been flooded
   int next;             // linked list if several per line
 };
 
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
-
 #define FLOOD_IN_USE             1
 #define FLOOD_TODO_ABOVE         2
 #define FLOOD_TODO_BELOW         4
 
-#define FLOOD_LINE(c)            (&flood_buf[c])
-
 static inline bool color_equal_32_raw(color_t c1, color_t c2)
 {
   return (c1 == c2);
@@ -132,161 +142,348 @@ inline bool color_equal<TilemapTraits>(color_t c1, color_t c2, int tolerance)
   return color_equal_32_raw(c1, c2);
 }
 
+// Rows of pixels are classified in bitsets (one bit per pixel, 1 =
+// the pixel can be filled) before running the flood algorithm.
+typedef uint64_t row_word_t;
+const int kRowWordBits = 64;
+const row_word_t kFullRowWord = ~row_word_t(0);
 
+// Minimum number of pixels to classify all rows in parallel before
+// filling.
+const int kParallelArea = 512*512;
+const int kParallelRows = 16;   // Rows per parallel_for() chunk
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(const Image* image,
-                   const Mask* mask,
-                   int x, int y,
-                   const gfx::Rect& bounds,
-                   color_t src_color, int tolerance, void *data, AlgoHLine proc)
+static inline void set_bits(row_word_t* bits, int i, row_word_t mask)
 {
-#define MASKED(u, v)                                                    \
-        (mask &&                                                        \
-         (!mask->bounds().contains(u, v) ||                             \
-          (mask->bitmap() &&                                            \
-           !get_pixel_fast<BitmapTraits>(mask->bitmap(),                \
-                                         (u)-mask->bounds().x,          \
-                                         (v)-mask->bounds().y))))
+  bits[i / kRowWordBits] |= (mask << (i % kRowWordBits));
+}
 
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
+static inline bool test_bit(const row_word_t* bits, int i)
+{
+  return ((bits[i / kRowWordBits] >> (i % kRowWordBits)) & 1) ? true: false;
+}
 
-  switch (image->pixelFormat()) {
+static void clear_bits(row_word_t* bits, int i, int end)
+{
+  for (; i<end; ++i)
+    bits[i / kRowWordBits] &= ~(row_word_t(1) << (i % kRowWordBits));
+}
 
-    case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
+// Returns the first position in [i, end) with a zero bit, or "end".
+static int find_zero_right(const row_word_t* bits, int i, int end)
+{
+  while (i < end) {
+    if ((i % kRowWordBits) == 0 && bits[i / kRowWordBits] == kFullRowWord) {
+      i += kRowWordBits;
+      continue;
+    }
+    if (!test_bit(bits, i))
+      return i;
+    ++i;
+  }
+  return end;
+}
 
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+// Returns the first position in [begin, i] going to the left with a
+// zero bit, or "begin-1".
+static int find_zero_left(const row_word_t* bits, int i, int begin)
+{
+  while (i >= begin) {
+    if ((i % kRowWordBits) == kRowWordBits-1 && bits[i / kRowWordBits] == kFullRowWord) {
+      i -= kRowWordBits;
+      continue;
+    }
+    if (!test_bit(bits, i))
+      return i;
+    --i;
+  }
+  return begin-1;
+}
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+// Sets the bits of the "n" pixels in "row" that are equal to
+// "src_color" (using the given tolerance).
+template<typename ImageTraits>
+static void match_row(const typename ImageTraits::pixel_t* row, int n,
+                      color_t src_color, int tolerance, row_word_t* bits)
+{
+  for (int i=0; i<n; ++i) {
+    if (color_equal<ImageTraits>(int(row[i]), src_color, tolerance))
+      set_bits(bits, i, 1);
+  }
+}
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+#if DOC_FLOODFILL_SSE2
 
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
+// The SSE2 versions compare all the channels of several pixels at
+// the same time using the absolute difference of each byte, which
+// gives the same result as color_equal_32/16/8() functions.
 
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+template<>
+void match_row<RgbTraits>(const uint32_t* row, int n,
+                          color_t src_color, int tolerance, row_word_t* bits)
+{
+  const __m128i src = _mm_set1_epi32(int(src_color));
+  const __m128i tol = _mm_set1_epi8(char(std::min(tolerance, 255)));
+  const __m128i alpha = _mm_set1_epi32(int(rgba_a_mask));
+  const __m128i zero = _mm_setzero_si128();
+  const bool transparentSrc = (rgba_geta(src_color) == 0);
+  int i = 0;
+
+  for (; i+4<=n; i+=4) {
+    const __m128i px = _mm_loadu_si128((const __m128i*)(row+i));
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(px, src),
+                                      _mm_subs_epu8(src, px));
+    __m128i m = _mm_cmpeq_epi32(_mm_subs_epu8(diff, tol), zero);
+    if (transparentSrc)
+      m = _mm_or_si128(m, _mm_cmpeq_epi32(_mm_and_si128(px, alpha), zero));
+    set_bits(bits, i, row_word_t(_mm_movemask_ps(_mm_castsi128_ps(m))));
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+  for (; i<n; ++i) {
+    if (color_equal_32(row[i], src_color, tolerance))
+      set_bits(bits, i, 1);
+  }
+}
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+template<>
+void match_row<GrayscaleTraits>(const uint16_t* row, int n,
+                                color_t src_color, int tolerance, row_word_t* bits)
+{
+  const __m128i src = _mm_set1_epi16(short(src_color));
+  const __m128i tol = _mm_set1_epi8(char(std::min(tolerance, 255)));
+  const __m128i alpha = _mm_set1_epi16(short(graya_a_mask));
+  const __m128i zero = _mm_setzero_si128();
+  const bool transparentSrc = (graya_geta(src_color) == 0);
+  int i = 0;
+
+  for (; i+8<=n; i+=8) {
+    const __m128i px = _mm_loadu_si128((const __m128i*)(row+i));
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(px, src),
+                                      _mm_subs_epu8(src, px));
+    __m128i m = _mm_cmpeq_epi16(_mm_subs_epu8(diff, tol), zero);
+    if (transparentSrc)
+      m = _mm_or_si128(m, _mm_cmpeq_epi16(_mm_and_si128(px, alpha), zero));
+    m = _mm_packs_epi16(m, zero);
+    set_bits(bits, i, row_word_t(_mm_movemask_epi8(m) & 0xff));
+  }
 
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
+  for (; i<n; ++i) {
+    if (color_equal_16(row[i], src_color, tolerance))
+      set_bits(bits, i, 1);
+  }
+}
 
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+template<>
+void match_row<IndexedTraits>(const uint8_t* row, int n,
+                              color_t src_color, int tolerance, row_word_t* bits)
+{
+  const __m128i src = _mm_set1_epi8(char(src_color));
+  const __m128i tol = _mm_set1_epi8(char(std::min(tolerance, 255)));
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+
+  if (src_color <= 255) {
+    for (; i+16<=n; i+=16) {
+      const __m128i px = _mm_loadu_si128((const __m128i*)(row+i));
+      const __m128i diff = _mm_or_si128(_mm_subs_epu8(px, src),
+                                        _mm_subs_epu8(src, px));
+      const __m128i m = _mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero);
+      set_bits(bits, i, row_word_t(_mm_movemask_epi8(m) & 0xffff));
+    }
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+  for (; i<n; ++i) {
+    if (color_equal_8(row[i], src_color, tolerance))
+      set_bits(bits, i, 1);
+  }
+}
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+template<>
+void match_row<TilemapTraits>(const uint32_t* row, int n,
+                              color_t src_color, int tolerance, row_word_t* bits)
+{
+  const __m128i src = _mm_set1_epi32(int(src_color));
+  int i = 0;
 
-    case IMAGE_TILEMAP:
-      {
-        // TODO add support for mask
+  for (; i+4<=n; i+=4) {
+    const __m128i px = _mm_loadu_si128((const __m128i*)(row+i));
+    const __m128i m = _mm_cmpeq_epi32(px, src);
+    set_bits(bits, i, row_word_t(_mm_movemask_ps(_mm_castsi128_ps(m))));
+  }
 
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
+  for (; i<n; ++i) {
+    if (color_equal_32_raw(row[i], src_color))
+      set_bits(bits, i, 1);
+  }
+}
 
-        // Check start pixel
-        if (!color_equal_32_raw((int)*(address+x), src_color))
-          return x+1;
+#endif // DOC_FLOODFILL_SSE2
+
+class FloodFill {
+public:
+  FloodFill(const Image* image,
+            const Mask* mask,
+            const gfx::Rect& bounds,
+            const color_t src_color,
+            const int tolerance,
+            void* data,
+            AlgoHLine proc)
+    : m_image(image)
+    // TODO add support for mask in tilemaps
+    , m_mask(image->pixelFormat() != IMAGE_TILEMAP ? mask: nullptr)
+    , m_bounds(bounds)
+    , m_src_color(src_color)
+    , m_tolerance(tolerance)
+    , m_data(data)
+    , m_proc(proc)
+    , m_rowWords((bounds.w + kRowWordBits - 1) / kRowWordBits)
+    , m_bits(std::size_t(m_rowWords) * bounds.h, 0)
+    , m_ready(bounds.h, false) {
+    // Build the mask spans now (they are cached lazily in the mask,
+    // so we cannot build them from several threads)
+    if (m_mask && m_mask->bitmap())
+      m_mask->spans();
+
+    if (m_bounds.w * m_bounds.h >= kParallelArea &&
+        parallel_concurrency() > 1) {
+      parallel_for(
+        0, m_bounds.h, kParallelRows,
+        [this](int v1, int v2){
+          for (int v=v1; v<v2; ++v)
+            classifyRow(v);
+        });
+      std::fill(m_ready.begin(), m_ready.end(), true);
+    }
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32_raw((int)*(address+left), src_color))
-            break;
-        }
+  void fill(const int x, const int y,
+            const bool isEightConnected);
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32_raw((int)*(address+right), src_color))
-            break;
-        }
-      }
-      break;
+  void replaceColor();
 
-    default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color || MASKED(x, y))
-        return x+1;
-
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color || MASKED(left, y))
-          break;
-      }
+private:
+  const row_word_t* row(const int y) {
+    const int v = y - m_bounds.y;
+    ASSERT(v >= 0 && v < m_bounds.h);
+    if (!m_ready[v]) {
+      classifyRow(v);
+      m_ready[v] = true;
+    }
+    return &m_bits[std::size_t(m_rowWords) * v];
+  }
+
+  void classifyRow(const int v);
+  int flooder(int x, int y);
+  bool checkFloodLine(int y, int left, int right);
+
+  const Image* m_image;
+  const Mask* m_mask;
+  const gfx::Rect m_bounds;
+  const color_t m_src_color;
+  const int m_tolerance;
+  void* m_data;
+  AlgoHLine m_proc;
+
+  // Bits of classified pixels (one row of m_rowWords for each
+  // row of m_bounds)
+  const int m_rowWords;
+  std::vector<row_word_t> m_bits;
+  std::vector<bool> m_ready;
+
+  // Segments which have been flooded
+  std::vector<FLOODED_LINE> m_flood_buf;
+  int m_flood_count;
+};
 
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color || MASKED(right, y))
-          break;
+void FloodFill::classifyRow(const int v)
+{
+  const int y = m_bounds.y + v;
+  const int w = m_bounds.w;
+  const uint8_t* address = m_image->getPixelAddress(m_bounds.x, y);
+  row_word_t* bits = &m_bits[std::size_t(m_rowWords) * v];
+
+  switch (m_image->pixelFormat()) {
+    case IMAGE_RGB:
+      match_row<RgbTraits>((const uint32_t*)address, w, m_src_color, m_tolerance, bits);
+      break;
+    case IMAGE_GRAYSCALE:
+      match_row<GrayscaleTraits>((const uint16_t*)address, w, m_src_color, m_tolerance, bits);
+      break;
+    case IMAGE_INDEXED:
+      match_row<IndexedTraits>(address, w, m_src_color, m_tolerance, bits);
+      break;
+    case IMAGE_TILEMAP:
+      match_row<TilemapTraits>((const uint32_t*)address, w, m_src_color, m_tolerance, bits);
+      break;
+    default:
+      for (int u=0; u<w; ++u) {
+        if (get_pixel(m_image, m_bounds.x+u, y) == m_src_color)
+          set_bits(bits, u, 1);
       }
       break;
   }
 
+  if (!m_mask)
+    return;
+
+  // Remove pixels outside the mask
+  const gfx::Rect& maskBounds = m_mask->bounds();
+  if (!m_mask->bitmap() || y < maskBounds.y || y >= maskBounds.y2()) {
+    std::fill(bits, bits+m_rowWords, 0);
+    return;
+  }
+
+  int u = 0;
+  for (const MaskSpan& span : m_mask->spans().row(y - maskBounds.y)) {
+    const int u1 = std::clamp(maskBounds.x + span.x - m_bounds.x, 0, w);
+    const int u2 = std::clamp(maskBounds.x + span.x2() - m_bounds.x, 0, w);
+    clear_bits(bits, u, u1);
+    u = std::max(u, u2);
+  }
+  clear_bits(bits, u, w);
+}
+
+/* flooder:
+ *  Fills a horizontal line around the specified position, and adds it
+ *  to the list of drawn segments. Returns the first x coordinate after
+ *  the part of the line which it has dealt with.
+ */
+int FloodFill::flooder(int x, int y)
+{
+  FLOODED_LINE *p;
+  int left, right;
+  int c;
+
+  const row_word_t* bits = row(y);
+  const int u = x - m_bounds.x;
+
+  // Check start pixel
+  if (!test_bit(bits, u))
+    return x+1;
+
+  // Work left and right from starting point
+  left = m_bounds.x + find_zero_left(bits, u-1, 0);
+  right = m_bounds.x + find_zero_right(bits, u+1, m_bounds.w);
+
   left++;
   right--;
 
   /* draw the line */
-  (*proc)(left, y, right, data);
+  (*m_proc)(left, y, right, m_data);
 
   /* store it in the list of flooded segments */
   c = y;
-  p = FLOOD_LINE(c);
+  p = &m_flood_buf[c];
 
   if (p->flags) {
     while (p->next) {
       c = p->next;
-      p = FLOOD_LINE(c);
+      p = &m_flood_buf[c];
     }
 
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
+    p->next = c = m_flood_count++;
+    m_flood_buf.resize(m_flood_count);
+    p = &m_flood_buf[c];
   }
 
   p->flags = FLOOD_IN_USE;
@@ -295,37 +492,31 @@ static int flooder(const Image* image,
   p->y = y;
   p->next = 0;
 
-  if (y > bounds.y)
+  if (y > m_bounds.y)
     p->flags |= FLOOD_TODO_ABOVE;
 
-  if (y+1 < bounds.y2())
+  if (y+1 < m_bounds.y2())
     p->flags |= FLOOD_TODO_BELOW;
 
   return right+2;
 }
 
-
-
 /* check_flood_line:
  *  Checks a line segment, using the scratch buffer is to store a list of
  *  segments which have already been drawn in order to minimise the required
  *  number of tests.
  */
-static int check_flood_line(const Image* image,
-                            const Mask* mask,
-                            int y, int left, int right,
-                            const gfx::Rect& bounds,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
+bool FloodFill::checkFloodLine(int y, int left, int right)
 {
   int c;
   FLOODED_LINE *p;
-  int ret = false;
+  bool ret = false;
 
   while (left <= right) {
     c = y;
 
     for (;;) {
-      p = FLOOD_LINE(c);
+      p = &m_flood_buf[c];
 
       if ((left >= p->lpos) && (left <= p->rpos)) {
         left = p->rpos+2;
@@ -335,7 +526,7 @@ static int check_flood_line(const Image* image,
       c = p->next;
 
       if (!c) {
-        left = flooder(image, mask, left, y, bounds, src_color, tolerance, data, proc);
+        left = flooder(left, y);
         ret = true;
         break;
       }
@@ -345,82 +536,25 @@ static int check_flood_line(const Image* image,
   return ret;
 }
 
-template<typename ImageTraits>
-static void replace_color(const Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void* data, AlgoHLine proc)
-{
-  typename ImageTraits::address_t address;
-
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
-
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
-
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
-            break;
-        }
-        (*proc)(x, y, right-1, data);
-        x = right;
-      }
-    }
-  }
-}
-
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
- */
-void floodfill(const Image* image,
-               const Mask* mask,
-               const int x, const int y,
-               const gfx::Rect& bounds,
-               const doc::color_t src_color,
-               const int tolerance,
-               const bool contiguous,
-               const bool isEightConnected,
-               void* data,
-               AlgoHLine proc)
+void FloodFill::fill(const int x, const int y,
+                     const bool isEightConnected)
 {
-  // Make sure we have a valid starting point
-  if ((x < 0) || (x >= image->width()) ||
-      (y < 0) || (y >= image->height()))
-    return;
-
-  // Non-contiguous case, we replace colors in the whole image.
-  if (!contiguous) {
-    switch (image->pixelFormat()) {
-      case IMAGE_RGB:
-        replace_color<RgbTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_GRAYSCALE:
-        replace_color<GrayscaleTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_INDEXED:
-        replace_color<IndexedTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_TILEMAP:
-        replace_color<TilemapTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-    }
-    return;
-  }
-
   /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = std::numeric_limits<int>::max();
-    p[c].rpos = std::numeric_limits<int>::min();
-    p[c].y = y;
-    p[c].next = 0;
+  m_flood_count = m_image->height();
+  m_flood_buf.resize(m_flood_count);
+  for (FLOODED_LINE& line : m_flood_buf) {
+    line.flags = 0;
+    line.lpos = std::numeric_limits<int>::max();
+    line.rpos = std::numeric_limits<int>::min();
+    line.y = y;
+    line.next = 0;
   }
 
+  const gfx::Rect& bounds = m_bounds;
+  FLOODED_LINE* p;
+
   // Start up the flood algorithm
-  flooder(image, mask, x, y, bounds, src_color, tolerance, data, proc);
+  flooder(x, y);
 
   // Continue as long as there are some segments still to test
   bool done;
@@ -428,8 +562,8 @@ void floodfill(const Image* image,
     done = true;
 
     // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-      p = FLOOD_LINE(c);
+    for (int c=0; c<m_flood_count; c++) {
+      p = &m_flood_buf[c];
 
       // Check below the segment?
       if (p->flags & FLOOD_TODO_BELOW) {
@@ -437,38 +571,33 @@ void floodfill(const Image* image,
 
         if (isEightConnected) {
           if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y+1, p->lpos+1, p->rpos)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y+1, p->lpos-1, p->rpos)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y+1, p->lpos, p->rpos+1)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y+1, p->lpos, p->rpos-1)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
         }
 
-        if (check_flood_line(image, mask, p->y+1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
+        if (checkFloodLine(p->y+1, p->lpos, p->rpos)) {
           done = false;
-          p = FLOOD_LINE(c);
+          p = &m_flood_buf[c];
         }
       }
 
@@ -478,36 +607,31 @@ void floodfill(const Image* image,
 
         if (isEightConnected) {
           if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y-1, p->lpos+1, p->rpos)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y-1, p->lpos-1, p->rpos)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y-1, p->lpos, p->rpos+1)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
 
           if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
+              checkFloodLine(p->y-1, p->lpos, p->rpos-1)) {
             done = false;
-            p = FLOOD_LINE(c);
+            p = &m_flood_buf[c];
           }
         }
 
-        if (check_flood_line(image, mask, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
+        if (checkFloodLine(p->y-1, p->lpos, p->rpos)) {
           done = false;
 
           // Special case shortcut for going backwards
@@ -519,5 +643,71 @@ void floodfill(const Image* image,
   } while (!done);
 }
 
+void FloodFill::replaceColor()
+{
+  for (int y=m_bounds.y; y<m_bounds.y2(); ++y) {
+    const row_word_t* bits = row(y);
+    int u = 0;
+    while (u < m_bounds.w) {
+      // Skip words without pixels to fill
+      if ((u % kRowWordBits) == 0 && bits[u / kRowWordBits] == 0) {
+        u += kRowWordBits;
+        continue;
+      }
+      if (!test_bit(bits, u)) {
+        ++u;
+        continue;
+      }
+
+      const int end = find_zero_right(bits, u+1, m_bounds.w);
+      (*m_proc)(m_bounds.x+u, y, m_bounds.x+end-1, m_data);
+      u = end;
+    }
+  }
+}
+
+} // anonymous namespace
+
+/* floodfill:
+ *  Fills an enclosed area (starting at point x, y) with the specified color.
+ */
+void floodfill(const Image* image,
+               const Mask* mask,
+               const int x, const int y,
+               const gfx::Rect& bounds,
+               const doc::color_t src_color,
+               const int tolerance,
+               const bool contiguous,
+               const bool isEightConnected,
+               void* data,
+               AlgoHLine proc)
+{
+  // Make sure we have a valid starting point
+  if ((x < 0) || (x >= image->width()) ||
+      (y < 0) || (y >= image->height()))
+    return;
+
+  // Non-contiguous case, we replace colors in the whole image.
+  if (!contiguous) {
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:
+      case IMAGE_GRAYSCALE:
+      case IMAGE_INDEXED:
+      case IMAGE_TILEMAP:
+        // The mask is not used in this case (the ink will use it)
+        FloodFill(image, nullptr, bounds, src_color, tolerance, data, proc)
+          .replaceColor();
+        break;
+    }
+    return;
+  }
+
+  if (!bounds.contains(gfx::Point(x, y)))
+    return;
+
+  FloodFill(image, mask, bounds, src_color, tolerance, data, proc)
+    .fill(x, y, isEightConnected);
+}
+
 } // namespace algorithm
 } // namespace doc
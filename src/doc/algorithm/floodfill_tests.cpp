@@ -0,0 +1,187 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+namespace {
+
+struct Filled {
+  ImageRef bitmap;
+  int hlines = 0;
+};
+
+void fill_hline(int x1, int y, int x2, void* data)
+{
+  Filled* filled = (Filled*)data;
+  for (int x=x1; x<=x2; ++x) {
+    // Each pixel must be filled just once
+    EXPECT_EQ(0, get_pixel(filled->bitmap.get(), x, y));
+    put_pixel(filled->bitmap.get(), x, y, 1);
+  }
+  ++filled->hlines;
+}
+
+bool equal_color(const Image* img, color_t a, color_t b, int tolerance)
+{
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB: {
+      if (rgba_geta(a) == 0 && rgba_geta(b) == 0)
+        return true;
+      return (std::abs(int(rgba_getr(a)) - int(rgba_getr(b))) <= tolerance &&
+              std::abs(int(rgba_getg(a)) - int(rgba_getg(b))) <= tolerance &&
+              std::abs(int(rgba_getb(a)) - int(rgba_getb(b))) <= tolerance &&
+              std::abs(int(rgba_geta(a)) - int(rgba_geta(b))) <= tolerance);
+    }
+    case IMAGE_GRAYSCALE: {
+      if (graya_geta(a) == 0 && graya_geta(b) == 0)
+        return true;
+      return (std::abs(int(graya_getv(a)) - int(graya_getv(b))) <= tolerance &&
+              std::abs(int(graya_geta(a)) - int(graya_geta(b))) <= tolerance);
+    }
+    case IMAGE_INDEXED:
+      return std::abs(int(a) - int(b)) <= tolerance;
+  }
+  return a == b;
+}
+
+// Simple reference implementation
+ImageRef reference_fill(const Image* img, const Mask* mask,
+                        int x, int y, int tolerance,
+                        bool contiguous, bool eight)
+{
+  ImageRef result(Image::create(IMAGE_BITMAP, img->width(), img->height()));
+  clear_image(result.get(), 0);
+
+  const color_t src = get_pixel(img, x, y);
+  auto inside = [&](int u, int v) {
+    return (equal_color(img, get_pixel(img, u, v), src, tolerance) &&
+            (!mask || !contiguous || mask->containsPoint(u, v)));
+  };
+
+  if (!contiguous) {
+    for (int v=0; v<img->height(); ++v)
+      for (int u=0; u<img->width(); ++u)
+        if (inside(u, v))
+          put_pixel(result.get(), u, v, 1);
+    return result;
+  }
+
+  std::vector<gfx::Point> stack;
+  if (inside(x, y)) {
+    stack.push_back(gfx::Point(x, y));
+    put_pixel(result.get(), x, y, 1);
+  }
+  while (!stack.empty()) {
+    gfx::Point pt = stack.back();
+    stack.pop_back();
+    for (int dv=-1; dv<=1; ++dv) {
+      for (int du=-1; du<=1; ++du) {
+        if ((du == 0 && dv == 0) || (!eight && du != 0 && dv != 0))
+          continue;
+        const int u = pt.x+du, v = pt.y+dv;
+        if (u < 0 || v < 0 || u >= img->width() || v >= img->height() ||
+            get_pixel(result.get(), u, v) || !inside(u, v))
+          continue;
+        put_pixel(result.get(), u, v, 1);
+        stack.push_back(gfx::Point(u, v));
+      }
+    }
+  }
+  return result;
+}
+
+color_t random_color(PixelFormat format)
+{
+  // Few different values to create regions
+  const int k = (std::rand() % 4) * 60;
+  switch (format) {
+    case IMAGE_RGB:
+      return rgba(k, k/2, 255-k, (std::rand() % 5) ? 255: 0);
+    case IMAGE_GRAYSCALE:
+      return graya(k, (std::rand() % 5) ? 255: 0);
+    default:
+      return k/60;
+  }
+}
+
+void test_fill(PixelFormat format, int w, int h, const Mask* mask)
+{
+  std::srand(w*h);
+  ImageRef img(Image::create(format, w, h));
+  for (int v=0; v<h; ++v)
+    for (int u=0; u<w; ++u)
+      put_pixel(img.get(), u, v, random_color(format));
+
+  for (int tolerance : { 0, 60 }) {
+    for (bool contiguous : { true, false }) {
+      for (bool eight : { false, true }) {
+        const int x = w/2, y = h/2;
+        Filled filled;
+        filled.bitmap.reset(Image::create(IMAGE_BITMAP, w, h));
+        clear_image(filled.bitmap.get(), 0);
+
+        floodfill(img.get(), mask, x, y, img->bounds(),
+                  get_pixel(img.get(), x, y), tolerance,
+                  contiguous, eight, &filled, fill_hline);
+
+        ImageRef expected = reference_fill(img.get(), mask, x, y,
+                                           tolerance, contiguous, eight);
+        EXPECT_TRUE(is_same_image(expected.get(), filled.bitmap.get()))
+          << "format=" << int(format) << " w=" << w << " h=" << h
+          << " tolerance=" << tolerance
+          << " contiguous=" << contiguous << " eight=" << eight;
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(FloodFill, MatchReference)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    test_fill(format, 1, 1, nullptr);
+    test_fill(format, 37, 23, nullptr);
+    test_fill(format, 130, 70, nullptr);
+  }
+}
+
+TEST(FloodFill, Mask)
+{
+  Mask mask;
+  mask.add(gfx::Rect(10, 5, 50, 30));
+  mask.subtract(gfx::Rect(30, 0, 3, 20));
+
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED })
+    test_fill(format, 80, 40, &mask);
+}
+
+TEST(FloodFill, LargeArea)
+{
+  // Big enough to classify rows in parallel
+  test_fill(IMAGE_RGB, 700, 600, nullptr);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2021 Igara Studio S.A.
+// Copyright (c) 2021-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,17 +11,29 @@
 
 #include "doc/algorithm/modify_selection.h"
 
+#include "doc/algorithm/distance_transform.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/mask.h"
-#include "doc/primitives.h"
+#include "doc/parallel.h"
 
-#include <memory>
+#include <cstddef>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
-// TODO create morphological operators/functions in "doc" namespace
-// TODO the impl is not optimal, but is good enough as a first version
+namespace {
+
+const int kRowsPerTask = 32;
+
+} // anonymous namespace
+
+// All modifiers are calculated with the distance from each pixel to
+// the nearest selected (Expand) or unselected (Contract/Border)
+// pixel, so the cost doesn't depend on the radius. The square brush
+// uses the Chebyshev distance and the circle brush the Euclidean
+// distance (a pixel is inside the circle if dx²+dy² <= radius²).
 void modify_selection(const SelectionModifier modifier,
                       const Mask* srcMask,
                       Mask* dstMask,
@@ -34,63 +46,88 @@ void modify_selection(const SelectionModifier modifier,
     srcMask->bounds().origin() -
     dstMask->bounds().origin();
 
-  // Image bounds to clip get/put pixels
-  const gfx::Rect srcBounds = srcImage->bounds();
-
-  // Create a kernel
-  const int size = 2*radius+1;
-  std::unique_ptr<doc::Image> kernel(doc::Image::create(IMAGE_BITMAP, size, size));
-  doc::clear_image(kernel.get(), 0);
-  if (brush == doc::kCircleBrushType)
-    doc::fill_ellipse(kernel.get(), 0, 0, size-1, size-1, 0, 0, 1);
-  else
-    doc::fill_rect(kernel.get(), 0, 0, size-1, size-1, 1);
-  doc::put_pixel(kernel.get(), radius, radius, 0);
-
-  int total = 0;                // Number of 1s in the kernel image
-  for (int v=0; v<size; ++v)
-    for (int u=0; u<size; ++u)
-      total += kernel->getPixel(u, v);
-
-  for (int y=-radius; y<srcBounds.h+radius; ++y) {
-    for (int x=-radius; x<srcBounds.w+radius; ++x) {
-      doc::color_t c;
-      if (srcBounds.contains(x, y))
-        c = srcImage->getPixel(x, y);
-      else
-        c = 0;
-
-      int accum = 0;
-      for (int v=0; v<size; ++v) {
-        for (int u=0; u<size; ++u) {
-          if (kernel->getPixel(u, v)) {
-            if (srcBounds.contains(x+u-radius, y+v-radius))
-              accum += srcImage->getPixel(x-radius+u, y-radius+v);
-          }
-        }
+  const DistanceMetric metric =
+    (brush == doc::kCircleBrushType ? DistanceMetric::Euclidean:
+                                      DistanceMetric::Chebyshev);
+  const int maxDist =
+    (metric == DistanceMetric::Euclidean ? radius*radius: radius);
+
+  // Grid of pixels where we calculate the distances: the expanded
+  // area of the source image, or the source image with a border of
+  // unselected pixels (the nearest unselected pixel outside the
+  // image is always in that border).
+  const int border = (modifier == SelectionModifier::Expand ? radius: 1);
+  const int w = srcImage->width() + 2*border;
+  const int h = srcImage->height() + 2*border;
+
+  // Features (selected pixels for Expand, unselected for
+  // Contract/Border), the rows/columns outside the source image are
+  // unselected.
+  const int srcW = srcImage->width();
+  const int srcH = srcImage->height();
+  const bool expand = (modifier == SelectionModifier::Expand);
+  std::vector<uint8_t> features(std::size_t(w)*h, expand ? 0: 1);
+  parallel_for(
+    0, srcH, kRowsPerTask,
+    [srcImage, srcW, border, w, expand, &features](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const auto srcRow = get_row_view<BitmapTraits>(srcImage, 0, y, srcW);
+        uint8_t* f = &features[std::size_t(y+border)*w + border];
+        for (int x=0; x<srcW; ++x)
+          f[x] = (expand ? srcRow[x]: !srcRow[x]);
       }
+    });
 
-      switch (modifier) {
-        case SelectionModifier::Border: {
-          c = (c && accum < total) ? 1: 0;
-          break;
-        }
-        case SelectionModifier::Expand: {
-          c = (c || accum > 0) ? 1: 0;
-          break;
-        }
-        case SelectionModifier::Contract: {
-          c = (c && accum == total) ? 1: 0;
-          break;
+  std::vector<int> dist(features.size());
+  distance_transform(w, h, features.data(), metric, dist.data());
+
+  // Write the result by rows in the destination bitmap (each row
+  // of a bitmap starts in its own byte, so rows can be written in
+  // parallel). Only the distances grid inside the destination bitmap
+  // is written.
+  const gfx::Rect dstBounds =
+    gfx::Rect(offset.x-border, offset.y-border, w, h) & dstImage->bounds();
+  if (dstBounds.isEmpty())
+    return;
+
+  dstImage->invalidateContentHash();
+  if (dstImage->isTiled())
+    dstImage->unshareTiles(dstBounds);
+
+  parallel_for(
+    dstBounds.y, dstBounds.y2(), kRowsPerTask,
+    [dstImage, dstBounds, offset, border, w, maxDist, modifier,
+     &features, &dist](const int y1, const int y2){
+      for (int dy=y1; dy<y2; ++dy) {
+        const RowView<BitmapTraits> dstRow(
+          (BitmapTraits::address_t)dstImage->getPixelAddress(dstBounds.x, dy),
+          dstBounds.x, dy, dstBounds.w);
+        const std::size_t i = std::size_t(dy-offset.y+border)*w
+                            + (dstBounds.x-offset.x+border);
+        const uint8_t* f = &features[i];
+        const int* d = &dist[i];
+
+        for (int x=0; x<dstBounds.w; ++x) {
+          bool c;
+          switch (modifier) {
+            case SelectionModifier::Border:
+              c = (!f[x] && d[x] <= maxDist);
+              break;
+            case SelectionModifier::Expand:
+              c = (d[x] <= maxDist);
+              break;
+            case SelectionModifier::Contract:
+              c = (!f[x] && d[x] > maxDist);
+              break;
+            default:
+              c = false;
+              break;
+          }
+          if (c)
+            dstRow.put(x, 1);
         }
       }
-
-      if (c)
-        doc::put_pixel(dstImage,
-                       offset.x+x,
-                       offset.y+y, 1);
-    }
-  }
+    });
 }
 
 } // namespace algorithm
@@ -0,0 +1,116 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/modify_selection.h"
+#include "doc/image.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+namespace {
+
+// Reference implementation: if there is a selected (Expand) or
+// unselected (Border/Contract) pixel in the brush area around each
+// pixel.
+bool reference_pixel(const SelectionModifier modifier,
+                     const Image* src,
+                     const int x, const int y,
+                     const int radius,
+                     const BrushType brush)
+{
+  auto selected = [src](int u, int v) {
+    return (src->bounds().contains(u, v) && src->getPixel(u, v) != 0);
+  };
+
+  const bool c = selected(x, y);
+  bool found = false;
+  for (int v=-radius; v<=radius && !found; ++v)
+    for (int u=-radius; u<=radius && !found; ++u) {
+      if (brush == kCircleBrushType && u*u+v*v > radius*radius)
+        continue;
+      if (modifier == SelectionModifier::Expand ?
+          selected(x+u, y+v): !selected(x+u, y+v))
+        found = true;
+    }
+
+  switch (modifier) {
+    case SelectionModifier::Border: return (c && found);
+    case SelectionModifier::Expand: return found;
+    case SelectionModifier::Contract: return (c && !found);
+  }
+  return false;
+}
+
+void test_mask(const Mask& srcMask)
+{
+  const gfx::Rect srcBounds = srcMask.bounds();
+  for (auto modifier : { SelectionModifier::Border,
+                         SelectionModifier::Expand,
+                         SelectionModifier::Contract }) {
+    for (auto brush : { kSquareBrushType, kCircleBrushType }) {
+      for (int radius : { 0, 1, 2, 5, 12 }) {
+        const gfx::Rect dstBounds = gfx::Rect(srcBounds).enlarge(radius);
+        Mask dstMask;
+        dstMask.reserve(dstBounds);
+        dstMask.freeze();
+        modify_selection(modifier, &srcMask, &dstMask, radius, brush);
+        dstMask.unfreeze();
+
+        for (int y=dstBounds.y; y<dstBounds.y2(); ++y)
+          for (int x=dstBounds.x; x<dstBounds.x2(); ++x) {
+            const bool expected =
+              reference_pixel(modifier, srcMask.bitmap(),
+                              x-srcBounds.x, y-srcBounds.y,
+                              radius, brush);
+            ASSERT_EQ(expected, dstMask.containsPoint(x, y))
+              << "modifier=" << int(modifier) << " brush=" << int(brush)
+              << " radius=" << radius << " x=" << x << " y=" << y;
+          }
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(ModifySelection, Rectangles)
+{
+  Mask mask;
+  mask.replace(gfx::Rect(10, 20, 16, 8));
+  test_mask(mask);
+
+  mask.add(gfx::Rect(20, 24, 12, 14));
+  mask.subtract(gfx::Rect(12, 22, 3, 3));
+  test_mask(mask);
+}
+
+TEST(ModifySelection, RandomPixels)
+{
+  std::srand(1);
+  Mask mask;
+  mask.replace(gfx::Rect(-3, 5, 23, 17));
+  for (int y=0; y<17; ++y)
+    for (int x=0; x<23; ++x)
+      if (std::rand() % 3 == 0)
+        put_pixel(mask.bitmap(), x, y, 0);
+  test_mask(mask);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -57,7 +57,18 @@ bool algorithm::createUnion(std::vector<int>& pairs,
   else if (ints%2 == 1)
     ints--;
 
-  for (int i=0; i < ints; i+=2) {
+  // As "pairs" is sorted, we can skip the segments that are
+  // completely before "x" (x > pairs[i+1] + 1) with a binary search.
+  int lo = 0, hi = ints/2;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (pairs[2*mid+1] + 1 < x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (int i=2*lo; i < ints; i+=2) {
     // Case:     pairs[i]      pairs[i+1]
     //               O --------- O
     //            -x-
@@ -162,39 +173,66 @@ void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine p
     }
   }
 
+  // Edge table: each pair of consecutive points of the contour is an
+  // edge (from top to bottom, horizontal edges are discarded), and
+  // edges are sorted by their top "y" coordinate. In this way we can
+  // keep an active edge list for the current scan line instead of
+  // intersecting all edges with each scan line.
+  struct Edge {
+    int x1, y1, x2, y2;
+  };
+  std::vector<Edge> edges;
+  edges.reserve(pts.size());
+  for (int i=0; i < pts.size(); i++) {
+    const int ind1 = (i == 0 ? pts.size() - 1: i - 1);
+    const int ind2 = i;
+    if (pts[ind1].y < pts[ind2].y)
+      edges.push_back(Edge{ pts[ind1].x, pts[ind1].y, pts[ind2].x, pts[ind2].y });
+    else if (pts[ind1].y > pts[ind2].y)
+      edges.push_back(Edge{ pts[ind2].x, pts[ind2].y, pts[ind1].x, pts[ind1].y });
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const Edge& a, const Edge& b){
+                     return a.y1 < b.y1;
+                   });
+
+  // Indexes of the contour points in each scan line (in the same
+  // order of "pts", as they are joined with createUnion() in that
+  // order).
+  const int rows = ymax - ymin + 1;
+  std::vector<int> rowPts(rows+1, 0);
+  std::vector<int> ptsByRow(pts.size());
+  for (const gfx::Point& pt : pts)
+    ++rowPts[pt.y - ymin + 1];
+  for (int i=0; i < rows; i++)
+    rowPts[i+1] += rowPts[i];
+  {
+    std::vector<int> next(rowPts.begin(), rowPts.end()-1);
+    for (int i=0; i < pts.size(); i++)
+      ptsByRow[next[pts[i].y - ymin]++] = i;
+  }
+
   // Scan Line Loop:
-  int y;
-  int x1, y1;
-  int x2, y2;
-  int ind1, ind2;
-  int ints;
-  std::vector<int> polyInts(pts.size());
-  for (y = ymin; y <= ymax; y++) {
-    ints = 0;
-    for (int i=0; i < pts.size(); i++) {
-      if (!i) {
-        ind1 = pts.size() - 1;
-        ind2 = 0;
-      }
-      else {
-        ind1 = i - 1;
-        ind2 = i;
-      }
-      y1 = pts[ind1].y;
-      y2 = pts[ind2].y;
-      if (y1 < y2) {
-        x1 = pts[ind1].x;
-        x2 = pts[ind2].x;
-      }
-      else if (y1 > y2) {
-        y2 = pts[ind1].y;
-        y1 = pts[ind2].y;
-        x2 = pts[ind1].x;
-        x1 = pts[ind2].x;
-      }
-      else
-        continue;
+  std::vector<const Edge*> active;
+  std::vector<int> polyInts;
+  int nextEdge = 0;
+  for (int y = ymin; y <= ymax; y++) {
+    // Add the edges that start in this scan line, and remove the
+    // edges that are above it (except in the last scan line, where
+    // we use the bottom point of edges that end there).
+    for (; nextEdge < edges.size() && edges[nextEdge].y1 <= y; ++nextEdge)
+      active.push_back(&edges[nextEdge]);
+    if (y < ymax) {
+      active.erase(std::remove_if(active.begin(), active.end(),
+                                  [y](const Edge* e){ return e->y2 <= y; }),
+                   active.end());
+    }
 
+    int ints = 0;
+    polyInts.resize(active.size());
+    for (const Edge* e : active) {
+      const int x1 = e->x1, y1 = e->y1;
+      const int x2 = e->x2, y2 = e->y2;
       if ((y >= y1 && y < y2) ||
           (y == ymax && y > y1 && y <= y2)) {
         polyInts[ints] = (int) ((float)((y - y1)*(x2 - x1)) / (float)(y2 - y1) + 0.5f + (float)x1);
@@ -202,14 +240,15 @@ void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine p
       }
     }
 
-    std::sort(polyInts.begin(), polyInts.begin() + ints);
+    // Keep "polyInts" with the used size, so createUnion() doesn't
+    // move unused elements when it inserts new segments.
+    polyInts.resize(ints);
+    std::sort(polyInts.begin(), polyInts.end());
 
-    for (int i=0; i < pts.size(); i++) {
-      if (pts[i].y == y)
-        createUnion(polyInts, pts[i].x, ints);
-    }
+    for (int j=rowPts[y - ymin]; j < rowPts[y - ymin + 1]; j++)
+      createUnion(polyInts, pts[ptsByRow[j]].x, ints);
 
-    for (int i=0; i < ints; i+=2)
+    for (int i=0; i+1 < ints; i+=2)
       proc(polyInts[i], y, polyInts[i+1], data);
   }
 }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -822,6 +822,27 @@ TEST(createUnion, testC10)
   EXPECT_EQ(ints, 2);
 }
 
+TEST(Polygon, ManyPoints)
+{
+  // Contour of a 200x100 rectangle with one point for each pixel of
+  // its border (like a lasso selection)
+  std::vector<int> points;
+  for (int x=0; x<200; ++x) { points.push_back(x); points.push_back(0); }
+  for (int y=1; y<100; ++y) { points.push_back(199); points.push_back(y); }
+  for (int x=198; x>=0; --x) { points.push_back(x); points.push_back(99); }
+  for (int y=98; y>0; --y) { points.push_back(0); points.push_back(y); }
+
+  ScanLineResult results;
+  doc::algorithm::polygon(points.size()/2, &points[0],
+                          &results, captureHscanSegment);
+
+  ASSERT_EQ(100, results.scanLines.size());
+  for (int y=0; y<100; ++y) {
+    EXPECT_EQ(0, results.scanLines[y].x1);
+    EXPECT_EQ(199, results.scanLines[y].x2);
+    EXPECT_EQ(y, results.scanLines[y].y);
+  }
+}
 
 int main(int argc, char** argv)
 {
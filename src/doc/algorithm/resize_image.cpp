@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,35 +13,407 @@
 
 #include "doc/algorithm/rotsprite.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 #include "gfx/point.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Source coordinates for each destination pixel of one axis (columns
+// or rows). These tables depend only on the source/destination sizes
+// so they are cached to be reused when we resize several images
+// (e.g. all frames of a sprite) to the same size.
+struct ResizeAxis {
+  std::vector<int> index0;      // First source pixel
+  std::vector<int> index1;      // Second source pixel (bilinear)
+  std::vector<double> weight1;  // Weight of the second source pixel (bilinear)
+};
+
+using ResizeAxisPtr = std::shared_ptr<const ResizeAxis>;
+
+ResizeAxisPtr create_nearest_axis(const int srcSize, const int dstSize)
+{
+  auto axis = std::make_shared<ResizeAxis>();
+  const double ratio = double(srcSize) / double(dstSize);
+  axis->index0.resize(dstSize);
+  for (int i=0; i<dstSize; ++i)
+    axis->index0[i] = int(std::floor(i * ratio));
+  return axis;
+}
+
+ResizeAxisPtr create_bilinear_axis(const int srcSize, const int dstSize)
+{
+  auto axis = std::make_shared<ResizeAxis>();
+  axis->index0.resize(dstSize);
+  axis->index1.resize(dstSize);
+  axis->weight1.resize(dstSize);
+
+  // We accumulate the position in the same way as the old per-pixel
+  // implementation to get exactly the same results.
+  const double d = (srcSize-1) * 1.0 / (dstSize-1);
+  double t = 0.0;
+  for (int i=0; i<dstSize; ++i, t+=d) {
+    int i0 = (int)std::floor(t);
+    int i1;
+    if (i0 > srcSize-1) {
+      i0 = srcSize-1;
+      i1 = srcSize-1;
+    }
+    else if (i0 == srcSize-1)
+      i1 = i0;
+    else
+      i1 = i0+1;
+
+    axis->index0[i] = i0;
+    axis->index1[i] = i1;
+    axis->weight1[i] = t - i0;
+  }
+  return axis;
+}
+
+ResizeAxisPtr get_resize_axis(const ResizeMethod method,
+                              const int srcSize,
+                              const int dstSize)
+{
+  struct Entry {
+    ResizeMethod method;
+    int srcSize, dstSize;
+    ResizeAxisPtr axis;
+  };
+  const int kMaxEntries = 8;
+  static std::mutex mutex;
+  static std::vector<Entry> entries;
+
+  const std::lock_guard lock(mutex);
+  for (auto it=entries.begin(); it!=entries.end(); ++it) {
+    if (it->method == method &&
+        it->srcSize == srcSize &&
+        it->dstSize == dstSize) {
+      return it->axis;
+    }
+  }
+
+  ResizeAxisPtr axis =
+    (method == RESIZE_METHOD_BILINEAR ? create_bilinear_axis(srcSize, dstSize):
+                                        create_nearest_axis(srcSize, dstSize));
+  if (int(entries.size()) >= kMaxEntries)
+    entries.erase(entries.begin());
+  entries.push_back(Entry{ method, srcSize, dstSize, axis });
+  return axis;
+}
+
+// Number of destination rows processed by each parallel_for() chunk.
+int rows_per_chunk(const Image* dst)
+{
+  return std::max(1, 32*1024 / std::max(1, dst->width()));
+}
+
 template<typename ImageTraits>
 void resize_image_nearest(const Image* src, Image* dst)
 {
-  double x_ratio = double(src->width()) / double(dst->width());
-  double y_ratio = double(src->height()) / double(dst->height());
-  double px, py;
-
-  LockImageBits<ImageTraits> dstBits(dst);
-  auto dstIt = dstBits.begin();
-
-  for (int y=0; y<dst->height(); ++y) {
-    py = std::floor(y * y_ratio);
-    for (int x=0; x<dst->width(); ++x, ++dstIt) {
-      px = std::floor(x * x_ratio);
-      *dstIt = get_pixel_fast<ImageTraits>(src, int(px), int(py));
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  const ResizeAxisPtr xAxis = get_resize_axis(RESIZE_METHOD_NEAREST_NEIGHBOR, src->width(), dst->width());
+  const ResizeAxisPtr yAxis = get_resize_axis(RESIZE_METHOD_NEAREST_NEIGHBOR, src->height(), dst->height());
+  const int* xs = xAxis->index0.data();
+  const int* ys = yAxis->index0.data();
+  const int w = dst->width();
+
+  // Prepare the whole destination image to be modified from several
+  // threads.
+  const LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock);
+
+  parallel_for(
+    0, dst->height(), rows_per_chunk(dst),
+    [=](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const pixel_t* srcRow = (const pixel_t*)src->getPixelAddress(0, ys[y]);
+        pixel_t* dstRow = (pixel_t*)dst->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x)
+          dstRow[x] = srcRow[xs[x]];
+      }
+    });
+}
+
+template<>
+void resize_image_nearest<BitmapTraits>(const Image* src, Image* dst)
+{
+  const ResizeAxisPtr xAxis = get_resize_axis(RESIZE_METHOD_NEAREST_NEIGHBOR, src->width(), dst->width());
+  const ResizeAxisPtr yAxis = get_resize_axis(RESIZE_METHOD_NEAREST_NEIGHBOR, src->height(), dst->height());
+  const int* xs = xAxis->index0.data();
+  const int* ys = yAxis->index0.data();
+  const int w = dst->width();
+
+  const LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
+
+  // Each row uses its own bytes, so rows can be processed in
+  // parallel too.
+  parallel_for(
+    0, dst->height(), rows_per_chunk(dst),
+    [=](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y)
+        for (int x=0; x<w; ++x)
+          put_pixel_fast<BitmapTraits>(dst, x, y,
+                                       get_pixel_fast<BitmapTraits>(src, xs[x], ys[y]));
+    });
+}
+
+// Bilinear interpolation is separable: we interpolate source rows
+// horizontally (keeping the intermediate values as doubles) and then
+// we interpolate vertically two of these rows. The result is the
+// same as interpolating the 4 neighbors for each pixel, but each
+// source row is interpolated horizontally only once for all the
+// destination rows that use it.
+class BilinearResizer {
+  // Channels of the horizontally interpolated rows
+  static constexpr int kChannels = 4;
+
+public:
+  BilinearResizer(const Image* src, Image* dst,
+                  const Palette* pal, const RgbMap* rgbmap,
+                  const color_t maskColor)
+    : m_src(src), m_dst(dst)
+    , m_pal(pal), m_rgbmap(rgbmap)
+    , m_maskColor(maskColor)
+    , m_xAxis(get_resize_axis(RESIZE_METHOD_BILINEAR, src->width(), dst->width()))
+    , m_yAxis(get_resize_axis(RESIZE_METHOD_BILINEAR, src->height(), dst->height())) {
+  }
+
+  void resize() {
+    switch (m_dst->pixelFormat()) {
+      case IMAGE_RGB: {
+        const LockImageBits<RgbTraits> dstBits(m_dst, Image::WriteLock);
+        parallel_for(0, m_dst->height(), rows_per_chunk(m_dst),
+                     [this](int y1, int y2){ resizeRows(y1, y2); });
+        break;
+      }
+      case IMAGE_GRAYSCALE: {
+        const LockImageBits<GrayscaleTraits> dstBits(m_dst, Image::WriteLock);
+        parallel_for(0, m_dst->height(), rows_per_chunk(m_dst),
+                     [this](int y1, int y2){ resizeRows(y1, y2); });
+        break;
+      }
+      case IMAGE_INDEXED: {
+        // RgbMap::mapColor() can modify its internal cache, so we
+        // cannot use it from several threads.
+        const LockImageBits<IndexedTraits> dstBits(m_dst, Image::WriteLock);
+        resizeRows(0, m_dst->height());
+        break;
+      }
     }
   }
+
+private:
+  void resizeRows(const int y1, const int y2) {
+    const int w = m_dst->width();
+    Row rows[2];
+
+    for (int y=y1; y<y2; ++y) {
+      const int v0 = m_yAxis->index0[y];
+      const int v1 = m_yAxis->index1[y];
+      const double* h0 = horizontalRow(rows, v0);
+      const double* h1 = horizontalRow(rows, v1);
+      const double wv1 = m_yAxis->weight1[y];
+      const double wv0 = 1 - wv1;
+      uint8_t* dstAddress = m_dst->getPixelAddress(0, y);
+
+      switch (m_dst->pixelFormat()) {
+        case IMAGE_RGB: {
+          uint32_t* dstRow = (uint32_t*)dstAddress;
+          for (int x=0; x<w; ++x, h0+=kChannels, h1+=kChannels) {
+            dstRow[x] = rgba(int(h0[0]*wv0 + h1[0]*wv1),
+                             int(h0[1]*wv0 + h1[1]*wv1),
+                             int(h0[2]*wv0 + h1[2]*wv1),
+                             int(h0[3]*wv0 + h1[3]*wv1));
+          }
+          break;
+        }
+        case IMAGE_GRAYSCALE: {
+          uint16_t* dstRow = (uint16_t*)dstAddress;
+          for (int x=0; x<w; ++x, h0+=kChannels, h1+=kChannels) {
+            dstRow[x] = graya(int(h0[0]*wv0 + h1[0]*wv1),
+                              int(h0[1]*wv0 + h1[1]*wv1));
+          }
+          break;
+        }
+        case IMAGE_INDEXED: {
+          uint8_t* dstRow = dstAddress;
+          for (int x=0; x<w; ++x, h0+=kChannels, h1+=kChannels) {
+            dstRow[x] = m_rgbmap->mapColor(int(h0[0]*wv0 + h1[0]*wv1),
+                                           int(h0[1]*wv0 + h1[1]*wv1),
+                                           int(h0[2]*wv0 + h1[2]*wv1),
+                                           int(h0[3]*wv0 + h1[3]*wv1));
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  // Cached horizontally interpolated source row
+  struct Row {
+    int v = -1;
+    std::vector<double> values;
+  };
+
+  // Returns the source row "v" interpolated horizontally using one
+  // of the two given cached rows.
+  const double* horizontalRow(Row rows[2], const int v) {
+    if (rows[0].v == v) return rows[0].values.data();
+    if (rows[1].v == v) return rows[1].values.data();
+
+    // Replace the row that is not the previous source row (rows are
+    // processed from top to bottom, so we'll not need the oldest one).
+    Row& row = (rows[0].v < rows[1].v ? rows[0]: rows[1]);
+    row.v = v;
+    row.values.resize(std::size_t(m_dst->width()) * kChannels);
+    interpolateRow(v, row.values.data());
+    return row.values.data();
+  }
+
+  void interpolateRow(const int v, double* out) {
+    const int w = m_dst->width();
+    const int* xs0 = m_xAxis->index0.data();
+    const int* xs1 = m_xAxis->index1.data();
+    const double* ws1 = m_xAxis->weight1.data();
+    const uint8_t* srcAddress = m_src->getPixelAddress(0, v);
+
+    switch (m_dst->pixelFormat()) {
+      case IMAGE_RGB: {
+        const uint32_t* srcRow = (const uint32_t*)srcAddress;
+        for (int x=0; x<w; ++x, out+=kChannels) {
+          const color_t c0 = srcRow[xs0[x]];
+          const color_t c1 = srcRow[xs1[x]];
+          const double u1 = ws1[x];
+          const double u2 = 1 - u1;
+          out[0] = rgba_getr(c0)*u2 + rgba_getr(c1)*u1;
+          out[1] = rgba_getg(c0)*u2 + rgba_getg(c1)*u1;
+          out[2] = rgba_getb(c0)*u2 + rgba_getb(c1)*u1;
+          out[3] = rgba_geta(c0)*u2 + rgba_geta(c1)*u1;
+        }
+        break;
+      }
+      case IMAGE_GRAYSCALE: {
+        const uint16_t* srcRow = (const uint16_t*)srcAddress;
+        for (int x=0; x<w; ++x, out+=kChannels) {
+          const color_t c0 = srcRow[xs0[x]];
+          const color_t c1 = srcRow[xs1[x]];
+          const double u1 = ws1[x];
+          const double u2 = 1 - u1;
+          out[0] = graya_getv(c0)*u2 + graya_getv(c1)*u1;
+          out[1] = graya_geta(c0)*u2 + graya_geta(c1)*u1;
+        }
+        break;
+      }
+      case IMAGE_INDEXED: {
+        const uint8_t* srcRow = srcAddress;
+        for (int x=0; x<w; ++x, out+=kChannels) {
+          const color_t c0 = paletteColor(srcRow[xs0[x]]);
+          const color_t c1 = paletteColor(srcRow[xs1[x]]);
+          const double u1 = ws1[x];
+          const double u2 = 1 - u1;
+          out[0] = rgba_getr(c0)*u2 + rgba_getr(c1)*u1;
+          out[1] = rgba_getg(c0)*u2 + rgba_getg(c1)*u1;
+          out[2] = rgba_getb(c0)*u2 + rgba_getb(c1)*u1;
+          out[3] = rgba_geta(c0)*u2 + rgba_geta(c1)*u1;
+        }
+        break;
+      }
+    }
+  }
+
+  // Converts an index to RGBA values
+  color_t paletteColor(const color_t index) const {
+    if (index == m_maskColor)
+      return m_pal->getEntry(index) & rgba_rgb_mask; // Set alpha = 0
+    else
+      return m_pal->getEntry(index);
+  }
+
+  const Image* m_src;
+  Image* m_dst;
+  const Palette* m_pal;
+  const RgbMap* m_rgbmap;
+  const color_t m_maskColor;
+  const ResizeAxisPtr m_xAxis;
+  const ResizeAxisPtr m_yAxis;
+};
+
+// Replaces the color of each completely-transparent pixel with the
+// average color of the non-transparent pixels in its 3x3
+// neighborhood (keeping the alpha=0). Only RGB and grayscale images
+// are supported.
+template<typename ImageTraits>
+void fixup_image_transparent_colors_templ(Image* image)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  constexpr bool rgb = (ImageTraits::pixel_format == IMAGE_RGB);
+  const int w = image->width();
+  const int h = image->height();
+
+  for_each_row<ImageTraits>(
+    image,
+    [image, w, h](const RowView<ImageTraits>& row){
+      // Rows of the 3x3 neighborhood (including the modified row,
+      // which is fine as only alpha>0 pixels are used)
+      const pixel_t* rows[3];
+      int nrows = 0;
+      for (int y=std::max(row.y()-1, 0); y<=std::min(row.y()+1, h-1); ++y)
+        rows[nrows++] = get_row_view<ImageTraits>(image, 0, y, w).data();
+
+      pixel_t* dst = row.data();
+      for (int x=0; x<w; ++x) {
+        if (rgb ? rgba_geta(dst[x]) != 0:
+                  graya_geta(dst[x]) != 0)
+          continue;
+
+        const int x1 = std::max(x-1, 0);
+        const int x2 = std::min(x+1, w-1);
+        int r = 0, g = 0, b = 0, count = 0;
+        for (int i=0; i<nrows; ++i) {
+          for (int u=x1; u<=x2; ++u) {
+            const pixel_t c = rows[i][u];
+            if constexpr (rgb) {
+              if (rgba_geta(c) > 0) {
+                r += rgba_getr(c);
+                g += rgba_getg(c);
+                b += rgba_getb(c);
+                ++count;
+              }
+            }
+            else {
+              if (graya_geta(c) > 0) {
+                r += graya_getv(c);
+                ++count;
+              }
+            }
+          }
+        }
+
+        if (count > 0) {
+          if constexpr (rgb)
+            dst[x] = rgba(r / count, g / count, b / count, 0);
+          else
+            dst[x] = graya(r / count, 0);
+        }
+      }
+    });
 }
 
+} // anonymous namespace
+
 void resize_image(const Image* src,
                   Image* dst,
                   const ResizeMethod method,
@@ -51,7 +423,6 @@ void resize_image(const Image* src,
 {
   switch (method) {
 
-    // TODO optimize this
     case RESIZE_METHOD_NEAREST_NEIGHBOR: {
       ASSERT(src->pixelFormat() == dst->pixelFormat());
 
@@ -64,18 +435,16 @@ void resize_image(const Image* src,
       break;
     }
 
-    // TODO optimize this
     case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
+      ASSERT(src->pixelFormat() == dst->pixelFormat());
 
       // We cannot do interpolations between RGB values on indexed
-      // images without a palette/rgbmap.
-      if (dst->pixelFormat() == IMAGE_INDEXED &&
-          (!pal || !rgbmap)) {
+      // images without a palette/rgbmap (and we cannot interpolate
+      // bitmaps).
+      if ((dst->pixelFormat() == IMAGE_INDEXED && (!pal || !rgbmap)) ||
+          (dst->pixelFormat() != IMAGE_RGB &&
+           dst->pixelFormat() != IMAGE_GRAYSCALE &&
+           dst->pixelFormat() != IMAGE_INDEXED)) {
         resize_image(
           src, dst,
           RESIZE_METHOD_NEAREST_NEIGHBOR,
@@ -83,93 +452,7 @@ void resize_image(const Image* src,
         return;
       }
 
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)std::floor(u);
-          v_floor = (int)std::floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              // Convert index to RGBA values
-              for (int i=0; i<4; ++i) {
-                if (color[i] == maskColor)
-                  color[i] = pal->getEntry(color[i]) & rgba_rgb_mask; // Set alpha = 0
-                else
-                  color[i] = pal->getEntry(color[i]);
-              }
-
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgbmap->mapColor(r, g, b, a);
-              break;
-            }
-          }
-
-          dst->putPixel(x, y, dst_color);
-          u += du;
-        }
-        u = 0.0;
-        v += dv;
-      }
+      BilinearResizer(src, dst, pal, rgbmap, maskColor).resize();
       break;
     }
 
@@ -188,86 +471,13 @@ void resize_image(const Image* src,
 
 void fixup_image_transparent_colors(Image* image)
 {
-  int x, y;
-
   switch (image->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      int r, g, b, count;
-      LockImageBits<RgbTraits> bits(image);
-      LockImageBits<RgbTraits>::iterator it = bits.begin();
-
-      for (y=0; y<image->height(); ++y) {
-        for (x=0; x<image->width(); ++x, ++it) {
-          uint32_t c = *it;
-
-          // if this is a completely-transparent pixel...
-          if (rgba_geta(c) == 0) {
-            count = 0;
-            r = g = b = 0;
-
-            gfx::Rect area = gfx::Rect(x-1, y-1, 3, 3).createIntersection(image->bounds());
-            LockImageBits<RgbTraits>::iterator it2 = bits.begin_area(area);
-            LockImageBits<RgbTraits>::iterator end2 = bits.end_area(area);
-
-            for (; it2 != end2; ++it2) {
-              c = *it2;
-              if (rgba_geta(c) > 0) {
-                r += rgba_getr(c);
-                g += rgba_getg(c);
-                b += rgba_getb(c);
-                ++count;
-              }
-            }
-
-            if (count > 0) {
-              r /= count;
-              g /= count;
-              b /= count;
-              *it = rgba(r, g, b, 0);
-            }
-          }
-        }
-      }
+    case IMAGE_RGB:
+      fixup_image_transparent_colors_templ<RgbTraits>(image);
       break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      int k, count;
-      LockImageBits<GrayscaleTraits> bits(image);
-      LockImageBits<GrayscaleTraits>::iterator it = bits.begin();
-
-      for (y=0; y<image->height(); ++y) {
-        for (x=0; x<image->width(); ++x, ++it) {
-          uint16_t c = *it;
-
-          // If this is a completely-transparent pixel...
-          if (graya_geta(c) == 0) {
-            count = 0;
-            k = 0;
-
-            gfx::Rect area = gfx::Rect(x-1, y-1, 3, 3).createIntersection(image->bounds());
-            LockImageBits<GrayscaleTraits>::iterator it2 = bits.begin_area(area);
-            LockImageBits<GrayscaleTraits>::iterator end2 = bits.end_area(area);
-
-            for (; it2 != end2; ++it2) {
-              c = *it2;
-              if (graya_geta(c) > 0) {
-                k += graya_getv(c);
-                ++count;
-              }
-            }
-
-            if (count > 0) {
-              k /= count;
-              *it = graya(k, 0);
-            }
-          }
-        }
-      }
+    case IMAGE_GRAYSCALE:
+      fixup_image_transparent_colors_templ<GrayscaleTraits>(image);
       break;
-    }
-
   }
 }
 
@@ -14,12 +14,16 @@
 #include "base/pi.h"
 #include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 #include "fixmath/fixmath.h"
 
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -39,48 +43,50 @@ static void ase_rotate_scale_flip_coordinates(
   int h_flip, int v_flip,
   fixed xs[4], fixed ys[4]);
 
+// Number of rows processed by each parallel task
+const int kRowsPerTask = 32;
+
 template<typename ImageTraits, typename BlendFunc>
 static void image_scale_tpl(
   Image* dst, const Image* src,
   int dst_x, int dst_y, int dst_w, int dst_h,
   int src_x, int src_y, int src_w, int src_h, BlendFunc blend)
 {
-  LockImageBits<ImageTraits> dst_bits(dst, gfx::Rect(dst_x, dst_y, dst_w, dst_h));
-  typename LockImageBits<ImageTraits>::iterator dst_it = dst_bits.begin();
-  fixed x, first_x = itofix(src_x);
-  fixed y = itofix(src_y);
-  fixed dx = fixdiv(itofix(src_w-1), itofix(dst_w-1));
-  fixed dy = fixdiv(itofix(src_h-1), itofix(dst_h-1));
-  int old_x, new_x;
-
-  for (int v=0; v<dst_h; ++v) {
-    old_x = fixtoi(x = first_x);
-
-    const LockImageBits<ImageTraits> src_bits(src, gfx::Rect(src_x, fixtoi(y), src_w, 1));
-    auto src_it = src_bits.begin();
-
-    for (int u=0; u<dst_w; ++u) {
-      ASSERT(dst_it != dst_bits.end());
-
-      *dst_it = blend(*dst_it, *src_it);
-      ++dst_it;
-
-      x = fixadd(x, dx);
-      new_x = fixtoi(x);
-      if (old_x != new_x) {
-        // We don't want to move the "src_it" iterator outside the src
-        // image bounds.
-        if (new_x < src_w) {
-          src_it += (new_x - old_x);
-          old_x = new_x;
+  const fixed first_x = itofix(src_x);
+  const fixed first_y = itofix(src_y);
+  const fixed dx = fixdiv(itofix(src_w-1), itofix(dst_w-1));
+  const fixed dy = fixdiv(itofix(src_h-1), itofix(dst_h-1));
+
+  // Rows are written directly from several threads
+  dst->unshareTiles(gfx::Rect(dst_x, dst_y, dst_w, dst_h));
+  dst->invalidateContentHash();
+
+  parallel_for(
+    0, dst_h, kRowsPerTask,
+    [=](const int v1, const int v2){
+      fixed y = fixed(first_y + int64_t(v1)*dy);
+
+      for (int v=v1; v<v2; ++v) {
+        const RowView<ImageTraits> dstRow(
+          (typename ImageTraits::address_t)dst->getPixelAddress(dst_x, dst_y+v),
+          dst_x, dst_y+v, dst_w);
+        const auto srcRow = get_row_view<ImageTraits>(src, 0, fixtoi(y), src_x+src_w);
+
+        fixed x = first_x;
+        int src_u = fixtoi(x);
+        for (int u=0; u<dst_w; ++u) {
+          dstRow.put(u, blend(dstRow[u], srcRow[src_u]));
+
+          // We don't want to read pixels outside the src image bounds
+          x = fixadd(x, dx);
+          src_u = fixtoi(x);
+          if (src_u >= src_x+src_w)
+            break;
         }
-        else
-          break;
-      }
-    }
 
-    y = fixadd(y, dy);
-  }
+        y = fixadd(y, dy);
+      }
+    });
 }
 
 static color_t rgba_blender(color_t back, color_t front) {
@@ -95,7 +101,7 @@ class if_blender {
 public:
   if_blender(color_t mask) : m_mask(mask) {
   }
-  color_t operator()(color_t back, color_t front) {
+  color_t operator()(color_t back, color_t front) const {
     if (front != m_mask)
       return front;
     else
@@ -227,8 +233,11 @@ static void draw_scanline(
 template<class Traits>
 class GenericDelegate {
 public:
+  // The const lockBits() is used because the tiles were unshared and
+  // the content hash invalidated before drawing scanlines in
+  // parallel.
   void lockBits(Image* bmp, const gfx::Rect& bounds) {
-    m_bits = bmp->lockBits<Traits>(Image::ReadWriteLock, bounds);
+    m_bits = static_cast<const Image*>(bmp)->lockBits<Traits>(Image::ReadWriteLock, bounds);
     m_it = m_bits.begin();
     m_end = m_bits.end();
   }
@@ -538,6 +547,18 @@ static void ase_parallelogram_map(
    * Loop through scanlines.
    */
 
+  /* Scanlines are calculated incrementally (as the rounding errors
+     are accumulated from one scanline to the next one) but they are
+     drawn later in parallel. */
+  struct Scanline {
+    fixed l_bmp_x;
+    int bmp_y_i;
+    fixed r_bmp_x;
+    fixed l_spr_x, l_spr_y;
+  };
+  std::vector<Scanline> scanlines;
+  scanlines.reserve(clip_bottom_i - bmp_y_i);
+
   while (1) {
     /* Has beginning of scanline passed a corner? */
     if (bmp_y_i >= l_bmp_y_bottom_i) {
@@ -713,10 +734,8 @@ static void ase_parallelogram_map(
           }
         }
       }
-      draw_scanline<Traits, Delegate>(bmp, spr, mask,
-        l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
-        l_spr_x_rounded, l_spr_y_rounded,
-        spr_dx, spr_dy, delegate);
+      scanlines.push_back(Scanline{ l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
+                                    l_spr_x_rounded, l_spr_y_rounded });
 
     }
     /* I'm not going to apoligize for this label and its gotos: to get
@@ -736,6 +755,29 @@ static void ase_parallelogram_map(
     r_spr_y += r_spr_dy;
 #endif
   }
+
+  if (scanlines.empty())
+    return;
+
+  /* Each scanline is in a different row, so they can be drawn from
+     several threads (each one with its own delegate copy). */
+  bmp->unshareTiles(gfx::Rect(0, scanlines.front().bmp_y_i,
+                              bmp->width(),
+                              scanlines.back().bmp_y_i - scanlines.front().bmp_y_i + 1));
+  bmp->invalidateContentHash();
+
+  parallel_for(
+    0, int(scanlines.size()), kRowsPerTask,
+    [&scanlines, bmp, spr, mask, spr_dx, spr_dy, &delegate](const int i1, const int i2){
+      Delegate taskDelegate = delegate;
+      for (int i=i1; i<i2; ++i) {
+        const Scanline& sl = scanlines[i];
+        draw_scanline<Traits, Delegate>(bmp, spr, mask,
+          sl.l_bmp_x, sl.bmp_y_i, sl.r_bmp_x,
+          sl.l_spr_x, sl.l_spr_y,
+          spr_dx, spr_dy, taskDelegate);
+      }
+    });
 }
 
 /* _parallelogram_map_standard:
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2023  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,152 +9,75 @@
 #include "config.h"
 #endif
 
+#include "doc/algorithm/rotsprite.h"
+
 #include "doc/algorithm/rotate.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Number of rows processed by each parallel task
+const int kRowsPerTask = 16;
+
+// Maximum number of scaled images in the cache
+const int kMaxCachedImages = 4;
+
 // More information about EPX/Scale2x:
 // http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
 template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
 {
-#if 0      // TODO complete this implementation that should be faster
-           // than using a lot of get/put_pixel_fast calls.
-  int dst_w = src_w*2;
-  int dst_h = src_h*2;
-
-  LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock, gfx::Rect(0, 0, dst_w, dst_h));
-  const LockImageBits<ImageTraits> srcBits(src);
-
-  LockImageBits<ImageTraits>::iterator dstRow0_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow1_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow0_end = dstBits.end();
-  LockImageBits<ImageTraits>::iterator dstRow1_end = dstBits.end();
-
-  // Iterators:
-  //   A
-  // C P B
-  //   D
-  //
-  // These iterators are displaced through src image and are modified in this way:
-  //
-  // P: is the simplest one, we just start from (0, 0) to srcEnd.
-  // A: starts from row 0 (so A = P in the first row), then we start
-  //    again from the row 0.
-  // B: It starts from (1, row) and in the last pixel we don't moved it.
-  // C: It starts from (0, 0) and then it is moved with a delay.
-  // D: It starts from row 1 and continues until we reach the last
-  //    row, in that case we start D iterator again.
-  //
-  LockImageBits<ImageTraits>::const_iterator itP, itA, itB, itC, itD, savedD;
-  LockImageBits<ImageTraits>::const_iterator srcEnd = srcBits.end();
-  color_t P, A, B, C, D;
-
-  // Adjust iterators
-  itP = itA = itB = itC = itD = savedD = srcBits.begin();
-  dstRow1_it += dst_w;
-  itD += src->width();
-
-  for (int y=0; y<src_h; ++y) {
-    if (y == 1) itA = srcBits.begin();
-    if (y == src_h-2) savedD = itD;
-    if (y == src_h-1) itD = savedD;
-    ++itB;
-
-    for (int x=0; x<src_w; ++x) {
-      ASSERT(itP != srcEnd);
-      ASSERT(itA != srcEnd);
-      ASSERT(itB != srcEnd);
-      ASSERT(itC != srcEnd);
-      ASSERT(itD != srcEnd);
-      ASSERT(dstRow0_it != dstRow0_end);
-      ASSERT(dstRow1_it != dstRow1_end);
-
-      P = *itP;
-      A = *itA;                 // y-1
-      B = *itB;                 // x+1
-      C = *itC;                 // x-1
-      D = *itD;                 // y+1
-
-      *dstRow0_it = (C == A && C != D && A != B ? A: P);
-      ++dstRow0_it;
-      *dstRow0_it = (A == B && A != C && B != D ? B: P);
-      ++dstRow0_it;
-
-      *dstRow1_it = (D == C && D != B && C != A ? C: P);
-      ++dstRow1_it;
-      *dstRow1_it = (B == D && B != A && D != C ? D: P);
-      ++dstRow1_it;
-
-      ++itP;
-      ++itA;
-      if (x < src_w-2) ++itB;
-      if (x > 0) ++itC;
-      ++itD;
-    }
-
-    // Adjust iterators for the next two rows.
-    ++itB;
-    ++itC;
-    dstRow0_it += dst_w;
-    if (y < src_h-1)
-      dstRow1_it += dst_w;
-  }
-
-  // ASSERT(itP == srcEnd);
-  // ASSERT(itA == srcEnd);
-  // ASSERT(itB == srcEnd);
-  // ASSERT(itC == srcEnd);
-  // ASSERT(itD == srcEnd);
-  ASSERT(dstRow0_it == dstRow0_end);
-  ASSERT(dstRow1_it == dstRow1_end);
-#else
-
-#define A c[0]
-#define B c[1]
-#define C c[2]
-#define D c[3]
-#define P c[4]
-
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
-  auto dstIt = dstBits.begin();
-  auto dstIt2 = dstIt;
-
-  color_t c[5];
-  for (int y=0; y<src_h; ++y) {
-    dstIt2 += src_w*2;
-    for (int x=0; x<src_w; ++x) {
-      P = get_pixel_fast<ImageTraits>(src, x, y);
-      A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
-      B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
-      C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
-      D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
-
-      *dstIt = (C == A && C != D && A != B ? A: P);
-      ++dstIt;
-      *dstIt = (A == B && A != C && B != D ? B: P);
-      ++dstIt;
-
-      *dstIt2 = (D == C && D != B && C != A ? C: P);
-      ++dstIt2;
-      *dstIt2 = (B == D && B != A && D != C ? D: P);
-      ++dstIt2;
-    }
-    dstIt += src_w*2;
-  }
-
-#endif
+  using address_t = typename ImageTraits::address_t;
+
+  // Rows are written directly from several threads
+  dst->unshareTiles(gfx::Rect(0, 0, src_w*2, src_h*2));
+  dst->invalidateContentHash();
+
+  parallel_for(
+    0, src_h, kRowsPerTask,
+    [dst, src, src_w, src_h](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const auto rowA = get_row_view<ImageTraits>(src, 0, std::max(y-1, 0), src_w);
+        const auto rowP = get_row_view<ImageTraits>(src, 0, y, src_w);
+        const auto rowD = get_row_view<ImageTraits>(src, 0, std::min(y+1, src_h-1), src_w);
+        const RowView<ImageTraits> dst0(
+          (address_t)dst->getPixelAddress(0, y*2), 0, y*2, src_w*2);
+        const RowView<ImageTraits> dst1(
+          (address_t)dst->getPixelAddress(0, y*2+1), 0, y*2+1, src_w*2);
+
+        for (int x=0; x<src_w; ++x) {
+          //   A
+          // C P B
+          //   D
+          const color_t P = rowP[x];
+          const color_t A = rowA[x];
+          const color_t B = (x < src_w-1 ? rowP[x+1]: P);
+          const color_t C = (x > 0 ? rowP[x-1]: P);
+          const color_t D = rowD[x];
+
+          dst0.put(x*2,   (C == A && C != D && A != B ? A: P));
+          dst0.put(x*2+1, (A == B && A != C && B != D ? B: P));
+          dst1.put(x*2,   (D == C && D != B && C != A ? C: P));
+          dst1.put(x*2+1, (B == D && B != A && D != C ? D: P));
+        }
+      }
+    });
 }
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
 {
   switch (src->pixelFormat()) {
     case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
@@ -164,16 +87,114 @@ static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
   }
 }
 
+// Images scaled 8x (the source image with scale2x, and the mask with
+// nearest neighbor) of the last used images. In this way rotating
+// the same image several times (e.g. while the user drags a rotation
+// handle) only needs to do the final parallelogram/sampling step.
+class ScaledImagesCache {
+public:
+  enum class Method { Scale2x, Nearest };
+
+  // Returns the given image scaled 8x with the given method.
+  const Image* get(const Image* image, const Method method) {
+    const uint32_t hash = image->contentHash();
+    uint64_t oldest = m_time;
+    Entry* reuse = nullptr;
+    for (Entry& entry : m_entries) {
+      if (entry.scaled &&
+          entry.id == image->id() &&
+          entry.version == image->version() &&
+          entry.hash == hash &&
+          entry.method == method &&
+          entry.spec == image->spec()) {
+        entry.time = ++m_time;
+        return entry.scaled.get();
+      }
+      if (!reuse || entry.time < oldest) {
+        reuse = &entry;
+        oldest = entry.time;
+      }
+    }
+
+    reuse->scaled.reset();
+    reuse->scaled = scale(image, method);
+    reuse->id = image->id();
+    reuse->version = image->version();
+    reuse->hash = hash;
+    reuse->method = method;
+    reuse->spec = image->spec();
+    reuse->time = ++m_time;
+    return reuse->scaled.get();
+  }
+
+  // Buffer used for temporary images
+  ImageBufferPtr buffer(const int i) {
+    if (!m_buffers[i])
+      m_buffers[i] = std::make_shared<ImageBuffer>(1);
+    return m_buffers[i];
+  }
+
+  std::mutex& mutex() { return m_mutex; }
+
+private:
+  struct Entry {
+    ObjectId id = 0;
+    ObjectVersion version = 0;
+    uint32_t hash = 0;
+    Method method = Method::Scale2x;
+    ImageSpec spec = ImageSpec(ColorMode::RGB, 1, 1);
+    std::unique_ptr<Image> scaled;
+    uint64_t time = 0;
+  };
+
+  std::unique_ptr<Image> scale(const Image* image, const Method method) {
+    const int scale = 8;
+    std::unique_ptr<Image> scaled(
+      Image::create(image->pixelFormat(),
+                    image->width()*scale,
+                    image->height()*scale));
+    scaled->setMaskColor(image->maskColor());
+
+    switch (method) {
+
+      case Method::Scale2x: {
+        // Three scale2x passes (1x -> 2x -> 4x -> 8x), the 4x image is
+        // the only temporary one
+        std::unique_ptr<Image> tmp(
+          Image::create(image->pixelFormat(),
+                        image->width()*scale/2,
+                        image->height()*scale/2,
+                        buffer(1)));
+        image_scale2x(scaled.get(), image, image->width(), image->height());
+        image_scale2x(tmp.get(), scaled.get(), image->width()*2, image->height()*2);
+        image_scale2x(scaled.get(), tmp.get(), image->width()*4, image->height()*4);
+        break;
+      }
+
+      case Method::Nearest:
+        clear_image(scaled.get(), 0);
+        scale_image(scaled.get(), image,
+                    0, 0, scaled->width(), scaled->height(),
+                    0, 0, image->width(), image->height());
+        break;
+    }
+    return scaled;
+  }
+
+  std::mutex m_mutex;
+  Entry m_entries[kMaxCachedImages];
+  ImageBufferPtr m_buffers[2];
+  uint64_t m_time = 0;
+};
+
+ScaledImagesCache g_cache;
+
+} // anonymous namespace
+
 void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   int x1, int y1, int x2, int y2,
   int x3, int y3, int x4, int y4)
 {
-  static ImageBufferPtr buf[3]; // TODO non-thread safe
-
-  for (int i=0; i<3; ++i)
-    if (!buf[i])
-      buf[i].reset(new ImageBuffer(1));
-
   int xmin = std::min(x1, std::min(x2, std::min(x3, x4)));
   int xmax = std::max(x1, std::max(x2, std::max(x3, x4)));
   int ymin = std::min(y1, std::min(y2, std::min(y3, y4)));
@@ -184,39 +205,21 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   if (rot_width == 0 || rot_height == 0)
     return;
 
+  const std::lock_guard lock(g_cache.mutex());
+
   int scale = 8;
-  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale, buf[0]));
-  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
-  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
-  std::unique_ptr<Image> msk_copy;
+  const Image* spr_copy = g_cache.get(spr, ScaledImagesCache::Method::Scale2x);
+  const Image* msk_copy = (mask ? g_cache.get(mask, ScaledImagesCache::Method::Nearest):
+                                  nullptr);
+  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale,
+                                                g_cache.buffer(0)));
 
   color_t maskColor = spr->maskColor();
-
   bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
-  spr_copy->setMaskColor(maskColor);
-
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
-
-  for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
-  }
-
-  if (mask) {
-    // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
-    clear_image(msk_copy.get(), 0);
-    scale_image(msk_copy.get(), mask,
-                0, 0, msk_copy->width(), msk_copy->height(),
-                0, 0, mask->width(), mask->height());
-  }
 
   clear_image(bmp_copy.get(), maskColor);
   parallelogram(
-    bmp_copy.get(), spr_copy.get(), msk_copy.get(),
+    bmp_copy.get(), spr_copy, msk_copy,
     (x1-xmin)*scale, (y1-ymin)*scale, (x2-xmin)*scale, (y2-ymin)*scale,
     (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale);
 
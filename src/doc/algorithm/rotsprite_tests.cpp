@@ -0,0 +1,72 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/rotsprite.h"
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+using namespace doc::algorithm;
+
+namespace {
+
+ImageRef rotate(const Image* src, const Image* mask)
+{
+  const int w = src->width(), h = src->height();
+  ImageRef dst(Image::create(src->pixelFormat(), w+8, h+8));
+  clear_image(dst.get(), 0);
+  rotsprite_image(dst.get(), src, mask,
+                  3, 1, w+7, 4, w+4, h+7, 1, h+3);
+  return dst;
+}
+
+} // anonymous namespace
+
+TEST(RotSprite, CachedScaledImages)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    ImageRef a(Image::create(pf, 37, 21));
+    ImageRef mask(Image::create(IMAGE_BITMAP, 37, 21));
+    random_image(a.get());
+    clear_image(mask.get(), 1);
+    put_pixel(mask.get(), 5, 5, 0);
+
+    const ImageRef r1 = rotate(a.get(), mask.get());
+    const ImageRef r2 = rotate(a.get(), mask.get());
+    EXPECT_TRUE(is_same_image(r1.get(), r2.get()));
+
+    // A copy (a different image, so a cache miss) must be rotated
+    // exactly in the same way
+    ImageRef b(Image::createCopy(a.get()));
+    const ImageRef r3 = rotate(b.get(), mask.get());
+    EXPECT_TRUE(is_same_image(r1.get(), r3.get()));
+
+    // Rotating two images alternately uses the cached versions of both
+    ImageRef c(Image::create(pf, 37, 21));
+    random_image(c.get());
+    const ImageRef r4 = rotate(c.get(), nullptr);
+    ImageRef d(Image::createCopy(c.get()));
+    EXPECT_TRUE(is_same_image(r4.get(), rotate(d.get(), nullptr).get()));
+    EXPECT_TRUE(is_same_image(r1.get(), rotate(a.get(), mask.get()).get()));
+
+    // Modified images cannot use the cached scaled image
+    fill_rect(a.get(), 0, 0, 36, 20, get_pixel(c.get(), 0, 0));
+    fill_rect(b.get(), 0, 0, 36, 20, get_pixel(c.get(), 0, 0));
+    const ImageRef r5 = rotate(a.get(), mask.get());
+    EXPECT_TRUE(is_same_image(r5.get(), rotate(b.get(), mask.get()).get()));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,12 +17,11 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
 
-#include <thread>
-
 namespace doc {
 namespace algorithm {
 
@@ -60,13 +59,20 @@ bool is_same_pixel<BitmapTraits>(color_t pixel1, color_t pixel2)
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
+bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels,
+                              const base::task_token* token = nullptr)
 {
+  const bool tiled = image->isTiled();
   int u, v;
   // Shrink left side
   for (u=bounds.x; u<bounds.x2(); ++u) {
+    if (token && token->canceled())
+      break;
     auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
     for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
+      // Rows of tiled images are contiguous only inside each tile
+      if (tiled && (v % Image::kTileRows) == 0)
+        ptr = get_pixel_address_fast<ImageTraits>(image, u, v);
       ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
       if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
         return (!bounds.isEmpty());
@@ -78,13 +84,20 @@ bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t ref
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
+bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels,
+                               const base::task_token* token = nullptr)
 {
+  const bool tiled = image->isTiled();
   int u, v;
   // Shrink right side
   for (u=bounds.x2()-1; u>=bounds.x; --u) {
+    if (token && token->canceled())
+      break;
     auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
     for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
+      // Rows of tiled images are contiguous only inside each tile
+      if (tiled && (v % Image::kTileRows) == 0)
+        ptr = get_pixel_address_fast<ImageTraits>(image, u, v);
       ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
       if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
         return (!bounds.isEmpty());
@@ -95,11 +108,14 @@ bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t re
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refpixel,
+                             const base::task_token* token = nullptr)
 {
   int u, v;
   // Shrink top side
   for (v=bounds.y; v<bounds.y2(); ++v) {
+    if (token && token->canceled())
+      break;
     auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
     for (; u<bounds.x2(); ++u, ++ptr) {
       ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
@@ -113,11 +129,14 @@ bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refp
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t refpixel,
+                                const base::task_token* token = nullptr)
 {
   int u, v;
   // Shrink bottom side
   for (v=bounds.y2()-1; v>=bounds.y; --v) {
+    if (token && token->canceled())
+      break;
     auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
     for (; u<bounds.x2(); ++u, ++ptr) {
       ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
@@ -132,26 +151,49 @@ bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t r
 template<typename ImageTraits>
 bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
+  // If we already know that the image is plain (e.g. an empty cel),
+  // it's shrunk completely or not at all.
+  color_t plainColor;
+  if (image->hasPlainInfo() && image->isPlain(&plainColor)) {
+    if (is_same_pixel<ImageTraits>(plainColor, refpixel)) {
+      bounds = gfx::Rect(bounds.x2(), bounds.y, 0, bounds.h);
+      return false;
+    }
+    return !bounds.isEmpty();
+  }
+
   // Pixels per row
   const int rowPixels = image->rowPixels();
   const int canvasSize = image->width()*image->height();
-  if ((std::thread::hardware_concurrency() >= 4) &&
+  if ((parallel_concurrency() >= 4) &&
       ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
        (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
     gfx::Rect
       leftBounds(bounds), rightBounds(bounds),
       topBounds(bounds), bottomBounds(bounds);
 
-    // TODO use a base::thread_pool and a base::task for each border
+    // Each border is shrunk in a task, if one of them finds that the
+    // whole image is plain, the other tasks can be canceled (the
+    // result will be an empty bounds anyway).
+    TaskGroup tasks;
+    tasks.run([&](base::task_token& token){
+      if (!shrink_bounds_left_templ<ImageTraits>(image, leftBounds, refpixel, rowPixels, &token))
+        tasks.cancel();
+    });
+    tasks.run([&](base::task_token& token){
+      if (!shrink_bounds_right_templ<ImageTraits>(image, rightBounds, refpixel, rowPixels, &token))
+        tasks.cancel();
+    });
+    tasks.run([&](base::task_token& token){
+      if (!shrink_bounds_top_templ<ImageTraits>(image, topBounds, refpixel, &token))
+        tasks.cancel();
+    });
+    tasks.run([&](base::task_token& token){
+      if (!shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel, &token))
+        tasks.cancel();
+    });
+    tasks.wait();
 
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowPixels); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowPixels); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
     bounds = leftBounds;
     bounds &= rightBounds;
     bounds &= topBounds;
@@ -159,11 +201,14 @@ bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel
     return !bounds.isEmpty();
   }
   else {
+    // Top/bottom rows are scanned first (sequential memory access),
+    // so the left/right columns are scanned only in the rows with
+    // content.
     return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
       shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel) &&
+      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
+      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels);
   }
 }
 
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,6 +15,8 @@
 #include "doc/algorithm/modify_selection.h"
 #include "doc/mask.h"
 
+#include <algorithm>
+
 namespace doc {
 namespace algorithm {
 
@@ -21,7 +24,8 @@ void stroke_selection(Image* image,
                       const gfx::Rect& imageBounds,
                       const Mask* origMask,
                       const color_t color,
-                      const Grid* grid)
+                      const Grid* grid,
+                      const int width)
 {
   ASSERT(origMask);
   ASSERT(origMask->bitmap());
@@ -32,12 +36,14 @@ void stroke_selection(Image* image,
   if (bounds.isEmpty())
     return;
 
+  // The border is calculated with a distance transform, so its cost
+  // doesn't depend on the width.
   Mask mask;
   mask.reserve(bounds);
   mask.freeze();
   modify_selection(
     SelectionModifier::Border,
-    origMask, &mask, 1,
+    origMask, &mask, std::max(1, width),
     BrushType::kCircleBrushType);
   mask.unfreeze();
 
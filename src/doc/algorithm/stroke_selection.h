@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,9 @@ namespace doc {
 
   namespace algorithm {
 
+    // Draws a stroke of "width" pixels inside the boundary of the
+    // selection (the pixels of the mask that are at a distance <=
+    // width from an unselected pixel).
     void stroke_selection(
       Image* image,
       const gfx::Rect& imageBounds,
@@ -26,7 +29,8 @@ namespace doc {
       // This can be a color_t or a tile_t if the image is a tilemap
       const color_t color,
       // Optional grid for tilemaps
-      const Grid* grid = nullptr);
+      const Grid* grid = nullptr,
+      const int width = 1);
 
   } // namespace algorithm
 } // namespace doc
@@ -0,0 +1,62 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/stroke_selection.h"
+#include "doc/image.h"
+#include "doc/mask.h"
+
+using namespace doc;
+using namespace gfx;
+
+TEST(StrokeSelection, Width)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 12, 12));
+  Mask mask;
+  mask.replace(Rect(1, 1, 10, 10));
+
+  for (int width : { 1, 2, 3, 10 }) {
+    image->clear(0);
+    algorithm::stroke_selection(image.get(), image->bounds(), &mask, 1,
+                                nullptr, width);
+
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x) {
+        const Rect inner = Rect(1, 1, 10, 10).shrink(width);
+        const bool expected = (mask.containsPoint(x, y) &&
+                               !inner.contains(Point(x, y)));
+        ASSERT_EQ(expected ? 1: 0, image->getPixel(x, y))
+          << "width=" << width << " x=" << x << " y=" << y;
+      }
+  }
+}
+
+TEST(StrokeSelection, MaskOffset)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 8, 8));
+  image->clear(0);
+
+  // A 4x4 selection in canvas (2,2) stroked in an image placed in
+  // canvas (1,1)
+  Mask mask;
+  mask.replace(Rect(2, 2, 4, 4));
+  algorithm::stroke_selection(image.get(), Rect(1, 1, 8, 8), &mask, 2);
+
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      const bool expected = (Rect(1, 1, 4, 4).contains(Point(x, y)) &&
+                             !Rect(2, 2, 2, 2).contains(Point(x, y)));
+      ASSERT_EQ(expected ? 2: 0, image->getPixel(x, y))
+        << "x=" << x << " y=" << y;
+    }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
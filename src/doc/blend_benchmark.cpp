@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +13,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +56,43 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+template<BlendMode M>
+void BM_RgbaRow(benchmark::State& state) {
+  const int w = state.range(0);
+  const int opacity = state.range(1);
+  const BlendFunc func = get_rgba_blender(M, true);
+  std::vector<color_t> dst(w, rgba(200, 128, 64, 128));
+  std::vector<color_t> src(w, rgba(32, 128, 200, 128));
+  while (state.KeepRunning()) {
+    for (int x=0; x<w; ++x)
+      dst[x] = func(dst[x], src[x], opacity);
+  }
+  state.SetItemsProcessed(state.iterations() * w);
+}
+
+template<BlendMode M>
+void BM_RgbaSpan(benchmark::State& state) {
+  const int w = state.range(0);
+  const int opacity = state.range(1);
+  const BlendSpanFunc func = get_rgba_span_blender(M, true);
+  std::vector<color_t> dst(w, rgba(200, 128, 64, 128));
+  std::vector<color_t> src(w, rgba(32, 128, 200, 128));
+  while (state.KeepRunning()) {
+    func(&dst[0], &src[0], w, opacity, 0);
+  }
+  state.SetItemsProcessed(state.iterations() * w);
+}
+
+static void RowArguments(benchmark::internal::Benchmark* b) {
+  b ->Args({ 64, 255 })
+    ->Args({ 64, 128 })
+    ->Args({ 1024, 255 })
+    ->Args({ 1024, 128 });
+}
+
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::NORMAL)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaSpan, BlendMode::NORMAL)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::MULTIPLY)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaSpan, BlendMode::MULTIPLY)->Apply(RowArguments);
+
 BENCHMARK_MAIN();
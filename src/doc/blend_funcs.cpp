@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -25,6 +25,10 @@
 #include <algorithm>
 #include <cmath>
 
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
+
 namespace  {
 
 #define blend_multiply(b, s, t)   (MUL_UN8((b), (s), (t)))
@@ -830,4 +834,157 @@ BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend)
   return indexed_blender_src;
 }
 
+//////////////////////////////////////////////////////////////////////
+// span blenders
+
+namespace {
+
+template<BlendFunc blend>
+void rgba_span_blender(color_t* dst, const color_t* src, int n,
+                       int opacity, color_t maskColor)
+{
+  for (; n > 0; --n, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = blend(*dst, *src, opacity);
+  }
+}
+
+void rgba_span_blender_src(color_t* dst, const color_t* src, int n,
+                           int opacity, color_t maskColor)
+{
+  for (; n > 0; --n, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = *src;
+  }
+}
+
+#if defined(__x86_64__) || defined(_WIN64)
+
+// MUL_UN8() for 32-bit lanes (a*b must fit in 16 bits)
+inline __m128i mul_un8_epi32(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi32(_mm_mullo_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+// Same as rgba_blender_normal() for 4 pixels. The division by Ra is
+// done with floats, which gives the exact same truncated integer
+// result as the numerator and denominator are small integers.
+void rgba_span_blender_normal(color_t* dst, const color_t* src, int n,
+                              int opacity, color_t maskColor)
+{
+  const __m128i mask8 = _mm_set1_epi32(0xff);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opacityV = _mm_set1_epi32(opacity);
+  const __m128i maskColorV = _mm_set1_epi32(int(maskColor));
+  const __m128i rgbMask = _mm_set1_epi32(int(rgba_rgb_mask));
+
+  for (; n >= 4; n -= 4, dst += 4, src += 4) {
+    const __m128i B = _mm_loadu_si128((const __m128i*)dst);
+    const __m128i S = _mm_loadu_si128((const __m128i*)src);
+
+    const __m128i Br = _mm_and_si128(B, mask8);
+    const __m128i Bg = _mm_and_si128(_mm_srli_epi32(B, 8), mask8);
+    const __m128i Bb = _mm_and_si128(_mm_srli_epi32(B, 16), mask8);
+    const __m128i Ba = _mm_srli_epi32(B, 24);
+
+    const __m128i Sr = _mm_and_si128(S, mask8);
+    const __m128i Sg = _mm_and_si128(_mm_srli_epi32(S, 8), mask8);
+    const __m128i Sb = _mm_and_si128(_mm_srli_epi32(S, 16), mask8);
+    const __m128i Sa = mul_un8_epi32(_mm_srli_epi32(S, 24), opacityV);
+
+    // Ra = Sa + Ba - Ba*Sa
+    const __m128i Ra = _mm_sub_epi32(_mm_add_epi32(Sa, Ba),
+                                     mul_un8_epi32(Ba, Sa));
+
+    // Avoid divisions by zero (these pixels are replaced below)
+    const __m128i RaIsZero = _mm_cmpeq_epi32(Ra, zero);
+    const __m128 SaF = _mm_cvtepi32_ps(Sa);
+    const __m128 RaF = _mm_cvtepi32_ps(
+      _mm_or_si128(Ra, _mm_and_si128(RaIsZero, _mm_set1_epi32(1))));
+
+    // Rc = Bc + (Sc-Bc)*Sa/Ra
+    auto blendChannel = [SaF, RaF](__m128i Bc, __m128i Sc) {
+      const __m128 num = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(Sc, Bc)), SaF);
+      return _mm_add_epi32(Bc, _mm_cvttps_epi32(_mm_div_ps(num, RaF)));
+    };
+    const __m128i Rr = blendChannel(Br, Sr);
+    const __m128i Rg = blendChannel(Bg, Sg);
+    const __m128i Rb = blendChannel(Bb, Sb);
+
+    __m128i R = _mm_or_si128(
+      _mm_or_si128(Rr, _mm_slli_epi32(Rg, 8)),
+      _mm_or_si128(_mm_slli_epi32(Rb, 16), _mm_slli_epi32(Ra, 24)));
+
+    // Transparent backdrop: source RGB with the source alpha
+    const __m128i BaIsZero = _mm_cmpeq_epi32(Ba, zero);
+    const __m128i R0 = _mm_or_si128(_mm_and_si128(S, rgbMask),
+                                    _mm_slli_epi32(Sa, 24));
+    R = _mm_or_si128(_mm_and_si128(BaIsZero, R0),
+                     _mm_andnot_si128(BaIsZero, R));
+
+    // Keep the backdrop for transparent source pixels (when the
+    // backdrop is not transparent) and for the mask color
+    const __m128i keep = _mm_or_si128(
+      _mm_andnot_si128(BaIsZero, _mm_cmpeq_epi32(_mm_srli_epi32(S, 24), zero)),
+      _mm_cmpeq_epi32(S, maskColorV));
+    R = _mm_or_si128(_mm_and_si128(keep, B),
+                     _mm_andnot_si128(keep, R));
+
+    _mm_storeu_si128((__m128i*)dst, R);
+  }
+
+  rgba_span_blender<rgba_blender_normal>(dst, src, n, opacity, maskColor);
+}
+
+#else
+
+void rgba_span_blender_normal(color_t* dst, const color_t* src, int n,
+                              int opacity, color_t maskColor)
+{
+  rgba_span_blender<rgba_blender_normal>(dst, src, n, opacity, maskColor);
+}
+
+#endif
+
+} // anonymous namespace
+
+BlendSpanFunc get_rgba_span_blender(BlendMode blendmode, const bool newBlend)
+{
+#define SPAN(name) rgba_span_blender<rgba_blender_##name>
+#define SPAN_N(name) (newBlend ? SPAN(name##_n): SPAN(name))
+  switch (blendmode) {
+    case BlendMode::SRC:            return rgba_span_blender_src;
+    case BlendMode::MERGE:          return SPAN(merge);
+    case BlendMode::NEG_BW:         return SPAN(neg_bw);
+    case BlendMode::RED_TINT:       return SPAN(red_tint);
+    case BlendMode::BLUE_TINT:      return SPAN(blue_tint);
+    case BlendMode::DST_OVER:       return SPAN(normal_dst_over);
+
+    case BlendMode::NORMAL:         return rgba_span_blender_normal;
+    case BlendMode::MULTIPLY:       return SPAN_N(multiply);
+    case BlendMode::SCREEN:         return SPAN_N(screen);
+    case BlendMode::OVERLAY:        return SPAN_N(overlay);
+    case BlendMode::DARKEN:         return SPAN_N(darken);
+    case BlendMode::LIGHTEN:        return SPAN_N(lighten);
+    case BlendMode::COLOR_DODGE:    return SPAN_N(color_dodge);
+    case BlendMode::COLOR_BURN:     return SPAN_N(color_burn);
+    case BlendMode::HARD_LIGHT:     return SPAN_N(hard_light);
+    case BlendMode::SOFT_LIGHT:     return SPAN_N(soft_light);
+    case BlendMode::DIFFERENCE:     return SPAN_N(difference);
+    case BlendMode::EXCLUSION:      return SPAN_N(exclusion);
+    case BlendMode::HSL_HUE:        return SPAN_N(hsl_hue);
+    case BlendMode::HSL_SATURATION: return SPAN_N(hsl_saturation);
+    case BlendMode::HSL_COLOR:      return SPAN_N(hsl_color);
+    case BlendMode::HSL_LUMINOSITY: return SPAN_N(hsl_luminosity);
+    case BlendMode::ADDITION:       return SPAN_N(addition);
+    case BlendMode::SUBTRACT:       return SPAN_N(subtract);
+    case BlendMode::DIVIDE:         return SPAN_N(divide);
+  }
+#undef SPAN
+#undef SPAN_N
+  ASSERT(false);
+  return rgba_span_blender_src;
+}
+
 } // namespace doc
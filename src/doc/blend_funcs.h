@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -68,6 +68,19 @@ namespace doc {
   BlendFunc get_graya_blender(BlendMode blendmode, const bool newBlend);
   BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend);
 
+  // Blends a row of "n" RGBA pixels, i.e. dst[i] = blend(dst[i],
+  // src[i], opacity) for each pixel, skipping source pixels equal to
+  // "maskColor". Gives the same result as calling the BlendFunc
+  // returned by get_rgba_blender() for each pixel, but some blend
+  // modes are processed several pixels at the same time (SIMD).
+  typedef void (*BlendSpanFunc)(color_t* dst,
+                                const color_t* src,
+                                int n,
+                                int opacity,
+                                color_t maskColor);
+
+  BlendSpanFunc get_rgba_span_blender(BlendMode blendmode, const bool newBlend);
+
 } // namespace doc
 
 #endif
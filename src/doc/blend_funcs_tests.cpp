@@ -0,0 +1,69 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend_funcs.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+static color_t random_rgba()
+{
+  // Use some special alpha values more frequently
+  static const int alphas[] = { 0, 0, 1, 127, 128, 254, 255, 255 };
+  int a = (std::rand() % 2 ? alphas[std::rand() % 8]: std::rand() % 256);
+  return rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, a);
+}
+
+TEST(BlendFuncs, SpanBlendersMatchPixelBlenders)
+{
+  const int n = 259;
+  std::vector<color_t> src(n), dst(n), expected(n);
+
+  for (int m=int(BlendMode::DST_OVER); m<=int(BlendMode::DIVIDE); ++m) {
+    const BlendMode mode = (BlendMode)m;
+    if (mode == BlendMode::UNSPECIFIED)
+      continue;
+
+    for (bool newBlend : { false, true }) {
+      const BlendFunc blend = get_rgba_blender(mode, newBlend);
+      const BlendSpanFunc blendSpan = get_rgba_span_blender(mode, newBlend);
+
+      for (int opacity : { 0, 1, 128, 255 }) {
+        for (color_t maskColor : { color_t(0), rgba(255, 0, 255, 255) }) {
+          for (int i=0; i<n; ++i) {
+            src[i] = (i % 17 == 0 ? maskColor: random_rgba());
+            dst[i] = random_rgba();
+            expected[i] = (src[i] != maskColor ? blend(dst[i], src[i], opacity): dst[i]);
+          }
+
+          // Use an unaligned starting point too
+          blendSpan(&dst[0], &src[0], 1, opacity, maskColor);
+          blendSpan(&dst[1], &src[1], n-1, opacity, maskColor);
+
+          for (int i=0; i<n; ++i) {
+            SCOPED_TRACE(i);
+            ASSERT_EQ(expected[i], dst[i]) << "mode=" << m
+                                           << " opacity=" << opacity;
+          }
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
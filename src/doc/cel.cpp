@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -99,6 +99,9 @@ void Cel::setOpacity(int opacity)
 void Cel::setZIndex(int zindex)
 {
   m_zIndex = zindex;
+
+  if (m_layer && m_layer->sprite())
+    m_layer->sprite()->invalidateRenderPlans();
 }
 
 Document* Cel::document() const
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -75,6 +75,9 @@ namespace doc {
   private:
     void fixupImage();
 
+    // To displace the frame of cels inside the layer
+    friend class LayerImage;
+
     LayerImage* m_layer;
     frame_t m_frame;            // Frame position
     CelDataRef m_data;
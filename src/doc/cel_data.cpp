@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -27,6 +27,7 @@ CelData::CelData(const ImageRef& image)
   , m_bounds(0, 0,
              image ? image->width(): 0,
              image ? image->height(): 0)
+  , m_boundsGeneration(0)
   , m_boundsF(nullptr)
 {
 }
@@ -36,6 +37,7 @@ CelData::CelData(const CelData& celData)
   , m_image(celData.m_image)
   , m_opacity(celData.m_opacity)
   , m_bounds(celData.m_bounds)
+  , m_boundsGeneration(0)
   , m_boundsF(celData.m_boundsF ? std::make_unique<gfx::RectF>(*celData.m_boundsF):
                                   nullptr)
 {
@@ -55,6 +57,7 @@ void CelData::setImage(const ImageRef& image, Layer* layer)
 
 void CelData::setPosition(const gfx::Point& pos)
 {
+  incrementBoundsGeneration();
   m_bounds.setOrigin(pos);
   if (m_boundsF)
     m_boundsF->setOrigin(gfx::PointF(pos));
@@ -63,6 +66,7 @@ void CelData::setPosition(const gfx::Point& pos)
 void CelData::adjustBounds(Layer* layer)
 {
   ASSERT(m_image);
+  incrementBoundsGeneration();
   if (m_image->pixelFormat() == IMAGE_TILEMAP) {
     Tileset* tileset = nullptr;
     if (layer && layer->isTilemap())
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,6 +14,7 @@
 #include "doc/with_user_data.h"
 #include "gfx/rect.h"
 
+#include <cstdint>
 #include <memory>
 
 namespace doc {
@@ -54,12 +55,14 @@ namespace doc {
     void setBounds(const gfx::Rect& bounds) {
       ASSERT(bounds.w > 0);
       ASSERT(bounds.h > 0);
+      incrementBoundsGeneration();
       m_bounds = bounds;
       if (m_boundsF)
         *m_boundsF = gfx::RectF(bounds);
     }
 
     void setBoundsF(const gfx::RectF& boundsF) {
+      incrementBoundsGeneration();
       if (m_boundsF)
         *m_boundsF = boundsF;
       else
@@ -87,10 +90,16 @@ namespace doc {
 
     void adjustBounds(Layer* layer);
 
+    // Counter incremented each time the bounds of this cel data
+    // change, so cached cel bounds (e.g. CelsIndex) can be validated.
+    uint32_t boundsGeneration() const { return m_boundsGeneration; }
+    void incrementBoundsGeneration() { ++m_boundsGeneration; }
+
   private:
     ImageRef m_image;
     int m_opacity;
     gfx::Rect m_bounds;
+    uint32_t m_boundsGeneration;
 
     // Special bounds for reference layers that can have subpixel
     // position.
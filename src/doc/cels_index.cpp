@@ -0,0 +1,162 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/cels_index.h"
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/layer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace doc {
+
+namespace {
+
+// Maximum number of columns/rows of the grid
+const int kMaxGridSide = 64;
+
+}
+
+CelsIndex::CelsIndex(const RenderPlan::Items& items)
+  : m_cellW(0.0)
+  , m_cellH(0.0)
+  , m_cols(0)
+  , m_rows(0)
+{
+  m_celData.reserve(items.size());
+  m_entries.reserve(items.size());
+  for (int i=0; i<int(items.size()); ++i) {
+    const Cel* cel = items[i].cel;
+    m_celData.push_back(celDataState(cel));
+    if (!cel || !cel->image())
+      continue;
+
+    gfx::RectF bounds;
+    if (cel->layer()->isReference())
+      bounds = cel->boundsF();
+    else
+      bounds = gfx::RectF(cel->bounds());
+    if (bounds.isEmpty())
+      continue;
+
+    m_entries.push_back(Entry{ bounds, i });
+    m_bounds |= bounds;
+  }
+
+  if (m_entries.empty())
+    return;
+
+  // One cell each ~1 cel (on average) in a square grid
+  const int side = std::clamp(int(std::ceil(std::sqrt(double(m_entries.size())))),
+                              1, kMaxGridSide);
+  m_cols = m_rows = side;
+  m_cellW = m_bounds.w / m_cols;
+  m_cellH = m_bounds.h / m_rows;
+  m_cells.resize(m_cols*m_rows);
+
+  const int bigCels = std::max(1, m_cols*m_rows/4);
+  for (int i=0; i<int(m_entries.size()); ++i) {
+    const gfx::RectF& bounds = m_entries[i].bounds;
+    const int u1 = col(bounds.x), u2 = col(bounds.x2());
+    const int v1 = row(bounds.y), v2 = row(bounds.y2());
+    if ((u2-u1+1)*(v2-v1+1) > bigCels) {
+      m_big.push_back(i);
+      continue;
+    }
+
+    for (int v=v1; v<=v2; ++v)
+      for (int u=u1; u<=u2; ++u)
+        m_cells[v*m_cols+u].push_back(i);
+  }
+}
+
+bool CelsIndex::isValid(const RenderPlan::Items& items) const
+{
+  if (items.size() != m_celData.size())
+    return false;
+
+  for (int i=0; i<int(items.size()); ++i) {
+    if (!(celDataState(items[i].cel) == m_celData[i]))
+      return false;
+  }
+  return true;
+}
+
+// static
+CelsIndex::CelDataState CelsIndex::celDataState(const Cel* cel)
+{
+  if (cel && cel->data())
+    return CelDataState{ cel->data()->id(), cel->data()->boundsGeneration() };
+  else
+    return CelDataState{ NullId, 0 };
+}
+
+void CelsIndex::cels(const gfx::PointF& pt, std::vector<int>& result) const
+{
+  result.clear();
+  if (!m_bounds.contains(pt))
+    return;
+
+  const gfx::RectF rc(pt.x, pt.y, 0.0, 0.0);
+  collect(m_cells[row(pt.y)*m_cols+col(pt.x)], rc, true, result);
+  collect(m_big, rc, true, result);
+  std::sort(result.begin(), result.end());
+}
+
+void CelsIndex::cels(const gfx::RectF& rc, std::vector<int>& result) const
+{
+  result.clear();
+  if (!m_bounds.intersects(rc))
+    return;
+
+  const int u1 = col(rc.x), u2 = col(rc.x2());
+  const int v1 = row(rc.y), v2 = row(rc.y2());
+  for (int v=v1; v<=v2; ++v)
+    for (int u=u1; u<=u2; ++u)
+      collect(m_cells[v*m_cols+u], rc, false, result);
+  collect(m_big, rc, false, result);
+
+  // Cels in several cells are added several times
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()),
+               result.end());
+}
+
+// Returns the grid column/row for the given coordinate. As the same
+// calculation is used for cels and queries, a cel that intersects a
+// rectangle is always in some cell of the rectangle range.
+int CelsIndex::col(const double x) const
+{
+  return int(std::clamp(std::floor((x - m_bounds.x) / m_cellW),
+                        0.0, double(m_cols-1)));
+}
+
+int CelsIndex::row(const double y) const
+{
+  return int(std::clamp(std::floor((y - m_bounds.y) / m_cellH),
+                        0.0, double(m_rows-1)));
+}
+
+void CelsIndex::collect(const std::vector<int>& entries,
+                        const gfx::RectF& rc,
+                        const bool point,
+                        std::vector<int>& result) const
+{
+  for (const int i : entries) {
+    const Entry& entry = m_entries[i];
+    if (point ? entry.bounds.contains(gfx::PointF(rc.x, rc.y)):
+                entry.bounds.intersects(rc))
+      result.push_back(entry.item);
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,84 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_CELS_INDEX_H_INCLUDED
+#define DOC_CELS_INDEX_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+#include "doc/render_plan.h"
+#include "gfx/rect.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+
+  // Uniform grid over the bounds of the cels of a render plan to
+  // find the cels in a point or rectangle without testing all of
+  // them (e.g. to pick cels with the mouse in sprites with hundreds
+  // of layers).
+  //
+  // The index is a snapshot of the cels bounds, it's valid while the
+  // render plan is valid and the cels keep the same CelData with the
+  // same CelData::boundsGeneration() (see RenderPlan::celsIndex()).
+  class CelsIndex {
+  public:
+    explicit CelsIndex(const RenderPlan::Items& items);
+
+    // Returns true if the bounds of the cels in "items" (the same
+    // render plan items used to create the index) didn't change.
+    bool isValid(const RenderPlan::Items& items) const;
+
+    // Returns the indexes of the render plan items (in ascending
+    // order) with a cel that contains the given point or intersects
+    // the given rectangle. Bounds of cels in reference layers are
+    // the subpixel ones (Cel::boundsF()).
+    void cels(const gfx::PointF& pt, std::vector<int>& result) const;
+    void cels(const gfx::RectF& rc, std::vector<int>& result) const;
+
+  private:
+    struct Entry {
+      gfx::RectF bounds;
+      int item;                 // Index in the render plan items
+    };
+
+    int col(const double x) const;
+    int row(const double y) const;
+    void collect(const std::vector<int>& entries,
+                 const gfx::RectF& rc,
+                 const bool point,
+                 std::vector<int>& result) const;
+
+    // CelData ID and bounds generation of each render plan item
+    struct CelDataState {
+      ObjectId id;
+      uint32_t boundsGeneration;
+      bool operator==(const CelDataState& o) const {
+        return (id == o.id && boundsGeneration == o.boundsGeneration);
+      }
+    };
+    static CelDataState celDataState(const Cel* cel);
+
+    std::vector<CelDataState> m_celData;
+    gfx::RectF m_bounds;        // Union of all cels bounds
+    double m_cellW, m_cellH;
+    int m_cols, m_rows;
+    std::vector<Entry> m_entries;
+
+    // Entries in each grid cell (row by row)
+    std::vector<std::vector<int>> m_cells;
+
+    // Entries that cover too many cells are tested in all queries
+    std::vector<int> m_big;
+
+    DISABLE_COPYING(CelsIndex);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,153 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cels_index.h"
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/document.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Creates a sprite with "n" layers with one small cel each in
+// random positions.
+Sprite* make_sprite(std::shared_ptr<Document>& doc, const int n)
+{
+  ImageSpec spec(ColorMode::RGB, 256, 256);
+  Sprite* spr = Sprite::MakeStdSprite(spec);
+  doc->sprites().add(spr);
+
+  for (int i=0; i<n; ++i) {
+    const int w = 1 + std::rand() % 32;
+    const int h = 1 + std::rand() % 32;
+    auto lay = new LayerImage(spr);
+    auto cel = new Cel(0, ImageRef(Image::create(IMAGE_RGB, w, h)));
+    cel->setPosition(std::rand() % 300 - 20,
+                     std::rand() % 300 - 20);
+    lay->addCel(cel);
+    spr->root()->addLayer(lay);
+  }
+  return spr;
+}
+
+std::vector<int> brute_force(const RenderPlan::Items& items,
+                             const gfx::RectF& rc,
+                             const bool point)
+{
+  std::vector<int> result;
+  for (int i=0; i<int(items.size()); ++i) {
+    const Cel* cel = items[i].cel;
+    if (!cel)
+      continue;
+    const gfx::RectF bounds(cel->bounds());
+    if (point ? bounds.contains(gfx::PointF(rc.x, rc.y)):
+                bounds.intersects(rc))
+      result.push_back(i);
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+TEST(CelsIndex, MatchBruteForce)
+{
+  std::srand(1);
+  auto doc = std::make_shared<Document>();
+  Sprite* spr = make_sprite(doc, 300);
+
+  RenderPlanPtr plan = spr->renderPlan(spr->root(), 0);
+  const auto& items = plan->items();
+  auto index = plan->celsIndex();
+
+  std::vector<int> result;
+  for (int i=0; i<1000; ++i) {
+    const gfx::PointF pt(std::rand() % 340 - 40 + 0.5,
+                         std::rand() % 340 - 40 + 0.5);
+    index->cels(pt, result);
+    EXPECT_EQ(brute_force(items, gfx::RectF(pt.x, pt.y, 0, 0), true), result);
+
+    const gfx::RectF rc(pt.x, pt.y,
+                        1 + std::rand() % 64,
+                        1 + std::rand() % 64);
+    index->cels(rc, result);
+    EXPECT_EQ(brute_force(items, rc, false), result);
+  }
+}
+
+TEST(CelsIndex, MovedCels)
+{
+  std::srand(2);
+  auto doc = std::make_shared<Document>();
+  Sprite* spr = make_sprite(doc, 64);
+
+  RenderPlanPtr plan = spr->renderPlan(spr->root(), 0);
+  auto index = plan->celsIndex();
+  EXPECT_EQ(index, plan->celsIndex());
+
+  // Moving a cel re-creates the index
+  Cel* cel = spr->root()->lastLayer()->cel(0);
+  ASSERT_EQ(cel, plan->items().back().cel);
+  cel->setPosition(500, 500);
+  auto index2 = plan->celsIndex();
+  EXPECT_NE(index, index2);
+
+  std::vector<int> result;
+  index2->cels(gfx::PointF(500, 500), result);
+  ASSERT_EQ(1, result.size());
+  EXPECT_EQ(cel, plan->items()[result[0]].cel);
+
+  // Picked cels are the same found by the index
+  CelList cels;
+  spr->pickCels(gfx::PointF(500, 500), 0, *plan, cels);
+  ASSERT_EQ(1, cels.size());
+  EXPECT_EQ(cel, cels.front());
+}
+
+TEST(CelsIndex, OtherSprites)
+{
+  std::srand(3);
+  auto doc = std::make_shared<Document>();
+  Sprite* spr = make_sprite(doc, 32);
+  Sprite* spr2 = make_sprite(doc, 32);
+
+  RenderPlanPtr plan = spr->renderPlan(spr->root(), 0);
+  auto index = plan->celsIndex();
+
+  // Changes in other sprites don't invalidate the index
+  spr2->root()->lastLayer()->cel(0)->setPosition(10, 10);
+  EXPECT_EQ(index, plan->celsIndex());
+
+  // Changes in the cel data (without the Cel) do
+  Cel* cel = spr->root()->firstLayer()->cel(0);
+  cel->data()->setPosition(gfx::Point(400, 400));
+  EXPECT_NE(index, plan->celsIndex());
+
+  // And a new cel data for the cel
+  index = plan->celsIndex();
+  cel->setDataRef(std::make_shared<CelData>(*cel->data()));
+  EXPECT_NE(index, plan->celsIndex());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/color_distance_map.h"
+
+#include "doc/image.h"
+#include "doc/parallel.h"
+
+#include <algorithm>
+
+namespace doc {
+
+namespace {
+
+inline uint8_t abs_diff(const int a, const int b)
+{
+  return uint8_t(a > b ? a-b: b-a);
+}
+
+// The loops are written without branches so they can be
+// auto-vectorized by the compiler.
+
+void rgb_distances(const uint32_t* src, uint8_t* dst, const int w,
+                   const color_t color)
+{
+  const int r = rgba_getr(color);
+  const int g = rgba_getg(color);
+  const int b = rgba_getb(color);
+  const int a = rgba_geta(color);
+  for (int x=0; x<w; ++x) {
+    const uint32_t c = src[x];
+    dst[x] = std::max(std::max(abs_diff(rgba_getr(c), r),
+                               abs_diff(rgba_getg(c), g)),
+                      std::max(abs_diff(rgba_getb(c), b),
+                               abs_diff(rgba_geta(c), a)));
+  }
+}
+
+void gray_distances(const uint16_t* src, uint8_t* dst, const int w,
+                    const color_t color)
+{
+  const int v = graya_getv(color);
+  const int a = graya_geta(color);
+  for (int x=0; x<w; ++x) {
+    const uint16_t c = src[x];
+    dst[x] = std::max(abs_diff(graya_getv(c), v),
+                      abs_diff(graya_geta(c), a));
+  }
+}
+
+void indexed_distances(const uint8_t* src, uint8_t* dst, const int w,
+                       const color_t color)
+{
+  // Indexes far from the color are clamped to the maximum distance
+  const int i = int(std::min<color_t>(color, 255));
+  for (int x=0; x<w; ++x)
+    dst[x] = abs_diff(src[x], i);
+}
+
+} // anonymous namespace
+
+void ColorDistanceMap::build(const Image* image, const color_t color)
+{
+  m_width = image->width();
+  m_height = image->height();
+  m_color = color;
+  m_imageId = image->id();
+  m_imageVersion = image->version();
+
+  // Other pixel formats (e.g. tilemaps) are completely selected
+  m_distances.clear();
+  m_distances.resize(std::size_t(m_width)*m_height, 0);
+
+  const PixelFormat pixelFormat = image->pixelFormat();
+  if (pixelFormat != IMAGE_RGB &&
+      pixelFormat != IMAGE_GRAYSCALE &&
+      pixelFormat != IMAGE_INDEXED)
+    return;
+
+  const int w = m_width;
+  parallel_for(
+    0, m_height, std::max(1, 64*1024 / std::max(1, w)),
+    [this, image, pixelFormat, color, w](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const uint8_t* src = image->getPixelAddress(0, y);
+        uint8_t* dst = m_distances.data() + std::size_t(y)*w;
+        switch (pixelFormat) {
+          case IMAGE_RGB:
+            rgb_distances((const uint32_t*)src, dst, w, color);
+            break;
+          case IMAGE_GRAYSCALE:
+            gray_distances((const uint16_t*)src, dst, w, color);
+            break;
+          case IMAGE_INDEXED:
+            indexed_distances(src, dst, w, color);
+            break;
+          default:
+            break;
+        }
+      }
+    });
+}
+
+void ColorDistanceMap::clear()
+{
+  m_width = m_height = 0;
+  m_color = 0;
+  m_imageId = NullId;
+  m_imageVersion = 0;
+  m_distances.clear();
+}
+
+bool ColorDistanceMap::isFor(const Image* image, const color_t color) const
+{
+  return (image &&
+          m_imageId == image->id() &&
+          m_imageVersion == image->version() &&
+          m_width == image->width() &&
+          m_height == image->height() &&
+          m_color == color);
+}
+
+} // namespace doc
@@ -0,0 +1,61 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_COLOR_DISTANCE_MAP_H_INCLUDED
+#define DOC_COLOR_DISTANCE_MAP_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+  class Image;
+
+  // Distance of each pixel of an image to a reference color (the
+  // maximum difference between the channels of both colors, or the
+  // difference between indexes in indexed images). A pixel is
+  // selected by Mask::byColor() if its distance is less than or
+  // equal to the tolerance, so the same map can be used to generate
+  // masks with different tolerances without reading the image again
+  // (e.g. when the user moves the tolerance slider).
+  class ColorDistanceMap {
+  public:
+    ColorDistanceMap() { }
+    ColorDistanceMap(const Image* image, color_t color) { build(image, color); }
+
+    // Calculates the distances of the image pixels. Rows are
+    // processed in parallel.
+    void build(const Image* image, color_t color);
+    void clear();
+
+    // Returns true if the map was built for the current version of
+    // the given image and the given color.
+    bool isFor(const Image* image, color_t color) const;
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    color_t color() const { return m_color; }
+
+    const uint8_t* row(int y) const {
+      return m_distances.data() + std::size_t(y)*m_width;
+    }
+
+  private:
+    int m_width = 0;
+    int m_height = 0;
+    color_t m_color = 0;
+    ObjectId m_imageId = NullId;
+    ObjectVersion m_imageVersion = 0;
+    std::vector<uint8_t> m_distances;
+  };
+
+} // namespace doc
+
+#endif
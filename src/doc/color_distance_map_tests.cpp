@@ -0,0 +1,132 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/color_distance_map.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+namespace {
+
+// Same condition used by the old per-pixel Mask::byColor()
+bool similar(const int a, const int b, const int fuzziness)
+{
+  return (a >= b-fuzziness && a <= b+fuzziness);
+}
+
+bool is_selected(const Image* image, int x, int y,
+                 const color_t color, const int fuzziness)
+{
+  const color_t c = get_pixel(image, x, y);
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      return (similar(rgba_getr(c), rgba_getr(color), fuzziness) &&
+              similar(rgba_getg(c), rgba_getg(color), fuzziness) &&
+              similar(rgba_getb(c), rgba_getb(color), fuzziness) &&
+              similar(rgba_geta(c), rgba_geta(color), fuzziness));
+    case IMAGE_GRAYSCALE:
+      return (similar(graya_getv(c), graya_getv(color), fuzziness) &&
+              similar(graya_geta(c), graya_geta(color), fuzziness));
+    case IMAGE_INDEXED:
+      return similar(c, color, fuzziness);
+  }
+  return true;
+}
+
+void fill_random(Image* image)
+{
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      color_t c = 0;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB:
+          c = rgba(std::rand() % 256, std::rand() % 256,
+                   std::rand() % 256, std::rand() % 256);
+          break;
+        case IMAGE_GRAYSCALE:
+          c = graya(std::rand() % 256, std::rand() % 256);
+          break;
+        case IMAGE_INDEXED:
+          c = std::rand() % 256;
+          break;
+      }
+      put_pixel(image, x, y, c);
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(ColorDistanceMap, SameMaskAsPixelComparison)
+{
+  const color_t colors[] = { rgba(128, 64, 200, 255),
+                             graya(100, 255),
+                             20 };
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+
+  std::srand(1);
+  for (int f=0; f<3; ++f) {
+    // Width is not multiple of 8 to test the last byte of each row
+    ImageRef image(Image::create(formats[f], 37, 21));
+    fill_random(image.get());
+
+    ColorDistanceMap distances(image.get(), colors[f]);
+    EXPECT_EQ(37, distances.width());
+    EXPECT_EQ(21, distances.height());
+    EXPECT_TRUE(distances.isFor(image.get(), colors[f]));
+
+    for (int fuzziness : { 0, 1, 16, 64, 128, 254, 255 }) {
+      Mask mask;
+      mask.byColor(distances, fuzziness);
+
+      for (int y=0; y<image->height(); ++y) {
+        for (int x=0; x<image->width(); ++x) {
+          EXPECT_EQ(is_selected(image.get(), x, y, colors[f], fuzziness),
+                    mask.containsPoint(x, y))
+            << "format=" << f << " fuzziness=" << fuzziness
+            << " x=" << x << " y=" << y;
+        }
+      }
+    }
+  }
+}
+
+TEST(ColorDistanceMap, IsFor)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image.get(), rgba(0, 0, 0, 255));
+
+  ColorDistanceMap distances(image.get(), rgba(0, 0, 0, 255));
+  EXPECT_TRUE(distances.isFor(image.get(), rgba(0, 0, 0, 255)));
+  EXPECT_FALSE(distances.isFor(image.get(), rgba(1, 0, 0, 255)));
+
+  Mask mask;
+  mask.byColor(distances, 0);
+  EXPECT_EQ(gfx::Rect(0, 0, 8, 8), mask.bounds());
+
+  // A new version of the image needs a new map
+  image->incrementVersion();
+  EXPECT_FALSE(distances.isFor(image.get(), rgba(0, 0, 0, 255)));
+
+  distances.clear();
+  EXPECT_FALSE(distances.isFor(image.get(), rgba(0, 0, 0, 255)));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,55 +11,198 @@
 
 #include "doc/compressed_image.h"
 
-#include "doc/primitives.h"
-#include "doc/primitives_fast.h"
+#include "doc/dispatch.h"
+#include "doc/image_rows.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+  #define DOC_COMPRESSED_IMAGE_SSE2 1
+#endif
 
 namespace doc {
 
-CompressedImage::CompressedImage(const Image* image,
-                                 const Image* maskBitmap,
-                                 bool diffColors)
-  : m_image(image)
+namespace {
+
+#if DOC_COMPRESSED_IMAGE_SSE2
+
+// Skips blocks of 16 bytes of pixels from "x" while none of them is
+// equal to "c" (when "equal" is true) or all of them are equal to
+// "c" (when "equal" is false). Returns the position of the first
+// block that wasn't skipped.
+template<typename pixel_t>
+int skip_blocks(const pixel_t* pixels, int x, const int w,
+                const pixel_t c, const bool equal)
 {
-  color_t c1, c2, mask = image->maskColor();
+  constexpr int n = 16 / sizeof(pixel_t);
+  const int skipMask = (equal ? 0: 0xffff);
+  __m128i v;
+  if constexpr (sizeof(pixel_t) == 1)
+    v = _mm_set1_epi8(char(c));
+  else if constexpr (sizeof(pixel_t) == 2)
+    v = _mm_set1_epi16(short(c));
+  else
+    v = _mm_set1_epi32(int(c));
+
+  for (; x+n<=w; x+=n) {
+    const __m128i px = _mm_loadu_si128((const __m128i*)(pixels+x));
+    __m128i m;
+    if constexpr (sizeof(pixel_t) == 1)
+      m = _mm_cmpeq_epi8(px, v);
+    else if constexpr (sizeof(pixel_t) == 2)
+      m = _mm_cmpeq_epi16(px, v);
+    else
+      m = _mm_cmpeq_epi32(px, v);
+    if (_mm_movemask_epi8(m) != skipMask)
+      break;
+  }
+  return x;
+}
 
-  for (int y=0; y<image->height(); ++y) {
-    Scanline scanline(y);
+#endif // DOC_COMPRESSED_IMAGE_SSE2
 
-    for (int x=0; x<image->width(); ) {
-      if (maskBitmap && !get_pixel_fast<BitmapTraits>(maskBitmap, x, y)) {
-        ++x;
-        continue;
-      }
+// Returns the first position from "x" where the pixel is equal to
+// "c" (or different if "equal" is false), or row.size() if there is
+// no such pixel.
+template<typename ImageTraits>
+int find_pixel(const ConstRowView<ImageTraits>& row, int x,
+               const typename ImageTraits::pixel_t c, const bool equal)
+{
+  const int w = row.size();
+  if constexpr (!ConstRowView<ImageTraits>::is_bitmap) {
+    const auto pixels = row.data();
+#if DOC_COMPRESSED_IMAGE_SSE2
+    x = skip_blocks(pixels, x, w, c, equal);
+#endif
+    for (; x<w && (pixels[x] == c) != equal; ++x)
+      ;
+  }
+  else {
+    for (; x<w && (row[x] == c) != equal; ++x)
+      ;
+  }
+  return x;
+}
 
-      c1 = get_pixel(image, x, y);
+// Returns the first position from "x" where the bit is set (or unset
+// if "set" is false) in a bitmap row that starts in the first bit of
+// "bits".
+int find_bit(const uint8_t* bits, int x, const int w, const bool set)
+{
+  auto bit = [bits](const int i) -> bool {
+    return (bits[i >> 3] & (1 << (i & 7))) != 0;
+  };
+  const uint8_t skipByte = (set ? 0: 0xff);
+
+  for (; x<w && (x & 7) && bit(x) != set; ++x)
+    ;
+  if (x < w && !(x & 7)) {
+    for (; x+8<=w && bits[x >> 3] == skipByte; x+=8)
+      ;
+  }
+  for (; x<w && bit(x) != set; ++x)
+    ;
+  return x;
+}
 
-      if (!maskBitmap && c1 == mask) {
-        ++x;
-        continue;
+template<typename ImageTraits>
+void compress_image_templ(const Image* image,
+                          const Image* maskBitmap,
+                          const bool diffColors,
+                          CompressedImage::Scanlines& scanlines)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const pixel_t mask = image->maskColor();
+  const int w = image->width();
+
+  ASSERT(!maskBitmap || maskBitmap->pixelFormat() == IMAGE_BITMAP);
+  ASSERT(!maskBitmap || maskBitmap->width() >= w);
+  ASSERT(!maskBitmap || maskBitmap->height() >= image->height());
+
+  for_each_row<ImageTraits>(
+    image,
+    [&](const ConstRowView<ImageTraits>& row){
+      CompressedImage::Scanline scanline(row.y());
+
+      if (maskBitmap) {
+        const auto bits = (const uint8_t*)maskBitmap->getPixelAddress(0, row.y());
+
+        for (int x=find_bit(bits, 0, w, true); x<w;
+             x=find_bit(bits, x, w, true)) {
+          const int x2 = find_bit(bits, x, w, false);
+          scanline.color = row[x];
+
+          if (diffColors) {
+            // One scanline for each run of the same color
+            while (x < x2) {
+              scanline.color = row[x];
+              scanline.x = x;
+              x = std::min(x2, find_pixel(row, x, scanline.color, false));
+              scanline.w = x - scanline.x;
+              scanlines.push_back(scanline);
+            }
+          }
+          else {
+            scanline.x = x;
+            scanline.w = x2 - x;
+            scanlines.push_back(scanline);
+            x = x2;
+          }
+        }
       }
+      else {
+        for (int x=find_pixel(row, 0, mask, false); x<w;
+             x=find_pixel(row, x, mask, false)) {
+          scanline.color = row[x];
+          scanline.x = x;
+
+          if (diffColors)
+            x = find_pixel(row, x, scanline.color, false);
+          else
+            x = find_pixel(row, x, mask, true);
+
+          scanline.w = x - scanline.x;
+          scanlines.push_back(scanline);
+        }
+      }
+    });
+}
 
-      scanline.color = c1;
-      scanline.x = x;
-
-      for (++x; x<image->width(); ++x) {
-        if (maskBitmap && !get_pixel_fast<BitmapTraits>(maskBitmap, x, y))
-          break;
+void compress_image(const Image* image,
+                    const Image* maskBitmap,
+                    const bool diffColors,
+                    CompressedImage::Scanlines& scanlines)
+{
+  DOC_DISPATCH_BY_COLOR_MODE(
+    image->colorMode(),
+    compress_image_templ,
+    image, maskBitmap, diffColors, scanlines);
+}
 
-        c2 = get_pixel(image, x, y);
+} // anonymous namespace
 
-        if (diffColors && c1 != c2)
-          break;
+CompressedImage::CompressedImage()
+  : m_image(nullptr)
+{
+}
 
-        if (!diffColors && !maskBitmap && c2 == mask)
-          break;
-      }
+CompressedImage::CompressedImage(const Image* image,
+                                 const Image* maskBitmap,
+                                 bool diffColors)
+  : m_image(nullptr)
+{
+  compress(image, maskBitmap, diffColors);
+}
 
-      scanline.w = x - scanline.x;
-      if (scanline.w > 0)
-        m_scanlines.push_back(scanline);
-    }
-  }
+void CompressedImage::compress(const Image* image,
+                               const Image* maskBitmap,
+                               bool diffColors)
+{
+  m_image = image;
+  m_scanlines.clear();
+  compress_image(image, maskBitmap, diffColors, m_scanlines);
 }
 
 } // namespace doc
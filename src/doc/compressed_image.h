@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -30,9 +31,16 @@ namespace doc {
     // each different color. If it's false, it generates a scanline
     // for each row of consecutive pixels different than the mask
     // color.
+    CompressedImage();
     CompressedImage(const Image* image,
                     const Image* maskBitmap, bool diffColors);
 
+    // Re-generates the scanlines for the given image (with the same
+    // parameters as the constructor) reusing the memory of the
+    // previous ones.
+    void compress(const Image* image,
+                  const Image* maskBitmap, bool diffColors);
+
     const_iterator begin() const { return m_scanlines.begin(); }
     const_iterator end() const { return m_scanlines.end(); }
 
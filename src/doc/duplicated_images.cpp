@@ -0,0 +1,85 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/duplicated_images.h"
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/cels_range.h"
+#include "doc/images_map.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <set>
+
+namespace doc {
+
+static bool is_same_cel_data(const CelData* a, const CelData* b)
+{
+  return (a->bounds() == b->bounds() &&
+          a->hasBoundsF() == b->hasBoundsF() &&
+          (!a->hasBoundsF() || a->boundsF() == b->boundsF()) &&
+          a->opacity() == b->opacity() &&
+          a->userData() == b->userData() &&
+          is_same_image(a->image(), b->image()));
+}
+
+DuplicatedImagesStats calculate_duplicated_images_stats(const Sprite* sprite)
+{
+  DuplicatedImagesStats stats;
+  std::set<ObjectId> visited;
+  ImagesMap images;
+
+  for (const Cel* cel : sprite->uniqueCels()) {
+    const ImageRef image = cel->imageRef();
+    if (!image || !visited.insert(image->id()).second)
+      continue;
+
+    const std::size_t size = image->getMemSize();
+    ++stats.images;
+    stats.bytes += size;
+
+    if (!images.insert(std::make_pair(image, 0)).second) {
+      ++stats.duplicatedImages;
+      stats.duplicatedBytes += size;
+    }
+  }
+  return stats;
+}
+
+std::size_t link_duplicated_cels(LayerImage* layer)
+{
+  std::size_t released = 0;
+  const Cel* prev = nullptr;
+
+  for (auto it=layer->getCelBegin(), end=layer->getCelEnd(); it!=end; ++it) {
+    Cel* cel = *it;
+    if (prev &&
+        prev->data() != cel->data() &&
+        prev->image() && cel->image() &&
+        is_same_cel_data(prev->data(), cel->data())) {
+      const CelDataRef old = cel->dataRef();
+      cel->setDataRef(prev->dataRef());
+
+      // The image is released only if it's not used by other cels
+      // (one reference is from "old" and the other from "image")
+      if (old.use_count() == 1) {
+        const ImageRef image = old->imageRef();
+        if (image.use_count() == 2)
+          released += image->getMemSize();
+      }
+    }
+    prev = cel;
+  }
+  return released;
+}
+
+} // namespace doc
@@ -0,0 +1,39 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_DUPLICATED_IMAGES_H_INCLUDED
+#define DOC_DUPLICATED_IMAGES_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+
+namespace doc {
+
+  class LayerImage;
+  class Sprite;
+
+  // Cel images of a sprite with the same pixels of other cel image
+  // (e.g. frames duplicated/pasted without linking their cels).
+  struct DuplicatedImagesStats {
+    int images = 0;                  // Number of different Image instances
+    int duplicatedImages = 0;        // Images equal to a previous image
+    std::size_t bytes = 0;           // Memory used by all images
+    std::size_t duplicatedBytes = 0; // Memory used by the duplicated ones
+  };
+
+  DuplicatedImagesStats calculate_duplicated_images_stats(const Sprite* sprite);
+
+  // Links each cel of the layer to the previous cel of the same layer
+  // when both have the same cel data (pixels, bounds, opacity, and
+  // user data), so the duplicated images are released. It doesn't
+  // generate undo information, so it's useful only for sprites that
+  // are being created (e.g. decoding a file). Returns the number of
+  // bytes of the released images.
+  std::size_t link_duplicated_cels(LayerImage* layer);
+
+} // namespace doc
+
+#endif
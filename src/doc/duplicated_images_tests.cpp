@@ -0,0 +1,72 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/duplicated_images.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <memory>
+
+using namespace doc;
+
+static Cel* add_cel(LayerImage* lay, frame_t frame, color_t color)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(image.get(), color);
+  Cel* cel = new Cel(frame, image);
+  lay->addCel(cel);
+  return cel;
+}
+
+TEST(DuplicatedImages, StatsAndLink)
+{
+  std::unique_ptr<Sprite> spr(
+    Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4)));
+  spr->setTotalFrames(5);
+
+  auto lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  const color_t red = rgba(255, 0, 0, 255);
+  const color_t blue = rgba(0, 0, 255, 255);
+  clear_image(lay->cel(0)->image(), red);
+  add_cel(lay, 1, red);
+  add_cel(lay, 2, red)->setPosition(1, 0);
+  add_cel(lay, 3, blue);
+  lay->addCel(Cel::MakeLink(4, lay->cel(3)));
+
+  const std::size_t size = lay->cel(0)->image()->getMemSize();
+  DuplicatedImagesStats stats = calculate_duplicated_images_stats(spr.get());
+  EXPECT_EQ(4, stats.images);
+  EXPECT_EQ(2, stats.duplicatedImages);
+  EXPECT_EQ(4*size, stats.bytes);
+  EXPECT_EQ(2*size, stats.duplicatedBytes);
+
+  // Only cels with the same position are linked
+  EXPECT_EQ(size, link_duplicated_cels(lay));
+  EXPECT_EQ(lay->cel(0)->data(), lay->cel(1)->data());
+  EXPECT_NE(lay->cel(1)->data(), lay->cel(2)->data());
+  EXPECT_EQ(lay->cel(3)->data(), lay->cel(4)->data());
+
+  stats = calculate_duplicated_images_stats(spr.get());
+  EXPECT_EQ(3, stats.images);
+  EXPECT_EQ(1, stats.duplicatedImages);
+
+  // Nothing else to link
+  EXPECT_EQ(0, link_duplicated_cels(lay));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,12 +17,24 @@
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/rgbmap.h"
+#include "doc/tile.h"
+
+#include <algorithm>
 
 namespace doc {
 
 Image::Image(const ImageSpec& spec)
   : Object(ObjectType::Image)
+  , m_tiled(false)
   , m_spec(spec)
+  , m_hash(0)
+  , m_hashKey(0)
+  , m_plainColor(0)
+  , m_plain(false)
+  , m_plainExact(false)
+  , m_plainKey(0)
+  , m_histogramKey(0)
+  , m_tileHistogramKey(0)
 {
 }
 
@@ -35,6 +47,95 @@ int Image::getMemSize() const
   return sizeof(Image) + rowBytes()*height();
 }
 
+uint32_t Image::contentHash() const
+{
+  if (!hasContentHash()) {
+    const std::lock_guard lock(m_cacheMutex);
+    if (!hasContentHash()) {
+      m_hash = calculate_image_hash(this, bounds());
+      m_hashKey.store(cacheKey(), std::memory_order_release);
+    }
+  }
+  return m_hash;
+}
+
+bool Image::isPlain(color_t* color, bool* exact) const
+{
+  if (!hasPlainInfo()) {
+    const std::lock_guard lock(m_cacheMutex);
+    if (!hasPlainInfo()) {
+      m_plain = calculate_plain_color(this, m_plainColor, m_plainExact);
+      m_plainKey.store(cacheKey(), std::memory_order_release);
+    }
+  }
+  if (color)
+    *color = m_plainColor;
+  if (exact)
+    *exact = m_plainExact;
+  return m_plain;
+}
+
+const Image::IndexHistogram& Image::indexHistogram() const
+{
+  if (!hasIndexHistogram()) {
+    const std::lock_guard lock(m_cacheMutex);
+    if (!hasIndexHistogram()) {
+      if (!m_histogram)
+        m_histogram = std::make_unique<IndexHistogram>();
+
+      IndexHistogram& histogram = *m_histogram;
+      histogram.fill(0);
+      if (pixelFormat() == IMAGE_INDEXED) {
+        for_each_pixel<IndexedTraits>(
+          this, [&histogram](const color_t c) {
+            ++histogram[c & 0xff];
+          });
+      }
+      m_histogramKey.store(cacheKey(), std::memory_order_release);
+    }
+  }
+  return *m_histogram;
+}
+
+const Image::TileHistogram& Image::tileHistogram() const
+{
+  if (!hasTileHistogram()) {
+    const std::lock_guard lock(m_cacheMutex);
+    if (!hasTileHistogram()) {
+      m_tileHistogram.clear();
+      if (pixelFormat() == IMAGE_TILEMAP) {
+        // Sort the used indexes to count them (tile indexes can be
+        // outside the tileset range, so we don't use a dense array)
+        std::vector<uint32_t> indexes;
+        indexes.reserve(std::size_t(width())*height());
+        for_each_pixel<TilemapTraits>(
+          this, [&indexes](const color_t t) {
+            if (t != notile)
+              indexes.push_back(tile_geti(t));
+          });
+        std::sort(indexes.begin(), indexes.end());
+
+        for (const uint32_t ti : indexes) {
+          if (m_tileHistogram.empty() || m_tileHistogram.back().first != ti)
+            m_tileHistogram.emplace_back(ti, 0);
+          ++m_tileHistogram.back().second;
+        }
+        m_tileHistogram.shrink_to_fit();
+      }
+      m_tileHistogramKey.store(cacheKey(), std::memory_order_release);
+    }
+  }
+  return m_tileHistogram;
+}
+
+void Image::setPlainColor(color_t color) const
+{
+  m_plainColor = color;
+  m_plain = true;
+  m_plainExact = true;
+  m_plainKey.store(cacheKey(), std::memory_order_release);
+}
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
@@ -64,8 +165,37 @@ Image* Image::create(const ImageSpec& spec,
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
+
+  // Copies of tiled images share their tiles with the original image
+  if (image->isTiled() && !buffer) {
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:       return new ImageImpl<RgbTraits>(image->spec(), TiledStorage(), (const ImageImpl<RgbTraits>*)image);
+      case IMAGE_GRAYSCALE: return new ImageImpl<GrayscaleTraits>(image->spec(), TiledStorage(), (const ImageImpl<GrayscaleTraits>*)image);
+      case IMAGE_INDEXED:   return new ImageImpl<IndexedTraits>(image->spec(), TiledStorage(), (const ImageImpl<IndexedTraits>*)image);
+      case IMAGE_BITMAP:    return new ImageImpl<BitmapTraits>(image->spec(), TiledStorage(), (const ImageImpl<BitmapTraits>*)image);
+      case IMAGE_TILEMAP:   return new ImageImpl<TilemapTraits>(image->spec(), TiledStorage(), (const ImageImpl<TilemapTraits>*)image);
+    }
+  }
+
   return crop_image(image, 0, 0, image->width(), image->height(),
                     image->maskColor(), buffer);
 }
 
+// static
+Image* Image::createTiled(const ImageSpec& spec)
+{
+  ASSERT(spec.width() >= 1 && spec.height() >= 1);
+  if (spec.width() < 1 || spec.height() < 1)
+    return nullptr;
+
+  switch (spec.colorMode()) {
+    case ColorMode::RGB:       return new ImageImpl<RgbTraits>(spec, TiledStorage());
+    case ColorMode::GRAYSCALE: return new ImageImpl<GrayscaleTraits>(spec, TiledStorage());
+    case ColorMode::INDEXED:   return new ImageImpl<IndexedTraits>(spec, TiledStorage());
+    case ColorMode::BITMAP:    return new ImageImpl<BitmapTraits>(spec, TiledStorage());
+    case ColorMode::TILEMAP:   return new ImageImpl<TilemapTraits>(spec, TiledStorage());
+  }
+  return nullptr;
+}
+
 } // namespace doc
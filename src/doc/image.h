@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,14 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
@@ -28,6 +36,10 @@ namespace doc {
 
   class Image : public Object {
   public:
+    using IndexHistogram = std::array<uint32_t, 256>;
+    // Pairs of tile index and number of uses, sorted by tile index.
+    using TileHistogram = std::vector<std::pair<uint32_t, uint32_t>>;
+
     enum LockType {
       ReadLock,                 // Read-only lock
       WriteLock,                // Write-only lock
@@ -41,6 +53,16 @@ namespace doc {
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
+    // Creates an image with tiled storage: pixels are stored in
+    // reference-counted tiles of kTileRows rows (each tile covers the
+    // whole width of the image so rows are still contiguous). A
+    // createCopy() of a tiled image shares all its tiles, and tiles
+    // are duplicated only when they are modified (copy-on-write).
+    static Image* createTiled(const ImageSpec& spec);
+
+    // Number of rows of each tile of a tiled image.
+    static constexpr int kTileRows = 64;
+
     virtual ~Image();
 
     const ImageSpec& spec() const { return m_spec; }
@@ -72,8 +94,82 @@ namespace doc {
 
     virtual int getMemSize() const override;
 
+    // Returns true if this image was created with createTiled() (or
+    // it's a copy of a tiled image).
+    bool isTiled() const { return m_tiled; }
+
+    // Duplicates the shared tiles that intersect the given bounds so
+    // they can be modified without affecting other images. All
+    // member functions that modify pixels, the non-const lockBits(),
+    // the non-const getPixelAddress(), and put_pixel_fast() already
+    // call this function. Only code that writes pixels through
+    // pointers obtained from a const image must call it before.
+    virtual void unshareTiles(const gfx::Rect& bounds) { }
+
+    // Must be called once before modifying pixels of the given rows
+    // directly: it invalidates the cached values (contentHash(),
+    // etc.) and duplicates the shared tiles of those rows.
+    void prepareRowsToWrite(int y1, int y2) {
+      invalidateContentHash();
+      if (m_tiled)
+        unshareTiles(gfx::Rect(0, y1, width(), y2-y1+1));
+    }
+
+    // Returns the hash of all pixels (see calculate_image_hash()).
+    // It's calculated lazily and cached until the image version
+    // changes or its pixels are modified through Image member
+    // functions or the non-const lockBits(). Code that modifies pixels
+    // directly through getPixelAddress() must call
+    // prepareRowsToWrite() once (or incrementVersion()). Several threads
+    // can call it (and the other cached values) at the same time while
+    // the image is not modified.
+    uint32_t contentHash() const;
+    bool hasContentHash() const {
+      return (m_hashKey.load(std::memory_order_acquire) == cacheKey());
+    }
+
+    // Returns true if all pixels have the same color (using the
+    // ImageTraits::same_color() criteria, i.e. all transparent
+    // pixels are equal), e.g. an empty cel. In that case "color" is
+    // the value of the first pixel, and "exact" is true if all
+    // pixels have exactly that value. It's cached like contentHash().
+    bool isPlain(color_t* color = nullptr, bool* exact = nullptr) const;
+    bool hasPlainInfo() const {
+      return (m_plainKey.load(std::memory_order_acquire) == cacheKey());
+    }
+
+    // Returns the number of pixels that use each index of an indexed
+    // image (all entries are zero for other pixel formats). It's
+    // cached like contentHash().
+    const IndexHistogram& indexHistogram() const;
+    bool hasIndexHistogram() const {
+      return (m_histogramKey.load(std::memory_order_acquire) == cacheKey());
+    }
+
+    // Returns the tile indexes used in a tilemap image and the number
+    // of tiles that use each index (notile is not counted, and it's
+    // empty for other pixel formats). It's cached like contentHash().
+    const TileHistogram& tileHistogram() const;
+    bool hasTileHistogram() const {
+      return (m_tileHistogramKey.load(std::memory_order_acquire) == cacheKey());
+    }
+
+    // Invalidates the cached contentHash(), isPlain(),
+    // indexHistogram(), and tileHistogram() values.
+    void invalidateContentHash() {
+      m_hashKey.store(0, std::memory_order_relaxed);
+      m_plainKey.store(0, std::memory_order_relaxed);
+      m_histogramKey.store(0, std::memory_order_relaxed);
+      m_tileHistogramKey.store(0, std::memory_order_relaxed);
+    }
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
+      // LockImageBits is used with ReadLock to modify pixels in
+      // several places, so we cannot trust the lockType here.
+      invalidateContentHash();
+      if (m_tiled)
+        unshareTiles(bounds);
       return ImageBits<ImageTraits>(this, bounds);
     }
 
@@ -91,6 +187,13 @@ namespace doc {
     // bounds checks. Use the primitives defined in doc/primitives.h
     // in case that you need bounds check.
     virtual uint8_t* getPixelAddress(int x, int y) const = 0;
+    // The non-const version is used to modify pixels directly, so it
+    // duplicates the shared tile of the row in tiled images.
+    uint8_t* getPixelAddress(int x, int y) {
+      if (m_tiled)
+        unshareTiles(gfx::Rect(0, y, width(), 1));
+      return static_cast<const Image*>(this)->getPixelAddress(x, y);
+    }
     virtual color_t getPixel(int x, int y) const = 0;
     virtual void putPixel(int x, int y, color_t color) = 0;
     virtual void clear(color_t color) = 0;
@@ -102,11 +205,46 @@ namespace doc {
   protected:
     Image(const ImageSpec& spec);
 
+    // Used by clear() to avoid calculating isPlain() later.
+    void setPlainColor(color_t color) const;
+
     // Number of bytes for each row.
     size_t m_rowBytes;
 
+    // True if the pixels are stored in shared tiles.
+    bool m_tiled;
+
   private:
+    // Key of the cached values calculated for the current version of
+    // the image (a key equal to 0 means that the value is invalid).
+    uint64_t cacheKey() const {
+      return (uint64_t(1) << 32) | version();
+    }
+
     ImageSpec m_spec;
+
+    // Locked to calculate the cached values. Each m_*Key is stored
+    // (with release semantics) after its value is calculated, so a
+    // thread that sees a valid key can read the value without locking.
+    mutable std::mutex m_cacheMutex;
+
+    // Cached contentHash().
+    mutable uint32_t m_hash;
+    mutable std::atomic<uint64_t> m_hashKey;
+
+    // Cached isPlain().
+    mutable color_t m_plainColor;
+    mutable bool m_plain;
+    mutable bool m_plainExact;
+    mutable std::atomic<uint64_t> m_plainKey;
+
+    // Cached indexHistogram() (allocated only if it's used).
+    mutable std::unique_ptr<IndexHistogram> m_histogram;
+    mutable std::atomic<uint64_t> m_histogramKey;
+
+    // Cached tileHistogram().
+    mutable TileHistogram m_tileHistogram;
+    mutable std::atomic<uint64_t> m_tileHistogramKey;
   };
 
 } // namespace doc
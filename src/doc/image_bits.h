@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2014  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -121,6 +121,17 @@ namespace doc {
       : m_bits(image->lockBits<ImageTraits>(Image::ReadLock, bounds)) {
     }
 
+    // Non-const images are locked to be modified (it's a common
+    // pattern to modify pixels locking a non-const image without a
+    // LockType).
+    explicit LockImageBits(Image* image)
+      : m_bits(image->lockBits<ImageTraits>(Image::ReadWriteLock, image->bounds())) {
+    }
+
+    LockImageBits(Image* image, const gfx::Rect& bounds)
+      : m_bits(image->lockBits<ImageTraits>(Image::ReadWriteLock, bounds)) {
+    }
+
     LockImageBits(Image* image, Image::LockType lockType)
       : m_bits(image->lockBits<ImageTraits>(lockType, image->bounds())) {
     }
@@ -11,7 +11,7 @@
 
 #include "base/disable_copying.h"
 #include "base/ints.h"
-#include "doc/aligned_memory.h"
+#include "doc/image_buffer_pool.h"
 
 #include <algorithm>
 #include <cstddef>
@@ -20,18 +20,21 @@
 
 namespace doc {
 
+  // Memory block to store image pixels. The memory is taken from the
+  // image buffer pool (see image_buffer_pool.h), so the real size of
+  // the buffer can be a little bigger than the requested one.
   class ImageBuffer {
   public:
     ImageBuffer(std::size_t size = 1)
-      : m_size(doc_align_size(size))
-      , m_buffer((uint8_t*)doc_aligned_alloc(m_size)) {
+      : m_size(size)
+      , m_buffer((uint8_t*)image_buffer_alloc(m_size)) {
       if (!m_buffer)
         throw std::bad_alloc();
     }
 
     ~ImageBuffer() noexcept {
       if (m_buffer)
-        doc_aligned_free(m_buffer);
+        image_buffer_free(m_buffer, m_size);
     }
 
     std::size_t size() const { return m_size; }
@@ -40,12 +43,12 @@ namespace doc {
     void resizeIfNecessary(std::size_t size) {
       if (size > m_size) {
         if (m_buffer) {
-          doc_aligned_free(m_buffer);
+          image_buffer_free(m_buffer, m_size);
           m_buffer = nullptr;
         }
 
-        m_size = doc_align_size(size);
-        m_buffer = (uint8_t*)doc_aligned_alloc(m_size);
+        m_size = size;
+        m_buffer = (uint8_t*)image_buffer_alloc(m_size);
         if (!m_buffer)
           throw std::bad_alloc();
       }
@@ -0,0 +1,320 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_pool.h"
+
+#include "base/debug.h"
+#include "doc/aligned_memory.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+namespace doc {
+
+namespace {
+
+// Size of the smallest class
+const std::size_t kMinClassSize = 256;
+const int kMinClassBits = 8;
+
+// Bigger blocks are allocated/freed directly from/to the system
+const std::size_t kMaxPooledSize = 64*1024*1024;
+
+// Max number of bytes kept in the global pool
+const std::size_t kMaxCachedSize = 128*1024*1024;
+
+// Only blocks of this size (or less) are cached per thread, each
+// thread caches up to kThreadCacheBlocks for each class and up to
+// kMaxThreadCachedBytes in total.
+const std::size_t kMaxThreadCachedSize = 4*1024*1024;
+const int kThreadCacheBlocks = 4;
+const std::size_t kMaxThreadCachedBytes = 8*1024*1024;
+
+// Each power of two is divided in 4 classes.
+const int kClassesPerBit = 4;
+const int kNumClasses = 1 + (sizeof(std::size_t)*8 - kMinClassBits) * kClassesPerBit;
+
+int highest_bit(std::size_t n)
+{
+  int bit = -1;
+  while (n) {
+    n >>= 1;
+    ++bit;
+  }
+  return bit;
+}
+
+// Returns the class index for the given size, and rounds the size
+// up to the size of the class.
+int size_class(std::size_t& size)
+{
+  if (size <= kMinClassSize) {
+    size = kMinClassSize;
+    return 0;
+  }
+
+  const int bit = highest_bit(size-1);
+  const std::size_t step = (std::size_t(1) << (bit-2));
+  size = (size + step - 1) & ~(step - 1);
+
+  const int k = int(size / step) - 4;
+  ASSERT(k >= 1 && k <= kClassesPerBit);
+  return 1 + (bit - kMinClassBits)*kClassesPerBit + (k - 1);
+}
+
+// Header stored at the beginning of each free block (free blocks
+// are at least kMinClassSize bytes) to link it in the LRU list of a
+// cache and in the list of blocks of its size class.
+struct FreeBlock {
+  FreeBlock* lruPrev;
+  FreeBlock* lruNext;
+  FreeBlock* classPrev;
+  FreeBlock* classNext;
+  std::size_t size;
+  int index;
+};
+
+static_assert(sizeof(FreeBlock) <= kMinClassSize,
+              "FreeBlock must fit in the smallest block");
+
+// Free blocks with a limit for the total number of bytes. When a new
+// block doesn't fit, the least recently freed blocks are evicted.
+class BlockCache {
+public:
+  explicit BlockCache(const std::size_t maxSize)
+    : m_maxSize(maxSize) {
+  }
+
+  std::size_t cachedSize() const { return m_cachedSize; }
+  int blocks(const int index) const { return m_classCount[index]; }
+
+  // Returns the most recently freed block of the given class.
+  void* pop(const int index) {
+    FreeBlock* b = m_classTail[index];
+    if (!b)
+      return nullptr;
+    unlink(b);
+    return b;
+  }
+
+  // Adds the block to the cache calling evict(ptr, index, size) for
+  // each block that must be removed to keep the cache under its
+  // limit. Returns false if the block is too big for this cache.
+  template<typename Evict>
+  bool push(const int index, const std::size_t size, void* ptr,
+            Evict&& evict) {
+    if (size > m_maxSize)
+      return false;
+
+    while (m_cachedSize + size > m_maxSize) {
+      FreeBlock* old = m_lruHead;
+      unlink(old);
+      evict((void*)old, old->index, old->size);
+    }
+
+    auto b = (FreeBlock*)ptr;
+    b->size = size;
+    b->index = index;
+    b->lruPrev = m_lruTail;
+    b->lruNext = nullptr;
+    if (m_lruTail)
+      m_lruTail->lruNext = b;
+    else
+      m_lruHead = b;
+    m_lruTail = b;
+
+    b->classPrev = m_classTail[index];
+    b->classNext = nullptr;
+    if (m_classTail[index])
+      m_classTail[index]->classNext = b;
+    m_classTail[index] = b;
+
+    ++m_classCount[index];
+    m_cachedSize += size;
+    return true;
+  }
+
+  // Removes all blocks (from the least recently freed one) calling
+  // f(ptr, index, size) for each one.
+  template<typename F>
+  void clear(F&& f) {
+    while (FreeBlock* b = m_lruHead) {
+      unlink(b);
+      f((void*)b, b->index, b->size);
+    }
+  }
+
+private:
+  void unlink(FreeBlock* b) {
+    if (b->lruPrev)
+      b->lruPrev->lruNext = b->lruNext;
+    else
+      m_lruHead = b->lruNext;
+    if (b->lruNext)
+      b->lruNext->lruPrev = b->lruPrev;
+    else
+      m_lruTail = b->lruPrev;
+
+    if (b->classPrev)
+      b->classPrev->classNext = b->classNext;
+    if (b->classNext)
+      b->classNext->classPrev = b->classPrev;
+    else
+      m_classTail[b->index] = b->classPrev;
+
+    --m_classCount[b->index];
+    m_cachedSize -= b->size;
+  }
+
+  FreeBlock* m_lruHead = nullptr; // Least recently freed block
+  FreeBlock* m_lruTail = nullptr; // Most recently freed block
+  FreeBlock* m_classTail[kNumClasses] = { };
+  int m_classCount[kNumClasses] = { };
+  std::size_t m_cachedSize = 0;
+  const std::size_t m_maxSize;
+};
+
+void free_block(void* ptr, int, std::size_t)
+{
+  doc_aligned_free(ptr);
+}
+
+struct GlobalPool {
+  std::mutex mutex;
+  BlockCache cache { kMaxCachedSize };
+
+  void* pop(const int index) {
+    const std::lock_guard lock(mutex);
+    return cache.pop(index);
+  }
+
+  bool push(const int index, const std::size_t size, void* ptr) {
+    const std::lock_guard lock(mutex);
+    return cache.push(index, size, ptr, free_block);
+  }
+
+  void trim() {
+    const std::lock_guard lock(mutex);
+    cache.clear(free_block);
+  }
+};
+
+// The global pool is never destroyed because ImageBuffers can be
+// released from the destructors of other static objects.
+GlobalPool& global_pool()
+{
+  static GlobalPool* pool = new GlobalPool;
+  return *pool;
+}
+
+void push_to_global_pool(void* ptr, int index, std::size_t size)
+{
+  if (!global_pool().push(index, size, ptr))
+    doc_aligned_free(ptr);
+}
+
+// Incremented by image_buffer_pool_trim() so the caches of other
+// threads are released the next time they are used.
+std::atomic<unsigned> trim_epoch(0);
+
+// Free blocks cached for the current thread, the evicted blocks and
+// the remaining ones when the thread finishes are moved to the global
+// pool.
+struct ThreadCache {
+  BlockCache cache { kMaxThreadCachedBytes };
+  unsigned epoch = trim_epoch.load(std::memory_order_relaxed);
+
+  ~ThreadCache();
+
+  // Releases the cached blocks if image_buffer_pool_trim() was
+  // called since the last time this cache was used.
+  void checkTrimEpoch() {
+    const unsigned current = trim_epoch.load(std::memory_order_relaxed);
+    if (epoch != current) {
+      cache.clear(free_block);
+      epoch = current;
+    }
+  }
+};
+
+thread_local ThreadCache thread_cache;
+
+// Set to true when thread_cache is destroyed (ImageBuffers released
+// after that point go directly to the global pool).
+thread_local bool thread_cache_destroyed = false;
+
+ThreadCache::~ThreadCache()
+{
+  cache.clear(push_to_global_pool);
+  thread_cache_destroyed = true;
+}
+
+} // anonymous namespace
+
+void* image_buffer_alloc(std::size_t& size)
+{
+  if (size > kMaxPooledSize)
+    return doc_aligned_alloc(size);
+
+  const int index = size_class(size);
+
+  if (!thread_cache_destroyed) {
+    thread_cache.checkTrimEpoch();
+    if (void* ptr = thread_cache.cache.pop(index))
+      return ptr;
+  }
+
+  if (void* ptr = global_pool().pop(index))
+    return ptr;
+
+  return doc_aligned_alloc(size);
+}
+
+void image_buffer_free(void* ptr, std::size_t size)
+{
+  if (!ptr)
+    return;
+
+  if (size > kMaxPooledSize) {
+    doc_aligned_free(ptr);
+    return;
+  }
+
+  const int index = size_class(size);
+
+  if (size <= kMaxThreadCachedSize && !thread_cache_destroyed) {
+    thread_cache.checkTrimEpoch();
+    auto& local = thread_cache.cache;
+    if (local.blocks(index) < kThreadCacheBlocks) {
+      local.push(index, size, ptr, push_to_global_pool);
+      return;
+    }
+  }
+
+  push_to_global_pool(ptr, index, size);
+}
+
+void image_buffer_pool_trim()
+{
+  trim_epoch.fetch_add(1, std::memory_order_relaxed);
+  if (!thread_cache_destroyed)
+    thread_cache.checkTrimEpoch();
+  global_pool().trim();
+}
+
+std::size_t image_buffer_pool_cached_size()
+{
+  auto& pool = global_pool();
+  const std::lock_guard lock(pool.mutex);
+  return pool.cache.cachedSize();
+}
+
+} // namespace doc
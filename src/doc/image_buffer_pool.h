@@ -0,0 +1,42 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#define DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+
+namespace doc {
+
+  // Process-wide pool of memory blocks used by ImageBuffer. Blocks
+  // are grouped in size classes (up to 25% bigger than the requested
+  // size), so images of similar sizes can reuse the same blocks
+  // without going to the system allocator. Each thread keeps a small
+  // cache of free blocks to avoid locking a mutex for short-lived
+  // temporary images. Both the pool and the thread caches have a
+  // limit of cached bytes, and the least recently freed blocks are
+  // released when a new block doesn't fit.
+
+  // Returns a block with space for at least "size" bytes. The given
+  // "size" is updated to the real capacity of the returned block,
+  // and it must be the size used to free it later.
+  void* image_buffer_alloc(std::size_t& size);
+  void image_buffer_free(void* ptr, std::size_t size);
+
+  // Releases all the free blocks cached in the pool and in the cache
+  // of the calling thread to the system. The caches of other threads
+  // are released the next time those threads allocate or free a
+  // block. It's called when documents are destroyed.
+  void image_buffer_pool_trim();
+
+  // Returns the number of bytes of free blocks that are kept in the
+  // pool (without the per-thread caches).
+  std::size_t image_buffer_pool_cached_size();
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,133 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_buffer.h"
+#include "doc/image_buffer_pool.h"
+
+#include <thread>
+
+using namespace doc;
+
+TEST(ImageBufferPool, SizeClasses)
+{
+  std::size_t size = 1;
+  void* ptr = image_buffer_alloc(size);
+  EXPECT_EQ(256, size);
+  image_buffer_free(ptr, size);
+
+  size = 1000;
+  ptr = image_buffer_alloc(size);
+  EXPECT_EQ(1024, size);
+  image_buffer_free(ptr, size);
+
+  size = 1025;
+  ptr = image_buffer_alloc(size);
+  EXPECT_EQ(1280, size);
+  image_buffer_free(ptr, size);
+
+  size = 64*64*4 + 1;
+  ptr = image_buffer_alloc(size);
+  EXPECT_EQ(64*64*4 + 4096, size);
+  image_buffer_free(ptr, size);
+}
+
+TEST(ImageBufferPool, ReuseBlocks)
+{
+  image_buffer_pool_trim();
+
+  std::size_t size = 32*32*4;
+  void* a = image_buffer_alloc(size);
+  image_buffer_free(a, size);
+
+  // The block is reused from the thread cache
+  std::size_t size2 = 32*32*4 - 3;
+  void* b = image_buffer_alloc(size2);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(size, size2);
+  image_buffer_free(b, size2);
+
+  ImageBuffer buf(32*32*4);
+  EXPECT_EQ(a, buf.buffer());
+}
+
+TEST(ImageBufferPool, ThreadCacheGoesToGlobalPool)
+{
+  image_buffer_pool_trim();
+  EXPECT_EQ(0, image_buffer_pool_cached_size());
+
+  std::thread thread([]{
+    ImageBuffer buf(16*1024);
+  });
+  thread.join();
+
+  EXPECT_EQ(16*1024, image_buffer_pool_cached_size());
+  image_buffer_pool_trim();
+  EXPECT_EQ(0, image_buffer_pool_cached_size());
+}
+
+TEST(ImageBufferPool, ThreadCacheLimit)
+{
+  image_buffer_pool_trim();
+
+  // The thread cache keeps up to 8MB, so the first freed block goes
+  // to the global pool
+  const std::size_t blockSize = 4*1024*1024;
+  void* blocks[3];
+  for (void*& b : blocks) {
+    std::size_t size = blockSize;
+    b = image_buffer_alloc(size);
+    EXPECT_EQ(blockSize, size);
+  }
+  for (void* b : blocks)
+    image_buffer_free(b, blockSize);
+  EXPECT_EQ(blockSize, image_buffer_pool_cached_size());
+
+  image_buffer_pool_trim();
+  EXPECT_EQ(0, image_buffer_pool_cached_size());
+}
+
+TEST(ImageBufferPool, EvictLeastRecentlyFreed)
+{
+  image_buffer_pool_trim();
+
+  // Blocks bigger than 4MB go directly to the global pool, which
+  // keeps up to 128MB, so the first freed block is released
+  const std::size_t blockSize = 40*1024*1024;
+  void* blocks[4];
+  for (void*& b : blocks) {
+    std::size_t size = blockSize;
+    b = image_buffer_alloc(size);
+    EXPECT_EQ(blockSize, size);
+  }
+  for (void* b : blocks)
+    image_buffer_free(b, blockSize);
+  EXPECT_EQ(3*blockSize, image_buffer_pool_cached_size());
+
+  // The most recently freed blocks are reused first
+  for (int i=3; i>=1; --i) {
+    std::size_t size = blockSize;
+    void* b = image_buffer_alloc(size);
+    EXPECT_EQ(blocks[i], b);
+    blocks[i] = b;
+  }
+  EXPECT_EQ(0, image_buffer_pool_cached_size());
+
+  for (int i=1; i<4; ++i)
+    image_buffer_free(blocks[i], blockSize);
+  image_buffer_pool_trim();
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
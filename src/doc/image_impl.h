@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include "doc/blend_funcs.h"
 #include "doc/image.h"
@@ -23,6 +24,9 @@ namespace doc {
 
   template<typename ImageTraits> class LockImageBits;
 
+  // Tag used to create an ImageImpl with tiled storage.
+  struct TiledStorage { };
+
   template<class Traits>
   class ImageImpl : public Image {
   public:
@@ -35,6 +39,10 @@ namespace doc {
     address_t* m_rows;
     address_t m_bits;
 
+    // Tiles of kTileRows rows to store pixels when the image was
+    // created with tiled storage (empty for regular images).
+    std::vector<ImageBufferPtr> m_tiles;
+
     inline address_t getLineAddress(int y) {
       ASSERT(y >= 0 && y < height());
       return m_rows[y];
@@ -45,6 +53,21 @@ namespace doc {
       return m_rows[y];
     }
 
+    std::size_t tileBytes(int i) const {
+      const int y = i*kTileRows;
+      return m_rowBytes * std::min(kTileRows, height() - y);
+    }
+
+    void updateTileRows(int i) {
+      const int y1 = i*kTileRows;
+      const int y2 = std::min(y1 + kTileRows, height());
+      auto addr = m_tiles[i]->buffer();
+      for (int y=y1; y<y2; ++y) {
+        m_rows[y] = (address_t)addr;
+        addr += m_rowBytes;
+      }
+    }
+
   public:
     inline address_t address(int x, int y) const {
       if constexpr (Traits::pixels_per_byte == 0) {
@@ -86,6 +109,63 @@ namespace doc {
       }
     }
 
+    // Creates an image with tiled storage. If "shared" is specified,
+    // the new image will share all the tiles with it.
+    ImageImpl(const ImageSpec& spec,
+              TiledStorage,
+              const ImageImpl* shared = nullptr)
+      : Image(spec)
+    {
+      ASSERT(Traits::color_mode == spec.colorMode());
+      ASSERT(!shared || (shared->isTiled() &&
+                         shared->bounds() == bounds()));
+
+      m_tiled = true;
+      m_rowBytes = Traits::rowstride_bytes(width());
+      m_buffer = std::make_shared<ImageBuffer>(sizeof(address_t) * height());
+      m_rows = (address_t*)m_buffer->buffer();
+
+      if (shared) {
+        m_tiles = shared->m_tiles;
+      }
+      else {
+        m_tiles.resize((height() + kTileRows - 1) / kTileRows);
+        for (int i=0; i<int(m_tiles.size()); ++i) {
+          const std::size_t size = tileBytes(i);
+          m_tiles[i] = std::make_shared<ImageBuffer>(size);
+          std::fill(m_tiles[i]->buffer(),
+                    m_tiles[i]->buffer()+size, 0);
+        }
+      }
+
+      for (int i=0; i<int(m_tiles.size()); ++i)
+        updateTileRows(i);
+
+      m_bits = m_rows[0];
+    }
+
+    void unshareTiles(const gfx::Rect& bounds) override {
+      if (!m_tiled)
+        return;
+
+      const int y1 = std::max(bounds.y, 0);
+      const int y2 = std::min(bounds.y2(), height());
+      if (y1 >= y2 || bounds.w < 1)
+        return;
+
+      for (int i=y1/kTileRows; i<=(y2-1)/kTileRows; ++i) {
+        ImageBufferPtr& tile = m_tiles[i];
+        if (tile.use_count() > 1) {
+          const std::size_t size = tileBytes(i);
+          auto copy = std::make_shared<ImageBuffer>(size);
+          std::copy(tile->buffer(), tile->buffer()+size, copy->buffer());
+          tile = copy;
+          updateTileRows(i);
+        }
+      }
+    }
+
+    using Image::getPixelAddress;
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
@@ -104,12 +184,15 @@ namespace doc {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
+      prepareRowsToWrite(y, y);
       *address(x, y) = color;
     }
 
     void clear(color_t color) override {
       const int w = width();
       const int h = height();
+      prepareRowsToWrite(0, h-1);
+      setPlainColor(typename traits_t::pixel_t(color));
       for (int y=0; y<h; ++y) {
         address_t p = address(0, y);
         std::fill(p, p+w, color);
@@ -124,6 +207,8 @@ namespace doc {
       if (!area.clip(width(), height(), src->width(), src->height()))
         return;
 
+      prepareRowsToWrite(area.dst.y, area.dst.y+area.size.h-1);
+
       for (int end_y=area.dst.y+area.size.h;
            area.dst.y<end_y;
            ++area.dst.y, ++area.src.y) {
@@ -137,6 +222,7 @@ namespace doc {
     }
 
     void drawHLine(int x1, int y, int x2, color_t color) override {
+      prepareRowsToWrite(y, y);
       LockImageBits<Traits> bits(this, gfx::Rect(x1, y, x2 - x1 + 1, 1));
       typename LockImageBits<Traits>::iterator it(bits.begin());
       typename LockImageBits<Traits>::iterator end(bits.end());
@@ -146,6 +232,8 @@ namespace doc {
     }
 
     void fillRect(int x1, int y1, int x2, int y2, color_t color) override {
+      prepareRowsToWrite(y1, y2);
+
       // Fill the first line
       ImageImpl<Traits>::drawHLine(x1, y1, x2, color);
 
@@ -222,12 +310,30 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
+    prepareRowsToWrite(0, height()-1);
+    setPlainColor(IndexedTraits::pixel_t(color));
+    if (m_tiled) {
+      for (int y=0; y<height(); ++y) {
+        uint8_t* p = address(0, y);
+        std::fill(p, p+rowBytes(), color);
+      }
+      return;
+    }
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), color);
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
+    prepareRowsToWrite(0, height()-1);
+    setPlainColor(color ? 1: 0);
+    if (m_tiled) {
+      for (int y=0; y<height(); ++y) {
+        uint8_t* p = address(0, y);
+        std::fill(p, p+rowBytes(), (color ? 0xff: 0x00));
+      }
+      return;
+    }
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), (color ? 0xff: 0x00));
   }
@@ -246,6 +352,7 @@ namespace doc {
     ASSERT(x >= 0 && x < width());
     ASSERT(y >= 0 && y < height());
 
+    prepareRowsToWrite(y, y);
     std::div_t d = std::div(x, 8);
     if (color)
       (*(getLineAddress(y) + d.quot)) |= (1 << d.rem);
@@ -264,6 +371,7 @@ namespace doc {
     address_t addr;
     int x, y;
 
+    prepareRowsToWrite(y1, y2);
     for (y=y1; y<=y2; ++y) {
       addr = (address_t)getPixelAddress(x1, y);
       for (x=x1; x<=x2; ++x) {
@@ -276,6 +384,7 @@ namespace doc {
   void copy_bitmaps(Image* dst, const Image* src, gfx::Clip area);
   template<>
   inline void ImageImpl<BitmapTraits>::copy(const Image* src, gfx::Clip area) {
+    prepareRowsToWrite(area.dst.y, area.dst.y+area.size.h-1);
     copy_bitmaps(this, src, area);
   }
 
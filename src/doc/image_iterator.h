@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -102,7 +102,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<ImageTraits>(m_image, m_x, m_y);
+          m_ptr = get_pixel_address_fast<ImageTraits>(static_cast<const Image*>(m_image), m_x, m_y);
       }
 
       return *this;
@@ -329,7 +329,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<BitmapTraits>(m_image, m_x, m_y);
+          m_ptr = get_pixel_address_fast<BitmapTraits>(static_cast<const Image*>(m_image), m_x, m_y);
         else
           ++m_ptr;
       }
@@ -0,0 +1,156 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_ROWS_H_INCLUDED
+#define DOC_IMAGE_ROWS_H_INCLUDED
+#pragma once
+
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "gfx/rect.h"
+
+#include <type_traits>
+#include <utility>
+
+namespace doc {
+
+  // A span of "size()" contiguous pixels of one image row starting
+  // at (x(), y()). For all pixel formats except BitmapTraits the
+  // pixels can be accessed directly with data()/begin()/end() so
+  // loops over rows can be optimized/vectorized by the compiler.
+  // Bitmap rows are bit-packed (starting in any bit of the first
+  // byte), so they must be accessed with operator[] and put().
+  //
+  // Use for_each_row() (or get_row_view()) to create these views.
+  template<typename ImageTraits, bool Const>
+  class RowViewT {
+  public:
+    using pixel_t = typename ImageTraits::pixel_t;
+    using address_t = std::conditional_t<Const,
+                                         typename ImageTraits::const_address_t,
+                                         typename ImageTraits::address_t>;
+    static constexpr bool is_bitmap = (ImageTraits::pixels_per_byte == 8);
+
+    RowViewT(address_t data, int x, int y, int w)
+      : m_data(data)
+      , m_x(x)
+      , m_y(y)
+      , m_w(w)
+      , m_bit(is_bitmap ? x % 8: 0) {
+    }
+
+    int x() const { return m_x; }
+    int y() const { return m_y; }
+    int size() const { return m_w; }
+    bool empty() const { return m_w <= 0; }
+
+    address_t data() const {
+      static_assert(!is_bitmap, "Bitmap rows are bit-packed");
+      return m_data;
+    }
+    address_t begin() const { return data(); }
+    address_t end() const { return data() + m_w; }
+
+    // Returns the pixel in the position i (relative to x()).
+    pixel_t operator[](const int i) const {
+      ASSERT(i >= 0 && i < m_w);
+      if constexpr (is_bitmap) {
+        const int j = m_bit + i;
+        return (m_data[j >> 3] & (1 << (j & 7))) ? 1: 0;
+      }
+      else {
+        return m_data[i];
+      }
+    }
+
+    void put(const int i, const pixel_t color) const {
+      static_assert(!Const, "Cannot modify pixels of a const row");
+      ASSERT(i >= 0 && i < m_w);
+      if constexpr (is_bitmap) {
+        const int j = m_bit + i;
+        if (color)
+          m_data[j >> 3] |= (1 << (j & 7));
+        else
+          m_data[j >> 3] &= ~(1 << (j & 7));
+      }
+      else {
+        m_data[i] = color;
+      }
+    }
+
+  private:
+    address_t m_data;           // Address of the pixel "x" (or the byte that contains it)
+    int m_x, m_y, m_w;
+    int m_bit;                  // Bit of m_data[0] for the pixel "x" for bitmaps
+  };
+
+  template<typename ImageTraits>
+  using RowView = RowViewT<ImageTraits, false>;
+
+  template<typename ImageTraits>
+  using ConstRowView = RowViewT<ImageTraits, true>;
+
+  // Returns a read-only view of "w" pixels from (x, y). The row
+  // must be inside the image.
+  template<typename ImageTraits>
+  inline ConstRowView<ImageTraits> get_row_view(const Image* image, int x, int y, int w) {
+    ASSERT(image->pixelFormat() == ImageTraits::pixel_format);
+    ASSERT(x >= 0 && w >= 0 && x+w <= image->width());
+    ASSERT(y >= 0 && y < image->height());
+    return ConstRowView<ImageTraits>(
+      (typename ImageTraits::const_address_t)image->getPixelAddress(x, y),
+      x, y, w);
+  }
+
+  // Calls f(ConstRowView<ImageTraits>) for each row of the given
+  // bounds (clipped to the image bounds). The cost of addressing
+  // pixels is paid only once per row instead of once per pixel (as
+  // get_pixel() or image iterators do).
+  template<typename ImageTraits, typename Func>
+  void for_each_row(const Image* image, const gfx::Rect& bounds, Func&& f) {
+    const gfx::Rect rc = (bounds & image->bounds());
+    if (rc.isEmpty())
+      return;
+
+    for (int y=rc.y; y<rc.y2(); ++y)
+      f(get_row_view<ImageTraits>(image, rc.x, y, rc.w));
+  }
+
+  template<typename ImageTraits, typename Func>
+  void for_each_row(const Image* image, Func&& f) {
+    for_each_row<ImageTraits>(image, image->bounds(), std::forward<Func>(f));
+  }
+
+  // Calls f(RowView<ImageTraits>) for each row of the given bounds
+  // to modify its pixels. Shared tiles of the area are unshared and
+  // the cached content hash is invalidated before the first call.
+  template<typename ImageTraits, typename Func>
+  void for_each_row(Image* image, const gfx::Rect& bounds, Func&& f) {
+    ASSERT(image->pixelFormat() == ImageTraits::pixel_format);
+    const gfx::Rect rc = (bounds & image->bounds());
+    if (rc.isEmpty())
+      return;
+
+    image->invalidateContentHash();
+    if (image->isTiled())
+      image->unshareTiles(rc);
+
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      f(RowView<ImageTraits>(
+          (typename ImageTraits::address_t)image->getPixelAddress(rc.x, y),
+          rc.x, y, rc.w));
+    }
+  }
+
+  template<typename ImageTraits, typename Func>
+  void for_each_row(Image* image, Func&& f) {
+    for_each_row<ImageTraits>(image, image->bounds(), std::forward<Func>(f));
+  }
+
+} // namespace doc
+
+#endif
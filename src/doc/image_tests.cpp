@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,10 +11,18 @@
 
 #include <gtest/gtest.h>
 
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/compressed_image.h"
 #include "doc/image_impl.h"
+#include "doc/image_rows.h"
 #include "doc/primitives.h"
+#include "doc/tile.h"
 
+#include <algorithm>
 #include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 using namespace base;
 using namespace doc;
@@ -128,6 +136,54 @@ TYPED_TEST(ImageAllTypes, PutGetAndIterators)
   }
 }
 
+TYPED_TEST(ImageAllTypes, RowViews)
+{
+  typedef TypeParam ImageTraits;
+
+  const int w = 21, h = 5;
+  std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image.get(), x, y, std::rand() % ImageTraits::max_value);
+
+  // Read rows of areas that start in any bit of a bitmap byte
+  for (int i=0; i<10; ++i) {
+    const gfx::Rect bounds(i, 1, w-i*2+3, h);
+    int rows = 0;
+    for_each_row<ImageTraits>(
+      (const Image*)image.get(), bounds,
+      [&](const ConstRowView<ImageTraits>& row){
+        ASSERT_EQ(i, row.x());
+        ASSERT_EQ(1+rows, row.y());
+        ASSERT_EQ(std::min(w-i*2+3, w-i), row.size());
+        for (int u=0; u<row.size(); ++u)
+          EXPECT_EQ(get_pixel(image.get(), row.x()+u, row.y()), row[u]);
+        ++rows;
+      });
+    EXPECT_EQ(h-1, rows);
+  }
+
+  // Write rows
+  std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+  const gfx::Rect bounds(3, 1, 9, 3);
+  for_each_row<ImageTraits>(
+    image.get(), bounds,
+    [](const RowView<ImageTraits>& row){
+      for (int u=0; u<row.size(); ++u)
+        row.put(u, (row[u] ? 0: 1));
+    });
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const color_t c = get_pixel(copy.get(), x, y);
+      if (bounds.contains(gfx::Point(x, y)))
+        EXPECT_EQ(c ? 0: 1, get_pixel(image.get(), x, y));
+      else
+        EXPECT_EQ(c, get_pixel(image.get(), x, y));
+    }
+  }
+}
+
 TEST(Image, DiffRgbImages)
 {
   std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 32, 32));
@@ -225,6 +281,396 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, TiledCopyOnWrite)
+{
+  typedef TypeParam ImageTraits;
+
+  const int w = 37;
+  const int h = 3*Image::kTileRows + 5;
+  std::unique_ptr<Image> a(Image::createTiled(ImageSpec((ColorMode)ImageTraits::pixel_format, w, h)));
+  ASSERT_TRUE(a->isTiled());
+
+  std::vector<int> data(w*h);
+  for (int i=0; i<w*h; ++i) {
+    data[i] = (std::rand() % ImageTraits::max_value);
+    put_pixel(a.get(), i%w, i/w, data[i]);
+  }
+
+  std::unique_ptr<Image> b(Image::createCopy(a.get()));
+  ASSERT_TRUE(b->isTiled());
+
+  // The const getPixelAddress() doesn't unshare tiles
+  const Image* ca = a.get();
+  const Image* cb = b.get();
+
+  // Both images share all the tiles
+  for (int y=0; y<h; y+=Image::kTileRows)
+    EXPECT_EQ(ca->getPixelAddress(0, y), cb->getPixelAddress(0, y));
+
+  // Modify one pixel of the second tile of "b"
+  const int y = Image::kTileRows + 1;
+  const color_t c = (data[y*w] ? 0: 1);
+  b->putPixel(0, y, c);
+
+  EXPECT_NE(ca->getPixelAddress(0, y), cb->getPixelAddress(0, y));
+  EXPECT_EQ(ca->getPixelAddress(0, 0), cb->getPixelAddress(0, 0));
+  EXPECT_EQ(ca->getPixelAddress(0, 2*Image::kTileRows),
+            cb->getPixelAddress(0, 2*Image::kTileRows));
+
+  // "a" wasn't modified, and "b" is equal to "a" (except the new pixel)
+  for (int i=0; i<w*h; ++i) {
+    EXPECT_EQ(data[i], get_pixel(a.get(), i%w, i/w));
+    if (i == y*w)
+      EXPECT_EQ(c, get_pixel(b.get(), i%w, i/w));
+    else
+      EXPECT_EQ(data[i], get_pixel(b.get(), i%w, i/w));
+  }
+
+  // Writing through LockImageBits unshares the locked area
+  {
+    LockImageBits<ImageTraits> bits(a.get(), Image::WriteLock,
+                                    gfx::Rect(0, h-1, w, 1));
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      *it = 0;
+  }
+  EXPECT_NE(ca->getPixelAddress(0, h-1), cb->getPixelAddress(0, h-1));
+  for (int x=0; x<w; ++x) {
+    EXPECT_EQ(0, get_pixel(a.get(), x, h-1));
+    EXPECT_EQ(data[(h-1)*w+x], get_pixel(b.get(), x, h-1));
+  }
+
+  // Clearing the image doesn't affect the copy
+  a->clear(0);
+  for (int i=0; i<w*h; ++i) {
+    EXPECT_EQ(0, get_pixel(a.get(), i%w, i/w));
+    if (i != y*w && i/w != h-1)
+      EXPECT_EQ(data[i], get_pixel(b.get(), i%w, i/w));
+  }
+}
+
+TYPED_TEST(ImageAllTypes, TiledRawWrites)
+{
+  typedef TypeParam ImageTraits;
+
+  const int w = 29;
+  const int h = 2*Image::kTileRows + 7;
+  std::unique_ptr<Image> a(Image::createTiled(ImageSpec((ColorMode)ImageTraits::pixel_format, w, h)));
+  a->clear(0);
+
+  std::unique_ptr<Image> b(Image::createCopy(a.get()));
+  const Image* ca = a.get();
+  const Image* cb = b.get();
+  for (int y=0; y<h; y+=Image::kTileRows)
+    EXPECT_EQ(ca->getPixelAddress(0, y), cb->getPixelAddress(0, y));
+
+  // put_pixel_fast() unshares the tile of the modified row
+  put_pixel_fast<ImageTraits>(a.get(), 1, 1, 1);
+  EXPECT_NE(ca->getPixelAddress(0, 0), cb->getPixelAddress(0, 0));
+  EXPECT_EQ(ca->getPixelAddress(0, Image::kTileRows),
+            cb->getPixelAddress(0, Image::kTileRows));
+
+  // The non-const getPixelAddress() unshares the tile of the row
+  const int y = Image::kTileRows + 2;
+  b->getPixelAddress(0, y);
+  EXPECT_NE(ca->getPixelAddress(0, y), cb->getPixelAddress(0, y));
+  EXPECT_EQ(ca->getPixelAddress(0, 2*Image::kTileRows),
+            cb->getPixelAddress(0, 2*Image::kTileRows));
+
+  EXPECT_EQ(1, get_pixel(a.get(), 1, 1));
+  EXPECT_EQ(0, get_pixel(b.get(), 1, 1));
+}
+
+TEST(Image, ContentHash)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 8, 8));
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(a.get(), rgba(0, 0, 0, 0));
+  clear_image(b.get(), rgba(255, 0, 0, 0));
+
+  // All transparent pixels are equal
+  EXPECT_FALSE(a->hasContentHash());
+  EXPECT_EQ(a->contentHash(), b->contentHash());
+  EXPECT_TRUE(a->hasContentHash());
+  EXPECT_TRUE(is_same_image(a.get(), b.get()));
+
+  // Modifying pixels invalidates the hash
+  a->putPixel(1, 1, rgba(255, 0, 0, 255));
+  EXPECT_FALSE(a->hasContentHash());
+  EXPECT_NE(a->contentHash(), b->contentHash());
+  EXPECT_FALSE(is_same_image(a.get(), b.get()));
+
+  b->putPixel(1, 1, rgba(255, 0, 0, 255));
+  EXPECT_EQ(a->contentHash(), b->contentHash());
+  EXPECT_TRUE(is_same_image(a.get(), b.get()));
+
+  // Direct modifications + incrementVersion()
+  const uint32_t hash = a->contentHash();
+  put_pixel_fast<RgbTraits>(a.get(), 2, 2, rgba(0, 0, 255, 255));
+  a->incrementVersion();
+  EXPECT_FALSE(a->hasContentHash());
+  EXPECT_NE(hash, a->contentHash());
+
+  // LockImageBits invalidates the hash
+  {
+    LockImageBits<RgbTraits> bits(b.get());
+    EXPECT_FALSE(b->hasContentHash());
+  }
+
+  // is_same_image() compares pixels even if the cached hashes are
+  // stale (pixels modified without incrementVersion())
+  clear_image(a.get(), rgba(0, 0, 0, 255));
+  clear_image(b.get(), rgba(0, 0, 0, 255));
+  b->putPixel(3, 3, rgba(255, 0, 0, 255));
+  EXPECT_NE(a->contentHash(), b->contentHash());
+  put_pixel_fast<RgbTraits>(a.get(), 3, 3, rgba(255, 0, 0, 255));
+  EXPECT_TRUE(is_same_image(a.get(), b.get()));
+}
+
+TEST(Image, CachedValuesFromSeveralThreads)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_INDEXED, 256, 256));
+  clear_image(a.get(), 3);
+  a->putPixel(10, 10, 5);
+  const uint32_t hash = calculate_image_hash(a.get(), a->bounds());
+
+  std::vector<std::thread> threads;
+  std::vector<int> results(8, 0);
+  for (int i=0; i<int(results.size()); ++i) {
+    threads.emplace_back([&a, &results, hash, i]{
+      const Image* img = a.get();
+      const auto& histogram = img->indexHistogram();
+      if (img->contentHash() == hash &&
+          !img->isPlain() &&
+          histogram[3] == 256*256-1 &&
+          histogram[5] == 1)
+        results[i] = 1;
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+
+  for (int r : results)
+    EXPECT_EQ(1, r);
+  EXPECT_TRUE(a->hasContentHash());
+  EXPECT_TRUE(a->hasIndexHistogram());
+}
+
+TEST(Image, IsPlain)
+{
+  color_t color;
+  bool exact;
+
+  // clear() knows the plain color
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(a.get(), rgba(0, 0, 0, 0));
+  EXPECT_TRUE(a->hasPlainInfo());
+  EXPECT_TRUE(a->isPlain(&color, &exact));
+  EXPECT_EQ(rgba(0, 0, 0, 0), color);
+  EXPECT_TRUE(exact);
+  EXPECT_TRUE(is_empty_image(a.get()));
+  EXPECT_TRUE(is_plain_image(a.get(), rgba(255, 0, 0, 0)));
+
+  // Different transparent pixels are plain but not exact
+  a->putPixel(1, 1, rgba(255, 0, 0, 0));
+  EXPECT_FALSE(a->hasPlainInfo());
+  EXPECT_TRUE(a->isPlain(&color, &exact));
+  EXPECT_TRUE(a->hasPlainInfo());
+  EXPECT_FALSE(exact);
+  EXPECT_TRUE(is_empty_image(a.get()));
+
+  a->putPixel(2, 2, rgba(255, 0, 0, 255));
+  EXPECT_FALSE(a->isPlain());
+  EXPECT_FALSE(is_empty_image(a.get()));
+
+  // Direct modifications + incrementVersion()
+  std::unique_ptr<Image> b(Image::create(IMAGE_INDEXED, 8, 8));
+  clear_image(b.get(), 3);
+  EXPECT_TRUE(b->isPlain(&color));
+  EXPECT_EQ(3, color);
+  put_pixel_fast<IndexedTraits>(b.get(), 7, 7, 4);
+  b->incrementVersion();
+  EXPECT_FALSE(b->hasPlainInfo());
+  EXPECT_FALSE(b->isPlain());
+  EXPECT_FALSE(is_plain_image(b.get(), 3));
+
+  // Trimming an image with plain info
+  clear_image(b.get(), 5);
+  gfx::Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(b.get(), 5, nullptr, bounds));
+  EXPECT_TRUE(algorithm::shrink_bounds(b.get(), 0, nullptr, bounds));
+  EXPECT_EQ(b->bounds(), bounds);
+}
+
+TEST(Image, IndexHistogram)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_INDEXED, 4, 2));
+  clear_image(a.get(), 0);
+  a->putPixel(1, 0, 3);
+  a->putPixel(2, 1, 3);
+  a->putPixel(3, 1, 255);
+  EXPECT_FALSE(a->hasIndexHistogram());
+  EXPECT_EQ(5, a->indexHistogram()[0]);
+  EXPECT_EQ(2, a->indexHistogram()[3]);
+  EXPECT_EQ(1, a->indexHistogram()[255]);
+  EXPECT_EQ(0, a->indexHistogram()[1]);
+  EXPECT_TRUE(a->hasIndexHistogram());
+
+  a->putPixel(0, 0, 1);
+  EXPECT_FALSE(a->hasIndexHistogram());
+  EXPECT_EQ(4, a->indexHistogram()[0]);
+  EXPECT_EQ(1, a->indexHistogram()[1]);
+
+  // Direct modifications + incrementVersion()
+  put_pixel_fast<IndexedTraits>(a.get(), 0, 1, 1);
+  a->incrementVersion();
+  EXPECT_FALSE(a->hasIndexHistogram());
+  EXPECT_EQ(3, a->indexHistogram()[0]);
+  EXPECT_EQ(2, a->indexHistogram()[1]);
+
+  // Non-indexed images have an empty histogram
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 4, 2));
+  clear_image(b.get(), rgba(0, 0, 0, 255));
+  for (uint32_t n : b->indexHistogram())
+    EXPECT_EQ(0, n);
+}
+
+TEST(Image, TileHistogram)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_TILEMAP, 4, 2));
+  clear_image(a.get(), notile);
+  a->putPixel(0, 0, tile(3, 0));
+  a->putPixel(1, 0, tile(3, tile_f_xflip));
+  a->putPixel(2, 1, tile(1, 0));
+  a->putPixel(3, 1, tile(900, 0));
+  EXPECT_FALSE(a->hasTileHistogram());
+
+  Image::TileHistogram expected = { { 1, 1 }, { 3, 2 }, { 900, 1 } };
+  EXPECT_EQ(expected, a->tileHistogram());
+  EXPECT_TRUE(a->hasTileHistogram());
+
+  a->putPixel(2, 1, tile(3, 0));
+  EXPECT_FALSE(a->hasTileHistogram());
+  expected = { { 3, 3 }, { 900, 1 } };
+  EXPECT_EQ(expected, a->tileHistogram());
+
+  // Direct modifications + incrementVersion()
+  put_pixel_fast<TilemapTraits>(a.get(), 3, 1, notile);
+  a->incrementVersion();
+  EXPECT_FALSE(a->hasTileHistogram());
+  expected = { { 3, 3 } };
+  EXPECT_EQ(expected, a->tileHistogram());
+
+  // Non-tilemap images have an empty histogram
+  std::unique_ptr<Image> b(Image::create(IMAGE_INDEXED, 4, 2));
+  clear_image(b.get(), 1);
+  EXPECT_TRUE(b->tileHistogram().empty());
+}
+
+TEST(Image, RowViewsInTiledImages)
+{
+  ImageSpec spec(ColorMode::INDEXED, 4, Image::kTileRows*2);
+  std::unique_ptr<Image> a(Image::createTiled(spec));
+  clear_image(a.get(), 1);
+  std::unique_ptr<Image> b(Image::createCopy(a.get()));
+  const uint32_t hash = b->contentHash();
+
+  // Modifying rows of "b" doesn't modify the shared tiles of "a"
+  for_each_row<IndexedTraits>(
+    b.get(), gfx::Rect(0, Image::kTileRows, 4, 1),
+    [](const RowView<IndexedTraits>& row){
+      std::fill(row.begin(), row.end(), 2);
+    });
+  EXPECT_FALSE(b->hasContentHash());
+  EXPECT_NE(hash, b->contentHash());
+  EXPECT_EQ(2, get_pixel(b.get(), 3, Image::kTileRows));
+  EXPECT_EQ(1, get_pixel(a.get(), 3, Image::kTileRows));
+  EXPECT_TRUE(is_plain_image(a.get(), 1));
+}
+
+TEST(Image, CompressedImage)
+{
+  std::unique_ptr<Image> image(Image::create(IMAGE_INDEXED, 8, 2));
+  std::unique_ptr<Image> bitmap(Image::create(IMAGE_BITMAP, 8, 2));
+  clear_image(image.get(), 0);
+  clear_image(bitmap.get(), 0);
+  image->drawHLine(1, 0, 2, 3);
+  image->drawHLine(3, 0, 5, 4);
+  bitmap->drawHLine(2, 1, 6, 1);
+  image->putPixel(4, 1, 5);
+
+  using Scanlines = std::vector<std::tuple<int, int, int, color_t>>;
+  auto scanlines = [](const CompressedImage& ci) {
+    Scanlines result;
+    for (const auto& sl : ci)
+      result.push_back(std::make_tuple(sl.x, sl.y, sl.w, sl.color));
+    return result;
+  };
+
+  EXPECT_EQ((Scanlines{ { 1, 0, 5, 3 }, { 4, 1, 1, 5 } }),
+            scanlines(CompressedImage(image.get(), nullptr, false)));
+  EXPECT_EQ((Scanlines{ { 1, 0, 2, 3 }, { 3, 0, 3, 4 }, { 4, 1, 1, 5 } }),
+            scanlines(CompressedImage(image.get(), nullptr, true)));
+  EXPECT_EQ((Scanlines{ { 2, 1, 5, 0 } }),
+            scanlines(CompressedImage(image.get(), bitmap.get(), false)));
+  EXPECT_EQ((Scanlines{ { 2, 1, 2, 0 }, { 4, 1, 1, 5 }, { 5, 1, 2, 0 } }),
+            scanlines(CompressedImage(image.get(), bitmap.get(), true)));
+}
+
+TEST(Image, CompressedImageRandom)
+{
+  // Scanlines generated pixel by pixel
+  auto expected = [](const Image* image, const Image* bitmap, const bool diffColors) {
+    std::vector<std::tuple<int, int, int, color_t>> result;
+    const color_t mask = image->maskColor();
+    for (int y=0; y<image->height(); ++y) {
+      for (int x=0; x<image->width(); ) {
+        const color_t c = get_pixel(image, x, y);
+        if (bitmap ? !get_pixel(bitmap, x, y): c == mask) {
+          ++x;
+          continue;
+        }
+        const int x1 = x;
+        for (++x; x<image->width(); ++x) {
+          const color_t c2 = get_pixel(image, x, y);
+          if ((bitmap ? !get_pixel(bitmap, x, y): c2 == mask) ||
+              (diffColors && c2 != c))
+            break;
+        }
+        result.push_back(std::make_tuple(x1, y, x-x1, c));
+      }
+    }
+    return result;
+  };
+
+  std::srand(3);
+  CompressedImage ci;
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE,
+                                    IMAGE_INDEXED, IMAGE_BITMAP }) {
+    for (int i=0; i<50; ++i) {
+      const int w = 1 + std::rand() % 70;
+      const int h = 1 + std::rand() % 4;
+      std::unique_ptr<Image> image(Image::create(format, w, h));
+      std::unique_ptr<Image> bitmap(Image::create(IMAGE_BITMAP, w, h));
+      const int runs = 1 + std::rand() % 20;
+      for (int y=0; y<h; ++y) {
+        for (int x=0; x<w; ++x) {
+          put_pixel(image.get(), x, y, ((x+y*w) / runs) % 3 == 0 ? 0: 1 + std::rand() % 2);
+          put_pixel(bitmap.get(), x, y, (x / (1 + i % 9)) % 2);
+        }
+      }
+      for (const Image* maskBitmap : { (const Image*)nullptr, (const Image*)bitmap.get() }) {
+        for (const bool diffColors : { false, true }) {
+          ci.compress(image.get(), maskBitmap, diffColors);
+          std::vector<std::tuple<int, int, int, color_t>> result;
+          for (const auto& sl : ci)
+            result.push_back(std::make_tuple(sl.x, sl.y, sl.w, sl.color));
+          ASSERT_EQ(expected(image.get(), maskBitmap, diffColors), result);
+        }
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
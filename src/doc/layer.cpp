@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -198,6 +198,31 @@ bool Layer::canEditPixels() const
   return true;
 }
 
+void Layer::setFlags(LayerFlags flags)
+{
+  const bool visibilityChanged =
+    ((int(m_flags) ^ int(flags)) & int(LayerFlags::Visible)) != 0;
+
+  m_flags = flags;
+
+  if (visibilityChanged)
+    invalidateRenderPlans();
+}
+
+void Layer::switchFlags(LayerFlags flags, bool state)
+{
+  if (state)
+    setFlags(LayerFlags(int(m_flags) | int(flags)));
+  else
+    setFlags(LayerFlags(int(m_flags) & ~int(flags)));
+}
+
+void Layer::invalidateRenderPlans()
+{
+  if (m_sprite)
+    m_sprite->invalidateRenderPlans();
+}
+
 bool Layer::hasAncestor(const Layer* ancestor) const
 {
   Layer* it = parent();
@@ -351,6 +376,7 @@ void LayerImage::addCel(Cel* cel)
   m_cels.insert(it, cel);
 
   cel->setParentLayer(this);
+  invalidateRenderPlans();
 }
 
 /**
@@ -368,6 +394,7 @@ void LayerImage::removeCel(Cel* cel)
   m_cels.erase(it);
 
   cel->setParentLayer(NULL);
+  invalidateRenderPlans();
 }
 
 void LayerImage::moveCel(Cel* cel, frame_t frame)
@@ -398,20 +425,24 @@ void LayerImage::configureAsBackground()
 
 void LayerImage::displaceFrames(frame_t fromThis, frame_t delta)
 {
-  Sprite* sprite = this->sprite();
+  // All cels from the given frame are displaced by the same delta,
+  // so we can change their frames in-place (without moving the cels
+  // in the sorted m_cels list). When delta < 0 the cels of the
+  // removed frames must be removed before.
+  auto it = findFirstCelIteratorAfter(fromThis-1);
+  if (it == getCelEnd())
+    return;
 
-  if (delta > 0) {
-    for (frame_t c=sprite->lastFrame(); c>=fromThis; --c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
-  }
-  else {
-    for (frame_t c=fromThis; c<=sprite->lastFrame(); ++c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
+  ASSERT(delta > 0 ||
+         it == getCelBegin() ||
+         (*(it-1))->frame() < (*it)->frame()+delta);
+
+  for (auto end=getCelEnd(); it!=end; ++it) {
+    Cel* cel = *it;
+    cel->m_frame += delta;
+    cel->incrementVersion();      // TODO this should be in app::cmd module
   }
+  invalidateRenderPlans();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -564,6 +595,7 @@ void LayerGroup::addLayer(Layer* layer)
 {
   m_layers.push_back(layer);
   layer->setParent(this);
+  invalidateRenderPlans();
 }
 
 void LayerGroup::removeLayer(Layer* layer)
@@ -573,6 +605,7 @@ void LayerGroup::removeLayer(Layer* layer)
   m_layers.erase(it);
 
   layer->setParent(nullptr);
+  invalidateRenderPlans();
 }
 
 void LayerGroup::insertLayer(Layer* layer, Layer* after)
@@ -586,6 +619,7 @@ void LayerGroup::insertLayer(Layer* layer, Layer* after)
   m_layers.insert(after_it, layer);
 
   layer->setParent(this);
+  invalidateRenderPlans();
 }
 
 void LayerGroup::stackLayer(Layer* layer, Layer* after)
@@ -114,22 +114,19 @@ namespace doc {
       return (int(m_flags) & int(flags)) == int(flags);
     }
 
-    void setFlags(LayerFlags flags) {
-      m_flags = flags;
-    }
-
-    void switchFlags(LayerFlags flags, bool state) {
-      if (state)
-        m_flags = LayerFlags(int(m_flags) | int(flags));
-      else
-        m_flags = LayerFlags(int(m_flags) & ~int(flags));
-    }
+    void setFlags(LayerFlags flags);
+    void switchFlags(LayerFlags flags, bool state);
 
     virtual Grid grid() const;
     virtual Cel* cel(frame_t frame) const;
     virtual void getCels(CelList& cels) const = 0;
     virtual void displaceFrames(frame_t fromThis, frame_t delta) = 0;
 
+  protected:
+    // Called when the layer tree or the cels of this layer are
+    // modified so the sprite discards its cached render plans.
+    void invalidateRenderPlans();
+
   private:
     std::string m_name;           // layer name
     Sprite* m_sprite;             // owner of the layer
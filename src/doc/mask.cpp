@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,8 +12,11 @@
 #include "doc/mask.h"
 
 #include "base/memory.h"
+#include "doc/color_distance_map.h"
 #include "doc/image_impl.h"
+#include "doc/parallel.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
@@ -67,6 +70,7 @@ void Mask::initialize()
 {
   m_freeze_count = 0;
   m_bounds = gfx::Rect(0, 0, 0, 0);
+  m_spansValid = false;
 }
 
 int Mask::getMemSize() const
@@ -74,6 +78,18 @@ int Mask::getMemSize() const
   return sizeof(Mask) + (m_bitmap ? m_bitmap->getMemSize(): 0);
 }
 
+const MaskSpans& Mask::spans() const
+{
+  if (!m_spansValid) {
+    if (m_bitmap)
+      m_spans.build(m_bitmap.get());
+    else
+      m_spans.clear();
+    m_spansValid = true;
+  }
+  return m_spans;
+}
+
 void Mask::setName(const char *name)
 {
   m_name = name;
@@ -100,15 +116,7 @@ bool Mask::isRectangular() const
   if (!m_bitmap)
     return false;
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
-  LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
-
-  for (; it != end; ++it) {
-    if (*it == 0)
-      return false;
-  }
-
-  return true;
+  return spans().isFull();
 }
 
 void Mask::copyFrom(const Mask* sourceMask)
@@ -136,6 +144,7 @@ void Mask::offsetOrigin(int dx, int dy)
 
 void Mask::clear()
 {
+  invalidateSpans();
   m_bitmap.reset();
   m_bounds = gfx::Rect(0, 0, 0, 0);
 }
@@ -145,6 +154,8 @@ void Mask::invert()
   if (!m_bitmap)
     return;
 
+  invalidateSpans();
+
   LockImageBits<BitmapTraits> bits(m_bitmap.get());
   LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
 
@@ -163,6 +174,7 @@ void Mask::replace(const gfx::Rect& bounds)
 
   m_bounds = bounds;
 
+  invalidateSpans();
   m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
   clear_image(m_bitmap.get(), 1);
 }
@@ -206,6 +218,7 @@ void Mask::add(const gfx::Rect& bounds)
   if (!m_bitmap)
     return;
 
+  invalidateSpans();
   fill_rect(m_bitmap.get(),
             bounds.x-m_bounds.x,
             bounds.y-m_bounds.y,
@@ -218,6 +231,7 @@ void Mask::subtract(const gfx::Rect& bounds)
   if (!m_bitmap)
     return;
 
+  invalidateSpans();
   fill_rect(m_bitmap.get(),
     bounds.x-m_bounds.x,
     bounds.y-m_bounds.y,
@@ -245,113 +259,51 @@ void Mask::intersect(const gfx::Rect& bounds)
       newBounds.h, 0);
   }
 
+  invalidateSpans();
   m_bitmap.reset(image);
   m_bounds = newBounds;
 
   shrink();
 }
 
-void Mask::byColor(const Image *src, int color, int fuzziness)
+void Mask::byColor(const Image* src, int color, int fuzziness)
 {
-  replace(src->bounds());
-
-  Image* dst = m_bitmap.get();
-
-  switch (src->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      color_t c;
-
-      dst_r = rgba_getr(color);
-      dst_g = rgba_getg(color);
-      dst_b = rgba_getb(color);
-      dst_a = rgba_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_r = rgba_getr(c);
-        src_g = rgba_getg(c);
-        src_b = rgba_getb(c);
-        src_a = rgba_geta(c);
-
-        if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-              (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-              (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_k, src_a;
-      int dst_k, dst_a;
-      color_t c;
-
-      dst_k = graya_getv(color);
-      dst_a = graya_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_k = graya_getv(c);
-        src_a = graya_geta(c);
-
-        if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      color_t c, min, max;
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
+  byColor(ColorDistanceMap(src, color), fuzziness);
+}
 
-        if (color > fuzziness)
-          min = color-fuzziness;
-        else
-          min = 0;
-        max = color + fuzziness;
+void Mask::byColor(const ColorDistanceMap& distances, int fuzziness)
+{
+  replace(gfx::Rect(0, 0, distances.width(), distances.height()));
+  if (!m_bitmap)
+    return;
 
-        if (!((c >= min) && (c <= max)))
-          *dst_it = 0;
+  // Prepare the whole bitmap to be modified from several threads.
+  Image* dst = m_bitmap.get();
+  const LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
+
+  const int w = distances.width();
+  const int limit = std::clamp(fuzziness, -1, 255);
+  parallel_for(
+    0, distances.height(), std::max(1, 64*1024 / std::max(1, w)),
+    [&distances, dst, w, limit](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const uint8_t* src = distances.row(y);
+        uint8_t* bits = dst->getPixelAddress(0, y);
+        int x = 0;
+        for (; x+8<=w; x+=8, ++bits) {
+          int byte = 0;
+          for (int i=0; i<8; ++i)
+            byte |= (src[x+i] <= limit ? 1: 0) << i;
+          *bits = uint8_t(byte);
+        }
+        if (x < w) {
+          int byte = 0;
+          for (int i=0; x+i<w; ++i)
+            byte |= (src[x+i] <= limit ? 1: 0) << i;
+          *bits = uint8_t(byte);
+        }
       }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-  }
+    });
 
   shrink();
 }
@@ -426,6 +378,7 @@ void Mask::reserve(const gfx::Rect& bounds)
   ASSERT(!bounds.isEmpty());
 
   if (!m_bitmap) {
+    invalidateSpans();
     m_bounds = bounds;
     m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
     clear_image(m_bitmap.get(), 0);
@@ -440,6 +393,7 @@ void Mask::reserve(const gfx::Rect& bounds)
         newBounds.y-m_bounds.y,
         newBounds.w,
         newBounds.h, 0);
+      invalidateSpans();
       m_bitmap.reset(image);
       m_bounds = newBounds;
     }
@@ -503,6 +457,7 @@ void Mask::shrink()
       m_bitmap.get(),
       m_bounds.x-u, m_bounds.y-v,
       m_bounds.w, m_bounds.h, 0);
+    invalidateSpans();
     m_bitmap.reset(image);
   }
 
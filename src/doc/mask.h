@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include "doc/image.h"
 #include "doc/image_buffer.h"
 #include "doc/image_ref.h"
+#include "doc/mask_spans.h"
 #include "doc/object.h"
 #include "doc/primitives.h"
 #include "gfx/rect.h"
@@ -19,6 +20,7 @@
 #include <string>
 
 namespace doc {
+  class ColorDistanceMap;
 
   // Represents the selection (selected pixels, 0/1, 0=non-selected, 1=selected)
   //
@@ -35,7 +37,22 @@ namespace doc {
     const std::string& name() const { return m_name; }
 
     const Image* bitmap() const { return m_bitmap.get(); }
-    Image* bitmap() { return m_bitmap.get(); }
+
+    // Returns the bitmap to be modified. As the caller can modify
+    // the pixels directly, the cached spans are discarded.
+    Image* bitmap() {
+      invalidateSpans();
+      return m_bitmap.get();
+    }
+
+    // Returns the runs of selected pixels of each row of the bitmap
+    // (coordinates relative to the bitmap origin). They are
+    // calculated lazily and cached until the mask is modified.
+    const MaskSpans& spans() const;
+
+    // Discards the cached spans (call it if you've modified the
+    // bitmap through a pointer got previously from bitmap()).
+    void invalidateSpans() { m_spansValid = false; }
 
     // Returns true if the mask is completely empty (i.e. nothing
     // selected)
@@ -92,7 +109,12 @@ namespace doc {
     void subtract(const gfx::Rect& bounds);
     void intersect(const gfx::Rect& bounds);
 
+    // Replaces the mask with the pixels of the image that are similar
+    // to the given color (the distance of each channel is less than
+    // or equal to "fuzziness"). The second version uses distances
+    // calculated previously (see ColorDistanceMap).
     void byColor(const Image* image, int color, int fuzziness);
+    void byColor(const ColorDistanceMap& distances, int fuzziness);
     void crop(const Image* image);
 
     // Reserves a rectangle to draw onto the bitmap (you should call
@@ -114,6 +136,8 @@ namespace doc {
     gfx::Rect m_bounds;           // Region bounds
     ImageRef m_bitmap;            // Bitmapped image mask
     ImageBufferPtr m_buffer;      // Buffer used in m_bitmap
+    mutable MaskSpans m_spans;    // Cached runs of m_bitmap
+    mutable bool m_spansValid;
 
     Mask& operator=(const Mask& mask);
   };
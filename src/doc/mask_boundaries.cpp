@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,19 +12,25 @@
 #include "doc/mask_boundaries.h"
 
 #include "doc/image_impl.h"
+#include "gfx/matrix.h"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
 
 namespace doc {
 
 void MaskBoundaries::reset()
 {
   m_segs.clear();
-  if (!m_path.isEmpty())
-    m_path.rewind();
+  m_origin = gfx::Point(0, 0);
+  invalidatePaths();
 }
 
 void MaskBoundaries::regen(const Image* bitmap)
 {
   reset();
+  m_bitmapSize = bitmap->size();
 
   int x, y, w = bitmap->width(), h = bitmap->height();
 
@@ -339,12 +346,247 @@ void MaskBoundaries::regen(const Image* bitmap)
   ASSERT(prevIt == bits.end());
 }
 
+void MaskBoundaries::regen(const Image* bitmap, const gfx::Rect& dirtyBounds)
+{
+  const gfx::Point origin = m_origin;
+
+  if (m_segs.empty() || m_bitmapSize != bitmap->size()) {
+    regen(bitmap);
+    offset(origin.x, origin.y);
+    return;
+  }
+
+  // Area of pixels to regenerate in bitmap coordinates. Segments are
+  // edges between two pixels, so we have to regenerate horizontal
+  // lines from rc.y to rc.y2() (both included) and vertical lines
+  // from rc.x to rc.x2().
+  const gfx::Rect rc = (dirtyBounds & bitmap->bounds());
+  if (rc.isEmpty())
+    return;
+
+  auto selected = [bitmap](const int x, const int y) -> bool {
+    return (x >= 0 && y >= 0 &&
+            x < bitmap->width() && y < bitmap->height() &&
+            get_pixel_fast<BitmapTraits>(bitmap, x, y));
+  };
+
+  // Segments that end just in the left/top side of the area
+  // ("before") or start just in the right/bottom side ("after") in
+  // each horizontal line (hseg*) and vertical line (vseg*), so we can
+  // join them with the new segments.
+  std::vector<int> hsegBefore(rc.h+1, -1), hsegAfter(rc.h+1, -1);
+  std::vector<int> vsegBefore(rc.w+1, -1), vsegAfter(rc.w+1, -1);
+
+  // Keep the segments outside the area (or their parts outside it)
+  list_type segs;
+  segs.reserve(m_segs.size());
+  for (const Segment& seg : m_segs) {
+    gfx::Rect b = seg.bounds();
+    b.offset(-origin);
+
+    if (seg.horizontal() && b.y >= rc.y && b.y <= rc.y2()) {
+      const int i = b.y - rc.y;
+      if (b.x < rc.x) {
+        segs.push_back(Segment(seg.open(),
+                               gfx::Rect(b.x, b.y, std::min(b.x2(), rc.x)-b.x, 0)));
+        if (b.x2() >= rc.x)
+          hsegBefore[i] = int(segs.size()-1);
+      }
+      if (b.x2() > rc.x2()) {
+        const int x = std::max(b.x, rc.x2());
+        segs.push_back(Segment(seg.open(),
+                               gfx::Rect(x, b.y, b.x2()-x, 0)));
+        if (b.x <= rc.x2())
+          hsegAfter[i] = int(segs.size()-1);
+      }
+    }
+    else if (seg.vertical() && b.x >= rc.x && b.x <= rc.x2()) {
+      const int i = b.x - rc.x;
+      if (b.y < rc.y) {
+        segs.push_back(Segment(seg.open(),
+                               gfx::Rect(b.x, b.y, 0, std::min(b.y2(), rc.y)-b.y)));
+        if (b.y2() >= rc.y)
+          vsegBefore[i] = int(segs.size()-1);
+      }
+      if (b.y2() > rc.y2()) {
+        const int y = std::max(b.y, rc.y2());
+        segs.push_back(Segment(seg.open(),
+                               gfx::Rect(b.x, y, 0, b.y2()-y)));
+        if (b.y <= rc.y2())
+          vsegAfter[i] = int(segs.size()-1);
+      }
+    }
+    else {
+      segs.push_back(Segment(seg.open(), b));
+    }
+  }
+
+  // Segments joined to a previous one (they are removed at the end)
+  std::vector<int> joined;
+
+  // Adds a new segment from "a" to "b" (in the given horizontal or
+  // vertical line), joining it with the previous/next segments.
+  auto addSeg = [&segs, &joined](const bool horz, const bool open,
+                                 const int line, const int a, const int b,
+                                 const bool atStart, int before,
+                                 const bool atEnd, const int after) {
+    int cur;
+    if (atStart && before >= 0 && segs[before].open() == open) {
+      cur = before;
+      if (horz)
+        segs[cur].m_bounds.w += b-a;
+      else
+        segs[cur].m_bounds.h += b-a;
+    }
+    else {
+      segs.push_back(Segment(open, horz ? gfx::Rect(a, line, b-a, 0):
+                                          gfx::Rect(line, a, 0, b-a)));
+      cur = int(segs.size()-1);
+    }
+
+    if (atEnd && after >= 0 && segs[after].open() == open) {
+      if (horz)
+        segs[cur].m_bounds.w += segs[after].m_bounds.w;
+      else
+        segs[cur].m_bounds.h += segs[after].m_bounds.h;
+      joined.push_back(after);
+    }
+  };
+
+  // Horizontal segments: edges between pixels (x, y-1) and (x, y),
+  // the segment is open if (x, y) is selected.
+  for (int y=rc.y; y<=rc.y2(); ++y) {
+    const int i = y - rc.y;
+    int start = rc.x;
+    int state = 0;              // 0=no edge, 1=closed edge, 2=open edge
+    for (int x=rc.x; x<=rc.x2(); ++x) {
+      int newState = 0;
+      if (x < rc.x2()) {
+        const bool above = selected(x, y-1);
+        const bool below = selected(x, y);
+        if (above != below)
+          newState = (below ? 2: 1);
+      }
+      if (newState != state) {
+        if (state)
+          addSeg(true, state == 2, y, start, x,
+                 start == rc.x, hsegBefore[i],
+                 x == rc.x2(), hsegAfter[i]);
+        start = x;
+        state = newState;
+      }
+    }
+  }
+
+  // Vertical segments: edges between pixels (x-1, y) and (x, y), the
+  // segment is open if (x, y) is selected.
+  for (int x=rc.x; x<=rc.x2(); ++x) {
+    const int i = x - rc.x;
+    int start = rc.y;
+    int state = 0;
+    for (int y=rc.y; y<=rc.y2(); ++y) {
+      int newState = 0;
+      if (y < rc.y2()) {
+        const bool left = selected(x-1, y);
+        const bool right = selected(x, y);
+        if (left != right)
+          newState = (right ? 2: 1);
+      }
+      if (newState != state) {
+        if (state)
+          addSeg(false, state == 2, x, start, y,
+                 start == rc.y, vsegBefore[i],
+                 y == rc.y2(), vsegAfter[i]);
+        start = y;
+        state = newState;
+      }
+    }
+  }
+
+  // Remove joined segments
+  if (!joined.empty()) {
+    std::vector<bool> removed(segs.size(), false);
+    for (const int i : joined)
+      removed[i] = true;
+
+    int j = 0;
+    for (int i=0; i<int(segs.size()); ++i) {
+      if (!removed[i])
+        segs[j++] = segs[i];
+    }
+    segs.erase(segs.begin()+j, segs.end());
+  }
+
+  for (Segment& seg : segs)
+    seg.offset(origin.x, origin.y);
+
+  m_segs.swap(segs);
+  invalidatePaths();
+}
+
 void MaskBoundaries::offset(int x, int y)
 {
   for (Segment& seg : m_segs)
     seg.offset(x, y);
 
   m_path.offset(x, y);
+  m_origin += gfx::Point(x, y);
+  m_transformedPathValid = false;
+  if (m_boundsValid)
+    m_bounds.offset(x, y);
+}
+
+const gfx::Rect& MaskBoundaries::bounds()
+{
+  if (!m_boundsValid) {
+    // Segments are lines (rectangles with zero width or height), so
+    // we cannot use gfx::Rect::createUnion() to join them
+    if (m_segs.empty())
+      m_bounds = gfx::Rect();
+    else {
+      int x1 = INT_MAX, y1 = INT_MAX;
+      int x2 = INT_MIN, y2 = INT_MIN;
+      for (const Segment& seg : m_segs) {
+        const gfx::Rect& rc = seg.bounds();
+        x1 = std::min(x1, rc.x);
+        y1 = std::min(y1, rc.y);
+        x2 = std::max(x2, rc.x2());
+        y2 = std::max(y2, rc.y2());
+      }
+      m_bounds = gfx::Rect(x1, y1, x2-x1, y2-y1);
+    }
+    m_boundsValid = true;
+  }
+  return m_bounds;
+}
+
+gfx::Path& MaskBoundaries::transformedPath(const double scaleX,
+                                           const double scaleY,
+                                           const gfx::PointF& offset)
+{
+  createPathIfNeeeded();
+
+  if (!m_transformedPathValid ||
+      m_scaleX != scaleX ||
+      m_scaleY != scaleY ||
+      m_transformedOffset != offset) {
+    m_path.transform(gfx::Matrix::MakeScale(scaleX, scaleY),
+                     &m_transformedPath);
+    m_transformedPath.offset(offset.x, offset.y);
+    m_transformedPathValid = true;
+    m_scaleX = scaleX;
+    m_scaleY = scaleY;
+    m_transformedOffset = offset;
+  }
+  return m_transformedPath;
+}
+
+void MaskBoundaries::invalidatePaths()
+{
+  if (!m_path.isEmpty())
+    m_path.rewind();
+  m_transformedPathValid = false;
+  m_boundsValid = false;
 }
 
 void MaskBoundaries::createPathIfNeeeded()
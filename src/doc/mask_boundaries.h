@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,7 +10,9 @@
 #pragma once
 
 #include "gfx/path.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
+#include "gfx/size.h"
 
 #include <vector>
 
@@ -47,6 +49,13 @@ namespace doc {
     void reset();
     void regen(const Image* bitmap);
 
+    // Regenerates only the segments that can be affected by the
+    // pixels of the given area (in bitmap coordinates) of a bitmap
+    // with the same size as the one used in the last regen(). The
+    // result is equal to regen(bitmap) + offset(origin()) (except
+    // for the order of the segments).
+    void regen(const Image* bitmap, const gfx::Rect& dirtyBounds);
+
     const_iterator begin() const { return m_segs.begin(); }
     const_iterator end() const { return m_segs.end(); }
     iterator begin() { return m_segs.begin(); }
@@ -55,11 +64,39 @@ namespace doc {
     void offset(int x, int y);
     gfx::Path& path() { return m_path; }
 
+    // Total offset() applied since the last full regen(), i.e. the
+    // position of the bitmap origin in the boundaries.
+    const gfx::Point& origin() const { return m_origin; }
+
     void createPathIfNeeeded();
 
+    // Returns the rectangle that contains all the segments. It's
+    // cached until the boundaries change.
+    const gfx::Rect& bounds();
+
+    // Returns path() scaled and then translated by the given values.
+    // The last result is cached until the boundaries change, so
+    // drawing the same boundaries with the same zoom (e.g. to
+    // animate the marching ants) doesn't transform the path again.
+    gfx::Path& transformedPath(const double scaleX,
+                               const double scaleY,
+                               const gfx::PointF& offset);
+
   private:
+    void invalidatePaths();
+
     list_type m_segs;
     gfx::Path m_path;
+    gfx::Point m_origin;
+    gfx::Size m_bitmapSize;
+
+    gfx::Path m_transformedPath;
+    bool m_transformedPathValid = false;
+    double m_scaleX = 1.0, m_scaleY = 1.0;
+    gfx::PointF m_transformedOffset;
+
+    gfx::Rect m_bounds;
+    bool m_boundsValid = false;
   };
 
 } // namespace doc
@@ -0,0 +1,124 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_ref.h"
+#include "doc/mask_boundaries.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+using Seg = std::tuple<int, int, int, int, bool>;
+
+std::vector<Seg> sorted_segs(const MaskBoundaries& boundaries)
+{
+  std::vector<Seg> segs;
+  for (const auto& seg : boundaries) {
+    const gfx::Rect& rc = seg.bounds();
+    segs.push_back(Seg(rc.x, rc.y, rc.w, rc.h, seg.open()));
+  }
+  std::sort(segs.begin(), segs.end());
+  return segs;
+}
+
+void random_pixels(Image* bitmap, const gfx::Rect& rc, const int density)
+{
+  for (int y=rc.y; y<rc.y2(); ++y)
+    for (int x=rc.x; x<rc.x2(); ++x)
+      put_pixel(bitmap, x, y, (std::rand() % density) == 0 ? 1: 0);
+}
+
+} // anonymous namespace
+
+TEST(MaskBoundaries, RegenDirtyBounds)
+{
+  std::srand(1);
+  const int w = 40, h = 30;
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, w, h));
+  clear_image(bitmap.get(), 0);
+  random_pixels(bitmap.get(), gfx::Rect(5, 5, 30, 20), 2);
+
+  MaskBoundaries incremental;
+  incremental.regen(bitmap.get());
+  incremental.offset(10, -3);
+
+  for (int i=0; i<300; ++i) {
+    gfx::Rect rc(std::rand() % w - 2, std::rand() % h - 2,
+                 1 + std::rand() % 12, 1 + std::rand() % 12);
+    if (i % 3 == 0)
+      fill_rect(bitmap.get(), rc, i % 2);
+    else
+      random_pixels(bitmap.get(), rc & bitmap->bounds(), 1 + i % 4);
+
+    incremental.regen(bitmap.get(), rc);
+    EXPECT_EQ(gfx::Point(10, -3), incremental.origin());
+
+    MaskBoundaries full;
+    full.regen(bitmap.get());
+    full.offset(10, -3);
+
+    ASSERT_EQ(sorted_segs(full), sorted_segs(incremental)) << "i=" << i;
+  }
+}
+
+TEST(MaskBoundaries, RegenDirtyBoundsWithOtherSize)
+{
+  ImageRef a(Image::create(IMAGE_BITMAP, 8, 8));
+  ImageRef b(Image::create(IMAGE_BITMAP, 4, 4));
+  clear_image(a.get(), 1);
+  clear_image(b.get(), 1);
+
+  MaskBoundaries boundaries;
+  boundaries.regen(a.get());
+  boundaries.offset(2, 2);
+
+  // A bitmap with a different size regenerates all the segments
+  boundaries.regen(b.get(), gfx::Rect(0, 0, 1, 1));
+
+  MaskBoundaries full;
+  full.regen(b.get());
+  full.offset(2, 2);
+  EXPECT_EQ(sorted_segs(full), sorted_segs(boundaries));
+}
+
+TEST(MaskBoundaries, Bounds)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 8, 8));
+  clear_image(bitmap.get(), 0);
+  fill_rect(bitmap.get(), gfx::Rect(1, 2, 3, 2), 1);
+  put_pixel(bitmap.get(), 6, 5, 1);
+
+  MaskBoundaries boundaries;
+  EXPECT_EQ(gfx::Rect(), boundaries.bounds());
+
+  boundaries.regen(bitmap.get());
+  EXPECT_EQ(gfx::Rect(1, 2, 6, 4), boundaries.bounds());
+
+  boundaries.offset(3, -1);
+  EXPECT_EQ(gfx::Rect(4, 1, 6, 4), boundaries.bounds());
+
+  put_pixel(bitmap.get(), 7, 7, 1);
+  boundaries.regen(bitmap.get(), gfx::Rect(7, 7, 1, 1));
+  EXPECT_EQ(gfx::Rect(4, 1, 7, 6), boundaries.bounds());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
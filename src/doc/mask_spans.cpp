@@ -0,0 +1,89 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/mask_spans.h"
+
+#include "doc/image.h"
+
+#include <algorithm>
+
+namespace doc {
+
+void MaskSpans::build(const Image* bitmap)
+{
+  ASSERT(bitmap);
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  clear();
+
+  const int w = bitmap->width();
+  const int h = bitmap->height();
+  const int bytes = (w+7) / 8;
+  m_width = w;
+  m_rows.reserve(h+1);
+
+  for (int y=0; y<h; ++y) {
+    const uint8_t* p = bitmap->getPixelAddress(0, y);
+    int start = -1;             // Start of the current run (-1 = outside)
+
+    for (int i=0; i<bytes; ++i, ++p) {
+      uint8_t byte = *p;
+      const int x0 = i*8;
+      const int n = std::min(8, w-x0);
+      if (n < 8)
+        byte &= (1 << n) - 1;
+
+      // Fast paths: the whole byte continues the current state
+      if (byte == 0 && start < 0)
+        continue;
+      if (byte == 0xff && start >= 0)
+        continue;
+
+      for (int b=0; b<n; ++b) {
+        if (byte & (1 << b)) {
+          if (start < 0)
+            start = x0+b;
+        }
+        else if (start >= 0) {
+          m_spans.push_back(MaskSpan(start, x0+b-start));
+          start = -1;
+        }
+      }
+    }
+
+    if (start >= 0)
+      m_spans.push_back(MaskSpan(start, w-start));
+
+    m_rows.push_back(int(m_spans.size()));
+  }
+}
+
+void MaskSpans::clear()
+{
+  m_width = 0;
+  m_spans.clear();
+  m_rows.clear();
+  m_rows.push_back(0);
+}
+
+bool MaskSpans::isFull() const
+{
+  const int h = height();
+  if (h <= 0 || size() != h)
+    return false;
+
+  for (const MaskSpan& span : m_spans) {
+    if (span.x != 0 || span.w != m_width)
+      return false;
+  }
+  return true;
+}
+
+} // namespace doc
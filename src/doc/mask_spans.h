@@ -0,0 +1,80 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_MASK_SPANS_H_INCLUDED
+#define DOC_MASK_SPANS_H_INCLUDED
+#pragma once
+
+#include <vector>
+
+namespace doc {
+  class Image;
+
+  // Horizontal run of selected pixels [x, x+w) in one row of a
+  // bitmap.
+  struct MaskSpan {
+    int x, w;
+    MaskSpan() : x(0), w(0) { }
+    MaskSpan(int x, int w) : x(x), w(w) { }
+    int x2() const { return x+w; } // Exclusive end
+  };
+
+  // Run-length representation of an IMAGE_BITMAP image: for each row
+  // we store the list of contiguous runs of non-zero pixels (sorted
+  // from left to right). Coordinates are relative to the bitmap.
+  class MaskSpans {
+  public:
+    typedef const MaskSpan* iterator;
+
+    // Range of spans in one row, to be used in range-for loops.
+    class Row {
+    public:
+      Row(iterator begin, iterator end) : m_begin(begin), m_end(end) { }
+      iterator begin() const { return m_begin; }
+      iterator end() const { return m_end; }
+      bool empty() const { return m_begin == m_end; }
+      int size() const { return int(m_end - m_begin); }
+    private:
+      iterator m_begin, m_end;
+    };
+
+    MaskSpans() { }
+    explicit MaskSpans(const Image* bitmap) { build(bitmap); }
+
+    void build(const Image* bitmap);
+    void clear();
+
+    int width() const { return m_width; }
+    int height() const { return int(m_rows.size())-1; }
+    bool empty() const { return m_spans.empty(); }
+
+    // Total number of runs in the whole bitmap.
+    int size() const { return int(m_spans.size()); }
+
+    Row row(int y) const {
+      const MaskSpan* spans = m_spans.data();
+      return Row(spans + m_rows[y],
+                 spans + m_rows[y+1]);
+    }
+
+    // Returns true if every row is completely selected.
+    bool isFull() const;
+
+    int getMemSize() const {
+      return int(sizeof(MaskSpans)
+                 + m_spans.capacity()*sizeof(MaskSpan)
+                 + m_rows.capacity()*sizeof(int));
+    }
+
+  private:
+    int m_width = 0;
+    std::vector<MaskSpan> m_spans;
+    std::vector<int> m_rows = { 0 }; // Offsets in m_spans (one per row + 1)
+  };
+
+} // namespace doc
+
+#endif
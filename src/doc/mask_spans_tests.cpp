@@ -0,0 +1,108 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+TEST(MaskSpans, Runs)
+{
+  ImageRef bmp(Image::create(IMAGE_BITMAP, 20, 3));
+  clear_image(bmp.get(), 0);
+  draw_hline(bmp.get(), 0, 0, 3, 1);
+  draw_hline(bmp.get(), 7, 0, 16, 1);
+  draw_hline(bmp.get(), 19, 0, 19, 1);
+  draw_hline(bmp.get(), 0, 2, 19, 1);
+
+  MaskSpans spans(bmp.get());
+  ASSERT_EQ(3, spans.height());
+  EXPECT_EQ(20, spans.width());
+  EXPECT_EQ(4, spans.size());
+  EXPECT_FALSE(spans.isFull());
+
+  auto row = spans.row(0);
+  ASSERT_EQ(3, row.size());
+  EXPECT_EQ(0, row.begin()[0].x);  EXPECT_EQ(4, row.begin()[0].w);
+  EXPECT_EQ(7, row.begin()[1].x);  EXPECT_EQ(10, row.begin()[1].w);
+  EXPECT_EQ(19, row.begin()[2].x); EXPECT_EQ(1, row.begin()[2].w);
+
+  EXPECT_TRUE(spans.row(1).empty());
+
+  row = spans.row(2);
+  ASSERT_EQ(1, row.size());
+  EXPECT_EQ(0, row.begin()->x);
+  EXPECT_EQ(20, row.begin()->w);
+}
+
+TEST(MaskSpans, MatchBitmap)
+{
+  std::srand(1);
+  for (int w : { 1, 7, 8, 9, 31, 64, 67 }) {
+    ImageRef bmp(Image::create(IMAGE_BITMAP, w, 8));
+    for (int y=0; y<8; ++y)
+      for (int x=0; x<w; ++x)
+        put_pixel(bmp.get(), x, y, (std::rand() % 3) ? 1: 0);
+
+    MaskSpans spans(bmp.get());
+    for (int y=0; y<8; ++y) {
+      std::vector<int> row(w, 0);
+      int prevEnd = -1;
+      for (const MaskSpan& span : spans.row(y)) {
+        EXPECT_GT(span.w, 0);
+        EXPECT_GT(span.x, prevEnd); // Sorted and non-adjacent
+        prevEnd = span.x2();
+        for (int x=span.x; x<span.x2(); ++x)
+          row[x] = 1;
+      }
+      for (int x=0; x<w; ++x)
+        EXPECT_EQ(get_pixel(bmp.get(), x, y), row[x]) << "w=" << w << " x=" << x << " y=" << y;
+    }
+  }
+}
+
+TEST(MaskSpans, MaskCache)
+{
+  Mask mask;
+  EXPECT_TRUE(mask.spans().empty());
+
+  mask.add(gfx::Rect(10, 20, 4, 3));
+  EXPECT_TRUE(mask.isRectangular());
+  EXPECT_EQ(3, mask.spans().height());
+  EXPECT_EQ(4, mask.spans().row(0).begin()->w);
+
+  mask.add(gfx::Rect(16, 20, 2, 1));
+  EXPECT_FALSE(mask.isRectangular());
+  ASSERT_EQ(2, mask.spans().row(0).size());
+  EXPECT_EQ(6, mask.spans().row(0).begin()[1].x);
+
+  // Modifying the bitmap directly invalidates the cache
+  draw_hline(mask.bitmap(), 4, 0, 5, 1);
+  ASSERT_EQ(1, mask.spans().row(0).size());
+  EXPECT_EQ(8, mask.spans().row(0).begin()->w);
+
+  mask.subtract(gfx::Rect(10, 20, 8, 1));
+  EXPECT_EQ(gfx::Rect(10, 21, 4, 2), mask.bounds());
+  EXPECT_TRUE(mask.spans().isFull());
+
+  mask.clear();
+  EXPECT_TRUE(mask.spans().empty());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
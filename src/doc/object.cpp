@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,16 @@
 
 #include "base/debug.h"
 
-#include <map>
 #include <mutex>
+#include <unordered_map>
 
 namespace doc {
 
 static std::mutex g_mutex;
 static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map is better
-static std::map<ObjectId, Object*> objects;
+// Scripts access objects by ID all the time, an unordered_map gives
+// us constant time lookups.
+static std::unordered_map<ObjectId, Object*> objects;
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -11,6 +11,10 @@
 #include "doc/octree_map.h"
 
 #include "doc/palette.h"
+#include "doc/parallel.h"
+
+#include <algorithm>
+#include <mutex>
 
 #define MIN_LEVEL_OCTREE_DEEP 3
 
@@ -52,6 +56,26 @@ int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index,
   return (*m_children)[index].mapColor(r, g, b, a, mask_index, palette, level + 1, octree);
 }
 
+void OctreeNode::merge(const OctreeNode& other, OctreeNode* parent)
+{
+  // Nodes that weren't reached by addColor() don't have a parent
+  if (!other.m_parent)
+    return;
+
+  m_parent = parent;
+  if (other.m_leafColor.pixelCount() > 0) {
+    m_leafColor.add(other.m_leafColor);
+    m_paletteIndex = other.m_paletteIndex;
+  }
+
+  if (other.m_children) {
+    if (!m_children)
+      m_children.reset(new std::array<OctreeNode, 16>());
+    for (int i=0; i<16; ++i)
+      (*m_children)[i].merge((*other.m_children)[i], this);
+  }
+}
+
 void OctreeNode::collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex)
 {
   for (int i=0; i<16; i++) {
@@ -232,35 +256,64 @@ void OctreeMap::feedWithImage(const Image* image,
 {
   ASSERT(image);
   ASSERT(image->pixelFormat() == IMAGE_RGB || image->pixelFormat() == IMAGE_GRAYSCALE);
-  color_t forceFullOpacity;
-  const bool imageIsRGBA = (image->pixelFormat() == IMAGE_RGB);
-
-  auto add_color_to_octree =
-    [this, &forceFullOpacity, levelDeep, imageIsRGBA](color_t color) {
-      const int alpha = (imageIsRGBA ? rgba_geta(color) : graya_geta(color));
-      if (alpha) {
-        color |= forceFullOpacity;
-        color = (imageIsRGBA ? color : rgba(graya_getv(color),
-                                            graya_getv(color),
-                                            graya_getv(color),
-                                            alpha));
-        addColor(color, levelDeep);
-      }
-    };
+
+  // Big images are split in bands of rows, each band is fed in its
+  // own octree in parallel and then merged into this one (the result
+  // is the same as feeding all rows serially).
+  const int kPixelsPerBand = 128*1024;
+  const int h = image->height();
+  const int rowsPerBand = std::max(1, kPixelsPerBand / std::max(1, image->width()));
+  if (h <= rowsPerBand || parallel_concurrency() < 2) {
+    feedWithRows(image, 0, h, withAlpha, levelDeep);
+  }
+  else {
+    std::mutex mutex;
+    parallel_for(0, h, rowsPerBand, [&](const int y0, const int y1){
+      OctreeMap band;
+      band.feedWithRows(image, y0, y1, withAlpha, levelDeep);
+
+      const std::lock_guard lock(mutex);
+      merge(band);
+    });
+  }
+  m_maskColor = maskColor;
+}
+
+void OctreeMap::feedWithRows(const Image* image,
+                             const int y0, const int y1,
+                             const bool withAlpha,
+                             const int levelDeep)
+{
+  const int w = image->width();
 
   switch (image->pixelFormat()) {
     case IMAGE_RGB: {
-      forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
-      doc::for_each_pixel<RgbTraits>(image, add_color_to_octree);
+      const color_t forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
+      for (int y=y0; y<y1; ++y) {
+        auto it = (RgbTraits::const_address_t)image->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x, ++it) {
+          const color_t color = *it;
+          if (rgba_geta(color))
+            addColor(color | forceFullOpacity, levelDeep);
+        }
+      }
       break;
     }
     case IMAGE_GRAYSCALE: {
-      forceFullOpacity = (withAlpha ? 0 : graya_a_mask);
-      doc::for_each_pixel<GrayscaleTraits>(image, add_color_to_octree);
+      for (int y=y0; y<y1; ++y) {
+        auto it = (GrayscaleTraits::const_address_t)image->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x, ++it) {
+          const color_t color = *it;
+          const int alpha = graya_geta(color);
+          if (alpha) {
+            const int v = graya_getv(color);
+            addColor(rgba(v, v, v, alpha), levelDeep);
+          }
+        }
+      }
       break;
     }
   }
-  m_maskColor = maskColor;
 }
 
 int OctreeMap::mapColor(color_t rgba) const
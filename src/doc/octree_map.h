@@ -14,6 +14,7 @@
 #include "doc/rgbmap_base.h"
 
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -43,10 +44,10 @@ private:
     }
 
     LeafColor(int r, int g, int b, int a, size_t pixelCount) :
-      m_r((double)r),
-      m_g((double)g),
-      m_b((double)b),
-      m_a((double)a),
+      m_r(r),
+      m_g(g),
+      m_b(b),
+      m_a(a),
       m_pixelCount(pixelCount) {
     }
 
@@ -58,7 +59,7 @@ private:
       ++m_pixelCount;
     }
 
-    void add(LeafColor leafColor) {
+    void add(const LeafColor& leafColor) {
       m_r += leafColor.m_r;
       m_g += leafColor.m_g;
       m_b += leafColor.m_b;
@@ -67,23 +68,26 @@ private:
     }
 
     color_t rgbaColor() const {
-      int auxR = (((int)m_r) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxG = (((int)m_g) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxB = (((int)m_b) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxA = (((int)m_a) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      return rgba(int(m_r / m_pixelCount + auxR),
-                  int(m_g / m_pixelCount + auxG),
-                  int(m_b / m_pixelCount + auxB),
-                  int(m_a / m_pixelCount + auxA));
+      const uint64_t n = m_pixelCount;
+      int auxR = (m_r % n > n / 2) ? 1: 0;
+      int auxG = (m_g % n > n / 2) ? 1: 0;
+      int auxB = (m_b % n > n / 2) ? 1: 0;
+      int auxA = (m_a % n > n / 2) ? 1: 0;
+      return rgba(int(m_r / n + auxR),
+                  int(m_g / n + auxG),
+                  int(m_b / n + auxB),
+                  int(m_a / n + auxA));
     }
 
     size_t pixelCount() const { return m_pixelCount; }
 
 private:
-    double m_r;
-    double m_g;
-    double m_b;
-    double m_a;
+    // Integer sums are exact, so the final color doesn't depend on
+    // the order in which pixels (or partial octrees) are added.
+    uint64_t m_r;
+    uint64_t m_g;
+    uint64_t m_b;
+    uint64_t m_a;
     size_t m_pixelCount;
   };
 
@@ -99,6 +103,10 @@ public:
                const Palette* palette, int level,
                const OctreeMap* octree) const;
 
+  // Adds the colors of other node (and its children) to this node,
+  // as if they were added with addColor().
+  void merge(const OctreeNode& other, OctreeNode* parent);
+
   void collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex);
 
   // removeLeaves(): remove leaves from a common parent
@@ -127,6 +135,14 @@ public:
     m_root.addColor(color, 0, &m_root, 0, levelDeep);
   }
 
+  // Adds all colors from other octree (fed with the same levelDeep)
+  // and uses its mask color. The result is the same as feeding this
+  // octree with the same images.
+  void merge(const OctreeMap& other) {
+    m_root.merge(other.m_root, &m_root);
+    m_maskColor = other.m_maskColor;
+  }
+
   // makePalette returns true if a 7 level octreeDeep is OK, and false
   // if we can add ONE level deep.
   bool makePalette(Palette* palette,
@@ -154,6 +170,11 @@ public:
   }
 
 private:
+  void feedWithRows(const Image* image,
+                    const int y0, const int y1,
+                    const bool withAlpha,
+                    const int levelDeep);
+
   OctreeNode m_root;
   OctreeNodes m_leavesVector;
   color_t m_maskColor = 0;
@@ -0,0 +1,106 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_ref.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+namespace {
+
+ImageRef random_image(int w, int h)
+{
+  ImageRef img(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x) {
+      // Few colors in some areas to get big leaves
+      const int k = (x < w/2 ? 4: 32);
+      put_pixel(img.get(), x, y,
+                rgba((std::rand() % k) * 255/k,
+                     (std::rand() % k) * 255/k,
+                     (std::rand() % k) * 255/k,
+                     (std::rand() % 4) ? 255: 128));
+    }
+  return img;
+}
+
+// Reference octree fed one pixel at a time
+void feed_serially(OctreeMap& octree, const Image* img, int levelDeep)
+{
+  for (int y=0; y<img->height(); ++y)
+    for (int x=0; x<img->width(); ++x) {
+      const color_t c = get_pixel(img, x, y);
+      if (rgba_geta(c))
+        octree.addColor(c, levelDeep);
+    }
+}
+
+// Creates a palette with each octree and checks that they are equal
+// (makePalette() modifies the octree, so it can be called just once).
+void expect_same_palette(OctreeMap& a, OctreeMap& b,
+                         int colors, int levelDeep)
+{
+  Palette palA(frame_t(0), colors);
+  Palette palB(frame_t(0), colors);
+  EXPECT_EQ(a.makePalette(&palA, colors, levelDeep),
+            b.makePalette(&palB, colors, levelDeep));
+  ASSERT_EQ(palA.size(), palB.size());
+  for (int i=0; i<palA.size(); ++i)
+    EXPECT_EQ(palA.getEntry(i), palB.getEntry(i))
+      << "colors=" << colors << " levelDeep=" << levelDeep << " i=" << i;
+}
+
+} // anonymous namespace
+
+TEST(OctreeMap, ParallelFeedMatchesSerial)
+{
+  std::srand(1);
+  // Big enough to be fed by bands of rows in parallel
+  ImageRef img = random_image(256, 640);
+
+  for (int levelDeep : { 7, 8 }) {
+    for (int colors : { 256, 16, 4 }) {
+      OctreeMap parallel, serial;
+      parallel.feedWithImage(img.get(), true, 0, levelDeep);
+      feed_serially(serial, img.get(), levelDeep);
+      expect_same_palette(parallel, serial, colors, levelDeep);
+    }
+  }
+}
+
+TEST(OctreeMap, Merge)
+{
+  std::srand(2);
+  ImageRef a = random_image(64, 32);
+  ImageRef b = random_image(32, 64);
+
+  OctreeMap octreeA, octreeB, merged;
+  octreeA.feedWithImage(a.get(), true, 0);
+  octreeB.feedWithImage(b.get(), true, 0);
+  merged.merge(octreeA);
+  merged.merge(octreeB);
+
+  OctreeMap serial;
+  feed_serially(serial, a.get(), 7);
+  feed_serially(serial, b.get(), 7);
+  expect_same_palette(merged, serial, 32, 7);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,355 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/parallel.h"
+
+#include "base/debug.h"
+#include "base/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// Maximum number of worker threads (without counting the threads
+// that call parallel_for() or TaskGroup::wait()).
+const int kMaxWorkers = 15;
+
+// A unit of work queued in the scheduler. The same task can be
+// referenced from a worker queue and from its TaskGroup, so it's
+// executed by the first thread that claims it.
+struct Task {
+  std::function<void()> func;
+  std::atomic<bool> claimed = false;
+
+  // Returns false if the task was already claimed by other thread.
+  bool tryRun() {
+    if (claimed.exchange(true))
+      return false;
+    func();
+    func = nullptr;             // Release captured data
+    return true;
+  }
+};
+
+using TaskPtr = std::shared_ptr<Task>;
+
+class Scheduler;
+
+// Index of the worker in the scheduler for worker threads, or -1 for
+// other threads.
+thread_local int t_workerIndex = -1;
+
+// Work-stealing scheduler: each worker has its own queue of tasks,
+// tasks queued from a worker thread go to its own queue (processed
+// in LIFO order), and tasks from other threads go to a shared
+// queue. Idle workers steal the oldest tasks from other workers.
+class Scheduler {
+public:
+  Scheduler() {
+    // We need at least one worker so TaskGroup tasks can run in
+    // background even in single core machines.
+    const int n = std::clamp(int(std::thread::hardware_concurrency())-1,
+                             1, kMaxWorkers);
+    for (int i=0; i<n; ++i)
+      m_workers.push_back(std::make_unique<Worker>());
+    // Start threads when all workers are created (so they can steal
+    // tasks from any other worker)
+    for (int i=0; i<n; ++i)
+      m_workers[i]->thread = std::thread([this, i]{ workerLoop(i); });
+  }
+
+  int workers() const { return int(m_workers.size()); }
+
+  void submit(const TaskPtr& task) {
+    const int self = t_workerIndex;
+    if (self >= 0) {
+      Worker& worker = *m_workers[self];
+      const std::lock_guard lock(worker.mutex);
+      worker.tasks.push_back(task);
+    }
+
+    {
+      const std::lock_guard lock(m_mutex);
+      if (self < 0)
+        m_injected.push_back(task);
+      ++m_queued;
+    }
+    m_queuedCv.notify_one();
+  }
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<TaskPtr> tasks;
+    std::thread thread;
+  };
+
+  void workerLoop(const int self) {
+    t_workerIndex = self;
+    base::this_thread::set_name("tasks");
+
+    while (true) {
+      if (TaskPtr task = pop(self)) {
+        task->tryRun();
+        continue;
+      }
+
+      std::unique_lock lock(m_mutex);
+      m_queuedCv.wait(lock, [this]{ return m_queued > 0; });
+    }
+  }
+
+  TaskPtr pop(const int self) {
+    TaskPtr task;
+
+    // Newest task from our own queue
+    {
+      Worker& worker = *m_workers[self];
+      const std::lock_guard lock(worker.mutex);
+      if (!worker.tasks.empty()) {
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+      }
+    }
+
+    // Oldest task queued from non-worker threads
+    if (!task) {
+      const std::lock_guard lock(m_mutex);
+      if (!m_injected.empty()) {
+        task = std::move(m_injected.front());
+        m_injected.pop_front();
+      }
+    }
+
+    // Steal the oldest task from other workers
+    const int n = workers();
+    for (int i=1; !task && i<n; ++i) {
+      Worker& victim = *m_workers[(self+i) % n];
+      const std::lock_guard lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+      }
+    }
+
+    if (task)
+      --m_queued;
+    return task;
+  }
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_queuedCv;
+  std::deque<TaskPtr> m_injected;
+  std::atomic<int> m_queued = 0;  // Tasks in all queues
+};
+
+Scheduler* get_scheduler()
+{
+  // The scheduler is never destroyed so worker threads can be used
+  // until the very end of the program.
+  static Scheduler* scheduler = new Scheduler;
+  return scheduler;
+}
+
+struct Job {
+  const std::function<void(int, int)>* func;
+  int end;
+  int grain;
+  int chunks;
+  std::atomic<int> next;
+  std::atomic<int> done = 0;    // Number of processed chunks
+  std::atomic<bool> failed = false;
+  std::exception_ptr error;     // First exception thrown by "func"
+  std::mutex mutex;
+  std::condition_variable doneCv;
+
+  // Processes chunks until there are no more chunks to process. It
+  // doesn't throw: the first exception is kept in "error" (to be
+  // re-thrown in the parallel_for() caller when all the chunks are
+  // done) and the remaining chunks are skipped.
+  void run() {
+    int i;
+    while ((i = next.fetch_add(grain)) < end) {
+      if (!failed) {
+        try {
+          (*func)(i, std::min(i+grain, end));
+        }
+        catch (...) {
+          const std::lock_guard lock(mutex);
+          if (!error)
+            error = std::current_exception();
+          failed = true;
+        }
+      }
+
+      if (done.fetch_add(1)+1 == chunks) {
+        const std::lock_guard lock(mutex);
+        doneCv.notify_all();
+      }
+    }
+  }
+};
+
+} // anonymous namespace
+
+int parallel_concurrency()
+{
+  return get_scheduler()->workers() + 1;
+}
+
+void parallel_for(const int begin,
+                  const int end,
+                  const int grain,
+                  const std::function<void(int, int)>& func)
+{
+  ASSERT(grain > 0);
+  if (begin >= end)
+    return;
+
+  // Run serially small ranges
+  if (end-begin <= grain) {
+    func(begin, end);
+    return;
+  }
+
+  // The job is shared with helper tasks because they can be started
+  // after all chunks were processed (when "func" is already out of
+  // scope, but they will not call it).
+  auto job = std::make_shared<Job>();
+  job->func = &func;
+  job->end = end;
+  job->grain = grain;
+  job->chunks = (end-begin+grain-1) / grain;
+  job->next = begin;
+
+  Scheduler* scheduler = get_scheduler();
+  const int helpers = std::min(scheduler->workers(), job->chunks-1);
+  for (int i=0; i<helpers; ++i) {
+    auto task = std::make_shared<Task>();
+    task->func = [job]{ job->run(); };
+    scheduler->submit(task);
+  }
+
+  job->run();
+
+  std::unique_lock lock(job->mutex);
+  job->doneCv.wait(lock, [&job]{ return job->done == job->chunks; });
+
+  if (job->error)
+    std::rethrow_exception(job->error);
+}
+
+//////////////////////////////////////////////////////////////////////
+// TaskGroup
+
+struct TaskGroup::State {
+  std::mutex mutex;
+  std::condition_variable doneCv;
+  std::vector<TaskPtr> tasks;   // Tasks that might be not started yet
+  int pending = 0;              // Tasks not finished yet
+  std::exception_ptr error;     // First exception thrown by a task
+  base::task_token token;
+};
+
+TaskGroup::TaskGroup()
+  : m_state(std::make_shared<State>())
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+  join();
+}
+
+void TaskGroup::run(Func&& func)
+{
+  auto task = std::make_shared<Task>();
+  task->func = [state = m_state, func = std::move(func)]{
+    if (!state->token.canceled()) {
+      try {
+        func(state->token);
+      }
+      catch (...) {
+        const std::lock_guard lock(state->mutex);
+        if (!state->error)
+          state->error = std::current_exception();
+      }
+    }
+
+    const std::lock_guard lock(state->mutex);
+    if (--state->pending == 0)
+      state->doneCv.notify_all();
+  };
+
+  {
+    const std::lock_guard lock(m_state->mutex);
+    m_state->tasks.push_back(task);
+    ++m_state->pending;
+  }
+  get_scheduler()->submit(task);
+}
+
+void TaskGroup::wait()
+{
+  join();
+
+  std::exception_ptr error;
+  {
+    const std::lock_guard lock(m_state->mutex);
+    std::swap(error, m_state->error);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void TaskGroup::join()
+{
+  std::vector<TaskPtr> tasks;
+  {
+    const std::lock_guard lock(m_state->mutex);
+    std::swap(tasks, m_state->tasks);
+  }
+
+  // Run tasks that weren't started by workers yet (instead of
+  // waiting them)
+  for (const TaskPtr& task : tasks)
+    task->tryRun();
+
+  std::unique_lock lock(m_state->mutex);
+  m_state->doneCv.wait(lock, [this]{ return m_state->pending == 0; });
+}
+
+void TaskGroup::cancel()
+{
+  m_state->token.cancel();
+}
+
+bool TaskGroup::canceled() const
+{
+  return m_state->token.canceled();
+}
+
+bool TaskGroup::done() const
+{
+  const std::lock_guard lock(m_state->mutex);
+  return (m_state->pending == 0);
+}
+
+} // namespace doc
@@ -0,0 +1,81 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PARALLEL_H_INCLUDED
+#define DOC_PARALLEL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/task.h"
+
+#include <functional>
+#include <memory>
+
+namespace doc {
+
+  // Returns the number of threads that can run a parallel_for() at
+  // the same time (including the calling thread).
+  int parallel_concurrency();
+
+  // Splits the [begin, end) range in chunks of "grain" elements and
+  // calls func(chunkBegin, chunkEnd) for each chunk from the shared
+  // work-stealing pool of worker threads. The calling thread
+  // processes chunks too and the function returns when all chunks
+  // were processed. If func() throws, the remaining chunks are
+  // skipped and the first exception is re-thrown here (after all
+  // running chunks are finished).
+  //
+  // It can be called from a chunk function or from a TaskGroup task
+  // (nested calls are distributed through the pool too).
+  void parallel_for(const int begin,
+                    const int end,
+                    const int grain,
+                    const std::function<void(int, int)>& func);
+
+  // A group of tasks executed in the same shared pool of worker
+  // threads used by parallel_for(). Tasks receive the group's
+  // base::task_token to check if the group was canceled.
+  //
+  // The destructor waits all tasks (and doesn't re-throw
+  // exceptions), so the group must outlive any data that its tasks
+  // reference.
+  class TaskGroup {
+  public:
+    using Func = std::function<void(base::task_token&)>;
+
+    TaskGroup();
+    ~TaskGroup();
+
+    // Queues a new task in the pool.
+    void run(Func&& func);
+
+    // Waits all tasks of this group. Tasks that weren't started yet
+    // are executed in the calling thread (or skipped if the group
+    // was canceled). If a task threw an exception, the first one is
+    // re-thrown here.
+    void wait();
+
+    // Cancels the group: tasks that weren't started yet will not
+    // run, and running tasks can check token.canceled() to finish
+    // as soon as possible.
+    void cancel();
+    bool canceled() const;
+
+    // Returns true if all the queued tasks were finished.
+    bool done() const;
+
+  private:
+    void join();
+
+    struct State;
+    std::shared_ptr<State> m_state;
+
+    DISABLE_COPYING(TaskGroup);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,114 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/parallel.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace doc;
+
+TEST(Parallel, ForEachChunk)
+{
+  std::vector<int> items(1000, 0);
+  parallel_for(0, int(items.size()), 7, [&items](int begin, int end){
+    EXPECT_LT(begin, end);
+    EXPECT_LE(end-begin, 7);
+    for (int i=begin; i<end; ++i)
+      ++items[i];
+  });
+  for (int i : items)
+    EXPECT_EQ(1, i);
+}
+
+TEST(Parallel, NestedFor)
+{
+  std::atomic<int> count = 0;
+  parallel_for(0, 16, 1, [&count](int, int){
+    parallel_for(0, 100, 10, [&count](int begin, int end){
+      count += end-begin;
+    });
+  });
+  EXPECT_EQ(1600, count);
+}
+
+TEST(Parallel, ForException)
+{
+  // Any chunk can throw (the ones processed by the calling thread or
+  // by workers), the exception is re-thrown when all running chunks
+  // are finished
+  for (int n=0; n<10; ++n) {
+    std::atomic<int> running = 0;
+    EXPECT_THROW(
+      parallel_for(0, 1000, 1, [&running, n](int begin, int){
+        ++running;
+        if (begin % 10 == n) {
+          --running;
+          throw std::runtime_error("error");
+        }
+        --running;
+      }),
+      std::runtime_error);
+    EXPECT_EQ(0, running);
+  }
+
+  // The pool can still be used
+  std::atomic<int> count = 0;
+  parallel_for(0, 100, 1, [&count](int begin, int end){
+    count += end-begin;
+  });
+  EXPECT_EQ(100, count);
+}
+
+TEST(Parallel, TaskGroup)
+{
+  std::vector<int> items(64, 0);
+  TaskGroup tasks;
+  for (int i=0; i<int(items.size()); ++i)
+    tasks.run([&items, i](base::task_token&){ items[i] = i; });
+  tasks.wait();
+
+  EXPECT_TRUE(tasks.done());
+  for (int i=0; i<int(items.size()); ++i)
+    EXPECT_EQ(i, items[i]);
+}
+
+TEST(Parallel, TaskGroupCancel)
+{
+  std::atomic<int> count = 0;
+  TaskGroup tasks;
+  tasks.cancel();
+  EXPECT_TRUE(tasks.canceled());
+
+  // Tasks of a canceled group are not executed
+  for (int i=0; i<10; ++i)
+    tasks.run([&count](base::task_token&){ ++count; });
+  tasks.wait();
+  EXPECT_EQ(0, count);
+}
+
+TEST(Parallel, TaskGroupException)
+{
+  TaskGroup tasks;
+  tasks.run([](base::task_token&){ throw std::runtime_error("error"); });
+  EXPECT_THROW(tasks.wait(), std::runtime_error);
+
+  // The exception is re-thrown just once
+  EXPECT_NO_THROW(tasks.wait());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
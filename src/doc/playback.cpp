@@ -16,6 +16,7 @@
 #include "doc/tag.h"
 
 #include <limits>
+#include <map>
 
 #define PLAY_TRACE(...) // TRACEARGS
 
@@ -109,6 +110,41 @@ Playback::Playback(const Sprite* sprite,
 {
 }
 
+Playback::Playback(const Playback& other)
+{
+  operator=(other);
+}
+
+Playback& Playback::operator=(const Playback& other)
+{
+  if (this == &other)
+    return *this;
+
+  m_sprite = other.m_sprite;
+  m_tags = other.m_tags;
+  m_initialFrame = other.m_initialFrame;
+  m_frame = other.m_frame;
+  m_playMode = other.m_playMode;
+  m_forward = other.m_forward;
+  m_played = other.m_played;
+
+  // Copy the PlayTags and make the delayedDelete pointers point to
+  // the new copies
+  std::map<const PlayTag*, PlayTag*> copies;
+  m_playing.clear();
+  for (const auto& playTag : other.m_playing) {
+    m_playing.push_back(std::make_unique<PlayTag>(*playTag));
+    copies[playTag.get()] = m_playing.back().get();
+  }
+  for (auto& playTag : m_playing) {
+    if (playTag->delayedDelete) {
+      auto it = copies.find(playTag->delayedDelete);
+      playTag->delayedDelete = (it != copies.end() ? it->second: nullptr);
+    }
+  }
+  return *this;
+}
+
 frame_t Playback::nextFrame(frame_t frameDelta)
 {
   PLAY_TRACE("  Playback::nextFrame { frame=", m_frame, "+", frameDelta);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2021-2022  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -58,6 +58,14 @@ namespace doc {
              const Mode playMode = PlayAll,
              const Tag* tag = nullptr);
 
+    // Copies the whole playback state, so the copy can be used to
+    // know the next frames without modifying the original playback
+    // (e.g. to pre-render the next frame).
+    Playback(const Playback& other);
+    Playback(Playback&& other) = default;
+    Playback& operator=(const Playback& other);
+    Playback& operator=(Playback&& other) = default;
+
     frame_t initialFrame() const { return m_initialFrame; }
     frame_t frame() const { return m_frame; }
 
@@ -1052,6 +1052,41 @@ TEST(Playback, InnerCascades)
   EXPECT_FALSE(play.isStopped());
 }
 
+TEST(Playback, CopyKeepsState)
+{
+  //    A
+  //   ---->
+  //       B
+  //     <----
+  //         C
+  //       <--->
+  // 0 1 2 3 4 5 6
+
+  Tag* tagA = make_tag("A", 1, 3, AniDir::FORWARD, 2);
+  Tag* tagB = make_tag("B", 2, 4, AniDir::REVERSE, 2);
+  Tag* tagC = make_tag("C", 3, 5, AniDir::PING_PONG, 2);
+  auto sprite = make_sprite(7, { tagA, tagB, tagC });
+
+  Playback play(sprite.get(), 0, Playback::Mode::PlayInLoop);
+  std::vector<frame_t> expected = {
+    0, 1,2,3,1,2,3, 4,3,2,4,3,2, 3,4,5,4,3, 6,
+    0, 1,2,3,1,2,3, 4,3,2,4,3,2, 3,4,5,4,3, 6, 0 };
+
+  // A copy in each step must give the same next frame without
+  // modifying the original playback
+  for (int i=1; i<int(expected.size()); ++i) {
+    Playback copy(play);
+    EXPECT_EQ(expected[i], copy.nextFrame()) << "[ " << i << " ]";
+    EXPECT_EQ(expected[i-1], play.frame());
+
+    Playback copy2;
+    copy2 = play;
+    EXPECT_EQ(expected[i], copy2.nextFrame()) << "[ " << i << " ]";
+
+    EXPECT_EQ(expected[i], play.nextFrame());
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
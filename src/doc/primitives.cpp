@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,6 +23,7 @@
 
 #include <city.h>
 
+#include <algorithm>
 #include <stdexcept>
 
 #if defined(__x86_64__) || defined(_WIN64)
@@ -99,18 +100,109 @@ Image* crop_image(const Image* image, const gfx::Rect& bounds, color_t bg, const
   return crop_image(image, bounds.x, bounds.y, bounds.w, bounds.h, bg, buffer);
 }
 
-void rotate_image(const Image* src, Image* dst, int angle)
+namespace {
+
+// Size of the square blocks used to rotate images by 90 degrees, so
+// the rows read from "src" and written in "dst" stay in the cache.
+const int kRotateBlockSize = 16;
+
+template<typename ImageTraits>
+void rotate_image_templ(const Image* src, Image* dst, int angle)
+{
+  using address_t = typename ImageTraits::address_t;
+  using const_address_t = typename ImageTraits::const_address_t;
+  const int w = src->width();
+  const int h = src->height();
+
+  dst->unshareTiles(dst->bounds());
+  dst->invalidateContentHash();
+
+  if (angle == 180) {
+    for (int y=0; y<h; ++y) {
+      auto s = (const_address_t)src->getPixelAddress(0, y);
+      auto d = (address_t)dst->getPixelAddress(0, h-y-1);
+      std::reverse_copy(s, s+w, d);
+    }
+    return;
+  }
+
+  address_t dstRows[kRotateBlockSize];
+  for (int by=0; by<h; by+=kRotateBlockSize) {
+    const int by2 = std::min(by+kRotateBlockSize, h);
+    for (int bx=0; bx<w; bx+=kRotateBlockSize) {
+      const int bx2 = std::min(bx+kRotateBlockSize, w);
+
+      // Each column of the source block is a row of the destination
+      for (int x=bx; x<bx2; ++x) {
+        dstRows[x-bx] = (address_t)dst->getPixelAddress(
+          0, (angle == 90 ? x: w-x-1));
+      }
+
+      int y = by;
+
+#if defined(__x86_64__) || defined(_WIN64)
+      // Transpose blocks of 4x4 pixels using SSE2
+      if constexpr (ImageTraits::bytes_per_pixel == 4) {
+        const int bx4 = bx + ((bx2-bx) & ~3);
+        for (; y+4<=by2; y+=4) {
+          const_address_t s[4];
+          for (int i=0; i<4; ++i)
+            s[i] = (const_address_t)src->getPixelAddress(bx, y+i);
+
+          int x = bx;
+          for (; x<bx4; x+=4) {
+            const int i = x-bx;
+            const __m128i r0 = _mm_loadu_si128((const __m128i*)(s[0]+i));
+            const __m128i r1 = _mm_loadu_si128((const __m128i*)(s[1]+i));
+            const __m128i r2 = _mm_loadu_si128((const __m128i*)(s[2]+i));
+            const __m128i r3 = _mm_loadu_si128((const __m128i*)(s[3]+i));
+            const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+            const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+            const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+            __m128i c[4] = { _mm_unpacklo_epi64(t0, t1),
+                             _mm_unpackhi_epi64(t0, t1),
+                             _mm_unpacklo_epi64(t2, t3),
+                             _mm_unpackhi_epi64(t2, t3) };
+            if (angle == 90) {
+              // Rows of the source are stored from right to left
+              for (int j=0; j<4; ++j) {
+                c[j] = _mm_shuffle_epi32(c[j], _MM_SHUFFLE(0, 1, 2, 3));
+                _mm_storeu_si128((__m128i*)(dstRows[i+j]+h-y-4), c[j]);
+              }
+            }
+            else {
+              for (int j=0; j<4; ++j)
+                _mm_storeu_si128((__m128i*)(dstRows[i+j]+y), c[j]);
+            }
+          }
+
+          // Remaining columns
+          for (; x<bx2; ++x) {
+            for (int i=0; i<4; ++i)
+              dstRows[x-bx][angle == 90 ? h-y-i-1: y+i] = s[i][x-bx];
+          }
+        }
+      }
+#endif
+
+      for (; y<by2; ++y) {
+        auto s = (const_address_t)src->getPixelAddress(bx, y);
+        const int u = (angle == 90 ? h-y-1: y);
+        for (int x=bx; x<bx2; ++x, ++s)
+          dstRows[x-bx][u] = *s;
+      }
+    }
+  }
+}
+
+void rotate_image_slow(const Image* src, Image* dst, int angle)
 {
-  ASSERT(src);
-  ASSERT(dst);
   int x, y;
 
   switch (angle) {
 
     case 180:
-      ASSERT(dst->width() == src->width());
-      ASSERT(dst->height() == src->height());
-
       for (y=0; y<src->height(); ++y)
         for (x=0; x<src->width(); ++x)
           dst->putPixel(src->width() - x - 1,
@@ -118,27 +210,52 @@ void rotate_image(const Image* src, Image* dst, int angle)
       break;
 
     case 90:
-      ASSERT(dst->width() == src->height());
-      ASSERT(dst->height() == src->width());
-
       for (y=0; y<src->height(); ++y)
         for (x=0; x<src->width(); ++x)
           dst->putPixel(src->height() - y - 1, x, src->getPixel(x, y));
       break;
 
     case -90:
-      ASSERT(dst->width() == src->height());
-      ASSERT(dst->height() == src->width());
-
       for (y=0; y<src->height(); ++y)
         for (x=0; x<src->width(); ++x)
           dst->putPixel(y, src->width() - x - 1, src->getPixel(x, y));
       break;
+  }
+}
+
+} // anonymous namespace
 
+void rotate_image(const Image* src, Image* dst, int angle)
+{
+  ASSERT(src);
+  ASSERT(dst);
+  ASSERT(src->pixelFormat() == dst->pixelFormat());
+
+  switch (angle) {
+    case 180:
+      ASSERT(dst->width() == src->width());
+      ASSERT(dst->height() == src->height());
+      break;
+    case 90:
+    case -90:
+      ASSERT(dst->width() == src->height());
+      ASSERT(dst->height() == src->width());
+      break;
     // bad angle
     default:
       throw std::invalid_argument("Invalid angle specified to rotate the image");
   }
+
+  // Bitmaps are packed, so we cannot access pixels directly
+  if (src->pixelFormat() == IMAGE_BITMAP) {
+    rotate_image_slow(src, dst, angle);
+    return;
+  }
+
+  DOC_DISPATCH_BY_COLOR_MODE_EXCLUDE_BITMAP(
+    src->colorMode(),
+    rotate_image_templ,
+    src, dst, angle);
 }
 
 void draw_hline(Image* image, int x1, int y, int x2, color_t color)
@@ -313,12 +430,32 @@ namespace {
 
 template<typename ImageTraits>
 bool is_plain_image_templ(const Image* img, const color_t color)
+{
+  // Don't calculate the plain color of the whole image if we already
+  // know that the first pixel is different.
+  if (!img->hasPlainInfo() &&
+      !ImageTraits::same_color(img->getPixel(0, 0), color))
+    return false;
+
+  color_t plainColor;
+  return (img->isPlain(&plainColor) &&
+          ImageTraits::same_color(plainColor, color));
+}
+
+template<typename ImageTraits>
+bool calculate_plain_color_templ(const Image* img, color_t& color, bool& exact)
 {
   const LockImageBits<ImageTraits> bits(img);
   typename LockImageBits<ImageTraits>::const_iterator it, end;
+  const typename ImageTraits::pixel_t first = *bits.begin();
+  color = first;
+  exact = true;
   for (it=bits.begin(), end=bits.end(); it!=end; ++it) {
-    if (!ImageTraits::same_color(*it, color))
-      return false;
+    if (*it != first) {
+      exact = false;
+      if (!ImageTraits::same_color(*it, first))
+        return false;
+    }
   }
   ASSERT(it == end);
   return true;
@@ -444,6 +581,20 @@ bool is_plain_image(const Image* img, color_t c)
   return false;
 }
 
+bool calculate_plain_color(const Image* img, color_t& color, bool& exact)
+{
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB:       return calculate_plain_color_templ<RgbTraits>(img, color, exact);
+    case IMAGE_GRAYSCALE: return calculate_plain_color_templ<GrayscaleTraits>(img, color, exact);
+    case IMAGE_INDEXED:   return calculate_plain_color_templ<IndexedTraits>(img, color, exact);
+    case IMAGE_BITMAP:    return calculate_plain_color_templ<BitmapTraits>(img, color, exact);
+    case IMAGE_TILEMAP:   return calculate_plain_color_templ<TilemapTraits>(img, color, exact);
+  }
+  color = 0;
+  exact = false;
+  return false;
+}
+
 bool is_empty_image(const Image* img)
 {
   color_t c = 0;                // alpha = 0
@@ -508,35 +659,42 @@ bool is_same_image(const Image* i1, const Image* i2)
   return false;
 }
 
-void remap_image(Image* image, const Remap& remap)
+bool remap_image(Image* image, const Remap& remap)
 {
   ASSERT(image->pixelFormat() == IMAGE_INDEXED ||
          image->pixelFormat() == IMAGE_TILEMAP);
 
+  bool modified = false;
   switch (image->pixelFormat()) {
     case IMAGE_INDEXED:
       transform_image<IndexedTraits>(
-        image, [&remap](color_t c) -> color_t {
+        image, [&remap, &modified](color_t c) -> color_t {
           auto to = remap[c];
-          if (to != Remap::kUnused)
+          if (to != Remap::kUnused) {
+            modified |= (color_t(to) != c);
             return to;
+          }
           else
             return c;
         });
       break;
     case IMAGE_TILEMAP:
       transform_image<TilemapTraits>(
-        image, [&remap](color_t c) -> color_t {
+        image, [&remap, &modified](color_t c) -> color_t {
           auto to = remap[tile_geti(c)];
+          color_t result;
           if (c == notile || to == Remap::kNoTile)
-            return notile;
+            result = notile;
           else if (to != Remap::kUnused)
-            return tile(to, tile_getf(c));
+            result = tile(to, tile_getf(c));
           else
-            return c;
+            result = c;
+          modified |= (result != c);
+          return result;
         });
       break;
   }
+  return modified;
 }
 
 // TODO test this hash routine and find a better alternative
@@ -553,10 +711,19 @@ static uint32_t calculate_image_hash_templ(const Image* image,
   static_assert(sizeof(void*) == 4, "This CPU is not 32-bit");
 #endif
 
+  // Transparent pixels are hashed as 0 (as ImageTraits::same_color()
+  // considers all transparent pixels equal), so two images that are
+  // equal for is_same_image() will have the same hash.
+  constexpr bool normalizeTransparent =
+    (ImageTraits::color_mode == ColorMode::RGB ||
+     ImageTraits::color_mode == ColorMode::GRAYSCALE);
+
   const uint32_t widthBytes = ImageTraits::bytes_per_pixel * bounds.w;
   const uint32_t len = widthBytes * bounds.h;
-  if (bounds == image->bounds() &&
-      widthBytes == image->rowBytes()) {
+  if (!normalizeTransparent &&
+      bounds == image->bounds() &&
+      widthBytes == image->rowBytes() &&
+      !image->isTiled()) {
     return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
   }
   else {
@@ -565,6 +732,14 @@ static uint32_t calculate_image_hash_templ(const Image* image,
     for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
       auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
       std::copy(src, src+widthBytes, dst);
+
+      if constexpr (normalizeTransparent) {
+        auto p = (typename ImageTraits::address_t)dst;
+        for (int x=0; x<bounds.w; ++x, ++p) {
+          if ((*p & Mask) == 0)
+            *p = 0;
+        }
+      }
     }
     return CITYHASH((const char*)&buf[0], buf.size());
   }
@@ -573,8 +748,8 @@ static uint32_t calculate_image_hash_templ(const Image* image,
 uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
 {
   switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_rgb_mask>(img, bounds);
-    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_v_mask>(img, bounds);
+    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_a_mask>(img, bounds);
+    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_a_mask>(img, bounds);
     case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits, 0xff>(img, bounds);
     case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits, 1>(img, bounds);
   }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -44,11 +44,16 @@ namespace doc {
   bool is_plain_image(const Image* img, color_t c);
   bool is_empty_image(const Image* img);
 
+  // Checks all pixels to know if the image is plain (see
+  // Image::isPlain(), which caches the result of this function).
+  bool calculate_plain_color(const Image* img, color_t& color, bool& exact);
+
   int count_diff_between_images(const Image* i1, const Image* i2);
   bool is_same_image(const Image* i1, const Image* i2);
   bool is_same_image_slow(const Image* i1, const Image* i2);
 
-  void remap_image(Image* image, const Remap& remap);
+  // Returns true if some pixel of the image was changed.
+  bool remap_image(Image* image, const Remap& remap);
 
   uint32_t calculate_image_hash(const Image* image,
                                 const gfx::Rect& bounds);
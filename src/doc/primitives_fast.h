@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -24,6 +24,18 @@ namespace doc {
     return (((ImageImpl<Traits>*)image)->address(x, y));
   }
 
+  // Used to modify pixels directly, so it duplicates the shared tile
+  // of the row in tiled images.
+  template<class Traits>
+  inline typename Traits::address_t get_pixel_address_fast(Image* image, int x, int y) {
+    ASSERT(x >= 0 && x < image->width());
+    ASSERT(y >= 0 && y < image->height());
+
+    if (image->isTiled())
+      image->unshareTiles(gfx::Rect(0, y, image->width(), 1));
+    return (((ImageImpl<Traits>*)image)->address(x, y));
+  }
+
   template<class Traits>
   inline typename Traits::pixel_t get_pixel_fast(const Image* image, int x, int y) {
     ASSERT(x >= 0 && x < image->width());
@@ -37,6 +49,8 @@ namespace doc {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
+    if (image->isTiled())
+      image->unshareTiles(gfx::Rect(0, y, image->width(), 1));
     *(((ImageImpl<Traits>*)image)->address(x, y)) = color;
   }
 
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -80,6 +80,34 @@ TYPED_TEST(Primitives, IsSameImage)
   }
 }
 
+TYPED_TEST(Primitives, RotateImage)
+{
+  using ImageTraits = TypeParam;
+
+  for (const Size& size : { Size(1, 1), Size(3, 70), Size(65, 33) }) {
+    const int w = size.w;
+    const int h = size.h;
+    ImageRef a(Image::create(ImageTraits::pixel_format, w, h));
+    doc::algorithm::random_image(a.get());
+
+    ImageRef r90(Image::create(ImageTraits::pixel_format, h, w));
+    ImageRef r180(Image::create(ImageTraits::pixel_format, w, h));
+    ImageRef r270(Image::create(ImageTraits::pixel_format, h, w));
+    rotate_image(a.get(), r90.get(), 90);
+    rotate_image(a.get(), r180.get(), 180);
+    rotate_image(a.get(), r270.get(), -90);
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        const color_t c = get_pixel_fast<ImageTraits>(a.get(), x, y);
+        ASSERT_EQ(c, get_pixel_fast<ImageTraits>(r90.get(), h-y-1, x));
+        ASSERT_EQ(c, get_pixel_fast<ImageTraits>(r180.get(), w-x-1, h-y-1));
+        ASSERT_EQ(c, get_pixel_fast<ImageTraits>(r270.get(), y, w-x-1));
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/render_plan.h"
 
 #include "doc/cel.h"
+#include "doc/cels_index.h"
 #include "doc/layer.h"
 
 #include <algorithm>
@@ -53,6 +54,17 @@ void RenderPlan::addLayer(const Layer* layer,
   }
 }
 
+std::shared_ptr<const CelsIndex> RenderPlan::celsIndex() const
+{
+  const Items& items = this->items();
+
+  const std::lock_guard lock(m_celsIndexMutex);
+  if (!m_celsIndex || !m_celsIndex->isValid(items)) {
+    m_celsIndex = std::make_shared<CelsIndex>(items);
+  }
+  return m_celsIndex;
+}
+
 void RenderPlan::processZIndexes() const
 {
   m_processZIndex = false;
@@ -80,4 +92,43 @@ void RenderPlan::processZIndexes() const
             });
 }
 
+RenderPlanPtr RenderPlanCache::get(const Layer* layer,
+                                   const frame_t frame)
+{
+  int generation;
+  {
+    const std::lock_guard lock(m_mutex);
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+      if (it->layer == layer && it->frame == frame) {
+        Entry entry = *it;
+        m_entries.erase(it);
+        m_entries.push_back(entry);
+        return entry.plan;
+      }
+    }
+    generation = m_generation;
+  }
+
+  // Create the plan outside the lock
+  auto plan = std::make_shared<RenderPlan>();
+  plan->addLayer(layer, frame);
+  plan->items();                // Process z-indexes now
+
+  const std::lock_guard lock(m_mutex);
+  // Don't cache a plan created while the cache was invalidated
+  if (generation == m_generation) {
+    if (int(m_entries.size()) >= kMaxPlans)
+      m_entries.erase(m_entries.begin());
+    m_entries.push_back(Entry{ layer, frame, plan });
+  }
+  return plan;
+}
+
+void RenderPlanCache::invalidate()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  ++m_generation;
+}
+
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,7 +12,12 @@
 #include "doc/cel_list.h"
 #include "doc/frame.h"
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace doc {
+  class CelsIndex;
   class Layer;
 
   // Creates a list of cels to be rendered in the correct order
@@ -43,12 +48,51 @@ namespace doc {
     void addLayer(const Layer* layer,
                   const frame_t frame);
 
+    // Returns a spatial index of the cels of items(), created the
+    // first time it's needed (and re-created if cels were moved or
+    // resized after that).
+    std::shared_ptr<const CelsIndex> celsIndex() const;
+
   private:
     void processZIndexes() const;
 
     int m_order = 0;
     mutable Items m_items;
     mutable bool m_processZIndex = true;
+    mutable std::mutex m_celsIndexMutex;
+    mutable std::shared_ptr<const CelsIndex> m_celsIndex;
+  };
+
+  using RenderPlanPtr = std::shared_ptr<const RenderPlan>;
+
+  // Keeps the last render plans created for each (layer, frame) of
+  // a sprite so repeated renders of the same frame don't have to
+  // traverse the layer tree and sort by z-index again. The sprite
+  // invalidates the whole cache when the layer tree changes (layers
+  // added/removed/restacked, visibility, cels moved or z-index
+  // changes).
+  class RenderPlanCache {
+  public:
+    static constexpr int kMaxPlans = 16;
+
+    // Returns the plan to render the given layer (and its children)
+    // in the given frame. The returned plan is already sorted, so
+    // it can be used from several threads at the same time.
+    RenderPlanPtr get(const Layer* layer,
+                      const frame_t frame);
+
+    void invalidate();
+
+  private:
+    struct Entry {
+      const Layer* layer;
+      frame_t frame;
+      RenderPlanPtr plan;
+    };
+
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;   // The most recently used at the end
+    int m_generation = 0;           // Incremented on each invalidate()
   };
 
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -134,6 +134,59 @@ TEST(RenderPlan, ZIndexBugWithEmptyCels)
   d->setZIndex(-3); EXPECT_PLAN(d, a, b);
 }
 
+TEST(RenderPlan, Cache)
+{
+  auto doc = std::make_shared<Document>();
+  ImageSpec spec(ColorMode::INDEXED, 2, 2);
+  Sprite* spr;
+  doc->sprites().add(spr = Sprite::MakeStdSprite(spec));
+
+  LayerImage
+    *lay0 = static_cast<LayerImage*>(spr->root()->firstLayer()),
+    *lay1 = new LayerImage(spr);
+
+  Cel* a = lay0->cel(0), *b;
+  lay1->addCel(b = new Cel(0, ImageRef(Image::create(spec))));
+  spr->root()->insertLayer(lay1, lay0);
+
+  RenderPlanPtr plan = spr->renderPlan(spr->root(), 0);
+  ASSERT_EQ(2, plan->items().size());
+  EXPECT_EQ(plan, spr->renderPlan(spr->root(), 0));
+  EXPECT_NE(plan, spr->renderPlan(spr->root(), 1));
+  EXPECT_NE(plan, spr->renderPlan(lay1, 0));
+
+  // Z-index changes
+  a->setZIndex(1);
+  RenderPlanPtr plan2 = spr->renderPlan(spr->root(), 0);
+  EXPECT_NE(plan, plan2);
+  EXPECT_EQ(b, plan2->items()[0].cel);
+  EXPECT_EQ(a, plan2->items()[1].cel);
+  // The old plan is still valid for its users
+  EXPECT_EQ(a, plan->items()[0].cel);
+
+  // Visibility changes
+  lay0->setVisible(false);
+  plan = spr->renderPlan(spr->root(), 0);
+  ASSERT_EQ(1, plan->items().size());
+  EXPECT_EQ(b, plan->items()[0].cel);
+
+  // Other flags don't invalidate the cache
+  lay0->setEditable(false);
+  EXPECT_EQ(plan, spr->renderPlan(spr->root(), 0));
+
+  // Cels moved
+  lay1->moveCel(b, 1);
+  plan = spr->renderPlan(spr->root(), 0);
+  ASSERT_EQ(1, plan->items().size());
+  EXPECT_EQ(nullptr, plan->items()[0].cel);
+
+  // Layers removed
+  spr->root()->removeLayer(lay1);
+  plan = spr->renderPlan(spr->root(), 1);
+  EXPECT_TRUE(plan->items().empty());
+  delete lay1;
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
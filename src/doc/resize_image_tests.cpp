@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -86,6 +86,62 @@ TEST(ResizeImage, NearestNeighborInterp)
   ASSERT_EQ(0, count_diff_between_images(src.get(), dst2.get()));
 }
 
+TEST(ResizeImage, BilinearGradient)
+{
+  const color_t black = rgba(0, 0, 0, 255);
+  const color_t white = rgba(255, 255, 255, 255);
+  const int expected[5] = { 0, 63, 127, 191, 255 };
+
+  ImageRef src(Image::create(IMAGE_RGB, 2, 2));
+  put_pixel(src.get(), 0, 0, black);
+  put_pixel(src.get(), 1, 0, white);
+  put_pixel(src.get(), 0, 1, black);
+  put_pixel(src.get(), 1, 1, white);
+
+  // Horizontal interpolation
+  ImageRef dst(Image::create(IMAGE_RGB, 5, 3));
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_BILINEAR,
+                          nullptr, nullptr, -1);
+  for (int y=0; y<3; ++y)
+    for (int x=0; x<5; ++x)
+      EXPECT_EQ(expected[x], rgba_getr(get_pixel(dst.get(), x, y))) << x << "," << y;
+
+  // Vertical interpolation
+  put_pixel(src.get(), 1, 0, black);
+  put_pixel(src.get(), 0, 1, white);
+  dst.reset(Image::create(IMAGE_RGB, 3, 5));
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_BILINEAR,
+                          nullptr, nullptr, -1);
+  for (int y=0; y<5; ++y)
+    for (int x=0; x<3; ++x)
+      EXPECT_EQ(expected[y], rgba_getr(get_pixel(dst.get(), x, y))) << x << "," << y;
+}
+
+TEST(ResizeImage, FixupTransparentColors)
+{
+  ImageRef rgb(Image::create(IMAGE_RGB, 4, 3));
+  clear_image(rgb.get(), rgba(255, 255, 255, 0));
+  rgb->putPixel(0, 0, rgba(100, 0, 0, 255));
+  rgb->putPixel(1, 1, rgba(200, 50, 0, 10));
+  algorithm::fixup_image_transparent_colors(rgb.get());
+
+  EXPECT_EQ(rgba(100, 0, 0, 255), get_pixel(rgb.get(), 0, 0));
+  EXPECT_EQ(rgba(150, 25, 0, 0), get_pixel(rgb.get(), 1, 0));
+  EXPECT_EQ(rgba(200, 50, 0, 10), get_pixel(rgb.get(), 1, 1));
+  EXPECT_EQ(rgba(200, 50, 0, 0), get_pixel(rgb.get(), 2, 2));
+  EXPECT_EQ(rgba(255, 255, 255, 0), get_pixel(rgb.get(), 3, 2));
+
+  ImageRef gray(Image::create(IMAGE_GRAYSCALE, 3, 1));
+  clear_image(gray.get(), graya(0, 0));
+  gray->putPixel(2, 0, graya(90, 255));
+  algorithm::fixup_image_transparent_colors(gray.get());
+
+  EXPECT_EQ(graya(0, 0), get_pixel(gray.get(), 0, 0));
+  EXPECT_EQ(graya(90, 0), get_pixel(gray.get(), 1, 0));
+}
+
 #if 0                           // TODO complete this test
 TEST(ResizeImage, BilinearInterpRGBType)
 {
@@ -32,6 +32,21 @@ namespace doc {
     // Should return the best index in a palette that matches the given RGBA values.
     virtual int mapColor(const color_t rgba) const = 0;
 
+    // Maps "n" RGBA values to palette indexes (e.g. a whole row of
+    // pixels). Implementations can override it to take advantage of
+    // consecutive pixels with similar colors.
+    virtual void mapColors(const color_t* rgba,
+                           uint8_t* indexes,
+                           const int n) const {
+      for (int i=0; i<n; ++i)
+        indexes[i] = mapColor(rgba[i]);
+    }
+
+    // Returns true if mapColor() and mapColors() can be called from
+    // several threads at the same time (i.e. the map doesn't fill a
+    // cache lazily).
+    virtual bool isThreadSafe() const { return false; }
+
     virtual int maskIndex() const = 0;
 
     virtual RgbMapAlgorithm rgbmapAlgorithm() const = 0;
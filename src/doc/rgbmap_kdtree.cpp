@@ -0,0 +1,254 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/rgbmap_kdtree.h"
+
+#include "doc/palette.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace doc {
+
+namespace {
+
+// Same weights used by Palette::initBestfit() for each axis of the
+// FitCriteria::DEFAULT space (g, r, b, a).
+const double kDefaultWeights[4] = { 59*59, 30*30, 11*11, 8*8 };
+
+}
+
+RgbMapKdTree::RgbMapKdTree()
+{
+  m_fitCriteria = FitCriteria::DEFAULT;
+}
+
+void RgbMapKdTree::regenerateMap(const Palette* palette,
+                                 const int maskIndex,
+                                 const FitCriteria fitCriteria)
+{
+  ASSERT(palette);
+  if (!palette)
+    return;
+
+  // Skip useless regenerations
+  if (m_palette == palette &&
+      m_modifications == palette->getModifications() &&
+      m_maskIndex == maskIndex &&
+      m_fitCriteria == fitCriteria)
+    return;
+
+  m_palette = palette;
+  m_fitCriteria = fitCriteria;
+  m_modifications = palette->getModifications();
+  m_maskIndex = maskIndex;
+
+  // Palette::findBestfit() (used for the default criteria) only
+  // checks the first 256 entries and never returns the mask index.
+  const bool defaultCriteria = (m_fitCriteria == FitCriteria::DEFAULT);
+  const int size = (defaultCriteria ? std::min(256, palette->size()):
+                                      palette->size());
+  m_points.clear();
+  m_points.reserve(size);
+  for (int i=0; i<size; ++i) {
+    if (defaultCriteria && i == maskIndex)
+      continue;
+
+    Point point;
+    toPoint(palette->getEntry(i), point.v);
+    point.index = i;
+    point.axis = 0;
+    m_points.push_back(point);
+  }
+
+  build(0, int(m_points.size()));
+
+  m_pointOfIndex.assign(size, -1);
+  for (int i=0; i<int(m_points.size()); ++i)
+    m_pointOfIndex[m_points[i].index] = i;
+}
+
+int RgbMapKdTree::mapColor(const color_t rgba) const
+{
+  return findNearest(rgba, -1);
+}
+
+void RgbMapKdTree::mapColors(const color_t* rgba,
+                             uint8_t* indexes,
+                             const int n) const
+{
+  // Rows of pixels usually have runs of the same color, or similar
+  // colors, so we re-use the previous result for equal colors and
+  // start the search from it for different ones.
+  color_t prevColor = 0;
+  int prevIndex = -1;
+  for (int i=0; i<n; ++i) {
+    const color_t color = rgba[i];
+    if (prevIndex < 0 || color != prevColor) {
+      prevIndex = findNearest(color, prevIndex);
+      prevColor = color;
+    }
+    indexes[i] = prevIndex;
+  }
+}
+
+void RgbMapKdTree::toPoint(const color_t rgba, double* v) const
+{
+  const int r = rgba_getr(rgba);
+  const int g = rgba_getg(rgba);
+  const int b = rgba_getb(rgba);
+  const int a = rgba_geta(rgba);
+
+  if (m_fitCriteria == FitCriteria::DEFAULT) {
+    v[0] = g>>3;
+    v[1] = r>>3;
+    v[2] = b>>3;
+    v[3] = a>>3;
+  }
+  else {
+    double x = r, y = g, z = b;
+    rgbToOtherSpace(x, y, z);
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+    v[3] = a;
+  }
+}
+
+// Returns the distance between two points in the given axis. It's
+// calculated exactly as the brute force search does, so adding the
+// four axis distances gives the same result (and the same best fit
+// index).
+double RgbMapKdTree::axisDistance(const int axis,
+                                  const double q,
+                                  const double p) const
+{
+  if (m_fitCriteria == FitCriteria::DEFAULT) {
+    const double d = q - p;
+    return kDefaultWeights[axis] * (d * d);
+  }
+  if (axis == 3) {
+    const double d = (q - p) / 128.0;
+    return d * d;
+  }
+  const double d = q - p;
+  return d * d;
+}
+
+double RgbMapKdTree::distance(const double* q, const double* p) const
+{
+  return (axisDistance(0, q[0], p[0]) +
+          axisDistance(1, q[1], p[1]) +
+          axisDistance(2, q[2], p[2]) +
+          axisDistance(3, q[3], p[3]));
+}
+
+void RgbMapKdTree::build(const int begin, const int end)
+{
+  if (begin >= end)
+    return;
+
+  // Split by the axis with the biggest extent
+  int axis = 0;
+  double extent = -1.0;
+  for (int k=0; k<4; ++k) {
+    double lo = std::numeric_limits<double>::max();
+    double hi = std::numeric_limits<double>::lowest();
+    for (int i=begin; i<end; ++i) {
+      lo = std::min(lo, m_points[i].v[k]);
+      hi = std::max(hi, m_points[i].v[k]);
+    }
+    const double d = axisDistance(k, hi, lo);
+    if (d > extent) {
+      extent = d;
+      axis = k;
+    }
+  }
+
+  const int mid = begin + (end-begin)/2;
+  std::nth_element(m_points.begin()+begin,
+                   m_points.begin()+mid,
+                   m_points.begin()+end,
+                   [axis](const Point& a, const Point& b){
+                     return a.v[axis] < b.v[axis];
+                   });
+  m_points[mid].axis = axis;
+
+  build(begin, mid);
+  build(mid+1, end);
+}
+
+void RgbMapKdTree::search(const double* q,
+                          const int begin,
+                          const int end,
+                          Best& best) const
+{
+  if (begin >= end)
+    return;
+
+  const int mid = begin + (end-begin)/2;
+  const Point& point = m_points[mid];
+
+  // Ties are resolved with the lowest index (like a linear search)
+  const double d = distance(q, point.v);
+  if (d < best.dist ||
+      (d == best.dist && point.index < best.index)) {
+    best.dist = d;
+    best.index = point.index;
+  }
+
+  const int axis = point.axis;
+  const bool left = (q[axis] < point.v[axis]);
+  if (left)
+    search(q, begin, mid, best);
+  else
+    search(q, mid+1, end, best);
+
+  // Points in the other side are at least at this distance (we use
+  // <= to find entries with the same distance and a lower index)
+  if (axisDistance(axis, q[axis], point.v[axis]) <= best.dist) {
+    if (left)
+      search(q, mid+1, end, best);
+    else
+      search(q, begin, mid, best);
+  }
+}
+
+int RgbMapKdTree::findNearest(const color_t rgba, const int hint) const
+{
+  // Mask index is like alpha = 0, so we can use it as transparent color.
+  const int a = rgba_geta(rgba);
+  if (m_maskIndex >= 0 &&
+      (m_fitCriteria == FitCriteria::DEFAULT ? (a>>3) == 0: a == 0))
+    return m_maskIndex;
+
+  if (m_points.empty())
+    return 0;
+
+  double q[4];
+  toPoint(rgba, q);
+
+  Best best = { std::numeric_limits<double>::max(),
+                std::numeric_limits<int>::max() };
+
+  // Starting from a good candidate discards more branches
+  if (hint >= 0 && hint < int(m_pointOfIndex.size())) {
+    const int i = m_pointOfIndex[hint];
+    if (i >= 0) {
+      best.dist = distance(q, m_points[i].v);
+      best.index = hint;
+    }
+  }
+
+  search(q, 0, int(m_points.size()), best);
+  return best.index;
+}
+
+} // namespace doc
@@ -0,0 +1,78 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_RGBMAP_KDTREE_H_INCLUDED
+#define DOC_RGBMAP_KDTREE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/rgbmap_base.h"
+
+#include <vector>
+
+namespace doc {
+
+  // Finds the nearest palette entry using a k-d tree of the palette
+  // colors. It returns exactly the same indexes as
+  // RgbMapBase::findBestfit() (a brute force search) for any fit
+  // criteria, but visiting only a few palette entries per color and
+  // without a cache, so mapColor() can be called from several threads.
+  class RgbMapKdTree : public RgbMapBase {
+  public:
+    RgbMapKdTree();
+
+    // RgbMap impl
+    void regenerateMap(const Palette* palette,
+                       const int maskIndex,
+                       const FitCriteria fitCriteria) override;
+    void regenerateMap(const Palette* palette,
+                       const int maskIndex) override {
+      regenerateMap(palette, maskIndex, m_fitCriteria);
+    }
+    int mapColor(const color_t rgba) const override;
+    void mapColors(const color_t* rgba,
+                   uint8_t* indexes,
+                   const int n) const override;
+    bool isThreadSafe() const override { return true; }
+
+    RgbMapAlgorithm rgbmapAlgorithm() const override {
+      return RgbMapAlgorithm::KDTREE;
+    }
+
+  private:
+    struct Point {
+      double v[4];
+      int index;                // Palette index
+      int axis;                 // Split axis of this node
+    };
+
+    struct Best {
+      double dist;
+      int index;
+    };
+
+    void toPoint(const color_t rgba, double* v) const;
+    double distance(const double* q, const double* p) const;
+    double axisDistance(const int axis, const double q, const double p) const;
+    void build(const int begin, const int end);
+    void search(const double* q, const int begin, const int end, Best& best) const;
+    int findNearest(const color_t rgba, const int hint) const;
+
+    // Nodes of the tree, each range [begin, end) has its root in the
+    // middle element, and the [begin, mid) and [mid+1, end) ranges
+    // are its children.
+    std::vector<Point> m_points;
+
+    // Position in m_points of each palette index (or -1 if the index
+    // isn't in the tree).
+    std::vector<int> m_pointOfIndex;
+
+    DISABLE_COPYING(RgbMapKdTree);
+  };
+
+} // namespace doc
+
+#endif
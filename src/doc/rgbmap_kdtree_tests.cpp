@@ -0,0 +1,120 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/rgbmap_kdtree.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+color_t random_color()
+{
+  return rgba(std::rand() % 256,
+              std::rand() % 256,
+              std::rand() % 256,
+              (std::rand() % 3) ? 255: std::rand() % 256);
+}
+
+// Compares the k-d tree results with the brute force search
+// (RgbMapBase::findBestfit()) for random colors.
+void test_palette(const Palette& palette, const int maskIndex)
+{
+  for (FitCriteria fc : { FitCriteria::DEFAULT,
+                          FitCriteria::RGB,
+                          FitCriteria::linearizedRGB,
+                          FitCriteria::CIEXYZ,
+                          FitCriteria::CIELAB }) {
+    RgbMapKdTree map;
+    map.regenerateMap(&palette, maskIndex, fc);
+    EXPECT_EQ(RgbMapAlgorithm::KDTREE, map.rgbmapAlgorithm());
+    EXPECT_EQ(maskIndex, map.maskIndex());
+    EXPECT_EQ(fc, map.fitCriteria());
+
+    std::vector<color_t> colors;
+    for (int i=0; i<palette.size(); ++i)
+      colors.push_back(palette.getEntry(i));
+    for (int i=0; i<2000; ++i) {
+      // Add runs of equal colors for mapColors()
+      const color_t c = random_color();
+      for (int j=std::rand()%3; j>=0; --j)
+        colors.push_back(c);
+    }
+
+    std::vector<uint8_t> indexes(colors.size());
+    map.mapColors(colors.data(), indexes.data(), int(colors.size()));
+
+    for (int i=0; i<int(colors.size()); ++i) {
+      const color_t c = colors[i];
+      const int expected = map.findBestfit(rgba_getr(c), rgba_getg(c),
+                                           rgba_getb(c), rgba_geta(c),
+                                           maskIndex);
+      EXPECT_EQ(expected, map.mapColor(c))
+        << "fc=" << int(fc) << " color=" << std::hex << c;
+      EXPECT_EQ(expected, indexes[i])
+        << "fc=" << int(fc) << " color=" << std::hex << c;
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(RgbMapKdTree, MatchBruteForce)
+{
+  std::srand(1);
+
+  for (int size : { 1, 2, 16, 256 }) {
+    Palette palette(frame_t(0), size);
+    for (int i=0; i<size; ++i)
+      palette.setEntry(i, random_color());
+
+    for (int maskIndex : { -1, 0, size-1 })
+      test_palette(palette, maskIndex);
+  }
+}
+
+TEST(RgbMapKdTree, DuplicatedEntries)
+{
+  // Equal entries must resolve to the lowest index
+  Palette palette(frame_t(0), 64);
+  for (int i=0; i<64; ++i)
+    palette.setEntry(i, rgba((i%4)*80, (i%8)*32, 0, 255));
+
+  test_palette(palette, -1);
+  test_palette(palette, 3);
+}
+
+TEST(RgbMapKdTree, RegenerateOnChange)
+{
+  Palette palette(frame_t(0), 2);
+  palette.setEntry(0, rgba(0, 0, 0, 255));
+  palette.setEntry(1, rgba(255, 255, 255, 255));
+
+  RgbMapKdTree map;
+  map.regenerateMap(&palette, -1, FitCriteria::DEFAULT);
+  EXPECT_EQ(1, map.mapColor(rgba(200, 200, 200, 255)));
+
+  palette.setEntry(0, rgba(200, 200, 200, 255));
+  map.regenerateMap(&palette, -1, FitCriteria::DEFAULT);
+  EXPECT_EQ(0, map.mapColor(rgba(200, 200, 200, 255)));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  // Palette::findBestfit() is used as the reference
+  Palette::initBestfit();
+  return RUN_ALL_TESTS();
+}
@@ -19,7 +19,8 @@ enum class SerialFormat : uint16_t {
   Ver0 = 0,           // Old version
   Ver1 = 1,           // New version with tilesets
   Ver2 = 2,           // Version 2 adds custom properties to user data
-  LastVer = Ver2
+  Ver3 = 3,           // Version 3 stores the type of vector elements only once if all have the same type
+  LastVer = Ver3
 };
 
 } // namespace doc
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,11 +13,27 @@
 
 #include "base/debug.h"
 #include "doc/slice.h"
+#include "doc/slices_index.h"
 
 #include <algorithm>
+#include <atomic>
 
 namespace doc {
 
+static std::atomic<uint32_t> g_generation(0);
+
+// static
+uint32_t Slices::generation()
+{
+  return g_generation;
+}
+
+// static
+void Slices::incrementGeneration()
+{
+  ++g_generation;
+}
+
 Slices::Slices(Sprite* sprite)
   : m_sprite(sprite)
 {
@@ -34,6 +51,7 @@ void Slices::add(Slice* slice)
 {
   m_slices.push_back(slice);
   slice->setOwner(this);
+  incrementGeneration();
 }
 
 void Slices::remove(Slice* slice)
@@ -44,6 +62,18 @@ void Slices::remove(Slice* slice)
     m_slices.erase(it);
 
   slice->setOwner(nullptr);
+  incrementGeneration();
+}
+
+std::shared_ptr<const SlicesIndex> Slices::index(const frame_t frame) const
+{
+  const std::lock_guard lock(m_indexMutex);
+  if (!m_index ||
+      m_index->frame() != frame ||
+      m_index->generation() != generation()) {
+    m_index = std::make_shared<SlicesIndex>(*this, frame);
+  }
+  return m_index;
 }
 
 Slice* Slices::getByName(const std::string& name) const
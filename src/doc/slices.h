@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,14 +10,19 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "doc/frame.h"
 #include "doc/object_id.h"
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace doc {
 
   class Slice;
+  class SlicesIndex;
   class Sprite;
 
   class Slices {
@@ -45,10 +51,24 @@ namespace doc {
     std::size_t size() const { return m_slices.size(); }
     bool empty() const { return m_slices.empty(); }
 
+    // Returns a spatial index of the slice keys in the given frame
+    // (re-created only when slices or keys are added/removed).
+    std::shared_ptr<const SlicesIndex> index(const frame_t frame) const;
+
+    // Counter incremented each time a slice or a slice key is
+    // added/removed, so cached slice keys (e.g. SlicesIndex) can be
+    // validated without iterating all slices.
+    static uint32_t generation();
+    static void incrementGeneration();
+
   private:
     Sprite* m_sprite;
     List m_slices;
 
+    // Index of the last frame used in index()
+    mutable std::mutex m_indexMutex;
+    mutable std::shared_ptr<const SlicesIndex> m_index;
+
     DISABLE_COPYING(Slices);
   };
 
@@ -0,0 +1,120 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/slices_index.h"
+
+#include "doc/slice.h"
+#include "doc/slices.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace doc {
+
+namespace {
+
+// Maximum number of columns/rows of the grid
+const int kMaxGridSide = 64;
+
+}
+
+SlicesIndex::SlicesIndex(const Slices& slices, const frame_t frame)
+  : m_generation(Slices::generation())
+  , m_frame(frame)
+  , m_cellW(1)
+  , m_cellH(1)
+  , m_cols(0)
+  , m_rows(0)
+{
+  m_entries.reserve(slices.size());
+  for (Slice* slice : slices) {
+    const SliceKey* key = slice->getByFrame(frame);
+    if (!key || key->isEmpty())
+      continue;
+
+    m_entries.push_back(Entry{ key->bounds(), slice });
+    m_bounds |= key->bounds();
+  }
+
+  if (m_entries.empty())
+    return;
+
+  // One cell each ~1 slice (on average) in a square grid
+  const int side = std::clamp(int(std::ceil(std::sqrt(double(m_entries.size())))),
+                              1, kMaxGridSide);
+  m_cellW = std::max(1, (m_bounds.w + side - 1) / side);
+  m_cellH = std::max(1, (m_bounds.h + side - 1) / side);
+  m_cols = (m_bounds.w + m_cellW - 1) / m_cellW;
+  m_rows = (m_bounds.h + m_cellH - 1) / m_cellH;
+  m_cells.resize(m_cols*m_rows);
+
+  const int bigSlices = std::max(1, m_cols*m_rows/4);
+  for (int i=0; i<int(m_entries.size()); ++i) {
+    const gfx::Rect& bounds = m_entries[i].bounds;
+    const int u1 = col(bounds.x), u2 = col(bounds.x2()-1);
+    const int v1 = row(bounds.y), v2 = row(bounds.y2()-1);
+    if ((u2-u1+1)*(v2-v1+1) > bigSlices) {
+      m_big.push_back(i);
+      continue;
+    }
+
+    for (int v=v1; v<=v2; ++v)
+      for (int u=u1; u<=u2; ++u)
+        m_cells[v*m_cols+u].push_back(i);
+  }
+}
+
+void SlicesIndex::slices(const gfx::Rect& rc, std::vector<Slice*>& result) const
+{
+  result.clear();
+  if (!m_bounds.intersects(rc))
+    return;
+
+  std::vector<int> entries;
+  const int u1 = col(rc.x), u2 = col(rc.x2()-1);
+  const int v1 = row(rc.y), v2 = row(rc.y2()-1);
+  for (int v=v1; v<=v2; ++v)
+    for (int u=u1; u<=u2; ++u)
+      collect(m_cells[v*m_cols+u], rc, entries);
+  collect(m_big, rc, entries);
+
+  // Slices in several cells are added several times
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()),
+                entries.end());
+
+  result.reserve(entries.size());
+  for (const int i : entries)
+    result.push_back(m_entries[i].slice);
+}
+
+// Returns the grid column/row for the given coordinate (the last
+// pixel of a rectangle is x2()-1/y2()-1).
+int SlicesIndex::col(const int x) const
+{
+  return std::clamp((x - m_bounds.x) / m_cellW, 0, m_cols-1);
+}
+
+int SlicesIndex::row(const int y) const
+{
+  return std::clamp((y - m_bounds.y) / m_cellH, 0, m_rows-1);
+}
+
+void SlicesIndex::collect(const std::vector<int>& entries,
+                          const gfx::Rect& rc,
+                          std::vector<int>& result) const
+{
+  for (const int i : entries) {
+    if (m_entries[i].bounds.intersects(rc))
+      result.push_back(i);
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,70 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_SLICES_INDEX_H_INCLUDED
+#define DOC_SLICES_INDEX_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "gfx/rect.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+
+  class Slice;
+  class Slices;
+
+  // Uniform grid over the bounds of the slice keys of one frame to
+  // find the slices in a rectangle without testing all of them
+  // (e.g. to draw/pick slices in sprites with thousands of them).
+  //
+  // The index is a snapshot of the slice keys, it's valid while
+  // Slices::generation() doesn't change (see Slices::index()).
+  class SlicesIndex {
+  public:
+    SlicesIndex(const Slices& slices, const frame_t frame);
+
+    uint32_t generation() const { return m_generation; }
+    frame_t frame() const { return m_frame; }
+
+    // Returns the slices (in the same order of the Slices list) with
+    // a key in the frame that intersects the given rectangle.
+    void slices(const gfx::Rect& rc, std::vector<Slice*>& result) const;
+
+  private:
+    struct Entry {
+      gfx::Rect bounds;
+      Slice* slice;
+    };
+
+    int col(const int x) const;
+    int row(const int y) const;
+    void collect(const std::vector<int>& entries,
+                 const gfx::Rect& rc,
+                 std::vector<int>& result) const;
+
+    uint32_t m_generation;
+    frame_t m_frame;
+    gfx::Rect m_bounds;         // Union of all keys bounds
+    int m_cellW, m_cellH;
+    int m_cols, m_rows;
+    std::vector<Entry> m_entries;
+
+    // Entries in each grid cell (row by row)
+    std::vector<std::vector<int>> m_cells;
+
+    // Entries that cover too many cells are tested in all queries
+    std::vector<int> m_big;
+
+    DISABLE_COPYING(SlicesIndex);
+  };
+
+} // namespace doc
+
+#endif
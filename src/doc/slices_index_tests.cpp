@@ -0,0 +1,116 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/slices_index.h"
+
+#include "doc/slice.h"
+#include "doc/slices.h"
+#include "doc/sprite.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Adds "n" slices with keys in random positions of frames 0 and 1
+// (some slices don't have a key in frame 1).
+void add_slices(Sprite* spr, const int n)
+{
+  for (int i=0; i<n; ++i) {
+    auto slice = new Slice;
+    for (frame_t frame=0; frame<2; ++frame) {
+      if (frame == 1 && (i % 3) == 0)
+        continue;
+      const int w = 1 + std::rand() % (i % 50 == 0 ? 300: 32);
+      const int h = 1 + std::rand() % 32;
+      slice->insert(frame, SliceKey(gfx::Rect(std::rand() % 300 - 20,
+                                              std::rand() % 300 - 20,
+                                              w, h)));
+    }
+    spr->slices().add(slice);
+  }
+}
+
+std::vector<Slice*> brute_force(const Slices& slices,
+                                const frame_t frame,
+                                const gfx::Rect& rc)
+{
+  std::vector<Slice*> result;
+  for (Slice* slice : slices) {
+    const SliceKey* key = slice->getByFrame(frame);
+    if (key && key->bounds().intersects(rc))
+      result.push_back(slice);
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+TEST(SlicesIndex, MatchBruteForce)
+{
+  std::srand(1);
+  std::unique_ptr<Sprite> spr(new Sprite(ImageSpec(ColorMode::RGB, 256, 256), 256));
+  spr->setTotalFrames(2);
+  add_slices(spr.get(), 2000);
+
+  std::vector<Slice*> result;
+  for (frame_t frame=0; frame<2; ++frame) {
+    auto index = spr->slices().index(frame);
+    EXPECT_EQ(frame, index->frame());
+
+    for (int i=0; i<1000; ++i) {
+      const gfx::Rect rc(std::rand() % 340 - 40,
+                         std::rand() % 340 - 40,
+                         1 + std::rand() % (i % 10 == 0 ? 200: 16),
+                         1 + std::rand() % 16);
+      index->slices(rc, result);
+      EXPECT_EQ(brute_force(spr->slices(), frame, rc), result);
+    }
+  }
+}
+
+TEST(SlicesIndex, ModifiedKeys)
+{
+  std::srand(2);
+  std::unique_ptr<Sprite> spr(new Sprite(ImageSpec(ColorMode::RGB, 256, 256), 256));
+  add_slices(spr.get(), 64);
+
+  auto index = spr->slices().index(0);
+  EXPECT_EQ(index, spr->slices().index(0));
+
+  // Modifying a key re-creates the index
+  Slice* slice = spr->slices().getByName("Slice");
+  ASSERT_TRUE(slice != nullptr);
+  slice->insert(0, SliceKey(gfx::Rect(500, 500, 4, 4)));
+  auto index2 = spr->slices().index(0);
+  EXPECT_NE(index, index2);
+
+  std::vector<Slice*> result;
+  index2->slices(gfx::Rect(501, 501, 1, 1), result);
+  ASSERT_EQ(1, result.size());
+  EXPECT_EQ(slice, result[0]);
+
+  // Removing the slice too
+  spr->slices().remove(slice);
+  spr->slices().index(0)->slices(gfx::Rect(501, 501, 1, 1), result);
+  EXPECT_TRUE(result.empty());
+  delete slice;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -14,15 +14,18 @@
 #include "base/memory.h"
 #include "base/remove_from_container.h"
 #include "doc/cel.h"
+#include "doc/cels_index.h"
 #include "doc/cels_range.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/render_plan.h"
+#include "doc/rgbmap_kdtree.h"
 #include "doc/rgbmap_rgb5a3.h"
 #include "doc/tag.h"
 #include "doc/tile_primitives.h"
@@ -38,6 +41,10 @@ namespace doc {
 
 static gfx::Rect g_defaultGridBounds(0, 0, 16, 16);
 
+// Minimum number of render plan items to use a CelsIndex in
+// Sprite::pickCels()
+static const int kMinItemsToIndexCels = 32;
+
 // static
 gfx::Rect Sprite::DefaultGridBounds()
 {
@@ -68,6 +75,7 @@ Sprite::Sprite(const ImageSpec& spec,
   , m_frlens(1, 100)            // First frame with 100 msecs of duration
   , m_root(new LayerGroup(this))
   , m_gridBounds(Sprite::DefaultGridBounds())
+  , m_renderPlans(std::make_unique<RenderPlanCache>())
   , m_tags(this)
   , m_slices(this)
   , m_tilesets(nullptr)
@@ -329,6 +337,19 @@ bool Sprite::hasVisibleReferenceLayers() const
   return root()->hasVisibleReferenceLayers();
 }
 
+RenderPlanPtr Sprite::renderPlan(const Layer* layer,
+                                 const frame_t frame) const
+{
+  ASSERT(layer->sprite() == this);
+  return m_renderPlans->get(layer, frame);
+}
+
+void Sprite::invalidateRenderPlans() const
+{
+  if (m_renderPlans)
+    m_renderPlans->invalidate();
+}
+
 //////////////////////////////////////////////////////////////////////
 // Palettes
 
@@ -449,6 +470,7 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
       m_rgbMap->fitCriteria() != fitCriteria) {
     switch (mapAlgo) {
       case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
+      case RgbMapAlgorithm::KDTREE: m_rgbMap.reset(new RgbMapKdTree); break;
       case RgbMapAlgorithm::DEFAULT:
       case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
       default:
@@ -468,24 +490,29 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
 //////////////////////////////////////////////////////////////////////
 // Frames
 
-void Sprite::addFrame(frame_t newFrame)
+void Sprite::addFrames(frame_t newFrame, frame_t count)
 {
-  setTotalFrames(m_frames+1);
+  ASSERT(count > 0);
+  setTotalFrames(m_frames+count);
 
-  frame_t to = std::max(1, newFrame);
-  for (frame_t i=m_frames-1; i>=to; --i)
-    setFrameDuration(i, frameDuration(i-1));
+  // New frames have the duration of the previous frame
+  const int newDuration = frameDuration(std::max(0, newFrame-1));
+  for (frame_t i=m_frames-1; i>=newFrame+count; --i)
+    setFrameDuration(i, frameDuration(i-count));
+  for (frame_t i=newFrame; i<newFrame+count; ++i)
+    setFrameDuration(i, newDuration);
 
-  root()->displaceFrames(newFrame, +1);
+  root()->displaceFrames(newFrame, +count);
 }
 
-void Sprite::removeFrame(frame_t frame)
+void Sprite::removeFrames(frame_t frame, frame_t count)
 {
-  root()->displaceFrames(frame, -1);
+  ASSERT(count > 0);
+  root()->displaceFrames(frame, -count);
 
-  frame_t newTotal = m_frames-1;
+  frame_t newTotal = m_frames-count;
   for (frame_t i=frame; i<newTotal; ++i)
-    setFrameDuration(i, frameDuration(i+1));
+    setFrameDuration(i, frameDuration(i+count));
   setTotalFrames(newTotal);
 }
 
@@ -643,6 +670,19 @@ void Sprite::getTilemapsByTileset(const Tileset* tileset,
   }
 }
 
+void Sprite::getIndexHistogram(Image::IndexHistogram& histogram) const
+{
+  histogram.fill(0);
+
+  std::vector<ImageRef> images;
+  getImages(images);
+  for (const ImageRef& image : images) {
+    const Image::IndexHistogram& h = image->indexHistogram();
+    for (int i=0; i<int(h.size()); ++i)
+      histogram[i] += h[i];
+  }
+}
+
 void Sprite::remapImages(const Remap& remap)
 {
   ASSERT(pixelFormat() == IMAGE_INDEXED);
@@ -657,12 +697,39 @@ void Sprite::remapImages(const Remap& remap)
 void Sprite::remapTilemaps(const Tileset* tileset,
                            const Remap& remap)
 {
+  std::vector<Image*> tilemaps;
   for (Cel* cel : uniqueCels()) {
     if (cel->layer()->isTilemap() &&
         static_cast<LayerTilemap*>(cel->layer())->tileset() == tileset) {
-      remap_image(cel->image(), remap);
+      tilemaps.push_back(cel->image());
     }
   }
+
+  // Each unique cel has its own image, so tilemaps can be remapped
+  // in parallel.
+  parallel_for(
+    0, int(tilemaps.size()), 1,
+    [&tilemaps, &remap](const int begin, const int end){
+      for (int i=begin; i<end; ++i) {
+        Image* tilemap = tilemaps[i];
+
+        // Skip tilemaps that don't use any remapped tile (the
+        // histogram is cached, so it's calculated only for tilemaps
+        // modified since the last time).
+        const Image::TileHistogram& histogram = tilemap->tileHistogram();
+        if (std::none_of(histogram.begin(), histogram.end(),
+                         [&remap](const auto& entry){
+                           const int to = remap[int(entry.first)];
+                           return (to == Remap::kNoTile ||
+                                   (to != Remap::kUnused &&
+                                    to != int(entry.first)));
+                         }))
+          continue;
+
+        if (remap_image(tilemap, remap))
+          tilemap->incrementVersion();
+      }
+    });
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -673,11 +740,24 @@ void Sprite::pickCels(const gfx::PointF& pos,
                       const RenderPlan& plan,
                       CelList& cels) const
 {
+  const auto& planItems = plan.items();
+
+  // Items with a cel in the given position. With few items it's
+  // faster to test all of them than to create the index.
+  std::vector<int> candidates;
+  if (int(planItems.size()) >= kMinItemsToIndexCels) {
+    plan.celsIndex()->cels(pos, candidates);
+  }
+  else {
+    candidates.resize(planItems.size());
+    for (int i=0; i<int(planItems.size()); ++i)
+      candidates[i] = i;
+  }
+
   // Iterate cels in reversed order (from the front-most to the
   // bottom-most) so we pick first visible cel in the given position.
-  const auto& planItems = plan.items();
-  for (auto it=planItems.rbegin(), end=planItems.rend(); it!=end; ++it) {
-    const Cel* cel = it->cel;
+  for (auto it=candidates.rbegin(), end=candidates.rend(); it!=end; ++it) {
+    const Cel* cel = planItems[*it].cel;
     if (!cel)
       continue;
 
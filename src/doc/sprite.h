@@ -47,6 +47,7 @@ namespace doc {
   class Palette;
   class Remap;
   class RenderPlan;
+  class RenderPlanCache;
   class RgbMap;
   class RgbMapRGB5A3;
   class SelectedFrames;
@@ -149,6 +150,16 @@ namespace doc {
     layer_t allLayersCount() const;
     bool hasVisibleReferenceLayers() const;
 
+    // Returns a cached plan to render the given layer in the given
+    // frame (see RenderPlanCache). The layer must be from this sprite.
+    std::shared_ptr<const RenderPlan> renderPlan(const Layer* layer,
+                                                 const frame_t frame) const;
+
+    // Must be called each time the layer tree changes in a way that
+    // can modify the render plans (the Layer/Cel member functions
+    // that modify the tree call it automatically).
+    void invalidateRenderPlans() const;
+
     ////////////////////////////////////////
     // Palettes
 
@@ -177,10 +188,16 @@ namespace doc {
     frame_t totalFrames() const { return m_frames; }
     frame_t lastFrame() const { return m_frames-1; }
 
-    void addFrame(frame_t newFrame);
-    void removeFrame(frame_t frame);
+    void addFrame(frame_t newFrame) { addFrames(newFrame, 1); }
+    void removeFrame(frame_t frame) { removeFrames(frame, 1); }
     void setTotalFrames(frame_t frames);
 
+    // Adds/removes "count" frames from the given frame displacing the
+    // cels of the next frames only once. The cels in the removed
+    // frames must be removed before calling removeFrames().
+    void addFrames(frame_t newFrame, frame_t count);
+    void removeFrames(frame_t frame, frame_t count);
+
     int frameDuration(frame_t frame) const;
     int totalAnimationDuration() const;
     void setFrameDuration(frame_t frame, int msecs);
@@ -212,7 +229,18 @@ namespace doc {
     void getTilemapsByTileset(const Tileset* tileset,
                               std::vector<ImageRef>& images) const;
 
+    // Returns the number of pixels of all sprite images (cel + tiles)
+    // that use each index. Images of linked cels are counted once.
+    // The histogram of each image is cached (see
+    // Image::indexHistogram()), so only modified images are scanned.
+    void getIndexHistogram(Image::IndexHistogram& histogram) const;
+
     void remapImages(const Remap& remap);
+
+    // Remaps the tiles of all tilemaps that use the given tileset
+    // (tilemaps are processed in parallel). Only the version of the
+    // modified tilemaps is incremented, tilemaps that don't use any
+    // remapped tile are not touched.
     void remapTilemaps(const Tileset* tileset,
                        const Remap& remap);
     void pickCels(const gfx::PointF& pos,
@@ -267,6 +295,9 @@ namespace doc {
     // Current rgb map
     mutable std::unique_ptr<RgbMap> m_rgbMap;
 
+    // Cached render plans
+    std::unique_ptr<RenderPlanCache> m_renderPlans;
+
     Tags m_tags;
     Slices m_slices;
 
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2022 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,8 +14,14 @@
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/pixel_format.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
 #include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
 
 #include <memory>
 
@@ -193,6 +199,121 @@ TEST(Sprite, CelsRange)
   EXPECT_EQ(3, i);
 }
 
+TEST(Sprite, AddAndRemoveFrames)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Sprite* spr = sprPtr.get();
+  spr->setTotalFrames(4);
+  for (frame_t fr=0; fr<4; ++fr)
+    spr->setFrameDuration(fr, 10*(fr+1));
+
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerGroup* grp1 = new LayerGroup(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(lay1);
+  spr->root()->addLayer(grp1);
+  grp1->addLayer(lay2);
+
+  Cel* cels[4];
+  for (frame_t fr=0; fr<4; ++fr) {
+    cels[fr] = new Cel(fr, ImageRef(Image::create(IMAGE_RGB, 32, 32)));
+    lay1->addCel(cels[fr]);
+  }
+  Cel* celA = new Cel(frame_t(3), ImageRef(Image::create(IMAGE_RGB, 32, 32)));
+  lay2->addCel(celA);
+
+  // Insert 3 frames before frame 1
+  spr->addFrames(1, 3);
+  EXPECT_EQ(7, spr->totalFrames());
+  EXPECT_EQ(0, cels[0]->frame());
+  EXPECT_EQ(4, cels[1]->frame());
+  EXPECT_EQ(5, cels[2]->frame());
+  EXPECT_EQ(6, cels[3]->frame());
+  EXPECT_EQ(6, celA->frame());
+  EXPECT_EQ(cels[1], lay1->cel(4));
+  EXPECT_EQ(nullptr, lay1->cel(1));
+  EXPECT_EQ(celA, lay2->cel(6));
+  // New frames have the duration of the previous one
+  EXPECT_EQ(10, spr->frameDuration(0));
+  EXPECT_EQ(10, spr->frameDuration(1));
+  EXPECT_EQ(10, spr->frameDuration(3));
+  EXPECT_EQ(20, spr->frameDuration(4));
+  EXPECT_EQ(40, spr->frameDuration(6));
+
+  // Remove the cels of frames 4 and 5, and then the frames
+  lay1->removeCel(cels[1]);
+  lay1->removeCel(cels[2]);
+  delete cels[1];
+  delete cels[2];
+  spr->removeFrames(4, 2);
+  EXPECT_EQ(5, spr->totalFrames());
+  EXPECT_EQ(0, cels[0]->frame());
+  EXPECT_EQ(4, cels[3]->frame());
+  EXPECT_EQ(4, celA->frame());
+  EXPECT_EQ(cels[3], lay1->cel(4));
+  EXPECT_EQ(2, lay1->getCelsCount());
+  EXPECT_EQ(40, spr->frameDuration(4));
+
+  // Remove the empty frames 1-3
+  spr->removeFrames(1, 3);
+  EXPECT_EQ(2, spr->totalFrames());
+  EXPECT_EQ(cels[0], lay1->cel(0));
+  EXPECT_EQ(cels[3], lay1->cel(1));
+  EXPECT_EQ(celA, lay2->cel(1));
+  EXPECT_EQ(10, spr->frameDuration(0));
+  EXPECT_EQ(40, spr->frameDuration(1));
+}
+
+TEST(Sprite, RemapTilemaps)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Sprite* spr = sprPtr.get();
+  spr->setTotalFrames(3);
+
+  Tileset* tileset = new Tileset(spr, Grid(gfx::Size(4, 4)), 4);
+  const tileset_index tsi = spr->tilesets()->add(tileset);
+  LayerTilemap* lay = new LayerTilemap(spr, tsi);
+  spr->root()->addLayer(lay);
+
+  // Tilemap A uses tiles 1 and 2, tilemap B uses just the tile 3
+  ImageRef imgA(Image::create(IMAGE_TILEMAP, 2, 2));
+  ImageRef imgB(Image::create(IMAGE_TILEMAP, 2, 2));
+  clear_image(imgA.get(), notile);
+  clear_image(imgB.get(), tile(3, 0));
+  put_pixel(imgA.get(), 0, 0, tile(1, tile_f_xflip));
+  put_pixel(imgA.get(), 1, 1, tile(2, 0));
+  lay->addCel(new Cel(frame_t(0), imgA));
+  lay->addCel(new Cel(frame_t(1), imgB));
+
+  // Swap tiles 1 and 2
+  Remap remap(4);
+  remap.map(0, 0);
+  remap.map(1, 2);
+  remap.map(2, 1);
+  remap.map(3, 3);
+
+  const ObjectVersion verA = imgA->version();
+  const ObjectVersion verB = imgB->version();
+  spr->remapTilemaps(tileset, remap);
+
+  EXPECT_EQ(tile(2, tile_f_xflip), get_pixel(imgA.get(), 0, 0));
+  EXPECT_EQ(tile(1, 0), get_pixel(imgA.get(), 1, 1));
+  EXPECT_EQ(notile, get_pixel(imgA.get(), 1, 0));
+  EXPECT_NE(verA, imgA->version());
+
+  // Tilemap B wasn't modified
+  EXPECT_EQ(tile(3, 0), get_pixel(imgB.get(), 0, 0));
+  EXPECT_EQ(verB, imgB->version());
+  EXPECT_TRUE(imgB->hasTileHistogram());
+
+  spr->remapTilemaps(tileset, remap.invert());
+  EXPECT_EQ(tile(1, tile_f_xflip), get_pixel(imgA.get(), 0, 0));
+  EXPECT_EQ(tile(2, 0), get_pixel(imgA.get(), 1, 1));
+  EXPECT_EQ(verB, imgB->version());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
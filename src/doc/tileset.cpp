@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -44,11 +44,8 @@ Tileset::Tileset(Sprite* sprite,
   //      clipboard
   //ASSERT(sprite);
 
-  for (tile_index ti=0; ti<ntiles; ++ti) {
-    ImageRef tile = makeEmptyTile();
-    m_tiles[ti].image = tile;
-    hashImage(ti, tile);
-  }
+  for (tile_index ti=0; ti<ntiles; ++ti)
+    m_tiles[ti].image = makeEmptyTile();
 }
 
 // static
@@ -127,6 +124,9 @@ void Tileset::resize(const tile_index ntiles)
   m_tiles.resize(ntiles);
   for (tile_index ti=oldSize; ti<ntiles; ++ti)
     m_tiles[ti].image = makeEmptyTile();
+
+  // Re-generate the hash table the next time it's needed
+  m_hash.clear();
 }
 
 void Tileset::remap(const Remap& remap)
@@ -172,13 +172,11 @@ void Tileset::set(const tile_index ti,
   }
 #endif
 
-  removeFromHash(ti, false);
-
   preprocess_transparent_pixels(image.get());
   m_tiles[ti].image = image;
 
   if (!m_hash.empty())
-    hashImage(ti, image);
+    m_hash.set(ti, image);
 }
 
 tile_index Tileset::add(const ImageRef& image,
@@ -193,7 +191,7 @@ tile_index Tileset::add(const ImageRef& image,
 
   const tile_index newIndex = tile_index(m_tiles.size()-1);
   if (!m_hash.empty())
-    hashImage(newIndex, image);
+    m_hash.add(image);
   return newIndex;
 }
 
@@ -215,25 +213,19 @@ void Tileset::insert(const tile_index ti,
   preprocess_transparent_pixels(image.get());
   m_tiles.insert(m_tiles.begin()+ti, Tile(image, userData));
 
-  if (!m_hash.empty()) {
-    // Fix all indexes in the hash that are greater than "ti"
-    for (auto& it : m_hash)
-      if (it.second >= ti)
-        ++it.second;
-
-    // And now we can add the new image with the "ti" index
-    hashImage(ti, image);
-  }
+  if (!m_hash.empty())
+    m_hash.insert(ti, image);
 }
 
 void Tileset::erase(const tile_index ti)
 {
   ASSERT(ti >= 0 && ti < size());
-  // TODO check why this doesn't work
-  //removeFromHash(ti, true);
 
   m_tiles.erase(m_tiles.begin()+ti);
-  rehash();
+  if (!m_hash.empty())
+    m_hash.erase(ti);
+
+  discardCompressedData();
 }
 
 ImageRef Tileset::makeEmptyTile()
@@ -252,68 +244,38 @@ void Tileset::setExternal(const std::string& filename,
 
 bool Tileset::findTileIndex(const ImageRef& tileImage,
                             tile_index& ti)
+{
+  tile_flags flags;
+  return findTileIndex(tileImage, 0, ti, flags);
+}
+
+bool Tileset::findTileIndex(const ImageRef& tileImage,
+                            const tile_flags matchFlags,
+                            tile_index& ti,
+                            tile_flags& flags)
 {
   ASSERT(tileImage);
-  if (!tileImage) {
-    ti = notile;
+  ti = notile;
+  flags = 0;
+  if (!tileImage)
     return false;
-  }
-
-  auto& h = hashTable(); // Don't use m_hash directly in case that
-                         // we've to regenerate the hash table.
 
-  auto it = h.find(tileImage);
-  if (it != h.end()) {
-    ti = it->second;
-    return true;
-  }
-  else {
-    ti = notile;
-    return false;
-  }
+  // Don't use m_hash directly in case that we've to regenerate the
+  // hash table.
+  return hashTable().find(tileImage.get(), matchFlags, ti, flags);
 }
 
 void Tileset::notifyTileContentChange(const tile_index ti)
 {
-#if 0 // TODO Try to do less work
-
-  ASSERT(ti >= 0 && ti < size());
-
-  // If two or more tiles are exactly the same, they will have the
-  // same hash, so the m_hash table can be smaller than the m_tiles
-  // array.
-  if (m_hash.size() < m_tiles.size()) {
-    // Count how many hash elements are poiting to this tile index
-    int tilesWithSameHash = 0;
-    for (auto item : m_hash)
-      if (item.second == ti)
-        ++tilesWithSameHash;
-
-    // In this case we re-generate the whole hash table because one or
-    // more tiles tile are using the hash of the modified tile.
-    if (tilesWithSameHash >= 2) {
-      rehash();
-      return;
-    }
-  }
-
-  // In other case we can do a fast-path, just removing and
-  // re-adding the tile to the hash table.
-  removeFromHash(ti, false);
-  if (!m_hash.empty())
-    hashImage(ti, m_tiles[ti]);
-
-#else // Regenerate the whole hash map (at the moment this is the
-      // only way to make it work correctly)
-
-  (void)ti;                     // unused
-
-  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image)
+  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image) {
     preprocess_transparent_pixels(m_tiles[ti].image.get());
 
-  rehash();
+    // Re-calculate the hashes of this specific tile
+    if (!m_hash.empty())
+      m_hash.set(ti, m_tiles[ti].image);
+  }
 
-#endif
+  discardCompressedData();
 }
 
 void Tileset::notifyRegenerateEmptyTile()
@@ -327,20 +289,14 @@ void Tileset::notifyRegenerateEmptyTile()
   rehash();
 }
 
-void Tileset::removeFromHash(const tile_index ti,
-                             const bool adjustIndexes)
+void Tileset::setMatchFlags(const tile_flags tf)
 {
-  auto end = m_hash.end();
-  for (auto it=m_hash.begin(); it!=end; ) {
-    if (it->second == ti) {
-      it = m_hash.erase(it);
-      end = m_hash.end();
-    }
-    else {
-      if (adjustIndexes && it->second > ti)
-        --it->second;
-      ++it;
-    }
+  if (m_matchFlags != tf) {
+    m_matchFlags = tf;
+
+    // The flipped versions of each tile are hashed depending on the
+    // match flags
+    m_hash.clear();
   }
 }
 
@@ -352,41 +308,24 @@ void Tileset::assertValidHashTable()
   if (m_hash.empty())
     return;
 
-  // If two or more tiles are exactly the same, they will have the
-  // same hash, so the m_hash table can be smaller than the m_tiles
-  // array.
-  if (m_hash.size() < m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-
-      // If the hash doesn't match, it is because other tile is equal
-      // to this one.
-      if (it->second != ti) {
-        ASSERT(is_same_image(it->first.get(), m_tiles[it->second].image.get()));
-      }
-    }
-  }
-  else if (m_hash.size() == m_tiles.size()) {
-    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
-      ASSERT(it != m_hash.end());
-      ASSERT(it->second == ti);
-    }
-  }
-  else {
-    ASSERT(false && "The hash table cannot contain more tiles than the tileset");
+  ASSERT(m_hash.size() == m_tiles.size());
+  ASSERT(m_hash.matchFlags() == m_matchFlags);
+
+  // If two or more tiles are exactly the same, the hash table will
+  // return the first one.
+  for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
+    tile_index found;
+    tile_flags flags;
+    const bool result = m_hash.find(m_tiles[ti].image.get(), 0, found, flags);
+    ASSERT(result);
+    ASSERT(found <= ti);
+    ASSERT(found == ti ||
+           is_same_image(m_tiles[found].image.get(), m_tiles[ti].image.get()));
+    (void)result;
   }
 }
 #endif
 
-void Tileset::hashImage(const tile_index ti,
-                        const ImageRef& tileImage)
-{
-  if (m_hash.find(tileImage) == m_hash.end())
-    m_hash[tileImage] = ti;
-}
-
 void Tileset::rehash()
 {
   // Clear the hash table, we'll lazy-rehash it when
@@ -402,9 +341,9 @@ TilesetHashTable& Tileset::hashTable()
 {
   if (m_hash.empty()) {
     // Re-hash/create the whole hash table from scratch
-    tile_index ti = 0;
+    m_hash.clear(m_matchFlags);
     for (auto& tile : m_tiles)
-      hashImage(ti++, tile.image);
+      m_hash.add(tile.image);
   }
   return m_hash;
 }
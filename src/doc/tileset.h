@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -16,6 +16,7 @@
 #include "doc/tileset_hash_table.h"
 #include "doc/with_user_data.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -62,7 +63,7 @@ namespace doc {
     // Allow to match tiles with the given flags/flips automatically
     // in Auto/Stack modes.
     tile_flags matchFlags() const { return m_matchFlags; }
-    void setMatchFlags(const tile_flags tf) { m_matchFlags = tf; }
+    void setMatchFlags(const tile_flags tf);
 
     // Cached compressed tileset read/writen directly from .aseprite
     // files.
@@ -71,6 +72,19 @@ namespace doc {
     const base::buffer& compressedData() const { return m_compressedData; }
     ObjectVersion compressedDataVersion() const { return m_compressedDataVersion; }
 
+    // Cached compressed data of groups of consecutive tiles written
+    // by the .aseprite encoder, so only groups with modified tiles
+    // are re-compressed when the tileset is saved again. The "key"
+    // is calculated by the encoder from the tiles of each group (this
+    // cache is not discarded when the tileset is modified).
+    struct CompressedTiles {
+      uint64_t key = 0;
+      base::buffer data;
+    };
+    std::vector<CompressedTiles>& compressedTilesCache() const {
+      return m_compressedTiles;
+    }
+
     int getMemSize() const override;
 
     iterator begin() { return m_tiles.begin(); }
@@ -127,6 +141,15 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Same as findTileIndex() but it can match a flipped version of
+    // a tile with the given "matchFlags" (generally matchFlags()),
+    // returning the flips that must be applied to "tileImage" to get
+    // the tile "ti" in "flags".
+    bool findTileIndex(const ImageRef& tileImage,
+                       const tile_flags matchFlags,
+                       tile_index& ti,
+                       tile_flags& flags);
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
@@ -143,10 +166,6 @@ namespace doc {
 #endif
 
   private:
-    void removeFromHash(const tile_index ti,
-                        const bool adjustIndexes);
-    void hashImage(const tile_index ti,
-                   const ImageRef& tileImage);
     void rehash();
     TilesetHashTable& hashTable();
 
@@ -173,6 +192,7 @@ namespace doc {
     // contains several layers with tilesets).
     mutable base::buffer m_compressedData;
     mutable doc::ObjectVersion m_compressedDataVersion;
+    mutable std::vector<CompressedTiles> m_compressedTiles;
   };
 
 } // namespace doc
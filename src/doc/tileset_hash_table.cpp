@@ -0,0 +1,214 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/tileset_hash_table.h"
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace doc {
+
+namespace {
+
+// All combinations of flips in the order they are tested to match a
+// tile (the same order that was used when each flipped image was
+// searched in the tileset).
+const tile_flags kFlips[] = {
+  0,
+  tile_f_xflip,
+  tile_f_yflip,
+  tile_f_xflip | tile_f_yflip,
+  tile_f_dflip,
+  tile_f_xflip | tile_f_dflip,
+  tile_f_xflip | tile_f_yflip | tile_f_dflip,
+  tile_f_yflip | tile_f_dflip,
+};
+const int kNumFlips = int(sizeof(kFlips) / sizeof(kFlips[0]));
+
+bool can_flip(const Image* image, const tile_flags flags)
+{
+  // Diagonal flips are only possible in square images
+  return ((flags & tile_f_dflip) == 0 ||
+          image->width() == image->height());
+}
+
+// Returns a copy of the image flipped with the given flags. The
+// inverse flip applies the diagonal flip first, so:
+//
+//   flipped_copy(flipped_copy(image, flags, false), flags, true) == image
+//
+Image* flipped_copy(const Image* image,
+                    const tile_flags flags,
+                    const bool inverse)
+{
+  ASSERT(can_flip(image, flags));
+
+  Image* copy = Image::createCopy(image);
+  const gfx::Rect bounds = copy->bounds();
+  if (inverse && (flags & tile_f_dflip))
+    algorithm::flip_image(copy, bounds, algorithm::FlipDiagonal);
+  if (flags & tile_f_xflip)
+    algorithm::flip_image(copy, bounds, algorithm::FlipHorizontal);
+  if (flags & tile_f_yflip)
+    algorithm::flip_image(copy, bounds, algorithm::FlipVertical);
+  if (!inverse && (flags & tile_f_dflip))
+    algorithm::flip_image(copy, bounds, algorithm::FlipDiagonal);
+  return copy;
+}
+
+} // anonymous namespace
+
+TilesetHashTable::TilesetHashTable()
+{
+  clear();
+}
+
+void TilesetHashTable::clear(const tile_flags matchFlags)
+{
+  m_entries.clear();
+  m_tiles.clear();
+  m_matchFlags = (matchFlags & tile_f_mask);
+
+  m_flips.clear();
+  for (int i=0; i<kNumFlips; ++i) {
+    if ((kFlips[i] & ~m_matchFlags) == 0)
+      m_flips.push_back(i);
+  }
+}
+
+void TilesetHashTable::add(const ImageRef& image)
+{
+  m_tiles.push_back(Tile{ image, {} });
+  hashTile(tile_index(m_tiles.size()-1));
+}
+
+void TilesetHashTable::insert(const tile_index ti, const ImageRef& image)
+{
+  ASSERT(ti >= 0 && ti <= size());
+  shiftIndexes(ti, +1);
+  m_tiles.insert(m_tiles.begin()+ti, Tile{ image, {} });
+  hashTile(ti);
+}
+
+void TilesetHashTable::set(const tile_index ti, const ImageRef& image)
+{
+  ASSERT(ti >= 0 && ti < size());
+  removeTileEntries(ti);
+  m_tiles[ti].image = image;
+  hashTile(ti);
+}
+
+void TilesetHashTable::erase(const tile_index ti)
+{
+  ASSERT(ti >= 0 && ti < size());
+  removeTileEntries(ti);
+  m_tiles.erase(m_tiles.begin()+ti);
+  shiftIndexes(ti, -1);
+}
+
+bool TilesetHashTable::find(const Image* image,
+                            const tile_flags flags,
+                            tile_index& ti,
+                            tile_flags& foundFlags) const
+{
+  ASSERT(image);
+
+  // Candidates with the same hash sorted by flip order and tile index
+  std::vector<Entry> candidates;
+  auto range = m_entries.equal_range(image->contentHash());
+  for (auto it=range.first; it!=range.second; ++it) {
+    if ((kFlips[it->second.flip] & ~flags) == 0)
+      candidates.push_back(it->second);
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Entry& a, const Entry& b){
+              return (a.flip < b.flip ||
+                      (a.flip == b.flip && a.ti < b.ti));
+            });
+
+  // Flipped copies of the image (created only if we have a candidate
+  // that needs it)
+  std::unique_ptr<Image> flipped[kNumFlips];
+
+  for (const Entry& entry : candidates) {
+    const Image* tileImage = m_tiles[entry.ti].image.get();
+    if (tileImage->bounds() != image->bounds())
+      continue;
+
+    const Image* a = image;
+    if (entry.flip != 0) {
+      std::unique_ptr<Image>& copy = flipped[entry.flip];
+      if (!copy)
+        copy.reset(flipped_copy(image, kFlips[entry.flip], false));
+      a = copy.get();
+    }
+
+    if (is_same_image(a, tileImage)) {
+      ti = entry.ti;
+      foundFlags = kFlips[entry.flip];
+      return true;
+    }
+  }
+  return false;
+}
+
+void TilesetHashTable::hashTile(const tile_index ti)
+{
+  Tile& tile = m_tiles[ti];
+  tile.hashes.clear();
+  if (!tile.image)
+    return;
+
+  for (const int flip : m_flips) {
+    uint32_t hash;
+    if (flip == 0) {
+      hash = tile.image->contentHash();
+    }
+    else if (can_flip(tile.image.get(), kFlips[flip])) {
+      // The hash of the image that matches this tile when it's
+      // flipped with kFlips[flip]
+      const std::unique_ptr<Image> copy(
+        flipped_copy(tile.image.get(), kFlips[flip], true));
+      hash = copy->contentHash();
+    }
+    else
+      continue;
+
+    tile.hashes.push_back(hash);
+    m_entries.insert(std::make_pair(hash, Entry{ ti, flip }));
+  }
+}
+
+void TilesetHashTable::removeTileEntries(const tile_index ti)
+{
+  for (const uint32_t hash : m_tiles[ti].hashes) {
+    auto range = m_entries.equal_range(hash);
+    for (auto it=range.first; it!=range.second; ) {
+      if (it->second.ti == ti)
+        it = m_entries.erase(it);
+      else
+        ++it;
+    }
+  }
+  m_tiles[ti].hashes.clear();
+}
+
+void TilesetHashTable::shiftIndexes(const tile_index ti, const int delta)
+{
+  for (auto& it : m_entries) {
+    if (it.second.ti >= ti)
+      it.second.ti += delta;
+  }
+}
+
+} // namespace doc
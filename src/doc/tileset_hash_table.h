@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,15 +14,71 @@
 #include "doc/primitives.h"
 #include "doc/tile.h"
 
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 namespace doc {
 
-  // A hash table used to match Image pixels data <-> tileset index
-  typedef std::unordered_map<ImageRef,
-                             tile_index,
-                             details::image_hash,
-                             details::image_eq> TilesetHashTable;
+  // A hash table used to match Image pixels data <-> tileset index.
+  //
+  // It contains the hash of each tile and the hashes of its flipped
+  // versions (for the flips allowed in matchFlags()), so we can find
+  // an image that matches a flipped tile calculating the hash of the
+  // image only once (instead of flipping the image and searching it
+  // for each combination of flips).
+  class TilesetHashTable {
+  public:
+    TilesetHashTable();
+
+    // An empty table means that it must be re-generated with add()
+    // for each tile.
+    bool empty() const { return m_tiles.empty(); }
+    tile_index size() const { return tile_index(m_tiles.size()); }
+
+    // Removes all tiles and sets the flips that will be hashed for
+    // the next added tiles.
+    void clear(const tile_flags matchFlags = 0);
+    tile_flags matchFlags() const { return m_matchFlags; }
+
+    // Functions to keep the table synchronized with the tileset.
+    void add(const ImageRef& image);
+    void insert(const tile_index ti, const ImageRef& image);
+    void set(const tile_index ti, const ImageRef& image);
+    void erase(const tile_index ti);
+
+    // Finds a tile which is equal to "image" when it's flipped with
+    // some combination of "flags" (flips that are not in
+    // matchFlags() are ignored). The combinations are tested in the
+    // order: no flip, X, Y, X+Y, D, X+D, X+Y+D, Y+D. The "foundFlags"
+    // are the flips that must be applied to "image" to get the tile
+    // "ti".
+    bool find(const Image* image,
+              const tile_flags flags,
+              tile_index& ti,
+              tile_flags& foundFlags) const;
+
+  private:
+    struct Entry {
+      tile_index ti;
+      int flip;                 // Index in the kFlips array
+    };
+
+    struct Tile {
+      ImageRef image;
+      // Hash of each flipped version of the image (in m_flips order)
+      std::vector<uint32_t> hashes;
+    };
+
+    void hashTile(const tile_index ti);
+    void removeTileEntries(const tile_index ti);
+    void shiftIndexes(const tile_index ti, const int delta);
+
+    std::unordered_multimap<uint32_t, Entry> m_entries;
+    std::vector<Tile> m_tiles;
+    std::vector<int> m_flips;   // Flips hashed for each tile (indexes of kFlips)
+    tile_flags m_matchFlags;
+  };
 
 } // namespace doc
 
@@ -0,0 +1,151 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/document.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+#include <cstdlib>
+#include <memory>
+
+using namespace doc;
+
+namespace {
+
+ImageRef random_tile(Tileset* tileset)
+{
+  ImageRef image = tileset->makeEmptyTile();
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image.get(), x, y, (std::rand() % 3) ? rgba(0, 0, 0, 0):
+                                                       rgba(255, 0, 0, 255));
+  return image;
+}
+
+ImageRef flipped(const ImageRef& image, const tile_flags flags)
+{
+  ImageRef copy(Image::createCopy(image.get()));
+  if (flags & tile_f_xflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipHorizontal);
+  if (flags & tile_f_yflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipVertical);
+  if (flags & tile_f_dflip)
+    algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipDiagonal);
+  return copy;
+}
+
+} // anonymous namespace
+
+TEST(Tileset, FindFlippedTiles)
+{
+  std::srand(1);
+  auto doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 32, 32));
+  doc->sprites().add(spr);
+
+  auto tileset = std::make_unique<Tileset>(spr, Grid(gfx::Size(4, 4)), 1);
+  for (int i=0; i<50; ++i)
+    tileset->add(random_tile(tileset.get()));
+
+  const tile_flags allFlags = (tile_f_xflip | tile_f_yflip | tile_f_dflip);
+  tileset->setMatchFlags(allFlags);
+
+  for (tile_index ti=1; ti<tileset->size(); ++ti) {
+    for (const tile_flags flags : { tile_flags(0),
+                                    tile_f_xflip,
+                                    tile_f_yflip | tile_f_dflip,
+                                    allFlags }) {
+      // Image that is equal to "ti" after applying "flags"
+      ImageRef image = tileset->get(ti);
+      if (flags & tile_f_dflip)
+        image = flipped(image, tile_f_dflip);
+      image = flipped(image, flags & ~tile_f_dflip);
+
+      tile_index found;
+      tile_flags foundFlags;
+      ASSERT_TRUE(tileset->findTileIndex(image, tileset->matchFlags(),
+                                         found, foundFlags));
+      EXPECT_TRUE(is_same_image(flipped(image, foundFlags).get(),
+                                tileset->get(found).get()));
+      if (flags == 0) {
+        EXPECT_EQ(ti, found);
+        EXPECT_EQ(0, foundFlags);
+      }
+
+      // Without match flags only an exact tile is found
+      bool exact = false;
+      for (tile_index tj=0; tj<tileset->size(); ++tj)
+        exact |= is_same_image(image.get(), tileset->get(tj).get());
+      EXPECT_EQ(exact, tileset->findTileIndex(image, found));
+    }
+  }
+}
+
+TEST(Tileset, UpdateHashTable)
+{
+  std::srand(2);
+  auto doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 32, 32));
+  doc->sprites().add(spr);
+
+  auto tileset = std::make_unique<Tileset>(spr, Grid(gfx::Size(4, 4)), 1);
+  tileset->setMatchFlags(tile_f_xflip);
+  ImageRef a = random_tile(tileset.get());
+  ImageRef b = random_tile(tileset.get());
+  ImageRef c = random_tile(tileset.get());
+  tileset->add(a);
+  tileset->add(b);
+
+  tile_index ti;
+  tile_flags flags;
+  EXPECT_TRUE(tileset->findTileIndex(b, ti));
+  EXPECT_EQ(2, ti);
+
+  // Insert/erase tiles after generating the hash table
+  tileset->insert(1, c);
+  EXPECT_TRUE(tileset->findTileIndex(b, ti));
+  EXPECT_EQ(3, ti);
+  EXPECT_TRUE(tileset->findTileIndex(flipped(c, tile_f_xflip), tile_f_xflip, ti, flags));
+  EXPECT_EQ(1, ti);
+  EXPECT_EQ(tile_f_xflip, flags);
+
+  tileset->erase(2);
+  EXPECT_FALSE(tileset->findTileIndex(a, ti));
+  EXPECT_TRUE(tileset->findTileIndex(b, ti));
+  EXPECT_EQ(2, ti);
+
+  // Modify a tile
+  ImageRef oldB(Image::createCopy(b.get()));
+  ImageRef d = random_tile(tileset.get());
+  tileset->get(2)->copy(d.get(), gfx::Clip(d->bounds()));
+  tileset->notifyTileContentChange(2);
+  EXPECT_FALSE(tileset->findTileIndex(oldB, ti));
+  EXPECT_TRUE(tileset->findTileIndex(d, ti));
+  EXPECT_EQ(2, ti);
+
+  tileset->set(1, oldB);
+  EXPECT_TRUE(tileset->findTileIndex(oldB, ti));
+  EXPECT_EQ(1, ti);
+  EXPECT_FALSE(tileset->findTileIndex(c, ti));
+
+#ifdef _DEBUG
+  tileset->assertValidHashTable();
+#endif
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
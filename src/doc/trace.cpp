@@ -0,0 +1,191 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/trace.h"
+
+#include "base/fstream_path.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace doc {
+
+namespace detail {
+  std::atomic<bool> g_traceEnabled = false;
+}
+
+namespace {
+
+struct Zone {
+  const char* name;
+  int64_t begin;                // In nanoseconds
+  int64_t duration;
+};
+
+// Ring buffer with the last zones of one thread. The mutex is used
+// only by its thread and when zones are written/cleared, so it's
+// almost never contended.
+struct ThreadBuffer {
+  std::mutex mutex;
+  std::vector<Zone> zones;
+  std::size_t capacity;
+  std::size_t next = 0;         // Next zone to replace when it's full
+  int tid;
+
+  ThreadBuffer(const std::size_t capacity, const int tid)
+    : capacity(capacity), tid(tid) { }
+
+  void add(const Zone& zone) {
+    if (capacity == 0)
+      return;
+    if (zones.size() < capacity)
+      zones.push_back(zone);
+    else {
+      zones[next] = zone;
+      next = (next+1) % capacity;
+    }
+  }
+
+  void clear(const std::size_t newCapacity) {
+    zones.clear();
+    zones.shrink_to_fit();
+    capacity = newCapacity;
+    next = 0;
+  }
+};
+
+using ThreadBufferPtr = std::shared_ptr<ThreadBuffer>;
+
+// Buffers of all threads that recorded zones (they are kept when the
+// thread finishes, so we can write its zones later).
+std::mutex g_buffersMutex;
+std::vector<ThreadBufferPtr> g_buffers;
+std::size_t g_capacity = kTraceEventsPerThread;
+std::atomic<int64_t> g_startTime = 0;
+
+thread_local ThreadBufferPtr t_buffer;
+
+ThreadBuffer* get_thread_buffer()
+{
+  if (!t_buffer) {
+    const std::lock_guard lock(g_buffersMutex);
+    t_buffer = std::make_shared<ThreadBuffer>(g_capacity, int(g_buffers.size()));
+    g_buffers.push_back(t_buffer);
+  }
+  return t_buffer.get();
+}
+
+void write_json_string(std::ostream& os, const char* s)
+{
+  static const char* hex = "0123456789abcdef";
+  os << '"';
+  for (; *s; ++s) {
+    const unsigned char chr = *s;
+    if (chr == '"' || chr == '\\')
+      os << '\\' << chr;
+    else if (chr < 32)
+      os << "\\u00" << hex[chr >> 4] << hex[chr & 15];
+    else
+      os << chr;
+  }
+  os << '"';
+}
+
+} // anonymous namespace
+
+namespace detail {
+
+int64_t trace_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_add_zone(const char* name, const int64_t begin)
+{
+  const int64_t end = trace_now();
+  ThreadBuffer* buffer = get_thread_buffer();
+  const std::lock_guard lock(buffer->mutex);
+  buffer->add(Zone{ name, begin, end - begin });
+}
+
+} // namespace detail
+
+void trace_start(const std::size_t eventsPerThread)
+{
+  {
+    const std::lock_guard lock(g_buffersMutex);
+    g_capacity = eventsPerThread;
+    for (auto& buffer : g_buffers) {
+      const std::lock_guard bufferLock(buffer->mutex);
+      buffer->clear(eventsPerThread);
+    }
+  }
+  g_startTime = detail::trace_now();
+  detail::g_traceEnabled = true;
+}
+
+void trace_stop()
+{
+  detail::g_traceEnabled = false;
+}
+
+std::size_t trace_write_chrome_json(std::ostream& os)
+{
+  const int64_t startTime = g_startTime;
+  std::size_t count = 0;
+
+  // Timestamps in microseconds (with nanoseconds as decimals)
+  const auto oldFlags = os.flags();
+  const auto oldPrecision = os.precision();
+  os << std::fixed << std::setprecision(3);
+
+  os << "{\"traceEvents\":[";
+
+  const std::lock_guard lock(g_buffersMutex);
+  for (auto& buffer : g_buffers) {
+    const std::lock_guard bufferLock(buffer->mutex);
+    const std::size_t n = buffer->zones.size();
+    for (std::size_t i=0; i<n; ++i) {
+      // Write the zones from the oldest one
+      const Zone& zone = buffer->zones[(buffer->next + i) % n];
+      if (count++ > 0)
+        os << ',';
+      os << "\n{\"name\":";
+      write_json_string(os, zone.name);
+      os << ",\"ph\":\"X\""
+         << ",\"ts\":" << double(zone.begin - startTime) / 1000.0
+         << ",\"dur\":" << double(zone.duration) / 1000.0
+         << ",\"pid\":0,\"tid\":" << buffer->tid << '}';
+    }
+  }
+
+  os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+  os.flags(oldFlags);
+  os.precision(oldPrecision);
+  return count;
+}
+
+bool trace_save_chrome_json(const std::string& filename)
+{
+  std::ofstream f(FSTREAM_PATH(filename));
+  if (!f)
+    return false;
+  trace_write_chrome_json(f);
+  return bool(f);
+}
+
+} // namespace doc
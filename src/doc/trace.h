@@ -0,0 +1,73 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TRACE_H_INCLUDED
+#define DOC_TRACE_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace doc {
+
+  // Default number of zones kept for each thread while tracing (the
+  // oldest zones are replaced when the buffer of a thread is full).
+  const std::size_t kTraceEventsPerThread = 64*1024;
+
+  // Starts recording zones (removing the previous recorded
+  // zones). Each thread keeps its last "eventsPerThread" zones.
+  void trace_start(const std::size_t eventsPerThread = kTraceEventsPerThread);
+  void trace_stop();
+
+  // Writes all recorded zones (from all threads) in the Chrome trace
+  // event format (JSON), which can be opened from chrome://tracing
+  // or https://ui.perfetto.dev. Returns the number of written zones.
+  std::size_t trace_write_chrome_json(std::ostream& os);
+  bool trace_save_chrome_json(const std::string& filename);
+
+  namespace detail {
+    extern std::atomic<bool> g_traceEnabled;
+    int64_t trace_now();
+    void trace_add_zone(const char* name, const int64_t begin);
+  }
+
+  inline bool trace_is_enabled() {
+    return detail::g_traceEnabled.load(std::memory_order_relaxed);
+  }
+
+  // Records the time from its construction to its destruction (when
+  // tracing is enabled). The name must be a static string, it's
+  // saved as a pointer.
+  class TraceZone {
+  public:
+    explicit TraceZone(const char* name) {
+      if (trace_is_enabled()) {
+        m_name = name;
+        m_begin = detail::trace_now();
+      }
+    }
+    ~TraceZone() {
+      if (m_name)
+        detail::trace_add_zone(m_name, m_begin);
+    }
+  private:
+    const char* m_name = nullptr;
+    int64_t m_begin = 0;
+  };
+
+} // namespace doc
+
+#define DOC_TRACE_ZONE_CONCAT2(a, b) a##b
+#define DOC_TRACE_ZONE_CONCAT(a, b) DOC_TRACE_ZONE_CONCAT2(a, b)
+
+// Records the rest of the current scope as a zone with the given name.
+#define DOC_TRACE_ZONE(name)                                    \
+  doc::TraceZone DOC_TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,92 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/parallel.h"
+#include "doc/trace.h"
+
+#include <sstream>
+
+using namespace doc;
+
+static std::string trace_json(std::size_t* count = nullptr)
+{
+  std::ostringstream os;
+  const std::size_t n = trace_write_chrome_json(os);
+  if (count)
+    *count = n;
+  return os.str();
+}
+
+TEST(Trace, DisabledByDefault)
+{
+  EXPECT_FALSE(trace_is_enabled());
+  {
+    DOC_TRACE_ZONE("ignored");
+  }
+  std::size_t count;
+  EXPECT_EQ(std::string::npos, trace_json(&count).find("ignored"));
+  EXPECT_EQ(0, count);
+}
+
+TEST(Trace, ZonesFromThreads)
+{
+  trace_start();
+  {
+    DOC_TRACE_ZONE("main \"zone\"");
+    parallel_for(0, 8, 1, [](int, int){
+      DOC_TRACE_ZONE("chunk");
+    });
+  }
+  trace_stop();
+  {
+    DOC_TRACE_ZONE("after stop");
+  }
+
+  std::size_t count;
+  const std::string json = trace_json(&count);
+  EXPECT_EQ(9, count);
+  EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"main \\\"zone\\\"\""));
+  EXPECT_NE(std::string::npos, json.find("\"chunk\""));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"X\""));
+  EXPECT_EQ(std::string::npos, json.find("after stop"));
+
+  // Starting again removes the old zones
+  trace_start();
+  trace_stop();
+  trace_json(&count);
+  EXPECT_EQ(0, count);
+}
+
+TEST(Trace, RingBuffer)
+{
+  trace_start(4);
+  const char* names[] = { "a", "b", "c", "d", "e", "f" };
+  for (const char* name : names) {
+    DOC_TRACE_ZONE(name);
+  }
+  trace_stop();
+
+  std::size_t count;
+  const std::string json = trace_json(&count);
+  EXPECT_EQ(4, count);
+  EXPECT_EQ(std::string::npos, json.find("\"a\""));
+  EXPECT_EQ(std::string::npos, json.find("\"b\""));
+  // The oldest zones are written first
+  EXPECT_LT(json.find("\"c\""), json.find("\"f\""));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "doc/string_io.h"
 #include "doc/user_data.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace doc {
@@ -34,6 +35,22 @@ static void write_size(std::ostream& os, const gfx::Size& size)
   write32(os, size.h);
 }
 
+static void write_property_value(std::ostream& os, const UserData::Variant& variant);
+
+static void write_properties(std::ostream& os, const UserData::Properties& properties)
+{
+  write32(os, properties.size());
+  for (const auto& property : properties) {
+    const std::string& name = property.first;
+    write_string(os, name);
+
+    const UserData::Variant& value = property.second;
+    write16(os, value.type());
+
+    write_property_value(os, value);
+  }
+}
+
 static void write_property_value(std::ostream& os, const UserData::Variant& variant)
 {
   switch (variant.type())
@@ -90,30 +107,32 @@ static void write_property_value(std::ostream& os, const UserData::Variant& vari
       break;
     }
     case USER_DATA_PROPERTY_TYPE_VECTOR: {
-        const std::vector<UserData::Variant>& vector = get_value<std::vector<UserData::Variant>>(variant);
-        write32(os, vector.size());
-        for (auto elem : vector) {
-          write16(os, elem.type());
-          write_property_value(os, elem);
-        }
-      break;
-    }
-    case USER_DATA_PROPERTY_TYPE_PROPERTIES: {
-      auto properties = get_value<UserData::Properties>(variant);
-      write32(os, properties.size());
-      for (auto property : properties) {
-        const std::string& name = property.first;
-        write_string(os, name);
+      const UserData::Vector& vector = get_value<UserData::Vector>(variant);
+      write32(os, vector.size());
 
-        const UserData::Variant& value = property.second;
-        write16(os, value.type());
+      // Vectors where all elements have the same type (e.g. a list of
+      // numbers) store the type only once (SerialFormat::Ver3).
+      uint16_t elemsType = (vector.empty() ? 0: vector.front().type());
+      for (const auto& elem : vector) {
+        if (elem.type() != elemsType) {
+          elemsType = 0;
+          break;
+        }
+      }
+      write16(os, elemsType);
 
-        write_property_value(os, value);
+      for (const auto& elem : vector) {
+        if (elemsType == 0)
+          write16(os, elem.type());
+        write_property_value(os, elem);
       }
       break;
     }
+    case USER_DATA_PROPERTY_TYPE_PROPERTIES:
+      write_properties(os, get_value<UserData::Properties>(variant));
+      break;
     case USER_DATA_PROPERTY_TYPE_UUID: {
-      auto uuid = get_value<base::Uuid>(variant);
+      const base::Uuid& uuid = get_value<base::Uuid>(variant);
       for (int i=0; i<16; ++i) {
         write8(os, uuid[i]);
       }
@@ -125,11 +144,11 @@ static void write_property_value(std::ostream& os, const UserData::Variant& vari
 static void write_properties_maps(std::ostream& os, const UserData::PropertiesMaps& propertiesMaps)
 {
   write32(os, propertiesMaps.size());
-  for (auto propertiesMap : propertiesMaps) {
+  for (const auto& propertiesMap : propertiesMaps) {
     const UserData::Properties& properties = propertiesMap.second;
     const std::string& extensionKey = propertiesMap.first;
     write_string(os, extensionKey);
-    write_property_value(os, properties);
+    write_properties(os, properties);
   }
 }
 
@@ -140,123 +159,137 @@ void write_user_data(std::ostream& os, const UserData& userData)
   write_properties_maps(os, userData.propertiesMaps());
 }
 
-static UserData::Variant read_property_value(std::istream& is, uint16_t type)
+static void read_property_value(std::istream& is, uint16_t type,
+                                SerialFormat serial,
+                                UserData::Variant& value);
+
+// Reads the properties in the given (already allocated) map, each
+// value is read in-place in its final map entry.
+static void read_properties(std::istream& is,
+                            SerialFormat serial,
+                            UserData::Properties& properties)
+{
+  auto numProps = read32(is);
+  for (int j=0; j<numProps && is; ++j) {
+    auto name = read_string(is);
+    auto type = read16(is);
+    read_property_value(is, type, serial, properties[name]);
+  }
+}
+
+static void read_property_value(std::istream& is, uint16_t type,
+                                SerialFormat serial,
+                                UserData::Variant& value)
 {
   switch (type) {
-    case USER_DATA_PROPERTY_TYPE_NULLPTR: {
-      return nullptr;
-    }
-    case USER_DATA_PROPERTY_TYPE_BOOL: {
-      bool value = read8(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT8: {
-      int8_t value = read8(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT8: {
-      uint8_t value = read8(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT16: {
-      int16_t value = read16(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT16: {
-      uint16_t value = read16(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT32: {
-      int32_t value = read32(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT32: {
-      uint32_t value = read32(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_INT64: {
-      int64_t value = read64(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_UINT64: {
-      uint64_t value = read64(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_FIXED: {
-      int32_t value = read32(is);
-      return doc::UserData::Fixed{value};
-    }
-    case USER_DATA_PROPERTY_TYPE_FLOAT: {
-      float value = read_float(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_DOUBLE: {
-      double value = read_double(is);
-      return value;
-    }
-    case USER_DATA_PROPERTY_TYPE_STRING: {
-      std::string value = read_string(is);
-      return value;
-    }
+    case USER_DATA_PROPERTY_TYPE_NULLPTR:
+      value = nullptr;
+      break;
+    case USER_DATA_PROPERTY_TYPE_BOOL:
+      value = bool(read8(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT8:
+      value = int8_t(read8(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT8:
+      value = uint8_t(read8(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT16:
+      value = int16_t(read16(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT16:
+      value = uint16_t(read16(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT32:
+      value = int32_t(read32(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT32:
+      value = uint32_t(read32(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_INT64:
+      value = int64_t(read64(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_UINT64:
+      value = uint64_t(read64(is));
+      break;
+    case USER_DATA_PROPERTY_TYPE_FIXED:
+      value = doc::UserData::Fixed{ int32_t(read32(is)) };
+      break;
+    case USER_DATA_PROPERTY_TYPE_FLOAT:
+      value = read_float(is);
+      break;
+    case USER_DATA_PROPERTY_TYPE_DOUBLE:
+      value = read_double(is);
+      break;
+    case USER_DATA_PROPERTY_TYPE_STRING:
+      value = read_string(is);
+      break;
     case USER_DATA_PROPERTY_TYPE_POINT: {
       int32_t x = read32(is);
       int32_t y = read32(is);
-      return gfx::Point(x, y);
+      value = gfx::Point(x, y);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_SIZE: {
       int32_t w = read32(is);
       int32_t h = read32(is);
-      return gfx::Size(w, h);
+      value = gfx::Size(w, h);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_RECT: {
       int32_t x = read32(is);
       int32_t y = read32(is);
       int32_t w = read32(is);
       int32_t h = read32(is);
-      return gfx::Rect(x, y, w, h);
+      value = gfx::Rect(x, y, w, h);
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_VECTOR: {
       auto numElems = read32(is);
-      std::vector<doc::UserData::Variant> value;
-      for (int k=0; k<numElems;++k) {
-        auto elemType = read16(is);
-        value.push_back(read_property_value(is, elemType));
+      uint16_t elemsType = 0;
+      if (serial >= SerialFormat::Ver3)
+        elemsType = read16(is);
+
+      value = UserData::Vector();
+      auto& vector = get_value<UserData::Vector>(value);
+      // Limit the pre-allocated elements in case that the data is
+      // corrupted
+      vector.reserve(std::min<uint32_t>(numElems, 0x10000));
+
+      for (int k=0; k<numElems && is; ++k) {
+        auto elemType = (elemsType ? elemsType: read16(is));
+        read_property_value(is, elemType, serial, vector.emplace_back());
       }
-      return value;
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_PROPERTIES: {
-      auto numProps = read32(is);
-      doc::UserData::Properties value;
-      for (int j=0; j<numProps;++j) {
-        auto name = read_string(is);
-        auto type = read16(is);
-        value[name] = read_property_value(is, type);
-      }
-      return value;
+      value = UserData::Properties();
+      read_properties(is, serial, get_value<UserData::Properties>(value));
+      break;
     }
     case USER_DATA_PROPERTY_TYPE_UUID: {
-      base::Uuid value;
-      uint8_t* bytes = value.bytes();
+      value = base::Uuid();
+      uint8_t* bytes = get_value<base::Uuid>(value).bytes();
       for (int i=0; i<16; ++i) {
         bytes[i] = read8(is);
       }
-      return value;
+      break;
     }
+    default:
+      value = UserData::Variant{};
+      break;
   }
-
-  return doc::UserData::Variant{};
 }
 
-static UserData::PropertiesMaps read_properties_maps(std::istream& is)
+static void read_properties_maps(std::istream& is,
+                                 SerialFormat serial,
+                                 UserData::PropertiesMaps& propertiesMaps)
 {
-  doc::UserData::PropertiesMaps propertiesMaps;
   size_t nmaps = read32(is);
-  for (int i=0; i<nmaps; ++i) {
+  for (int i=0; i<nmaps && is; ++i) {
     std::string extensionId = read_string(is);
-    auto properties = read_property_value(is, USER_DATA_PROPERTY_TYPE_PROPERTIES);
-    propertiesMaps[extensionId] = doc::get_value<doc::UserData::Properties>(properties);
+    read_properties(is, serial, propertiesMaps[extensionId]);
   }
-  return propertiesMaps;
 }
 
 UserData read_user_data(std::istream& is,
@@ -275,7 +308,7 @@ UserData read_user_data(std::istream& is,
     // to skip reading the parts that it doesn't contains. Otherwise
     // it is very likely to fail.
     if (serial >= SerialFormat::Ver2) {
-      userData.propertiesMaps() = read_properties_maps(is);
+      read_properties_maps(is, serial, userData.propertiesMaps());
     }
   }
   return userData;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,9 @@
 #include <gtest/gtest.h>
 
 #include "doc/user_data.h"
+#include "doc/user_data_io.h"
+
+#include <sstream>
 
 using namespace doc;
 using Variant = UserData::Variant;
@@ -180,6 +183,46 @@ TEST(ExtensionProperties, SimpleProperties)
   EXPECT_TRUE(data.properties("someExtensionId").size() == 0);
 }
 
+TEST(CustomProperties, WriteAndReadProperties)
+{
+  UserData data;
+  data.setText("text");
+  data.properties()["numbers"] = Vector{ int32_t(1), int32_t(-2), int32_t(3) };
+  data.properties()["mixed"] = Vector{ int32_t(1), std::string("two"), gfx::Point(3, 4) };
+  data.properties()["empty"] = Vector{};
+  data.properties()["nested"] = Vector{ Vector{ 1.0f, 2.0f }, Vector{ true } };
+  data.properties("ext")["object"] = Properties{ { "id", uint16_t(400) },
+                                                 { "rect", gfx::Rect(1, 2, 3, 4) } };
+
+  std::stringstream s;
+  write_user_data(s, data);
+  UserData data2 = read_user_data(s);
+
+  EXPECT_EQ("text", data2.text());
+  EXPECT_EQ(2, data2.propertiesMaps().size());
+
+  auto& numbers = get_value<Vector>(data2.properties()["numbers"]);
+  ASSERT_EQ(3, numbers.size());
+  EXPECT_EQ(-2, get_value<int32_t>(numbers[1]));
+
+  auto& mixed = get_value<Vector>(data2.properties()["mixed"]);
+  ASSERT_EQ(3, mixed.size());
+  EXPECT_EQ(1, get_value<int32_t>(mixed[0]));
+  EXPECT_EQ("two", get_value<std::string>(mixed[1]));
+  EXPECT_EQ(gfx::Point(3, 4), get_value<gfx::Point>(mixed[2]));
+
+  EXPECT_TRUE(get_value<Vector>(data2.properties()["empty"]).empty());
+
+  auto& nested = get_value<Vector>(data2.properties()["nested"]);
+  ASSERT_EQ(2, nested.size());
+  EXPECT_EQ(2.0f, get_value<float>(get_value<Vector>(nested[0])[1]));
+  EXPECT_TRUE(get_value<bool>(get_value<Vector>(nested[1])[0]));
+
+  auto& object = get_value<Properties>(data2.properties("ext")["object"]);
+  EXPECT_EQ(400, get_value<uint16_t>(object["id"]));
+  EXPECT_EQ(gfx::Rect(1, 2, 3, 4), get_value<gfx::Rect>(object["rect"]));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
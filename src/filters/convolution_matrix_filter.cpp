@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +19,12 @@
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
 namespace filters {
 
 using namespace doc;
@@ -107,14 +113,96 @@ namespace {
     }
   };
 
+  int wrap_or_clamp(int i, const int size, const bool tiled)
+  {
+    if (tiled) {
+      i %= size;
+      return (i < 0 ? i+size: i);
+    }
+    else
+      return std::clamp(i, 0, size-1);
+  }
+
+  // Returns true if the matrix can be expressed as the product of a
+  // column vector "v" and a row vector "h" (i.e. matrix(x, y) ==
+  // v[y]*h[x]) using integers, so the convolution can be done with
+  // two 1D passes and the same results.
+  bool separate_matrix(const ConvolutionMatrix& matrix,
+                       std::vector<int>& h,
+                       std::vector<int>& v)
+  {
+    const int w = matrix.getWidth();
+    const int hgt = matrix.getHeight();
+
+    // Use the first non-zero row as the horizontal kernel
+    int y0 = 0;
+    for (; y0<hgt; ++y0) {
+      int x = 0;
+      for (; x<w && !matrix.value(x, y0); ++x)
+        ;
+      if (x < w)
+        break;
+    }
+    if (y0 == hgt)
+      return false;
+
+    int g = 0;
+    for (int x=0; x<w; ++x)
+      g = std::gcd(g, std::abs(matrix.value(x, y0)));
+
+    h.resize(w);
+    int x0 = -1;
+    for (int x=0; x<w; ++x) {
+      h[x] = matrix.value(x, y0) / g;
+      if (x0 < 0 && h[x])
+        x0 = x;
+    }
+
+    v.resize(hgt);
+    for (int y=0; y<hgt; ++y) {
+      if (matrix.value(x0, y) % h[x0] != 0)
+        return false;
+      v[y] = matrix.value(x0, y) / h[x0];
+      for (int x=0; x<w; ++x)
+        if (matrix.value(x, y) != v[y]*h[x])
+          return false;
+    }
+    return true;
+  }
+
 }
 
+struct ConvolutionMatrixFilter::Separable {
+  const ConvolutionMatrix* matrix = nullptr;
+  bool valid = false;
+  std::vector<int> hKernel;
+  std::vector<int> vKernel;
+  int kernelSum = 0;
+
+  // Each row of the ring buffer contains the horizontal pass of one
+  // source row for each channel plus the sum of the weights of
+  // opaque pixels, i.e. "nplanes" planes of "width" elements.
+  const Image* image = nullptr;
+  int x = 0;
+  int width = 0;
+  int nplanes = 0;
+  std::vector<int> keys;        // Unwrapped Y of each row of the ring buffer
+  std::vector<int> rows;        // Ring buffer of horizontal sums
+  std::vector<int> cols;        // Source X of each pixel of the extended row
+  std::vector<int> line;        // Unpacked pixels of the extended row
+  std::vector<int> sums;        // Result of the vertical pass
+};
+
 ConvolutionMatrixFilter::ConvolutionMatrixFilter()
   : m_matrix(NULL)
   , m_tiledMode(TiledMode::NONE)
 {
 }
 
+ConvolutionMatrixFilter::~ConvolutionMatrixFilter()
+{
+}
+
 void ConvolutionMatrixFilter::setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
@@ -130,6 +218,124 @@ const char* ConvolutionMatrixFilter::getName()
   return "Convolution Matrix";
 }
 
+// Returns the data to apply the matrix in two passes, or nullptr if
+// the matrix isn't separable. The cached rows are discarded in the
+// first row of each image.
+ConvolutionMatrixFilter::Separable*
+ConvolutionMatrixFilter::getSeparable(FilterManager* filterMgr,
+                                      const int nplanes)
+{
+  if (!m_separable)
+    m_separable = std::make_unique<Separable>();
+
+  Separable* sep = m_separable.get();
+  if (filterMgr->isFirstRow() || sep->matrix != m_matrix.get()) {
+    sep->matrix = m_matrix.get();
+    sep->valid = separate_matrix(*m_matrix, sep->hKernel, sep->vKernel);
+    sep->kernelSum = 0;
+    for (int y=0; y<m_matrix->getHeight(); ++y)
+      for (int x=0; x<m_matrix->getWidth(); ++x)
+        sep->kernelSum += m_matrix->value(x, y);
+    sep->image = nullptr;
+  }
+  if (!sep->valid)
+    return nullptr;
+
+  const Image* src = filterMgr->getSourceImage();
+  if (sep->image != src ||
+      sep->x != filterMgr->x() ||
+      sep->width != filterMgr->getWidth() ||
+      sep->nplanes != nplanes) {
+    const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+    const int mw = m_matrix->getWidth();
+    const int mh = m_matrix->getHeight();
+
+    sep->image = src;
+    sep->x = filterMgr->x();
+    sep->width = filterMgr->getWidth();
+    sep->nplanes = nplanes;
+    sep->keys.assign(mh, INT_MIN);
+    sep->rows.resize(mh * nplanes * sep->width);
+    sep->cols.resize(sep->width + mw - 1);
+    for (int i=0; i<int(sep->cols.size()); ++i)
+      sep->cols[i] = wrap_or_clamp(sep->x - m_matrix->getCenterX() + i,
+                                   src->width(), tiledX);
+    sep->line.resize(nplanes * sep->cols.size());
+    sep->sums.resize(nplanes * sep->width);
+  }
+  return sep;
+}
+
+// Calculates the matrix sums for the current row using the
+// horizontal sums of the source rows that are in the ring buffer.
+// Returns "nplanes" planes of "width" sums: one for each channel of
+// opaque pixels, and one with the sum of the weights of the opaque
+// pixels (transparent pixels are ignored as in the 2D version).
+//
+// "unpack" gets the channels of a pixel and returns false if it's
+// transparent.
+template<typename Traits, typename Unpack>
+const int* ConvolutionMatrixFilter::applySeparable(FilterManager* filterMgr,
+                                                   Separable* sep,
+                                                   Unpack unpack)
+{
+  const Image* src = filterMgr->getSourceImage();
+  const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+  const int mw = m_matrix->getWidth();
+  const int mh = m_matrix->getHeight();
+  const int w = sep->width;
+  const int n = int(sep->cols.size());
+  const int nplanes = sep->nplanes;
+  const int nchannels = nplanes-1;
+
+  std::fill(sep->sums.begin(), sep->sums.end(), 0);
+
+  for (int dy=0; dy<mh; ++dy) {
+    const int vk = sep->vKernel[dy];
+    if (!vk)
+      continue;
+
+    const int key = filterMgr->y() - m_matrix->getCenterY() + dy;
+    const int slot = ((key % mh) + mh) % mh;
+    int* row = &sep->rows[slot * nplanes * w];
+
+    // Horizontal pass of this source row
+    if (sep->keys[slot] != key) {
+      const int gety = wrap_or_clamp(key, src->height(), tiledY);
+      auto srcRow = (typename Traits::const_address_t)src->getPixelAddress(0, gety);
+      int values[4];
+
+      for (int i=0; i<n; ++i) {
+        const bool opaque = unpack(srcRow[sep->cols[i]], values);
+        for (int c=0; c<nchannels; ++c)
+          sep->line[c*n + i] = (opaque ? values[c]: 0);
+        sep->line[nchannels*n + i] = (opaque ? 1: 0);
+      }
+
+      for (int p=0; p<nplanes; ++p) {
+        int* out = row + p*w;
+        std::fill(out, out+w, 0);
+        for (int dx=0; dx<mw; ++dx) {
+          const int hk = sep->hKernel[dx];
+          if (!hk)
+            continue;
+          const int* in = &sep->line[p*n + dx];
+          for (int i=0; i<w; ++i)
+            out[i] += hk * in[i];
+        }
+      }
+      sep->keys[slot] = key;
+    }
+
+    // Vertical pass
+    int* sums = sep->sums.data();
+    for (int i=0; i<nplanes*w; ++i)
+      sums[i] += vk * row[i];
+  }
+
+  return sep->sums.data();
+}
+
 void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
 {
   if (!m_matrix)
@@ -139,14 +345,39 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
   uint32_t color;
   GetPixelsDelegateRgba delegate;
 
+  const int* sums = nullptr;
+  Separable* sep = getSeparable(filterMgr, 5);
+  if (sep) {
+    sums = applySeparable<RgbTraits>(
+      filterMgr, sep,
+      [](const color_t c, int* values) {
+        values[0] = rgba_getr(c);
+        values[1] = rgba_getg(c);
+        values[2] = rgba_getb(c);
+        values[3] = rgba_geta(c);
+        return (values[3] != 0);
+      });
+  }
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
+    if (sums) {
+      const int w = sep->width;
+      const int i = x - sep->x;
+      delegate.div = m_matrix->getDiv() - sep->kernelSum + sums[4*w + i];
+      delegate.r = sums[i];
+      delegate.g = sums[w + i];
+      delegate.b = sums[2*w + i];
+      delegate.a = sums[3*w + i];
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<RgbTraits>(src, x, y,
+                                        m_matrix->getWidth(),
+                                        m_matrix->getHeight(),
+                                        m_matrix->getCenterX(),
+                                        m_matrix->getCenterY(),
+                                        m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<RgbTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -196,14 +427,35 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
   uint16_t color;
   GetPixelsDelegateGrayscale delegate;
 
+  const int* sums = nullptr;
+  Separable* sep = getSeparable(filterMgr, 3);
+  if (sep) {
+    sums = applySeparable<GrayscaleTraits>(
+      filterMgr, sep,
+      [](const color_t c, int* values) {
+        values[0] = graya_getv(c);
+        values[1] = graya_geta(c);
+        return (values[1] != 0);
+      });
+  }
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
+    if (sums) {
+      const int w = sep->width;
+      const int i = x - sep->x;
+      delegate.div = m_matrix->getDiv() - sep->kernelSum + sums[2*w + i];
+      delegate.v = sums[i];
+      delegate.a = sums[w + i];
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<GrayscaleTraits>(src, x, y,
+                                              m_matrix->getWidth(),
+                                              m_matrix->getHeight(),
+                                              m_matrix->getCenterX(),
+                                              m_matrix->getCenterY(),
+                                              m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@ namespace filters {
   class ConvolutionMatrixFilter : public Filter {
   public:
     ConvolutionMatrixFilter();
+    ~ConvolutionMatrixFilter();
 
     void setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix);
     void setTiledMode(TiledMode tiledMode);
@@ -35,8 +36,19 @@ namespace filters {
     void applyToIndexed(FilterManager* filterMgr);
 
   private:
+    // Data to apply separable matrices (e.g. box or gaussian blurs)
+    // in two 1D passes.
+    struct Separable;
+
+    Separable* getSeparable(FilterManager* filterMgr, const int nplanes);
+    template<typename Traits, typename Unpack>
+    const int* applySeparable(FilterManager* filterMgr,
+                              Separable* sep,
+                              Unpack unpack);
+
     std::shared_ptr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
+    std::unique_ptr<Separable> m_separable;
   };
 
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -57,4 +57,12 @@ void FilterWithPalette::applyToPalette(FilterManager* filterMgr)
   onApplyToPalette(filterMgr, picks);
 }
 
+// Filters with palette in indexed images only modify pixels when
+// there is a selection (see applyToPalette()).
+bool FilterWithPalette::modifiesOnlyPalette(const FilterManager* filterMgr) const
+{
+  return (filterMgr->pixelFormat() == doc::IMAGE_INDEXED &&
+          !filterMgr->isMaskActive());
+}
+
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -44,6 +44,17 @@ namespace filters {
 
     // Applies the filter to the color palette.
     virtual void applyToPalette(FilterManager* filterMgr) { }
+
+    // Returns true if applyToRgba()/applyToGrayscale() can be called
+    // for different rows at the same time from several threads (i.e.
+    // the filter doesn't modify its own state when it's applied).
+    virtual bool isThreadSafe() const { return false; }
+
+    // Returns true if applying the filter with the given
+    // FilterManager only modifies the palette (i.e. the pixels of the
+    // images will not change), so the filter doesn't need to be
+    // applied to each cel.
+    virtual bool modifiesOnlyPalette(const FilterManager* filterMgr) const { return false; }
   };
 
   // Filter that support applying it only to palette colors.
@@ -51,6 +62,7 @@ namespace filters {
   public:
     FilterWithPalette();
     void applyToPalette(FilterManager* filterMgr) override;
+    bool modifiesOnlyPalette(const FilterManager* filterMgr) const override;
 
   protected:
     virtual void onApplyToPalette(FilterManager* filterMgr,
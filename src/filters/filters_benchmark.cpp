@@ -0,0 +1,336 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/task.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+#include "filters/median_filter.h"
+#include "filters/outline_filter.h"
+#include "filters/replace_color_filter.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+// Minimal FilterManager to apply a filter to a whole image row by
+// row. It does the same per-row/per-pixel work as the
+// FilterManagerImpl of the app (source/destination addresses,
+// skipPixel() with an optional mask), without the document/undo
+// parts.
+class BenchFilterManager : public FilterManager
+                         , public FilterIndexedData {
+public:
+  BenchFilterManager(const PixelFormat pf, const int w, const int h,
+                     const bool withMask)
+    : m_src(Image::create(pf, w, h))
+    , m_dst(Image::create(pf, w, h))
+    , m_palette(0, 256)
+    , m_row(0) {
+    doc::algorithm::random_image(m_src.get());
+    for (int i=0; i<256; ++i)
+      m_palette.setEntry(i, rgba(i, 255-i, (i*7) & 255, 255));
+    m_rgbmap.regenerateMap(&m_palette, 0);
+
+    // Ellipse selection in the center of the image
+    if (withMask) {
+      m_mask = std::make_unique<Mask>();
+      m_mask->replace(gfx::Rect(0, 0, w, h));
+      clear_image(m_mask->bitmap(), 0);
+      fill_ellipse(m_mask->bitmap(), 0, 0, w-1, h-1, 0, 0, 1);
+    }
+
+    m_target = (pf == IMAGE_INDEXED ? TARGET_INDEX_CHANNEL:
+                                      TARGET_ALL_CHANNELS);
+  }
+
+  void apply(Filter* filter) {
+    for (m_row=0; m_row<m_src->height(); ++m_row) {
+      if (m_mask)
+        m_maskAddress = (const uint8_t*)m_mask->bitmap()->getPixelAddress(0, m_row);
+      m_maskBit = 0;
+
+      if (m_row == 0)
+        filter->applyToPalette(this);
+
+      switch (m_src->pixelFormat()) {
+        case IMAGE_RGB:       filter->applyToRgba(this); break;
+        case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+        case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+      }
+    }
+  }
+
+  // FilterManager implementation
+  PixelFormat pixelFormat() const override { return m_src->pixelFormat(); }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_row); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override {
+    if (!m_mask)
+      return false;
+    const bool skip = !(*m_maskAddress & (1 << m_maskBit));
+    if (++m_maskBit == 8) {
+      m_maskBit = 0;
+      ++m_maskAddress;
+    }
+    return skip;
+  }
+  const Image* getSourceImage() override { return m_src.get(); }
+  int x() const override { return 0; }
+  int y() const override { return m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_mask != nullptr; }
+  base::task_token& taskToken() const override { return m_token; }
+
+  // FilterIndexedData implementation
+  const Palette* getPalette() const override { return &m_palette; }
+  const RgbMap* getRgbMap() const override { return &m_rgbmap; }
+  Palette* getNewPalette() override { return &m_palette; }
+  PalettePicks getPalettePicks() override { return PalettePicks(); }
+
+private:
+  ImageRef m_src;
+  ImageRef m_dst;
+  Palette m_palette;
+  RgbMapRGB5A3 m_rgbmap;
+  std::unique_ptr<Mask> m_mask;
+  const uint8_t* m_maskAddress = nullptr;
+  int m_maskBit = 0;
+  Target m_target;
+  int m_row;
+  mutable base::task_token m_token;
+};
+
+// Filter that just copies the pixels, to measure the overhead of the
+// FilterManager interface.
+class CopyFilter : public Filter {
+public:
+  const char* getName() override { return "Copy"; }
+  void applyToRgba(FilterManager* filterMgr) override { copy<uint32_t>(filterMgr); }
+  void applyToGrayscale(FilterManager* filterMgr) override { copy<uint16_t>(filterMgr); }
+  void applyToIndexed(FilterManager* filterMgr) override { copy<uint8_t>(filterMgr); }
+
+private:
+  template<typename T>
+  void copy(FilterManager* filterMgr) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(T) {
+      *dst_address = *src_address;
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+};
+
+std::shared_ptr<ConvolutionMatrix> make_blur_matrix(const int size)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(size, size);
+  int div = 0;
+  for (int y=0; y<size; ++y) {
+    for (int x=0; x<size; ++x) {
+      const int v = (1+std::min(x, size-1-x)) * (1+std::min(y, size-1-y));
+      matrix->value(x, y) = v;
+      div += v;
+    }
+  }
+  matrix->setCenterX(size/2);
+  matrix->setCenterY(size/2);
+  matrix->setDiv(div);
+  matrix->setBias(0);
+  return matrix;
+}
+
+// Sharpen-like matrix that cannot be separated in two 1D passes
+std::shared_ptr<ConvolutionMatrix> make_sharpen_matrix(const int size)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(size, size);
+  for (int y=0; y<size; ++y)
+    for (int x=0; x<size; ++x)
+      matrix->value(x, y) = -1;
+  matrix->value(size/2, size/2) = size*size;
+  matrix->setCenterX(size/2);
+  matrix->setCenterY(size/2);
+  matrix->setDiv(1);
+  matrix->setBias(0);
+  return matrix;
+}
+
+void run_filter(benchmark::State& state, Filter& filter)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int size = state.range(1);
+  BenchFilterManager filterMgr(pf, size, size, false);
+  for (auto _ : state)
+    filterMgr.apply(&filter);
+  state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+} // anonymous namespace
+
+// Args: pixel format, image size, with mask
+void BM_FilterManagerOverhead(benchmark::State& state)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int size = state.range(1);
+  BenchFilterManager filterMgr(pf, size, size, state.range(2) != 0);
+  CopyFilter filter;
+  for (auto _ : state)
+    filterMgr.apply(&filter);
+  state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+// Args: pixel format, image size
+void BM_InvertColor(benchmark::State& state)
+{
+  InvertColorFilter filter;
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size
+void BM_BrightnessContrast(benchmark::State& state)
+{
+  BrightnessContrastFilter filter;
+  filter.setBrightness(0.2);
+  filter.setContrast(0.3);
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size
+void BM_ColorCurve(benchmark::State& state)
+{
+  ColorCurve curve;
+  curve.addPoint(gfx::Point(0, 0));
+  curve.addPoint(gfx::Point(64, 96));
+  curve.addPoint(gfx::Point(255, 255));
+  ColorCurveFilter filter;
+  filter.setCurve(curve);
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size
+void BM_HueSaturation(benchmark::State& state)
+{
+  HueSaturationFilter filter;
+  filter.setHue(30.0);
+  filter.setSaturation(0.2);
+  filter.setLightness(-0.1);
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size, tolerance
+void BM_ReplaceColor(benchmark::State& state)
+{
+  ReplaceColorFilter filter;
+  filter.setFrom(rgba(255, 0, 0, 255));
+  filter.setTo(rgba(0, 0, 255, 255));
+  filter.setTolerance(state.range(2));
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size, tiled mode, window size
+void BM_Median(benchmark::State& state)
+{
+  MedianFilter filter;
+  filter.setTiledMode((TiledMode)state.range(2));
+  filter.setSize(state.range(3), state.range(3));
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size, tiled mode, matrix size, separable
+void BM_ConvolutionMatrix(benchmark::State& state)
+{
+  const int size = state.range(3);
+  ConvolutionMatrixFilter filter;
+  filter.setTiledMode((TiledMode)state.range(2));
+  filter.setMatrix(state.range(4) ? make_blur_matrix(size):
+                                    make_sharpen_matrix(size));
+  run_filter(state, filter);
+}
+
+// Args: pixel format, image size, tiled mode, thickness
+void BM_Outline(benchmark::State& state)
+{
+  OutlineFilter filter;
+  filter.tiledMode((TiledMode)state.range(2));
+  filter.thickness(state.range(3));
+  filter.color(rgba(0, 0, 0, 255));
+  run_filter(state, filter);
+}
+
+#define PIXEL_FORMATS { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }
+#define IMAGE_SIZES { 64, 512, 2048 }
+#define TILED_MODES { int(TiledMode::NONE), int(TiledMode::BOTH) }
+
+BENCHMARK(BM_FilterManagerOverhead)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES, { 0, 1 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_InvertColor)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_BrightnessContrast)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_ColorCurve)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_HueSaturation)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_ReplaceColor)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES, { 0, 32 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_Median)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES, TILED_MODES, { 3, 9 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_ConvolutionMatrix)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES, TILED_MODES, { 3, 9 }, { 0, 1 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_Outline)
+  ->ArgsProduct({ PIXEL_FORMATS, IMAGE_SIZES, TILED_MODES, { 1, 4 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
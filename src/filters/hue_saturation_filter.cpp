@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,12 +21,49 @@
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <iterator>
 
 namespace filters {
 
 using namespace doc;
 
+namespace {
+
+  // Cache of converted colors for each thread (so the filter can be
+  // applied from several threads at the same time). Converting a
+  // color to HSL/HSV and back is expensive, and images usually
+  // contain a lot of pixels with the same color.
+  struct ColorCache {
+    static const int kSize = 4096;
+    static const uint32_t kEmpty = 0xffffffff; // RGB keys have 24 bits
+
+    uint64_t configId = 0;
+    uint32_t keys[kSize];
+    uint32_t values[kSize];
+    int grayValues[256];
+
+    ColorCache& reset(const uint64_t id) {
+      if (configId != id) {
+        configId = id;
+        std::fill(std::begin(keys), std::end(keys), kEmpty);
+        std::fill(std::begin(grayValues), std::end(grayValues), -1);
+      }
+      return *this;
+    }
+
+    static int hash(const uint32_t rgb) {
+      return int((rgb * 2654435761u) >> 20) & (kSize-1);
+    }
+  };
+
+  thread_local ColorCache g_cache;
+  std::atomic<uint64_t> g_nextConfigId(1);
+
+}
+
 const char* HueSaturationFilter::getName()
 {
   return "Hue Saturation Color";
@@ -39,26 +76,36 @@ HueSaturationFilter::HueSaturationFilter()
   , m_l(0.0)
   , m_a(0.0)
 {
+  updateConfigId();
+}
+
+void HueSaturationFilter::updateConfigId()
+{
+  m_configId = g_nextConfigId++;
 }
 
 void HueSaturationFilter::setMode(Mode mode)
 {
   m_mode = mode;
+  updateConfigId();
 }
 
 void HueSaturationFilter::setHue(double h)
 {
   m_h = h;
+  updateConfigId();
 }
 
 void HueSaturationFilter::setSaturation(double s)
 {
   m_s = s;
+  updateConfigId();
 }
 
 void HueSaturationFilter::setLightness(double l)
 {
   m_l = l;
+  updateConfigId();
 }
 
 void HueSaturationFilter::setAlpha(double a)
@@ -71,6 +118,7 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
   FilterIndexedData* fid = filterMgr->getIndexedData();
   const Palette* pal = fid->getPalette();
   Palette* newPal = (m_usePaletteOnRGB ? fid->getNewPalette(): nullptr);
+  ColorCache& cache = g_cache.reset(m_configId);
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
     color_t c = *src_address;
@@ -85,7 +133,29 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
         c = newPal->getEntry(i);
     }
     else {
-      applyFilterToRgb(target, c);
+      // Convert the RGB components (the alpha doesn't affect them)
+      // only if they aren't in the cache.
+      const uint32_t rgb = (c & rgba_rgb_mask);
+      const int i = ColorCache::hash(rgb);
+      if (cache.keys[i] != rgb) {
+        color_t d = rgb;
+        applyFilterToRgb(TARGET_RED_CHANNEL |
+                         TARGET_GREEN_CHANNEL |
+                         TARGET_BLUE_CHANNEL, d);
+        cache.keys[i] = rgb;
+        cache.values[i] = (d & rgba_rgb_mask);
+      }
+      const color_t d = cache.values[i];
+
+      int a = rgba_geta(c);
+      if (a && (target & TARGET_ALPHA_CHANNEL)) {
+        a = a*(1.0+m_a);
+        a = std::clamp(a, 0, 255);
+      }
+      c = rgba((target & TARGET_RED_CHANNEL   ? rgba_getr(d): rgba_getr(c)),
+               (target & TARGET_GREEN_CHANNEL ? rgba_getg(d): rgba_getg(c)),
+               (target & TARGET_BLUE_CHANNEL  ? rgba_getb(d): rgba_getb(c)),
+               a);
     }
 
     *dst_address = c;
@@ -95,21 +165,28 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
 
 void HueSaturationFilter::applyToGrayscale(FilterManager* filterMgr)
 {
+  ColorCache& cache = g_cache.reset(m_configId);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
     color_t c = *src_address;
     int k = graya_getv(c);
     int a = graya_geta(c);
 
     {
-      gfx::Hsl hsl(gfx::Rgb(k, k, k));
-
-      double l = hsl.lightness()*(1.0+m_l);
-      l = std::clamp(l, 0.0, 1.0);
-
-      hsl.lightness(l);
-      gfx::Rgb rgb(hsl);
-
-      if (target & TARGET_GRAY_CHANNEL) k = rgb.red();
+      if (target & TARGET_GRAY_CHANNEL) {
+        int& value = cache.grayValues[k];
+        if (value < 0) {
+          gfx::Hsl hsl(gfx::Rgb(k, k, k));
+
+          double l = hsl.lightness()*(1.0+m_l);
+          l = std::clamp(l, 0.0, 1.0);
+
+          hsl.lightness(l);
+          gfx::Rgb rgb(hsl);
+          value = rgb.red();
+        }
+        k = value;
+      }
 
       if (a && (target & TARGET_ALPHA_CHANNEL)) {
         a = a*(1.0+m_a);
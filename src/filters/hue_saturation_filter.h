@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,8 @@
 #include "filters/filter.h"
 #include "filters/target.h"
 
+#include <cstdint>
+
 namespace filters {
 
   class HueSaturationFilter : public FilterWithPalette {
@@ -35,6 +37,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr) override;
     void applyToGrayscale(FilterManager* filterMgr) override;
     void applyToIndexed(FilterManager* filterMgr) override;
+    bool isThreadSafe() const override { return true; }
 
   private:
     void onApplyToPalette(FilterManager* filterMgr,
@@ -45,9 +48,15 @@ namespace filters {
              void (T::*set_lightness)(double)>
     void applyFilterToRgbT(const Target target, doc::color_t& color, bool multiply);
     void applyFilterToRgb(const Target target, doc::color_t& color);
+    void updateConfigId();
 
     Mode m_mode;
     double m_h, m_s, m_l, m_a;
+
+    // Unique ID of the current mode/hue/saturation/lightness values,
+    // used to know if the cached colors of each thread are still
+    // valid.
+    uint64_t m_configId;
   };
 
 } // namespace filters
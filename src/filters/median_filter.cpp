@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -11,90 +11,141 @@
 
 #include "filters/median_filter.h"
 
-#include "base/memory.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
-#include "filters/neighboring_pixels.h"
 #include "filters/tiled_mode.h"
 
 #include <algorithm>
+#include <iterator>
+#include <vector>
 
 namespace filters {
 
 using namespace doc;
 
 namespace {
-  struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+  // Histogram of 8-bit values used to find the median of the pixels
+  // in the window. The coarse histogram (16 bins of 16 values each)
+  // is used to find the median in 16+16 steps at most.
+  class Histogram {
+  public:
+    Histogram() { clear(); }
 
-    void reset() { c = 0; }
-
-    void operator()(RgbTraits::pixel_t color)
-    {
-      channel[0][c] = rgba_getr(color);
-      channel[1][c] = rgba_getg(color);
-      channel[2][c] = rgba_getb(color);
-      channel[3][c] = rgba_geta(color);
-      c++;
+    void clear() {
+      std::fill(std::begin(m_coarse), std::end(m_coarse), 0);
+      std::fill(std::begin(m_fine), std::end(m_fine), 0);
     }
-  };
-
-  struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
-
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
 
-    void reset() { c = 0; }
+    void add(const int value, const int delta) {
+      m_coarse[value >> 4] += delta;
+      m_fine[value] += delta;
+    }
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      channel[0][c] = graya_getv(color);
-      channel[1][c] = graya_geta(color);
-      c++;
+    // Returns the value in the given position (0-based) of the sorted
+    // list of values.
+    int valueAt(int rank) const {
+      int i = 0;
+      for (; i<15 && rank >= m_coarse[i]; ++i)
+        rank -= m_coarse[i];
+      int j = (i << 4);
+      for (const int end=j+15; j<end && rank >= m_fine[j]; ++j)
+        rank -= m_fine[j];
+      return j;
     }
-  };
 
-  struct GetPixelsDelegateIndexed {
-    const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
-    Target target;
-    int c;
+  private:
+    int m_coarse[16];
+    int m_fine[256];
+  };
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
-      : pal(pal), channel(channel), target(target) { }
+  int wrap_or_clamp(int i, const int size, const bool tiled)
+  {
+    if (tiled) {
+      i %= size;
+      return (i < 0 ? i+size: i);
+    }
+    else
+      return std::clamp(i, 0, size-1);
+  }
 
-    void reset() { c = 0; }
+  // Applies the median filter to the current row of "filterMgr" with
+  // a sliding window (Huang's algorithm): a histogram of each channel
+  // is kept for the window, and when we move to the next pixel, only
+  // the column that leaves the window and the column that enters are
+  // updated (instead of sorting the whole window for each pixel).
+  //
+  // "unpack" converts a pixel to N 8-bit channels, and "pack" creates
+  // the destination pixel from the channels.
+  template<typename Traits, int N, typename Unpack, typename Pack>
+  void apply_median_to_row(FilterManager* filterMgr,
+                           const int width, const int height,
+                           const TiledMode tiledMode,
+                           const bool (&channels)[N],
+                           Unpack unpack,
+                           Pack pack)
+  {
+    using pixel_t = typename Traits::pixel_t;
+
+    const Image* src = filterMgr->getSourceImage();
+    const bool tiledX = (int(tiledMode) & int(TiledMode::X_AXIS));
+    const bool tiledY = (int(tiledMode) & int(TiledMode::Y_AXIS));
+    const int centerX = width/2;
+    const int rank = width*height/2;
+
+    // Source rows of the window
+    std::vector<const pixel_t*> rows(height);
+    for (int dy=0; dy<height; ++dy) {
+      const int gety = wrap_or_clamp(filterMgr->y() - height/2 + dy,
+                                     src->height(), tiledY);
+      rows[dy] = (const pixel_t*)src->getPixelAddress(0, gety);
+    }
 
-    void operator()(IndexedTraits::pixel_t color)
-    {
-      if (target & TARGET_INDEX_CHANNEL) {
-        channel[0][c] = color;
+    Histogram hist[N];
+    auto addColumn = [&](const int col, const int delta) {
+      const int getx = wrap_or_clamp(col, src->width(), tiledX);
+      uint8_t values[N];
+      for (int dy=0; dy<height; ++dy) {
+        unpack(rows[dy][getx], values);
+        for (int c=0; c<N; ++c)
+          if (channels[c])
+            hist[c].add(values[c], delta);
       }
-      else {
-        color_t rgb = pal->getEntry(color);
-        channel[0][c] = rgba_getr(rgb);
-        channel[1][c] = rgba_getg(rgb);
-        channel[2][c] = rgba_getb(rgb);
-        channel[3][c] = rgba_geta(rgb);
+    };
+
+    // X position of the center of the window (skipped pixels don't
+    // move the window, so we move it until we reach the current
+    // pixel).
+    int histX = filterMgr->x();
+    for (int dx=0; dx<width; ++dx)
+      addColumn(histX - centerX + dx, 1);
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(pixel_t) {
+      for (; histX < x; ++histX) {
+        addColumn(histX - centerX, -1);
+        addColumn(histX - centerX + width, 1);
       }
-      c++;
+
+      uint8_t values[N];
+      unpack(*src_address, values);
+      for (int c=0; c<N; ++c)
+        if (channels[c])
+          values[c] = hist[c].valueAt(rank);
+
+      *dst_address = pack(values);
     }
-  };
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
 };
 
 MedianFilter::MedianFilter()
   : m_tiledMode(TiledMode::NONE)
   , m_width(1)
   , m_height(1)
-  , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -110,10 +161,6 @@ void MedianFilter::setSize(int width, int height)
 
   m_width = std::max(1, width);
   m_height = std::max(1, height);
-  m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -123,135 +170,85 @@ const char* MedianFilter::getName()
 
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  int color, r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
-
-    color = get_pixel_fast<RgbTraits>(src, x, y);
-
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
-    else
-      r = rgba_getr(color);
-
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
-    else
-      g = rgba_getg(color);
-
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
-    else
-      b = rgba_getb(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
-    else
-      a = rgba_geta(color);
+  const Target target = filterMgr->getTarget();
+  const bool channels[4] = {
+    (target & TARGET_RED_CHANNEL) != 0,
+    (target & TARGET_GREEN_CHANNEL) != 0,
+    (target & TARGET_BLUE_CHANNEL) != 0,
+    (target & TARGET_ALPHA_CHANNEL) != 0
+  };
 
-    *dst_address = rgba(r, g, b, a);
-  }
-  FILTER_LOOP_THROUGH_ROW_END()
+  apply_median_to_row<RgbTraits>(
+    filterMgr, m_width, m_height, m_tiledMode, channels,
+    [](const color_t color, uint8_t* values) {
+      values[0] = rgba_getr(color);
+      values[1] = rgba_getg(color);
+      values[2] = rgba_getb(color);
+      values[3] = rgba_geta(color);
+    },
+    [](const uint8_t* values) -> color_t {
+      return rgba(values[0], values[1], values[2], values[3]);
+    });
 }
 
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
-
-    color = get_pixel_fast<GrayscaleTraits>(src, x, y);
-
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
-    else
-      k = graya_getv(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
-    else
-      a = graya_geta(color);
+  const Target target = filterMgr->getTarget();
+  const bool channels[2] = {
+    (target & TARGET_GRAY_CHANNEL) != 0,
+    (target & TARGET_ALPHA_CHANNEL) != 0
+  };
 
-    *dst_address = graya(k, a);
-  }
-  FILTER_LOOP_THROUGH_ROW_END()
+  apply_median_to_row<GrayscaleTraits>(
+    filterMgr, m_width, m_height, m_tiledMode, channels,
+    [](const color_t color, uint8_t* values) {
+      values[0] = graya_getv(color);
+      values[1] = graya_geta(color);
+    },
+    [](const uint8_t* values) -> color_t {
+      return graya(values[0], values[1]);
+    });
 }
 
 void MedianFilter::applyToIndexed(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int color, r, g, b, a;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, filterMgr->getTarget());
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *dst_address = m_channel[0][m_ncolors/2];
-    }
-    else {
-      color = get_pixel_fast<IndexedTraits>(src, x, y);
-      color = pal->getEntry(color);
-
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
-      else
-        r = rgba_getr(color);
-
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
-      else
-        g = rgba_getg(pal->getEntry(color));
-
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
-      else
-        b = rgba_getb(color);
-
-      if (target & TARGET_ALPHA_CHANNEL) {
-        std::sort(m_channel[3].begin(), m_channel[3].end());
-        a = m_channel[3][m_ncolors/2];
-      }
-      else
-        a = rgba_geta(color);
-
-      *dst_address = rgbmap->mapColor(r, g, b, a);
-    }
+  const Target target = filterMgr->getTarget();
+
+  if (target & TARGET_INDEX_CHANNEL) {
+    const bool channels[1] = { true };
+
+    apply_median_to_row<IndexedTraits>(
+      filterMgr, m_width, m_height, m_tiledMode, channels,
+      [](const color_t index, uint8_t* values) {
+        values[0] = index;
+      },
+      [](const uint8_t* values) -> color_t {
+        return values[0];
+      });
+  }
+  else {
+    const bool channels[4] = {
+      (target & TARGET_RED_CHANNEL) != 0,
+      (target & TARGET_GREEN_CHANNEL) != 0,
+      (target & TARGET_BLUE_CHANNEL) != 0,
+      (target & TARGET_ALPHA_CHANNEL) != 0
+    };
+
+    apply_median_to_row<IndexedTraits>(
+      filterMgr, m_width, m_height, m_tiledMode, channels,
+      [pal](const color_t index, uint8_t* values) {
+        const color_t color = pal->getEntry(index);
+        values[0] = rgba_getr(color);
+        values[1] = rgba_getg(color);
+        values[2] = rgba_getb(color);
+        values[3] = rgba_geta(color);
+      },
+      [rgbmap](const uint8_t* values) -> color_t {
+        return rgbmap->mapColor(values[0], values[1], values[2], values[3]);
+      });
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 } // namespace filters
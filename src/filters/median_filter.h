@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -8,12 +9,9 @@
 #define FILTERS_MEDIAN_FILTER_PROCESS_H_INCLUDED
 #pragma once
 
-#include "base/ints.h"
 #include "filters/filter.h"
 #include "filters/tiled_mode.h"
 
-#include <vector>
-
 namespace filters {
 
   class MedianFilter : public Filter {
@@ -37,8 +35,6 @@ namespace filters {
     TiledMode m_tiledMode;
     int m_width;
     int m_height;
-    int m_ncolors;
-    std::vector<std::vector<uint8_t> > m_channel;
   };
 
 } // namespace filters
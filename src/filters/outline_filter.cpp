@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,6 +10,7 @@
 
 #include "filters/outline_filter.h"
 
+#include "doc/algorithm/distance_transform.h"
 #include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
@@ -18,6 +19,7 @@
 #include "filters/neighboring_pixels.h"
 
 #include <algorithm>
+#include <cstddef>
 
 namespace filters {
 
@@ -79,6 +81,16 @@ namespace {
     }
   };
 
+  int wrap_or_clamp(int i, const int size, const bool tiled)
+  {
+    if (tiled) {
+      i %= size;
+      return (i < 0 ? i+size: i);
+    }
+    else
+      return std::clamp(i, 0, size-1);
+  }
+
 }
 
 OutlineFilter::OutlineFilter()
@@ -87,6 +99,8 @@ OutlineFilter::OutlineFilter()
   , m_tiledMode(TiledMode::NONE)
   , m_color(0)
   , m_bgColor(0)
+  , m_thickness(1)
+  , m_outlineMaskImage(nullptr)
 {
 }
 
@@ -95,6 +109,92 @@ const char* OutlineFilter::getName()
   return "Outline";
 }
 
+// A thick outline includes all pixels at a distance <= m_thickness
+// from the opaque pixels (Outside) or the transparent pixels
+// (Inside). Circle and Square matrices are calculated with a
+// distance transform (Euclidean and Chebyshev distance), so the
+// cost doesn't depend on the thickness. Other matrices are applied
+// m_thickness times to the whole image (it's the same as applying
+// the 1-pixel outline several times, but in just one step).
+template<typename Traits, typename IsTransparent>
+void OutlineFilter::calcOutlineMask(FilterManager* filterMgr,
+                                    IsTransparent isTransparent)
+{
+  const Image* src = filterMgr->getSourceImage();
+  if (!filterMgr->isFirstRow() && m_outlineMaskImage == src)
+    return;
+  m_outlineMaskImage = src;
+
+  // Add a border of m_thickness pixels around the image, using the
+  // same pixels that get_neighboring_pixels() uses outside the image
+  // (wrapped pixels in tiled mode, or the edge pixels).
+  const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+  const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+  const int t = m_thickness;
+  const int w = src->width() + 2*t;
+  const int h = src->height() + 2*t;
+
+  std::vector<uint8_t> features(std::size_t(w)*h);
+  for (int y=0; y<h; ++y) {
+    auto srcRow = (typename Traits::const_address_t)
+      src->getPixelAddress(0, wrap_or_clamp(y-t, src->height(), tiledY));
+    uint8_t* f = &features[std::size_t(y)*w];
+    for (int x=0; x<w; ++x) {
+      const bool transparent =
+        isTransparent(srcRow[wrap_or_clamp(x-t, src->width(), tiledX)]);
+      f[x] = (m_place == Place::Outside ? !transparent: transparent);
+    }
+  }
+
+  std::vector<uint8_t> reach;
+  if (m_matrix == Matrix::Circle ||
+      m_matrix == Matrix::Square) {
+    const bool circle = (m_matrix == Matrix::Circle);
+    const int maxDist = (circle ? t*t: t);
+
+    std::vector<int> dist(features.size());
+    doc::algorithm::distance_transform(
+      w, h, features.data(),
+      (circle ? doc::algorithm::DistanceMetric::Euclidean:
+                doc::algorithm::DistanceMetric::Chebyshev),
+      dist.data());
+
+    reach.resize(features.size());
+    for (std::size_t i=0; i<reach.size(); ++i)
+      reach[i] = (dist[i] <= maxDist);
+  }
+  else {
+    reach = features;
+    std::vector<uint8_t> next(reach.size());
+    for (int i=0; i<t; ++i) {
+      for (int y=0; y<h; ++y) {
+        for (int x=0; x<w; ++x) {
+          uint8_t value = reach[std::size_t(y)*w + x];
+          int bit = 1;
+          for (int dy=-1; dy<=1 && !value; ++dy) {
+            for (int dx=-1; dx<=1; ++dx, bit <<= 1) {
+              if ((int(m_matrix) & bit) &&
+                  x+dx >= 0 && x+dx < w &&
+                  y+dy >= 0 && y+dy < h &&
+                  reach[std::size_t(y+dy)*w + x+dx]) {
+                value = 1;
+                break;
+              }
+            }
+          }
+          next[std::size_t(y)*w + x] = value;
+        }
+      }
+      std::swap(reach, next);
+    }
+  }
+
+  m_outlineMask.resize(std::size_t(src->width()) * src->height());
+  for (int y=0; y<src->height(); ++y)
+    std::copy_n(&reach[std::size_t(y+t)*w + t], src->width(),
+                &m_outlineMask[std::size_t(y)*src->width()]);
+}
+
 void OutlineFilter::applyToRgba(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
@@ -105,12 +205,26 @@ void OutlineFilter::applyToRgba(FilterManager* filterMgr)
   GetPixelsDelegateRgba delegate;
   delegate.init(m_bgColor, m_matrix);
 
+  const bool thick = (m_thickness > 1);
+  if (thick) {
+    calcOutlineMask<RgbTraits>(
+      filterMgr,
+      [this](const color_t c) {
+        return (rgba_geta(c) == 0 || c == m_bgColor);
+      });
+  }
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (thick) {
+      n = m_outlineMask[std::size_t(y)*src->width() + x];
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<RgbTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (rgba_geta(c) == 0 || c == m_bgColor);
 
     if ((n >= 1) &&
@@ -138,12 +252,26 @@ void OutlineFilter::applyToGrayscale(FilterManager* filterMgr)
   GetPixelsDelegateGrayscale delegate;
   delegate.init(m_bgColor, m_matrix);
 
+  const bool thick = (m_thickness > 1);
+  if (thick) {
+    calcOutlineMask<GrayscaleTraits>(
+      filterMgr,
+      [this](const color_t c) {
+        return (graya_geta(c) == 0 || c == m_bgColor);
+      });
+  }
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (thick) {
+      n = m_outlineMask[std::size_t(y)*src->width() + x];
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<GrayscaleTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (graya_geta(c) == 0 || c == m_bgColor);
 
     if ((n >= 1) &&
@@ -171,12 +299,26 @@ void OutlineFilter::applyToIndexed(FilterManager* filterMgr)
   GetPixelsDelegateIndexed delegate(pal);
   delegate.init(m_bgColor, m_matrix);
 
+  const bool thick = (m_thickness > 1);
+  if (thick) {
+    calcOutlineMask<IndexedTraits>(
+      filterMgr,
+      [this, pal](const color_t c) {
+        return (rgba_geta(pal->getEntry(c)) == 0 || c == m_bgColor);
+      });
+  }
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+    if (thick) {
+      n = m_outlineMask[std::size_t(y)*src->width() + x];
+    }
+    else {
+      delegate.reset();
+      get_neighboring_pixels<IndexedTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
+      n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
+    }
 
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
 
     if (target & TARGET_INDEX_CHANNEL) {
       isTransparent = (c == m_bgColor);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,6 +12,13 @@
 #include "filters/filter.h"
 #include "filters/tiled_mode.h"
 
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
 namespace filters {
 
   class OutlineFilter : public Filter {
@@ -32,12 +39,14 @@ namespace filters {
     void tiledMode(const TiledMode tiledMode) { m_tiledMode = tiledMode; }
     void color(const doc::color_t color) { m_color = color; }
     void bgColor(const doc::color_t color) { m_bgColor = color; }
+    void thickness(const int thickness) { m_thickness = thickness; }
 
     Place place() const { return m_place; }
     Matrix matrix() const { return m_matrix; }
     TiledMode tiledMode() const { return m_tiledMode; }
     doc::color_t color() const { return m_color; }
     doc::color_t bgColor() const { return m_bgColor; }
+    int thickness() const { return m_thickness; }
 
     // Filter implementation
     const char* getName();
@@ -46,11 +55,24 @@ namespace filters {
     void applyToIndexed(FilterManager* filterMgr);
 
   private:
+    // Calculates m_outlineMask for thick outlines (m_thickness > 1)
+    // for the whole source image. "isTransparent" must return true for
+    // transparent pixels of the image.
+    template<typename Traits, typename IsTransparent>
+    void calcOutlineMask(FilterManager* filterMgr,
+                         IsTransparent isTransparent);
+
     Place m_place;
     Matrix m_matrix;
     TiledMode m_tiledMode;
     doc::color_t m_color;
     doc::color_t m_bgColor;
+    int m_thickness;
+
+    // Pixels of the source image that must be painted with the
+    // outline color (only for thick outlines).
+    const doc::Image* m_outlineMaskImage;
+    std::vector<uint8_t> m_outlineMask;
   };
 
 } // namespace filters
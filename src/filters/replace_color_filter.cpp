@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -17,10 +17,33 @@
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace filters {
 
 using namespace doc;
 
+namespace {
+
+  color_t rgba_target_mask(const Target target)
+  {
+    return
+      (target & TARGET_RED_CHANNEL   ? rgba_r_mask: 0) |
+      (target & TARGET_GREEN_CHANNEL ? rgba_g_mask: 0) |
+      (target & TARGET_BLUE_CHANNEL  ? rgba_b_mask: 0) |
+      (target & TARGET_ALPHA_CHANNEL ? rgba_a_mask: 0);
+  }
+
+  uint16_t graya_target_mask(const Target target)
+  {
+    return
+      (target & TARGET_GRAY_CHANNEL  ? graya_v_mask: 0) |
+      (target & TARGET_ALPHA_CHANNEL ? graya_a_mask: 0);
+  }
+
+}
+
 ReplaceColorFilter::ReplaceColorFilter()
 {
   m_from = m_to = 0;
@@ -47,43 +70,43 @@ const char* ReplaceColorFilter::getName()
   return "Replace Color";
 }
 
+// The pixels are compared using only the bits of the target channels:
+// if there is no tolerance, the masked pixel must be equal to the
+// masked "from" color, in other case each target channel must be in
+// the [from-tolerance, from+tolerance] range. Then the bits of the
+// target channels are replaced with the "to" color.
+
 void ReplaceColorFilter::applyToRgba(FilterManager* filterMgr)
 {
-  int from_r, from_g, from_b, from_a;
-  int src_r, src_g, src_b, src_a;
-  int to_r, to_g, to_b, to_a;
-  int c;
-
-  from_r = rgba_getr(m_from);
-  from_g = rgba_getg(m_from);
-  from_b = rgba_getb(m_from);
-  from_a = rgba_geta(m_from);
-  to_r = rgba_getr(m_to);
-  to_g = rgba_getg(m_to);
-  to_b = rgba_getb(m_to);
-  to_a = rgba_geta(m_to);
+  const color_t mask = rgba_target_mask(filterMgr->getTarget());
+  const color_t from = (m_from & mask);
+  const color_t to = (m_to & mask);
+
+  if (m_tolerance == 0) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+      const color_t c = *src_address;
+      *dst_address = ((c & mask) == from ? (c & ~mask) | to: c);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
+
+  // Minimum value of each channel (the range of each channel is
+  // from "lo" to "lo+2*tolerance")
+  const int tol2 = 2*m_tolerance;
+  const int lo_r = rgba_getr(m_from) - m_tolerance;
+  const int lo_g = rgba_getg(m_from) - m_tolerance;
+  const int lo_b = rgba_getb(m_from) - m_tolerance;
+  const int lo_a = rgba_geta(m_from) - m_tolerance;
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    c = *src_address;
-    src_r = rgba_getr(c);
-    src_g = rgba_getg(c);
-    src_b = rgba_getb(c);
-    src_a = rgba_geta(c);
-
-    if (!(target & TARGET_RED_CHANNEL  )) from_r = src_r;
-    if (!(target & TARGET_GREEN_CHANNEL)) from_g = src_g;
-    if (!(target & TARGET_BLUE_CHANNEL )) from_b = src_b;
-    if (!(target & TARGET_ALPHA_CHANNEL)) from_a = src_a;
-
-    if ((ABS(src_r-from_r) <= m_tolerance) &&
-        (ABS(src_g-from_g) <= m_tolerance) &&
-        (ABS(src_b-from_b) <= m_tolerance) &&
-        (ABS(src_a-from_a) <= m_tolerance)) {
-      *dst_address = rgba(
-        (target & TARGET_RED_CHANNEL   ? to_r: src_r),
-        (target & TARGET_GREEN_CHANNEL ? to_g: src_g),
-        (target & TARGET_BLUE_CHANNEL  ? to_b: src_b),
-        (target & TARGET_ALPHA_CHANNEL ? to_a: src_a));
+    const color_t c = *src_address;
+
+    if ((!(target & TARGET_RED_CHANNEL  ) || unsigned(rgba_getr(c) - lo_r) <= unsigned(tol2)) &&
+        (!(target & TARGET_GREEN_CHANNEL) || unsigned(rgba_getg(c) - lo_g) <= unsigned(tol2)) &&
+        (!(target & TARGET_BLUE_CHANNEL ) || unsigned(rgba_getb(c) - lo_b) <= unsigned(tol2)) &&
+        (!(target & TARGET_ALPHA_CHANNEL) || unsigned(rgba_geta(c) - lo_a) <= unsigned(tol2))) {
+      *dst_address = (c & ~mask) | to;
     }
     else
       *dst_address = c;
@@ -93,29 +116,29 @@ void ReplaceColorFilter::applyToRgba(FilterManager* filterMgr)
 
 void ReplaceColorFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  int from_v, from_a;
-  int src_v, src_a;
-  int to_v, to_a;
-  int c;
+  const uint16_t mask = graya_target_mask(filterMgr->getTarget());
+  const uint16_t from = (m_from & mask);
+  const uint16_t to = (m_to & mask);
+
+  if (m_tolerance == 0) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
+      const uint16_t c = *src_address;
+      *dst_address = ((c & mask) == from ? (c & ~mask) | to: c);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
 
-  from_v = graya_getv(m_from);
-  from_a = graya_geta(m_from);
-  to_v = graya_getv(m_to);
-  to_a = graya_geta(m_to);
+  const int tol2 = 2*m_tolerance;
+  const int lo_v = graya_getv(m_from) - m_tolerance;
+  const int lo_a = graya_geta(m_from) - m_tolerance;
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    c = *src_address;
-    src_v = graya_getv(c);
-    src_a = graya_geta(c);
-
-    if (!(target & TARGET_GRAY_CHANNEL )) from_v = src_v;
-    if (!(target & TARGET_ALPHA_CHANNEL)) from_a = src_a;
-
-    if ((ABS(src_v-from_v) <= m_tolerance) &&
-        (ABS(src_a-from_a) <= m_tolerance)) {
-      *dst_address = graya(
-        (target & TARGET_GRAY_CHANNEL  ? to_v: src_v),
-        (target & TARGET_ALPHA_CHANNEL ? to_a: src_a));
+    const uint16_t c = *src_address;
+
+    if ((!(target & TARGET_GRAY_CHANNEL ) || unsigned(graya_getv(c) - lo_v) <= unsigned(tol2)) &&
+        (!(target & TARGET_ALPHA_CHANNEL) || unsigned(graya_geta(c) - lo_a) <= unsigned(tol2))) {
+      *dst_address = (c & ~mask) | to;
     }
     else
       *dst_address = c;
@@ -127,56 +150,46 @@ void ReplaceColorFilter::applyToIndexed(FilterManager* filterMgr)
 {
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int from_r, from_g, from_b, from_a;
-  int src_r, src_g, src_b, src_a;
-  int to_r, to_g, to_b, to_a;
-  int c;
-
-  c = pal->getEntry(m_from);
-  from_r = rgba_getr(c);
-  from_g = rgba_getg(c);
-  from_b = rgba_getb(c);
-  from_a = rgba_geta(c);
-
-  c = pal->getEntry(m_to);
-  to_r = rgba_getr(c);
-  to_g = rgba_getg(c);
-  to_b = rgba_getb(c);
-  to_a = rgba_geta(c);
+  if (filterMgr->getTarget() & TARGET_INDEX_CHANNEL) {
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+      const int c = *src_address;
+      *dst_address = (ABS(c-m_from) <= m_tolerance ? m_to: c);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+    return;
+  }
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    c = *src_address;
+  const color_t mask = rgba_target_mask(filterMgr->getTarget());
+  const color_t from = pal->getEntry(m_from);
+  const color_t to = (pal->getEntry(m_to) & mask);
 
-    if (target & TARGET_INDEX_CHANNEL) {
-      if (ABS(c-m_from) <= m_tolerance)
-        *dst_address = m_to;
-      else
-        *dst_address = c;
-    }
-    else {
-      src_r = rgba_getr(pal->getEntry(c));
-      src_g = rgba_getg(pal->getEntry(c));
-      src_b = rgba_getb(pal->getEntry(c));
-      src_a = rgba_geta(pal->getEntry(c));
-
-      if (!(target & TARGET_RED_CHANNEL  )) from_r = src_r;
-      if (!(target & TARGET_GREEN_CHANNEL)) from_g = src_g;
-      if (!(target & TARGET_BLUE_CHANNEL )) from_b = src_b;
-      if (!(target & TARGET_ALPHA_CHANNEL)) from_a = src_a;
-
-      if ((ABS(src_r-from_r) <= m_tolerance) &&
-          (ABS(src_g-from_g) <= m_tolerance) &&
-          (ABS(src_b-from_b) <= m_tolerance) &&
-          (ABS(src_a-from_a) <= m_tolerance)) {
-        *dst_address = rgbmap->mapColor(
-          (target & TARGET_RED_CHANNEL   ? to_r: src_r),
-          (target & TARGET_GREEN_CHANNEL ? to_g: src_g),
-          (target & TARGET_BLUE_CHANNEL  ? to_b: src_b),
-          (target & TARGET_ALPHA_CHANNEL ? to_a: src_a));
+  // The result depends only on the palette entry, so it's calculated
+  // once for each used index of the row.
+  int table[256];
+  std::fill(std::begin(table), std::end(table), -1);
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+    const int index = *src_address;
+    int& result = table[index];
+
+    if (result < 0) {
+      const color_t c = pal->getEntry(index);
+
+      if ((!(target & TARGET_RED_CHANNEL  ) || ABS(rgba_getr(c)-rgba_getr(from)) <= m_tolerance) &&
+          (!(target & TARGET_GREEN_CHANNEL) || ABS(rgba_getg(c)-rgba_getg(from)) <= m_tolerance) &&
+          (!(target & TARGET_BLUE_CHANNEL ) || ABS(rgba_getb(c)-rgba_getb(from)) <= m_tolerance) &&
+          (!(target & TARGET_ALPHA_CHANNEL) || ABS(rgba_geta(c)-rgba_geta(from)) <= m_tolerance)) {
+        const color_t d = (c & ~mask) | to;
+        result = rgbmap->mapColor(rgba_getr(d),
+                                  rgba_getg(d),
+                                  rgba_getb(d),
+                                  rgba_geta(d));
       }
       else
-        *dst_address = c;
+        result = index;
     }
+
+    *dst_address = result;
   }
   FILTER_LOOP_THROUGH_ROW_END()
 }
@@ -92,6 +92,11 @@ void gen_strings_class(const std::string& inputFn)
     << "    };\n"
     << "\n";
 
+  // Each string has an index (in the same order of the en.ini file)
+  // so T::Translate() can cache the translated string in an array
+  // instead of looking for the string ID in a hash table each time.
+  int index = 0;
+
   for (const auto& section : sections) {
     keys.clear();
     cfg.getAllKeys(section.c_str(), keys);
@@ -109,7 +114,7 @@ void gen_strings_class(const std::string& inputFn)
       // Create just a function to get the translated string (it
       // doesn't have arguments).
       if (nargs == 0 || force_simple_string(cppId)) {
-        std::cout << "    static const std::string& " << cppId << "() { return T::Translate(ID::" << cppId << "); }\n";
+        std::cout << "    static const std::string& " << cppId << "() { return T::Translate(" << index << ", ID::" << cppId << "); }\n";
       }
       // Create a function to format the translated string with a
       // specific number of arguments (the good part is that we can
@@ -137,11 +142,14 @@ void gen_strings_class(const std::string& inputFn)
         std::cout << "); }\n";
       }
 
+      ++index;
       textId.erase(section.size()+1);
     }
   }
 
   std::cout
+    << "\n"
+    << "    static constexpr int kStringsCount = " << index << ";\n"
     << "  };\n"
     << "\n"
     << "} // namespace gen\n"
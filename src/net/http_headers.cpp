@@ -1,4 +1,5 @@
 // Aseprite Network Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,6 +11,8 @@
 
 #include "net/http_headers.h"
 
+#include "base/string.h"
+
 namespace net {
 
 void HttpHeaders::setHeader(const std::string& name,
@@ -18,4 +21,18 @@ void HttpHeaders::setHeader(const std::string& name,
   m_map[name] = value;
 }
 
+std::string HttpHeaders::getHeader(const std::string& name) const
+{
+  auto it = m_map.find(name);
+  if (it != m_map.end())
+    return it->second;
+
+  const std::string lname = base::string_to_lower(name);
+  for (const auto& header : m_map) {
+    if (base::string_to_lower(header.first) == lname)
+      return header.second;
+  }
+  return std::string();
+}
+
 } // namespace net
@@ -1,4 +1,5 @@
 // Aseprite Network Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -28,6 +29,10 @@ public:
   void setHeader(const std::string& name,
                  const std::string& value);
 
+  // Returns the value of the given header (case-insensitive name) or
+  // an empty string if it doesn't exist.
+  std::string getHeader(const std::string& name) const;
+
 private:
   Map m_map;
 };
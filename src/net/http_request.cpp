@@ -1,4 +1,5 @@
 // Aseprite Network Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,10 +15,55 @@
 #include "net/http_headers.h"
 #include "net/http_response.h"
 
+#include "base/trim_string.h"
+
 #include <curl/curl.h>
 
+#include <mutex>
+
 namespace net {
 
+// Connections, DNS entries, and SSL sessions shared between all
+// requests (even from different threads), so concurrent requests to
+// the same host (or through the same proxy) re-use the already
+// established connections.
+class HttpConnectionPool {
+public:
+  static CURLSH* share() {
+    static HttpConnectionPool pool;
+    return pool.m_share;
+  }
+
+private:
+  HttpConnectionPool() : m_share(curl_share_init()) {
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &HttpConnectionPool::lockCallback);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &HttpConnectionPool::unlockCallback);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  }
+
+  ~HttpConnectionPool() {
+    curl_share_cleanup(m_share);
+  }
+
+  static void lockCallback(CURL*, curl_lock_data data, curl_lock_access, void* userdata) {
+    auto pool = reinterpret_cast<HttpConnectionPool*>(userdata);
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+      pool->m_mutexes[data].lock();
+  }
+
+  static void unlockCallback(CURL*, curl_lock_data data, void* userdata) {
+    auto pool = reinterpret_cast<HttpConnectionPool*>(userdata);
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+      pool->m_mutexes[data].unlock();
+  }
+
+  CURLSH* m_share;
+  std::mutex m_mutexes[CURL_LOCK_DATA_LAST];
+};
+
 class HttpRequestImpl {
 public:
   HttpRequestImpl(const std::string& url)
@@ -26,6 +72,9 @@ public:
     , m_response(nullptr) {
     curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
     curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, &HttpRequestImpl::writeBodyCallback);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, this);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, &HttpRequestImpl::writeHeaderCallback);
+    curl_easy_setopt(m_curl, CURLOPT_SHARE, HttpConnectionPool::share());
     curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1);
   }
@@ -79,6 +128,32 @@ private:
     return bytes;
   }
 
+  std::size_t writeHeader(char* ptr, std::size_t bytes) {
+    ASSERT(m_response != NULL);
+    std::string line(ptr, bytes);
+
+    // A new status line (e.g. after a redirection) discards the
+    // headers of the previous response.
+    if (line.compare(0, 5, "HTTP/") == 0) {
+      m_response->clearHeaders();
+    }
+    else {
+      std::string::size_type i = line.find(':');
+      if (i != std::string::npos) {
+        std::string name, value;
+        base::trim_string(line.substr(0, i), name);
+        base::trim_string(line.substr(i+1), value);
+        m_response->setHeader(name, value);
+      }
+    }
+    return bytes;
+  }
+
+  static std::size_t writeHeaderCallback(char* ptr, std::size_t size, std::size_t nmemb, void* userdata) {
+    HttpRequestImpl* req = reinterpret_cast<HttpRequestImpl*>(userdata);
+    return req->writeHeader(ptr, size*nmemb);
+  }
+
   static std::size_t writeBodyCallback(char* ptr, std::size_t size, std::size_t nmemb, void* userdata) {
     HttpRequestImpl* req = reinterpret_cast<HttpRequestImpl*>(userdata);
     return req->writeBody(ptr, size*nmemb);
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c)      2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,13 +9,17 @@
 #define RENDER_COLOR_HISTOGRAM_H_INCLUDED
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <limits>
+#include <mutex>
 #include <vector>
 
 #include "doc/color.h"
 #include "doc/image.h"
 #include "doc/image_traits.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 
 #include "render/median_cut.h"
 
@@ -51,38 +55,48 @@ namespace render {
     // Add the specified "color" in the histogram as many times as the
     // specified value in "count".
     void addSamples(doc::color_t color, std::size_t count = 1) {
-      int i = histogramIndex(color);
-
-      if (m_histogram[i] < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
-        m_histogram[i] += count;
-      else
-        m_histogram[i] = std::numeric_limits<std::size_t>::max();
+      addCount(m_histogram[histogramIndex(color)], count);
 
       // Accurate colors are used only for less than 256 colors.  If the
       // image has more than 256 colors the m_histogram is used
       // instead.
-      if (m_useHighPrecision) {
-        std::vector<doc::color_t>::iterator it =
-          std::find(m_highPrecision.begin(), m_highPrecision.end(), color);
-
-        // The color is not in the high-precision table
-        if (it == m_highPrecision.end()) {
-          if (m_highPrecision.size() < 256) {
-            m_highPrecision.push_back(color);
-          }
-          else {
-            // In this case we reach the limit for the high-precision histogram.
-            m_useHighPrecision = false;
-          }
-        }
+      if (m_useHighPrecision)
+        addHighPrecisionColor(color);
+    }
+
+    // Adds all the samples of other histogram (e.g. filled from other
+    // thread with other part of the image). The result is the same
+    // as adding the samples of "other" after the samples of this
+    // histogram.
+    void merge(const ColorHistogram& other) {
+      parallel_for(
+        0, int(m_histogram.size()), int(m_histogram.size() / 16),
+        [this, &other](const int begin, const int end) {
+          for (int i=begin; i<end; ++i)
+            if (other.m_histogram[i])
+              addCount(m_histogram[i], other.m_histogram[i]);
+        });
+
+      for (const doc::color_t color : other.m_highPrecision) {
+        if (!m_useHighPrecision)
+          break;
+        addHighPrecisionColor(color);
       }
+      // If "other" has more than 256 colors, both have more than
+      // 256 colors
+      if (!other.m_useHighPrecision)
+        m_useHighPrecision = false;
     }
 
     // Creates a set of entries for the given palette in the given range
     // with the more important colors in the histogram. Returns the
     // number of used entries in the palette (maybe the range [from,to]
     // is more than necessary).
-    int createOptimizedPalette(Palette* palette) {
+    //
+    // If kmeansIterations > 0, the colors generated with the median
+    // cut are refined with refineColors().
+    int createOptimizedPalette(Palette* palette,
+                               const int kmeansIterations = 0) {
       // Can we use the high-precision table?
       if (m_useHighPrecision && int(m_highPrecision.size()) <= palette->size()) {
         for (int i=0; i<(int)m_highPrecision.size(); ++i)
@@ -95,6 +109,8 @@ namespace render {
       else {
         std::vector<doc::color_t> result;
         median_cut(*this, palette->size(), result);
+        if (kmeansIterations > 0)
+          refineColors(result, kmeansIterations);
 
         for (int i=0; i<(int)result.size(); ++i)
           palette->setEntry(i, result[i]);
@@ -103,10 +119,136 @@ namespace render {
       }
     }
 
+    // Moves each color to the mean of the histogram points that are
+    // nearer to it than to the other colors (k-means). It's repeated
+    // the given number of iterations or until the colors don't change.
+    void refineColors(std::vector<doc::color_t>& colors,
+                      const int iterations) const {
+      const int k = int(colors.size());
+      if (k == 0)
+        return;
+
+      // Coordinates (in the 8-bit range) and weight of each point
+      std::vector<int> pr, pg, pb, pa;
+      std::vector<std::size_t> pw;
+      for (int i=0; i<int(m_histogram.size()); ++i) {
+        if (!m_histogram[i])
+          continue;
+        pr.push_back(255 * (i & (RElements-1)) / (RElements-1));
+        pg.push_back(255 * ((i >> RBits) & (GElements-1)) / (GElements-1));
+        pb.push_back(255 * ((i >> (RBits+GBits)) & (BElements-1)) / (BElements-1));
+        pa.push_back(255 * ((i >> (RBits+GBits+BBits)) & (AElements-1)) / (AElements-1));
+        pw.push_back(m_histogram[i]);
+      }
+      const int n = int(pw.size());
+      if (n == 0)
+        return;
+
+      // Colors as separated arrays of components, so the distance to
+      // all colors can be calculated with SIMD instructions
+      std::vector<int> cr(k), cg(k), cb(k), ca(k);
+      for (int j=0; j<k; ++j) {
+        cr[j] = rgba_getr(colors[j]);
+        cg[j] = rgba_getg(colors[j]);
+        cb[j] = rgba_getb(colors[j]);
+        ca[j] = rgba_geta(colors[j]);
+      }
+
+      struct Sum {
+        uint64_t r = 0, g = 0, b = 0, a = 0, w = 0;
+      };
+      std::vector<Sum> sums(k);
+      std::mutex mutex;
+
+      for (int iter=0; iter<iterations; ++iter) {
+        std::fill(sums.begin(), sums.end(), Sum());
+
+        parallel_for(
+          0, n, std::max(1024, n / (4*parallel_concurrency())),
+          [&](const int begin, const int end) {
+            std::vector<Sum> partial(k);
+            std::vector<int> dist(k);
+            for (int i=begin; i<end; ++i) {
+              const int r = pr[i], g = pg[i], b = pb[i], a = pa[i];
+              for (int j=0; j<k; ++j) {
+                const int dr = cr[j] - r;
+                const int dg = cg[j] - g;
+                const int db = cb[j] - b;
+                const int da = ca[j] - a;
+                dist[j] = dr*dr + dg*dg + db*db + da*da;
+              }
+              const int j = int(std::min_element(dist.begin(), dist.end()) - dist.begin());
+              const uint64_t w = pw[i];
+              Sum& sum = partial[j];
+              sum.r += w * r;
+              sum.g += w * g;
+              sum.b += w * b;
+              sum.a += w * a;
+              sum.w += w;
+            }
+
+            const std::lock_guard lock(mutex);
+            for (int j=0; j<k; ++j) {
+              sums[j].r += partial[j].r;
+              sums[j].g += partial[j].g;
+              sums[j].b += partial[j].b;
+              sums[j].a += partial[j].a;
+              sums[j].w += partial[j].w;
+            }
+          });
+
+        // Colors without points are kept in the same position
+        bool changed = false;
+        for (int j=0; j<k; ++j) {
+          const Sum& sum = sums[j];
+          if (!sum.w)
+            continue;
+          const int r = int((sum.r + sum.w/2) / sum.w);
+          const int g = int((sum.g + sum.w/2) / sum.w);
+          const int b = int((sum.b + sum.w/2) / sum.w);
+          const int a = int((sum.a + sum.w/2) / sum.w);
+          if (r != cr[j] || g != cg[j] || b != cb[j] || a != ca[j]) {
+            cr[j] = r;
+            cg[j] = g;
+            cb[j] = b;
+            ca[j] = a;
+            changed = true;
+          }
+        }
+        if (!changed)
+          break;
+      }
+
+      for (int j=0; j<k; ++j)
+        colors[j] = doc::rgba(cr[j], cg[j], cb[j], ca[j]);
+    }
+
     bool isHighPrecision() { return m_useHighPrecision; }
     int highPrecisionSize() { return m_highPrecision.size(); }
 
   private:
+    static void addCount(std::size_t& value, const std::size_t count) {
+      if (value < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
+        value += count;
+      else
+        value = std::numeric_limits<std::size_t>::max();
+    }
+
+    void addHighPrecisionColor(const doc::color_t color) {
+      auto it = std::find(m_highPrecision.begin(), m_highPrecision.end(), color);
+
+      // The color is not in the high-precision table
+      if (it == m_highPrecision.end()) {
+        if (m_highPrecision.size() < 256) {
+          m_highPrecision.push_back(color);
+        }
+        else {
+          // In this case we reach the limit for the high-precision histogram.
+          m_useHighPrecision = false;
+        }
+      }
+    }
+
     // Converts input color in a index for the histogram. It reduces
     // each 8-bit component to the resolution given in the template
     // parameters.
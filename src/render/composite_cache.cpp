@@ -0,0 +1,99 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/composite_cache.h"
+
+#include "doc/image.h"
+
+namespace render {
+
+namespace {
+
+std::size_t tile_bytes(const CompositeCache::Tile& tile)
+{
+  if (tile.image)
+    return std::size_t(tile.image->rowBytes()) * tile.image->height();
+  else
+    return 0;
+}
+
+} // anonymous namespace
+
+bool CompositeCache::ItemState::operator==(const ItemState& o) const
+{
+  return (layer == o.layer &&
+          cel == o.cel &&
+          image == o.image &&
+          imageId == o.imageId &&
+          imageVersion == o.imageVersion &&
+          imageHash == o.imageHash &&
+          celBounds == o.celBounds &&
+          opacity == o.opacity &&
+          blendMode == o.blendMode &&
+          palette == o.palette &&
+          paletteModifications == o.paletteModifications);
+}
+
+bool CompositeCache::Key::operator==(const Key& o) const
+{
+  return (sprite == o.sprite &&
+          spriteId == o.spriteId &&
+          frame == o.frame &&
+          format == o.format &&
+          proj.zoom() == o.proj.zoom() &&
+          proj.pixelRatio().w == o.proj.pixelRatio().w &&
+          proj.pixelRatio().h == o.proj.pixelRatio().h &&
+          bgColor == o.bgColor &&
+          flags == o.flags &&
+          nonactiveLayersOpacity == o.nonactiveLayersOpacity &&
+          selectedLayerForOpacity == o.selectedLayerForOpacity &&
+          origin == o.origin);
+}
+
+CompositeCache::CompositeCache(const std::size_t maxBytes)
+  : m_maxBytes(maxBytes)
+{
+}
+
+CompositeCache::Tile& CompositeCache::tile(const Key& key)
+{
+  for (auto it=m_tiles.begin(); it!=m_tiles.end(); ++it) {
+    if (it->key == key) {
+      m_tiles.splice(m_tiles.begin(), m_tiles, it);
+      return m_tiles.front();
+    }
+  }
+  m_tiles.push_front(Tile{ key, {}, nullptr });
+  return m_tiles.front();
+}
+
+void CompositeCache::shrink()
+{
+  std::size_t total = bytes();
+  while (total > m_maxBytes && !m_tiles.empty()) {
+    total -= tile_bytes(m_tiles.back());
+    m_tiles.pop_back();
+  }
+}
+
+void CompositeCache::clear()
+{
+  m_tiles.clear();
+}
+
+std::size_t CompositeCache::bytes() const
+{
+  std::size_t total = 0;
+  for (const Tile& tile : m_tiles)
+    total += tile_bytes(tile);
+  return total;
+}
+
+} // namespace render
@@ -0,0 +1,129 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_COMPOSITE_CACHE_H_INCLUDED
+#define RENDER_COMPOSITE_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/blend_mode.h"
+#include "doc/color.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "doc/pixel_format.h"
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "render/projection.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace doc {
+  class Cel;
+  class Image;
+  class Layer;
+  class Palette;
+  class Sprite;
+}
+
+namespace render {
+
+  // Cache of the composition of the bottom layers of a sprite frame
+  // used by Render::renderSprite(). The canvas (in projected
+  // coordinates) is divided in tiles of kTileSize x kTileSize
+  // pixels, and each tile contains the background color and the
+  // first N rendered cels already composited (including the cels of
+  // the onion skin frames rendered behind or in front of the
+  // sprite). So when the user modifies the layer N (e.g. painting a
+  // stroke with a preview image) we only need to composite the layers
+  // N, N+1, etc. over the cached tiles.
+  //
+  // It must be used from one thread at the same time.
+  class CompositeCache {
+  public:
+    static constexpr int kTileSize = 256;
+
+    // Everything that can change the pixels of one rendered cel (the
+    // cel can be from the rendered frame or from an onion skin
+    // frame).
+    struct ItemState {
+      const doc::Layer* layer = nullptr;
+      const doc::Cel* cel = nullptr;
+      const doc::Image* image = nullptr;
+      doc::ObjectId imageId = 0;
+      doc::ObjectVersion imageVersion = 0;
+      uint32_t imageHash = 0;
+      gfx::Rect celBounds;
+      int opacity = 0;
+      doc::BlendMode blendMode = doc::BlendMode::NORMAL;
+      const doc::Palette* palette = nullptr;
+      int paletteModifications = 0;
+
+      bool operator==(const ItemState& o) const;
+      bool operator!=(const ItemState& o) const { return !operator==(o); }
+    };
+
+    // Render options and position of a tile.
+    struct Key {
+      const doc::Sprite* sprite = nullptr;
+      doc::ObjectId spriteId = 0;
+      doc::frame_t frame = 0;
+      doc::PixelFormat format = doc::IMAGE_RGB;
+      Projection proj;
+      doc::color_t bgColor = 0;
+      int flags = 0;
+      int nonactiveLayersOpacity = 255;
+      const doc::Layer* selectedLayerForOpacity = nullptr;
+      gfx::Point origin;      // Position of the tile in canvas coordinates
+
+      bool operator==(const Key& o) const;
+    };
+
+    struct Tile {
+      Key key;
+      // State of the composited cels (in rendering order)
+      std::vector<ItemState> items;
+      doc::ImageRef image;
+    };
+
+    // Number of tiles which cached composition could be re-used
+    // (hits) or had to be composited from the first cel (misses).
+    // Used to measure how effective the cache is.
+    struct Stats {
+      std::size_t hits = 0;
+      std::size_t misses = 0;
+    };
+
+    explicit CompositeCache(const std::size_t maxBytes = 64*1024*1024);
+
+    // Returns the tile with the given key, creating a new one (without
+    // image) if it doesn't exist. The returned tile is valid until
+    // the next call to shrink() or clear().
+    Tile& tile(const Key& key);
+
+    // Removes the least recently used tiles if the memory limit was
+    // exceeded.
+    void shrink();
+
+    void clear();
+
+    std::size_t bytes() const;
+
+    Stats& stats() { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+  private:
+    std::list<Tile> m_tiles;        // The most recently used first
+    std::size_t m_maxBytes;
+    Stats m_stats;
+  };
+
+} // namespace render
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,10 +14,98 @@
 #include "base/vector2d.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
+#include "doc/parallel.h"
 #include "render/dithering_matrix.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 namespace render {
 
+namespace {
+
+// Rows rendered by each parallel_for() chunk
+const int kRowsPerTask = 16;
+
+// Renders the gradient in "img" row by row (rows are rendered in
+// parallel). The "calcRow(y, f)" function must calculate the
+// gradient parameter "f" of each pixel of the row "y" (0.0 for c0,
+// 1.0 for c1). The parameters of a whole row are calculated in a
+// loop without branches so it can be vectorized by the compiler,
+// and then they are converted to colors.
+template<typename CalcRow>
+void render_rgba_gradient_rows(
+  doc::Image* img,
+  doc::color_t c0,
+  doc::color_t c1,
+  const render::DitheringMatrix& matrix,
+  CalcRow&& calcRow)
+{
+  // As we use non-premultiplied RGB values, we need correct RGB
+  // values on each stop. So in case that one color has alpha=0
+  // (complete transparent), use the RGB values of the
+  // non-transparent color in the other stop point.
+  if (doc::rgba_geta(c0) == 0 &&
+      doc::rgba_geta(c1) != 0) {
+    c0 = (c1 & doc::rgba_rgb_mask);
+  }
+  else if (doc::rgba_geta(c0) != 0 &&
+           doc::rgba_geta(c1) == 0) {
+    c1 = (c0 & doc::rgba_rgb_mask);
+  }
+
+  const int r0 = doc::rgba_getr(c0);
+  const int g0 = doc::rgba_getg(c0);
+  const int b0 = doc::rgba_getb(c0);
+  const int a0 = doc::rgba_geta(c0);
+
+  const int dr = doc::rgba_getr(c1) - r0;
+  const int dg = doc::rgba_getg(c1) - g0;
+  const int db = doc::rgba_getb(c1) - b0;
+  const int da = doc::rgba_geta(c1) - a0;
+
+  const int width = img->width();
+  const bool dither = (matrix.rows() != 1 || matrix.cols() != 1);
+  const int ditherMax = matrix.maxValue()+2;
+
+  // Prepare the whole image to be modified from several threads.
+  const doc::LockImageBits<doc::RgbTraits> bits(img, doc::Image::WriteLock);
+
+  doc::parallel_for(
+    0, img->height(), kRowsPerTask,
+    [=, &calcRow, &matrix](const int y1, const int y2){
+      // Local copies of the captured values (so the compiler knows
+      // that they cannot be modified through "dst" and the loops can
+      // be vectorized)
+      const int w = width;
+      const int r = r0, g = g0, b = b0, a = a0;
+
+      std::vector<double> f(w);
+      for (int y=y1; y<y2; ++y) {
+        calcRow(y, f.data());
+
+        auto dst = (doc::RgbTraits::address_t)img->getPixelAddress(0, y);
+        if (!dither) {
+          for (int x=0; x<w; ++x) {
+            // Clamping "f" gives exactly c0 (f < 0) or c1 (f > 1)
+            const double t = std::clamp(f[x], 0.0, 1.0);
+            dst[x] = doc::rgba(int(r + t*dr + 1e-7),
+                               int(g + t*dg + 1e-7),
+                               int(b + t*db + 1e-7),
+                               int(a + t*da + 1e-7));
+          }
+        }
+        else {
+          for (int x=0; x<w; ++x)
+            dst[x] = (f[x]*ditherMax < matrix(y, x)+1 ? c0: c1);
+        }
+      }
+    });
+}
+
+} // anonymous namespace
+
 void render_rgba_gradient(
   doc::Image* img,
   const gfx::Point imgPos,
@@ -66,68 +154,17 @@ void render_rgba_linear_gradient(
   const double wmag = w.magnitude();
   w = w.normalize();
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
-
-  const uint8_t r0 = doc::rgba_getr(c0);
-  const uint8_t g0 = doc::rgba_getg(c0);
-  const uint8_t b0 = doc::rgba_getb(c0);
-  const uint8_t a0 = doc::rgba_geta(c0);
-
-  const uint8_t r1 = doc::rgba_getr(c1);
-  const uint8_t g1 = doc::rgba_getg(c1);
-  const uint8_t b1 = doc::rgba_getb(c1);
-  const uint8_t a1 = doc::rgba_geta(c1);
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
+  // f = ((imgPos + (x, y) - u) * w) / wmag, where the "y" term is
+  // the same for the whole row.
   const int width = img->width();
-  const int height = img->height();
-
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(r0 + f*(r1-r0) + 1e-7),
-                        int(g0 + f*(g1-g0) + 1e-7),
-                        int(b0 + f*(b1-b0) + 1e-7),
-                        int(a0 + f*(a1-a0) + 1e-7));
-        }
-
-        *it = c;
-      }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
-      }
-    }
-  }
+  const double qx0 = imgPos.x - u.x;
+  render_rgba_gradient_rows(
+    img, c0, c1, matrix,
+    [=](const int y, double* f){
+      const double qyw = (imgPos.y+y - u.y) * w.y;
+      for (int x=0; x<width; ++x)
+        f[x] = ((qx0+x)*w.x + qyw) / wmag;
+    });
 }
 
 void render_rgba_radial_gradient(
@@ -157,72 +194,23 @@ void render_rgba_radial_gradient(
     return;
   }
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
-
-  const uint8_t r0 = doc::rgba_getr(c0);
-  const uint8_t g0 = doc::rgba_getg(c0);
-  const uint8_t b0 = doc::rgba_getb(c0);
-  const uint8_t a0 = doc::rgba_geta(c0);
-
-  const uint8_t r1 = doc::rgba_getr(c1);
-  const uint8_t g1 = doc::rgba_getg(c1);
-  const uint8_t b1 = doc::rgba_getb(c1);
-  const uint8_t a1 = doc::rgba_geta(c1);
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
+  // f = |(imgPos + (x, y) - center) / |w||, where the "y" term is
+  // the same for the whole row.
+  const base::Vector2d<double> center = (u+v)/2;
+  const double wx = std::fabs(w.x);
+  const double wy = std::fabs(w.y);
   const int width = img->width();
-  const int height = img->height();
-
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(r0 + f*(r1-r0) + 1e-7),
-                        int(g0 + f*(g1-g0) + 1e-7),
-                        int(b0 + f*(b1-b0) + 1e-7),
-                        int(a0 + f*(a1-a0) + 1e-7));
-        }
-
-        *it = c;
+  const double qx0 = imgPos.x - center.x;
+  render_rgba_gradient_rows(
+    img, c0, c1, matrix,
+    [=](const int y, double* f){
+      const double qy = (imgPos.y+y - center.y) / wy;
+      const double qy2 = qy*qy;
+      for (int x=0; x<width; ++x) {
+        const double qx = (qx0+x) / wx;
+        f[x] = std::sqrt(qx*qx + qy2);
       }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
-      }
-    }
-  }
+    });
 }
 
 template<typename ImageTraits>
@@ -0,0 +1,124 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/gradient.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "render/dithering_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace doc;
+using namespace render;
+
+namespace {
+
+// Per-pixel gradient parameter (0.0 for c0, 1.0 for c1) calculated
+// as in the original gradient implementation.
+double gradient_param(const GradientType type,
+                      const gfx::Point& pos,
+                      const gfx::Point& p0,
+                      const gfx::Point& p1)
+{
+  if (type == GradientType::Linear) {
+    const double wx = p1.x - p0.x;
+    const double wy = p1.y - p0.y;
+    const double wmag = std::sqrt(wx*wx + wy*wy);
+    return ((pos.x - p0.x)*(wx/wmag) + (pos.y - p0.y)*(wy/wmag)) / wmag;
+  }
+  else {
+    const double qx = (pos.x - (p0.x + p1.x) / 2.0) / std::fabs((p1.x - p0.x) / 2.0);
+    const double qy = (pos.y - (p0.y + p1.y) / 2.0) / std::fabs((p1.y - p0.y) / 2.0);
+    return std::sqrt(qx*qx + qy*qy);
+  }
+}
+
+void test_gradient(const GradientType type,
+                   const DitheringMatrix& matrix)
+{
+  const gfx::Point imgPos(3, 5);
+  const gfx::Point p0(10, 4), p1(50, 36);
+  const color_t c0 = rgba(255, 0, 32, 255);
+  const color_t c1 = rgba(0, 128, 255, 64);
+
+  ImageRef img(Image::create(IMAGE_RGB, 61, 43));
+  render_rgba_gradient(img.get(), imgPos, p0, p1, c0, c1, matrix, type);
+
+  const bool dither = (matrix.rows() != 1 || matrix.cols() != 1);
+  for (int y=0; y<img->height(); ++y) {
+    for (int x=0; x<img->width(); ++x) {
+      const double f = gradient_param(type, imgPos + gfx::Point(x, y), p0, p1);
+      color_t expected;
+      if (dither) {
+        expected = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
+      }
+      else {
+        const double t = std::clamp(f, 0.0, 1.0);
+        expected = rgba(int(rgba_getr(c0) + t*(rgba_getr(c1)-rgba_getr(c0)) + 1e-7),
+                        int(rgba_getg(c0) + t*(rgba_getg(c1)-rgba_getg(c0)) + 1e-7),
+                        int(rgba_getb(c0) + t*(rgba_getb(c1)-rgba_getb(c0)) + 1e-7),
+                        int(rgba_geta(c0) + t*(rgba_geta(c1)-rgba_geta(c0)) + 1e-7));
+      }
+      // Allow differences of one unit per channel in pixels where
+      // the parameter is just in the limit of a rounding step.
+      const color_t c = get_pixel(img.get(), x, y);
+      EXPECT_NEAR(int(rgba_getr(expected)), int(rgba_getr(c)), 1) << x << "," << y;
+      EXPECT_NEAR(int(rgba_getg(expected)), int(rgba_getg(c)), 1) << x << "," << y;
+      EXPECT_NEAR(int(rgba_getb(expected)), int(rgba_getb(c)), 1) << x << "," << y;
+      EXPECT_NEAR(int(rgba_geta(expected)), int(rgba_geta(c)), 1) << x << "," << y;
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(Gradient, Linear)
+{
+  test_gradient(GradientType::Linear, DitheringMatrix());
+}
+
+TEST(Gradient, Radial)
+{
+  test_gradient(GradientType::Radial, DitheringMatrix());
+}
+
+TEST(Gradient, Dithering)
+{
+  BayerMatrix matrix(4);
+  test_gradient(GradientType::Linear, matrix);
+  test_gradient(GradientType::Radial, matrix);
+}
+
+TEST(Gradient, EmptyVector)
+{
+  ImageRef img(Image::create(IMAGE_RGB, 8, 8));
+  const color_t c0 = rgba(255, 0, 0, 255);
+  const color_t c1 = rgba(0, 0, 255, 255);
+  render_rgba_linear_gradient(img.get(), gfx::Point(0, 0),
+                              gfx::Point(4, 4), gfx::Point(4, 4),
+                              c0, c1, DitheringMatrix());
+  EXPECT_EQ(c0, get_pixel(img.get(), 7, 7));
+
+  render_rgba_radial_gradient(img.get(), gfx::Point(0, 0),
+                              gfx::Point(4, 4), gfx::Point(4, 4),
+                              c0, c1, DitheringMatrix());
+  EXPECT_EQ(c1, get_pixel(img.get(), 7, 7));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
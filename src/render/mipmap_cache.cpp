@@ -0,0 +1,265 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/mipmap_cache.h"
+
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/image_rows.h"
+#include "doc/parallel.h"
+
+#include <algorithm>
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+// Number of rows generated by each parallel task
+const int kRowsPerTask = 32;
+
+// Copies the pixel (x<<shift, y<<shift) of "src" into (x, y) of "dst"
+template<typename ImageTraits>
+void reduce_image(Image* dst, const Image* src, const int shift)
+{
+  using address_t = typename ImageTraits::address_t;
+
+  const int w = dst->width();
+  parallel_for(
+    0, dst->height(), kRowsPerTask,
+    [dst, src, shift, w](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const auto srcRow = get_row_view<ImageTraits>(src, 0, y << shift, ((w-1) << shift) + 1);
+        const RowView<ImageTraits> dstRow(
+          (address_t)dst->getPixelAddress(0, y), 0, y, w);
+        for (int x=0; x<w; ++x)
+          dstRow.put(x, srcRow[x << shift]);
+      }
+    });
+}
+
+ImageRef create_level(const Image* src, const int shift)
+{
+  ImageSpec spec = src->spec();
+  spec.setSize(src->width() >> shift, src->height() >> shift);
+  ImageRef dst(Image::create(spec));
+
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       reduce_image<RgbTraits>(dst.get(), src, shift); break;
+    case IMAGE_GRAYSCALE: reduce_image<GrayscaleTraits>(dst.get(), src, shift); break;
+    case IMAGE_INDEXED:   reduce_image<IndexedTraits>(dst.get(), src, shift); break;
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+  return dst;
+}
+
+// Samples the nearest pixel of "src" for each pixel of "dst" (the
+// same pixels that composite_image_general() would sample)
+template<typename ImageTraits>
+void resample_image(Image* dst, const Image* src)
+{
+  using address_t = typename ImageTraits::address_t;
+
+  const int w = dst->width();
+  const int srcW = src->width();
+  const int srcH = src->height();
+  const double sx = double(srcW) / double(w);
+  const double sy = double(srcH) / double(dst->height());
+  parallel_for(
+    0, dst->height(), kRowsPerTask,
+    [dst, src, w, srcW, srcH, sx, sy](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const int srcY = std::min(int(sy*y), srcH-1);
+        const auto srcRow = get_row_view<ImageTraits>(src, 0, srcY, srcW);
+        const RowView<ImageTraits> dstRow(
+          (address_t)dst->getPixelAddress(0, y), 0, y, w);
+        for (int x=0; x<w; ++x)
+          dstRow.put(x, srcRow[std::min(int(sx*x), srcW-1)]);
+      }
+    });
+}
+
+ImageRef create_resampled(const Image* src, const gfx::Size& size)
+{
+  ImageSpec spec = src->spec();
+  spec.setSize(size);
+  ImageRef dst(Image::create(spec));
+
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       resample_image<RgbTraits>(dst.get(), src); break;
+    case IMAGE_GRAYSCALE: resample_image<GrayscaleTraits>(dst.get(), src); break;
+    case IMAGE_INDEXED:   resample_image<IndexedTraits>(dst.get(), src); break;
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+  return dst;
+}
+
+std::size_t level_bytes(const Image* image)
+{
+  return std::size_t(image->rowBytes()) * image->height();
+}
+
+} // anonymous namespace
+
+MipmapCache::MipmapCache(const std::size_t maxBytes)
+  : m_bytes(0)
+  , m_maxBytes(maxBytes)
+{
+}
+
+// static
+bool MipmapCache::isValidImage(const Image* image)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+    case IMAGE_GRAYSCALE:
+    case IMAGE_INDEXED:
+      return (image->width()*image->height() >= kMinImagePixels);
+    default:
+      return false;
+  }
+}
+
+ImageRef MipmapCache::get(const Image* image,
+                          const int level,
+                          const bool onlyCached)
+{
+  ASSERT(isValidImage(image));
+  ASSERT(level >= kMinLevel && level <= kMaxLevel);
+
+  if ((image->width() >> level) < 1 ||
+      (image->height() >> level) < 1)
+    return nullptr;
+
+  // The content hash cannot be calculated from several threads
+  if (onlyCached && !image->hasContentHash())
+    return nullptr;
+
+  const ObjectId id = image->id();
+  const ObjectVersion version = image->version();
+  const uint32_t hash = image->contentHash();
+  const ImageSpec spec = image->spec();
+
+  const std::lock_guard lock(m_mutex);
+
+  // Finer level of the same image to generate the new one
+  const Entry* finer = nullptr;
+
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    if (it->id != id ||
+        it->version != version ||
+        it->hash != hash ||
+        it->spec != spec)
+      continue;
+
+    if (it->level == level) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->mipmap;
+    }
+    if (it->level >= kMinLevel &&
+        it->level < level &&
+        (!finer || it->level > finer->level))
+      finer = &(*it);
+  }
+
+  if (onlyCached)
+    return nullptr;
+
+  ImageRef mipmap;
+  if (finer) {
+    mipmap = create_level(finer->mipmap.get(), level - finer->level);
+    ASSERT(mipmap->width() == image->width() >> level);
+    ASSERT(mipmap->height() == image->height() >> level);
+  }
+  else {
+    mipmap = create_level(image, level);
+  }
+  if (!mipmap)
+    return nullptr;
+
+  addEntry(Entry{ id, version, hash, spec, level, mipmap });
+  return mipmap;
+}
+
+ImageRef MipmapCache::getResampled(const Image* image,
+                                   const gfx::Size& size,
+                                   const bool onlyCached)
+{
+  ASSERT(isValidImage(image));
+
+  if (size.w < 1 || size.w >= image->width() ||
+      size.h < 1 || size.h >= image->height())
+    return nullptr;
+
+  // Big resampled images would remove all the other entries
+  const std::size_t bytes =
+    std::size_t(size.w) * image->bytesPerPixel() * size.h;
+  if (bytes > m_maxBytes / 4)
+    return nullptr;
+
+  // The content hash cannot be calculated from several threads
+  if (onlyCached && !image->hasContentHash())
+    return nullptr;
+
+  const ObjectId id = image->id();
+  const ObjectVersion version = image->version();
+  const uint32_t hash = image->contentHash();
+  const ImageSpec spec = image->spec();
+
+  const std::lock_guard lock(m_mutex);
+
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    if (it->id == id &&
+        it->version == version &&
+        it->hash == hash &&
+        it->spec == spec &&
+        it->level == kResampled &&
+        it->mipmap->size() == size) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->mipmap;
+    }
+  }
+
+  if (onlyCached)
+    return nullptr;
+
+  ImageRef resampled = create_resampled(image, size);
+  if (!resampled)
+    return nullptr;
+
+  addEntry(Entry{ id, version, hash, spec, kResampled, resampled });
+  return resampled;
+}
+
+void MipmapCache::addEntry(Entry&& entry)
+{
+  m_bytes += level_bytes(entry.mipmap.get());
+  m_entries.push_front(std::move(entry));
+
+  // Remove the least recently used entries (but not the new one)
+  while (m_bytes > m_maxBytes && m_entries.size() > 1) {
+    m_bytes -= level_bytes(m_entries.back().mipmap.get());
+    m_entries.pop_back();
+  }
+}
+
+void MipmapCache::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_bytes = 0;
+}
+
+} // namespace render
@@ -0,0 +1,100 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_MIPMAP_CACHE_H_INCLUDED
+#define RENDER_MIPMAP_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/image_spec.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "gfx/size.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+
+namespace doc {
+  class Image;
+}
+
+namespace render {
+
+  // Cache of reduced versions of big images used to render them
+  // zoomed out. The level N of an image contains one pixel of each
+  // 2^N x 2^N block of the original image (the pixel in its top-left
+  // corner), so the nearest neighbor sampling of the level N with a
+  // 2^N times smaller step gives exactly the same result than
+  // sampling the original image, but reading a lot less memory.
+  //
+  // Levels are identified by the image ID, version and content hash,
+  // so an image modified through any doc::Image function (or a
+  // doc::cmd) will generate a new level. Images that are modified
+  // directly without invalidating its content hash (e.g. temporary
+  // preview images) must not be used with this cache.
+  class MipmapCache {
+  public:
+    // Levels 0 and 1 are not worth the memory
+    static constexpr int kMinLevel = 2;
+    static constexpr int kMaxLevel = 8;
+
+    // Smaller images are sampled directly
+    static constexpr int kMinImagePixels = 256*256;
+
+    explicit MipmapCache(const std::size_t maxBytes = 128*1024*1024);
+
+    // Returns true if the given image can have mipmaps.
+    static bool isValidImage(const doc::Image* image);
+
+    // Returns the given level of the image. If the level is not
+    // cached it's generated (using the worker threads), except if
+    // "onlyCached" is true (then nullptr is returned). This function
+    // can be called from several threads at the same time only with
+    // onlyCached=true.
+    doc::ImageRef get(const doc::Image* image,
+                      const int level,
+                      const bool onlyCached = false);
+
+    // Returns a version of the image resampled (nearest neighbor) to
+    // the given smaller size. It's used to render reference layers
+    // (big images scaled to the sprite bounds) one time for each
+    // zoom level instead of sampling the original image in each
+    // paint. Returns nullptr if the resampled image would use too
+    // much of the cache memory.
+    doc::ImageRef getResampled(const doc::Image* image,
+                               const gfx::Size& size,
+                               const bool onlyCached = false);
+
+    void clear();
+
+    std::size_t bytes() const { return m_bytes; }
+
+  private:
+    // Level of the entries created with getResampled()
+    static constexpr int kResampled = -1;
+
+    struct Entry {
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      uint32_t hash;
+      doc::ImageSpec spec;
+      int level;
+      doc::ImageRef mipmap;
+    };
+
+    void addEntry(Entry&& entry);
+
+    std::mutex m_mutex;
+    std::list<Entry> m_entries;    // The most recently used first
+    std::size_t m_bytes;
+    std::size_t m_maxBytes;
+  };
+
+} // namespace render
+
+#endif
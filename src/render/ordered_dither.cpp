@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,15 +11,21 @@
 
 #include "render/ordered_dither.h"
 
+#include "doc/parallel.h"
 #include "render/dithering.h"
 #include "render/dithering_matrix.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <mutex>
 #include <vector>
 
 namespace render {
 
+// Rows dithered by each parallel_for() chunk (1D algorithms only).
+static const int kRowsPerTask = 16;
+
 // Base 2x2 dither matrix, called D(2):
 int BayerMatrix::D2[4] = { 0, 2,
                            3, 1 };
@@ -40,6 +46,52 @@ static int colorDistance(int r1, int g1, int b1, int a1,
   return result;
 }
 
+// Maps the "n" colors to palette indexes at once (the same indexes
+// that RgbMap::mapColor() or Palette::findBestfit() would return).
+static void mapColors(const doc::color_t* colors,
+                      uint8_t* indexes,
+                      const int n,
+                      const doc::RgbMap* rgbmap,
+                      const doc::Palette* palette,
+                      const int transparentIndex)
+{
+  if (rgbmap) {
+    rgbmap->mapColors(colors, indexes, n);
+  }
+  else {
+    for (int i=0; i<n; ++i) {
+      const doc::color_t c = colors[i];
+      indexes[i] = palette->findBestfit(doc::rgba_getr(c),
+                                        doc::rgba_getg(c),
+                                        doc::rgba_getb(c),
+                                        doc::rgba_geta(c),
+                                        transparentIndex);
+    }
+  }
+}
+
+// Thresholds of the row "y" of the matrix (one per column)
+static std::vector<int> rowThresholds(const DitheringMatrix& matrix,
+                                      const int y)
+{
+  std::vector<int> thresholds(matrix.cols());
+  for (int j=0; j<matrix.cols(); ++j)
+    thresholds[j] = matrix(y, j);
+  return thresholds;
+}
+
+void DitheringAlgorithmBase::ditherRgbRowToIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t* src,
+  uint8_t* dst,
+  const int x, const int y, const int n,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette)
+{
+  for (int i=0; i<n; ++i)
+    dst[i] = ditherRgbPixelToIndex(matrix, src[i], x+i, y, rgbmap, palette);
+}
+
 OrderedDither::OrderedDither(int transparentIndex)
   : m_transparentIndex(transparentIndex)
 {
@@ -119,6 +171,82 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
                           nearest1idx);
 }
 
+void OrderedDither::ditherRgbRowToIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t* src,
+  uint8_t* dst,
+  const int x, const int y, const int n,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette)
+{
+  // Same algorithm as ditherRgbPixelToIndex() but first we map the
+  // nearest colors of the whole row, then the colors with the
+  // opposite error, and finally we compare the distances with the
+  // thresholds of the matrix row.
+  std::vector<uint8_t> nearest1(n);
+  mapColors(src, nearest1.data(), n, rgbmap, palette, m_transparentIndex);
+
+  std::vector<doc::color_t> colors2(n);
+  for (int i=0; i<n; ++i) {
+    const doc::color_t c = src[i];
+    const doc::color_t c1 = palette->getEntry(nearest1[i]);
+    colors2[i] = doc::rgba(
+      std::clamp(2*doc::rgba_getr(c) - doc::rgba_getr(c1), 0, 255),
+      std::clamp(2*doc::rgba_getg(c) - doc::rgba_getg(c1), 0, 255),
+      std::clamp(2*doc::rgba_getb(c) - doc::rgba_getb(c1), 0, 255),
+      std::clamp(2*doc::rgba_geta(c) - doc::rgba_geta(c1), 0, 255));
+  }
+
+  std::vector<uint8_t> nearest2(n);
+  mapColors(colors2.data(), nearest2.data(), n, rgbmap, palette, m_transparentIndex);
+
+  const std::vector<int> thresholds = rowThresholds(matrix, y);
+  const int maxValue = matrix.maxValue();
+  int j = x % matrix.cols();
+
+  for (int i=0; i<n; ++i, j=(j+1 < matrix.cols() ? j+1: 0)) {
+    const doc::color_t c = src[i];
+    const int a = doc::rgba_geta(c);
+
+    // Alpha=0, output transparent color
+    if (m_transparentIndex >= 0 && a == 0) {
+      dst[i] = m_transparentIndex;
+      continue;
+    }
+
+    // Both nearest colors use the same index, no dither possible
+    if (nearest1[i] == nearest2[i]) {
+      dst[i] = nearest1[i];
+      continue;
+    }
+
+    const doc::color_t c1 = palette->getEntry(nearest1[i]);
+    const doc::color_t c2 = palette->getEntry(nearest2[i]);
+    const int r1 = doc::rgba_getr(c1);
+    const int g1 = doc::rgba_getg(c1);
+    const int b1 = doc::rgba_getb(c1);
+    const int a1 = doc::rgba_geta(c1);
+
+    int d = colorDistance(r1, g1, b1, a1,
+                          doc::rgba_getr(c),
+                          doc::rgba_getg(c),
+                          doc::rgba_getb(c), a);
+    const int D = colorDistance(r1, g1, b1, a1,
+                                doc::rgba_getr(c2),
+                                doc::rgba_getg(c2),
+                                doc::rgba_getb(c2),
+                                doc::rgba_geta(c2));
+    if (D == 0) {
+      dst[i] = nearest1[i];
+      continue;
+    }
+
+    d = maxValue * d / D;
+    dst[i] = (d > thresholds[j] ? nearest2[i]:
+                                  nearest1[i]);
+  }
+}
+
 OrderedDither2::OrderedDither2(int transparentIndex)
   : m_transparentIndex(transparentIndex)
 {
@@ -227,6 +355,114 @@ doc::color_t OrderedDither2::ditherRgbPixelToIndex(
     return index;
 }
 
+void OrderedDither2::ditherRgbRowToIndex(
+  const DitheringMatrix& matrix,
+  const doc::color_t* src,
+  uint8_t* dst,
+  const int x, const int y, const int n,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette)
+{
+  // Best palette entry for each color of the row
+  std::vector<uint8_t> nearest(n);
+  mapColors(src, nearest.data(), n, rgbmap, palette, m_transparentIndex);
+
+  // RGBA components of the palette entries
+  const int npal = palette->size();
+  std::vector<int> pal(4*npal);
+  for (int i=0; i<npal; ++i) {
+    const doc::color_t c = palette->getEntry(i);
+    pal[4*i  ] = doc::rgba_getr(c);
+    pal[4*i+1] = doc::rgba_getg(c);
+    pal[4*i+2] = doc::rgba_getb(c);
+    pal[4*i+3] = doc::rgba_geta(c);
+  }
+
+  const std::vector<int> thresholds = rowThresholds(matrix, y);
+  const int maxMixValue = matrix.maxValue();
+  int j = x % matrix.cols();
+
+  // The best mix depends only on the color, so it's reused for runs
+  // of pixels with the same color (only the threshold changes).
+  doc::color_t lastColor = 0;
+  int bestMix = 0;
+  int altIndex = -1;
+  bool hasLast = false;
+
+  for (int k=0; k<n; ++k, j=(j+1 < matrix.cols() ? j+1: 0)) {
+    const doc::color_t color = src[k];
+    const int a = doc::rgba_geta(color);
+
+    // Alpha=0, output transparent color
+    if (m_transparentIndex >= 0 && a == 0) {
+      dst[k] = m_transparentIndex;
+      continue;
+    }
+
+    const int index = nearest[k];
+    if (!hasLast || color != lastColor) {
+      const int r = doc::rgba_getr(color);
+      const int g = doc::rgba_getg(color);
+      const int b = doc::rgba_getb(color);
+      const doc::color_t color0 = palette->getEntry(index);
+      const int r0 = doc::rgba_getr(color0);
+      const int g0 = doc::rgba_getg(color0);
+      const int b0 = doc::rgba_getb(color0);
+      const int a0 = doc::rgba_geta(color0);
+
+      // Same search as ditherRgbPixelToIndex()
+      bestMix = 0;
+      altIndex = -1;
+      int closestDistance = std::numeric_limits<int>::max();
+      for (int i=0; i<npal; ++i) {
+        if (i == m_transparentIndex)
+          continue;
+
+        const int r1 = pal[4*i  ];
+        const int g1 = pal[4*i+1];
+        const int b1 = pal[4*i+2];
+        const int a1 = pal[4*i+3];
+
+        int mix = 0;
+        int div = 0;
+        if (a && a0 && a1) {
+          if (r1-r0) mix += 2126 * maxMixValue * (r-r0) / (r1-r0), div += 2126;
+          if (g1-g0) mix += 7152 * maxMixValue * (g-g0) / (g1-g0), div += 7152;
+          if (b1-b0) mix +=  722 * maxMixValue * (b-b0) / (b1-b0), div +=  722;
+        }
+        if (a1-a0) mix += 20000 * maxMixValue * (a-a0) / (a1-a0), div += 20000;
+        if (mix) {
+          if (div)
+            mix /= div;
+          mix = std::clamp(mix, 0, maxMixValue);
+        }
+
+        const int rM = r0 + (r1-r0) * mix / maxMixValue;
+        const int gM = g0 + (g1-g0) * mix / maxMixValue;
+        const int bM = b0 + (b1-b0) * mix / maxMixValue;
+        const int aM = a0 + (a1-a0) * mix / maxMixValue;
+        const int d =
+          colorDistance(r, g, b, a, rM, gM, bM, aM)
+          + colorDistance(r0, g0, b0, a0, r1, g1, b1, a1) / 10;
+
+        if (closestDistance > d) {
+          closestDistance = d;
+          bestMix = mix;
+          altIndex = i;
+        }
+      }
+
+      lastColor = color;
+      hasLast = true;
+    }
+
+    if (altIndex >= 0 && thresholds[j] < bestMix)
+      dst[k] = altIndex;
+    else
+      dst[k] = index;
+  }
+}
+
 void dither_rgb_image_to_indexed(
   DitheringAlgorithmBase& algorithm,
   const Dithering& dithering,
@@ -242,29 +478,44 @@ void dither_rgb_image_to_indexed(
   algorithm.start(srcImage, dstImage, dithering.factor());
 
   if (algorithm.dimensions() == 1) {
-    const doc::LockImageBits<doc::RgbTraits> srcBits(srcImage);
+    // Touches the destination bits to unshare its tiles and
+    // invalidate its content hash
     doc::LockImageBits<doc::IndexedTraits> dstBits(dstImage);
-    auto srcIt = srcBits.begin();
-    auto dstIt = dstBits.begin();
 
-    for (int y=0; y<h; ++y) {
-      for (int x=0; x<w; ++x, ++srcIt, ++dstIt) {
-        ASSERT(srcIt != srcBits.end());
-        ASSERT(dstIt != dstBits.end());
-        *dstIt = algorithm.ditherRgbPixelToIndex(
-          dithering.matrix(), *srcIt, x, y, rgbmap, palette);
+    // Each pixel depends only on its source color, so rows can be
+    // dithered in parallel if the rgbmap can be used from several
+    // threads.
+    const bool parallel = (!rgbmap || rgbmap->isThreadSafe());
+    const DitheringMatrix matrix = dithering.matrix();
+    std::mutex mutex;
+    std::atomic<bool> canceled = false;
+    int rowsDone = 0;
+
+    auto ditherRows = [&](const int y1, const int y2){
+      for (int y=y1; y<y2 && !canceled; ++y) {
+        algorithm.ditherRgbRowToIndex(
+          matrix,
+          doc::get_pixel_address_fast<doc::RgbTraits>(srcImage, 0, y),
+          doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, y),
+          0, y, w, rgbmap, palette);
 
         if (delegate) {
+          const std::lock_guard lock(mutex);
           if (!delegate->continueTask())
-            return;
+            canceled = true;
+          else
+            delegate->notifyTaskProgress(double(++rowsDone) / double(h));
         }
       }
+    };
 
-      if (delegate) {
-        delegate->notifyTaskProgress(
-          double(y+1) / double(h));
-      }
-    }
+    if (parallel)
+      doc::parallel_for(0, h, kRowsPerTask, ditherRows);
+    else
+      ditherRows(0, h);
+
+    if (canceled)
+      return;
   }
   else {
     auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, 0);
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -36,6 +36,9 @@ namespace render {
 
     virtual void finish() { }
 
+    // Used by 1D algorithms. It can be called from several threads
+    // at the same time (for different pixels) when the given rgbmap
+    // is thread-safe (or there is no rgbmap).
     virtual doc::color_t ditherRgbPixelToIndex(
       const DitheringMatrix& matrix,
       const doc::color_t color,
@@ -43,6 +46,20 @@ namespace render {
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) { return 0; }
 
+    // Dithers the "n" pixels of the row "y" starting at column "x"
+    // (used by 1D algorithms). It must give the same result as
+    // calling ditherRgbPixelToIndex() for each pixel, but
+    // implementations can map all the colors of the row at once. It
+    // can be called from several threads like
+    // ditherRgbPixelToIndex().
+    virtual void ditherRgbRowToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int x, const int y, const int n,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette);
+
     virtual doc::color_t ditherRgbToIndex2D(
       const int x, const int y,
       const doc::RgbMap* rgbmap,
@@ -59,6 +76,13 @@ namespace render {
       const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
+    void ditherRgbRowToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int x, const int y, const int n,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette) override;
   private:
     int m_transparentIndex;
   };
@@ -73,6 +97,13 @@ namespace render {
       const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
+    void ditherRgbRowToIndex(
+      const DitheringMatrix& matrix,
+      const doc::color_t* src,
+      uint8_t* dst,
+      const int x, const int y, const int n,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette) override;
   private:
     int m_transparentIndex;
   };
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,9 +11,14 @@
 
 #include <gtest/gtest.h>
 
+#include "doc/palette.h"
+#include "doc/rgbmap_kdtree.h"
 #include "render/dithering_matrix.h"
 #include "render/ordered_dither.h"
 
+#include <cstdlib>
+#include <vector>
+
 using namespace doc;
 using namespace render;
 
@@ -65,6 +70,65 @@ TEST(BayerMatrix, CheckD8)
       EXPECT_EQ(expected[c++], matrix(i, j));
 }
 
+// ditherRgbRowToIndex() must give the same result as calling
+// ditherRgbPixelToIndex() for each pixel.
+template<typename Algorithm>
+void test_dither_rows(const int transparentIndex)
+{
+  Palette::initBestfit();
+  Palette palette(0, 40);
+  for (int i=0; i<palette.size(); ++i)
+    palette.setEntry(i, rgba(std::rand() % 256,
+                             std::rand() % 256,
+                             std::rand() % 256,
+                             (i % 7) ? 255: std::rand() % 256));
+
+  RgbMapKdTree rgbmap;
+  rgbmap.regenerateMap(&palette, std::max(transparentIndex, 0));
+
+  // Random colors with runs of the same color and transparent pixels
+  std::vector<color_t> src;
+  while (src.size() < 300) {
+    const color_t c = rgba(std::rand() % 256,
+                           std::rand() % 256,
+                           std::rand() % 256,
+                           (std::rand() % 4) ? 255: std::rand() % 256);
+    for (int j=std::rand()%4; j>=0; --j)
+      src.push_back(c);
+  }
+  const int n = int(src.size());
+
+  Algorithm algorithm(transparentIndex);
+  for (const RgbMap* map : { (const RgbMap*)&rgbmap, (const RgbMap*)nullptr }) {
+    for (int size : { 2, 4, 8 }) {
+      const BayerMatrix matrix(size);
+      for (int x : { 0, 3 }) {
+        for (int y=0; y<size; ++y) {
+          std::vector<uint8_t> row(n);
+          algorithm.ditherRgbRowToIndex(matrix, src.data(), row.data(),
+                                        x, y, n, map, &palette);
+          for (int i=0; i<n; ++i) {
+            ASSERT_EQ(algorithm.ditherRgbPixelToIndex(matrix, src[i], x+i, y, map, &palette),
+                      row[i]) << "i=" << i << " x=" << x << " y=" << y;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(OrderedDither, RowsAsPixels)
+{
+  test_dither_rows<OrderedDither>(-1);
+  test_dither_rows<OrderedDither>(0);
+}
+
+TEST(OrderedDither2, RowsAsPixels)
+{
+  test_dither_rows<OrderedDither2>(-1);
+  test_dither_rows<OrderedDither2>(0);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "doc/layer.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
@@ -25,9 +26,11 @@
 #include "render/task_delegate.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace render {
@@ -35,6 +38,166 @@ namespace render {
 using namespace doc;
 using namespace gfx;
 
+namespace {
+
+// Renders the given range of frames and feeds the octree with them.
+// Chunks of frames are rendered in parallel, each one fed in its own
+// octree that is merged into "octreemap" later (which gives the same
+// octree as feeding all frames serially). Returns false if the task
+// was canceled.
+bool feed_octree_with_frames(OctreeMap& octreemap,
+                             const Sprite* sprite,
+                             const frame_t fromFrame,
+                             const frame_t toFrame,
+                             const bool withAlpha,
+                             const bool newBlend,
+                             const color_t maskColor,
+                             const int levelDeep,
+                             TaskDelegate* delegate)
+{
+  const int nframes = toFrame-fromFrame+1;
+  const int grain = std::max(1, nframes / (4*parallel_concurrency()));
+  std::mutex mutex;
+  std::atomic<bool> canceled = false;
+  int framesDone = 0;
+
+  parallel_for(fromFrame, toFrame+1, grain, [&](const int begin, const int end){
+    ImageRef flat_image(Image::create(IMAGE_RGB,
+                                      sprite->width(), sprite->height()));
+    render::Render render;
+    render.setNewBlend(newBlend);
+
+    OctreeMap partial;
+    for (frame_t frame=begin; frame<end && !canceled; ++frame) {
+      render.renderSprite(flat_image.get(), sprite, frame);
+      partial.feedWithImage(flat_image.get(), withAlpha, maskColor, levelDeep);
+
+      if (delegate) {
+        const std::lock_guard lock(mutex);
+        if (!delegate->continueTask())
+          canceled = true;
+        else
+          delegate->notifyTaskProgress(double(++framesDone) / double(nframes));
+      }
+    }
+
+    if (!canceled) {
+      const std::lock_guard lock(mutex);
+      octreemap.merge(partial);
+    }
+  });
+
+  return !canceled;
+}
+
+// Renders the given range of frames and feeds the optimizer with them.
+// Like feed_octree_with_frames(), contiguous chunks of frames are
+// rendered in parallel in their own optimizer, and then merged in
+// order. Returns false if the task was canceled.
+bool feed_optimizer_with_frames(PaletteOptimizer& optimizer,
+                                const Sprite* sprite,
+                                const frame_t fromFrame,
+                                const frame_t toFrame,
+                                const bool withAlpha,
+                                const bool newBlend,
+                                TaskDelegate* delegate)
+{
+  const int nframes = toFrame-fromFrame+1;
+  // Each optimizer has a big histogram, so we use only one chunk of
+  // frames per thread.
+  const int nchunks = std::clamp(parallel_concurrency(), 1, nframes);
+  std::vector<PaletteOptimizer> partials(nchunks);
+  std::mutex mutex;
+  std::atomic<bool> canceled = false;
+  int framesDone = 0;
+
+  parallel_for(0, nchunks, 1, [&](const int chunkBegin, const int chunkEnd){
+    ImageRef flat_image(Image::create(IMAGE_RGB,
+                                      sprite->width(), sprite->height()));
+    render::Render render;
+    render.setNewBlend(newBlend);
+
+    for (int chunk=chunkBegin; chunk<chunkEnd; ++chunk) {
+      const frame_t begin = fromFrame + nframes * chunk / nchunks;
+      const frame_t end = fromFrame + nframes * (chunk+1) / nchunks;
+
+      for (frame_t frame=begin; frame<end && !canceled; ++frame) {
+        render.renderSprite(flat_image.get(), sprite, frame);
+        partials[chunk].feedWithImage(flat_image.get(), withAlpha);
+
+        if (delegate) {
+          const std::lock_guard lock(mutex);
+          if (!delegate->continueTask())
+            canceled = true;
+          else
+            delegate->notifyTaskProgress(double(++framesDone) / double(nframes));
+        }
+      }
+    }
+  });
+
+  if (canceled)
+    return false;
+
+  for (const auto& partial : partials)
+    optimizer.merge(partial);
+  return true;
+}
+
+// Rows converted by each parallel_for() chunk.
+const int kRowsPerTask = 16;
+
+// Calls convertRow(srcRow, dstRow, width) for each row of "src" and
+// "dst" (images of the same size). Rows are converted in parallel if
+// "parallel" is true, so convertRow must be thread-safe in that case.
+template<typename SrcTraits, typename DstTraits, typename ConvertRow>
+void convert_rows(const Image* src,
+                  Image* dst,
+                  const bool parallel,
+                  ConvertRow&& convertRow)
+{
+  using src_address_t = typename SrcTraits::const_address_t;
+  using dst_address_t = typename DstTraits::address_t;
+
+  ASSERT(src->width() == dst->width());
+  ASSERT(src->height() == dst->height());
+
+  // Unshares tiles and invalidates the content hash of "dst"
+  LockImageBits<DstTraits> dstBits(dst, Image::WriteLock);
+
+  const int w = src->width();
+  auto convertRows = [src, dst, w, &convertRow](const int y1, const int y2){
+    for (int y=y1; y<y2; ++y) {
+      convertRow((src_address_t)src->getPixelAddress(0, y),
+                 (dst_address_t)dst->getPixelAddress(0, y), w);
+    }
+  };
+
+  if (parallel)
+    parallel_for(0, src->height(), kRowsPerTask, convertRows);
+  else
+    convertRows(0, src->height());
+}
+
+// Converts each pixel of "src" to "dst" using convertPixel(color).
+template<typename SrcTraits, typename DstTraits, typename ConvertPixel>
+void convert_pixels(const Image* src,
+                    Image* dst,
+                    const bool parallel,
+                    ConvertPixel&& convertPixel)
+{
+  convert_rows<SrcTraits, DstTraits>(
+    src, dst, parallel,
+    [&convertPixel](typename SrcTraits::const_address_t srcRow,
+                    typename DstTraits::address_t dstRow,
+                    const int w) {
+      for (int x=0; x<w; ++x)
+        dstRow[x] = convertPixel(srcRow[x]);
+    });
+}
+
+} // anonymous namespace
+
 Palette* create_palette_from_sprite(
   const Sprite* sprite,
   const frame_t fromFrame,
@@ -44,9 +207,12 @@ Palette* create_palette_from_sprite(
   TaskDelegate* delegate,
   const bool newBlend,
   RgbMapAlgorithm mapAlgo,
-  const bool calculateWithTransparent)
+  const bool calculateWithTransparent,
+  const bool refinePalette)
 {
-   if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
+   // The k-d tree only maps colors, it cannot generate a palette
+   if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT ||
+       mapAlgo == doc::RgbMapAlgorithm::KDTREE)
      mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
   PaletteOptimizer optimizer;
@@ -73,43 +239,31 @@ Palette* create_palette_from_sprite(
   if (!palette)
     palette = new Palette(fromFrame, 256);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
-
-  render::Render render;
-  render.setNewBlend(newBlend);
+  const int kmeansIterations = (refinePalette ? kRefinePaletteIterations: 0);
 
   // Feed the optimizer with all rendered frames
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
-
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3:
-        optimizer.feedWithImage(flat_image.get(), withAlpha);
-        break;
-      case RgbMapAlgorithm::OCTREE:
-        octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor);
-        break;
-      default:
-        ASSERT(false);
-        break;
-    }
-
-    if (delegate) {
-      if (!delegate->continueTask())
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3:
+      if (!feed_optimizer_with_frames(optimizer, sprite, fromFrame, toFrame,
+                                      withAlpha, newBlend, delegate))
         return nullptr;
-
-      delegate->notifyTaskProgress(
-        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-    }
+      break;
+    case RgbMapAlgorithm::OCTREE:
+      if (!feed_octree_with_frames(octreemap, sprite, fromFrame, toFrame,
+                                   withAlpha, newBlend, maskColor, 7,
+                                   delegate))
+        return nullptr;
+      break;
+    default:
+      ASSERT(false);
+      break;
   }
 
   switch (mapAlgo) {
 
     case RgbMapAlgorithm::RGB5A3: {
       // Generate an optimized palette
-      optimizer.calculate(palette, maskIndex);
+      optimizer.calculate(palette, maskIndex, kmeansIterations);
       break;
     }
 
@@ -120,19 +274,23 @@ Palette* create_palette_from_sprite(
         // We can use an 8-bit deep octree map, instead of 7-bit of the
         // first attempt.
         octreemap = OctreeMap();
-        for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-          render.renderSprite(flat_image.get(), sprite, frame);
-          octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return nullptr;
-
-            delegate->notifyTaskProgress(
-              double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-          }
-        }
+        if (!feed_octree_with_frames(octreemap, sprite, fromFrame, toFrame,
+                                     withAlpha, newBlend, maskColor, 8,
+                                     delegate))
+          return nullptr;
         octreemap.makePalette(palette, palette->size(), 8);
       }
+
+      // The octree doesn't keep the samples, so we need a histogram
+      // of the frames to refine the palette
+      if (kmeansIterations > 0) {
+        if (!feed_optimizer_with_frames(optimizer, sprite, fromFrame, toFrame,
+                                        withAlpha, newBlend, delegate))
+          return nullptr;
+        optimizer.refinePalette(palette,
+                                (maskColor == DOC_OCTREE_IS_OPAQUE ? 0: 1),
+                                kmeansIterations);
+      }
       break;
   }
 
@@ -189,15 +347,13 @@ Image* convert_pixel_format(
       toGray = &rgba_to_graya_using_luma;
   }
 
-  color_t c;
-  int r, g, b, a;
+  // Conversions that don't use the rgbmap can always be done in
+  // parallel.
+  const bool parallelMap = (!rgbmap || rgbmap->isThreadSafe());
 
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(image);
-      auto src_it = srcBits.begin(), src_end = srcBits.end();
-
       switch (new_image->pixelFormat()) {
 
         // RGB -> RGB
@@ -206,76 +362,63 @@ Image* convert_pixel_format(
           break;
 
         // RGB -> Grayscale
-        case IMAGE_GRAYSCALE: {
-          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
+        case IMAGE_GRAYSCALE:
           ASSERT(toGray);
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            *dst_it = (*toGray)(*src_it);
-          }
-          ASSERT(dst_it == dst_end);
+          convert_pixels<RgbTraits, GrayscaleTraits>(
+            image, new_image, true,
+            [toGray](const color_t c) -> color_t {
+              return (*toGray)(c);
+            });
           break;
-        }
 
         // RGB -> Indexed
-        case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
-
-            r = rgba_getr(c);
-            g = rgba_getg(c);
-            b = rgba_getb(c);
-            a = rgba_geta(c);
-
-            if (a == 0)
-              *dst_it = new_mask_color0;
-            else if (rgbmap)
-              *dst_it = rgbmap->mapColor(c);
-            else
-              *dst_it = palette->findBestfit(r, g, b, a, new_mask_color);
+        case IMAGE_INDEXED:
+          // Map whole rows at once
+          if (rgbmap) {
+            convert_rows<RgbTraits, IndexedTraits>(
+              image, new_image, parallelMap,
+              [rgbmap, new_mask_color0](const color_t* src_row,
+                                        uint8_t* dst_row,
+                                        const int w) {
+                rgbmap->mapColors(src_row, dst_row, w);
+
+                for (int x=0; x<w; ++x) {
+                  if (rgba_geta(src_row[x]) == 0)
+                    dst_row[x] = new_mask_color0;
+                }
+              });
+          }
+          else {
+            convert_pixels<RgbTraits, IndexedTraits>(
+              image, new_image, true,
+              [palette, new_mask_color, new_mask_color0](const color_t c) -> color_t {
+                const int a = rgba_geta(c);
+                if (a == 0)
+                  return new_mask_color0;
+                else
+                  return palette->findBestfit(rgba_getr(c),
+                                              rgba_getg(c),
+                                              rgba_getb(c), a,
+                                              new_mask_color);
+              });
           }
-          ASSERT(dst_it == dst_end);
           break;
-        }
       }
       break;
     }
 
     case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(image);
-      auto src_it = srcBits.begin(), src_end = srcBits.end();
-
       switch (new_image->pixelFormat()) {
 
         // Grayscale -> RGB
-        case IMAGE_RGB: {
-          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
-
-            g = graya_getv(c);
-
-            *dst_it = rgba(g, g, g, graya_geta(c));
-          }
-          ASSERT(dst_it == dst_end);
+        case IMAGE_RGB:
+          convert_pixels<GrayscaleTraits, RgbTraits>(
+            image, new_image, true,
+            [](const color_t c) -> color_t {
+              const int g = graya_getv(c);
+              return rgba(g, g, g, graya_geta(c));
+            });
           break;
-        }
 
         // Grayscale -> Grayscale
         case IMAGE_GRAYSCALE:
@@ -283,115 +426,80 @@ Image* convert_pixel_format(
           break;
 
         // Grayscale -> Indexed
-        case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
-            a = graya_geta(c);
-            c = graya_getv(c);
-
-            if (a == 0)
-              *dst_it = new_mask_color0;
-            else if (rgbmap)
-              *dst_it = rgbmap->mapColor(c, c, c, a);
-            else
-              *dst_it = palette->findBestfit(c, c, c, a, new_mask_color);
-          }
-          ASSERT(dst_it == dst_end);
+        case IMAGE_INDEXED:
+          convert_pixels<GrayscaleTraits, IndexedTraits>(
+            image, new_image, parallelMap,
+            [rgbmap, palette, new_mask_color, new_mask_color0](const color_t c) -> color_t {
+              const int a = graya_geta(c);
+              const int v = graya_getv(c);
+
+              if (a == 0)
+                return new_mask_color0;
+              else if (rgbmap)
+                return rgbmap->mapColor(v, v, v, a);
+              else
+                return palette->findBestfit(v, v, v, a, new_mask_color);
+            });
           break;
-        }
       }
       break;
     }
 
     case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(image);
-      auto src_it = srcBits.begin(), src_end = srcBits.end();
+      const color_t maskColor = image->maskColor();
 
       switch (new_image->pixelFormat()) {
 
         // Indexed -> RGB
-        case IMAGE_RGB: {
-          LockImageBits<RgbTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
+        case IMAGE_RGB:
+          convert_pixels<IndexedTraits, RgbTraits>(
+            image, new_image, true,
+            [palette, is_background, maskColor](const color_t c) -> color_t {
+              if (!is_background && c == maskColor)
+                return rgba(0, 0, 0, 0);
 
-            if (!is_background && c == image->maskColor())
-              *dst_it = rgba(0, 0, 0, 0);
-            else {
               const uint32_t p = palette->getEntry(c);
               if (is_background)
-                *dst_it = rgba(rgba_getr(p), rgba_getg(p), rgba_getb(p), 255);
+                return rgba(rgba_getr(p), rgba_getg(p), rgba_getb(p), 255);
               else
-                *dst_it = p;
-            }
-          }
-          ASSERT(dst_it == dst_end);
+                return p;
+            });
           break;
-        }
 
         // Indexed -> Grayscale
-        case IMAGE_GRAYSCALE: {
-          LockImageBits<GrayscaleTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
+        case IMAGE_GRAYSCALE:
           ASSERT(toGray);
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
-
-            if (!is_background && c == image->maskColor())
-              *dst_it = graya(0, 0);
-            else {
-              c = palette->getEntry(c);
-              *dst_it = (*toGray)(c);
-            }
-          }
-          ASSERT(dst_it == dst_end);
+          convert_pixels<IndexedTraits, GrayscaleTraits>(
+            image, new_image, true,
+            [palette, is_background, maskColor, toGray](const color_t c) -> color_t {
+              if (!is_background && c == maskColor)
+                return graya(0, 0);
+              else
+                return (*toGray)(palette->getEntry(c));
+            });
           break;
-        }
 
         // Indexed -> Indexed
-        case IMAGE_INDEXED: {
-          LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
-          auto dst_it = dstBits.begin();
-#ifdef _DEBUG
-          auto dst_end = dstBits.end();
-#endif
-          for (; src_it != src_end; ++src_it, ++dst_it) {
-            ASSERT(dst_it != dst_end);
-            c = *src_it;
+        case IMAGE_INDEXED:
+          convert_pixels<IndexedTraits, IndexedTraits>(
+            image, new_image, parallelMap,
+            [rgbmap, palette, is_background, maskColor,
+             new_mask_color, new_mask_color0](color_t c) -> color_t {
+              if (!is_background && c == maskColor)
+                return new_mask_color0;
 
-            if (!is_background && c == image->maskColor())
-              *dst_it = new_mask_color0;
-            else {
               c = palette->getEntry(c);
-              r = rgba_getr(c);
-              g = rgba_getg(c);
-              b = rgba_getb(c);
-              a = rgba_geta(c);
+              const int r = rgba_getr(c);
+              const int g = rgba_getg(c);
+              const int b = rgba_getb(c);
+              const int a = rgba_geta(c);
 
               if (rgbmap)
-                *dst_it = rgbmap->mapColor(r, g, b, a);
+                return rgbmap->mapColor(r, g, b, a);
               else
-                *dst_it = palette->findBestfit(r, g, b, a, new_mask_color);
-            }
-          }
-          ASSERT(dst_it == dst_end);
+                return palette->findBestfit(r, g, b, a, new_mask_color);
+            });
           break;
-        }
 
       }
       break;
@@ -414,13 +522,52 @@ void PaletteOptimizer::feedWithImage(const Image* image,
 void PaletteOptimizer::feedWithImage(const Image* image,
                                      const gfx::Rect& bounds,
                                      const bool withAlpha)
+{
+  ASSERT(image);
+
+  // Minimum number of pixels to feed each chunk of rows in parallel
+  // (each chunk needs its own histogram, which is expensive to
+  // create and merge).
+  const int kMinPixelsPerChunk = 1024*1024;
+
+  const gfx::Rect rc = (bounds & image->bounds());
+  const int nchunks =
+    std::clamp(int(int64_t(rc.w) * rc.h / kMinPixelsPerChunk),
+               1, parallel_concurrency());
+
+  if (nchunks == 1) {
+    feedWithImageRows(image, rc, withAlpha);
+    return;
+  }
+
+  std::vector<PaletteOptimizer> partials(nchunks);
+  parallel_for(0, nchunks, 1, [&](const int chunkBegin, const int chunkEnd){
+    for (int chunk=chunkBegin; chunk<chunkEnd; ++chunk) {
+      const int y1 = rc.y + rc.h * chunk / nchunks;
+      const int y2 = rc.y + rc.h * (chunk+1) / nchunks;
+      partials[chunk].feedWithImageRows(
+        image, gfx::Rect(rc.x, y1, rc.w, y2-y1), withAlpha);
+    }
+  });
+
+  // Merged in order to get the same result as feeding the rows
+  // serially
+  for (const auto& partial : partials)
+    merge(partial);
+}
+
+void PaletteOptimizer::feedWithImageRows(const Image* image,
+                                         const gfx::Rect& bounds,
+                                         const bool withAlpha)
 {
   uint32_t color;
 
   if (withAlpha)
     m_withAlpha = true;
 
-  ASSERT(image);
+  if (bounds.isEmpty())
+    return;
+
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB:
@@ -473,7 +620,15 @@ void PaletteOptimizer::feedWithRgbaColor(color_t color)
   m_histogram.addSamples(color, 1);
 }
 
-void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
+void PaletteOptimizer::merge(const PaletteOptimizer& other)
+{
+  m_histogram.merge(other.m_histogram);
+  if (other.m_withAlpha)
+    m_withAlpha = true;
+}
+
+void PaletteOptimizer::calculate(Palette* palette, int maskIndex,
+                                 const int kmeansIterations)
 {
   bool addMask;
 
@@ -489,7 +644,7 @@ void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
   // used, in other case the 0 indexed will be the mask color, so it
   // will not be used later in the color conversion (from RGB to
   // Indexed).
-  int usedColors = m_histogram.createOptimizedPalette(palette);
+  int usedColors = m_histogram.createOptimizedPalette(palette, kmeansIterations);
 
   if (addMask) {
     palette->resize(usedColors+1);
@@ -508,4 +663,19 @@ void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
   }
 }
 
+void PaletteOptimizer::refinePalette(Palette* palette,
+                                     const int fromIndex,
+                                     const int kmeansIterations)
+{
+  if (fromIndex >= palette->size())
+    return;
+
+  std::vector<color_t> colors(palette->rawColorsData() + fromIndex,
+                              palette->rawColorsData() + palette->size());
+  m_histogram.refineColors(colors, kmeansIterations);
+
+  for (int i=0; i<int(colors.size()); ++i)
+    palette->setEntry(fromIndex+i, colors[i]);
+}
+
 } // namespace render
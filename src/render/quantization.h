@@ -1,5 +1,5 @@
 // Aseprite Rener Library
-// Copyright (c) 2019-2021  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -27,24 +27,50 @@ namespace render {
   class Dithering;
   class TaskDelegate;
 
+  // Number of k-means iterations used to refine palettes when it's
+  // requested (e.g. create_palette_from_sprite(refinePalette=true)).
+  const int kRefinePaletteIterations = 10;
+
   class PaletteOptimizer {
   public:
+    // Big images are fed in parallel (splitting the image in chunks
+    // of rows, each one with its own histogram).
     void feedWithImage(const doc::Image* image,
                        const bool withAlpha);
     void feedWithImage(const doc::Image* image,
                        const gfx::Rect& bounds,
                        const bool withAlpha);
     void feedWithRgbaColor(doc::color_t color);
-    void calculate(doc::Palette* palette, int maskIndex);
+
+    // Adds the samples of other optimizer (as if its images were fed
+    // after the images of this one).
+    void merge(const PaletteOptimizer& other);
+
+    // Generates the palette with median cut, refining the result with
+    // the given number of k-means iterations.
+    void calculate(doc::Palette* palette, int maskIndex,
+                   const int kmeansIterations = 0);
+
+    // Refines the palette entries in the [fromIndex, palette->size())
+    // range with k-means iterations.
+    void refinePalette(doc::Palette* palette, const int fromIndex,
+                       const int kmeansIterations);
+
     bool isHighPrecision() { return m_histogram.isHighPrecision(); }
     int highPrecisionSize() { return m_histogram.highPrecisionSize(); }
 
   private:
+    void feedWithImageRows(const doc::Image* image,
+                           const gfx::Rect& bounds,
+                           const bool withAlpha);
+
     render::ColorHistogram<5, 6, 5, 5> m_histogram;
     bool m_withAlpha = false;
   };
 
   // Creates a new palette suitable to quantize the given RGB sprite to Indexed color.
+  // If "refinePalette" is true, the generated palette is refined with
+  // k-means iterations (slower, but the result has less error).
   doc::Palette* create_palette_from_sprite(
     const doc::Sprite* sprite,
     const doc::frame_t fromFrame,
@@ -54,7 +80,8 @@ namespace render {
     TaskDelegate* delegate,
     const bool newBlend,
     RgbMapAlgorithm mapAlgo,
-    const bool calculateWithTransparent = true);
+    const bool calculateWithTransparent = true,
+    const bool refinePalette = false);
 
   // Changes the image pixel format. The dithering method is used only
   // when you want to convert from RGB to Indexed.
@@ -0,0 +1,214 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_kdtree.h"
+#include "render/dithering.h"
+#include "render/dithering_matrix.h"
+#include "render/quantization.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+using namespace doc;
+using namespace render;
+
+namespace {
+
+// The same k-d tree but used from one thread only (so
+// convert_pixel_format() uses the serial paths).
+class SerialRgbMap : public RgbMapKdTree {
+public:
+  bool isThreadSafe() const override { return false; }
+};
+
+Palette random_palette(const int ncolors)
+{
+  Palette palette(0, ncolors);
+  palette.setEntry(0, rgba(0, 0, 0, 0));
+  for (int i=1; i<ncolors; ++i)
+    palette.setEntry(i, rgba(std::rand() % 256,
+                             std::rand() % 256,
+                             std::rand() % 256,
+                             (i % 5) ? 255: std::rand() % 256));
+  return palette;
+}
+
+void expect_same_images(const Image* a, const Image* b)
+{
+  ASSERT_EQ(a->width(), b->width());
+  ASSERT_EQ(a->height(), b->height());
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      ASSERT_EQ(get_pixel(a, x, y), get_pixel(b, x, y)) << "x=" << x << " y=" << y;
+}
+
+// Sum of squared distances from each pixel of the RGB image to the
+// nearest color of the palette.
+uint64_t palette_error(const Image* image, const Palette& palette)
+{
+  uint64_t error = 0;
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      const color_t c = get_pixel(image, x, y);
+      int best = std::numeric_limits<int>::max();
+      for (int i=0; i<palette.size(); ++i) {
+        const color_t p = palette.getEntry(i);
+        const int dr = int(rgba_getr(c)) - int(rgba_getr(p));
+        const int dg = int(rgba_getg(c)) - int(rgba_getg(p));
+        const int db = int(rgba_getb(c)) - int(rgba_getb(p));
+        best = std::min(best, dr*dr + dg*dg + db*db);
+      }
+      error += best;
+    }
+  }
+  return error;
+}
+
+void expect_same_palettes(const Palette& a, const Palette& b)
+{
+  ASSERT_EQ(a.size(), b.size());
+  for (int i=0; i<a.size(); ++i)
+    EXPECT_EQ(a.getEntry(i), b.getEntry(i)) << "i=" << i;
+}
+
+} // anonymous namespace
+
+// Converting rows in parallel must give the same result than the
+// serial conversion.
+TEST(Quantization, ParallelConvertPixelFormat)
+{
+  Palette::initBestfit();
+  const Palette palette = random_palette(64);
+
+  RgbMapKdTree parallelMap;
+  SerialRgbMap serialMap;
+  parallelMap.regenerateMap(&palette, 0);
+  serialMap.regenerateMap(&palette, 0);
+  ASSERT_TRUE(parallelMap.isThreadSafe());
+
+  for (PixelFormat srcFormat : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    ImageRef src(Image::create(srcFormat, 97, 131));
+    doc::algorithm::random_image(src.get());
+    if (srcFormat == IMAGE_INDEXED) {
+      for (int y=0; y<src->height(); ++y)
+        for (int x=0; x<src->width(); ++x)
+          put_pixel(src.get(), x, y, get_pixel(src.get(), x, y) % palette.size());
+    }
+
+    for (PixelFormat dstFormat : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+      for (const bool is_background : { false, true }) {
+        ImageRef a(convert_pixel_format(
+                     src.get(), nullptr, dstFormat, Dithering(),
+                     &parallelMap, &palette, is_background, 0));
+        ImageRef b(convert_pixel_format(
+                     src.get(), nullptr, dstFormat, Dithering(),
+                     &serialMap, &palette, is_background, 0));
+        expect_same_images(a.get(), b.get());
+      }
+    }
+  }
+}
+
+TEST(Quantization, ParallelDithering)
+{
+  Palette::initBestfit();
+  const Palette palette = random_palette(32);
+
+  RgbMapKdTree parallelMap;
+  SerialRgbMap serialMap;
+  parallelMap.regenerateMap(&palette, 0);
+  serialMap.regenerateMap(&palette, 0);
+
+  ImageRef src(Image::create(IMAGE_RGB, 113, 89));
+  doc::algorithm::random_image(src.get());
+
+  for (DitheringAlgorithm algorithm : { DitheringAlgorithm::Ordered,
+                                        DitheringAlgorithm::Old,
+                                        DitheringAlgorithm::ErrorDiffusion }) {
+    const Dithering dithering(algorithm, BayerMatrix(8), 0.75);
+    ImageRef a(convert_pixel_format(
+                 src.get(), nullptr, IMAGE_INDEXED, dithering,
+                 &parallelMap, &palette, false, 0));
+    ImageRef b(convert_pixel_format(
+                 src.get(), nullptr, IMAGE_INDEXED, dithering,
+                 &serialMap, &palette, false, 0));
+    expect_same_images(a.get(), b.get());
+  }
+}
+
+// Feeding parts of an image in different optimizers and merging them
+// must give the same palette than feeding the whole image.
+TEST(Quantization, MergePaletteOptimizer)
+{
+  for (const int ncolors : { 16, 4096 }) {
+    ImageRef src(Image::create(IMAGE_RGB, 64, 64));
+    for (int y=0; y<src->height(); ++y)
+      for (int x=0; x<src->width(); ++x) {
+        const int i = std::rand() % ncolors;
+        put_pixel(src.get(), x, y, rgba(i & 255, (i * 7) & 255, i >> 4, 255));
+      }
+
+    PaletteOptimizer whole, top, bottom;
+    whole.feedWithImage(src.get(), false);
+    top.feedWithImage(src.get(), gfx::Rect(0, 0, 64, 20), false);
+    bottom.feedWithImage(src.get(), gfx::Rect(0, 20, 64, 44), false);
+    top.merge(bottom);
+    EXPECT_EQ(whole.isHighPrecision(), top.isHighPrecision());
+
+    Palette a(0, 32), b(0, 32);
+    whole.calculate(&a, -1);
+    top.calculate(&b, -1);
+    expect_same_palettes(a, b);
+  }
+}
+
+// k-means iterations cannot increase the error of the palette
+// generated with median cut.
+TEST(Quantization, RefinePalette)
+{
+  // Use colors in the center of the histogram bins, so the histogram
+  // represents the image exactly
+  ImageRef src(Image::create(IMAGE_RGB, 64, 64));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x) {
+      put_pixel(src.get(), x, y,
+                rgba(255 * (std::rand() % 32) / 31,
+                     255 * (std::rand() % 64) / 63,
+                     255 * (std::rand() % 32) / 31, 255));
+    }
+
+  PaletteOptimizer optimizer;
+  optimizer.feedWithImage(src.get(), false);
+  ASSERT_FALSE(optimizer.isHighPrecision());
+
+  Palette a(0, 16), b(0, 16);
+  optimizer.calculate(&a, -1);
+  optimizer.calculate(&b, -1, kRefinePaletteIterations);
+  ASSERT_EQ(a.size(), b.size());
+  EXPECT_LE(palette_error(src.get(), b), palette_error(src.get(), a));
+
+  Palette c = a;
+  optimizer.refinePalette(&c, 0, kRefinePaletteIterations);
+  expect_same_palettes(b, c);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
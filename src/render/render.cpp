@@ -16,14 +16,27 @@
 #include "doc/doc.h"
 #include "doc/image_impl.h"
 #include "doc/layer_tilemap.h"
+#include "doc/parallel.h"
 #include "doc/playback.h"
 #include "doc/render_plan.h"
 #include "doc/tileset.h"
 #include "doc/tilesets.h"
+#include "doc/trace.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "render/mipmap_cache.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+  #define RENDER_SSE2 1
+#endif
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -31,6 +44,111 @@ namespace render {
 
 namespace {
 
+// Rows of each strip rendered by Render::renderSpriteInStrips(), and
+// minimum number of pixels to use strips (smaller areas are faster
+// in the calling thread).
+const int kRowsPerStrip = 64;
+const int kMinPixelsForStrips = 256*256;
+
+//////////////////////////////////////////////////////////////////////
+// Pixel replication
+
+#if RENDER_SSE2
+
+template<typename pixel_t>
+__m128i set1_pixel(const pixel_t c)
+{
+  if constexpr (sizeof(pixel_t) == 1)
+    return _mm_set1_epi8(char(c));
+  else if constexpr (sizeof(pixel_t) == 2)
+    return _mm_set1_epi16(short(c));
+  else
+    return _mm_set1_epi32(int(c));
+}
+
+#endif // RENDER_SSE2
+
+// Writes each one of the "n" pixels of "src" "times" times in "dst"
+// (which must have space for n*times pixels).
+template<typename pixel_t>
+void replicate_pixels(const pixel_t* src, const int n, const int times, pixel_t* dst)
+{
+  int i = 0;
+
+#if RENDER_SSE2
+  constexpr int lanes = 16 / sizeof(pixel_t);
+  pixel_t* const dst_end = dst + n*times;
+
+  if (times == 2) {
+    // Interleave blocks of pixels with themselves
+    for (; i+lanes<=n; i+=lanes, dst+=2*lanes) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+      __m128i lo, hi;
+      if constexpr (sizeof(pixel_t) == 1) {
+        lo = _mm_unpacklo_epi8(v, v);
+        hi = _mm_unpackhi_epi8(v, v);
+      }
+      else if constexpr (sizeof(pixel_t) == 2) {
+        lo = _mm_unpacklo_epi16(v, v);
+        hi = _mm_unpackhi_epi16(v, v);
+      }
+      else {
+        lo = _mm_unpacklo_epi32(v, v);
+        hi = _mm_unpackhi_epi32(v, v);
+      }
+      _mm_storeu_si128((__m128i*)dst, lo);
+      _mm_storeu_si128((__m128i*)(dst+lanes), hi);
+    }
+  }
+  else if (times > 2) {
+    // Fill each run with whole blocks, the last block can overwrite
+    // the first pixels of the next runs (which are written later).
+    const int blocks = (times + lanes - 1) / lanes;
+    for (; i<n && dst+blocks*lanes<=dst_end; ++i, dst+=times) {
+      const __m128i v = set1_pixel(src[i]);
+      for (int j=0; j<blocks; ++j)
+        _mm_storeu_si128((__m128i*)(dst+j*lanes), v);
+    }
+  }
+#endif
+
+  for (; i<n; ++i, dst+=times)
+    std::fill_n(dst, times, src[i]);
+}
+
+// Calls the blender only when the destination/source pixels change:
+// zoomed in images (or a solid destination) blend the same pair of
+// pixels several consecutive times.
+template<class DstTraits, class SrcTraits>
+class CachedBlender {
+  using dst_pixel_t = typename DstTraits::pixel_t;
+  using src_pixel_t = typename SrcTraits::pixel_t;
+public:
+  CachedBlender(BlenderHelper<DstTraits, SrcTraits>& blender,
+                const int opacity)
+    : m_blender(blender)
+    , m_opacity(opacity) {
+  }
+
+  dst_pixel_t operator()(const dst_pixel_t dst, const src_pixel_t src) {
+    if (!m_valid || dst != m_dst || src != m_src) {
+      m_dst = dst;
+      m_src = src;
+      m_result = m_blender(dst, src, m_opacity);
+      m_valid = true;
+    }
+    return m_result;
+  }
+
+private:
+  BlenderHelper<DstTraits, SrcTraits>& m_blender;
+  const int m_opacity;
+  bool m_valid = false;
+  dst_pixel_t m_dst = 0;
+  src_pixel_t m_src = 0;
+  dst_pixel_t m_result = 0;
+};
+
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
@@ -50,8 +168,6 @@ void composite_image_without_scale(
   ASSERT(DstTraits::pixel_format == dst->pixelFormat());
   ASSERT(SrcTraits::pixel_format == src->pixelFormat());
 
-  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
-
   gfx::Clip area(areaF);
   if (!area.clip(dst->width(), dst->height(),
                  src->width(), src->height()))
@@ -63,6 +179,23 @@ void composite_image_without_scale(
 
   ASSERT(!srcBounds.isEmpty());
 
+  // RGB -> RGB can be blended row by row with the span blenders
+  if constexpr (std::is_same_v<DstTraits, RgbTraits> &&
+                std::is_same_v<SrcTraits, RgbTraits>) {
+    const BlendSpanFunc blendSpan = get_rgba_span_blender(blendMode, newBlend);
+    const color_t maskColor = src->maskColor();
+
+    dst->unshareTiles(dstBounds);
+    for (int y=0; y<srcBounds.h; ++y) {
+      blendSpan((color_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y+y),
+                (const color_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y),
+                srcBounds.w, opacity, maskColor);
+    }
+    return;
+  }
+
+  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+
   // Lock all necessary bits
   const LockImageBits<SrcTraits> srcBits(src, srcBounds);
   LockImageBits<DstTraits> dstBits(dst, dstBounds);
@@ -114,7 +247,6 @@ void composite_image_scale_up(
     return;
 
   BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
-  int px_x, px_y;
   int px_w = int(sx);
   int px_h = int(sy);
 
@@ -142,106 +274,44 @@ void composite_image_scale_up(
   if (srcBounds.isEmpty())
     return;
 
-  gfx::Rect dstBounds = area.dstBounds();
-  int bottom = dstBounds.y2()-1;
-  int line_h;
+  const gfx::Rect dstBounds = area.dstBounds();
+  const int bottom = dstBounds.y2();
 
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(srcBounds.w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
-
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // The "scanline" contains the blended src/dst pixels (one time for
+  // each source pixel), and the "line" is the scanline with the
+  // pixels replicated in the same way as they are painted on "dst".
+  using dst_pixel_t = typename DstTraits::pixel_t;
+  std::vector<dst_pixel_t> scanline(srcBounds.w);
+  std::vector<dst_pixel_t> line(first_px_w + (srcBounds.w-1)*px_w);
+  const int line_w = std::min(int(line.size()), dstBounds.w);
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
-  for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      *scanline_it = blender(*dst_it, *src_it, opacity);
-      ++src_it;
-
-      int delta;
-      if (x == 0)
-        delta = first_px_w;
-      else
-        delta = px_w;
-
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
-
-      ++scanline_it;
+  int dstY = dstBounds.y;
+  for (int y=0; y<srcBounds.h && dstY<bottom; ++y) {
+    const auto* srcPtr = get_pixel_address_fast<SrcTraits>(src, srcBounds.x, srcBounds.y+y);
+    const auto* dstPtr = get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstY);
+
+    // Blend each source pixel with the first 'dst' pixel where it's
+    // painted
+    for (int x=0, dstX=0; x<srcBounds.w; ++x) {
+      ASSERT(dstX < dstBounds.w);
+      scanline[x] = blender(dstPtr[dstX], srcPtr[x], opacity);
+      dstX += (x == 0 ? first_px_w: px_w);
     }
 
+    std::fill_n(line.begin(), first_px_w, scanline[0]);
+    replicate_pixels(scanline.data()+1, srcBounds.w-1, px_w,
+                     line.data()+first_px_w);
+
     // Get the 'height' of the line to be painted in 'dst'
-    if ((y == 0) && (first_px_h > 0))
-      line_h = first_px_h;
-    else
-      line_h = px_h;
+    const int line_h = (y == 0 ? first_px_h: px_h);
 
     // Draw the line in 'dst'
-    for (px_y=0; px_y<line_h; ++px_y) {
-      dst_it = dstBits.begin_area(dstBounds);
-      dst_end = dstBits.end_area(dstBounds);
-      scanline_it = scanline.begin();
-
-      int x = 0;
-
-      // first pixel
-      for (px_x=0; px_x<first_px_w; ++px_x) {
-        ASSERT(scanline_it != scanline_end);
-        ASSERT(dst_it != dst_end);
-
-        *dst_it = *scanline_it;
-
-        ++dst_it;
-        if (dst_it == dst_end)
-          goto done_with_line;
-      }
-
-      ++scanline_it;
-      ++x;
-
-      // the rest of the line
-      for (; x<srcBounds.w; ++x) {
-        for (px_x=0; px_x<px_w; ++px_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
-
-done_with_line:;
-      if (++dstBounds.y > bottom)
-        goto done_with_blit;
+    for (int px_y=0; px_y<line_h && dstY<bottom; ++px_y, ++dstY) {
+      std::copy_n(line.data(), line_w,
+                  get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstY));
     }
   }
-
-done_with_blit:;
 }
 
 template<class DstTraits, class SrcTraits>
@@ -344,6 +414,8 @@ void composite_image_general(
 
   dstBounds &= dst->bounds();
 
+  CachedBlender<DstTraits, SrcTraits> cachedBlender(blender, opacity);
+
   int dstY = dstBounds.y;
   double srcXStart = srcBounds.x / sx;
   double srcXDelta = 1.0 / sx;
@@ -371,7 +443,7 @@ void composite_image_general(
       ASSERT(dstX >= 0 && dstX < dst->width());
       ASSERT(srcX >= 0 && srcX < src->width());
 
-      *dstPtr = blender(*dstPtr, *srcPtr, opacity);
+      *dstPtr = cachedBlender(*dstPtr, *srcPtr);
       ++x;
 
       oldSrcX = int(srcX);
@@ -428,6 +500,28 @@ void composite_image_general_with_tile_flags(
     srcBounds.y = sy*srcImgBounds.y2() - srcBounds.y2();
   }
 
+  // Source column of each destination column (before the diagonal
+  // flip), calculated once for all rows
+  std::vector<int> srcXs(dstBounds.w);
+  for (int x=0; x<dstBounds.w; ++x) {
+    if (tileFlags & tile_f_xflip) {
+      srcXs[x] = (srcBounds.x2()-1-x) / sx;
+    }
+    else {
+      srcXs[x] = (srcBounds.x+x) / sx;
+    }
+  }
+
+  const bool dflip = (tileFlags & tile_f_dflip);
+  gfx::Size minSize;
+  if (dflip) {
+    minSize.w = minSize.h = std::min(srcMinSize.w, srcMinSize.h);
+  }
+  else {
+    minSize = srcMinSize;
+  }
+
+  CachedBlender<DstTraits, SrcTraits> cachedBlender(blender, opacity);
   int dstY = dstBounds.y;
 
   for (int y=0; y<dstBounds.h; ++y, ++dstY) {
@@ -435,41 +529,30 @@ void composite_image_general_with_tile_flags(
 
     auto dstPtr = get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstY);
 
+    int srcY0;
+    if (tileFlags & tile_f_yflip) {
+      srcY0 = (srcBounds.y2()-1-y) / sy;
+    }
+    else {
+      srcY0 = (srcBounds.y+y) / sy;
+    }
+
 #if _DEBUG
     int dstX = dstBounds.x;
 #endif
 
     for (int x=0; x<dstBounds.w; ++x, ++dstPtr) {
-      int srcX;
-      int srcY;
-      if (tileFlags & tile_f_xflip) {
-        srcX = (srcBounds.x2()-1-x) / sx;
-      }
-      else {
-        srcX = (srcBounds.x+x) / sx;
-      }
-      if (tileFlags & tile_f_yflip) {
-        srcY = (srcBounds.y2()-1-y) / sy;
-      }
-      else {
-        srcY = (srcBounds.y+y) / sy;
-      }
-
-      gfx::Size minSize;
-      if (tileFlags & tile_f_dflip) {
+      int srcX = srcXs[x];
+      int srcY = srcY0;
+      if (dflip)
         std::swap(srcX, srcY);
-        minSize.w = minSize.h = std::min(srcMinSize.w, srcMinSize.h);
-      }
-      else {
-        minSize = srcMinSize;
-      }
 
       ASSERT(dstX >= 0 && dstX < dst->width());
 
       if (srcX >= 0 && srcX < minSize.w &&
           srcY >= 0 && srcY < minSize.h) {
         auto srcPtr = get_pixel_address_fast<SrcTraits>(src, srcX, srcY);
-        *dstPtr = blender(*dstPtr, *srcPtr, opacity);
+        *dstPtr = cachedBlender(*dstPtr, *srcPtr);
       }
       else {
         *dstPtr = 0;
@@ -508,6 +591,44 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   }
 }
 
+// The 9 combinations of destination/source traits of the given
+// composite function template
+#define RENDER_COMPOSITE_FUNCS(f)              \
+    f<RgbTraits, RgbTraits>,                   \
+    f<RgbTraits, GrayscaleTraits>,             \
+    f<RgbTraits, IndexedTraits>,               \
+    f<GrayscaleTraits, RgbTraits>,             \
+    f<GrayscaleTraits, GrayscaleTraits>,       \
+    f<GrayscaleTraits, IndexedTraits>,         \
+    f<IndexedTraits, RgbTraits>,               \
+    f<IndexedTraits, GrayscaleTraits>,         \
+    f<IndexedTraits, IndexedTraits>
+
+// Returns true if the given function is one of the
+// composite_image_scale_down() versions (which can use mipmaps).
+bool is_scale_down_composition(const CompositeImageFunc func)
+{
+  static const CompositeImageFunc funcs[] = {
+    RENDER_COMPOSITE_FUNCS(composite_image_scale_down),
+  };
+  return (std::find(std::begin(funcs), std::end(funcs), func) != std::end(funcs));
+}
+
+// Returns true if the given composition function gives the same
+// result for each pixel independently of the clipping area (i.e. we
+// can render an area in several parts).
+bool is_exact_for_any_area(const CompositeImageFunc func)
+{
+  static const CompositeImageFunc funcs[] = {
+    RENDER_COMPOSITE_FUNCS(composite_image_without_scale),
+    RENDER_COMPOSITE_FUNCS(composite_image_scale_up),
+    RENDER_COMPOSITE_FUNCS(composite_image_scale_down),
+  };
+  return (std::find(std::begin(funcs), std::end(funcs), func) != std::end(funcs));
+}
+
+#undef RENDER_COMPOSITE_FUNCS
+
 bool has_visible_reference_layers(const LayerGroup* group)
 {
   for (const Layer* child : group->layers()) {
@@ -524,6 +645,54 @@ bool has_visible_reference_layers(const LayerGroup* group)
   return false;
 }
 
+// Returns true if compositing "src" in "dst" doesn't change "dst",
+// i.e. all "src" pixels are exactly the mask color (something that
+// is cached in the image, see Image::isPlain()) and the composition
+// keeps the destination for transparent pixels.
+//
+// If "onlyCachedInfo" is true, the plain info is not calculated when
+// it's not already cached (it cannot be modified from several
+// threads at the same time).
+bool is_transparent_composition(const Image* dst,
+                                const Image* src,
+                                const BlendMode blendMode,
+                                const bool onlyCachedInfo)
+{
+  // Special blend modes (SRC, MERGE, etc.) can modify the
+  // destination even with transparent pixels.
+  if (int(blendMode) < int(BlendMode::NORMAL))
+    return false;
+
+  switch (dst->pixelFormat()) {
+    case IMAGE_RGB:
+      break;
+    case IMAGE_GRAYSCALE:
+      // RGB -> Grayscale converts all pixels
+      if (src->pixelFormat() == IMAGE_RGB)
+        return false;
+      break;
+    case IMAGE_INDEXED:
+      // X -> Indexed finds the best fit for all pixels
+      if (src->pixelFormat() != IMAGE_INDEXED)
+        return false;
+      break;
+    default:
+      return false;
+  }
+
+  if (src->pixelFormat() == IMAGE_TILEMAP ||
+      (onlyCachedInfo && !src->hasPlainInfo()))
+    return false;
+
+  // Transparent pixels with other RGB values are blended with
+  // transparent pixels of the destination, so we require the exact
+  // mask color.
+  color_t color;
+  bool exact;
+  return (src->isPlain(&color, &exact) &&
+          exact && color == src->maskColor());
+}
+
 } // anonymous namespace
 
 Render::Render()
@@ -544,6 +713,10 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_parallel(false)
+  , m_mipmaps(nullptr)
+  , m_compositeCache(nullptr)
+  , m_renderingStrip(false)
 {
 }
 
@@ -631,6 +804,21 @@ void Render::disableOnionskin()
   m_onionskin.type(OnionskinType::NONE);
 }
 
+void Render::setParallel(const bool parallel)
+{
+  m_parallel = parallel;
+}
+
+void Render::setMipmapCache(MipmapCache* mipmaps)
+{
+  m_mipmaps = mipmaps;
+}
+
+void Render::setCompositeCache(CompositeCache* cache)
+{
+  m_compositeCache = cache;
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -669,10 +857,9 @@ void Render::renderLayer(
 
   m_globalOpacity = 255;
 
-  doc::RenderPlan plan;
-  plan.addLayer(layer, frame);
+  const doc::RenderPlanPtr plan = m_sprite->renderPlan(layer, frame);
   renderPlan(
-    plan, dstImage, area,
+    *plan, dstImage, area,
     frame, compositeImage,
     true, true, blendMode);
 }
@@ -682,6 +869,125 @@ void Render::renderSprite(
   const Sprite* sprite,
   frame_t frame,
   const gfx::ClipF& area)
+{
+  DOC_TRACE_ZONE("render sprite");
+
+  if (m_parallel &&
+      !m_renderingStrip &&
+      !canUseCompositeCache(dstImage, sprite, area) &&
+      canRenderInStrips(dstImage, area)) {
+    renderSpriteInStrips(dstImage, sprite, frame, area);
+  }
+  else {
+    renderSpriteArea(dstImage, sprite, frame, area);
+  }
+}
+
+bool Render::canRenderInStrips(
+  const Image* dstImage,
+  const gfx::ClipF& area) const
+{
+  switch (dstImage->pixelFormat()) {
+    case IMAGE_RGB:
+    case IMAGE_GRAYSCALE:
+    case IMAGE_INDEXED:
+      break;
+    default:
+      return false;
+  }
+
+  // The checkered background pattern is aligned to the origin of
+  // dstImage, so we cannot move each strip to the origin of its own
+  // image if the area doesn't start in the first row. Strips are
+  // copied row by row, so tiled images are not supported either.
+  if (area.dst.y != 0 ||
+      dstImage->isTiled())
+    return false;
+
+  const gfx::Rect dstBounds = gfx::Rect(area.dstBounds()) & dstImage->bounds();
+  return (dstBounds.h >= 2*kRowsPerStrip &&
+          dstBounds.w*dstBounds.h >= kMinPixelsForStrips &&
+          parallel_concurrency() > 1);
+}
+
+void Render::renderSpriteInStrips(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
+{
+  const gfx::Rect dstBounds = gfx::Rect(area.dstBounds()) & dstImage->bounds();
+  const int nstrips = (dstBounds.h + kRowsPerStrip - 1) / kRowsPerStrip;
+  const std::size_t rowSize = std::size_t(dstBounds.w) * dstImage->bytesPerPixel();
+
+  // Calculate the plain info of the images of this frame in this
+  // thread (the strips will use the cached value).
+  const doc::RenderPlanPtr plan = sprite->renderPlan(sprite->root(), frame);
+  for (const auto& item : plan->items()) {
+    if (item.cel && item.cel->image())
+      item.cel->image()->isPlain();
+  }
+  if (m_previewImage)
+    m_previewImage->isPlain();
+  if (m_extraImage)
+    m_extraImage->isPlain();
+
+  // Generate the mipmaps that the strips are going to use
+  if (m_mipmaps &&
+      is_scale_down_composition(
+        getImageComposition(dstImage->pixelFormat(),
+                            sprite->pixelFormat(), sprite->root()))) {
+    for (const auto& item : plan->items()) {
+      if (item.cel && item.cel->image() &&
+          item.layer->isImage() && !item.layer->isReference()) {
+        double sx = m_proj.scaleX();
+        double sy = m_proj.scaleY();
+        getMipmap(item.cel->image(), sx, sy);
+      }
+    }
+  }
+
+  // Strips are copied directly to the dstImage rows from each task
+  dstImage->invalidateContentHash();
+
+  parallel_for(
+    0, nstrips, 1,
+    [this, dstImage, sprite, frame, &area,
+     &dstBounds, rowSize](const int i1, const int i2){
+      for (int i=i1; i<i2; ++i) {
+        const int y1 = dstBounds.y + i*kRowsPerStrip;
+        const int y2 = std::min(y1 + kRowsPerStrip, dstBounds.y2());
+
+        // Each strip is rendered with its own copy of the Render
+        // (with its own temporary buffers) as the area that starts
+        // y1 rows below (area.dst.y is 0).
+        Render render(*this);
+        render.m_tmpBuf.reset();
+        render.m_renderingStrip = true;
+
+        ImageSpec spec = dstImage->spec();
+        spec.setSize(dstBounds.x2(), y2-y1);
+        ImageRef strip(Image::create(spec));
+
+        render.renderSpriteArea(
+          strip.get(), sprite, frame,
+          gfx::ClipF(area.dst.x, 0,
+                     area.src.x, area.src.y + y1,
+                     area.size.w, area.size.h - y1));
+
+        for (int y=y1; y<y2; ++y) {
+          std::copy_n(strip->getPixelAddress(dstBounds.x, y-y1), rowSize,
+                      dstImage->getPixelAddress(dstBounds.x, y));
+        }
+      }
+    });
+}
+
+void Render::renderSpriteArea(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
 {
   m_sprite = sprite;
 
@@ -707,15 +1013,36 @@ void Render::renderSprite(
     }
   }
 
+  // True if the onion skin in front of the sprite was already
+  // rendered from the composite cache
+  bool onionskinRendered = false;
+
   // New Blending Method:
   if (m_newBlendMethod) {
     // Clear dstImage with the bg_color (if the background is not a
     // special background pattern like the checkered background, this
     // is enough as a base color).
-    fill_rect(dstImage, area.dstBounds(), bg_color);
+    //
+    // The onion skin in front of the sprite can be cached only if
+    // it's rendered directly over the layers (i.e. without a
+    // special background between them).
+    const bool withOnionskinInFront =
+      (m_onionskin.type() != OnionskinType::NONE &&
+       m_onionskin.position() == OnionskinPosition::INFRONT &&
+       isSolidBackground(bgLayer, bg_color));
+
+    if (canUseCompositeCache(dstImage, sprite, area) &&
+        renderSpriteLayersWithCache(dstImage, gfx::Clip(area), frame,
+                                    compositeImage, bg_color,
+                                    withOnionskinInFront)) {
+      onionskinRendered = withOnionskinInFront;
+    }
+    else {
+      fill_rect(dstImage, area.dstBounds(), bg_color);
 
-    // Draw the Background layer - Onion skin behind the sprite - Transparent Layers
-    renderSpriteLayers(dstImage, area, frame, compositeImage);
+      // Draw the Background layer - Onion skin behind the sprite - Transparent Layers
+      renderSpriteLayers(dstImage, area, frame, compositeImage);
+    }
 
     // In case that we need a special background (e.g. like the
     // checkered pattern), we can draw the background in a temporal
@@ -739,7 +1066,8 @@ void Render::renderSprite(
   }
 
   // Draw onion skin in front of the sprite.
-  if (m_onionskin.position() == OnionskinPosition::INFRONT)
+  if (m_onionskin.position() == OnionskinPosition::INFRONT &&
+      !onionskinRendered)
     renderOnionskin(dstImage, area, frame, compositeImage);
 
   // Overlay preview image
@@ -763,17 +1091,272 @@ void Render::renderSprite(
   }
 }
 
+bool Render::canUseCompositeCache(
+  const Image* dstImage,
+  const Sprite* sprite,
+  const gfx::ClipF& area)
+{
+  if (!m_compositeCache ||
+      m_renderingStrip ||
+      !m_newBlendMethod ||
+      dstImage->isTiled())
+    return false;
+
+  switch (dstImage->pixelFormat()) {
+    case IMAGE_RGB:
+    case IMAGE_GRAYSCALE:
+    case IMAGE_INDEXED:
+      break;
+    default:
+      return false;
+  }
+
+  // Tiles are rendered with other clipping areas than the given one,
+  // so we can use them only with the composition functions that
+  // give the same result pixel by pixel for any clipping area.
+  if (area.dst.x != std::floor(area.dst.x) ||
+      area.dst.y != std::floor(area.dst.y) ||
+      area.src.x != std::floor(area.src.x) ||
+      area.src.y != std::floor(area.src.y) ||
+      area.size.w != std::floor(area.size.w) ||
+      area.size.h != std::floor(area.size.h))
+    return false;
+
+  return is_exact_for_any_area(
+    getImageComposition(dstImage->pixelFormat(),
+                        sprite->pixelFormat(), sprite->root()));
+}
+
+bool Render::getItemState(
+  const RenderPlan::Item& item,
+  const frame_t frame,
+  const int globalOpacity,
+  const BlendMode blendMode,
+  CompositeCache::ItemState& state) const
+{
+  const Layer* layer = item.layer;
+  state.layer = layer;
+
+  if (layer->isReference() &&
+      !(m_flags & Flags::ShowRefLayers))
+    return true;               // Not rendered
+
+  // Tilemaps and reference layers (scaled cels) cannot be cached
+  if (layer->type() != ObjectType::LayerImage ||
+      layer->isReference())
+    return false;
+
+  const Cel* cel = (item.cel ? item.cel: layer->cel(frame));
+  state.cel = cel;
+
+  // Cels where the extra cel can be drawn (the extra cel frame or
+  // its linked cels in onion skin frames) cannot be cached
+  if (m_extraCel && layer == m_currentLayer) {
+    if (frame == m_extraCel->frame())
+      return false;
+
+    const Cel* cel2 = layer->cel(m_extraCel->frame());
+    if (cel && cel2 && cel->data() == cel2->data())
+      return false;
+  }
+
+  if (!cel)
+    return true;
+
+  if (m_previewImage &&
+      checkIfWeShouldUsePreview(cel))
+    return false;
+
+  const Image* image = cel->image();
+  state.image = image;
+  if (!image)
+    return true;
+
+  state.imageId = image->id();
+  state.imageVersion = image->version();
+  state.imageHash = image->contentHash();
+  state.celBounds = cel->bounds();
+
+  // Same opacity calculated in renderPlanItem()
+  const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+  const bool isSelected = (m_selectedLayerForOpacity == layer);
+  int t;
+  int opacity = cel->opacity();
+  opacity = MUL_UN8(opacity, imgLayer->opacity(), t);
+  opacity = MUL_UN8(opacity, globalOpacity, t);
+  if (!isSelected && m_nonactiveLayersOpacity != 255)
+    opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
+  state.opacity = opacity;
+  state.blendMode = (blendMode == BlendMode::UNSPECIFIED ?
+                     imgLayer->blendMode(): blendMode);
+  state.palette = m_sprite->palette(frame);
+  state.paletteModifications = state.palette->getModifications();
+  return true;
+}
+
+bool Render::renderSpriteLayersWithCache(
+  Image* dstImage,
+  const gfx::Clip& area,
+  frame_t frame,
+  CompositeImageFunc compositeImage,
+  const color_t bg_color,
+  const bool withOnionskinInFront)
+{
+  // Cels in the same order that renderSpriteLayers() and
+  // renderOnionskin() render them: the background layer, the onion
+  // skin behind the sprite, the transparent layers, and the onion
+  // skin in front of the sprite.
+  struct Step {
+    const RenderPlan::Item* item;
+    frame_t frame;
+    int globalOpacity;
+    BlendMode blendMode;
+  };
+  std::vector<Step> steps;
+  std::vector<doc::RenderPlanPtr> plans;
+
+  auto addPlan = [&steps, &plans](const doc::RenderPlanPtr& plan,
+                                  const frame_t frame,
+                                  const int globalOpacity,
+                                  const BlendMode blendMode,
+                                  const bool render_background,
+                                  const bool render_transparent) {
+    for (const auto& item : plan->items()) {
+      if (item.layer->isBackground() ? render_background:
+                                       render_transparent)
+        steps.push_back(Step{ &item, frame, globalOpacity, blendMode });
+    }
+    plans.push_back(plan);
+  };
+
+  const Layer* onionLayer = (m_onionskin.layer() ? m_onionskin.layer():
+                                                   m_sprite->root());
+  const std::vector<OnionskinFrame> onionFrames = getOnionskinFrames(frame);
+  const doc::RenderPlanPtr plan = m_sprite->renderPlan(m_sprite->root(), frame);
+
+  addPlan(plan, frame, 255, BlendMode::UNSPECIFIED, true, false);
+  if (m_onionskin.position() == OnionskinPosition::BEHIND) {
+    for (const OnionskinFrame& onion : onionFrames)
+      addPlan(m_sprite->renderPlan(onionLayer, onion.frame),
+              onion.frame, onion.opacity, onion.blendMode, false, true);
+  }
+  addPlan(plan, frame, 255, BlendMode::UNSPECIFIED, false, true);
+  if (withOnionskinInFront) {
+    ASSERT(m_onionskin.position() == OnionskinPosition::INFRONT);
+    for (const OnionskinFrame& onion : onionFrames)
+      addPlan(m_sprite->renderPlan(onionLayer, onion.frame),
+              onion.frame, onion.opacity, onion.blendMode,
+              onion.opacity < 255, true);
+  }
+
+  // States of the first cels that can be cached
+  std::vector<CompositeCache::ItemState> states;
+  for (const Step& step : steps) {
+    CompositeCache::ItemState state;
+    if (!getItemState(*step.item, step.frame,
+                      step.globalOpacity, step.blendMode, state))
+      break;
+    states.push_back(state);
+  }
+  if (states.empty())
+    return false;
+
+  // The items were already filtered by background/transparent layers
+  auto renderStep = [this, compositeImage](const Step& step,
+                                           Image* image,
+                                           const gfx::Clip& area) {
+    m_globalOpacity = step.globalOpacity;
+    renderPlanItem(*step.item, image, area, step.frame,
+                   compositeImage, true, true, step.blendMode);
+  };
+
+  const int T = CompositeCache::kTileSize;
+  const gfx::Rect srcBounds(area.src, area.size);
+  const gfx::Rect dstBounds = area.dstBounds() & dstImage->bounds();
+  if (dstBounds.isEmpty())
+    return true;
+
+  CompositeCache::Key key;
+  key.sprite = m_sprite;
+  key.spriteId = m_sprite->id();
+  key.frame = frame;
+  key.format = dstImage->pixelFormat();
+  key.proj = m_proj;
+  key.bgColor = bg_color;
+  key.flags = m_flags;
+  key.nonactiveLayersOpacity = m_nonactiveLayersOpacity;
+  key.selectedLayerForOpacity = m_selectedLayerForOpacity;
+
+  // Tiles are aligned to multiples of kTileSize in canvas coordinates
+  auto align = [T](const int v){ return (v >= 0 ? v / T: -((-v + T - 1) / T)) * T; };
+  const int tx1 = align(srcBounds.x);
+  const int ty1 = align(srcBounds.y);
+
+  for (int ty=ty1; ty<srcBounds.y2(); ty+=T) {
+    for (int tx=tx1; tx<srcBounds.x2(); tx+=T) {
+      // Tile bounds in dstImage
+      const gfx::Point tileDst(area.dst.x + tx - area.src.x,
+                               area.dst.y + ty - area.src.y);
+      const gfx::Rect rc = gfx::Rect(tileDst, gfx::Size(T, T)) & dstBounds;
+      if (rc.isEmpty())
+        continue;
+
+      key.origin = gfx::Point(tx, ty);
+      CompositeCache::Tile& tile = m_compositeCache->tile(key);
+
+      // Use the cached composition if its cels are the first cels
+      // of the current plan (we can composite more cels over it)
+      std::size_t cached = tile.items.size();
+      if (!tile.image ||
+          cached > states.size() ||
+          !std::equal(tile.items.begin(), tile.items.end(), states.begin())) {
+        if (!tile.image ||
+            tile.image->pixelFormat() != dstImage->pixelFormat()) {
+          ImageSpec spec = dstImage->spec();
+          spec.setSize(T, T);
+          tile.image.reset(Image::create(spec));
+        }
+        fill_rect(tile.image.get(), tile.image->bounds(), bg_color);
+        tile.items.clear();
+        cached = 0;
+      }
+
+      if (cached > 0)
+        ++m_compositeCache->stats().hits;
+      else
+        ++m_compositeCache->stats().misses;
+
+      if (cached < states.size()) {
+        const gfx::Clip tileArea(0, 0, tx, ty, T, T);
+        for (std::size_t i=cached; i<states.size(); ++i)
+          renderStep(steps[i], tile.image.get(), tileArea);
+        tile.items = states;
+      }
+
+      dstImage->copy(tile.image.get(),
+                     gfx::Clip(rc.x, rc.y,
+                               rc.x - tileDst.x, rc.y - tileDst.y,
+                               rc.w, rc.h));
+    }
+  }
+  m_compositeCache->shrink();
+
+  // Composite the rest of cels over the cached ones
+  for (std::size_t i=states.size(); i<steps.size(); ++i)
+    renderStep(steps[i], dstImage, area);
+  return true;
+}
+
 void Render::renderSpriteLayers(Image* dstImage,
                                 const gfx::ClipF& area,
                                 frame_t frame,
                                 CompositeImageFunc compositeImage)
 {
-  doc::RenderPlan plan;
-  plan.addLayer(m_sprite->root(), frame);
+  const doc::RenderPlanPtr plan = m_sprite->renderPlan(m_sprite->root(), frame);
 
   // Draw the background layer.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, dstImage,
              area, frame, compositeImage,
              true,
              false,
@@ -785,7 +1368,7 @@ void Render::renderSpriteLayers(Image* dstImage,
 
   // Draw the transparent layers.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, dstImage,
              area, frame, compositeImage,
              false,
              true,
@@ -836,6 +1419,56 @@ bool Render::isSolidBackground(
       rgba_geta(bg_color) == 255));
 }
 
+std::vector<Render::OnionskinFrame> Render::getOnionskinFrames(const frame_t frame) const
+{
+  std::vector<OnionskinFrame> frames;
+  if (m_onionskin.type() == OnionskinType::NONE)
+    return frames;
+
+  Tag* loop = m_onionskin.loopTag();
+  Playback play(
+    m_sprite,
+    TagsList(),  // TODO add an onionskin option to iterate subtags
+    frame,
+    loop ? Playback::PlayInLoop : Playback::PlayAll,
+    loop);
+  frame_t prevFrames = (loop ? m_onionskin.prevFrames():
+                               std::min(frame, m_onionskin.prevFrames()));
+  play.nextFrame(-prevFrames);
+
+  for (frame_t frameOut = frame - prevFrames;
+       frameOut <= frame + m_onionskin.nextFrames();
+       ++frameOut, play.nextFrame()) {
+    const frame_t frameIn = play.frame();
+
+    if (frameIn == frame ||
+        frameIn < 0 ||
+        frameIn > m_sprite->lastFrame()) {
+      continue;
+    }
+
+    int opacity;
+    if (frameOut < frame) {
+      opacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frame - frameOut)-1);
+    }
+    else {
+      opacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frameOut - frame)-1);
+    }
+
+    opacity = std::clamp(opacity, 0, 255);
+    if (opacity > 0) {
+      BlendMode blendMode = BlendMode::UNSPECIFIED;
+      if (m_onionskin.type() == OnionskinType::MERGE)
+        blendMode = BlendMode::NORMAL;
+      else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
+        blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
+
+      frames.push_back(OnionskinFrame{ frameIn, opacity, blendMode });
+    }
+  }
+  return frames;
+}
+
 void Render::renderOnionskin(
   Image* dstImage,
   const gfx::Clip& area,
@@ -844,58 +1477,21 @@ void Render::renderOnionskin(
 {
   // Onion-skin feature: Draw previous/next frames with different
   // opacity (<255)
-  if (m_onionskin.type() != OnionskinType::NONE) {
-    Tag* loop = m_onionskin.loopTag();
-    Layer* onionLayer = (m_onionskin.layer() ? m_onionskin.layer():
-                                               m_sprite->root());
-    Playback play(
-      m_sprite,
-      TagsList(),  // TODO add an onionskin option to iterate subtags
-      frame,
-      loop ? Playback::PlayInLoop : Playback::PlayAll,
-      loop);
-    frame_t prevFrames = (loop ? m_onionskin.prevFrames():
-                                 std::min(frame, m_onionskin.prevFrames()));
-    play.nextFrame(-prevFrames);
-
-    for (frame_t frameOut = frame - prevFrames;
-         frameOut <= frame + m_onionskin.nextFrames();
-         ++frameOut, play.nextFrame()) {
-      const frame_t frameIn = play.frame();
-
-      if (frameIn == frame ||
-          frameIn < 0 ||
-          frameIn > m_sprite->lastFrame()) {
-        continue;
-      }
-
-      if (frameOut < frame) {
-        m_globalOpacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frame - frameOut)-1);
-      }
-      else {
-        m_globalOpacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frameOut - frame)-1);
-      }
-
-      m_globalOpacity = std::clamp(m_globalOpacity, 0, 255);
-      if (m_globalOpacity > 0) {
-        BlendMode blendMode = BlendMode::UNSPECIFIED;
-        if (m_onionskin.type() == OnionskinType::MERGE)
-          blendMode = BlendMode::NORMAL;
-        else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
-          blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
-
-        doc::RenderPlan plan;
-        plan.addLayer(onionLayer, frameIn);
-        renderPlan(
-          plan, dstImage,
-          area, frameIn, compositeImage,
-          // Render background only for "in-front" onion skinning and
-          // when opacity is < 255
-          (m_globalOpacity < 255 &&
-           m_onionskin.position() == OnionskinPosition::INFRONT),
-          true, blendMode);
-      }
-    }
+  const Layer* onionLayer = (m_onionskin.layer() ? m_onionskin.layer():
+                                                   m_sprite->root());
+
+  for (const OnionskinFrame& onion : getOnionskinFrames(frame)) {
+    m_globalOpacity = onion.opacity;
+
+    const doc::RenderPlanPtr plan = m_sprite->renderPlan(onionLayer, onion.frame);
+    renderPlan(
+      *plan, dstImage,
+      area, onion.frame, compositeImage,
+      // Render background only for "in-front" onion skinning and
+      // when opacity is < 255
+      (m_globalOpacity < 255 &&
+       m_onionskin.position() == OnionskinPosition::INFRONT),
+      true, onion.blendMode);
   }
 }
 
@@ -986,7 +1582,7 @@ void Render::renderImage(
 }
 
 void Render::renderPlan(
-  RenderPlan& plan,
+  const RenderPlan& plan,
   Image* image,
   const gfx::Clip& area,
   const frame_t frame,
@@ -996,173 +1592,188 @@ void Render::renderPlan(
   const BlendMode blendMode)
 {
   for (const auto& item : plan.items()) {
-    const Cel* cel = item.cel;
-    const Layer* layer = item.layer;
-
-    ASSERT(layer->isVisible()); // Hidden layers shouldn't be in the plan
-
-    const bool isSelected = (m_selectedLayerForOpacity == layer);
-    gfx::Rect extraArea;
-    bool drawExtra = false;
-
-    if (m_extraCel &&
-        m_extraImage &&
-        layer == m_currentLayer &&
-        ((layer->isBackground() && render_background) ||
-         (!layer->isBackground() && render_transparent)) &&
-        // Don't use a tilemap extra cel (IMAGE_TILEMAP) in a
-        // non-tilemap layer (in the other hand tilemap layers allow
-        // extra cels of any kind). This fixes a crash on renderCel()
-        // when we were painting the Preview window using a tilemap
-        // extra image to patch a regular layer, when switching from a
-        // tilemap layer to a regular layer.
-        ((layer->isTilemap()) ||
-         (!layer->isTilemap() && m_extraImage->pixelFormat() != IMAGE_TILEMAP))) {
-      if (frame == m_extraCel->frame() &&
-          frame == m_currentFrame) { // TODO this double check is not necessary
+    renderPlanItem(
+      item, image, area, frame, compositeImage,
+      render_background, render_transparent, blendMode);
+  }
+}
+
+void Render::renderPlanItem(
+  const RenderPlan::Item& item,
+  Image* image,
+  const gfx::Clip& area,
+  const frame_t frame,
+  const CompositeImageFunc compositeImage,
+  const bool render_background,
+  const bool render_transparent,
+  const BlendMode blendMode)
+{
+  const Cel* cel = item.cel;
+  const Layer* layer = item.layer;
+
+  ASSERT(layer->isVisible()); // Hidden layers shouldn't be in the plan
+
+  const bool isSelected = (m_selectedLayerForOpacity == layer);
+  gfx::Rect extraArea;
+  bool drawExtra = false;
+
+  if (m_extraCel &&
+      m_extraImage &&
+      layer == m_currentLayer &&
+      ((layer->isBackground() && render_background) ||
+       (!layer->isBackground() && render_transparent)) &&
+      // Don't use a tilemap extra cel (IMAGE_TILEMAP) in a
+      // non-tilemap layer (in the other hand tilemap layers allow
+      // extra cels of any kind). This fixes a crash on renderCel()
+      // when we were painting the Preview window using a tilemap
+      // extra image to patch a regular layer, when switching from a
+      // tilemap layer to a regular layer.
+      ((layer->isTilemap()) ||
+       (!layer->isTilemap() && m_extraImage->pixelFormat() != IMAGE_TILEMAP))) {
+    if (frame == m_extraCel->frame() &&
+        frame == m_currentFrame) { // TODO this double check is not necessary
+      drawExtra = true;
+    }
+    else {
+      // Check if we can draw the extra cel when we render a linked
+      // frame.
+      const Cel* cel2 = layer->cel(m_extraCel->frame());
+      if (cel && cel2 &&
+          cel->data() == cel2->data()) {
         drawExtra = true;
       }
-      else {
-        // Check if we can draw the extra cel when we render a linked
-        // frame.
-        const Cel* cel2 = layer->cel(m_extraCel->frame());
-        if (cel && cel2 &&
-            cel->data() == cel2->data()) {
-          drawExtra = true;
-        }
-      }
     }
+  }
 
-    if (drawExtra) {
-      extraArea = m_extraCel->bounds();
-      extraArea = m_proj.apply(extraArea);
-      if (m_proj.scaleX() < 1.0) extraArea.w--;
-      if (m_proj.scaleY() < 1.0) extraArea.h--;
-      if (extraArea.w < 1) extraArea.w = 1;
-      if (extraArea.h < 1) extraArea.h = 1;
-    }
+  if (drawExtra) {
+    extraArea = m_extraCel->bounds();
+    extraArea = m_proj.apply(extraArea);
+    if (m_proj.scaleX() < 1.0) extraArea.w--;
+    if (m_proj.scaleY() < 1.0) extraArea.h--;
+    if (extraArea.w < 1) extraArea.w = 1;
+    if (extraArea.h < 1) extraArea.h = 1;
+  }
 
-    switch (layer->type()) {
-
-      case ObjectType::LayerImage:
-      case ObjectType::LayerTilemap: {
-        if ((!render_background  &&  layer->isBackground()) ||
-            (!render_transparent && !layer->isBackground()))
-          break;
-
-        // Ignore reference layers
-        if (!(m_flags & Flags::ShowRefLayers) &&
-            layer->isReference())
-          break;
-
-        if (!cel)
-          cel = layer->cel(frame);
-
-        if (cel) {
-          Palette* pal = m_sprite->palette(frame);
-          const Image* celImage = nullptr;
-          gfx::RectF celBounds;
-
-          // Is the 'm_previewImage' set to be used with this layer?
-          if (m_previewImage &&
-              checkIfWeShouldUsePreview(cel)) {
-            celImage = m_previewImage;
-            celBounds = gfx::RectF(m_previewPos.x,
-                                   m_previewPos.y,
-                                   m_previewImage->width(),
-                                   m_previewImage->height());
-          }
-          // If not, we use the original cel-image from the images' stock
-          else {
-            celImage = cel->image();
-            if (layer->isReference())
-              celBounds = cel->boundsF();
-            else
-              celBounds = cel->bounds();
-          }
+  switch (layer->type()) {
 
-          if (celImage) {
-            const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
-            BlendMode layerBlendMode =
-              (blendMode == BlendMode::UNSPECIFIED ?
-               imgLayer->blendMode():
-               blendMode);
-
-            ASSERT(cel->opacity() >= 0);
-            ASSERT(cel->opacity() <= 255);
-            ASSERT(imgLayer->opacity() >= 0);
-            ASSERT(imgLayer->opacity() <= 255);
-
-            // Multiple three opacities: cel*layer*global (*nonactive-layer-opacity)
-            int t;
-            int opacity = cel->opacity();
-            opacity = MUL_UN8(opacity, imgLayer->opacity(), t);
-            opacity = MUL_UN8(opacity, m_globalOpacity, t);
-            if (!isSelected && m_nonactiveLayersOpacity != 255)
-              opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
-
-            // Generally this is just one pass, but if we are using
-            // OVER_COMPOSITE extra cel, this will be two passes.
-            for (int pass=0; pass<2; ++pass) {
-              // Draw parts outside the "m_extraCel" area
-              if (drawExtra && m_extraType == ExtraType::PATCH) {
-                gfx::Region originalAreas(area.srcBounds());
-                originalAreas.createSubtraction(
-                  originalAreas, gfx::Region(extraArea));
-
-                for (auto rc : originalAreas) {
-                  renderCel(
-                    image, cel, celImage, layer, pal, celBounds,
-                    gfx::Clip(area.dst.x+rc.x-area.src.x,
-                              area.dst.y+rc.y-area.src.y, rc),
-                    compositeImage, opacity, layerBlendMode);
-                }
-              }
-              // Draw the whole cel
-              else {
+    case ObjectType::LayerImage:
+    case ObjectType::LayerTilemap: {
+      if ((!render_background  &&  layer->isBackground()) ||
+          (!render_transparent && !layer->isBackground()))
+        break;
+
+      // Ignore reference layers
+      if (!(m_flags & Flags::ShowRefLayers) &&
+          layer->isReference())
+        break;
+
+      if (!cel)
+        cel = layer->cel(frame);
+
+      if (cel) {
+        Palette* pal = m_sprite->palette(frame);
+        const Image* celImage = nullptr;
+        gfx::RectF celBounds;
+
+        // Is the 'm_previewImage' set to be used with this layer?
+        if (m_previewImage &&
+            checkIfWeShouldUsePreview(cel)) {
+          celImage = m_previewImage;
+          celBounds = gfx::RectF(m_previewPos.x,
+                                 m_previewPos.y,
+                                 m_previewImage->width(),
+                                 m_previewImage->height());
+        }
+        // If not, we use the original cel-image from the images' stock
+        else {
+          celImage = cel->image();
+          if (layer->isReference())
+            celBounds = cel->boundsF();
+          else
+            celBounds = cel->bounds();
+        }
+
+        if (celImage) {
+          const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+          BlendMode layerBlendMode =
+            (blendMode == BlendMode::UNSPECIFIED ?
+             imgLayer->blendMode():
+             blendMode);
+
+          ASSERT(cel->opacity() >= 0);
+          ASSERT(cel->opacity() <= 255);
+          ASSERT(imgLayer->opacity() >= 0);
+          ASSERT(imgLayer->opacity() <= 255);
+
+          // Multiple three opacities: cel*layer*global (*nonactive-layer-opacity)
+          int t;
+          int opacity = cel->opacity();
+          opacity = MUL_UN8(opacity, imgLayer->opacity(), t);
+          opacity = MUL_UN8(opacity, m_globalOpacity, t);
+          if (!isSelected && m_nonactiveLayersOpacity != 255)
+            opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
+
+          // Generally this is just one pass, but if we are using
+          // OVER_COMPOSITE extra cel, this will be two passes.
+          for (int pass=0; pass<2; ++pass) {
+            // Draw parts outside the "m_extraCel" area
+            if (drawExtra && m_extraType == ExtraType::PATCH) {
+              gfx::Region originalAreas(area.srcBounds());
+              originalAreas.createSubtraction(
+                originalAreas, gfx::Region(extraArea));
+
+              for (auto rc : originalAreas) {
                 renderCel(
-                  image, cel, celImage, layer, pal,
-                  celBounds, area, compositeImage,
-                  opacity, layerBlendMode);
+                  image, cel, celImage, layer, pal, celBounds,
+                  gfx::Clip(area.dst.x+rc.x-area.src.x,
+                            area.dst.y+rc.y-area.src.y, rc),
+                  compositeImage, opacity, layerBlendMode);
               }
+            }
+            // Draw the whole cel
+            else {
+              renderCel(
+                image, cel, celImage, layer, pal,
+                celBounds, area, compositeImage,
+                opacity, layerBlendMode);
+            }
 
-              if (m_extraType == ExtraType::OVER_COMPOSITE &&
-                  layer == m_currentLayer &&
-                  pass == 0) {
-                // Go for second pass with the extra blend mode...
-                layerBlendMode = m_extraBlendMode;
-              }
-              else
-                break;
+            if (m_extraType == ExtraType::OVER_COMPOSITE &&
+                layer == m_currentLayer &&
+                pass == 0) {
+              // Go for second pass with the extra blend mode...
+              layerBlendMode = m_extraBlendMode;
             }
+            else
+              break;
           }
         }
-        break;
       }
+      break;
+    }
 
-      case ObjectType::LayerGroup:
-        ASSERT(false);
-        break;
+    case ObjectType::LayerGroup:
+      ASSERT(false);
+      break;
 
-    }
+  }
 
-    // Draw extras
-    if (drawExtra && m_extraType != ExtraType::NONE) {
-      if (m_extraCel->opacity() > 0) {
-        renderCel(
-          image,
-          m_extraCel,
-          m_sprite,
-          m_extraImage,
-          m_currentLayer, // Current layer (useful to use get the tileset if extra cel is a tilemap)
-          m_sprite->palette(frame),
-          m_extraCel->bounds(),
-          gfx::Clip(area.dst.x+extraArea.x-area.src.x,
-                    area.dst.y+extraArea.y-area.src.y,
-                    extraArea),
-          m_extraCel->opacity(),
-          m_extraBlendMode);
-      }
+  // Draw extras
+  if (drawExtra && m_extraType != ExtraType::NONE) {
+    if (m_extraCel->opacity() > 0) {
+      renderCel(
+        image,
+        m_extraCel,
+        m_sprite,
+        m_extraImage,
+        m_currentLayer, // Current layer (useful to use get the tileset if extra cel is a tilemap)
+        m_sprite->palette(frame),
+        m_extraCel->bounds(),
+        gfx::Clip(area.dst.x+extraArea.x-area.src.x,
+                  area.dst.y+extraArea.y-area.src.y,
+                  extraArea),
+        m_extraCel->opacity(),
+        m_extraBlendMode);
     }
   }
 }
@@ -1295,8 +1906,16 @@ void Render::renderCel(
     }
   }
   else {
-    renderImage(dst_image, cel_image, pal, celBounds,
-                area, compositeImage, opacity, blendMode);
+    // Use the cached resampled version of reference layers
+    ImageRef resampled;
+    if (m_mipmaps &&
+        cel_layer &&
+        cel_layer->isReference()) {
+      resampled = getResampledReference(cel_image, celBounds);
+    }
+
+    renderImage(dst_image, (resampled ? resampled.get(): cel_image),
+                pal, celBounds, area, compositeImage, opacity, blendMode);
   }
 }
 
@@ -1316,6 +1935,11 @@ void Render::renderImage(
   if (srcBounds.isEmpty())
     return;
 
+  // Skip empty cels/tiles
+  if (is_transparent_composition(dst_image, cel_image, blendMode,
+                                 m_renderingStrip))
+    return;
+
   // Get the function to composite the tile with the given flip flags
   if (tileFlags) {
     compositeImage = getImageComposition(
@@ -1324,8 +1948,19 @@ void Render::renderImage(
       nullptr, tileFlags);
   }
 
+  double sx = m_proj.scaleX() * celBounds.w / double(cel_image->width());
+  double sy = m_proj.scaleY() * celBounds.h / double(cel_image->height());
+
+  // Sample a reduced version of the image when we are zoomed out
+  ImageRef mipmap;
+  if (m_mipmaps &&
+      !tileFlags &&
+      is_scale_down_composition(compositeImage)) {
+    mipmap = getMipmap(cel_image, sx, sy);
+  }
+
   compositeImage(
-    dst_image, cel_image, pal,
+    dst_image, (mipmap ? mipmap.get(): cel_image), pal,
     gfx::ClipF(
       double(area.dst.x) + srcBounds.x - double(area.src.x),
       double(area.dst.y) + srcBounds.y - double(area.src.y),
@@ -1335,8 +1970,7 @@ void Render::renderImage(
       srcBounds.h),
     opacity,
     blendMode,
-    m_proj.scaleX() * celBounds.w / double(cel_image->width()),
-    m_proj.scaleY() * celBounds.h / double(cel_image->height()),
+    sx, sy,
     m_newBlendMethod,
     tileFlags);
 }
@@ -1399,6 +2033,71 @@ CompositeImageFunc Render::getImageComposition(
   return nullptr;
 }
 
+ImageRef Render::getMipmap(const Image* image,
+                           double& sx,
+                           double& sy) const
+{
+  ASSERT(m_mipmaps);
+
+  // Preview/extra images are modified in place without new versions
+  if (image == m_previewImage ||
+      image == m_extraImage ||
+      !MipmapCache::isValidImage(image))
+    return nullptr;
+
+  // composite_image_scale_down() samples one pixel each
+  // "step" pixels, so we can use the level N if 2^N divides the step
+  const int stepW = int(1.0 / sx);
+  const int stepH = int(1.0 / sy);
+  if (stepW < 1 || stepH < 1)
+    return nullptr;
+
+  int level = 0;
+  while (level < MipmapCache::kMaxLevel &&
+         ((stepW | stepH) & (1 << level)) == 0)
+    ++level;
+  if (level < MipmapCache::kMinLevel)
+    return nullptr;
+
+  // Check that the sampled pixels and the clipping of
+  // composite_image_scale_down() will be exactly the same with the
+  // reduced image
+  const double sx2 = 1.0 / double(stepW >> level);
+  const double sy2 = 1.0 / double(stepH >> level);
+  if (int(1.0 / sx2) != (stepW >> level) ||
+      int(1.0 / sy2) != (stepH >> level) ||
+      int(sx2*double(image->width() >> level)) != int(sx*double(image->width())) ||
+      int(sy2*double(image->height() >> level)) != int(sy*double(image->height())))
+    return nullptr;
+
+  ImageRef mipmap = m_mipmaps->get(image, level, m_renderingStrip);
+  if (mipmap) {
+    sx = sx2;
+    sy = sy2;
+  }
+  return mipmap;
+}
+
+ImageRef Render::getResampledReference(const Image* image,
+                                       const gfx::RectF& celBounds) const
+{
+  ASSERT(m_mipmaps);
+
+  // Preview/extra images are modified in place without new versions
+  if (image == m_previewImage ||
+      image == m_extraImage ||
+      !MipmapCache::isValidImage(image))
+    return nullptr;
+
+  // The resampled image has the size of the cel in the projection,
+  // so it's drawn almost without scale
+  const gfx::RectF scaledBounds = m_proj.apply(celBounds);
+  const gfx::Size size(int(std::round(scaledBounds.w)),
+                       int(std::round(scaledBounds.h)));
+
+  return m_mipmaps->getResampled(image, size, m_renderingStrip);
+}
+
 bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
 {
   if ((m_selectedLayer == cel->layer())) {
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,22 +14,26 @@
 #include "doc/color.h"
 #include "doc/doc.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/pixel_format.h"
+#include "doc/render_plan.h"
 #include "doc/tile.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
 #include "gfx/size.h"
 #include "render/bg_options.h"
+#include "render/composite_cache.h"
 #include "render/extra_type.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+#include <vector>
+
 namespace doc {
   class Cel;
   class Image;
   class Layer;
   class Palette;
-  class RenderPlan;
   class Sprite;
   class Tileset;
 }
@@ -37,6 +41,8 @@ namespace doc {
 namespace render {
   using namespace doc;
 
+  class MipmapCache;
+
   typedef void (*CompositeImageFunc)(
     Image* dst,
     const Image* src,
@@ -86,6 +92,23 @@ namespace render {
     void setOnionskin(const OnionskinOptions& options);
     void disableOnionskin();
 
+    // Enables the parallel mode of renderSprite(): big areas are
+    // divided in horizontal strips and each strip is rendered in a
+    // different thread (with its own temporary images). The result
+    // is exactly the same as rendering the whole area in the calling
+    // thread.
+    void setParallel(const bool parallel);
+
+    // Sets a cache of reduced images to render big cels faster when
+    // the projection is zoomed out (the result is exactly the same).
+    // The cache can be shared between several Render instances.
+    void setMipmapCache(MipmapCache* mipmaps);
+
+    // Sets a cache of the composited bottom layers (the layers below
+    // the one that is being modified) to avoid compositing them on
+    // each renderSprite() call. The result is exactly the same.
+    void setCompositeCache(CompositeCache* cache);
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -139,6 +162,42 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    void renderSpriteArea(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
+    bool canRenderInStrips(
+      const Image* dstImage,
+      const gfx::ClipF& area) const;
+
+    void renderSpriteInStrips(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
+    bool canUseCompositeCache(
+      const Image* dstImage,
+      const Sprite* sprite,
+      const gfx::ClipF& area);
+
+    bool renderSpriteLayersWithCache(
+      Image* dstImage,
+      const gfx::Clip& area,
+      frame_t frame,
+      CompositeImageFunc compositeImage,
+      const color_t bg_color,
+      const bool withOnionskinInFront);
+
+    bool getItemState(
+      const doc::RenderPlan::Item& item,
+      const frame_t frame,
+      const int globalOpacity,
+      const BlendMode blendMode,
+      CompositeCache::ItemState& state) const;
+
     void renderSpriteLayers(
       Image* dstImage,
       const gfx::ClipF& area,
@@ -155,6 +214,15 @@ namespace render {
       const Layer* bgLayer,
       const color_t bg_color) const;
 
+    // A frame rendered as onion skin of other frame
+    struct OnionskinFrame {
+      frame_t frame;
+      int opacity;
+      BlendMode blendMode;
+    };
+
+    std::vector<OnionskinFrame> getOnionskinFrames(const frame_t frame) const;
+
     void renderOnionskin(
       Image* image,
       const gfx::Clip& area,
@@ -162,7 +230,17 @@ namespace render {
       const CompositeImageFunc compositeImage);
 
     void renderPlan(
-      doc::RenderPlan& plan,
+      const doc::RenderPlan& plan,
+      Image* image,
+      const gfx::Clip& area,
+      const frame_t frame,
+      const CompositeImageFunc compositeImage,
+      const bool render_background,
+      const bool render_transparent,
+      const BlendMode blendMode);
+
+    void renderPlanItem(
+      const doc::RenderPlan::Item& item,
       Image* image,
       const gfx::Clip& area,
       const frame_t frame,
@@ -202,6 +280,13 @@ namespace render {
 
     bool checkIfWeShouldUsePreview(const Cel* cel) const;
 
+    ImageRef getMipmap(const Image* image,
+                       double& sx,
+                       double& sy) const;
+
+    ImageRef getResampledReference(const Image* image,
+                                   const gfx::RectF& celBounds) const;
+
     int m_flags;
     int m_nonactiveLayersOpacity;
     const Sprite* m_sprite;
@@ -224,6 +309,12 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+    bool m_parallel;
+    MipmapCache* m_mipmaps;
+    CompositeCache* m_compositeCache;
+    // True if this is a copy of the Render used to render one strip
+    // of renderSpriteInStrips() (in a worker thread)
+    bool m_renderingStrip;
   };
 
   void composite_image(Image* dst,
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,18 +10,107 @@
 
 #include "render/render.h"
 
+#include "doc/algorithm/random_image.h"
 #include "doc/cel.h"
+#include "doc/grid.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "render/composite_cache.h"
+#include "render/mipmap_cache.h"
 
 #include <benchmark/benchmark.h>
 
+#include <memory>
+
 using namespace doc;
 using namespace render;
 
+namespace {
+
+// Creates a sprite of the given color mode with "nlayers" layers
+// and "nframes" frames. Each cel has random pixels and is displaced
+// a little from the cel below, so all cels overlap partially.
+std::unique_ptr<Sprite> make_sprite(const ColorMode colorMode,
+                                    const int w, const int h,
+                                    const int nlayers,
+                                    const int nframes = 1)
+{
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(colorMode, w, h)));
+  spr->setTotalFrames(nframes);
+
+  LayerImage* first = static_cast<LayerImage*>(spr->root()->firstLayer());
+  for (int i=0; i<nlayers; ++i) {
+    LayerImage* layer = first;
+    if (i > 0) {
+      layer = new LayerImage(spr.get());
+      spr->root()->addLayer(layer);
+    }
+    for (frame_t frame=0; frame<nframes; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        ImageRef image(Image::create(spr->pixelFormat(), w, h));
+        cel = new Cel(frame, image);
+        layer->addCel(cel);
+      }
+      doc::algorithm::random_image(cel->image());
+      cel->setPosition((i+frame) % 16, (i*3+frame) % 16);
+    }
+  }
+  return spr;
+}
+
+BgOptions checkered_bg(const PixelFormat format)
+{
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = format;
+  if (format == IMAGE_RGB) {
+    bg.color1 = rgba(100, 100, 100, 255);
+    bg.color2 = rgba(200, 200, 200, 255);
+  }
+  else {
+    bg.color1 = 1;
+    bg.color2 = 2;
+  }
+  bg.stripeSize = gfx::Size(16, 16);
+  return bg;
+}
+
+// Renders the whole sprite (with the given projection) in an RGB
+// image in each iteration of the benchmark.
+void render_loop(benchmark::State& state,
+                 Render& render,
+                 const Sprite* spr,
+                 const Projection& proj = Projection(),
+                 const frame_t frame = 0)
+{
+  render.setProjection(proj);
+
+  const int w = proj.applyX(spr->width());
+  const int h = proj.applyY(spr->height());
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, w, h));
+  const gfx::Clip area(0, 0, 0, 0, w, h);
+
+  // Render one time before measuring, so the cached info of the
+  // images (content hashes, mipmaps, composited tiles, etc.) is
+  // already calculated.
+  render.renderSprite(dst.get(), spr, frame, area);
+
+  while (state.KeepRunning())
+    render.renderSprite(dst.get(), spr, frame, area);
+
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+} // anonymous namespace
+
 static void Bm_Render(benchmark::State& state)
 {
   const int w = state.range(0);
@@ -79,4 +168,188 @@ BENCHMARK(Bm_Render)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+// Args: color mode, sprite size
+static void Bm_RenderColorModes(benchmark::State& state)
+{
+  const ColorMode colorMode = ColorMode(state.range(0));
+  const int size = state.range(1);
+
+  std::unique_ptr<Sprite> spr = make_sprite(colorMode, size, size, 3);
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render_loop(state, render, spr.get());
+}
+
+// Args: number of layers
+static void Bm_RenderLayers(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, 256, 256, nlayers);
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render_loop(state, render, spr.get());
+}
+
+// Args: blend mode of all layers (except the first one)
+static void Bm_RenderBlendModes(benchmark::State& state)
+{
+  const BlendMode blendMode = BlendMode(state.range(0));
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, 512, 512, 4);
+  for (Layer* layer : spr->root()->layers()) {
+    if (layer != spr->root()->firstLayer())
+      static_cast<LayerImage*>(layer)->setBlendMode(blendMode);
+  }
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render_loop(state, render, spr.get());
+}
+
+// Args: sprite size, zoom numerator, zoom denominator, caches (1=mipmaps, 2=composite cache)
+static void Bm_RenderZoom(benchmark::State& state)
+{
+  const int size = state.range(0);
+  const Zoom zoom(state.range(1), state.range(2));
+  const int caches = state.range(3);
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, size, size, 3);
+  MipmapCache mipmaps;
+  CompositeCache composites;
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  if (caches & 1)
+    render.setMipmapCache(&mipmaps);
+  if (caches & 2)
+    render.setCompositeCache(&composites);
+  render_loop(state, render, spr.get(), Projection(PixelRatio(1, 1), zoom));
+}
+
+// Args: tile flags, zoom numerator
+static void Bm_RenderTilemap(benchmark::State& state)
+{
+  const tile_flags flags = tile_flags(state.range(0));
+  const Zoom zoom(state.range(1), 1);
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, 256, 256, 1);
+
+  auto tileset = new Tileset(spr.get(), Grid(gfx::Size(16, 16)), 16);
+  for (tile_index ti=1; ti<16; ++ti)
+    doc::algorithm::random_image(tileset->get(ti).get());
+  spr->tilesets()->add(tileset);
+
+  auto layer = new LayerTilemap(spr.get(), 0);
+  spr->root()->addLayer(layer);
+
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, 16, 16));
+  for (int y=0; y<16; ++y)
+    for (int x=0; x<16; ++x)
+      put_pixel(tilemap.get(), x, y, tile(1 + (x+y) % 15, flags));
+  layer->addCel(new Cel(0, tilemap));
+
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render_loop(state, render, spr.get(), Projection(PixelRatio(1, 1), zoom));
+}
+
+// Args: previous/next frames, onion skin position, use composite cache
+static void Bm_RenderOnionskin(benchmark::State& state)
+{
+  const int frames = state.range(0);
+  const OnionskinPosition position = OnionskinPosition(state.range(1));
+  const bool useCache = state.range(2);
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, 256, 256, 3, 11);
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.position(position);
+  onionskin.prevFrames(frames);
+  onionskin.nextFrames(frames);
+  onionskin.opacityBase(68);
+  onionskin.opacityStep(28);
+
+  CompositeCache composites;
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render.setOnionskin(onionskin);
+  if (useCache)
+    render.setCompositeCache(&composites);
+  render_loop(state, render, spr.get(), Projection(), 5);
+}
+
+// Args: zoom numerator, zoom denominator
+static void Bm_RenderReferenceLayer(benchmark::State& state)
+{
+  const Zoom zoom(state.range(0), state.range(1));
+
+  std::unique_ptr<Sprite> spr = make_sprite(ColorMode::RGB, 256, 256, 2);
+  Layer* ref = spr->root()->lastLayer();
+  ref->setReference(true);
+  ref->cel(0)->setBoundsF(gfx::RectF(10.5, 20.25, 300.5, 200.75));
+
+  Render render;
+  render.setBgOptions(checkered_bg(IMAGE_RGB));
+  render.setRefLayersVisiblity(true);
+  render_loop(state, render, spr.get(), Projection(PixelRatio(1, 1), zoom));
+}
+
+BENCHMARK(Bm_RenderColorModes)
+  ->ArgsProduct({ { int(ColorMode::RGB),
+                    int(ColorMode::GRAYSCALE),
+                    int(ColorMode::INDEXED) },
+                  { 256, 1024 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderLayers)
+  ->Arg(1)->Arg(10)->Arg(50)->Arg(100)->Arg(200)
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderBlendModes)
+  ->DenseRange(int(BlendMode::NORMAL), int(BlendMode::DIVIDE))
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderZoom)
+  // Zoom in
+  ->Args({ 256, 2, 1, 0 })
+  ->Args({ 256, 3, 1, 0 })
+  ->Args({ 256, 4, 1, 0 })
+  ->Args({ 256, 8, 1, 0 })
+  ->Args({ 128, 16, 1, 0 })
+  ->Args({ 256, 3, 2, 0 })
+  // Zoom out
+  ->Args({ 4096, 1, 2, 0 })
+  ->Args({ 4096, 1, 3, 0 })
+  ->Args({ 4096, 1, 4, 0 })
+  ->Args({ 4096, 1, 8, 0 })
+  ->Args({ 4096, 1, 16, 0 })
+  // With mipmap/composite caches
+  ->Args({ 256, 8, 1, 2 })
+  ->Args({ 4096, 1, 4, 1 })
+  ->Args({ 4096, 1, 4, 2 })
+  ->Args({ 4096, 1, 4, 3 })
+  ->Args({ 4096, 1, 16, 1 })
+  ->Args({ 4096, 1, 16, 3 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderTilemap)
+  ->ArgsProduct({ { 0,
+                    int(tile_f_xflip),
+                    int(tile_f_yflip),
+                    int(tile_f_dflip),
+                    int(tile_f_xflip | tile_f_yflip | tile_f_dflip) },
+                  { 1, 4 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderOnionskin)
+  ->ArgsProduct({ { 1, 5 },
+                  { int(OnionskinPosition::BEHIND),
+                    int(OnionskinPosition::INFRONT) },
+                  { 0, 1 } })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(Bm_RenderReferenceLayer)
+  ->Args({ 1, 1 })
+  ->Args({ 4, 1 })
+  ->Args({ 1, 4 })
+  ->Unit(benchmark::kMicrosecond);
+
 BENCHMARK_MAIN();
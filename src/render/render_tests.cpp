@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,13 +13,17 @@
 
 #include "render/render.h"
 
+#include "doc/algorithm/random_image.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "render/composite_cache.h"
+#include "render/mipmap_cache.h"
 
+#include <cstdlib>
 #include <memory>
 
 using namespace doc;
@@ -103,6 +107,56 @@ TYPED_TEST(RenderAllModes, CheckDefaultBackgroundMode)
   EXPECT_2X2_PIXELS(dst.get(), 0, 0, 0, 1);
 }
 
+TYPED_TEST(RenderAllModes, ScaleUpReplicatesPixels)
+{
+  typedef TypeParam ImageTraits;
+
+  std::srand(3);
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ImageTraits::color_mode, 37, 23));
+  doc->sprites().add(sprite);
+  doc::algorithm::random_image(sprite->root()->firstLayer()->cel(0)->image());
+
+  ImageRef original(Image::create(ImageTraits::pixel_format, 37, 23));
+  clear_image(original.get(), 0);
+  Render().renderSprite(original.get(), sprite, 0);
+
+  for (int zoom=2; zoom<=17; ++zoom) {
+    for (const PixelRatio ratio : { PixelRatio(1, 1), PixelRatio(2, 1) }) {
+      const int w = 37*zoom*ratio.w;
+      const int h = 23*zoom*ratio.h;
+      const gfx::Rect rc(std::rand() % w, std::rand() % h,
+                         1 + std::rand() % w, 1 + std::rand() % h);
+
+      ImageRef dst(Image::create(ImageTraits::pixel_format, rc.w, rc.h));
+      clear_image(dst.get(), 0);
+
+      // Zoomed background to use composite_image_scale_up()
+      // (instead of the pixel by pixel composition)
+      BgOptions bg;
+      bg.zoom = true;
+
+      Render render;
+      render.setBgOptions(bg);
+      render.setProjection(Projection(ratio, Zoom(zoom, 1)));
+      render.renderSprite(dst.get(), sprite, 0, gfx::Clip(0, 0, rc));
+
+      // Each pixel must be the nearest pixel of the original image
+      for (int y=0; y<rc.h; ++y) {
+        for (int x=0; x<rc.w; ++x) {
+          const int u = (rc.x+x) / (zoom*ratio.w);
+          const int v = (rc.y+y) / (zoom*ratio.h);
+          const color_t expected = (u < 37 && v < 23 ?
+                                    get_pixel(original.get(), u, v): 0);
+          ASSERT_EQ(expected, get_pixel(dst.get(), x, y))
+            << " zoom=" << zoom << " x=" << x << " y=" << y;
+        }
+      }
+    }
+  }
+}
+
 TEST(Render, DefaultBackgroundModeWithNonzeroTransparentIndex)
 {
   std::shared_ptr<Document> doc = std::make_shared<Document>();
@@ -277,6 +331,339 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, ParallelStrips)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 170, 160));
+  doc->sprites().add(sprite);
+  sprite->setTotalFrames(3);
+
+  LayerImage* layer1 = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  LayerImage* layer2 = new LayerImage(sprite);
+  sprite->root()->addLayer(layer2);
+  layer2->setBlendMode(BlendMode::MULTIPLY);
+
+  for (frame_t frame=0; frame<3; ++frame) {
+    if (frame > 0) {
+      ImageRef image(Image::create(IMAGE_RGB, 170, 160));
+      layer1->addCel(new Cel(frame, image));
+    }
+    doc::algorithm::random_image(layer1->cel(frame)->image());
+
+    ImageRef image(Image::create(IMAGE_RGB, 90, 100));
+    doc::algorithm::random_image(image.get());
+    Cel* cel = new Cel(frame, image);
+    cel->setPosition(10+frame*13, 5+frame*7);
+    layer2->addCel(cel);
+  }
+
+  ImageRef preview(Image::create(IMAGE_RGB, 50, 40));
+  doc::algorithm::random_image(preview.get());
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = rgba(128, 128, 128, 255);
+  bg.color2 = rgba(64, 64, 64, 255);
+  bg.stripeSize = gfx::Size(5, 3);
+
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.prevFrames(1);
+  onionskin.nextFrames(1);
+  onionskin.opacityBase(128);
+  onionskin.opacityStep(32);
+
+  // Big enough areas to be rendered in strips
+  for (int zoom : { 2, 3 }) {
+    for (auto position : { OnionskinPosition::BEHIND,
+                           OnionskinPosition::INFRONT }) {
+      const gfx::ClipF area(0, 0, 7*zoom, 3*zoom, 160*zoom, 150*zoom);
+      ImageRef serial(Image::create(IMAGE_RGB, 170*zoom, 160*zoom));
+      ImageRef parallel(Image::create(IMAGE_RGB, 170*zoom, 160*zoom));
+      clear_image(serial.get(), 0);
+      clear_image(parallel.get(), 0);
+
+      onionskin.position(position);
+
+      Render render;
+      render.setBgOptions(bg);
+      render.setOnionskin(onionskin);
+      render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+      render.setPreviewImage(nullptr, 1, preview.get(), nullptr,
+                             gfx::Point(20, 30), BlendMode::NORMAL);
+
+      render.renderSprite(serial.get(), sprite, 1, area);
+      render.setParallel(true);
+      render.renderSprite(parallel.get(), sprite, 1, area);
+
+      EXPECT_EQ(0, count_diff_between_images(serial.get(), parallel.get()))
+        << " zoom=" << zoom;
+    }
+  }
+}
+
+TEST(Render, MipmapCache)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 1000, 700));
+  doc->sprites().add(sprite);
+
+  Image* src = sprite->root()->firstLayer()->cel(0)->image();
+  doc::algorithm::random_image(src);
+
+  MipmapCache mipmaps;
+
+  for (int den : { 4, 8, 12, 16, 24, 32, 64 }) {
+    for (int i=0; i<3; ++i) {
+      // Modify the image (the cache must generate the levels again)
+      if (i == 2)
+        fill_rect(src, 10, 20, 500, 600, rgba(0, 0, 255, 255));
+
+      const gfx::ClipF area(0, 0, 0, 0, 1000/den, 700/den);
+      ImageRef expected(Image::create(IMAGE_RGB, 1000/den, 700/den));
+      ImageRef result(Image::create(IMAGE_RGB, 1000/den, 700/den));
+
+      Render render;
+      render.setBgOptions(BgOptions::MakeNone());
+      render.setProjection(Projection(PixelRatio(1, 1), Zoom(1, den)));
+      render.renderSprite(expected.get(), sprite, 0, area);
+
+      render.setMipmapCache(&mipmaps);
+      render.renderSprite(result.get(), sprite, 0, area);
+
+      EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+        << " zoom=1/" << den;
+    }
+  }
+  EXPECT_LT(0, mipmaps.bytes());
+
+  mipmaps.clear();
+  EXPECT_EQ(0, mipmaps.bytes());
+}
+
+TEST(Render, ResampledReferenceLayer)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 200, 150));
+  doc->sprites().add(sprite);
+
+  // Reference layer with a big image scaled to the sprite bounds
+  auto layer = new LayerImage(sprite);
+  layer->setReference(true);
+  sprite->root()->addLayer(layer);
+
+  ImageRef src(Image::create(IMAGE_RGB, 1000, 750));
+  doc::algorithm::random_image(src.get());
+  Cel* cel = new Cel(0, src);
+  cel->setBoundsF(gfx::RectF(0, 0, 200, 150));
+  layer->addCel(cel);
+
+  MipmapCache mipmaps;
+
+  for (int i=0; i<3; ++i) {
+    // Modify the image (the cache must resample it again)
+    if (i == 2)
+      fill_rect(src.get(), 10, 20, 500, 600, rgba(0, 0, 255, 255));
+
+    ImageRef expected(Image::create(IMAGE_RGB, 200, 150));
+    ImageRef result(Image::create(IMAGE_RGB, 200, 150));
+
+    Render render;
+    render.setBgOptions(BgOptions::MakeNone());
+    render.setRefLayersVisiblity(true);
+    render.renderSprite(expected.get(), sprite, 0);
+
+    render.setMipmapCache(&mipmaps);
+    render.renderSprite(result.get(), sprite, 0);
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()));
+  }
+  EXPECT_LT(0, mipmaps.bytes());
+}
+
+TEST(Render, CompositeCache)
+{
+  std::srand(7);
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 300, 200));
+  doc->sprites().add(sprite);
+
+  LayerImage* layers[4];
+  layers[0] = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  doc::algorithm::random_image(layers[0]->cel(0)->image());
+  for (int i=1; i<4; ++i) {
+    layers[i] = new LayerImage(sprite);
+    sprite->root()->addLayer(layers[i]);
+    layers[i]->setBlendMode(i == 2 ? BlendMode::SCREEN: BlendMode::NORMAL);
+    layers[i]->setOpacity(200 + i*10);
+
+    ImageRef image(Image::create(IMAGE_RGB, 150, 120));
+    doc::algorithm::random_image(image.get());
+    Cel* cel = new Cel(0, image);
+    cel->setPosition(-20 + i*50, 10 + i*20);
+    layers[i]->addCel(cel);
+  }
+
+  ImageRef preview(Image::create(IMAGE_RGB, 150, 120));
+  doc::algorithm::random_image(preview.get());
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = rgba(128, 128, 128, 255);
+  bg.color2 = rgba(64, 64, 64, 255);
+  bg.stripeSize = gfx::Size(8, 8);
+
+  CompositeCache cache;
+
+  for (int i=0; i<60; ++i) {
+    const int zoom = 1 + (i % 3);
+    const int w = 300*zoom, h = 200*zoom;
+
+    Render expected, cached;
+    for (Render* render : { &expected, &cached }) {
+      render->setBgOptions(bg);
+      render->setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    }
+    cached.setCompositeCache(&cache);
+
+    // Paint over the layer 2 with a preview image (layers 0 and 1
+    // can be reused from the cache)
+    if (i >= 20 && i < 40) {
+      for (Render* render : { &expected, &cached })
+        render->setPreviewImage(layers[2], 0, preview.get(), nullptr,
+                                gfx::Point(30, 50), BlendMode::NORMAL);
+    }
+    // Modify the bottom layer
+    if (i == 40)
+      fill_rect(layers[0]->cel(0)->image(), 10, 10, 100, 50, rgba(255, 0, 0, 255));
+
+    const gfx::Rect rc(std::rand() % w, std::rand() % h,
+                       1 + std::rand() % 400, 1 + std::rand() % 300);
+    const gfx::Clip area(2, 3, rc);
+
+    ImageRef a(Image::create(IMAGE_RGB, rc.w + 4, rc.h + 6));
+    ImageRef b(Image::create(IMAGE_RGB, rc.w + 4, rc.h + 6));
+    clear_image(a.get(), 0);
+    clear_image(b.get(), 0);
+    expected.renderSprite(a.get(), sprite, 0, area);
+    cached.renderSprite(b.get(), sprite, 0, area);
+
+    ASSERT_EQ(0, count_diff_between_images(a.get(), b.get()))
+      << " i=" << i << " zoom=" << zoom;
+  }
+  EXPECT_LT(0, cache.bytes());
+  EXPECT_LT(0, cache.stats().hits);
+  EXPECT_LT(0, cache.stats().misses);
+
+  cache.resetStats();
+  EXPECT_EQ(std::size_t(0), cache.stats().hits);
+  EXPECT_EQ(std::size_t(0), cache.stats().misses);
+}
+
+TEST(Render, OnionskinCompositeCache)
+{
+  std::srand(11);
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 300, 200));
+  doc->sprites().add(sprite);
+  sprite->setTotalFrames(5);
+
+  LayerImage* layer1 = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  LayerImage* layer2 = new LayerImage(sprite);
+  LayerImage* layer3 = new LayerImage(sprite);
+  sprite->root()->addLayer(layer2);
+  sprite->root()->addLayer(layer3);
+  layer1->setBackground(true);
+  layer2->setBlendMode(BlendMode::MULTIPLY);
+
+  for (frame_t frame=0; frame<5; ++frame) {
+    int i = 0;
+    for (LayerImage* layer : { layer1, layer2, layer3 }) {
+      ImageRef image(Image::create(IMAGE_RGB, 120, 90));
+      doc::algorithm::random_image(image.get());
+      Cel* cel = new Cel(frame, image);
+      cel->setPosition(10 + frame*30 + i*40, 5 + frame*10 + i*30);
+      layer->addCel(cel);
+      ++i;
+    }
+  }
+
+  // Layer 3 of frame 2 is linked with frame 1
+  Cel* oldCel = layer3->cel(2);
+  layer3->removeCel(oldCel);
+  delete oldCel;
+  layer3->addCel(Cel::MakeLink(2, layer3->cel(1)));
+
+  ImageRef preview(Image::create(IMAGE_RGB, 120, 90));
+  doc::algorithm::random_image(preview.get());
+
+  CompositeCache cache;
+
+  // The same frames are rendered with different options to check
+  // that the cached tiles are not reused with other onion skin
+  // options
+  for (int zoom=1; zoom<=2; ++zoom)
+  for (int options=0; options<16; ++options)
+  for (frame_t frame=0; frame<5; ++frame)
+  for (int pass=0; pass<2; ++pass) {
+    BgOptions bg;
+    if (options & 8) {
+      bg.type = BgType::CHECKERED;
+      bg.zoom = true;
+      bg.colorPixelFormat = IMAGE_RGB;
+      bg.color1 = rgba(128, 128, 128, 255);
+      bg.color2 = rgba(64, 64, 64, 255);
+      bg.stripeSize = gfx::Size(8, 8);
+    }
+
+    OnionskinOptions onionskin(options & 2 ? OnionskinType::RED_BLUE_TINT:
+                                             OnionskinType::MERGE);
+    onionskin.position(options & 4 ? OnionskinPosition::INFRONT:
+                                     OnionskinPosition::BEHIND);
+    onionskin.prevFrames(2);
+    onionskin.nextFrames(2);
+    onionskin.opacityBase(options & 1 ? 200: 160);
+    onionskin.opacityStep(48);
+
+    Render expected, cached;
+    for (Render* render : { &expected, &cached }) {
+      render->setBgOptions(bg);
+      render->setOnionskin(onionskin);
+      render->setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+      // Preview over the layer 3 in the frame 1 (visible in the
+      // linked cel of the frame 2 too)
+      if (pass == 1)
+        render->setPreviewImage(layer3, 1, preview.get(), nullptr,
+                                gfx::Point(40, 20), BlendMode::NORMAL);
+    }
+    cached.setCompositeCache(&cache);
+
+    const int w = 300*zoom, h = 200*zoom;
+    const gfx::Rect rc =
+      (pass == 0 ? gfx::Rect(0, 0, w, h):
+                   gfx::Rect(std::rand() % w, std::rand() % h,
+                             1 + std::rand() % 500, 1 + std::rand() % 350));
+    const gfx::Clip area(1, 2, rc);
+
+    ImageRef a(Image::create(IMAGE_RGB, rc.w + 2, rc.h + 4));
+    ImageRef b(Image::create(IMAGE_RGB, rc.w + 2, rc.h + 4));
+    clear_image(a.get(), 0);
+    clear_image(b.get(), 0);
+    expected.renderSprite(a.get(), sprite, frame, area);
+    cached.renderSprite(b.get(), sprite, frame, area);
+
+    ASSERT_EQ(0, count_diff_between_images(a.get(), b.get()))
+      << " options=" << options << " frame=" << frame
+      << " zoom=" << zoom << " pass=" << pass;
+  }
+  EXPECT_LT(0, cache.bytes());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
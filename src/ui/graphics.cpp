@@ -31,7 +31,9 @@
 
 #include <algorithm>
 #include <cctype>
+#include <list>
 #include <string>
+#include <unordered_map>
 
 namespace ui {
 
@@ -334,20 +336,6 @@ void Graphics::setFont(const os::FontRef& font)
   m_font = font;
 }
 
-void Graphics::drawText(const std::string& str,
-                        gfx::Color fg, gfx::Color bg,
-                        const gfx::Point& origPt,
-                        os::DrawTextDelegate* delegate)
-{
-  gfx::Point pt(m_dx+origPt.x, m_dy+origPt.y);
-
-  os::SurfaceLock lock(m_surface.get());
-  gfx::Rect textBounds =
-    os::draw_text(m_surface.get(), m_font.get(), str, fg, bg, pt.x, pt.y, delegate);
-
-  dirty(gfx::Rect(pt.x, pt.y, textBounds.w, textBounds.h));
-}
-
 namespace {
 
 class DrawUITextDelegate : public os::DrawTextDelegate {
@@ -411,15 +399,170 @@ private:
   gfx::Rect m_bounds;
 };
 
+// Cache of text runs (font + string + mnemonic) with their measured
+// width and a white RGBA surface with the rendered glyphs, so the
+// same labels/items painted each frame are shaped and rasterized just
+// once, and then they are drawn tinted with the foreground color.
+class TextRunCache {
+public:
+  // Max number of runs in the cache (the least recently used ones
+  // are discarded)
+  static constexpr int kMaxRuns = 512;
+  // Bigger runs are not cached (e.g. long lines of a TextBox)
+  static constexpr int kMaxRunPixels = 256*1024;
+
+  struct Run {
+    int width = -1;             // Result of measureUITextLength()
+    os::SurfaceRef surface;     // Rendered glyphs (white color)
+    gfx::Point origin;          // Text origin inside the surface
+    gfx::Rect bounds;           // Drawn area inside the surface
+  };
+
+  static TextRunCache& instance() {
+    static TextRunCache cache;
+    return cache;
+  }
+
+  int measure(os::Font* font, const std::string& str) {
+    Run& run = get(font, str, 0);
+    if (run.width < 0) {
+      DrawUITextDelegate delegate(nullptr, font, 0);
+      os::draw_text(nullptr, font, str,
+                    gfx::ColorNone, gfx::ColorNone, 0, 0,
+                    &delegate);
+      run.width = delegate.bounds().w;
+    }
+    return run.width;
+  }
+
+  // Returns nullptr if the run cannot be cached.
+  const Run* render(os::Font* font, const std::string& str, int mnemonic) {
+    Run& run = get(font, str, mnemonic);
+    if (run.surface)
+      return &run;
+
+    DrawUITextDelegate measureDelegate(nullptr, font, 0);
+    os::draw_text(nullptr, font, str,
+                  gfx::ColorNone, gfx::ColorNone, 0, 0,
+                  &measureDelegate);
+    const gfx::Rect rc = measureDelegate.bounds();
+    if (rc.isEmpty())
+      return nullptr;
+
+    // Space for the mnemonic underscore below the text
+    const int pad = 2*guiscale()+1;
+    run.origin = gfx::Point(pad - std::min(rc.x, 0),
+                            pad - std::min(rc.y, 0));
+    const int w = run.origin.x + rc.x2() + pad;
+    const int h = run.origin.y + rc.y2() + pad;
+    if (w*h > kMaxRunPixels)
+      return nullptr;
+
+    os::SurfaceRef surface = os::instance()->makeRgbaSurface(w, h);
+    {
+      os::SurfaceLock lock(surface.get());
+      surface->clear();
+
+      DrawUITextDelegate delegate(surface.get(), font, mnemonic);
+      os::draw_text(surface.get(), font, str,
+                    gfx::rgba(255, 255, 255), gfx::ColorNone,
+                    run.origin.x, run.origin.y, &delegate);
+      run.bounds = delegate.bounds();
+    }
+    run.surface = surface;
+    return &run;
+  }
+
+  void clear() {
+    m_runs.clear();
+    m_lru.clear();
+  }
+
+private:
+  struct Key {
+    os::Font* font;
+    std::string str;
+    int mnemonic;
+    bool operator==(const Key& other) const {
+      return (font == other.font &&
+              mnemonic == other.mnemonic &&
+              str == other.str);
+    }
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return std::hash<std::string>()(key.str)
+        ^ (std::hash<const void*>()(key.font) << 1)
+        ^ std::size_t(key.mnemonic);
+    }
+  };
+
+  struct Entry {
+    os::FontRef font;           // Keeps the font alive while it's a key
+    Run run;
+    std::list<Key>::iterator lruIt;
+  };
+
+  Run& get(os::Font* font, const std::string& str, int mnemonic) {
+    Key key{ font, str, mnemonic };
+    auto it = m_runs.find(key);
+    if (it != m_runs.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+      return it->second.run;
+    }
+
+    if (int(m_runs.size()) >= kMaxRuns) {
+      m_runs.erase(m_lru.back());
+      m_lru.pop_back();
+    }
+
+    m_lru.push_front(key);
+    Entry& entry = m_runs[key];
+    entry.font = AddRef(font);
+    entry.lruIt = m_lru.begin();
+    return entry.run;
+  }
+
+  std::unordered_map<Key, Entry, KeyHash> m_runs;
+  std::list<Key> m_lru;
+};
+
+}
+
+void Graphics::drawText(const std::string& str,
+                        gfx::Color fg, gfx::Color bg,
+                        const gfx::Point& origPt,
+                        os::DrawTextDelegate* delegate)
+{
+  gfx::Point pt(m_dx+origPt.x, m_dy+origPt.y);
+
+  // Text without a custom delegate or background is drawn from the
+  // cache of text runs
+  if (!delegate && gfx::is_transparent(bg)) {
+    if (drawCachedTextRun(str, fg, pt, 0))
+      return;
+  }
+
+  os::SurfaceLock lock(m_surface.get());
+  gfx::Rect textBounds =
+    os::draw_text(m_surface.get(), m_font.get(), str, fg, bg, pt.x, pt.y, delegate);
+
+  dirty(gfx::Rect(pt.x, pt.y, textBounds.w, textBounds.h));
 }
 
 void Graphics::drawUIText(const std::string& str, gfx::Color fg, gfx::Color bg,
                           const gfx::Point& pt, const int mnemonic)
 {
-  os::SurfaceLock lock(m_surface.get());
   int x = m_dx+pt.x;
   int y = m_dy+pt.y;
 
+  if (gfx::is_transparent(bg) &&
+      drawCachedTextRun(str, fg, gfx::Point(x, y), mnemonic)) {
+    return;
+  }
+
+  os::SurfaceLock lock(m_surface.get());
   DrawUITextDelegate delegate(m_surface.get(), m_font.get(), mnemonic);
   os::draw_text(m_surface.get(), m_font.get(), str,
                 fg, bg, x, y, &delegate);
@@ -427,6 +570,37 @@ void Graphics::drawUIText(const std::string& str, gfx::Color fg, gfx::Color bg,
   dirty(delegate.bounds());
 }
 
+bool Graphics::drawCachedTextRun(const std::string& str, gfx::Color fg,
+                                 const gfx::Point& pt, const int mnemonic)
+{
+  if (!m_font)
+    return false;
+
+  const TextRunCache::Run* run =
+    TextRunCache::instance().render(m_font.get(), str, mnemonic);
+  if (!run)
+    return false;
+
+  const gfx::Rect src = run->bounds;
+  const gfx::Rect dst(pt.x - run->origin.x + src.x,
+                      pt.y - run->origin.y + src.y,
+                      src.w, src.h);
+  dirty(dst);
+
+  os::SurfaceLock lockSrc(run->surface.get());
+  os::SurfaceLock lockDst(m_surface.get());
+  m_surface->drawColoredRgbaSurface(
+    run->surface.get(), fg, gfx::ColorNone,
+    gfx::Clip(dst.x, dst.y, src.x, src.y, src.w, src.h));
+  return true;
+}
+
+// static
+void Graphics::clearTextCache()
+{
+  TextRunCache::instance().clear();
+}
+
 void Graphics::drawAlignedUIText(const std::string& str, gfx::Color fg, gfx::Color bg,
                                  const gfx::Rect& rc, const int align)
 {
@@ -443,11 +617,7 @@ gfx::Size Graphics::measureUIText(const std::string& str)
 // static
 int Graphics::measureUITextLength(const std::string& str, os::Font* font)
 {
-  DrawUITextDelegate delegate(nullptr, font, 0);
-  os::draw_text(nullptr, font, str,
-                gfx::ColorNone, gfx::ColorNone, 0, 0,
-                &delegate);
-  return delegate.bounds().w;
+  return TextRunCache::instance().measure(font, str);
 }
 
 gfx::Size Graphics::fitString(const std::string& str, int maxWidth, int align)
@@ -114,6 +114,10 @@ namespace ui {
     static int measureUITextLength(const std::string& str, os::Font* font);
     gfx::Size fitString(const std::string& str, int maxWidth, int align);
 
+    // Discards the cached text runs (e.g. when the theme/fonts
+    // change).
+    static void clearTextCache();
+
     // Can be used in case that you've accessed/changed the
     // getInternalSurface() directly and need to specify which area
     // was modified.
@@ -121,6 +125,8 @@ namespace ui {
 
   private:
     gfx::Size doUIStringAlgorithm(const std::string& str, gfx::Color fg, gfx::Color bg, const gfx::Rect& rc, int align, bool draw);
+    bool drawCachedTextRun(const std::string& str, gfx::Color fg,
+                           const gfx::Point& pt, const int mnemonic);
     void dirty(const gfx::Rect& bounds);
 
     Display* m_display;
@@ -64,6 +64,26 @@ enum class RedrawState {
 };
 RedrawState redrawState = RedrawState::Normal;
 
+// Frame pacing: displays are painted at most get_max_paint_rate()
+// times per second. Invalidated regions are accumulated in the
+// widgets (m_updateRegion) until the next paint, so several input
+// events are coalesced in one paint.
+base::tick_t lastPaintTick = 0;
+bool paintPending = false;
+
+// Returns the milliseconds to wait until the next paint (0 if we can
+// paint right now).
+base::tick_t time_to_next_paint()
+{
+  const int fps = get_max_paint_rate();
+  if (fps <= 0)
+    return 0;
+
+  const base::tick_t interval = 1000 / fps;
+  const base::tick_t elapsed = base::current_tick() - lastPaintTick;
+  return (elapsed >= interval ? 0: interval - elapsed);
+}
+
 } // anonymous namespace
 
 static const int NFILTERS = (int)(kFirstRegisteredMessage+1);
@@ -358,7 +378,8 @@ bool Manager::generateMessages()
   // Returns true if we have to dispatch messages (if the redraw was
   // delayed, we have to pump messages because there is where paint
   // messages are flushed)
-  if (!msg_queue.empty() || redrawState != RedrawState::Normal)
+  if (!msg_queue.empty() || redrawState != RedrawState::Normal ||
+      (paintPending && time_to_next_paint() == 0))
     return true;
   else
     return false;
@@ -415,6 +436,15 @@ void Manager::generateMessagesFromOSEvents()
     if (msg_queue.empty() && redrawState == RedrawState::Normal) {
       if (!Timer::getNextTimeout(timeout))
         timeout = os::EventQueue::kWithoutTimeout;
+
+      // Wake up to paint the pending invalidated regions
+      if (paintPending) {
+        const double paintTimeout = time_to_next_paint() / 1000.0;
+        if (timeout == os::EventQueue::kWithoutTimeout ||
+            paintTimeout < timeout) {
+          timeout = paintTimeout;
+        }
+      }
     }
 
     if (timeout == os::EventQueue::kWithoutTimeout && used_msg_queue.empty())
@@ -863,7 +893,9 @@ void Manager::dispatchMessages()
   // might change the state of widgets, etc. In case pumpQueue()
   // returns a number greater than 0, it means that we've processed
   // some messages, so we've to redraw the screen.
-  if (pumpQueue() > 0 || redrawState == RedrawState::RedrawDelayed) {
+  if (pumpQueue() > 0 ||
+      redrawState == RedrawState::RedrawDelayed ||
+      paintPending) {
     if (redrawState == RedrawState::ClosingApp) {
       // Do nothing, we don't flush nor process paint messages
     }
@@ -874,6 +906,11 @@ void Manager::dispatchMessages()
     else if (redrawState == RedrawState::AWindowHasJustBeenClosed) {
       redrawState = RedrawState::RedrawDelayed;
     }
+    // We've painted recently, paint in the next frame (so we can
+    // process more input messages in the meantime).
+    else if (time_to_next_paint() > 0) {
+      paintPending = true;
+    }
     else {
       if (redrawState == RedrawState::RedrawDelayed)
         redrawState = RedrawState::Normal;
@@ -884,6 +921,9 @@ void Manager::dispatchMessages()
 
       // Flip back-buffers to real displays.
       flipAllDisplays();
+
+      paintPending = false;
+      lastPaintTick = base::current_tick();
     }
   }
 }
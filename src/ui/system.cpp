@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -28,6 +28,7 @@
 #include "ui/theme.h"
 #include "ui/widget.h"
 
+#include <algorithm>
 #include <thread>
 
 namespace ui {
@@ -39,6 +40,9 @@ std::thread::id main_gui_thread;
 // Multiple displays (create one os::Window for each ui::Window)
 bool multi_displays = false;
 
+// Frame pacing of Manager::dispatchMessages()
+static int max_paint_rate = 0;
+
 // Current mouse cursor type.
 static CursorType mouse_cursor_type = kOutsideDisplay;
 static const Cursor* mouse_cursor_custom = nullptr;
@@ -266,6 +270,16 @@ bool get_multiple_displays()
   return multi_displays;
 }
 
+void set_max_paint_rate(int fps)
+{
+  max_paint_rate = std::max(0, fps);
+}
+
+int get_max_paint_rate()
+{
+  return max_paint_rate;
+}
+
 void set_clipboard_text(const std::string& text)
 {
   ASSERT(g_instance);
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -43,6 +43,11 @@ namespace ui {
   void set_multiple_displays(bool multi);
   bool get_multiple_displays();
 
+  // Maximum number of times per second that displays are painted (0
+  // to paint after each group of processed messages).
+  void set_max_paint_rate(int fps);
+  int get_max_paint_rate();
+
   void set_clipboard_text(const std::string& text);
   bool get_clipboard_text(std::string& text);
 
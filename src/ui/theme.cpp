@@ -16,6 +16,7 @@
 #include "os/font.h"
 #include "os/surface.h"
 #include "os/system.h"
+#include "ui/graphics.h"
 #include "ui/intern.h"
 #include "ui/manager.h"
 #include "ui/paint_event.h"
@@ -777,6 +778,9 @@ void Theme::calcWidgetMetrics(const Widget* widget,
 
 void set_theme(Theme* theme, const int uiscale)
 {
+  // Fonts can be replaced/rescaled, so cached text runs are useless
+  Graphics::clearTextCache();
+
   old_ui_scale = current_ui_scale;
   current_ui_scale = uiscale;
 
@@ -49,6 +49,35 @@ namespace ui {
 
 using namespace gfx;
 
+namespace {
+
+// Size hints are cached during a layout pass (the outermost
+// setBounds() or sizeHint() call), so the hint of each widget is
+// calculated just once per pass instead of once for each ancestor
+// that asks for it. Changes in a widget that could modify its size
+// hint (text, visibility, children, bounds, etc.) discard the cached
+// hints of the widget and its ancestors.
+int g_layoutPassDepth = 0;
+int g_layoutPass = 0;           // 0 = we're not in a layout pass
+int g_lastLayoutPass = 0;
+
+class LayoutPass {
+public:
+  LayoutPass() {
+    if (g_layoutPassDepth++ == 0) {
+      if (++g_lastLayoutPass <= 0)
+        g_lastLayoutPass = 1;
+      g_layoutPass = g_lastLayoutPass;
+    }
+  }
+  ~LayoutPass() {
+    if (--g_layoutPassDepth == 0)
+      g_layoutPass = 0;
+  }
+};
+
+} // anonymous namespace
+
 WidgetType register_widget_type()
 {
   static int type = (int)kFirstUserWidget;
@@ -66,6 +95,7 @@ Widget::Widget(WidgetType type)
   , m_parent(nullptr)
   , m_parentIndex(-1)
   , m_sizeHint(nullptr)
+  , m_sizeHintCachePass(0)
   , m_mnemonic(0)
   , m_minSize(0, 0)
   , m_maxSize(std::numeric_limits<int>::max(),
@@ -118,6 +148,7 @@ void Widget::initTheme()
 {
   InitThemeEvent ev(this, m_theme);
   onInitTheme(ev);
+  invalidateSizeHintCache();
 }
 
 int Widget::textInt() const
@@ -160,6 +191,7 @@ void Widget::setTextQuiet(const std::string& text)
 
   m_text = text;
   enableFlags(HAS_TEXT);
+  invalidateSizeHintCache();
 }
 
 os::Font* Widget::font() const
@@ -190,6 +222,7 @@ void Widget::setTheme(Theme* theme)
 
   m_theme = theme;
   m_font = nullptr;
+  invalidateSizeHintCache();
 
   for (auto child : children())
     child->setTheme(theme);
@@ -208,6 +241,7 @@ void Widget::setStyle(Style* style)
   m_maxSize = m_theme->calcMaxSize(this, style);
   if (style->font())
     m_font = AddRef(style->font());
+  invalidateSizeHintCache();
 }
 
 // ===============================================================
@@ -221,6 +255,7 @@ void Widget::setVisible(bool state)
   if (state) {
     if (hasFlags(HIDDEN)) {
       disableFlags(HIDDEN);
+      invalidateSizeHintCache();
       invalidate();
 
       onVisible(true);
@@ -231,6 +266,7 @@ void Widget::setVisible(bool state)
       if (auto man = manager())
         man->freeWidget(this); // Free from manager
       enableFlags(HIDDEN);
+      invalidateSizeHintCache();
 
       onVisible(false);
     }
@@ -562,6 +598,7 @@ void Widget::addChild(Widget* child)
   m_children.push_back(child);
   child->m_parent = this;
   child->m_parentIndex = i;
+  invalidateSizeHintCache();
 }
 
 void Widget::removeChild(const WidgetsList::iterator& it)
@@ -593,6 +630,7 @@ void Widget::removeChild(const WidgetsList::iterator& it)
 
   child->m_parent = nullptr;
   child->m_parentIndex = -1;
+  invalidateSizeHintCache();
 }
 
 void Widget::removeChild(Widget* child)
@@ -638,6 +676,7 @@ void Widget::replaceChild(Widget* oldChild, Widget* newChild)
 
   newChild->m_parent = this;
   newChild->m_parentIndex = index;
+  invalidateSizeHintCache();
 }
 
 void Widget::insertChild(int index, Widget* child)
@@ -655,6 +694,7 @@ void Widget::insertChild(int index, Widget* child)
 
   child->m_parent = this;
   child->m_parentIndex = index;
+  invalidateSizeHintCache();
 }
 
 void Widget::moveChildTo(Widget* thisChild, Widget* toThisPosition)
@@ -676,6 +716,7 @@ void Widget::moveChildTo(Widget* thisChild, Widget* toThisPosition)
   thisChild->m_parentIndex = to;
   for (++it, end=m_children.end(); it!=end; ++it)
     ++(*it)->m_parentIndex;
+  invalidateSizeHintCache();
 }
 
 // ===============================================================
@@ -770,6 +811,7 @@ void Widget::setBounds(const Rect& rc)
   if (is_app_state_closing())
     return;
 
+  LayoutPass pass;
   ResizeEvent ev(this, rc);
   onResize(ev);
 }
@@ -777,6 +819,10 @@ void Widget::setBounds(const Rect& rc)
 void Widget::setBoundsQuietly(const gfx::Rect& rc)
 {
   if (m_bounds != rc) {
+    // Some size hints depend on the current size of the widget
+    if (m_bounds.size() != rc.size())
+      invalidateSizeHintCache();
+
     m_bounds = rc;
 
     // Remove all paint messages for this widget.
@@ -793,6 +839,7 @@ void Widget::setBoundsQuietly(const gfx::Rect& rc)
 void Widget::setBorder(const Border& br)
 {
   m_border = br;
+  invalidateSizeHintCache();
 
 #ifdef _DEBUG
   if (m_style) {
@@ -805,6 +852,7 @@ void Widget::setBorder(const Border& br)
 void Widget::setChildSpacing(int childSpacing)
 {
   m_childSpacing = childSpacing;
+  invalidateSizeHintCache();
 
 #ifdef _DEBUG
   if (m_style) {
@@ -1034,6 +1082,7 @@ void Widget::setMinSize(const gfx::Size& sz)
   ASSERT(sz.w <= m_maxSize.w);
   ASSERT(sz.h <= m_maxSize.h);
   m_minSize = sz;
+  invalidateSizeHintCache();
 }
 
 void Widget::setMaxSize(const gfx::Size& sz)
@@ -1041,6 +1090,7 @@ void Widget::setMaxSize(const gfx::Size& sz)
   ASSERT(sz.w >= m_minSize.w);
   ASSERT(sz.h >= m_minSize.h);
   m_maxSize = sz;
+  invalidateSizeHintCache();
 }
 
 void Widget::setMinMaxSize(const gfx::Size& minSz,
@@ -1050,17 +1100,20 @@ void Widget::setMinMaxSize(const gfx::Size& minSz,
   ASSERT(minSz.h <= maxSz.h);
   m_minSize = minSz;
   m_maxSize = maxSz;
+  invalidateSizeHintCache();
 }
 
 void Widget::resetMinSize()
 {
   m_minSize = gfx::Size(0, 0);
+  invalidateSizeHintCache();
 }
 
 void Widget::resetMaxSize()
 {
   m_maxSize = gfx::Size(std::numeric_limits<int>::max(),
                         std::numeric_limits<int>::max());
+  invalidateSizeHintCache();
 }
 
 void Widget::flushRedraw()
@@ -1371,17 +1424,7 @@ void Widget::broadcastMouseMessage(const gfx::Point& screenPos,
 */
 Size Widget::sizeHint()
 {
-  if (m_sizeHint)
-    return *m_sizeHint;
-  else {
-    SizeHintEvent ev(this, Size(0, 0));
-    onSizeHint(ev);
-
-    Size sz(ev.sizeHint());
-    sz.w = std::clamp(sz.w, m_minSize.w, m_maxSize.w);
-    sz.h = std::clamp(sz.h, m_minSize.h, m_maxSize.h);
-    return sz;
-  }
+  return sizeHint(Size(0, 0));
 }
 
 /**
@@ -1403,12 +1446,22 @@ Size Widget::sizeHint(const Size& fitIn)
   if (m_sizeHint)
     return *m_sizeHint;
   else {
+    LayoutPass pass;
+    if (m_sizeHintCachePass == g_layoutPass &&
+        m_sizeHintCacheFitIn == fitIn) {
+      return m_sizeHintCache;
+    }
+
     SizeHintEvent ev(this, fitIn);
     onSizeHint(ev);
 
     Size sz(ev.sizeHint());
     sz.w = std::clamp(sz.w, m_minSize.w, m_maxSize.w);
     sz.h = std::clamp(sz.h, m_minSize.h, m_maxSize.h);
+
+    m_sizeHintCachePass = g_layoutPass;
+    m_sizeHintCacheFitIn = fitIn;
+    m_sizeHintCache = sz;
     return sz;
   }
 }
@@ -1421,6 +1474,7 @@ void Widget::setSizeHint(const Size& fixedSize)
 {
   delete m_sizeHint;
   m_sizeHint = new Size(fixedSize);
+  invalidateSizeHintCache();
 }
 
 void Widget::setSizeHint(int fixedWidth, int fixedHeight)
@@ -1433,6 +1487,7 @@ void Widget::resetSizeHint()
   if (m_sizeHint) {
     delete m_sizeHint;
     m_sizeHint = nullptr;
+    invalidateSizeHintCache();
   }
 }
 
@@ -1778,4 +1833,13 @@ void Widget::setDirtyFlag()
   }
 }
 
+void Widget::invalidateSizeHintCache()
+{
+  Widget* widget = this;
+  while (widget) {
+    widget->m_sizeHintCachePass = 0;
+    widget = widget->parent();
+  }
+}
+
 } // namespace ui
@@ -447,6 +447,7 @@ namespace ui {
     bool paintEvent(Graphics* graphics,
                     const bool isBg);
     void setDirtyFlag();
+    void invalidateSizeHintCache();
 
     WidgetType m_type;           // Widget's type
     std::string m_id;            // Widget's id
@@ -463,6 +464,12 @@ namespace ui {
     int m_parentIndex;            // Location/index of this widget in the parent's Widget::m_children vector
     gfx::Size* m_sizeHint;
 
+    // Last size hint calculated in the current layout pass (see
+    // LayoutPass in widget.cpp)
+    int m_sizeHintCachePass;
+    gfx::Size m_sizeHintCacheFitIn;
+    gfx::Size m_sizeHintCache;
+
     // Keyboard shortcut to access this widget like Alt+mnemonic.  If
     // kMnemonicModifiersMask bit is zero, it means that the mnemonic
     // can be used without Alt or Command key modifiers (useful for
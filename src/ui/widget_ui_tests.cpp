@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -9,6 +9,20 @@
 
 using namespace ui;
 
+namespace {
+
+class CountSizeHint : public Widget {
+public:
+  int count = 0;
+protected:
+  void onSizeHint(SizeHintEvent& ev) override {
+    ++count;
+    ev.setSizeHint(gfx::Size(int(text().size()), 1));
+  }
+};
+
+} // anonymous namespace
+
 TEST(Widget, ParentIndex)
 {
   Widget a, b, c, d, e;
@@ -55,3 +69,31 @@ TEST(Widget, ParentIndex)
   EXPECT_EQ(2, d.parentIndex());
   EXPECT_EQ(3, c.parentIndex());
 }
+
+TEST(Widget, SizeHintCache)
+{
+  Box outer(VERTICAL), inner(HORIZONTAL);
+  CountSizeHint leaf;
+  outer.addChild(&inner);
+  inner.addChild(&leaf);
+  leaf.setText("abc");
+
+  // The size hint of the leaf is calculated just once in the whole
+  // layout pass
+  outer.setBounds(gfx::Rect(0, 0, 10, 10));
+  EXPECT_EQ(1, leaf.count);
+  EXPECT_EQ(3, leaf.bounds().w);
+
+  // Outside a layout pass the size hint is always calculated
+  leaf.sizeHint();
+  EXPECT_EQ(2, leaf.count);
+
+  // Changes in the leaf are visible in the next layout pass
+  leaf.setText("abcde");
+  outer.setBounds(gfx::Rect(0, 0, 10, 10));
+  EXPECT_EQ(3, leaf.count);
+  EXPECT_EQ(5, leaf.bounds().w);
+
+  inner.removeChild(&leaf);
+  outer.removeChild(&inner);
+}
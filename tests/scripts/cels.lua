@@ -1,4 +1,4 @@
--- Copyright (C) 2020  Igara Studio S.A.
+-- Copyright (C) 2020-2024  Igara Studio S.A.
 -- Copyright (C) 2018  David Capello
 --
 -- This file is released under the terms of the MIT license.
@@ -84,3 +84,38 @@ do
   app.undo()
 
 end
+
+-- Layer cels/layers are reused while they're not modified
+do
+  local s = Sprite(4, 4)
+  s:newFrame()
+  s:newFrame()
+  local a = s.layers[1]
+  assert(rawequal(a, s.layers[1]))
+  assert(rawequal(a.cels, a.cels))
+  assert(rawequal(a.cels[1], s.cels[1]))
+
+  local cels = a.cels
+  assert(#cels == 3)
+  s:deleteCel(a, 2)
+  assert(#cels == 3)        -- Old list is not modified
+  assert(#a.cels == 2)
+  assert(a.cels[2].frameNumber == 3)
+
+  -- Moving a cel changes the order of the cels
+  a.cels[1].frameNumber = 2
+  a.cels[1].frameNumber = 1
+  local c = a.cels[2]
+  c.frameNumber = 2
+  assert(#a.cels == 2)
+  assert(a.cels[2] == c)
+  assert(a.cels[2].frameNumber == 2)
+
+  local layers = s.layers
+  local b = s:newLayer()
+  assert(#layers == 1)
+  assert(#s.layers == 2)
+  assert(s.layers[2] == b)
+  app.undo()
+  assert(#s.layers == 1)
+end
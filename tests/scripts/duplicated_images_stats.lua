@@ -0,0 +1,26 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+do
+  local spr = Sprite(8, 8)
+  local stats = spr.duplicatedImagesStats
+  assert(stats.images == 1)
+  assert(stats.duplicatedImages == 0)
+  assert(stats.duplicatedSize == 0)
+
+  local img = Image(spr.spec)
+  img:clear(Color(255, 0, 0))
+  spr:newEmptyFrame()
+  spr:newEmptyFrame()
+  spr:newCel(spr.layers[1], 1, img, Point(0, 0))
+  spr:newCel(spr.layers[1], 2, img, Point(0, 0))
+  spr:newCel(spr.layers[1], 3, img, Point(0, 0))
+
+  stats = spr.duplicatedImagesStats
+  assert(stats.images == 3)
+  assert(stats.duplicatedImages == 2)
+  assert(stats.size > 0)
+  assert(stats.duplicatedSize * 3 == stats.size * 2)
+end
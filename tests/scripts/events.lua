@@ -1,4 +1,4 @@
--- Copyright (C) 2021  Igara Studio S.A.
+-- Copyright (C) 2021-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -134,3 +134,20 @@ do
   s:close()
   app.events:off(onSiteChange)
 end
+
+-- Handlers run in a coroutine and can yield to continue their work
+-- later (without UI they continue immediately)
+do
+  local steps = 0
+  local listener = app.events:on('sitechange',
+    function()
+      for j=1,3 do
+        steps = steps + 1
+        coroutine.yield()
+      end
+    end)
+  local s = Sprite(32, 32)
+  expect_eq(3, steps)
+  app.events:off(listener)
+  s:close()
+end
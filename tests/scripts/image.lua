@@ -534,3 +534,65 @@ do
                     2, 3 })
 
 end
+
+-- Image:getPixels() and Image:setPixels()
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  array_to_pixels({ 0, 1, 2,
+                    3, 4, 5 }, img)
+  local pixels = img:getPixels()
+  assert(#pixels == 6)
+  for i=1,6 do assert(pixels[i] == i-1) end
+
+  pixels = img:getPixels(Rectangle(1, 0, 2, 2))
+  assert(#pixels == 4)
+  assert(pixels[1] == 1 and pixels[2] == 2 and
+         pixels[3] == 4 and pixels[4] == 5)
+  assert(not pcall(function() img:getPixels(Rectangle(2, 0, 2, 2)) end))
+
+  img:setPixels({ 9, 8, 7, 6 }, Rectangle(0, 0, 2, 2))
+  expect_img(img, { 9, 8, 2,
+                    7, 6, 5 })
+  assert(not pcall(function() img:setPixels({ 1, 2 }) end))
+  assert(not pcall(function() img:setPixels({ 1, 2, 3, 4, 5, "x" }) end))
+  expect_img(img, { 9, 8, 2,
+                    7, 6, 5 })
+
+  local rgb = Image(2, 1)
+  rgb:setPixels({ rgba(255, 0, 0), rgba(0, 0, 255, 128) })
+  expect_img(rgb, { rgba(255, 0, 0), rgba(0, 0, 255, 128) })
+
+  -- Changes in a cel image are undoable
+  local spr = Sprite(2, 2, ColorMode.INDEXED)
+  local cel = spr.cels[1]
+  cel.image:setPixels({ 1, 2, 3, 4 })
+  expect_img(cel.image, { 1, 2,
+                          3, 4 })
+  app.undo()
+  expect_img(cel.image, { 0, 0,
+                          0, 0 })
+end
+
+-- Image:histogram()
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  array_to_pixels({ 0, 1, 1,
+                    2, 1, 255 }, img)
+  local h = img:histogram()
+  expect_eq(1, h[0])
+  expect_eq(3, h[1])
+  expect_eq(1, h[2])
+  expect_eq(0, h[3])
+  expect_eq(1, h[255])
+
+  -- The histogram is updated when the image is modified
+  img:drawPixel(0, 0, 1)
+  h = img:histogram()
+  expect_eq(0, h[0])
+  expect_eq(4, h[1])
+
+  img:clear(2)
+  h = img:histogram()
+  expect_eq(0, h[1])
+  expect_eq(6, h[2])
+end
@@ -0,0 +1,94 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+local rgba = app.pixelColor.rgba
+
+-- Image:drawImages{}
+do
+  local a = Image(2, 2, ColorMode.INDEXED)
+  a:clear(1)
+  local b = Image(1, 1, ColorMode.INDEXED)
+  b:clear(2)
+
+  local img = Image(4, 3, ColorMode.INDEXED)
+  img:clear(0)
+  img:drawImages{ { image=a },
+                  { image=a, position=Point(2, 1) },
+                  { image=b, position={ 1, 1 } } }
+  expect_img(img, { 1, 1, 0, 0,
+                    1, 2, 1, 1,
+                    0, 0, 1, 1 })
+end
+
+-- Image:mapColors()
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  array_to_pixels({ 0, 1, 2,
+                    2, 1, 0 }, img)
+  img:mapColors({ [0]=2, [2]=0 })
+  expect_img(img, { 2, 1, 0,
+                    0, 1, 2 })
+
+  img:mapColors({ [1]=5 }, Rectangle(0, 1, 3, 1))
+  expect_img(img, { 2, 1, 0,
+                    0, 5, 2 })
+
+  local rgb = Image(2, 1)
+  rgb:drawPixel(0, 0, rgba(255, 0, 0))
+  rgb:drawPixel(1, 0, rgba(0, 0, 255))
+  rgb:mapColors({ [rgba(255, 0, 0)]=Color(0, 255, 0) })
+  expect_img(rgb, { rgba(0, 255, 0), rgba(0, 0, 255) })
+end
+
+-- Image:blendRect()
+do
+  local img = Image(3, 2)
+  img:clear(rgba(0, 0, 0, 255))
+  img:blendRect(Rectangle(1, 0, 5, 1), rgba(255, 255, 255, 255))
+  expect_img(img, { rgba(0, 0, 0), rgba(255, 255, 255), rgba(255, 255, 255),
+                    rgba(0, 0, 0), rgba(0, 0, 0), rgba(0, 0, 0) })
+end
+
+-- Changes in a cel image inside a transaction are undone in just one step
+do
+  local spr = Sprite(4, 2, ColorMode.INDEXED)
+  local img = spr.cels[1].image
+  local stamp = Image(1, 1, ColorMode.INDEXED)
+  stamp:clear(3)
+
+  app.transaction(
+    function()
+      for x=0,3 do
+        img:drawImage(stamp, Point(x, 0))
+      end
+      img:mapColors({ [3]=4 }, Rectangle(0, 0, 2, 1))
+      spr.cels[1].image:drawImages{ { image=stamp, position=Point(3, 1) } }
+    end)
+
+  expect_img(img, { 4, 4, 3, 3,
+                    0, 0, 0, 3 })
+  app.undo()
+  expect_img(img, { 0, 0, 0, 0,
+                    0, 0, 0, 0 })
+  app.redo()
+  expect_img(img, { 4, 4, 3, 3,
+                    0, 0, 0, 3 })
+
+  -- Changes are undone in order when other commands modify the image
+  -- in the middle of the transaction
+  app.transaction(
+    function()
+      img:drawImage(stamp, Point(1, 1))
+      img:flip(FlipType.HORIZONTAL)
+      img:drawImage(stamp, Point(0, 0))
+    end)
+  expect_img(img, { 3, 3, 4, 4,
+                    3, 0, 3, 0 })
+  app.undo()
+  expect_img(img, { 4, 4, 3, 3,
+                    0, 0, 0, 3 })
+end
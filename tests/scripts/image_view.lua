@@ -0,0 +1,117 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+local rgba = app.pixelColor.rgba
+
+-- Get/set pixels by index and by (x, y)
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  local v = img:view()
+  assert(v.width == 3)
+  assert(v.height == 2)
+  assert(v.bounds == Rectangle(0, 0, 3, 2))
+  assert(v.colorMode == ColorMode.INDEXED)
+  assert(v.modified.isEmpty)
+
+  for i=0,5 do v:set(i, i) end
+  expect_img(img, { 0, 1, 2,
+                    3, 4, 5 })
+  assert(v:get(4) == 4)
+  assert(v:get(2, 1) == 5)
+  v:set(0, 1, 9)
+  assert(img:getPixel(0, 1) == 9)
+  assert(v.modified == Rectangle(0, 0, 3, 2))
+
+  -- Bounds checks
+  assert(not pcall(function() v:get(6) end))
+  assert(not pcall(function() v:get(-1) end))
+  assert(not pcall(function() v:set(3, 0, 1) end))
+end
+
+-- View of a part of the image
+do
+  local img = Image(4, 4, ColorMode.INDEXED)
+  img:clear(0)
+  local v = img:view(Rectangle(1, 1, 2, 2))
+  assert(v.width == 2)
+  assert(v.height == 2)
+  v:set(0, 0, 1)
+  v:fill(2, Rectangle(1, 0, 5, 5))
+  expect_img(img, { 0, 0, 0, 0,
+                    0, 1, 2, 0,
+                    0, 0, 2, 0,
+                    0, 0, 0, 0 })
+  assert(v.modified == Rectangle(1, 1, 2, 2))
+
+  -- copyFrom() between views of the same image
+  local src = img:view(Rectangle(1, 1, 2, 2))
+  local dst = img:view(Rectangle(2, 2, 2, 2))
+  dst:copyFrom(src)
+  expect_img(img, { 0, 0, 0, 0,
+                    0, 1, 2, 0,
+                    0, 0, 1, 2,
+                    0, 0, 0, 2 })
+end
+
+-- copyFrom() between different images
+do
+  local a = Image(2, 2)
+  local b = Image(3, 3)
+  a:view():fill(rgba(255, 0, 0))
+  b:clear(0)
+  b:view():copyFrom(a:view(), Point(1, 1))
+  expect_img(b, { 0, 0, 0,
+                  0, rgba(255, 0, 0), rgba(255, 0, 0),
+                  0, rgba(255, 0, 0), rgba(255, 0, 0) })
+
+  local c = Image(2, 2, ColorMode.GRAYSCALE)
+  assert(not pcall(function() c:view():copyFrom(a:view()) end))
+end
+
+-- Changes in a cel image are undone with just one undo step
+do
+  local spr = Sprite(4, 4, ColorMode.INDEXED)
+  local cel = spr.cels[1]
+  cel.image:clear(0)
+  local v = cel.image:view()
+  for i=0,15 do v:set(i, 3) end
+  v:fill(5, Rectangle(0, 0, 2, 2))
+  v:commit()
+  assert(v.modified.isEmpty)
+  expect_img(cel.image, { 5, 5, 3, 3,
+                          5, 5, 3, 3,
+                          3, 3, 3, 3,
+                          3, 3, 3, 3 })
+  app.undo()
+  expect_img(cel.image, { 0, 0, 0, 0,
+                          0, 0, 0, 0,
+                          0, 0, 0, 0,
+                          0, 0, 0, 0 })
+  app.redo()
+  assert(cel.image:getPixel(0, 0) == 5)
+  assert(cel.image:getPixel(3, 3) == 3)
+end
+
+-- Changes in cel images are applied only by commit(), uncommitted
+-- changes are dropped when the view is garbage collected
+do
+  local spr = Sprite(2, 2, ColorMode.INDEXED)
+  local cel = spr.cels[1]
+  cel.image:clear(1)
+  do
+    local v = cel.image:view()
+    v:fill(4)
+    v:set(1, 1, 7)
+    assert(v:get(0, 0) == 4)
+    assert(v:get(1, 1) == 7)
+    expect_img(cel.image, { 1, 1,
+                            1, 1 })
+  end
+  collectgarbage()
+  expect_img(cel.image, { 1, 1,
+                          1, 1 })
+end
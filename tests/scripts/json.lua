@@ -1,4 +1,4 @@
--- Copyright (C) 2023  Igara Studio S.A.
+-- Copyright (C) 2023-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -101,3 +101,57 @@ do
 
   assert(tostring(o) == '{"a": [10, 20, 30, 40], "b": {"c": 1, "d": 2}}')
 end
+
+-- Parse directly to Lua tables
+do
+  local o = json.parse('{"a":true,"b":5,"c":[1,3.5,"x"],"d":{"e":null},' ..
+                       '"f":"\\u00e9\\n\\"", "g":[]}')
+  assert(type(o) == "table")
+  assert(o.a == true)
+  assert(o.b == 5 and math.type(o.b) == "integer")
+  assert(#o.c == 3)
+  assert(o.c[1] == 1)
+  assert(o.c[2] == 3.5)
+  assert(o.c[3] == "x")
+  assert(type(o.d) == "table" and o.d.e == nil)
+  assert(o.f == "\u{e9}\n\"")
+  assert(type(o.g) == "table" and #o.g == 0)
+
+  assert(json.parse('"hi"') == "hi")
+  assert(json.parse(' 2.5e1 ') == 25)
+
+  assert(not pcall(function() json.parse('[1,]') end))
+  assert(not pcall(function() json.parse('{"a" 1}') end))
+  assert(not pcall(function() json.parse('[1] 2') end))
+  assert(not pcall(function() json.parse('01') end))
+end
+
+-- Round trip between Lua tables and files
+do
+  local t = { name="sprite", frames={}, tags={ { from=1, to=10 } } }
+  for i=1,1000 do
+    t.frames[i] = { duration=i*0.5, file="frame" .. i .. ".png" }
+  end
+  local str = json.encode(t)
+  assert(json.encode(json.parse(str)) == str)
+
+  local fn = "_test_json.json"
+  local f = io.open(fn, "wb")
+  f:write(str)
+  f:close()
+  local u = json.parseFile(fn)
+  os.remove(fn)
+
+  assert(u.name == "sprite")
+  assert(#u.frames == 1000)
+  assert(u.frames[1000].duration == 500)
+  assert(u.frames[1000].file == "frame1000.png")
+  assert(u.tags[1].from == 1 and u.tags[1].to == 10)
+end
+
+-- Encode special strings and numbers
+do
+  assert(json.encode({ "a\"b\\c\n\1" }) == '["a\\"b\\\\c\\n\\u0001"]')
+  assert(json.encode({ 1, 1.5, 1/0 }) == '[1, 1.5, null]')
+  assert(json.encode({ [1]="a", [3]="b" }) == '{"1": "a", "3": "b"}')
+end
@@ -0,0 +1,52 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+local function fill(img)
+  for y=0,img.height-1 do
+    for x=0,img.width-1 do
+      img:drawPixel(x, y, x+y)
+    end
+  end
+end
+
+assert(not app.profiler.isRunning)
+app.profiler.start()
+assert(app.profiler.isRunning)
+
+local img = Image(32, 32, ColorMode.INDEXED)
+for i=1,4 do
+  fill(img)
+end
+
+-- Errors inside pcall() don't break the call stack
+assert(not pcall(function() error("error") end))
+fill(img)
+
+app.profiler.stop()
+assert(not app.profiler.isRunning)
+
+local report = app.profiler.report()
+assert(report:find("Image:drawPixel", 1, true))
+assert(report:find("fill", 1, true))
+
+-- Only one function in the report
+local lines = 0
+for _ in app.profiler.report(1):gmatch("[^\n]+") do
+  lines = lines + 1
+end
+assert(lines == 2)
+
+-- Folded stacks
+local fn = "_profile.txt"
+app.profiler.save(fn)
+local found = false
+for line in io.lines(fn) do
+  assert(line:match("^.+ %d+$"))
+  if line:find("fill", 1, true) and line:find("Image:drawPixel", 1, true) then
+    found = true
+  end
+end
+os.remove(fn)
+assert(found)
@@ -0,0 +1,20 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+do
+  local spr = Sprite(32, 32)
+  local mem = spr.memoryUsage
+  assert(mem.images >= 32*32*4)
+  assert(mem.tilesets == 0)
+  assert(mem.total == mem.images + mem.tilesets + mem.undoHistory +
+                      mem.renderCache + mem.thumbnails)
+
+  local images = mem.images
+  spr:newCel(spr.layers[1], 1, Image(64, 64), Point(0, 0))
+  assert(spr.memoryUsage.images > images)
+
+  -- The undo history uses memory too
+  assert(spr.memoryUsage.undoHistory > 0)
+end
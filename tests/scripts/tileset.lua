@@ -1,4 +1,4 @@
--- Copyright (C) 2022-2023  Igara Studio S.A.
+-- Copyright (C) 2022-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -321,3 +321,65 @@ do
   ts = spr:newTileset()
   assert(ts.grid.tileSize == Size(3, 4))
 end
+
+-- Sprite:newTiles(), Tileset:findTile(), and tilemap Image:getPixels/setPixels()
+do
+  local spr = Sprite(4, 4, ColorMode.INDEXED)
+  spr.gridBounds = Rectangle(0, 0, 2, 2)
+  app.command.NewLayer{ tilemap=true }
+  local tilemap = spr.layers[2]
+  local tileset = tilemap.tileset
+  assert(#tileset == 1)
+
+  local a = Image(2, 2, ColorMode.INDEXED)
+  local b = Image(2, 2, ColorMode.INDEXED)
+  local empty = Image(2, 2, ColorMode.INDEXED)
+  array_to_pixels({ 1, 1, 0, 0 }, a)
+  array_to_pixels({ 2, 0, 0, 2 }, b)
+  empty:clear(0)
+
+  local tiles = spr:newTiles(tileset, { a, b, a:clone(), empty })
+  assert(#tiles == 4)
+  assert(tiles[1] == 1 and tiles[2] == 2 and tiles[3] == 1 and tiles[4] == 0)
+  assert(#tileset == 3)
+  expect_img(tileset:getTile(1), { 1, 1, 0, 0 })
+  expect_img(tileset:getTile(2), { 2, 0, 0, 2 })
+
+  -- Just one undo step
+  app.undo()
+  assert(#tileset == 1)
+  app.redo()
+  assert(#tileset == 3)
+
+  assert(tileset:findTile(b) == 2)
+  assert(tileset:findTile(empty) == 0)
+  local c = Image(2, 2, ColorMode.INDEXED)
+  c:clear(3)
+  assert(tileset:findTile(c) == nil)
+  assert(tileset:findTile(Image(3, 3, ColorMode.INDEXED)) == nil)
+
+  -- Add repeated tiles
+  tiles = spr:newTiles(tileset, { a }, false)
+  assert(tiles[1] == 3)
+  assert(#tileset == 4)
+  assert(not pcall(function() spr:newTiles(tileset, { Image(3, 3) }) end))
+
+  -- Read/write tiles in a tilemap cel
+  app.useTool{ tool="pencil",
+               color=1,
+               layer=tilemap,
+               tilesetMode=TilesetMode.AUTO,
+               tilemapMode=TilemapMode.PIXELS,
+               points={ Point(0, 0), Point(3, 3) }}
+  local map = tilemap:cel(1).image
+  assert(map.colorMode == ColorMode.TILEMAP)
+  assert(map.width == 2 and map.height == 2)
+  local before = map:getPixels()
+
+  map:setPixels({ 1, 2, 0, 1 })
+  local after = map:getPixels()
+  assert(after[1] == 1 and after[2] == 2 and after[3] == 0 and after[4] == 1)
+  app.undo()
+  after = map:getPixels()
+  for i=1,4 do assert(after[i] == before[i]) end
+end
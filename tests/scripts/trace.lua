@@ -0,0 +1,34 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+do
+  local fn = "_test_trace.json"
+  local pngFn = "_test_trace.png"
+
+  app.startTrace()
+  local spr = Sprite(32, 32)
+  spr:saveAs(pngFn)
+  spr:close()
+  assert(app.stopTrace(fn) == true)
+  os.remove(pngFn)
+
+  local trace = json.parseFile(fn)
+  os.remove(fn)
+
+  local found = false
+  for _,event in ipairs(trace.traceEvents) do
+    assert(event.ph == "X")
+    assert(event.dur >= 0)
+    if event.name == "file save" then
+      found = true
+    end
+  end
+  assert(found)
+
+  -- Zones are not recorded after stopping the trace
+  app.stopTrace()
+  app.startTrace(1)
+  app.stopTrace()
+end
@@ -0,0 +1,40 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+do
+  local spr = Sprite(32, 32)
+  local stats = spr.undoMemoryStats
+  assert(stats.totalSize == 0)
+  assert(#stats.states == 0)
+  assert(#stats.byType == 0)
+  assert(#stats.largeCommands == 0)
+
+  spr.layers[1].name = "Base"
+  app.useTool{ tool='pencil', color=Color(255, 0, 0), points={ Point(2, 2), Point(20, 20) } }
+  spr.width = 64
+
+  stats = spr.undoMemoryStats
+  assert(stats.totalSize > 0)
+  assert(#stats.states == 3)
+  assert(stats.states[1].age == 0)
+  assert(stats.states[3].age == 2)
+
+  -- Groups are sorted by size and the sum of all groups is the total
+  local total = 0
+  for i,group in ipairs(stats.byType) do
+    if i > 1 then
+      assert(stats.byType[i-1].size >= group.size)
+    end
+    assert(group.count > 0)
+    total = total + group.size
+  end
+  assert(total == stats.totalSize)
+
+  local base = false
+  for _,group in ipairs(stats.byLayer) do
+    if group.name == "Base" then base = true end
+  end
+  assert(base)
+end
@@ -0,0 +1,99 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+-- Values are copied to/from the worker
+do
+  local messages = {}
+  local done
+  local w = Worker{
+    input={ a=1, b={ "x", 2.5, true } },
+    run=function(input)
+      postMessage(input.a)
+      postMessage(input.b[1])
+      return { sum=input.a + input.b[2], flag=input.b[3] }
+    end,
+    onmessage=function(msg) table.insert(messages, msg) end,
+    ondone=function(result) done = result end }
+
+  local result = w:wait()
+  assert(not w.isRunning)
+  assert(result.sum == 3.5)
+  assert(result.flag == true)
+  assert(done == result)
+  assert(#messages == 2)
+  assert(messages[1] == 1)
+  assert(messages[2] == "x")
+end
+
+-- Images are sent as copies
+do
+  local img = Image(3, 1, ColorMode.INDEXED)
+  array_to_pixels({ 1, 2, 3 }, img)
+  local w = Worker{
+    input=img,
+    run=function(img)
+      local out = Image(img.width, img.height, img.colorMode)
+      for x=0,img.width-1 do
+        out:drawPixel(x, 0, img:getPixel(img.width-1-x, 0) * 2)
+      end
+      img:clear(0)
+      return out
+    end }
+  local out = w:wait()
+  expect_img(out, { 6, 4, 2 })
+  expect_img(img, { 1, 2, 3 })
+  assert(out.colorMode == ColorMode.INDEXED)
+end
+
+-- Code as string
+do
+  local w = Worker{ input=21, run="local n = ... return n*2" }
+  assert(w:wait() == 42)
+end
+
+-- Errors
+do
+  local w = Worker{ run=function() error("worker error") end,
+                    onerror=function() end }
+  local ok, msg = pcall(function() return w:wait() end)
+  assert(not ok)
+  assert(msg:find("worker error"))
+
+  -- The worker cannot use upvalues or unsupported values
+  local x = 1
+  assert(not pcall(Worker, { run=function() return x end }))
+  assert(not pcall(Worker, { input=print, run=function() end }))
+
+  -- The worker doesn't have access to the app API or files
+  w = Worker{ run=function() return app == nil and io == nil and os == nil end }
+  assert(w:wait() == true)
+end
+
+-- Cancel a worker
+do
+  local w = Worker{ run=function() while true do end end,
+                    onerror=function() end }
+  w:cancel()
+  assert(not pcall(function() w:wait() end))
+end
+
+-- Workers cannot load binary chunks or use the debug library (only
+-- debug.traceback() is available)
+do
+  local w = Worker{
+    run=function()
+      local f = load("return 5")
+      local bin = string.dump(function() return 1 end)
+      return f() == 5 and
+             load(bin) == nil and
+             load(bin, "bin", "b") == nil and
+             debug.sethook == nil and
+             debug.getinfo == nil and
+             type(debug.traceback()) == "string"
+    end }
+  assert(w:wait() == true)
+end